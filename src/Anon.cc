@@ -1,9 +1,12 @@
 #include "zeek/Anon.h"
 
+#include <openssl/evp.h>
 #include <sys/time.h>
 #include <unistd.h>
+#include <algorithm>
 #include <cassert>
 #include <cstdlib>
+#include <cstring>
 
 #include "zeek/Event.h"
 #include "zeek/ID.h"
@@ -61,18 +64,53 @@ static int bi_ffs(uint32_t value)
 
 ipaddr32_t AnonymizeIPAddr::Anonymize(ipaddr32_t addr)
 	{
-	std::map<ipaddr32_t, ipaddr32_t>::iterator p = mapping.find(addr);
+	auto p = mapping.find(addr);
 	if ( p != mapping.end() )
 		return p->second;
 	else
 		{
 		ipaddr32_t new_addr = anonymize(addr);
-		mapping[addr] = new_addr;
+		mapping.emplace(addr, new_addr);
 
 		return new_addr;
 		}
 	}
 
+std::optional<IPAddr> AnonymizeIPAddr::Anonymize(const IPAddr& addr)
+	{
+	const uint32_t* bytes;
+	addr.GetBytes(&bytes);
+
+	if ( addr.GetFamily() == IPv4 )
+		{
+		ipaddr32_t new_addr = Anonymize(*bytes);
+		return IPAddr(IPv4, &new_addr, IPAddr::Network);
+		}
+
+	if ( ! SupportsIPv6() )
+		return std::nullopt;
+
+	std::string key(reinterpret_cast<const char*>(bytes), 16);
+	auto p = mapping6.find(key);
+
+	if ( p != mapping6.end() )
+		return p->second;
+
+	uint32_t new_bytes[4];
+	anonymize6(reinterpret_cast<const uint8_t*>(bytes), reinterpret_cast<uint8_t*>(new_bytes));
+
+	IPAddr new_addr(IPv6, new_bytes, IPAddr::Network);
+	mapping6.emplace(std::move(key), new_addr);
+
+	return new_addr;
+	}
+
+void AnonymizeIPAddr::AnonymizeBatch(const ipaddr32_t* addrs, ipaddr32_t* out, size_t n)
+	{
+	for ( size_t i = 0; i < n; ++i )
+		out[i] = Anonymize(addrs[i]);
+	}
+
 // Keep the specified prefix unchanged.
 bool AnonymizeIPAddr::PreservePrefix(ipaddr32_t /* input */, int /* num_bits */)
 	{
@@ -355,6 +393,123 @@ AnonymizeIPAddr_A50::Node* AnonymizeIPAddr_A50::find_node(ipaddr32_t a)
 	return nullptr;
 	}
 
+AnonymizeIPAddr_CryptoPAn::AnonymizeIPAddr_CryptoPAn(const uint8_t* key)
+	{
+	ctx = EVP_CIPHER_CTX_new();
+
+	if ( ! ctx || ! EVP_EncryptInit_ex(ctx, EVP_aes_128_ecb(), nullptr, key, nullptr) )
+		reporter->InternalError("cannot initialize AES for Crypto-PAn");
+
+	EVP_CIPHER_CTX_set_padding(ctx, 0);
+
+	int len;
+	EVP_EncryptUpdate(ctx, pad, &len, key + 16, sizeof(pad));
+	}
+
+AnonymizeIPAddr_CryptoPAn::~AnonymizeIPAddr_CryptoPAn()
+	{
+	EVP_CIPHER_CTX_free(ctx);
+	}
+
+ipaddr32_t AnonymizeIPAddr_CryptoPAn::anonymize(ipaddr32_t addr)
+	{
+	ipaddr32_t output;
+	AnonymizeBytes(reinterpret_cast<const uint8_t*>(&addr), sizeof(addr), 1,
+	               reinterpret_cast<uint8_t*>(&output));
+	return output;
+	}
+
+void AnonymizeIPAddr_CryptoPAn::anonymize6(const uint8_t* addr, uint8_t* out)
+	{
+	AnonymizeBytes(addr, 16, 1, out);
+	}
+
+void AnonymizeIPAddr_CryptoPAn::AnonymizeBatch(const ipaddr32_t* addrs, ipaddr32_t* out, size_t n)
+	{
+	// Enough addresses per encryption to keep the AES units busy,
+	// with the blocks still fitting into the L1 cache.
+	constexpr size_t CHUNK = 32;
+
+	std::vector<ipaddr32_t> todo;
+	std::vector<size_t> todo_index;
+
+	for ( size_t i = 0; i < n; ++i )
+		{
+		auto p = mapping.find(addrs[i]);
+
+		if ( p != mapping.end() )
+			out[i] = p->second;
+		else
+			{
+			todo.push_back(addrs[i]);
+			todo_index.push_back(i);
+			}
+		}
+
+	std::vector<ipaddr32_t> todo_out(todo.size());
+
+	for ( size_t i = 0; i < todo.size(); i += CHUNK )
+		AnonymizeBytes(reinterpret_cast<const uint8_t*>(&todo[i]), sizeof(ipaddr32_t),
+		               std::min(CHUNK, todo.size() - i),
+		               reinterpret_cast<uint8_t*>(&todo_out[i]));
+
+	for ( size_t i = 0; i < todo.size(); ++i )
+		{
+		out[todo_index[i]] = todo_out[i];
+		mapping.emplace(todo[i], todo_out[i]);
+		}
+	}
+
+void AnonymizeIPAddr_CryptoPAn::AnonymizeBytes(const uint8_t* addrs, int len, size_t n,
+                                               uint8_t* out)
+	{
+	int bits = len * 8;
+	size_t num_blocks = n * bits;
+
+	blocks.resize(num_blocks * 16);
+	encrypted.resize(num_blocks * 16);
+
+	// The block for bit i is the input's first i bits, followed by the
+	// pad's remaining ones.
+	for ( size_t a = 0; a < n; ++a )
+		{
+		const uint8_t* addr = addrs + a * len;
+
+		for ( int i = 0; i < bits; ++i )
+			{
+			uint8_t* b = &blocks[(a * bits + i) * 16];
+			int full = i / 8;
+			int rem = i % 8;
+
+			memcpy(b, addr, full);
+			memcpy(b + full, pad + full, 16 - full);
+
+			if ( rem )
+				{
+				uint8_t mask = static_cast<uint8_t>(0xff << (8 - rem));
+				b[full] = (addr[full] & mask) | (pad[full] & ~mask);
+				}
+			}
+		}
+
+	// One call for all blocks lets AES-NI, where OpenSSL finds it,
+	// pipeline them.
+	int encrypted_len;
+	EVP_EncryptUpdate(ctx, encrypted.data(), &encrypted_len, blocks.data(), blocks.size());
+
+	// Bit i of the output is bit i of the input, flipped by the most
+	// significant bit of block i's encryption.
+	for ( size_t a = 0; a < n; ++a )
+		{
+		uint8_t* o = out + a * len;
+		memmove(o, addrs + a * len, len);
+
+		for ( int i = 0; i < bits; ++i )
+			if ( encrypted[(a * bits + i) * 16] & 0x80 )
+				o[i / 8] ^= 0x80 >> (i % 8);
+		}
+	}
+
 static TableValPtr anon_preserve_orig_addr;
 static TableValPtr anon_preserve_resp_addr;
 static TableValPtr anon_preserve_other_addr;
@@ -367,6 +522,26 @@ void init_ip_addr_anonymizers()
 	ip_anonymizer[PREFIX_PRESERVING_A50] = new AnonymizeIPAddr_A50();
 	ip_anonymizer[PREFIX_PRESERVING_MD5] = new AnonymizeIPAddr_PrefixMD5();
 
+	std::string key;
+
+	if ( const auto& id = global_scope()->Find("cryptopan_key") )
+		key = id->GetVal()->AsStringVal()->ToStdString();
+
+	if ( key.size() != AnonymizeIPAddr_CryptoPAn::KEY_LEN )
+		{
+		if ( ! key.empty() )
+			reporter->Error("cryptopan_key must have %d bytes, using a random one",
+			                AnonymizeIPAddr_CryptoPAn::KEY_LEN);
+
+		key.clear();
+
+		while ( key.size() < AnonymizeIPAddr_CryptoPAn::KEY_LEN )
+			key.push_back(static_cast<char>(rand32()));
+		}
+
+	ip_anonymizer[PREFIX_PRESERVING_CRYPTOPAN] = new AnonymizeIPAddr_CryptoPAn(
+		reinterpret_cast<const uint8_t*>(key.data()));
+
 	auto id = global_scope()->Find("preserve_orig_addr");
 
 	if ( id )
@@ -383,55 +558,133 @@ void init_ip_addr_anonymizers()
 		anon_preserve_other_addr = cast_intrusive<TableVal>(id->GetVal());
 	}
 
-ipaddr32_t anonymize_ip(ipaddr32_t ip, enum ip_addr_anonymization_class_t cl)
+// Returns the anonymization method for a class of addresses, along with
+// the addresses of the class to leave as they are.
+static int anonymization_method(enum ip_addr_anonymization_class_t cl, TableVal** preserve_addr)
 	{
-	TableVal* preserve_addr = nullptr;
-	auto addr = make_intrusive<AddrVal>(ip);
-
-	int method = -1;
-
 	switch ( cl )
 		{
 		case ORIG_ADDR: // client address
-			preserve_addr = anon_preserve_orig_addr.get();
-			method = orig_addr_anonymization;
-			break;
+			*preserve_addr = anon_preserve_orig_addr.get();
+			return orig_addr_anonymization;
 
 		case RESP_ADDR: // server address
-			preserve_addr = anon_preserve_resp_addr.get();
-			method = resp_addr_anonymization;
-			break;
+			*preserve_addr = anon_preserve_resp_addr.get();
+			return resp_addr_anonymization;
 
 		default:
-			preserve_addr = anon_preserve_other_addr.get();
-			method = other_addr_anonymization;
-			break;
+			*preserve_addr = anon_preserve_other_addr.get();
+			return other_addr_anonymization;
 		}
+	}
+
+static bool preserve(TableVal* preserve_addr, const IPAddr& ip)
+	{
+	return preserve_addr && preserve_addr->Size() > 0 &&
+	       preserve_addr->FindOrDefault(make_intrusive<AddrVal>(ip));
+	}
+
+// Returns the anonymizer for a method, or null for keeping addresses.
+static AnonymizeIPAddr* anonymizer(int method)
+	{
+	if ( method < 0 || method >= NUM_ADDR_ANONYMIZATION_METHODS )
+		reporter->InternalError("invalid IP anonymization method");
+
+	if ( method == KEEP_ORIG_ADDR )
+		return nullptr;
+
+	if ( ! ip_anonymizer[method] )
+		reporter->InternalError("IP anonymizer not initialized");
+
+	return ip_anonymizer[method];
+	}
+
+ipaddr32_t anonymize_ip(ipaddr32_t ip, enum ip_addr_anonymization_class_t cl)
+	{
+	TableVal* preserve_addr = nullptr;
+	int method = anonymization_method(cl, &preserve_addr);
+	ipaddr32_t new_ip = ip;
+
+	if ( ! preserve(preserve_addr, IPAddr(IPv4, &ip, IPAddr::Network)) )
+		{
+		if ( auto anon = anonymizer(method) )
+			new_ip = anon->Anonymize(ip);
+		}
+
+#ifdef LOG_ANONYMIZATION_MAPPING
+	log_anonymization_mapping(ip, new_ip);
+#endif
+	return new_ip;
+	}
 
-	ipaddr32_t new_ip = 0;
+bool anonymize_ip(const IPAddr& ip, enum ip_addr_anonymization_class_t cl, IPAddr* out)
+	{
+	if ( ip.GetFamily() == IPv4 )
+		{
+		const uint32_t* bytes;
+		ip.GetBytes(&bytes);
+		ipaddr32_t new_ip = anonymize_ip(*bytes, cl);
+		*out = IPAddr(IPv4, &new_ip, IPAddr::Network);
+		return true;
+		}
 
-	if ( preserve_addr && preserve_addr->FindOrDefault(addr) )
-		new_ip = ip;
+	TableVal* preserve_addr = nullptr;
+	int method = anonymization_method(cl, &preserve_addr);
+	*out = ip;
 
-	else if ( method >= 0 && method < NUM_ADDR_ANONYMIZATION_METHODS )
+	if ( ! preserve(preserve_addr, ip) )
 		{
-		if ( method == KEEP_ORIG_ADDR )
-			new_ip = ip;
+		if ( auto anon = anonymizer(method) )
+			{
+			auto new_ip = anon->Anonymize(ip);
 
-		else if ( ! ip_anonymizer[method] )
-			reporter->InternalError("IP anonymizer not initialized");
+			if ( ! new_ip )
+				return false;
 
+			*out = *new_ip;
+			}
+		}
+
+#ifdef LOG_ANONYMIZATION_MAPPING
+	log_anonymization_mapping(ip, *out);
+#endif
+	return true;
+	}
+
+void anonymize_ips(const ipaddr32_t* ips, ipaddr32_t* out, size_t n,
+                   enum ip_addr_anonymization_class_t cl)
+	{
+	TableVal* preserve_addr = nullptr;
+	int method = anonymization_method(cl, &preserve_addr);
+	std::vector<ipaddr32_t> todo;
+	std::vector<size_t> todo_index;
+
+	for ( size_t i = 0; i < n; ++i )
+		{
+		if ( preserve(preserve_addr, IPAddr(IPv4, &ips[i], IPAddr::Network)) )
+			out[i] = ips[i];
 		else
-			new_ip = ip_anonymizer[method]->Anonymize(ip);
+			{
+			todo.push_back(ips[i]);
+			todo_index.push_back(i);
+			}
 		}
 
-	else
-		reporter->InternalError("invalid IP anonymization method");
+	if ( ! todo.empty() )
+		{
+		std::vector<ipaddr32_t> todo_out(todo);
+
+		if ( auto anon = anonymizer(method) )
+			anon->AnonymizeBatch(todo.data(), todo_out.data(), todo.size());
+
+		for ( size_t i = 0; i < todo.size(); ++i )
+			out[todo_index[i]] = todo_out[i];
+		}
 
 #ifdef LOG_ANONYMIZATION_MAPPING
-	log_anonymization_mapping(ip, new_ip);
+	for ( size_t i = 0; i < n; ++i )
+		log_anonymization_mapping(ips[i], out[i]);
 #endif
-	return new_ip;
 	}
 
 #ifdef LOG_ANONYMIZATION_MAPPING
@@ -443,6 +696,13 @@ void log_anonymization_mapping(ipaddr32_t input, ipaddr32_t output)
 		                  make_intrusive<AddrVal>(output));
 	}
 
+void log_anonymization_mapping(const IPAddr& input, const IPAddr& output)
+	{
+	if ( anonymization_mapping )
+		event_mgr.Enqueue(anonymization_mapping, make_intrusive<AddrVal>(input),
+		                  make_intrusive<AddrVal>(output));
+	}
+
 #endif
 
 	} // namespace zeek::detail
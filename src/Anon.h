@@ -11,9 +11,15 @@
 #pragma once
 
 #include <cstdint>
-#include <map>
+#include <optional>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
+#include "zeek/IPAddr.h"
+
+struct evp_cipher_ctx_st;
+
 namespace zeek::detail
 	{
 
@@ -34,6 +40,7 @@ enum ip_addr_anonymization_method_t
 	RANDOM_MD5,
 	PREFIX_PRESERVING_A50,
 	PREFIX_PRESERVING_MD5,
+	PREFIX_PRESERVING_CRYPTOPAN,
 	NUM_ADDR_ANONYMIZATION_METHODS,
 	};
 
@@ -49,6 +56,16 @@ public:
 
 	ipaddr32_t Anonymize(ipaddr32_t addr);
 
+	// Anonymizes an address of either family. Returns nothing for IPv6
+	// addresses if the method only supports IPv4.
+	std::optional<IPAddr> Anonymize(const IPAddr& addr);
+
+	// Anonymizes *n* addresses into *out*. Methods that can share work
+	// between addresses do so; the others handle them one by one.
+	virtual void AnonymizeBatch(const ipaddr32_t* addrs, ipaddr32_t* out, size_t n);
+
+	virtual bool SupportsIPv6() const { return false; }
+
 	virtual bool PreservePrefix(ipaddr32_t input, int num_bits);
 
 	virtual ipaddr32_t anonymize(ipaddr32_t addr) = 0;
@@ -56,7 +73,14 @@ public:
 	bool PreserveNet(ipaddr32_t input);
 
 protected:
-	std::map<ipaddr32_t, ipaddr32_t> mapping;
+	// Anonymizes an IPv6 address, for methods that support it. Both
+	// addresses are 16 bytes in network order.
+	virtual void anonymize6(const uint8_t* /* addr */, uint8_t* /* out */) { }
+
+	std::unordered_map<ipaddr32_t, ipaddr32_t> mapping;
+
+	// IPv6 addresses, keyed by their bytes.
+	std::unordered_map<std::string, IPAddr> mapping6;
 	};
 
 class AnonymizeIPAddr_Seq : public AnonymizeIPAddr
@@ -130,13 +154,60 @@ protected:
 	Node* find_node(ipaddr32_t);
 	};
 
+// Crypto-PAn, as described in "Prefix-Preserving IP Address Anonymization:
+// Measurement-based Security Evaluation and a New Cryptography-based
+// Scheme", by Xu et al (ICNP 2002). Each bit of the output is the input's
+// bit XORed with a bit of an AES encryption of the bits before it, so
+// addresses sharing a prefix map to addresses sharing a prefix of the
+// same length. The mapping depends only on the key, which makes it
+// consistent across runs and tools.
+class AnonymizeIPAddr_CryptoPAn : public AnonymizeIPAddr
+	{
+public:
+	// The key has KEY_LEN bytes: the AES-128 key, followed by the
+	// secret that the pad gets encrypted from.
+	static constexpr int KEY_LEN = 32;
+
+	explicit AnonymizeIPAddr_CryptoPAn(const uint8_t* key);
+	~AnonymizeIPAddr_CryptoPAn() override;
+
+	ipaddr32_t anonymize(ipaddr32_t addr) override;
+	void AnonymizeBatch(const ipaddr32_t* addrs, ipaddr32_t* out, size_t n) override;
+
+	bool SupportsIPv6() const override { return true; }
+
+protected:
+	void anonymize6(const uint8_t* addr, uint8_t* out) override;
+
+	// Anonymizes *n* addresses of *len* bytes each, with one encryption
+	// of all of their blocks.
+	void AnonymizeBytes(const uint8_t* addrs, int len, size_t n, uint8_t* out);
+
+	evp_cipher_ctx_st* ctx;
+	uint8_t pad[16];
+
+	// Reused buffers for the blocks to encrypt, and their encryptions.
+	std::vector<uint8_t> blocks;
+	std::vector<uint8_t> encrypted;
+	};
+
 // The global IP anonymizers.
 extern AnonymizeIPAddr* ip_anonymizer[NUM_ADDR_ANONYMIZATION_METHODS];
 
 void init_ip_addr_anonymizers();
 ipaddr32_t anonymize_ip(ipaddr32_t ip, enum ip_addr_anonymization_class_t cl);
 
+// Anonymizes an address of either family. Returns false if the class's
+// method doesn't support the address's family.
+bool anonymize_ip(const IPAddr& ip, enum ip_addr_anonymization_class_t cl, IPAddr* out);
+
+// Anonymizes *n* IPv4 addresses of one class into *out*, like
+// anonymize_ip() does for each of them.
+void anonymize_ips(const ipaddr32_t* ips, ipaddr32_t* out, size_t n,
+                   enum ip_addr_anonymization_class_t cl);
+
 #define LOG_ANONYMIZATION_MAPPING
 void log_anonymization_mapping(ipaddr32_t input, ipaddr32_t output);
+void log_anonymization_mapping(const IPAddr& input, const IPAddr& output);
 
 	} // namespace zeek::detail
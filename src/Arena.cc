@@ -0,0 +1,208 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/Arena.h"
+
+#include "zeek/zeek-config.h"
+
+#ifdef HAVE_JEMALLOC
+#ifdef __FreeBSD__
+#include <malloc_np.h>
+#else
+#include <jemalloc/jemalloc.h>
+#endif
+#endif
+
+#include <atomic>
+#include <new>
+#include <string>
+
+#include "zeek/3rdparty/doctest.h"
+#include "zeek/util.h"
+
+namespace zeek::detail
+	{
+
+namespace
+	{
+
+const char* arena_names[NUM_ARENAS] = {"default", "sessions", "reassembly", "values", "messages"};
+
+std::atomic<uint64_t> allocated_bytes[NUM_ARENAS];
+
+#ifdef HAVE_JEMALLOC
+
+// jemalloc's indices of our arenas, zero for the default one.
+unsigned arena_indices[NUM_ARENAS];
+
+bool create_arenas()
+	{
+	for ( int a = ARENA_DEFAULT + 1; a < NUM_ARENAS; ++a )
+		{
+		unsigned idx;
+		size_t len = sizeof(idx);
+
+		if ( mallctl("arenas.create", &idx, &len, nullptr, 0) != 0 )
+			{
+			// Stick with the default arena for all.
+			for ( auto& i : arena_indices )
+				i = 0;
+
+			return false;
+			}
+
+		arena_indices[a] = idx;
+		}
+
+	return true;
+	}
+
+bool have_arenas()
+	{
+	static const bool created = create_arenas();
+	return created;
+	}
+
+// A thread's caches for allocating from the arenas. The thread's automatic
+// cache would hand out memory of whatever arena got freed into it last,
+// so each arena needs one of its own.
+struct ThreadCaches
+	{
+	unsigned ids[NUM_ARENAS] = {};
+	bool created[NUM_ARENAS] = {};
+
+	// Allocations in destructors of static objects may come after the
+	// main thread's caches went away.
+	bool alive = true;
+
+	~ThreadCaches()
+		{
+		for ( int a = 0; a < NUM_ARENAS; ++a )
+			if ( created[a] )
+				mallctl("tcache.destroy", nullptr, nullptr, &ids[a], sizeof(ids[a]));
+
+		alive = false;
+		}
+	};
+
+thread_local ThreadCaches thread_caches;
+
+int arena_flags(Arena a)
+	{
+	if ( ! have_arenas() )
+		return 0;
+
+	auto& tc = thread_caches;
+
+	if ( ! tc.alive )
+		return MALLOCX_ARENA(arena_indices[a]) | MALLOCX_TCACHE_NONE;
+
+	if ( ! tc.created[a] )
+		{
+		size_t len = sizeof(tc.ids[a]);
+		tc.created[a] = mallctl("tcache.create", &tc.ids[a], &len, nullptr, 0) == 0;
+		}
+
+	return MALLOCX_ARENA(arena_indices[a]) |
+	       (tc.created[a] ? MALLOCX_TCACHE(tc.ids[a]) : MALLOCX_TCACHE_NONE);
+	}
+
+#endif
+
+	} // namespace
+
+void* arena_allocate(Arena a, size_t size)
+	{
+	if ( a == ARENA_DEFAULT )
+		return ::operator new(size);
+
+	// Neither allocator likes zero sizes.
+	if ( size == 0 )
+		size = 1;
+
+	allocated_bytes[a].fetch_add(size, std::memory_order_relaxed);
+
+#ifdef HAVE_JEMALLOC
+	if ( void* p = mallocx(size, arena_flags(a)) )
+		return p;
+
+	throw std::bad_alloc();
+#else
+	return ::operator new(size);
+#endif
+	}
+
+void arena_free(Arena a, void* p, size_t size)
+	{
+	if ( ! p )
+		return;
+
+	if ( a == ARENA_DEFAULT )
+		{
+		::operator delete(p);
+		return;
+		}
+
+	if ( size == 0 )
+		size = 1;
+
+	allocated_bytes[a].fetch_sub(size, std::memory_order_relaxed);
+
+#ifdef HAVE_JEMALLOC
+	sdallocx(p, size, arena_flags(a));
+#else
+	::operator delete(p);
+#endif
+	}
+
+void get_arena_stats(Arena a, ArenaStats* s)
+	{
+	s->name = arena_names[a];
+	s->allocated = allocated_bytes[a].load(std::memory_order_relaxed);
+	s->resident = 0;
+
+#ifdef HAVE_JEMALLOC
+	if ( a == ARENA_DEFAULT || ! have_arenas() )
+		return;
+
+	// The statistics only get refreshed when advancing the epoch.
+	uint64_t epoch = 1;
+	size_t len = sizeof(epoch);
+	mallctl("epoch", &epoch, &len, &epoch, len);
+
+	size_t resident;
+	len = sizeof(resident);
+
+	if ( mallctl(util::fmt("stats.arenas.%u.resident", arena_indices[a]), &resident, &len,
+	             nullptr, 0) == 0 )
+		s->resident = resident;
+#endif
+	}
+
+bool arenas_are_separate()
+	{
+#ifdef HAVE_JEMALLOC
+	return have_arenas();
+#else
+	return false;
+#endif
+	}
+
+TEST_CASE("arena accounting")
+	{
+	ArenaStats before, after;
+	get_arena_stats(ARENA_MESSAGES, &before);
+	CHECK(std::string(before.name) == "messages");
+
+	void* p = arena_allocate(ARENA_MESSAGES, 100);
+	void* q = arena_allocate(ARENA_MESSAGES, 0);
+	get_arena_stats(ARENA_MESSAGES, &after);
+	CHECK(after.allocated == before.allocated + 101);
+
+	arena_free(ARENA_MESSAGES, p, 100);
+	arena_free(ARENA_MESSAGES, q, 0);
+	arena_free(ARENA_MESSAGES, nullptr, 10);
+	get_arena_stats(ARENA_MESSAGES, &after);
+	CHECK(after.allocated == before.allocated);
+	}
+
+	} // namespace zeek::detail
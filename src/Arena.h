@@ -0,0 +1,85 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+// Separate heaps for the core's main consumers of memory.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace zeek::detail
+	{
+
+/**
+ * The heaps that the main subsystems allocate from. Objects whose
+ * lifetimes differ a lot, like connections living for minutes and the
+ * values of a single event, fragment each other's memory when they share
+ * a heap. When built with jemalloc, each of these gets an arena of its
+ * own, so that a subsystem's freed memory gets reused by the same
+ * subsystem and whole pages become free together. Otherwise they all
+ * come from the regular heap. Either way, the bytes allocated in each get
+ * counted, which tells where memory goes.
+ */
+enum Arena
+	{
+	ARENA_DEFAULT, ///< The regular heap, not counted.
+	ARENA_SESSIONS, ///< Connections, files and their analyzers.
+	ARENA_REASSEMBLY, ///< Data buffered for stream and file reassembly.
+	ARENA_VALUES, ///< Script values, strings and events.
+	ARENA_MESSAGES, ///< Messages to and from threads, like log writes.
+
+	// Terminal value. Add new above.
+	NUM_ARENAS,
+	};
+
+/**
+ * Allocates memory from an arena.
+ *
+ * @param a The arena.
+ *
+ * @param size The number of bytes, which may be zero.
+ *
+ * @return The memory, never null.
+ */
+void* arena_allocate(Arena a, size_t size);
+
+/**
+ * Frees memory that arena_allocate() returned, possibly in another
+ * thread.
+ *
+ * @param a The arena it came from.
+ *
+ * @param p The memory, or null for nothing to free.
+ *
+ * @param size The size it got allocated with.
+ */
+void arena_free(Arena a, void* p, size_t size);
+
+struct ArenaStats
+	{
+	const char* name;
+	uint64_t allocated; //< Bytes currently allocated from the arena.
+	uint64_t resident; //< Bytes of physical memory the arena holds, if known.
+	};
+
+/**
+ * Fills in statistics about an arena.
+ */
+void get_arena_stats(Arena a, ArenaStats* s);
+
+/**
+ * @return True if the arenas are separate heaps, rather than accounting
+ * over the regular one.
+ */
+bool arenas_are_separate();
+
+/**
+ * Defines class-specific operator new and delete that allocate from the
+ * given arena. Unlike with memory pools, objects may get freed by threads
+ * other than the one allocating them.
+ */
+#define ZEEK_ARENA_ALLOCATED(arena)                                                                \
+	static void* operator new(size_t size) { return zeek::detail::arena_allocate(arena, size); }  \
+	static void operator delete(void* p, size_t size) { zeek::detail::arena_free(arena, p, size); }
+
+	} // namespace zeek::detail
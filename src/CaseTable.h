@@ -0,0 +1,263 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+// Lookup tables for the case labels of switch statements, shared by the
+// interpreter and ZAM.
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace zeek::detail
+	{
+
+/**
+ * Maps the integer case labels of a switch statement to targets: the
+ * index of the case for the interpreter, the instruction to branch to for
+ * ZAM. Labels that cover their range densely enough get a jump table
+ * indexed by the value, others a sorted vector to bisect.
+ */
+template <typename T> class IntCaseTable
+	{
+public:
+	/**
+	 * Adds a label. Labels must be distinct; Build() must come after the
+	 * last one.
+	 */
+	void Insert(T v, int target) { entries.emplace_back(v, target); }
+
+	/**
+	 * Sets up the lookups after inserting the labels.
+	 */
+	void Build()
+		{
+		jump.clear();
+
+		if ( entries.empty() )
+			return;
+
+		std::sort(entries.begin(), entries.end());
+		min = entries.front().first;
+
+		// Spans that would take a lot more memory than the labels do
+		// stay with bisection.
+		auto span = static_cast<U>(entries.back().first) - static_cast<U>(min);
+
+		if ( span >= MAX_JUMP_SIZE || span >= 4 * entries.size() + 8 )
+			return;
+
+		jump.assign(span + 1, -1);
+
+		for ( const auto& [v, target] : entries )
+			jump[static_cast<U>(v) - static_cast<U>(min)] = target;
+		}
+
+	/**
+	 * @return The target of the label for a value, or the default.
+	 */
+	int Lookup(T v, int dflt) const
+		{
+		if ( ! jump.empty() )
+			{
+			// Values below the minimum wrap around past the end.
+			auto offset = static_cast<U>(v) - static_cast<U>(min);
+
+			if ( offset >= jump.size() || jump[offset] < 0 )
+				return dflt;
+
+			return jump[offset];
+			}
+
+		auto it = std::lower_bound(entries.begin(), entries.end(), v,
+		                           [](const auto& e, T x) { return e.first < x; });
+
+		return it != entries.end() && it->first == v ? it->second : dflt;
+		}
+
+	/**
+	 * @return True if lookups go through a jump table.
+	 */
+	bool IsDense() const { return ! jump.empty(); }
+
+	const std::vector<std::pair<T, int>>& Entries() const { return entries; }
+
+private:
+	using U = std::make_unsigned_t<T>;
+	static constexpr U MAX_JUMP_SIZE = 65536;
+
+	std::vector<std::pair<T, int>> entries;
+	std::vector<int> jump;
+	T min = 0;
+	};
+
+/**
+ * Maps the string case labels of a switch statement to targets, like
+ * IntCaseTable. The labels get a perfect hash function, found by hashing
+ * them into buckets and then searching each bucket for a displacement
+ * that moves its labels into free slots, so that a lookup hashes the
+ * value once and compares it to at most one label. Should that search
+ * fail, lookups bisect a sorted vector instead.
+ */
+class StrCaseTable
+	{
+public:
+	/**
+	 * Adds a label, like IntCaseTable::Insert().
+	 */
+	void Insert(std::string v, int target) { entries.emplace_back(std::move(v), target); }
+
+	/**
+	 * Sets up the lookups after inserting the labels.
+	 */
+	void Build()
+		{
+		std::sort(entries.begin(), entries.end());
+		slots.clear();
+		displacements.clear();
+
+		for ( size_t size = 1; size < 4 * entries.size() + 1; size *= 2 )
+			{
+			if ( size >= entries.size() && TryPerfectHash(size) )
+				return;
+			}
+
+		slots.clear();
+		displacements.clear();
+		}
+
+	/**
+	 * @return The target of the label for a value, or the default.
+	 */
+	int Lookup(const char* s, size_t len, int dflt) const
+		{
+		if ( ! slots.empty() )
+			{
+			auto h = Hash(s, len);
+			auto d = displacements[(h >> 32) & (displacements.size() - 1)];
+			auto e = slots[Slot(h, d)];
+
+			if ( e >= 0 && entries[e].first.size() == len &&
+			     memcmp(entries[e].first.data(), s, len) == 0 )
+				return entries[e].second;
+
+			return dflt;
+			}
+
+		std::string_view v(s, len);
+		auto it = std::lower_bound(entries.begin(), entries.end(), v,
+		                           [](const auto& e, std::string_view x) { return e.first < x; });
+
+		return it != entries.end() && it->first == v ? it->second : dflt;
+		}
+
+	int Lookup(std::string_view s, int dflt) const { return Lookup(s.data(), s.size(), dflt); }
+
+	/**
+	 * @return True if lookups go through the perfect hash.
+	 */
+	bool IsPerfect() const { return ! slots.empty(); }
+
+	const std::vector<std::pair<std::string, int>>& Entries() const { return entries; }
+
+private:
+	static uint64_t Hash(const char* s, size_t len)
+		{
+		// FNV-1a, with a final mix so that both halves are usable.
+		uint64_t h = 0xcbf29ce484222325ULL;
+
+		for ( size_t i = 0; i < len; ++i )
+			h = (h ^ static_cast<unsigned char>(s[i])) * 0x100000001b3ULL;
+
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdULL;
+		h ^= h >> 33;
+		return h;
+		}
+
+	size_t Slot(uint64_t h, uint32_t d) const
+		{
+		uint64_t x = (h ^ (d * 0x9e3779b97f4a7c15ULL)) * 0xc4ceb9fe1a85ec53ULL;
+		return (x >> 32) & (slots.size() - 1);
+		}
+
+	bool TryPerfectHash(size_t size)
+		{
+		static constexpr uint32_t MAX_DISPLACEMENT = 4096;
+
+		slots.assign(size, -1);
+
+		size_t num_buckets = 1;
+		while ( num_buckets * 4 < entries.size() )
+			num_buckets *= 2;
+
+		displacements.assign(num_buckets, 0);
+
+		std::vector<uint64_t> hashes;
+		std::vector<std::vector<int>> buckets(num_buckets);
+
+		for ( size_t i = 0; i < entries.size(); ++i )
+			{
+			const auto& k = entries[i].first;
+			hashes.push_back(Hash(k.data(), k.size()));
+			buckets[(hashes.back() >> 32) & (num_buckets - 1)].push_back(i);
+			}
+
+		// The largest buckets are the hardest to place, so go first.
+		std::vector<size_t> order(num_buckets);
+		for ( size_t i = 0; i < num_buckets; ++i )
+			order[i] = i;
+
+		std::stable_sort(order.begin(), order.end(),
+		                 [&](size_t a, size_t b) { return buckets[a].size() > buckets[b].size(); });
+
+		std::vector<size_t> placed;
+
+		for ( auto b : order )
+			{
+			uint32_t d = 0;
+
+			for ( ; d < MAX_DISPLACEMENT; ++d )
+				{
+				placed.clear();
+
+				for ( auto i : buckets[b] )
+					{
+					auto slot = Slot(hashes[i], d);
+
+					if ( slots[slot] >= 0 ||
+					     std::find(placed.begin(), placed.end(), slot) != placed.end() )
+						break;
+
+					placed.push_back(slot);
+					}
+
+				if ( placed.size() == buckets[b].size() )
+					break;
+				}
+
+			if ( d == MAX_DISPLACEMENT )
+				return false;
+
+			displacements[b] = d;
+
+			for ( size_t j = 0; j < placed.size(); ++j )
+				slots[placed[j]] = buckets[b][j];
+			}
+
+		return true;
+		}
+
+	std::vector<std::pair<std::string, int>> entries;
+
+	// Indices into entries, or -1 for free slots.
+	std::vector<int> slots;
+	std::vector<uint32_t> displacements;
+	};
+
+	} // namespace zeek::detail
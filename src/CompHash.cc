@@ -60,17 +60,189 @@ const HashkeyMapPtr ordered_hashkeys(const TableVal* tv)
 	return res;
 	}
 
+namespace
+	{
+
+// Accessors for the values of an index, for the fast path.
+struct ValIndex
+	{
+	// Either the list of values, or the single one.
+	const ListVal* list;
+	const Val* single;
+
+	const Val* Get(size_t i) const { return list ? list->Idx(i).get() : single; }
+
+	zeek_int_t Int(size_t i) const { return Get(i)->AsInt(); }
+	zeek_uint_t Unsigned(size_t i) const { return Get(i)->AsCount(); }
+	double Double(size_t i) const { return Get(i)->InternalDouble(); }
+	const IPAddr& Addr(size_t i) const { return Get(i)->AsAddr(); }
+	const String* Str(size_t i) const { return Get(i)->AsString(); }
+	};
+
+struct ZValIndex
+	{
+	const ZVal* vals;
+
+	zeek_int_t Int(size_t i) const { return vals[i].int_val; }
+	zeek_uint_t Unsigned(size_t i) const { return vals[i].uint_val; }
+	double Double(size_t i) const { return vals[i].double_val; }
+	const IPAddr& Addr(size_t i) const { return vals[i].addr_val->Get(); }
+	const String* Str(size_t i) const { return vals[i].string_val->AsString(); }
+	};
+
+	} // namespace
+
 CompositeHash::CompositeHash(TypeListPtr composite_type) : type(std::move(composite_type))
 	{
-	if ( type->GetTypes().size() == 1 )
+	const auto& tl = type->GetTypes();
+
+	if ( tl.size() == 1 )
 		is_singleton = true;
+
+	fast_path = true;
+
+	for ( const auto& t : tl )
+		{
+		auto it = t->InternalType();
+		internal_types.push_back(it);
+
+		if ( it != TYPE_INTERNAL_INT && it != TYPE_INTERNAL_UNSIGNED &&
+		     it != TYPE_INTERNAL_DOUBLE && it != TYPE_INTERNAL_ADDR && it != TYPE_INTERNAL_STRING )
+			fast_path = false;
+		}
+	}
+
+template <typename Index>
+std::unique_ptr<HashKey> CompositeHash::FastHashKey(const Index& index) const
+	{
+	auto hk = std::make_unique<HashKey>();
+	auto n = internal_types.size();
+
+	// Numbers go into the key itself for singletons, everything else
+	// needs its space reserved first.
+	bool reserve = ! is_singleton || internal_types[0] == TYPE_INTERNAL_ADDR ||
+	               internal_types[0] == TYPE_INTERNAL_STRING;
+
+	if ( reserve )
+		{
+		for ( size_t i = 0; i < n; ++i )
+			switch ( internal_types[i] )
+				{
+				case TYPE_INTERNAL_INT:
+					hk->ReserveType<zeek_int_t>("int");
+					break;
+
+				case TYPE_INTERNAL_UNSIGNED:
+					hk->ReserveType<zeek_int_t>("unsigned");
+					break;
+
+				case TYPE_INTERNAL_DOUBLE:
+					hk->ReserveType<double>("double");
+					break;
+
+				case TYPE_INTERNAL_ADDR:
+					hk->Reserve("addr", sizeof(uint32_t) * 4, sizeof(uint32_t));
+					break;
+
+				case TYPE_INTERNAL_STRING:
+					if ( ! is_singleton )
+						hk->ReserveType<int>("string-len");
+					hk->Reserve("string", index.Str(i)->Len());
+					break;
+
+				default:
+					break;
+				}
+
+		hk->Allocate();
+		}
+
+	for ( size_t i = 0; i < n; ++i )
+		switch ( internal_types[i] )
+			{
+			case TYPE_INTERNAL_INT:
+				hk->Write("int", index.Int(i));
+				break;
+
+			case TYPE_INTERNAL_UNSIGNED:
+				hk->Write("unsigned", index.Unsigned(i));
+				break;
+
+			case TYPE_INTERNAL_DOUBLE:
+				hk->Write("double", index.Double(i));
+				break;
+
+			case TYPE_INTERNAL_ADDR:
+				hk->AlignWrite(sizeof(uint32_t));
+				hk->EnsureWriteSpace(sizeof(uint32_t) * 4);
+				index.Addr(i).CopyIPv6(static_cast<uint32_t*>(hk->KeyAtWrite()));
+				hk->SkipWrite("addr", sizeof(uint32_t) * 4);
+				break;
+
+			case TYPE_INTERNAL_STRING:
+				{
+				const auto* s = index.Str(i);
+
+				if ( ! is_singleton )
+					hk->Write("string-len", s->Len());
+
+				hk->Write("string", s->Bytes(), s->Len());
+				break;
+				}
+
+			default:
+				break;
+			}
+
+	return hk;
+	}
+
+std::unique_ptr<HashKey> CompositeHash::MakeHashKey(const ZVal* vals) const
+	{
+	ASSERT(fast_path);
+	return FastHashKey(ZValIndex{vals});
 	}
 
 std::unique_ptr<HashKey> CompositeHash::MakeHashKey(const Val& argv, bool type_check) const
 	{
-	auto res = std::make_unique<HashKey>();
 	const auto& tl = type->GetTypes();
 
+	if ( fast_path )
+		{
+		ValIndex index{nullptr, &argv};
+
+		if ( argv.GetType()->Tag() == TYPE_LIST )
+			{
+			auto lv = argv.AsListVal();
+
+			if ( is_singleton )
+				{
+				if ( (type_check && lv->Length() != 1) || lv->Length() == 0 )
+					return nullptr;
+
+				index.single = lv->Idx(0).get();
+				}
+
+			else if ( static_cast<size_t>(lv->Length()) != tl.size() )
+				return nullptr;
+
+			else
+				index.list = lv;
+			}
+
+		else if ( ! is_singleton )
+			return nullptr;
+
+		if ( type_check )
+			for ( size_t i = 0; i < tl.size(); ++i )
+				if ( index.Get(i)->GetType()->InternalType() != internal_types[i] )
+					return nullptr;
+
+		return FastHashKey(index);
+		}
+
+	auto res = std::make_unique<HashKey>();
+
 	if ( is_singleton )
 		{
 		const Val* v = &argv;
@@ -115,6 +287,83 @@ std::unique_ptr<HashKey> CompositeHash::MakeHashKey(const Val& argv, bool type_c
 	return res;
 	}
 
+void CompositeHash::RecoverZVals(const HashKey& hk, const std::vector<bool>& wanted,
+                                 ZVal* vals) const
+	{
+	ASSERT(fast_path);
+
+	hk.ResetRead();
+
+	for ( size_t i = 0; i < internal_types.size(); ++i )
+		switch ( internal_types[i] )
+			{
+			case TYPE_INTERNAL_INT:
+				if ( wanted[i] )
+					hk.Read("int", vals[i].int_val);
+				else
+					{
+					hk.AlignRead(sizeof(zeek_int_t));
+					hk.SkipRead("int", sizeof(zeek_int_t));
+					}
+				break;
+
+			case TYPE_INTERNAL_UNSIGNED:
+				if ( wanted[i] )
+					hk.Read("unsigned", vals[i].uint_val);
+				else
+					{
+					hk.AlignRead(sizeof(zeek_uint_t));
+					hk.SkipRead("unsigned", sizeof(zeek_uint_t));
+					}
+				break;
+
+			case TYPE_INTERNAL_DOUBLE:
+				if ( wanted[i] )
+					hk.Read("double", vals[i].double_val);
+				else
+					{
+					hk.AlignRead(sizeof(double));
+					hk.SkipRead("double", sizeof(double));
+					}
+				break;
+
+			case TYPE_INTERNAL_ADDR:
+				hk.AlignRead(sizeof(uint32_t));
+				hk.EnsureReadSpace(sizeof(uint32_t) * 4);
+
+				if ( wanted[i] )
+					{
+					IPAddr addr(IPv6, static_cast<const uint32_t*>(hk.KeyAtRead()),
+					            IPAddr::Network);
+					vals[i].addr_val = val_mgr->Addr(addr).release();
+					}
+
+				hk.SkipRead("addr", sizeof(uint32_t) * 4);
+				break;
+
+			case TYPE_INTERNAL_STRING:
+				{
+				int n = hk.Size();
+
+				if ( ! is_singleton )
+					{
+					hk.Read("string-len", n);
+					hk.EnsureReadSpace(n);
+					}
+
+				if ( wanted[i] )
+					vals[i].string_val = new StringVal(
+						new String((const byte_vec)hk.KeyAtRead(), n, true));
+
+				hk.SkipRead("string", n);
+				break;
+				}
+
+			default:
+				reporter->InternalError("bad type in CompositeHash::RecoverZVals()");
+			}
+	}
+
 ListValPtr CompositeHash::RecoverVals(const HashKey& hk) const
 	{
 	auto l = make_intrusive<ListVal>(TYPE_ANY);
@@ -225,7 +474,7 @@ bool CompositeHash::RecoverOneVal(const HashKey& hk, Type* t, ValPtr* pval, bool
 			switch ( tag )
 				{
 				case TYPE_ADDR:
-					*pval = make_intrusive<AddrVal>(addr);
+					*pval = val_mgr->Addr(addr);
 					break;
 
 				default:
@@ -12,6 +12,7 @@ namespace zeek
 
 class ListVal;
 using ListValPtr = zeek::IntrusivePtr<ListVal>;
+union ZVal;
 
 	} // namespace zeek
 
@@ -29,10 +30,29 @@ public:
 	// or nullptr if it fails to typecheck.
 	std::unique_ptr<HashKey> MakeHashKey(const Val& v, bool type_check) const;
 
+	// True if all of the index types are numbers, addresses or strings,
+	// which the key can be computed from directly, without walking the
+	// types. MakeHashKey() then does so by itself.
+	bool HasFastPath() const { return fast_path; }
+
+	// Like MakeHashKey(), for index values given as ZVals, one for each
+	// of the index types. Requires HasFastPath().
+	std::unique_ptr<HashKey> MakeHashKey(const ZVal* vals) const;
+
 	// Given a hash key, recover the values used to create it.
 	ListValPtr RecoverVals(const HashKey& k) const;
 
+	// Like RecoverVals(), for keys computed with the fast path, recovering
+	// the values directly as ZVals. Skips over those that "wanted" is false
+	// for, leaving their ZVals alone. The caller takes over the references
+	// of recovered addresses and strings. Requires HasFastPath().
+	void RecoverZVals(const HashKey& k, const std::vector<bool>& wanted, ZVal* vals) const;
+
 protected:
+	// Computes a key with the fast path, getting the index values from
+	// the given accessor. Writes the same bytes as SingleValHash().
+	template <typename Index> std::unique_ptr<HashKey> FastHashKey(const Index& index) const;
+
 	bool SingleValHash(HashKey& hk, const Val* v, Type* bt, bool type_check, bool optional,
 	                   bool singleton) const;
 
@@ -68,6 +88,10 @@ protected:
 
 	TypeListPtr type;
 	bool is_singleton = false; // if just one type in index
+	bool fast_path = false;
+
+	// The internal types of the index types, for the fast path.
+	std::vector<InternalTypeTag> internal_types;
 	};
 
 	} // namespace zeek::detail
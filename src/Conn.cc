@@ -27,6 +27,7 @@ namespace zeek
 
 uint64_t Connection::total_connections = 0;
 uint64_t Connection::current_connections = 0;
+detail::MemoryPool Connection::pool("connection", detail::ARENA_SESSIONS);
 
 Connection::Connection(const detail::ConnKey& k, double t, const ConnTuple* id, uint32_t flow,
                        const Packet* pkt)
@@ -226,9 +227,9 @@ const RecordValPtr& Connection::GetVal()
 		TransportProto prot_type = ConnTransport();
 
 		auto id_val = make_intrusive<RecordVal>(id::conn_id);
-		id_val->Assign(0, make_intrusive<AddrVal>(orig_addr));
+		id_val->Assign(0, val_mgr->Addr(orig_addr));
 		id_val->Assign(1, val_mgr->Port(ntohs(orig_port), prot_type));
-		id_val->Assign(2, make_intrusive<AddrVal>(resp_addr));
+		id_val->Assign(2, val_mgr->Addr(resp_addr));
 		id_val->Assign(3, val_mgr->Port(ntohs(resp_port), prot_type));
 
 		auto orig_endp = make_intrusive<RecordVal>(id::endpoint);
@@ -473,4 +474,10 @@ bool Connection::PermitWeird(const char* name, uint64_t threshold, uint64_t rate
 	return detail::PermitWeird(weird_state, name, threshold, rate, duration);
 	}
 
+bool Connection::PermitWeird(detail::WeirdID id, uint64_t threshold, uint64_t rate,
+                             double duration)
+	{
+	return detail::PermitWeird(weird_state, id, threshold, rate, duration);
+	}
+
 	} // namespace zeek
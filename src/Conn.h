@@ -9,6 +9,7 @@
 
 #include "zeek/IPAddr.h"
 #include "zeek/IntrusivePtr.h"
+#include "zeek/MemoryPool.h"
 #include "zeek/Rule.h"
 #include "zeek/Tag.h"
 #include "zeek/Timer.h"
@@ -83,6 +84,10 @@ public:
 	           const Packet* pkt);
 	~Connection() override;
 
+	// Connections come and go at a high rate, so with memory pools
+	// enabled they're allocated from a dedicated pool.
+	ZEEK_POOL_ALLOCATED(pool)
+
 	/**
 	 * Invoked when an encapsulation is discovered. It records the encapsulation
 	 * with the connection and raises a "tunnel_changed" event if it's different
@@ -242,6 +247,7 @@ public:
 	uint32_t GetRespFlowLabel() { return resp_flow_label; }
 
 	bool PermitWeird(const char* name, uint64_t threshold, uint64_t rate, double duration);
+	bool PermitWeird(detail::WeirdID id, uint64_t threshold, uint64_t rate, double duration);
 
 private:
 	friend class session::detail::Timer;
@@ -277,6 +283,8 @@ private:
 	// Count number of connections.
 	static uint64_t total_connections;
 	static uint64_t current_connections;
+
+	static detail::MemoryPool pool;
 	};
 
 	} // namespace zeek
@@ -4,14 +4,121 @@
 
 #include "zeek/zeek-config.h"
 
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
 #include "zeek/Desc.h"
 #include "zeek/EquivClass.h"
 #include "zeek/Hash.h"
+#include "zeek/NetVar.h"
+#include "zeek/Reporter.h"
+#include "zeek/digest.h"
+#include "zeek/telemetry/Manager.h"
+#include "zeek/util.h"
 
 namespace zeek::detail
 	{
 
+namespace
+	{
+
+// Across all state caches, which matcher threads may grow concurrently.
+std::atomic<uint64_t> total_states = 0;
+std::atomic<uint64_t> total_mem = 0;
+
+// All machines, for reclaiming memory from others once the total exceeds
+// its budget, with the position we got to last time.
+std::vector<DFA_Machine*>& machines()
+	{
+	static auto* all = new std::vector<DFA_Machine*>();
+	return *all;
+	}
+
+size_t clock_hand = 0;
+
+// Guards the above. Recursive, as loading caches may reclaim memory.
+std::recursive_mutex& machines_mutex()
+	{
+	static auto* mutex = new std::recursive_mutex();
+	return *mutex;
+	}
+
+struct DFAMetrics
+	{
+	telemetry::IntGauge states = telemetry_mgr->GaugeInstance(
+		"zeek", "dfa-states", {}, "DFA states cached by all regular expressions");
+	telemetry::IntGauge mem = telemetry_mgr->GaugeInstance(
+		"zeek", "dfa-state-memory", {}, "Memory taken up by cached DFA states", "bytes");
+	telemetry::IntCounter flushes = telemetry_mgr->CounterInstance(
+		"zeek", "dfa-cache-flushes", {}, "DFA state caches flushed for exceeding their budget",
+		"1", true);
+
+	DFAMetrics()
+		{
+		states.Inc(total_states);
+		mem.Inc(total_mem);
+		}
+	};
+
+DFAMetrics* metrics()
+	{
+	static DFAMetrics* m = nullptr;
+
+	// Patterns get compiled before the telemetry manager exists, and
+	// destroyed after it's gone.
+	if ( ! telemetry_mgr )
+		return nullptr;
+
+	if ( ! m )
+		m = new DFAMetrics();
+
+	return m;
+	}
+
+uint64_t state_memory(DFA_State* s)
+	{
+	return util::pad_size(s->Size()) + padded_sizeof(*s);
+	}
+
+// Cache files start with the magic number, which also tells whether they
+// were written with the same byte order, and the format's version.
+constexpr uint32_t CACHE_MAGIC = 0x4146445a; // "ZDFA"
+constexpr uint32_t CACHE_VERSION = 1;
+
+// Machines with fewer states warm up quickly enough on their own.
+constexpr int MIN_CACHED_STATES = 8;
+
+// Transitions to no state at all in cache files.
+constexpr int32_t CACHE_JAM_STATE = -1;
+
+std::string cache_dir;
+
+template <typename T> void put(std::string* buf, T v)
+	{
+	buf->append(reinterpret_cast<const char*>(&v), sizeof(v));
+	}
+
+template <typename T> bool get(const std::string& buf, size_t* pos, T* v)
+	{
+	if ( buf.size() - *pos < sizeof(*v) )
+		return false;
+
+	memcpy(v, buf.data() + *pos, sizeof(*v));
+	*pos += sizeof(*v);
+	return true;
+	}
+
+	} // namespace
+
 unsigned int DFA_State::transition_counter = 0;
+bool DFA_Machine::locking = false;
 
 DFA_State::DFA_State(int arg_state_num, const EquivClass* ec, NFA_state_list* arg_nfa_states,
                      AcceptingSet* arg_accept)
@@ -21,6 +128,7 @@ DFA_State::DFA_State(int arg_state_num, const EquivClass* ec, NFA_state_list* ar
 	nfa_states = arg_nfa_states;
 	accept = arg_accept;
 	mark = nullptr;
+	retired = false;
 
 	SymPartition(ec);
 
@@ -43,6 +151,12 @@ void DFA_State::AddXtion(int sym, DFA_State* next_state)
 	xtions[sym] = next_state;
 	}
 
+void DFA_State::ClearXtions()
+	{
+	for ( int i = 0; i < num_sym; ++i )
+		xtions[i] = DFA_UNCOMPUTED_STATE_PTR;
+	}
+
 void DFA_State::SymPartition(const EquivClass* ec)
 	{
 	// Partitioning is done by creating equivalence classes for those
@@ -291,7 +405,8 @@ unsigned int DFA_State::Size()
 
 DFA_State_Cache::DFA_State_Cache()
 	{
-	hits = misses = 0;
+	hits = misses = flushes = 0;
+	mem = 0;
 	}
 
 DFA_State_Cache::~DFA_State_Cache()
@@ -299,12 +414,60 @@ DFA_State_Cache::~DFA_State_Cache()
 	for ( auto& entry : states )
 		{
 		assert(entry.second);
-		Unref(entry.second);
+		Remove(entry.second);
 		}
 
 	states.clear();
 	}
 
+uint64_t DFA_State_Cache::TotalMemory()
+	{
+	return total_mem;
+	}
+
+uint64_t DFA_State_Cache::TotalStates()
+	{
+	return total_states;
+	}
+
+void DFA_State_Cache::Remove(DFA_State* state)
+	{
+	uint64_t m = state_memory(state);
+	mem -= m;
+	total_mem -= m;
+	--total_states;
+
+	if ( auto* mx = metrics() )
+		{
+		mx->states.Dec();
+		mx->mem.Dec(m);
+		}
+
+	state->retired = true;
+	Unref(state);
+	}
+
+void DFA_State_Cache::Flush(DFA_State* keep)
+	{
+	for ( auto it = states.begin(); it != states.end(); )
+		{
+		if ( it->second == keep )
+			{
+			keep->ClearXtions();
+			++it;
+			continue;
+			}
+
+		Remove(it->second);
+		it = states.erase(it);
+		}
+
+	++flushes;
+
+	if ( auto* mx = metrics() )
+		mx->flushes.Inc();
+	}
+
 DFA_State* DFA_State_Cache::Lookup(const NFA_state_list& nfas, DigestStr* digest)
 	{
 	// We assume that state ID's don't exceed 10 digits, plus
@@ -352,9 +515,32 @@ DFA_State* DFA_State_Cache::Lookup(const NFA_state_list& nfas, DigestStr* digest
 DFA_State* DFA_State_Cache::Insert(DFA_State* state, DigestStr digest)
 	{
 	states.emplace(std::move(digest), state);
+
+	uint64_t m = state_memory(state);
+	mem += m;
+	total_mem += m;
+	++total_states;
+
+	if ( auto* mx = metrics() )
+		{
+		mx->states.Inc();
+		mx->mem.Inc(m);
+		}
+
 	return state;
 	}
 
+std::vector<DFA_State*> DFA_State_Cache::States() const
+	{
+	std::vector<DFA_State*> all;
+	all.reserve(states.size());
+
+	for ( const auto& entry : states )
+		all.push_back(entry.second);
+
+	return all;
+	}
+
 void DFA_State_Cache::GetStats(Stats* s)
 	{
 	s->dfa_states = 0;
@@ -364,6 +550,7 @@ void DFA_State_Cache::GetStats(Stats* s)
 	s->mem = 0;
 	s->hits = hits;
 	s->misses = misses;
+	s->flushes = flushes;
 
 	for ( const auto& state : states )
 		{
@@ -371,13 +558,14 @@ void DFA_State_Cache::GetStats(Stats* s)
 		++s->dfa_states;
 		s->nfa_states += e->NFAStateNum();
 		e->Stats(&s->computed, &s->uncomputed);
-		s->mem += util::pad_size(e->Size()) + padded_sizeof(*e);
+		s->mem += state_memory(e);
 		}
 	}
 
 DFA_Machine::DFA_Machine(NFA_Machine* n, EquivClass* arg_ec)
 	{
 	state_count = 0;
+	flush_pending = false;
 
 	nfa = n;
 	Ref(n);
@@ -386,6 +574,11 @@ DFA_Machine::DFA_Machine(NFA_Machine* n, EquivClass* arg_ec)
 
 	dfa_state_cache = new DFA_State_Cache();
 
+		{
+		std::lock_guard<std::recursive_mutex> lock(machines_mutex());
+		machines().push_back(this);
+		}
+
 	NFA_state_list* ns = new NFA_state_list;
 	ns->push_back(n->FirstState());
 
@@ -399,10 +592,19 @@ DFA_Machine::DFA_Machine(NFA_Machine* n, EquivClass* arg_ec)
 		start_state = nullptr; // Jam
 		delete ns;
 		}
+
+	if ( start_state && ! cache_dir.empty() )
+		LoadCache();
 	}
 
 DFA_Machine::~DFA_Machine()
 	{
+		{
+		std::lock_guard<std::recursive_mutex> lock(machines_mutex());
+		auto& all = machines();
+		all.erase(std::find(all.begin(), all.end(), this));
+		}
+
 	delete dfa_state_cache;
 	Unref(nfa);
 	}
@@ -446,6 +648,330 @@ bool DFA_Machine::StateSetToDFA_State(NFA_state_list* state_set, DFA_State*& d,
 	DFA_State* ds = new DFA_State(state_count++, ec, state_set, accept);
 	d = dfa_state_cache->Insert(ds, std::move(digest));
 
+	// We're likely in the middle of matching, so flushing our own cache
+	// has to wait until the next CheckBudget().
+	if ( dfa_state_memory_limit > 0 && dfa_state_cache->Memory() > dfa_state_memory_limit )
+		flush_pending = true;
+
+	if ( total_dfa_state_memory_limit > 0 && total_mem > total_dfa_state_memory_limit )
+		ReclaimMemory();
+
+	return true;
+	}
+
+void DFA_Machine::EnableLocking()
+	{
+	// The metrics get created on first use, which needs to happen here
+	// rather than on another thread.
+	metrics();
+	locking = true;
+	}
+
+void DFA_Machine::Flush()
+	{
+	flush_pending = false;
+	dfa_state_cache->Flush(start_state);
+	}
+
+void DFA_Machine::ReclaimMemory()
+	{
+	// Flush the other machines' caches in turn until we're within the
+	// budget again. Only this machine may be in the middle of matching
+	// on this thread, so theirs can go right away unless another thread
+	// is using them. If that's not enough, we need to give up our own
+	// states, too.
+	std::lock_guard<std::recursive_mutex> lock(machines_mutex());
+	auto& all = machines();
+
+	for ( size_t n = 0; n < all.size() && total_mem > total_dfa_state_memory_limit; ++n )
+		{
+		clock_hand = (clock_hand + 1) % all.size();
+		auto* m = all[clock_hand];
+
+		if ( m == this || m->dfa_state_cache->NumEntries() <= 1 )
+			continue;
+
+		if ( ! locking )
+			m->Flush();
+
+		else if ( m->mutex.try_lock() )
+			{
+			m->Flush();
+			m->mutex.unlock();
+			}
+		}
+
+	if ( total_mem > total_dfa_state_memory_limit )
+		flush_pending = true;
+	}
+
+DFA_State* DFA_Machine::Revive(const DFA_State* retired)
+	{
+	NFA_state_list* state_set = new NFA_state_list(*retired->NFAStates());
+
+	DFA_State* d;
+	if ( ! StateSetToDFA_State(state_set, d, ec) )
+		delete state_set;
+
+	return d;
+	}
+
+void DFA_Machine::UseCacheDirectory(const std::string& dir)
+	{
+	if ( ! dir.empty() && ! util::detail::ensure_dir(dir.c_str()) )
+		return;
+
+	cache_dir = dir;
+
+	if ( cache_dir.empty() )
+		return;
+
+	std::lock_guard<std::recursive_mutex> lock(machines_mutex());
+
+	for ( auto* m : machines() )
+		if ( m->start_state )
+			m->LoadCache();
+	}
+
+void DFA_Machine::SaveCaches()
+	{
+	if ( cache_dir.empty() )
+		return;
+
+	std::lock_guard<std::recursive_mutex> lock(machines_mutex());
+
+	for ( auto* m : machines() )
+		{
+		DFA_Lock machine_lock(m);
+
+		if ( m->NumStates() < MIN_CACHED_STATES || m->SaveCache() )
+			continue;
+
+		reporter->Warning("cannot save DFA states to %s: %s", cache_dir.c_str(), strerror(errno));
+		break;
+		}
+	}
+
+std::string DFA_Machine::Fingerprint(std::vector<NFA_State*>* order) const
+	{
+	std::string material;
+	put(&material, CACHE_VERSION);
+	put(&material, ec->NumSyms());
+	put(&material, ec->NumClasses());
+
+	for ( int i = 0; i < ec->NumSyms(); ++i )
+		put(&material, ec->SymEquivClass(i));
+
+	// Number the NFA's states breadth-first, so the numbers don't depend
+	// on how many states got created before, and describe each one's
+	// transitions by them.
+	std::unordered_map<const NFA_State*, int> index;
+	order->clear();
+
+	auto number = [&](NFA_State* n)
+	{
+		auto [it, inserted] = index.emplace(n, static_cast<int>(order->size()));
+
+		if ( inserted )
+			order->push_back(n);
+
+		return it->second;
+	};
+
+	number(nfa->FirstState());
+
+	for ( size_t i = 0; i < order->size(); ++i )
+		{
+		NFA_State* n = (*order)[i];
+		put(&material, n->TransSym());
+		put(&material, n->Accept());
+
+		if ( n->TransSym() == SYM_CCL )
+			{
+			CCL* ccl = n->TransCCL();
+			put(&material, ccl->IsNegated());
+			put(&material, ccl->Syms()->size());
+
+			for ( auto sym : *ccl->Syms() )
+				put(&material, sym);
+			}
+
+		NFA_state_list* xtions = n->Transitions();
+		put(&material, xtions->length());
+
+		for ( auto* next : *xtions )
+			put(&material, number(next));
+		}
+
+	u_char digest[SHA256_DIGEST_LENGTH];
+	calculate_digest(Hash_SHA256, reinterpret_cast<const u_char*>(material.data()),
+	                 material.size(), digest);
+
+	return sha256_digest_print(digest);
+	}
+
+bool DFA_Machine::LoadCache()
+	{
+	std::vector<NFA_State*> order;
+	std::string path = cache_dir + "/" + Fingerprint(&order) + ".dfa";
+
+	FILE* f = fopen(path.c_str(), "rb");
+	if ( ! f )
+		return false;
+
+	std::string buf;
+	char chunk[65536];
+	size_t n;
+
+	while ( (n = fread(chunk, 1, sizeof(chunk), f)) > 0 )
+		buf.append(chunk, n);
+
+	fclose(f);
+
+	size_t pos = 0;
+	uint32_t magic, version, num_nfa, num_syms, num_states;
+
+	if ( ! get(buf, &pos, &magic) || ! get(buf, &pos, &version) || ! get(buf, &pos, &num_nfa) ||
+	     ! get(buf, &pos, &num_syms) || ! get(buf, &pos, &num_states) )
+		return false;
+
+	if ( magic != CACHE_MAGIC || version != CACHE_VERSION || num_nfa != order.size() ||
+	     num_syms != static_cast<uint32_t>(ec->NumClasses()) )
+		return false;
+
+	// Each state takes up at least its NFA state count and transitions.
+	if ( num_states > (buf.size() - pos) / (sizeof(uint32_t) + num_syms * sizeof(int32_t)) )
+		return false;
+
+	// Check the whole file before adding any states.
+	std::vector<std::vector<uint32_t>> nfa_states(num_states);
+	std::vector<int32_t> xtions(static_cast<size_t>(num_states) * num_syms);
+
+	for ( uint32_t i = 0; i < num_states; ++i )
+		{
+		uint32_t num;
+		if ( ! get(buf, &pos, &num) || num == 0 || num > num_nfa )
+			return false;
+
+		nfa_states[i].resize(num);
+
+		for ( auto& idx : nfa_states[i] )
+			if ( ! get(buf, &pos, &idx) || idx >= num_nfa )
+				return false;
+
+		for ( uint32_t sym = 0; sym < num_syms; ++sym )
+			{
+			int32_t& next = xtions[i * num_syms + sym];
+
+			if ( ! get(buf, &pos, &next) || next < DFA_UNCOMPUTED_STATE ||
+			     next >= static_cast<int32_t>(num_states) )
+				return false;
+			}
+		}
+
+	if ( pos != buf.size() )
+		return false;
+
+	std::vector<DFA_State*> states(num_states);
+
+	for ( uint32_t i = 0; i < num_states; ++i )
+		{
+		NFA_state_list* state_set = new NFA_state_list;
+
+		for ( auto idx : nfa_states[i] )
+			state_set->push_back(order[idx]);
+
+		std::sort(state_set->begin(), state_set->end(), NFA_state_cmp_neg);
+
+		if ( ! StateSetToDFA_State(state_set, states[i], ec) )
+			delete state_set;
+		}
+
+	for ( uint32_t i = 0; i < num_states; ++i )
+		for ( uint32_t sym = 0; sym < num_syms; ++sym )
+			{
+			int32_t next = xtions[i * num_syms + sym];
+
+			if ( next == CACHE_JAM_STATE )
+				states[i]->AddXtion(sym, nullptr);
+			else if ( next != DFA_UNCOMPUTED_STATE )
+				states[i]->AddXtion(sym, states[next]);
+			}
+
+	return true;
+	}
+
+bool DFA_Machine::SaveCache() const
+	{
+	std::vector<NFA_State*> order;
+	std::string path = cache_dir + "/" + Fingerprint(&order) + ".dfa";
+
+	std::unordered_map<const NFA_State*, uint32_t> nfa_index;
+	for ( size_t i = 0; i < order.size(); ++i )
+		nfa_index[order[i]] = i;
+
+	auto states = dfa_state_cache->States();
+	std::unordered_map<const DFA_State*, int32_t> dfa_index;
+	for ( size_t i = 0; i < states.size(); ++i )
+		dfa_index[states[i]] = i;
+
+	std::string buf;
+	put(&buf, CACHE_MAGIC);
+	put(&buf, CACHE_VERSION);
+	put(&buf, static_cast<uint32_t>(order.size()));
+	put(&buf, static_cast<uint32_t>(ec->NumClasses()));
+	put(&buf, static_cast<uint32_t>(states.size()));
+
+	for ( auto* s : states )
+		{
+		put(&buf, static_cast<uint32_t>(s->nfa_states->length()));
+
+		for ( auto* n : *s->nfa_states )
+			{
+			auto it = nfa_index.find(n);
+
+			// Can't happen for states derived from the NFA.
+			if ( it == nfa_index.end() )
+				return true;
+
+			put(&buf, it->second);
+			}
+
+		for ( int sym = 0; sym < s->num_sym; ++sym )
+			{
+			DFA_State* next = s->xtions[sym];
+
+			if ( next == DFA_UNCOMPUTED_STATE_PTR )
+				put(&buf, int32_t(DFA_UNCOMPUTED_STATE));
+			else if ( ! next )
+				put(&buf, CACHE_JAM_STATE);
+			else
+				{
+				auto it = dfa_index.find(next);
+				put(&buf, it != dfa_index.end() ? it->second : int32_t(DFA_UNCOMPUTED_STATE));
+				}
+			}
+		}
+
+	// Write to a temporary file first, so that other processes sharing
+	// the directory never see a partial one.
+	std::string tmp = path + "." + std::to_string(getpid()) + ".tmp";
+
+	FILE* f = fopen(tmp.c_str(), "wb");
+	if ( ! f )
+		return false;
+
+	bool ok = fwrite(buf.data(), 1, buf.size(), f) == buf.size();
+	ok = fclose(f) == 0 && ok;
+
+	if ( ! ok || rename(tmp.c_str(), path.c_str()) != 0 )
+		{
+		int err = errno;
+		unlink(tmp.c_str());
+		errno = err;
+		return false;
+		}
+
 	return true;
 	}
 
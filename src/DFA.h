@@ -4,8 +4,11 @@
 
 #include <sys/types.h> // for u_char
 #include <cassert>
+#include <cstdint>
 #include <map>
+#include <mutex>
 #include <string>
+#include <vector>
 
 #include "zeek/NFA.h"
 #include "zeek/Obj.h"
@@ -31,6 +34,7 @@ public:
 
 	int StateNum() const { return state_num; }
 	int NFAStateNum() const { return nfa_states->length(); }
+	const NFA_state_list* NFAStates() const { return nfa_states; }
 	void AddXtion(int sym, DFA_State* next_state);
 
 	inline DFA_State* Xtion(int sym, DFA_Machine* machine);
@@ -53,14 +57,24 @@ public:
 	void Stats(unsigned int* computed, unsigned int* uncomputed);
 	unsigned int Size();
 
+	// True once the state's machine has dropped it from its cache. Its
+	// transitions must not be followed anymore; DFA_Machine::Revive()
+	// returns the equivalent live state.
+	bool Retired() const { return retired; }
+
 protected:
 	friend class DFA_State_Cache;
+	friend class DFA_Machine; // for loading and saving states
 
 	DFA_State* ComputeXtion(int sym, DFA_Machine* machine);
 	void AppendIfNew(int sym, int_list* sym_list);
 
+	// Forgets all transitions, to be computed again when needed.
+	void ClearXtions();
+
 	int state_num;
 	int num_sym;
+	bool retired;
 
 	DFA_State** xtions;
 
@@ -88,6 +102,33 @@ public:
 
 	int NumEntries() const { return states.size(); }
 
+	/**
+	 * Returns all cached states, in no particular order.
+	 */
+	std::vector<DFA_State*> States() const;
+
+	/**
+	 * Returns the memory the cached states take up, in bytes.
+	 */
+	uint64_t Memory() const { return mem; }
+
+	/**
+	 * Returns the memory that the states of all caches take up, in bytes.
+	 */
+	static uint64_t TotalMemory();
+
+	/**
+	 * Returns the number of states in all caches.
+	 */
+	static uint64_t TotalStates();
+
+	/**
+	 * Drops all states except the given one, whose transitions get
+	 * recomputed as needed. The dropped states live on while something
+	 * holds a reference to them, marked as retired.
+	 */
+	void Flush(DFA_State* keep);
+
 	struct Stats
 		{
 		// Sum of all NFA states
@@ -98,13 +139,18 @@ public:
 		unsigned int mem;
 		unsigned int hits;
 		unsigned int misses;
+		unsigned int flushes;
 		};
 
 	void GetStats(Stats* s);
 
 private:
+	void Remove(DFA_State* state);
+
 	int hits; // Statistics
 	int misses;
+	int flushes;
+	uint64_t mem;
 
 	// Hash indexed by NFA states (MD5s of them, actually).
 	std::map<DigestStr, DFA_State*> states;
@@ -122,16 +168,84 @@ public:
 
 	DFA_State_Cache* Cache() { return dfa_state_cache; }
 
+	/**
+	 * Flushes the state cache if it exceeded its budget since the last
+	 * call. Callers must not hold on to states across this call, other
+	 * than by reference and checking for retirement.
+	 */
+	void CheckBudget()
+		{
+		if ( flush_pending )
+			Flush();
+		}
+
+	/**
+	 * Returns the live state for the same NFA states as a retired one.
+	 */
+	DFA_State* Revive(const DFA_State* retired);
+
 	int Rep(int sym);
 
 	void Describe(ODesc* d) const override;
 	void Dump(FILE* f);
 
+	/**
+	 * Sets the directory that machines load their states from when
+	 * they're created, and save them to with SaveCaches(), see
+	 * dfa_cache_dir. Machines that exist already load their states
+	 * right away.
+	 *
+	 * @param dir The directory, created if needed. Empty turns off
+	 * caching.
+	 */
+	static void UseCacheDirectory(const std::string& dir);
+
+	/**
+	 * Saves the states of all machines that have more than a few to the
+	 * cache directory, if there's one.
+	 */
+	static void SaveCaches();
+
+	/**
+	 * Returns the lock that guards the machine's states once locking is
+	 * enabled.
+	 */
+	std::mutex& Mutex() { return mutex; }
+
+	/**
+	 * Makes matching lock the machines it steps through from now on, so
+	 * that threads other than the main one can match, see RuleMatchPool.
+	 * Must be called from the main thread before any other matches.
+	 */
+	static void EnableLocking();
+
+	/**
+	 * Returns true if matching needs to lock the machines.
+	 */
+	static bool Locking() { return locking; }
+
 protected:
 	friend class DFA_State; // for DFA_State::ComputeXtion
 	friend class DFA_State_Cache;
 
+	void Flush();
+
+	// Flushes other machines' caches while the states of all of them
+	// exceed their budget.
+	void ReclaimMemory();
+
+	// Returns a digest of the NFA and the equivalence classes, which
+	// the cached states of the machine depend on. Fills in the NFA's
+	// states in the order that cache files refer to them by.
+	std::string Fingerprint(std::vector<NFA_State*>* order) const;
+
+	// Adds the states from the machine's cache file, if there's a valid
+	// one, returning true if so.
+	bool LoadCache();
+	bool SaveCache() const;
+
 	int state_count;
+	bool flush_pending;
 
 	// The state list has to be sorted according to IDs.
 	bool StateSetToDFA_State(NFA_state_list* state_set, DFA_State*& d, const EquivClass* ec);
@@ -142,6 +256,35 @@ protected:
 	DFA_State_Cache* dfa_state_cache;
 
 	NFA_Machine* nfa;
+
+	std::mutex mutex;
+	static bool locking;
+	};
+
+// Holds a machine's lock for its scope, if machines get locked at all.
+class DFA_Lock
+	{
+public:
+	explicit DFA_Lock(DFA_Machine* m)
+		{
+		if ( m && DFA_Machine::Locking() )
+			{
+			mutex = &m->Mutex();
+			mutex->lock();
+			}
+		}
+
+	~DFA_Lock()
+		{
+		if ( mutex )
+			mutex->unlock();
+		}
+
+	DFA_Lock(const DFA_Lock&) = delete;
+	DFA_Lock& operator=(const DFA_Lock&) = delete;
+
+private:
+	std::mutex* mutex = nullptr;
 	};
 
 inline DFA_State* DFA_State::Xtion(int sym, DFA_Machine* machine)
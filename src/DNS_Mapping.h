@@ -40,6 +40,7 @@ public:
 
 	double CreationTime() const { return creation_time; }
 	uint32_t TTL() const { return req_ttl; }
+	uint64_t LastUsed() const { return last_used; }
 
 	void Save(FILE* f) const;
 
@@ -78,6 +79,7 @@ protected:
 	ListValPtr addrs_val;
 
 	double creation_time = 0.0;
+	uint64_t last_used = 0; // in ticks of the DNS_Mgr's use_clock
 	bool no_mapping = false; // when initializing from a file, immediately hit EOF
 	bool init_failed = false;
 	bool failed = false;
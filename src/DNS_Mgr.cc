@@ -564,6 +564,16 @@ void DNS_Mgr::Done()
 	{
 	shutting_down = true;
 	Flush();
+
+	// DNS_PRIME mode saves once resolving finished, see setup().
+	if ( ! save_cache || mode == DNS_PRIME )
+		return;
+
+	if ( ! dir.empty() )
+		util::detail::ensure_dir(dir.c_str());
+
+	if ( ! Save() )
+		reporter->Warning("can't save DNS cache to %s", cache_name.c_str());
 	}
 
 void DNS_Mgr::RegisterSocket(int fd, bool read, bool write)
@@ -670,6 +680,8 @@ void DNS_Mgr::InitPostScript()
 	if ( ! doctest::is_running_in_test )
 		{
 		dm_rec = id::find_type<RecordType>("dns_mapping");
+		SetCacheLimit(id::find_val("dns_cache_max_entries")->AsCount());
+		SetSaveCache(id::find_val("dns_save_cache")->AsBool());
 
 		// Registering will call InitSource(), which sets up all of the DNS library stuff
 		iosource_mgr->Register(this, true);
@@ -733,7 +745,10 @@ ValPtr DNS_Mgr::Lookup(const std::string& name, int request_type)
 	if ( mode != DNS_PRIME )
 		{
 		if ( auto val = LookupOtherInCache(name, request_type, false) )
+			{
+			++cache_hits;
 			return val;
+			}
 		}
 
 	switch ( mode )
@@ -782,7 +797,10 @@ TableValPtr DNS_Mgr::LookupHost(const std::string& name)
 	if ( mode != DNS_PRIME )
 		{
 		if ( auto val = LookupNameInCache(name, false, true) )
+			{
+			++cache_hits;
 			return val;
+			}
 		}
 
 	// Not found, or priming.
@@ -833,7 +851,10 @@ StringValPtr DNS_Mgr::LookupAddr(const IPAddr& addr)
 	if ( mode != DNS_PRIME )
 		{
 		if ( auto val = LookupAddrInCache(addr, false, true) )
+			{
+			++cache_hits;
 			return val;
+			}
 		}
 
 	// Not found, or priming.
@@ -880,6 +901,7 @@ void DNS_Mgr::LookupHost(const std::string& name, LookupCallback* callback)
 	// Do we already know the answer?
 	if ( auto addrs = LookupNameInCache(name, true, false) )
 		{
+		++cache_hits;
 		resolve_lookup_cb(callback, std::move(addrs));
 		return;
 		}
@@ -923,6 +945,7 @@ void DNS_Mgr::LookupAddr(const IPAddr& addr, LookupCallback* callback)
 	// Do we already know the answer?
 	if ( auto name = LookupAddrInCache(addr, true, false) )
 		{
+		++cache_hits;
 		resolve_lookup_cb(callback, name->CheckString());
 		return;
 		}
@@ -965,6 +988,7 @@ void DNS_Mgr::Lookup(const std::string& name, int request_type, LookupCallback*
 	// Do we already know the answer?
 	if ( auto txt = LookupOtherInCache(name, request_type, true) )
 		{
+		++cache_hits;
 		resolve_lookup_cb(callback, txt->CheckString());
 		return;
 		}
@@ -1108,10 +1132,52 @@ void DNS_Mgr::AddResult(DNS_Request* dr, struct hostent* h, uint32_t ttl, bool m
 	if ( prev_mapping && ! dr->IsTxt() )
 		CompareMappings(prev_mapping, new_mapping);
 
+	Touch(it->second);
+
 	if ( keep_prev )
 		new_mapping.reset();
 	else
 		prev_mapping.reset();
+
+	EvictLeastRecentlyUsed();
+	}
+
+void DNS_Mgr::SetCacheLimit(size_t max_entries)
+	{
+	max_cache_entries = max_entries;
+	EvictLeastRecentlyUsed();
+	}
+
+void DNS_Mgr::Touch(const DNS_MappingPtr& dm)
+	{
+	dm->last_used = ++use_clock;
+	}
+
+void DNS_Mgr::EvictLeastRecentlyUsed()
+	{
+	if ( ! max_cache_entries || all_mappings.size() <= max_cache_entries )
+		return;
+
+	// Evict a tenth of the limit beyond what's needed, so that the
+	// selection's cost spreads over many insertions.
+	auto keep = max_cache_entries - max_cache_entries / 10;
+	std::vector<std::pair<uint64_t, MappingMap::iterator>> by_use;
+	by_use.reserve(all_mappings.size());
+
+	for ( auto it = all_mappings.begin(); it != all_mappings.end(); ++it )
+		{
+		const auto& dm = it->second;
+		by_use.emplace_back(dm && ! dm->Expired() ? dm->LastUsed() : 0, it);
+		}
+
+	auto num_evict = by_use.size() - keep;
+	std::nth_element(by_use.begin(), by_use.begin() + num_evict - 1, by_use.end(),
+	                 [](const auto& a, const auto& b) { return a.first < b.first; });
+
+	for ( size_t i = 0; i < num_evict; ++i )
+		all_mappings.erase(by_use[i].second);
+
+	cache_evictions += num_evict;
 	}
 
 void DNS_Mgr::CompareMappings(const DNS_MappingPtr& prev_mapping, const DNS_MappingPtr& new_mapping)
@@ -1202,6 +1268,8 @@ void DNS_Mgr::LoadCache(const std::string& path)
 	auto m = std::make_shared<DNS_Mapping>(f);
 	for ( ; ! m->NoMapping() && ! m->InitFailed(); m = std::make_shared<DNS_Mapping>(f) )
 		{
+		Touch(m);
+
 		if ( m->ReqHost() )
 			all_mappings.insert_or_assign(std::make_pair(m->ReqType(), m->ReqHost()), m);
 		else
@@ -1212,6 +1280,7 @@ void DNS_Mgr::LoadCache(const std::string& path)
 		reporter->FatalError("DNS cache corrupted");
 
 	fclose(f);
+	EvictLeastRecentlyUsed();
 	}
 
 bool DNS_Mgr::Save()
@@ -1259,6 +1328,8 @@ TableValPtr DNS_Mgr::LookupNameInCache(const std::string& name, bool cleanup_exp
 		return nullptr;
 		}
 
+	Touch(d);
+
 	if ( check_failed && (d && d->Failed()) )
 		{
 		reporter->Warning("Can't resolve host: %s", name.c_str());
@@ -1281,7 +1352,10 @@ StringValPtr DNS_Mgr::LookupAddrInCache(const IPAddr& addr, bool cleanup_expired
 		all_mappings.erase(it);
 		return nullptr;
 		}
-	else if ( check_failed && d->Failed() )
+
+	Touch(d);
+
+	if ( check_failed && d->Failed() )
 		{
 		std::string s(addr);
 		reporter->Warning("can't resolve IP address: %s", s.c_str());
@@ -1309,6 +1383,8 @@ StringValPtr DNS_Mgr::LookupOtherInCache(const std::string& name, int request_ty
 		return nullptr;
 		}
 
+	Touch(d);
+
 	if ( d->Host() )
 		return d->Host();
 
@@ -1474,6 +1550,8 @@ void DNS_Mgr::GetStats(Stats* stats)
 	stats->cached_hosts = 0;
 	stats->cached_addresses = 0;
 	stats->cached_texts = 0;
+	stats->cache_hits = cache_hits;
+	stats->cache_evictions = cache_evictions;
 
 	for ( const auto& [key, mapping] : all_mappings )
 		{
@@ -1601,6 +1679,9 @@ class TestDNS_Mgr final : public DNS_Mgr
 public:
 	explicit TestDNS_Mgr(DNS_MgrMode mode) : DNS_Mgr(mode) { }
 	void Process();
+
+	bool AddrInCache(const IPAddr& addr) { return LookupAddrInCache(addr) != nullptr; }
+	size_t CacheSize() const { return all_mappings.size(); }
 	};
 
 void TestDNS_Mgr::Process()
@@ -1611,6 +1692,43 @@ void TestDNS_Mgr::Process()
 	IssueAsyncRequests();
 	}
 
+TEST_CASE("dns_mgr cache limit")
+	{
+	TestDNS_Mgr mgr(DNS_DEFAULT);
+	mgr.SetCacheLimit(10);
+
+	char name[] = "host.example.com";
+	struct hostent h = {};
+	h.h_name = name;
+
+	auto add = [&](int i)
+		{
+		DNS_Request req(IPAddr(util::fmt("10.0.0.%d", i)));
+		mgr.AddResult(&req, &h, 3600);
+		};
+
+	for ( int i = 0; i < 10; ++i )
+		add(i);
+
+	CHECK(mgr.CacheSize() == 10);
+
+	// Using the first one makes the second the least recently used.
+	CHECK(mgr.AddrInCache(IPAddr("10.0.0.0")));
+	add(10);
+
+	// Going beyond the limit evicts a tenth of it more, so that there's
+	// room for the next one.
+	CHECK(mgr.CacheSize() == 9);
+	CHECK(mgr.AddrInCache(IPAddr("10.0.0.0")));
+	CHECK_FALSE(mgr.AddrInCache(IPAddr("10.0.0.1")));
+	CHECK_FALSE(mgr.AddrInCache(IPAddr("10.0.0.2")));
+	CHECK(mgr.AddrInCache(IPAddr("10.0.0.10")));
+
+	DNS_Mgr::Stats stats;
+	mgr.GetStats(&stats);
+	CHECK(stats.cache_evictions == 2);
+	}
+
 TEST_CASE("dns_mgr priming" * doctest::skip(true))
 	{
 	char prefix[] = "/tmp/zeek-unit-test-XXXXXX";
@@ -189,6 +189,21 @@ public:
 	 */
 	void SetDir(const std::string& arg_dir) { dir = arg_dir; }
 
+	/**
+	 * Bounds the number of cached mappings. Once there are more, the least
+	 * recently used ones get evicted, expired ones first.
+	 *
+	 * @param max_entries The maximum number of mappings, or zero for no
+	 * bound.
+	 */
+	void SetCacheLimit(size_t max_entries);
+
+	/**
+	 * Sets whether to save the cache to disk when done, also if not in
+	 * DNS_PRIME mode, so that the next run starts with it.
+	 */
+	void SetSaveCache(bool arg_save_cache) { save_cache = arg_save_cache; }
+
 	/**
 	 * Waits for responses to become available or a timeout to occur,
 	 * and handles any responses.
@@ -209,6 +224,8 @@ public:
 		unsigned long cached_hosts;
 		unsigned long cached_addresses;
 		unsigned long cached_texts;
+		unsigned long cache_hits;
+		unsigned long cache_evictions;
 		};
 
 	/**
@@ -280,6 +297,13 @@ protected:
 	void LoadCache(const std::string& path);
 	void Save(FILE* f, const MappingMap& m);
 
+	// Marks a cached mapping as just used.
+	void Touch(const DNS_MappingPtr& dm);
+
+	// Evicts the least recently used mappings while the cache is beyond
+	// its limit.
+	void EvictLeastRecentlyUsed();
+
 	// Issue as many queued async requests as slots are available.
 	void IssueAsyncRequests();
 
@@ -298,8 +322,12 @@ protected:
 	std::string dir; // directory in which cache_name resides
 
 	bool did_init = false;
+	bool save_cache = false;
 	int asyncs_pending = 0;
 
+	size_t max_cache_entries = 0;
+	uint64_t use_clock = 0;
+
 	RecordTypePtr dm_rec;
 
 	ares_channel channel{};
@@ -339,6 +367,8 @@ protected:
 	unsigned long num_requests = 0;
 	unsigned long successful = 0;
 	unsigned long failed = 0;
+	unsigned long cache_hits = 0;
+	unsigned long cache_evictions = 0;
 
 	std::set<int> socket_fds;
 	std::set<int> write_socket_fds;
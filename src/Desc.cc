@@ -384,6 +384,12 @@ void ODesc::Grow(unsigned int n)
 		base = util::safe_realloc(base, size);
 	}
 
+void ODesc::Reserve(unsigned int n)
+	{
+	if ( ! f && n > offset )
+		Grow(n - offset);
+	}
+
 void ODesc::Clear()
 	{
 	offset = 0;
@@ -160,6 +160,11 @@ public:
 
 	int Len() const { return offset; }
 
+	// Makes room for a description of at least the given number of
+	// bytes, so that building one of about that size doesn't keep
+	// growing the buffer.
+	void Reserve(unsigned int n);
+
 	void Clear();
 
 	// Used to determine recursive types. Records push their types on here;
@@ -11,6 +11,7 @@
 #include <climits>
 #include <csignal>
 #include <fstream>
+#include <random>
 
 #include "zeek/3rdparty/doctest.h"
 #include "zeek/Reporter.h"
@@ -374,6 +375,98 @@ TEST_CASE("dict iterator invalidation")
 	delete key3;
 	}
 
+TEST_CASE("dict long clusters")
+	{
+	PDict<uint32_t> dict;
+	uint32_t vals[100];
+
+	// Keys with the same hash share a bucket and their control bytes, so
+	// lookups have to tell them apart across several groups of slots.
+	// Every tenth key gets a bucket of its own.
+	auto hash = [](uint32_t k) { return k % 10 == 0 ? detail::hash_t(k) : 42; };
+
+	for ( uint32_t k = 0; k < 100; ++k )
+		{
+		vals[k] = k;
+		dict.Insert(&k, sizeof(k), hash(k), &vals[k], true);
+		}
+
+	CHECK(dict.Length() == 100);
+
+	for ( uint32_t k = 0; k < 100; ++k )
+		{
+		uint32_t* v = dict.Lookup(&k, sizeof(k), hash(k));
+		REQUIRE(v);
+		CHECK(*v == k);
+		}
+
+	uint32_t missing = 1000;
+	CHECK(dict.Lookup(&missing, sizeof(missing), 42) == nullptr);
+
+	for ( uint32_t k = 0; k < 100; k += 2 )
+		CHECK(dict.Remove(&k, sizeof(k), hash(k)) == &vals[k]);
+
+	for ( uint32_t k = 0; k < 100; ++k )
+		CHECK((dict.Lookup(&k, sizeof(k), hash(k)) != nullptr) == (k % 2 == 1));
+	}
+
+TEST_CASE("dict control byte matching")
+	{
+	std::mt19937 rng(42);
+	uint8_t ctrl[detail::DICT_GROUP_SIZE];
+
+	for ( int round = 0; round < 200; ++round )
+		{
+		// Mostly tags and empty slots, the others now and then.
+		for ( auto& c : ctrl )
+			c = rng() % 4 ? rng() % 0x81 : rng();
+
+		uint32_t empty = 0;
+
+		for ( int i = 0; i < detail::DICT_GROUP_SIZE; ++i )
+			if ( ctrl[i] >= detail::DICT_CTRL_EMPTY )
+				empty |= 1u << i;
+
+		CHECK(detail::dict_match_empty(ctrl) == empty);
+		CHECK(detail::dict_match_empty_scalar(ctrl) == empty);
+
+		for ( int b = 0; b < 256; ++b )
+			{
+			uint32_t expected = 0;
+
+			for ( int i = 0; i < detail::DICT_GROUP_SIZE; ++i )
+				if ( ctrl[i] == b )
+					expected |= 1u << i;
+
+			CHECK(detail::dict_match_ctrl(ctrl, b) == expected);
+			CHECK(detail::dict_match_ctrl_scalar(ctrl, b) == expected);
+			}
+		}
+	}
+
+TEST_CASE("dict inline keys")
+	{
+	PDict<uint32_t> dict;
+	uint32_t val = 1;
+
+	char small[detail::DICT_INLINE_KEY_SIZE] = "an addr and a port";
+	char large[detail::DICT_INLINE_KEY_SIZE + 1] = "too large for inline";
+
+	dict.Insert(small, sizeof(small), 1, &val, true);
+	CHECK(dict.HeapKeys() == 0);
+
+	dict.Insert(large, sizeof(large), 2, &val, true);
+	CHECK(dict.HeapKeys() == 1);
+	CHECK(dict.MemoryAllocation() >=
+	      dict.Capacity() * sizeof(detail::DictEntry<uint32_t>) + sizeof(large));
+
+	CHECK(dict.Lookup(small, sizeof(small), 1) == &val);
+	CHECK(dict.Lookup(large, sizeof(large), 2) == &val);
+
+	dict.Remove(large, sizeof(large), 2);
+	CHECK(dict.HeapKeys() == 0);
+	}
+
 // private
 void generic_delete_func(void* v)
 	{
@@ -2,12 +2,21 @@
 
 #pragma once
 
+#include "zeek/zeek-config.h"
+
 #include <algorithm>
 #include <cstdint>
+#include <cstring>
 #include <fstream>
 #include <memory>
 #include <vector>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
 #include "zeek/Hash.h"
 #include "zeek/Reporter.h"
 
@@ -61,10 +70,82 @@ constexpr uint8_t DEFAULT_DICT_SIZE = 0;
 // Basically if dict size < 2^DICT_THRESHOLD_BITS + n, we size up only if necessary.
 constexpr uint8_t DICT_THRESHOLD_BITS = 3;
 
+// Keys up to this size live in the entry itself rather than in a separate allocation. 24
+// bytes hold the hash keys of an addr, an addr and a port, or a short string.
+constexpr uint16_t DICT_INLINE_KEY_SIZE = 24;
+
 // The value of an iteration cookie is the bucket and offset within the
 // bucket at which to start looking for the next value to return.
 constexpr uint16_t TOO_FAR_TO_REACH = 0xFFFF;
 
+// Lookups compare the control bytes of this many slots at a time.
+constexpr int DICT_GROUP_SIZE = 16;
+
+// The control byte of an empty slot. Those of occupied slots hold a 7-bit tag
+// derived from the entry's hash, so only the empty ones have the high bit set.
+constexpr uint8_t DICT_CTRL_EMPTY = 0x80;
+
+#if defined(__ARM_NEON) && defined(__aarch64__) && ! defined(__SSE2__)
+// Turns the all-ones or all-zeros bytes of a comparison into a bitmask.
+inline uint32_t dict_neon_movemask(uint8x16_t v)
+	{
+	static const uint8_t bits[16] = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+	uint8x16_t masked = vandq_u8(v, vld1q_u8(bits));
+	return vaddv_u8(vget_low_u8(masked)) | (uint32_t(vaddv_u8(vget_high_u8(masked))) << 8);
+	}
+#endif
+
+// The byte loops that dict_match_ctrl() and dict_match_empty() fall back to
+// without SSE2 or NEON.
+inline uint32_t dict_match_ctrl_scalar(const uint8_t* ctrl, uint8_t b)
+	{
+	uint32_t mask = 0;
+
+	for ( int i = 0; i < DICT_GROUP_SIZE; i++ )
+		if ( ctrl[i] == b )
+			mask |= 1u << i;
+
+	return mask;
+	}
+
+inline uint32_t dict_match_empty_scalar(const uint8_t* ctrl)
+	{
+	uint32_t mask = 0;
+
+	for ( int i = 0; i < DICT_GROUP_SIZE; i++ )
+		if ( ctrl[i] & DICT_CTRL_EMPTY )
+			mask |= 1u << i;
+
+	return mask;
+	}
+
+// Returns a mask with bit i set if ctrl[i] equals b, for the DICT_GROUP_SIZE
+// control bytes starting at ctrl.
+inline uint32_t dict_match_ctrl(const uint8_t* ctrl, uint8_t b)
+	{
+#ifdef __SSE2__
+	__m128i group = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl));
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(static_cast<char>(b))));
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+	return dict_neon_movemask(vceqq_u8(vld1q_u8(ctrl), vdupq_n_u8(b)));
+#else
+	return dict_match_ctrl_scalar(ctrl, b);
+#endif
+	}
+
+// Like dict_match_ctrl(), for the empty slots. Since tags only use seven
+// bits, this matches any control byte with the high bit set.
+inline uint32_t dict_match_empty(const uint8_t* ctrl)
+	{
+#ifdef __SSE2__
+	return _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl)));
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+	return dict_neon_movemask(vcgeq_u8(vld1q_u8(ctrl), vdupq_n_u8(DICT_CTRL_EMPTY)));
+#else
+	return dict_match_empty_scalar(ctrl);
+#endif
+	}
+
 /**
  * An entry stored in the dictionary.
  */
@@ -78,8 +159,8 @@ public:
 	// Distance from the expected position in the table. 0xFFFF means that the entry is empty.
 	uint16_t distance = TOO_FAR_TO_REACH;
 
-	// The size of the key. Less than 8 bytes we'll store directly in the entry, otherwise we'll
-	// store it as a pointer. This avoids extra allocations if we can help it.
+	// The size of the key. Up to DICT_INLINE_KEY_SIZE bytes we'll store directly in the entry,
+	// otherwise we'll store it as a pointer. This avoids extra allocations if we can help it.
 	uint16_t key_size = 0;
 
 	// Lower 4 bytes of the 8-byte hash, which is used to calculate the position in the table.
@@ -87,7 +168,8 @@ public:
 
 	T* value = nullptr;
 		union {
-		char key_here[8]; // hold key len<=8. when over 8, it's a pointer to real keys.
+		// hold key len<=DICT_INLINE_KEY_SIZE. when over, it's a pointer to real keys.
+		char key_here[DICT_INLINE_KEY_SIZE];
 		char* key;
 		};
 
@@ -98,7 +180,7 @@ public:
 		if ( ! arg_key )
 			return;
 
-		if ( key_size <= 8 )
+		if ( ! HeapKey() )
 			{
 			memcpy(key_here, arg_key, key_size);
 			if ( ! copy_key )
@@ -134,17 +216,27 @@ public:
 
 	void Clear()
 		{
-		if ( key_size > 8 )
+		if ( HeapKey() )
 			delete[] key;
 		SetEmpty();
 		}
 
-	const char* GetKey() const { return key_size <= 8 ? key_here : key; }
+	// True if the key lives in a separate allocation.
+	bool HeapKey() const { return key_size > DICT_INLINE_KEY_SIZE; }
+
+	const char* GetKey() const { return HeapKey() ? key : key_here; }
 	std::unique_ptr<detail::HashKey> GetHashKey() const
 		{
 		return std::make_unique<detail::HashKey>(GetKey(), key_size, hash);
 		}
 
+	// Like GetHashKey(), without copying the key. The result is valid
+	// only as long as the entry is.
+	detail::HashKey GetHashKeyView() const
+		{
+		return detail::HashKey(GetKey(), key_size, hash, true);
+		}
+
 	bool Equal(const char* arg_key, int arg_key_size, hash_t arg_hash) const
 		{ // only 40-bit hash comparison.
 		return (0 == ((hash ^ arg_hash) & HASH_MASK)) && key_size == arg_key_size &&
@@ -497,6 +589,11 @@ public:
 	// if the removal may have invalidated any existing iterators.
 	T* Insert(detail::HashKey* key, T* val, bool* iterators_invalidated = nullptr)
 		{
+		// Keys that the entry holds inline get copied there, no need to take them.
+		if ( key->Size() <= detail::DICT_INLINE_KEY_SIZE )
+			return Insert(const_cast<void*>(key->Key()), key->Size(), key->Hash(), val, true,
+			              iterators_invalidated);
+
 		return Insert(key->TakeKey(), key->Size(), key->Hash(), val, false, iterators_invalidated);
 		}
 
@@ -705,6 +802,10 @@ public:
 				}
 			free(table);
 			table = nullptr;
+#ifdef ZEEK_DICT_CTRL_BYTES
+			free(ctrl);
+			ctrl = nullptr;
+#endif
 			}
 
 		if ( order )
@@ -734,6 +835,40 @@ public:
 		return table ? capacity : 0;
 		}
 
+	/// The number of entries whose keys are too large to live in the entry.
+	int HeapKeys() const
+		{
+		int n = 0;
+		for ( int i = 0; i < Capacity(); i++ )
+			if ( ! table[i].Empty() && table[i].HeapKey() )
+				n++;
+		return n;
+		}
+
+	/// The memory the dictionary allocates for its table, keys and order, in bytes. Doesn't
+	/// include the values.
+	uint64_t MemoryAllocation() const
+		{
+		uint64_t size = sizeof(*this);
+
+		if ( table )
+			{
+			size += zeek::util::pad_size(Capacity() * sizeof(detail::DictEntry<T>));
+#ifdef ZEEK_DICT_CTRL_BYTES
+			size += zeek::util::pad_size(Capacity() + detail::DICT_GROUP_SIZE);
+#endif
+			}
+
+		for ( int i = 0; i < Capacity(); i++ )
+			if ( ! table[i].Empty() && table[i].HeapKey() )
+				size += zeek::util::pad_size(table[i].key_size);
+
+		if ( order )
+			size += sizeof(*order) + order->capacity() * sizeof(detail::DictEntry<T>);
+
+		return size;
+		}
+
 	// Debugging
 #define DUMPIF(f)                                                                                  \
 	if ( f )                                                                                       \
@@ -754,6 +889,16 @@ public:
 		ASSERT(valid);
 		DUMPIF(! valid);
 
+#ifdef ZEEK_DICT_CTRL_BYTES
+		// control bytes must match the entries
+		for ( int i = 0; i < Capacity(); i++ )
+			{
+			valid = (ctrl[i] == (table[i].Empty() ? detail::DICT_CTRL_EMPTY : Tag(table[i].hash)));
+			ASSERT(valid);
+			DUMPIF(! valid);
+			}
+#endif
+
 		// entries must clustered together
 		for ( int i = 1; i < Capacity(); i++ )
 			{
@@ -805,10 +950,12 @@ public:
 		int distances[DICT_NUM_DISTANCES];
 		int max_distance = 0;
 		DistanceStats(max_distance, distances, DICT_NUM_DISTANCES);
-		printf("cap %'7d ent %'7d %'-7d load %.2f max_dist %2d key/ent %3d lg "
-		       "%2d remaps %1d remap_end %4d ",
+		printf("cap %'7d ent %'7d %'-7d load %.2f max_dist %2d key/ent %3d mem/ent %4" PRIu64
+		       " heap_keys %'7d lg %2d remaps %1d remap_end %4d ",
 		       Capacity(), Length(), MaxLength(), (double)Length() / (table ? Capacity() : 1),
-		       max_distance, key_size / (Length() ? Length() : 1), log2_buckets, remaps, remap_end);
+		       max_distance, key_size / (Length() ? Length() : 1),
+		       MemoryAllocation() / (Length() ? Length() : 1), HeapKeys(), log2_buckets, remaps,
+		       remap_end);
 		if ( Length() > 0 )
 			{
 			for ( int i = 0; i < DICT_NUM_DISTANCES - 1; i++ )
@@ -971,6 +1118,12 @@ private:
 		return h;
 		}
 
+#ifdef ZEEK_DICT_CTRL_BYTES
+	// The control byte for an entry with the given hash. Buckets come from
+	// the low bits of the Fibonacci hash, so the tag uses the top ones.
+	uint8_t Tag(detail::hash_t h) const { return FibHash(h) >> 57; }
+#endif
+
 	// Maps a hash to the appropriate n-bit table bucket.
 	int BucketByHash(detail::hash_t h, int bit) const
 		{
@@ -1071,6 +1224,29 @@ private:
 		table = (detail::DictEntry<T>*)malloc(sizeof(detail::DictEntry<T>) * Capacity(true));
 		for ( int i = Capacity() - 1; i >= 0; i-- )
 			table[i].SetEmpty();
+
+#ifdef ZEEK_DICT_CTRL_BYTES
+		// Groups starting near the end of the table read into the padding.
+		ctrl = (uint8_t*)malloc(Capacity() + detail::DICT_GROUP_SIZE);
+		memset(ctrl, detail::DICT_CTRL_EMPTY, Capacity() + detail::DICT_GROUP_SIZE);
+#endif
+		}
+
+	// Sets the entry at a position, along with its control byte.
+	void Place(int position, const detail::DictEntry<T>& entry)
+		{
+		table[position] = entry;
+#ifdef ZEEK_DICT_CTRL_BYTES
+		ctrl[position] = Tag(entry.hash);
+#endif
+		}
+
+	void Vacate(int position)
+		{
+		table[position].SetEmpty();
+#ifdef ZEEK_DICT_CTRL_BYTES
+		ctrl[position] = detail::DICT_CTRL_EMPTY;
+#endif
 		}
 
 	// Lookup
@@ -1144,12 +1320,27 @@ private:
 	                int* insert_position = nullptr, int* insert_distance = nullptr)
 		{
 		ASSERT(begin >= 0 && begin < Buckets());
+
+#ifdef ZEEK_DICT_CTRL_BYTES
+		if ( int position = FindInCluster(key, key_size, hash, begin, end); position >= 0 )
+			return position;
+
+		if ( ! insert_position && ! insert_distance )
+			return -1;
+
+		// Not found, the key would go right after the bucket's cluster.
+		int i = begin;
+		while ( i < end && ! table[i].Empty() && BucketByPosition(i) <= begin )
+			i++;
+#else
 		int i = begin;
 		for ( ; i < end && ! table[i].Empty() && BucketByPosition(i) <= begin; i++ )
 			if ( BucketByPosition(i) == begin && table[i].Equal((char*)key, key_size, hash) )
 				return i;
 
 		// no such cluster, or not found in the cluster.
+#endif
+
 		if ( insert_position )
 			*insert_position = i;
 
@@ -1165,6 +1356,46 @@ private:
 		return -1;
 		}
 
+#ifdef ZEEK_DICT_CTRL_BYTES
+	// Returns the position of the item in the cluster of the given bucket, or -1. Only entries
+	// whose control byte matches the hash's tag get compared, a group of them at a time.
+	int FindInCluster(const void* key, int key_size, detail::hash_t hash, int bucket,
+	                  int end) const
+		{
+		uint8_t tag = Tag(hash);
+
+		for ( int group = bucket; group < end; group += detail::DICT_GROUP_SIZE )
+			{
+			// The cluster ends at the first empty slot, if not before.
+			uint32_t empty = detail::dict_match_empty(ctrl + group);
+			int limit = std::min(end - group, empty ? __builtin_ctz(empty)
+			                                        : int(detail::DICT_GROUP_SIZE));
+
+			uint32_t candidates = detail::dict_match_ctrl(ctrl + group, tag) &
+			                      ((1u << limit) - 1);
+
+			for ( ; candidates; candidates &= candidates - 1 )
+				{
+				int i = group + __builtin_ctz(candidates);
+
+				if ( BucketByPosition(i) == bucket &&
+				     table[i].Equal((const char*)key, key_size, hash) )
+					return i;
+				}
+
+			if ( limit < detail::DICT_GROUP_SIZE )
+				break;
+
+			// Clusters are sorted by bucket, so once an entry belongs to a
+			// later one, none of the following can be in ours.
+			if ( BucketByPosition(group + detail::DICT_GROUP_SIZE - 1) > bucket )
+				break;
+			}
+
+		return -1;
+		}
+#endif
+
 	/// Insert entry, Adjust iterators when necessary.
 	void InsertRelocateAndAdjust(detail::DictEntry<T>& entry, int insert_position)
 		{
@@ -1200,14 +1431,14 @@ private:
 				ASSERT(insert_position == Capacity());
 				SizeUp(); // copied all the items to new table. as it's just copying without
 				          // remapping, insert_position is now empty.
-				table[insert_position] = entry;
+				Place(insert_position, entry);
 				if ( last_affected_position )
 					*last_affected_position = insert_position;
 				return;
 				}
 			if ( table[insert_position].Empty() )
 				{ // the condition to end the loop.
-				table[insert_position] = entry;
+				Place(insert_position, entry);
 				if ( last_affected_position )
 					*last_affected_position = insert_position;
 				return;
@@ -1219,7 +1450,7 @@ private:
 			t.distance += next - insert_position;
 
 			// swap
-			table[insert_position] = entry;
+			Place(insert_position, entry);
 			entry = t;
 			insert_position = next; // append to the end of the current cluster.
 			}
@@ -1278,13 +1509,13 @@ private:
 				{
 				// no next cluster to fill, or next position is empty or next position is already in
 				// perfect bucket.
-				table[position].SetEmpty();
+				Vacate(position);
 				if ( last_affected_position )
 					*last_affected_position = position;
 				return entry;
 				}
 			int next = TailOfClusterByPosition(position + 1);
-			table[position] = table[next];
+			Place(position, table[next]);
 			table[position].distance -= next - position; // distance improved for the item.
 			position = next;
 			}
@@ -1394,6 +1625,12 @@ private:
 		for ( int i = prev_capacity; i < capacity; i++ )
 			table[i].SetEmpty();
 
+#ifdef ZEEK_DICT_CTRL_BYTES
+		ctrl = (uint8_t*)realloc(ctrl, capacity + detail::DICT_GROUP_SIZE);
+		memset(ctrl + prev_capacity, detail::DICT_CTRL_EMPTY,
+		       capacity - prev_capacity + detail::DICT_GROUP_SIZE);
+#endif
+
 		// REmap from last to first in reverse order. SizeUp can be triggered by 2 conditions, one
 		// of which is that the last space in the table is occupied and there's nowhere to put new
 		// items. In this case, the table doubles in capacity and the item is put at the
@@ -1511,6 +1748,12 @@ private:
 
 	dict_delete_func delete_func = nullptr;
 	detail::DictEntry<T>* table = nullptr;
+
+#ifdef ZEEK_DICT_CTRL_BYTES
+	// One control byte per slot of the table, followed by DICT_GROUP_SIZE empty ones.
+	uint8_t* ctrl = nullptr;
+#endif
+
 	std::vector<RobustDictIterator<T>*>* iterators = nullptr;
 
 	// Order means the order of insertion. means no deletion until exit. will be inefficient.
@@ -5,11 +5,15 @@
 #include "zeek/zeek-config.h"
 
 #include <algorithm>
+#include <cstring>
 
+#include "zeek/Expr.h"
 #include "zeek/Func.h"
+#include "zeek/ID.h"
 #include "zeek/IP.h"
 #include "zeek/Reporter.h" // for InterpreterException
 #include "zeek/RunState.h"
+#include "zeek/Stmt.h"
 #include "zeek/Val.h"
 #include "zeek/Var.h"
 #include "zeek/ZeekString.h"
@@ -17,6 +21,670 @@
 namespace zeek::detail
 	{
 
+namespace
+	{
+
+// Programs bigger than this aren't worth it. It also bounds the code that
+// gets duplicated for the statements following if-statements.
+constexpr size_t MAX_TESTS = 4096;
+
+void flatten(const Stmt* s, std::vector<const Stmt*>* stmts)
+	{
+	if ( s->Tag() == STMT_LIST )
+		{
+		for ( const auto* si : s->AsStmtList()->Stmts() )
+			flatten(si, stmts);
+		}
+	else
+		stmts->push_back(s);
+	}
+
+// The value of an expression that's a constant, or null.
+ValPtr constant(const Expr* e)
+	{
+	if ( e->Tag() == EXPR_CONST )
+		return e->AsConstExpr()->ValuePtr();
+
+	if ( e->Tag() == EXPR_NAME )
+		{
+		auto id = e->AsNameExpr()->Id();
+
+		if ( id->IsGlobal() && id->IsConst() && ! id->IsOption() )
+			return id->GetVal();
+		}
+
+	return nullptr;
+	}
+
+	} // namespace
+
+std::unique_ptr<DiscarderPredicate> DiscarderPredicate::Compile(const Func* f)
+	{
+	if ( f->GetKind() != Func::SCRIPT_FUNC || f->GetBodies().size() != 1 )
+		return nullptr;
+
+	const auto& params = f->GetType()->Params();
+
+	if ( params->NumFields() == 0 )
+		return nullptr;
+
+	std::unique_ptr<DiscarderPredicate> p{new DiscarderPredicate(params->FieldName(0))};
+
+	std::vector<const Stmt*> stmts;
+	flatten(f->GetBodies()[0].stmts.get(), &stmts);
+
+	auto start = p->CompileStmts(std::move(stmts), 0);
+
+	if ( ! start || p->tests.size() > MAX_TESTS )
+		return nullptr;
+
+	p->start = *start;
+	return p;
+	}
+
+std::optional<int> DiscarderPredicate::CompileStmts(std::vector<const Stmt*> stmts, size_t i)
+	{
+	if ( tests.size() > MAX_TESTS )
+		return std::nullopt;
+
+	for ( ; i < stmts.size(); ++i )
+		{
+		const Stmt* s = stmts[i];
+
+		switch ( s->Tag() )
+			{
+			case STMT_NULL:
+				break;
+
+			case STMT_RETURN:
+				{
+				auto e = s->AsReturnStmt()->StmtExpr();
+
+				if ( ! e )
+					return std::nullopt;
+
+				return CompileCond(e, ACCEPT, REJECT);
+				}
+
+			case STMT_IF:
+				{
+				// Either branch continues with what follows the if.
+				auto is = s->AsIfStmt();
+				std::vector<const Stmt*> t_stmts;
+				std::vector<const Stmt*> f_stmts;
+
+				flatten(is->TrueBranch(), &t_stmts);
+				flatten(is->FalseBranch(), &f_stmts);
+				t_stmts.insert(t_stmts.end(), stmts.begin() + i + 1, stmts.end());
+				f_stmts.insert(f_stmts.end(), stmts.begin() + i + 1, stmts.end());
+
+				auto t = CompileStmts(std::move(t_stmts), 0);
+				auto f = t ? CompileStmts(std::move(f_stmts), 0) : std::nullopt;
+
+				if ( ! f )
+					return std::nullopt;
+
+				return CompileCond(is->StmtExpr(), *t, *f);
+				}
+
+			default:
+				return std::nullopt;
+			}
+		}
+
+	// Falling off the end doesn't return a verdict.
+	return std::nullopt;
+	}
+
+std::optional<int> DiscarderPredicate::CompileCond(const Expr* e, int t, int f)
+	{
+	if ( tests.size() > MAX_TESTS )
+		return std::nullopt;
+
+	switch ( e->Tag() )
+		{
+		case EXPR_CONST:
+		case EXPR_NAME:
+			{
+			auto v = constant(e);
+
+			if ( ! v || v->GetType()->Tag() != TYPE_BOOL )
+				return std::nullopt;
+
+			return v->AsBool() ? t : f;
+			}
+
+		case EXPR_NOT:
+			return CompileCond(e->GetOp1().get(), f, t);
+
+		case EXPR_AND_AND:
+			{
+			auto op2 = CompileCond(e->GetOp2().get(), t, f);
+			return op2 ? CompileCond(e->GetOp1().get(), *op2, f) : std::nullopt;
+			}
+
+		case EXPR_OR_OR:
+			{
+			auto op2 = CompileCond(e->GetOp2().get(), t, f);
+			return op2 ? CompileCond(e->GetOp1().get(), t, *op2) : std::nullopt;
+			}
+
+		case EXPR_HAS_FIELD:
+			{
+			auto hf = e->AsHasFieldExpr();
+			auto layer = ParseLayer(hf->GetOp1().get(), hf->FieldName());
+
+			if ( ! layer )
+				return std::nullopt;
+
+			Test test;
+			test.op = OP_HAS;
+			test.layer = *layer;
+			test.jt = t;
+			test.jf = f;
+			return Emit(test);
+			}
+
+		case EXPR_EQ:
+		case EXPR_NE:
+		case EXPR_LT:
+		case EXPR_LE:
+		case EXPR_GT:
+		case EXPR_GE:
+			return CompileComparison(e, t, f);
+
+		case EXPR_IN:
+			return CompileIn(e, t, f);
+
+		default:
+			return std::nullopt;
+		}
+	}
+
+std::optional<int> DiscarderPredicate::CompileComparison(const Expr* e, int t, int f)
+	{
+	auto tag = e->Tag();
+	auto op1 = e->GetOp1();
+	auto op2 = e->GetOp2();
+	auto v = constant(op2.get());
+
+	if ( ! v )
+		{
+		// Constants on the left move to the right.
+		std::swap(op1, op2);
+		v = constant(op2.get());
+
+		if ( tag == EXPR_LT )
+			tag = EXPR_GT;
+		else if ( tag == EXPR_LE )
+			tag = EXPR_GE;
+		else if ( tag == EXPR_GT )
+			tag = EXPR_LT;
+		else if ( tag == EXPR_GE )
+			tag = EXPR_LE;
+		}
+
+	auto o = v ? ParseOperand(op1.get()) : std::nullopt;
+
+	if ( ! o || v->GetType()->Tag() != o->type )
+		return std::nullopt;
+
+	Test test;
+	test.layer = LayerOf(o->field);
+	test.field = o->field;
+	test.mask = o->mask;
+
+	if ( o->type == TYPE_ADDR )
+		{
+		if ( tag != EXPR_EQ && tag != EXPR_NE )
+			return std::nullopt;
+
+		test.addr = v->AsAddr();
+		}
+	else
+		test.num = v->AsCount();
+
+	// The other comparisons negate these.
+	if ( tag == EXPR_EQ || tag == EXPR_NE )
+		test.op = OP_EQ;
+	else if ( tag == EXPR_LT || tag == EXPR_GE )
+		test.op = OP_LT;
+	else
+		test.op = OP_LE;
+
+	bool negate = tag == EXPR_NE || tag == EXPR_GE || tag == EXPR_GT;
+	test.jt = negate ? f : t;
+	test.jf = negate ? t : f;
+	return Emit(test);
+	}
+
+std::optional<int> DiscarderPredicate::CompileIn(const Expr* e, int t, int f)
+	{
+	auto o = ParseOperand(e->GetOp1().get());
+	auto v = constant(e->GetOp2().get());
+
+	if ( ! o || ! v )
+		return std::nullopt;
+
+	Test test;
+	test.layer = LayerOf(o->field);
+	test.field = o->field;
+	test.mask = o->mask;
+	test.jt = t;
+	test.jf = f;
+
+	const auto& vt = v->GetType();
+
+	if ( vt->Tag() == TYPE_SUBNET )
+		{
+		if ( o->type != TYPE_ADDR )
+			return std::nullopt;
+
+		test.op = OP_IN_SUBNET;
+		test.prefix = v->AsSubNet();
+		return Emit(test);
+		}
+
+	if ( ! vt->IsSet() || vt->AsTableType()->GetIndexTypes().size() != 1 )
+		return std::nullopt;
+
+	auto index_type = vt->AsTableType()->GetIndexTypes()[0]->Tag();
+	auto elems = v->AsTableVal()->ToPureListVal();
+
+	if ( ! elems )
+		return std::nullopt;
+
+	if ( index_type == TYPE_SUBNET && o->type == TYPE_ADDR )
+		{
+		std::vector<IPPrefix> s;
+
+		for ( int i = 0; i < elems->Length(); ++i )
+			s.push_back(elems->Idx(i)->AsSubNet());
+
+		test.op = OP_IN_SUBNETS;
+		test.set = subnet_sets.size();
+		subnet_sets.push_back(std::move(s));
+		}
+
+	else if ( index_type == TYPE_ADDR && o->type == TYPE_ADDR )
+		{
+		std::vector<IPAddr> s;
+
+		for ( int i = 0; i < elems->Length(); ++i )
+			s.push_back(elems->Idx(i)->AsAddr());
+
+		std::sort(s.begin(), s.end());
+		test.op = OP_IN_ADDRS;
+		test.set = addr_sets.size();
+		addr_sets.push_back(std::move(s));
+		}
+
+	else if ( index_type == o->type && (index_type == TYPE_COUNT || index_type == TYPE_PORT) )
+		{
+		std::vector<uint64_t> s;
+
+		for ( int i = 0; i < elems->Length(); ++i )
+			s.push_back(elems->Idx(i)->AsCount());
+
+		std::sort(s.begin(), s.end());
+		test.op = OP_IN_NUMS;
+		test.set = num_sets.size();
+		num_sets.push_back(std::move(s));
+		}
+
+	else
+		return std::nullopt;
+
+	return Emit(test);
+	}
+
+std::optional<DiscarderPredicate::Layer> DiscarderPredicate::ParseLayer(const Expr* e,
+                                                                        const char* name) const
+	{
+	// The record has to be the parameter, not something else of type
+	// pkt_hdr.
+	if ( e->Tag() != EXPR_NAME )
+		return std::nullopt;
+
+	auto id = e->AsNameExpr()->Id();
+
+	if ( id->IsGlobal() || param != id->Name() )
+		return std::nullopt;
+
+	static const std::pair<const char*, Layer> layers[] = {
+		{"ip", LAYER_IP4}, {"ip6", LAYER_IP6}, {"tcp", LAYER_TCP},
+		{"udp", LAYER_UDP}, {"icmp", LAYER_ICMP},
+	};
+
+	for ( const auto& [n, l] : layers )
+		if ( strcmp(n, name) == 0 )
+			return l;
+
+	return std::nullopt;
+	}
+
+std::optional<DiscarderPredicate::Operand> DiscarderPredicate::ParseOperand(const Expr* e) const
+	{
+	uint64_t mask = ~uint64_t(0);
+	ExprPtr masked;
+
+	if ( e->Tag() == EXPR_AND )
+		{
+		masked = e->GetOp1();
+		auto op2 = e->GetOp2();
+		auto v = constant(op2.get());
+
+		if ( ! v )
+			{
+			std::swap(masked, op2);
+			v = constant(op2.get());
+			}
+
+		if ( ! v || v->GetType()->Tag() != TYPE_COUNT )
+			return std::nullopt;
+
+		mask = v->AsCount();
+		e = masked.get();
+		}
+
+	if ( e->Tag() != EXPR_FIELD )
+		return std::nullopt;
+
+	auto fe = e->AsFieldExpr();
+	auto rec = fe->GetOp1();
+
+	if ( rec->Tag() != EXPR_FIELD )
+		return std::nullopt;
+
+	auto layer = ParseLayer(rec->GetOp1().get(), rec->AsFieldExpr()->FieldName());
+
+	if ( ! layer )
+		return std::nullopt;
+
+	static const struct
+		{
+		Layer layer;
+		const char* name;
+		Field field;
+		} fields[] = {
+		{LAYER_IP4, "hl", IP4_HL},
+		{LAYER_IP4, "tos", IP4_TOS},
+		{LAYER_IP4, "len", IP4_LEN},
+		{LAYER_IP4, "id", IP4_ID},
+		{LAYER_IP4, "ttl", IP4_TTL},
+		{LAYER_IP4, "p", IP4_P},
+		{LAYER_IP4, "src", IP4_SRC},
+		{LAYER_IP4, "dst", IP4_DST},
+		{LAYER_IP6, "class", IP6_CLASS},
+		{LAYER_IP6, "flow", IP6_FLOW},
+		{LAYER_IP6, "len", IP6_LEN},
+		{LAYER_IP6, "nxt", IP6_NXT},
+		{LAYER_IP6, "hlim", IP6_HLIM},
+		{LAYER_IP6, "src", IP6_SRC},
+		{LAYER_IP6, "dst", IP6_DST},
+		{LAYER_TCP, "sport", TCP_SPORT},
+		{LAYER_TCP, "dport", TCP_DPORT},
+		{LAYER_TCP, "seq", TCP_SEQ},
+		{LAYER_TCP, "ack", TCP_ACK},
+		{LAYER_TCP, "hl", TCP_HL},
+		{LAYER_TCP, "dl", TCP_DL},
+		{LAYER_TCP, "reserved", TCP_RESERVED},
+		{LAYER_TCP, "flags", TCP_FLAGS},
+		{LAYER_TCP, "win", TCP_WIN},
+		{LAYER_UDP, "sport", UDP_SPORT},
+		{LAYER_UDP, "dport", UDP_DPORT},
+		{LAYER_UDP, "ulen", UDP_ULEN},
+		{LAYER_ICMP, "icmp_type", ICMP_TYPE},
+	};
+
+	auto type = e->GetType()->Tag();
+
+	// Only counts get masked.
+	if ( masked && type != TYPE_COUNT )
+		return std::nullopt;
+
+	for ( const auto& fi : fields )
+		if ( fi.layer == *layer && strcmp(fi.name, fe->FieldName()) == 0 )
+			return Operand{fi.field, mask, type};
+
+	return std::nullopt;
+	}
+
+int DiscarderPredicate::Emit(Test test)
+	{
+	tests.push_back(std::move(test));
+	return static_cast<int>(tests.size()) - 1;
+	}
+
+DiscarderPredicate::Layer DiscarderPredicate::LayerOf(Field f)
+	{
+	if ( f <= IP4_DST )
+		return LAYER_IP4;
+	if ( f <= IP6_DST )
+		return LAYER_IP6;
+	if ( f <= TCP_WIN )
+		return LAYER_TCP;
+	if ( f <= UDP_ULEN )
+		return LAYER_UDP;
+
+	return LAYER_ICMP;
+	}
+
+bool DiscarderPredicate::HasLayer(const IP_Hdr& ip, int caplen, Layer l)
+	{
+	// Unlike when building pkt_hdr, transport headers only count as
+	// present when they got captured in full.
+	int proto = ip.NextProto();
+
+	switch ( l )
+		{
+		case LAYER_IP4:
+			return ip.IP4_Hdr() != nullptr;
+
+		case LAYER_IP6:
+			return ip.IP6_Hdr() != nullptr;
+
+		case LAYER_TCP:
+			return proto == IPPROTO_TCP && caplen >= static_cast<int>(sizeof(struct tcphdr));
+
+		case LAYER_UDP:
+			return proto == IPPROTO_UDP && caplen >= static_cast<int>(sizeof(struct udphdr));
+
+		case LAYER_ICMP:
+			return (proto == IPPROTO_ICMP || proto == IPPROTO_ICMPV6) && caplen > 0;
+		}
+
+	return false;
+	}
+
+bool DiscarderPredicate::Load(const IP_Hdr& ip, int caplen, Field f, uint64_t* num, IPAddr* addr)
+	{
+	if ( ! HasLayer(ip, caplen, LayerOf(f)) )
+		return false;
+
+	const struct ip* ip4 = ip.IP4_Hdr();
+	const struct ip6_hdr* ip6 = ip.IP6_Hdr();
+	const u_char* data = ip.Payload();
+	const struct tcphdr* tp = reinterpret_cast<const struct tcphdr*>(data);
+	const struct udphdr* up = reinterpret_cast<const struct udphdr*>(data);
+
+	switch ( f )
+		{
+		case IP4_HL:
+			*num = ip4->ip_hl * 4;
+			break;
+		case IP4_TOS:
+			*num = ip4->ip_tos;
+			break;
+		case IP4_LEN:
+			*num = ntohs(ip4->ip_len);
+			break;
+		case IP4_ID:
+			*num = ntohs(ip4->ip_id);
+			break;
+		case IP4_TTL:
+			*num = ip4->ip_ttl;
+			break;
+		case IP4_P:
+			*num = ip4->ip_p;
+			break;
+		case IP4_SRC:
+			*addr = IPAddr(ip4->ip_src);
+			break;
+		case IP4_DST:
+			*addr = IPAddr(ip4->ip_dst);
+			break;
+
+		case IP6_CLASS:
+			*num = (ntohl(ip6->ip6_flow) & 0x0ff00000) >> 20;
+			break;
+		case IP6_FLOW:
+			*num = ntohl(ip6->ip6_flow) & 0x000fffff;
+			break;
+		case IP6_LEN:
+			*num = ntohs(ip6->ip6_plen);
+			break;
+		case IP6_NXT:
+			*num = ip6->ip6_nxt;
+			break;
+		case IP6_HLIM:
+			*num = ip6->ip6_hlim;
+			break;
+		case IP6_SRC:
+			*addr = IPAddr(ip6->ip6_src);
+			break;
+		case IP6_DST:
+			*addr = IPAddr(ip6->ip6_dst);
+			break;
+
+		case TCP_SPORT:
+			*num = PortVal::Mask(ntohs(tp->th_sport), TRANSPORT_TCP);
+			break;
+		case TCP_DPORT:
+			*num = PortVal::Mask(ntohs(tp->th_dport), TRANSPORT_TCP);
+			break;
+		case TCP_SEQ:
+			*num = ntohl(tp->th_seq);
+			break;
+		case TCP_ACK:
+			*num = ntohl(tp->th_ack);
+			break;
+		case TCP_HL:
+			*num = tp->th_off * 4;
+			break;
+		case TCP_DL:
+			{
+			int hl = tp->th_off * 4;
+			int payload_len = ip.PayloadLen();
+			*num = payload_len >= hl ? payload_len - hl : 0;
+			break;
+			}
+		case TCP_RESERVED:
+			*num = tp->th_x2;
+			break;
+		case TCP_FLAGS:
+			*num = tp->th_flags;
+			break;
+		case TCP_WIN:
+			*num = ntohs(tp->th_win);
+			break;
+
+		case UDP_SPORT:
+			*num = PortVal::Mask(ntohs(up->uh_sport), TRANSPORT_UDP);
+			break;
+		case UDP_DPORT:
+			*num = PortVal::Mask(ntohs(up->uh_dport), TRANSPORT_UDP);
+			break;
+		case UDP_ULEN:
+			*num = ntohs(up->uh_ulen);
+			break;
+
+		case ICMP_TYPE:
+			// ICMP and ICMPv6 both start with the type.
+			*num = data[0];
+			break;
+		}
+
+	return true;
+	}
+
+bool DiscarderPredicate::Eval(const IP_Hdr& ip, int caplen) const
+	{
+	int i = start;
+
+	while ( i >= 0 )
+		{
+		const auto& test = tests[i];
+		bool result = false;
+
+		if ( test.op == OP_HAS )
+			result = HasLayer(ip, caplen, test.layer);
+		else
+			{
+			uint64_t num = 0;
+			IPAddr addr;
+
+			if ( ! Load(ip, caplen, test.field, &num, &addr) )
+				// Where the script would have failed.
+				return false;
+
+			num &= test.mask;
+
+			switch ( test.op )
+				{
+				case OP_EQ:
+					if ( test.field == IP4_SRC || test.field == IP4_DST ||
+					     test.field == IP6_SRC || test.field == IP6_DST )
+						result = addr == test.addr;
+					else
+						result = num == test.num;
+					break;
+
+				case OP_LT:
+					result = num < test.num;
+					break;
+
+				case OP_LE:
+					result = num <= test.num;
+					break;
+
+				case OP_IN_SUBNET:
+					result = test.prefix.Contains(addr);
+					break;
+
+				case OP_IN_NUMS:
+					{
+					const auto& s = num_sets[test.set];
+					result = std::binary_search(s.begin(), s.end(), num);
+					break;
+					}
+
+				case OP_IN_ADDRS:
+					{
+					const auto& s = addr_sets[test.set];
+					result = std::binary_search(s.begin(), s.end(), addr);
+					break;
+					}
+
+				case OP_IN_SUBNETS:
+					{
+					const auto& s = subnet_sets[test.set];
+					result = std::any_of(s.begin(), s.end(),
+					                     [&addr](const IPPrefix& p) { return p.Contains(addr); });
+					break;
+					}
+
+				case OP_HAS:
+					break;
+				}
+			}
+
+		i = result ? test.jt : test.jf;
+		}
+
+	return i == ACCEPT;
+	}
+
 Discarder::Discarder()
 	{
 	check_ip = id::find_func("discarder_check_ip");
@@ -25,6 +693,18 @@ Discarder::Discarder()
 	check_icmp = id::find_func("discarder_check_icmp");
 
 	discarder_maxlen = static_cast<int>(id::find_val("discarder_maxlen")->AsCount());
+
+	if ( id::find_val("discarder_compile")->AsBool() )
+		{
+		if ( check_ip )
+			ip_predicate = DiscarderPredicate::Compile(check_ip.get());
+		if ( check_tcp )
+			tcp_predicate = DiscarderPredicate::Compile(check_tcp.get());
+		if ( check_udp )
+			udp_predicate = DiscarderPredicate::Compile(check_udp.get());
+		if ( check_icmp )
+			icmp_predicate = DiscarderPredicate::Compile(check_icmp.get());
+		}
 	}
 
 Discarder::~Discarder() { }
@@ -38,7 +718,13 @@ bool Discarder::NextPacket(const std::shared_ptr<IP_Hdr>& ip, int len, int caple
 	{
 	bool discard_packet = false;
 
-	if ( check_ip )
+	if ( ip_predicate )
+		{
+		if ( ip_predicate->Eval(*ip, caplen - ip->HdrLen()) )
+			return true;
+		}
+
+	else if ( check_ip )
 		{
 		zeek::Args args{ip->ToPktHdrVal()};
 
@@ -85,7 +771,10 @@ bool Discarder::NextPacket(const std::shared_ptr<IP_Hdr>& ip, int len, int caple
 
 	if ( is_tcp )
 		{
-		if ( check_tcp )
+		if ( tcp_predicate )
+			discard_packet = tcp_predicate->Eval(*ip, caplen);
+
+		else if ( check_tcp )
 			{
 			const struct tcphdr* tp = (const struct tcphdr*)data;
 			int th_len = tp->th_off * 4;
@@ -109,7 +798,10 @@ bool Discarder::NextPacket(const std::shared_ptr<IP_Hdr>& ip, int len, int caple
 
 	else if ( is_udp )
 		{
-		if ( check_udp )
+		if ( udp_predicate )
+			discard_packet = udp_predicate->Eval(*ip, caplen);
+
+		else if ( check_udp )
 			{
 			const struct udphdr* up = (const struct udphdr*)data;
 			int uh_len = sizeof(struct udphdr);
@@ -133,7 +825,10 @@ bool Discarder::NextPacket(const std::shared_ptr<IP_Hdr>& ip, int len, int caple
 
 	else
 		{
-		if ( check_icmp )
+		if ( icmp_predicate )
+			discard_packet = icmp_predicate->Eval(*ip, caplen);
+
+		else if ( check_icmp )
 			{
 			const struct icmp* ih = (const struct icmp*)data;
 
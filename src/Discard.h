@@ -3,9 +3,15 @@
 #pragma once
 
 #include <sys/types.h> // for u_char
+#include <cstdint>
 #include <memory>
+#include <optional>
+#include <string>
+#include <vector>
 
+#include "zeek/IPAddr.h"
 #include "zeek/IntrusivePtr.h"
+#include "zeek/Type.h"
 
 namespace zeek
 	{
@@ -18,6 +24,172 @@ using FuncPtr = IntrusivePtr<Func>;
 namespace detail
 	{
 
+class Expr;
+class Stmt;
+
+/**
+ * A native form of a discarder_check_* function, for functions whose body
+ * only decides on the packet's header fields. Such a function gets compiled
+ * into a small program of tests, each of which jumps to another test or to
+ * a verdict depending on its outcome, like BPF does. Evaluating it reads
+ * the headers directly, without building a pkt_hdr record or calling into
+ * the interpreter.
+ *
+ * Bodies that fit consist of if-statements and return-statements, with
+ * conditions combining these via &&, || and ! :
+ *
+ *  - comparisons of pkt_hdr fields of type count, port or addr with
+ *    constants, optionally masking counts with a constant via &;
+ *  - tests of fields of type addr for membership in constant subnets;
+ *  - tests of fields for membership in constant sets of addresses,
+ *    subnets, ports or counts;
+ *  - tests for presence of pkt_hdr's header records, via ?$ .
+ *
+ * Constants may be literals or globals declared const. As with the
+ * interpreter, which gives up on the function when it accesses a field
+ * that isn't there, such an access (say, to $ip on an IPv6 packet) makes
+ * the verdict false.
+ */
+class DiscarderPredicate
+	{
+public:
+	/**
+	 * Compiles a discarder function.
+	 *
+	 * @return The predicate, or null if the function's body doesn't fit.
+	 */
+	static std::unique_ptr<DiscarderPredicate> Compile(const Func* f);
+
+	/**
+	 * Decides on a packet.
+	 *
+	 * @param ip The packet's IP header.
+	 *
+	 * @param caplen The number of bytes captured after the IP header, to
+	 * tell whether the transport header is there.
+	 *
+	 * @return The verdict the function would have returned.
+	 */
+	bool Eval(const IP_Hdr& ip, int caplen) const;
+
+	/**
+	 * @return The number of tests in the program.
+	 */
+	size_t NumTests() const { return tests.size(); }
+
+private:
+	// The header records of pkt_hdr.
+	enum Layer
+		{
+		LAYER_IP4,
+		LAYER_IP6,
+		LAYER_TCP,
+		LAYER_UDP,
+		LAYER_ICMP
+		};
+
+	// The fields of those.
+	enum Field
+		{
+		IP4_HL,
+		IP4_TOS,
+		IP4_LEN,
+		IP4_ID,
+		IP4_TTL,
+		IP4_P,
+		IP4_SRC,
+		IP4_DST,
+		IP6_CLASS,
+		IP6_FLOW,
+		IP6_LEN,
+		IP6_NXT,
+		IP6_HLIM,
+		IP6_SRC,
+		IP6_DST,
+		TCP_SPORT,
+		TCP_DPORT,
+		TCP_SEQ,
+		TCP_ACK,
+		TCP_HL,
+		TCP_DL,
+		TCP_RESERVED,
+		TCP_FLAGS,
+		TCP_WIN,
+		UDP_SPORT,
+		UDP_DPORT,
+		UDP_ULEN,
+		ICMP_TYPE
+		};
+
+	enum Op
+		{
+		OP_HAS, // the layer is present
+		OP_EQ, // (field & mask) == num, or field == addr
+		OP_LT, // (field & mask) < num
+		OP_LE, // (field & mask) <= num
+		OP_IN_SUBNET, // field in prefix
+		OP_IN_NUMS, // field in num_sets[set]
+		OP_IN_ADDRS, // field in addr_sets[set]
+		OP_IN_SUBNETS // field in one of subnet_sets[set]
+		};
+
+	// Where tests jump to for the verdicts.
+	static constexpr int ACCEPT = -1;
+	static constexpr int REJECT = -2;
+
+	struct Test
+		{
+		Op op;
+		Layer layer = LAYER_IP4;
+		Field field = IP4_HL;
+		uint64_t mask = ~uint64_t(0);
+		uint64_t num = 0;
+		IPAddr addr;
+		IPPrefix prefix;
+		int set = 0;
+
+		// The next test for outcomes true and false.
+		int jt;
+		int jf;
+		};
+
+	// An operand of a test: a field, possibly masked.
+	struct Operand
+		{
+		Field field;
+		uint64_t mask;
+		TypeTag type;
+		};
+
+	DiscarderPredicate(std::string param) : param(std::move(param)) { }
+
+	// Each of these returns where to start, or nothing if the code
+	// doesn't fit.
+	std::optional<int> CompileStmts(std::vector<const Stmt*> stmts, size_t i);
+	std::optional<int> CompileCond(const Expr* e, int t, int f);
+	std::optional<int> CompileComparison(const Expr* e, int t, int f);
+	std::optional<int> CompileIn(const Expr* e, int t, int f);
+
+	std::optional<Layer> ParseLayer(const Expr* e, const char* name) const;
+	std::optional<Operand> ParseOperand(const Expr* e) const;
+
+	int Emit(Test test);
+
+	static Layer LayerOf(Field f);
+
+	// Loads a field, returning false if its layer isn't present.
+	static bool Load(const IP_Hdr& ip, int caplen, Field f, uint64_t* num, IPAddr* addr);
+	static bool HasLayer(const IP_Hdr& ip, int caplen, Layer l);
+
+	// The name of the pkt_hdr parameter.
+	std::string param;
+	int start = REJECT;
+	std::vector<Test> tests;
+	std::vector<std::vector<uint64_t>> num_sets;
+	std::vector<std::vector<IPAddr>> addr_sets;
+	std::vector<std::vector<IPPrefix>> subnet_sets;
+	};
+
 class Discarder
 	{
 public:
@@ -36,6 +208,12 @@ protected:
 	FuncPtr check_udp;
 	FuncPtr check_icmp;
 
+	// The native forms of those that have one.
+	std::unique_ptr<DiscarderPredicate> ip_predicate;
+	std::unique_ptr<DiscarderPredicate> tcp_predicate;
+	std::unique_ptr<DiscarderPredicate> udp_predicate;
+	std::unique_ptr<DiscarderPredicate> icmp_predicate;
+
 	// Maximum amount of application data passed to filtering functions.
 	int discarder_maxlen;
 	};
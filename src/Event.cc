@@ -4,21 +4,29 @@
 
 #include "zeek/zeek-config.h"
 
+#include <utility>
+#include <vector>
+
 #include "zeek/Desc.h"
+#include "zeek/EventReplay.h"
 #include "zeek/Func.h"
 #include "zeek/NetVar.h"
+#include "zeek/PacketTracer.h"
 #include "zeek/RunState.h"
 #include "zeek/Trigger.h"
 #include "zeek/Val.h"
 #include "zeek/iosource/Manager.h"
 #include "zeek/iosource/PktSrc.h"
 #include "zeek/plugin/Manager.h"
+#include "zeek/telemetry/Manager.h"
 
 zeek::EventMgr zeek::event_mgr;
 
 namespace zeek
 	{
 
+detail::MemoryPool Event::pool("event", detail::ARENA_VALUES);
+
 Event::Event(EventHandlerPtr arg_handler, zeek::Args arg_args, util::detail::SourceID arg_src,
              analyzer::ID arg_aid, Obj* arg_obj)
 	: handler(arg_handler), args(std::move(arg_args)), src(arg_src), aid(arg_aid), obj(arg_obj),
@@ -51,6 +59,25 @@ void Event::Dispatch(bool no_remote)
 	if ( handler->ErrorHandler() )
 		reporter->BeginErrorHandler();
 
+	double start = 0.0;
+	double traced_start = 0.0;
+	double cpu_start = 0.0;
+
+	if ( event_mgr.HandlerProfiling() )
+		start = util::current_time();
+
+	if ( detail::event_recorder && ! from_script )
+		detail::event_recorder->Record(this);
+
+	if ( detail::event_replayer )
+		cpu_start = detail::EventReplayer::CPUTime();
+
+	if ( traced_at > 0.0 && detail::tracing_packet() )
+		{
+		traced_start = util::current_time(true);
+		detail::packet_tracer->Record(detail::PacketTracer::EVENT_QUEUE, traced_start - traced_at);
+		}
+
 	try
 		{
 		handler->Call(&args, no_remote);
@@ -61,6 +88,18 @@ void Event::Dispatch(bool no_remote)
 		// Already reported.
 		}
 
+	if ( detail::event_replayer )
+		detail::event_replayer->RecordDispatch(handler.Ptr(),
+		                                       detail::EventReplayer::CPUTime() - cpu_start);
+
+	if ( start > 0.0 )
+		handler->RecordDispatch(util::current_time() - start,
+		                        queued_at > 0.0 ? start - queued_at : -1.0);
+
+	if ( traced_start > 0.0 && detail::tracing_packet() )
+		detail::packet_tracer->Record(detail::PacketTracer::HANDLER_EXECUTION,
+		                              util::current_time(true) - traced_start);
+
 	if ( obj )
 		// obj->EventDone();
 		Unref(obj);
@@ -69,9 +108,70 @@ void Event::Dispatch(bool no_remote)
 		reporter->EndErrorHandler();
 	}
 
+namespace
+	{
+
+const char* priority_class_names[NUM_EVENT_PRIORITY_CLASSES] = {"high", "normal", "low"};
+
+// One in this many queued events gets its latency from queueing to
+// dispatch measured.
+constexpr uint64_t LATENCY_SAMPLE_INTERVAL = 64;
+
+struct EventQueueMetrics
+	{
+	std::vector<telemetry::IntGauge> depths;
+	std::vector<telemetry::DblHistogram> latencies;
+
+	EventQueueMetrics()
+		{
+		static constexpr double latency_bounds[] = {0.0001, 0.001, 0.01, 0.1, 1.0, 10.0};
+
+		for ( auto name : priority_class_names )
+			{
+			depths.push_back(telemetry_mgr->GaugeInstance(
+				"zeek", "event-queue-depth", {{"priority", name}},
+				"Events queued when Zeek last started to drain the event queue"));
+			latencies.push_back(telemetry_mgr->HistogramInstance<double>(
+				"zeek", "event-queue-latency", {{"priority", name}}, latency_bounds,
+				"Time from queueing sampled events to dispatching them", "seconds"));
+			}
+		}
+	};
+
+EventQueueMetrics* metrics()
+	{
+	static EventQueueMetrics* m = nullptr;
+
+	// Events get queued before the telemetry manager exists.
+	if ( ! telemetry_mgr )
+		return nullptr;
+
+	if ( ! m )
+		m = new EventQueueMetrics();
+
+	return m;
+	}
+
+	} // namespace
+
+void EventMgr::EventList::Append(Event* first)
+	{
+	if ( ! first )
+		return;
+
+	if ( tail )
+		tail->SetNext(first);
+	else
+		head = first;
+
+	tail = first;
+
+	while ( tail->NextEvent() )
+		tail = tail->NextEvent();
+	}
+
 EventMgr::EventMgr()
 	{
-	head = tail = nullptr;
 	current_src = util::detail::SOURCE_LOCAL;
 	current_aid = 0;
 	src_val = nullptr;
@@ -80,16 +180,31 @@ EventMgr::EventMgr()
 
 EventMgr::~EventMgr()
 	{
-	while ( head )
-		{
-		Event* n = head->NextEvent();
-		Unref(head);
-		head = n;
-		}
+	for ( auto lists : {queues, deferred} )
+		for ( int c = 0; c < NUM_EVENT_PRIORITY_CLASSES; ++c )
+			{
+			Event* e = lists[c].head;
+
+			while ( e )
+				{
+				Event* n = e->NextEvent();
+				Unref(e);
+				e = n;
+				}
+			}
 
 	Unref(src_val);
 	}
 
+bool EventMgr::HasEvents() const
+	{
+	for ( int c = 0; c < NUM_EVENT_PRIORITY_CLASSES; ++c )
+		if ( queues[c].head || deferred[c].head )
+			return true;
+
+	return false;
+	}
+
 void EventMgr::Enqueue(const EventHandlerPtr& h, Args vl, util::detail::SourceID src,
                        analyzer::ID aid, Obj* obj)
 	{
@@ -103,18 +218,28 @@ void EventMgr::QueueEvent(Event* event)
 	if ( done )
 		return;
 
-	if ( ! head )
-		{
-		head = tail = event;
+	if ( ! HasEvents() )
 		queue_flare.Fire();
-		}
+
+	auto& q = queues[event->Handler()->PriorityClass()];
+
+	if ( q.tail )
+		q.tail->SetNext(event);
 	else
+		q.head = event;
+
+	q.tail = event;
+
+	event->from_script = script_scopes > 0 || ! detail::call_stack.empty();
+
+	if ( ++event_mgr.num_events_queued % LATENCY_SAMPLE_INTERVAL == 0 || handler_profiling )
+		event->queued_at = util::current_time();
+
+	if ( detail::tracing_packet() )
 		{
-		tail->SetNext(event);
-		tail = event;
+		event->traced_at = util::current_time(true);
+		detail::packet_tracer->Reached(detail::PacketTracer::FIRST_EVENT);
 		}
-
-	++event_mgr.num_events_queued;
 	}
 
 void EventMgr::Dispatch(Event* event, bool no_remote)
@@ -124,6 +249,103 @@ void EventMgr::Dispatch(Event* event, bool no_remote)
 	Unref(event);
 	}
 
+// Moves the events following the given one that have the same handler to
+// right after it, keeping their order, and returns the last of them.
+static Event* gather_batch(Event* first)
+	{
+	auto h = first->Handler();
+	Event* batch_tail = first;
+	Event* others = nullptr;
+	Event* others_tail = nullptr;
+
+	for ( Event* e = first->NextEvent(); e; e = e->NextEvent() )
+		{
+		if ( e->Handler() == h )
+			{
+			batch_tail->SetNext(e);
+			batch_tail = e;
+			}
+		else
+			{
+			if ( others_tail )
+				others_tail->SetNext(e);
+			else
+				others = e;
+
+			others_tail = e;
+			}
+		}
+
+	if ( others_tail )
+		others_tail->SetNext(nullptr);
+
+	batch_tail->SetNext(others);
+
+	return batch_tail;
+	}
+
+Event* EventMgr::DispatchEvents(Event* current, double deadline)
+	{
+	// The last event of the batch being dispatched, if any.
+	Event* batch_end = nullptr;
+
+	while ( current )
+		{
+		if ( deadline > 0.0 && util::current_time() > deadline )
+			return current;
+
+		if ( ! batch_end && current->Handler()->Batchable() )
+			batch_end = gather_batch(current);
+
+		if ( current == batch_end )
+			batch_end = nullptr;
+
+		Event* next = current->NextEvent();
+
+		if ( current->queued_at > 0.0 )
+			{
+			if ( auto* mx = metrics() )
+				mx->latencies[current->Handler()->PriorityClass()].Observe(util::current_time() -
+				                                                           current->queued_at);
+			}
+
+		current_src = current->Source();
+		current_aid = current->Analyzer();
+		current->Dispatch();
+		Unref(current);
+
+		++event_mgr.num_events_dispatched;
+		current = next;
+		}
+
+	return nullptr;
+	}
+
+void EventMgr::UpdateQueueMetrics()
+	{
+	auto* mx = metrics();
+
+	if ( ! mx )
+		return;
+
+	for ( int c = 0; c < NUM_EVENT_PRIORITY_CLASSES; ++c )
+		{
+		int64_t n = 0;
+
+		for ( auto lists : {queues, deferred} )
+			for ( Event* e = lists[c].head; e; e = e->NextEvent() )
+				++n;
+
+		auto& depth = mx->depths[c];
+		auto diff = n - depth.Value();
+
+		if ( diff > 0 )
+			depth.Inc(diff);
+		else if ( diff < 0 )
+			depth.Dec(-diff);
+		}
+	}
+
 void EventMgr::Drain()
 	{
 	if ( event_queue_flush_point )
@@ -133,8 +355,27 @@ void EventMgr::Drain()
 
 	PLUGIN_HOOK_VOID(HOOK_DRAIN_EVENTS, HookDrainEvents());
 
+	UpdateQueueMetrics();
+
 	draining = true;
 
+	// With a time budget, events that don't get their turn before the
+	// deadline wait for the next drain, unless they're of the high
+	// priority class. The events a previous drain left that way don't
+	// count against this one's budget, so every event gets dispatched
+	// within two drains of being queued.
+	double deadline = 0.0;
+
+	if ( detail::event_drain_budget > 0.0 )
+		deadline = util::current_time() + detail::event_drain_budget;
+
+	EventList carried[NUM_EVENT_PRIORITY_CLASSES];
+
+	for ( int c = 0; c < NUM_EVENT_PRIORITY_CLASSES; ++c )
+		carried[c] = std::exchange(deferred[c], EventList{});
+
+	bool out_of_time = false;
+
 	// Past Zeek versions drained as long as there events, including when
 	// a handler queued new events during its execution. This could lead
 	// to endless loops in case a handler kept triggering its own event.
@@ -142,26 +383,42 @@ void EventMgr::Drain()
 	// just one round to make it less likley to break existing scripts
 	// that expect the old behavior to trigger something quickly.
 
-	for ( int round = 0; head && round < 2; round++ )
+	for ( int round = 0; round < 2; round++ )
 		{
-		Event* current = head;
-		head = nullptr;
-		tail = nullptr;
+		EventList current[NUM_EVENT_PRIORITY_CLASSES];
+		bool have_events = false;
+
+		for ( int c = 0; c < NUM_EVENT_PRIORITY_CLASSES; ++c )
+			{
+			current[c] = std::exchange(queues[c], EventList{});
+			have_events = have_events || current[c].head || carried[c].head;
+			}
 
-		while ( current )
+		if ( ! have_events )
+			break;
+
+		for ( int c = 0; c < NUM_EVENT_PRIORITY_CLASSES; ++c )
 			{
-			Event* next = current->NextEvent();
+			DispatchEvents(std::exchange(carried[c].head, nullptr));
+
+			double class_deadline = c == EVENT_PRIORITY_HIGH ? 0.0 : deadline;
+			Event* rest = current[c].head;
 
-			current_src = current->Source();
-			current_aid = current->Analyzer();
-			current->Dispatch();
-			Unref(current);
+			if ( ! out_of_time || class_deadline == 0.0 )
+				rest = DispatchEvents(rest, class_deadline);
 
-			++event_mgr.num_events_dispatched;
-			current = next;
+			if ( rest )
+				{
+				out_of_time = true;
+				deferred[c].Append(rest);
+				}
 			}
 		}
 
+	// Make sure we get to the deferred events soon.
+	if ( out_of_time )
+		queue_flare.Fire();
+
 	// Note: we might eventually need a general way to specify things to
 	// do after draining events.
 	draining = false;
@@ -174,17 +431,21 @@ void EventMgr::Drain()
 void EventMgr::Describe(ODesc* d) const
 	{
 	int n = 0;
-	Event* e;
-	for ( e = head; e; e = e->NextEvent() )
-		++n;
+
+	for ( auto lists : {deferred, queues} )
+		for ( int c = 0; c < NUM_EVENT_PRIORITY_CLASSES; ++c )
+			for ( Event* e = lists[c].head; e; e = e->NextEvent() )
+				++n;
 
 	d->AddCount(n);
 
-	for ( e = head; e; e = e->NextEvent() )
-		{
-		e->Describe(d);
-		d->NL();
-		}
+	for ( auto lists : {deferred, queues} )
+		for ( int c = 0; c < NUM_EVENT_PRIORITY_CLASSES; ++c )
+			for ( Event* e = lists[c].head; e; e = e->NextEvent() )
+				{
+				e->Describe(d);
+				d->NL();
+				}
 	}
 
 void EventMgr::Process()
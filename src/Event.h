@@ -5,8 +5,10 @@
 #include <tuple>
 #include <type_traits>
 
+#include "zeek/EventHandler.h"
 #include "zeek/Flare.h"
 #include "zeek/IntrusivePtr.h"
+#include "zeek/MemoryPool.h"
 #include "zeek/ZeekArgs.h"
 #include "zeek/ZeekList.h"
 #include "zeek/analyzer/Analyzer.h"
@@ -24,6 +26,10 @@ public:
 	      util::detail::SourceID src = util::detail::SOURCE_LOCAL, analyzer::ID aid = 0,
 	      Obj* obj = nullptr);
 
+	// Events live only until they've been dispatched, so with memory
+	// pools enabled they're allocated from a dedicated pool.
+	ZEEK_POOL_ALLOCATED(pool)
+
 	void SetNext(Event* n) { next_event = n; }
 	Event* NextEvent() const { return next_event; }
 
@@ -32,6 +38,10 @@ public:
 	EventHandlerPtr Handler() const { return handler; }
 	const zeek::Args& Args() const { return args; }
 
+	// True if a script raised the event, including by scheduling it,
+	// rather than the engine.
+	bool FromScript() const { return from_script; }
+
 	void Describe(ODesc* d) const override;
 
 protected:
@@ -47,6 +57,19 @@ protected:
 	analyzer::ID aid;
 	Obj* obj;
 	Event* next_event;
+
+	// When the event got queued, if it's one of those sampled for
+	// measuring queueing latency or handler profiling is on, and 0
+	// otherwise.
+	double queued_at = 0.0;
+
+	// When the event got queued, if that happened during the processing
+	// of a packet traced by the PacketTracer, and 0 otherwise.
+	double traced_at = 0.0;
+
+	bool from_script = false;
+
+	static detail::MemoryPool pool;
 	};
 
 class EventMgr final : public Obj, public iosource::IOSource
@@ -86,7 +109,7 @@ public:
 	void Drain();
 	bool IsDraining() const { return draining; }
 
-	bool HasEvents() const { return head != nullptr; }
+	bool HasEvents() const;
 
 	// Returns the source ID of last raised event.
 	util::detail::SourceID CurrentSource() const { return current_src; }
@@ -97,6 +120,12 @@ public:
 
 	int Size() const { return num_events_queued - num_events_dispatched; }
 
+	// Turns on or off the timing of each dispatch and the measuring of
+	// each event's time in the queue, per event handler.  Off by default,
+	// as that takes two clock reads per event.
+	void SetHandlerProfiling(bool enable) { handler_profiling = enable; }
+	bool HandlerProfiling() const { return handler_profiling; }
+
 	void Describe(ODesc* d) const override;
 
 	double GetNextTimeout() override { return -1; }
@@ -107,18 +136,64 @@ public:
 	uint64_t num_events_queued = 0;
 	uint64_t num_events_dispatched = 0;
 
+	// While positive, queued events count as raised by scripts even
+	// without a script function executing, see ScriptEventScope.
+	int script_scopes = 0;
+
 protected:
+	// A list of queued events, linked through the events themselves.
+	struct EventList
+		{
+		Event* head = nullptr;
+		Event* tail = nullptr;
+
+		// Adds events linked to each other to the end of the list.
+		void Append(Event* first);
+		};
+
 	void QueueEvent(Event* event);
 
-	Event* head;
-	Event* tail;
+	// Dispatches a list of events, in order but for batching.  Returns
+	// the first event not dispatched because the deadline passed, if
+	// given and any.
+	Event* DispatchEvents(Event* events, double deadline = 0.0);
+
+	// Reports the current queue depths to telemetry.
+	void UpdateQueueMetrics();
+
+	// The queues of events by priority class, each in order of queueing.
+	EventList queues[NUM_EVENT_PRIORITY_CLASSES];
+
+	// Events that Drain() left for lack of time. The next Drain()
+	// dispatches them before the events queued since.
+	EventList deferred[NUM_EVENT_PRIORITY_CLASSES];
+
 	util::detail::SourceID current_src;
 	analyzer::ID current_aid;
 	RecordVal* src_val;
 	bool draining;
+	bool handler_profiling = false;
 	detail::Flare queue_flare;
 	};
 
 extern EventMgr event_mgr;
 
+namespace detail
+	{
+
+// Marks the events queued during its lifetime as raised by scripts, for
+// script code that runs outside of script functions, such as timers of
+// scheduled events and the bodies of when statements.
+class ScriptEventScope
+	{
+public:
+	ScriptEventScope() { ++event_mgr.script_scopes; }
+	~ScriptEventScope() { --event_mgr.script_scopes; }
+
+	ScriptEventScope(const ScriptEventScope&) = delete;
+	ScriptEventScope& operator=(const ScriptEventScope&) = delete;
+	};
+
+	} // namespace detail
+
 	} // namespace zeek
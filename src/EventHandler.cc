@@ -1,18 +1,49 @@
 #include "zeek/EventHandler.h"
 
+#include <algorithm>
+
 #include "zeek/Desc.h"
 #include "zeek/Event.h"
+#include "zeek/EventReplay.h"
+#include "zeek/EventTrace.h"
 #include "zeek/Func.h"
 #include "zeek/ID.h"
 #include "zeek/NetVar.h"
+#include "zeek/PacketTracer.h"
 #include "zeek/Scope.h"
 #include "zeek/Var.h"
 #include "zeek/broker/Data.h"
 #include "zeek/broker/Manager.h"
+#include "zeek/broker/ValWire.h"
+#include "zeek/plugin/Manager.h"
+#include "zeek/telemetry/Manager.h"
 
 namespace zeek
 	{
 
+struct EventHandler::Timings
+	{
+	static constexpr double latency_bounds[] = {0.00001, 0.0001, 0.001, 0.01, 0.1, 1.0};
+	static constexpr double queue_delay_bounds[] = {0.0001, 0.001, 0.01, 0.1, 1.0, 10.0};
+
+	explicit Timings(const std::string& name)
+		: time(telemetry_mgr->CounterInstance<double>(
+			  "zeek", "event-handler-time", {{"name", name}},
+			  "Time spent in event handlers while profiling them", "seconds", true)),
+		  latency(telemetry_mgr->HistogramInstance<double>(
+			  "zeek", "event-handler-latency", {{"name", name}}, latency_bounds,
+			  "Durations of event handler calls while profiling them", "seconds")),
+		  queue_delay(telemetry_mgr->HistogramInstance<double>(
+			  "zeek", "event-handler-queue-delay", {{"name", name}}, queue_delay_bounds,
+			  "Time events waited in the queue while profiling their handlers", "seconds"))
+		{
+		}
+
+	telemetry::ShardedDblCounter time;
+	telemetry::ShardedDblHistogram latency;
+	telemetry::ShardedDblHistogram queue_delay;
+	};
+
 EventHandler::EventHandler(std::string arg_name)
 	{
 	name = std::move(arg_name);
@@ -20,13 +51,33 @@ EventHandler::EventHandler(std::string arg_name)
 	error_handler = false;
 	enabled = true;
 	generate_always = false;
+	batchable = false;
+	priority_class = EVENT_PRIORITY_NORMAL;
 	}
 
+EventHandler::~EventHandler() = default;
+
 EventHandler::operator bool() const
 	{
 	return enabled && ((local && local->HasBodies()) || generate_always || ! auto_publish.empty());
 	}
 
+bool EventHandler::ArgUsed(int n) const
+	{
+	if ( n < 0 || static_cast<size_t>(n) >= used_args.size() )
+		return true;
+
+	if ( generate_always || ! auto_publish.empty() || new_event || detail::etm ||
+	     detail::event_recorder )
+		return true;
+
+	if ( plugin_mgr->HavePluginForHook(plugin::HOOK_QUEUE_EVENT) ||
+	     plugin_mgr->HavePluginForHook(plugin::HOOK_CALL_FUNCTION) )
+		return true;
+
+	return used_args[n];
+	}
+
 const FuncTypePtr& EventHandler::GetType(bool check_export)
 	{
 	if ( type )
@@ -52,6 +103,17 @@ void EventHandler::SetFunc(FuncPtr f)
 
 void EventHandler::Call(Args* vl, bool no_remote)
 	{
+	if ( ! calls && telemetry_mgr )
+		{
+		auto family = telemetry_mgr->CounterFamily("zeek", "event-handler-calls", {"name"},
+		                                           "Calls of event handlers", "1", true);
+		calls = std::make_unique<telemetry::ShardedIntCounter>(
+			family.GetOrAdd({{"name", name}}));
+		}
+
+	if ( calls )
+		calls->Inc();
+
 	if ( new_event )
 		NewEvent(vl);
 
@@ -59,23 +121,38 @@ void EventHandler::Call(Args* vl, bool no_remote)
 		{
 		if ( ! auto_publish.empty() )
 			{
+			if ( detail::tracing_packet() )
+				detail::packet_tracer->Reached(detail::PacketTracer::FIRST_PUBLISH);
+
+			detail::PacketTraceScope pts(detail::PacketTracer::BROKER_PUBLISH);
+
 			// Send event in form [name, xs...] where xs represent the arguments.
 			broker::vector xs;
 			xs.reserve(vl->size());
 			bool valid_args = true;
+			std::optional<broker::vector> wire_xs;
 
-			for ( auto i = 0u; i < vl->size(); ++i )
-				{
-				auto opt_data = Broker::detail::val_to_data((*vl)[i].get());
+			if ( broker_mgr->WireEvents() )
+				wire_xs = Broker::detail::encode_event_args(GetType()->ParamList()->GetTypes(),
+				                                            *vl);
 
-				if ( opt_data )
-					xs.emplace_back(std::move(*opt_data));
-				else
+			if ( wire_xs )
+				xs = std::move(*wire_xs);
+			else
+				{
+				for ( auto i = 0u; i < vl->size(); ++i )
 					{
-					valid_args = false;
-					auto_publish.clear();
-					reporter->Error("failed auto-remote event '%s', disabled", Name());
-					break;
+					auto opt_data = Broker::detail::val_to_data((*vl)[i].get());
+
+					if ( opt_data )
+						xs.emplace_back(std::move(*opt_data));
+					else
+						{
+						valid_args = false;
+						auto_publish.clear();
+						reporter->Error("failed auto-remote event '%s', disabled", Name());
+						break;
+						}
 					}
 				}
 
@@ -103,6 +180,26 @@ void EventHandler::Call(Args* vl, bool no_remote)
 		local->Invoke(vl);
 	}
 
+void EventHandler::RecordDispatch(double duration, double queue_delay)
+	{
+	if ( ! timings )
+		{
+		if ( ! telemetry_mgr )
+			return;
+
+		timings = std::make_unique<Timings>(name);
+		}
+
+	// The clock may have gone backwards.
+	duration = std::max(duration, 0.0);
+
+	timings->time.Inc(duration);
+	timings->latency.Observe(duration);
+
+	if ( queue_delay >= 0.0 )
+		timings->queue_delay.Observe(queue_delay);
+	}
+
 void EventHandler::NewEvent(Args* vl)
 	{
 	if ( ! new_event )
@@ -2,8 +2,12 @@
 
 #pragma once
 
+#include <cstdint>
+#include <memory>
 #include <string>
 #include <unordered_set>
+#include <utility>
+#include <vector>
 
 #include "zeek/Type.h"
 #include "zeek/ZeekArgs.h"
@@ -15,10 +19,27 @@ namespace zeek
 class Func;
 using FuncPtr = IntrusivePtr<Func>;
 
+namespace telemetry
+	{
+template <class ValueType> class ShardedCounter;
+using ShardedIntCounter = ShardedCounter<int64_t>;
+	}
+
+// The classes of events by priority, from the one dispatched first to the
+// one dispatched last. These match the script-level EventPriorityClass.
+enum EventPriorityClass
+	{
+	EVENT_PRIORITY_HIGH,
+	EVENT_PRIORITY_NORMAL,
+	EVENT_PRIORITY_LOW,
+	NUM_EVENT_PRIORITY_CLASSES
+	};
+
 class EventHandler
 	{
 public:
 	explicit EventHandler(std::string name);
+	~EventHandler();
 
 	const char* Name() const { return name.data(); }
 
@@ -52,7 +73,39 @@ public:
 	void SetGenerateAlways() { generate_always = true; }
 	bool GenerateAlways() { return generate_always; }
 
+	// Flags the event as one whose queued instances may run back to
+	// back, ahead of other events queued in between.  This suits
+	// high-volume events whose handlers don't depend on the order
+	// relative to other events.
+	void SetBatchable(bool arg_batchable) { batchable = arg_batchable; }
+	bool Batchable() const { return batchable; }
+
+	// Queued events of higher priority classes get dispatched before
+	// those of lower ones, and only events of the high class are exempt
+	// from the event_drain_budget script option.
+	void SetPriorityClass(EventPriorityClass c) { priority_class = c; }
+	EventPriorityClass PriorityClass() const { return priority_class; }
+
+	// Records which of the event's arguments its handlers look at, as
+	// found by script analysis.  Without this, all of them count as
+	// used.
+	void SetUsedArgs(std::vector<bool> arg_used_args) { used_args = std::move(arg_used_args); }
+
+	// Returns false if nothing looks at the event's n'th argument, in
+	// which case code raising the event can pass a cheap placeholder of
+	// the right type rather than build the actual value.  Besides the
+	// handlers, this accounts for those who see all of the arguments,
+	// such as new_event(), remote peers and plugins.
+	bool ArgUsed(int n) const;
+
+	// Records the duration of a dispatch, and how long the event waited
+	// in the queue if known (negative otherwise), for EventMgr's handler
+	// profiling.
+	void RecordDispatch(double duration, double queue_delay);
+
 private:
+	struct Timings;
+
 	void NewEvent(zeek::Args* vl); // Raise new_event() meta event.
 
 	std::string name;
@@ -62,8 +115,18 @@ private:
 	bool enabled;
 	bool error_handler; // this handler reports error messages.
 	bool generate_always;
+	bool batchable;
+	EventPriorityClass priority_class;
 
 	std::unordered_set<std::string> auto_publish;
+	std::vector<bool> used_args;
+
+	// Counts the calls for the zeek_event_handler_calls metric, created
+	// on the first call.
+	std::unique_ptr<telemetry::ShardedIntCounter> calls;
+
+	// The metrics of handler profiling, created on first use.
+	std::unique_ptr<Timings> timings;
 	};
 
 // Encapsulates a ptr to an event handler to overload the boolean operator.
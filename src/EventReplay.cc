@@ -0,0 +1,808 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/EventReplay.h"
+
+#include <netinet/in.h>
+#include <time.h>
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cstring>
+
+#include "zeek/Event.h"
+#include "zeek/EventRegistry.h"
+#include "zeek/IPAddr.h"
+#include "zeek/NetVar.h"
+#include "zeek/RE.h"
+#include "zeek/Reporter.h"
+#include "zeek/RunState.h"
+#include "zeek/Timer.h"
+#include "zeek/iosource/Manager.h"
+
+namespace zeek::detail
+	{
+
+EventRecorder* event_recorder = nullptr;
+EventReplayer* event_replayer = nullptr;
+
+namespace
+	{
+
+constexpr char MAGIC[] = "ZEEKEVR1";
+constexpr size_t MAGIC_LEN = sizeof(MAGIC) - 1;
+
+// The kinds of entries in a recording.
+constexpr char ENTRY_NAME = 'N';
+constexpr char ENTRY_EVENT = 'E';
+
+// Values start with their type's tag, or one of these.
+constexpr uint8_t VAL_ABSENT = TYPE_VOID;
+constexpr uint8_t VAL_CONN = 0xff;
+
+// Aggregates nested deeper than this get written as absent, which keeps
+// cyclic values from recursing forever.
+constexpr int MAX_DEPTH = 64;
+
+// Larger strings and aggregates can only come from a corrupt file.
+constexpr uint32_t MAX_SIZE = 1u << 30;
+
+bool is_conn(const Type* t)
+	{
+	return t == id::connection.get();
+	}
+
+template <typename T> void put(std::string* buf, const T& v)
+	{
+	buf->append(reinterpret_cast<const char*>(&v), sizeof(v));
+	}
+
+void put_string(std::string* buf, const char* s, size_t len)
+	{
+	put(buf, static_cast<uint32_t>(len));
+	buf->append(s, len);
+	}
+
+	} // namespace
+
+bool EventRecorder::Open(const std::string& path)
+	{
+	Close();
+
+	FILE* f = fopen(path.c_str(), "wb");
+
+	if ( ! f )
+		{
+		reporter->Error("cannot open event recording %s: %s", path.c_str(), strerror(errno));
+		return false;
+		}
+
+	fwrite(MAGIC, 1, MAGIC_LEN, f);
+	event_recorder = new EventRecorder(f);
+	return true;
+	}
+
+void EventRecorder::Close()
+	{
+	delete event_recorder;
+	event_recorder = nullptr;
+	}
+
+EventRecorder::~EventRecorder()
+	{
+	fclose(f);
+	}
+
+uint32_t EventRecorder::Intern(const std::string& name)
+	{
+	auto [it, is_new] = names.emplace(name, names.size());
+
+	if ( is_new )
+		{
+		std::string def(1, ENTRY_NAME);
+		put_string(&def, name.data(), name.size());
+		fwrite(def.data(), 1, def.size(), f);
+		}
+
+	return it->second;
+	}
+
+void EventRecorder::Record(const Event* e)
+	{
+	auto h = e->Handler();
+
+	// These come along with replaying anyway.
+	if ( h == zeek_init || h == zeek_done || h == zeek_script_loaded || h == net_done ||
+	     h == event_queue_flush_point )
+		return;
+
+	buf.assign(1, ENTRY_EVENT);
+	put(&buf, run_state::network_time);
+	put(&buf, Intern(h->Name()));
+	put(&buf, static_cast<uint32_t>(e->Args().size()));
+
+	for ( const auto& a : e->Args() )
+		Write(a, 0);
+
+	fwrite(buf.data(), 1, buf.size(), f);
+	}
+
+void EventRecorder::Write(const ValPtr& v, int depth)
+	{
+	if ( ! v || depth > MAX_DEPTH )
+		{
+		put(&buf, VAL_ABSENT);
+		return;
+		}
+
+	const auto& t = v->GetType();
+	auto tag = t->Tag();
+
+	if ( is_conn(t.get()) )
+		{
+		auto rv = v->AsRecordVal();
+		auto uid = rv->GetField<StringVal>("uid");
+
+		if ( uid )
+			{
+			put(&buf, VAL_CONN);
+			put_string(&buf, uid->CheckString(), uid->Len());
+			WriteRecord(rv, t->AsRecordType()->NumOrigFields(), depth);
+			return;
+			}
+		}
+
+	switch ( tag )
+		{
+		case TYPE_BOOL:
+			put(&buf, static_cast<uint8_t>(tag));
+			put(&buf, static_cast<uint8_t>(v->AsBool()));
+			break;
+
+		case TYPE_INT:
+			put(&buf, static_cast<uint8_t>(tag));
+			put(&buf, static_cast<int64_t>(v->AsInt()));
+			break;
+
+		case TYPE_COUNT:
+		case TYPE_PORT:
+			put(&buf, static_cast<uint8_t>(tag));
+			put(&buf, static_cast<uint64_t>(v->AsCount()));
+			break;
+
+		case TYPE_DOUBLE:
+		case TYPE_TIME:
+		case TYPE_INTERVAL:
+			put(&buf, static_cast<uint8_t>(tag));
+			put(&buf, v->AsDouble());
+			break;
+
+		case TYPE_ADDR:
+			{
+			in6_addr a;
+			v->AsAddr().CopyIPv6(&a);
+			put(&buf, static_cast<uint8_t>(tag));
+			put(&buf, a);
+			break;
+			}
+
+		case TYPE_SUBNET:
+			{
+			in6_addr a;
+			const auto& p = v->AsSubNet();
+			p.Prefix().CopyIPv6(&a);
+			put(&buf, static_cast<uint8_t>(tag));
+			put(&buf, a);
+			put(&buf, p.LengthIPv6());
+			break;
+			}
+
+		case TYPE_STRING:
+			{
+			auto s = v->AsString();
+			put(&buf, static_cast<uint8_t>(tag));
+			put_string(&buf, reinterpret_cast<const char*>(s->Bytes()), s->Len());
+			break;
+			}
+
+		case TYPE_ENUM:
+			{
+			auto name = t->AsEnumType()->Lookup(v->AsEnum());
+
+			if ( ! name )
+				{
+				put(&buf, VAL_ABSENT);
+				break;
+				}
+
+			put(&buf, static_cast<uint8_t>(tag));
+			put(&buf, Intern(name));
+			break;
+			}
+
+		case TYPE_PATTERN:
+			{
+			auto re = v->AsPatternVal()->Get();
+			put(&buf, static_cast<uint8_t>(tag));
+			put_string(&buf, re->PatternText(), strlen(re->PatternText()));
+			put_string(&buf, re->AnywherePatternText(), strlen(re->AnywherePatternText()));
+			break;
+			}
+
+		case TYPE_RECORD:
+			put(&buf, static_cast<uint8_t>(tag));
+			WriteRecord(v->AsRecordVal(), t->AsRecordType()->NumFields(), depth);
+			break;
+
+		case TYPE_TABLE:
+			{
+			auto tv = v->AsTableVal();
+			auto has_yield = ! t->IsSet();
+			auto m = tv->ToMap();
+
+			put(&buf, static_cast<uint8_t>(tag));
+			put(&buf, static_cast<uint8_t>(has_yield));
+			put(&buf, static_cast<uint32_t>(m.size()));
+			put(&buf, static_cast<uint32_t>(t->AsTableType()->GetIndexTypes().size()));
+
+			for ( const auto& [k, y] : m )
+				{
+				for ( const auto& i : k->AsListVal()->Vals() )
+					Write(i, depth + 1);
+
+				if ( has_yield )
+					Write(y, depth + 1);
+				}
+			break;
+			}
+
+		case TYPE_VECTOR:
+			{
+			auto vv = v->AsVectorVal();
+			auto n = vv->Size();
+
+			put(&buf, static_cast<uint8_t>(tag));
+			put(&buf, static_cast<uint32_t>(n));
+
+			for ( unsigned int i = 0; i < n; ++i )
+				Write(vv->ValAt(i), depth + 1);
+			break;
+			}
+
+		default:
+			// Functions, files, opaques and the like.
+			put(&buf, VAL_ABSENT);
+			break;
+		}
+	}
+
+void EventRecorder::WriteRecord(const RecordVal* rv, int num_fields, int depth)
+	{
+	auto rt = rv->GetType()->AsRecordType();
+	uint32_t n = 0;
+
+	for ( int i = 0; i < num_fields; ++i )
+		if ( rv->HasField(i) )
+			++n;
+
+	put(&buf, n);
+
+	for ( int i = 0; i < num_fields; ++i )
+		if ( rv->HasField(i) )
+			{
+			put(&buf, Intern(rt->FieldName(i)));
+			Write(rv->GetField(i), depth + 1);
+			}
+	}
+
+bool EventReplayer::Open(const std::string& path)
+	{
+	Close();
+
+	FILE* f = fopen(path.c_str(), "rb");
+
+	if ( ! f )
+		{
+		reporter->Error("cannot open event recording %s: %s", path.c_str(), strerror(errno));
+		return false;
+		}
+
+	char magic[MAGIC_LEN];
+
+	if ( fread(magic, 1, MAGIC_LEN, f) != MAGIC_LEN || memcmp(magic, MAGIC, MAGIC_LEN) != 0 )
+		{
+		reporter->Error("%s is not an event recording", path.c_str());
+		fclose(f);
+		return false;
+		}
+
+	event_replayer = new EventReplayer(f);
+
+	// The manager stops using it once it's closed, we delete it in
+	// Close().
+	iosource_mgr->Register(event_replayer, false, false);
+	return true;
+	}
+
+void EventReplayer::Close()
+	{
+	delete event_replayer;
+	event_replayer = nullptr;
+	}
+
+EventReplayer::~EventReplayer()
+	{
+	fclose(f);
+	}
+
+double EventReplayer::CPUTime()
+	{
+	struct timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return double(ts.tv_sec) + double(ts.tv_nsec) / 1e9;
+	}
+
+void EventReplayer::RecordDispatch(const EventHandler* h, double cpu)
+	{
+	// Only what the replay itself causes counts, not zeek_init.
+	if ( wall_start == 0.0 )
+		return;
+
+	auto& s = stats[h];
+	++s.calls;
+	s.cpu += cpu;
+	}
+
+void EventReplayer::Process()
+	{
+	if ( ! have_next && ! ReadHeader() )
+		{
+		if ( failed )
+			reporter->Warning("event recording ends in the middle of an entry");
+
+		Report();
+		SetClosed(true);
+		return;
+		}
+
+	if ( wall_start == 0.0 )
+		{
+		wall_start = util::current_time(true);
+		cpu_start = CPUTime();
+		dispatched_at_start = event_mgr.num_events_dispatched;
+		}
+
+	// Like with packets, network time never goes back.
+	double t = next_time;
+	run_state::detail::update_network_time(std::max(t, timer_mgr->Time()));
+	run_state::detail::expire_timers();
+
+	// The arguments get read only now, after dispatching the previous
+	// group's events, as they may update the records of connections
+	// that those events carry.
+	do
+		{
+		have_next = false;
+
+		auto h = event_registry->Lookup(Name(next_handler));
+		zeek::Args args;
+
+		if ( ! ReadArgs(h && *h ? h : nullptr, &args) )
+			{
+			++num_skipped;
+			continue;
+			}
+
+		if ( h == connection_state_remove.Ptr() )
+			conns.erase(args[0]->AsRecordVal()->GetField<StringVal>("uid")->ToStdString());
+
+		event_mgr.Enqueue(h, std::move(args));
+		++num_replayed;
+		} while ( ReadHeader() && next_time == t );
+	}
+
+bool EventReplayer::ReadBytes(void* dst, size_t n)
+	{
+	if ( ! failed && fread(dst, 1, n, f) == n )
+		return true;
+
+	failed = true;
+	memset(dst, 0, n);
+	return false;
+	}
+
+const std::string& EventReplayer::Name(uint32_t id)
+	{
+	static const std::string unknown;
+
+	if ( id < names.size() )
+		return names[id];
+
+	failed = true;
+	return unknown;
+	}
+
+bool EventReplayer::ReadHeader()
+	{
+	while ( ! failed )
+		{
+		int kind = fgetc(f);
+
+		if ( kind == EOF )
+			return false;
+
+		if ( kind == ENTRY_NAME )
+			{
+			auto len = ReadRaw<uint32_t>();
+
+			if ( len > MAX_SIZE )
+				{
+				failed = true;
+				break;
+				}
+
+			std::string name(len, '\0');
+			ReadBytes(name.data(), len);
+			names.push_back(std::move(name));
+			}
+
+		else if ( kind == ENTRY_EVENT )
+			{
+			next_time = ReadRaw<double>();
+			next_handler = ReadRaw<uint32_t>();
+			have_next = ! failed;
+			return have_next;
+			}
+
+		else
+			failed = true;
+		}
+
+	return false;
+	}
+
+bool EventReplayer::ReadArgs(EventHandler* h, zeek::Args* args)
+	{
+	auto n = ReadRaw<uint32_t>();
+	RecordType* params = nullptr;
+
+	if ( h && h->GetType() )
+		params = h->GetType()->Params().get();
+
+	// Arguments not fitting the handler still need reading to get past
+	// them.
+	if ( params && static_cast<uint32_t>(params->NumFields()) != n )
+		params = nullptr;
+
+	bool ok = params;
+
+	for ( uint32_t i = 0; i < n && ! failed; ++i )
+		{
+		auto v = Read(params ? params->GetFieldType(i) : nullptr, 0);
+
+		if ( ! v )
+			ok = false;
+
+		args->push_back(std::move(v));
+		}
+
+	return ok && ! failed;
+	}
+
+ValPtr EventReplayer::Read(const TypePtr& t, int depth)
+	{
+	auto tag = ReadRaw<uint8_t>();
+
+	if ( failed || tag == VAL_ABSENT || depth > MAX_DEPTH )
+		return nullptr;
+
+	if ( tag == VAL_CONN )
+		{
+		auto len = ReadRaw<uint32_t>();
+
+		if ( len > MAX_SIZE )
+			{
+			failed = true;
+			return nullptr;
+			}
+
+		std::string uid(len, '\0');
+		ReadBytes(uid.data(), len);
+
+		if ( ! t || ! is_conn(t.get()) )
+			return ReadRecord(nullptr, nullptr, depth);
+
+		auto& rv = conns[uid];
+
+		if ( ! rv )
+			rv = make_intrusive<RecordVal>(id::connection);
+
+		if ( ! ReadRecord(t, rv, depth) )
+			{
+			conns.erase(uid);
+			return nullptr;
+			}
+
+		return rv;
+		}
+
+	// Values of a type that doesn't fit just get read past, except that
+	// those of atomic types carry enough to fill in for "any".
+	TypePtr vt = t;
+
+	if ( t && t->Tag() == TYPE_ANY && tag != TYPE_ENUM && tag != TYPE_RECORD &&
+	     tag != TYPE_TABLE && tag != TYPE_VECTOR && tag < NUM_TYPES )
+		vt = base_type(static_cast<TypeTag>(tag));
+
+	else if ( t && t->Tag() != tag )
+		vt = nullptr;
+
+	switch ( tag )
+		{
+		case TYPE_BOOL:
+			{
+			auto b = ReadRaw<uint8_t>();
+			return vt ? val_mgr->Bool(b) : nullptr;
+			}
+
+		case TYPE_INT:
+			{
+			auto i = ReadRaw<int64_t>();
+			return vt ? val_mgr->Int(i) : nullptr;
+			}
+
+		case TYPE_COUNT:
+			{
+			auto c = ReadRaw<uint64_t>();
+			return vt ? val_mgr->Count(c) : nullptr;
+			}
+
+		case TYPE_PORT:
+			{
+			auto p = ReadRaw<uint64_t>();
+			return vt ? val_mgr->Port(p) : nullptr;
+			}
+
+		case TYPE_DOUBLE:
+		case TYPE_TIME:
+		case TYPE_INTERVAL:
+			{
+			auto d = ReadRaw<double>();
+
+			if ( ! vt )
+				return nullptr;
+
+			if ( tag == TYPE_TIME )
+				return make_intrusive<TimeVal>(d);
+
+			if ( tag == TYPE_INTERVAL )
+				return make_intrusive<IntervalVal>(d);
+
+			return make_intrusive<DoubleVal>(d);
+			}
+
+		case TYPE_ADDR:
+			{
+			auto a = ReadRaw<in6_addr>();
+			return vt ? make_intrusive<AddrVal>(IPAddr(a)) : nullptr;
+			}
+
+		case TYPE_SUBNET:
+			{
+			auto a = ReadRaw<in6_addr>();
+			auto len = ReadRaw<uint8_t>();
+			return vt ? make_intrusive<SubNetVal>(IPPrefix(IPAddr(a), len, true)) : nullptr;
+			}
+
+		case TYPE_STRING:
+			{
+			auto len = ReadRaw<uint32_t>();
+
+			if ( len > MAX_SIZE )
+				{
+				failed = true;
+				return nullptr;
+				}
+
+			std::string s(len, '\0');
+			ReadBytes(s.data(), len);
+			return vt ? make_intrusive<StringVal>(s) : nullptr;
+			}
+
+		case TYPE_ENUM:
+			{
+			const auto& name = Name(ReadRaw<uint32_t>());
+
+			if ( ! vt )
+				return nullptr;
+
+			auto et = vt->AsEnumType();
+			auto i = et->Lookup(name);
+			return i < 0 ? nullptr : et->GetEnumVal(i);
+			}
+
+		case TYPE_PATTERN:
+			{
+			std::string texts[2];
+
+			for ( auto& text : texts )
+				{
+				auto len = ReadRaw<uint32_t>();
+
+				if ( len > MAX_SIZE )
+					{
+					failed = true;
+					return nullptr;
+					}
+
+				text.resize(len);
+				ReadBytes(text.data(), len);
+				}
+
+			if ( ! vt )
+				return nullptr;
+
+			auto re = new RE_Matcher(texts[0].c_str(), texts[1].c_str());
+
+			if ( ! re->Compile() )
+				{
+				delete re;
+				return nullptr;
+				}
+
+			return make_intrusive<PatternVal>(re);
+			}
+
+		case TYPE_RECORD:
+			return ReadRecord(vt, vt ? make_intrusive<RecordVal>(cast_intrusive<RecordType>(vt))
+			                         : nullptr,
+			                  depth);
+
+		case TYPE_TABLE:
+			{
+			auto has_yield = ReadRaw<uint8_t>();
+			auto n = ReadRaw<uint32_t>();
+			auto arity = ReadRaw<uint32_t>();
+
+			if ( n > MAX_SIZE || arity > MAX_SIZE )
+				{
+				failed = true;
+				return nullptr;
+				}
+
+			auto tt = vt ? vt->AsTableType() : nullptr;
+
+			if ( tt && (tt->GetIndexTypes().size() != arity || tt->IsSet() == bool(has_yield)) )
+				tt = nullptr;
+
+			TableValPtr tv;
+
+			if ( tt )
+				tv = make_intrusive<TableVal>(cast_intrusive<TableType>(vt));
+
+			for ( uint32_t i = 0; i < n && ! failed; ++i )
+				{
+				auto index = make_intrusive<ListVal>(TYPE_ANY);
+				bool complete = true;
+
+				for ( uint32_t j = 0; j < arity; ++j )
+					{
+					auto v = Read(tt ? tt->GetIndexTypes()[j] : nullptr, depth + 1);
+
+					if ( v )
+						index->Append(std::move(v));
+					else
+						complete = false;
+					}
+
+				ValPtr yield;
+
+				if ( has_yield )
+					{
+					yield = Read(tt ? tt->Yield() : nullptr, depth + 1);
+					complete = complete && yield;
+					}
+
+				if ( tv && complete )
+					tv->Assign(std::move(index), std::move(yield));
+				}
+
+			return tv;
+			}
+
+		case TYPE_VECTOR:
+			{
+			auto n = ReadRaw<uint32_t>();
+
+			if ( n > MAX_SIZE )
+				{
+				failed = true;
+				return nullptr;
+				}
+
+			VectorValPtr vv;
+
+			if ( vt )
+				vv = make_intrusive<VectorVal>(cast_intrusive<VectorType>(vt));
+
+			for ( uint32_t i = 0; i < n && ! failed; ++i )
+				{
+				auto v = Read(vv ? vt->Yield() : nullptr, depth + 1);
+
+				if ( vv && v )
+					vv->Assign(i, std::move(v));
+				}
+
+			return vv;
+			}
+
+		default:
+			// Nothing else gets written.
+			failed = true;
+			return nullptr;
+		}
+	}
+
+ValPtr EventReplayer::ReadRecord(const TypePtr& t, RecordValPtr rv, int depth)
+	{
+	auto n = ReadRaw<uint32_t>();
+
+	if ( n > MAX_SIZE )
+		{
+		failed = true;
+		return nullptr;
+		}
+
+	auto rt = rv ? t->AsRecordType() : nullptr;
+
+	for ( uint32_t i = 0; i < n && ! failed; ++i )
+		{
+		const auto& name = Name(ReadRaw<uint32_t>());
+		int offset = rt ? rt->FieldOffset(name.c_str()) : -1;
+		auto v = Read(offset >= 0 ? rt->GetFieldType(offset) : nullptr, depth + 1);
+
+		if ( v )
+			rv->Assign(offset, std::move(v));
+		}
+
+	if ( ! rv || failed )
+		return nullptr;
+
+	// Handlers may rely on fields that aren't optional.
+	for ( int i = 0; i < rt->NumFields(); ++i )
+		if ( ! rv->HasField(i) && ! rt->FieldHasAttr(i, ATTR_OPTIONAL) )
+			return nullptr;
+
+	return rv;
+	}
+
+void EventReplayer::Report() const
+	{
+	if ( wall_start == 0.0 )
+		{
+		fprintf(stderr, "# replayed no events\n");
+		return;
+		}
+
+	double wall = util::current_time(true) - wall_start;
+	double cpu = CPUTime() - cpu_start;
+	uint64_t dispatched = event_mgr.num_events_dispatched - dispatched_at_start;
+
+	fprintf(stderr,
+	        "# replayed %" PRIu64 " events (%" PRIu64 " skipped), dispatched %" PRIu64
+	        " events in total\n",
+	        num_replayed, num_skipped, dispatched);
+	fprintf(stderr, "# %.6f s wall, %.6f s CPU, %.0f events/sec\n", wall, cpu,
+	        wall > 0.0 ? dispatched / wall : 0.0);
+
+	std::vector<std::pair<const EventHandler*, HandlerStats>> sorted(stats.begin(), stats.end());
+	std::sort(sorted.begin(), sorted.end(),
+	          [](const auto& a, const auto& b) { return a.second.cpu > b.second.cpu; });
+
+	fprintf(stderr, "# %-40s %10s %12s %10s\n", "handler", "calls", "CPU (s)", "us/call");
+
+	for ( const auto& [h, s] : sorted )
+		fprintf(stderr, "# %-40s %10" PRIu64 " %12.6f %10.2f\n", h->Name(), s.calls, s.cpu,
+		        s.cpu * 1e6 / s.calls);
+	}
+
+	} // namespace zeek::detail
@@ -0,0 +1,197 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+// Recording the events the engine raises, and replaying them against the
+// loaded scripts without any packet processing, for benchmarking scripts.
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "zeek/EventHandler.h"
+#include "zeek/Val.h"
+#include "zeek/ZeekArgs.h"
+#include "zeek/iosource/IOSource.h"
+
+namespace zeek
+	{
+
+class Event;
+
+namespace detail
+	{
+
+/**
+ * Writes the events that the engine raises to a file, along with the
+ * network time of their dispatch and their arguments, for replaying them
+ * with EventReplayer. Events that scripts raise, including by scheduling
+ * them, don't get written, as the scripts raise them again when replaying.
+ *
+ * The file holds a compact binary encoding of the values, in host byte
+ * order. Values of types that don't have one, such as functions, files
+ * and opaques, get written as absent. Records of type connection get
+ * written with just the fields that the engine fills in, along with
+ * their uid, so that replaying can keep one record per connection that
+ * the handlers' state accumulates in, like with live traffic.
+ *
+ * The recorder only exists while on; see Open().
+ */
+class EventRecorder
+	{
+public:
+	/**
+	 * Starts recording to a file, see --record-events.
+	 *
+	 * @return False, after reporting an error, if the file can't be
+	 * opened.
+	 */
+	static bool Open(const std::string& path);
+
+	/**
+	 * Stops recording, flushing the file.
+	 */
+	static void Close();
+
+	~EventRecorder();
+
+	EventRecorder(const EventRecorder&) = delete;
+	EventRecorder& operator=(const EventRecorder&) = delete;
+
+	/**
+	 * Writes an event right before dispatching it, unless replays raise
+	 * it on their own, like zeek_init.
+	 */
+	void Record(const Event* e);
+
+private:
+	explicit EventRecorder(FILE* f) : f(f) { }
+
+	// Returns the ID for a name, writing its definition if new.
+	uint32_t Intern(const std::string& name);
+
+	void Write(const ValPtr& v, int depth);
+	void WriteRecord(const RecordVal* rv, int num_fields, int depth);
+
+	FILE* f;
+
+	// The encoding of the event being recorded.
+	std::string buf;
+
+	std::unordered_map<std::string, uint32_t> names;
+	};
+
+/**
+ * Replays the events from a file that EventRecorder wrote, at full speed
+ * and without any packet processing, then reports the number of events
+ * per second and how much CPU time each handler took. Events get replayed
+ * in groups of those of the same network time, which stand in for the
+ * packets that raised them, advancing network time and expiring timers
+ * in between.
+ *
+ * Events whose handlers the loaded scripts no longer have, or whose
+ * arguments don't fit the handlers' types, get skipped.
+ *
+ * The replayer only exists while on; see Open().
+ */
+class EventReplayer final : public iosource::IOSource
+	{
+public:
+	/**
+	 * Starts replaying a file, see --replay-events. Takes the place of a
+	 * packet source.
+	 *
+	 * @return False, after reporting an error, if the file can't be
+	 * opened or isn't a recording.
+	 */
+	static bool Open(const std::string& path);
+
+	/**
+	 * Stops replaying.
+	 */
+	static void Close();
+
+	~EventReplayer() override;
+
+	/**
+	 * @return The CPU time the current thread has used, in seconds.
+	 */
+	static double CPUTime();
+
+	/**
+	 * Accounts for the CPU time of a handler's dispatch.
+	 */
+	void RecordDispatch(const EventHandler* h, double cpu);
+
+	double GetNextTimeout() override { return 0.0; }
+	void Process() override;
+	const char* Tag() override { return "EventReplayer"; }
+
+private:
+	explicit EventReplayer(FILE* f) : f(f) { }
+
+	struct HandlerStats
+		{
+		uint64_t calls = 0;
+		double cpu = 0.0;
+		};
+
+	// Reads the time and handler of the next event, leaving its
+	// arguments for ReadArgs(). Returns false at the end of the file.
+	bool ReadHeader();
+
+	// Reads the arguments of the event whose header got read last,
+	// returning false if it can't get replayed.
+	bool ReadArgs(EventHandler* h, zeek::Args* args);
+
+	// Reads a value that the recorder wrote, returning null if it's
+	// absent or doesn't fit the given type, or if there's no type, which
+	// just skips it.
+	ValPtr Read(const TypePtr& t, int depth);
+	ValPtr ReadRecord(const TypePtr& t, RecordValPtr rv, int depth);
+
+	bool ReadBytes(void* dst, size_t n);
+	template <typename T> T ReadRaw()
+		{
+		T v{};
+		ReadBytes(&v, sizeof(v));
+		return v;
+		}
+
+	const std::string& Name(uint32_t id);
+
+	// Writes the report to stderr.
+	void Report() const;
+
+	FILE* f;
+
+	// Set once reading came up short, which only the end of the file
+	// may cause between events.
+	bool failed = false;
+	bool have_next = false;
+	double next_time = 0.0;
+	uint32_t next_handler = 0;
+
+	std::vector<std::string> names;
+
+	// The records of connections still live in the recording, by uid.
+	std::unordered_map<std::string, RecordValPtr> conns;
+
+	std::unordered_map<const EventHandler*, HandlerStats> stats;
+	uint64_t num_replayed = 0;
+	uint64_t num_skipped = 0;
+	uint64_t dispatched_at_start = 0;
+	double wall_start = 0.0;
+	double cpu_start = 0.0;
+	};
+
+// Set while recording.
+extern EventRecorder* event_recorder;
+
+// Set while replaying.
+extern EventReplayer* event_replayer;
+
+	} // namespace detail
+	} // namespace zeek
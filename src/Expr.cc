@@ -4,6 +4,9 @@
 
 #include "zeek/zeek-config.h"
 
+#include <algorithm>
+#include <memory>
+
 #include "zeek/DebugLogger.h"
 #include "zeek/Desc.h"
 #include "zeek/Event.h"
@@ -703,6 +706,174 @@ void UnaryExpr::ExprDescribe(ODesc* d) const
 		}
 	}
 
+using ElemVec = std::vector<std::optional<ZVal>>;
+
+template <typename T> static T raw_elem(const ZVal& z)
+	{
+	if constexpr ( std::is_same_v<T, zeek_int_t> )
+		return z.AsInt();
+	else if constexpr ( std::is_same_v<T, zeek_uint_t> )
+		return z.AsCount();
+	else
+		return z.AsDouble();
+	}
+
+// Applies f to pairs of elements, taking those of a scalar operand from
+// a_val or b_val where a or b is nil.
+template <typename T, typename F>
+static void apply_dense(const ElemVec* a, T a_val, const ElemVec* b, T b_val, ElemVec* res, F f)
+	{
+	auto n = res->size();
+
+	for ( size_t i = 0; i < n; ++i )
+		{
+		T x = a ? raw_elem<T>(*(*a)[i]) : a_val;
+		T y = b ? raw_elem<T>(*(*b)[i]) : b_val;
+		(*res)[i] = ZVal(f(x, y));
+		}
+	}
+
+template <typename T>
+static ElemVec* fold_dense(ExprTag tag, const ElemVec* a, T a_val, const ElemVec* b, T b_val, size_t n)
+	{
+	if ( tag == EXPR_DIVIDE || tag == EXPR_MOD )
+		{
+		// Leave reporting division by zero to the generic folding.
+		if ( b ? std::any_of(b->begin(), b->end(), [](const auto& e)
+		                     { return raw_elem<T>(*e) == 0; })
+		       : b_val == 0 )
+			return nullptr;
+		}
+
+	auto res = std::make_unique<ElemVec>(n);
+
+#define DENSE_FOLD(op) apply_dense(a, a_val, b, b_val, res.get(), [](T x, T y) { return T(x op y); })
+#define DENSE_REL_FOLD(op)                                                                         \
+	apply_dense(a, a_val, b, b_val, res.get(), [](T x, T y) { return zeek_int_t(x op y); })
+
+	switch ( tag )
+		{
+		case EXPR_ADD:
+			DENSE_FOLD(+);
+			break;
+		case EXPR_SUB:
+			DENSE_FOLD(-);
+			break;
+		case EXPR_TIMES:
+			DENSE_FOLD(*);
+			break;
+		case EXPR_DIVIDE:
+			DENSE_FOLD(/);
+			break;
+
+		case EXPR_LT:
+			DENSE_REL_FOLD(<);
+			break;
+		case EXPR_LE:
+			DENSE_REL_FOLD(<=);
+			break;
+		case EXPR_EQ:
+			DENSE_REL_FOLD(==);
+			break;
+		case EXPR_NE:
+			DENSE_REL_FOLD(!=);
+			break;
+		case EXPR_GE:
+			DENSE_REL_FOLD(>=);
+			break;
+		case EXPR_GT:
+			DENSE_REL_FOLD(>);
+			break;
+
+		default:
+			if constexpr ( std::is_integral_v<T> )
+				{
+				if ( tag == EXPR_MOD )
+					{
+					DENSE_FOLD(%);
+					break;
+					}
+				}
+
+			return nullptr;
+		}
+
+#undef DENSE_FOLD
+#undef DENSE_REL_FOLD
+
+	return res.release();
+	}
+
+// Folds vector operands whose elements are all present and of the same
+// arithmetic type on their raw values, rather than creating a Val for
+// every element and result.  One of the operands may be a scalar.
+// Returns nil if that doesn't apply, leaving the operation to folding
+// the elements one at a time.
+static VectorValPtr fold_dense_vectors(ExprTag tag, VectorTypePtr t, Val* v1, Val* v2)
+	{
+	auto elem_type = [](Val* v) -> const TypePtr&
+	{ return is_vector(v) ? v->GetType()->Yield() : v->GetType(); };
+
+	auto it = elem_type(v1)->InternalType();
+
+	if ( elem_type(v2)->InternalType() != it )
+		return nullptr;
+
+	bool is_rel = tag == EXPR_LT || tag == EXPR_LE || tag == EXPR_EQ || tag == EXPR_NE ||
+	              tag == EXPR_GE || tag == EXPR_GT;
+	const auto& yt = t->Yield();
+
+	if ( is_rel ? yt->Tag() != TYPE_BOOL : yt->InternalType() != it )
+		return nullptr;
+
+	const ElemVec* a = nullptr;
+	const ElemVec* b = nullptr;
+	size_t n = 0;
+
+	if ( is_vector(v1) )
+		{
+		a = v1->AsVectorVal()->RawVec();
+		n = a->size();
+		}
+
+	if ( is_vector(v2) )
+		{
+		b = v2->AsVectorVal()->RawVec();
+		n = b->size();
+		}
+
+	auto has_holes = [](const ElemVec* v)
+	{ return v && std::any_of(v->begin(), v->end(), [](const auto& e) { return ! e; }); };
+
+	if ( has_holes(a) || has_holes(b) )
+		return nullptr;
+
+	ElemVec* res = nullptr;
+
+	switch ( it )
+		{
+		case TYPE_INTERNAL_INT:
+			res = fold_dense<zeek_int_t>(tag, a, a ? 0 : v1->InternalInt(), b,
+			                             b ? 0 : v2->InternalInt(), n);
+			break;
+		case TYPE_INTERNAL_UNSIGNED:
+			res = fold_dense<zeek_uint_t>(tag, a, a ? 0 : v1->InternalUnsigned(), b,
+			                              b ? 0 : v2->InternalUnsigned(), n);
+			break;
+		case TYPE_INTERNAL_DOUBLE:
+			res = fold_dense<double>(tag, a, a ? 0 : v1->InternalDouble(), b,
+			                         b ? 0 : v2->InternalDouble(), n);
+			break;
+		default:
+			break;
+		}
+
+	if ( ! res )
+		return nullptr;
+
+	return make_intrusive<VectorVal>(std::move(t), res);
+	}
+
 ValPtr BinaryExpr::Eval(Frame* f) const
 	{
 	if ( IsError() )
@@ -732,6 +903,9 @@ ValPtr BinaryExpr::Eval(Frame* f) const
 			return nullptr;
 			}
 
+		if ( auto v_result = fold_dense_vectors(Tag(), GetType<VectorType>(), v1.get(), v2.get()) )
+			return v_result;
+
 		auto v_result = make_intrusive<VectorVal>(GetType<VectorType>());
 
 		for ( unsigned int i = 0; i < v_op1->Size(); ++i )
@@ -749,6 +923,9 @@ ValPtr BinaryExpr::Eval(Frame* f) const
 
 	if ( IsVector(GetType()->Tag()) && (is_vec1 || is_vec2) )
 		{ // fold vector against scalar
+		if ( auto v_result = fold_dense_vectors(Tag(), GetType<VectorType>(), v1.get(), v2.get()) )
+			return v_result;
+
 		VectorVal* vv = (is_vec1 ? v1 : v2)->AsVectorVal();
 		auto v_result = make_intrusive<VectorVal>(GetType<VectorType>());
 
@@ -1065,13 +1242,7 @@ ValPtr BinaryExpr::StringFold(Val* v1, Val* v2) const
 
 		case EXPR_ADD:
 		case EXPR_ADD_TO:
-			{
-			std::vector<const String*> strings;
-			strings.push_back(s1);
-			strings.push_back(s2);
-
-			return make_intrusive<StringVal>(concatenate(strings));
-			}
+			return make_intrusive<StringVal>(concatenate(s1, s2));
 
 		default:
 			BadTag("BinaryExpr::StringFold", expr_name(tag));
@@ -4227,6 +4398,30 @@ ValPtr RecordCoerceExpr::Fold(Val* v) const
 	return coerce_to_record(rt, v, map);
 	}
 
+ValPtr coerce_to_record(RecordTypePtr rt, Val* v)
+	{
+	// Only coercions that worked get remembered, so that failing ones
+	// keep reporting their errors.
+	static TypePairCache<std::shared_ptr<const std::vector<int>>> maps;
+
+	if ( auto m = maps.Find(rt.get(), v->GetType().get()) )
+		{
+		if ( same_type(rt, v->GetType()) )
+			return {NewRef{}, v};
+
+		auto map = *m;
+		return coerce_to_record(std::move(rt), v, *map);
+		}
+
+	auto from = v->GetType();
+	auto e = make_intrusive<RecordCoerceExpr>(make_intrusive<ConstExpr>(ValPtr{NewRef{}, v}), rt);
+
+	if ( ! e->IsError() )
+		maps.Insert(rt.get(), from.get(), std::make_shared<const std::vector<int>>(e->Map()));
+
+	return e->Eval(nullptr);
+	}
+
 RecordValPtr coerce_to_record(RecordTypePtr rt, Val* v, const std::vector<int>& map)
 	{
 	int map_size = map.size();
@@ -4387,7 +4582,10 @@ ScheduleTimer::~ScheduleTimer() { }
 void ScheduleTimer::Dispatch(double /* t */, bool /* is_expire */)
 	{
 	if ( event )
+		{
+		ScriptEventScope scope;
 		event_mgr.Enqueue(event, std::move(args));
+		}
 	}
 
 ScheduleExpr::ScheduleExpr(ExprPtr arg_when, EventExprPtr arg_event)
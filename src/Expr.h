@@ -1333,6 +1333,10 @@ protected:
 
 extern RecordValPtr coerce_to_record(RecordTypePtr rt, Val* v, const std::vector<int>& map);
 
+// Coerces a record value to a record type like a RecordCoerceExpr does,
+// reusing the field map of earlier coercions between the same types.
+extern ValPtr coerce_to_record(RecordTypePtr rt, Val* v);
+
 class TableCoerceExpr final : public UnaryExpr
 	{
 public:
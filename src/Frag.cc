@@ -323,6 +323,13 @@ void FragReassembler::Expire(double t)
 	fragment_mgr->Remove(this);
 	}
 
+void FragReassembler::Evict(bool /* flush */)
+	{
+	// There's no delivering part of a packet, so always drop it.
+	Weird("reassembly_memory_budget_exceeded");
+	fragment_mgr->Remove(this);
+	}
+
 void FragReassembler::DeleteTimer()
 	{
 	if ( expire_timer )
@@ -338,6 +345,12 @@ FragmentManager::~FragmentManager()
 	Clear();
 	}
 
+void FragmentManager::InitPostScript()
+	{
+	if ( use_compact_fragment_table )
+		table = std::make_unique<FragmentTable>(fragment_table_size, fragment_memory_limit);
+	}
+
 FragReassembler* FragmentManager::NextFragment(double t, const std::shared_ptr<IP_Hdr>& ip,
                                                const u_char* pkt)
 	{
@@ -368,6 +381,9 @@ void FragmentManager::Clear()
 		Unref(entry.second);
 
 	fragments.clear();
+
+	if ( table )
+		table->Clear();
 	}
 
 void FragmentManager::Remove(detail::FragReassembler* f)
@@ -3,8 +3,10 @@
 #pragma once
 
 #include <sys/types.h> // for u_char
+#include <memory>
 #include <tuple>
 
+#include "zeek/FragmentTable.h"
 #include "zeek/IPAddr.h"
 #include "zeek/Reassem.h"
 #include "zeek/Timer.h"
@@ -47,6 +49,7 @@ public:
 protected:
 	void BlockInserted(DataBlockMap::const_iterator it) override;
 	void Overlap(const u_char* b1, const u_char* b2, uint64_t n) override;
+	void Evict(bool flush) override;
 	void Weird(const char* name) const;
 
 	u_char* proto_hdr;
@@ -81,17 +84,30 @@ public:
 	FragmentManager() = default;
 	~FragmentManager();
 
+	/**
+	 * Switches over to a FragmentTable if use_compact_fragment_table is
+	 * set.
+	 */
+	void InitPostScript();
+
 	FragReassembler* NextFragment(double t, const std::shared_ptr<IP_Hdr>& ip, const u_char* pkt);
 	void Clear();
 	void Remove(detail::FragReassembler* f);
 
-	size_t Size() const { return fragments.size(); }
-	size_t MaxFragments() const { return max_fragments; }
+	/**
+	 * Returns the fragment table to pass fragments to instead of
+	 * NextFragment(), or nullptr if there's none in use.
+	 */
+	FragmentTable* CompactTable() const { return table.get(); }
+
+	size_t Size() const { return table ? table->Size() : fragments.size(); }
+	size_t MaxFragments() const { return table ? table->MaxSize() : max_fragments; }
 
 private:
 	using FragmentMap = std::map<detail::FragReassemblerKey, detail::FragReassembler*>;
 	FragmentMap fragments;
 	size_t max_fragments = 0;
+	std::unique_ptr<FragmentTable> table;
 	};
 
 extern FragmentManager* fragment_mgr;
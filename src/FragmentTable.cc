@@ -0,0 +1,663 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/FragmentTable.h"
+
+#include "zeek/zeek-config.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "zeek/Hash.h"
+#include "zeek/IP.h"
+#include "zeek/NetVar.h"
+#include "zeek/Reporter.h"
+#include "zeek/session/Manager.h"
+#include "zeek/telemetry/Manager.h"
+
+#include "zeek/3rdparty/doctest.h"
+
+constexpr uint32_t MIN_ACCEPTABLE_FRAG_SIZE = 64;
+constexpr uint32_t MAX_ACCEPTABLE_FRAG_SIZE = 64000;
+
+namespace zeek::detail
+	{
+
+namespace
+	{
+
+telemetry::IntCounter eviction_counter(const char* reason)
+	{
+	auto family = telemetry_mgr->CounterFamily(
+		"zeek", "fragment-evictions", {"reason"},
+		"Datagrams dropped from the fragment table before completing reassembly", "1", true);
+	return family.GetOrAdd({{"reason", reason}});
+	}
+
+struct FragmentMetrics
+	{
+	telemetry::IntCounter capacity_evictions = eviction_counter("capacity");
+	telemetry::IntCounter memory_evictions = eviction_counter("memory");
+	};
+
+FragmentMetrics* metrics()
+	{
+	// Fragments only start arriving once the telemetry manager exists.
+	static FragmentMetrics* m = telemetry_mgr ? new FragmentMetrics() : nullptr;
+	return m;
+	}
+
+	} // namespace
+
+bool FragmentTable::Key::operator==(const Key& other) const
+	{
+	return memcmp(this, &other, sizeof(Key)) == 0;
+	}
+
+FragmentTable::FragmentTable(size_t capacity, uint64_t arg_memory_limit)
+	: memory_limit(arg_memory_limit)
+	{
+	capacity = std::clamp(capacity, size_t(1), size_t(NONE - 1));
+	entries.resize(capacity);
+
+	for ( size_t i = 0; i < capacity; ++i )
+		entries[i].next = i + 1 < capacity ? static_cast<uint32_t>(i + 1) : NONE;
+
+	free_head = 0;
+
+	// Keep the index at most half full.
+	size_t num_slots = 2;
+	while ( num_slots < capacity * 2 )
+		num_slots *= 2;
+
+	slots.assign(num_slots, NONE);
+	slot_mask = num_slots - 1;
+	}
+
+FragmentTable::Key FragmentTable::MakeKey(const IP_Hdr* ip)
+	{
+	Key key;
+	memset(&key, 0, sizeof(key));
+	ip->SrcAddr().CopyIPv6(&key.src);
+	ip->DstAddr().CopyIPv6(&key.dst);
+	key.id = ip->ID();
+	key.proto = ip->NextProto();
+	return key;
+	}
+
+uint64_t FragmentTable::Hash(const Key& key)
+	{
+	return HashKey::HashBytes(&key, sizeof(key));
+	}
+
+std::shared_ptr<IP_Hdr> FragmentTable::NextFragment(double t, const std::shared_ptr<IP_Hdr>& ip,
+                                                    const u_char* pkt)
+	{
+	if ( frag_timeout != 0.0 )
+		ExpireOld(t);
+
+	uint32_t len = ip->TotalLen();
+	uint16_t hdr_len = ip->HdrLen();
+
+	if ( len < hdr_len )
+		{
+		Weird("fragment_protocol_inconsistency", ip.get());
+		return nullptr;
+		}
+
+	// For IPv6, only the part before the fragment header gets kept.
+	uint16_t unfrag_len = ip->IP4_Hdr() ? hdr_len : hdr_len - 8;
+
+	Key key = MakeKey(ip.get());
+	uint64_t hash = Hash(key);
+	uint32_t idx = Find(key, hash);
+	bool is_new = idx == NONE;
+
+	if ( is_new )
+		idx = Insert(key, hash, t, unfrag_len);
+	else
+		{
+		// The protocol is part of the key, so only the header length
+		// can differ.
+		if ( unfrag_len != entries[idx].hdr_len )
+			Weird("fragment_protocol_inconsistency", ip.get());
+
+		Touch(idx, t);
+		}
+
+	if ( ip->DF() )
+		// Linux MTU discovery for UDP can do this, for example.
+		Weird("fragment_with_DF", ip.get());
+
+	Entry* e = &entries[idx];
+	uint32_t offset = ip->FragOffset();
+	uint32_t upper_seq = offset + len - hdr_len;
+	bool last = ! ip->MF();
+
+	if ( last )
+		{
+		if ( e->frag_size == 0 )
+			e->frag_size = upper_seq;
+
+		else if ( upper_seq != e->frag_size )
+			{
+			Weird("fragment_size_inconsistency", ip.get());
+
+			if ( upper_seq > e->frag_size )
+				e->frag_size = upper_seq;
+			}
+		}
+
+	else if ( len < MIN_ACCEPTABLE_FRAG_SIZE )
+		Weird("excessively_small_fragment", ip.get());
+
+	if ( upper_seq > MAX_ACCEPTABLE_FRAG_SIZE )
+		Weird("excessively_large_fragment", ip.get());
+
+	if ( e->frag_size && upper_seq > e->frag_size )
+		{
+		// A fragment that's not the last one, but still imputes a size
+		// larger than what a previous last fragment indicated.
+		Weird("fragment_size_inconsistency", ip.get());
+		e->frag_size = upper_seq;
+		}
+
+	if ( e->hdr_len + upper_seq > MAX_DATAGRAM_SIZE )
+		{
+		// There's no representing the reassembled datagram.
+		Remove(idx);
+		return nullptr;
+		}
+
+	if ( ! Reserve(idx, upper_seq) )
+		return nullptr;
+
+	if ( is_new )
+		{
+		// Don't do a structure copy - need to pick up options, too.
+		const void* hdr = ip->IP4_Hdr() ? static_cast<const void*>(ip->IP4_Hdr())
+		                                : static_cast<const void*>(ip->IP6_Hdr());
+		memcpy(e->buffer.get(), hdr, e->hdr_len);
+		}
+
+	AddPayload(idx, ip.get(), offset, pkt + hdr_len, len - hdr_len, last);
+
+	if ( ! e->frag_size )
+		return nullptr;
+
+	uint32_t end = ContiguousEnd(idx);
+
+	if ( end < e->frag_size )
+		return nullptr;
+
+	if ( end > e->frag_size || end < e->data_end )
+		{
+		// Either further fragments extend past the last one, or the
+		// contiguous part reaches the expected end with a hole beyond.
+		// This can happen for benign reasons when fragments of two
+		// datagrams intermingle. Analyze the contiguous part.
+		Weird("fragment_size_inconsistency", ip.get());
+		e->frag_size = end;
+		}
+
+	return Reassemble(idx);
+	}
+
+uint32_t FragmentTable::Find(const Key& key, uint64_t hash) const
+	{
+	for ( size_t i = hash & slot_mask;; i = (i + 1) & slot_mask )
+		{
+		uint32_t idx = slots[i];
+
+		if ( idx == NONE )
+			return NONE;
+
+		if ( entries[idx].hash == hash && entries[idx].key == key )
+			return idx;
+		}
+	}
+
+uint32_t FragmentTable::Insert(const Key& key, uint64_t hash, double t, uint16_t hdr_len)
+	{
+	if ( free_head == NONE )
+		Evict(false);
+
+	uint32_t idx = free_head;
+	Entry& e = entries[idx];
+	free_head = e.next;
+
+	e.key = key;
+	e.hash = hash;
+	e.last_time = t;
+	e.frag_size = 0;
+	e.data_end = 0;
+	e.buffer_size = 0;
+	e.hdr_len = hdr_len;
+	memset(e.coverage, 0, sizeof(e.coverage));
+
+	size_t i = hash & slot_mask;
+	while ( slots[i] != NONE )
+		i = (i + 1) & slot_mask;
+
+	slots[i] = idx;
+	LinkFront(idx);
+
+	if ( ++size > max_size )
+		max_size = size;
+
+	return idx;
+	}
+
+void FragmentTable::Remove(uint32_t idx)
+	{
+	Entry& e = entries[idx];
+
+	size_t i = e.hash & slot_mask;
+	while ( slots[i] != idx )
+		i = (i + 1) & slot_mask;
+
+	// Shift later entries of the probe sequence back into the gap, so
+	// that lookups never need to skip over removed entries.
+	for ( size_t j = (i + 1) & slot_mask; slots[j] != NONE; j = (j + 1) & slot_mask )
+		{
+		size_t home = entries[slots[j]].hash & slot_mask;
+
+		if ( ((j - home) & slot_mask) >= ((j - i) & slot_mask) )
+			{
+			slots[i] = slots[j];
+			i = j;
+			}
+		}
+
+	slots[i] = NONE;
+	Unlink(idx);
+
+	memory -= e.buffer_size;
+
+	if ( e.large_coverage )
+		memory -= MAX_COVERAGE_WORDS * sizeof(uint64_t);
+
+	e.buffer.reset();
+	e.large_coverage.reset();
+	e.buffer_size = 0;
+
+	e.next = free_head;
+	free_head = idx;
+	--size;
+	}
+
+void FragmentTable::Touch(uint32_t idx, double t)
+	{
+	entries[idx].last_time = t;
+
+	if ( lru_head != idx )
+		{
+		Unlink(idx);
+		LinkFront(idx);
+		}
+	}
+
+void FragmentTable::LinkFront(uint32_t idx)
+	{
+	Entry& e = entries[idx];
+	e.prev = NONE;
+	e.next = lru_head;
+
+	if ( lru_head != NONE )
+		entries[lru_head].prev = idx;
+	else
+		lru_tail = idx;
+
+	lru_head = idx;
+	}
+
+void FragmentTable::Unlink(uint32_t idx)
+	{
+	Entry& e = entries[idx];
+
+	if ( e.prev != NONE )
+		entries[e.prev].next = e.next;
+	else
+		lru_head = e.next;
+
+	if ( e.next != NONE )
+		entries[e.next].prev = e.prev;
+	else
+		lru_tail = e.prev;
+	}
+
+bool FragmentTable::Reserve(uint32_t idx, uint32_t payload_end)
+	{
+	Entry& e = entries[idx];
+	size_t needed = e.hdr_len + payload_end;
+
+	if ( needed <= e.buffer_size )
+		return true;
+
+	size_t new_size = std::min(std::max(needed, size_t(e.buffer_size) * 2), MAX_DATAGRAM_SIZE);
+	bool grow_coverage = payload_end > INLINE_COVERAGE_SIZE && ! e.large_coverage;
+	uint64_t extra = new_size - e.buffer_size;
+
+	if ( grow_coverage )
+		extra += MAX_COVERAGE_WORDS * sizeof(uint64_t);
+
+	if ( memory_limit )
+		{
+		// The entry being added to is the most recent one, so it only
+		// goes once all others have.
+		while ( memory + extra > memory_limit && lru_tail != idx )
+			Evict(true);
+
+		if ( memory + extra > memory_limit )
+			{
+			Remove(idx);
+			++memory_evictions;
+
+			if ( auto* m = metrics() )
+				m->memory_evictions.Inc();
+
+			return false;
+			}
+		}
+
+	auto buffer = std::make_unique<u_char[]>(new_size);
+
+	if ( e.buffer_size )
+		memcpy(buffer.get(), e.buffer.get(), e.buffer_size);
+
+	e.buffer = std::move(buffer);
+	e.buffer_size = new_size;
+
+	if ( grow_coverage )
+		{
+		e.large_coverage = std::make_unique<uint64_t[]>(MAX_COVERAGE_WORDS);
+		memcpy(e.large_coverage.get(), e.coverage, sizeof(e.coverage));
+		}
+
+	memory += extra;
+	return true;
+	}
+
+void FragmentTable::AddPayload(uint32_t idx, const IP_Hdr* ip, uint32_t offset,
+                               const u_char* data, uint32_t len, bool last)
+	{
+	Entry& e = entries[idx];
+	uint64_t* coverage = e.Coverage();
+	u_char* payload = e.buffer.get() + e.hdr_len;
+
+	uint32_t end = offset + len;
+	uint32_t end_unit = last ? (end + UNIT - 1) / UNIT : end / UNIT;
+	bool overlap = false;
+	bool inconsistent = false;
+
+	// Fragment offsets always fall on unit boundaries. Where a unit has
+	// arrived already, its data stays.
+	for ( uint32_t unit = offset / UNIT; unit < end_unit; ++unit )
+		{
+		uint32_t seq = unit * UNIT;
+		uint32_t n = std::min(uint32_t(UNIT), end - seq);
+		uint64_t bit = uint64_t(1) << (unit % 64);
+
+		if ( coverage[unit / 64] & bit )
+			{
+			overlap = true;
+
+			// A last fragment may have covered just part of the unit.
+			uint32_t have = seq < e.data_end ? std::min(n, e.data_end - seq) : 0;
+
+			if ( memcmp(payload + seq, data + seq - offset, have) != 0 )
+				inconsistent = true;
+			}
+		else
+			{
+			memcpy(payload + seq, data + seq - offset, n);
+			coverage[unit / 64] |= bit;
+			}
+		}
+
+	if ( end > e.data_end )
+		e.data_end = end;
+
+	if ( inconsistent )
+		Weird("fragment_inconsistency", ip);
+	else if ( overlap )
+		Weird("fragment_overlap", ip);
+	}
+
+uint32_t FragmentTable::ContiguousEnd(uint32_t idx)
+	{
+	Entry& e = entries[idx];
+	const uint64_t* coverage = e.Coverage();
+	size_t words = e.large_coverage ? MAX_COVERAGE_WORDS : INLINE_COVERAGE_WORDS;
+	uint64_t units = 0;
+
+	for ( size_t i = 0; i < words; ++i )
+		{
+		if ( coverage[i] != ~uint64_t(0) )
+			{
+			units += __builtin_ctzll(~coverage[i]);
+			break;
+			}
+
+		units += 64;
+		}
+
+	return std::min(units * UNIT, uint64_t(e.data_end));
+	}
+
+std::shared_ptr<IP_Hdr> FragmentTable::Reassemble(uint32_t idx)
+	{
+	Entry& e = entries[idx];
+	uint32_t n = e.hdr_len + e.frag_size;
+	std::shared_ptr<IP_Hdr> reassembled;
+
+	// The datagram takes over the buffer.
+	u_char* pkt = e.buffer.release();
+	memory -= e.buffer_size;
+	e.buffer_size = 0;
+
+	unsigned int version = ((const struct ip*)pkt)->ip_v;
+
+	if ( version == 4 )
+		{
+		struct ip* reassem4 = (struct ip*)pkt;
+		reassem4->ip_len = htons(n);
+		reassembled = std::make_shared<IP_Hdr>(reassem4, true, true);
+		}
+
+	else if ( version == 6 )
+		{
+		struct ip6_hdr* reassem6 = (struct ip6_hdr*)pkt;
+		reassem6->ip6_plen = htons(n - 40);
+		const IPv6_Hdr_Chain* chain = new IPv6_Hdr_Chain(reassem6, e.key.proto, n);
+		reassembled = std::make_shared<IP_Hdr>(reassem6, true, n, chain, true);
+		}
+
+	else
+		{
+		reporter->InternalWarning("bad IP version in fragment reassembly: %d", version);
+		delete[] pkt;
+		}
+
+	Remove(idx);
+	return reassembled;
+	}
+
+void FragmentTable::ExpireOld(double t)
+	{
+	// The recency list is ordered by the time of the last fragment.
+	while ( lru_tail != NONE && entries[lru_tail].last_time + frag_timeout <= t )
+		{
+		Remove(lru_tail);
+		++expired;
+		}
+	}
+
+void FragmentTable::Evict(bool for_memory)
+	{
+	Remove(lru_tail);
+
+	if ( for_memory )
+		{
+		++memory_evictions;
+
+		if ( auto* m = metrics() )
+			m->memory_evictions.Inc();
+		}
+	else
+		{
+		++capacity_evictions;
+
+		if ( auto* m = metrics() )
+			m->capacity_evictions.Inc();
+		}
+	}
+
+void FragmentTable::Clear()
+	{
+	while ( lru_head != NONE )
+		Remove(lru_head);
+	}
+
+void FragmentTable::GetStats(Stats* s) const
+	{
+	s->size = size;
+	s->max_size = max_size;
+	s->memory = memory;
+	s->capacity_evictions = capacity_evictions;
+	s->memory_evictions = memory_evictions;
+	s->expired = expired;
+	}
+
+void FragmentTable::Weird(const char* name, const IP_Hdr* ip) const
+	{
+	if ( session_mgr )
+		session_mgr->Weird(name, ip);
+	}
+
+TEST_SUITE_BEGIN("FragmentTable");
+
+namespace
+	{
+
+// Builds an IPv4 fragment of a UDP datagram whose payload bytes count up
+// from zero.
+std::vector<u_char> make_fragment(uint16_t id, uint16_t offset, uint16_t len, bool mf,
+                                  uint8_t first_byte = 0)
+	{
+	std::vector<u_char> pkt(20 + len);
+	auto* ip4 = reinterpret_cast<struct ip*>(pkt.data());
+	ip4->ip_v = 4;
+	ip4->ip_hl = 5;
+	ip4->ip_len = htons(pkt.size());
+	ip4->ip_id = htons(id);
+	ip4->ip_off = htons((offset / 8) | (mf ? 0x2000 : 0));
+	ip4->ip_ttl = 64;
+	ip4->ip_p = IPPROTO_UDP;
+	ip4->ip_src.s_addr = htonl(0x0a000001);
+	ip4->ip_dst.s_addr = htonl(0x0a000002);
+
+	for ( uint16_t i = 0; i < len; ++i )
+		pkt[20 + i] = static_cast<u_char>(first_byte + offset + i);
+
+	return pkt;
+	}
+
+std::shared_ptr<IP_Hdr> add(FragmentTable& table, const std::vector<u_char>& pkt)
+	{
+	auto ip = std::make_shared<IP_Hdr>(reinterpret_cast<const struct ip*>(pkt.data()), false);
+	return table.NextFragment(1.0, ip, pkt.data());
+	}
+
+	} // namespace
+
+TEST_CASE("fragment table reassembly")
+	{
+	FragmentTable table(16, 1024 * 1024);
+
+	CHECK_FALSE(add(table, make_fragment(1, 2000, 500, false)));
+	CHECK_FALSE(add(table, make_fragment(1, 0, 1000, true)));
+	CHECK(table.Size() == 1);
+
+	// Overlaps both neighbors, and fills the hole.
+	auto r = add(table, make_fragment(1, 992, 1016, true));
+	REQUIRE(r);
+	CHECK(table.Size() == 0);
+	CHECK(r->TotalLen() == 20 + 2500);
+	CHECK(r->NextProto() == IPPROTO_UDP);
+
+	const u_char* payload = r->Payload();
+	bool in_order = true;
+
+	for ( int i = 0; i < 2500; ++i )
+		in_order = in_order && payload[i] == static_cast<u_char>(i);
+
+	CHECK(in_order);
+
+	FragmentTable::Stats s;
+	table.GetStats(&s);
+	CHECK(s.memory == 0);
+	CHECK(s.max_size == 1);
+	}
+
+TEST_CASE("fragment table keeps earlier data")
+	{
+	FragmentTable table(16, 1024 * 1024);
+
+	CHECK_FALSE(add(table, make_fragment(2, 0, 16, true)));
+	CHECK_FALSE(add(table, make_fragment(2, 8, 16, true, 100)));
+	auto r = add(table, make_fragment(2, 24, 3, false));
+	REQUIRE(r);
+	CHECK(r->TotalLen() == 20 + 27);
+	CHECK(r->Payload()[8] == 8);
+	CHECK(r->Payload()[16] == 116);
+	CHECK(r->Payload()[26] == 26);
+	}
+
+TEST_CASE("fragment table large datagrams")
+	{
+	FragmentTable table(16, 1024 * 1024);
+
+	for ( uint16_t offset = 0; offset < 40960; offset += 1024 )
+		CHECK_FALSE(add(table, make_fragment(3, offset, 1024, true)));
+
+	auto r = add(table, make_fragment(3, 40960, 100, false));
+	REQUIRE(r);
+	CHECK(r->TotalLen() == 20 + 41060);
+	CHECK(r->Payload()[41059] == static_cast<u_char>(41059));
+	}
+
+TEST_CASE("fragment table eviction")
+	{
+	FragmentTable table(2, 4096);
+	FragmentTable::Stats s;
+
+	CHECK_FALSE(add(table, make_fragment(1, 0, 1000, true)));
+	CHECK_FALSE(add(table, make_fragment(2, 0, 1000, true)));
+	CHECK_FALSE(add(table, make_fragment(1, 1000, 1000, true)));
+
+	// The table is full, so the least recently updated one goes.
+	CHECK_FALSE(add(table, make_fragment(3, 0, 1000, true)));
+	table.GetStats(&s);
+	CHECK(s.size == 2);
+	CHECK(s.capacity_evictions == 1);
+
+	// Datagram 1 now needs more memory than there is with 3 around.
+	CHECK_FALSE(add(table, make_fragment(1, 2000, 2000, true)));
+	table.GetStats(&s);
+	CHECK(s.size == 1);
+	CHECK(s.memory_evictions == 1);
+	CHECK(s.memory <= 4096);
+
+	auto r = add(table, make_fragment(1, 4000, 8, false));
+	REQUIRE(r);
+	CHECK(r->TotalLen() == 20 + 4008);
+
+	table.Clear();
+	table.GetStats(&s);
+	CHECK(s.size == 0);
+	CHECK(s.memory == 0);
+	}
+
+TEST_SUITE_END();
+
+	} // namespace zeek::detail
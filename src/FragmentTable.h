@@ -0,0 +1,191 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <sys/types.h> // for u_char
+#include <netinet/in.h>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace zeek
+	{
+
+class IP_Hdr;
+
+namespace detail
+	{
+
+/**
+ * A fixed-capacity table of IP datagrams under reassembly, usable in place
+ * of a FragReassembler per datagram. Each entry keeps the datagram's bytes
+ * in a single buffer, headed by the unfragmentable part of the first
+ * fragment's IP header, and tracks which parts have arrived in a bitmap
+ * with a bit per eight bytes, the unit in which fragment offsets are
+ * counted. Datagrams up to INLINE_COVERAGE_SIZE bytes keep the bitmap
+ * within the entry.
+ *
+ * Once the table is full, or the entries' buffers would exceed the memory
+ * limit, the least recently updated datagrams get dropped. Entries time out
+ * frag_timeout after their most recent fragment.
+ */
+class FragmentTable
+	{
+public:
+	/**
+	 * Datagrams up to this size track coverage without an allocation.
+	 */
+	static constexpr size_t INLINE_COVERAGE_SIZE = 8192;
+
+	struct Stats
+		{
+		size_t size; //< Number of datagrams under reassembly.
+		size_t max_size; //< The most datagrams that were under reassembly at once.
+		uint64_t memory; //< Bytes allocated for datagrams under reassembly.
+		uint64_t capacity_evictions; //< Datagrams dropped because the table was full.
+		uint64_t memory_evictions; //< Datagrams dropped because of the memory limit.
+		uint64_t expired; //< Datagrams dropped because of frag_timeout.
+		};
+
+	/**
+	 * Constructor.
+	 *
+	 * @param capacity The most datagrams that may be under reassembly.
+	 *
+	 * @param memory_limit The most bytes that datagrams under reassembly
+	 * may take up.
+	 */
+	FragmentTable(size_t capacity, uint64_t memory_limit);
+
+	FragmentTable(const FragmentTable&) = delete;
+	FragmentTable& operator=(const FragmentTable&) = delete;
+
+	/**
+	 * Adds a fragment.
+	 *
+	 * @param t The current time.
+	 *
+	 * @param ip The fragment's IP header.
+	 *
+	 * @param pkt The fragment's data, starting with the IP header.
+	 *
+	 * @return The reassembled datagram, if the fragment completed one.
+	 */
+	std::shared_ptr<IP_Hdr> NextFragment(double t, const std::shared_ptr<IP_Hdr>& ip,
+	                                     const u_char* pkt);
+
+	/**
+	 * Drops all datagrams under reassembly.
+	 */
+	void Clear();
+
+	size_t Size() const { return size; }
+	size_t MaxSize() const { return max_size; }
+
+	/**
+	 * Fills in statistics about the table.
+	 */
+	void GetStats(Stats* s) const;
+
+private:
+	static constexpr uint32_t NONE = UINT32_MAX;
+	static constexpr size_t UNIT = 8;
+	static constexpr size_t MAX_DATAGRAM_SIZE = 65535;
+	static constexpr size_t INLINE_COVERAGE_WORDS = INLINE_COVERAGE_SIZE / UNIT / 64;
+	static constexpr size_t MAX_COVERAGE_WORDS = (MAX_DATAGRAM_SIZE + UNIT * 64 - 1) / (UNIT * 64);
+
+	struct Key
+		{
+		in6_addr src;
+		in6_addr dst;
+		uint32_t id;
+		uint32_t proto;
+
+		bool operator==(const Key& other) const;
+		};
+
+	struct Entry
+		{
+		Key key;
+		uint64_t hash;
+		double last_time;
+
+		// Neighbors in the recency list, or in the free list.
+		uint32_t prev;
+		uint32_t next;
+
+		// Size of the reassembled payload once known, zero until then.
+		uint32_t frag_size;
+
+		// The end of the highest fragment seen, relative to the payload.
+		uint32_t data_end;
+
+		uint32_t buffer_size;
+
+		// Length of the IP header heading the buffer.
+		uint16_t hdr_len;
+
+		std::unique_ptr<u_char[]> buffer;
+		std::unique_ptr<uint64_t[]> large_coverage;
+		uint64_t coverage[INLINE_COVERAGE_WORDS];
+
+		uint64_t* Coverage() { return large_coverage ? large_coverage.get() : coverage; }
+		};
+
+	static Key MakeKey(const IP_Hdr* ip);
+	static uint64_t Hash(const Key& key);
+
+	uint32_t Find(const Key& key, uint64_t hash) const;
+	uint32_t Insert(const Key& key, uint64_t hash, double t, uint16_t hdr_len);
+	void Remove(uint32_t idx);
+
+	// Moves an entry to the front of the recency list.
+	void Touch(uint32_t idx, double t);
+	void LinkFront(uint32_t idx);
+	void Unlink(uint32_t idx);
+
+	// Makes sure an entry's buffer can hold the payload up to the given
+	// offset, evicting others to stay within the memory limit. Returns
+	// false if it can't.
+	bool Reserve(uint32_t idx, uint32_t payload_end);
+
+	// Copies a fragment's payload into an entry, checking overlaps with
+	// what's there already. Only the final fragment may end within a unit.
+	void AddPayload(uint32_t idx, const IP_Hdr* ip, uint32_t offset, const u_char* data,
+	                uint32_t len, bool last);
+
+	// Returns the end of the contiguous payload starting at offset zero.
+	uint32_t ContiguousEnd(uint32_t idx);
+
+	// Builds the reassembled datagram, handing over the entry's buffer.
+	std::shared_ptr<IP_Hdr> Reassemble(uint32_t idx);
+
+	// Drops entries that haven't seen a fragment for frag_timeout.
+	void ExpireOld(double t);
+
+	// Drops the least recently updated entry.
+	void Evict(bool for_memory);
+
+	void Weird(const char* name, const IP_Hdr* ip) const;
+
+	std::vector<Entry> entries;
+
+	// Open-addressing index into the entries, with linear probing.
+	std::vector<uint32_t> slots;
+	size_t slot_mask;
+
+	uint32_t free_head = NONE;
+	uint32_t lru_head = NONE;
+	uint32_t lru_tail = NONE;
+
+	size_t size = 0;
+	size_t max_size = 0;
+	uint64_t memory = 0;
+	uint64_t memory_limit;
+	uint64_t capacity_evictions = 0;
+	uint64_t memory_evictions = 0;
+	uint64_t expired = 0;
+	};
+
+	} // namespace detail
+	} // namespace zeek
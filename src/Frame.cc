@@ -79,6 +79,23 @@ void Frame::Reset(int startIdx)
 		frame[i] = nullptr;
 	}
 
+void Frame::Recycle(const zeek::Args* fn_args)
+	{
+	current_offset = 0;
+	Reset(0);
+
+	func_args = fn_args;
+	next_stmt = nullptr;
+	break_before_next_stmt = false;
+	break_on_return = false;
+	delayed = false;
+
+	trigger = nullptr;
+	call = nullptr;
+	assoc = nullptr;
+	call_loc = nullptr;
+	}
+
 void Frame::Describe(ODesc* d) const
 	{
 	if ( ! d->IsBinary() )
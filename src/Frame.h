@@ -107,6 +107,20 @@ public:
 	 */
 	void Reset(int startIdx);
 
+	/**
+	 * Readies a frame whose call has finished for another call of the
+	 * same function, leaving it as though newly constructed.  This
+	 * releases the frame's values.
+	 *
+	 * @param fn_args the arguments being passed to the new call.
+	 */
+	void Recycle(const zeek::Args* fn_args);
+
+	/**
+	 * @return the number of values that the frame holds.
+	 */
+	int Size() const { return size; }
+
 	/**
 	 * Describes the frame and all of its values.
 	 */
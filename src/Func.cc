@@ -30,6 +30,7 @@
 #include "zeek/RunState.h"
 #include "zeek/Scope.h"
 #include "zeek/ScriptProfile.h"
+#include "zeek/ScriptSampler.h"
 #include "zeek/Stmt.h"
 #include "zeek/Traverse.h"
 #include "zeek/Var.h"
@@ -320,6 +321,7 @@ ScriptFunc::~ScriptFunc()
 	{
 	delete captures_frame;
 	delete captures_offset_mapping;
+	Unref(spare_frame);
 	}
 
 bool ScriptFunc::IsPure() const
@@ -353,7 +355,20 @@ ValPtr ScriptFunc::Invoke(zeek::Args* args, Frame* parent) const
 		return Flavor() == FUNC_FLAVOR_HOOK ? val_mgr->True() : nullptr;
 		}
 
-	auto f = make_intrusive<Frame>(frame_size, this, args);
+	// Frames of closures and of calls made while evaluating "when"
+	// conditions can outlive the call, so only other calls recycle
+	// their frames.
+	bool recycle_frame = ! captures_frame && ! (parent && parent->GetTrigger());
+	FramePtr f;
+
+	if ( recycle_frame && spare_frame && spare_frame->Size() == static_cast<int>(frame_size) )
+		{
+		f = {AdoptRef{}, spare_frame};
+		spare_frame = nullptr;
+		f->Recycle(args);
+		}
+	else
+		f = make_intrusive<Frame>(frame_size, this, args);
 
 	// Hand down any trigger.
 	if ( parent )
@@ -366,6 +381,9 @@ ValPtr ScriptFunc::Invoke(zeek::Args* args, Frame* parent) const
 	const CallExpr* call_expr = parent ? parent->GetCall() : nullptr;
 	call_stack.emplace_back(CallInfo{call_expr, this, *args});
 
+	if ( script_sampler )
+		script_sampler->Enter(this);
+
 	if ( etm && Flavor() == FUNC_FLAVOR_EVENT )
 		etm->StartEvent(this, args);
 
@@ -413,6 +431,10 @@ ValPtr ScriptFunc::Invoke(zeek::Args* args, Frame* parent) const
 				{
 				g_frame_stack.pop_back();
 				call_stack.pop_back();
+
+				if ( script_sampler )
+					script_sampler->Leave();
+
 				// Result not set b/c exception was thrown
 				throw;
 				}
@@ -449,6 +471,9 @@ ValPtr ScriptFunc::Invoke(zeek::Args* args, Frame* parent) const
 
 	call_stack.pop_back();
 
+	if ( script_sampler )
+		script_sampler->Leave();
+
 	if ( Flavor() == FUNC_FLAVOR_HOOK )
 		{
 		if ( ! result )
@@ -476,6 +501,14 @@ ValPtr ScriptFunc::Invoke(zeek::Args* args, Frame* parent) const
 
 	g_frame_stack.pop_back();
 
+	// Keep the frame only if nothing else holds onto it.
+	if ( recycle_frame && f->RefCnt() == 1 && ! f->HasDelayed() )
+		{
+		f->Recycle(nullptr);
+		Unref(spare_frame);
+		spare_frame = f.release();
+		}
+
 	return result;
 	}
 
@@ -703,7 +736,15 @@ ValPtr BuiltinFunc::Invoke(Args* args, Frame* parent) const
 
 	const CallExpr* call_expr = parent ? parent->GetCall() : nullptr;
 	call_stack.emplace_back(CallInfo{call_expr, this, *args});
+
+	if ( script_sampler )
+		script_sampler->Enter(this);
+
 	auto result = std::move(func(parent, args).rval);
+
+	if ( script_sampler )
+		script_sampler->Leave();
+
 	call_stack.pop_back();
 
 	if ( result && g_trace_state.DoTrace() )
@@ -978,6 +1019,7 @@ void init_primary_bifs()
 	ThreadStats = id::find_type<RecordType>("ThreadStats");
 	BrokerStats = id::find_type<RecordType>("BrokerStats");
 	ReporterStats = id::find_type<RecordType>("ReporterStats");
+	DumperStats = id::find_type<RecordType>("DumperStats");
 
 	var_sizes = id::find_type("var_sizes")->AsTableType();
 
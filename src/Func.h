@@ -44,6 +44,7 @@ using IDPtr = IntrusivePtr<ID>;
 using StmtPtr = IntrusivePtr<Stmt>;
 
 class ScriptFunc;
+class ScriptSampler;
 
 	} // namespace detail
 
@@ -134,6 +135,12 @@ protected:
 	Kind kind = SCRIPT_FUNC;
 	FuncTypePtr type;
 	std::string name;
+
+private:
+	friend class detail::ScriptSampler;
+
+	// The function's name in script samples, if it's been sampled.
+	mutable int sample_id = -1;
 	};
 
 namespace detail
@@ -262,6 +269,11 @@ private:
 
 	OffsetMap* captures_offset_mapping = nullptr;
 
+	// The frame of the most recent finished call, kept for the next
+	// call to reuse rather than allocate its own.  Recursive calls
+	// find it taken and allocate as usual.
+	mutable Frame* spare_frame = nullptr;
+
 	// The most recently added/updated body ...
 	StmtPtr current_body;
 
@@ -7,7 +7,9 @@
 #include <highwayhash/highwayhash_target.h>
 #include <highwayhash/instruction_sets.h>
 #include <highwayhash/sip_hash.h>
+#include <set>
 
+#include "zeek/3rdparty/doctest.h"
 #include "zeek/DebugLogger.h"
 #include "zeek/Desc.h"
 #include "zeek/Reporter.h"
@@ -56,6 +58,12 @@ void KeyedHash::InitializeSeeds(const std::array<uint32_t, SEED_INIT_SIZE>& seed
 	                 reinterpret_cast<unsigned char*>(shared_highwayhash_key));
 	memcpy(shared_siphash_key, reinterpret_cast<const char*>(seed_data.data()) + 64, 16);
 
+	// Derived from the SipHash key rather than taken from the seed data
+	// directly, so that it doesn't reveal anything about the other keys.
+	static constexpr char fasthash_label[] = "FastHash64";
+	shared_fasthash_seed = highwayhash::SipHash(shared_siphash_key, fasthash_label,
+	                                            sizeof(fasthash_label) - 1);
+
 	seeds_initialized = true;
 	}
 
@@ -82,6 +90,126 @@ void KeyedHash::Hash256(const void* bytes, uint64_t size, hash256_t* result)
 		shared_highwayhash_key, static_cast<const char*>(bytes), size, result);
 	}
 
+// The building blocks of FastHash64(), following wyhash's final version.
+namespace
+	{
+
+// wyhash's default secret.
+constexpr uint64_t fasthash_secret[4] = {0x2d358dccaa6c78a5ULL, 0x8bb84b93962eacc9ULL,
+                                         0x4b33a62ed433d4a3ULL, 0x4d5a2da51de1aa47ULL};
+
+// Multiplies a and b, leaving the low half of the product in a and the
+// high half in b.
+inline void fasthash_mum(uint64_t* a, uint64_t* b)
+	{
+#ifdef __SIZEOF_INT128__
+	__uint128_t r = *a;
+	r *= *b;
+	*a = static_cast<uint64_t>(r);
+	*b = static_cast<uint64_t>(r >> 64);
+#else
+	uint64_t ha = *a >> 32, hb = *b >> 32;
+	uint64_t la = static_cast<uint32_t>(*a), lb = static_cast<uint32_t>(*b);
+	uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+	uint64_t t = rl + (rm0 << 32);
+	uint64_t c = t < rl;
+	uint64_t lo = t + (rm1 << 32);
+	c += lo < t;
+	*a = lo;
+	*b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+	}
+
+inline uint64_t fasthash_mix(uint64_t a, uint64_t b)
+	{
+	fasthash_mum(&a, &b);
+	return a ^ b;
+	}
+
+inline uint64_t fasthash_read64(const uint8_t* p)
+	{
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+	}
+
+inline uint64_t fasthash_read32(const uint8_t* p)
+	{
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+	}
+
+// Reads 1-3 bytes.
+inline uint64_t fasthash_read_small(const uint8_t* p, size_t k)
+	{
+	return (uint64_t(p[0]) << 16) | (uint64_t(p[k >> 1]) << 8) | p[k - 1];
+	}
+
+	} // namespace
+
+hash64_t KeyedHash::FastHash64(const void* bytes, uint64_t size)
+	{
+	const auto* s = fasthash_secret;
+	const auto* p = static_cast<const uint8_t*>(bytes);
+	uint64_t seed = shared_fasthash_seed;
+	uint64_t a, b;
+
+	seed ^= fasthash_mix(seed ^ s[0], s[1]);
+
+	if ( size <= 16 )
+		{
+		if ( size >= 4 )
+			{
+			size_t off = (size >> 3) << 2;
+			a = (fasthash_read32(p) << 32) | fasthash_read32(p + off);
+			b = (fasthash_read32(p + size - 4) << 32) | fasthash_read32(p + size - 4 - off);
+			}
+		else if ( size > 0 )
+			{
+			a = fasthash_read_small(p, size);
+			b = 0;
+			}
+		else
+			a = b = 0;
+		}
+	else
+		{
+		uint64_t i = size;
+
+		if ( i > 48 )
+			{
+			uint64_t see1 = seed, see2 = seed;
+
+			do
+				{
+				seed = fasthash_mix(fasthash_read64(p) ^ s[1], fasthash_read64(p + 8) ^ seed);
+				see1 = fasthash_mix(fasthash_read64(p + 16) ^ s[2], fasthash_read64(p + 24) ^ see1);
+				see2 = fasthash_mix(fasthash_read64(p + 32) ^ s[3], fasthash_read64(p + 40) ^ see2);
+				p += 48;
+				i -= 48;
+				} while ( i > 48 );
+
+			seed ^= see1 ^ see2;
+			}
+
+		while ( i > 16 )
+			{
+			seed = fasthash_mix(fasthash_read64(p) ^ s[1], fasthash_read64(p + 8) ^ seed);
+			i -= 16;
+			p += 16;
+			}
+
+		a = fasthash_read64(p + i - 16);
+		b = fasthash_read64(p + i - 8);
+		}
+
+	a ^= s[1];
+	b ^= seed;
+	fasthash_mum(&a, &b);
+	return fasthash_mix(a ^ s[0] ^ size, b ^ s[1]);
+	}
+
 hash64_t KeyedHash::StaticHash64(const void* bytes, uint64_t size)
 	{
 	hash64_t result = 0;
@@ -256,7 +384,11 @@ char* HashKey::CopyKey(const char* k, size_t s) const
 
 hash_t HashKey::HashBytes(const void* bytes, size_t size)
 	{
+#ifdef ZEEK_FAST_TABLE_HASH
+	return KeyedHash::FastHash64(bytes, size);
+#else
 	return KeyedHash::Hash64(bytes, size);
+#endif
 	}
 
 void HashKey::Set(bool b)
@@ -543,4 +675,32 @@ void HashKey::EnsureReadSpace(size_t n) const
 		                        n, size - read_size);
 	}
 
+TEST_CASE("fast hash")
+	{
+	uint8_t buf[128];
+
+	for ( size_t i = 0; i < sizeof(buf); ++i )
+		buf[i] = static_cast<uint8_t>(i * 7 + 1);
+
+	std::set<hash64_t> hashes;
+
+	// Every length, as each range takes a different path, and every
+	// position within the key needs to count.
+	for ( size_t n = 0; n <= sizeof(buf); ++n )
+		{
+		auto h = KeyedHash::FastHash64(buf, n);
+		CHECK(h == KeyedHash::FastHash64(buf, n));
+		hashes.insert(h);
+
+		for ( size_t i = 0; i < n; ++i )
+			{
+			buf[i] ^= 0x10;
+			hashes.insert(KeyedHash::FastHash64(buf, n));
+			buf[i] ^= 0x10;
+			}
+		}
+
+	CHECK(hashes.size() == (sizeof(buf) + 1) * (sizeof(buf) + 2) / 2);
+	}
+
 	} // namespace zeek::detail
@@ -112,6 +112,28 @@ public:
 	 */
 	static void Hash256(const void* bytes, uint64_t size, hash256_t* result);
 
+	/**
+	 * Generate a 64 bit digest hash with a fast, non-cryptographic hash
+	 * function in the style of wyhash.
+	 *
+	 * Like Hash64(), this hash is seeded with random data unless the
+	 * ZEEK_SEED_FILE environment variable is set. Its seed makes it hard to
+	 * predict which keys collide, but unlike SipHash it's not a PRF, so
+	 * it makes collision attacks harder rather than impossible. It takes
+	 * a fraction of SipHash's time for the short keys that table lookups
+	 * typically use.
+	 *
+	 * HashKey uses this instead of Hash64() when Zeek was configured
+	 * with --enable-fast-table-hash.
+	 *
+	 * @param bytes Bytes to hash
+	 *
+	 * @param size Size of bytes
+	 *
+	 * @returns 64 bit digest hash
+	 */
+	static hash64_t FastHash64(const void* bytes, uint64_t size);
+
 	/**
 	 * Generates a installation-specific 64 bit hash.
 	 *
@@ -212,6 +234,9 @@ private:
 	alignas(16) static unsigned long long shared_siphash_key[2];
 	// This key changes each start (unless a seed is specified)
 	inline static uint8_t shared_hmac_md5_key[16];
+	// The seed of FastHash64(). This changes each start (unless a seed is
+	// specified)
+	inline static uint64_t shared_fasthash_seed = 0;
 	inline static bool seeds_initialized = false;
 
 	friend void util::detail::hmac_md5(size_t size, const unsigned char* bytes,
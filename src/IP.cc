@@ -67,8 +67,8 @@ RecordValPtr IPv6_Hdr::ToVal(VectorValPtr chain) const
 			rv->Assign(2, ntohs(ip6->ip6_plen));
 			rv->Assign(3, ip6->ip6_nxt);
 			rv->Assign(4, ip6->ip6_hlim);
-			rv->Assign(5, make_intrusive<AddrVal>(IPAddr(ip6->ip6_src)));
-			rv->Assign(6, make_intrusive<AddrVal>(IPAddr(ip6->ip6_dst)));
+			rv->Assign(5, val_mgr->Addr(IPAddr(ip6->ip6_src)));
+			rv->Assign(6, val_mgr->Addr(IPAddr(ip6->ip6_dst)));
 			if ( ! chain )
 				chain = make_intrusive<VectorVal>(id::find_type<VectorType>("ip6_ext_hdr_chain"));
 			rv->Assign(7, std::move(chain));
@@ -344,8 +344,8 @@ RecordValPtr IP_Hdr::ToIPHdrVal() const
 		rval->Assign(3, ntohs(ip4->ip_id));
 		rval->Assign(4, ip4->ip_ttl);
 		rval->Assign(5, ip4->ip_p);
-		rval->Assign(6, make_intrusive<AddrVal>(ip4->ip_src.s_addr));
-		rval->Assign(7, make_intrusive<AddrVal>(ip4->ip_dst.s_addr));
+		rval->Assign(6, val_mgr->Addr(IPAddr(ip4->ip_src)));
+		rval->Assign(7, val_mgr->Addr(IPAddr(ip4->ip_dst)));
 		}
 	else
 		{
@@ -0,0 +1,168 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/IPv4PrefixIndex.h"
+
+#include <algorithm>
+#include <random>
+
+#include "zeek/3rdparty/doctest.h"
+
+namespace zeek::detail
+	{
+
+void IPv4PrefixIndex::Build(std::vector<Prefix> prefixes)
+	{
+	// Going from shorter to longer prefixes lets longer ones simply
+	// overwrite what they cover, and means that no chunk exists yet
+	// where a prefix fills entries.
+	std::sort(prefixes.begin(), prefixes.end(),
+	          [](const Prefix& a, const Prefix& b) { return a.len < b.len; });
+
+	entries.assign(TOP_SIZE, 0);
+	entries.shrink_to_fit();
+	data.clear();
+	data.reserve(prefixes.size());
+
+	for ( const auto& p : prefixes )
+		{
+		data.push_back(p.data);
+		auto leaf = static_cast<uint32_t>(data.size());
+		auto addr = p.len > 0 ? p.addr & (0xffffffff << (32 - p.len)) : 0;
+
+		size_t start;
+		size_t span;
+
+		if ( p.len <= 16 )
+			{
+			start = addr >> 16;
+			span = size_t(1) << (16 - p.len);
+			}
+
+		else
+			{
+			auto chunk = Child(addr >> 16);
+
+			if ( p.len <= 24 )
+				{
+				start = chunk + ((addr >> 8) & 0xff);
+				span = size_t(1) << (24 - p.len);
+				}
+			else
+				{
+				chunk = Child(chunk + ((addr >> 8) & 0xff));
+				start = chunk + (addr & 0xff);
+				span = size_t(1) << (32 - p.len);
+				}
+			}
+
+		std::fill_n(entries.begin() + start, span, leaf);
+		}
+	}
+
+size_t IPv4PrefixIndex::Child(size_t pos)
+	{
+	auto e = entries[pos];
+
+	if ( e & CHILD )
+		return ChunkStart(e);
+
+	// The new chunk inherits the prefix that covered its entry.
+	auto chunk = static_cast<uint32_t>((entries.size() - TOP_SIZE) / CHUNK_SIZE);
+	entries.resize(entries.size() + CHUNK_SIZE, e);
+	entries[pos] = CHILD | chunk;
+
+	return ChunkStart(entries[pos]);
+	}
+
+void IPv4PrefixIndex::Clear()
+	{
+	entries = {};
+	data = {};
+	}
+
+size_t IPv4PrefixIndex::MemoryAllocation() const
+	{
+	return sizeof(*this) + entries.capacity() * sizeof(uint32_t) + data.capacity() * sizeof(void*);
+	}
+
+TEST_SUITE_BEGIN("IPv4PrefixIndex");
+
+TEST_CASE("ipv4 prefix index")
+	{
+	int d[5];
+	IPv4PrefixIndex idx;
+
+	CHECK_FALSE(idx.IsBuilt());
+
+	idx.Build({{0x0a000000, 8, &d[0]}, // 10.0.0.0/8
+	           {0x0a010000, 16, &d[1]}, // 10.1.0.0/16
+	           {0x0a010200, 24, &d[2]}, // 10.1.2.0/24
+	           {0x0a010203, 32, &d[3]}, // 10.1.2.3/32
+	           {0xc0a80000, 17, &d[4]}}); // 192.168.0.0/17
+
+	REQUIRE(idx.IsBuilt());
+	CHECK(idx.Lookup(0x0a020304) == &d[0]);
+	CHECK(idx.Lookup(0x0a01ff00) == &d[1]);
+	CHECK(idx.Lookup(0x0a010201) == &d[2]);
+	CHECK(idx.Lookup(0x0a010203) == &d[3]);
+	CHECK(idx.Lookup(0x0a010204) == &d[2]);
+	CHECK(idx.Lookup(0xc0a87fff) == &d[4]);
+	CHECK(idx.Lookup(0xc0a88000) == nullptr);
+	CHECK(idx.Lookup(0x0b000000) == nullptr);
+
+	idx.Build({{0, 0, &d[0]}, {0x0a010203, 32, &d[1]}});
+	CHECK(idx.Lookup(0x01020304) == &d[0]);
+	CHECK(idx.Lookup(0x0a010203) == &d[1]);
+
+	idx.Clear();
+	CHECK_FALSE(idx.IsBuilt());
+	}
+
+TEST_CASE("ipv4 prefix index vs linear search")
+	{
+	std::mt19937 rng(42);
+	std::vector<IPv4PrefixIndex::Prefix> prefixes;
+	std::vector<int> d(500);
+
+	// Prefixes within a few networks, so that they nest.
+	for ( auto& i : d )
+		{
+		auto len = static_cast<int>(8 + rng() % 25);
+		auto addr = static_cast<uint32_t>((0x0a000000 | (rng() & 0x0003ffff)) &
+		                                  (0xffffffff << (32 - len)));
+
+		bool dup = false;
+		for ( const auto& p : prefixes )
+			dup = dup || (p.addr == addr && p.len == len);
+
+		if ( ! dup )
+			prefixes.push_back({addr, len, &i});
+		}
+
+	IPv4PrefixIndex idx;
+	idx.Build(prefixes);
+
+	for ( int i = 0; i < 10000; ++i )
+		{
+		auto addr = static_cast<uint32_t>(0x0a000000 | (rng() & 0x0003ffff));
+		void* expected = nullptr;
+		int best = -1;
+
+		for ( const auto& p : prefixes )
+			{
+			auto mask = 0xffffffff << (32 - p.len);
+
+			if ( (addr & mask) == p.addr && p.len > best )
+				{
+				best = p.len;
+				expected = p.data;
+				}
+			}
+
+		REQUIRE(idx.Lookup(addr) == expected);
+		}
+	}
+
+TEST_SUITE_END();
+
+	} // namespace zeek::detail
@@ -0,0 +1,90 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace zeek::detail
+	{
+
+/**
+ * A multibit trie over IPv4 prefixes for longest-prefix lookups of IPv4
+ * addresses. It splits addresses into strides of 16, 8 and 8 bits and
+ * expands prefixes to fill every slot they cover, so a lookup is at most
+ * three array accesses. The index is built in one go from a set of
+ * prefixes and doesn't support updates; the owner rebuilds it instead.
+ */
+class IPv4PrefixIndex
+	{
+public:
+	struct Prefix
+		{
+		uint32_t addr; // in host order
+		int len; // 0 to 32
+		void* data;
+		};
+
+	/**
+	 * Builds the index anew from the given prefixes, which must be
+	 * distinct and non-null.
+	 */
+	void Build(std::vector<Prefix> prefixes);
+
+	/**
+	 * Drops the index.
+	 */
+	void Clear();
+
+	/**
+	 * Returns true if the index holds anything.
+	 */
+	bool IsBuilt() const { return ! entries.empty(); }
+
+	/**
+	 * Returns the data associated with the longest prefix covering an
+	 * address, or nullptr if there's none.
+	 *
+	 * @param addr The address, in host order.
+	 */
+	void* Lookup(uint32_t addr) const
+		{
+		auto e = entries[addr >> 16];
+
+		if ( e & CHILD )
+			{
+			e = entries[ChunkStart(e) + ((addr >> 8) & 0xff)];
+
+			if ( e & CHILD )
+				e = entries[ChunkStart(e) + (addr & 0xff)];
+			}
+
+		return e ? data[e - 1] : nullptr;
+		}
+
+	/**
+	 * Returns the memory that the index takes up, in bytes.
+	 */
+	size_t MemoryAllocation() const;
+
+private:
+	// Entries refer either to a chunk of 256 entries for the next 8 bits,
+	// if this bit is set, or else to the data at one less than their
+	// value, with 0 meaning no prefix covers them.
+	static constexpr uint32_t CHILD = 0x80000000;
+	static constexpr size_t TOP_SIZE = 1 << 16;
+	static constexpr size_t CHUNK_SIZE = 1 << 8;
+
+	static size_t ChunkStart(uint32_t e) { return TOP_SIZE + (e & ~CHILD) * CHUNK_SIZE; }
+
+	// Returns the start of the chunk below the given entry, creating it
+	// if needed.
+	size_t Child(size_t pos);
+
+	// The 2^16 top-level entries, followed by the chunks.
+	std::vector<uint32_t> entries;
+	std::vector<void*> data;
+	};
+
+	} // namespace zeek::detail
@@ -0,0 +1,474 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/LiteralPrefilter.h"
+
+#include "zeek/zeek-config.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#endif
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <random>
+
+#include "zeek/util.h"
+
+#include "zeek/3rdparty/doctest.h"
+
+namespace zeek::detail
+	{
+
+// Returns true if the pattern has an alternative outside of any group, in
+// which case not all of its matches need to start the same way.
+static bool has_toplevel_alternative(const char* p)
+	{
+	int depth = 0;
+
+	while ( *p )
+		{
+		switch ( *p )
+			{
+			case '\\':
+				if ( ! *++p )
+					return false;
+				break;
+
+			case '"':
+				while ( *++p && *p != '"' )
+					if ( *p == '\\' && ! *++p )
+						return false;
+
+				if ( ! *p )
+					return false;
+				break;
+
+			case '[':
+				// A closing bracket right at the start is a member.
+				if ( *++p == '^' )
+					++p;
+
+				if ( *p == ']' )
+					++p;
+
+				while ( *p && *p != ']' )
+					if ( *p++ == '\\' && *p )
+						++p;
+
+				if ( ! *p )
+					return false;
+				break;
+
+			case '(': ++depth; break;
+			case ')': --depth; break;
+
+			case '|':
+				if ( depth == 0 )
+					return true;
+				break;
+			}
+
+		++p;
+		}
+
+	return false;
+	}
+
+// Parses a single literal character, returning false if there's none at
+// the given position.
+static bool parse_literal_char(const char*& p, char* c)
+	{
+	if ( isalnum(*p) || (*p && strchr(" !#%&',-/:;<=>@_`~]}", *p)) )
+		{
+		*c = *p++;
+		return true;
+		}
+
+	if ( *p != '\\' )
+		return false;
+
+	const char* q = p + 1;
+
+	if ( *q == 'x' )
+		{
+		if ( ! isxdigit(q[1]) || ! isxdigit(q[2]) )
+			return false;
+
+		*c = static_cast<char>(util::detail::expand_escape(q));
+		p = q;
+		return true;
+		}
+
+	// Octal escapes may run past three digits in patterns, leave them alone.
+	if ( ! *q || *q == '\n' || (*q >= '0' && *q <= '7') )
+		return false;
+
+	*c = static_cast<char>(util::detail::expand_escape(q));
+	p = q;
+	return true;
+	}
+
+bool LiteralPrefilter::ExtractLiteral(const char* pattern, std::string* literal)
+	{
+	const char* p = pattern;
+
+	if ( *p == '^' )
+		++p;
+
+	if ( strncmp(p, ".*", 2) != 0 )
+		return false;
+
+	p += 2;
+
+	if ( has_toplevel_alternative(p) )
+		return false;
+
+	std::string lit;
+	char c;
+
+	while ( parse_literal_char(p, &c) )
+		{
+		// An optional or repeated character isn't part of every match
+		// in that form; one that repeats at least once still starts it.
+		if ( *p == '*' || *p == '?' || *p == '{' )
+			break;
+
+		lit += c;
+
+		if ( *p == '+' )
+			break;
+		}
+
+	if ( lit.size() < MIN_LENGTH )
+		return false;
+
+	*literal = std::move(lit);
+	return true;
+	}
+
+bool LiteralPrefilter::ParseLiteral(const char* pattern, std::string* literal, bool* bol,
+                                    bool* eol)
+	{
+	const char* p = pattern;
+	bool at_bol = false;
+	bool at_eol = false;
+
+	if ( *p == '^' )
+		{
+		at_bol = true;
+		++p;
+		}
+
+	std::string lit;
+	char c;
+
+	while ( parse_literal_char(p, &c) )
+		lit += c;
+
+	if ( *p == '$' )
+		{
+		at_eol = true;
+		++p;
+		}
+
+	if ( *p || lit.empty() )
+		return false;
+
+	*literal = std::move(lit);
+	*bol = at_bol;
+	*eol = at_eol;
+	return true;
+	}
+
+namespace
+	{
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+
+#define HAVE_AVX2_PREFILTER
+
+// Returns a mask of the positions among the 32 starting at data whose
+// two bytes may be the prefix of a literal. Reads 33 bytes.
+__attribute__((target("avx2"))) uint32_t candidates_avx2(const uint8_t (*buckets)[16],
+                                                          const u_char* data)
+	{
+	const __m256i low_nibble = _mm256_set1_epi8(0x0f);
+	__m256i tables[4];
+
+	for ( int k = 0; k < 4; ++k )
+		tables[k] = _mm256_broadcastsi128_si256(
+			_mm_loadu_si128(reinterpret_cast<const __m128i*>(buckets[k])));
+
+	__m256i first = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+	__m256i second = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + 1));
+
+	__m256i first_lo = _mm256_and_si256(first, low_nibble);
+	__m256i first_hi = _mm256_and_si256(_mm256_srli_epi16(first, 4), low_nibble);
+	__m256i second_lo = _mm256_and_si256(second, low_nibble);
+	__m256i second_hi = _mm256_and_si256(_mm256_srli_epi16(second, 4), low_nibble);
+
+	// The buckets that have a prefix matching all four nibbles.
+	__m256i match = _mm256_and_si256(_mm256_shuffle_epi8(tables[0], first_lo),
+	                                 _mm256_shuffle_epi8(tables[1], first_hi));
+	match = _mm256_and_si256(match, _mm256_shuffle_epi8(tables[2], second_lo));
+	match = _mm256_and_si256(match, _mm256_shuffle_epi8(tables[3], second_hi));
+
+	__m256i none = _mm256_cmpeq_epi8(match, _mm256_setzero_si256());
+	return ~static_cast<uint32_t>(_mm256_movemask_epi8(none));
+	}
+
+#endif
+
+using candidates_func = uint32_t (*)(const uint8_t (*)[16], const u_char*);
+
+// Returns null if the scan should go through the data one position at a
+// time.
+candidates_func select_candidates()
+	{
+#ifdef ZEEK_SIMD_PREFILTER
+#if defined(HAVE_AVX2_PREFILTER)
+	if ( __builtin_cpu_supports("avx2") )
+		return candidates_avx2;
+#endif
+#endif
+
+	return nullptr;
+	}
+
+// A reference so that the unit tests can switch kernels.
+candidates_func& default_candidates()
+	{
+	static candidates_func kernel = select_candidates();
+	return kernel;
+	}
+
+// Spreads the prefixes over the eight buckets.
+uint8_t prefix_bucket(uint16_t prefix)
+	{
+	return uint8_t(1) << (((prefix * 0x9e37u) >> 13) & 7);
+	}
+
+	}
+
+void LiteralPrefilter::Add(const std::string& literal, int group)
+	{
+	auto p = reinterpret_cast<const u_char*>(literal.data());
+	auto prefix = Prefix(p);
+	prefixes[prefix / 64] |= uint64_t(1) << (prefix % 64);
+
+	auto bucket = prefix_bucket(prefix);
+	nibble_buckets[0][p[0] & 0x0f] |= bucket;
+	nibble_buckets[1][p[0] >> 4] |= bucket;
+	nibble_buckets[2][p[1] & 0x0f] |= bucket;
+	nibble_buckets[3][p[1] >> 4] |= bucket;
+
+	auto it = std::upper_bound(literals.begin(), literals.end(), prefix,
+	                           [](uint16_t p, const std::pair<std::string, int>& l)
+	                           { return p < Prefix(reinterpret_cast<const u_char*>(l.first.data())); });
+
+	literals.emplace(it, literal, group);
+	max_length = std::max(max_length, literal.size());
+	}
+
+void LiteralPrefilter::Scan(const u_char* data, size_t len, std::vector<bool>* waiting,
+                            std::vector<int>* found) const
+	{
+	if ( len < MIN_LENGTH )
+		return;
+
+	size_t i = 0;
+
+	if ( auto candidates = default_candidates() )
+		{
+		// Each block of 32 positions reads the byte following them, too.
+		for ( ; i + 33 <= len; i += 32 )
+			for ( auto c = candidates(nibble_buckets, data + i); c; c &= c - 1 )
+				ScanAt(data, len, i + __builtin_ctz(c), waiting, found);
+		}
+
+	for ( ; i + MIN_LENGTH <= len; ++i )
+		ScanAt(data, len, i, waiting, found);
+	}
+
+void LiteralPrefilter::ScanAt(const u_char* data, size_t len, size_t i, std::vector<bool>* waiting,
+                              std::vector<int>* found) const
+	{
+	auto prefix = Prefix(data + i);
+
+	if ( ! (prefixes[prefix / 64] & (uint64_t(1) << (prefix % 64))) )
+		return;
+
+	auto it = std::lower_bound(literals.begin(), literals.end(), prefix,
+	                           [](const std::pair<std::string, int>& l, uint16_t p)
+	                           { return Prefix(reinterpret_cast<const u_char*>(l.first.data())) < p; });
+
+	for ( ; it != literals.end() &&
+	        Prefix(reinterpret_cast<const u_char*>(it->first.data())) == prefix;
+	      ++it )
+		{
+		const auto& [literal, group] = *it;
+
+		if ( ! (*waiting)[group] || literal.size() > len - i ||
+		     memcmp(data + i, literal.data(), literal.size()) != 0 )
+			continue;
+
+		(*waiting)[group] = false;
+		found->push_back(group);
+		}
+	}
+
+TEST_SUITE_BEGIN("LiteralPrefilter");
+
+TEST_CASE("literal extraction")
+	{
+	std::string lit;
+
+	CHECK(LiteralPrefilter::ExtractLiteral(".*GET /", &lit));
+	CHECK(lit == "GET /");
+
+	CHECK(LiteralPrefilter::ExtractLiteral("^.*\\x16\\x03\\x01[\\x00-\\x03]", &lit));
+	CHECK(lit == "\x16\x03\x01");
+
+	CHECK(LiteralPrefilter::ExtractLiteral(".*USER\\r\\n(foo|bar)", &lit));
+	CHECK(lit == "USER\r\n");
+
+	// The last character is optional.
+	CHECK(LiteralPrefilter::ExtractLiteral(".*abcd?e", &lit));
+	CHECK(lit == "abc");
+
+	CHECK(LiteralPrefilter::ExtractLiteral(".*abc+", &lit));
+	CHECK(lit == "abc");
+
+	// Anchored, too short, or without a common literal.
+	CHECK_FALSE(LiteralPrefilter::ExtractLiteral("GET /", &lit));
+	CHECK_FALSE(LiteralPrefilter::ExtractLiteral(".*ab[cd]", &lit));
+	CHECK_FALSE(LiteralPrefilter::ExtractLiteral(".*[Gg][Ee][Tt]", &lit));
+	CHECK_FALSE(LiteralPrefilter::ExtractLiteral(".*GET|POST", &lit));
+	CHECK_FALSE(LiteralPrefilter::ExtractLiteral("(?i:.*GET)", &lit));
+	CHECK_FALSE(LiteralPrefilter::ExtractLiteral(".*\\101\\102\\103", &lit));
+
+	// Alternatives within groups are fine.
+	CHECK(LiteralPrefilter::ExtractLiteral(".*GET (a|b)[|]\"|\"", &lit));
+	CHECK(lit == "GET ");
+	}
+
+TEST_CASE("literal parsing")
+	{
+	std::string lit;
+	bool bol, eol;
+
+	CHECK(LiteralPrefilter::ParseLiteral("GET \\/", &lit, &bol, &eol));
+	CHECK(lit == "GET /");
+	CHECK_FALSE(bol);
+	CHECK_FALSE(eol);
+
+	CHECK(LiteralPrefilter::ParseLiteral("^\\x16\\x03$", &lit, &bol, &eol));
+	CHECK(lit == "\x16\x03");
+	CHECK(bol);
+	CHECK(eol);
+
+	CHECK(LiteralPrefilter::ParseLiteral("a\\$", &lit, &bol, &eol));
+	CHECK(lit == "a$");
+	CHECK_FALSE(eol);
+
+	CHECK_FALSE(LiteralPrefilter::ParseLiteral("", &lit, &bol, &eol));
+	CHECK_FALSE(LiteralPrefilter::ParseLiteral("^$", &lit, &bol, &eol));
+	CHECK_FALSE(LiteralPrefilter::ParseLiteral("ab+", &lit, &bol, &eol));
+	CHECK_FALSE(LiteralPrefilter::ParseLiteral("a.c", &lit, &bol, &eol));
+	CHECK_FALSE(LiteralPrefilter::ParseLiteral("a|b", &lit, &bol, &eol));
+	CHECK_FALSE(LiteralPrefilter::ParseLiteral("a$b", &lit, &bol, &eol));
+	CHECK_FALSE(LiteralPrefilter::ParseLiteral("\\101", &lit, &bol, &eol));
+	}
+
+TEST_CASE("literal scan")
+	{
+	LiteralPrefilter pf;
+	pf.Add("GET /", 0);
+	pf.Add("GEX", 1);
+	pf.Add("POST", 2);
+	pf.Add("xyz", 3);
+
+	CHECK(pf.MaxLength() == 5);
+
+	std::vector<bool> waiting = {true, true, true, true};
+	std::vector<int> found;
+
+	const char* data = "xx GET /a POST GET /b xy";
+	pf.Scan(reinterpret_cast<const u_char*>(data), strlen(data), &waiting, &found);
+
+	CHECK(found == std::vector<int>{0, 2});
+	CHECK(waiting == std::vector<bool>{false, true, false, true});
+
+	// Only groups still waiting get reported, and literals need to fit.
+	found.clear();
+	data = "POST GEX xyz";
+	pf.Scan(reinterpret_cast<const u_char*>(data), strlen(data) - 1, &waiting, &found);
+
+	CHECK(found == std::vector<int>{1});
+	CHECK(waiting == std::vector<bool>{false, false, false, true});
+	}
+
+#if defined(HAVE_AVX2_PREFILTER)
+TEST_CASE("literal scan with and without AVX2")
+	{
+	if ( ! __builtin_cpu_supports("avx2") )
+		{
+		MESSAGE("skipping, no AVX2 support");
+		return;
+		}
+
+	// A small alphabet makes for plenty of matches and near misses, and
+	// the high bytes check the nibble lookups.
+	const std::string alphabet("abc\x00\x8f\xf1", 6);
+	std::mt19937 rng(42);
+	auto random = [&rng](size_t n) { return std::uniform_int_distribution<size_t>(0, n - 1)(rng); };
+	auto random_string = [&](size_t n)
+	{
+		std::string s;
+
+		for ( size_t i = 0; i < n; i++ )
+			s.push_back(alphabet[random(alphabet.size())]);
+
+		return s;
+	};
+
+	constexpr int GROUPS = 64;
+	LiteralPrefilter pf;
+
+	for ( int g = 0; g < GROUPS; ++g )
+		pf.Add(random_string(LiteralPrefilter::MIN_LENGTH + g % 4), g);
+
+	auto saved = default_candidates();
+
+	for ( size_t len : {0, 2, 3, 31, 32, 33, 34, 63, 64, 65, 100, 1000} )
+		for ( int round = 0; round < 20; ++round )
+			{
+			auto data = random_string(len);
+			std::vector<bool> waiting(GROUPS);
+
+			for ( int g = 0; g < GROUPS; ++g )
+				waiting[g] = random(4) != 0;
+
+			auto waiting_avx2 = waiting;
+			std::vector<int> found;
+			std::vector<int> found_avx2;
+
+			default_candidates() = nullptr;
+			pf.Scan(reinterpret_cast<const u_char*>(data.data()), len, &waiting, &found);
+
+			default_candidates() = candidates_avx2;
+			pf.Scan(reinterpret_cast<const u_char*>(data.data()), len, &waiting_avx2,
+			        &found_avx2);
+
+			CHECK(found_avx2 == found);
+			CHECK(waiting_avx2 == waiting);
+			}
+
+	default_candidates() = saved;
+	}
+#endif
+
+TEST_SUITE_END();
+
+	} // namespace zeek::detail
@@ -0,0 +1,118 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <sys/types.h> // for u_char
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace zeek::detail
+	{
+
+/**
+ * A set of literal strings, each belonging to a group, that can be searched
+ * for in a single pass over some data. The signature engine uses it to find
+ * out which groups of unanchored patterns can possibly match before running
+ * their DFAs: a pattern like /.*GET \/foo/ can't match before "GET /foo"
+ * shows up.
+ *
+ * Every two-byte prefix of a literal sets a bit in a bitmap, so that the
+ * scan only needs to look at the literals themselves at positions where
+ * one of the prefixes occurs. With AVX2, the scan first narrows down those
+ * positions 32 at a time by the nibbles of the prefixes, in the manner of
+ * the Teddy algorithm.
+ */
+class LiteralPrefilter
+	{
+public:
+	/**
+	 * The shortest literal worth searching for. Shorter ones occur too
+	 * often to spare the matching.
+	 */
+	static constexpr size_t MIN_LENGTH = 3;
+
+	/**
+	 * Extracts the literal that every match of a signature pattern starts
+	 * with, for patterns of the form ".*<literal>..." that may start
+	 * matching anywhere in the data.
+	 *
+	 * @param pattern The pattern, in the syntax of signatures.
+	 *
+	 * @param literal Receives the literal.
+	 *
+	 * @return True if the pattern has such a literal, at least MIN_LENGTH
+	 * bytes long.
+	 */
+	static bool ExtractLiteral(const char* pattern, std::string* literal);
+
+	/**
+	 * Parses a pattern that's nothing but a literal, possibly anchored at
+	 * the beginning or end of the data, such as /^GET /.
+	 *
+	 * @param pattern The pattern, in the syntax of signatures.
+	 *
+	 * @param literal Receives the literal.
+	 *
+	 * @param bol Receives whether the pattern starts with '^'.
+	 *
+	 * @param eol Receives whether the pattern ends with '$'.
+	 *
+	 * @return True if the pattern is a non-empty literal.
+	 */
+	static bool ParseLiteral(const char* pattern, std::string* literal, bool* bol, bool* eol);
+
+	/**
+	 * Adds a literal.
+	 *
+	 * @param literal The literal, at least MIN_LENGTH bytes long.
+	 *
+	 * @param group The group the literal belongs to.
+	 */
+	void Add(const std::string& literal, int group);
+
+	bool Empty() const { return literals.empty(); }
+
+	/**
+	 * Returns the length of the longest literal.
+	 */
+	size_t MaxLength() const { return max_length; }
+
+	/**
+	 * Searches for the literals of the groups still waiting for one.
+	 *
+	 * @param data The data to search.
+	 *
+	 * @param len The length of the data.
+	 *
+	 * @param waiting Flags for all groups, telling which ones are still
+	 * waiting. Cleared for groups whose literal occurs in the data.
+	 *
+	 * @param found Receives the groups that had their flag cleared.
+	 */
+	void Scan(const u_char* data, size_t len, std::vector<bool>* waiting,
+	          std::vector<int>* found) const;
+
+private:
+	static uint16_t Prefix(const u_char* p) { return (uint16_t(p[0]) << 8) | p[1]; }
+
+	// Looks for the literals of waiting groups at position i of the data.
+	void ScanAt(const u_char* data, size_t len, size_t i, std::vector<bool>* waiting,
+	            std::vector<int>* found) const;
+
+	// Literals with their group, sorted by their prefix.
+	std::vector<std::pair<std::string, int>> literals;
+
+	// One bit per two-byte prefix, set if a literal starts with it.
+	uint64_t prefixes[65536 / 64] = {};
+
+	// The literals' prefixes hash into eight buckets. For the low and
+	// high nibbles of the prefixes' first and second bytes, these have
+	// the bits of the buckets with a prefix that has that nibble value.
+	uint8_t nibble_buckets[4][16] = {};
+
+	size_t max_length = 0;
+	};
+
+	} // namespace zeek::detail
@@ -0,0 +1,154 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/MemoryPool.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+
+#include "zeek/3rdparty/doctest.h"
+
+namespace zeek::detail
+	{
+
+namespace
+	{
+
+// Slabs are shared by all threads and never released. Keeping them in a
+// list also keeps them reachable for leak checkers.
+std::mutex slab_mutex;
+std::vector<void*>* slabs = nullptr;
+uint64_t slab_bytes[MemoryPool::MAX_POOLS];
+
+	} // namespace
+
+std::vector<MemoryPool*>& MemoryPool::Registry()
+	{
+	static std::vector<MemoryPool*> pools;
+	return pools;
+	}
+
+const std::vector<MemoryPool*>& MemoryPool::Pools()
+	{
+	return Registry();
+	}
+
+MemoryPool::MemoryPool(const char* arg_name, Arena arg_arena) : name(arg_name), arena(arg_arena)
+	{
+	auto& pools = Registry();
+	index = pools.size();
+
+	if ( index >= MAX_POOLS )
+		{
+		fprintf(stderr, "too many memory pools\n");
+		abort();
+		}
+
+	pools.push_back(this);
+	}
+
+void* MemoryPool::Refill(size_t size_class)
+	{
+	size_t chunk_size = (size_class + 1) * GRANULARITY;
+	auto* slab = static_cast<char*>(arena_allocate(arena, SLAB_SIZE));
+
+		{
+		std::lock_guard<std::mutex> lock(slab_mutex);
+
+		if ( ! slabs )
+			slabs = new std::vector<void*>;
+
+		slabs->push_back(slab);
+		slab_bytes[index] += SLAB_SIZE;
+		}
+
+	// Keep the first chunk for the caller, queue up the rest in address
+	// order.
+	auto& cache = caches[index];
+	size_t n = SLAB_SIZE / chunk_size;
+
+	for ( size_t i = n - 1; i > 0; --i )
+		{
+		auto* chunk = reinterpret_cast<FreeChunk*>(slab + i * chunk_size);
+		chunk->next = cache.free[size_class];
+		cache.free[size_class] = chunk;
+		}
+
+	return slab;
+	}
+
+void* MemoryPool::AllocateLarge(size_t size)
+	{
+	++caches[index].fallbacks;
+	return arena_allocate(arena, size);
+	}
+
+void MemoryPool::GetStats(Stats* s) const
+	{
+	const auto& cache = caches[index];
+
+	s->name = name;
+	s->in_use = 0;
+	s->in_use_bytes = 0;
+	s->allocations = cache.allocations;
+	s->fallbacks = cache.fallbacks;
+
+	for ( size_t c = 0; c < NUM_CLASSES; ++c )
+		{
+		s->in_use += cache.in_use[c];
+		s->in_use_bytes += cache.in_use[c] * (c + 1) * GRANULARITY;
+		}
+
+	std::lock_guard<std::mutex> lock(slab_mutex);
+	s->slab_bytes = slab_bytes[index];
+	}
+
+TEST_SUITE_BEGIN("MemoryPool");
+
+TEST_CASE("memory pool reuse")
+	{
+	static MemoryPool pool("test");
+	MemoryPool::Stats s;
+
+	void* a = pool.Allocate(100);
+	void* b = pool.Allocate(100);
+	void* c = pool.Allocate(20);
+	CHECK(a != b);
+
+	pool.Free(b, 100);
+	void* d = pool.Allocate(97);
+
+#ifndef ZEEK_MEMORY_POOLS_DISABLED
+	// Freed chunks are handed out again first.
+	CHECK(d == b);
+
+	pool.GetStats(&s);
+	CHECK(s.in_use == 3);
+	CHECK(s.in_use_bytes == 112 + 112 + 32);
+	CHECK(s.slab_bytes == 2 * MemoryPool::SLAB_SIZE);
+	CHECK(s.allocations == 4);
+#endif
+
+	pool.Free(a, 100);
+	pool.Free(c, 20);
+	pool.Free(d, 97);
+
+	pool.GetStats(&s);
+	CHECK(s.in_use == 0);
+	}
+
+TEST_CASE("memory pool large allocations")
+	{
+	static MemoryPool pool("test-large");
+	MemoryPool::Stats s;
+
+	void* p = pool.Allocate(MemoryPool::MAX_SIZE + 1);
+	pool.GetStats(&s);
+	CHECK(s.fallbacks == 1);
+	CHECK(s.in_use == 0);
+	pool.Free(p, MemoryPool::MAX_SIZE + 1);
+	}
+
+TEST_SUITE_END();
+
+	} // namespace zeek::detail
@@ -0,0 +1,183 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include "zeek/zeek-config.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "zeek/Arena.h"
+
+#if defined(__SANITIZE_ADDRESS__)
+#define ZEEK_MEMORY_POOLS_DISABLED
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define ZEEK_MEMORY_POOLS_DISABLED
+#endif
+#endif
+
+namespace zeek::detail
+	{
+
+/**
+ * A pool allocator for objects that get created and destroyed in large
+ * numbers, like connections and their analyzers. Allocations are sorted
+ * into size classes of GRANULARITY bytes, so one pool can serve a whole
+ * class hierarchy. Memory comes in slabs of SLAB_SIZE bytes, which the
+ * pool carves into chunks of a size class on demand and never returns to
+ * the system. Freed chunks go onto a per-thread freelist for their size
+ * class, so that allocating and freeing are just a few instructions, take
+ * no locks, and reuse recently touched memory.
+ *
+ * Classes opt in by defining their operator new and delete in terms of a
+ * pool (see ZEEK_POOL_ALLOCATED), which only takes effect when configured
+ * with --enable-memory-pools. Slabs, and allocations larger than
+ * MAX_SIZE, come from the pool's arena (see Arena.h). When built with
+ * AddressSanitizer, all allocations go there directly, so that it can
+ * still catch use-after-free errors.
+ */
+class MemoryPool
+	{
+public:
+	static constexpr size_t GRANULARITY = 16;
+	static constexpr size_t MAX_SIZE = 2048;
+	static constexpr size_t NUM_CLASSES = MAX_SIZE / GRANULARITY;
+	static constexpr size_t SLAB_SIZE = 64 * 1024;
+
+	// The number of pools that may exist; their freelists are kept in
+	// fixed-size thread-local arrays.
+	static constexpr size_t MAX_POOLS = 16;
+
+	struct Stats
+		{
+		const char* name;
+		uint64_t in_use; //< Chunks currently allocated by the calling thread.
+		uint64_t in_use_bytes; //< Bytes in those chunks.
+		uint64_t slab_bytes; //< Bytes in all slabs, across all threads.
+		uint64_t allocations; //< Total allocations made by the calling thread.
+		uint64_t fallbacks; //< Allocations too large for the pool.
+		};
+
+	/**
+	 * Constructor. Pools are meant to be global objects living until
+	 * the process exits.
+	 *
+	 * @param name A name for the pool, for statistics.
+	 *
+	 * @param arena The arena to take memory from.
+	 */
+	explicit MemoryPool(const char* name, Arena arena = ARENA_DEFAULT);
+
+	MemoryPool(const MemoryPool&) = delete;
+	MemoryPool& operator=(const MemoryPool&) = delete;
+
+	/**
+	 * Allocates memory for an object of the given size.
+	 */
+	void* Allocate(size_t size)
+		{
+#ifndef ZEEK_MEMORY_POOLS_DISABLED
+		if ( size <= MAX_SIZE && size > 0 )
+			{
+			auto& cache = caches[index];
+			size_t c = (size - 1) / GRANULARITY;
+			++cache.in_use[c];
+			++cache.allocations;
+
+			if ( auto* chunk = cache.free[c] )
+				{
+				cache.free[c] = chunk->next;
+				return chunk;
+				}
+
+			return Refill(c);
+			}
+#endif
+
+		return AllocateLarge(size);
+		}
+
+	/**
+	 * Frees memory returned by Allocate().
+	 *
+	 * @param p The memory to free.
+	 *
+	 * @param size The size that Allocate() was called with.
+	 */
+	void Free(void* p, size_t size)
+		{
+#ifndef ZEEK_MEMORY_POOLS_DISABLED
+		if ( size <= MAX_SIZE && size > 0 )
+			{
+			auto& cache = caches[index];
+			size_t c = (size - 1) / GRANULARITY;
+			auto* chunk = static_cast<FreeChunk*>(p);
+			chunk->next = cache.free[c];
+			cache.free[c] = chunk;
+			--cache.in_use[c];
+			return;
+			}
+#endif
+
+		arena_free(arena, p, size);
+		}
+
+	/**
+	 * Fills in statistics about the pool.
+	 */
+	void GetStats(Stats* s) const;
+
+	/**
+	 * Returns all pools that exist, for statistics.
+	 */
+	static const std::vector<MemoryPool*>& Pools();
+
+private:
+	struct FreeChunk
+		{
+		FreeChunk* next;
+		};
+
+	struct ThreadCache
+		{
+		FreeChunk* free[NUM_CLASSES];
+		uint64_t in_use[NUM_CLASSES];
+		uint64_t allocations;
+		uint64_t fallbacks;
+		};
+
+	// Carves a new slab into chunks of the given size class and returns
+	// the first.
+	void* Refill(size_t size_class);
+
+	void* AllocateLarge(size_t size);
+
+	static std::vector<MemoryPool*>& Registry();
+
+	const char* name;
+	size_t index;
+	Arena arena;
+
+	// Indexed by the pools' index. Zero-initialized, so there's nothing
+	// to construct for new threads.
+	static inline thread_local ThreadCache caches[MAX_POOLS] = {};
+	};
+
+/**
+ * Defines class-specific operator new and delete that allocate from the
+ * given pool. Since the sized delete operator receives the dynamic size of
+ * objects with virtual destructors, subclasses of such a class share the
+ * pool. Without ZEEK_MEMORY_POOLS, this expands to nothing and the class
+ * uses the regular heap.
+ */
+#ifdef ZEEK_MEMORY_POOLS
+#define ZEEK_POOL_ALLOCATED(pool)                                                                  \
+	static void* operator new(size_t size) { return pool.Allocate(size); }                         \
+	static void operator delete(void* p, size_t size) { pool.Free(p, size); }
+#else
+#define ZEEK_POOL_ALLOCATED(pool)
+#endif
+
+	} // namespace zeek::detail
@@ -112,6 +112,8 @@ namespace zeek::detail
 int watchdog_interval;
 
 int max_timer_expires;
+int use_timer_wheel;
+double event_drain_budget;
 
 int ignore_checksums;
 int partial_connection_ok;
@@ -119,6 +121,9 @@ int tcp_SYN_ack_ok;
 int tcp_match_undelivered;
 
 double frag_timeout;
+int use_compact_fragment_table;
+zeek_uint_t fragment_table_size;
+zeek_uint_t fragment_memory_limit;
 
 double tcp_SYN_timeout;
 double tcp_session_timer;
@@ -132,6 +137,20 @@ int tcp_max_initial_window;
 int tcp_max_above_hole_without_any_acks;
 int tcp_excessive_data_without_further_acks;
 int tcp_max_old_segments;
+int tcp_content_bypass;
+
+zeek_uint_t reassembly_memory_budget;
+int reassembly_evict_largest;
+int reassembly_evict_flush;
+
+int embryonic_sessions;
+zeek_uint_t embryonic_summary_batch_size;
+double embryonic_summary_interval;
+double flow_sampling_fraction;
+double flow_sampling_summary_interval;
+double flow_sampling_inactivity_timeout;
+double aggregation_interval;
+zeek_uint_t session_shards;
 
 double non_analyzed_lifetime;
 double tcp_inactivity_timeout;
@@ -162,6 +181,7 @@ int dns_max_queries;
 double table_expire_interval;
 double table_expire_delay;
 int table_incremental_step;
+double table_expire_step_budget;
 
 double connection_status_update_interval;
 
@@ -179,12 +199,17 @@ int load_sample_freq;
 int packet_filter_default;
 
 int sig_max_group_size;
+int sig_literal_prefilter;
+int sig_match_threads;
+zeek_uint_t dfa_state_memory_limit;
+zeek_uint_t total_dfa_state_memory_limit;
 
 int dpd_reassemble_first_packets;
 int dpd_buffer_size;
 int dpd_max_packets;
 int dpd_match_only_beginning;
 int dpd_late_match_stop;
+int dpd_give_up_early;
 int dpd_ignore_ports;
 
 int check_for_unused_event_handlers;
@@ -240,8 +265,13 @@ void init_general_global_var()
 	table_expire_interval = id::find_val("table_expire_interval")->AsInterval();
 	table_expire_delay = id::find_val("table_expire_delay")->AsInterval();
 	table_incremental_step = id::find_val("table_incremental_step")->AsCount();
+	table_expire_step_budget = id::find_val("table_expire_step_budget")->AsInterval();
 	packet_filter_default = id::find_val("packet_filter_default")->AsBool();
 	sig_max_group_size = id::find_val("sig_max_group_size")->AsCount();
+	sig_literal_prefilter = id::find_val("sig_literal_prefilter")->AsBool();
+	sig_match_threads = id::find_val("sig_match_threads")->AsCount();
+	dfa_state_memory_limit = id::find_val("dfa_state_memory_limit")->AsCount();
+	total_dfa_state_memory_limit = id::find_val("total_dfa_state_memory_limit")->AsCount();
 	check_for_unused_event_handlers = id::find_val("check_for_unused_event_handlers")->AsBool();
 	record_all_packets = id::find_val("record_all_packets")->AsBool();
 	bits_per_uid = id::find_val("bits_per_uid")->AsCount();
@@ -263,6 +293,9 @@ void init_net_var()
 	tcp_match_undelivered = id::find_val("tcp_match_undelivered")->AsBool();
 
 	frag_timeout = id::find_val("frag_timeout")->AsInterval();
+	use_compact_fragment_table = id::find_val("use_compact_fragment_table")->AsBool();
+	fragment_table_size = id::find_val("fragment_table_size")->AsCount();
+	fragment_memory_limit = id::find_val("fragment_memory_limit")->AsCount();
 
 	tcp_SYN_timeout = id::find_val("tcp_SYN_timeout")->AsInterval();
 	tcp_session_timer = id::find_val("tcp_session_timer")->AsInterval();
@@ -278,6 +311,21 @@ void init_net_var()
 	tcp_excessive_data_without_further_acks =
 		id::find_val("tcp_excessive_data_without_further_acks")->AsCount();
 	tcp_max_old_segments = id::find_val("tcp_max_old_segments")->AsCount();
+	tcp_content_bypass = id::find_val("tcp_content_bypass")->AsBool();
+
+	reassembly_memory_budget = id::find_val("reassembly_memory_budget")->AsCount();
+	reassembly_evict_largest = id::find_val("reassembly_evict_largest")->AsBool();
+	reassembly_evict_flush = id::find_val("reassembly_evict_flush")->AsBool();
+
+	embryonic_sessions = id::find_val("embryonic_sessions")->AsBool();
+	embryonic_summary_batch_size = id::find_val("embryonic_summary_batch_size")->AsCount();
+	embryonic_summary_interval = id::find_val("embryonic_summary_interval")->AsInterval();
+	flow_sampling_fraction = id::find_val("flow_sampling_fraction")->AsDouble();
+	flow_sampling_summary_interval = id::find_val("flow_sampling_summary_interval")->AsInterval();
+	flow_sampling_inactivity_timeout =
+		id::find_val("flow_sampling_inactivity_timeout")->AsInterval();
+	aggregation_interval = id::find_val("aggregation_interval")->AsInterval();
+	session_shards = id::find_val("session_shards")->AsCount();
 
 	non_analyzed_lifetime = id::find_val("non_analyzed_lifetime")->AsInterval();
 	tcp_inactivity_timeout = id::find_val("tcp_inactivity_timeout")->AsInterval();
@@ -301,6 +349,8 @@ void init_net_var()
 	watchdog_interval = int(id::find_val("watchdog_interval")->AsInterval());
 
 	max_timer_expires = id::find_val("max_timer_expires")->AsCount();
+	use_timer_wheel = id::find_val("use_timer_wheel")->AsBool();
+	event_drain_budget = id::find_val("event_drain_budget")->AsInterval();
 
 	mime_segment_length = id::find_val("mime_segment_length")->AsCount();
 	mime_segment_overlap_length = id::find_val("mime_segment_overlap_length")->AsCount();
@@ -344,6 +394,7 @@ void init_net_var()
 	dpd_max_packets = id::find_val("dpd_max_packets")->AsCount();
 	dpd_match_only_beginning = id::find_val("dpd_match_only_beginning")->AsBool();
 	dpd_late_match_stop = id::find_val("dpd_late_match_stop")->AsBool();
+	dpd_give_up_early = id::find_val("dpd_give_up_early")->AsBool();
 	dpd_ignore_ports = id::find_val("dpd_ignore_ports")->AsBool();
 
 	tunnel_max_changes_per_connection =
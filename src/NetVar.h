@@ -12,6 +12,8 @@ namespace zeek::detail
 extern int watchdog_interval;
 
 extern int max_timer_expires;
+extern int use_timer_wheel;
+extern double event_drain_budget;
 
 extern int ignore_checksums;
 extern int partial_connection_ok;
@@ -19,6 +21,9 @@ extern int tcp_SYN_ack_ok;
 extern int tcp_match_undelivered;
 
 extern double frag_timeout;
+extern int use_compact_fragment_table;
+extern zeek_uint_t fragment_table_size;
+extern zeek_uint_t fragment_memory_limit;
 
 extern double tcp_SYN_timeout;
 extern double tcp_session_timer;
@@ -32,6 +37,20 @@ extern int tcp_max_initial_window;
 extern int tcp_max_above_hole_without_any_acks;
 extern int tcp_excessive_data_without_further_acks;
 extern int tcp_max_old_segments;
+extern int tcp_content_bypass;
+
+extern zeek_uint_t reassembly_memory_budget;
+extern int reassembly_evict_largest;
+extern int reassembly_evict_flush;
+
+extern int embryonic_sessions;
+extern zeek_uint_t embryonic_summary_batch_size;
+extern double embryonic_summary_interval;
+extern double flow_sampling_fraction;
+extern double flow_sampling_summary_interval;
+extern double flow_sampling_inactivity_timeout;
+extern double aggregation_interval;
+extern zeek_uint_t session_shards;
 
 extern double non_analyzed_lifetime;
 extern double tcp_inactivity_timeout;
@@ -63,6 +82,7 @@ extern int dns_max_queries;
 extern double table_expire_interval;
 extern double table_expire_delay;
 extern int table_incremental_step;
+extern double table_expire_step_budget;
 
 extern int orig_addr_anonymization, resp_addr_anonymization;
 extern int other_addr_anonymization;
@@ -80,12 +100,17 @@ extern int load_sample_freq;
 extern int packet_filter_default;
 
 extern int sig_max_group_size;
+extern int sig_literal_prefilter;
+extern int sig_match_threads;
+extern zeek_uint_t dfa_state_memory_limit;
+extern zeek_uint_t total_dfa_state_memory_limit;
 
 extern int dpd_reassemble_first_packets;
 extern int dpd_buffer_size;
 extern int dpd_max_packets;
 extern int dpd_match_only_beginning;
 extern int dpd_late_match_stop;
+extern int dpd_give_up_early;
 extern int dpd_ignore_ports;
 
 extern int check_for_unused_event_handlers;
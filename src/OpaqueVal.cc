@@ -12,13 +12,16 @@
 
 #include <broker/data.hh>
 #include <broker/error.hh>
+#include <cstdlib>
 #include <memory>
 
 #include "zeek/CompHash.h"
 #include "zeek/Desc.h"
 #include "zeek/NetVar.h"
+#include "zeek/RE.h"
 #include "zeek/Reporter.h"
 #include "zeek/Scope.h"
+#include "zeek/SharedTable.h"
 #include "zeek/Var.h"
 #include "zeek/probabilistic/BloomFilter.h"
 #include "zeek/probabilistic/CardinalityCounter.h"
@@ -624,6 +627,8 @@ bool SHA256Val::DoUnserialize(const broker::data& data)
 
 EntropyVal::EntropyVal() : OpaqueVal(entropy_type) { }
 
+EntropyVal::EntropyVal(bool histogram_only) : OpaqueVal(entropy_type), state(histogram_only) { }
+
 bool EntropyVal::Feed(const void* data, size_t size)
 	{
 	state.add(data, size);
@@ -712,6 +717,94 @@ bool EntropyVal::DoUnserialize(const broker::data& data)
 	return true;
 	}
 
+namespace detail
+	{
+
+const HashKey* probabilistic_hash_key(const CompositeHash* hash, const Val* val)
+	{
+	struct LastKey
+		{
+		ValPtr val;
+		std::unique_ptr<HashKey> key;
+		};
+
+	// Never freed, so that no value gets released during teardown.
+	static auto* last = new LastKey();
+
+	if ( last->val && last->val.get() == val )
+		return last->key.get();
+
+	last->key = hash->MakeHashKey(*val, true);
+
+	// Holding on to the value rules out another one at the same address.
+	// Values of other types might change, so their keys don't get reused.
+	if ( hash->HasFastPath() )
+		last->val = {NewRef{}, const_cast<Val*>(val)};
+	else
+		last->val = nullptr;
+
+	return last->key.get();
+	}
+
+TypePtr probabilistic_element_type(const Val* xs)
+	{
+	const auto& t = xs->GetType();
+
+	if ( t->Tag() == TYPE_VECTOR )
+		return t->AsVectorType()->Yield();
+
+	if ( t->IsSet() )
+		{
+		const auto& indices = t->AsTableType()->GetIndexTypes();
+
+		if ( indices.size() == 1 )
+			return indices[0];
+		}
+
+	return nullptr;
+	}
+
+	} // namespace detail
+
+namespace
+	{
+
+// Calls f with the hash key of each element of a vector or single-index
+// set, until it returns false. Unlike probabilistic_hash_key(), this
+// doesn't hold on to the elements, as a batch rarely repeats one.
+template <typename F> void for_each_key(const detail::CompositeHash* hash, const Val* xs, F f)
+	{
+	auto call = [hash, &f](const Val& v)
+	{
+		auto key = hash->MakeHashKey(v, true);
+		return ! key || f(*key);
+	};
+
+	if ( xs->GetType()->Tag() == TYPE_VECTOR )
+		{
+		auto vv = xs->AsVectorVal();
+
+		for ( unsigned int i = 0; i < vv->Size(); ++i )
+			{
+			auto v = vv->ValAt(i);
+
+			// Holes in the vector aren't elements.
+			if ( v && ! call(*v) )
+				return;
+			}
+		}
+	else
+		{
+		auto l = xs->AsTableVal()->ToPureListVal();
+
+		for ( int i = 0; i < l->Length(); ++i )
+			if ( ! call(*l->Idx(i)) )
+				return;
+		}
+	}
+
+	} // namespace
+
 BloomFilterVal::BloomFilterVal() : OpaqueVal(bloomfilter_type)
 	{
 	hash = nullptr;
@@ -753,23 +846,46 @@ bool BloomFilterVal::Typify(TypePtr arg_type)
 
 void BloomFilterVal::Add(const Val* val)
 	{
-	auto key = hash->MakeHashKey(*val, true);
-	bloom_filter->Add(key.get());
+	bloom_filter->Add(detail::probabilistic_hash_key(hash, val));
 	}
 
 bool BloomFilterVal::Decrement(const Val* val)
 	{
-	auto key = hash->MakeHashKey(*val, true);
-	return bloom_filter->Decrement(key.get());
+	return bloom_filter->Decrement(detail::probabilistic_hash_key(hash, val));
 	}
 
 size_t BloomFilterVal::Count(const Val* val) const
 	{
-	auto key = hash->MakeHashKey(*val, true);
-	size_t cnt = bloom_filter->Count(key.get());
+	size_t cnt = bloom_filter->Count(detail::probabilistic_hash_key(hash, val));
 	return cnt;
 	}
 
+void BloomFilterVal::AddAll(const Val* xs)
+	{
+	auto add = [this](const detail::HashKey& key)
+	{
+		bloom_filter->Add(&key);
+		return true;
+	};
+
+	for_each_key(hash, xs, add);
+	}
+
+bool BloomFilterVal::CountAny(const Val* xs) const
+	{
+	bool found = false;
+
+	auto lookup = [this, &found](const detail::HashKey& key)
+	{
+		found = bloom_filter->Count(&key) > 0;
+		return ! found;
+	};
+
+	for_each_key(hash, xs, lookup);
+
+	return found;
+	}
+
 void BloomFilterVal::Clear()
 	{
 	bloom_filter->Clear();
@@ -866,6 +982,84 @@ BloomFilterVal::~BloomFilterVal()
 
 IMPLEMENT_OPAQUE_VALUE(BloomFilterVal)
 
+// The element type of mapped Bloom filters, named like for serialization.
+static std::string type_to_meta(const TypePtr& t)
+	{
+	if ( ! t )
+		return "";
+
+	if ( t->InternalType() == TYPE_INTERNAL_OTHER )
+		return t->GetName();
+
+	return util::fmt("#%d", static_cast<int>(t->Tag()));
+	}
+
+static TypePtr meta_to_type(const std::string& meta)
+	{
+	if ( meta.empty() )
+		return nullptr;
+
+	if ( meta[0] == '#' )
+		{
+		auto tag = atoi(meta.c_str() + 1);
+
+		if ( tag < 0 || tag >= NUM_TYPES )
+			return nullptr;
+
+		return base_type(static_cast<TypeTag>(tag));
+		}
+
+	const auto& id = detail::global_scope()->Find(meta);
+
+	if ( ! (id && id->IsType()) )
+		return nullptr;
+
+	return id->GetType();
+	}
+
+bool BloomFilterVal::ToFile(const std::string& path, std::string* error) const
+	{
+	auto basic = dynamic_cast<const probabilistic::BasicBloomFilter*>(bloom_filter);
+
+	if ( ! basic )
+		{
+		*error = "only basic Bloom filters can be written to a file";
+		return false;
+		}
+
+	if ( type && type->InternalType() == TYPE_INTERNAL_ERROR )
+		{
+		*error = "cannot write the Bloom filter's type";
+		return false;
+		}
+
+	return probabilistic::MappedBloomFilter::Write(path, basic, type_to_meta(type), error);
+	}
+
+BloomFilterValPtr BloomFilterVal::FromFile(const std::string& path, std::string* error)
+	{
+	auto bf = probabilistic::MappedBloomFilter::Open(path, error);
+
+	if ( ! bf )
+		return nullptr;
+
+	auto meta = bf->Meta();
+	auto val = make_intrusive<BloomFilterVal>(bf.release());
+
+	if ( meta.empty() )
+		return val;
+
+	auto t = meta_to_type(meta);
+
+	if ( ! (t && val->Typify(std::move(t))) )
+		{
+		*error = "unknown element type " + meta + " in " + path;
+		return nullptr;
+		}
+
+	return val;
+	}
+
 broker::expected<broker::data> BloomFilterVal::DoSerialize() const
 	{
 	broker::vector d;
@@ -954,8 +1148,18 @@ bool CardinalityVal::Typify(TypePtr arg_type)
 
 void CardinalityVal::Add(const Val* val)
 	{
-	auto key = hash->MakeHashKey(*val, true);
-	c->AddElement(key->Hash());
+	c->AddElement(detail::probabilistic_hash_key(hash, val)->Hash());
+	}
+
+void CardinalityVal::AddAll(const Val* xs)
+	{
+	auto add = [this](const detail::HashKey& key)
+	{
+		c->AddElement(key.Hash());
+		return true;
+	};
+
+	for_each_key(hash, xs, add);
 	}
 
 IMPLEMENT_OPAQUE_VALUE(CardinalityVal)
@@ -1092,6 +1296,144 @@ ValPtr ParaglobVal::DoClone(CloneState* state)
 		}
 	}
 
+PatternSetVal::PatternSetVal(std::vector<std::string> arg_patterns)
+	: OpaqueVal(pattern_set_type), patterns(std::move(arg_patterns))
+	{
+	}
+
+bool PatternSetVal::Compile()
+	{
+	detail::string_list set;
+	detail::int_list idx;
+
+	for ( const auto& p : patterns )
+		{
+		set.push_back(const_cast<char*>(p.c_str()));
+		// Zero can't be an index.
+		idx.push_back(idx.size() + 1);
+		}
+
+	auto m = std::make_shared<detail::Specific_RE_Matcher>(detail::MATCH_ANYWHERE);
+
+	if ( ! m->CompileSet(set, idx) )
+		return false;
+
+	matcher = std::move(m);
+	return true;
+	}
+
+VectorValPtr PatternSetVal::Match(const String* s)
+	{
+	auto rval = make_intrusive<VectorVal>(id::index_vec);
+
+	if ( ! matcher )
+		return rval;
+
+	std::vector<detail::AcceptIdx> matches;
+	matcher->MatchSet(s->Bytes(), s->Len(), &matches);
+
+	for ( auto m : matches )
+		rval->Append(val_mgr->Count(m - 1));
+
+	return rval;
+	}
+
+IMPLEMENT_OPAQUE_VALUE(PatternSetVal)
+
+broker::expected<broker::data> PatternSetVal::DoSerialize() const
+	{
+	broker::vector d;
+
+	for ( const auto& p : patterns )
+		d.emplace_back(p);
+
+	return {std::move(d)};
+	}
+
+bool PatternSetVal::DoUnserialize(const broker::data& data)
+	{
+	auto d = broker::get_if<broker::vector>(&data);
+	if ( ! d )
+		return false;
+
+	patterns.clear();
+
+	for ( const auto& p : *d )
+		{
+		auto s = broker::get_if<std::string>(&p);
+		if ( ! s )
+			return false;
+
+		patterns.push_back(*s);
+		}
+
+	return Compile();
+	}
+
+ValPtr PatternSetVal::DoClone(CloneState* state)
+	{
+	auto c = make_intrusive<PatternSetVal>(patterns);
+	c->matcher = matcher;
+	return state->NewClone(this, std::move(c));
+	}
+
+SharedTableVal::SharedTableVal(std::shared_ptr<detail::SharedTable> arg_table)
+	: OpaqueVal(shared_table_type), table(std::move(arg_table))
+	{
+	}
+
+static std::string_view as_view(const String* s)
+	{
+	return {reinterpret_cast<const char*>(s->Bytes()), static_cast<size_t>(s->Len())};
+	}
+
+StringValPtr SharedTableVal::Lookup(const String* key) const
+	{
+	auto v = table->Lookup(as_view(key));
+	if ( ! v )
+		return nullptr;
+
+	return make_intrusive<StringVal>(static_cast<int>(v->size()), v->data());
+	}
+
+bool SharedTableVal::Contains(const String* key) const
+	{
+	return table->Lookup(as_view(key)).has_value();
+	}
+
+size_t SharedTableVal::Size() const
+	{
+	return table->Size();
+	}
+
+IMPLEMENT_OPAQUE_VALUE(SharedTableVal)
+
+broker::expected<broker::data> SharedTableVal::DoSerialize() const
+	{
+	// The receiver maps the same file, which only works on the same host.
+	return {table->Path()};
+	}
+
+bool SharedTableVal::DoUnserialize(const broker::data& data)
+	{
+	auto path = broker::get_if<std::string>(&data);
+	if ( ! path )
+		return false;
+
+	std::string error;
+	auto t = detail::SharedTable::Open(*path, &error);
+	if ( ! t )
+		return false;
+
+	table = std::move(t);
+	return true;
+	}
+
+ValPtr SharedTableVal::DoClone(CloneState* state)
+	{
+	return state->NewClone(this, make_intrusive<SharedTableVal>(table));
+	}
+
 broker::expected<broker::data> TelemetryVal::DoSerialize() const
 	{
 	return broker::make_error(broker::ec::invalid_data, "cannot serialize metric handles");
@@ -33,6 +33,11 @@ namespace probabilistic::detail
 	{
 class CardinalityCounter;
 	}
+namespace detail
+	{
+class SharedTable;
+class Specific_RE_Matcher;
+	}
 
 class OpaqueVal;
 using OpaqueValPtr = IntrusivePtr<OpaqueVal>;
@@ -318,6 +323,12 @@ class EntropyVal : public OpaqueVal
 public:
 	EntropyVal();
 
+	/**
+	 * Constructor for values that only compute what the byte histogram
+	 * gives, see RandTest. This doesn't survive serialization.
+	 */
+	explicit EntropyVal(bool histogram_only);
+
 	bool Feed(const void* data, size_t size);
 	bool Get(double* r_ent, double* r_chisq, double* r_mean, double* r_montepicalc, double* r_scc);
 
@@ -329,6 +340,39 @@ private:
 	detail::RandTest state;
 	};
 
+namespace detail
+	{
+
+class CompositeHash;
+class HashKey;
+
+/**
+ * Returns the hash key of a value for use with a probabilistic data
+ * structure. Scripts often add the same value to a Bloom filter, a
+ * cardinality counter and a top-k in a row, so the key of the most recent
+ * value gets reused when it's the very same value again, and of a type
+ * that keys derive from directly, see CompositeHash::HasFastPath(). The
+ * key remains valid until the next call.
+ *
+ * @param hash The structure's hash, which *val* has to match in type.
+ *
+ * @param val The value to get the key of.
+ */
+const HashKey* probabilistic_hash_key(const CompositeHash* hash, const Val* val);
+
+/**
+ * Returns the type of the elements of a vector, or of a set with a single
+ * index, for adding them to a probabilistic data structure in one go. See
+ * BloomFilterVal::AddAll().
+ *
+ * @param xs The vector or set.
+ *
+ * @return The elements' type, or null if *xs* is neither.
+ */
+TypePtr probabilistic_element_type(const Val* xs);
+
+	} // namespace detail
+
 class BloomFilterVal : public OpaqueVal
 	{
 public:
@@ -344,6 +388,19 @@ public:
 	void Add(const Val* val);
 	bool Decrement(const Val* val);
 	size_t Count(const Val* val) const;
+
+	/**
+	 * Adds all elements of a vector or set, whose type
+	 * detail::probabilistic_element_type() must match the filter's.
+	 */
+	void AddAll(const Val* xs);
+
+	/**
+	 * Checks whether any element of a vector or set is in the filter,
+	 * stopping at the first one that is. The elements' type must match the
+	 * filter's.
+	 */
+	bool CountAny(const Val* xs) const;
 	void Clear();
 	bool Empty() const;
 	std::string InternalState() const;
@@ -351,6 +408,29 @@ public:
 	static BloomFilterValPtr Merge(const BloomFilterVal* x, const BloomFilterVal* y);
 	static BloomFilterValPtr Intersect(const BloomFilterVal* x, const BloomFilterVal* y);
 
+	/**
+	 * Writes a basic Bloom filter to a file that FromFile() maps, see
+	 * probabilistic::MappedBloomFilter.
+	 *
+	 * @param path The file's path.
+	 *
+	 * @param error Receives a description of the problem on failure.
+	 *
+	 * @return False on failure.
+	 */
+	bool ToFile(const std::string& path, std::string* error) const;
+
+	/**
+	 * Maps a Bloom filter that ToFile() wrote, of the same element type.
+	 *
+	 * @param path The file's path.
+	 *
+	 * @param error Receives a description of the problem on failure.
+	 *
+	 * @return The read-only Bloom filter, or nullptr on failure.
+	 */
+	static BloomFilterValPtr FromFile(const std::string& path, std::string* error);
+
 protected:
 	friend class Val;
 	BloomFilterVal();
@@ -376,6 +456,11 @@ public:
 
 	void Add(const Val* val);
 
+	/**
+	 * Adds all elements of a vector or set, like BloomFilterVal::AddAll().
+	 */
+	void AddAll(const Val* xs);
+
 	const TypePtr& Type() const { return type; }
 
 	bool Typify(TypePtr type);
@@ -409,6 +494,85 @@ private:
 	std::unique_ptr<paraglob::Paraglob> internal_paraglob;
 	};
 
+/**
+ * A set of patterns compiled into a single DFA, which finds all of the
+ * patterns that match a string in one pass over it, rather than one pass
+ * per pattern.
+ */
+class PatternSetVal : public OpaqueVal
+	{
+public:
+	/**
+	 * Constructor.
+	 *
+	 * @param patterns The texts of the patterns, as they match anywhere
+	 * in a string (see RE_Matcher::AnywherePatternText()).
+	 */
+	explicit PatternSetVal(std::vector<std::string> patterns);
+
+	/**
+	 * Compiles the patterns. Must be called before Match().
+	 *
+	 * @return False if a pattern doesn't compile.
+	 */
+	bool Compile();
+
+	/**
+	 * Returns the positions of the patterns that match somewhere in the
+	 * given string, in ascending order. A pattern matches if "pattern in
+	 * s" would hold for it.
+	 */
+	VectorValPtr Match(const String* s);
+
+	size_t Size() const { return patterns.size(); }
+
+	ValPtr DoClone(CloneState* state) override;
+
+protected:
+	PatternSetVal() : OpaqueVal(pattern_set_type) { }
+
+	DECLARE_OPAQUE_VALUE(PatternSetVal)
+
+private:
+	std::vector<std::string> patterns;
+
+	// Clones share the matcher, which only ever grows its DFA.
+	std::shared_ptr<detail::Specific_RE_Matcher> matcher;
+	};
+
+/**
+ * A read-only table of strings mapped from a file, which all processes on a
+ * host opening the same file share (see detail::SharedTable).
+ */
+class SharedTableVal : public OpaqueVal
+	{
+public:
+	explicit SharedTableVal(std::shared_ptr<detail::SharedTable> table);
+
+	/**
+	 * Returns the value for a key, or nullptr if there's no such key.
+	 */
+	StringValPtr Lookup(const String* key) const;
+
+	/**
+	 * Returns true if the table has the given key.
+	 */
+	bool Contains(const String* key) const;
+
+	size_t Size() const;
+
+	ValPtr DoClone(CloneState* state) override;
+
+protected:
+	SharedTableVal() : OpaqueVal(shared_table_type) { }
+
+	DECLARE_OPAQUE_VALUE(SharedTableVal)
+
+private:
+	// Clones share the mapping, which never changes.
+	std::shared_ptr<detail::SharedTable> table;
+	};
+
 /**
  * Base class for metric handles. Handle types are not serializable.
  */
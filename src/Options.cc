@@ -148,8 +148,14 @@ void usage(const char* prog, int code)
 	fprintf(
 		stderr,
 		"    --profile-scripts[=file]        | profile scripts to given file (default stdout)\n");
+	fprintf(stderr, "    --parallel <workers>            | read the trace of -r with the given "
+	                "number of worker processes, merging their logs\n");
 	fprintf(stderr, "    --pseudo-realtime[=<speedup>]   | enable pseudo-realtime for performance "
 	                "evaluation (default 1)\n");
+	fprintf(stderr, "    --record-events <file>          | record the events the engine raises to "
+	                "the given file\n");
+	fprintf(stderr, "    --replay-events <file>          | replay recorded events instead of "
+	                "reading packets, reporting how long handlers took\n");
 	fprintf(stderr, "    -j|--jobs                       | enable supervisor mode\n");
 
 	fprintf(stderr, "    --test                          | run unit tests ('--test -h' for help, "
@@ -204,11 +210,17 @@ static void print_analysis_help()
 	fprintf(stderr,
 	        "    profile-ZAM	generate to stdout a ZAM execution profile; implies -O ZAM\n");
 	fprintf(stderr, "    report-recursive	report on recursive functions and exit\n");
+	fprintf(stderr, "    use-ZAM-profile=<file>	steer optimization by a saved profile-ZAM output; "
+	                "implies -O ZAM unless generating C++\n");
+	fprintf(stderr, "    ZAM-report=<file>	write a JSON report on compiling and running each "
+	                "function to <file> at exit; implies -O ZAM\n");
 	fprintf(stderr, "    xform	transform scripts to \"reduced\" form\n");
 
 	fprintf(stderr, "\n--optimize options when generating C++:\n");
 	fprintf(stderr, "    add-C++	add C++ script bodies to existing generated code\n");
 	fprintf(stderr, "    gen-C++	generate C++ script bodies\n");
+	fprintf(stderr, "    gen-C++-unit=<name>	generate C++ script bodies to CPP-gen-<name>.cc, "
+	                "for building separately\n");
 	fprintf(stderr, "    gen-standalone-C++	generate \"standalone\" C++ script bodies\n");
 	fprintf(stderr, "    help	print this list\n");
 	fprintf(stderr, "    report-C++	report available C++ script bodies and exit\n");
@@ -246,6 +258,21 @@ static void set_analysis_option(const char* opt, Options& opts)
 		a_o.gen_CPP = true;
 	else if ( util::streq(opt, "gen-standalone-C++") )
 		a_o.gen_standalone_CPP = true;
+	else if ( util::starts_with(opt, "gen-C++-unit=") )
+		{
+		std::string unit = opt + strlen("gen-C++-unit=");
+
+		if ( unit.empty() ||
+		     unit.find_first_not_of("abcdefghijklmnopqrstuvwxyz"
+		                            "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_-") != std::string::npos )
+			{
+			fprintf(stderr, "zeek: C++ unit names may only use letters, digits, '_' and '-': %s\n",
+			        unit.c_str());
+			exit(1);
+			}
+
+		a_o.CPP_unit = std::move(unit);
+		}
 	else if ( util::streq(opt, "gen-ZAM-code") )
 		a_o.activate = a_o.gen_ZAM_code = true;
 	else if ( util::streq(opt, "inline") )
@@ -266,6 +293,10 @@ static void set_analysis_option(const char* opt, Options& opts)
 		a_o.report_uncompilable = true;
 	else if ( util::streq(opt, "use-C++") )
 		a_o.use_CPP = true;
+	else if ( util::starts_with(opt, "use-ZAM-profile=") )
+		a_o.ZAM_profile_file = opt + strlen("use-ZAM-profile=");
+	else if ( util::starts_with(opt, "ZAM-report=") )
+		a_o.ZAM_report_file = opt + strlen("ZAM-report=");
 	else if ( util::streq(opt, "xform") )
 		a_o.activate = true;
 
@@ -370,6 +401,9 @@ Options parse_cmdline(int argc, char** argv)
 
 	int profile_scripts = 0;
 	int no_unused_warnings = 0;
+	int record_events = 0;
+	int replay_events = 0;
+	int parallel = 0;
 
 	struct option long_opts[] = {
 		{"parse-only", no_argument, nullptr, 'a'},
@@ -414,6 +448,9 @@ Options parse_cmdline(int argc, char** argv)
 
 		{"profile-scripts", optional_argument, &profile_scripts, 1},
 		{"no-unused-warnings", no_argument, &no_unused_warnings, 1},
+		{"record-events", required_argument, &record_events, 1},
+		{"replay-events", required_argument, &replay_events, 1},
+		{"parallel", required_argument, &parallel, 1},
 		{"pseudo-realtime", optional_argument, nullptr, '~'},
 		{"jobs", optional_argument, nullptr, 'j'},
 		{"test", no_argument, nullptr, '#'},
@@ -620,6 +657,30 @@ Options parse_cmdline(int argc, char** argv)
 
 				if ( no_unused_warnings )
 					rval.no_unused_warnings = true;
+
+				if ( record_events )
+					{
+					rval.event_record_file = optarg;
+					record_events = 0;
+					}
+
+				if ( replay_events )
+					{
+					rval.event_replay_file = optarg;
+					replay_events = 0;
+					}
+
+				if ( parallel )
+					{
+					rval.parallel_workers = atoi(optarg);
+					parallel = 0;
+
+					if ( rval.parallel_workers < 1 )
+						{
+						fprintf(stderr, "ERROR: --parallel needs a positive number of workers.\n");
+						exit(1);
+						}
+					}
 				break;
 
 			case '?':
@@ -691,6 +752,29 @@ Options parse_cmdline(int argc, char** argv)
 			canonify_script_path(&s);
 		}
 
+	if ( rval.event_replay_file && (rval.pcap_file || rval.interface) )
+		{
+		fprintf(stderr, "ERROR: --replay-events is not allowed when reading packets.\n");
+		exit(1);
+		}
+
+	if ( rval.parallel_workers )
+		{
+		if ( ! rval.pcap_file )
+			{
+			fprintf(stderr, "ERROR: --parallel needs a trace file to read (-r).\n");
+			exit(1);
+			}
+
+		if ( rval.pcap_output_file || rval.pseudo_realtime || rval.supervisor_mode ||
+		     rval.event_replay_file )
+			{
+			fprintf(stderr, "ERROR: --parallel is not allowed with -w, -j, --pseudo-realtime "
+			                "or --replay-events.\n");
+			exit(1);
+			}
+		}
+
 	return rval;
 	}
 
@@ -48,6 +48,7 @@ struct Options
 	bool ignore_checksums = false;
 	bool use_watchdog = false;
 	double pseudo_realtime = 0;
+	int parallel_workers = 0;
 	detail::DNS_MgrMode dns_mode = detail::DNS_DEFAULT;
 
 	bool supervisor_mode = false;
@@ -75,6 +76,8 @@ struct Options
 	std::optional<std::string> zeekygen_config_file;
 	std::optional<std::string> unprocessed_output_file;
 	std::optional<std::string> event_trace_file;
+	std::optional<std::string> event_record_file;
+	std::optional<std::string> event_replay_file;
 
 	std::set<std::string> plugins_to_load;
 	std::vector<std::string> scripts_to_load;
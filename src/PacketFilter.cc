@@ -1,6 +1,7 @@
 #include "zeek/PacketFilter.h"
 
 #include "zeek/IP.h"
+#include "zeek/Val.h"
 
 namespace zeek::detail
 	{
@@ -11,84 +12,165 @@ void PacketFilter::DeleteFilter(void* data)
 	delete f;
 	}
 
+PacketFilter::Filter PacketFilter::MakeFilter(uint32_t tcp_flags, double probability)
+	{
+	Filter f;
+	f.tcp_flags = tcp_flags;
+	f.probability = probability * static_cast<double>(util::detail::max_random());
+	return f;
+	}
+
+size_t PacketFilter::Rules::AddrHash::operator()(const IPAddr& addr) const
+	{
+	uint32_t b[4];
+	addr.CopyIPv6(b);
+
+	uint64_t h = (static_cast<uint64_t>(b[0]) << 32 | b[1]) * 0x9e3779b97f4a7c15ull;
+	h ^= (static_cast<uint64_t>(b[2]) << 32 | b[3]) + (h >> 29);
+	return h * 0xbf58476d1ce4e5b9ull;
+	}
+
+PacketFilter::Rules::Rules()
+	{
+	nets.SetDeleteFunction(PacketFilter::DeleteFilter);
+	}
+
+bool PacketFilter::Rules::AsHost(const Val* v, IPAddr* addr)
+	{
+	switch ( v->GetType()->Tag() )
+		{
+		case TYPE_ADDR:
+			*addr = v->AsAddr();
+			return true;
+
+		case TYPE_SUBNET:
+			if ( v->AsSubNet().LengthIPv6() != 128 )
+				return false;
+
+			*addr = v->AsSubNet().Prefix();
+			return true;
+
+		default:
+			return false;
+		}
+	}
+
+void PacketFilter::Rules::Add(const IPAddr& addr, const Filter& f)
+	{
+	hosts[addr] = f;
+	}
+
+void PacketFilter::Rules::Add(Val* v, const Filter& f)
+	{
+	IPAddr addr;
+
+	if ( AsHost(v, &addr) )
+		{
+		Add(addr, f);
+		return;
+		}
+
+	auto prev = static_cast<Filter*>(nets.Insert(v, new Filter(f)));
+
+	if ( prev )
+		delete prev;
+	else
+		++num_nets;
+	}
+
+bool PacketFilter::Rules::Remove(const IPAddr& addr)
+	{
+	return hosts.erase(addr) > 0;
+	}
+
+bool PacketFilter::Rules::Remove(Val* v)
+	{
+	IPAddr addr;
+
+	if ( AsHost(v, &addr) )
+		return Remove(addr);
+
+	auto f = static_cast<Filter*>(nets.Remove(v));
+
+	if ( ! f )
+		return false;
+
+	delete f;
+	--num_nets;
+	return true;
+	}
+
+const PacketFilter::Filter* PacketFilter::Rules::Lookup(const IPAddr& addr) const
+	{
+	// A host entry is always the longest matching prefix.
+	if ( ! hosts.empty() )
+		{
+		auto it = hosts.find(addr);
+		if ( it != hosts.end() )
+			return &it->second;
+		}
+
+	if ( num_nets == 0 )
+		return nullptr;
+
+	return static_cast<const Filter*>(nets.Lookup(addr, 128));
+	}
+
 PacketFilter::PacketFilter(bool arg_default)
 	{
 	default_match = arg_default;
-	src_filter.SetDeleteFunction(PacketFilter::DeleteFilter);
-	dst_filter.SetDeleteFunction(PacketFilter::DeleteFilter);
 	}
 
 void PacketFilter::AddSrc(const IPAddr& src, uint32_t tcp_flags, double probability)
 	{
-	Filter* f = new Filter;
-	f->tcp_flags = tcp_flags;
-	f->probability = probability * static_cast<double>(util::detail::max_random());
-	auto prev = static_cast<Filter*>(src_filter.Insert(src, 128, f));
-	delete prev;
+	src_filter.Add(src, MakeFilter(tcp_flags, probability));
 	}
 
 void PacketFilter::AddSrc(Val* src, uint32_t tcp_flags, double probability)
 	{
-	Filter* f = new Filter;
-	f->tcp_flags = tcp_flags;
-	f->probability = probability * static_cast<double>(util::detail::max_random());
-	auto prev = static_cast<Filter*>(src_filter.Insert(src, f));
-	delete prev;
+	src_filter.Add(src, MakeFilter(tcp_flags, probability));
 	}
 
 void PacketFilter::AddDst(const IPAddr& dst, uint32_t tcp_flags, double probability)
 	{
-	Filter* f = new Filter;
-	f->tcp_flags = tcp_flags;
-	f->probability = probability * static_cast<double>(util::detail::max_random());
-	auto prev = static_cast<Filter*>(dst_filter.Insert(dst, 128, f));
-	delete prev;
+	dst_filter.Add(dst, MakeFilter(tcp_flags, probability));
 	}
 
 void PacketFilter::AddDst(Val* dst, uint32_t tcp_flags, double probability)
 	{
-	Filter* f = new Filter;
-	f->tcp_flags = tcp_flags;
-	f->probability = probability * static_cast<double>(util::detail::max_random());
-	auto prev = static_cast<Filter*>(dst_filter.Insert(dst, f));
-	delete prev;
+	dst_filter.Add(dst, MakeFilter(tcp_flags, probability));
 	}
 
 bool PacketFilter::RemoveSrc(const IPAddr& src)
 	{
-	auto f = static_cast<Filter*>(src_filter.Remove(src, 128));
-	delete f;
-	return f != nullptr;
+	return src_filter.Remove(src);
 	}
 
 bool PacketFilter::RemoveSrc(Val* src)
 	{
-	auto f = static_cast<Filter*>(src_filter.Remove(src));
-	delete f;
-	return f != nullptr;
+	return src_filter.Remove(src);
 	}
 
 bool PacketFilter::RemoveDst(const IPAddr& dst)
 	{
-	auto f = static_cast<Filter*>(dst_filter.Remove(dst, 128));
-	delete f;
-	return f != nullptr;
+	return dst_filter.Remove(dst);
 	}
 
 bool PacketFilter::RemoveDst(Val* dst)
 	{
-	auto f = static_cast<Filter*>(dst_filter.Remove(dst));
-	delete f;
-	return f != nullptr;
+	return dst_filter.Remove(dst);
 	}
 
 bool PacketFilter::Match(const std::shared_ptr<IP_Hdr>& ip, int len, int caplen)
 	{
-	Filter* f = (Filter*)src_filter.Lookup(ip->SrcAddr(), 128);
+	if ( src_filter.Empty() && dst_filter.Empty() )
+		return default_match;
+
+	const Filter* f = src_filter.Lookup(ip->SrcAddr());
 	if ( f )
 		return MatchFilter(*f, *ip, len, caplen);
 
-	f = (Filter*)dst_filter.Lookup(ip->DstAddr(), 128);
+	f = dst_filter.Lookup(ip->DstAddr());
 	if ( f )
 		return MatchFilter(*f, *ip, len, caplen);
 
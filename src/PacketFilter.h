@@ -3,6 +3,7 @@
 #pragma once
 
 #include <memory>
+#include <unordered_map>
 
 #include "zeek/IPAddr.h"
 #include "zeek/PrefixTable.h"
@@ -47,13 +48,49 @@ private:
 		double probability;
 		};
 
+	// The filters for one direction. Filters for single addresses, the
+	// common case when shunting individual hosts, live in a hash table
+	// so that their lookup cost doesn't depend on how many there are.
+	// Only actual subnets go into the prefix table, which we skip
+	// entirely while it's empty.
+	class Rules
+		{
+	public:
+		Rules();
+
+		void Add(const IPAddr& addr, const Filter& f);
+		void Add(Val* v, const Filter& f);
+		bool Remove(const IPAddr& addr);
+		bool Remove(Val* v);
+
+		bool Empty() const { return hosts.empty() && num_nets == 0; }
+
+		// Returns the filter with the longest matching prefix, or null.
+		const Filter* Lookup(const IPAddr& addr) const;
+
+	private:
+		struct AddrHash
+			{
+			size_t operator()(const IPAddr& addr) const;
+			};
+
+		// Returns true and sets addr if the value is a single address,
+		// either as an addr or as a subnet covering only one address.
+		static bool AsHost(const Val* v, IPAddr* addr);
+
+		std::unordered_map<IPAddr, Filter, AddrHash> hosts;
+		PrefixTable nets;
+		size_t num_nets = 0;
+		};
+
 	static void DeleteFilter(void* data);
+	static Filter MakeFilter(uint32_t tcp_flags, double probability);
 
 	bool MatchFilter(const Filter& f, const IP_Hdr& ip, int len, int caplen);
 
 	bool default_match;
-	PrefixTable src_filter;
-	PrefixTable dst_filter;
+	Rules src_filter;
+	Rules dst_filter;
 	};
 
 	} // namespace detail
@@ -0,0 +1,417 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/PacketRing.h"
+
+#include <fcntl.h>
+#include <pcap.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "zeek/3rdparty/doctest.h"
+#include "zeek/Hash.h"
+#include "zeek/Reporter.h"
+#include "zeek/iosource/Packet.h"
+
+namespace zeek::detail
+	{
+
+PacketRing* packet_ring = nullptr;
+
+struct PacketRing::Record
+	{
+	int64_t ts_sec;
+	uint32_t ts_usec;
+	uint32_t link_type;
+	uint32_t cap_len;
+	uint32_t len;
+	};
+
+namespace
+	{
+
+// Records start at multiples of this, which suits their alignment.
+constexpr uint64_t ALIGN = 8;
+
+uint64_t aligned(uint64_t n)
+	{
+	return (n + ALIGN - 1) & ~(ALIGN - 1);
+	}
+
+	} // namespace
+
+size_t PacketRing::KeyHash::operator()(const ConnKey& k) const
+	{
+	return HashKey::HashBytes(&k, sizeof(k));
+	}
+
+bool PacketRing::Open(uint64_t size, const std::string& path, uint64_t conn_cutoff)
+	{
+	Close();
+
+	size = aligned(size);
+
+	if ( size < aligned(sizeof(Record)) * 2 )
+		{
+		reporter->Error("packet ring of %" PRIu64 " bytes is too small", size);
+		return false;
+		}
+
+	auto ring = new PacketRing(size, conn_cutoff);
+	void* mem = MAP_FAILED;
+
+	if ( path.empty() )
+		mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	else
+		{
+		ring->fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+
+		if ( ring->fd >= 0 && ftruncate(ring->fd, size) == 0 )
+			mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, ring->fd, 0);
+		}
+
+	if ( mem == MAP_FAILED )
+		{
+		reporter->Error("cannot set up packet ring%s%s: %s", path.empty() ? "" : " in ",
+		                path.c_str(), strerror(errno));
+		delete ring;
+		return false;
+		}
+
+	ring->ring = static_cast<unsigned char*>(mem);
+	ring->next_sweep = size;
+	packet_ring = ring;
+	return true;
+	}
+
+void PacketRing::Close()
+	{
+	delete packet_ring;
+	packet_ring = nullptr;
+	}
+
+PacketRing::~PacketRing()
+	{
+	if ( ring )
+		munmap(ring, size);
+
+	if ( fd >= 0 )
+		close(fd);
+	}
+
+void PacketRing::Add(const ConnKey& key, const Packet* pkt)
+	{
+	uint64_t total = aligned(sizeof(Record) + pkt->cap_len);
+
+	if ( total > size )
+		return;
+
+	auto& flow = flows[key];
+
+	if ( conn_cutoff && flow.bytes >= conn_cutoff )
+		return;
+
+	// Records don't wrap around, the rest of the ring gets skipped
+	// instead.
+	uint64_t offset = head % size;
+
+	if ( offset + total > size )
+		head += size - offset;
+
+	auto rec = reinterpret_cast<Record*>(ring + head % size);
+	rec->ts_sec = pkt->ts.tv_sec;
+	rec->ts_usec = pkt->ts.tv_usec;
+	rec->link_type = pkt->link_type;
+	rec->cap_len = pkt->cap_len;
+	rec->len = pkt->len;
+	memcpy(rec + 1, pkt->data, pkt->cap_len);
+
+	flow.records.push_back(head);
+	flow.bytes += pkt->cap_len;
+	head += total;
+
+	// Once per round through the ring, the flows that fell out of it get
+	// forgotten.
+	if ( head >= next_sweep )
+		{
+		Sweep();
+		next_sweep = head + size;
+		}
+	}
+
+void PacketRing::Trim(Flow* flow) const
+	{
+	auto& r = flow->records;
+	auto first = std::find_if(r.begin(), r.end(), [this](uint64_t pos) { return Valid(pos); });
+	r.erase(r.begin(), first);
+	}
+
+void PacketRing::Sweep()
+	{
+	for ( auto it = flows.begin(); it != flows.end(); )
+		{
+		Trim(&it->second);
+
+		if ( it->second.records.empty() )
+			it = flows.erase(it);
+		else
+			++it;
+		}
+	}
+
+int64_t PacketRing::Extract(const ConnKey& key, const std::string& path, std::string* error)
+	{
+	std::vector<const Record*> records;
+
+	if ( auto it = flows.find(key); it != flows.end() )
+		{
+		Trim(&it->second);
+
+		for ( auto pos : it->second.records )
+			records.push_back(reinterpret_cast<const Record*>(ring + pos % size));
+		}
+
+	int link_type = records.empty() ? DLT_EN10MB : records.front()->link_type;
+	uint32_t snaplen = 0;
+
+	for ( auto rec : records )
+		snaplen = std::max(snaplen, rec->cap_len);
+
+	pcap_t* pd = pcap_open_dead(link_type, std::max(snaplen, 65535u));
+
+	if ( ! pd )
+		{
+		*error = "error for pcap_open_dead";
+		return -1;
+		}
+
+	pcap_dumper_t* dumper = pcap_dump_open(pd, path.c_str());
+
+	if ( ! dumper )
+		{
+		*error = pcap_geterr(pd);
+		pcap_close(pd);
+		return -1;
+		}
+
+	int64_t written = 0;
+
+	for ( auto rec : records )
+		{
+		if ( static_cast<int>(rec->link_type) != link_type )
+			continue;
+
+		struct pcap_pkthdr hdr;
+		hdr.ts.tv_sec = rec->ts_sec;
+		hdr.ts.tv_usec = rec->ts_usec;
+		hdr.caplen = rec->cap_len;
+		hdr.len = rec->len;
+		pcap_dump(reinterpret_cast<u_char*>(dumper), &hdr,
+		          reinterpret_cast<const u_char*>(rec + 1));
+		++written;
+		}
+
+	pcap_dump_close(dumper);
+	pcap_close(pd);
+	return written;
+	}
+
+	} // namespace zeek::detail
+
+using namespace zeek;
+using namespace zeek::detail;
+
+namespace
+	{
+
+// Each test packet is filled with a tag byte, which is also its time.
+struct TestPacket
+	{
+	uint8_t tag;
+	uint32_t cap_len;
+	int link_type;
+	};
+
+ConnKey test_key(int n)
+	{
+	return ConnKey(IPAddr("10.0.0.1"), IPAddr("10.0.0.2"), htons(1000 + n), htons(80),
+	               TRANSPORT_TCP, false);
+	}
+
+void add(const ConnKey& key, uint8_t tag, uint32_t cap_len = 40, int link_type = DLT_EN10MB)
+	{
+	std::vector<u_char> data(cap_len, tag);
+	pkt_timeval ts = {tag, 0};
+	Packet pkt(link_type, &ts, cap_len, cap_len, data.data());
+	packet_ring->Add(key, &pkt);
+	}
+
+// Extracts a flow and reads the trace back, checking each packet's data.
+std::vector<TestPacket> extract(const ConnKey& key)
+	{
+	char path[] = "/tmp/zeek-packet-ring-XXXXXX";
+	int fd = mkstemp(path);
+	REQUIRE(fd >= 0);
+	close(fd);
+
+	std::string error;
+	int64_t n = packet_ring->Extract(key, path, &error);
+	CHECK(n >= 0);
+
+	std::vector<TestPacket> packets;
+	char errbuf[PCAP_ERRBUF_SIZE];
+	pcap_t* pd = pcap_open_offline(path, errbuf);
+	REQUIRE(pd);
+
+	struct pcap_pkthdr* hdr;
+	const u_char* data;
+
+	while ( pcap_next_ex(pd, &hdr, &data) == 1 )
+		{
+		uint8_t tag = hdr->ts.tv_sec;
+		CHECK(hdr->caplen > 0);
+		CHECK(std::all_of(data, data + hdr->caplen, [tag](u_char c) { return c == tag; }));
+		packets.push_back({tag, hdr->caplen, pcap_datalink(pd)});
+		}
+
+	pcap_close(pd);
+	unlink(path);
+	CHECK(n == static_cast<int64_t>(packets.size()));
+	return packets;
+	}
+
+std::vector<uint8_t> tags(const std::vector<TestPacket>& packets)
+	{
+	std::vector<uint8_t> t;
+
+	for ( const auto& p : packets )
+		t.push_back(p.tag);
+
+	return t;
+	}
+
+	} // namespace
+
+TEST_SUITE_BEGIN("PacketRing");
+
+// A packet of 40 bytes takes up a record of 64 with its header.
+
+TEST_CASE("packet ring keeps the most recent packets after a full lap")
+	{
+	REQUIRE(PacketRing::Open(256, "", 0));
+	auto key = test_key(1);
+
+	for ( uint8_t i = 1; i <= 4; ++i )
+		add(key, i);
+
+	// The ring is exactly full, nothing got overwritten yet.
+	CHECK(tags(extract(key)) == std::vector<uint8_t>({1, 2, 3, 4}));
+
+	add(key, 5);
+	CHECK(tags(extract(key)) == std::vector<uint8_t>({2, 3, 4, 5}));
+
+	for ( uint8_t i = 6; i <= 12; ++i )
+		add(key, i);
+
+	CHECK(tags(extract(key)) == std::vector<uint8_t>({9, 10, 11, 12}));
+	PacketRing::Close();
+	}
+
+TEST_CASE("packet ring skips to the start instead of wrapping a record")
+	{
+	// Room for three records, plus eight bytes that don't fit a fourth.
+	REQUIRE(PacketRing::Open(200, "", 0));
+	auto key = test_key(1);
+
+	for ( uint8_t i = 1; i <= 4; ++i )
+		add(key, i);
+
+	// The fourth went to the start, over the first.
+	CHECK(tags(extract(key)) == std::vector<uint8_t>({2, 3, 4}));
+
+	add(key, 5);
+	add(key, 6);
+	CHECK(tags(extract(key)) == std::vector<uint8_t>({4, 5, 6}));
+
+	// The next lap skips the end again.
+	add(key, 7);
+	CHECK(tags(extract(key)) == std::vector<uint8_t>({5, 6, 7}));
+
+	// Packets larger than the ring don't get kept.
+	add(key, 8, 200);
+	CHECK(tags(extract(key)) == std::vector<uint8_t>({5, 6, 7}));
+	PacketRing::Close();
+	}
+
+TEST_CASE("packet ring forgets flows that got overwritten")
+	{
+	REQUIRE(PacketRing::Open(256, "", 0));
+	auto old_flow = test_key(1);
+	auto new_flow = test_key(2);
+
+	add(old_flow, 1);
+	CHECK(packet_ring->NumFlows() == 1);
+
+	for ( uint8_t i = 2; i <= 12; ++i )
+		add(new_flow, i);
+
+	CHECK(packet_ring->NumFlows() == 1);
+	CHECK(extract(old_flow).empty());
+	CHECK(tags(extract(new_flow)) == std::vector<uint8_t>({9, 10, 11, 12}));
+	PacketRing::Close();
+	}
+
+TEST_CASE("packet ring conn cutoff")
+	{
+	REQUIRE(PacketRing::Open(4096, "", 100));
+	auto a = test_key(1);
+	auto b = test_key(2);
+
+	// Packets get kept while a flow has less than the cutoff.
+	for ( uint8_t i = 1; i <= 5; ++i )
+		{
+		add(a, i);
+		add(b, i + 10);
+		}
+
+	CHECK(tags(extract(a)) == std::vector<uint8_t>({1, 2, 3}));
+	CHECK(tags(extract(b)) == std::vector<uint8_t>({11, 12, 13}));
+	PacketRing::Close();
+	}
+
+TEST_CASE("packet ring extracts packets of the first link type")
+	{
+	REQUIRE(PacketRing::Open(4096, "", 0));
+	auto a = test_key(1);
+	auto b = test_key(2);
+
+	add(a, 1, 40, DLT_EN10MB);
+	add(a, 2, 40, DLT_RAW);
+	add(a, 3, 60, DLT_EN10MB);
+	add(a, 4, 40, DLT_RAW);
+	add(a, 5, 20, DLT_EN10MB);
+
+	auto packets = extract(a);
+	CHECK(tags(packets) == std::vector<uint8_t>({1, 3, 5}));
+	REQUIRE(packets.size() == 3);
+	CHECK(packets[0].link_type == DLT_EN10MB);
+	CHECK(packets[1].cap_len == 60);
+	CHECK(packets[2].cap_len == 20);
+
+	add(b, 6, 40, DLT_RAW);
+	add(b, 7, 40, DLT_EN10MB);
+	add(b, 8, 40, DLT_RAW);
+
+	packets = extract(b);
+	CHECK(tags(packets) == std::vector<uint8_t>({6, 8}));
+	REQUIRE(packets.size() == 2);
+	CHECK(packets[0].link_type == DLT_RAW);
+	PacketRing::Close();
+	}
+
+TEST_SUITE_END();
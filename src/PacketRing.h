@@ -0,0 +1,137 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+// A bounded buffer of recent packets, for extracting connections on demand.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "zeek/IPAddr.h"
+
+namespace zeek
+	{
+
+class Packet;
+
+namespace detail
+	{
+
+/**
+ * Keeps the most recent packets in a ring of fixed size, indexed by their
+ * flow, so that the packets of a connection can get written out to a
+ * trace after the fact, say when it raises a notice. Each packet gets
+ * copied once, from the packet source's buffer straight into the ring;
+ * older packets get overwritten as newer ones come in. The ring can live
+ * in a file that gets mapped into memory, to have the page cache rather
+ * than Zeek's memory hold it.
+ *
+ * The ring only exists while on; see Open().
+ */
+class PacketRing
+	{
+public:
+	/**
+	 * Turns the ring on, see packet_ring_size.
+	 *
+	 * @param size The size of the ring in bytes, including a small header
+	 * per packet.
+	 *
+	 * @param path A file to keep the ring in, or empty for memory.
+	 *
+	 * @param conn_cutoff The number of bytes to keep of each flow's
+	 * packets, or zero for no limit. Packets past the cutoff don't get
+	 * kept.
+	 *
+	 * @return False, after reporting an error, if setting up the ring
+	 * failed.
+	 */
+	static bool Open(uint64_t size, const std::string& path, uint64_t conn_cutoff);
+
+	/**
+	 * Turns the ring off, dropping the packets it holds.
+	 */
+	static void Close();
+
+	~PacketRing();
+
+	PacketRing(const PacketRing&) = delete;
+	PacketRing& operator=(const PacketRing&) = delete;
+
+	/**
+	 * Keeps a packet.
+	 *
+	 * @param key The key for the packet's flow.
+	 *
+	 * @param pkt The packet.
+	 */
+	void Add(const ConnKey& key, const Packet* pkt);
+
+	/**
+	 * Writes a flow's packets that the ring still holds to a trace file,
+	 * oldest first. Only packets of the same link type as the first one
+	 * get written.
+	 *
+	 * @param key The key for the flow.
+	 *
+	 * @param path The file to write.
+	 *
+	 * @param error Receives a description of what went wrong, on failure.
+	 *
+	 * @return The number of packets written, or -1 on failure.
+	 */
+	int64_t Extract(const ConnKey& key, const std::string& path, std::string* error);
+
+	/**
+	 * Returns the number of flows the ring keeps track of. Flows whose
+	 * packets all got overwritten count until the ring forgets them, once
+	 * per round through the ring.
+	 */
+	size_t NumFlows() const { return flows.size(); }
+
+private:
+	PacketRing(uint64_t size, uint64_t conn_cutoff) : size(size), conn_cutoff(conn_cutoff) { }
+
+	struct Record;
+
+	struct KeyHash
+		{
+		size_t operator()(const ConnKey& k) const;
+		};
+
+	struct Flow
+		{
+		// Where the flow's packets start, in terms of head.
+		std::vector<uint64_t> records;
+		uint64_t bytes = 0;
+		};
+
+	// True if the ring still holds what got written at the position.
+	bool Valid(uint64_t pos) const { return pos + size >= head; }
+
+	// Drops a flow's positions that got overwritten.
+	void Trim(Flow* flow) const;
+
+	// Forgets flows whose packets all got overwritten.
+	void Sweep();
+
+	uint64_t size;
+	uint64_t conn_cutoff;
+	unsigned char* ring = nullptr;
+	int fd = -1;
+
+	// Where the next packet goes, counting all bytes ever written; its
+	// position in the ring is this modulo the size.
+	uint64_t head = 0;
+	uint64_t next_sweep = 0;
+
+	std::unordered_map<ConnKey, Flow, KeyHash> flows;
+	};
+
+// Set while the ring is on.
+extern PacketRing* packet_ring;
+
+	} // namespace detail
+	} // namespace zeek
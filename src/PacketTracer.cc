@@ -0,0 +1,150 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/PacketTracer.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "zeek/iosource/Packet.h"
+#include "zeek/telemetry/Manager.h"
+#include "zeek/util.h"
+
+namespace zeek::detail
+	{
+
+PacketTracer* packet_tracer = nullptr;
+
+namespace
+	{
+
+const char* stage_names[PacketTracer::NUM_STAGES] = {
+	"extract",    "packet_analysis",   "session_lookup", "analyzer_delivery",
+	"event_queue", "handler_execution", "broker_publish",
+};
+
+const char* point_names[PacketTracer::NUM_POINTS] = {
+	"dispatch",
+	"first_event",
+	"handlers_done",
+	"first_publish",
+};
+
+// From a microsecond to ten seconds, in steps of about 3x.
+constexpr double bounds[] = {0.000001, 0.000003, 0.00001, 0.00003, 0.0001, 0.0003, 0.001,
+                             0.003,    0.01,     0.03,    0.1,     0.3,    1.0,    3.0,
+                             10.0};
+
+	} // namespace
+
+struct PacketTracer::Metrics
+	{
+	Metrics()
+		{
+		auto stage_family = telemetry_mgr->HistogramFamily<double>(
+			"zeek", "packet-trace-stage", {"stage"}, bounds,
+			"Durations of the processing stages of traced packets", "seconds");
+
+		for ( auto name : stage_names )
+			stages.push_back(stage_family.GetOrAdd({{"stage", name}}));
+
+		auto point_family = telemetry_mgr->HistogramFamily<double>(
+			"zeek", "packet-trace-latency", {"point"}, bounds,
+			"Latencies from capture to points of processing of traced packets", "seconds");
+
+		for ( auto name : point_names )
+			points.push_back(point_family.GetOrAdd({{"point", name}}));
+		}
+
+	std::vector<telemetry::DblHistogram> stages;
+	std::vector<telemetry::DblHistogram> points;
+	};
+
+PacketTracer::PacketTracer(uint64_t rate) : rate(rate), countdown(rate) { }
+
+void PacketTracer::SetSampleRate(uint64_t rate)
+	{
+	if ( ! rate )
+		{
+		delete packet_tracer;
+		packet_tracer = nullptr;
+		return;
+		}
+
+	if ( ! packet_tracer )
+		packet_tracer = new PacketTracer(rate);
+
+	packet_tracer->rate = rate;
+	packet_tracer->countdown = std::min(packet_tracer->countdown, rate);
+	}
+
+void PacketTracer::BeginPacket(const Packet* pkt, bool live)
+	{
+	if ( --countdown > 0 )
+		return;
+
+	countdown = rate;
+	tracing = true;
+	std::fill(std::begin(reached), std::end(reached), false);
+
+	if ( ! metrics )
+		metrics = std::make_unique<Metrics>();
+
+	auto now = util::current_time(true);
+
+	// Timestamps of packets from traces tell nothing about when Zeek
+	// got them.
+	origin = live ? pkt->time : now;
+
+	if ( live )
+		Reached(DISPATCH);
+	else
+		reached[DISPATCH] = true;
+
+	Record(EXTRACT, extract_per_packet);
+	}
+
+void PacketTracer::EndPacket()
+	{
+	if ( ! tracing )
+		return;
+
+	Reached(HANDLERS_DONE);
+	tracing = false;
+	}
+
+void PacketTracer::Record(Stage stage, double seconds)
+	{
+	if ( tracing )
+		metrics->stages[stage].Observe(std::max(seconds, 0.0));
+	}
+
+void PacketTracer::Reached(Point point)
+	{
+	if ( ! tracing || reached[point] )
+		return;
+
+	reached[point] = true;
+	metrics->points[point].Observe(std::max(util::current_time(true) - origin, 0.0));
+	}
+
+PacketTraceScope::PacketTraceScope(PacketTracer::Stage stage) : stage(stage)
+	{
+	if ( tracing_packet() )
+		start = util::current_time(true);
+	}
+
+PacketTraceScope::~PacketTraceScope()
+	{
+	End();
+	}
+
+void PacketTraceScope::End()
+	{
+	// Tracing may have ended or started within the scope.
+	if ( start > 0.0 && tracing_packet() )
+		packet_tracer->Record(stage, util::current_time(true) - start);
+
+	start = 0.0;
+	}
+
+	} // namespace zeek::detail
@@ -0,0 +1,160 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+// Tracing of sampled packets through the processing pipeline.
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+
+namespace zeek
+	{
+
+class Packet;
+
+namespace detail
+	{
+
+/**
+ * Traces one in every so many packets through Zeek's processing, for
+ * measuring how long it takes from capture to analysis, to the handling of
+ * the resulting events, to publishing what the handlers decide. Each
+ * traced packet adds the durations of its stages, and its latencies since
+ * capture, to histograms in the telemetry framework.
+ *
+ * Stages nest: packet analysis includes the session lookup and the
+ * delivery to analyzers, and handler execution includes Broker publishing.
+ * Tracing covers the events queued while the packet is processed, which
+ * get dispatched before the next packet.
+ *
+ * The tracer only exists while tracing is on; see set_sample_rate().
+ */
+class PacketTracer
+	{
+public:
+	enum Stage
+		{
+		EXTRACT, //< Extracting the packet from the source, averaged over its batch.
+		PACKET_ANALYSIS, //< The packet analyzers, from the link layer on.
+		SESSION_LOOKUP, //< Finding or creating the packet's connection.
+		ANALYZER_DELIVERY, //< Delivery to the connection's analyzers.
+		EVENT_QUEUE, //< The wait of each of the events in the queue.
+		HANDLER_EXECUTION, //< The handlers of each of the events.
+		BROKER_PUBLISH, //< Each publishing of an event through Broker.
+		NUM_STAGES
+		};
+
+	enum Point
+		{
+		DISPATCH, //< Processing started; only for live sources.
+		FIRST_EVENT, //< The first event got queued.
+		HANDLERS_DONE, //< All events got handled.
+		FIRST_PUBLISH, //< Handlers first published an event.
+		NUM_POINTS
+		};
+
+	/**
+	 * Turns tracing on or off.
+	 *
+	 * @param rate Traces one in this many packets, or none if zero.
+	 */
+	static void SetSampleRate(uint64_t rate);
+
+	/**
+	 * Notes the time that extracting the current batch of packets took.
+	 *
+	 * @param seconds The time the extraction took.
+	 *
+	 * @param num_packets The number of packets extracted.
+	 */
+	void ExtractedBatch(double seconds, size_t num_packets)
+		{
+		extract_per_packet = num_packets ? seconds / num_packets : 0.0;
+		}
+
+	/**
+	 * Starts processing a packet, tracing it if it's the one to sample.
+	 *
+	 * @param pkt The packet.
+	 *
+	 * @param live True if the packet comes from a live source, so that its
+	 * timestamp is when it got captured.
+	 */
+	void BeginPacket(const Packet* pkt, bool live);
+
+	/**
+	 * Finishes processing the current packet, once its events got
+	 * handled.
+	 */
+	void EndPacket();
+
+	/**
+	 * @return True while tracing a packet.
+	 */
+	bool Tracing() const { return tracing; }
+
+	/**
+	 * Records a stage's duration for the traced packet.
+	 */
+	void Record(Stage stage, double seconds);
+
+	/**
+	 * Records the latency since capture for the traced packet, if not
+	 * done so yet.
+	 */
+	void Reached(Point point);
+
+private:
+	explicit PacketTracer(uint64_t rate);
+
+	struct Metrics;
+
+	uint64_t rate;
+	uint64_t countdown;
+	bool tracing = false;
+	double extract_per_packet = 0.0;
+
+	// When the traced packet got captured, or for sources that aren't
+	// live, when its processing started.
+	double origin = 0.0;
+	bool reached[NUM_POINTS] = {};
+
+	std::unique_ptr<Metrics> metrics;
+	};
+
+/**
+ * Times a stage of the traced packet, for the lifetime of the object; does
+ * nothing unless a packet is traced.
+ */
+class PacketTraceScope
+	{
+public:
+	explicit PacketTraceScope(PacketTracer::Stage stage);
+	~PacketTraceScope();
+
+	PacketTraceScope(const PacketTraceScope&) = delete;
+	PacketTraceScope& operator=(const PacketTraceScope&) = delete;
+
+	/**
+	 * Ends the stage before the object goes away.
+	 */
+	void End();
+
+private:
+	PacketTracer::Stage stage;
+	double start = 0.0;
+	};
+
+// Set while tracing is on.
+extern PacketTracer* packet_tracer;
+
+/**
+ * @return True if tracing is on and the current packet is traced.
+ */
+inline bool tracing_packet()
+	{
+	return packet_tracer && packet_tracer->Tracing();
+	}
+
+	} // namespace detail
+	} // namespace zeek
@@ -0,0 +1,724 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/Parallel.h"
+
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <set>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+extern "C"
+	{
+#include <pcap.h>
+	}
+
+#include "zeek/Options.h"
+#include "zeek/iosource/parallel/Source.h"
+#include "zeek/util.h"
+
+using namespace zeek::iosource::parallel;
+
+namespace zeek::detail
+	{
+
+namespace
+	{
+
+// How far apart in trace time the workers get told about the progress of
+// the trace.
+constexpr double TICK_INTERVAL = 0.1;
+
+// How much gets buffered for a worker before writing it to its pipe.
+constexpr size_t FLUSH_SIZE = 256 * 1024;
+
+#ifdef F_SETPIPE_SZ
+// How large we ask the pipes to be, to absorb workers' hiccups.
+constexpr int PIPE_SIZE = 1024 * 1024;
+#endif
+
+struct Worker
+	{
+	pid_t pid = -1;
+	int fd = -1;
+	std::string dir;
+	std::string buffer;
+	bool failed = false;
+	};
+
+bool write_all(int fd, const char* data, size_t len)
+	{
+	while ( len > 0 )
+		{
+		ssize_t n = write(fd, data, len);
+
+		if ( n < 0 )
+			{
+			if ( errno == EINTR )
+				continue;
+
+			return false;
+			}
+
+		data += n;
+		len -= n;
+		}
+
+	return true;
+	}
+
+void flush(Worker* w)
+	{
+	if ( ! w->failed && ! write_all(w->fd, w->buffer.data(), w->buffer.size()) )
+		{
+		// The worker went away, which its exit status will tell about.
+		w->failed = true;
+		close(w->fd);
+		w->fd = -1;
+		}
+
+	w->buffer.clear();
+	}
+
+void add_frame(Worker* w, FrameKind kind, const struct timeval& ts, uint32_t caplen = 0,
+               uint32_t len = 0, const u_char* data = nullptr)
+	{
+	FrameHeader hdr = {};
+	hdr.kind = kind;
+	hdr.caplen = caplen;
+	hdr.len = len;
+	hdr.ts_sec = ts.tv_sec;
+	hdr.ts_usec = ts.tv_usec;
+
+	w->buffer.append(reinterpret_cast<const char*>(&hdr), sizeof(hdr));
+
+	if ( caplen )
+		w->buffer.append(reinterpret_cast<const char*>(data), caplen);
+
+	if ( w->buffer.size() >= FLUSH_SIZE )
+		flush(w);
+	}
+
+uint64_t fnv1a(uint64_t h, const u_char* data, size_t len)
+	{
+	for ( size_t i = 0; i < len; ++i )
+		h = (h ^ data[i]) * 0x100000001b3ULL;
+
+	return h;
+	}
+
+// Hashes the pair of addresses of an IP packet the same way for both
+// directions. Returns zero for anything that's not IP.
+uint64_t hash_ip(const u_char* data, uint32_t caplen)
+	{
+	if ( caplen < 1 )
+		return 0;
+
+	size_t off, addr_len;
+
+	switch ( data[0] >> 4 )
+		{
+		case 4:
+			off = 12;
+			addr_len = 4;
+			break;
+		case 6:
+			off = 8;
+			addr_len = 16;
+			break;
+		default:
+			return 0;
+		}
+
+	if ( caplen < off + 2 * addr_len )
+		return 0;
+
+	const u_char* a = data + off;
+	const u_char* b = a + addr_len;
+
+	if ( memcmp(a, b, addr_len) > 0 )
+		std::swap(a, b);
+
+	uint64_t h = fnv1a(0xcbf29ce484222325ULL, a, addr_len);
+	h = fnv1a(h, b, addr_len);
+
+	// The FNV's low bits don't mix well enough for taking the modulo.
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	return h;
+	}
+
+// Finds the IP header behind the link layer and hashes it, for the link
+// types that traces commonly come with. Anything else goes to the first
+// worker.
+uint64_t hash_packet(int link_type, const u_char* data, uint32_t caplen)
+	{
+	uint32_t off;
+	uint32_t ether_type;
+
+	switch ( link_type )
+		{
+		case DLT_RAW:
+#ifdef DLT_IPV4
+		case DLT_IPV4:
+#endif
+#ifdef DLT_IPV6
+		case DLT_IPV6:
+#endif
+			return hash_ip(data, caplen);
+
+		case DLT_NULL:
+		case DLT_LOOP:
+			return caplen > 4 ? hash_ip(data + 4, caplen - 4) : 0;
+
+		case DLT_LINUX_SLL:
+			if ( caplen < 16 )
+				return 0;
+
+			off = 16;
+			ether_type = (data[14] << 8) | data[15];
+			break;
+
+		case DLT_EN10MB:
+			if ( caplen < 14 )
+				return 0;
+
+			off = 14;
+			ether_type = (data[12] << 8) | data[13];
+			break;
+
+		default:
+			return 0;
+		}
+
+	// Skip VLAN tags.
+	while ( (ether_type == 0x8100 || ether_type == 0x88a8 || ether_type == 0x9100) &&
+	        off + 4 <= caplen )
+		{
+		ether_type = (data[off + 2] << 8) | data[off + 3];
+		off += 4;
+		}
+
+	// Skip MPLS labels, guessing IP behind them.
+	if ( ether_type == 0x8847 )
+		{
+		while ( off + 4 <= caplen )
+			{
+			bool bottom = data[off + 2] & 0x01;
+			off += 4;
+
+			if ( bottom )
+				break;
+			}
+
+		ether_type = 0x0800;
+		}
+
+	if ( (ether_type != 0x0800 && ether_type != 0x86dd) || off >= caplen )
+		return 0;
+
+	return hash_ip(data + off, caplen - off);
+	}
+
+// Reads the packets of the trace and hands them out to the workers.
+// Returns false if the trace couldn't get read in full.
+bool split_trace(pcap_t* pd, const std::string& path, std::vector<Worker>* workers)
+	{
+	int link_type = pcap_datalink(pd);
+
+	StreamHeader shdr = {};
+	shdr.magic = STREAM_MAGIC;
+	shdr.link_type = link_type;
+	shdr.path_len = path.size();
+
+	for ( auto& w : *workers )
+		{
+		w.buffer.append(reinterpret_cast<const char*>(&shdr), sizeof(shdr));
+		w.buffer.append(path);
+		}
+
+	size_t num_workers = workers->size();
+	double next_tick = 0.0;
+	struct timeval last_ts = {};
+	bool ok = true;
+
+	while ( true )
+		{
+		struct pcap_pkthdr* hdr;
+		const u_char* data;
+		int res = pcap_next_ex(pd, &hdr, &data);
+
+		if ( res == PCAP_ERROR_BREAK )
+			break;
+
+		if ( res != 1 )
+			{
+			fprintf(stderr, "ERROR: failed to read a packet from %s: %s\n", path.c_str(),
+			        pcap_geterr(pd));
+			ok = false;
+			break;
+			}
+
+		double t = hdr->ts.tv_sec + hdr->ts.tv_usec / 1e6;
+
+		// All packets before this one are with the workers, so their
+		// time can move up to its. The first one also starts their
+		// network time together.
+		if ( t >= next_tick )
+			{
+			for ( auto& w : *workers )
+				add_frame(&w, FRAME_TICK, hdr->ts);
+
+			next_tick = t + TICK_INTERVAL;
+			}
+
+		auto& w = (*workers)[hash_packet(link_type, data, hdr->caplen) % num_workers];
+		add_frame(&w, FRAME_PACKET, hdr->ts, hdr->caplen, hdr->len, data);
+
+		if ( t > last_ts.tv_sec + last_ts.tv_usec / 1e6 )
+			last_ts = hdr->ts;
+		}
+
+	for ( auto& w : *workers )
+		{
+		add_frame(&w, FRAME_END, last_ts);
+		flush(&w);
+
+		if ( w.fd >= 0 )
+			{
+			close(w.fd);
+			w.fd = -1;
+			}
+		}
+
+	return ok;
+	}
+
+// A worker's copy of a log being merged.
+struct LogInput
+	{
+	std::ifstream in;
+	size_t index = 0;
+
+	std::string line;
+	bool have_line = false;
+
+	bool json = false;
+	char separator = '\t';
+	int ts_field = -1;
+
+	// The timestamp of the current line.
+	std::string ts;
+	double ts_num = 0.0;
+	bool ts_is_num = false;
+	};
+
+// Turns the escaped separator of an ASCII log's header into the real one.
+char unescape_separator(const std::string& s)
+	{
+	if ( s.size() == 4 && s[0] == '\\' && s[1] == 'x' )
+		return static_cast<char>(strtol(s.substr(2).c_str(), nullptr, 16));
+
+	return s.empty() ? '\t' : s[0];
+	}
+
+// Pulls the timestamp out of the current line, returning false if it
+// doesn't have one.
+bool extract_ts(LogInput* li)
+	{
+	const auto& line = li->line;
+
+	if ( li->json )
+		{
+		static const std::string ts_key = "\"ts\":";
+		auto p = line.find(ts_key);
+
+		if ( p == std::string::npos )
+			return false;
+
+		p += ts_key.size();
+
+		if ( p < line.size() && line[p] == '"' )
+			{
+			auto q = line.find('"', p + 1);
+			li->ts = line.substr(p + 1, q == std::string::npos ? q : q - p - 1);
+			}
+		else
+			li->ts = line.substr(p, line.find_first_of(",}", p) - p);
+		}
+
+	else
+		{
+		if ( li->ts_field < 0 )
+			return false;
+
+		size_t start = 0;
+
+		for ( int i = 0; i < li->ts_field && start != std::string::npos; ++i )
+			{
+			start = line.find(li->separator, start);
+
+			if ( start != std::string::npos )
+				++start;
+			}
+
+		if ( start == std::string::npos )
+			return false;
+
+		li->ts = line.substr(start, line.find(li->separator, start) - start);
+		}
+
+	char* end;
+	li->ts_num = strtod(li->ts.c_str(), &end);
+	li->ts_is_num = ! li->ts.empty() && *end == '\0';
+	return true;
+	}
+
+// Moves on to the next line of data, keeping the latest #close line seen.
+void next_line(LogInput* li, std::string* close_line)
+	{
+	li->have_line = false;
+
+	while ( std::getline(li->in, li->line) )
+		{
+		if ( ! li->line.empty() && li->line[0] == '#' )
+			{
+			if ( li->line.compare(0, 6, "#close") == 0 && li->line > *close_line )
+				*close_line = li->line;
+
+			continue;
+			}
+
+		li->have_line = true;
+		extract_ts(li);
+		return;
+		}
+	}
+
+// Timestamps that are numbers order by their value, before any others.
+bool ts_less(const LogInput& a, const LogInput& b)
+	{
+	if ( a.ts_is_num != b.ts_is_num )
+		return a.ts_is_num;
+
+	if ( a.ts_is_num ? a.ts_num != b.ts_num : a.ts != b.ts )
+		return a.ts_is_num ? a.ts_num < b.ts_num : a.ts < b.ts;
+
+	return a.index < b.index;
+	}
+
+// Merges the workers' copies of a log into one, by their lines'
+// timestamps. Logs without timestamps get concatenated instead, with lines
+// that more than one worker wrote, like the loaded scripts, showing up
+// just once.
+bool merge_log(const std::vector<zeek::filesystem::path>& inputs,
+               const zeek::filesystem::path& output)
+	{
+	std::vector<LogInput> lis(inputs.size());
+	std::vector<std::string> header;
+	std::string close_line;
+	bool timed = true;
+
+	for ( size_t i = 0; i < inputs.size(); ++i )
+		{
+		auto& li = lis[i];
+		li.index = i;
+		li.in.open(inputs[i].string());
+
+		if ( ! li.in )
+			{
+			fprintf(stderr, "ERROR: cannot read %s\n", inputs[i].c_str());
+			return false;
+			}
+
+		bool first_header = header.empty();
+
+		while ( std::getline(li.in, li.line) )
+			{
+			if ( li.line.empty() || li.line[0] != '#' )
+				{
+				li.have_line = true;
+				break;
+				}
+
+			if ( li.line.compare(0, 6, "#close") == 0 )
+				{
+				if ( li.line > close_line )
+					close_line = li.line;
+
+				continue;
+				}
+
+			if ( first_header )
+				header.push_back(li.line);
+
+			if ( li.line.compare(0, 11, "#separator ") == 0 )
+				li.separator = unescape_separator(li.line.substr(11));
+
+			else if ( li.line.compare(0, 8, "#fields") == 0 )
+				{
+				auto fields = util::tokenize_string(li.line, li.separator);
+
+				for ( size_t j = 1; j < fields.size(); ++j )
+					if ( fields[j] == "ts" )
+						li.ts_field = j - 1;
+				}
+			}
+
+		if ( ! li.have_line )
+			continue;
+
+		li.json = li.line[0] == '{';
+
+		if ( ! extract_ts(&li) )
+			timed = false;
+		}
+
+	std::ofstream out(output.string(), std::ios::trunc);
+
+	if ( ! out )
+		{
+		fprintf(stderr, "ERROR: cannot write %s\n", output.c_str());
+		return false;
+		}
+
+	for ( const auto& h : header )
+		out << h << '\n';
+
+	if ( timed )
+		{
+		while ( true )
+			{
+			LogInput* next = nullptr;
+
+			for ( auto& li : lis )
+				if ( li.have_line && (! next || ts_less(li, *next)) )
+					next = &li;
+
+			if ( ! next )
+				break;
+
+			out << next->line << '\n';
+			next_line(next, &close_line);
+			}
+		}
+
+	else
+		{
+		std::unordered_set<std::string> seen;
+
+		for ( auto& li : lis )
+			{
+			for ( ; li.have_line; next_line(&li, &close_line) )
+				if ( seen.insert(li.line).second )
+					out << li.line << '\n';
+			}
+		}
+
+	if ( ! close_line.empty() )
+		out << close_line << '\n';
+
+	out.close();
+
+	if ( ! out )
+		{
+		fprintf(stderr, "ERROR: failed writing %s\n", output.c_str());
+		return false;
+		}
+
+	return true;
+	}
+
+// Merges the logs that the workers wrote into the output directory,
+// removing the workers' directories if nothing else remains in them.
+bool merge_logs(const std::vector<Worker>& workers, const zeek::filesystem::path& tmp_dir,
+                const zeek::filesystem::path& out_dir)
+	{
+	std::set<std::string> names;
+	std::error_code ec;
+
+	for ( const auto& w : workers )
+		{
+		for ( const auto& e : zeek::filesystem::directory_iterator(w.dir, ec) )
+			{
+			auto name = e.path().filename().string();
+
+			if ( e.is_regular_file() && name[0] != '.' && util::ends_with(name, ".log") )
+				names.insert(name);
+			}
+		}
+
+	bool ok = true;
+
+	for ( const auto& name : names )
+		{
+		std::vector<zeek::filesystem::path> inputs;
+
+		for ( const auto& w : workers )
+			{
+			auto p = zeek::filesystem::path(w.dir) / name;
+
+			if ( zeek::filesystem::exists(p, ec) )
+				inputs.push_back(p);
+			}
+
+		if ( ! merge_log(inputs, out_dir / name) )
+			{
+			ok = false;
+			continue;
+			}
+
+		for ( const auto& p : inputs )
+			zeek::filesystem::remove(p, ec);
+		}
+
+	// Only succeeds for empty directories.
+	for ( const auto& w : workers )
+		zeek::filesystem::remove(w.dir, ec);
+
+	if ( ! zeek::filesystem::remove(tmp_dir, ec) )
+		fprintf(stderr, "workers left files other than logs in %s\n", tmp_dir.c_str());
+
+	return ok;
+	}
+
+	} // namespace
+
+std::optional<int> run_parallel(Options* options)
+	{
+	auto num_workers = options->parallel_workers;
+	const auto& path = *options->pcap_file;
+
+	// The workers log where a single process would, so see if the
+	// command line asks for a directory.
+	std::string out_dir = ".";
+	static const std::string logdir_option = "Log::default_logdir=";
+
+	for ( const auto& o : options->script_options_to_set )
+		if ( o.compare(0, logdir_option.size(), logdir_option) == 0 )
+			out_dir = o.substr(logdir_option.size());
+
+	if ( out_dir.empty() )
+		out_dir = ".";
+
+	char errbuf[PCAP_ERRBUF_SIZE];
+	pcap_t* pd = pcap_open_offline(path.c_str(), errbuf);
+
+	if ( ! pd )
+		{
+		fprintf(stderr, "ERROR: problem with trace file %s (%s)\n", path.c_str(), errbuf);
+		return 1;
+		}
+
+	// The workers don't touch the trace, but they can't close it either,
+	// as that might move the file offset they share with us.
+	fcntl(fileno(pcap_file(pd)), F_SETFD, FD_CLOEXEC);
+
+	auto tmp_dir = zeek::filesystem::path(out_dir) / util::fmt(".parallel-%d", getpid());
+	std::vector<Worker> workers(num_workers);
+
+	for ( int i = 0; i < num_workers; ++i )
+		{
+		auto& w = workers[i];
+		w.dir = (tmp_dir / util::fmt("worker-%d", i + 1)).string();
+
+		std::error_code ec;
+		zeek::filesystem::create_directories(w.dir, ec);
+
+		if ( ec )
+			{
+			fprintf(stderr, "ERROR: cannot create %s: %s\n", w.dir.c_str(),
+			        ec.message().c_str());
+			return 1;
+			}
+
+		int fds[2];
+
+		if ( pipe(fds) < 0 )
+			{
+			fprintf(stderr, "ERROR: cannot create pipe for worker: %s\n", strerror(errno));
+			return 1;
+			}
+
+#ifdef F_SETPIPE_SZ
+		// Just a hint, the default works too.
+		fcntl(fds[1], F_SETPIPE_SZ, PIPE_SIZE);
+#endif
+
+		w.pid = fork();
+
+		if ( w.pid < 0 )
+			{
+			fprintf(stderr, "ERROR: cannot fork worker: %s\n", strerror(errno));
+			return 1;
+			}
+
+		if ( w.pid == 0 )
+			{
+			for ( int j = 0; j < i; ++j )
+				close(workers[j].fd);
+
+			close(fds[1]);
+
+			options->pcap_file = util::fmt("parallel::%d", fds[0]);
+			options->script_options_to_set.emplace_back(logdir_option + w.dir);
+			options->parallel_workers = 0;
+			util::detail::set_unique_id_instance(i + 1);
+			return std::nullopt;
+			}
+
+		close(fds[0]);
+		w.fd = fds[1];
+		}
+
+	// Workers going away show in their exit status.
+	signal(SIGPIPE, SIG_IGN);
+
+	int rc = 0;
+
+	if ( ! split_trace(pd, path, &workers) )
+		rc = 1;
+
+	pcap_close(pd);
+
+	for ( int i = 0; i < num_workers; ++i )
+		{
+		int status;
+
+		while ( waitpid(workers[i].pid, &status, 0) < 0 )
+			{
+			if ( errno != EINTR )
+				{
+				status = -1;
+				break;
+				}
+			}
+
+		if ( WIFEXITED(status) && WEXITSTATUS(status) == 0 )
+			continue;
+
+		if ( status != -1 && WIFSIGNALED(status) )
+			fprintf(stderr, "ERROR: worker %d terminated by signal %d\n", i + 1,
+			        WTERMSIG(status));
+		else
+			fprintf(stderr, "ERROR: worker %d failed\n", i + 1);
+
+		rc = 1;
+		}
+
+	if ( ! merge_logs(workers, tmp_dir, out_dir) )
+		rc = 1;
+
+	return rc;
+	}
+
+	} // namespace zeek::detail
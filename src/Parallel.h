@@ -0,0 +1,40 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+// Reading a trace with several worker processes, see --parallel.
+
+#pragma once
+
+#include <optional>
+
+namespace zeek
+	{
+
+struct Options;
+
+namespace detail
+	{
+
+/**
+ * Splits up reading the trace of -r among the number of worker processes
+ * that --parallel asks for. This forks the workers, each of which goes on
+ * to set up Zeek as usual with the options adjusted to read its share of
+ * the trace from a pipe, and to log into a directory of its own. The
+ * original process stays behind to read the trace, sending each packet
+ * to a worker by a hash of its pair of addresses, which keeps flows,
+ * their fragments and flows between the same hosts together. Every so
+ * often, it tells all workers how far the trace has gotten, so their
+ * network time, and with it their timers, keep up with the trace as a
+ * whole even when they don't see packets for a while. Once all workers
+ * are done, it merges the logs they wrote by timestamp into one set.
+ *
+ * Needs calling before anything starts threads.
+ *
+ * @param options The options, which get adjusted for the workers.
+ *
+ * @return Nothing in the workers, which carry on. The exit code in the
+ * original process, once the workers finished.
+ */
+std::optional<int> run_parallel(Options* options);
+
+	} // namespace detail
+	} // namespace zeek
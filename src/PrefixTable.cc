@@ -1,20 +1,27 @@
 #include "zeek/PrefixTable.h"
 
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
 #include "zeek/Reporter.h"
 #include "zeek/Val.h"
 
 namespace zeek::detail
 	{
 
-prefix_t* PrefixTable::MakePrefix(const IPAddr& addr, int width)
+void PrefixTable::InitPrefix(prefix_t* prefix, const IPAddr& addr, int width)
 	{
-	prefix_t* prefix = (prefix_t*)util::safe_malloc(sizeof(prefix_t));
-
 	addr.CopyIPv6(&prefix->add.sin6);
 	prefix->family = AF_INET6;
 	prefix->bitlen = width;
 	prefix->ref_count = 1;
+	}
 
+prefix_t* PrefixTable::MakePrefix(const IPAddr& addr, int width)
+	{
+	prefix_t* prefix = (prefix_t*)util::safe_malloc(sizeof(prefix_t));
+	InitPrefix(prefix, addr, width);
 	return prefix;
 	}
 
@@ -43,6 +50,11 @@ void* PrefixTable::Insert(const IPAddr& addr, int width, void* data)
 	// node itself.
 	node->data = data ? data : node;
 
+	if ( ! old )
+		++num_prefixes;
+
+	Changed();
+
 	return old;
 	}
 
@@ -71,17 +83,17 @@ void* PrefixTable::Insert(const Val* value, void* data)
 std::list<std::tuple<IPPrefix, void*>> PrefixTable::FindAll(const IPAddr& addr, int width) const
 	{
 	std::list<std::tuple<IPPrefix, void*>> out;
-	prefix_t* prefix = MakePrefix(addr, width);
+	prefix_t prefix;
+	InitPrefix(&prefix, addr, width);
 
 	int elems = 0;
 	patricia_node_t** list = nullptr;
 
-	patricia_search_all(tree, prefix, &list, &elems);
+	patricia_search_all(tree, &prefix, &list, &elems);
 
 	for ( int i = 0; i < elems; ++i )
 		out.push_back(std::make_tuple(PrefixToIPPrefix(list[i]->prefix), list[i]->data));
 
-	Deref_Prefix(prefix);
 	free(list);
 	return out;
 	}
@@ -93,17 +105,102 @@ std::list<std::tuple<IPPrefix, void*>> PrefixTable::FindAll(const SubNetVal* val
 
 void* PrefixTable::Lookup(const IPAddr& addr, int width, bool exact) const
 	{
-	prefix_t* prefix = MakePrefix(addr, width);
-	patricia_node_t* node = exact ? patricia_search_exact(tree, prefix)
-	                              : patricia_search_best(tree, prefix);
+	if ( ! exact && width == 128 && addr.GetFamily() == IPv4 && UseIPv4Index() )
+		{
+		const uint32_t* bytes;
+		addr.GetBytes(&bytes);
+		return ipv4_index.Lookup(ntohl(*bytes));
+		}
 
-	int elems = 0;
-	patricia_node_t** list = nullptr;
+	// The patricia functions don't keep the prefix we're looking for,
+	// so it can live on the stack.
+	prefix_t prefix;
+	InitPrefix(&prefix, addr, width);
+	patricia_node_t* node = exact ? patricia_search_exact(tree, &prefix)
+	                              : patricia_search_best(tree, &prefix);
 
-	Deref_Prefix(prefix);
 	return node ? node->data : nullptr;
 	}
 
+bool PrefixTable::UseIPv4Index() const
+	{
+	if ( ipv4_index.IsBuilt() )
+		return true;
+
+	if ( num_prefixes < IPV4_INDEX_MIN_PREFIXES || ++lookups_since_change < num_prefixes )
+		return false;
+
+	BuildIPv4Index();
+	return true;
+	}
+
+// Returns true if the first n bits of two addresses are the same.
+static bool same_bits(const uint8_t* a, const uint8_t* b, int n)
+	{
+	if ( memcmp(a, b, n / 8) != 0 )
+		return false;
+
+	if ( n % 8 == 0 )
+		return true;
+
+	uint8_t mask = 0xff << (8 - n % 8);
+	return ((a[n / 8] ^ b[n / 8]) & mask) == 0;
+	}
+
+void PrefixTable::BuildIPv4Index() const
+	{
+	static const uint8_t v4_mapped[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff};
+
+	std::vector<IPv4PrefixIndex::Prefix> prefixes;
+	prefixes.reserve(num_prefixes);
+
+	// Prefixes that cover all of the IPv4-mapped range; the longest of
+	// them applies to IPv4 addresses no other prefix covers.
+	patricia_node_t* v4_default = nullptr;
+
+	std::vector<patricia_node_t*> stack;
+
+	if ( tree->head )
+		stack.push_back(tree->head);
+
+	while ( ! stack.empty() )
+		{
+		auto node = stack.back();
+		stack.pop_back();
+
+		if ( node->l )
+			stack.push_back(node->l);
+		if ( node->r )
+			stack.push_back(node->r);
+
+		if ( ! node->prefix )
+			continue;
+
+		auto bytes = reinterpret_cast<const uint8_t*>(&node->prefix->add.sin6);
+		int width = node->prefix->bitlen;
+
+		if ( ! same_bits(bytes, v4_mapped, std::min(width, 96)) )
+			continue;
+
+		if ( width <= 96 )
+			{
+			if ( ! v4_default || width > v4_default->prefix->bitlen )
+				v4_default = node;
+
+			continue;
+			}
+
+		uint32_t addr;
+		memcpy(&addr, bytes + 12, sizeof(addr));
+		prefixes.push_back({ntohl(addr), width - 96, node->data});
+		}
+
+	if ( v4_default )
+		prefixes.push_back({0, 0, v4_default->data});
+
+	ipv4_index.Build(std::move(prefixes));
+	}
+
 void* PrefixTable::Lookup(const Val* value, bool exact) const
 	{
 	// [elem] -> elem
@@ -129,9 +226,9 @@ void* PrefixTable::Lookup(const Val* value, bool exact) const
 
 void* PrefixTable::Remove(const IPAddr& addr, int width)
 	{
-	prefix_t* prefix = MakePrefix(addr, width);
-	patricia_node_t* node = patricia_search_exact(tree, prefix);
-	Deref_Prefix(prefix);
+	prefix_t prefix;
+	InitPrefix(&prefix, addr, width);
+	patricia_node_t* node = patricia_search_exact(tree, &prefix);
 
 	if ( ! node )
 		return nullptr;
@@ -139,6 +236,9 @@ void* PrefixTable::Remove(const IPAddr& addr, int width)
 	void* old = node->data;
 	patricia_remove(tree, node);
 
+	--num_prefixes;
+	Changed();
+
 	return old;
 	}
 
@@ -5,10 +5,12 @@ extern "C"
 #include "zeek/3rdparty/patricia.h"
 	}
 
+#include <cstddef>
 #include <list>
 #include <tuple>
 
 #include "zeek/IPAddr.h"
+#include "zeek/IPv4PrefixIndex.h"
 
 namespace zeek
 	{
@@ -60,7 +62,12 @@ public:
 	void* Remove(const IPAddr& addr, int width);
 	void* Remove(const Val* value);
 
-	void Clear() { Clear_Patricia(tree, delete_function); }
+	void Clear()
+		{
+		Clear_Patricia(tree, delete_function);
+		num_prefixes = 0;
+		Changed();
+		}
 
 	// Sets a function to call for each node when table is cleared/destroyed.
 	void SetDeleteFunction(data_fn_t del_fn) { delete_function = del_fn; }
@@ -68,12 +75,34 @@ public:
 	iterator InitIterator();
 	void* GetNext(iterator* i);
 
+	// Tables with at least this many prefixes look up IPv4 addresses
+	// through an IPv4PrefixIndex.
+	static constexpr size_t IPV4_INDEX_MIN_PREFIXES = 64;
+
 private:
+	static void InitPrefix(prefix_t* prefix, const IPAddr& addr, int width);
 	static prefix_t* MakePrefix(const IPAddr& addr, int width);
 	static IPPrefix PrefixToIPPrefix(prefix_t* p);
 
+	// Returns true if longest-prefix lookups of IPv4 addresses can go
+	// through the index, building it if it's due.
+	bool UseIPv4Index() const;
+	void BuildIPv4Index() const;
+
+	void Changed()
+		{
+		ipv4_index.Clear();
+		lookups_since_change = 0;
+		}
+
 	patricia_tree_t* tree;
 	data_fn_t delete_function;
+	size_t num_prefixes = 0;
+
+	// The index is only built once there have been as many lookups since
+	// the last change as there are prefixes, so that they pay for it.
+	mutable IPv4PrefixIndex ipv4_index;
+	mutable size_t lookups_since_change = 0;
 	};
 
 	} // namespace detail
@@ -25,10 +25,16 @@ public:
 
 	void MinimizeTime() { time = -HUGE_VAL; }
 
+	// The TimerWheel slot holding the element, or -1 if none. While in a
+	// slot, the offset is the element's position within it.
+	int WheelSlot() const { return wheel_slot; }
+	void SetWheelSlot(int slot) { wheel_slot = slot; }
+
 protected:
 	PQ_Element() = default;
 	double time = 0.0;
 	int offset = -1;
+	int wheel_slot = -1;
 	};
 
 class PriorityQueue
@@ -4,13 +4,17 @@
 
 #include "zeek/zeek-config.h"
 
+#include <algorithm>
 #include <cstdlib>
+#include <cstring>
 #include <utility>
 
 #include "zeek/3rdparty/doctest.h"
 #include "zeek/CCL.h"
 #include "zeek/DFA.h"
 #include "zeek/EquivClass.h"
+#include "zeek/LiteralPrefilter.h"
+#include "zeek/NetVar.h"
 #include "zeek/Reporter.h"
 #include "zeek/ZeekString.h"
 
@@ -244,6 +248,8 @@ bool Specific_RE_Matcher::MatchAll(const u_char* bv, int n)
 		// matched is empty.
 		return n == 0;
 
+	DFA_Lock lock(dfa);
+	dfa->CheckBudget();
 	DFA_State* d = dfa->StartState();
 	d = d->Xtion(ecs[SYM_BOL], dfa);
 
@@ -268,6 +274,8 @@ int Specific_RE_Matcher::Match(const u_char* bv, int n)
 		// An empty pattern matches anything.
 		return 1;
 
+	DFA_Lock lock(dfa);
+	dfa->CheckBudget();
 	DFA_State* d = dfa->StartState();
 
 	d = d->Xtion(ecs[SYM_BOL], dfa);
@@ -295,6 +303,41 @@ int Specific_RE_Matcher::Match(const u_char* bv, int n)
 	return 0;
 	}
 
+void Specific_RE_Matcher::MatchSet(const u_char* bv, int n, std::vector<AcceptIdx>* matches)
+	{
+	matches->clear();
+
+	if ( ! dfa )
+		return;
+
+	DFA_Lock lock(dfa);
+	dfa->CheckBudget();
+	DFA_State* d = dfa->StartState();
+	d = d->Xtion(ecs[SYM_BOL], dfa);
+
+	AcceptingSet found;
+	const AcceptingSet* last = nullptr;
+
+	// As for Match(), accepting right after the start doesn't count.
+	for ( int i = 0; d && i <= n; ++i )
+		{
+		d = d->Xtion(i < n ? ecs[bv[i]] : ecs[SYM_EOL], dfa);
+
+		if ( ! d )
+			break;
+
+		auto ac = d->Accept();
+
+		if ( ac && ac != last )
+			{
+			found.insert(ac->begin(), ac->end());
+			last = ac;
+			}
+		}
+
+	matches->assign(found.begin(), found.end());
+	}
+
 void Specific_RE_Matcher::Dump(FILE* f)
 	{
 	dfa->Dump(f);
@@ -308,14 +351,35 @@ inline void RE_Match_State::AddMatches(const AcceptingSet& as, MatchPos position
 		accepted_matches.insert(am_idx(*it, position));
 	}
 
+RE_Match_State::~RE_Match_State()
+	{
+	DFA_Lock lock(dfa);
+	Unref(current_state);
+	}
+
+void RE_Match_State::Clear()
+	{
+	current_pos = -1;
+
+	DFA_Lock lock(dfa);
+	Unref(current_state);
+	current_state = nullptr;
+	accepted_matches.clear();
+	}
+
 bool RE_Match_State::Match(const u_char* bv, int n, bool bol, bool eol, bool clear)
 	{
+	if ( ! dfa )
+		return false;
+
+	DFA_Lock lock(dfa);
+	dfa->CheckBudget();
+
+	DFA_State* held = current_state;
+
 	if ( current_pos == -1 )
 		{
 		// First call to Match().
-		if ( ! dfa )
-			return false;
-
 		// Initialize state and copy the accepting states of the start
 		// state into the acceptance set.
 		current_state = dfa->StartState();
@@ -329,13 +393,30 @@ bool RE_Match_State::Match(const u_char* bv, int n, bool bol, bool eol, bool cle
 	else if ( clear )
 		current_state = dfa->StartState();
 
-	if ( ! current_state )
-		return false;
-
-	current_pos = 0;
+	else if ( current_state && current_state->Retired() )
+		current_state = dfa->Revive(current_state);
 
 	size_t old_matches = accepted_matches.size();
 
+	if ( current_state )
+		{
+		current_pos = 0;
+		Advance(bv, n, bol, eol);
+		}
+
+	if ( current_state != held )
+		{
+		if ( current_state )
+			Ref(current_state);
+
+		Unref(held);
+		}
+
+	return accepted_matches.size() != old_matches;
+	}
+
+void RE_Match_State::Advance(const u_char* bv, int n, bool bol, bool eol)
+	{
 	int ec;
 	int m = bol ? n + 1 : n;
 	int e = eol ? -1 : 0;
@@ -366,8 +447,6 @@ bool RE_Match_State::Match(const u_char* bv, int n, bool bol, bool eol, bool cle
 
 		current_state = next_state;
 		}
-
-	return accepted_matches.size() != old_matches;
 	}
 
 int Specific_RE_Matcher::LongestMatch(const u_char* bv, int n)
@@ -378,6 +457,8 @@ int Specific_RE_Matcher::LongestMatch(const u_char* bv, int n)
 
 	// Use -1 to indicate no match.
 	int last_accept = -1;
+	DFA_Lock lock(dfa);
+	dfa->CheckBudget();
 	DFA_State* d = dfa->StartState();
 
 	d = d->Xtion(ecs[SYM_BOL], dfa);
@@ -436,6 +517,11 @@ RE_Matcher* RE_Matcher_disjunction(const RE_Matcher* re1, const RE_Matcher* re2)
 
 	} // namespace detail
 
+static char fold_case(char c)
+	{
+	return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+	}
+
 RE_Matcher::RE_Matcher()
 	{
 	re_anywhere = new detail::Specific_RE_Matcher(detail::MATCH_ANYWHERE);
@@ -466,6 +552,7 @@ RE_Matcher::~RE_Matcher()
 
 void RE_Matcher::AddPat(const char* new_pat)
 	{
+	++num_pats;
 	re_anywhere->AddPat(new_pat);
 	re_exact->AddPat(new_pat);
 	}
@@ -488,7 +575,90 @@ void RE_Matcher::MakeSingleLine()
 
 bool RE_Matcher::Compile(bool lazy)
 	{
-	return re_anywhere->Compile(lazy) && re_exact->Compile(lazy);
+	if ( ! re_anywhere->Compile(lazy) || ! re_exact->Compile(lazy) )
+		return false;
+
+	// The DFAs stay around for the pattern texts and for combining the
+	// pattern with others, but plain literals don't need them for matching.
+	is_literal = num_pats == 1 &&
+	             detail::LiteralPrefilter::ParseLiteral(orig_text.c_str(), &literal, &literal_bol,
+	                                                    &literal_eol);
+
+	if ( is_literal && is_case_insensitive )
+		std::transform(literal.begin(), literal.end(), literal.begin(), fold_case);
+
+	return true;
+	}
+
+bool RE_Matcher::MatchExactly(const String* s)
+	{
+	return is_literal ? LiteralMatchExactly(s->Bytes(), s->Len()) : re_exact->MatchAll(s);
+	}
+
+int RE_Matcher::MatchAnywhere(const String* s)
+	{
+	return is_literal ? LiteralMatch(s->Bytes(), s->Len()) : re_anywhere->Match(s);
+	}
+
+int RE_Matcher::MatchPrefix(const String* s)
+	{
+	return is_literal ? LiteralMatchPrefix(s->Bytes(), s->Len()) : re_exact->LongestMatch(s);
+	}
+
+bool RE_Matcher::LiteralEquals(const u_char* s) const
+	{
+	if ( ! is_case_insensitive )
+		return memcmp(s, literal.data(), literal.size()) == 0;
+
+	for ( size_t i = 0; i < literal.size(); ++i )
+		if ( fold_case(s[i]) != literal[i] )
+			return false;
+
+	return true;
+	}
+
+int RE_Matcher::LiteralMatch(const u_char* s, int n) const
+	{
+	int len = literal.size();
+
+	if ( n < len )
+		return 0;
+
+	if ( literal_bol && literal_eol )
+		return n == len && LiteralEquals(s) ? n : 0;
+
+	if ( literal_bol )
+		return LiteralEquals(s) ? len : 0;
+
+	if ( literal_eol )
+		return LiteralEquals(s + n - len) ? n : 0;
+
+	// Like the DFA, report the position just beyond the first occurrence.
+	if ( ! is_case_insensitive )
+		{
+		auto p = static_cast<const u_char*>(memmem(s, n, literal.data(), len));
+		return p ? p - s + len : 0;
+		}
+
+	for ( int i = 0; i + len <= n; ++i )
+		if ( fold_case(s[i]) == literal[0] && LiteralEquals(s + i) )
+			return i + len;
+
+	return 0;
+	}
+
+int RE_Matcher::LiteralMatchPrefix(const u_char* s, int n) const
+	{
+	int len = literal.size();
+
+	if ( n < len || ! LiteralEquals(s) )
+		return -1;
+
+	// Anchored at the end, only the whole data can match.
+	if ( literal_eol )
+		return n == len ? n : -1;
+
+	return len;
 	}
 
 TEST_SUITE("re_matcher")
@@ -594,6 +764,189 @@ TEST_SUITE("re_matcher")
 		CHECK(dj->MatchExactly("def"));
 		delete dj;
 		}
+
+	TEST_CASE("literal patterns")
+		{
+		const char* pats[] = {"GET /", "^GET /", "GET /$", "^GET /$", "a\\.b"};
+		const char* inputs[] = {"",         "GET /",      "GET /x", "xGET /", "get /",
+		                        "GET GET /", "GET /GET /", "a.b",    "xa.bx",  "GET"};
+
+		for ( auto ci : {false, true} )
+			for ( auto pat : pats )
+				{
+				RE_Matcher lit(pat);
+
+				if ( ci )
+					lit.MakeCaseInsensitive();
+
+				lit.Compile();
+				REQUIRE(lit.IsLiteral());
+
+				// The same pattern, but going through the DFAs.
+				RE_Matcher re(lit.PatternText(), lit.AnywherePatternText());
+				re.Compile();
+				REQUIRE_FALSE(re.IsLiteral());
+
+				for ( auto s : inputs )
+					{
+					auto bytes = reinterpret_cast<const u_char*>(s);
+					int n = strlen(s);
+
+					CHECK(lit.MatchExactly(s) == re.MatchExactly(s));
+					CHECK(lit.MatchAnywhere(s) == re.MatchAnywhere(s));
+					CHECK(lit.MatchPrefix(s) == re.MatchPrefix(s));
+					CHECK(lit.MatchPrefix(bytes, n) == re.MatchPrefix(bytes, n));
+					CHECK(lit.Match(bytes, n) == re.Match(bytes, n));
+					}
+				}
+
+		RE_Matcher not_lit("GET /+");
+		not_lit.Compile();
+		CHECK_FALSE(not_lit.IsLiteral());
+
+		RE_Matcher two("GET");
+		two.AddPat("POST");
+		two.Compile();
+		CHECK_FALSE(two.IsLiteral());
+		}
+
+	TEST_CASE("dfa state budget")
+		{
+		detail::Specific_RE_Matcher m(detail::MATCH_EXACTLY, true);
+		string_list set;
+		int_list ids;
+		set.push_back(util::copy_string(".*x[a-z][a-z]y"));
+		ids.push_back(1);
+		REQUIRE(m.CompileSet(set, ids));
+
+		// Every new state exceeds the budget, so the DFA flushes its
+		// cache before each chunk.
+		auto old_limit = detail::dfa_state_memory_limit;
+		detail::dfa_state_memory_limit = 1;
+
+		detail::RE_Match_State state(&m);
+		const char* chunks[] = {"aaaa", "x", "bc", "y"};
+
+		for ( auto c : chunks )
+			state.Match(reinterpret_cast<const u_char*>(c), strlen(c), false, false, false);
+
+		detail::DFA_State_Cache::Stats stats;
+		m.DFA()->Cache()->GetStats(&stats);
+
+		CHECK(stats.flushes > 0);
+		CHECK(state.AcceptedMatches().size() == 1);
+
+		detail::dfa_state_memory_limit = old_limit;
+		delete[] set[0];
+		}
+
+	TEST_CASE("pattern set")
+		{
+		RE_Matcher p1("GET|POST");
+		RE_Matcher p2("[0-9]+$");
+		RE_Matcher p3("^abc");
+		RE_Matcher p4("xyz");
+		p4.MakeCaseInsensitive();
+
+		string_list set;
+		int_list ids;
+
+		for ( auto p : {&p1, &p2, &p3, &p4} )
+			{
+			REQUIRE(p->Compile());
+			set.push_back(util::copy_string(p->AnywherePatternText()));
+			ids.push_back(static_cast<int>(ids.size()) + 1);
+			}
+
+		detail::Specific_RE_Matcher m(detail::MATCH_ANYWHERE);
+		REQUIRE(m.CompileSet(set, ids));
+
+		std::vector<detail::AcceptIdx> matches;
+		auto match_set = [&](const char* s)
+		{
+			m.MatchSet(reinterpret_cast<const u_char*>(s), strlen(s), &matches);
+			return matches;
+		};
+
+		CHECK(match_set("abc POST 123") == std::vector<detail::AcceptIdx>{1, 2, 3});
+		CHECK(match_set("123 abc") == std::vector<detail::AcceptIdx>{});
+		CHECK(match_set("xYz GET") == std::vector<detail::AcceptIdx>{1, 4});
+		CHECK(match_set("") == std::vector<detail::AcceptIdx>{});
+
+		// The same as matching each pattern on its own.
+		for ( auto s : {"abc POST 123", "123 abc", "xYz GET", "", "abcxyz1"} )
+			{
+			match_set(s);
+			int i = 0;
+
+			for ( auto p : {&p1, &p2, &p3, &p4} )
+				{
+				++i;
+				bool in_set = std::find(matches.begin(), matches.end(), i) != matches.end();
+				CHECK(in_set == (p->MatchAnywhere(s) != 0));
+				}
+			}
+
+		for ( auto s : set )
+			delete[] s;
+		}
+
+	TEST_CASE("dfa state cache files")
+		{
+		char dir[] = "/tmp/zeek-dfa-cache-XXXXXX";
+		REQUIRE(mkdtemp(dir));
+		detail::DFA_Machine::UseCacheDirectory(dir);
+
+		string_list set;
+		int_list ids;
+		set.push_back(util::copy_string(".*GET /[a-z]+"));
+		set.push_back(util::copy_string(".*POST"));
+		set.push_back(util::copy_string(".*x[0-9]+y"));
+		ids.push_back(1);
+		ids.push_back(2);
+		ids.push_back(3);
+
+		const char* data = "GET /abc POST x123y";
+		int num_states;
+		size_t num_matches;
+
+			{
+			detail::Specific_RE_Matcher m(detail::MATCH_EXACTLY, true);
+			REQUIRE(m.CompileSet(set, ids));
+			CHECK(m.DFA()->NumStates() == 1);
+
+			detail::RE_Match_State state(&m);
+			state.Match(reinterpret_cast<const u_char*>(data), strlen(data), true, true, false);
+			num_states = m.DFA()->NumStates();
+			num_matches = state.AcceptedMatches().size();
+			REQUIRE(num_states >= 8);
+
+			detail::DFA_Machine::SaveCaches();
+			}
+
+		// The same set comes back with all of its states, and matching
+		// doesn't need to add any.
+		detail::Specific_RE_Matcher m(detail::MATCH_EXACTLY, true);
+		REQUIRE(m.CompileSet(set, ids));
+		CHECK(m.DFA()->NumStates() == num_states);
+
+		detail::RE_Match_State state(&m);
+		state.Match(reinterpret_cast<const u_char*>(data), strlen(data), true, true, false);
+		CHECK(m.DFA()->NumStates() == num_states);
+		CHECK(state.AcceptedMatches().size() == num_matches);
+
+		// Different accept IDs make for a different NFA.
+		ids[2] = 4;
+		detail::Specific_RE_Matcher other(detail::MATCH_EXACTLY, true);
+		REQUIRE(other.CompileSet(set, ids));
+		CHECK(other.DFA()->NumStates() == 1);
+
+		detail::DFA_Machine::UseCacheDirectory("");
+		filesystem::remove_all(dir);
+
+		for ( auto s : set )
+			delete[] s;
+		}
 	}
 
 	} // namespace zeek
@@ -4,9 +4,11 @@
 
 #include <sys/types.h> // for u_char
 #include <cctype>
+#include <cstring>
 #include <map>
 #include <set>
 #include <string>
+#include <vector>
 
 #include "zeek/CCL.h"
 #include "zeek/EquivClass.h"
@@ -117,6 +119,11 @@ public:
 	int LongestMatch(const String* s);
 	int LongestMatch(const u_char* bv, int n);
 
+	// For a set compiled with CompileSet(), returns the indices of all
+	// expressions that match in a single pass, in ascending order. An
+	// expression matches if Match() would find it on its own.
+	void MatchSet(const u_char* bv, int n, std::vector<AcceptIdx>* matches);
+
 	EquivClass* EC() { return &equiv_class; }
 
 	const char* PatternText() const { return pattern_text.c_str(); }
@@ -165,29 +172,38 @@ public:
 		current_state = nullptr;
 		}
 
+	~RE_Match_State();
+
+	RE_Match_State(const RE_Match_State&) = delete;
+	RE_Match_State& operator=(const RE_Match_State&) = delete;
+
 	const AcceptingMatchSet& AcceptedMatches() const { return accepted_matches; }
 
 	// Returns the number of bytes feeded into the matcher so far
 	int Length() { return current_pos; }
 
+	// Returns true if no further input can lead to another match.
+	bool Finished() const { return ! dfa || (current_pos >= 0 && ! current_state); }
+
 	// Returns true if this inputs leads to at least one new match.
 	// If clear is true, starts matching over.
 	bool Match(const u_char* bv, int n, bool bol, bool eol, bool clear);
 
-	void Clear()
-		{
-		current_pos = -1;
-		current_state = nullptr;
-		accepted_matches.clear();
-		}
+	void Clear();
 
 	void AddMatches(const AcceptingSet& as, MatchPos position);
 
 protected:
+	// Feeds data into the current state, which must not be null.
+	void Advance(const u_char* bv, int n, bool bol, bool eol);
+
 	DFA_Machine* dfa;
 	int* ecs;
 
 	AcceptingMatchSet accepted_matches;
+
+	// We hold a reference to this between calls to Match(), as the
+	// machine may drop it from its cache in the meantime.
 	DFA_State* current_state;
 	int current_pos;
 	};
@@ -217,23 +233,45 @@ public:
 	bool Compile(bool lazy = false);
 
 	// Returns true if s exactly matches the pattern, false otherwise.
-	bool MatchExactly(const char* s) { return re_exact->MatchAll(s); }
-	bool MatchExactly(const String* s) { return re_exact->MatchAll(s); }
+	bool MatchExactly(const char* s)
+		{
+		return is_literal ? LiteralMatchExactly(reinterpret_cast<const u_char*>(s), strlen(s))
+		                  : re_exact->MatchAll(s);
+		}
+	bool MatchExactly(const String* s);
 
 	// Returns the position in s just beyond where the first match
 	// occurs, or 0 if there is no such position in s.  Note that
 	// if the pattern matches empty strings, matching continues
 	// in an attempt to match at least one character.
-	int MatchAnywhere(const char* s) { return re_anywhere->Match(s); }
-	int MatchAnywhere(const String* s) { return re_anywhere->Match(s); }
+	int MatchAnywhere(const char* s)
+		{
+		return is_literal ? LiteralMatch(reinterpret_cast<const u_char*>(s), strlen(s))
+		                  : re_anywhere->Match(s);
+		}
+	int MatchAnywhere(const String* s);
 
 	// Note: it matches the *longest* prefix and returns the
 	// length of matched prefix. It returns -1 on mismatch.
-	int MatchPrefix(const char* s) { return re_exact->LongestMatch(s); }
-	int MatchPrefix(const String* s) { return re_exact->LongestMatch(s); }
-	int MatchPrefix(const u_char* s, int n) { return re_exact->LongestMatch(s, n); }
+	int MatchPrefix(const char* s)
+		{
+		return is_literal ? LiteralMatchPrefix(reinterpret_cast<const u_char*>(s), strlen(s))
+		                  : re_exact->LongestMatch(s);
+		}
+	int MatchPrefix(const String* s);
+	int MatchPrefix(const u_char* s, int n)
+		{
+		return is_literal ? LiteralMatchPrefix(s, n) : re_exact->LongestMatch(s, n);
+		}
 
-	bool Match(const u_char* s, int n) { return re_anywhere->Match(s, n); }
+	bool Match(const u_char* s, int n)
+		{
+		return is_literal ? LiteralMatch(s, n) : re_anywhere->Match(s, n);
+		}
+
+	// True if Compile() found the pattern to be a plain literal, which
+	// then gets matched without running the DFAs.
+	bool IsLiteral() const { return is_literal; }
 
 	const char* PatternText() const { return re_exact->PatternText(); }
 	const char* AnywherePatternText() const { return re_anywhere->PatternText(); }
@@ -243,7 +281,24 @@ public:
 	const char* OrigText() const { return orig_text.c_str(); }
 
 protected:
+	// Counterparts of the DFA matching for literal patterns.
+	bool LiteralEquals(const u_char* s) const;
+	bool LiteralMatchExactly(const u_char* s, int n) const
+		{
+		return n == static_cast<int>(literal.size()) && LiteralEquals(s);
+		}
+	int LiteralMatch(const u_char* s, int n) const;
+	int LiteralMatchPrefix(const u_char* s, int n) const;
+
 	std::string orig_text;
+	int num_pats = 0;
+
+	// The literal of a literal pattern, lower-cased if the matcher is
+	// case-insensitive, and whether the pattern is anchored on either end.
+	std::string literal;
+	bool is_literal = false;
+	bool literal_bol = false;
+	bool literal_eol = false;
 
 	detail::Specific_RE_Matcher* re_anywhere;
 	detail::Specific_RE_Matcher* re_exact;
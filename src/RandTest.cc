@@ -25,12 +25,17 @@ static double rt_log2(double x)
 	}
 
 // RT_INCIRC = pow(pow(256.0, (double) (RT_MONTEN / 2)) - 1, 2.0);
-constexpr double RT_INCIRC = 281474943156225.0;
+constexpr uint64_t RT_INCIRC_INT = 281474943156225;
+
+// Number of tables that count_bytes() counts in, and the smallest
+// buffer that's worth zeroing them for.
+constexpr int RT_SPLIT = 4;
+constexpr int RT_SPLIT_MIN = 1024;
 
 namespace zeek::detail
 	{
 
-RandTest::RandTest()
+RandTest::RandTest(bool arg_histogram_only) : histogram_only(arg_histogram_only)
 	{
 	totalc = 0;
 	mp = 0;
@@ -47,51 +52,132 @@ RandTest::RandTest()
 void RandTest::add(const void* buf, int bufl)
 	{
 	const unsigned char* bp = static_cast<const unsigned char*>(buf);
-	int oc;
 
-	while ( bufl-- > 0 )
+	if ( bufl <= 0 )
+		return;
+
+	count_bytes(bp, bufl);
+	totalc += bufl;
+
+	if ( histogram_only )
+		return;
+
+	add_monte_carlo(bp, bufl);
+	add_serial_correlation(bp, bufl);
+	}
+
+void RandTest::count_bytes(const unsigned char* bp, int bufl)
+	{
+	if ( bufl < RT_SPLIT_MIN )
 		{
-		oc = *bp++;
-		ccount[oc]++; /* Update counter for this bin */
-		totalc++;
-
-		/* Update inside / outside circle counts for Monte Carlo
-		   computation of PI */
-		monte[mp++] = oc; /* Save character for Monte Carlo */
-		if ( mp >= RT_MONTEN ) /* Calculate every RT_MONTEN character */
-			{
-			mp = 0;
-			mcount++;
-			montex = 0;
-			montey = 0;
-			for ( int mj = 0; mj < RT_MONTEN / 2; mj++ )
-				{
-				montex = (montex * 256.0) + monte[mj];
-				montey = (montey * 256.0) + monte[(RT_MONTEN / 2) + mj];
-				}
-			if ( montex * montex + montey * montey <= RT_INCIRC )
-				{
-				inmont++;
-				}
-			}
+		for ( int i = 0; i < bufl; i++ )
+			ccount[bp[i]]++;
+
+		return;
+		}
 
-		/* Update calculation of serial correlation coefficient */
-		if ( sccfirst )
+	/* Runs of the same value would make each increment wait for the
+	   previous one to get stored. Spreading consecutive bytes over
+	   separate tables lets the increments overlap. */
+	uint32_t counts[RT_SPLIT][256] = {};
+	int i = 0;
+
+	for ( ; i + RT_SPLIT <= bufl; i += RT_SPLIT )
+		for ( int j = 0; j < RT_SPLIT; j++ )
+			counts[j][bp[i + j]]++;
+
+	for ( ; i < bufl; i++ )
+		counts[0][bp[i]]++;
+
+	for ( int b = 0; b < 256; b++ )
+		{
+		int64_t n = 0;
+
+		for ( int j = 0; j < RT_SPLIT; j++ )
+			n += counts[j][b];
+
+		ccount[b] += n;
+		}
+	}
+
+void RandTest::add_monte_carlo(const unsigned char* bp, int bufl)
+	{
+	/* Update inside / outside circle counts for Monte Carlo
+	   computation of PI, every RT_MONTEN characters. Both
+	   co-ordinates fit into 24 bits, so integers compute the
+	   same as doubles. */
+	auto point = [this](const auto* m)
+	{
+		uint64_t x = 0;
+		uint64_t y = 0;
+
+		for ( int mj = 0; mj < RT_MONTEN / 2; mj++ )
 			{
-			sccfirst = 0;
-			scclast = 0;
-			sccu0 = oc;
+			x = (x << 8) | m[mj];
+			y = (y << 8) | m[(RT_MONTEN / 2) + mj];
 			}
-		else
+
+		mcount++;
+
+		if ( x * x + y * y <= RT_INCIRC_INT )
+			inmont++;
+
+		montex = x;
+		montey = y;
+	};
+
+	int i = 0;
+
+	/* Complete the characters saved from the last buffer. */
+	while ( mp > 0 && i < bufl )
+		{
+		monte[mp++] = bp[i++];
+
+		if ( mp >= RT_MONTEN )
 			{
-			scct1 = scct1 + scclast * oc;
+			mp = 0;
+			point(monte);
 			}
+		}
+
+	for ( ; i + RT_MONTEN <= bufl; i += RT_MONTEN )
+		point(bp + i);
 
-		scct2 = scct2 + oc;
-		scct3 = scct3 + (oc * oc);
-		scclast = oc;
-		oc <<= 1;
+	/* Save the remaining characters for the next buffer. */
+	while ( i < bufl )
+		monte[mp++] = bp[i++];
+	}
+
+void RandTest::add_serial_correlation(const unsigned char* bp, int bufl)
+	{
+	/* Update calculation of serial correlation coefficient. The
+	   sums of products stay integral, so adding integer sums of a
+	   buffer at once gives the same as adding each product. */
+	uint64_t t1 = 0;
+	uint64_t t2 = 0;
+	uint64_t t3 = 0;
+
+	if ( sccfirst )
+		{
+		sccfirst = 0;
+		sccu0 = bp[0];
 		}
+	else
+		t1 = static_cast<uint64_t>(scclast) * bp[0];
+
+	for ( int i = 1; i < bufl; i++ )
+		t1 += static_cast<uint64_t>(bp[i - 1]) * bp[i];
+
+	for ( int i = 0; i < bufl; i++ )
+		{
+		t2 += bp[i];
+		t3 += static_cast<uint64_t>(bp[i]) * bp[i];
+		}
+
+	scct1 = scct1 + t1;
+	scct2 = scct2 + t2;
+	scct3 = scct3 + t3;
+	scclast = bp[bufl - 1];
 	}
 
 void RandTest::end(double* r_ent, double* r_chisq, double* r_mean, double* r_montepicalc,
@@ -142,6 +228,9 @@ void RandTest::end(double* r_ent, double* r_chisq, double* r_mean, double* r_mon
 	   within the circle */
 	montepi = mcount == 0 ? 0 : 4.0 * (((double)inmont) / mcount);
 
+	if ( histogram_only )
+		scc = 0.0;
+
 	/* Return results through arguments */
 	*r_ent = ent;
 	*r_chisq = chisq;
@@ -21,13 +21,27 @@ namespace detail
 class RandTest
 	{
 public:
-	RandTest();
+	/**
+	 * Constructor.
+	 *
+	 * @param histogram_only true to only count bytes, for the entropy,
+	 * chi-square and mean. The Monte Carlo value for pi and the serial
+	 * correlation coefficient then come out as zero.
+	 */
+	explicit RandTest(bool histogram_only = false);
+
 	void add(const void* buf, int bufl);
 	void end(double* r_ent, double* r_chisq, double* r_mean, double* r_montepicalc, double* r_scc);
 
 private:
 	friend class zeek::EntropyVal;
 
+	void count_bytes(const unsigned char* bp, int bufl);
+	void add_monte_carlo(const unsigned char* bp, int bufl);
+	void add_serial_correlation(const unsigned char* bp, int bufl);
+
+	bool histogram_only;
+
 	int64_t ccount[256]; /* Bins to count occurrences of values */
 	int64_t totalc; /* Total bytes counted */
 	int mp;
@@ -5,8 +5,13 @@
 #include "zeek/zeek-config.h"
 
 #include <algorithm>
+#include <vector>
 
+#include "zeek/3rdparty/doctest.h"
 #include "zeek/Desc.h"
+#include "zeek/NetVar.h"
+#include "zeek/RunState.h"
+#include "zeek/telemetry/Manager.h"
 
 using std::min;
 
@@ -15,13 +20,116 @@ namespace zeek
 
 uint64_t Reassembler::total_size = 0;
 uint64_t Reassembler::sizes[REASSEM_NUM];
+Reassembler* Reassembler::holders_head = nullptr;
+Reassembler* Reassembler::holders_tail = nullptr;
+
+namespace
+	{
+
+const char* reassembler_type_name(ReassemblerType rtype)
+	{
+	switch ( rtype )
+		{
+		case REASSEM_TCP:
+			return "tcp";
+		case REASSEM_FRAG:
+			return "frag";
+		case REASSEM_FILE:
+			return "file";
+		default:
+			return "unknown";
+		}
+	}
+
+// Telemetry for the memory the reassemblers hold, by type of reassembler.
+struct ReassemblyMetrics
+	{
+	std::vector<telemetry::IntGauge> buffered;
+	std::vector<telemetry::IntHistogram> peaks;
+	std::vector<telemetry::IntCounter> evictions;
+	std::vector<telemetry::IntCounter> evicted_bytes;
+
+	ReassemblyMetrics()
+		{
+		int64_t peak_bounds[] = {1 << 10, 16 << 10, 64 << 10, 256 << 10,
+		                         1 << 20, 4 << 20,  16 << 20};
+
+		auto buffered_family = telemetry_mgr->GaugeFamily(
+			"zeek", "reassembly-buffered", {"type"}, "Bytes buffered by reassemblers", "bytes");
+		auto peak_family = telemetry_mgr->HistogramFamily(
+			"zeek", "reassembly-peak-buffered", {"type"}, peak_bounds,
+			"Most bytes buffered by individual reassemblers over their lifetime", "bytes");
+		auto evictions_family = telemetry_mgr->CounterFamily(
+			"zeek", "reassembly-evictions", {"type"},
+			"Reassemblers evicted for exceeding the reassembly memory budget", "1", true);
+		auto evicted_family = telemetry_mgr->CounterFamily(
+			"zeek", "reassembly-evicted", {"type"},
+			"Bytes held by reassemblers evicted for exceeding the reassembly memory budget",
+			"bytes", true);
+
+		for ( int i = 0; i < REASSEM_NUM; ++i )
+			{
+			auto name = reassembler_type_name(static_cast<ReassemblerType>(i));
+			buffered.emplace_back(buffered_family.GetOrAdd({{"type", name}}));
+			peaks.emplace_back(peak_family.GetOrAdd({{"type", name}}));
+			evictions.emplace_back(evictions_family.GetOrAdd({{"type", name}}));
+			evicted_bytes.emplace_back(evicted_family.GetOrAdd({{"type", name}}));
+			}
+		}
+	};
+
+ReassemblyMetrics* metrics()
+	{
+	// Reassemblers only start working once the telemetry manager exists.
+	static ReassemblyMetrics* m = telemetry_mgr ? new ReassemblyMetrics() : nullptr;
+	return m;
+	}
+
+	} // namespace
 
 DataBlock::DataBlock(const u_char* data, uint64_t size, uint64_t arg_seq)
 	{
 	seq = arg_seq;
 	upper = seq + size;
-	block = new u_char[size];
-	memcpy(block, data, size);
+
+	// If the data lives in a buffer lent by the packet source, hold a
+	// reference to that instead of copying.
+	auto* pb = run_state::detail::current_pkt_buffer;
+
+	if ( pb && pb->WorthRetaining(data, size) )
+		{
+		buffer = {NewRef{}, pb};
+		block = data;
+		return;
+		}
+
+	block = CopyData(data, size);
+	capacity = size;
+	}
+
+bool DataBlock::Extend(const u_char* data, uint64_t size, uint64_t max_size)
+	{
+	auto new_size = Size() + size;
+
+	if ( buffer || new_size > max_size )
+		return false;
+
+	if ( new_size > capacity )
+		{
+		// Grow geometrically so that a run of small appends doesn't
+		// copy the data over and over.
+		auto new_capacity = std::min(std::max(new_size, 2 * capacity), max_size);
+		auto* grown = static_cast<u_char*>(
+			detail::arena_allocate(detail::ARENA_REASSEMBLY, new_capacity));
+		memcpy(grown, block, Size());
+		detail::arena_free(detail::ARENA_REASSEMBLY, const_cast<u_char*>(block), capacity);
+		block = grown;
+		capacity = new_capacity;
+		}
+
+	memcpy(const_cast<u_char*>(block) + Size(), data, size);
+	upper += size;
+	return true;
 	}
 
 void DataBlockList::DataSize(uint64_t seq_cutoff, uint64_t* below, uint64_t* above) const
@@ -49,12 +157,12 @@ void DataBlockList::Delete(DataBlockMap::const_iterator it)
 	{
 	const auto& b = it->second;
 	auto size = b.Size();
+	auto memory = b.DataMemory();
 
 	block_map.erase(it);
 	total_data_size -= size;
 
-	Reassembler::total_size -= size + sizeof(DataBlock);
-	Reassembler::sizes[reassembler->rtype] -= size + sizeof(DataBlock);
+	reassembler->ReleaseMemory(memory + sizeof(DataBlock));
 	}
 
 DataBlock DataBlockList::Remove(DataBlockMap::const_iterator it)
@@ -70,10 +178,14 @@ DataBlock DataBlockList::Remove(DataBlockMap::const_iterator it)
 
 void DataBlockList::Clear()
 	{
-	auto total_db_size = sizeof(DataBlock) * block_map.size();
-	auto total = total_data_size + total_db_size;
-	Reassembler::total_size -= total;
-	Reassembler::sizes[reassembler->rtype] -= total;
+	uint64_t total = sizeof(DataBlock) * block_map.size();
+
+	for ( const auto& e : block_map )
+		total += e.second.DataMemory();
+
+	if ( total )
+		reassembler->ReleaseMemory(total);
+
 	total_data_size = 0;
 	block_map.clear();
 	}
@@ -109,12 +221,42 @@ DataBlockMap::const_iterator DataBlockList::Insert(uint64_t seq, uint64_t upper,
 	auto rval = block_map.emplace_hint(hint, seq, DataBlock(data, size, seq));
 
 	total_data_size += size;
-	Reassembler::sizes[reassembler->rtype] += size + sizeof(DataBlock);
-	Reassembler::total_size += size + sizeof(DataBlock);
+	reassembler->AddMemory(rval->second.DataMemory() + sizeof(DataBlock));
 
 	return rval;
 	}
 
+bool DataBlockList::ExtendLast(uint64_t seq, uint64_t upper, const u_char* data)
+	{
+	if ( block_map.empty() )
+		return false;
+
+	auto& last = block_map.rbegin()->second;
+
+	if ( last.upper != seq )
+		return false;
+
+	auto size = upper - seq;
+
+	// Data that's cheaper to reference than to copy goes into a block
+	// of its own.
+	auto* pb = run_state::detail::current_pkt_buffer;
+
+	if ( pb && pb->WorthRetaining(data, size) )
+		return false;
+
+	auto old_memory = last.DataMemory();
+
+	if ( ! last.Extend(data, size, Reassembler::MAX_COALESCED_BLOCK_SIZE) )
+		return false;
+
+	total_data_size += size;
+
+	// Growing the block may have reserved room beyond the new data.
+	reassembler->AddMemory(last.DataMemory() - old_memory);
+	return true;
+	}
+
 DataBlockMap::const_iterator DataBlockList::Insert(uint64_t seq, uint64_t upper, const u_char* data,
                                                    DataBlockMap::const_iterator* hint)
 	{
@@ -271,6 +413,122 @@ Reassembler::Reassembler(uint64_t init_seq, ReassemblerType reassem_type)
 	{
 	}
 
+Reassembler::~Reassembler()
+	{
+	// Release the blocks while we can still account for them.
+	ClearBlocks();
+	ClearOldBlocks();
+
+	if ( memory_usage )
+		UnlinkHolder();
+
+	if ( peak_memory_usage )
+		if ( auto* m = metrics() )
+			m->peaks[rtype].Observe(peak_memory_usage);
+	}
+
+void Reassembler::LinkHolder()
+	{
+	prev_holder = holders_tail;
+	next_holder = nullptr;
+
+	if ( holders_tail )
+		holders_tail->next_holder = this;
+	else
+		holders_head = this;
+
+	holders_tail = this;
+	}
+
+void Reassembler::UnlinkHolder()
+	{
+	if ( prev_holder )
+		prev_holder->next_holder = next_holder;
+	else
+		holders_head = next_holder;
+
+	if ( next_holder )
+		next_holder->prev_holder = prev_holder;
+	else
+		holders_tail = prev_holder;
+
+	prev_holder = next_holder = nullptr;
+	}
+
+void Reassembler::AddMemory(uint64_t n)
+	{
+	if ( memory_usage == 0 )
+		LinkHolder();
+
+	total_size += n;
+	sizes[rtype] += n;
+	memory_usage += n;
+
+	if ( memory_usage > peak_memory_usage )
+		peak_memory_usage = memory_usage;
+
+	if ( auto* m = metrics() )
+		m->buffered[rtype].Inc(n);
+	}
+
+void Reassembler::ReleaseMemory(uint64_t n)
+	{
+	total_size -= n;
+	sizes[rtype] -= n;
+	memory_usage -= n;
+
+	if ( memory_usage == 0 )
+		UnlinkHolder();
+
+	if ( auto* m = metrics() )
+		m->buffered[rtype].Dec(n);
+	}
+
+void Reassembler::Evict(bool flush)
+	{
+	ClearBlocks();
+	ClearOldBlocks();
+	}
+
+void Reassembler::EnforceMemoryBudget()
+	{
+	uint64_t budget = zeek::detail::reassembly_memory_budget;
+
+	if ( ! budget || total_size <= budget )
+		return;
+
+	uint64_t target = budget - budget / 8;
+
+	// Evicting a reassembler releases all of its memory, so we need at
+	// most one round through the current holders. Data flushed out of
+	// one may end up in another, though, so don't loop forever.
+	size_t max_evictions = 0;
+
+	for ( auto* r = holders_head; r; r = r->next_holder )
+		++max_evictions;
+
+	while ( total_size > target && holders_head && max_evictions-- > 0 )
+		{
+		Reassembler* victim = holders_head;
+
+		if ( zeek::detail::reassembly_evict_largest )
+			{
+			for ( auto* r = holders_head->next_holder; r; r = r->next_holder )
+				if ( r->memory_usage > victim->memory_usage )
+					victim = r;
+			}
+
+		if ( auto* m = metrics() )
+			{
+			m->evictions[victim->rtype].Inc();
+			m->evicted_bytes[victim->rtype].Inc(victim->memory_usage);
+			}
+
+		// Evicting may delete the reassembler, so don't touch it after.
+		victim->Evict(zeek::detail::reassembly_evict_flush);
+		}
+	}
+
 void Reassembler::CheckOverlap(const DataBlockList& list, uint64_t seq, uint64_t len,
                                const u_char* data)
 	{
@@ -344,8 +602,16 @@ void Reassembler::NewBlock(double t, uint64_t seq, uint64_t len, const u_char* d
 		len -= amount_old;
 		}
 
+	// Data continuing where reassembly left off is ready for delivery
+	// right away. Just append it to the last block if we can.
+	if ( coalesce_in_order && max_old_blocks == 0 && seq == last_reassem_seq &&
+	     block_list.ExtendLast(seq, upper_seq, data) )
+		{
+		BlockExtended(std::prev(block_list.End()), seq);
+		return;
+		}
+
 	auto it = block_list.Insert(seq, upper_seq, data);
-	;
 	BlockInserted(it);
 	}
 
@@ -386,3 +652,95 @@ uint64_t Reassembler::MemoryAllocation(ReassemblerType rtype)
 	}
 
 	} // namespace zeek
+
+using namespace zeek;
+
+namespace
+	{
+
+// Delivers in-order data right away, but keeps the blocks around so
+// that the test can look at them.
+class TestReassembler : public Reassembler
+	{
+public:
+	TestReassembler() : Reassembler(0, REASSEM_TCP) { SetCoalesceInOrder(true); }
+
+	const DataBlockList& Blocks() const { return block_list; }
+
+protected:
+	void BlockInserted(DataBlockMap::const_iterator it) override
+		{
+		if ( it->second.seq == last_reassem_seq )
+			last_reassem_seq = it->second.upper;
+		}
+
+	void BlockExtended(DataBlockMap::const_iterator it, uint64_t seq) override
+		{
+		last_reassem_seq = it->second.upper;
+		}
+
+	void Overlap(const u_char* b1, const u_char* b2, uint64_t n) override { }
+	};
+
+	}
+
+TEST_SUITE_BEGIN("Reassembler");
+
+TEST_CASE("in-order data coalesces up to the maximum block size")
+	{
+	constexpr uint64_t SEGMENT = 1500;
+	std::vector<u_char> data(25 * SEGMENT);
+
+	for ( size_t i = 0; i < data.size(); ++i )
+		data[i] = static_cast<u_char>(i % 251);
+
+	TestReassembler r;
+
+	for ( uint64_t seq = 0; seq < data.size(); seq += SEGMENT )
+		r.NewBlock(0.0, seq, SEGMENT, data.data() + seq);
+
+	// Ten segments fit below the maximum, the eleventh starts a new block.
+	const auto& blocks = r.Blocks();
+	REQUIRE(blocks.NumBlocks() == 3);
+	CHECK(blocks.DataSize() == data.size());
+
+	uint64_t seq = 0;
+
+	for ( auto it = blocks.Begin(); it != blocks.End(); ++it )
+		{
+		const auto& b = it->second;
+		CHECK(b.seq == seq);
+		CHECK(b.Size() <= Reassembler::MAX_COALESCED_BLOCK_SIZE);
+		CHECK(memcmp(b.block, data.data() + b.seq, b.Size()) == 0);
+		seq = b.upper;
+		}
+
+	CHECK(seq == data.size());
+	CHECK(blocks.Begin()->second.Size() == 10 * SEGMENT);
+
+	// Blocks double their room as they grow, up to the maximum: the full
+	// blocks hold 16384 bytes each, the last one 12000.
+	CHECK(r.MemoryUsage() == 2 * 16384 + 12000 + 3 * sizeof(DataBlock));
+
+	r.ClearBlocks();
+	CHECK(r.MemoryUsage() == 0);
+	}
+
+TEST_CASE("data out of order doesn't coalesce")
+	{
+	u_char data[300];
+	memset(data, 'x', sizeof(data));
+
+	TestReassembler r;
+	r.NewBlock(0.0, 200, 100, data + 200);
+	r.NewBlock(0.0, 0, 100, data);
+	r.NewBlock(0.0, 100, 100, data + 100);
+
+	CHECK(r.Blocks().NumBlocks() == 3);
+	CHECK(r.MemoryUsage() == 300 + 3 * sizeof(DataBlock));
+
+	r.ClearBlocks();
+	CHECK(r.MemoryUsage() == 0);
+	}
+
+TEST_SUITE_END();
@@ -8,7 +8,9 @@
 #include <cstring>
 #include <map>
 
+#include "zeek/Arena.h"
 #include "zeek/Obj.h"
+#include "zeek/iosource/PacketBuffer.h"
 
 namespace zeek
 	{
@@ -43,9 +45,9 @@ public:
 		{
 		seq = other.seq;
 		upper = other.upper;
-		auto size = other.Size();
-		block = new u_char[size];
-		memcpy(block, other.block, size);
+		block = other.buffer ? other.block : CopyData(other.block, other.Size());
+		capacity = other.buffer ? 0 : other.Size();
+		buffer = other.buffer;
 		}
 
 	DataBlock(DataBlock&& other)
@@ -53,7 +55,10 @@ public:
 		seq = other.seq;
 		upper = other.upper;
 		block = other.block;
+		capacity = other.capacity;
+		buffer = std::move(other.buffer);
 		other.block = nullptr;
+		other.capacity = 0;
 		}
 
 	DataBlock& operator=(const DataBlock& other)
@@ -63,10 +68,10 @@ public:
 
 		seq = other.seq;
 		upper = other.upper;
-		auto size = other.Size();
-		delete[] block;
-		block = new u_char[size];
-		memcpy(block, other.block, size);
+		FreeData();
+		block = other.buffer ? other.block : CopyData(other.block, other.Size());
+		capacity = other.buffer ? 0 : other.Size();
+		buffer = other.buffer;
 		return *this;
 		}
 
@@ -77,22 +82,65 @@ public:
 
 		seq = other.seq;
 		upper = other.upper;
-		delete[] block;
+		FreeData();
 		block = other.block;
+		capacity = other.capacity;
+		buffer = std::move(other.buffer);
 		other.block = nullptr;
+		other.capacity = 0;
 		return *this;
 		}
 
-	~DataBlock() { delete[] block; }
+	~DataBlock() { FreeData(); }
 
 	/**
 	 * @return length of the data block
 	 */
 	uint64_t Size() const { return upper - seq; }
 
+	/**
+	 * @return the memory the block's data takes up, which for a block
+	 * that grew through Extend() can be more than its size.
+	 */
+	uint64_t DataMemory() const { return buffer ? Size() : capacity; }
+
+	/**
+	 * Appends data directly following the block's current end, growing
+	 * its memory as needed. Only blocks owning their data can grow.
+	 * @param data  the data to append
+	 * @param size  the number of bytes to append
+	 * @param max_size  the size the block must not grow beyond
+	 * @return true if the data was appended, false if the block can't
+	 * take it.
+	 */
+	bool Extend(const u_char* data, uint64_t size, uint64_t max_size);
+
 	uint64_t seq;
 	uint64_t upper;
-	u_char* block;
+	const u_char* block;
+
+	/**
+	 * If set, *block* points into this buffer lent by the packet source
+	 * instead of into memory owned by the block itself.
+	 */
+	iosource::PacketBufferPtr buffer;
+
+private:
+	static const u_char* CopyData(const u_char* data, uint64_t size)
+		{
+		auto* copy = static_cast<u_char*>(detail::arena_allocate(detail::ARENA_REASSEMBLY, size));
+		memcpy(copy, data, size);
+		return copy;
+		}
+
+	void FreeData()
+		{
+		if ( ! buffer )
+			detail::arena_free(detail::ARENA_REASSEMBLY, const_cast<u_char*>(block), capacity);
+		}
+
+	// The number of bytes allocated at *block*, if owned by the block.
+	uint64_t capacity = 0;
 	};
 
 using DataBlockMap = std::map<uint64_t, DataBlock>;
@@ -183,6 +231,17 @@ public:
 	DataBlockMap::const_iterator Insert(uint64_t seq, uint64_t upper, const u_char* data,
 	                                    DataBlockMap::const_iterator* hint = nullptr);
 
+	/**
+	 * Appends data to the last block of the list rather than inserting a
+	 * new one, if the data directly follows that block and the block can
+	 * take it. This saves allocations for in-order data, the common case.
+	 * @param seq  lower sequence number of the data
+	 * @param upper  highest sequence number of the data
+	 * @param data  points to the data
+	 * @return whether the data was appended
+	 */
+	bool ExtendLast(uint64_t seq, uint64_t upper, const u_char* data);
+
 	/**
 	 * Insert a new data block at the end of the list and remove blocks
 	 * from the beginning of the list to keep the list size under a limit.
@@ -247,8 +306,13 @@ private:
 class Reassembler : public Obj
 	{
 public:
+	/**
+	 * The size up to which blocks of in-order data get coalesced.
+	 */
+	static constexpr uint64_t MAX_COALESCED_BLOCK_SIZE = 16 * 1024;
+
 	Reassembler(uint64_t init_seq, ReassemblerType reassem_type = REASSEM_UNKNOWN);
-	~Reassembler() override { }
+	~Reassembler() override;
 
 	void NewBlock(double t, uint64_t seq, uint64_t len, const u_char* data);
 
@@ -281,6 +345,28 @@ public:
 	// Data buffered by type of reassembler.
 	static uint64_t MemoryAllocation(ReassemblerType rtype);
 
+	/**
+	 * @return the memory currently held by this reassembler's blocks,
+	 * including old blocks and per-block overhead.
+	 */
+	uint64_t MemoryUsage() const { return memory_usage; }
+
+	/**
+	 * @return the most memory this reassembler's blocks have held at
+	 * any point.
+	 */
+	uint64_t PeakMemoryUsage() const { return peak_memory_usage; }
+
+	/**
+	 * Evicts reassemblers if all of them together hold more memory than
+	 * the budget set through ``reassembly_memory_budget``, until they're
+	 * back below seven eighths of it. Which reassemblers go first, and
+	 * whether they flush or drop their data, follows
+	 * ``reassembly_evict_largest`` and ``reassembly_evict_flush``. Called
+	 * after processing each packet, when there's no reassembler in use.
+	 */
+	static void EnforceMemoryBudget();
+
 	void SetMaxOldBlocks(uint32_t count) { max_old_blocks = count; }
 
 protected:
@@ -291,17 +377,59 @@ protected:
 	virtual void BlockInserted(DataBlockMap::const_iterator it) = 0;
 	virtual void Overlap(const u_char* b1, const u_char* b2, uint64_t n) = 0;
 
+	/**
+	 * Called instead of BlockInserted() when in-order data got appended
+	 * to the last block, see SetCoalesceInOrder(). Only happens if all
+	 * data up to the block's previous end had been reassembled, so the
+	 * new data at [seq, it->second.upper) is ready for delivery.
+	 */
+	virtual void BlockExtended(DataBlockMap::const_iterator it, uint64_t seq) { }
+
+	/**
+	 * Enables appending data that arrives in order to the last block
+	 * instead of inserting a new block for it. Subclasses enabling this
+	 * must implement BlockExtended().
+	 */
+	void SetCoalesceInOrder(bool enable) { coalesce_in_order = enable; }
+
+	/**
+	 * Called to make the reassembler release all of its memory when the
+	 * reassemblers exceed their memory budget. Subclasses may deliver
+	 * what they can, reporting gaps for the rest, if *flush* is true. The
+	 * reassembler may delete itself. The default implementation just
+	 * discards all blocks.
+	 */
+	virtual void Evict(bool flush);
+
 	void CheckOverlap(const DataBlockList& list, uint64_t seq, uint64_t len, const u_char* data);
 
+	// Accounts for memory added to or released from the block list.
+	void AddMemory(uint64_t n);
+	void ReleaseMemory(uint64_t n);
+
 	DataBlockList block_list;
 	DataBlockList old_block_list;
 
 	uint64_t last_reassem_seq = 0;
 	uint64_t trim_seq = 0; // how far we've trimmed
 	uint32_t max_old_blocks = 0;
+	bool coalesce_in_order = false;
 
 	ReassemblerType rtype = REASSEM_UNKNOWN;
 
+	uint64_t memory_usage = 0;
+	uint64_t peak_memory_usage = 0;
+
+	// Reassemblers currently holding memory, in the order in which they
+	// started doing so.
+	static Reassembler* holders_head;
+	static Reassembler* holders_tail;
+	Reassembler* prev_holder = nullptr;
+	Reassembler* next_holder = nullptr;
+
+	void LinkHolder();
+	void UnlinkHolder();
+
 	static uint64_t total_size;
 	static uint64_t sizes[REASSEM_NUM];
 	};
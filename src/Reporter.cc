@@ -92,6 +92,7 @@ void Reporter::InitOptions()
 
 	init_weird_set(&weird_sampling_whitelist, "Weird::sampling_whitelist");
 	init_weird_set(&weird_sampling_global_list, "Weird::sampling_global_list");
+	UpdateWeirdListFlags();
 	}
 
 void Reporter::Info(const char* fmt, ...)
@@ -264,23 +265,67 @@ void Reporter::WeirdHelper(EventHandlerPtr event, ValPList vl, const char* fmt_n
 	va_end(ap);
 	}
 
-void Reporter::UpdateWeirdStats(const char* name)
+detail::WeirdID Reporter::UpdateWeirdStats(const char* name)
 	{
+	auto id = detail::intern_weird(name);
 	++weird_count;
-	++weird_count_by_type[name];
+	++GetWeirdInfo(id).count;
+	return id;
+	}
+
+Reporter::WeirdInfo& Reporter::GetWeirdInfo(detail::WeirdID id)
+	{
+	if ( id >= weird_info.size() )
+		{
+		auto old_size = weird_info.size();
+		weird_info.resize(detail::num_weird_names());
+
+		for ( auto i = old_size; i < weird_info.size(); ++i )
+			{
+			const auto& name = detail::weird_name(i);
+			weird_info[i].on_whitelist = weird_sampling_whitelist.count(name) > 0;
+			weird_info[i].on_global_list = weird_sampling_global_list.count(name) > 0;
+			}
+		}
+
+	return weird_info[id];
+	}
+
+void Reporter::UpdateWeirdListFlags()
+	{
+	for ( size_t i = 0; i < weird_info.size(); ++i )
+		{
+		const auto& name = detail::weird_name(i);
+		weird_info[i].on_whitelist = weird_sampling_whitelist.count(name) > 0;
+		weird_info[i].on_global_list = weird_sampling_global_list.count(name) > 0;
+		}
+	}
+
+const Reporter::WeirdCountMap& Reporter::GetWeirdsByType() const
+	{
+	for ( size_t i = 0; i < weird_info.size(); ++i )
+		if ( weird_info[i].count )
+			weird_count_by_type[detail::weird_name(i)] = weird_info[i].count;
+
+	return weird_count_by_type;
+	}
+
+bool Reporter::WeirdObserved(EventHandlerPtr event) const
+	{
+	return event || plugin_mgr->HavePluginForHook(plugin::HOOK_REPORTER);
 	}
 
 class NetWeirdTimer final : public detail::Timer
 	{
 public:
-	NetWeirdTimer(double t, const char* name, double timeout)
-		: detail::Timer(t + timeout, detail::TIMER_NET_WEIRD_EXPIRE), weird_name(name)
+	NetWeirdTimer(double t, detail::WeirdID id, double timeout)
+		: detail::Timer(t + timeout, detail::TIMER_NET_WEIRD_EXPIRE), weird_id(id)
 		{
 		}
 
-	void Dispatch(double t, bool is_expire) override { reporter->ResetNetWeird(weird_name); }
+	void Dispatch(double t, bool is_expire) override { reporter->ResetNetWeird(weird_id); }
 
-	std::string weird_name;
+	detail::WeirdID weird_id;
 	};
 
 class FlowWeirdTimer final : public detail::Timer
@@ -318,7 +363,12 @@ public:
 
 void Reporter::ResetNetWeird(const std::string& name)
 	{
-	net_weird_state.erase(name);
+	ResetNetWeird(detail::intern_weird(name));
+	}
+
+void Reporter::ResetNetWeird(detail::WeirdID id)
+	{
+	GetWeirdInfo(id).net_count = 0;
 	}
 
 void Reporter::ResetFlowWeird(const IPAddr& orig, const IPAddr& resp)
@@ -331,26 +381,28 @@ void Reporter::ResetExpiredConnWeird(const ConnTuple& id)
 	expired_conn_weird_state.erase(id);
 	}
 
-Reporter::PermitWeird Reporter::CheckGlobalWeirdLists(const char* name)
+Reporter::PermitWeird Reporter::CheckGlobalWeirdLists(detail::WeirdID id)
 	{
-	if ( WeirdOnSamplingWhiteList(name) )
+	const auto& info = GetWeirdInfo(id);
+
+	if ( info.on_whitelist )
 		return PermitWeird::Allow;
 
-	if ( WeirdOnGlobalList(name) )
-		// We track weirds on the global list through the "net_weird" table.
-		return PermitNetWeird(name) ? PermitWeird::Allow : PermitWeird::Deny;
+	if ( info.on_global_list )
+		// We track weirds on the global list the same as "net" weirds.
+		return PermitNetWeird(id) ? PermitWeird::Allow : PermitWeird::Deny;
 
 	return PermitWeird::Unknown;
 	}
 
-bool Reporter::PermitNetWeird(const char* name)
+bool Reporter::PermitNetWeird(detail::WeirdID id)
 	{
-	auto& count = net_weird_state[name];
+	auto& count = GetWeirdInfo(id).net_count;
 	++count;
 
 	if ( count == 1 )
 		detail::timer_mgr->Add(
-			new NetWeirdTimer(run_state::network_time, name, weird_sampling_duration));
+			new NetWeirdTimer(run_state::network_time, id, weird_sampling_duration));
 
 	if ( count <= weird_sampling_threshold )
 		return true;
@@ -362,7 +414,7 @@ bool Reporter::PermitNetWeird(const char* name)
 		return false;
 	}
 
-bool Reporter::PermitFlowWeird(const char* name, const IPAddr& orig, const IPAddr& resp)
+bool Reporter::PermitFlowWeird(detail::WeirdID id, const IPAddr& orig, const IPAddr& resp)
 	{
 	auto endpoints = std::make_pair(orig, resp);
 	auto& map = flow_weird_state[endpoints];
@@ -371,7 +423,7 @@ bool Reporter::PermitFlowWeird(const char* name, const IPAddr& orig, const IPAdd
 		detail::timer_mgr->Add(
 			new FlowWeirdTimer(run_state::network_time, endpoints, weird_sampling_duration));
 
-	auto& count = map[name];
+	auto& count = map[id].count;
 	++count;
 
 	if ( count <= weird_sampling_threshold )
@@ -384,7 +436,7 @@ bool Reporter::PermitFlowWeird(const char* name, const IPAddr& orig, const IPAdd
 		return false;
 	}
 
-bool Reporter::PermitExpiredConnWeird(const char* name, const RecordVal& conn_id)
+bool Reporter::PermitExpiredConnWeird(detail::WeirdID id, const RecordVal& conn_id)
 	{
 	if ( ! conn_id.HasField("orig_h") || ! conn_id.HasField("resp_h") ||
 	     ! conn_id.HasField("orig_p") || ! conn_id.HasField("resp_p") )
@@ -402,7 +454,7 @@ bool Reporter::PermitExpiredConnWeird(const char* name, const RecordVal& conn_id
 		detail::timer_mgr->Add(new ConnTupleWeirdTimer(
 			run_state::network_time, std::move(conn_tuple), weird_sampling_duration));
 
-	auto& count = map[name];
+	auto& count = map[id].count;
 	++count;
 
 	if ( count <= weird_sampling_threshold )
@@ -418,53 +470,62 @@ bool Reporter::PermitExpiredConnWeird(const char* name, const RecordVal& conn_id
 
 void Reporter::Weird(const char* name, const char* addl, const char* source)
 	{
-	UpdateWeirdStats(name);
+	auto id = UpdateWeirdStats(name);
 
-	if ( ! WeirdOnSamplingWhiteList(name) )
+	if ( ! GetWeirdInfo(id).on_whitelist )
 		{
-		if ( ! PermitNetWeird(name) )
+		if ( ! PermitNetWeird(id) )
 			return;
 		}
 
+	if ( ! WeirdObserved(net_weird) )
+		return;
+
 	WeirdHelper(net_weird, {new StringVal(addl), new StringVal(source)}, "%s", name);
 	}
 
 void Reporter::Weird(file_analysis::File* f, const char* name, const char* addl, const char* source)
 	{
-	UpdateWeirdStats(name);
+	auto id = UpdateWeirdStats(name);
 
-	switch ( CheckGlobalWeirdLists(name) )
+	switch ( CheckGlobalWeirdLists(id) )
 		{
 		case PermitWeird::Allow:
 			break;
 		case PermitWeird::Deny:
 			return;
 		case PermitWeird::Unknown:
-			if ( ! f->PermitWeird(name, weird_sampling_threshold, weird_sampling_rate,
+			if ( ! f->PermitWeird(id, weird_sampling_threshold, weird_sampling_rate,
 			                      weird_sampling_duration) )
 				return;
 		}
 
+	if ( ! WeirdObserved(file_weird) )
+		return;
+
 	WeirdHelper(file_weird, {f->ToVal()->Ref(), new StringVal(addl), new StringVal(source)}, "%s",
 	            name);
 	}
 
 void Reporter::Weird(Connection* conn, const char* name, const char* addl, const char* source)
 	{
-	UpdateWeirdStats(name);
+	auto id = UpdateWeirdStats(name);
 
-	switch ( CheckGlobalWeirdLists(name) )
+	switch ( CheckGlobalWeirdLists(id) )
 		{
 		case PermitWeird::Allow:
 			break;
 		case PermitWeird::Deny:
 			return;
 		case PermitWeird::Unknown:
-			if ( ! conn->PermitWeird(name, weird_sampling_threshold, weird_sampling_rate,
+			if ( ! conn->PermitWeird(id, weird_sampling_threshold, weird_sampling_rate,
 			                         weird_sampling_duration) )
 				return;
 		}
 
+	if ( ! WeirdObserved(conn_weird) )
+		return;
+
 	WeirdHelper(conn_weird, {conn->GetVal()->Ref(), new StringVal(addl), new StringVal(source)},
 	            "%s", name);
 	}
@@ -472,19 +533,22 @@ void Reporter::Weird(Connection* conn, const char* name, const char* addl, const
 void Reporter::Weird(RecordValPtr conn_id, StringValPtr uid, const char* name, const char* addl,
                      const char* source)
 	{
-	UpdateWeirdStats(name);
+	auto id = UpdateWeirdStats(name);
 
-	switch ( CheckGlobalWeirdLists(name) )
+	switch ( CheckGlobalWeirdLists(id) )
 		{
 		case PermitWeird::Allow:
 			break;
 		case PermitWeird::Deny:
 			return;
 		case PermitWeird::Unknown:
-			if ( ! PermitExpiredConnWeird(name, *conn_id) )
+			if ( ! PermitExpiredConnWeird(id, *conn_id) )
 				return;
 		}
 
+	if ( ! WeirdObserved(expired_conn_weird) )
+		return;
+
 	WeirdHelper(expired_conn_weird,
 	            {conn_id.release(), uid.release(), new StringVal(addl), new StringVal(source)},
 	            "%s", name);
@@ -493,19 +557,22 @@ void Reporter::Weird(RecordValPtr conn_id, StringValPtr uid, const char* name, c
 void Reporter::Weird(const IPAddr& orig, const IPAddr& resp, const char* name, const char* addl,
                      const char* source)
 	{
-	UpdateWeirdStats(name);
+	auto id = UpdateWeirdStats(name);
 
-	switch ( CheckGlobalWeirdLists(name) )
+	switch ( CheckGlobalWeirdLists(id) )
 		{
 		case PermitWeird::Allow:
 			break;
 		case PermitWeird::Deny:
 			return;
 		case PermitWeird::Unknown:
-			if ( ! PermitFlowWeird(name, orig, resp) )
+			if ( ! PermitFlowWeird(id, orig, resp) )
 				return;
 		}
 
+	if ( ! WeirdObserved(flow_weird) )
+		return;
+
 	WeirdHelper(flow_weird,
 	            {new AddrVal(orig), new AddrVal(resp), new StringVal(addl), new StringVal(source)},
 	            "%s", name);
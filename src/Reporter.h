@@ -10,7 +10,9 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <utility>
+#include <vector>
 
+#include "zeek/WeirdState.h"
 #include "zeek/ZeekList.h"
 #include "zeek/net_util.h"
 
@@ -70,8 +72,8 @@ public:
 	using IPPair = std::pair<IPAddr, IPAddr>;
 	using ConnTuple = std::tuple<IPAddr, IPAddr, uint32_t, uint32_t, TransportProto>;
 	using WeirdCountMap = std::unordered_map<std::string, uint64_t>;
-	using WeirdFlowMap = std::map<IPPair, WeirdCountMap>;
-	using WeirdConnTupleMap = std::map<ConnTuple, WeirdCountMap>;
+	using WeirdFlowMap = std::map<IPPair, detail::WeirdStateMap>;
+	using WeirdConnTupleMap = std::map<ConnTuple, detail::WeirdStateMap>;
 	using WeirdSet = std::unordered_set<std::string>;
 
 	Reporter(bool abort_on_scripting_errors);
@@ -181,6 +183,7 @@ public:
 	 * Reset/cleanup state tracking for a "net" weird.
 	 */
 	void ResetNetWeird(const std::string& name);
+	void ResetNetWeird(detail::WeirdID id);
 
 	/**
 	 * Reset/cleanup state tracking for a "flow" weird.
@@ -202,7 +205,7 @@ public:
 	 * Return number of weirds generated per weird type/name (counts weirds
 	 * before any rate-limiting occurs).
 	 */
-	const WeirdCountMap& GetWeirdsByType() const { return weird_count_by_type; }
+	const WeirdCountMap& GetWeirdsByType() const;
 
 	/**
 	 * Gets the weird sampling whitelist.
@@ -217,6 +220,7 @@ public:
 	void SetWeirdSamplingWhitelist(WeirdSet weird_sampling_whitelist)
 		{
 		this->weird_sampling_whitelist = std::move(weird_sampling_whitelist);
+		UpdateWeirdListFlags();
 		}
 
 	/**
@@ -232,6 +236,7 @@ public:
 	void SetWeirdSamplingGlobalList(WeirdSet weird_sampling_global_list)
 		{
 		this->weird_sampling_global_list = std::move(weird_sampling_global_list);
+		UpdateWeirdListFlags();
 		}
 
 	/**
@@ -296,18 +301,28 @@ private:
 	void WeirdHelper(EventHandlerPtr event, ValPList vl, const char* fmt_name, ...)
 		__attribute__((format(printf, 4, 5)));
 	;
-	void UpdateWeirdStats(const char* name);
-	inline bool WeirdOnSamplingWhiteList(const char* name)
-		{
-		return weird_sampling_whitelist.find(name) != weird_sampling_whitelist.end();
-		}
-	inline bool WeirdOnGlobalList(const char* name)
+
+	// What's tracked per weird name, indexed by the name's ID.
+	struct WeirdInfo
 		{
-		return weird_sampling_global_list.find(name) != weird_sampling_global_list.end();
-		}
-	bool PermitNetWeird(const char* name);
-	bool PermitFlowWeird(const char* name, const IPAddr& o, const IPAddr& r);
-	bool PermitExpiredConnWeird(const char* name, const RecordVal& conn_id);
+		uint64_t count = 0; // Before any rate-limiting.
+		uint64_t net_count = 0; // For rate-limiting "net" weirds.
+		bool on_whitelist = false;
+		bool on_global_list = false;
+		};
+
+	// Interns a weird's name and counts the weird.
+	detail::WeirdID UpdateWeirdStats(const char* name);
+	WeirdInfo& GetWeirdInfo(detail::WeirdID id);
+	void UpdateWeirdListFlags();
+
+	// Whether anything would see a weird raising the given event. If not,
+	// there's no need to build its arguments.
+	bool WeirdObserved(EventHandlerPtr event) const;
+
+	bool PermitNetWeird(detail::WeirdID id);
+	bool PermitFlowWeird(detail::WeirdID id, const IPAddr& o, const IPAddr& r);
+	bool PermitExpiredConnWeird(detail::WeirdID id, const RecordVal& conn_id);
 
 	enum class PermitWeird
 		{
@@ -315,7 +330,7 @@ private:
 		Deny,
 		Unknown
 		};
-	PermitWeird CheckGlobalWeirdLists(const char* name);
+	PermitWeird CheckGlobalWeirdLists(detail::WeirdID id);
 
 	bool EmitToStderr(bool flag);
 
@@ -330,8 +345,8 @@ private:
 	std::list<std::pair<const detail::Location*, const detail::Location*>> locations;
 
 	uint64_t weird_count;
-	WeirdCountMap weird_count_by_type;
-	WeirdCountMap net_weird_state;
+	std::vector<WeirdInfo> weird_info;
+	mutable WeirdCountMap weird_count_by_type; // Filled from weird_info on request.
 	WeirdFlowMap flow_weird_state;
 	WeirdConnTupleMap expired_conn_weird_state;
 
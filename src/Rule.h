@@ -13,6 +13,7 @@ namespace zeek::detail
 
 class RuleCondition;
 class RuleAction;
+class RuleEndpointState;
 class RuleHdrTest;
 class RuleMatcher;
 class Rule;
@@ -68,6 +69,7 @@ public:
 
 private:
 	friend class RuleMatcher;
+	friend class RuleEndpointState;
 
 	void SortHdrTests();
 
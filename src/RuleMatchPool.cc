@@ -0,0 +1,255 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/RuleMatchPool.h"
+
+#include <algorithm>
+
+#include "zeek/DFA.h"
+#include "zeek/NetVar.h"
+#include "zeek/Reporter.h"
+#include "zeek/RuleMatcher.h"
+#include "zeek/iosource/Manager.h"
+#include "zeek/threading/Manager.h"
+#include "zeek/util.h"
+
+namespace zeek::detail
+	{
+
+namespace
+	{
+
+// How much data may be waiting for a thread before the main thread holds
+// off delivering more.
+constexpr size_t MAX_PENDING = 4 * 1024 * 1024;
+
+RuleMatchPool* the_pool = nullptr;
+bool pool_checked = false;
+
+	} // namespace
+
+RuleMatchPool* RuleMatchPool::Get()
+	{
+	if ( ! pool_checked )
+		{
+		pool_checked = true;
+
+		if ( sig_match_threads > 0 )
+			the_pool = new RuleMatchPool(sig_match_threads);
+		}
+
+	return the_pool;
+	}
+
+RuleMatchPool::RuleMatchPool(int num_threads)
+	{
+	// From now on, the main thread and the pool's share the DFAs.
+	DFA_Machine::EnableLocking();
+
+	for ( int i = 0; i < std::max(num_threads, 1); ++i )
+		{
+		auto t = std::make_unique<Thread>();
+		t->thread = std::thread(&RuleMatchPool::Work, this, t.get());
+		thread_mgr->ApplyAffinity(t->thread, "sig-match", "sig-match");
+		threads.push_back(std::move(t));
+		}
+
+	iosource_mgr->Register(this, true);
+
+	if ( ! iosource_mgr->RegisterFd(flare.FD(), this) )
+		reporter->FatalError("Failed to register signature matching flare with iosource_mgr");
+	}
+
+RuleMatchPool::~RuleMatchPool()
+	{
+		{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+		}
+
+	for ( auto& t : threads )
+		t->work_cond.notify_all();
+
+	for ( auto& t : threads )
+		t->thread.join();
+
+	if ( the_pool == this )
+		the_pool = nullptr;
+	}
+
+std::unique_ptr<RuleMatchPool::Job> RuleMatchPool::NewJob(RuleEndpointState* state,
+                                                          const Job* opposite)
+	{
+	size_t t;
+
+	if ( opposite )
+		t = opposite->thread;
+	else
+		{
+		t = next_thread;
+		next_thread = (next_thread + 1) % threads.size();
+		}
+
+	return std::make_unique<Job>(state, t);
+	}
+
+void RuleMatchPool::Feed(Job* job, Rule::PatternType type, const u_char* data, int data_len,
+                         bool bol, bool eol, bool clear)
+	{
+	auto* t = threads[job->thread].get();
+	std::unique_lock<std::mutex> lock(mutex);
+
+	if ( t->bytes >= MAX_PENDING )
+		done_cond.wait(lock, [t] { return t->bytes < MAX_PENDING; });
+
+	Chunk c;
+	c.job = job;
+	c.type = type;
+	c.data.assign(reinterpret_cast<const char*>(data), data_len);
+	c.bol = bol;
+	c.eol = eol;
+	c.clear = clear;
+
+	t->bytes += c.data.size();
+	t->chunks.push_back(std::move(c));
+	++job->queued;
+
+	lock.unlock();
+	t->work_cond.notify_one();
+	}
+
+void RuleMatchPool::Finish(Job* job)
+	{
+	std::deque<Result> results;
+
+		{
+		std::unique_lock<std::mutex> lock(mutex);
+		done_cond.wait(lock, [job] { return job->queued == 0; });
+
+		if ( job->results == 0 )
+			return;
+
+		// Take the job's results out of order, the others stay.
+		for ( auto it = done.begin(); it != done.end(); )
+			{
+			if ( it->job != job )
+				{
+				++it;
+				continue;
+				}
+
+			results.push_back(std::move(*it));
+			it = done.erase(it);
+			}
+
+		job->results = 0;
+		}
+
+	for ( auto& r : results )
+		Execute(&r);
+	}
+
+void RuleMatchPool::Cancel(Job* job)
+	{
+	auto* t = threads[job->thread].get();
+	std::unique_lock<std::mutex> lock(mutex);
+
+	for ( auto it = t->chunks.begin(); it != t->chunks.end(); )
+		{
+		if ( it->job != job )
+			{
+			++it;
+			continue;
+			}
+
+		t->bytes -= it->data.size();
+		--job->queued;
+		it = t->chunks.erase(it);
+		}
+
+	done_cond.wait(lock, [job] { return job->queued == 0; });
+
+	done.erase(std::remove_if(done.begin(), done.end(), [job](const Result& r)
+	                          { return r.job == job; }),
+	           done.end());
+
+	job->results = 0;
+	}
+
+bool RuleMatchPool::Exhausted(const Job* job)
+	{
+	std::lock_guard<std::mutex> lock(mutex);
+	return job->queued == 0 && job->results == 0 && job->exhausted;
+	}
+
+void RuleMatchPool::Work(Thread* t)
+	{
+	util::detail::set_thread_name("zk/sig-match");
+
+	for ( ;; )
+		{
+		Chunk c;
+
+			{
+			std::unique_lock<std::mutex> lock(mutex);
+			t->work_cond.wait(lock, [this, t] { return stopping || ! t->chunks.empty(); });
+
+			if ( stopping )
+				return;
+
+			c = std::move(t->chunks.front());
+			t->chunks.pop_front();
+			t->bytes -= c.data.size();
+			}
+
+		// Nobody else touches the job's matchers while it has chunks
+		// queued.
+		Result r;
+		bool matched = rule_matcher->MatchPatterns(
+			c.job->state, c.type, reinterpret_cast<const u_char*>(c.data.data()), c.data.size(),
+			c.bol, c.eol, c.clear, true, &r.accepted);
+		bool exhausted = c.job->state->MatchersFinished(true);
+
+			{
+			std::lock_guard<std::mutex> lock(mutex);
+			c.job->exhausted = exhausted;
+
+			if ( matched )
+				{
+				r.job = c.job;
+				r.data = std::move(c.data);
+				++c.job->results;
+				done.push_back(std::move(r));
+				flare.Fire();
+				}
+
+			--c.job->queued;
+			}
+
+		done_cond.notify_all();
+		}
+	}
+
+void RuleMatchPool::Execute(Result* r)
+	{
+	rule_matcher->ExecMatches(r->job->state, r->accepted,
+	                          reinterpret_cast<const u_char*>(r->data.data()), r->data.size());
+	}
+
+void RuleMatchPool::Process()
+	{
+	std::deque<Result> results;
+
+		{
+		std::lock_guard<std::mutex> lock(mutex);
+		flare.Extinguish();
+		results.swap(done);
+
+		for ( auto& r : results )
+			--r.job->results;
+		}
+
+	for ( auto& r : results )
+		Execute(&r);
+	}
+
+	} // namespace zeek::detail
@@ -0,0 +1,161 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <sys/types.h>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "zeek/Flare.h"
+#include "zeek/RE.h"
+#include "zeek/Rule.h"
+#include "zeek/iosource/IOSource.h"
+
+namespace zeek::detail
+	{
+
+class RuleEndpointState;
+
+/**
+ * Matches the patterns of signatures that only raise events on a fixed
+ * number of threads rather than on the main thread, see sig_match_threads.
+ * RuleMatcher hands each chunk of an endpoint's data to the endpoint's
+ * job, whose thread feeds it into the endpoint's asynchronous matchers.
+ * Both endpoints of a connection share a thread, so their chunks get
+ * matched in the order they arrived. When a chunk completes patterns, the
+ * main thread takes it from there on its next pass over the IO sources,
+ * checking the rules' other conditions and executing their actions.
+ *
+ * The pool registers itself with the iosource manager, which owns it.
+ */
+class RuleMatchPool : public iosource::IOSource
+	{
+public:
+	/**
+	 * The asynchronous matching of one endpoint. Owned by its
+	 * RuleEndpointState.
+	 */
+	struct Job
+		{
+		Job(RuleEndpointState* arg_state, size_t arg_thread)
+			: state(arg_state), thread(arg_thread)
+			{
+			}
+
+		RuleEndpointState* state;
+		size_t thread;
+
+		// Guarded by the pool's mutex.
+		size_t queued = 0; // Chunks waiting for or being matched.
+		size_t results = 0; // Chunks with matches not executed yet.
+		bool exhausted = false; // See RuleEndpointState::Exhausted().
+		};
+
+	/**
+	 * Returns the pool, creating it on first use, or null if
+	 * sig_match_threads is zero or the pool is gone already.
+	 */
+	static RuleMatchPool* Get();
+
+	/**
+	 * Constructor.
+	 *
+	 * @param threads The number of matcher threads, at least one.
+	 */
+	explicit RuleMatchPool(int threads);
+
+	/**
+	 * Destructor. Drops the chunks still queued and the matches not
+	 * executed yet.
+	 */
+	~RuleMatchPool() override;
+
+	/**
+	 * Creates the job for an endpoint.
+	 *
+	 * @param state The endpoint.
+	 *
+	 * @param opposite The job of the connection's other endpoint, if
+	 * there's one, so that both go to the same thread.
+	 */
+	std::unique_ptr<Job> NewJob(RuleEndpointState* state, const Job* opposite);
+
+	/**
+	 * Queues a chunk of data for the job's matchers, see
+	 * RuleMatcher::Match(). If the job's thread has too much queued
+	 * already, waits for it to catch up.
+	 */
+	void Feed(Job* job, Rule::PatternType type, const u_char* data, int data_len, bool bol,
+	          bool eol, bool clear);
+
+	/**
+	 * Waits until all of a job's chunks have been matched, and executes
+	 * the rules they completed right away. Afterwards the caller may use
+	 * the job's matchers itself until it queues the next chunk.
+	 */
+	void Finish(Job* job);
+
+	/**
+	 * Drops a job's queued chunks and pending matches, and waits until
+	 * its thread doesn't use the endpoint anymore.
+	 */
+	void Cancel(Job* job);
+
+	/**
+	 * Returns true if none of the job's matchers can match anything
+	 * anymore and all of its matches have been executed.
+	 */
+	bool Exhausted(const Job* job);
+
+	// IOSource interface.
+	double GetNextTimeout() override { return -1; }
+	void Process() override;
+	const char* Tag() override { return "RuleMatchPool"; }
+
+private:
+	struct Chunk
+		{
+		Job* job;
+		Rule::PatternType type;
+		std::string data;
+		bool bol;
+		bool eol;
+		bool clear;
+		};
+
+	struct Result
+		{
+		Job* job;
+		std::string data;
+		AcceptingMatchSet accepted;
+		};
+
+	struct Thread
+		{
+		std::deque<Chunk> chunks;
+		size_t bytes = 0;
+		std::condition_variable work_cond;
+		std::thread thread;
+		};
+
+	void Work(Thread* t);
+
+	// Executes the rules that a chunk's matches completed.
+	void Execute(Result* r);
+
+	std::mutex mutex;
+	std::condition_variable done_cond;
+	std::vector<std::unique_ptr<Thread>> threads;
+	std::deque<Result> done;
+	size_t next_thread = 0;
+	bool stopping = false;
+	Flare flare;
+	};
+
+	} // namespace zeek::detail
@@ -14,10 +14,12 @@
 #include "zeek/IPAddr.h"
 #include "zeek/IntSet.h"
 #include "zeek/IntrusivePtr.h"
+#include "zeek/LiteralPrefilter.h"
 #include "zeek/NetVar.h"
 #include "zeek/Reporter.h"
 #include "zeek/RuleAction.h"
 #include "zeek/RuleCondition.h"
+#include "zeek/RuleMatchPool.h"
 #include "zeek/RunState.h"
 #include "zeek/Scope.h"
 #include "zeek/Var.h"
@@ -149,6 +151,9 @@ RuleHdrTest::~RuleHdrTest()
 			delete pset->re;
 			delete pset;
 			}
+
+		delete prefilters[i];
+		delete async_prefilters[i];
 		}
 
 	delete ruleset;
@@ -199,10 +204,20 @@ RuleEndpointState::RuleEndpointState(analyzer::Analyzer* arg_analyzer, bool arg_
 		opposite->opposite = this;
 
 	pia = arg_PIA;
+
+	prefilter_stats.scans = 0;
+	prefilter_stats.hits = 0;
+	prefilter_stats.skipped = 0;
 	}
 
 RuleEndpointState::~RuleEndpointState()
 	{
+	if ( job )
+		{
+		if ( auto* pool = RuleMatchPool::Get() )
+			pool->Cancel(job.get());
+		}
+
 	for ( auto matcher : matchers )
 		{
 		delete matcher->state;
@@ -213,6 +228,77 @@ RuleEndpointState::~RuleEndpointState()
 		delete text;
 	}
 
+void RuleEndpointState::ResetPrefilter(Prefilter* pf)
+	{
+	pf->num_waiting = 0;
+	pf->tail.clear();
+
+	for ( size_t i = 0; i < pf->matchers.size(); ++i )
+		{
+		auto* m = pf->matchers[i];
+
+		if ( ! m )
+			{
+			pf->waiting[i] = false;
+			continue;
+			}
+
+		m->waiting = m->prefiltered;
+		m->restart = false;
+		pf->waiting[i] = m->waiting;
+
+		if ( m->waiting )
+			++pf->num_waiting;
+		}
+	}
+
+bool RuleEndpointState::MatchersFinished(bool async) const
+	{
+	for ( const auto& m : matchers )
+		{
+		if ( m->async != async )
+			continue;
+
+		if ( m->waiting || m->restart || ! m->state->Finished() )
+			return false;
+		}
+
+	return true;
+	}
+
+bool RuleEndpointState::Exhausted() const
+	{
+	if ( ! MatchersFinished(false) )
+		return false;
+
+	if ( job )
+		{
+		auto* pool = RuleMatchPool::Get();
+
+		if ( pool && ! pool->Exhausted(job.get()) )
+			return false;
+		}
+
+	// Rules whose conditions didn't hold yet may still fire at the end
+	// of the connection.
+	for ( const auto& r : matched_by_patterns )
+		{
+		if ( ! is_member_of(matched_rules, r->Index()) )
+			return false;
+		}
+
+	for ( const auto& h : hdr_tests )
+		{
+		for ( Rule* r = h->pure_rules; r; r = r->next )
+			{
+			if ( ! is_member_of(matched_rules, r->Index()) )
+				return false;
+			}
+		}
+
+	return true;
+	}
+
 RuleFileMagicState::~RuleFileMagicState()
 	{
 	for ( auto matcher : matchers )
@@ -228,6 +314,8 @@ RuleMatcher::RuleMatcher(int arg_RE_level)
 	RE_level = arg_RE_level;
 	parse_error = false;
 	has_non_file_magic_rule = false;
+	prefilter_scans = 0;
+	prefilter_hits = 0;
 	}
 
 RuleMatcher::~RuleMatcher()
@@ -472,7 +560,7 @@ void RuleMatcher::BuildRegEx(RuleHdrTest* hdr_test, string_list* exprs, int_list
 		{
 		for ( int i = 0; i < Rule::TYPES; ++i )
 			if ( exprs[i].length() )
-				BuildPatternSets(&hdr_test->psets[i], exprs[i], ids[i]);
+				BuildPatternSets(hdr_test, (Rule::PatternType)i, exprs[i], ids[i]);
 		}
 
 	// Get the patterns on all of our children.
@@ -499,43 +587,151 @@ void RuleMatcher::BuildRegEx(RuleHdrTest* hdr_test, string_list* exprs, int_list
 		{
 		for ( int i = 0; i < Rule::TYPES; ++i )
 			if ( exprs[i].length() )
-				BuildPatternSets(&hdr_test->psets[i], exprs[i], ids[i]);
+				BuildPatternSets(hdr_test, (Rule::PatternType)i, exprs[i], ids[i]);
 		}
 
 	// If we're below the RE_level, the regexprs remains empty.
 	}
 
-void RuleMatcher::BuildPatternSets(RuleHdrTest::pattern_set_list* dst, const string_list& exprs,
-                                   const int_list& ids)
+void RuleMatcher::BuildPatternSets(RuleHdrTest* hdr_test, Rule::PatternType type,
+                                   const string_list& exprs, const int_list& ids)
 	{
-	assert(static_cast<size_t>(exprs.length()) == ids.size());
-
-	// We build groups of at most sig_max_group_size regexps.
+	if ( sig_match_threads == 0 || type == Rule::FILE_MAGIC )
+		{
+		BuildPatternSets(hdr_test, type, exprs, ids, false);
+		return;
+		}
 
-	string_list group_exprs;
-	int_list group_ids;
+	// Patterns of rules that only raise events get matched on the
+	// RuleMatchPool, in sets of their own.
+	string_list sync_exprs;
+	int_list sync_ids;
+	string_list async_exprs;
+	int_list async_ids;
 
-	for ( int i = 0; i < exprs.length() + 1 /* sic! */; i++ )
+	for ( int i = 0; i < exprs.length(); ++i )
 		{
-		if ( i < exprs.length() )
+		if ( MatchesAsync(Rule::rule_table[ids[i] - 1]) )
+			{
+			async_exprs.push_back(exprs[i]);
+			async_ids.push_back(ids[i]);
+			}
+		else
 			{
-			group_exprs.push_back(exprs[i]);
-			group_ids.push_back(ids[i]);
+			sync_exprs.push_back(exprs[i]);
+			sync_ids.push_back(ids[i]);
 			}
+		}
+
+	if ( sync_exprs.length() )
+		BuildPatternSets(hdr_test, type, sync_exprs, sync_ids, false);
+
+	if ( async_exprs.length() )
+		BuildPatternSets(hdr_test, type, async_exprs, async_ids, true);
+	}
+
+bool RuleMatcher::MatchesAsync(const Rule* r)
+	{
+	if ( ! r->dependents.empty() || ! r->preconds.empty() )
+		return false;
 
-		if ( group_exprs.length() > sig_max_group_size || i == exprs.length() )
+	for ( const auto& action : r->actions )
+		{
+		if ( ! dynamic_cast<const RuleActionEvent*>(action) )
+			return false;
+		}
+
+	return true;
+	}
+
+void RuleMatcher::BuildPatternSets(RuleHdrTest* hdr_test, Rule::PatternType type,
+                                   const string_list& exprs, const int_list& ids, bool async)
+	{
+	assert(static_cast<size_t>(exprs.length()) == ids.size());
+
+	RuleHdrTest::pattern_set_list* dst = &hdr_test->psets[type];
+	LiteralPrefilter*& prefilter = async ? hdr_test->async_prefilters[type]
+	                                     : hdr_test->prefilters[type];
+
+	// Patterns that may match anywhere but always start with the same
+	// literal go into groups of their own, whose DFAs only need to run
+	// once one of the literals shows up in the data. File magic gets
+	// matched all at once, leave it alone.
+	string_list plain_exprs;
+	int_list plain_ids;
+	string_list literal_exprs;
+	int_list literal_ids;
+	std::vector<std::string> literals;
+
+	for ( int i = 0; i < exprs.length(); ++i )
+		{
+		std::string literal;
+
+		if ( sig_literal_prefilter && type != Rule::FILE_MAGIC &&
+		     LiteralPrefilter::ExtractLiteral(exprs[i], &literal) )
+			{
+			literal_exprs.push_back(exprs[i]);
+			literal_ids.push_back(ids[i]);
+			literals.push_back(std::move(literal));
+			}
+		else
 			{
-			RuleHdrTest::PatternSet* set = new RuleHdrTest::PatternSet;
-			set->re = new Specific_RE_Matcher(MATCH_EXACTLY, true);
-			set->re->CompileSet(group_exprs, group_ids);
-			set->patterns = group_exprs;
-			set->ids = group_ids;
-			dst->push_back(set);
-
-			group_exprs.clear();
-			group_ids.clear();
+			plain_exprs.push_back(exprs[i]);
+			plain_ids.push_back(ids[i]);
 			}
 		}
+
+	// We build groups of at most sig_max_group_size regexps.
+	auto build_groups = [&](const string_list& set_exprs, const int_list& set_ids, bool prefiltered)
+	{
+		string_list group_exprs;
+		int_list group_ids;
+		int group_start = 0;
+
+		for ( int i = 0; i < set_exprs.length() + 1 /* sic! */; i++ )
+			{
+			if ( i < set_exprs.length() )
+				{
+				group_exprs.push_back(set_exprs[i]);
+				group_ids.push_back(set_ids[i]);
+				}
+
+			if ( group_exprs.length() > sig_max_group_size || i == set_exprs.length() )
+				{
+				if ( prefiltered && group_exprs.empty() )
+					break;
+
+				RuleHdrTest::PatternSet* set = new RuleHdrTest::PatternSet;
+				set->re = new Specific_RE_Matcher(MATCH_EXACTLY, true);
+				set->re->CompileSet(group_exprs, group_ids);
+				set->patterns = group_exprs;
+				set->ids = group_ids;
+				set->prefiltered = prefiltered;
+				set->async = async;
+
+				if ( prefiltered )
+					{
+					if ( ! prefilter )
+						prefilter = new LiteralPrefilter;
+
+					for ( int j = 0; j < group_exprs.length(); ++j )
+						prefilter->Add(literals[group_start + j], dst->length());
+					}
+
+				dst->push_back(set);
+
+				group_start = i + 1;
+				group_exprs.clear();
+				group_ids.clear();
+				}
+			}
+	};
+
+	if ( plain_exprs.length() )
+		build_groups(plain_exprs, plain_ids, false);
+
+	if ( literal_exprs.length() )
+		build_groups(literal_exprs, literal_ids, true);
 	}
 
 // Get a 8/16/32-bit value from the given position in the packet header
@@ -759,7 +955,34 @@ RuleMatcher::MIME_Matches* RuleMatcher::Match(RuleFileMagicState* state, const u
 		return rval;
 
 	DBG_LOG(DBG_RULES, "New pattern match found");
+	AddMIMEMatches(state, rval);
+
+	return rval;
+	}
 
+bool RuleMatcher::MatchMore(RuleFileMagicState* state, const u_char* data, uint64_t len,
+                            bool first, MIME_Matches* rval) const
+	{
+	bool newmatch = false;
+	bool finished = true;
+
+	for ( const auto& m : state->matchers )
+		{
+		if ( m->state->Match(data, len, first, false, first) )
+			newmatch = true;
+
+		if ( ! m->state->Finished() )
+			finished = false;
+		}
+
+	if ( newmatch )
+		AddMIMEMatches(state, rval);
+
+	return finished;
+	}
+
+void RuleMatcher::AddMIMEMatches(const RuleFileMagicState* state, MIME_Matches* rval)
+	{
 	AcceptingMatchSet accepted_matches;
 
 	for ( const auto& m : state->matchers )
@@ -798,8 +1021,6 @@ RuleMatcher::MIME_Matches* RuleMatcher::Match(RuleFileMagicState* state, const u
 			ss.insert(ram->GetMIME());
 			}
 		}
-
-	return rval;
 	}
 
 RuleEndpointState* RuleMatcher::InitEndpoint(analyzer::Analyzer* analyzer, const IP_Hdr* ip,
@@ -835,6 +1056,16 @@ RuleEndpointState* RuleMatcher::InitEndpoint(analyzer::Analyzer* analyzer, const
 			{
 			for ( int i = Rule::PAYLOAD; i < Rule::TYPES; ++i )
 				{
+				RuleEndpointState::Prefilter pf;
+				pf.literals = hdr_test->prefilters[i];
+				pf.type = (Rule::PatternType)i;
+				pf.async = false;
+
+				RuleEndpointState::Prefilter async_pf;
+				async_pf.literals = hdr_test->async_prefilters[i];
+				async_pf.type = (Rule::PatternType)i;
+				async_pf.async = true;
+
 				for ( const auto& set : hdr_test->psets[i] )
 					{
 					assert(set->re);
@@ -842,7 +1073,32 @@ RuleEndpointState* RuleMatcher::InitEndpoint(analyzer::Analyzer* analyzer, const
 					auto* m = new RuleEndpointState::Matcher;
 					m->state = new RE_Match_State(set->re);
 					m->type = (Rule::PatternType)i;
+					m->prefiltered = set->prefiltered;
+					m->async = set->async;
 					state->matchers.push_back(m);
+
+					if ( pf.literals )
+						pf.matchers.push_back(m->async ? nullptr : m);
+
+					if ( async_pf.literals )
+						async_pf.matchers.push_back(m->async ? m : nullptr);
+
+					if ( m->async && ! state->job )
+						{
+						if ( auto* pool = RuleMatchPool::Get() )
+							state->job = pool->NewJob(state,
+							                          opposite ? opposite->job.get() : nullptr);
+						}
+					}
+
+				for ( auto* p : {&pf, &async_pf} )
+					{
+					if ( ! p->literals )
+						continue;
+
+					p->waiting.resize(p->matchers.size());
+					state->ResetPrefilter(p);
+					state->prefilters.push_back(std::move(*p));
 					}
 				}
 			}
@@ -929,8 +1185,6 @@ void RuleMatcher::Match(RuleEndpointState* state, Rule::PatternType type, const
 	// for 'accepted' (that depends on the average number of matching
 	// patterns).
 
-	bool newmatch = false;
-
 #ifdef DEBUG
 	if ( debug_logger.IsEnabled(DBG_RULES) )
 		{
@@ -953,27 +1207,62 @@ void RuleMatcher::Match(RuleEndpointState* state, Rule::PatternType type, const
 			state->payload_size = 0;
 		}
 
+	// The pool's threads take care of the async matchers, in order.
+	if ( state->job )
+		{
+		if ( auto* pool = RuleMatchPool::Get() )
+			pool->Feed(state->job.get(), type, data, data_len, bol, eol, clear);
+		}
+
+	AcceptingMatchSet accepted_matches;
+
+	if ( MatchPatterns(state, type, data, data_len, bol, eol, clear, false, &accepted_matches) )
+		ExecMatches(state, accepted_matches, data, data_len);
+	}
+
+bool RuleMatcher::MatchPatterns(RuleEndpointState* state, Rule::PatternType type,
+                                const u_char* data, int data_len, bool bol, bool eol, bool clear,
+                                bool async, AcceptingMatchSet* accepted)
+	{
+	bool newmatch = false;
+
+	if ( ! state->prefilters.empty() )
+		RunPrefilters(state, type, data, data_len, clear, async);
+
 	// Feed data into all relevant matchers.
 	for ( const auto& m : state->matchers )
 		{
-		if ( m->type == type && m->state->Match((const u_char*)data, data_len, bol, eol, clear) )
+		if ( m->type != type || m->async != async || m->waiting )
+			continue;
+
+		bool restart = m->restart;
+		m->restart = false;
+
+		if ( m->state->Match((const u_char*)data, data_len, bol || restart, eol, clear || restart) )
 			newmatch = true;
 		}
 
 	// If no new match found, we're already done.
 	if ( ! newmatch )
-		return;
-
-	DBG_LOG(DBG_RULES, "New pattern match found");
-
-	AcceptingMatchSet accepted_matches;
+		return false;
 
 	for ( const auto& m : state->matchers )
 		{
+		if ( m->async != async )
+			continue;
+
 		const AcceptingMatchSet& ams = m->state->AcceptedMatches();
-		accepted_matches.insert(ams.begin(), ams.end());
+		accepted->insert(ams.begin(), ams.end());
 		}
 
+	return true;
+	}
+
+void RuleMatcher::ExecMatches(RuleEndpointState* state, const AcceptingMatchSet& accepted_matches,
+                              const u_char* data, int data_len)
+	{
+	DBG_LOG(DBG_RULES, "New pattern match found");
+
 	// Determine the rules for which all patterns have matched.
 	// This code should be fast enough as long as there are only very few
 	// matched patterns per connection (which is a plausible assumption).
@@ -1034,11 +1323,92 @@ void RuleMatcher::Match(RuleEndpointState* state, Rule::PatternType type, const
 		}
 	}
 
+void RuleMatcher::RunPrefilters(RuleEndpointState* state, Rule::PatternType type,
+                                const u_char* data, int data_len, bool clear, bool async)
+	{
+	std::vector<int> found;
+	size_t len = data_len;
+
+	for ( auto& pf : state->prefilters )
+		{
+		if ( pf.type != type || pf.async != async )
+			continue;
+
+		if ( clear )
+			state->ResetPrefilter(&pf);
+
+		if ( ! pf.num_waiting || ! len )
+			continue;
+
+		++state->prefilter_stats.scans;
+		++prefilter_scans;
+
+		const auto* literals = pf.literals;
+		size_t keep = literals->MaxLength() - 1;
+		found.clear();
+
+		// Look for literals that started in earlier chunks first.
+		if ( ! pf.tail.empty() )
+			{
+			std::string boundary = pf.tail;
+			boundary.append(reinterpret_cast<const char*>(data), std::min(len, keep));
+			literals->Scan(reinterpret_cast<const u_char*>(boundary.data()), boundary.size(),
+			               &pf.waiting, &found);
+			}
+
+		literals->Scan(data, len, &pf.waiting, &found);
+
+		for ( int group : found )
+			{
+			// Each match starts with a literal, and none completed
+			// before the tail, so the DFA can start over at the
+			// beginning of the tail without missing any.
+			auto* m = pf.matchers[group];
+			m->waiting = false;
+
+			if ( pf.tail.empty() )
+				m->restart = true;
+			else
+				m->state->Match(reinterpret_cast<const u_char*>(pf.tail.data()), pf.tail.size(),
+				                true, false, true);
+			}
+
+		pf.num_waiting -= found.size();
+		state->prefilter_stats.hits += found.size();
+		prefilter_hits += found.size();
+		state->prefilter_stats.skipped += len * pf.num_waiting;
+
+		if ( ! pf.num_waiting )
+			{
+			pf.tail.clear();
+			continue;
+			}
+
+		// Keep the end of the data for the next chunk.
+		if ( len >= keep )
+			pf.tail.assign(reinterpret_cast<const char*>(data) + len - keep, keep);
+		else
+			{
+			pf.tail.append(reinterpret_cast<const char*>(data), len);
+
+			if ( pf.tail.size() > keep )
+				pf.tail.erase(0, pf.tail.size() - keep);
+			}
+		}
+	}
+
 void RuleMatcher::FinishEndpoint(RuleEndpointState* state)
 	{
 	// Send EOL to payload matchers.
 	Match(state, Rule::PAYLOAD, (const u_char*)"", 0, false, true, false);
 
+	// The async matches need to be in before the end.
+	if ( state->job )
+		{
+		if ( auto* pool = RuleMatchPool::Get() )
+			pool->Finish(state->job.get());
+		}
+
 	// Some of the pure rules may match at the end of the connection,
 	// although they have not matched at the beginning. So, we have
 	// to test the candidates here.
@@ -1178,12 +1548,22 @@ void RuleMatcher::ExecRule(Rule* rule, RuleEndpointState* state, bool eos)
 
 void RuleMatcher::ClearEndpointState(RuleEndpointState* state)
 	{
+	// Get the pool's threads out of the way of the async matchers.
+	if ( state->job )
+		{
+		if ( auto* pool = RuleMatchPool::Get() )
+			pool->Finish(state->job.get());
+		}
+
 	ExecPureRules(state, true);
 
 	state->payload_size = -1;
 
 	for ( const auto& matcher : state->matchers )
 		matcher->state->Clear();
+
+	for ( auto& pf : state->prefilters )
+		state->ResetPrefilter(&pf);
 	}
 
 void RuleMatcher::ClearFileMagicState(RuleFileMagicState* state) const
@@ -1255,6 +1635,9 @@ void RuleMatcher::GetStats(Stats* stats, RuleHdrTest* hdr_test)
 		stats->hits = 0;
 		stats->misses = 0;
 		stats->nfa_states = 0;
+		stats->prefiltered = 0;
+		stats->prefilter_scans = prefilter_scans;
+		stats->prefilter_hits = prefilter_hits;
 		hdr_test = root;
 		}
 
@@ -1267,7 +1650,14 @@ void RuleMatcher::GetStats(Stats* stats, RuleHdrTest* hdr_test)
 			assert(set->re);
 
 			++stats->matchers;
-			set->re->DFA()->Cache()->GetStats(&cstats);
+
+			if ( set->prefiltered )
+				++stats->prefiltered;
+
+				{
+				DFA_Lock lock(set->re->DFA());
+				set->re->DFA()->Cache()->GetStats(&cstats);
+				}
 
 			stats->dfa_states += cstats.dfa_states;
 			stats->computed += cstats.computed;
@@ -1293,6 +1683,10 @@ void RuleMatcher::DumpStats(File* f)
 	                   stats.mem));
 	f->Write(util::fmt("%.6f DFA cache hits = %d; misses = %d\n", run_state::network_time,
 	                   stats.hits, stats.misses));
+	f->Write(util::fmt("%.6f prefiltered matchers = %d; prefilter scans = %" PRIu64
+	                   "; hits = %" PRIu64 "\n",
+	                   run_state::network_time, stats.prefiltered, stats.prefilter_scans,
+	                   stats.prefilter_hits));
 
 	DumpStateStats(f, root);
 	}
@@ -1526,6 +1920,12 @@ void RuleMatcherState::Match(Rule::PatternType type, const u_char* data, int dat
 	                    eol, clear);
 	}
 
+bool RuleMatcherState::MatchersExhausted() const
+	{
+	return orig_match_state && resp_match_state && orig_match_state->Exhausted() &&
+	       resp_match_state->Exhausted();
+	}
+
 void RuleMatcherState::ClearMatchState(bool orig)
 	{
 	if ( ! rule_matcher )
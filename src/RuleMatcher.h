@@ -1,9 +1,11 @@
 #pragma once
 
 #include <sys/types.h> // for u_char
+#include <atomic>
 #include <climits>
 #include <functional>
 #include <map>
+#include <memory>
 #include <set>
 #include <string>
 #include <vector>
@@ -11,6 +13,7 @@
 #include "zeek/CCL.h"
 #include "zeek/RE.h"
 #include "zeek/Rule.h"
+#include "zeek/RuleMatchPool.h"
 #include "zeek/ScannedFile.h"
 #include "zeek/plugin/Manager.h"
 
@@ -47,6 +50,7 @@ class PIA;
 namespace detail
 	{
 
+class LiteralPrefilter;
 class RE_Match_State;
 class Specific_RE_Matcher;
 class RuleMatcher;
@@ -136,10 +140,11 @@ private:
 
 	// The following are all set by RuleMatcher::BuildRulesTree().
 	friend class RuleMatcher;
+	friend class RuleEndpointState;
 
 	struct PatternSet
 		{
-		PatternSet() : re() { }
+		PatternSet() : re(), prefiltered(), async() { }
 
 		// If we're above the 'RE_level' (see RuleMatcher), this
 		// expr contains all patterns on this node. If we're on
@@ -150,11 +155,26 @@ private:
 		// All the patterns and their rule indices.
 		string_list patterns;
 		int_list ids; // (only needed for debugging)
+
+		// True if all patterns start with a literal in the node's
+		// prefilter, so that the set can't match before one of them
+		// shows up.
+		bool prefiltered;
+
+		// True if the set's rules get matched on the RuleMatchPool.
+		bool async;
 		};
 
 	using pattern_set_list = PList<PatternSet>;
 	pattern_set_list psets[Rule::TYPES];
 
+	// The literals of the prefiltered pattern sets, with the sets'
+	// index as their group. Null if there are none.
+	LiteralPrefilter* prefilters[Rule::TYPES] = {};
+
+	// Likewise for the pattern sets matched on the RuleMatchPool.
+	LiteralPrefilter* async_prefilters[Rule::TYPES] = {};
+
 	// List of rules belonging to this node.
 	Rule* pattern_rules; // rules w/ at least one pattern of any type
 	Rule* pure_rules; // rules containing no patterns at all
@@ -189,8 +209,29 @@ public:
 
 	analyzer::pia::PIA* PIA() const { return pia; }
 
+	struct PrefilterStats
+		{
+		std::atomic<uint64_t> scans; //< Chunks searched for literals of waiting pattern sets.
+		std::atomic<uint64_t> hits; //< Pattern sets that had their DFA started by a literal.
+		std::atomic<uint64_t> skipped; //< Bytes not fed into the DFAs of waiting pattern sets.
+		};
+
+	/**
+	 * Returns statistics about the literal prefilter for this endpoint.
+	 */
+	const PrefilterStats& GetPrefilterStats() const { return prefilter_stats; }
+
+	/**
+	 * Returns true if no rule can match for this endpoint anymore, no
+	 * matter what input follows: the DFAs of all its pattern sets are
+	 * stuck, and all rules whose patterns matched, as well as all rules
+	 * without patterns, have fired already.
+	 */
+	bool Exhausted() const;
+
 private:
 	friend class RuleMatcher;
+	friend class RuleMatchPool;
 
 	// Constructor is private; use RuleMatcher::InitEndpoint()
 	// for creating an instance.
@@ -201,15 +242,58 @@ private:
 		{
 		RE_Match_State* state;
 		Rule::PatternType type;
+
+		// True if the matcher's pattern set is behind the prefilter.
+		bool prefiltered;
+
+		// True while the prefilter hasn't seen a literal of the
+		// matcher's pattern set yet, so that its DFA doesn't run.
+		bool waiting;
+
+		// True if the DFA needs to start over with the next chunk.
+		bool restart;
+
+		// True if the matcher runs on the RuleMatchPool, which then
+		// owns its state while the endpoint's job has chunks queued.
+		bool async;
 		};
 
 	using matcher_list = PList<Matcher>;
 
+	// The state of a node's prefilter for one type of patterns.
+	struct Prefilter
+		{
+		const LiteralPrefilter* literals;
+		Rule::PatternType type;
+		bool async;
+
+		// The node's matchers, indexed by pattern set. Null for those
+		// of the other kind (see Matcher::async).
+		std::vector<Matcher*> matchers;
+
+		// Which of them are waiting.
+		std::vector<bool> waiting;
+		size_t num_waiting;
+
+		// The end of the data seen so far, to find literals that
+		// span chunks.
+		std::string tail;
+		};
+
+	// Makes a prefilter's matchers wait for a literal again.
+	void ResetPrefilter(Prefilter* pf);
+
+	// Returns true if none of the matchers of the given kind can match
+	// anything anymore.
+	bool MatchersFinished(bool async) const;
+
 	analyzer::Analyzer* analyzer;
 	RuleEndpointState* opposite;
 	analyzer::pia::PIA* pia;
 
 	matcher_list matchers;
+	std::vector<Prefilter> prefilters;
+	PrefilterStats prefilter_stats;
 	rule_hdr_test_list hdr_tests;
 
 	// The follow tracks which rules for which all patterns have matched,
@@ -222,6 +306,9 @@ private:
 	bool is_orig;
 
 	int_list matched_rules; // Rules for which all conditions have matched
+
+	// Set if there are matchers on the RuleMatchPool.
+	std::unique_ptr<RuleMatchPool::Job> job;
 	};
 
 /**
@@ -291,6 +378,22 @@ public:
 	MIME_Matches* Match(RuleFileMagicState* state, const u_char* data, uint64_t len,
 	                    MIME_Matches* matches = nullptr) const;
 
+	/**
+	 * Matches the next chunk of a file's data against file magic
+	 * signatures. Unlike Match(), this continues where the previous chunk
+	 * left off.
+	 * @param state A state object previously returned from
+	 *              RuleMatcher::InitFileMagic(), used for one file only.
+	 * @param data Chunk of data to match signatures against.
+	 * @param len Length of \a data in bytes.
+	 * @param first True for the file's first chunk.
+	 * @param matches The match result object to add new matches to.
+	 * @return True if no signature can match any further data, so that
+	 *         \a matches is complete.
+	 */
+	bool MatchMore(RuleFileMagicState* state, const u_char* data, uint64_t len, bool first,
+	               MIME_Matches* matches) const;
+
 	/**
 	 * Resets a state object used with matching file magic signatures.
 	 * @param state The state object to reset to an initial condition.
@@ -341,6 +444,10 @@ public:
 		// # cache hits (sampled, multiply by MOVE_TO_FRONT_SAMPLE_SIZE)
 		unsigned int hits;
 		unsigned int misses; // # cache misses
+
+		unsigned int prefiltered; // # matchers behind the literal prefilter
+		uint64_t prefilter_scans; // # chunks searched for literals
+		uint64_t prefilter_hits; // # matchers started by a literal
 		};
 
 	Val* BuildRuleStateValue(const Rule* rule, const RuleEndpointState* state) const;
@@ -349,6 +456,8 @@ public:
 	void DumpStats(File* f);
 
 private:
+	friend class RuleMatchPool;
+
 	// Delete node and all children.
 	void Delete(RuleHdrTest* node);
 
@@ -361,9 +470,37 @@ private:
 	// Traverse tree building the combined regular expressions.
 	void BuildRegEx(RuleHdrTest* hdr_test, string_list* exprs, int_list* ids);
 
-	// Build groups of regular epxressions.
-	void BuildPatternSets(RuleHdrTest::pattern_set_list* dst, const string_list& exprs,
-	                      const int_list& ids);
+	// Build groups of regular epxressions, putting those that start
+	// with a literal into groups of their own behind the prefilter.
+	void BuildPatternSets(RuleHdrTest* hdr_test, Rule::PatternType type,
+	                      const string_list& exprs, const int_list& ids);
+
+	// Likewise for patterns of one kind, see PatternSet::async.
+	void BuildPatternSets(RuleHdrTest* hdr_test, Rule::PatternType type,
+	                      const string_list& exprs, const int_list& ids, bool async);
+
+	// Returns true if a rule's patterns can be matched on the
+	// RuleMatchPool: all it does is raise events, and no other rule
+	// depends on it or the other way around.
+	static bool MatchesAsync(const Rule* r);
+
+	// Runs the prefilters of the given type and kind, starting the
+	// matchers whose literals show up in the data.
+	void RunPrefilters(RuleEndpointState* state, Rule::PatternType type, const u_char* data,
+	                   int data_len, bool clear, bool async);
+
+	// Feeds data into the matchers of the given type and kind. If any
+	// of them found a new match, returns true and fills in the matches
+	// of all of them so far. Called by the RuleMatchPool's threads for
+	// the async ones.
+	bool MatchPatterns(RuleEndpointState* state, Rule::PatternType type, const u_char* data,
+	                   int data_len, bool bol, bool eol, bool clear, bool async,
+	                   AcceptingMatchSet* accepted);
+
+	// Checks the rules whose patterns have all matched, executing their
+	// actions if their other conditions hold, too.
+	void ExecMatches(RuleEndpointState* state, const AcceptingMatchSet& accepted,
+	                 const u_char* data, int data_len);
 
 	// Check an arbitrary rule if it's satisfied right now.
 	// eos signals end of stream
@@ -391,12 +528,20 @@ private:
 	static bool AllRulePatternsMatched(const Rule* r, MatchPos matchpos,
 	                                   const AcceptingMatchSet& ams);
 
+	// Adds the MIME types of the file magic signatures whose patterns
+	// have all matched so far.
+	static void AddMIMEMatches(const RuleFileMagicState* state, MIME_Matches* rval);
+
 	int RE_level;
 	bool has_non_file_magic_rule;
 	bool parse_error;
 	RuleHdrTest* root;
 	rule_list rules;
 	rule_dict rules_by_id;
+
+	// Also counted by the RuleMatchPool's threads.
+	std::atomic<uint64_t> prefilter_scans;
+	std::atomic<uint64_t> prefilter_hits;
 	};
 
 // Keeps bi-directional matching-state.
@@ -424,6 +569,11 @@ public:
 
 	bool MatcherInitialized(bool orig) { return orig ? orig_match_state : resp_match_state; }
 
+	// True if the matchers of both endpoints have seen input and
+	// neither can match anything anymore, see
+	// RuleEndpointState::Exhausted().
+	bool MatchersExhausted() const;
+
 private:
 	RuleEndpointState* orig_match_state;
 	RuleEndpointState* resp_match_state;
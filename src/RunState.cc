@@ -29,6 +29,8 @@ extern "C"
 #include "zeek/Event.h"
 #include "zeek/ID.h"
 #include "zeek/NetVar.h"
+#include "zeek/PacketTracer.h"
+#include "zeek/Reassem.h"
 #include "zeek/Reporter.h"
 #include "zeek/Scope.h"
 #include "zeek/Timer.h"
@@ -56,6 +58,7 @@ namespace detail
 iosource::PktDumper* pkt_dumper = nullptr;
 iosource::PktSrc* current_pktsrc = nullptr;
 iosource::IOSource* current_iosrc = nullptr;
+iosource::PacketBuffer* current_pkt_buffer = nullptr;
 bool have_pending_timers = false;
 double first_wallclock = 0.0;
 double first_timestamp = 0.0;
@@ -214,10 +217,8 @@ void expire_timers()
 		network_time, zeek::detail::max_timer_expires - current_dispatched);
 	}
 
-void dispatch_packet(Packet* pkt, iosource::PktSrc* pkt_src)
+void advance_network_time(double t)
 	{
-	double t = run_state::pseudo_realtime ? check_pseudo_time(pkt) : pkt->time;
-
 	if ( ! zeek_start_network_time )
 		{
 		zeek_start_network_time = t;
@@ -226,13 +227,33 @@ void dispatch_packet(Packet* pkt, iosource::PktSrc* pkt_src)
 			event_mgr.Enqueue(network_time_init, Args{});
 		}
 
+	// network_time never goes back.
+	update_network_time(zeek::detail::timer_mgr->Time() < t ? t : zeek::detail::timer_mgr->Time());
+	expire_timers();
+
+	if ( session_mgr->HaveEmbryonic() )
+		session_mgr->ExpireEmbryonic(network_time);
+
+	if ( session_mgr->HaveUnsampled() )
+		session_mgr->ExpireUnsampled(network_time);
+
+	if ( session_mgr->HaveAggregated() )
+		session_mgr->ExpireAggregated(network_time);
+
+	if ( session_mgr->HaveShunts() )
+		session_mgr->ExpireShunts(network_time);
+	}
+
+void dispatch_packet(Packet* pkt, iosource::PktSrc* pkt_src)
+	{
+	double t = run_state::pseudo_realtime ? check_pseudo_time(pkt) : pkt->time;
+
 	current_iosrc = pkt_src;
 	current_pktsrc = pkt_src;
+	current_pkt_buffer = pkt->buffer.get();
 
-	// network_time never goes back.
-	update_network_time(zeek::detail::timer_mgr->Time() < t ? t : zeek::detail::timer_mgr->Time());
 	processing_start_time = t;
-	expire_timers();
+	advance_network_time(t);
 
 	zeek::detail::SegmentProfiler* sp = nullptr;
 
@@ -254,9 +275,21 @@ void dispatch_packet(Packet* pkt, iosource::PktSrc* pkt_src)
 			}
 		}
 
+	if ( zeek::detail::packet_tracer )
+		zeek::detail::packet_tracer->BeginPacket(pkt, pkt_src && pkt_src->IsLive());
+
+	zeek::detail::PacketTraceScope analysis_pts(zeek::detail::PacketTracer::PACKET_ANALYSIS);
 	packet_mgr->ProcessPacket(pkt);
+	analysis_pts.End();
+
+	if ( zeek::detail::reassembly_memory_budget )
+		Reassembler::EnforceMemoryBudget();
+
 	event_mgr.Drain();
 
+	if ( zeek::detail::packet_tracer )
+		zeek::detail::packet_tracer->EndPacket();
+
 	if ( sp )
 		{
 		delete sp;
@@ -271,6 +304,7 @@ void dispatch_packet(Packet* pkt, iosource::PktSrc* pkt_src)
 
 	current_iosrc = nullptr;
 	current_pktsrc = nullptr;
+	current_pkt_buffer = nullptr;
 	}
 
 void run_loop()
@@ -342,6 +376,9 @@ void run_loop()
 
 		event_mgr.Drain();
 
+		// Send what the iteration published, unless asked to wait longer.
+		broker_mgr->FlushEventBuffers(true);
+
 		processing_start_time = 0.0; // = "we're not processing now"
 		current_dispatched = 0;
 		current_iosrc = nullptr;
@@ -16,6 +16,7 @@ namespace iosource
 	{
 
 class IOSource;
+class PacketBuffer;
 class PktSrc;
 class PktDumper;
 
@@ -35,6 +36,14 @@ extern void finish_run(int drain_events);
 extern void delete_run(); // Reclaim all memory, etc.
 extern void update_network_time(double new_network_time);
 extern void dispatch_packet(zeek::Packet* pkt, zeek::iosource::PktSrc* pkt_src);
+
+/**
+ * Moves network time forward as a packet of the given time would, starting
+ * it if this is the first time, and expires the timers that are due. For
+ * sources that learn about time passing without having a packet for it.
+ */
+extern void advance_network_time(double t);
+
 extern void expire_timers();
 extern void zeek_terminate_loop(const char* reason);
 
@@ -49,6 +58,11 @@ extern double check_pseudo_time(const Packet* pkt);
 extern zeek::iosource::IOSource* current_iosrc;
 extern zeek::iosource::PktDumper* pkt_dumper; // where to save packets
 
+// The buffer lent by the packet source for the packet currently being
+// processed, if any. Data pointing into it can be retained by taking a
+// reference rather than copying it.
+extern zeek::iosource::PacketBuffer* current_pkt_buffer;
+
 // True if we have timers scheduled for the future on which we need
 // to wait.  "Need to wait" here means that we're running live (though
 // perhaps not reading_live, but just running in real-time) as opposed
@@ -0,0 +1,218 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/ScriptSampler.h"
+
+#include <pthread.h>
+#include <sys/time.h>
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+
+namespace zeek::detail
+	{
+
+ScriptSampler* script_sampler = nullptr;
+
+// Never freed, as a signal may still be on its way after stopping.
+static ScriptSampler* the_sampler = nullptr;
+static pthread_t main_thread;
+static struct sigaction prev_action;
+static bool handler_installed = false;
+
+bool ScriptSampler::Start(uint64_t hz, std::string* error)
+	{
+	if ( hz == 0 || hz > 1000000 )
+		{
+		*error = "sampling frequency must be between 1 and 1000000";
+		return false;
+		}
+
+	if ( ! the_sampler )
+		the_sampler = new ScriptSampler();
+
+	if ( ! handler_installed )
+		{
+		struct sigaction action;
+		memset(&action, 0, sizeof(action));
+		action.sa_handler = HandleSignal;
+		action.sa_flags = SA_RESTART;
+		sigemptyset(&action.sa_mask);
+
+		if ( sigaction(SIGPROF, &action, &prev_action) != 0 )
+			{
+			*error = std::string("cannot install SIGPROF handler: ") + strerror(errno);
+			return false;
+			}
+
+		handler_installed = true;
+		}
+
+	// Calls running already don't get their end marked.
+	if ( ! script_sampler )
+		the_sampler->depth = 0;
+
+	main_thread = pthread_self();
+	script_sampler = the_sampler;
+
+	struct itimerval timer;
+	timer.it_interval.tv_sec = 0;
+	timer.it_interval.tv_usec = static_cast<suseconds_t>(1000000 / hz);
+
+	if ( hz == 1 )
+		{
+		timer.it_interval.tv_sec = 1;
+		timer.it_interval.tv_usec = 0;
+		}
+
+	timer.it_value = timer.it_interval;
+
+	if ( setitimer(ITIMER_PROF, &timer, nullptr) != 0 )
+		{
+		*error = std::string("cannot start profiling timer: ") + strerror(errno);
+		Stop();
+		return false;
+		}
+
+	return true;
+	}
+
+void ScriptSampler::Stop()
+	{
+	struct itimerval timer;
+	memset(&timer, 0, sizeof(timer));
+	setitimer(ITIMER_PROF, &timer, nullptr);
+
+	if ( handler_installed )
+		{
+		sigaction(SIGPROF, &prev_action, nullptr);
+		handler_installed = false;
+		}
+
+	script_sampler = nullptr;
+	}
+
+void ScriptSampler::HandleSignal(int sig)
+	{
+	auto s = script_sampler;
+
+	// The process's CPU time includes that of Zeek's threads, which
+	// don't run scripts.
+	if ( s && pthread_equal(pthread_self(), main_thread) )
+		s->Record();
+	}
+
+void ScriptSampler::Record()
+	{
+	int d = depth;
+
+	if ( d == 0 )
+		{
+		non_script = non_script + 1;
+		return;
+		}
+
+	int next = (pending_end + 1) % MAX_PENDING;
+
+	if ( next == pending_start )
+		{
+		dropped = dropped + 1;
+		return;
+		}
+
+	auto& sample = pending[pending_end];
+	sample.depth = std::min(d, MAX_DEPTH);
+
+	for ( int i = 0; i < sample.depth; ++i )
+		sample.stack[i] = stack[i];
+
+	std::atomic_signal_fence(std::memory_order_release);
+	pending_end = next;
+	}
+
+void ScriptSampler::Drain()
+	{
+	// The signal handler only interrupts the main thread, so what it
+	// added is complete once seen here.
+	int end = pending_end;
+	std::atomic_signal_fence(std::memory_order_acquire);
+
+	for ( int i = pending_start; i != end; i = (i + 1) % MAX_PENDING )
+		{
+		const auto& sample = pending[i];
+		++counts[std::vector<int>(sample.stack, sample.stack + sample.depth)];
+		}
+
+	pending_start = end;
+	}
+
+int ScriptSampler::NameId(const std::string& name)
+	{
+	auto [it, inserted] = name_ids.emplace(name, static_cast<int>(names.size()));
+
+	if ( inserted )
+		{
+		// The folded format separates frames by ';' and the count by
+		// the last space.
+		auto folded = name;
+		std::replace(folded.begin(), folded.end(), ';', ':');
+		std::replace(folded.begin(), folded.end(), ' ', '_');
+		names.emplace_back(std::move(folded));
+		}
+
+	return it->second;
+	}
+
+bool ScriptSampler::Write(const std::string& path, std::string* error)
+	{
+	FILE* f = fopen(path.c_str(), "w");
+
+	if ( ! f )
+		{
+		*error = "cannot create " + path + ": " + strerror(errno);
+		return false;
+		}
+
+	auto s = the_sampler;
+
+	if ( s )
+		{
+		s->Drain();
+
+		for ( const auto& [stack, n] : s->counts )
+			{
+			std::string folded;
+
+			for ( auto id : stack )
+				{
+				if ( ! folded.empty() )
+					folded += ';';
+
+				folded += s->names[id];
+				}
+
+			fprintf(f, "%s %" PRIu64 "\n", folded.c_str(), n);
+			}
+
+		if ( s->non_script > 0 )
+			fprintf(f, "[non-script] %d\n", static_cast<int>(s->non_script));
+
+		if ( s->dropped > 0 )
+			fprintf(f, "[dropped] %d\n", static_cast<int>(s->dropped));
+
+		s->counts.clear();
+		s->non_script = 0;
+		s->dropped = 0;
+		}
+
+	if ( fclose(f) != 0 )
+		{
+		*error = "cannot write " + path + ": " + strerror(errno);
+		return false;
+		}
+
+	return true;
+	}
+
+	} // namespace zeek::detail
@@ -0,0 +1,141 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+// Sampling profiler for script execution, cheap enough to leave on.
+
+#pragma once
+
+#include <atomic>
+#include <csignal>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "zeek/Func.h"
+
+namespace zeek::detail
+	{
+
+/**
+ * Samples which script functions run, at a given frequency of the
+ * process's CPU time, for attributing script CPU on production systems.
+ * Unlike ScriptProfileMgr, it takes no measurements per call: calls only
+ * maintain a shadow stack of the functions running, which a SIGPROF
+ * handler copies on each sample. The samples aggregate into stacks in
+ * the folded format of flame graph tools.
+ *
+ * Functions that ZAM inlined into their callers don't show up on their
+ * own. Samples that hit while no script runs, such as during packet
+ * processing, count as non-script time.
+ */
+class ScriptSampler
+	{
+public:
+	/**
+	 * Starts sampling, or changes the frequency of sampling already
+	 * running. Uses the process's profiling timer and SIGPROF.
+	 *
+	 * @param hz The samples per second of CPU time.
+	 *
+	 * @param error Receives a description of the problem on failure.
+	 *
+	 * @return False on failure.
+	 */
+	static bool Start(uint64_t hz, std::string* error);
+
+	/**
+	 * Stops sampling. The samples taken remain for Write().
+	 */
+	static void Stop();
+
+	/**
+	 * Writes the stacks sampled since the previous call, with the
+	 * number of samples of each, and forgets them.
+	 *
+	 * @param path The file to write.
+	 *
+	 * @param error Receives a description of the problem on failure.
+	 *
+	 * @return False on failure.
+	 */
+	static bool Write(const std::string& path, std::string* error);
+
+	/**
+	 * Marks the start of a call.
+	 */
+	void Enter(const Func* f)
+		{
+		if ( depth < MAX_DEPTH )
+			stack[depth] = Id(f);
+
+		// The signal handler reads the stack only up to depth.
+		std::atomic_signal_fence(std::memory_order_release);
+		depth = depth + 1;
+
+		if ( pending_start != pending_end )
+			Drain();
+		}
+
+	/**
+	 * Marks the end of a call.
+	 */
+	void Leave()
+		{
+		// Calls that were running when sampling started don't count.
+		if ( depth > 0 )
+			depth = depth - 1;
+		}
+
+private:
+	static constexpr int MAX_DEPTH = 64;
+	static constexpr int MAX_PENDING = 256;
+
+	// A sample taken in the signal handler, waiting to get aggregated.
+	struct Sample
+		{
+		int depth;
+		int stack[MAX_DEPTH];
+		};
+
+	static void HandleSignal(int sig);
+
+	// Returns the function's slot in names, looking it up on first use.
+	int Id(const Func* f)
+		{
+		if ( f->sample_id < 0 )
+			f->sample_id = NameId(f->Name());
+
+		return f->sample_id;
+		}
+
+	// Returns the slot of a name, assigning one on first use. Lambdas
+	// get instantiated over and over, but under the same name.
+	int NameId(const std::string& name);
+
+	// Takes a sample, in the signal handler.
+	void Record();
+
+	// Aggregates the pending samples.
+	void Drain();
+
+	// Shadow stack of the running calls, by function slot.
+	int stack[MAX_DEPTH];
+	volatile sig_atomic_t depth = 0;
+
+	// Samples the signal handler added, which the main thread aggregates.
+	Sample pending[MAX_PENDING];
+	volatile sig_atomic_t pending_start = 0;
+	volatile sig_atomic_t pending_end = 0;
+	volatile sig_atomic_t non_script = 0;
+	volatile sig_atomic_t dropped = 0;
+
+	std::vector<std::string> names;
+	std::unordered_map<std::string, int> name_ids;
+	std::map<std::vector<int>, uint64_t> counts;
+	};
+
+// If non-nil, script sampling is active.
+extern ScriptSampler* script_sampler;
+
+	} // namespace zeek::detail
@@ -0,0 +1,267 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/SharedTable.h"
+
+#include "zeek/zeek-config.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include "zeek/3rdparty/doctest.h"
+
+namespace zeek::detail
+	{
+
+static constexpr char shared_table_magic[8] = {'Z', 'E', 'E', 'K', 'S', 'T', '0', '1'};
+static constexpr size_t header_size = sizeof(shared_table_magic) + sizeof(uint64_t);
+static constexpr size_t entry_header_size = 2 * sizeof(uint32_t);
+
+static std::string errno_msg(const char* what, const std::string& path)
+	{
+	return std::string(what) + " " + path + ": " + strerror(errno);
+	}
+
+bool SharedTable::Write(const std::string& path, Entries entries, std::string* error)
+	{
+	std::sort(entries.begin(), entries.end());
+
+	std::string data(shared_table_magic, sizeof(shared_table_magic));
+	uint64_t n = entries.size();
+	data.append(reinterpret_cast<const char*>(&n), sizeof(n));
+
+	std::vector<uint64_t> offsets;
+	offsets.reserve(entries.size());
+	uint64_t offset = header_size + entries.size() * sizeof(uint64_t);
+
+	for ( const auto& [key, val] : entries )
+		{
+		if ( key.size() > UINT32_MAX || val.size() > UINT32_MAX )
+			{
+			*error = "entry too large for " + path;
+			return false;
+			}
+
+		offsets.push_back(offset);
+		offset += entry_header_size + key.size() + val.size();
+		}
+
+	data.append(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(uint64_t));
+
+	for ( const auto& [key, val] : entries )
+		{
+		uint32_t lens[2] = {static_cast<uint32_t>(key.size()), static_cast<uint32_t>(val.size())};
+		data.append(reinterpret_cast<const char*>(lens), sizeof(lens));
+		data.append(key);
+		data.append(val);
+		}
+
+	// Write a new file and move it into place, rather than changing a
+	// file that others may have mapped.
+	auto tmp_path = path + ".tmp";
+	FILE* f = fopen(tmp_path.c_str(), "wb");
+
+	if ( ! f )
+		{
+		*error = errno_msg("cannot create", tmp_path);
+		return false;
+		}
+
+	bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+
+	if ( fclose(f) != 0 )
+		ok = false;
+
+	if ( ! ok )
+		{
+		*error = errno_msg("cannot write", tmp_path);
+		unlink(tmp_path.c_str());
+		return false;
+		}
+
+	if ( rename(tmp_path.c_str(), path.c_str()) != 0 )
+		{
+		*error = errno_msg("cannot rename to", path);
+		unlink(tmp_path.c_str());
+		return false;
+		}
+
+	return true;
+	}
+
+std::unique_ptr<SharedTable> SharedTable::Open(const std::string& path, std::string* error)
+	{
+	int fd = open(path.c_str(), O_RDONLY);
+
+	if ( fd < 0 )
+		{
+		*error = errno_msg("cannot open", path);
+		return nullptr;
+		}
+
+	struct stat st;
+
+	if ( fstat(fd, &st) != 0 )
+		{
+		*error = errno_msg("cannot stat", path);
+		close(fd);
+		return nullptr;
+		}
+
+	size_t size = st.st_size;
+
+	if ( size < header_size )
+		{
+		*error = path + " is not a shared table";
+		close(fd);
+		return nullptr;
+		}
+
+	void* base = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if ( base == MAP_FAILED )
+		{
+		*error = errno_msg("cannot map", path);
+		return nullptr;
+		}
+
+	std::unique_ptr<SharedTable> t{new SharedTable(path, static_cast<const char*>(base), size)};
+
+	if ( ! t->Validate() )
+		{
+		*error = path + " is not a valid shared table";
+		return nullptr;
+		}
+
+	return t;
+	}
+
+SharedTable::SharedTable(std::string arg_path, const char* arg_base, size_t arg_size)
+	: path(std::move(arg_path)), base(arg_base), size(arg_size)
+	{
+	uint64_t n;
+	memcpy(&n, base + sizeof(shared_table_magic), sizeof(n));
+
+	// Validate() rejects what doesn't fit.
+	num_entries = n;
+	offsets = reinterpret_cast<const uint64_t*>(base + header_size);
+	}
+
+SharedTable::~SharedTable()
+	{
+	munmap(const_cast<char*>(base), size);
+	}
+
+bool SharedTable::Validate() const
+	{
+	if ( memcmp(base, shared_table_magic, sizeof(shared_table_magic)) != 0 )
+		return false;
+
+	if ( num_entries > (size - header_size) / sizeof(uint64_t) )
+		return false;
+
+	for ( size_t i = 0; i < num_entries; ++i )
+		{
+		auto offset = offsets[i];
+
+		if ( offset > size || size - offset < entry_header_size )
+			return false;
+
+		uint32_t lens[2];
+		memcpy(lens, base + offset, sizeof(lens));
+
+		if ( size - offset - entry_header_size < uint64_t(lens[0]) + lens[1] )
+			return false;
+		}
+
+	return true;
+	}
+
+std::string_view SharedTable::Key(size_t i) const
+	{
+	uint32_t key_len;
+	memcpy(&key_len, base + offsets[i], sizeof(key_len));
+	return {base + offsets[i] + entry_header_size, key_len};
+	}
+
+std::optional<std::string_view> SharedTable::Lookup(std::string_view key) const
+	{
+	size_t lo = 0;
+	size_t hi = num_entries;
+
+	while ( lo < hi )
+		{
+		auto mid = lo + (hi - lo) / 2;
+		auto c = Key(mid).compare(key);
+
+		if ( c == 0 )
+			{
+			uint32_t lens[2];
+			memcpy(lens, base + offsets[mid], sizeof(lens));
+			return std::string_view{base + offsets[mid] + entry_header_size + lens[0], lens[1]};
+			}
+
+		if ( c < 0 )
+			lo = mid + 1;
+		else
+			hi = mid;
+		}
+
+	return std::nullopt;
+	}
+
+TEST_SUITE_BEGIN("SharedTable");
+
+TEST_CASE("shared table")
+	{
+	char tmpl[] = "/tmp/zeek-shared-table-XXXXXX";
+	int fd = mkstemp(tmpl);
+	REQUIRE(fd >= 0);
+	close(fd);
+
+	std::string path = tmpl;
+	std::string error;
+	SharedTable::Entries entries = {
+		{"www.example.com", "allow"}, {"a", ""}, {"", "empty key"}, {std::string("x\0y", 3), "nul"}};
+
+	REQUIRE(SharedTable::Write(path, entries, &error));
+
+	auto t = SharedTable::Open(path, &error);
+	REQUIRE(t);
+	CHECK(t->Size() == 4);
+	CHECK(t->Lookup("www.example.com") == "allow");
+	CHECK(t->Lookup("a") == "");
+	CHECK(t->Lookup("") == "empty key");
+	CHECK(t->Lookup(std::string("x\0y", 3)) == "nul");
+	CHECK_FALSE(t->Lookup("x"));
+	CHECK_FALSE(t->Lookup("www.example.co"));
+
+	// A replaced file doesn't change the mapped one.
+	REQUIRE(SharedTable::Write(path, {}, &error));
+	CHECK(t->Lookup("a") == "");
+
+	auto t2 = SharedTable::Open(path, &error);
+	REQUIRE(t2);
+	CHECK(t2->Size() == 0);
+	CHECK_FALSE(t2->Lookup("a"));
+
+	FILE* f = fopen(path.c_str(), "wb");
+	REQUIRE(f);
+	fputs("ZEEKST01\xff\xff\xff\xff\xff\xff\xff\x7f", f);
+	fclose(f);
+	CHECK_FALSE(SharedTable::Open(path, &error));
+
+	CHECK_FALSE(SharedTable::Open(path + ".missing", &error));
+
+	unlink(path.c_str());
+	}
+
+TEST_SUITE_END();
+
+	} // namespace zeek::detail
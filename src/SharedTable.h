@@ -0,0 +1,98 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace zeek::detail
+	{
+
+/**
+ * A read-only table of strings to strings kept in a file that processes
+ * map into memory rather than load, so that all processes on a host
+ * looking up the same file share a single copy of it through the page
+ * cache. Lookups read the mapped file directly.
+ *
+ * The file starts with an 8-byte magic and the number of entries, as a
+ * uint64_t, followed by that many uint64_t offsets of the entries, in the
+ * order of their keys. Each entry is the key's and then the value's length,
+ * as uint32_t, followed by the key's and the value's bytes. Numbers are in
+ * host byte order, as the file is meant to be used on the host that wrote
+ * it.
+ */
+class SharedTable
+	{
+public:
+	using Entries = std::vector<std::pair<std::string, std::string>>;
+
+	/**
+	 * Writes a table to a file, replacing any previous one atomically so
+	 * that processes mapping the old file keep a consistent view of it.
+	 *
+	 * @param path The file's path.
+	 *
+	 * @param entries The table's keys and values. The keys must be
+	 * distinct.
+	 *
+	 * @param error Receives a description of the problem on failure.
+	 *
+	 * @return False on failure.
+	 */
+	static bool Write(const std::string& path, Entries entries, std::string* error);
+
+	/**
+	 * Maps a file that Write() created.
+	 *
+	 * @param path The file's path.
+	 *
+	 * @param error Receives a description of the problem on failure.
+	 *
+	 * @return The table, or nullptr on failure.
+	 */
+	static std::unique_ptr<SharedTable> Open(const std::string& path, std::string* error);
+
+	~SharedTable();
+
+	SharedTable(const SharedTable&) = delete;
+	SharedTable& operator=(const SharedTable&) = delete;
+
+	/**
+	 * Returns the value for a key, pointing into the mapped file, or
+	 * nothing if there's no such key.
+	 */
+	std::optional<std::string_view> Lookup(std::string_view key) const;
+
+	/**
+	 * Returns the number of entries.
+	 */
+	size_t Size() const { return num_entries; }
+
+	/**
+	 * Returns the path that the table was opened from.
+	 */
+	const std::string& Path() const { return path; }
+
+private:
+	SharedTable(std::string path, const char* base, size_t size);
+
+	// Returns the key of the entry at the given position.
+	std::string_view Key(size_t i) const;
+
+	// Checks that all entries lie within the file.
+	bool Validate() const;
+
+	std::string path;
+	const char* base;
+	size_t size;
+	size_t num_entries;
+	const uint64_t* offsets;
+	};
+
+	} // namespace zeek::detail
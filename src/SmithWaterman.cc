@@ -6,6 +6,7 @@
 
 #include <algorithm>
 #include <cctype>
+#include <cstdlib>
 
 #include "zeek/Reporter.h"
 #include "zeek/Val.h"
@@ -178,53 +179,51 @@ bool SubstringCmp::operator()(const Substring* bst1, const Substring* bst2) cons
 	return false;
 	}
 
-// A node in Smith-Waterman's dynamic programming matrix.  Each node
-// contains the byte it represents in the case of a match, the score
-// at this point, and a pointer to the previous cell. Previous means
-// one up and left in case of a match, or a jump somewhere above and
-// left in case of a gap.
+// Smith-Waterman's dynamic programming matrix, for backtracking through
+// it once the scores are known. Scoring only needs the previous row, so
+// the matrix keeps just a byte per cell: whether the cell's score came
+// from the cell above (rather than the one to the left, or diagonally for
+// matching bytes), and whether a backtrack went through it. Whether a
+// cell matches follows from the strings. With a band, the matrix holds
+// only the cells at most that far from the diagonal.
 //
-struct SWNode
+class SWMatrix
 	{
-	// ID field for the cell, for debugging purposes.
-	int id;
+public:
+	SWMatrix(const String* s1, const String* s2, int band)
+		: _s1(s1), _s2(s2), _rows(s1->Len() + 1), _cols(s2->Len() + 1)
+		{
+		if ( band > 0 && band < std::max(_rows, _cols) )
+			_band = band;
 
-	u_char swn_byte;
-	bool swn_byte_assigned;
-	bool swn_visited;
+		_width = _band ? 2 * _band + 1 : _cols;
+		_cells.resize(size_t(_rows) * _width);
+		}
 
-	// The score in this cell. The cell with the globally best score
-	// marks the end of the alignment.
-	int swn_score;
+	bool InBand(int row, int col) const
+		{
+		if ( row < 0 || row >= _rows || col < 0 || col >= _cols )
+			return false;
 
-	// Pointer to previous match, walking back yields subsequence.
-	SWNode* swn_prev;
-	};
+		return ! _band || std::abs(row - col) <= _band;
+		}
 
-// A matrix of Smith-Waterman nodes.
-//
-class SWNodeMatrix
-	{
-public:
-	SWNodeMatrix(const String* s1, const String* s2)
-		: _s1(s1), _s2(s2), _rows(s1->Len() + 1), _cols(s2->Len() + 1)
+	// The first and last column within the band, for rows past the first.
+	int FirstCol(int row) const { return _band ? std::max(1, row - _band) : 1; }
+	int LastCol(int row) const { return _band ? std::min(_cols - 1, row + _band) : _cols - 1; }
+
+	bool Match(int row, int col) const
 		{
-		_nodes = new SWNode[_cols * _rows];
-		memset(_nodes, 0, sizeof(SWNode) * _cols * _rows);
+		return row > 0 && col > 0 && _s1->Bytes()[row - 1] == _s2->Bytes()[col - 1];
 		}
 
-	~SWNodeMatrix() { delete[] _nodes; }
+	u_char Byte(int row) const { return _s1->Bytes()[row - 1]; }
 
-	SWNode* operator()(int row, int col)
-		{
-		// Make sure access is in allowed range.
-		if ( row < 0 || row >= _rows )
-			return nullptr;
-		if ( col < 0 || col >= _cols )
-			return nullptr;
+	bool FromTop(int row, int col) const { return Cell(row, col) & FROM_TOP; }
+	void SetFromTop(int row, int col) { Cell(row, col) |= FROM_TOP; }
 
-		return &(_nodes[row * _cols + col]);
-		}
+	bool Visited(int row, int col) const { return Cell(row, col) & VISITED; }
+	void Visit(int row, int col) { Cell(row, col) |= VISITED; }
 
 	const String* GetRowsString() const { return _s1; }
 	const String* GetColsString() const { return _s2; }
@@ -232,68 +231,85 @@ public:
 	int GetHeight() const { return _rows; }
 	int GetWidth() const { return _cols; }
 
-	// Quick helper function that calculates the coordinates of a
-	// node in the matrix via pointer arithmetic.
-	//
-	void GetNodeIndices(SWNode* node, int& row, int& col)
+private:
+	static constexpr u_char FROM_TOP = 0x01;
+	static constexpr u_char VISITED = 0x02;
+
+	u_char& Cell(int row, int col)
 		{
-		SWNode* base = &_nodes[0];
-		int offset = (node - base);
-		col = (offset % _cols);
-		row = (offset / _cols);
+		return _cells[size_t(row) * _width + (_band ? col - row + _band : col)];
+		}
+
+	u_char Cell(int row, int col) const
+		{
+		return _cells[size_t(row) * _width + (_band ? col - row + _band : col)];
 		}
 
-private:
 	const String* _s1;
 	const String* _s2;
 
 	int _rows, _cols;
-	SWNode* _nodes;
+	int _band = 0;
+	int _width;
+	std::vector<u_char> _cells;
 	};
 
-// Returns the common subsequence starting from a given node.
+// Returns the common subsequence ending at a given cell. Backtracking
+// ends at the first row or column, or when it leaves the band.
 // @result: vector holding results on return.
 // @matrix: SW matrix.
-// @node: starting node.
+// @row, @col: starting cell.
 // @params: SW parameters.
 //
-static void sw_collect_single(Substring::Vec* result, SWNodeMatrix& matrix, SWNode* node,
+static void sw_collect_single(Substring::Vec* result, SWMatrix& matrix, int row, int col,
                               SWParams& params)
 	{
 	std::string substring("");
-	int row = 0, col = 0;
+	int start_row = 0, start_col = 0;
 
-	while ( node )
+	for ( ;; )
 		{
-		//		printf("NODE: %i\n", node->id);
-		node->swn_visited = true;
+		bool in_band = matrix.InBand(row, col);
+
+		if ( in_band )
+			matrix.Visit(row, col);
 
 		// Once we hit a gap, terminate the string and prepend
 		// it to our result vector, IF it has at least the length
 		// requested through the params._min_toklen parameter.
 		//
-		if ( node->swn_byte_assigned )
+		if ( in_band && matrix.Match(row, col) )
 			{
-			matrix.GetNodeIndices(node, row, col);
-			substring += node->swn_byte;
-			//			printf("SUBSTRING: %s\n", substring.c_str());
+			start_row = row;
+			start_col = col;
+			substring += matrix.Byte(row);
 			}
 		else
 			{
-			//			printf("GAP\n");
 			if ( substring.size() >= params._min_toklen )
 				{
 				reverse(substring.begin(), substring.end());
 				auto* bst = new Substring(substring);
-				bst->AddAlignment(matrix.GetRowsString(), row - 1);
-				bst->AddAlignment(matrix.GetColsString(), col - 1);
+				bst->AddAlignment(matrix.GetRowsString(), start_row - 1);
+				bst->AddAlignment(matrix.GetColsString(), start_col - 1);
 				result->push_back(bst);
 				}
 
 			substring = "";
 			}
 
-		node = node->swn_prev;
+		if ( ! in_band || row == 0 || col == 0 )
+			break;
+
+		if ( matrix.Match(row, col) )
+			{
+			--row;
+			--col;
+			}
+		else if ( matrix.FromTop(row, col) )
+			--row;
+		else
+			--col;
 		}
 
 	// Anything left over now is the first string of an alignment and is
@@ -303,8 +319,8 @@ static void sw_collect_single(Substring::Vec* result, SWNodeMatrix& matrix, SWNo
 		{
 		reverse(substring.begin(), substring.end());
 		auto* bst = new Substring(substring);
-		bst->AddAlignment(matrix.GetRowsString(), row - 1);
-		bst->AddAlignment(matrix.GetColsString(), col - 1);
+		bst->AddAlignment(matrix.GetRowsString(), start_row - 1);
+		bst->AddAlignment(matrix.GetColsString(), start_col - 1);
 		result->push_back(bst);
 		}
 
@@ -315,27 +331,27 @@ static void sw_collect_single(Substring::Vec* result, SWNodeMatrix& matrix, SWNo
 // Returns repeated common-subsequence alignments.
 // @result: vector holding results on return.
 // @matrix: SW matrix.
+// @last_row: the last row that got scored.
 // @params: SW parameters.
 //
 // The approach taken is to essentially follow back from all starting points of
 // common subsequences while tracking which nodes were visited earlier and which
 // substrings are redundant (i.e., fully covered by a larger common substring).
 //
-static void sw_collect_multiple(Substring::Vec* result, SWNodeMatrix& matrix, SWParams& params)
+static void sw_collect_multiple(Substring::Vec* result, SWMatrix& matrix, int last_row,
+                                SWParams& params)
 	{
 	std::vector<Substring::Vec*> als;
 
-	for ( int i = matrix.GetHeight() - 1; i > 0; --i )
+	for ( int i = last_row; i > 0; --i )
 		{
-		for ( int j = matrix.GetWidth() - 1; j > 0; --j )
+		for ( int j = matrix.LastCol(i); j >= matrix.FirstCol(i); --j )
 			{
-			SWNode* node = matrix(i, j);
-
-			if ( ! (node->swn_byte_assigned && ! node->swn_visited) )
+			if ( ! (matrix.Match(i, j) && ! matrix.Visited(i, j)) )
 				continue;
 
 			auto* new_al = new Substring::Vec();
-			sw_collect_single(new_al, matrix, node, params);
+			sw_collect_single(new_al, matrix, i, j, params);
 
 			for ( auto& old_al : als )
 				{
@@ -396,150 +412,94 @@ Substring::Vec* smith_waterman(const String* s1, const String* s2, SWParams& par
 	// Length of both strings, plus one because SW needs
 	// an extra row and column.
 	//
-	int i, len1 = s1->Len() + 1;
-	int j, len2 = s2->Len() + 1;
-
-	int row = 0, col = 0;
+	int len1 = s1->Len() + 1;
+	int len2 = s2->Len() + 1;
 
-	byte_vec string1 = s1->Bytes();
-	byte_vec string2 = s2->Bytes();
+	SWMatrix matrix(s1, s2, params._band);
 
-	SWNodeMatrix matrix(s1, s2); // dynamic programming matrix.
-	SWNode* node_max = nullptr; // pointer to the best score's node
-	SWNode* node_br_max = nullptr; // pointer to lowest-right matching node
+	// The scores of the previous and the current row. Cells in the
+	// first row and column, and those outside of the band, score 0.
+	std::vector<int> prev(len2, 0);
+	std::vector<int> cur(len2, 0);
 
-	// The highest score in the matrix, globally.  We initialize to 1
-	// because we are only interested in real scores (initializing to
-	// -infty would mean 0 is larger, and would complicate the link
-	// structure in the matrix).
+	// The highest score in the matrix, globally, and the first cell that
+	// has it, to backtrack from.  We initialize to 1 because we are only
+	// interested in real scores.
 	//
 	int matrix_max = 1;
-	int br_max_r = 0;
-	int br_max_b = 0;
+	int max_row = -1, max_col = -1;
+	int last_row = len1 - 1;
 
-	// Matrix initialization ----------------------------------------------
-
-	// Assign IDs to each cell -- this is only for debugging purposes
-	// and can go later.
-
-	int counter = 1;
+	for ( int i = 1; i < len1; ++i )
+		{
+		int first = matrix.FirstCol(i);
+		int last = matrix.LastCol(i);
 
-	for ( i = 1; i < len1; ++i )
-		for ( j = 1; j < len2; ++j )
-			matrix(i, j)->id = counter++;
+		// The cells bordering the band for this row, for the next one.
+		cur[first - 1] = 0;
 
-	// Subsequence calculation --------------------------------------------
+		if ( last + 1 < len2 )
+			cur[last + 1] = 0;
 
-	for ( i = 1; i < len1; ++i )
-		{
-		for ( j = 1; j < len2; ++j )
+		for ( int j = first; j <= last; ++j )
 			{
-			// Current node, top/left neighbours.
-			//
-			SWNode* current = matrix(i, j);
-			SWNode* node_tl = matrix(i - 1, j - 1);
-			SWNode* node_l = matrix(i, j - 1);
-			SWNode* node_t = matrix(i - 1, j);
-
-			// Scores of neighbouring nodes.
-			//
-			int score_t = node_t->swn_score;
-			int score_l = node_l->swn_score;
-			int score_tl = node_tl->swn_score;
-
-			// If strings at current indices match, assign new
-			// score to current node.  Minus-one adjustments
-			// are necessary since matrix has one extra
-			// row + column.
-			//
-			if ( string1[i - 1] == string2[j - 1] )
-				{
-				// We have a match: improve previous score.
-				//
-				score_tl += 1;
+			int score_t = prev[j];
+			int score_l = cur[j - 1];
+			int score_tl = prev[j - 1];
+			int score;
 
-				// If we're continuing a chain of matches, rate
-				// higher.  This favours longer consecutive
-				// substrings.
+			if ( matrix.Match(i, j) )
+				{
+				// We have a match: improve previous score. If we're
+				// continuing a chain of matches, rate higher.  This
+				// favours longer consecutive substrings.
 				//
-				if ( node_tl->swn_byte_assigned )
-					score_tl += 99;
+				score = score_tl + 1;
 
-				// Store the byte we've matched in the node for
-				// easier access.
-				//
-				current->swn_byte = string1[i - 1];
-				current->swn_byte_assigned = true;
+				if ( matrix.Match(i - 1, j - 1) )
+					score += 99;
 				}
-
-			// Pick the score among the neighbours that is now highest.
-			// This is the core of Smith-Waterman.
-			//
-			if ( current->swn_byte_assigned )
-				current->swn_score = score_tl;
 			else
-				current->swn_score = std::max(std::max(score_t, score_l), score_tl);
-
-			// Establish predecessor chain according to neighbor
-			// with best score.
-			//
-			if ( current->swn_score == score_tl && current->swn_byte_assigned )
 				{
-				// If we had matched bytes (*and* it's the
-				// best neighbor), marke the node accordingly
-				//
-				if ( i >= br_max_b && j >= br_max_r )
-					{
-					node_br_max = current;
-					br_max_b = i;
-					br_max_r = j;
-					}
+				// Pick the score among the neighbours that is highest.
+				// Ties go to the cell above, then to the one to the
+				// left.
+				score = std::max(std::max(score_t, score_l), score_tl);
 
-				current->swn_prev = node_tl;
+				if ( score == score_t )
+					matrix.SetFromTop(i, j);
 				}
-			else if ( current->swn_score == score_t )
-				current->swn_prev = node_t;
-			else
-				current->swn_prev = node_l;
-
-			// Check if we have a new global maximum -- we
-			// specifically track the node that is the global
-			// maximum so we now from where to backtrack at
-			// the end of the matrix iteration.
-			//
-			if ( current->swn_score > matrix_max )
+
+			cur[j] = score;
+
+			if ( score > matrix_max )
 				{
-				node_max = current;
-				matrix_max = current->swn_score;
+				matrix_max = score;
+				max_row = i;
+				max_col = j;
 				}
-
-#if 0
-			printf("%4i/%.5i%c/%.5i[%c%c] ",
-				current->swn_score,
-		 		current->id,
-				current->swn_byte_assigned ? '*' : ' ',
-		 		current->swn_prev ? current->swn_prev->id : 0,
-			       string1[i-1], string2[j-1]);
-#endif
-			// printf("%.5i ", current->swn_score);
 			}
 
-#if 0
-		printf("\n");
-#endif
+		std::swap(prev, cur);
+
+		if ( params._score_threshold && matrix_max >= int(params._score_threshold) )
+			{
+			last_row = i;
+			break;
+			}
 		}
 
 	// Result generation.
 
 	// How we do this depends on the mode we operate in.  In SW_SINGLE, we
-	// follow the path from the best node until there is no predecessor
-	// (that is, when we hit a node in row 0), and stop.  In SW_MULTIPLE,
-	// we collect all non-redundant common subsequences.
+	// follow the path from the best cell until there is no predecessor
+	// (that is, when we hit the first row or column), and stop.  In
+	// SW_MULTIPLE, we collect all non-redundant common subsequences.
 
 	if ( params._sw_variant == SW_MULTIPLE )
-		sw_collect_multiple(result, matrix, params);
-	else
-		sw_collect_single(result, matrix, node_max, params);
+		sw_collect_multiple(result, matrix, last_row, params);
+	else if ( max_row > 0 )
+		sw_collect_single(result, matrix, max_row, max_col, params);
 
 	if ( len1 > len2 )
 		sort(result->begin(), result->end(), SubstringCmp(0));
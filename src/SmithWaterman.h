@@ -122,10 +122,13 @@ enum SWVariant
 //
 struct SWParams
 	{
-	explicit SWParams(unsigned int min_toklen = 3, SWVariant sw_variant = SW_SINGLE)
+	explicit SWParams(unsigned int min_toklen = 3, SWVariant sw_variant = SW_SINGLE,
+	                  unsigned int band = 0, unsigned int score_threshold = 0)
 		{
 		_min_toklen = min_toklen;
 		_sw_variant = sw_variant;
+		_band = band;
+		_score_threshold = score_threshold;
 		}
 
 	// The minimum string size to report.  For example, min_toklen = 2
@@ -133,6 +136,15 @@ struct SWParams
 	unsigned int _min_toklen;
 
 	SWVariant _sw_variant;
+
+	// If non-zero, only align bytes whose offsets differ by at most
+	// this much. That makes time and memory linear in the length of
+	// the strings.
+	unsigned int _band;
+
+	// If non-zero, stop scoring after the first row in which a score
+	// reaches this value.
+	unsigned int _score_threshold;
 	};
 
 // The smith_waterman() algorithm finds the longest common subsequence(s)
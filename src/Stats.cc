@@ -1,17 +1,27 @@
 #include "zeek/Stats.h"
 
+#include <string_view>
+
 #include "zeek/Conn.h"
+#include "zeek/DFA.h"
 #include "zeek/DNS_Mgr.h"
 #include "zeek/Event.h"
 #include "zeek/File.h"
+#include "zeek/Frag.h"
 #include "zeek/Func.h"
 #include "zeek/ID.h"
+#include "zeek/MemoryPool.h"
 #include "zeek/NetVar.h"
+#include "zeek/Reassem.h"
 #include "zeek/RuleMatcher.h"
 #include "zeek/RunState.h"
 #include "zeek/Scope.h"
+#include "zeek/Timer.h"
 #include "zeek/Trigger.h"
+#include "zeek/Val.h"
+#include "zeek/analyzer/Manager.h"
 #include "zeek/broker/Manager.h"
+#include "zeek/file_analysis/Manager.h"
 #include "zeek/input.h"
 #include "zeek/packet_analysis/protocol/tcp/TCP.h"
 #include "zeek/session/Manager.h"
@@ -32,6 +42,66 @@ uint64_t& tot_gap_bytes = zeek::detail::tot_gap_bytes;
 namespace zeek::detail
 	{
 
+StartupStats startup_stats;
+
+void get_memory_stats(MemoryStats* stats)
+	{
+	*stats = {};
+
+	for ( const auto* pool : MemoryPool::Pools() )
+		{
+		MemoryPool::Stats ps;
+		pool->GetStats(&ps);
+		stats->pools += ps.slab_bytes;
+
+		// The pools of the objects making up sessions and files.
+		std::string_view name = ps.name;
+
+		if ( name == "connection" || name == "analyzer" || name == "session-adapter" )
+			stats->sessions += ps.in_use_bytes;
+		else if ( name == "file" )
+			stats->file_analysis += ps.in_use_bytes;
+		}
+
+	auto file_reassembly = Reassembler::MemoryAllocation(REASSEM_FILE);
+	stats->reassembly = Reassembler::TotalMemoryAllocation() - file_reassembly;
+	stats->file_analysis += file_reassembly;
+	stats->dfa_caches = DFA_State_Cache::TotalMemory();
+
+	if ( broker_mgr )
+		stats->broker_buffers = broker_mgr->BufferedBytes();
+
+	util::get_memory_usage(&stats->total, &stats->malloced);
+	}
+
+std::vector<ObjectCount> get_object_counts()
+	{
+	std::vector<ObjectCount> counts;
+	counts.push_back({"Connection", "", Connection::CurrentConnections()});
+
+	for ( const auto& [tag, stats] : analyzer_mgr->GetAllStats() )
+		if ( stats.instances )
+			counts.push_back({"Analyzer", analyzer_mgr->GetComponentName(tag), stats.instances});
+
+	counts.push_back({"File", "", file_mgr->CurrentFiles()});
+
+	auto timers = TimerMgr::CurrentTimers();
+
+	for ( int i = 0; i < NUM_TIMER_TYPES; ++i )
+		if ( timers[i] )
+			counts.push_back({"Timer", timer_type_to_string(static_cast<TimerType>(i)), timers[i]});
+
+	auto vals = Val::LiveCounts();
+
+	for ( int i = 0; i < NUM_TYPES; ++i )
+		if ( vals[i] )
+			counts.push_back({"Val", type_name(static_cast<TypeTag>(i)), vals[i]});
+
+	counts.push_back({"DFA_State", "", DFA_State_Cache::TotalStates()});
+
+	return counts;
+	}
+
 class ProfileTimer final : public Timer
 	{
 public:
@@ -121,6 +191,18 @@ void ProfileLogger::Log()
 		"%.06f Memory: total=%" PRId64 "K total_adj=%" PRId64 "K malloced: %" PRId64 "K\n",
 		run_state::network_time, total / 1024, (total - first_total) / 1024, malloced / 1024));
 
+#ifdef ZEEK_MEMORY_POOLS
+	for ( const auto* pool : detail::MemoryPool::Pools() )
+		{
+		detail::MemoryPool::Stats ps;
+		pool->GetStats(&ps);
+		file->Write(util::fmt("%.06f Pool %s: in_use=%" PRIu64 " (%" PRIu64 "K) slabs=%" PRIu64
+		                      "K allocs=%" PRIu64 " fallbacks=%" PRIu64 "\n",
+		                      run_state::network_time, ps.name, ps.in_use, ps.in_use_bytes / 1024,
+		                      ps.slab_bytes / 1024, ps.allocations, ps.fallbacks));
+		}
+#endif
+
 	file->Write(util::fmt("%.06f Run-time: user+sys=%.1f user=%.1f sys=%.1f real=%.1f\n",
 	                      run_state::network_time, (utime + stime) - (first_utime + first_stime),
 	                      utime - first_utime, stime - first_stime, rtime - first_rtime));
@@ -138,6 +220,32 @@ void ProfileLogger::Log()
 	                      run_state::network_time, s.num_TCP_conns, s.max_TCP_conns,
 	                      s.num_UDP_conns, s.max_UDP_conns, s.num_ICMP_conns, s.max_ICMP_conns));
 
+	file->Write(util::fmt("%.06f Sessions: table=%zu lookups=%" PRIu64 " probes=%" PRIu64
+	                      " max_probe=%" PRIu64 "\n",
+	                      run_state::network_time, s.table_capacity, s.table_lookups,
+	                      s.table_probes, s.table_max_probe_length));
+
+	if ( s.num_shards > 1 )
+		file->Write(util::fmt("%.06f Sessions: shards=%zu largest=%zu\n", run_state::network_time,
+		                      s.num_shards, s.max_shard_size));
+
+	if ( zeek::detail::embryonic_sessions )
+		file->Write(util::fmt("%.06f Embryonic: current=%zu total=%" PRIu64 " promoted=%" PRIu64
+		                      "\n",
+		                      run_state::network_time, s.num_embryonic, s.cumulative_embryonic,
+		                      s.promoted_embryonic));
+
+	if ( auto* table = detail::fragment_mgr->CompactTable() )
+		{
+		detail::FragmentTable::Stats fs;
+		table->GetStats(&fs);
+		file->Write(util::fmt("%.06f Fragments: current=%zu max=%zu mem=%" PRIu64
+		                      "K evicted_capacity=%" PRIu64 " evicted_memory=%" PRIu64
+		                      " expired=%" PRIu64 "\n",
+		                      run_state::network_time, fs.size, fs.max_size, fs.memory / 1024,
+		                      fs.capacity_evictions, fs.memory_evictions, fs.expired));
+		}
+
 	packet_analysis::TCP::TCPAnalyzer::GetStats().PrintStats(
 		file, util::fmt("%.06f TCP-States:", run_state::network_time));
 
@@ -170,6 +278,10 @@ void ProfileLogger::Log()
 		                      "ncomputed=%d mem=%dK\n",
 		                      run_state::network_time, stats.matchers, stats.nfa_states,
 		                      stats.dfa_states, stats.computed, stats.mem / 1024));
+		file->Write(util::fmt("%06f RuleMatcher: prefiltered=%d prefilter_scans=%" PRIu64
+		                      " prefilter_hits=%" PRIu64 "\n",
+		                      run_state::network_time, stats.prefiltered, stats.prefilter_scans,
+		                      stats.prefilter_hits));
 		}
 	file->Write(util::fmt("%.06f Timers: current=%zu max=%zu lag=%.2fs\n", run_state::network_time,
 	                      timer_mgr->Size(), timer_mgr->PeakSize(),
@@ -235,6 +347,8 @@ void ProfileLogger::Log()
 		{
 		int total_table_entries = 0;
 		int total_table_rentries = 0;
+		uint64_t total_table_mem = 0;
+		int total_table_heap_keys = 0;
 
 		for ( const auto& global : globals )
 			{
@@ -249,12 +363,20 @@ void ProfileLogger::Log()
 				bool print = false;
 				int entries = -1;
 				int rentries = -1;
+				uint64_t mem = 0;
+				int heap_keys = 0;
 
 				if ( v->GetType()->Tag() == TYPE_TABLE )
 					{
 					entries = v->AsTable()->Length();
 					total_table_entries += entries;
 
+					const auto* dict = v->AsTableVal()->Get();
+					mem = dict->MemoryAllocation();
+					heap_keys = dict->HeapKeys();
+					total_table_mem += mem;
+					total_table_heap_keys += heap_keys;
+
 					// ### 100 shouldn't be hardwired
 					// in here.
 					if ( entries >= 100 )
@@ -268,14 +390,18 @@ void ProfileLogger::Log()
 
 				if ( print && entries >= 0 )
 					{
-					file->Write(util::fmt("%.06f                %d/%d entries\n",
-					                      run_state::network_time, entries, rentries));
+					file->Write(util::fmt("%.06f                %d/%d entries mem=%" PRIu64
+					                      "K bytes/entry=%" PRIu64 " heap_keys=%d\n",
+					                      run_state::network_time, entries, rentries, mem / 1024,
+					                      mem / (entries ? entries : 1), heap_keys));
 					}
 				}
 			}
 
-		file->Write(util::fmt("%.06f Total number of table entries: %d/%d\n",
-		                      run_state::network_time, total_table_entries, total_table_rentries));
+		file->Write(util::fmt("%.06f Total number of table entries: %d/%d mem=%" PRIu64
+		                      "K heap_keys=%d\n",
+		                      run_state::network_time, total_table_entries, total_table_rentries,
+		                      total_table_mem / 1024, total_table_heap_keys));
 		}
 
 	// Create an event so that scripts can log their information, too.
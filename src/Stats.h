@@ -9,6 +9,8 @@
 #include <sys/types.h>
 #include <cstdint>
 #include <memory>
+#include <string>
+#include <vector>
 
 namespace zeek
 	{
@@ -107,6 +109,49 @@ protected:
 	TableVal* load_samples;
 	};
 
+// Memory in use by the core's main consumers, in bytes. Each part comes
+// from a running total or a short list of buffers, so collecting them is
+// cheap enough to do often.
+struct MemoryStats
+	{
+	uint64_t sessions = 0; //< Connections and their analyzers, if allocated from memory pools.
+	uint64_t reassembly = 0; //< Data buffered by stream and fragment reassembly.
+	uint64_t dfa_caches = 0; //< The states of the regular expressions' DFAs.
+	uint64_t file_analysis = 0; //< Files (if allocated from memory pools) and their buffered data.
+	uint64_t broker_buffers = 0; //< Messages waiting to be published.
+	uint64_t pools = 0; //< Slabs the memory pools allocated.
+	uint64_t malloced = 0; //< Memory allocated through malloc, if known.
+	uint64_t total = 0; //< The process's peak resident size.
+	};
+
+void get_memory_stats(MemoryStats* stats);
+
+// The number of objects of a class alive, for those classes whose
+// instances typically pile up when something leaks. Classes split by a
+// type name count separately per type.
+struct ObjectCount
+	{
+	std::string cls; //< "Connection", "Analyzer", "File", "Timer", "Val" or "DFA_State".
+	std::string type; //< The analyzer, timer or value type; empty if not split.
+	uint64_t count = 0;
+	};
+
+// Types without objects alive get left out. Like get_memory_stats(), this
+// only reads counters that the classes maintain anyway.
+std::vector<ObjectCount> get_object_counts();
+
+// How long the phases of startup took, in seconds of wall-clock time.
+struct StartupStats
+	{
+	double parse = 0.0; //< Scanning and parsing the scripts.
+	double init = 0.0; //< Setting up the managers for what the scripts define.
+	double optimize = 0.0; //< Analyzing and compiling the scripts, per -O.
+	double zeek_init = 0.0; //< Top-level statements and the zeek_init handlers.
+	double total = 0.0; //< From the start of the process on.
+	};
+
+extern StartupStats startup_stats;
+
 extern std::shared_ptr<ProfileLogger> profiling_logger;
 extern std::shared_ptr<ProfileLogger> segment_logger;
 extern std::shared_ptr<SampleLogger> sample_logger;
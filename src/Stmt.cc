@@ -849,6 +849,46 @@ SwitchStmt::SwitchStmt(ExprPtr index, case_list* arg_cases)
 
 	if ( have_exprs && have_types )
 		Error("cannot mix cases with expressions and types");
+
+	if ( have_exprs && ! have_types )
+		InitCaseTables();
+	}
+
+void SwitchStmt::InitCaseTables()
+	{
+	auto it = e->GetType()->InternalType();
+
+	for ( const auto& [v, idx] : case_label_value_map )
+		{
+		switch ( it )
+			{
+			case TYPE_INTERNAL_INT:
+				int_case_table.Insert(v->InternalInt(), idx);
+				break;
+
+			case TYPE_INTERNAL_UNSIGNED:
+				uint_case_table.Insert(v->InternalUnsigned(), idx);
+				break;
+
+			case TYPE_INTERNAL_STRING:
+				{
+				auto s = v->AsString();
+				str_case_table.Insert(std::string(reinterpret_cast<const char*>(s->Bytes()),
+				                                  s->Len()),
+				                      idx);
+				break;
+				}
+
+			default:
+				// Addresses, subnets and doubles stay with hashing.
+				return;
+			}
+		}
+
+	int_case_table.Build();
+	uint_case_table.Build();
+	str_case_table.Build();
+	case_table_type = it;
 	}
 
 SwitchStmt::~SwitchStmt()
@@ -900,6 +940,26 @@ std::pair<int, ID*> SwitchStmt::FindCaseLabelMatch(const Val* v) const
 	int label_idx = -1;
 	ID* label_id = nullptr;
 
+	switch ( case_table_type )
+		{
+		case TYPE_INTERNAL_INT:
+			return {int_case_table.Lookup(v->InternalInt(), default_case_idx), nullptr};
+
+		case TYPE_INTERNAL_UNSIGNED:
+			return {uint_case_table.Lookup(v->InternalUnsigned(), default_case_idx), nullptr};
+
+		case TYPE_INTERNAL_STRING:
+			{
+			auto s = v->AsString();
+			return {str_case_table.Lookup(reinterpret_cast<const char*>(s->Bytes()), s->Len(),
+			                              default_case_idx),
+			        nullptr};
+			}
+
+		default:
+			break;
+		}
+
 	// Find matching expression cases.
 	if ( case_label_hash_map.Length() )
 		{
@@ -1330,9 +1390,9 @@ ValPtr ForStmt::DoExec(Frame* f, Val* v, StmtFlowType& flow)
 
 		for ( const auto& lve : *loop_vals )
 			{
-			auto k = lve.GetHashKey();
+			auto k = lve.GetHashKeyView();
 			auto* current_tev = lve.value;
-			auto ind_lv = tv->RecreateIndex(*k);
+			auto ind_lv = tv->RecreateIndex(k);
 
 			if ( value_var )
 				f->SetElement(value_var, current_tev->GetVal());
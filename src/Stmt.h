@@ -4,6 +4,7 @@
 
 // Zeek statements.
 
+#include "zeek/CaseTable.h"
 #include "zeek/Dict.h"
 #include "zeek/Expr.h"
 #include "zeek/ID.h"
@@ -223,12 +224,23 @@ protected:
 	// the matching type-based case if it defines one.
 	std::pair<int, ID*> FindCaseLabelMatch(const Val* v) const;
 
+	// Sets up the direct lookup of integer and string case labels, for
+	// switches without type cases.
+	void InitCaseTables();
+
 	case_list* cases;
 	int default_case_idx;
 	CompositeHash* comp_hash;
 	std::unordered_map<const Val*, int> case_label_value_map;
 	PDict<int> case_label_hash_map;
 	std::vector<std::pair<ID*, int>> case_label_type_list;
+
+	// The case labels by value for switches on integers or strings, which
+	// FindCaseLabelMatch() consults instead of hashing the value.
+	InternalTypeTag case_table_type = TYPE_INTERNAL_VOID;
+	IntCaseTable<zeek_int_t> int_case_table;
+	IntCaseTable<zeek_uint_t> uint_case_table;
+	StrCaseTable str_case_table;
 	};
 
 // Helper class. Added for script optimization, but it makes sense
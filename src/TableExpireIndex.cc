@@ -0,0 +1,135 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/TableExpireIndex.h"
+
+#include <cstring>
+#include <string>
+
+#include "zeek/3rdparty/doctest.h"
+
+namespace zeek::detail
+	{
+
+TableExpireIndex::TableExpireIndex(int arg_width) : width(arg_width > 0 ? arg_width : 1) { }
+
+void TableExpireIndex::Add(int bucket, const void* key, uint32_t key_size, hash_t hash)
+	{
+	auto& keys = buckets[bucket];
+	auto n = keys.size();
+
+	keys.resize(n + sizeof(key_size) + sizeof(hash) + key_size);
+	memcpy(&keys[n], &key_size, sizeof(key_size));
+	memcpy(&keys[n + sizeof(key_size)], &hash, sizeof(hash));
+	memcpy(&keys[n + sizeof(key_size) + sizeof(hash)], key, key_size);
+
+	++size;
+	}
+
+bool TableExpireIndex::Next(double due, Key* k)
+	{
+	while ( current_pos >= current.size() )
+		{
+		auto it = scanned ? buckets.upper_bound(current_bucket) : buckets.begin();
+
+		if ( it == buckets.end() || double(it->first) * width >= due )
+			{
+			current.clear();
+			current_pos = 0;
+			return false;
+			}
+
+		current = std::move(it->second);
+		current_pos = 0;
+		current_bucket = it->first;
+		scanned = true;
+		buckets.erase(it);
+		}
+
+	memcpy(&k->size, &current[current_pos], sizeof(k->size));
+	current_pos += sizeof(k->size);
+	memcpy(&k->hash, &current[current_pos], sizeof(k->hash));
+	current_pos += sizeof(k->hash);
+	k->key = &current[current_pos];
+	current_pos += k->size;
+	k->bucket = current_bucket;
+
+	--size;
+	return true;
+	}
+
+void TableExpireIndex::Clear()
+	{
+	buckets.clear();
+	current.clear();
+	current_pos = 0;
+	size = 0;
+	}
+
+size_t TableExpireIndex::MemoryAllocation() const
+	{
+	size_t mem = sizeof(*this) + current.capacity();
+
+	for ( const auto& [bucket, keys] : buckets )
+		mem += sizeof(bucket) + sizeof(keys) + keys.capacity();
+
+	return mem;
+	}
+
+TEST_SUITE_BEGIN("TableExpireIndex");
+
+TEST_CASE("table expire index buckets")
+	{
+	TableExpireIndex idx(10);
+
+	CHECK(idx.Bucket(0) == 0);
+	CHECK(idx.Bucket(9) == 0);
+	CHECK(idx.Bucket(10) == 1);
+	CHECK(idx.Bucket(-1) == -1);
+	CHECK(idx.Bucket(-10) == -1);
+	CHECK(idx.Bucket(-11) == -2);
+	}
+
+TEST_CASE("table expire index scan")
+	{
+	TableExpireIndex idx(10);
+	TableExpireIndex::Key k;
+
+	idx.Add(idx.Bucket(25), "c", 1, 3);
+	idx.Add(idx.Bucket(5), "a", 1, 1);
+	idx.Add(idx.Bucket(7), "bb", 2, 2);
+	CHECK(idx.Size() == 3);
+
+	// Only the first bucket starts before time 10.
+	idx.BeginScan();
+	REQUIRE(idx.Next(10, &k));
+	CHECK(std::string(k.key, k.size) == "a");
+	CHECK(k.hash == 1);
+	CHECK(k.bucket == 0);
+
+	REQUIRE(idx.Next(10, &k));
+	CHECK(std::string(k.key, k.size) == "bb");
+	CHECK(k.hash == 2);
+
+	// Keys added back to a bucket come up again only in the next scan.
+	idx.Add(k.bucket, k.key, k.size, k.hash);
+	CHECK_FALSE(idx.Next(10, &k));
+	CHECK(idx.Size() == 2);
+
+	idx.BeginScan();
+	REQUIRE(idx.Next(30, &k));
+	CHECK(std::string(k.key, k.size) == "bb");
+	REQUIRE(idx.Next(30, &k));
+	CHECK(std::string(k.key, k.size) == "c");
+	CHECK(k.bucket == 2);
+	CHECK_FALSE(idx.Next(30, &k));
+	CHECK(idx.Size() == 0);
+
+	idx.Add(0, "d", 1, 4);
+	idx.Clear();
+	idx.BeginScan();
+	CHECK_FALSE(idx.Next(30, &k));
+	}
+
+TEST_SUITE_END();
+
+	} // namespace zeek::detail
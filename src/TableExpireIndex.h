@@ -0,0 +1,115 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+#include "zeek/Hash.h"
+
+namespace zeek::detail
+	{
+
+/**
+ * An index of a table's keys by the time of their entries' most recent
+ * expiration-relevant access, so that expiring the table only needs to look
+ * at entries that may be due. The index keeps copies of the keys in buckets
+ * spanning a fixed number of seconds each. It doesn't follow accesses as
+ * they happen: entries move to a later bucket only once their bucket comes
+ * due and they turn out not to be, and keys of entries that went away get
+ * dropped at that point.
+ *
+ * Times are in seconds since Zeek's start, as TableEntryVal keeps them.
+ */
+class TableExpireIndex
+	{
+public:
+	/**
+	 * A key found by Next(). Its bytes remain valid until the next call
+	 * to Next() or Clear().
+	 */
+	struct Key
+		{
+		const char* key;
+		uint32_t size;
+		hash_t hash;
+		int bucket;
+		};
+
+	/**
+	 * Constructor.
+	 *
+	 * @param width The number of seconds each bucket spans, at least 1.
+	 */
+	explicit TableExpireIndex(int width);
+
+	/**
+	 * Returns the bucket for entries accessed at the given time.
+	 */
+	int Bucket(int access_time) const
+		{
+		// Round down for times before Zeek's start, too.
+		return access_time >= 0 ? access_time / width : -((-access_time - 1) / width) - 1;
+		}
+
+	/**
+	 * Adds a key to a bucket.
+	 */
+	void Add(int bucket, const void* key, uint32_t size, hash_t hash);
+
+	/**
+	 * Starts looking for keys anew. Next() returns each key at most once
+	 * between calls to this, except for those it's in the middle of a
+	 * bucket of.
+	 */
+	void BeginScan() { scanned = false; }
+
+	/**
+	 * Returns the next key from the buckets that start before the given
+	 * time, taking it out of the index. Keys of entries that aren't due
+	 * yet need to be added back.
+	 *
+	 * @param due Buckets starting before this time are due.
+	 *
+	 * @param k Receives the key.
+	 *
+	 * @return False if there's no more key in due buckets.
+	 */
+	bool Next(double due, Key* k);
+
+	/**
+	 * Drops all keys.
+	 */
+	void Clear();
+
+	/**
+	 * Returns the number of keys in the index, including those of
+	 * entries that went away since.
+	 */
+	size_t Size() const { return size; }
+
+	/**
+	 * Returns the memory that the index takes up, in bytes.
+	 */
+	size_t MemoryAllocation() const;
+
+private:
+	int width;
+	size_t size = 0;
+
+	// Per bucket, the keys' sizes, hashes and bytes, one after the other.
+	std::map<int, std::vector<char>> buckets;
+
+	// The bucket that Next() takes keys from, and where it is in it.
+	std::vector<char> current;
+	size_t current_pos = 0;
+	int current_bucket = 0;
+
+	// True if Next() took a bucket since BeginScan(), the latest being
+	// the current one.
+	bool scanned = false;
+	};
+
+	} // namespace zeek::detail
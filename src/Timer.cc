@@ -10,6 +10,7 @@
 #include "zeek/broker/Manager.h"
 #include "zeek/iosource/Manager.h"
 #include "zeek/iosource/PktSrc.h"
+#include "zeek/telemetry/Manager.h"
 #include "zeek/util.h"
 
 namespace zeek::detail
@@ -57,6 +58,30 @@ const char* timer_type_to_string(TimerType type)
 	return TimerNames[type];
 	}
 
+namespace
+	{
+
+// Counts the timers fired per type. Called for every timer, hence sharded.
+void count_fired(TimerType type)
+	{
+	static telemetry::ShardedIntCounter* fired[NUM_TIMER_TYPES] = {};
+
+	if ( ! fired[type] )
+		{
+		if ( ! telemetry_mgr )
+			return;
+
+		auto family = telemetry_mgr->CounterFamily("zeek", "timers-fired", {"type"},
+		                                           "Timers dispatched", "1", true);
+		fired[type] = new telemetry::ShardedIntCounter(
+			family.GetOrAdd({{"type", TimerNames[type]}}));
+		}
+
+	fired[type]->Inc();
+	}
+
+	} // namespace
+
 void Timer::Describe(ODesc* d) const
 	{
 	d->Add(TimerNames[type]);
@@ -111,6 +136,23 @@ void TimerMgr::InitPostScript()
 	{
 	if ( iosource_mgr )
 		iosource_mgr->Register(this, true);
+
+	if ( use_timer_wheel )
+		UseTimerWheel();
+	}
+
+void TimerMgr::UseTimerWheel()
+	{
+	if ( wheel )
+		return;
+
+	wheel = std::make_unique<TimerWheel>();
+
+	while ( auto* timer = q->Remove() )
+		{
+		wheel->Add(timer);
+		++moved_to_wheel;
+		}
 	}
 
 void TimerMgr::Add(Timer* timer)
@@ -121,7 +163,10 @@ void TimerMgr::Add(Timer* timer)
 	// Add the timer even if it's already expired - that way, if
 	// multiple already-added timers are added, they'll still
 	// execute in sorted order.
-	if ( ! q->Add(timer) )
+	if ( wheel )
+		wheel->Add(timer);
+
+	else if ( ! q->Add(timer) )
 		reporter->InternalError("out of memory");
 
 	++current_timers[timer->Type()];
@@ -130,9 +175,10 @@ void TimerMgr::Add(Timer* timer)
 void TimerMgr::Expire()
 	{
 	Timer* timer;
-	while ( (timer = Remove()) )
+	while ( Top(HUGE_VAL) && (timer = Remove()) )
 		{
 		DBG_LOG(DBG_TM, "Dispatching timer %s (%p)", timer_type_to_string(timer->Type()), timer);
+		count_fired(timer->Type());
 		timer->Dispatch(t, true);
 		--current_timers[timer->Type()];
 		delete timer;
@@ -141,9 +187,8 @@ void TimerMgr::Expire()
 
 int TimerMgr::DoAdvance(double new_t, int max_expire)
 	{
-	Timer* timer = Top();
-	for ( num_expired = 0; (num_expired < max_expire) && timer && timer->Time() <= new_t;
-	      ++num_expired )
+	Timer* timer = Top(new_t);
+	for ( num_expired = 0; (num_expired < max_expire) && timer; ++num_expired )
 		{
 		last_timestamp = timer->Time();
 		--current_timers[timer->Type()];
@@ -154,10 +199,18 @@ int TimerMgr::DoAdvance(double new_t, int max_expire)
 		(void)Remove();
 
 		DBG_LOG(DBG_TM, "Dispatching timer %s (%p)", timer_type_to_string(timer->Type()), timer);
+		count_fired(timer->Type());
 		timer->Dispatch(new_t, false);
-		delete timer;
 
-		timer = Top();
+		if ( timer->rearm )
+			{
+			timer->rearm = false;
+			Add(timer);
+			}
+		else
+			delete timer;
+
+		timer = Top(new_t);
 		}
 
 	return num_expired;
@@ -165,7 +218,7 @@ int TimerMgr::DoAdvance(double new_t, int max_expire)
 
 void TimerMgr::Remove(Timer* timer)
 	{
-	if ( ! q->Remove(timer) )
+	if ( ! (wheel ? wheel->Remove(timer) : q->Remove(timer)) )
 		reporter->InternalError("asked to remove a missing timer");
 
 	--current_timers[timer->Type()];
@@ -174,7 +227,16 @@ void TimerMgr::Remove(Timer* timer)
 
 double TimerMgr::GetNextTimeout()
 	{
-	Timer* top = Top();
+	if ( wheel )
+		{
+		double next = wheel->NextTime();
+		if ( next >= 0 )
+			return std::max(0.0, next - run_state::network_time);
+
+		return -1;
+		}
+
+	Timer* top = (Timer*)q->Top();
 	if ( top )
 		return std::max(0.0, top->Time() - run_state::network_time);
 
@@ -183,12 +245,19 @@ double TimerMgr::GetNextTimeout()
 
 Timer* TimerMgr::Remove()
 	{
+	if ( wheel )
+		return (Timer*)wheel->RemoveTop();
+
 	return (Timer*)q->Remove();
 	}
 
-Timer* TimerMgr::Top()
+Timer* TimerMgr::Top(double t)
 	{
-	return (Timer*)q->Top();
+	if ( wheel )
+		return (Timer*)wheel->Top(t);
+
+	Timer* top = (Timer*)q->Top();
+	return top && top->Time() <= t ? top : nullptr;
 	}
 
 	} // namespace zeek::detail
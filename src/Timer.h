@@ -2,10 +2,12 @@
 
 #pragma once
 
+#include <algorithm>
 #include <cstdint>
 #include <memory>
 
 #include "zeek/PriorityQueue.h"
+#include "zeek/TimerWheel.h"
 #include "zeek/iosource/IOSource.h"
 
 namespace zeek
@@ -73,7 +75,26 @@ public:
 	void Describe(ODesc* d) const;
 
 protected:
+	/**
+	 * Makes the timer fire again at time t rather than getting deleted once
+	 * Dispatch() returns. This is cheaper than adding a new timer, which
+	 * matters for timers that mostly just find their deadline has moved.
+	 * Only valid from within a Dispatch() that isn't expiring timers.
+	 *
+	 * @param t the new dispatch time.
+	 */
+	void Rearm(double t)
+		{
+		time = t;
+		rearm = true;
+		}
+
 	TimerType type{};
+
+private:
+	friend class TimerMgr;
+
+	bool rearm = false;
 	};
 
 class TimerMgr final : public iosource::IOSource
@@ -116,9 +137,16 @@ public:
 
 	double Time() const { return t ? t : 1; } // 1 > 0
 
-	size_t Size() const { return q->Size(); }
-	size_t PeakSize() const { return q->PeakSize(); }
-	size_t CumulativeNum() const { return q->CumulativeNum(); }
+	size_t Size() const { return wheel ? wheel->Size() : q->Size(); }
+	size_t PeakSize() const
+		{
+		return wheel ? std::max<size_t>(wheel->PeakSize(), q->PeakSize()) : q->PeakSize();
+		}
+	size_t CumulativeNum() const
+		{
+		return wheel ? q->CumulativeNum() + wheel->CumulativeNum() - moved_to_wheel
+		             : q->CumulativeNum();
+		}
 
 	double LastTimestamp() const { return last_timestamp; }
 
@@ -136,16 +164,32 @@ public:
 
 	/**
 	 * Performs some extra initialization on a timer manager. This shouldn't
-	 * need to be called for managers other than the global one.
+	 * need to be called for managers other than the global one. If
+	 * configured through the ``use_timer_wheel`` script constant, this
+	 * switches the manager to keeping its timers in a TimerWheel.
 	 */
 	void InitPostScript();
 
+	/**
+	 * Returns true if the timers are kept in a TimerWheel rather than in a
+	 * binary heap.
+	 */
+	bool UsingTimerWheel() const { return wheel != nullptr; }
+
+	/**
+	 * Switches to keeping timers in a TimerWheel, moving over all pending
+	 * timers.
+	 */
+	void UseTimerWheel();
+
 private:
 	int DoAdvance(double t, int max_expire);
 	void Remove(Timer* timer);
 
 	Timer* Remove();
-	Timer* Top();
+
+	// Returns the earliest timer if it's due by time t, or nullptr.
+	Timer* Top(double t);
 
 	double t;
 	double last_timestamp;
@@ -158,6 +202,12 @@ private:
 
 	static unsigned int current_timers[NUM_TIMER_TYPES];
 	std::unique_ptr<PriorityQueue> q;
+
+	// If set, all timers live here instead of in q.
+	std::unique_ptr<TimerWheel> wheel;
+
+	// The number of timers that were in q when switching to the wheel.
+	size_t moved_to_wheel = 0;
 	};
 
 extern TimerMgr* timer_mgr;
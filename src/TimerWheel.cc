@@ -0,0 +1,337 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/TimerWheel.h"
+
+#include <algorithm>
+
+#include "zeek/3rdparty/doctest.h"
+
+namespace zeek::detail
+	{
+
+TimerWheel::TimerWheel(double arg_resolution) : resolution(arg_resolution) { }
+
+TimerWheel::~TimerWheel()
+	{
+	for ( auto& slot : slots )
+		for ( auto* e : slot )
+			delete e;
+	}
+
+uint64_t TimerWheel::Tick(double t) const
+	{
+	if ( ! (t > 0) )
+		return 0;
+
+	// Clamp far-out (or infinite) times, which all land in the
+	// overflow heap anyway.
+	double ticks = t / resolution;
+	constexpr uint64_t max_tick = uint64_t(1) << 62;
+
+	if ( ticks >= static_cast<double>(max_tick) )
+		return max_tick;
+
+	return static_cast<uint64_t>(ticks);
+	}
+
+void TimerWheel::Add(PQ_Element* e)
+	{
+	Insert(e);
+
+	++cumulative_num;
+
+	if ( ++size > peak_size )
+		peak_size = size;
+	}
+
+void TimerWheel::Insert(PQ_Element* e)
+	{
+	uint64_t tick = Tick(e->Time());
+
+	if ( tick <= now_tick )
+		{
+		ready.Add(e);
+		return;
+		}
+
+	// Use the lowest level on which the element's slot comes up before
+	// the level wraps around, i.e., where all higher bits of the tick
+	// match the current one.
+	for ( int level = 0; level < LEVELS; ++level )
+		{
+		int shift = SLOT_BITS * (level + 1);
+
+		if ( (tick >> shift) != (now_tick >> shift) )
+			continue;
+
+		int slot = (tick >> (SLOT_BITS * level)) & (SLOTS - 1);
+		auto& v = slots[level * SLOTS + slot];
+
+		e->SetWheelSlot(level * SLOTS + slot);
+		e->SetOffset(v.size());
+		v.push_back(e);
+		occupied[level][slot / 64] |= uint64_t(1) << (slot % 64);
+		return;
+		}
+
+	overflow.Add(e);
+	}
+
+void TimerWheel::Unlink(PQ_Element* e)
+	{
+	int idx = e->WheelSlot();
+	auto& v = slots[idx];
+
+	PQ_Element* last = v.back();
+	v[e->Offset()] = last;
+	last->SetOffset(e->Offset());
+	v.pop_back();
+
+	if ( v.empty() )
+		{
+		int level = idx / SLOTS;
+		int slot = idx % SLOTS;
+		occupied[level][slot / 64] &= ~(uint64_t(1) << (slot % 64));
+		}
+
+	e->SetWheelSlot(-1);
+	e->SetOffset(-1);
+	}
+
+PQ_Element* TimerWheel::Remove(PQ_Element* e)
+	{
+	if ( e->WheelSlot() >= 0 )
+		Unlink(e);
+
+	else if ( ! ready.Remove(e) && ! overflow.Remove(e) )
+		return nullptr;
+
+	--size;
+	return e;
+	}
+
+int TimerWheel::NextOccupied(int level, int slot) const
+	{
+	for ( int word = (slot + 1) / 64; word < SLOTS / 64; ++word )
+		{
+		uint64_t bits = occupied[level][word];
+
+		// Mask out the bits up to and including the given slot.
+		if ( word == (slot + 1) / 64 )
+			bits &= ~uint64_t(0) << ((slot + 1) % 64);
+
+		if ( bits )
+			return word * 64 + __builtin_ctzll(bits);
+		}
+
+	return -1;
+	}
+
+uint64_t TimerWheel::NextEventTick() const
+	{
+	uint64_t next = NO_TICK;
+
+	for ( int level = 0; level < LEVELS; ++level )
+		{
+		int shift = SLOT_BITS * level;
+		int pos = (now_tick >> shift) & (SLOTS - 1);
+		int slot = NextOccupied(level, pos);
+
+		if ( slot < 0 )
+			continue;
+
+		// The tick at which the wheel reaches the slot.
+		uint64_t base = (now_tick >> (shift + SLOT_BITS)) << (shift + SLOT_BITS);
+		next = std::min(next, base | (uint64_t(slot) << shift));
+		}
+
+	if ( auto* e = overflow.Top() )
+		{
+		// Overflow elements get pulled in once the top level's range
+		// covers them.
+		int shift = SLOT_BITS * LEVELS;
+		uint64_t start = (Tick(e->Time()) >> shift) << shift;
+		next = std::min(next, std::max(start, now_tick + 1));
+		}
+
+	return next;
+	}
+
+void TimerWheel::TurnTo(uint64_t tick)
+	{
+	now_tick = tick;
+
+	std::vector<PQ_Element*> moving;
+
+	auto take = [&](int level, int slot)
+	{
+		auto& v = slots[level * SLOTS + slot];
+
+		if ( v.empty() )
+			return;
+
+		moving.insert(moving.end(), v.begin(), v.end());
+		v.clear();
+		occupied[level][slot / 64] &= ~(uint64_t(1) << (slot % 64));
+	};
+
+	while ( auto* e = overflow.Top() )
+		{
+		int shift = SLOT_BITS * LEVELS;
+		if ( (Tick(e->Time()) >> shift) > (now_tick >> shift) )
+			break;
+
+		moving.push_back(overflow.Remove());
+		}
+
+	// Distribute the slots the wheel just reached. Elements move to
+	// lower levels, or into the ready heap if they're due now.
+	for ( int level = LEVELS - 1; level >= 0; --level )
+		{
+		int shift = SLOT_BITS * level;
+
+		if ( tick & ((uint64_t(1) << shift) - 1) )
+			// Not at a slot boundary on this level.
+			continue;
+
+		take(level, (tick >> shift) & (SLOTS - 1));
+		}
+
+	for ( auto* e : moving )
+		{
+		e->SetWheelSlot(-1);
+		Insert(e);
+		}
+	}
+
+PQ_Element* TimerWheel::Top(double t)
+	{
+	uint64_t to = Tick(t);
+
+	while ( ready.Size() == 0 && now_tick < to )
+		{
+		uint64_t next = NextEventTick();
+
+		if ( next > to )
+			{
+			// Nothing in between, skip ahead.
+			now_tick = to;
+			break;
+			}
+
+		TurnTo(next);
+		}
+
+	PQ_Element* top = ready.Top();
+	return top && top->Time() <= t ? top : nullptr;
+	}
+
+PQ_Element* TimerWheel::RemoveTop()
+	{
+	PQ_Element* e = ready.Remove();
+
+	if ( e )
+		--size;
+
+	return e;
+	}
+
+double TimerWheel::NextTime() const
+	{
+	if ( auto* e = ready.Top() )
+		return e->Time();
+
+	uint64_t next = NextEventTick();
+
+	if ( next == NO_TICK )
+		return -1;
+
+	// Elements of a tick are due no earlier than its start.
+	return next * resolution;
+	}
+
+TEST_SUITE_BEGIN("TimerWheel");
+
+TEST_CASE("timer wheel order")
+	{
+	TimerWheel w(0.001);
+	std::vector<double> times = {5.0, 0.0005, 70.0, 0.0004, 3600.0, 1e7, 0.5, 70.0, 259.0};
+
+	for ( auto t : times )
+		w.Add(new PQ_Element(t));
+
+	CHECK(w.Size() == static_cast<int>(times.size()));
+
+	std::sort(times.begin(), times.end());
+
+	for ( auto t : times )
+		{
+		CHECK(w.Top(t - 0.0001) == nullptr);
+
+		auto* e = w.Top(t);
+		REQUIRE(e);
+		CHECK(e->Time() == t);
+		CHECK(w.RemoveTop() == e);
+		delete e;
+		}
+
+	CHECK(w.Size() == 0);
+	CHECK(w.Top(HUGE_VAL) == nullptr);
+	CHECK(w.NextTime() == -1);
+	}
+
+TEST_CASE("timer wheel cancel")
+	{
+	TimerWheel w(0.001);
+	std::vector<PQ_Element*> elems;
+
+	for ( int i = 0; i < 1000; ++i )
+		{
+		elems.push_back(new PQ_Element(i * 1.7));
+		w.Add(elems.back());
+		}
+
+	// Cancel every other one, some after the wheel started turning.
+	CHECK(w.Top(200) != nullptr);
+
+	for ( int i = 0; i < 1000; i += 2 )
+		CHECK(w.Remove(elems[i]) == elems[i]);
+
+	for ( int i = 0; i < 1000; i += 2 )
+		{
+		CHECK(w.Remove(elems[i]) == nullptr);
+		delete elems[i];
+		}
+
+	CHECK(w.Size() == 500);
+
+	for ( int i = 1; i < 1000; i += 2 )
+		{
+		auto* e = w.Top(HUGE_VAL);
+		REQUIRE(e == elems[i]);
+		w.RemoveTop();
+		delete e;
+		}
+
+	CHECK(w.Size() == 0);
+	}
+
+TEST_CASE("timer wheel adds in the past")
+	{
+	TimerWheel w(0.001);
+	w.Add(new PQ_Element(100.0));
+	CHECK(w.Top(50) == nullptr);
+
+	// Due before the wheel's current time.
+	auto* e = new PQ_Element(10.0);
+	w.Add(e);
+	CHECK(w.Top(50) == e);
+	delete w.RemoveTop();
+
+	CHECK(w.NextTime() <= 100.0);
+	CHECK(w.NextTime() > 50.0);
+	}
+
+TEST_SUITE_END();
+
+	} // namespace zeek::detail
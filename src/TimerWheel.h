@@ -0,0 +1,120 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "zeek/PriorityQueue.h"
+
+namespace zeek::detail
+	{
+
+/**
+ * A hashed hierarchical timer wheel, usable in place of a PriorityQueue for
+ * elements that get removed in time order. Time is divided into ticks of a
+ * fixed resolution. Each of the wheel's levels has 256 slots, with a slot on
+ * level n covering 256^n ticks; elements sit in the slot for their tick on
+ * the lowest level that doesn't wrap around before they're due, and move
+ * down a level whenever the wheel reaches their slot. Elements further out
+ * than the top level covers wait in an overflow heap. Adding and removing
+ * an element therefore takes constant time, independent of the number of
+ * pending elements.
+ *
+ * Once the wheel reaches an element's tick, the element moves into a small
+ * heap holding only the current tick's elements, so that elements still
+ * come out exactly in time order.
+ */
+class TimerWheel
+	{
+public:
+	/**
+	 * Constructor.
+	 *
+	 * @param resolution The length of a tick, in seconds.
+	 */
+	explicit TimerWheel(double resolution = 0.001);
+
+	/**
+	 * Destructor. Deletes all pending elements.
+	 */
+	~TimerWheel();
+
+	/**
+	 * Adds an element.
+	 */
+	void Add(PQ_Element* e);
+
+	/**
+	 * Removes an element.
+	 *
+	 * @return The element, or nullptr if it wasn't in the wheel.
+	 */
+	PQ_Element* Remove(PQ_Element* e);
+
+	/**
+	 * Returns the earliest element if it's due by time \a t, or nullptr
+	 * otherwise. Turns the wheel forward as far as needed.
+	 */
+	PQ_Element* Top(double t);
+
+	/**
+	 * Removes and returns the element that Top() returned last.
+	 */
+	PQ_Element* RemoveTop();
+
+	/**
+	 * Returns a lower bound for the time of the earliest element without
+	 * turning the wheel, or -1 if the wheel is empty.
+	 */
+	double NextTime() const;
+
+	int Size() const { return size; }
+	int PeakSize() const { return peak_size; }
+	uint64_t CumulativeNum() const { return cumulative_num; }
+
+private:
+	static constexpr int LEVELS = 4;
+	static constexpr int SLOT_BITS = 8;
+	static constexpr int SLOTS = 1 << SLOT_BITS;
+	static constexpr uint64_t NO_TICK = UINT64_MAX;
+
+	uint64_t Tick(double t) const;
+
+	// Files an element into the slot (or heap) matching its tick.
+	void Insert(PQ_Element* e);
+
+	// Takes an element out of its slot.
+	void Unlink(PQ_Element* e);
+
+	// Returns the next tick at which a slot needs processing, or NO_TICK.
+	uint64_t NextEventTick() const;
+
+	// Moves the wheel to the given tick, processing the slots that
+	// start there.
+	void TurnTo(uint64_t tick);
+
+	// Returns the next occupied slot on a level after the given one,
+	// or -1 if none.
+	int NextOccupied(int level, int slot) const;
+
+	double resolution;
+	uint64_t now_tick = 0;
+
+	std::vector<PQ_Element*> slots[LEVELS * SLOTS];
+
+	// One bit per slot, set while the slot is occupied.
+	uint64_t occupied[LEVELS][SLOTS / 64] = {};
+
+	// Elements due during the current tick or before.
+	PriorityQueue ready;
+
+	// Elements beyond the range of the top level.
+	PriorityQueue overflow;
+
+	int size = 0;
+	int peak_size = 0;
+	uint64_t cumulative_num = 0;
+	};
+
+	} // namespace zeek::detail
@@ -5,6 +5,7 @@
 
 #include "zeek/DebugLogger.h"
 #include "zeek/Desc.h"
+#include "zeek/Event.h"
 #include "zeek/Expr.h"
 #include "zeek/Frame.h"
 #include "zeek/ID.h"
@@ -312,6 +313,7 @@ bool Trigger::Eval()
 
 	v = nullptr;
 	StmtFlowType flow;
+	ScriptEventScope scope;
 
 	try
 		{
@@ -366,6 +368,7 @@ void Trigger::Timeout()
 		StmtFlowType flow;
 		FramePtr f{AdoptRef{}, frame->Clone()};
 		ValPtr v;
+		ScriptEventScope scope;
 
 		try
 			{
@@ -529,10 +532,12 @@ void Manager::Process()
 	TriggerList tmp;
 	pending = &tmp;
 
-	for ( TriggerList::iterator i = orig->begin(); i != orig->end(); ++i )
+	for ( auto t : *orig )
 		{
-		Trigger* t = *i;
-		(*i)->Eval();
+		// Once it's evaluating, changes it sees need another
+		// evaluation.
+		t->queued = false;
+		t->Eval();
 		Unref(t);
 		}
 
@@ -544,13 +549,21 @@ void Manager::Process()
 
 void Manager::Queue(Trigger* trigger)
 	{
-	if ( std::find(pending->begin(), pending->end(), trigger) == pending->end() )
-		{
-		Ref(trigger);
-		pending->push_back(trigger);
-		total_triggers++;
+	// Thousands of triggers can be waiting on asynchronous results, such
+	// as Broker store reads or DNS lookups, so this needs to be cheap
+	// when their results come in: the trigger flags whether it's pending
+	// already, and once something is pending there's no need to wake
+	// up the main loop again.
+	if ( trigger->queued )
+		return;
+
+	if ( pending->empty() )
 		iosource_mgr->Wakeup(Tag());
-		}
+
+	Ref(trigger);
+	trigger->queued = true;
+	pending->push_back(trigger);
+	total_triggers++;
 	}
 
 void Manager::GetStats(Stats* stats)
@@ -1,6 +1,5 @@
 #pragma once
 
-#include <list>
 #include <map>
 #include <vector>
 
@@ -111,6 +110,7 @@ public:
 
 private:
 	friend class TriggerTimer;
+	friend class Manager;
 
 	void Init(ExprPtr cond, StmtPtr body, StmtPtr timeout_stmts, Frame* frame, bool is_return,
 	          const Location* location);
@@ -136,6 +136,7 @@ private:
 
 	bool delayed; // true if a function call is currently being delayed
 	bool disabled;
+	bool queued = false; // true if waiting in the manager's pending list
 
 	// Globals and locals present in the when expression.
 	IDSet globals;
@@ -177,7 +178,7 @@ public:
 	void GetStats(Stats* stats);
 
 private:
-	using TriggerList = std::list<Trigger*>;
+	using TriggerList = std::vector<Trigger*>;
 	TriggerList* pending;
 	unsigned long total_triggers = 0;
 	};
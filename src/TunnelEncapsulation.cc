@@ -2,12 +2,28 @@
 
 #include "zeek/TunnelEncapsulation.h"
 
+#include <cstring>
+#include <functional>
+
+#include "zeek/3rdparty/doctest.h"
 #include "zeek/Conn.h"
+#include "zeek/Hash.h"
 #include "zeek/util.h"
 
 namespace zeek
 	{
 
+namespace
+	{
+
+// Recently built chains, indexed by the hash of their outer chain and
+// inner-most tunnel. Chains that drop out of the cache stay valid for the
+// stacks still referring to them.
+constexpr size_t CHAIN_CACHE_SIZE = 4096;
+std::shared_ptr<detail::EncapsulationChain> chain_cache[CHAIN_CACHE_SIZE];
+
+	} // namespace
+
 EncapsulatingConn::EncapsulatingConn(Connection* c, BifEnum::Tunnel::Type t)
 	: src_addr(c->OrigAddr()), dst_addr(c->RespAddr()), src_port(c->OrigPort()),
 	  dst_port(c->RespPort()), proto(c->ConnTransport()), type(t), uid(c->GetUID())
@@ -36,24 +52,92 @@ RecordValPtr EncapsulatingConn::ToVal() const
 	return rv;
 	}
 
-bool operator==(const EncapsulationStack& e1, const EncapsulationStack& e2)
+size_t EncapsulatingConn::Hash() const
+	{
+	struct
+		{
+		in6_addr src;
+		in6_addr dst;
+		uint16_t src_port;
+		uint16_t dst_port;
+		int type;
+		} key;
+
+	memset(&key, 0, sizeof(key));
+	src_addr.CopyIPv6(&key.src);
+	dst_addr.CopyIPv6(&key.dst);
+	key.src_port = src_port;
+	key.dst_port = dst_port;
+	key.type = type;
+
+	return zeek::detail::HashKey::HashBytes(&key, sizeof(key));
+	}
+
+void EncapsulationStack::Add(const EncapsulatingConn& c)
 	{
-	if ( ! e1.conns )
-		return e2.conns;
+	size_t h = c.Hash() ^ std::hash<const void*>{}(chain.get());
+	auto& cached = chain_cache[h % CHAIN_CACHE_SIZE];
 
-	if ( ! e2.conns )
-		return false;
+	if ( cached && cached->outer == chain && cached->conn.Identical(c) )
+		{
+		chain = cached;
+		return;
+		}
+
+	auto extended = std::make_shared<detail::EncapsulationChain>();
+	extended->outer = chain;
+	extended->conn = c;
+	extended->depth = Depth() + 1;
+	chain = extended;
+	cached = std::move(extended);
+	}
 
-	if ( e1.conns->size() != e2.conns->size() )
+bool operator==(const EncapsulationStack& e1, const EncapsulationStack& e2)
+	{
+	if ( e1.chain == e2.chain )
+		return true;
+
+	if ( e1.Depth() != e2.Depth() )
 		return false;
 
-	for ( size_t i = 0; i < e1.conns->size(); ++i )
+	// Once the chains meet, the rest is shared.
+	for ( auto c1 = e1.chain.get(), c2 = e2.chain.get(); c1 != c2;
+	      c1 = c1->outer.get(), c2 = c2->outer.get() )
 		{
-		if ( (*e1.conns)[i] != (*e2.conns)[i] )
+		if ( c1->conn != c2->conn )
 			return false;
 		}
 
 	return true;
 	}
 
+TEST_CASE("encapsulation stack interning")
+	{
+	EncapsulatingConn a(IPAddr("10.0.0.1"), IPAddr("10.0.0.2"));
+	EncapsulatingConn b(IPAddr("10.0.0.3"), IPAddr("10.0.0.4"));
+
+	EncapsulationStack s1;
+	s1.Add(a);
+	s1.Add(b);
+
+	EncapsulationStack s2;
+	s2.Add(a);
+	s2.Add(b);
+
+	CHECK(s1.Depth() == 2);
+	CHECK(s1 == s2);
+	CHECK(s1.Last() == s2.Last());
+
+	EncapsulationStack s3;
+	s3.Add(a);
+	CHECK(s3 != s1);
+	CHECK(s3.At(1) == s1.At(1));
+	CHECK(s1.At(2) == s1.Last());
+	CHECK(s1.At(3) == nullptr);
+
+	EncapsulationStack empty;
+	CHECK(empty == EncapsulationStack());
+	CHECK(empty != s3);
+	}
+
 	} // namespace zeek
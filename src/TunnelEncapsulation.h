@@ -4,6 +4,7 @@
 
 #include "zeek/zeek-config.h"
 
+#include <memory>
 #include <vector>
 
 #include "zeek/ID.h"
@@ -130,6 +131,23 @@ public:
 		return ! (ec1 == ec2);
 		}
 
+	/**
+	 * Returns true if two tunnels are the same in all respects, including
+	 * the order of their endpoints, which the equality operator ignores
+	 * for some types of tunnels.
+	 */
+	bool Identical(const EncapsulatingConn& other) const
+		{
+		return type == other.type && src_addr == other.src_addr && dst_addr == other.dst_addr &&
+		       src_port == other.src_port && dst_port == other.dst_port &&
+		       proto == other.proto && uid == other.uid;
+		}
+
+	/**
+	 * Returns a hash of the tunnel's endpoints and type.
+	 */
+	size_t Hash() const;
+
 	// TODO: temporarily public
 	std::shared_ptr<IP_Hdr> ip_hdr;
 
@@ -143,64 +161,67 @@ protected:
 	UID uid;
 	};
 
+namespace detail
+	{
+
 /**
- * Abstracts an arbitrary amount of nested tunneling.
+ * A chain of tunnels, linked from the inner-most one outwards, which all
+ * EncapsulationStacks for the same tunnels share. Chains get interned, see
+ * EncapsulationStack::Add(), and don't change once built, other than the
+ * IP headers of their tunnels, which refer to the packet being processed.
  */
-class EncapsulationStack
+struct EncapsulationChain
 	{
-public:
-	EncapsulationStack() : conns(nullptr) { }
+	// The chain without the inner-most tunnel, or null for a single one.
+	std::shared_ptr<EncapsulationChain> outer;
+	EncapsulatingConn conn;
+	size_t depth = 1;
 
-	EncapsulationStack(const EncapsulationStack& other)
-		{
-		if ( other.conns )
-			conns = new std::vector<EncapsulatingConn>(*(other.conns));
-		else
-			conns = nullptr;
-		}
-
-	EncapsulationStack& operator=(const EncapsulationStack& other)
+	/**
+	 * Returns the tunnel at a given depth, one being the outermost.
+	 */
+	EncapsulatingConn* At(size_t index)
 		{
-		if ( this == &other )
-			return *this;
+		auto c = this;
 
-		delete conns;
+		for ( size_t i = depth; i > index; --i )
+			c = c->outer.get();
 
-		if ( other.conns )
-			conns = new std::vector<EncapsulatingConn>(*(other.conns));
-		else
-			conns = nullptr;
-
-		return *this;
+		return &c->conn;
 		}
+	};
+
+	} // namespace detail
 
-	~EncapsulationStack() { delete conns; }
+/**
+ * Abstracts an arbitrary amount of nested tunneling. Stacks refer to
+ * interned chains of tunnels, so that copying them doesn't allocate, and
+ * stacks for the same tunnels usually compare by pointer.
+ */
+class EncapsulationStack
+	{
+public:
+	EncapsulationStack() = default;
 
 	/**
 	 * Add a new inner-most tunnel to the EncapsulationStack.
 	 *
 	 * @param c The new inner-most tunnel to append to the tunnel chain.
 	 */
-	void Add(const EncapsulatingConn& c)
-		{
-		if ( ! conns )
-			conns = new std::vector<EncapsulatingConn>();
-
-		conns->push_back(c);
-		}
+	void Add(const EncapsulatingConn& c);
 
 	/**
 	 * Return how many nested tunnels are involved in a encapsulation, zero
 	 * meaning no tunnels are present.
 	 */
-	size_t Depth() const { return conns ? conns->size() : 0; }
+	size_t Depth() const { return chain ? chain->depth : 0; }
 
 	/**
 	 * Return the tunnel type of the inner-most tunnel.
 	 */
 	BifEnum::Tunnel::Type LastType() const
 		{
-		return conns ? (*conns)[conns->size() - 1].Type() : BifEnum::Tunnel::NONE;
+		return chain ? chain->conn.Type() : BifEnum::Tunnel::NONE;
 		}
 
 	/**
@@ -211,11 +232,8 @@ public:
 		{
 		auto vv = make_intrusive<VectorVal>(id::find_type<VectorType>("EncapsulatingConnVector"));
 
-		if ( conns )
-			{
-			for ( size_t i = 0; i < conns->size(); ++i )
-				vv->Assign(i, (*conns)[i].ToVal());
-			}
+		for ( auto c = chain.get(); c; c = c->outer.get() )
+			vv->Assign(c->depth - 1, c->conn.ToVal());
 
 		return vv;
 		}
@@ -231,7 +249,7 @@ public:
 	 * Returns a pointer the last element in the stack. Returns a nullptr
 	 * if the stack is empty or hasn't been initialized yet.
 	 */
-	EncapsulatingConn* Last() { return Depth() > 0 ? &(conns->back()) : nullptr; }
+	EncapsulatingConn* Last() { return chain ? &chain->conn : nullptr; }
 
 	/**
 	 * Returns an EncapsulatingConn from the requested index in the stack.
@@ -244,13 +262,13 @@ public:
 	EncapsulatingConn* At(size_t index)
 		{
 		if ( index > 0 && index <= Depth() )
-			return &(conns->at(index - 1));
+			return chain->At(index);
 
 		return nullptr;
 		}
 
 protected:
-	std::vector<EncapsulatingConn>* conns;
+	std::shared_ptr<detail::EncapsulationChain> chain;
 	};
 
 	} // namespace zeek
@@ -12,6 +12,7 @@
 #include "zeek/Desc.h"
 #include "zeek/Expr.h"
 #include "zeek/Reporter.h"
+#include "zeek/RunState.h"
 #include "zeek/Scope.h"
 #include "zeek/Val.h"
 #include "zeek/Var.h"
@@ -1286,6 +1287,8 @@ const char* RecordType::AddFields(const type_decl_list& others, bool add_log_att
 
 void RecordType::AddFieldsDirectly(const type_decl_list& others, bool add_log_attr)
 	{
+	++detail::type_cache_generation;
+
 	for ( const auto& td : others )
 		{
 		if ( add_log_attr )
@@ -1304,7 +1307,7 @@ void RecordType::AddFieldsDirectly(const type_decl_list& others, bool add_log_at
 	num_fields = types->length();
 	}
 
-void RecordType::Create(std::vector<std::optional<ZVal>>& r) const
+void RecordType::Create(RecordVal* r) const
 	{
 	int n = NumFields();
 
@@ -1317,7 +1320,7 @@ void RecordType::Create(std::vector<std::optional<ZVal>>& r) const
 		switch ( init->init_type )
 			{
 			case FieldInit::R_INIT_NONE:
-				r.push_back(std::nullopt);
+				r->AppendRawField(std::nullopt);
 				continue;
 
 			case FieldInit::R_INIT_DIRECT:
@@ -1362,7 +1365,7 @@ void RecordType::Create(std::vector<std::optional<ZVal>>& r) const
 				break;
 			}
 
-		r.push_back(r_i);
+		r->AppendRawField(r_i);
 		}
 	}
 
@@ -1964,6 +1967,13 @@ static bool is_init_compat(const Type& t1, const Type& t2)
 	return false;
 	}
 
+namespace detail
+	{
+
+uint64_t type_cache_generation = 0;
+
+	} // namespace detail
+
 bool same_type(const Type& arg_t1, const Type& arg_t2, bool is_init, bool match_record_field_names)
 	{
 	if ( &arg_t1 == &arg_t2 || arg_t1.Tag() == TYPE_ANY || arg_t2.Tag() == TYPE_ANY )
@@ -2109,6 +2119,20 @@ bool same_type(const Type& arg_t1, const Type& arg_t2, bool is_init, bool match_
 	// If we get to here, then we're dealing with a type with
 	// subtypes, and thus potentially recursive.
 
+	// Outermost comparisons get memoized once parsing is over, since
+	// types then stay as they are. Type lists don't, as list values
+	// grow theirs.
+	static detail::TypePairCache<bool> cache;
+	uint32_t cache_flags = (is_init ? 1 : 0) | (match_record_field_names ? 2 : 0);
+	bool use_cache = analyzed_types.empty() && ! run_state::is_parsing &&
+	                 t1->Tag() != TYPE_LIST && t1->Tag() != TYPE_TYPE;
+
+	if ( use_cache )
+		{
+		if ( auto r = cache.Find(t1, t2, cache_flags) )
+			return *r;
+		}
+
 	if ( analyzed_types.count(t1) > 0 || analyzed_types.count(t2) > 0 )
 		{
 		// We've analyzed at least one of the types previously.
@@ -2235,6 +2259,9 @@ bool same_type(const Type& arg_t1, const Type& arg_t2, bool is_init, bool match_
 	analyzed_types.erase(t1);
 	analyzed_types.erase(t2);
 
+	if ( use_cache )
+		cache.Insert(t1, t2, result, cache_flags);
+
 	return result;
 	}
 
@@ -192,6 +192,10 @@ public:
 	TypeTag Tag() const { return tag; }
 	InternalTypeTag InternalType() const { return internal_tag; }
 
+	// A number unique to the type, for keying caches. Unlike the type's
+	// address, it never gets reused once the type goes away.
+	uint64_t Serial() const { return serial; }
+
 	// Whether it's stored in network order.
 	bool IsNetworkOrder() const { return is_network_order; }
 
@@ -317,8 +321,10 @@ private:
 	bool is_network_order;
 	bool base_type;
 	std::string name;
+	uint64_t serial = ++last_serial;
 
 	static TypeAliasMap type_aliases;
+	static inline uint64_t last_serial = 0;
 	};
 
 class TypeList final : public Type
@@ -679,9 +685,9 @@ public:
 	/**
 	 *
 	 * Populates a new instance of the record with its initial values.
-	 * @param r  The record's underlying value vector.
+	 * @param r  The record, which doesn't have any fields yet.
 	 */
-	void Create(std::vector<std::optional<ZVal>>& r) const;
+	void Create(RecordVal* r) const;
 
 	void DescribeReST(ODesc* d, bool roles_only = false) const override;
 	void DescribeFields(ODesc* d) const;
@@ -860,6 +866,83 @@ protected:
 	TypePtr yield_type;
 	};
 
+namespace detail
+	{
+
+// Bumped whenever a type changes in a way that invalidates what
+// TypePairCache's have learned, such as a record type gaining fields.
+extern uint64_t type_cache_generation;
+
+/**
+ * Memoizes results that depend only on a pair of types, such as whether
+ * they're the same, or how to coerce records of one to the other. Keys are
+ * the types' serial numbers, so entries for types that went away never
+ * match again. The cache starts over once it fills up, and when types
+ * change; see type_cache_generation.
+ */
+template <typename V> class TypePairCache
+	{
+public:
+	/**
+	 * @return The value for the pair and flags, or null if there's none.
+	 * The pointer is valid until the next Insert().
+	 */
+	const V* Find(const Type* t1, const Type* t2, uint32_t flags = 0)
+		{
+		if ( generation != type_cache_generation )
+			{
+			entries.clear();
+			generation = type_cache_generation;
+			}
+
+		auto it = entries.find({t1->Serial(), t2->Serial(), flags});
+		return it == entries.end() ? nullptr : &it->second;
+		}
+
+	/**
+	 * Sets the value for the pair and flags.
+	 *
+	 * @return The value as stored.
+	 */
+	const V& Insert(const Type* t1, const Type* t2, V v, uint32_t flags = 0)
+		{
+		if ( entries.size() >= MAX_ENTRIES )
+			entries.clear();
+
+		return entries.insert_or_assign({t1->Serial(), t2->Serial(), flags}, std::move(v))
+		    .first->second;
+		}
+
+private:
+	static constexpr size_t MAX_ENTRIES = 16384;
+
+	struct Key
+		{
+		uint64_t s1;
+		uint64_t s2;
+		uint32_t flags;
+
+		bool operator==(const Key& o) const
+			{
+			return s1 == o.s1 && s2 == o.s2 && flags == o.flags;
+			}
+		};
+
+	struct KeyHash
+		{
+		size_t operator()(const Key& k) const
+			{
+			auto h = k.s1 * 0x9e3779b97f4a7c15ULL ^ k.s2 * 0xc2b2ae3d27d4eb4fULL ^ k.flags;
+			return static_cast<size_t>(h ^ (h >> 32));
+			}
+		};
+
+	std::unordered_map<Key, V, KeyHash> entries;
+	uint64_t generation = 0;
+	};
+
+	} // namespace detail
+
 // True if the two types are equivalent.  If is_init is true then the test is
 // done in the context of an initialization. If match_record_field_names is
 // true then for record types the field names have to match, too.
@@ -1079,6 +1162,8 @@ extern zeek::OpaqueTypePtr bloomfilter_type;
 extern zeek::OpaqueTypePtr x509_opaque_type;
 extern zeek::OpaqueTypePtr ocsp_resp_opaque_type;
 extern zeek::OpaqueTypePtr paraglob_type;
+extern zeek::OpaqueTypePtr pattern_set_type;
+extern zeek::OpaqueTypePtr shared_table_type;
 extern zeek::OpaqueTypePtr int_counter_metric_type;
 extern zeek::OpaqueTypePtr int_counter_metric_family_type;
 extern zeek::OpaqueTypePtr dbl_counter_metric_type;
@@ -4,6 +4,7 @@
 
 #include <cstdlib>
 
+#include "zeek/3rdparty/doctest.h"
 #include "zeek/Reporter.h"
 #include "zeek/util.h"
 
@@ -12,6 +13,30 @@ using namespace std;
 namespace zeek
 	{
 
+namespace
+	{
+
+// A 64-bit value takes up to 11 digits in base 62.
+constexpr size_t MAX_BASE62_DIGITS = 11;
+
+// Writes the digits of a value in base 62, least significant first like
+// util::uitoa_n() does. Dividing by a constant lets the compiler turn the
+// divisions into multiplications.
+char* append_base62(uint64_t v, char* p)
+	{
+	static constexpr char dig[] = "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+
+	do
+		{
+		*p++ = dig[v % 62];
+		v /= 62;
+		} while ( v );
+
+	return p;
+	}
+
+	} // namespace
+
 void UID::Set(zeek_uint_t bits, const uint64_t* v, size_t n)
 	{
 	initialized = true;
@@ -37,11 +62,32 @@ std::string UID::Base62(std::string prefix) const
 	if ( ! initialized )
 		reporter->InternalError("use of uninitialized UID");
 
-	char tmp[sizeof(uid) * 8 + 1]; // enough for even binary representation
+	char digits[UID_LEN * MAX_BASE62_DIGITS];
+	char* end = digits;
+
 	for ( size_t i = 0; i < UID_LEN; ++i )
-		prefix.append(util::uitoa_n(uid[i], tmp, sizeof(tmp), 62));
+		end = append_base62(uid[i], end);
 
+	prefix.append(digits, end - digits);
 	return prefix;
 	}
 
+TEST_CASE("uid base62")
+	{
+	const uint64_t values[][UID_LEN] = {
+		{0, 0}, {1, 61}, {62, 3843}, {0x0123456789abcdef, UINT64_MAX}};
+
+	for ( const auto& v : values )
+		{
+		UID u(UID_LEN * 64, v, UID_LEN);
+		std::string expected = "C";
+		char tmp[65];
+
+		for ( auto x : v )
+			expected += util::uitoa_n(x, tmp, sizeof(tmp), 62);
+
+		CHECK(u.Base62("C") == expected);
+		}
+	}
+
 	} // namespace zeek
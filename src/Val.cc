@@ -9,11 +9,15 @@
 #include <sys/param.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <algorithm>
 #include <cmath>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <set>
+#include <string>
 
+#include "zeek/3rdparty/doctest.h"
 #include "zeek/Attr.h"
 #include "zeek/CompHash.h"
 #include "zeek/Conn.h"
@@ -32,6 +36,7 @@
 #include "zeek/Reporter.h"
 #include "zeek/RunState.h"
 #include "zeek/Scope.h"
+#include "zeek/TableExpireIndex.h"
 #include "zeek/ZeekString.h"
 #include "zeek/broker/Data.h"
 #include "zeek/broker/Manager.h"
@@ -43,8 +48,13 @@ using namespace std;
 namespace zeek
 	{
 
+detail::MemoryPool Val::pool("value", detail::ARENA_VALUES);
+uint64_t Val::live_counts[NUM_TYPES];
+
 Val::~Val()
 	{
+	--live_counts[type->Tag()];
+
 #ifdef DEBUG
 	delete[] bound_id;
 #endif
@@ -771,6 +781,24 @@ ValPtr PortVal::DoClone(CloneState* state)
 	return {NewRef{}, this};
 	}
 
+#ifdef ZEEK_COMPACT_VALUES
+AddrVal::AddrVal(const char* text) : Val(base_type(TYPE_ADDR)), addr_val(text) { }
+
+AddrVal::AddrVal(const std::string& text) : AddrVal(text.c_str()) { }
+
+AddrVal::AddrVal(uint32_t addr)
+	: Val(base_type(TYPE_ADDR)), addr_val(IPv4, &addr, IPAddr::Network)
+	{
+	// ### perhaps do gethostbyaddr here?
+	}
+
+AddrVal::AddrVal(const uint32_t addr[4])
+	: Val(base_type(TYPE_ADDR)), addr_val(IPv6, addr, IPAddr::Network)
+	{
+	}
+
+AddrVal::AddrVal(const IPAddr& addr) : Val(base_type(TYPE_ADDR)), addr_val(addr) { }
+#else
 AddrVal::AddrVal(const char* text) : Val(base_type(TYPE_ADDR))
 	{
 	addr_val = new IPAddr(text);
@@ -798,10 +826,11 @@ AddrVal::~AddrVal()
 	{
 	delete addr_val;
 	}
+#endif
 
 ValPtr AddrVal::SizeVal() const
 	{
-	if ( addr_val->GetFamily() == IPv4 )
+	if ( Get().GetFamily() == IPv4 )
 		return val_mgr->Count(32);
 	else
 		return val_mgr->Count(128);
@@ -1063,11 +1092,15 @@ StringValPtr StringVal::Replace(RE_Matcher* re, const String& repl, bool do_all)
 
 ValPtr StringVal::DoClone(CloneState* state)
 	{
-	// We could likely treat this type as immutable and return a reference
-	// instead of creating a new copy, but we first need to be careful and
-	// audit whether anything internal actually does mutate it.
-	return state->NewClone(this, make_intrusive<StringVal>(new String((u_char*)string_val->Bytes(),
-	                                                                  string_val->Len(), true)));
+	// Immutable: nothing changes a string's bytes once scripts can see
+	// it, ToUpper() is only used on freshly created values.  That lets
+	// copies of aggregates share their strings.
+	return {NewRef{}, this};
+	}
+
+uint64_t StringVal::MemoryFootprint() const
+	{
+	return sizeof(*this) + sizeof(*string_val) + string_val->Len();
 	}
 
 FuncVal::FuncVal(FuncPtr f) : Val(f->GetType())
@@ -1413,7 +1446,7 @@ void TableVal::Init(TableTypePtr t)
 	table_type = std::move(t);
 	expire_func = nullptr;
 	expire_time = nullptr;
-	expire_iterator = nullptr;
+	expire_index = nullptr;
 	timer = nullptr;
 	def_val = nullptr;
 
@@ -1423,6 +1456,7 @@ void TableVal::Init(TableTypePtr t)
 		subnets = nullptr;
 
 	table_hash = new detail::CompositeHash(table_type->GetIndices());
+	fast_index = table_hash->HasFastPath() && ! subnets;
 	table_val = new PDict<TableEntryVal>;
 	table_val->SetDeleteFunc(table_entry_val_delete_func);
 	}
@@ -1435,17 +1469,19 @@ TableVal::~TableVal()
 	delete table_hash;
 	delete table_val;
 	delete subnets;
-	delete expire_iterator;
+	delete expire_index;
 	}
 
 void TableVal::RemoveAll()
 	{
-	delete expire_iterator;
-	expire_iterator = nullptr;
+	if ( expire_index )
+		expire_index->Clear();
+
 	// Here we take the brute force approach.
 	delete table_val;
 	table_val = new PDict<TableEntryVal>;
 	table_val->SetDeleteFunc(table_entry_val_delete_func);
+	entries_footprint = 0;
 	}
 
 int TableVal::Size() const
@@ -1453,6 +1489,27 @@ int TableVal::Size() const
 	return table_val->Length();
 	}
 
+uint64_t TableVal::MemoryFootprint() const
+	{
+	return sizeof(*this) + sizeof(*table_val) +
+	       table_val->Capacity() * sizeof(detail::DictEntry<TableEntryVal>) + entries_footprint;
+	}
+
+void TableVal::AddToFootprint(const detail::HashKey& k, TableEntryVal* v)
+	{
+	// Keys too large for the dictionary's entries live on the heap.
+	uint64_t size = sizeof(TableEntryVal);
+
+	if ( k.Size() > detail::DICT_INLINE_KEY_SIZE )
+		size += k.Size();
+
+	if ( v->val )
+		size += v->val->MemoryFootprint();
+
+	v->footprint = static_cast<uint32_t>(std::min(size, uint64_t(UINT32_MAX)));
+	entries_footprint += v->footprint;
+	}
+
 int TableVal::RecursiveSize() const
 	{
 	int n = table_val->Length();
@@ -1565,6 +1622,11 @@ bool TableVal::Assign(ValPtr index, std::unique_ptr<detail::HashKey> k, ValPtr n
 	// from here on out.
 	k = nullptr;
 
+	AddToFootprint(k_copy, new_entry_val);
+
+	if ( old_entry_val )
+		RemoveFromFootprint(old_entry_val);
+
 	if ( subnets )
 		{
 		if ( ! index )
@@ -1580,6 +1642,12 @@ bool TableVal::Assign(ValPtr index, std::unique_ptr<detail::HashKey> k, ValPtr n
 	if ( old_entry_val && attrs && attrs->Find(detail::ATTR_EXPIRE_CREATE) )
 		new_entry_val->SetExpireAccess(old_entry_val->ExpireAccessTime());
 
+	// A replaced entry's key is in the expiration index already.
+	if ( old_entry_val )
+		new_entry_val->expire_bucket = old_entry_val->expire_bucket;
+	else
+		AddToExpireIndex(k_copy, new_entry_val);
+
 	Modified();
 
 	if ( change_func || (broker_forward && ! broker_store.empty()) )
@@ -1708,7 +1776,11 @@ TableValPtr TableVal::Intersection(const TableVal& tv) const
 		// Here we leverage the same assumption about consistent
 		// hashes as in TableVal::RemoveFrom above.
 		if ( t0->Lookup(k.get()) )
-			result->table_val->Insert(k.get(), new TableEntryVal(nullptr));
+			{
+			auto entry = new TableEntryVal(nullptr);
+			result->AddToFootprint(*k, entry);
+			result->table_val->Insert(k.get(), entry);
+			}
 		}
 
 	return result;
@@ -1892,6 +1964,28 @@ ValPtr TableVal::FindOrDefault(const ValPtr& index)
 	return Default(index);
 	}
 
+const ValPtr& TableVal::FindZVals(const ZVal* index)
+	{
+	ASSERT(fast_index);
+
+	if ( table_val->Length() == 0 )
+		return Val::nil;
+
+	auto k = table_hash->MakeHashKey(index);
+	TableEntryVal* v = table_val->Lookup(k.get());
+
+	if ( ! v )
+		return Val::nil;
+
+	if ( attrs && attrs->Find(detail::ATTR_EXPIRE_READ) )
+		v->SetExpireAccess(run_state::network_time);
+
+	if ( v->GetVal() )
+		return v->GetVal();
+
+	return val_mgr->True();
+	}
+
 bool TableVal::Contains(const IPAddr& addr) const
 	{
 	if ( ! subnets )
@@ -1974,6 +2068,12 @@ ListValPtr TableVal::RecreateIndex(const detail::HashKey& k) const
 	return table_hash->RecoverVals(k);
 	}
 
+void TableVal::RecreateIndex(const detail::HashKey& k, const std::vector<bool>& wanted,
+                             ZVal* vals) const
+	{
+	table_hash->RecoverZVals(k, wanted, vals);
+	}
+
 void TableVal::CallChangeFunc(const ValPtr& index, const ValPtr& old_value, OnChangeType tpe)
 	{
 	if ( ! change_func || ! index || in_change_func )
@@ -2159,6 +2259,9 @@ ValPtr TableVal::Remove(const Val& index, bool broker_forward, bool* iterators_i
 	if ( subnets && ! subnets->Remove(&index) )
 		reporter->InternalWarning("index not in prefix table");
 
+	if ( v )
+		RemoveFromFootprint(v);
+
 	delete v;
 
 	Modified();
@@ -2192,6 +2295,9 @@ ValPtr TableVal::Remove(const detail::HashKey& k, bool* iterators_invalidated)
 			reporter->InternalWarning("index not in prefix table");
 		}
 
+	if ( v )
+		RemoveFromFootprint(v);
+
 	delete v;
 
 	Modified();
@@ -2430,97 +2536,128 @@ void TableVal::DoExpire(double t)
 		// error, it has been reported already.
 		return;
 
-	if ( ! expire_iterator )
+	if ( ! expire_index )
 		{
-		auto it = table_val->begin_robust();
-		expire_iterator = new RobustDictIterator(std::move(it));
+		// The index starts out with the keys of all entries so far,
+		// in case the table got its attributes after some of them.
+		int width = std::max(1, int(zeek::detail::table_expire_interval));
+		expire_index = new detail::TableExpireIndex(width);
+
+		for ( const auto& tble : *table_val )
+			AddToExpireIndex(tble.GetHashKeyView(), tble.value);
 		}
 
+	// Entries accessed before this, relative to Zeek's start, are due.
+	double due = t - timeout - run_state::zeek_start_network_time;
+	double budget = zeek::detail::table_expire_step_budget;
+	double deadline = budget > 0 ? util::current_time(true) + budget : 0;
+
 	bool modified = false;
+	bool exhausted = false;
+	detail::TableExpireIndex::Key ik;
 
-	for ( int i = 0;
-	      i < zeek::detail::table_incremental_step && *expire_iterator != table_val->end_robust();
-	      ++i, ++(*expire_iterator) )
+	expire_index->BeginScan();
+
+	for ( int i = 0;; ++i )
 		{
-		auto v = (*expire_iterator)->value;
+		// Check the clock only every so often, it's not free either.
+		if ( budget > 0 ? (i % 32 == 0 && i > 0 && util::current_time(true) > deadline)
+		                : i >= zeek::detail::table_incremental_step )
+			break;
 
-		if ( v->ExpireAccessTime() == 0 )
+		if ( ! expire_index->Next(due, &ik) )
 			{
-			// This happens when we insert val while network_time
-			// hasn't been initialized yet (e.g. in zeek_init()), and
-			// also when zeek_start_network_time hasn't been initialized
-			// (e.g. before first packet).  The expire_access_time is
-			// correct, so we just need to wait.
+			exhausted = true;
+			break;
 			}
 
-		else if ( v->ExpireAccessTime() + timeout < t )
-			{
-			auto k = (*expire_iterator)->GetHashKey();
-			ListValPtr idx = nullptr;
+		detail::HashKey ik_view(ik.key, ik.size, ik.hash, true);
+		auto v = table_val->Lookup(&ik_view);
 
-			if ( expire_func )
-				{
-				idx = RecreateIndex(*k);
-				double secs = CallExpireFunc(idx);
+		if ( ! v || v->expire_bucket != ik.bucket )
+			// The entry went away, or got indexed anew since.
+			continue;
 
-				// It's possible that the user-provided
-				// function modified or deleted the table
-				// value, so look it up again.
-				v = table_val->Lookup(k.get());
+		if ( v->ExpireAccessTime() == 0 || v->ExpireAccessTime() + timeout >= t )
+			{
+			// Either not due, or inserted while network_time
+			// hasn't been initialized yet (e.g. in zeek_init()), or
+			// before zeek_start_network_time has been (e.g. before
+			// the first packet). The expire_access_time is correct in
+			// the latter case, so we just need to wait.
+			AddToExpireIndex(ik_view, v);
+			continue;
+			}
 
-				if ( ! v )
-					{ // user-provided function deleted it
-					if ( ! expire_iterator )
-						// Entire table got dropped (e.g. clear_table() / RemoveAll())
-						break;
+		// The expiration function may change the table, including
+		// the index the key's bytes live in.
+		auto k = expire_func ? std::make_unique<detail::HashKey>(ik.key, ik.size, ik.hash)
+		                     : std::make_unique<detail::HashKey>(ik.key, ik.size, ik.hash, true);
+		ListValPtr idx = nullptr;
 
-					continue;
-					}
+		if ( expire_func )
+			{
+			idx = RecreateIndex(*k);
+			double secs = CallExpireFunc(idx);
 
-				if ( secs > 0 )
-					{
-					// User doesn't want us to expire
-					// this now.
-					v->SetExpireAccess(run_state::network_time - timeout + secs);
-					continue;
-					}
-				}
+			// It's possible that the user-provided
+			// function modified or deleted the table
+			// value, so look it up again.
+			v = table_val->Lookup(k.get());
 
-			if ( subnets )
-				{
-				if ( ! idx )
-					idx = RecreateIndex(*k);
-				if ( ! subnets->Remove(idx.get()) )
-					reporter->InternalWarning("index not in prefix table");
-				}
+			if ( ! v )
+				// user-provided function deleted it
+				continue;
 
-			table_val->RemoveEntry(k.get());
-			if ( change_func )
+			if ( secs > 0 )
 				{
-				if ( ! idx )
-					idx = RecreateIndex(*k);
-
-				CallChangeFunc(idx, v->GetVal(), ELEMENT_EXPIRED);
+				// User doesn't want us to expire
+				// this now.
+				v->SetExpireAccess(run_state::network_time - timeout + secs);
+				AddToExpireIndex(*k, v);
+				continue;
 				}
+			}
 
-			delete v;
-			modified = true;
+		if ( subnets )
+			{
+			if ( ! idx )
+				idx = RecreateIndex(*k);
+			if ( ! subnets->Remove(idx.get()) )
+				reporter->InternalWarning("index not in prefix table");
 			}
+
+		if ( change_func && ! idx )
+			idx = RecreateIndex(*k);
+
+		table_val->RemoveEntry(k.get());
+
+		if ( change_func )
+			CallChangeFunc(idx, v->GetVal(), ELEMENT_EXPIRED);
+
+		RemoveFromFootprint(v);
+		delete v;
+		modified = true;
 		}
 
 	if ( modified )
 		Modified();
 
-	if ( ! expire_iterator || (*expire_iterator) == table_val->end_robust() )
-		{
-		delete expire_iterator;
-		expire_iterator = nullptr;
+	if ( exhausted )
 		InitTimer(zeek::detail::table_expire_interval);
-		}
 	else
 		InitTimer(zeek::detail::table_expire_delay);
 	}
 
+void TableVal::AddToExpireIndex(const detail::HashKey& k, TableEntryVal* v)
+	{
+	if ( ! expire_index )
+		return;
+
+	v->expire_bucket = expire_index->Bucket(v->expire_access_time);
+	expire_index->Add(v->expire_bucket, k.Key(), k.Size(), k.Hash());
+	}
+
 double TableVal::GetExpireTime()
 	{
 	if ( ! expire_time )
@@ -2542,6 +2679,8 @@ double TableVal::GetExpireTime()
 		return interval;
 
 	expire_time = nullptr;
+	delete expire_index;
+	expire_index = nullptr;
 
 	if ( timer )
 		detail::timer_mgr->Cancel(timer);
@@ -2623,6 +2762,7 @@ ValPtr TableVal::DoClone(CloneState* state)
 		auto key = tble.GetHashKey();
 		auto* val = tble.value;
 		TableEntryVal* nval = val->Clone(state);
+		tv->AddToFootprint(*key, nval);
 		tv->table_val->Insert(key.get(), nval);
 
 		if ( subnets )
@@ -2737,10 +2877,7 @@ RecordVal::RecordVal(RecordTypePtr t, bool init_fields) : Val(t), is_managed(t->
 	origin = nullptr;
 	rt = std::move(t);
 
-	int n = rt->NumFields();
-
-	record_val = new std::vector<std::optional<ZVal>>;
-	record_val->reserve(n);
+	Reserve(rt->NumFields());
 
 	if ( run_state::is_parsing )
 		parse_time_records[rt.get()].emplace_back(NewRef{}, this);
@@ -2749,7 +2886,7 @@ RecordVal::RecordVal(RecordTypePtr t, bool init_fields) : Val(t), is_managed(t->
 		{
 		try
 			{
-			rt->Create(*record_val);
+			rt->Create(this);
 			}
 		catch ( InterpreterException& e )
 			{
@@ -2762,13 +2899,39 @@ RecordVal::RecordVal(RecordTypePtr t, bool init_fields) : Val(t), is_managed(t->
 
 RecordVal::~RecordVal()
 	{
-	auto n = record_val->size();
-
-	for ( unsigned int i = 0; i < n; ++i )
+	for ( unsigned int i = 0; i < num_fields; ++i )
 		if ( HasField(i) && IsManaged(i) )
-			ZVal::DeleteManagedType(*(*record_val)[i]);
+			ZVal::DeleteManagedType(record_val[i]);
+
+	::operator delete(record_val);
+	}
+
+void RecordVal::Reserve(unsigned int n)
+	{
+	if ( n <= max_fields )
+		return;
+
+	auto num_words = (n + 63) / 64;
+	auto block = static_cast<char*>(
+		::operator new(n * sizeof(ZVal) + num_words * sizeof(uint64_t)));
+
+	auto new_vals = reinterpret_cast<ZVal*>(block);
+	auto new_present = reinterpret_cast<uint64_t*>(block + n * sizeof(ZVal));
+
+	auto old_words = (max_fields + 63) / 64;
+
+	if ( record_val )
+		{
+		memcpy(new_vals, record_val, num_fields * sizeof(ZVal));
+		memcpy(new_present, present, old_words * sizeof(uint64_t));
+		::operator delete(record_val);
+		}
+
+	memset(new_present + old_words, 0, (num_words - old_words) * sizeof(uint64_t));
 
-	delete record_val;
+	record_val = new_vals;
+	present = new_present;
+	max_fields = n;
 	}
 
 ValPtr RecordVal::SizeVal() const
@@ -2776,6 +2939,36 @@ ValPtr RecordVal::SizeVal() const
 	return val_mgr->Count(GetType()->AsRecordType()->NumFields());
 	}
 
+uint64_t RecordVal::MemoryFootprint(int depth) const
+	{
+	constexpr int MAX_DEPTH = 8;
+	uint64_t size = sizeof(*this) + max_fields * sizeof(ZVal) + (max_fields + 63) / 64 * 8;
+
+	for ( unsigned int i = 0; i < num_fields; ++i )
+		{
+		if ( ! HasField(i) || ! IsManaged(i) )
+			continue;
+
+		// Files and functions aren't values of their own, and are
+		// shared anyway.
+		auto tag = rt->GetFieldType(i)->Tag();
+
+		if ( tag == TYPE_FILE || tag == TYPE_FUNC )
+			continue;
+
+		auto v = static_cast<const Val*>(record_val[i].ManagedVal());
+
+		if ( v->GetType()->Tag() != TYPE_RECORD )
+			size += v->MemoryFootprint();
+		else if ( depth < MAX_DEPTH )
+			size += v->AsRecordVal()->MemoryFootprint(depth + 1);
+		else
+			size += sizeof(RecordVal);
+		}
+
+	return size;
+	}
+
 void RecordVal::Assign(int field, ValPtr new_val)
 	{
 	if ( new_val )
@@ -2783,7 +2976,8 @@ void RecordVal::Assign(int field, ValPtr new_val)
 		DeleteFieldIfManaged(field);
 
 		auto t = rt->GetFieldType(field);
-		(*record_val)[field] = ZVal(new_val, t);
+		record_val[field] = ZVal(new_val, t);
+		SetPresent(field);
 		Modified();
 		}
 	else
@@ -2795,9 +2989,9 @@ void RecordVal::Remove(int field)
 	if ( HasField(field) )
 		{
 		if ( IsManaged(field) )
-			ZVal::DeleteManagedType(*(*record_val)[field]);
+			ZVal::DeleteManagedType(record_val[field]);
 
-		(*record_val)[field] = std::nullopt;
+		ClearPresent(field);
 
 		Modified();
 		}
@@ -2860,20 +3054,51 @@ ValPtr RecordVal::GetFieldOrDefault(const char* field) const
 	return GetFieldOrDefault(idx);
 	}
 
+namespace
+	{
+
+// What coercing records of one type to another takes: whether the types
+// are compatible, and for each field of the source type, its offset in
+// the target type, or -1 if it has none.
+struct RecordCoercion
+	{
+	bool compatible;
+	std::vector<int> offsets;
+	};
+
+	} // namespace
+
 RecordValPtr RecordVal::DoCoerceTo(RecordTypePtr t, bool allow_orphaning) const
 	{
-	if ( ! record_promotion_compatible(t.get(), GetType()->AsRecordType()) )
+	static detail::TypePairCache<std::shared_ptr<const RecordCoercion>> coercions;
+
+	const RecordType* rv_t = GetType()->AsRecordType();
+	std::shared_ptr<const RecordCoercion> coercion;
+
+	if ( auto c = coercions.Find(t.get(), rv_t) )
+		coercion = *c;
+	else
+		{
+		auto nc = std::make_shared<RecordCoercion>();
+		nc->compatible = record_promotion_compatible(t.get(), rv_t);
+
+		for ( int i = 0; i < rv_t->NumFields(); ++i )
+			nc->offsets.push_back(t->FieldOffset(rv_t->FieldName(i)));
+
+		coercion = coercions.Insert(t.get(), rv_t, std::move(nc));
+		}
+
+	if ( ! coercion->compatible )
 		return nullptr;
 
 	auto aggr = make_intrusive<RecordVal>(std::move(t));
 
 	RecordType* ar_t = aggr->GetType()->AsRecordType();
-	const RecordType* rv_t = GetType()->AsRecordType();
 
 	int i;
 	for ( i = 0; i < rv_t->NumFields(); ++i )
 		{
-		int t_i = ar_t->FieldOffset(rv_t->FieldName(i));
+		int t_i = coercion->offsets[i];
 
 		if ( t_i < 0 )
 			{
@@ -2896,10 +3121,7 @@ RecordValPtr RecordVal::DoCoerceTo(RecordTypePtr t, bool allow_orphaning) const
 
 		if ( ft->Tag() == TYPE_RECORD && ! same_type(ft, v->GetType()) )
 			{
-			auto rhs = make_intrusive<detail::ConstExpr>(v);
-			auto e = make_intrusive<detail::RecordCoerceExpr>(std::move(rhs),
-			                                                  cast_intrusive<RecordType>(ft));
-			aggr->Assign(t_i, e->Eval(nullptr));
+			aggr->Assign(t_i, detail::coerce_to_record(cast_intrusive<RecordType>(ft), v.get()));
 			continue;
 			}
 
@@ -2933,7 +3155,7 @@ TableValPtr RecordVal::GetRecordFieldsVal() const
 
 void RecordVal::Describe(ODesc* d) const
 	{
-	auto n = record_val->size();
+	auto n = NumFields();
 
 	if ( d->IsBinary() )
 		{
@@ -2969,7 +3191,7 @@ void RecordVal::Describe(ODesc* d) const
 
 void RecordVal::DescribeReST(ODesc* d) const
 	{
-	auto n = record_val->size();
+	auto n = NumFields();
 	auto rt = GetType()->AsRecordType();
 
 	d->Add("{");
@@ -3007,10 +3229,19 @@ ValPtr RecordVal::DoClone(CloneState* state)
 	state->NewClone(this, rv);
 
 	int n = NumFields();
+	rv->Reserve(n);
+
 	for ( auto i = 0; i < n; ++i )
 		{
-		auto f_i = GetField(i);
-		auto v = f_i ? f_i->Clone(state) : nullptr;
+		// Fields that don't refer to other values get copied as they
+		// are, rather than going through a Val of their own.
+		if ( ! HasField(i) || ! IsManaged(i) )
+			{
+			rv->AppendRawField(RawOptField(i));
+			continue;
+			}
+
+		auto v = GetField(i)->Clone(state);
 		rv->AppendField(std::move(v), rt->GetFieldType(i));
 		}
 
@@ -3108,6 +3339,19 @@ ValPtr VectorVal::SizeVal() const
 	return val_mgr->Count(uint32_t(vector_val->size()));
 	}
 
+uint64_t VectorVal::MemoryFootprint() const
+	{
+	uint64_t size = sizeof(*this) + sizeof(*vector_val) +
+	                vector_val->capacity() * sizeof(std::optional<ZVal>);
+
+	// Elements that are objects of their own count with a fixed size, to
+	// keep this from visiting each.
+	if ( managed_yield || yield_types )
+		size += vector_val->size() * sizeof(Val);
+
+	return size;
+	}
+
 bool VectorVal::CheckElementType(const ValPtr& element)
 	{
 	if ( ! element )
@@ -3587,9 +3831,18 @@ void VectorVal::Reserve(unsigned int num_elements)
 ValPtr VectorVal::DoClone(CloneState* state)
 	{
 	auto vv = make_intrusive<VectorVal>(GetType<VectorType>());
-	vv->Reserve(vector_val->size());
 	state->NewClone(this, vv);
 
+	if ( ! managed_yield && ! yield_types )
+		{
+		// The elements don't refer to other values, so copy them as
+		// they are.
+		*vv->vector_val = *vector_val;
+		return vv;
+		}
+
+	vv->Reserve(vector_val->size());
+
 	int n = vector_val->size();
 
 	for ( auto i = 0; i < n; ++i )
@@ -3968,6 +4221,46 @@ ValManager::ValManager()
 		}
 	}
 
+AddrValPtr ValManager::Addr(const IPAddr& addr)
+	{
+#ifdef ZEEK_COMPACT_VALUES
+	const uint32_t* words;
+	int n = addr.GetBytes(&words);
+
+	uint32_t h = 0;
+	for ( int i = 0; i < n; ++i )
+		h ^= words[i];
+
+	// Fibonacci hashing spreads out the low-entropy bits of addresses
+	// from the same network.
+	auto& v = addrs[(h * 2654435769u) >> (32 - ADDR_CACHE_BITS)];
+
+	if ( ! v || v->Get() != addr )
+		v = make_intrusive<AddrVal>(addr);
+
+	return v;
+#else
+	return make_intrusive<AddrVal>(addr);
+#endif
+	}
+
+StringValPtr ValManager::InternedString(std::string_view s)
+	{
+#ifdef ZEEK_COMPACT_VALUES
+	if ( auto it = interned_strings.find(s); it != interned_strings.end() )
+		return it->second;
+
+	auto sv = make_intrusive<StringVal>(s);
+
+	if ( s.size() <= MAX_INTERNED_STRING_LENGTH && interned_strings.size() < MAX_INTERNED_STRINGS )
+		interned_strings.emplace(s, sv);
+
+	return sv;
+#else
+	return make_intrusive<StringVal>(s);
+#endif
+	}
+
 const PortValPtr& ValManager::Port(uint32_t port_num, TransportProto port_type) const
 	{
 	if ( port_num >= 65536 )
@@ -3995,3 +4288,181 @@ const PortValPtr& ValManager::Port(uint32_t port_num) const
 	}
 
 	}
+
+using namespace zeek;
+
+namespace
+	{
+
+// Declarations of &optional fields f<first> up to f<first + n - 1>.  Even
+// fields are counts and odd ones strings, so every other field is managed.
+void add_optional_fields(type_decl_list* decls, int first, int n)
+	{
+	for ( int i = first; i < first + n; ++i )
+		{
+		auto t = i % 2 == 0 ? base_type(TYPE_COUNT) : base_type(TYPE_STRING);
+		std::vector<detail::AttrPtr> a{make_intrusive<detail::Attr>(detail::ATTR_OPTIONAL)};
+		auto attrs = make_intrusive<detail::Attributes>(std::move(a), t, true, false);
+		auto id = "f" + std::to_string(i);
+		decls->push_back(new TypeDecl(util::copy_string(id.c_str()), t, std::move(attrs)));
+		}
+	}
+
+RecordTypePtr optional_fields_type(int n)
+	{
+	auto decls = new type_decl_list();
+	add_optional_fields(decls, 0, n);
+	return make_intrusive<RecordType>(decls);
+	}
+
+// Each field's value is derived from its index.
+void set_field(RecordVal* r, int i)
+	{
+	if ( i % 2 == 0 )
+		r->Assign(i, zeek_uint_t(i));
+	else
+		r->Assign(i, std::to_string(i));
+	}
+
+bool field_is_set(const RecordVal* r, int i)
+	{
+	if ( ! r->HasField(i) )
+		return false;
+
+	if ( i % 2 == 0 )
+		return r->GetField<CountVal>(i)->Get() == zeek_uint_t(i);
+
+	return r->GetField<StringVal>(i)->ToStdString() == std::to_string(i);
+	}
+
+	} // namespace
+
+TEST_SUITE_BEGIN("RecordVal");
+
+TEST_CASE("record field presence across bitmap words")
+	{
+	auto r = make_intrusive<RecordVal>(optional_fields_type(130));
+	REQUIRE(r->NumFields() == 130);
+
+	for ( int i = 0; i < 130; ++i )
+		CHECK_FALSE(r->HasField(i));
+
+	std::set<int> fields = {0, 1, 62, 63, 64, 65, 127, 128, 129};
+
+	for ( auto i : fields )
+		set_field(r.get(), i);
+
+	for ( int i = 0; i < 130; ++i )
+		{
+		if ( fields.count(i) )
+			CHECK(field_is_set(r.get(), i));
+		else
+			CHECK_FALSE(r->HasField(i));
+		}
+
+	// Setting a field again replaces its value and leaves it present.
+	r->Assign(64, zeek_uint_t(1000));
+	r->Assign(65, "new");
+	CHECK(r->GetField<CountVal>(64)->Get() == 1000);
+	CHECK(r->GetField<StringVal>(65)->ToStdString() == "new");
+	CHECK(field_is_set(r.get(), 63));
+	CHECK(field_is_set(r.get(), 127));
+	}
+
+TEST_CASE("record optional fields can be cleared")
+	{
+	auto r = make_intrusive<RecordVal>(optional_fields_type(70));
+
+	for ( int i = 0; i < 70; ++i )
+		set_field(r.get(), i);
+
+	r->Remove(63);
+	r->Remove(64);
+	r->Assign(65, ValPtr());
+	r->Remove(66);
+	r->Remove(66);
+
+	for ( int i = 0; i < 70; ++i )
+		{
+		if ( i >= 63 && i <= 66 )
+			{
+			CHECK_FALSE(r->HasField(i));
+			CHECK(r->GetField(i) == nullptr);
+			}
+		else
+			CHECK(field_is_set(r.get(), i));
+		}
+
+	set_field(r.get(), 63);
+	set_field(r.get(), 64);
+	CHECK(field_is_set(r.get(), 63));
+	CHECK(field_is_set(r.get(), 64));
+	CHECK_FALSE(r->HasField(65));
+	}
+
+TEST_CASE("record fields survive growth")
+	{
+	// Redefining a record type while parsing appends fields to the
+	// records created so far, moving their storage each time.
+	auto rt = optional_fields_type(60);
+	run_state::is_parsing = true;
+	auto r = make_intrusive<RecordVal>(rt);
+	run_state::is_parsing = false;
+
+	for ( int i = 0; i < 60; i += 3 )
+		set_field(r.get(), i);
+
+	type_decl_list more;
+	add_optional_fields(&more, 60, 10);
+	CHECK(rt->AddFields(more) == nullptr);
+	RecordVal::DoneParsing();
+
+	REQUIRE(r->NumFields() == 70);
+
+	for ( int i = 0; i < 70; ++i )
+		{
+		if ( i < 60 && i % 3 == 0 )
+			CHECK(field_is_set(r.get(), i));
+		else
+			CHECK_FALSE(r->HasField(i));
+		}
+
+	for ( int i = 60; i < 70; ++i )
+		set_field(r.get(), i);
+
+	for ( int i = 0; i < 70; ++i )
+		CHECK(r->HasField(i) == ((i < 60 && i % 3 == 0) || i >= 60));
+
+	CHECK(field_is_set(r.get(), 63));
+	CHECK(field_is_set(r.get(), 64));
+	CHECK(field_is_set(r.get(), 69));
+	}
+
+TEST_CASE("record clone")
+	{
+	auto r = make_intrusive<RecordVal>(optional_fields_type(70));
+
+	for ( int i = 0; i < 70; ++i )
+		if ( i % 5 != 0 )
+			set_field(r.get(), i);
+
+	auto c = cast_intrusive<RecordVal>(r->Clone());
+	REQUIRE(c->NumFields() == 70);
+
+	for ( int i = 0; i < 70; ++i )
+		{
+		if ( i % 5 != 0 )
+			CHECK(field_is_set(c.get(), i));
+		else
+			CHECK_FALSE(c->HasField(i));
+		}
+
+	// The clone doesn't share its managed fields with the original.
+	CHECK(c->GetField(1).get() != r->GetField(1).get());
+	r->Assign(1, "changed");
+	r->Remove(2);
+	CHECK(field_is_set(c.get(), 1));
+	CHECK(field_is_set(c.get(), 2));
+	}
+
+TEST_SUITE_END();
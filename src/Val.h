@@ -2,13 +2,18 @@
 
 #pragma once
 
+#include "zeek/zeek-config.h"
+
 #include <sys/types.h> // for u_char
 #include <array>
 #include <list>
+#include <map>
 #include <unordered_map>
 #include <vector>
 
+#include "zeek/IPAddr.h"
 #include "zeek/IntrusivePtr.h"
+#include "zeek/MemoryPool.h"
 #include "zeek/Notifier.h"
 #include "zeek/Reporter.h"
 #include "zeek/Timer.h"
@@ -49,6 +54,7 @@ class Frame;
 class PrefixTable;
 class CompositeHash;
 class HashKey;
+class TableExpireIndex;
 
 class ValTrace;
 class ZBody;
@@ -102,6 +108,12 @@ public:
 
 	~Val() override;
 
+	// Values come and go at a high rate, most of them living just for
+	// the dispatch of an event or the evaluation of an expression, so
+	// with memory pools enabled they're allocated from a pool shared by
+	// all value classes.
+	ZEEK_POOL_ALLOCATED(pool)
+
 	Val* Ref()
 		{
 		zeek::Ref(this);
@@ -138,6 +150,27 @@ public:
 		return Footprint(&analyzed_vals);
 		}
 
+	/**
+	 * Returns an estimate of the memory the value takes, in bytes. Unlike
+	 * Footprint(), this doesn't traverse the value: tables keep a running
+	 * total of what their entries took when inserted, so they answer in
+	 * constant time. Records add up their fields, and vectors count their
+	 * slots plus a fixed size per element value.
+	 *
+	 * Values referenced from several places count for each of them, and
+	 * changes made in place to a table's element only show once the
+	 * element gets assigned again.
+	 *
+	 * @return  The estimated size in bytes.
+	 */
+	virtual uint64_t MemoryFootprint() const { return sizeof(Val); }
+
+	/**
+	 * Returns the number of values alive, indexed by the TypeTag of
+	 * their type, which determines their class.
+	 */
+	static const uint64_t* LiveCounts() { return live_counts; }
+
 	// Add this value to the given value (if appropriate).
 	// Returns true if succcessful.  is_first_init is true only if
 	// this is the *first* initialization of the value, not
@@ -254,7 +287,7 @@ protected:
 	static ValPtr MakeInt(zeek_int_t i);
 	static ValPtr MakeCount(zeek_uint_t u);
 
-	explicit Val(TypePtr t) noexcept : type(std::move(t)) { }
+	explicit Val(TypePtr t) noexcept : type(std::move(t)) { ++live_counts[type->Tag()]; }
 
 	/**
 	 * Internal function for computing a Val's "footprint".
@@ -287,6 +320,11 @@ protected:
 
 	TypePtr type;
 
+	static detail::MemoryPool pool;
+
+	// Values come and go only in the main thread.
+	static uint64_t live_counts[NUM_TYPES];
+
 #ifdef DEBUG
 	// For debugging, we keep the name of the ID to which a Val is bound.
 	const char* bound_id = nullptr;
@@ -303,6 +341,9 @@ public:
 	static constexpr zeek_int_t PREALLOCATED_INT_LOWEST = -255;
 	static constexpr zeek_int_t PREALLOCATED_INT_HIGHEST = PREALLOCATED_INT_LOWEST +
 	                                                       PREALLOCATED_INTS - 1;
+	static constexpr size_t MAX_INTERNED_STRINGS = 1024;
+	static constexpr size_t MAX_INTERNED_STRING_LENGTH = 64;
+	static constexpr int ADDR_CACHE_BITS = 12;
 
 	ValManager();
 
@@ -326,6 +367,33 @@ public:
 
 	inline const StringValPtr& EmptyString() const { return empty_string; }
 
+	/**
+	 * Returns a string value shared by everyone asking for the same
+	 * contents, for strings that analyzers produce over and over, such
+	 * as HTTP methods or MIME header names.  Shared values live until
+	 * shutdown, so only a limited number of short strings get shared;
+	 * others come back as new values.  Callers must not modify the value.
+	 * Values only get shared when Zeek is configured with
+	 * ``--enable-compact-values``.
+	 *
+	 * @param s  The string's contents.
+	 *
+	 * @return  The string value.
+	 */
+	StringValPtr InternedString(std::string_view s);
+
+	/**
+	 * Returns a value for the given address. When Zeek is configured
+	 * with ``--enable-compact-values``, values of recently used addresses
+	 * are shared, as with ints, counts and ports, which saves allocations
+	 * for the hosts that keep coming up in connections and table indices.
+	 *
+	 * @param addr  The address.
+	 *
+	 * @return  The address value.
+	 */
+	AddrValPtr Addr(const IPAddr& addr);
+
 	// Port number given in host order.
 	const PortValPtr& Port(uint32_t port_num, TransportProto port_type) const;
 
@@ -336,7 +404,13 @@ private:
 	std::array<std::array<PortValPtr, 65536>, NUM_PORT_SPACES> ports;
 	std::array<ValPtr, PREALLOCATED_COUNTS> counts;
 	std::array<ValPtr, PREALLOCATED_INTS> ints;
+#ifdef ZEEK_COMPACT_VALUES
+	std::array<AddrValPtr, 1 << ADDR_CACHE_BITS> addrs;
+#endif
 	StringValPtr empty_string;
+#ifdef ZEEK_COMPACT_VALUES
+	std::map<std::string, StringValPtr, std::less<>> interned_strings;
+#endif
 	ValPtr b_true;
 	ValPtr b_false;
 	};
@@ -497,7 +571,9 @@ class AddrVal final : public Val
 public:
 	explicit AddrVal(const char* text);
 	explicit AddrVal(const std::string& text);
+#ifndef ZEEK_COMPACT_VALUES
 	~AddrVal() override;
+#endif
 
 	ValPtr SizeVal() const override;
 
@@ -506,13 +582,21 @@ public:
 	explicit AddrVal(const uint32_t addr[4]); // IPv6.
 	explicit AddrVal(const IPAddr& addr);
 
+#ifdef ZEEK_COMPACT_VALUES
+	const IPAddr& Get() const { return addr_val; }
+#else
 	const IPAddr& Get() const { return *addr_val; }
+#endif
 
 protected:
 	ValPtr DoClone(CloneState* state) override;
 
 private:
+#ifdef ZEEK_COMPACT_VALUES
+	IPAddr addr_val;
+#else
 	IPAddr* addr_val;
+#endif
 	};
 
 class SubNetVal final : public Val
@@ -571,6 +655,8 @@ public:
 
 	StringValPtr Replace(RE_Matcher* re, const String& repl, bool do_all);
 
+	uint64_t MemoryFootprint() const override;
+
 protected:
 	void ValDescribe(ODesc* d) const override;
 	ValPtr DoClone(CloneState* state) override;
@@ -718,6 +804,13 @@ protected:
 	// to save a few bytes, as we do not need a high resolution for these
 	// anyway.
 	int expire_access_time;
+
+	// The bucket of the table's expiration index that has the entry's
+	// key, see TableExpireIndex.
+	int expire_bucket = 0;
+
+	// What the entry added to its table's memory footprint.
+	uint32_t footprint = 0;
 	};
 
 class TableValTimer final : public detail::Timer
@@ -861,6 +954,21 @@ public:
 	 */
 	ValPtr FindOrDefault(const ValPtr& index);
 
+	/**
+	 * Returns true if FindZVals() can be used on this table. That's the
+	 * case if all its index types are numbers, addresses or strings.
+	 */
+	bool HasFastIndex() const { return fast_index; }
+
+	/**
+	 * Like Find(), for an index given as ZVals, one for each of the
+	 * table's index types. This spares building Vals for the index.
+	 * Requires HasFastIndex().
+	 * @param index  The index values to lookup in the table.
+	 * @return  The value associated with the index, as for Find().
+	 */
+	const ValPtr& FindZVals(const ZVal* index);
+
 	/**
 	 * Returns true if this is a table[subnet]/set[subnet] and the
 	 * given address was found in the table. Otherwise returns false.
@@ -890,6 +998,17 @@ public:
 	 */
 	ListValPtr RecreateIndex(const detail::HashKey& k) const;
 
+	/**
+	 * Like RecreateIndex(), for tables with HasFastIndex(), recovering
+	 * the index directly as ZVals.
+	 * @param k  The HashKey of the index.
+	 * @param wanted  Flags for which of the index values to recover.
+	 * @param vals  Receives the recovered values, which come with a
+	 *        reference if they're managed.
+	 */
+	void RecreateIndex(const detail::HashKey& k, const std::vector<bool>& wanted,
+	                   ZVal* vals) const;
+
 	/**
 	 * Remove an element from the table and return it.
 	 * @param index  The index to remove.
@@ -936,6 +1055,8 @@ public:
 	int Size() const;
 	int RecursiveSize() const;
 
+	uint64_t MemoryFootprint() const override;
+
 	// Returns the Prefix table used inside the table (if present).
 	// This allows us to do more direct queries to this specialized
 	// type that the general Table API does not allow.
@@ -1022,6 +1143,9 @@ protected:
 	// Calls &expire_func and returns its return interval;
 	double CallExpireFunc(ListValPtr idx);
 
+	// Adds an entry's key to the expiration index, if there is one.
+	void AddToExpireIndex(const detail::HashKey& k, TableEntryVal* v);
+
 	// Enum for the different kinds of changes an &on_change handler can see
 	enum OnChangeType
 		{
@@ -1037,6 +1161,11 @@ protected:
 	// Sends data on to backing Broker Store
 	void SendToStore(const Val* index, const TableEntryVal* new_entry_val, OnChangeType tpe);
 
+	// Adds a new entry to the table's memory footprint, and takes
+	// away one that's leaving.
+	void AddToFootprint(const detail::HashKey& k, TableEntryVal* v);
+	void RemoveFromFootprint(const TableEntryVal* v) { entries_footprint -= v->footprint; }
+
 	unsigned int ComputeFootprint(std::unordered_set<const Val*>* analyzed_vals) const override;
 
 	ValPtr DoClone(CloneState* state) override;
@@ -1047,19 +1176,23 @@ protected:
 	detail::ExprPtr expire_time;
 	detail::ExprPtr expire_func;
 	TableValTimer* timer;
-	RobustDictIterator<TableEntryVal>* expire_iterator;
+	detail::TableExpireIndex* expire_index;
 	detail::PrefixTable* subnets;
 	ValPtr def_val;
 	detail::ExprPtr change_func;
 	std::string broker_store;
 	// prevent recursion of change functions
 	bool in_change_func = false;
+	bool fast_index = false;
 
 	static TableRecordDependencies parse_time_table_record_dependencies;
 	static ParseTimeTableStates parse_time_table_states;
 
 private:
 	PDict<TableEntryVal>* table_val;
+
+	// The sum of the entries' footprints.
+	uint64_t entries_footprint = 0;
 	};
 
 // This would be way easier with is_convertible_v, but sadly that won't
@@ -1089,6 +1222,8 @@ public:
 
 	ValPtr SizeVal() const override;
 
+	uint64_t MemoryFootprint() const override { return MemoryFootprint(0); }
+
 	/**
 	 * Assign a value to a record field.
 	 * @param field  The field index to assign.
@@ -1118,13 +1253,15 @@ public:
 	// The following provide efficient record field assignments.
 	void Assign(int field, bool new_val)
 		{
-		(*record_val)[field] = ZVal(zeek_int_t(new_val));
+		record_val[field] = ZVal(zeek_int_t(new_val));
+		SetPresent(field);
 		AddedField(field);
 		}
 
 	void Assign(int field, int new_val)
 		{
-		(*record_val)[field] = ZVal(zeek_int_t(new_val));
+		record_val[field] = ZVal(zeek_int_t(new_val));
+		SetPresent(field);
 		AddedField(field);
 		}
 
@@ -1133,18 +1270,21 @@ public:
 	// than the other.
 	void Assign(int field, uint32_t new_val)
 		{
-		(*record_val)[field] = ZVal(zeek_uint_t(new_val));
+		record_val[field] = ZVal(zeek_uint_t(new_val));
+		SetPresent(field);
 		AddedField(field);
 		}
 	void Assign(int field, uint64_t new_val)
 		{
-		(*record_val)[field] = ZVal(zeek_uint_t(new_val));
+		record_val[field] = ZVal(zeek_uint_t(new_val));
+		SetPresent(field);
 		AddedField(field);
 		}
 
 	void Assign(int field, double new_val)
 		{
-		(*record_val)[field] = ZVal(new_val);
+		record_val[field] = ZVal(new_val);
+		SetPresent(field);
 		AddedField(field);
 		}
 
@@ -1158,8 +1298,9 @@ public:
 	void Assign(int field, StringVal* new_val)
 		{
 		if ( HasField(field) )
-			ZVal::DeleteManagedType(*(*record_val)[field]);
-		(*record_val)[field] = ZVal(new_val);
+			ZVal::DeleteManagedType(record_val[field]);
+		record_val[field] = ZVal(new_val);
+		SetPresent(field);
 		AddedField(field);
 		}
 	void Assign(int field, const char* new_val) { Assign(field, new StringVal(new_val)); }
@@ -1182,7 +1323,7 @@ public:
 	 * Returns the number of fields in the record.
 	 * @return  The number of fields in the record.
 	 */
-	unsigned int NumFields() const { return record_val->size(); }
+	unsigned int NumFields() const { return num_fields; }
 
 	/**
 	 * Returns true if the given field is in the record, false if
@@ -1190,7 +1331,10 @@ public:
 	 * @param field  The field index to retrieve.
 	 * @return  Whether there's a value for the given field index.
 	 */
-	bool HasField(int field) const { return (*record_val)[field] ? true : false; }
+	bool HasField(int field) const
+		{
+		return (present[field / 64] & (uint64_t(1) << (field % 64))) != 0;
+		}
 
 	/**
 	 * Returns true if the given field is in the record, false if
@@ -1214,7 +1358,7 @@ public:
 		if ( ! HasField(field) )
 			return nullptr;
 
-		return (*record_val)[field]->ToVal(rt->GetFieldType(field));
+		return record_val[field].ToVal(rt->GetFieldType(field));
 		}
 
 	/**
@@ -1289,32 +1433,32 @@ public:
 		{
 		if constexpr ( std::is_same_v<T, BoolVal> || std::is_same_v<T, IntVal> ||
 		               std::is_same_v<T, EnumVal> )
-			return record_val->operator[](field)->int_val;
+			return record_val[field].int_val;
 		else if constexpr ( std::is_same_v<T, CountVal> )
-			return record_val->operator[](field)->uint_val;
+			return record_val[field].uint_val;
 		else if constexpr ( std::is_same_v<T, DoubleVal> || std::is_same_v<T, TimeVal> ||
 		                    std::is_same_v<T, IntervalVal> )
-			return record_val->operator[](field)->double_val;
+			return record_val[field].double_val;
 		else if constexpr ( std::is_same_v<T, PortVal> )
-			return val_mgr->Port(record_val->at(field)->uint_val);
+			return val_mgr->Port(record_val[field].uint_val);
 		else if constexpr ( std::is_same_v<T, StringVal> )
-			return record_val->operator[](field)->string_val->Get();
+			return record_val[field].string_val->Get();
 		else if constexpr ( std::is_same_v<T, AddrVal> )
-			return record_val->operator[](field)->addr_val->Get();
+			return record_val[field].addr_val->Get();
 		else if constexpr ( std::is_same_v<T, SubNetVal> )
-			return record_val->operator[](field)->subnet_val->Get();
+			return record_val[field].subnet_val->Get();
 		else if constexpr ( std::is_same_v<T, File> )
-			return *(record_val->operator[](field)->file_val);
+			return *(record_val[field].file_val);
 		else if constexpr ( std::is_same_v<T, Func> )
-			return *(record_val->operator[](field)->func_val);
+			return *(record_val[field].func_val);
 		else if constexpr ( std::is_same_v<T, PatternVal> )
-			return record_val->operator[](field)->re_val->Get();
+			return record_val[field].re_val->Get();
 		else if constexpr ( std::is_same_v<T, RecordVal> )
-			return record_val->operator[](field)->record_val;
+			return record_val[field].record_val;
 		else if constexpr ( std::is_same_v<T, VectorVal> )
-			return record_val->operator[](field)->vector_val;
+			return record_val[field].vector_val;
 		else if constexpr ( std::is_same_v<T, TableVal> )
-			return record_val->operator[](field)->table_val->Get();
+			return record_val[field].table_val->Get();
 		else
 			{
 			// It's an error to reach here, although because of
@@ -1328,11 +1472,11 @@ public:
 	T GetFieldAs(int field) const
 		{
 		if constexpr ( std::is_integral_v<T> && std::is_signed_v<T> )
-			return record_val->operator[](field)->int_val;
+			return record_val[field].int_val;
 		else if constexpr ( std::is_integral_v<T> && std::is_unsigned_v<T> )
-			return record_val->operator[](field)->uint_val;
+			return record_val[field].uint_val;
 		else if constexpr ( std::is_floating_point_v<T> )
-			return record_val->operator[](field)->double_val;
+			return record_val[field].double_val;
 
 		// Note: we could add other types here using type traits,
 		// such as is_same_v<T, std::string>, etc.
@@ -1389,6 +1533,7 @@ public:
 protected:
 	friend class zeek::detail::ValTrace;
 	friend class zeek::detail::ZBody;
+	friend class RecordType; // for AppendRawField()
 
 	RecordValPtr DoCoerceTo(RecordTypePtr other, bool allow_orphaning) const;
 
@@ -1404,23 +1549,52 @@ protected:
 	void AppendField(ValPtr v, const TypePtr& t)
 		{
 		if ( v )
-			record_val->emplace_back(ZVal(v, t));
+			AppendRawField(ZVal(v, t));
 		else
-			record_val->emplace_back(std::nullopt);
+			AppendRawField(std::nullopt);
+		}
+
+	/**
+	 * Appends a low-level value to the record's fields, or a missing
+	 * field if there's none.  The caller assumes responsibility for
+	 * memory management.
+	 * @param v  The value to append.
+	 */
+	void AppendRawField(std::optional<ZVal> v)
+		{
+		if ( num_fields == max_fields )
+			Reserve(num_fields + 1);
+
+		if ( v )
+			{
+			record_val[num_fields] = *v;
+			SetPresent(num_fields);
+			}
+
+		++num_fields;
 		}
 
 	// For internal use by low-level ZAM instructions and event tracing.
 	// Caller assumes responsibility for memory management.  The first
-	// version allows manipulation of whether the field is present at all.
-	// The second version ensures that the optional value is present.
-	std::optional<ZVal>& RawOptField(int field) { return (*record_val)[field]; }
+	// version returns the field's value if it's present at all.  The
+	// second version ensures that the value is present.
+	std::optional<ZVal> RawOptField(int field) const
+		{
+		if ( ! HasField(field) )
+			return std::nullopt;
+
+		return record_val[field];
+		}
 
 	ZVal& RawField(int field)
 		{
-		auto& f = RawOptField(field);
-		if ( ! f )
-			f = ZVal();
-		return *f;
+		if ( ! HasField(field) )
+			{
+			record_val[field] = ZVal();
+			SetPresent(field);
+			}
+
+		return record_val[field];
 		}
 
 	ValPtr DoClone(CloneState* state) override;
@@ -1436,21 +1610,41 @@ private:
 	void DeleteFieldIfManaged(unsigned int field)
 		{
 		if ( HasField(field) && IsManaged(field) )
-			ZVal::DeleteManagedType(*(*record_val)[field]);
+			ZVal::DeleteManagedType(record_val[field]);
+		}
+
+	void SetPresent(unsigned int field) { present[field / 64] |= uint64_t(1) << (field % 64); }
+	void ClearPresent(unsigned int field)
+		{
+		present[field / 64] &= ~(uint64_t(1) << (field % 64));
 		}
 
+	// Makes room for at least the given number of fields.
+	void Reserve(unsigned int n);
+
 	bool IsManaged(unsigned int offset) const { return is_managed[offset]; }
 
 	// Just for template inferencing.
 	RecordVal* Get() { return this; }
 
+	// Nested records count up to a depth limit, in case of records
+	// containing themselves.
+	uint64_t MemoryFootprint(int depth) const;
+
 	unsigned int ComputeFootprint(std::unordered_set<const Val*>* analyzed_vals) const override;
 
 	// Keep this handy for quick access during low-level operations.
 	RecordTypePtr rt;
 
-	// Low-level values of each of the fields.
-	std::vector<std::optional<ZVal>>* record_val;
+	// Low-level values of each of the fields, followed in the same
+	// allocation by a bitmap telling which of them are present.  That's
+	// a single allocation of 8 bytes and a bit per field, where a vector
+	// of optional values would take two allocations and 16 bytes.
+	ZVal* record_val = nullptr;
+	uint64_t* present = nullptr;
+
+	unsigned int num_fields = 0;
+	unsigned int max_fields = 0;
 
 	// Whether a given field requires explicit memory management.
 	const std::vector<bool>& is_managed;
@@ -1500,6 +1694,8 @@ public:
 
 	ValPtr SizeVal() const override;
 
+	uint64_t MemoryFootprint() const override;
+
 	/**
 	 * Assigns an element to a given vector index.
 	 * @param index  The index to assign.
@@ -1,15 +1,70 @@
 #include "zeek/WeirdState.h"
 
+#include <memory>
+#include <unordered_map>
+
+#include "zeek/3rdparty/doctest.h"
 #include "zeek/RunState.h"
 #include "zeek/util.h"
 
 namespace zeek::detail
 	{
 
-bool PermitWeird(WeirdStateMap& wsm, const char* name, uint64_t threshold, uint64_t rate,
+namespace
+	{
+
+// The names own their strings, and the index refers to them by views.
+// Keeping the names in unique_ptrs keeps the views valid as the vector
+// grows.
+std::vector<std::unique_ptr<std::string>> weird_names;
+std::unordered_map<std::string_view, WeirdID> weird_ids;
+
+	} // namespace
+
+WeirdID intern_weird(std::string_view name)
+	{
+	if ( auto it = weird_ids.find(name); it != weird_ids.end() )
+		return it->second;
+
+	auto id = static_cast<WeirdID>(weird_names.size());
+	weird_names.emplace_back(std::make_unique<std::string>(name));
+	weird_ids.emplace(*weird_names.back(), id);
+	return id;
+	}
+
+const std::string& weird_name(WeirdID id)
+	{
+	return *weird_names[id];
+	}
+
+size_t num_weird_names()
+	{
+	return weird_names.size();
+	}
+
+TEST_CASE("weird interning")
+	{
+	auto a = intern_weird("test_weird_interning_a");
+	auto b = intern_weird("test_weird_interning_b");
+
+	CHECK(a != b);
+	CHECK(intern_weird(std::string("test_weird_interning_a")) == a);
+	CHECK(weird_name(b) == "test_weird_interning_b");
+	CHECK(num_weird_names() > b);
+
+	WeirdStateMap wsm;
+	CHECK(wsm.empty());
+	wsm[a].count = 3;
+	wsm[b].count = 5;
+	CHECK(wsm[a].count == 3);
+	CHECK(wsm[b].count == 5);
+	CHECK_FALSE(wsm.empty());
+	}
+
+bool PermitWeird(WeirdStateMap& wsm, WeirdID id, uint64_t threshold, uint64_t rate,
                  double duration)
 	{
-	auto& state = wsm[name];
+	auto& state = wsm[id];
 	++state.count;
 
 	if ( state.count <= threshold )
@@ -2,12 +2,35 @@
 
 #pragma once
 
+#include <cstdint>
 #include <string>
-#include <unordered_map>
+#include <string_view>
+#include <utility>
+#include <vector>
 
 namespace zeek::detail
 	{
 
+// Weird names get interned to small integers on first use, so that tracking
+// weirds by name needs a single string lookup per weird.
+using WeirdID = uint32_t;
+
+/**
+ * Returns the ID of a weird name, assigning the next unused one to names
+ * not seen before. IDs count up from zero.
+ */
+WeirdID intern_weird(std::string_view name);
+
+/**
+ * Returns the name of an interned weird.
+ */
+const std::string& weird_name(WeirdID id);
+
+/**
+ * Returns the number of weird names interned so far.
+ */
+size_t num_weird_names();
+
 struct WeirdState
 	{
 	WeirdState() = default;
@@ -15,9 +38,34 @@ struct WeirdState
 	double sampling_start_time = 0;
 	};
 
-using WeirdStateMap = std::unordered_map<std::string, WeirdState>;
+// The sampling state of the weirds of a connection, file or flow. These
+// mostly see a few kinds of weirds, so a short vector searched linearly
+// beats a hash table.
+class WeirdStateMap
+	{
+public:
+	WeirdState& operator[](WeirdID id)
+		{
+		for ( auto& [i, state] : states )
+			if ( i == id )
+				return state;
+
+		return states.emplace_back(id, WeirdState{}).second;
+		}
 
-bool PermitWeird(WeirdStateMap& wsm, const char* name, uint64_t threshold, uint64_t rate,
+	bool empty() const { return states.empty(); }
+
+private:
+	std::vector<std::pair<WeirdID, WeirdState>> states;
+	};
+
+bool PermitWeird(WeirdStateMap& wsm, WeirdID id, uint64_t threshold, uint64_t rate,
                  double duration);
 
+inline bool PermitWeird(WeirdStateMap& wsm, const char* name, uint64_t threshold, uint64_t rate,
+                        double duration)
+	{
+	return PermitWeird(wsm, intern_weird(name), threshold, rate, duration);
+	}
+
 	} // namespace zeek::detail
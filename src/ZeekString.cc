@@ -26,6 +26,8 @@ using namespace std::string_literals;
 namespace zeek
 	{
 
+detail::MemoryPool String::pool("string", detail::ARENA_VALUES);
+
 // This constructor forces the user to specify arg_final_NUL.  When str
 // is a *normal* NUL-terminated string, make arg_n == strlen(str) and
 // arg_final_NUL == 1; when str is a sequence of n bytes, make
@@ -64,10 +66,13 @@ String::String()
 
 void String::Reset()
 	{
-	if ( use_free_to_delete )
-		free(b);
-	else
-		delete[] b;
+	if ( ! IsInline() )
+		{
+		if ( use_free_to_delete )
+			free(b);
+		else
+			delete[] b;
+		}
 
 	b = nullptr;
 	n = 0;
@@ -77,9 +82,12 @@ void String::Reset()
 
 const String& String::operator=(const String& bs)
 	{
+	if ( this == &bs )
+		return *this;
+
 	Reset();
 	n = bs.n;
-	b = new u_char[n + 1];
+	b = Allocate(n + 1);
 
 	memcpy(b, bs.b, n);
 	b[n] = '\0';
@@ -134,7 +142,7 @@ void String::Set(const u_char* str, int len, bool add_NUL)
 	Reset();
 
 	n = len;
-	b = new u_char[add_NUL ? n + 1 : n];
+	b = Allocate(add_NUL ? n + 1 : n);
 	memcpy(b, str, n);
 	final_NUL = add_NUL;
 
@@ -151,7 +159,7 @@ void String::Set(std::string_view str)
 	if ( str.data() )
 		{
 		n = str.size();
-		b = new u_char[n + 1];
+		b = Allocate(n + 1);
 		memcpy(b, str.data(), n);
 		b[n] = 0;
 		final_NUL = true;
@@ -211,13 +219,12 @@ char* String::Render(int format, int* len) const
 
 		else if ( (b[i] < ' ' || b[i] > 126) && (format & ESC_HEX) )
 			{
-			char hex_fmt[16];
+			static const char hex[] = "0123456789abcdef";
 
 			*sp++ = '\\';
 			*sp++ = 'x';
-			sprintf(hex_fmt, "%02x", b[i]);
-			*sp++ = hex_fmt[0];
-			*sp++ = hex_fmt[1];
+			*sp++ = hex[b[i] >> 4];
+			*sp++ = hex[b[i] & 0xf];
 			}
 
 		else if ( (b[i] < ' ' || b[i] > 126) && (format & ESC_DOT) )
@@ -286,9 +293,7 @@ std::istream& String::Read(std::istream& is, int format)
 
 void String::ToUpper()
 	{
-	for ( int i = 0; i < n; ++i )
-		if ( islower(b[i]) )
-			b[i] = toupper(b[i]);
+	util::ascii_to_upper(b, n, b);
 	}
 
 String* String::GetSubstring(int start, int len) const
@@ -481,6 +486,28 @@ String* concatenate(String::CVec& v)
 	return new String(true, (byte_vec)data, len);
 	}
 
+String* concatenate(const String* s1, const String* s2, const String* s3)
+	{
+	int len = s1->Len() + s2->Len() + (s3 ? s3->Len() : 0);
+	char* data = new char[len + 1];
+
+	char* b = data;
+	memcpy(b, s1->Bytes(), s1->Len());
+	b += s1->Len();
+	memcpy(b, s2->Bytes(), s2->Len());
+	b += s2->Len();
+
+	if ( s3 )
+		{
+		memcpy(b, s3->Bytes(), s3->Len());
+		b += s3->Len();
+		}
+
+	*b = '\0';
+
+	return new String(true, (byte_vec)data, len);
+	}
+
 String* concatenate(String::Vec& v)
 	{
 	String::CVec cv;
@@ -597,6 +624,46 @@ TEST_CASE("set/assignment/comparison")
 	CHECK_FALSE(s < s5);
 	}
 
+#ifdef ZEEK_COMPACT_VALUES
+TEST_CASE("inline storage")
+	{
+	zeek::String s{"GET"};
+	CHECK(s.IsInline());
+
+	// The final NUL needs to fit, too.
+	std::string fits(zeek::String::INLINE_SIZE - 1, 'x');
+	zeek::String s2{fits};
+	CHECK(s2.IsInline());
+	CHECK_EQ(s2, fits);
+
+	zeek::String s3{fits + "x"};
+	CHECK_FALSE(s3.IsInline());
+	CHECK_EQ(s3, fits + "x");
+
+	// Copies get their own bytes, wherever they keep them.
+	zeek::String s4{s};
+	CHECK(s4.IsInline());
+	CHECK(s4.Bytes() != s.Bytes());
+	s4.ToUpper();
+	CHECK_EQ(s, "GET");
+
+	s = s3;
+	CHECK_FALSE(s.IsInline());
+	CHECK_EQ(s, s3);
+
+	s.Set("abc");
+	CHECK(s.IsInline());
+	CHECK_EQ(s, "abc");
+
+	s = s;
+	CHECK_EQ(s, "abc");
+
+	zeek::String s5{reinterpret_cast<const u_char*>("ab"), 2, false};
+	CHECK(s5.IsInline());
+	CHECK_EQ(s5.Len(), 2);
+	}
+#endif
+
 TEST_CASE("searching/modification")
 	{
 	zeek::String s{"this is a test"};
@@ -717,6 +784,17 @@ TEST_CASE("misc")
 	CHECK_EQ(*s, "abcdefghijk");
 	delete s;
 
+	zeek::String c1{"abc"};
+	zeek::String c2{""};
+	zeek::String c3{"defg"};
+	s = zeek::concatenate(&c1, &c3);
+	CHECK_EQ(*s, "abcdefg");
+	CHECK_EQ(s->Bytes()[s->Len()], '\0');
+	delete s;
+	s = zeek::concatenate(&c1, &c2, &c3);
+	CHECK_EQ(*s, "abcdefg");
+	delete s;
+
 	std::vector<zeek::String*> sv2 = {new zeek::String{"abcde"}, new zeek::String{"fghi"}};
 	std::sort(sv2.begin(), sv2.end(), zeek::StringLenCmp(true));
 	CHECK_EQ(*(sv2.front()), "fghi");
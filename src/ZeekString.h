@@ -9,6 +9,8 @@
 #include <string>
 #include <vector>
 
+#include "zeek/MemoryPool.h"
+
 namespace zeek
 	{
 
@@ -52,6 +54,10 @@ public:
 	String();
 	~String() { Reset(); }
 
+	// Strings mostly belong to values, which come and go at a high
+	// rate, so with memory pools enabled they're allocated from a pool.
+	ZEEK_POOL_ALLOCATED(pool)
+
 	const String& operator=(const String& bs);
 	bool operator==(const String& bs) const;
 	bool operator<(const String& bs) const;
@@ -157,13 +163,37 @@ public:
 	static Vec* VecFromPolicy(VectorVal* vec);
 	static char* VecToString(const Vec* vec);
 
+#ifdef ZEEK_COMPACT_VALUES
+	// Strings of up to this many bytes, including any final NUL, keep
+	// them inside the object rather than in a separate allocation.
+	static constexpr int INLINE_SIZE = 16;
+
+	// Whether the string's bytes are inside the object.
+	bool IsInline() const { return b == inline_bytes; }
+#else
+	bool IsInline() const { return false; }
+#endif
+
 protected:
 	void Reset();
 
+	// Returns room for the given number of bytes, inside the object if
+	// they fit.
+#ifdef ZEEK_COMPACT_VALUES
+	byte_vec Allocate(int len) { return len <= INLINE_SIZE ? inline_bytes : new u_char[len]; }
+#else
+	byte_vec Allocate(int len) { return new u_char[len]; }
+#endif
+
 	byte_vec b;
 	int n;
 	bool final_NUL; // whether we have added a final NUL
 	bool use_free_to_delete; // free() vs. operator delete
+#ifdef ZEEK_COMPACT_VALUES
+	u_char inline_bytes[INLINE_SIZE];
+#endif
+
+	static detail::MemoryPool pool;
 	};
 
 // A comparison class that sorts pointers to String's according to
@@ -202,6 +232,7 @@ struct data_chunk_t
 extern String* concatenate(std::vector<data_chunk_t>& v);
 extern String* concatenate(String::Vec& v);
 extern String* concatenate(String::CVec& v);
+extern String* concatenate(const String* s1, const String* s2, const String* s3 = nullptr);
 extern void delete_strings(std::vector<const String*>& v);
 
 	} // namespace zeek
@@ -4,6 +4,7 @@
 
 #include <binpac.h>
 #include <algorithm>
+#include <chrono>
 
 #include "zeek/Event.h"
 #include "zeek/ZeekString.h"
@@ -13,6 +14,60 @@
 namespace zeek::analyzer
 	{
 
+namespace
+	{
+
+// Counts a delivery to an analyzer, and times it if it's sampled. Each
+// analyzer gets only the time that its children didn't take.
+class DeliveryTimer
+	{
+public:
+	DeliveryTimer(AnalyzerStats* arg_stats, int len) : stats(arg_stats)
+		{
+		if ( ! stats )
+			return;
+
+		++stats->deliveries;
+		stats->bytes += len;
+
+		// Within a timed delivery, the nested ones get timed too so that
+		// the outer one can leave out their time.
+		if ( ! current && ! analyzer_mgr->SampleDelivery() )
+			return;
+
+		parent = current;
+		current = this;
+		timed = true;
+		start = std::chrono::steady_clock::now();
+		}
+
+	~DeliveryTimer()
+		{
+		if ( ! timed )
+			return;
+
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		++stats->sampled;
+		stats->sampled_time += elapsed.count() - children;
+		current = parent;
+
+		if ( parent )
+			parent->children += elapsed.count();
+		}
+
+private:
+	// Analyzers run on the main thread only.
+	static inline DeliveryTimer* current = nullptr;
+
+	AnalyzerStats* stats;
+	DeliveryTimer* parent = nullptr;
+	std::chrono::steady_clock::time_point start;
+	double children = 0;
+	bool timed = false;
+	};
+
+	} // namespace
+
 class AnalyzerTimer final : public zeek::detail::Timer
 	{
 public:
@@ -68,6 +123,7 @@ void AnalyzerTimer::Init(Analyzer* arg_analyzer, analyzer_timer_func arg_timer,
 	}
 
 analyzer::ID Analyzer::id_counter = 0;
+zeek::detail::MemoryPool Analyzer::pool("analyzer", zeek::detail::ARENA_SESSIONS);
 
 const char* Analyzer::GetAnalyzerName() const
 	{
@@ -121,17 +177,29 @@ void Analyzer::CtorInit(const zeek::Tag& arg_tag, Connection* arg_conn)
 	skip = false;
 	finished = false;
 	removing = false;
+	content_done_orig = false;
+	content_done_resp = false;
 	parent = nullptr;
 	orig_supporters = nullptr;
 	resp_supporters = nullptr;
 	signature = nullptr;
 	output_handler = nullptr;
+	stats = nullptr;
+
+	if ( tag && analyzer_mgr )
+		{
+		stats = analyzer_mgr->GetStats(tag);
+		++stats->instances;
+		}
 	}
 
 Analyzer::~Analyzer()
 	{
 	assert(finished);
 
+	if ( stats )
+		--stats->instances;
+
 	// Make sure any late entries into the analyzer tree are handled (e.g.
 	// from some Done() implementation).
 	LOOP_OVER_GIVEN_CHILDREN(i, new_children)
@@ -223,6 +291,7 @@ void Analyzer::NextPacket(int len, const u_char* data, bool is_orig, uint64_t se
 		{
 		try
 			{
+			DeliveryTimer timer(stats, len);
 			DeliverPacket(len, data, is_orig, seq, ip, caplen);
 			}
 		catch ( binpac::Exception const& e )
@@ -246,6 +315,7 @@ void Analyzer::NextStream(int len, const u_char* data, bool is_orig)
 		{
 		try
 			{
+			DeliveryTimer timer(stats, len);
 			DeliverStream(len, data, is_orig);
 			}
 		catch ( binpac::Exception const& e )
@@ -806,8 +876,11 @@ void SupportAnalyzer::ForwardPacket(int len, const u_char* data, bool is_orig, u
 		// Pass to next in chain.
 		next_sibling->NextPacket(len, data, is_orig, seq, ip, caplen);
 	else
+		{
 		// Finished with preprocessing - now it's the parent's turn.
+		DeliveryTimer timer(Parent()->stats, len);
 		Parent()->DeliverPacket(len, data, is_orig, seq, ip, caplen);
+		}
 	}
 
 void SupportAnalyzer::ForwardStream(int len, const u_char* data, bool is_orig)
@@ -826,8 +899,11 @@ void SupportAnalyzer::ForwardStream(int len, const u_char* data, bool is_orig)
 		// Pass to next in chain.
 		next_sibling->NextStream(len, data, is_orig);
 	else
+		{
 		// Finished with preprocessing - now it's the parent's turn.
+		DeliveryTimer timer(Parent()->stats, len);
 		Parent()->DeliverStream(len, data, is_orig);
+		}
 	}
 
 void SupportAnalyzer::ForwardUndelivered(uint64_t seq, int len, bool is_orig)
@@ -10,6 +10,7 @@
 
 #include "zeek/EventHandler.h"
 #include "zeek/IntrusivePtr.h"
+#include "zeek/MemoryPool.h"
 #include "zeek/Obj.h"
 #include "zeek/Tag.h"
 #include "zeek/Timer.h"
@@ -60,6 +61,18 @@ using analyzer_list = std::list<Analyzer*>;
 using ID = uint32_t;
 using analyzer_timer_func = void (Analyzer::*)(double t);
 
+/**
+ * Resource usage of all analyzers of one type, see Manager::GetStats().
+ */
+struct AnalyzerStats
+	{
+	uint64_t deliveries = 0; // Packets and stream chunks delivered.
+	uint64_t bytes = 0; // Data of those deliveries.
+	uint64_t sampled = 0; // Deliveries timed, see Analyzer::stats_sample_rate.
+	double sampled_time = 0; // Seconds the timed ones took, without children's.
+	uint64_t instances = 0; // Analyzers currently alive.
+	};
+
 /**
  * Class to receive processed output from an anlyzer.
  */
@@ -141,6 +154,11 @@ public:
 	 */
 	virtual ~Analyzer();
 
+	// With memory pools enabled, analyzers are allocated from a pool
+	// shared by all analyzer classes, except for session adapters,
+	// which have their own.
+	ZEEK_POOL_ALLOCATED(pool)
+
 	/**
 	 * Initializes the analyzer before input processing starts.
 	 */
@@ -343,6 +361,36 @@ public:
 	 */
 	bool Skipping() const { return skip; }
 
+	/**
+	 * Signals that the analyzer doesn't need any further stream data
+	 * from one of the connection's endpoints, for example because all
+	 * that follows is encrypted. Once all analyzers directly below a
+	 * TCP connection are done with an endpoint's data, or have been
+	 * removed, the connection stops reassembling that data and just
+	 * keeps track of sequence numbers, so that sizes, gaps and history
+	 * still get reported accurately. The analyzer's children receive no
+	 * further data from it either.
+	 *
+	 * @param is_orig True to stop on the originator's data, false for
+	 * the responder's.
+	 */
+	void SetContentDone(bool is_orig)
+		{
+		if ( is_orig )
+			content_done_orig = true;
+		else
+			content_done_resp = true;
+		}
+
+	/**
+	 * Returns true if the analyzer has signaled that it doesn't need any
+	 * further stream data from an endpoint, see SetContentDone().
+	 */
+	bool ContentDone(bool is_orig) const
+		{
+		return is_orig ? content_done_orig : content_done_resp;
+		}
+
 	/**
 	 * Returns true if Done() has been called.
 	 */
@@ -612,6 +660,7 @@ public:
 protected:
 	friend class AnalyzerTimer;
 	friend class Manager;
+	friend class SupportAnalyzer;
 	friend class zeek::Connection;
 	friend class zeek::analyzer::tcp::TCP_ApplicationAnalyzer;
 	friend class zeek::packet_analysis::IP::IPBasedAnalyzer;
@@ -714,6 +763,7 @@ private:
 
 	zeek::Tag tag;
 	ID id;
+	AnalyzerStats* stats;
 
 	Connection* conn;
 	Analyzer* parent;
@@ -735,8 +785,11 @@ private:
 	bool skip;
 	bool finished;
 	bool removing;
+	bool content_done_orig;
+	bool content_done_resp;
 
 	static ID id_counter;
+	static zeek::detail::MemoryPool pool;
 	};
 
 /**
@@ -2,6 +2,9 @@
 
 #include "zeek/analyzer/Manager.h"
 
+#include <algorithm>
+#include <cmath>
+
 #include "zeek/Hash.h"
 #include "zeek/IntrusivePtr.h"
 #include "zeek/RunState.h"
@@ -96,6 +99,15 @@ void Manager::InitPostScript()
 	initialized = true;
 	}
 
+void Manager::SetStatsSampleRate(double rate)
+	{
+	// Timing every n-th delivery is cheaper than drawing random numbers,
+	// and a delivery's turn doesn't depend on its analyzer.
+	sample_interval =
+		rate > 0 ? static_cast<uint64_t>(std::llround(1 / std::clamp(rate, 1e-9, 1.0))) : 0;
+	sample_countdown = sample_interval;
+	}
+
 void Manager::DumpDebug()
 	{
 #ifdef DEBUG
@@ -20,6 +20,7 @@
  */
 #pragma once
 
+#include <map>
 #include <queue>
 #include <vector>
 
@@ -333,6 +334,35 @@ public:
 	 */
 	const std::vector<uint16_t>& GetVxlanPorts() const { return vxlan_ports; }
 
+	/**
+	 * Returns the resource usage of all analyzers of a type, creating its
+	 * entry on first use. The entry remains valid.
+	 */
+	AnalyzerStats* GetStats(const zeek::Tag& tag) { return &stats[tag]; }
+
+	/**
+	 * Returns the resource usage of all analyzer types used so far.
+	 */
+	const std::map<zeek::Tag, AnalyzerStats>& GetAllStats() const { return stats; }
+
+	/**
+	 * Sets the fraction of deliveries to analyzers to time, see
+	 * Analyzer::stats_sample_rate. Zero disables timing.
+	 */
+	void SetStatsSampleRate(double rate);
+
+	/**
+	 * Returns true if the next delivery to an analyzer is to get timed.
+	 */
+	bool SampleDelivery()
+		{
+		if ( ! sample_interval || --sample_countdown > 0 )
+			return false;
+
+		sample_countdown = sample_interval;
+		return true;
+		}
+
 private:
 	// Internal version that must be used only once InitPostScript has completed.
 	bool RegisterAnalyzerForPort(const std::tuple<zeek::Tag, TransportProto, uint32_t>& p);
@@ -387,6 +417,10 @@ private:
 	conns_map conns;
 	conns_queue conns_by_timeout;
 	std::vector<uint16_t> vxlan_ports;
+
+	std::map<zeek::Tag, AnalyzerStats> stats;
+	uint64_t sample_interval = 0; // Time every this many deliveries.
+	uint64_t sample_countdown = 0;
 	};
 
 	} // namespace analyzer
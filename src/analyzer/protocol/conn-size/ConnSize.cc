@@ -16,7 +16,7 @@ namespace zeek::analyzer::conn_size
 ConnSize_Analyzer::ConnSize_Analyzer(Connection* c)
 	: Analyzer("CONNSIZE", c), orig_bytes(), resp_bytes(), orig_pkts(), resp_pkts(),
 	  orig_bytes_thresh(), resp_bytes_thresh(), orig_pkts_thresh(), resp_pkts_thresh(),
-	  duration_thresh()
+	  duration_thresh(), armed()
 	{
 	start_time = c->StartTime();
 	}
@@ -36,6 +36,8 @@ void ConnSize_Analyzer::Init()
 	orig_pkts_thresh = 0;
 	resp_bytes_thresh = 0;
 	resp_pkts_thresh = 0;
+
+	UpdateArmed();
 	}
 
 void ConnSize_Analyzer::Done()
@@ -92,6 +94,14 @@ void ConnSize_Analyzer::CheckThresholds(bool is_orig)
 			duration_thresh = 0;
 			}
 		}
+
+	UpdateArmed();
+	}
+
+void ConnSize_Analyzer::UpdateArmed()
+	{
+	armed = orig_bytes_thresh || resp_bytes_thresh || orig_pkts_thresh || resp_pkts_thresh ||
+	        duration_thresh != 0;
 	}
 
 void ConnSize_Analyzer::DeliverPacket(int len, const u_char* data, bool is_orig, uint64_t seq,
@@ -110,7 +120,8 @@ void ConnSize_Analyzer::DeliverPacket(int len, const u_char* data, bool is_orig,
 		resp_pkts++;
 		}
 
-	CheckThresholds(is_orig);
+	if ( armed )
+		CheckThresholds(is_orig);
 	}
 
 void ConnSize_Analyzer::SetByteAndPacketThreshold(uint64_t threshold, bool bytes, bool orig)
@@ -162,13 +173,15 @@ void ConnSize_Analyzer::SetDurationThreshold(double duration)
 
 void ConnSize_Analyzer::UpdateConnVal(RecordVal* conn_val)
 	{
-	// RecordType *connection_type is decleared in NetVar.h
-	RecordVal* orig_endp = conn_val->GetFieldAs<RecordVal>("orig");
-	RecordVal* resp_endp = conn_val->GetFieldAs<RecordVal>("resp");
-
-	// endpoint is the RecordType from NetVar.h
-	int pktidx = id::endpoint->FieldOffset("num_pkts");
-	int bytesidx = id::endpoint->FieldOffset("num_bytes_ip");
+	// This runs whenever an event needs the connection record, so look
+	// up the fields only once.
+	static auto orig_idx = id::connection->FieldOffset("orig");
+	static auto resp_idx = id::connection->FieldOffset("resp");
+	static auto pktidx = id::endpoint->FieldOffset("num_pkts");
+	static auto bytesidx = id::endpoint->FieldOffset("num_bytes_ip");
+
+	RecordVal* orig_endp = conn_val->GetFieldAs<RecordVal>(orig_idx);
+	RecordVal* resp_endp = conn_val->GetFieldAs<RecordVal>(resp_idx);
 
 	if ( pktidx < 0 )
 		reporter->InternalError("'endpoint' record missing 'num_pkts' field");
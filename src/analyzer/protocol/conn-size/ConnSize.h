@@ -34,6 +34,9 @@ protected:
 	                   int caplen) override;
 	void CheckThresholds(bool is_orig);
 
+	// Updates whether any threshold is set.
+	void UpdateArmed();
+
 	void ThresholdEvent(EventHandlerPtr f, uint64_t threshold, bool is_orig);
 
 	uint64_t orig_bytes;
@@ -48,6 +51,10 @@ protected:
 
 	double start_time;
 	double duration_thresh;
+
+	// True if any threshold is set, so that packets of connections
+	// without any skip the checks.
+	bool armed;
 	};
 
 	} // namespace zeek::analyzer::conn_size
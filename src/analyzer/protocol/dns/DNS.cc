@@ -208,8 +208,8 @@ bool DNS_Interpreter::ParseQuestion(detail::DNS_MsgInfo* msg, const u_char*& dat
 bool DNS_Interpreter::ParseAnswer(detail::DNS_MsgInfo* msg, const u_char*& data, int& len,
                                   const u_char* msg_start)
 	{
-	u_char name[513];
-	int name_len = sizeof(name) - 1;
+	u_char* name = answer_name;
+	int name_len = sizeof(answer_name) - 1;
 
 	u_char* name_end = ExtractName(data, len, name, name_len, msg_start);
 
@@ -225,7 +225,7 @@ bool DNS_Interpreter::ParseAnswer(detail::DNS_MsgInfo* msg, const u_char*& data,
 	// Note that the exact meaning of some of these fields will be
 	// re-interpreted by other, more adventurous RR types.
 
-	msg->query_name = make_intrusive<StringVal>(new String(name, name_end - name, true));
+	msg->SetQueryName(name, name_end - name);
 	msg->atype = detail::RR_Type(ExtractShort(data, len));
 	msg->aclass = ExtractShort(data, len);
 	msg->ttl = ExtractLong(data, len);
@@ -1813,6 +1813,22 @@ DNS_MsgInfo::DNS_MsgInfo(DNS_RawMsgHdr* hdr, int arg_is_query)
 	skip_event = 0;
 	}
 
+void DNS_MsgInfo::SetQueryName(const u_char* name, int len)
+	{
+	query_name = nullptr;
+	query_name_data = name;
+	query_name_len = len;
+	}
+
+const StringValPtr& DNS_MsgInfo::QueryName()
+	{
+	if ( ! query_name && query_name_data )
+		query_name = make_intrusive<StringVal>(
+			new String(query_name_data, query_name_len, true));
+
+	return query_name;
+	}
+
 RecordValPtr DNS_MsgInfo::BuildHdrVal()
 	{
 	static auto dns_msg = id::find_type<RecordType>("dns_msg");
@@ -1841,7 +1857,7 @@ RecordValPtr DNS_MsgInfo::BuildAnswerVal()
 	auto r = make_intrusive<RecordVal>(dns_answer);
 
 	r->Assign(0, answer_type);
-	r->Assign(1, query_name);
+	r->Assign(1, QueryName());
 	r->Assign(2, atype);
 	r->Assign(3, aclass);
 	r->AssignInterval(4, double(ttl));
@@ -1857,7 +1873,7 @@ RecordValPtr DNS_MsgInfo::BuildEDNS_Val()
 	auto r = make_intrusive<RecordVal>(dns_edns_additional);
 
 	r->Assign(0, answer_type);
-	r->Assign(1, query_name);
+	r->Assign(1, QueryName());
 
 	// type = 0x29 or 41 = EDNS
 	r->Assign(2, atype);
@@ -1930,7 +1946,7 @@ RecordValPtr DNS_MsgInfo::BuildTSIG_Val(struct TSIG_DATA* tsig)
 	double rtime = tsig->time_s + tsig->time_ms / 1000.0;
 
 	// r->Assign(0, answer_type);
-	r->Assign(0, query_name);
+	r->Assign(0, QueryName());
 	r->Assign(1, answer_type);
 	r->Assign(2, tsig->alg_name);
 	r->Assign(3, tsig->sig);
@@ -1948,7 +1964,7 @@ RecordValPtr DNS_MsgInfo::BuildRRSIG_Val(RRSIG_DATA* rrsig)
 	static auto dns_rrsig_rr = id::find_type<RecordType>("dns_rrsig_rr");
 	auto r = make_intrusive<RecordVal>(dns_rrsig_rr);
 
-	r->Assign(0, query_name);
+	r->Assign(0, QueryName());
 	r->Assign(1, answer_type);
 	r->Assign(2, rrsig->type_covered);
 	r->Assign(3, rrsig->algorithm);
@@ -1969,7 +1985,7 @@ RecordValPtr DNS_MsgInfo::BuildDNSKEY_Val(DNSKEY_DATA* dnskey)
 	static auto dns_dnskey_rr = id::find_type<RecordType>("dns_dnskey_rr");
 	auto r = make_intrusive<RecordVal>(dns_dnskey_rr);
 
-	r->Assign(0, query_name);
+	r->Assign(0, QueryName());
 	r->Assign(1, answer_type);
 	r->Assign(2, dnskey->dflags);
 	r->Assign(3, dnskey->dprotocol);
@@ -1985,7 +2001,7 @@ RecordValPtr DNS_MsgInfo::BuildNSEC3_Val(NSEC3_DATA* nsec3)
 	static auto dns_nsec3_rr = id::find_type<RecordType>("dns_nsec3_rr");
 	auto r = make_intrusive<RecordVal>(dns_nsec3_rr);
 
-	r->Assign(0, query_name);
+	r->Assign(0, QueryName());
 	r->Assign(1, answer_type);
 	r->Assign(2, nsec3->nsec_flags);
 	r->Assign(3, nsec3->nsec_hash_algo);
@@ -2005,7 +2021,7 @@ RecordValPtr DNS_MsgInfo::BuildNSEC3PARAM_Val(NSEC3PARAM_DATA* nsec3param)
 	static auto dns_nsec3param_rr = id::find_type<RecordType>("dns_nsec3param_rr");
 	auto r = make_intrusive<RecordVal>(dns_nsec3param_rr);
 
-	r->Assign(0, query_name);
+	r->Assign(0, QueryName());
 	r->Assign(1, answer_type);
 	r->Assign(2, nsec3param->nsec_flags);
 	r->Assign(3, nsec3param->nsec_hash_algo);
@@ -2022,7 +2038,7 @@ RecordValPtr DNS_MsgInfo::BuildDS_Val(DS_DATA* ds)
 	static auto dns_ds_rr = id::find_type<RecordType>("dns_ds_rr");
 	auto r = make_intrusive<RecordVal>(dns_ds_rr);
 
-	r->Assign(0, query_name);
+	r->Assign(0, QueryName());
 	r->Assign(1, answer_type);
 	r->Assign(2, ds->key_tag);
 	r->Assign(3, ds->algorithm);
@@ -2038,7 +2054,7 @@ RecordValPtr DNS_MsgInfo::BuildBINDS_Val(BINDS_DATA* binds)
 	static auto dns_binds_rr = id::find_type<RecordType>("dns_binds_rr");
 	auto r = make_intrusive<RecordVal>(dns_binds_rr);
 
-	r->Assign(0, query_name);
+	r->Assign(0, QueryName());
 	r->Assign(1, answer_type);
 	r->Assign(2, binds->algorithm);
 	r->Assign(3, binds->key_id);
@@ -2054,7 +2070,7 @@ RecordValPtr DNS_MsgInfo::BuildLOC_Val(LOC_DATA* loc)
 	static auto dns_loc_rr = id::find_type<RecordType>("dns_loc_rr");
 	auto r = make_intrusive<RecordVal>(dns_loc_rr);
 
-	r->Assign(0, query_name);
+	r->Assign(0, QueryName());
 	r->Assign(1, answer_type);
 	r->Assign(2, loc->version);
 	r->Assign(3, loc->size);
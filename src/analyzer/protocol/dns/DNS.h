@@ -313,6 +313,18 @@ public:
 	RecordValPtr BuildLOC_Val(struct LOC_DATA*);
 	RecordValPtr BuildSVCB_Val(const struct SVCB_DATA&);
 
+	/**
+	 * Sets the owner name of the current RR. The name needs to stay
+	 * around until the next one gets set, as it only becomes a value
+	 * once an event needs it.
+	 */
+	void SetQueryName(const u_char* name, int len);
+
+	/**
+	 * Returns the owner name of the current RR.
+	 */
+	const StringValPtr& QueryName();
+
 	int id;
 	int opcode; ///< query type, see DNS_Opcode
 	int rcode; ///< return code, see DNS_Code
@@ -328,7 +340,9 @@ public:
 	int arcount; ///< number of additional RRs
 	int is_query; ///< whether it came from the session initiator
 
-	StringValPtr query_name;
+	StringValPtr query_name; ///< built from query_name_data on first use
+	const u_char* query_name_data = nullptr;
+	int query_name_len = 0;
 	RR_Type atype;
 	int aclass; ///< normally = 1, inet
 	uint32_t ttl;
@@ -425,6 +439,10 @@ protected:
 
 	analyzer::Analyzer* analyzer;
 	bool first_message;
+
+	// Holds the owner name of the RR being parsed, see
+	// DNS_MsgInfo::SetQueryName().
+	u_char answer_name[513];
 	};
 
 enum TCP_DNS_state
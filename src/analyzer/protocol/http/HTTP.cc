@@ -358,7 +358,9 @@ void HTTP_Entity::SetPlainDelivery(int64_t length)
 
 void HTTP_Entity::SubmitHeader(analyzer::mime::MIME_Header* h)
 	{
-	if ( analyzer::mime::istrequal(h->get_name(), "content-length") )
+	int name_id = h->get_name_id();
+
+	if ( name_id == analyzer::mime::MIME_HEADER_CONTENT_LENGTH )
 		{
 		data_chunk_t vt = h->get_value_token();
 		if ( ! analyzer::mime::is_null_data_chunk(vt) )
@@ -384,7 +386,7 @@ void HTTP_Entity::SubmitHeader(analyzer::mime::MIME_Header* h)
 		}
 
 	// Figure out content-length for HTTP 206 Partial Content response
-	else if ( analyzer::mime::istrequal(h->get_name(), "content-range") &&
+	else if ( name_id == analyzer::mime::MIME_HEADER_CONTENT_RANGE &&
 	          http_message->MyHTTP_Analyzer()->HTTP_ReplyCode() == 206 )
 		{
 		data_chunk_t vt = h->get_value_token();
@@ -466,7 +468,7 @@ void HTTP_Entity::SubmitHeader(analyzer::mime::MIME_Header* h)
 			}
 		}
 
-	else if ( analyzer::mime::istrequal(h->get_name(), "transfer-encoding") )
+	else if ( name_id == analyzer::mime::MIME_HEADER_TRANSFER_ENCODING )
 		{
 		HTTP_Analyzer::HTTP_VersionNumber http_version;
 
@@ -481,7 +483,7 @@ void HTTP_Entity::SubmitHeader(analyzer::mime::MIME_Header* h)
 			chunked_transfer_state = BEFORE_CHUNK;
 		}
 
-	else if ( analyzer::mime::istrequal(h->get_name(), "content-encoding") )
+	else if ( name_id == analyzer::mime::MIME_HEADER_CONTENT_ENCODING )
 		{
 		data_chunk_t vt = h->get_value_token();
 		if ( analyzer::mime::istrequal(vt, "gzip") || analyzer::mime::istrequal(vt, "x-gzip") )
@@ -1226,7 +1228,7 @@ int HTTP_Analyzer::HTTP_RequestLine(const char* line, const char* end_of_line)
 		return -1;
 		}
 
-	request_method = make_intrusive<StringVal>(end_of_method - line, line);
+	request_method = val_mgr->InternedString(std::string_view(line, end_of_method - line));
 
 	Conn()->Match(zeek::detail::Rule::HTTP_REQUEST,
 	              (const u_char*)unescaped_URI->AsString()->Bytes(),
@@ -1372,14 +1374,14 @@ void HTTP_Analyzer::HTTP_Request()
 		// DEBUG_MSG("%.6f http_request\n", run_state::network_time);
 		EnqueueConnEvent(http_request, ConnVal(), request_method, TruncateURI(request_URI),
 		                 TruncateURI(unescaped_URI),
-		                 make_intrusive<StringVal>(util::fmt("%.1f", request_version.ToDouble())));
+		                 val_mgr->InternedString(util::fmt("%.1f", request_version.ToDouble())));
 	}
 
 void HTTP_Analyzer::HTTP_Reply()
 	{
 	if ( http_reply )
 		EnqueueConnEvent(http_reply, ConnVal(),
-		                 make_intrusive<StringVal>(util::fmt("%.1f", reply_version.ToDouble())),
+		                 val_mgr->InternedString(util::fmt("%.1f", reply_version.ToDouble())),
 		                 val_mgr->Count(reply_code),
 		                 reply_reason_phrase ? reply_reason_phrase
 		                                     : make_intrusive<StringVal>("<empty>"));
@@ -1559,13 +1561,15 @@ void HTTP_Analyzer::HTTP_Header(bool is_orig, analyzer::mime::MIME_Header* h)
 	// side, and if seen assume the connection to be persistent.
 	// This seems fairly safe - at worst, the client does indeed
 	// send additional requests, and the server ignores them.
-	if ( is_orig && analyzer::mime::istrequal(h->get_name(), "connection") )
+	int name_id = h->get_name_id();
+
+	if ( is_orig && name_id == analyzer::mime::MIME_HEADER_CONNECTION )
 		{
 		if ( analyzer::mime::istrequal(h->get_value_token(), "keep-alive") )
 			keep_alive = 1;
 		}
 
-	if ( ! is_orig && analyzer::mime::istrequal(h->get_name(), "connection") )
+	if ( ! is_orig && name_id == analyzer::mime::MIME_HEADER_CONNECTION )
 		{
 		if ( analyzer::mime::istrequal(h->get_value_token(), "close") )
 			connection_close = 1;
@@ -1573,7 +1577,7 @@ void HTTP_Analyzer::HTTP_Header(bool is_orig, analyzer::mime::MIME_Header* h)
 			upgrade_connection = true;
 		}
 
-	if ( ! is_orig && analyzer::mime::istrequal(h->get_name(), "upgrade") )
+	if ( ! is_orig && name_id == analyzer::mime::MIME_HEADER_UPGRADE )
 		upgrade_protocol.assign(h->get_value_token().data, h->get_value_token().length);
 
 	if ( http_header )
@@ -1593,12 +1597,16 @@ void HTTP_Analyzer::HTTP_Header(bool is_orig, analyzer::mime::MIME_Header* h)
 		if ( DEBUG_http )
 			DEBUG_MSG("%.6f http_header\n", run_state::network_time);
 
-		auto upper_hn = analyzer::mime::to_string_val(h->get_name());
-		upper_hn->ToUpper();
-
+		// Scripts typically look at only one version of the name.
 		EnqueueConnEvent(http_header, ConnVal(), val_mgr->Bool(is_orig),
-		                 analyzer::mime::to_string_val(h->get_name()), std::move(upper_hn),
-		                 analyzer::mime::to_string_val(h->get_value()));
+		                 http_header->ArgUsed(2)
+		                     ? analyzer::mime::to_header_name_val(h->get_name())
+		                     : val_mgr->EmptyString(),
+		                 http_header->ArgUsed(3)
+		                     ? analyzer::mime::to_header_name_val(h->get_name(), true)
+		                     : val_mgr->EmptyString(),
+		                 http_header->ArgUsed(4) ? analyzer::mime::to_string_val(h->get_value())
+		                                         : val_mgr->EmptyString());
 		}
 	}
 
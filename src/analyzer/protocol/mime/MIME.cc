@@ -2,6 +2,9 @@
 
 #include "zeek/zeek-config.h"
 
+#include <cctype>
+#include <string>
+
 #include "zeek/Base64.h"
 #include "zeek/NetVar.h"
 #include "zeek/Reporter.h"
@@ -123,6 +126,19 @@ StringValPtr to_string_val(const data_chunk_t buf)
 	return to_string_val(buf.length, buf.data);
 	}
 
+StringValPtr to_header_name_val(const data_chunk_t name, bool upper_case)
+	{
+	if ( ! upper_case )
+		return val_mgr->InternedString(std::string_view(name.data, name.length));
+
+	std::string upper(name.data, name.length);
+
+	for ( auto& c : upper )
+		c = toupper(static_cast<u_char>(c));
+
+	return val_mgr->InternedString(upper);
+	}
+
 static data_chunk_t get_data_chunk(String* s)
 	{
 	data_chunk_t b;
@@ -155,6 +171,54 @@ bool istrequal(data_chunk_t s, const char* t)
 	return strncasecmp(s.data, t, len) == 0;
 	}
 
+int MIME_classify_header_name(data_chunk_t name)
+	{
+	// The names' lengths tell them apart, so that it takes one comparison
+	// at most.
+	const char* candidate;
+	int id;
+
+	switch ( name.length )
+		{
+		case 7:
+			candidate = "upgrade";
+			id = MIME_HEADER_UPGRADE;
+			break;
+		case 10:
+			candidate = "connection";
+			id = MIME_HEADER_CONNECTION;
+			break;
+		case 12:
+			candidate = "content-type";
+			id = MIME_HEADER_CONTENT_TYPE;
+			break;
+		case 13:
+			candidate = "content-range";
+			id = MIME_HEADER_CONTENT_RANGE;
+			break;
+		case 14:
+			candidate = "content-length";
+			id = MIME_HEADER_CONTENT_LENGTH;
+			break;
+		case 16:
+			candidate = "content-encoding";
+			id = MIME_HEADER_CONTENT_ENCODING;
+			break;
+		case 17:
+			candidate = "transfer-encoding";
+			id = MIME_HEADER_TRANSFER_ENCODING;
+			break;
+		case 25:
+			candidate = "content-transfer-encoding";
+			id = MIME_HEADER_CONTENT_TRANSFER_ENCODING;
+			break;
+		default:
+			return MIME_HEADER_OTHER;
+		}
+
+	return strncasecmp(name.data, candidate, name.length) == 0 ? id : MIME_HEADER_OTHER;
+	}
+
 int MIME_count_leading_lws(int len, const char* data)
 	{
 	int i;
@@ -461,6 +525,7 @@ MIME_Header::MIME_Header(MIME_Multiline* hl)
 	{
 	lines = hl;
 	name = value = value_token = rest_value = null_data_chunk;
+	name_id = MIME_HEADER_OTHER;
 
 	String* s = hl->get_concatenated_line();
 	int len = s->Len();
@@ -487,6 +552,8 @@ MIME_Header::MIME_Header(MIME_Multiline* hl)
 	else
 		// malformed header line
 		name = null_data_chunk;
+
+	name_id = MIME_classify_header_name(name);
 	}
 
 MIME_Header::~MIME_Header()
@@ -766,17 +833,21 @@ void MIME_Entity::ParseMIMEHeader(MIME_Header* h)
 	if ( h == nullptr )
 		return;
 
-	current_field_type = LookupMIMEHeaderName(h->get_name());
-
-	switch ( current_field_type )
+	switch ( h->get_name_id() )
 		{
-		case MIME_CONTENT_TYPE:
+		case MIME_HEADER_CONTENT_TYPE:
+			current_field_type = MIME_CONTENT_TYPE;
 			ParseContentTypeField(h);
 			break;
 
-		case MIME_CONTENT_TRANSFER_ENCODING:
+		case MIME_HEADER_CONTENT_TRANSFER_ENCODING:
+			current_field_type = MIME_CONTENT_TRANSFER_ENCODING;
 			ParseContentEncodingField(h);
 			break;
+
+		default:
+			current_field_type = -1;
+			break;
 		}
 	}
 
@@ -1052,6 +1123,13 @@ void MIME_Entity::DecodeBinary(int len, const char* data, bool trailing_CRLF)
 		}
 	}
 
+// True for characters that quoted-printable encoding leaves as they are:
+// printables except '=', and whitespace.
+static bool is_qp_literal(char ch)
+	{
+	return (ch >= 33 && ch <= 60) || (ch >= 62 && ch <= 126) || ch == HT || ch == SP;
+	}
+
 void MIME_Entity::DecodeQuotedPrintable(int len, const char* data)
 	{
 	// Ignore trailing HT and SP.
@@ -1065,7 +1143,19 @@ void MIME_Entity::DecodeQuotedPrintable(int len, const char* data)
 
 	for ( i = 0; i <= end_of_line; ++i )
 		{
-		if ( data[i] == '=' )
+		// Characters that stand for themselves go out in runs.
+		int run = i;
+
+		while ( run <= end_of_line && is_qp_literal(data[run]) )
+			++run;
+
+		if ( run > i )
+			{
+			DataOctets(run - i, data + i);
+			i = run - 1;
+			}
+
+		else if ( data[i] == '=' )
 			{
 			if ( i == end_of_line )
 				soft_line_break = 1;
@@ -1097,14 +1187,6 @@ void MIME_Entity::DecodeQuotedPrintable(int len, const char* data)
 				}
 			}
 
-		else if ( (data[i] >= 33 && data[i] <= 60) ||
-		          // except controls, whitespace and '='
-		          (data[i] >= 62 && data[i] <= 126) )
-			DataOctet(data[i]);
-
-		else if ( data[i] == HT || data[i] == SP )
-			DataOctet(data[i]);
-
 		else
 			{
 			IllegalEncoding(
@@ -1290,10 +1372,8 @@ RecordValPtr MIME_Message::ToHeaderVal(MIME_Header* h)
 	{
 	static auto mime_header_rec = id::find_type<RecordType>("mime_header_rec");
 	auto header_record = make_intrusive<RecordVal>(mime_header_rec);
-	header_record->Assign(0, to_string_val(h->get_name()));
-	auto upper_hn = to_string_val(h->get_name());
-	upper_hn->ToUpper();
-	header_record->Assign(1, std::move(upper_hn));
+	header_record->Assign(0, to_header_name_val(h->get_name()));
+	header_record->Assign(1, to_header_name_val(h->get_name(), true));
 	header_record->Assign(2, to_string_val(h->get_value()));
 	return header_record;
 	}
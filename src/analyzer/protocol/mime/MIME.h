@@ -45,6 +45,21 @@ enum MIME_CONTENT_TYPE
 	CONTENT_TYPE_OTHER, // image | audio | video | application | <other>
 	};
 
+// Header names that the analyzers built on MIME act on, see
+// MIME_Header::get_name_id().
+enum MIME_HEADER_ID
+	{
+	MIME_HEADER_OTHER,
+	MIME_HEADER_CONNECTION,
+	MIME_HEADER_CONTENT_ENCODING,
+	MIME_HEADER_CONTENT_LENGTH,
+	MIME_HEADER_CONTENT_RANGE,
+	MIME_HEADER_CONTENT_TRANSFER_ENCODING,
+	MIME_HEADER_CONTENT_TYPE,
+	MIME_HEADER_TRANSFER_ENCODING,
+	MIME_HEADER_UPGRADE,
+	};
+
 enum MIME_EVENT_TYPE
 	{
 	MIME_EVENT_ILLEGAL_FORMAT,
@@ -85,6 +100,10 @@ public:
 	data_chunk_t get_name() const { return name; }
 	data_chunk_t get_value() const { return value; }
 
+	// Returns the MIME_HEADER_ID of the header's name, so that users
+	// don't need to compare it to the names they are interested in.
+	int get_name_id() const { return name_id; }
+
 	data_chunk_t get_value_token();
 	data_chunk_t get_value_after_token();
 
@@ -95,6 +114,7 @@ protected:
 	data_chunk_t name;
 	data_chunk_t value;
 	data_chunk_t value_token, rest_value;
+	int name_id;
 	};
 
 using MIME_HeaderList = std::vector<MIME_Header*>;
@@ -281,8 +301,12 @@ extern bool is_null_data_chunk(data_chunk_t b);
 extern StringValPtr to_string_val(int length, const char* data);
 extern StringValPtr to_string_val(const char* data, const char* end_of_data);
 extern StringValPtr to_string_val(const data_chunk_t buf);
+// Header names repeat a lot, so their values are shared, see
+// ValManager::InternedString().
+extern StringValPtr to_header_name_val(const data_chunk_t name, bool upper_case = false);
 extern int fputs(data_chunk_t b, FILE* fp);
 extern bool istrequal(data_chunk_t s, const char* t);
+extern int MIME_classify_header_name(data_chunk_t name);
 extern bool is_lws(char ch);
 extern bool MIME_is_field_name_char(char ch);
 extern int MIME_count_leading_lws(int len, const char* data);
@@ -9,10 +9,36 @@
 #include "zeek/RunState.h"
 #include "zeek/analyzer/protocol/tcp/TCP_Flags.h"
 #include "zeek/analyzer/protocol/tcp/TCP_Reassembler.h"
+#include "zeek/telemetry/Manager.h"
 
 namespace zeek::analyzer::pia
 	{
 
+namespace
+	{
+
+struct PIAMetrics
+	{
+	telemetry::IntCounter buffered = telemetry_mgr->CounterInstance(
+		"zeek", "dpd-buffered", {}, "Data buffered for analyzers that signatures may activate",
+		"bytes", true);
+	telemetry::IntCounter replayed = telemetry_mgr->CounterInstance(
+		"zeek", "dpd-replayed", {}, "Buffered data replayed to analyzers activated by signatures",
+		"bytes", true);
+	telemetry::IntCounter gave_up = telemetry_mgr->CounterInstance(
+		"zeek", "dpd-gave-up", {},
+		"Connections that stopped buffering because no signature could match anymore", "1",
+		true);
+	};
+
+PIAMetrics* metrics()
+	{
+	static PIAMetrics* m = telemetry_mgr ? new PIAMetrics() : nullptr;
+	return m;
+	}
+
+	} // namespace
+
 PIA::PIA(analyzer::Analyzer* arg_as_analyzer)
 	: state(INIT), as_analyzer(arg_as_analyzer), conn(), current_packet()
 	{
@@ -30,7 +56,10 @@ void PIA::ClearBuffer(Buffer* buffer)
 		{
 		next = b->next;
 		delete b->ip;
-		delete[] b->data;
+
+		if ( ! b->buffer )
+			delete[] b->data;
+
 		delete b;
 		}
 
@@ -41,17 +70,29 @@ void PIA::ClearBuffer(Buffer* buffer)
 void PIA::AddToBuffer(Buffer* buffer, uint64_t seq, int len, const u_char* data, bool is_orig,
                       const IP_Hdr* ip)
 	{
-	u_char* tmp = nullptr;
+	DataBlock* b = new DataBlock;
+	b->data = nullptr;
 
 	if ( data )
 		{
-		tmp = new u_char[len];
-		memcpy(tmp, data, len);
+		// Reference the packet source's buffer if the data lives in
+		// there, otherwise make a copy.
+		auto* pb = run_state::detail::current_pkt_buffer;
+
+		if ( pb && pb->WorthRetaining(data, len) )
+			{
+			b->buffer = {NewRef{}, pb};
+			b->data = data;
+			}
+		else
+			{
+			u_char* tmp = new u_char[len];
+			memcpy(tmp, data, len);
+			b->data = tmp;
+			}
 		}
 
-	DataBlock* b = new DataBlock;
 	b->ip = ip ? ip->Copy() : nullptr;
-	b->data = tmp;
 	b->is_orig = is_orig;
 	b->len = len;
 	b->seq = seq;
@@ -66,7 +107,12 @@ void PIA::AddToBuffer(Buffer* buffer, uint64_t seq, int len, const u_char* data,
 		buffer->head = buffer->tail = b;
 
 	if ( data )
+		{
 		buffer->size += len;
+
+		if ( auto m = metrics() )
+			m->buffered.Inc(len);
+		}
 	}
 
 void PIA::AddToBuffer(Buffer* buffer, int len, const u_char* data, bool is_orig, const IP_Hdr* ip)
@@ -74,10 +120,38 @@ void PIA::AddToBuffer(Buffer* buffer, int len, const u_char* data, bool is_orig,
 	AddToBuffer(buffer, -1, len, data, is_orig, ip);
 	}
 
+bool PIA::MatchingExhausted() const
+	{
+	if ( ! zeek::detail::dpd_give_up_early )
+		return false;
+
+	// Without signatures, nothing ever activates an analyzer here.
+	if ( ! zeek::detail::rule_matcher || ! zeek::detail::rule_matcher->HasNonFileMagicRule() )
+		return true;
+
+	return MatchersExhausted();
+	}
+
+PIA::State PIA::GiveUp(Buffer* buffer)
+	{
+	DBG_LOG(DBG_ANALYZER, "PIA giving up after %" PRIu64 " bytes, no signature can match",
+	        buffer->size);
+
+	if ( auto m = metrics() )
+		m->gave_up.Inc();
+
+	// There's no analyzer left to replay the buffer to.
+	ClearBuffer(buffer);
+	return SKIPPING;
+	}
+
 void PIA::ReplayPacketBuffer(analyzer::Analyzer* analyzer)
 	{
 	DBG_LOG(DBG_ANALYZER, "PIA replaying %" PRIu64 " total packet bytes", pkt_buffer.size);
 
+	if ( auto m = metrics() )
+		m->replayed.Inc(pkt_buffer.size);
+
 	for ( DataBlock* b = pkt_buffer.head; b; b = b->next )
 		analyzer->DeliverPacket(b->len, b->data, b->is_orig, -1, b->ip, 0);
 	}
@@ -117,6 +191,10 @@ void PIA::PIA_DeliverPacket(int len, const u_char* data, bool is_orig, uint64_t
 	if ( clear_state )
 		zeek::detail::RuleMatcherState::ClearMatchState(is_orig);
 
+	// Each packet matching from scratch never runs out of candidates.
+	else if ( new_state == BUFFERING && MatchingExhausted() )
+		new_state = GiveUp(&pkt_buffer);
+
 	pkt_buffer.state = new_state;
 
 	current_packet.data = nullptr;
@@ -287,7 +365,17 @@ void PIA_TCP::DeliverStream(int len, const u_char* data, bool is_orig)
 
 	DoMatch(data, len, is_orig, false, false, false, nullptr);
 
+	if ( new_state == BUFFERING && MatchingExhausted() )
+		new_state = GiveUp(&stream_buffer);
+
 	stream_buffer.state = new_state;
+
+	if ( new_state == SKIPPING )
+		{
+		// We won't look at any further data.
+		SetContentDone(true);
+		SetContentDone(false);
+		}
 	}
 
 void PIA_TCP::Undelivered(uint64_t seq, int len, bool is_orig)
@@ -304,6 +392,12 @@ void PIA_TCP::Undelivered(uint64_t seq, int len, bool is_orig)
 		{
 		stream_buffer.state = zeek::detail::dpd_match_only_beginning ? SKIPPING : MATCHING_ONLY;
 		DBG_LOG(DBG_ANALYZER, "PIA_TCP[%d] buffer chunks exceeded", GetID());
+
+		if ( stream_buffer.state == SKIPPING )
+			{
+			SetContentDone(true);
+			SetContentDone(false);
+			}
 		}
 	}
 
@@ -438,6 +532,9 @@ void PIA_TCP::ReplayStreamBuffer(analyzer::Analyzer* analyzer)
 	{
 	DBG_LOG(DBG_ANALYZER, "PIA_TCP replaying %" PRIu64 " total stream bytes", stream_buffer.size);
 
+	if ( auto m = metrics() )
+		m->replayed.Inc(stream_buffer.size);
+
 	for ( DataBlock* b = stream_buffer.head; b; b = b->next )
 		{
 		if ( b->data )
@@ -5,6 +5,7 @@
 #include "zeek/RuleMatcher.h"
 #include "zeek/analyzer/Analyzer.h"
 #include "zeek/analyzer/protocol/tcp/TCP.h"
+#include "zeek/iosource/PacketBuffer.h"
 
 namespace zeek::detail
 	{
@@ -66,6 +67,10 @@ protected:
 		int len;
 		uint64_t seq;
 		DataBlock* next;
+
+		// If set, *data* points into this buffer lent by the packet
+		// source rather than into a copy owned by the block.
+		iosource::PacketBufferPtr buffer;
 		};
 
 	struct Buffer
@@ -91,6 +96,15 @@ protected:
 	                 const IP_Hdr* ip = nullptr);
 	void ClearBuffer(Buffer* buffer);
 
+	// Returns true if buffering doesn't pay off anymore because no
+	// signature can match for the connection from here on, see
+	// dpd_give_up_early.
+	bool MatchingExhausted() const;
+
+	// Stops buffering once MatchingExhausted() holds, returning the
+	// buffer's new state.
+	State GiveUp(Buffer* buffer);
+
 	DataBlock* CurrentPacket() { return &current_packet; }
 
 	void DoMatch(const u_char* data, int len, bool is_orig, bool bol, bool eol, bool clear_state,
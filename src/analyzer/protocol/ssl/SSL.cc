@@ -3,8 +3,12 @@
 #include <arpa/inet.h>
 #include <openssl/evp.h>
 #include <openssl/opensslv.h>
+#include <algorithm>
+#include <cstring>
 
+#include "zeek/ID.h"
 #include "zeek/Reporter.h"
+#include "zeek/Val.h"
 #include "zeek/analyzer/Manager.h"
 #include "zeek/analyzer/protocol/ssl/events.bif.h"
 #include "zeek/analyzer/protocol/ssl/ssl_pac.h"
@@ -43,6 +47,12 @@ static std::basic_string<unsigned char> fmt_seq(uint32_t num)
 	return out;
 	}
 
+static bool skip_encrypted_records()
+	{
+	static const bool skip = id::find_val("SSL::skip_encrypted_records")->AsBool();
+	return skip;
+	}
+
 SSL_Analyzer::SSL_Analyzer(Connection* c) : analyzer::tcp::TCP_ApplicationAnalyzer("SSL", c)
 	{
 	interp = new binpac::SSL::SSL_Conn(this);
@@ -103,6 +113,80 @@ void SSL_Analyzer::DeliverStream(int len, const u_char* data, bool orig)
 		// deliver data to the other side if the script layer can handle this.
 		return;
 
+	auto& t = trackers[orig];
+
+	if ( ! skip_encrypted_records() )
+		t.valid = false;
+
+	// Start of the data that binpac hasn't seen yet.
+	const u_char* run = data;
+
+	while ( len > 0 && t.valid )
+		{
+		int n;
+		bool skip = t.skipping;
+
+		if ( t.remaining > 0 )
+			{
+			n = std::min(len, t.remaining);
+			t.remaining -= n;
+			}
+
+		else
+			{
+			if ( t.header_len == 0 )
+				{
+				// Only switch at record boundaries, where binpac
+				// has nothing buffered. Whether the records are
+				// encrypted depends on those parsed before.
+				if ( MaySkipRecords() )
+					{
+					if ( data > run && ! Parse(data - run, run, orig) )
+						return;
+
+					run = data;
+					t.skipping = interp->records_encrypted(orig);
+					}
+				else
+					t.skipping = false;
+
+				skip = t.skipping;
+				}
+
+			n = std::min(len, static_cast<int>(sizeof(t.header)) - t.header_len);
+			memcpy(t.header + t.header_len, data, n);
+			t.header_len += n;
+
+			if ( t.header_len == sizeof(t.header) )
+				{
+				t.header_len = 0;
+				t.remaining = (t.header[3] << 8) | t.header[4];
+
+				// SSLv2 framing, or a version that binpac rejects.
+				if ( (t.header[0] & 0x80) || t.header[1] != 3 || t.header[2] > 3 )
+					{
+					t.valid = false;
+
+					// Let binpac see the header to report on it.
+					if ( skip && ! Parse(sizeof(t.header), t.header, orig) )
+						return;
+					}
+				}
+			}
+
+		data += n;
+		len -= n;
+
+		if ( skip )
+			run = data;
+		}
+
+	if ( data + len > run )
+		Parse(data + len - run, run, orig);
+	}
+
+bool SSL_Analyzer::Parse(int len, const u_char* data, bool orig)
+	{
 	try
 		{
 		interp->NewData(orig, data, data + len);
@@ -110,7 +194,19 @@ void SSL_Analyzer::DeliverStream(int len, const u_char* data, bool orig)
 	catch ( const binpac::Exception& e )
 		{
 		AnalyzerViolation(util::fmt("Binpac exception: %s", e.c_msg()));
+
+		// Where binpac's parse resumes is anyone's guess now.
+		trackers[orig].valid = false;
+		return false;
 		}
+
+	return true;
+	}
+
+bool SSL_Analyzer::MaySkipRecords() const
+	{
+	// Decryption and ssl_encrypted_data need to see each record.
+	return skip_encrypted_records() && ! ssl_encrypted_data && secret.empty() && keys.empty();
 	}
 
 void SSL_Analyzer::SendHandshake(uint16_t raw_tls_version, const u_char* begin, const u_char* end,
@@ -161,6 +161,27 @@ protected:
 	 */
 	void ForwardDecryptedData(const std::vector<u_char>& data, bool is_orig);
 
+	// Follows the TLS record framing of one direction, so that encrypted
+	// records nobody looks at can bypass the binpac parser, see
+	// SSL::skip_encrypted_records.
+	struct RecordTracker
+		{
+		bool valid = true; // False once the framing isn't TLS's.
+		bool skipping = false; // True while the current record bypasses binpac.
+		int header_len = 0; // Bytes of the next record header seen so far.
+		u_char header[5];
+		int remaining = 0; // Bytes of the current record yet to come.
+		};
+
+	// Feeds data into binpac, returning false and stopping tracking if
+	// that fails.
+	bool Parse(int len, const u_char* data, bool orig);
+
+	// Returns true if encrypted records don't need to get parsed.
+	bool MaySkipRecords() const;
+
+	RecordTracker trackers[2];
+
 	binpac::SSL::SSL_Conn* interp;
 	binpac::TLSHandshake::Handshake_Conn* handshake_interp;
 	bool had_gap;
@@ -1,5 +1,14 @@
 #include "zeek/analyzer/protocol/tcp/ContentLine.h"
 
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "zeek/3rdparty/doctest.h"
 #include "zeek/Reporter.h"
 #include "zeek/analyzer/protocol/tcp/TCP.h"
 #include "zeek/analyzer/protocol/tcp/events.bif.h"
@@ -7,6 +16,55 @@
 namespace zeek::analyzer::tcp
 	{
 
+namespace
+	{
+
+// Returns the number of bytes at the start of data before the first CR,
+// LF or NUL.
+int plain_run_scalar(const u_char* data, int len)
+	{
+	for ( int n = 0; n < len; ++n )
+		if ( data[n] == '\r' || data[n] == '\n' || data[n] == '\0' )
+			return n;
+
+	return len;
+	}
+
+#ifdef __SSE2__
+// Same as plain_run_scalar(), 16 bytes at a time.
+int plain_run_sse2(const u_char* data, int len)
+	{
+	const __m128i cr = _mm_set1_epi8('\r');
+	const __m128i lf = _mm_set1_epi8('\n');
+	const __m128i nul = _mm_setzero_si128();
+	int n = 0;
+
+	for ( ; n + 16 <= len; n += 16 )
+		{
+		__m128i group = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + n));
+		__m128i special = _mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(group, cr), _mm_cmpeq_epi8(group, lf)),
+			_mm_cmpeq_epi8(group, nul));
+
+		if ( int mask = _mm_movemask_epi8(special) )
+			return n + __builtin_ctz(mask);
+		}
+
+	return n + plain_run_scalar(data + n, len - n);
+	}
+#endif
+
+int plain_run(const u_char* data, int len)
+	{
+#ifdef __SSE2__
+	return plain_run_sse2(data, len);
+#else
+	return plain_run_scalar(data, len);
+#endif
+	}
+
+	} // namespace
+
 ContentLine_Analyzer::ContentLine_Analyzer(Connection* conn, bool orig, int max_line_length)
 	: TCP_SupportAnalyzer("CONTENTLINE", conn, orig), max_line_length(max_line_length)
 	{
@@ -229,6 +287,32 @@ int ContentLine_Analyzer::DoDeliverOnce(int len, const u_char* data)
 
 	for ( ; len > 0; --len, ++data )
 		{
+		// Copy characters that need no further look all at once. A
+		// character after a CR still goes the long way, to tell about
+		// the single CR, and so does the one hitting max_line_length.
+		if ( last_char != '\r' && offset < max_line_length )
+			{
+			int n = plain_run(data, std::min(len, max_line_length - offset));
+
+			if ( n > 0 )
+				{
+				int size = buf_len;
+
+				while ( size < offset + n + 1 )
+					size *= 2;
+
+				InitBuffer(size);
+				memcpy(buf + offset, data, n);
+				offset += n;
+				last_char = data[n - 1];
+				data += n;
+				len -= n;
+
+				if ( len == 0 )
+					break;
+				}
+			}
+
 		if ( offset >= buf_len )
 			InitBuffer(buf_len * 2);
 
@@ -368,3 +452,48 @@ void ContentLine_Analyzer::SkipBytes(int64_t length)
 	}
 
 	} // namespace zeek::analyzer::tcp
+
+#ifdef __SSE2__
+using namespace zeek::analyzer::tcp;
+
+TEST_SUITE_BEGIN("ContentLine");
+
+TEST_CASE("plain run sse2 matches scalar")
+	{
+	for ( int len = 0; len <= 48; ++len )
+		{
+		// Bytes with the high bit set, so that a signed comparison would
+		// go wrong, mixed with plain text.
+		std::vector<u_char> data(len);
+
+		for ( int i = 0; i < len; ++i )
+			data[i] = i % 3 == 0 ? 'a' + i % 26 : 0x80 + (i * 37) % 128;
+
+		CHECK_EQ(plain_run_scalar(data.data(), len), len);
+		CHECK_EQ(plain_run_sse2(data.data(), len), len);
+
+		for ( u_char t : {'\r', '\n', '\0'} )
+			for ( int pos = 0; pos < len; ++pos )
+				{
+				auto orig = data[pos];
+				data[pos] = t;
+
+				CHECK_EQ(plain_run_scalar(data.data(), len), pos);
+				CHECK_EQ(plain_run_sse2(data.data(), len), pos);
+
+				// Only the first terminator counts.
+				if ( pos + 1 < len )
+					{
+					auto next = data[len - 1];
+					data[len - 1] = '\n';
+					CHECK_EQ(plain_run_sse2(data.data(), len), pos);
+					data[len - 1] = next;
+					}
+
+				data[pos] = orig;
+				}
+		}
+	}
+
+TEST_SUITE_END();
+#endif
@@ -31,20 +31,13 @@ TCP_Endpoint::TCP_Endpoint(packet_analysis::TCP::TCPSessionAdapter* arg_analyzer
 	window = 0;
 	window_scale = 0;
 	window_seq = window_ack_seq = 0;
-	contents_start_seq = 0;
 	FIN_seq = 0;
 	SYN_cnt = FIN_cnt = RST_cnt = 0;
 	did_close = false;
 	tcp_analyzer = arg_analyzer;
 	is_orig = arg_is_orig;
 
-	gap_cnt = chk_cnt = rxmt_cnt = win0_cnt = 0;
-	gap_thresh = chk_thresh = rxmt_thresh = win0_thresh = 1;
-
 	hist_last_SYN = hist_last_FIN = hist_last_RST = 0;
-
-	src_addr = is_orig ? Conn()->RespAddr() : Conn()->OrigAddr();
-	dst_addr = is_orig ? Conn()->OrigAddr() : Conn()->RespAddr();
 	}
 
 TCP_Endpoint::~TCP_Endpoint()
@@ -57,6 +50,18 @@ Connection* TCP_Endpoint::Conn() const
 	return tcp_analyzer->Conn();
 	}
 
+TCP_Endpoint::Extra* TCP_Endpoint::GetExtra()
+	{
+#ifdef ZEEK_COMPACT_VALUES
+	if ( ! extra )
+		extra = std::make_unique<Extra>();
+
+	return extra.get();
+#else
+	return &extra;
+#endif
+	}
+
 void TCP_Endpoint::Done()
 	{
 	if ( contents_processor )
@@ -84,8 +89,8 @@ void TCP_Endpoint::AddReassembler(TCP_Reassembler* arg_contents_processor)
 		delete contents_processor;
 	contents_processor = arg_contents_processor;
 
-	if ( contents_file )
-		contents_processor->SetContentsFile(contents_file);
+	if ( auto e = FindExtra(); e && e->contents_file )
+		contents_processor->SetContentsFile(e->contents_file);
 	}
 
 bool TCP_Endpoint::DataPending() const
@@ -122,7 +127,8 @@ bool TCP_Endpoint::ValidChecksum(const struct tcphdr* tp, int len, bool ipv4) co
 	{
 	int tcp_len = tp->th_off * 4 + len;
 
-	auto sum = detail::ip_in_cksum(ipv4, src_addr, dst_addr, IPPROTO_TCP,
+	// The sum doesn't depend on which address is which.
+	auto sum = detail::ip_in_cksum(ipv4, Conn()->OrigAddr(), Conn()->RespAddr(), IPPROTO_TCP,
 	                               reinterpret_cast<const uint8_t*>(tp), tcp_len);
 
 	return sum == 0xffff;
@@ -207,8 +213,12 @@ bool TCP_Endpoint::DataSent(double t, uint64_t seq, int len, int caplen, const u
 	if ( caplen <= 0 )
 		return status;
 
-	if ( contents_file && ! contents_processor && seq + len > contents_start_seq )
+	auto e = FindExtra();
+
+	if ( e && e->contents_file && ! contents_processor && seq + len > e->contents_start_seq )
 		{
+		const auto& contents_file = e->contents_file;
+		uint64_t contents_start_seq = e->contents_start_seq;
 		int64_t under_seq = contents_start_seq - seq;
 		if ( under_seq > 0 )
 			{
@@ -245,14 +255,25 @@ void TCP_Endpoint::AckReceived(uint64_t seq)
 
 void TCP_Endpoint::SetContentsFile(FilePtr f)
 	{
-	contents_file = std::move(f);
-	contents_start_seq = ToRelativeSeqSpace(last_seq, seq_wraps);
+	if ( ! f && ! FindExtra() )
+		return;
+
+	auto e = GetExtra();
+	e->contents_file = std::move(f);
+	e->contents_start_seq = ToRelativeSeqSpace(last_seq, seq_wraps);
 
-	if ( contents_start_seq == 0 )
-		contents_start_seq = 1; // skip SYN
+	if ( e->contents_start_seq == 0 )
+		e->contents_start_seq = 1; // skip SYN
 
 	if ( contents_processor )
-		contents_processor->SetContentsFile(contents_file);
+		contents_processor->SetContentsFile(e->contents_file);
+	}
+
+const FilePtr& TCP_Endpoint::GetContentsFile() const
+	{
+	static const FilePtr no_file;
+	auto e = FindExtra();
+	return e ? e->contents_file : no_file;
 	}
 
 bool TCP_Endpoint::CheckHistory(uint32_t mask, char code)
@@ -299,29 +320,33 @@ void TCP_Endpoint::AddHistory(char code)
 
 void TCP_Endpoint::ChecksumError()
 	{
-	uint32_t t = chk_thresh;
-	if ( Conn()->ScaledHistoryEntry(IsOrig() ? 'C' : 'c', chk_cnt, chk_thresh) )
+	auto e = GetExtra();
+	uint32_t t = e->chk_thresh;
+	if ( Conn()->ScaledHistoryEntry(IsOrig() ? 'C' : 'c', e->chk_cnt, e->chk_thresh) )
 		Conn()->HistoryThresholdEvent(tcp_multiple_checksum_errors, IsOrig(), t);
 	}
 
 void TCP_Endpoint::DidRxmit()
 	{
-	uint32_t t = rxmt_thresh;
-	if ( Conn()->ScaledHistoryEntry(IsOrig() ? 'T' : 't', rxmt_cnt, rxmt_thresh) )
+	auto e = GetExtra();
+	uint32_t t = e->rxmt_thresh;
+	if ( Conn()->ScaledHistoryEntry(IsOrig() ? 'T' : 't', e->rxmt_cnt, e->rxmt_thresh) )
 		Conn()->HistoryThresholdEvent(tcp_multiple_retransmissions, IsOrig(), t);
 	}
 
 void TCP_Endpoint::ZeroWindow()
 	{
-	uint32_t t = win0_thresh;
-	if ( Conn()->ScaledHistoryEntry(IsOrig() ? 'W' : 'w', win0_cnt, win0_thresh) )
+	auto e = GetExtra();
+	uint32_t t = e->win0_thresh;
+	if ( Conn()->ScaledHistoryEntry(IsOrig() ? 'W' : 'w', e->win0_cnt, e->win0_thresh) )
 		Conn()->HistoryThresholdEvent(tcp_multiple_zero_windows, IsOrig(), t);
 	}
 
 void TCP_Endpoint::Gap(uint64_t seq, uint64_t len)
 	{
-	uint32_t t = gap_thresh;
-	if ( Conn()->ScaledHistoryEntry(IsOrig() ? 'G' : 'g', gap_cnt, gap_thresh) )
+	auto e = GetExtra();
+	uint32_t t = e->gap_thresh;
+	if ( Conn()->ScaledHistoryEntry(IsOrig() ? 'G' : 'g', e->gap_cnt, e->gap_thresh) )
 		Conn()->HistoryThresholdEvent(tcp_multiple_gap, IsOrig(), t);
 	}
 
@@ -2,6 +2,10 @@
 
 #pragma once
 
+#include "zeek/zeek-config.h"
+
+#include <memory>
+
 #include "zeek/File.h"
 #include "zeek/IPAddr.h"
 
@@ -33,13 +37,20 @@ enum EndpointState
 	TCP_ENDPOINT_RESET // RST seen
 	};
 
-// One endpoint of a TCP connection.
+// One endpoint of a TCP connection. When configured with
+// --enable-compact-values, TCPSessionAdapter holds its two endpoints by
+// value, and what only some connections ever need lives in a separate
+// structure that gets allocated on first use, to keep the footprint of
+// idle connections small.
 class TCP_Endpoint
 	{
 public:
 	TCP_Endpoint(packet_analysis::TCP::TCPSessionAdapter* analyzer, bool is_orig);
 	~TCP_Endpoint();
 
+	TCP_Endpoint(const TCP_Endpoint&) = delete;
+	TCP_Endpoint& operator=(const TCP_Endpoint&) = delete;
+
 	void Done();
 
 	packet_analysis::TCP::TCPSessionAdapter* TCP() { return tcp_analyzer; }
@@ -198,7 +209,7 @@ public:
 	void AckReceived(uint64_t seq);
 
 	void SetContentsFile(FilePtr f);
-	const FilePtr& GetContentsFile() const { return contents_file; }
+	const FilePtr& GetContentsFile() const;
 
 	// Codes used for tracking history.  For responders, we shift these
 	// over by 16 bits in order to fit both originator and responder
@@ -221,16 +232,12 @@ public:
 	TCP_Endpoint* peer;
 	TCP_Reassembler* contents_processor;
 	packet_analysis::TCP::TCPSessionAdapter* tcp_analyzer;
-	FilePtr contents_file;
 
 	double start_time, last_time;
-	IPAddr src_addr; // the other endpoint
-	IPAddr dst_addr; // this endpoint
 	uint32_t window; // current advertised window (*scaled*, not pre-scaling)
 	int window_scale; // from the TCP option
 	uint32_t window_ack_seq; // at which ack_seq number did we record 'window'
 	uint32_t window_seq; // at which sending sequence number did we record 'window'
-	uint64_t contents_start_seq; // relative seq # where contents file starts
 	uint64_t FIN_seq; // relative seq # to start_seq
 	int SYN_cnt, FIN_cnt, RST_cnt;
 	bool did_close; // whether we've reported it closing
@@ -250,11 +257,37 @@ protected:
 	uint32_t seq_wraps, ack_wraps; // Number of times 32-bit TCP sequence space
 	                               // has wrapped around (overflowed).
 
-	// Performance history accounting.
-	uint32_t chk_cnt, chk_thresh;
-	uint32_t rxmt_cnt, rxmt_thresh;
-	uint32_t win0_cnt, win0_thresh;
-	uint32_t gap_cnt, gap_thresh;
+private:
+	// State for recording contents and for reporting trouble, which
+	// most endpoints never need.
+	struct Extra
+		{
+		FilePtr contents_file;
+		uint64_t contents_start_seq = 0; // relative seq # where contents file starts
+
+		// Performance history accounting.
+		uint32_t chk_cnt = 0, chk_thresh = 1;
+		uint32_t rxmt_cnt = 0, rxmt_thresh = 1;
+		uint32_t win0_cnt = 0, win0_thresh = 1;
+		uint32_t gap_cnt = 0, gap_thresh = 1;
+		};
+
+	// Returns the extra state, or null if the endpoint hasn't needed it
+	// yet.
+#ifdef ZEEK_COMPACT_VALUES
+	const Extra* FindExtra() const { return extra.get(); }
+#else
+	const Extra* FindExtra() const { return &extra; }
+#endif
+
+	// Returns the extra state, allocating it if needed.
+	Extra* GetExtra();
+
+#ifdef ZEEK_COMPACT_VALUES
+	std::unique_ptr<Extra> extra;
+#else
+	Extra extra;
+#endif
 	};
 
 #define ENDIAN_UNKNOWN 0
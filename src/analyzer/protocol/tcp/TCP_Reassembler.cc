@@ -36,6 +36,9 @@ TCP_Reassembler::TCP_Reassembler(analyzer::Analyzer* arg_dst_analyzer,
 	did_EOF = false;
 	seq_to_skip = 0;
 	in_delivery = false;
+	bypass_content = false;
+
+	SetCoalesceInOrder(true);
 
 	if ( zeek::detail::tcp_max_old_segments )
 		SetMaxOldBlocks(zeek::detail::tcp_max_old_segments);
@@ -224,7 +227,25 @@ void TCP_Reassembler::Undelivered(uint64_t up_to_seq)
 			          up_to_seq - last_reassem_seq, skip_deliveries);
 			}
 
-		if ( ! skip_deliveries )
+		if ( bypass_content )
+			{
+			// Report the holes between the ranges that arrived.
+			auto it = bypass_ranges.begin();
+
+			while ( it != bypass_ranges.end() && it->first <= up_to_seq )
+				{
+				if ( it->first > last_reassem_seq )
+					Gap(last_reassem_seq, it->first - last_reassem_seq);
+
+				last_reassem_seq = std::max(last_reassem_seq, it->second);
+				it = bypass_ranges.erase(it);
+				}
+
+			if ( up_to_seq > last_reassem_seq )
+				Gap(last_reassem_seq, up_to_seq - last_reassem_seq);
+			}
+
+		else if ( ! skip_deliveries )
 			{
 			// If we have blocks that begin below up_to_seq, deliver them.
 			auto it = block_list.Begin();
@@ -343,7 +364,12 @@ void TCP_Reassembler::RecordToSeq(uint64_t start_seq, uint64_t stop_seq, const F
 
 void TCP_Reassembler::RecordBlock(const DataBlock& b, const FilePtr& f)
 	{
-	if ( f->Write((const char*)b.block, b.Size()) )
+	RecordData(b.block, b.Size(), f);
+	}
+
+void TCP_Reassembler::RecordData(const u_char* data, uint64_t len, const FilePtr& f)
+	{
+	if ( f->Write((const char*)data, len) )
 		return;
 
 	reporter->Error("TCP_Reassembler contents write failed");
@@ -402,6 +428,25 @@ void TCP_Reassembler::BlockInserted(DataBlockMap::const_iterator it)
 		++it;
 		}
 
+	TrimDelivered();
+	}
+
+void TCP_Reassembler::BlockExtended(DataBlockMap::const_iterator it, uint64_t seq)
+	{
+	const auto& b = it->second;
+	const u_char* data = b.block + (seq - b.seq);
+	uint64_t len = b.upper - seq;
+	last_reassem_seq += len;
+
+	if ( record_contents_file )
+		RecordData(data, len, record_contents_file);
+
+	DeliverBlock(seq, len, data);
+	TrimDelivered();
+	}
+
+void TCP_Reassembler::TrimDelivered()
+	{
 	TCP_Endpoint* e = endp;
 
 	if ( ! e->peer->HasContents() )
@@ -445,6 +490,21 @@ void TCP_Reassembler::Overlap(const u_char* b1, const u_char* b2, uint64_t n)
 		}
 	}
 
+void TCP_Reassembler::Evict(bool flush)
+	{
+	tcp_analyzer->Weird("reassembly_memory_budget_exceeded", flush ? "flushed" : "dropped");
+
+	if ( flush && ! block_list.Empty() )
+		// Delivers whatever's above holes, reporting the holes as gaps.
+		TrimToSeq(block_list.LastBlock().upper);
+
+	else if ( ! flush )
+		skip_deliveries = true;
+
+	ClearBlocks();
+	ClearOldBlocks();
+	}
+
 void TCP_Reassembler::Deliver(uint64_t seq, int len, const u_char* data)
 	{
 	if ( type == Direct )
@@ -468,6 +528,20 @@ bool TCP_Reassembler::DataSent(double t, uint64_t seq, int len, const u_char* da
 	if ( skip_deliveries )
 		return false;
 
+	if ( bypass_content )
+		{
+		if ( CanBypassContent() )
+			{
+			BypassDataSent(seq, upper_seq);
+			return false;
+			}
+
+		// An analyzer got added that wants data again. It will see
+		// what we skipped as a gap.
+		bypass_content = false;
+		bypass_ranges.clear();
+		}
+
 	if ( seq < ack && ! replaying )
 		{
 		if ( upper_seq <= ack )
@@ -507,9 +581,77 @@ bool TCP_Reassembler::DataSent(double t, uint64_t seq, int len, const u_char* da
 		skip_deliveries = true;
 		}
 
+	if ( zeek::detail::tcp_content_bypass && ! skip_deliveries && CanBypassContent() )
+		BypassContent();
+
 	return true;
 	}
 
+bool TCP_Reassembler::CanBypassContent() const
+	{
+	return dst_analyzer == tcp_analyzer && ! deliver_tcp_contents && ! record_contents_file &&
+	       tcp_analyzer->ChildrenDoneWithContent(IsOrig());
+	}
+
+void TCP_Reassembler::BypassContent()
+	{
+	if ( bypass_content )
+		return;
+
+	bypass_content = true;
+
+	// Blocks we still have are either delivered already or sit above
+	// a hole. The latter still count as having arrived.
+	for ( auto it = block_list.Begin(); it != block_list.End(); ++it )
+		if ( it->second.upper > last_reassem_seq )
+			BypassDataSent(it->second.seq, it->second.upper);
+
+	ClearBlocks();
+	ClearOldBlocks();
+	}
+
+void TCP_Reassembler::BypassDataSent(uint64_t seq, uint64_t upper)
+	{
+	if ( upper <= last_reassem_seq )
+		return;
+
+	if ( seq <= last_reassem_seq )
+		{
+		last_reassem_seq = upper;
+
+		// Take in the ranges that are contiguous now.
+		auto it = bypass_ranges.begin();
+
+		while ( it != bypass_ranges.end() && it->first <= last_reassem_seq )
+			{
+			last_reassem_seq = std::max(last_reassem_seq, it->second);
+			it = bypass_ranges.erase(it);
+			}
+
+		return;
+		}
+
+	// Merge with overlapping or adjacent ranges.
+	auto it = bypass_ranges.upper_bound(seq);
+
+	if ( it != bypass_ranges.begin() && std::prev(it)->second >= seq )
+		{
+		--it;
+		seq = it->first;
+		upper = std::max(upper, it->second);
+		it = bypass_ranges.erase(it);
+		}
+
+	while ( it != bypass_ranges.end() && it->first <= upper )
+		{
+		upper = std::max(upper, it->second);
+		it = bypass_ranges.erase(it);
+		}
+
+	if ( bypass_ranges.size() < MAX_BYPASS_RANGES )
+		bypass_ranges.emplace(seq, upper);
+	}
+
 void TCP_Reassembler::AckReceived(uint64_t seq)
 	{
 	if ( endp->FIN_cnt > 0 && seq >= endp->FIN_seq )
@@ -519,7 +661,7 @@ void TCP_Reassembler::AckReceived(uint64_t seq)
 		// Nothing to do.
 		return;
 
-	bool test_active = ! skip_deliveries && ! tcp_analyzer->Skipping() &&
+	bool test_active = ! skip_deliveries && ! bypass_content && ! tcp_analyzer->Skipping() &&
 	                   (BifConst::report_gaps_for_partial ||
 	                    (endp->state == TCP_ENDPOINT_ESTABLISHED &&
 	                     endp->peer->state == TCP_ENDPOINT_ESTABLISHED));
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <map>
+
 #include "zeek/File.h"
 #include "zeek/Reassem.h"
 #include "zeek/analyzer/protocol/tcp/TCP_Endpoint.h"
@@ -68,6 +70,12 @@ public:
 	// Can be used to skip HTTP data for performance considerations.
 	void SkipToSeq(uint64_t seq);
 
+	// Stops buffering and delivering data, because none of the analyzers
+	// needs it anymore. We then keep track of just the sequence ranges
+	// that arrived, so that gaps still get reported.
+	void BypassContent();
+	bool BypassingContent() const { return bypass_content; }
+
 	bool DataSent(double t, uint64_t seq, int len, const u_char* data,
 	              analyzer::tcp::TCP_Flags flags, bool replaying = true);
 	void AckReceived(uint64_t seq);
@@ -96,12 +104,25 @@ private:
 	void Undelivered(uint64_t up_to_seq) override;
 	void Gap(uint64_t seq, uint64_t len);
 
+	// Returns true if there's no need to reassemble data anymore, see
+	// tcp_content_bypass.
+	bool CanBypassContent() const;
+
+	// Notes the arrival of data while bypassing content.
+	void BypassDataSent(uint64_t seq, uint64_t upper);
+
+	// Trims delivered data if we can't expect to see acks for it.
+	void TrimDelivered();
+
 	void RecordToSeq(uint64_t start_seq, uint64_t stop_seq, const FilePtr& f);
 	void RecordBlock(const DataBlock& b, const FilePtr& f);
+	void RecordData(const u_char* data, uint64_t len, const FilePtr& f);
 	void RecordGap(uint64_t start_seq, uint64_t upper_seq, const FilePtr& f);
 
 	void BlockInserted(DataBlockMap::const_iterator it) override;
+	void BlockExtended(DataBlockMap::const_iterator it, uint64_t seq) override;
 	void Overlap(const u_char* b1, const u_char* b2, uint64_t n) override;
+	void Evict(bool flush) override;
 
 	TCP_Endpoint* endp;
 
@@ -112,6 +133,13 @@ private:
 
 	uint64_t seq_to_skip;
 
+	// While bypassing content, the ranges that arrived above a hole,
+	// mapping their start to their end. Past MAX_BYPASS_RANGES, further
+	// ones get reported as gaps.
+	static constexpr size_t MAX_BYPASS_RANGES = 16;
+	bool bypass_content;
+	std::map<uint64_t, uint64_t> bypass_ranges;
+
 	bool in_delivery;
 	analyzer::tcp::TCP_Flags flags;
 
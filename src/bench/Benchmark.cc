@@ -0,0 +1,102 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/bench/Benchmark.h"
+
+#include <sys/resource.h>
+#include <algorithm>
+#include <cinttypes>
+#include <ctime>
+
+#include "zeek/util.h"
+
+namespace zeek::bench
+	{
+
+namespace
+	{
+
+double to_seconds(const struct timespec& ts)
+	{
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+	}
+
+	} // namespace
+
+double wall_time()
+	{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return to_seconds(ts);
+	}
+
+double thread_cpu_time()
+	{
+	struct timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return to_seconds(ts);
+	}
+
+double process_cpu_time()
+	{
+	struct rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 + ru.ru_stime.tv_sec +
+	       ru.ru_stime.tv_usec / 1e6;
+	}
+
+std::vector<Benchmark>& benchmarks()
+	{
+	static std::vector<Benchmark> all;
+	return all;
+	}
+
+void State::PauseTiming()
+	{
+	wall += wall_time() - wall_start;
+	cpu += thread_cpu_time() - cpu_start;
+	}
+
+void State::ResumeTiming()
+	{
+	wall_start = wall_time();
+	cpu_start = thread_cpu_time();
+	}
+
+void Runner::Run(const Benchmark& b)
+	{
+	uint64_t iterations = 1;
+
+	for ( ;; )
+		{
+		State state(iterations);
+		state.ResumeTiming();
+		b.func(state);
+		state.PauseTiming();
+
+		// Also stop at the limit, so that a benchmark whose iterations
+		// cost nothing still finishes.
+		if ( state.WallTime() >= min_time || iterations >= (uint64_t(1) << 40) )
+			{
+			auto items = static_cast<double>(state.Items());
+			fprintf(out,
+			        "{\"benchmark\":\"%s\",\"iterations\":%" PRIu64
+			        ",\"items\":%.0f,\"ns_per_item\":%.3f,\"cpu_ns_per_item\":%.3f,"
+			        "\"items_per_sec\":%.1f}\n",
+			        util::json_escape_utf8(b.name).c_str(), iterations, items,
+			        state.WallTime() * 1e9 / items, state.CPUTime() * 1e9 / items,
+			        items / std::max(state.WallTime(), 1e-9));
+			fflush(out);
+			return;
+			}
+
+		// Aim a bit past the minimum, growing by at most 10x per round.
+		double factor = 10.0;
+
+		if ( state.WallTime() > 0.0 )
+			factor = std::clamp(min_time * 1.4 / state.WallTime(), 2.0, 10.0);
+
+		iterations = static_cast<uint64_t>(iterations * factor);
+		}
+	}
+
+	} // namespace zeek::bench
@@ -0,0 +1,132 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+// A minimal harness for the microbenchmarks of zeek-bench.
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace zeek::bench
+	{
+
+/**
+ * Times one run of a benchmark, for a given number of iterations.
+ * Benchmarks loop Iterations() times over the operation they measure,
+ * and may pause the timing for preparations that shouldn't count.
+ */
+class State
+	{
+public:
+	explicit State(uint64_t iterations) : iterations(iterations) { }
+
+	uint64_t Iterations() const { return iterations; }
+
+	/**
+	 * Stops the clocks, e.g. while setting up the next batch of data.
+	 */
+	void PauseTiming();
+
+	/**
+	 * Restarts the clocks after PauseTiming().
+	 */
+	void ResumeTiming();
+
+	/**
+	 * Sets the count of items that a run processed, if an iteration
+	 * doesn't process exactly one.
+	 */
+	void SetItems(uint64_t n) { items = n; }
+
+	uint64_t Items() const { return items ? items : iterations; }
+	double WallTime() const { return wall; }
+	double CPUTime() const { return cpu; }
+
+private:
+	friend class Runner;
+
+	uint64_t iterations;
+	uint64_t items = 0;
+	double wall = 0.0;
+	double cpu = 0.0;
+	double wall_start = 0.0;
+	double cpu_start = 0.0;
+	};
+
+using Function = std::function<void(State&)>;
+
+struct Benchmark
+	{
+	std::string name;
+	Function func;
+	};
+
+/**
+ * @return All benchmarks registered through ZEEK_BENCHMARK.
+ */
+std::vector<Benchmark>& benchmarks();
+
+/**
+ * Registers a benchmark during static initialization.
+ */
+class Registrar
+	{
+public:
+	Registrar(const char* name, Function func)
+		{
+		benchmarks().push_back({name, std::move(func)});
+		}
+	};
+
+/**
+ * Runs benchmarks, increasing the iterations of each until a run takes
+ * long enough to time reliably, and reports each result as a line of
+ * JSON.
+ */
+class Runner
+	{
+public:
+	/**
+	 * Constructor.
+	 *
+	 * @param min_time The least time in seconds that the reported run
+	 * of each benchmark takes.
+	 *
+	 * @param out Where results go.
+	 */
+	Runner(double min_time, FILE* out) : min_time(min_time), out(out) { }
+
+	/**
+	 * Runs a benchmark and reports its result.
+	 */
+	void Run(const Benchmark& b);
+
+private:
+	double min_time;
+	FILE* out;
+	};
+
+/**
+ * @return The wall clock time, from a monotonic clock, in seconds.
+ */
+double wall_time();
+
+/**
+ * @return The CPU time the calling thread used, in seconds.
+ */
+double thread_cpu_time();
+
+/**
+ * @return The CPU time the whole process used, in seconds.
+ */
+double process_cpu_time();
+
+	} // namespace zeek::bench
+
+#define ZEEK_BENCHMARK(name)                                                                       \
+	static void bench_##name(zeek::bench::State& state);                                           \
+	static zeek::bench::Registrar bench_registrar_##name(#name, bench_##name);                     \
+	static void bench_##name(zeek::bench::State& state)
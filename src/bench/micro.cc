@@ -0,0 +1,557 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+// Microbenchmarks of the core's hot paths. Each runs a single operation
+// in a loop, over inputs prepared with the timing paused.
+
+#include <arpa/inet.h>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "zeek/Attr.h"
+#include "zeek/CompHash.h"
+#include "zeek/Conn.h"
+#include "zeek/Desc.h"
+#include "zeek/Dict.h"
+#include "zeek/Func.h"
+#include "zeek/Hash.h"
+#include "zeek/ID.h"
+#include "zeek/IPAddr.h"
+#include "zeek/LiteralPrefilter.h"
+#include "zeek/Reassem.h"
+#include "zeek/RunState.h"
+#include "zeek/Timer.h"
+#include "zeek/Val.h"
+#include "zeek/bench/Benchmark.h"
+#include "zeek/file_analysis/Manager.h"
+#include "zeek/iosource/Packet.h"
+#include "zeek/session/Manager.h"
+#include "zeek/threading/SerialTypes.h"
+#include "zeek/threading/formatters/Ascii.h"
+#include "zeek/threading/formatters/JSON.h"
+#include "zeek/util.h"
+
+namespace
+	{
+
+using namespace zeek;
+
+constexpr int NUM_KEYS = 100000;
+
+// The same pseudo-random inputs on every run.
+std::vector<uint32_t> random_numbers(size_t n)
+	{
+	std::mt19937 rng(42);
+	std::vector<uint32_t> v(n);
+
+	for ( auto& x : v )
+		x = rng();
+
+	return v;
+	}
+
+ZEEK_BENCHMARK(dict_insert)
+	{
+	auto numbers = random_numbers(NUM_KEYS);
+	static int value;
+	uint64_t items = 0;
+
+	for ( uint64_t i = 0; i < state.Iterations(); ++i )
+		{
+		PDict<int> d;
+
+		for ( auto n : numbers )
+			{
+			detail::HashKey key(static_cast<zeek_uint_t>(n));
+			d.Insert(&key, &value);
+			}
+
+		items += numbers.size();
+		}
+
+	state.SetItems(items);
+	}
+
+ZEEK_BENCHMARK(dict_lookup)
+	{
+	state.PauseTiming();
+	auto numbers = random_numbers(NUM_KEYS);
+	static int value;
+	PDict<int> d;
+	std::vector<std::unique_ptr<detail::HashKey>> keys;
+
+	for ( auto n : numbers )
+		{
+		keys.emplace_back(std::make_unique<detail::HashKey>(static_cast<zeek_uint_t>(n)));
+		d.Insert(keys.back().get(), &value);
+		}
+
+	// Inserting took the keys' data, so build them anew for looking up.
+	keys.clear();
+
+	for ( auto n : numbers )
+		keys.emplace_back(std::make_unique<detail::HashKey>(static_cast<zeek_uint_t>(n)));
+
+	state.ResumeTiming();
+
+	uint64_t found = 0;
+
+	for ( uint64_t i = 0; i < state.Iterations(); ++i )
+		found += d.Lookup(keys[i % keys.size()].get()) != nullptr;
+
+	if ( found != state.Iterations() )
+		fprintf(stderr, "dict_lookup: missed keys\n");
+	}
+
+// Hashes keys of a given size with one of KeyedHash's functions, at
+// varying alignments.
+template <typename F> void hash_bytes(bench::State& state, size_t size, F hash)
+	{
+	state.PauseTiming();
+	std::vector<uint8_t> buf(size + 8);
+
+	for ( size_t i = 0; i < buf.size(); ++i )
+		buf[i] = static_cast<uint8_t>(i);
+
+	state.ResumeTiming();
+
+	// Keeps the compiler from dropping the hashing.
+	static volatile uint64_t result;
+	uint64_t sum = 0;
+
+	for ( uint64_t i = 0; i < state.Iterations(); ++i )
+		sum += hash(buf.data() + (i & 7), size);
+
+	result = sum;
+	}
+
+#define HASH_BENCHMARKS(size)                                                                      \
+	ZEEK_BENCHMARK(siphash_##size) { hash_bytes(state, size, detail::KeyedHash::Hash64); }         \
+	ZEEK_BENCHMARK(fasthash_##size) { hash_bytes(state, size, detail::KeyedHash::FastHash64); }
+
+// The sizes of keys for ports and IPv4 addresses, pairs of them, IPv6
+// addresses, connection keys, and longer strings.
+HASH_BENCHMARKS(4)
+HASH_BENCHMARKS(8)
+HASH_BENCHMARKS(16)
+HASH_BENCHMARKS(40)
+HASH_BENCHMARKS(128)
+
+// Hashes table indices of the shape [addr, port, string].
+ZEEK_BENCHMARK(composite_hash)
+	{
+	state.PauseTiming();
+	auto tl = make_intrusive<TypeList>();
+	tl->Append(base_type(TYPE_ADDR));
+	tl->Append(base_type(TYPE_PORT));
+	tl->Append(base_type(TYPE_STRING));
+	detail::CompositeHash hash(tl);
+
+	std::vector<ListValPtr> indices;
+
+	for ( auto n : random_numbers(1024) )
+		{
+		auto lv = make_intrusive<ListVal>(TYPE_ANY);
+		lv->Append(make_intrusive<AddrVal>(n));
+		lv->Append(val_mgr->Port(n % 65536, TRANSPORT_TCP));
+		lv->Append(make_intrusive<StringVal>("www.example.com"));
+		indices.emplace_back(std::move(lv));
+		}
+
+	state.ResumeTiming();
+
+	for ( uint64_t i = 0; i < state.Iterations(); ++i )
+		hash.MakeHashKey(*indices[i % indices.size()], true);
+	}
+
+// Creates records of 40 optional count and string fields, sets half of
+// them, and reads them back, like log records get built up.
+ZEEK_BENCHMARK(record_fields)
+	{
+	constexpr int FIELDS = 40;
+	state.PauseTiming();
+	auto decls = new type_decl_list();
+
+	for ( int i = 0; i < FIELDS; ++i )
+		{
+		auto t = i % 2 == 0 ? base_type(TYPE_COUNT) : base_type(TYPE_STRING);
+		std::vector<detail::AttrPtr> a{make_intrusive<detail::Attr>(detail::ATTR_OPTIONAL)};
+		auto attrs = make_intrusive<detail::Attributes>(std::move(a), t, true, false);
+		auto id = "f" + std::to_string(i);
+		decls->push_back(new TypeDecl(util::copy_string(id.c_str()), t, std::move(attrs)));
+		}
+
+	auto rt = make_intrusive<RecordType>(decls);
+	state.ResumeTiming();
+
+	uint64_t present = 0;
+
+	for ( uint64_t i = 0; i < state.Iterations(); ++i )
+		{
+		auto r = make_intrusive<RecordVal>(rt);
+
+		for ( int j = 0; j < FIELDS; j += 4 )
+			{
+			r->Assign(j, zeek_uint_t(j));
+			r->Assign(j + 1, "value");
+			}
+
+		for ( int j = 0; j < FIELDS; ++j )
+			present += r->HasField(j);
+		}
+
+	state.SetItems(state.Iterations());
+
+	if ( present != state.Iterations() * FIELDS / 2 )
+		fprintf(stderr, "record_fields: wrong fields\n");
+	}
+
+ZEEK_BENCHMARK(session_lookup)
+	{
+	state.PauseTiming();
+	Packet pkt;
+	std::vector<detail::ConnKey> keys;
+	std::vector<Connection*> conns;
+
+	for ( auto n : random_numbers(NUM_KEYS) )
+		{
+		ConnTuple tuple;
+		tuple.src_addr = IPAddr(IPv4, &n, IPAddr::Host);
+		tuple.dst_addr = IPAddr("192.168.1.1");
+		tuple.src_port = htons(1024 + n % 60000);
+		tuple.dst_port = htons(443);
+		tuple.is_one_way = false;
+		tuple.proto = TRANSPORT_TCP;
+
+		detail::ConnKey key(tuple);
+		auto c = new Connection(key, run_state::network_time, &tuple, 0, &pkt);
+		session_mgr->Insert(c, false);
+		keys.push_back(key);
+		conns.push_back(c);
+		}
+
+	state.ResumeTiming();
+
+	uint64_t found = 0;
+
+	for ( uint64_t i = 0; i < state.Iterations(); ++i )
+		found += session_mgr->FindConnection(keys[i % keys.size()]) != nullptr;
+
+	state.PauseTiming();
+
+	if ( found != state.Iterations() )
+		fprintf(stderr, "session_lookup: missed connections\n");
+
+	for ( auto c : conns )
+		c->Done();
+
+	session_mgr->Clear();
+	state.ResumeTiming();
+	}
+
+class BenchTimer final : public detail::Timer
+	{
+public:
+	explicit BenchTimer(double t) : detail::Timer(t, detail::TIMER_NETWORK) { }
+
+	void Dispatch(double t, bool is_expire) override { }
+	};
+
+// Adds timers at random times within ten minutes and fires them all.
+ZEEK_BENCHMARK(timer_mgr)
+	{
+	auto numbers = random_numbers(NUM_KEYS);
+	double base = detail::timer_mgr->Time();
+	uint64_t items = 0;
+
+	for ( uint64_t i = 0; i < state.Iterations(); ++i )
+		{
+		for ( auto n : numbers )
+			detail::timer_mgr->Add(new BenchTimer(base + (n % 600000) / 1000.0));
+
+		base += 600.0;
+		detail::timer_mgr->Advance(base, NUM_KEYS);
+		items += numbers.size();
+		}
+
+	state.SetItems(items);
+	}
+
+class BenchReassembler final : public Reassembler
+	{
+public:
+	BenchReassembler() : Reassembler(0, REASSEM_FILE) { }
+
+	uint64_t delivered = 0;
+
+protected:
+	// Delivers what's in order, like the file reassembler.
+	void BlockInserted(DataBlockMap::const_iterator it) override
+		{
+		while ( it != block_list.End() && it->second.seq <= last_reassem_seq )
+			{
+			const auto& b = it->second;
+
+			if ( b.upper > last_reassem_seq )
+				{
+				delivered += b.upper - last_reassem_seq;
+				last_reassem_seq = b.upper;
+				}
+
+			++it;
+			}
+
+		TrimToSeq(last_reassem_seq);
+		}
+
+	void Overlap(const u_char* b1, const u_char* b2, uint64_t n) override { }
+	};
+
+// Feeds a stream of 1460-byte segments, every fourth one swapped with
+// its successor, so that half of the data arrives out of order.
+ZEEK_BENCHMARK(reassembler)
+	{
+	constexpr uint64_t SEGMENT = 1460;
+	constexpr int SEGMENTS = 1024;
+	std::vector<u_char> data(SEGMENT, 'x');
+	uint64_t bytes = 0;
+
+	for ( uint64_t i = 0; i < state.Iterations(); ++i )
+		{
+		BenchReassembler r;
+
+		for ( int j = 0; j < SEGMENTS; ++j )
+			{
+			int k = j % 4 == 0 ? j + 1 : (j % 4 == 1 ? j - 1 : j);
+			r.NewBlock(run_state::network_time, k * SEGMENT, SEGMENT, data.data());
+			}
+
+		bytes += r.delivered;
+		}
+
+	state.SetItems(state.Iterations() * SEGMENTS);
+
+	if ( bytes != state.Iterations() * SEGMENTS * SEGMENT )
+		fprintf(stderr, "reassembler: lost data\n");
+	}
+
+// Matches file magic signatures against the start of a PNG file.
+ZEEK_BENCHMARK(rule_matcher)
+	{
+	static const u_char png[] = "\x89PNG\r\n\x1a\n\0\0\0\rIHDR\0\0\x01\0\0\0\x01\0\x08\x06\0\0\0";
+	std::string mime;
+
+	for ( uint64_t i = 0; i < state.Iterations(); ++i )
+		mime = file_mgr->DetectMIME(png, sizeof(png) - 1);
+
+	if ( mime != "image/png" )
+		fprintf(stderr, "rule_matcher: unexpected MIME type '%s'\n", mime.c_str());
+	}
+
+// A log entry as the logging framework hands it to writers.
+struct LogEntry
+	{
+	LogEntry()
+		{
+		fields.push_back(new threading::Field("ts", nullptr, TYPE_TIME, TYPE_VOID, false));
+		fields.push_back(new threading::Field("uid", nullptr, TYPE_STRING, TYPE_VOID, false));
+		fields.push_back(new threading::Field("orig_h", nullptr, TYPE_ADDR, TYPE_VOID, false));
+		fields.push_back(new threading::Field("orig_p", nullptr, TYPE_PORT, TYPE_VOID, false));
+		fields.push_back(new threading::Field("bytes", nullptr, TYPE_COUNT, TYPE_VOID, false));
+		fields.push_back(new threading::Field("note", nullptr, TYPE_STRING, TYPE_VOID, true));
+
+		auto v = new threading::Value(TYPE_TIME);
+		v->val.double_val = 1665400000.123456;
+		vals.push_back(v);
+
+		v = new threading::Value(TYPE_STRING);
+		v->val.string_val.data = util::copy_string("CHhAvVGS1DHFjwGM9");
+		v->val.string_val.length = strlen(v->val.string_val.data);
+		vals.push_back(v);
+
+		v = new threading::Value(TYPE_ADDR);
+		v->val.addr_val.family = IPv4;
+		inet_pton(AF_INET, "10.1.2.3", &v->val.addr_val.in.in4);
+		vals.push_back(v);
+
+		v = new threading::Value(TYPE_PORT);
+		v->val.port_val.port = 49152;
+		v->val.port_val.proto = TRANSPORT_TCP;
+		vals.push_back(v);
+
+		v = new threading::Value(TYPE_COUNT);
+		v->val.uint_val = 123456789;
+		vals.push_back(v);
+
+		vals.push_back(new threading::Value(TYPE_STRING, false));
+		}
+
+	~LogEntry()
+		{
+		for ( auto f : fields )
+			delete f;
+
+		for ( auto v : vals )
+			delete v;
+		}
+
+	std::vector<threading::Field*> fields;
+	std::vector<threading::Value*> vals;
+	};
+
+ZEEK_BENCHMARK(format_json)
+	{
+	LogEntry entry;
+	threading::formatter::JSON json(nullptr, threading::formatter::JSON::TS_EPOCH);
+	ODesc desc;
+
+	for ( uint64_t i = 0; i < state.Iterations(); ++i )
+		{
+		desc.Clear();
+		json.Describe(&desc, entry.fields.size(), entry.fields.data(), entry.vals.data());
+		}
+	}
+
+ZEEK_BENCHMARK(format_ascii)
+	{
+	LogEntry entry;
+	threading::formatter::Ascii::SeparatorInfo info("\t", ",", "-", "(empty)");
+	threading::formatter::Ascii ascii(nullptr, info);
+	ODesc desc;
+
+	for ( uint64_t i = 0; i < state.Iterations(); ++i )
+		{
+		desc.Clear();
+		ascii.Describe(&desc, entry.fields.size(), entry.fields.data(), entry.vals.data());
+		}
+	}
+
+// A request line and headers like the ones that HTTP scripts take apart.
+std::string http_text()
+	{
+	std::string text;
+
+	while ( text.size() < 4096 )
+		text += "GET /Search/Results.aspx?Query=Zeek+Network+Monitor&Page=2 HTTP/1.1\r\n"
+		        "Host: WWW.Example.COM\r\nUser-Agent: Mozilla/5.0 (X11; Linux x86_64)\r\n";
+
+	return text;
+	}
+
+// The string kernels report bytes as items.
+ZEEK_BENCHMARK(string_to_lower)
+	{
+	auto text = http_text();
+	std::vector<u_char> out(text.size());
+
+	for ( uint64_t i = 0; i < state.Iterations(); ++i )
+		util::ascii_to_lower(reinterpret_cast<const u_char*>(text.data()), text.size(),
+		                     out.data());
+
+	state.SetItems(state.Iterations() * text.size());
+	}
+
+ZEEK_BENCHMARK(string_is_ascii)
+	{
+	auto text = http_text();
+	uint64_t ascii = 0;
+
+	for ( uint64_t i = 0; i < state.Iterations(); ++i )
+		ascii += util::is_ascii(reinterpret_cast<const u_char*>(text.data()), text.size());
+
+	state.SetItems(state.Iterations() * text.size());
+
+	if ( ascii != state.Iterations() )
+		fprintf(stderr, "string_is_ascii: wrong result\n");
+	}
+
+// Searches for a string that's missing, so each search covers the text.
+ZEEK_BENCHMARK(string_find)
+	{
+	auto text = http_text();
+	static const u_char needle[] = "Cookie:";
+	int found = 0;
+
+	for ( uint64_t i = 0; i < state.Iterations(); ++i )
+		found |= util::strstr_n(text.size(), reinterpret_cast<const u_char*>(text.data()),
+		                        sizeof(needle) - 1, needle) >= 0;
+
+	state.SetItems(state.Iterations() * text.size());
+
+	if ( found )
+		fprintf(stderr, "string_find: unexpected match\n");
+	}
+
+// Scans for signature literals that are missing, so each scan covers the
+// text, reporting bytes as items.
+ZEEK_BENCHMARK(literal_prefilter)
+	{
+	static const char* literals[] = {"cmd.exe", "/etc/passwd", "\x16\x03\x01", "SSH-",
+	                                 "USER root", "<script", "union select", "\x7f\x45LF",
+	                                 "../../", "powershell", "wget http", "MZ\x90",
+	                                 "SELECT * FROM", "%u9090", "/bin/sh", "PK\x03\x04"};
+	auto text = http_text();
+	detail::LiteralPrefilter pf;
+	int groups = 0;
+
+	for ( auto l : literals )
+		pf.Add(l, groups++);
+
+	std::vector<int> found;
+
+	for ( uint64_t i = 0; i < state.Iterations(); ++i )
+		{
+		std::vector<bool> waiting(groups, true);
+		pf.Scan(reinterpret_cast<const u_char*>(text.data()), text.size(), &waiting, &found);
+		}
+
+	state.SetItems(state.Iterations() * text.size());
+
+	if ( ! found.empty() )
+		fprintf(stderr, "literal_prefilter: unexpected match\n");
+	}
+
+// Calls a script function that loops over arithmetic and a table, from
+// bench.zeek. It runs in ZAM when zeek-bench gets passed -O ZAM.
+ZEEK_BENCHMARK(script_loop)
+	{
+	constexpr zeek_uint_t STEPS = 1000;
+	auto f = id::find_func("Bench::loop");
+
+	if ( ! f )
+		{
+		fprintf(stderr, "script_loop: Bench::loop not found\n");
+		return;
+		}
+
+	auto n = val_mgr->Count(STEPS);
+
+	for ( uint64_t i = 0; i < state.Iterations(); ++i )
+		f->Invoke(n);
+
+	state.SetItems(state.Iterations() * STEPS);
+	}
+
+// Calls a script function that switches on counts and strings, from
+// bench.zeek. It runs in ZAM when zeek-bench gets passed -O ZAM.
+ZEEK_BENCHMARK(script_switch)
+	{
+	constexpr zeek_uint_t STEPS = 1000;
+	auto f = id::find_func("Bench::switches");
+
+	if ( ! f )
+		{
+		fprintf(stderr, "script_switch: Bench::switches not found\n");
+		return;
+		}
+
+	auto n = val_mgr->Count(STEPS);
+
+	for ( uint64_t i = 0; i < state.Iterations(); ++i )
+		f->Invoke(n);
+
+	state.SetItems(state.Iterations() * STEPS);
+	}
+
+	} // namespace
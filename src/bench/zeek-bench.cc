@@ -0,0 +1,143 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+// Runs Zeek's benchmarks: the microbenchmarks of micro.cc, or, with
+// --pcap, Zeek's whole processing of a trace. Results go to stdout as
+// one line of JSON per benchmark.
+
+#include "zeek/zeek-config.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "zeek/RunState.h"
+#include "zeek/bench/Benchmark.h"
+#include "zeek/iosource/Manager.h"
+#include "zeek/packet_analysis/Manager.h"
+#include "zeek/util.h"
+#include "zeek/zeek-setup.h"
+
+namespace
+	{
+
+void usage(const char* prog)
+	{
+	fprintf(stderr,
+	        "usage: %s [--filter <substring>] [--min-time <secs>] [--list] [--pcap <file>] "
+	        "[-- <zeek options and scripts>]\n",
+	        prog);
+	exit(1);
+	}
+
+int run_pcap(const std::string& pcap, const std::vector<std::string>& zeek_args)
+	{
+	auto wall_start = zeek::bench::wall_time();
+	auto cpu_start = zeek::bench::process_cpu_time();
+	bool did_run_loop = false;
+
+	if ( zeek::iosource_mgr->Size() > 0 || zeek::run_state::detail::have_pending_timers )
+		{
+		zeek::run_state::detail::run_loop();
+		did_run_loop = true;
+		}
+
+	auto wall = zeek::bench::wall_time() - wall_start;
+	auto cpu = zeek::bench::process_cpu_time() - cpu_start;
+	auto packets = zeek::packet_mgr->PacketsProcessed();
+	auto args = zeek::util::json_escape_utf8(zeek::util::implode_string_vector(zeek_args, " "));
+
+	printf("{\"benchmark\":\"pcap\",\"trace\":\"%s\",\"args\":\"%s\",\"packets\":%" PRIu64
+	       ",\"wall_secs\":%.6f,\"cpu_secs\":%.6f,\"packets_per_sec\":%.1f,"
+	       "\"cpu_us_per_packet\":%.3f}\n",
+	       zeek::util::json_escape_utf8(pcap).c_str(), args.c_str(), packets, wall, cpu,
+	       packets / std::max(wall, 1e-9), packets ? cpu * 1e6 / packets : 0.0);
+	fflush(stdout);
+
+	return zeek::detail::cleanup(did_run_loop);
+	}
+
+	} // namespace
+
+int main(int argc, char** argv)
+	{
+	std::string filter;
+	std::string pcap;
+	double min_time = 0.5;
+	bool list = false;
+	std::vector<std::string> zeek_args;
+
+	for ( int i = 1; i < argc; ++i )
+		{
+		auto arg = std::string(argv[i]);
+
+		if ( arg == "--" )
+			{
+			zeek_args.assign(argv + i + 1, argv + argc);
+			break;
+			}
+
+		if ( arg == "--list" )
+			list = true;
+		else if ( i + 1 >= argc )
+			usage(argv[0]);
+		else if ( arg == "--filter" )
+			filter = argv[++i];
+		else if ( arg == "--min-time" )
+			min_time = atof(argv[++i]);
+		else if ( arg == "--pcap" )
+			pcap = argv[++i];
+		else
+			usage(argv[0]);
+		}
+
+	if ( list )
+		{
+		for ( const auto& b : zeek::bench::benchmarks() )
+			printf("%s\n", b.name.c_str());
+
+		return 0;
+		}
+
+	if ( min_time <= 0.0 )
+		usage(argv[0]);
+
+	// Trace runs take the trace like zeek -r does. The microbenchmarks
+	// need the script functions they call, and no packet source.
+	std::vector<std::string> setup_args = {argv[0]};
+
+	if ( ! pcap.empty() )
+		{
+		setup_args.emplace_back("-r");
+		setup_args.emplace_back(pcap);
+		}
+	else
+		setup_args.emplace_back(ZEEK_BENCH_SCRIPT);
+
+	setup_args.insert(setup_args.end(), zeek_args.begin(), zeek_args.end());
+
+	std::vector<char*> setup_argv;
+
+	for ( auto& a : setup_args )
+		setup_argv.push_back(a.data());
+
+	setup_argv.push_back(nullptr);
+
+	auto setup_result = zeek::detail::setup(setup_args.size(), setup_argv.data());
+
+	if ( setup_result.code )
+		return setup_result.code;
+
+	if ( ! pcap.empty() )
+		return run_pcap(pcap, zeek_args);
+
+	zeek::bench::Runner runner(min_time, stdout);
+
+	for ( const auto& b : zeek::bench::benchmarks() )
+		if ( filter.empty() || b.name.find(filter) != std::string::npos )
+			runner.Run(b);
+
+	return zeek::detail::cleanup(false);
+	}
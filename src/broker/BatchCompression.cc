@@ -0,0 +1,639 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/broker/BatchCompression.h"
+
+#include "zeek/zeek-config.h"
+
+#include <broker/zeek.hh>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "zeek/3rdparty/doctest.h"
+
+namespace zeek::Broker::detail
+	{
+
+namespace
+	{
+
+// Marks the single element of a compressed batch.
+constexpr const char* compressed_batch_tag = "Broker::__zstd_batch";
+
+// Guards against malformed input nesting containers without end.
+constexpr int max_depth = 64;
+
+// Guards against malformed input claiming huge sizes.
+constexpr uint64_t max_decompressed_size = 1ULL << 30;
+
+enum Tag : uint8_t
+	{
+	TAG_NONE,
+	TAG_BOOL,
+	TAG_COUNT,
+	TAG_INTEGER,
+	TAG_REAL,
+	TAG_STRING,
+	TAG_ADDRESS,
+	TAG_SUBNET,
+	TAG_PORT,
+	TAG_TIMESTAMP,
+	TAG_TIMESPAN,
+	TAG_ENUM,
+	TAG_SET,
+	TAG_TABLE,
+	TAG_VECTOR,
+	};
+
+struct data_writer
+	{
+	using result_type = void;
+
+	std::string& out;
+
+	void PutByte(uint8_t b) { out.push_back(static_cast<char>(b)); }
+
+	void PutVarint(uint64_t v)
+		{
+		while ( v >= 0x80 )
+			{
+			PutByte(static_cast<uint8_t>(v) | 0x80);
+			v >>= 7;
+			}
+
+		PutByte(static_cast<uint8_t>(v));
+		}
+
+	void PutSigned(int64_t v) { PutVarint((uint64_t(v) << 1) ^ uint64_t(v >> 63)); }
+
+	void PutString(const std::string& s)
+		{
+		PutVarint(s.size());
+		out.append(s);
+		}
+
+	void PutAddress(const broker::address& a)
+		{
+		out.append(reinterpret_cast<const char*>(a.bytes().data()), a.bytes().size());
+		}
+
+	result_type operator()(broker::none) { PutByte(TAG_NONE); }
+
+	result_type operator()(bool a)
+		{
+		PutByte(TAG_BOOL);
+		PutByte(a ? 1 : 0);
+		}
+
+	result_type operator()(uint64_t a)
+		{
+		PutByte(TAG_COUNT);
+		PutVarint(a);
+		}
+
+	result_type operator()(int64_t a)
+		{
+		PutByte(TAG_INTEGER);
+		PutSigned(a);
+		}
+
+	result_type operator()(double a)
+		{
+		PutByte(TAG_REAL);
+		char buf[sizeof(double)];
+		memcpy(buf, &a, sizeof(a));
+		out.append(buf, sizeof(buf));
+		}
+
+	result_type operator()(const std::string& a)
+		{
+		PutByte(TAG_STRING);
+		PutString(a);
+		}
+
+	result_type operator()(const broker::address& a)
+		{
+		PutByte(TAG_ADDRESS);
+		PutAddress(a);
+		}
+
+	result_type operator()(const broker::subnet& a)
+		{
+		PutByte(TAG_SUBNET);
+		PutAddress(a.network());
+		PutByte(a.length());
+		}
+
+	result_type operator()(const broker::port& a)
+		{
+		PutByte(TAG_PORT);
+		PutVarint(a.number());
+		PutByte(static_cast<uint8_t>(a.type()));
+		}
+
+	result_type operator()(const broker::timestamp& a)
+		{
+		PutByte(TAG_TIMESTAMP);
+		PutSigned(a.time_since_epoch().count());
+		}
+
+	result_type operator()(const broker::timespan& a)
+		{
+		PutByte(TAG_TIMESPAN);
+		PutSigned(a.count());
+		}
+
+	result_type operator()(const broker::enum_value& a)
+		{
+		PutByte(TAG_ENUM);
+		PutString(a.name);
+		}
+
+	result_type operator()(const broker::set& a)
+		{
+		PutByte(TAG_SET);
+		PutVarint(a.size());
+
+		for ( const auto& e : a )
+			visit(*this, e);
+		}
+
+	result_type operator()(const broker::table& a)
+		{
+		PutByte(TAG_TABLE);
+		PutVarint(a.size());
+
+		for ( const auto& [k, v] : a )
+			{
+			visit(*this, k);
+			visit(*this, v);
+			}
+		}
+
+	result_type operator()(const broker::vector& a)
+		{
+		PutByte(TAG_VECTOR);
+		PutVarint(a.size());
+
+		for ( const auto& e : a )
+			visit(*this, e);
+		}
+	};
+
+class DataReader
+	{
+public:
+	explicit DataReader(const std::string& s) : pos(s.data()), end(s.data() + s.size()) { }
+
+	bool AtEnd() const { return pos == end; }
+
+	bool Read(broker::data* d, int depth = 0)
+		{
+		uint8_t tag;
+
+		if ( depth > max_depth || ! GetByte(&tag) )
+			return false;
+
+		switch ( tag )
+			{
+			case TAG_NONE:
+				*d = broker::data{};
+				return true;
+
+			case TAG_BOOL:
+				{
+				uint8_t b;
+
+				if ( ! GetByte(&b) || b > 1 )
+					return false;
+
+				*d = broker::data{b == 1};
+				return true;
+				}
+
+			case TAG_COUNT:
+				{
+				uint64_t v;
+
+				if ( ! GetVarint(&v) )
+					return false;
+
+				*d = broker::data{broker::count{v}};
+				return true;
+				}
+
+			case TAG_INTEGER:
+				{
+				int64_t v;
+
+				if ( ! GetSigned(&v) )
+					return false;
+
+				*d = broker::data{broker::integer{v}};
+				return true;
+				}
+
+			case TAG_REAL:
+				{
+				double v;
+
+				if ( end - pos < static_cast<ptrdiff_t>(sizeof(v)) )
+					return false;
+
+				memcpy(&v, pos, sizeof(v));
+				pos += sizeof(v);
+				*d = broker::data{v};
+				return true;
+				}
+
+			case TAG_STRING:
+				{
+				std::string s;
+
+				if ( ! GetString(&s) )
+					return false;
+
+				*d = broker::data{std::move(s)};
+				return true;
+				}
+
+			case TAG_ADDRESS:
+				{
+				broker::address a;
+
+				if ( ! GetAddress(&a) )
+					return false;
+
+				*d = broker::data{a};
+				return true;
+				}
+
+			case TAG_SUBNET:
+				{
+				broker::address a;
+				uint8_t len;
+
+				if ( ! GetAddress(&a) || ! GetByte(&len) )
+					return false;
+
+				*d = broker::data{broker::subnet(a, len)};
+				return true;
+				}
+
+			case TAG_PORT:
+				{
+				uint64_t number;
+				uint8_t proto;
+
+				if ( ! GetVarint(&number) || number > 65535 || ! GetByte(&proto) ||
+				     proto > static_cast<uint8_t>(broker::port::protocol::icmp) )
+					return false;
+
+				*d = broker::data{broker::port(static_cast<broker::port::number_type>(number),
+				                               static_cast<broker::port::protocol>(proto))};
+				return true;
+				}
+
+			case TAG_TIMESTAMP:
+				{
+				int64_t ns;
+
+				if ( ! GetSigned(&ns) )
+					return false;
+
+				*d = broker::data{broker::timestamp{broker::timespan{ns}}};
+				return true;
+				}
+
+			case TAG_TIMESPAN:
+				{
+				int64_t ns;
+
+				if ( ! GetSigned(&ns) )
+					return false;
+
+				*d = broker::data{broker::timespan{ns}};
+				return true;
+				}
+
+			case TAG_ENUM:
+				{
+				std::string name;
+
+				if ( ! GetString(&name) )
+					return false;
+
+				*d = broker::data{broker::enum_value{std::move(name)}};
+				return true;
+				}
+
+			case TAG_SET:
+				{
+				uint64_t n;
+
+				if ( ! GetVarint(&n) )
+					return false;
+
+				broker::set s;
+
+				for ( uint64_t i = 0; i < n; ++i )
+					{
+					broker::data e;
+
+					if ( ! Read(&e, depth + 1) )
+						return false;
+
+					s.insert(std::move(e));
+					}
+
+				*d = broker::data{std::move(s)};
+				return true;
+				}
+
+			case TAG_TABLE:
+				{
+				uint64_t n;
+
+				if ( ! GetVarint(&n) )
+					return false;
+
+				broker::table t;
+
+				for ( uint64_t i = 0; i < n; ++i )
+					{
+					broker::data k;
+					broker::data v;
+
+					if ( ! Read(&k, depth + 1) || ! Read(&v, depth + 1) )
+						return false;
+
+					t.emplace(std::move(k), std::move(v));
+					}
+
+				*d = broker::data{std::move(t)};
+				return true;
+				}
+
+			case TAG_VECTOR:
+				{
+				uint64_t n;
+
+				// Each element takes at least a byte.
+				if ( ! GetVarint(&n) || n > static_cast<uint64_t>(end - pos) )
+					return false;
+
+				broker::vector v;
+				v.reserve(n);
+
+				for ( uint64_t i = 0; i < n; ++i )
+					{
+					broker::data e;
+
+					if ( ! Read(&e, depth + 1) )
+						return false;
+
+					v.emplace_back(std::move(e));
+					}
+
+				*d = broker::data{std::move(v)};
+				return true;
+				}
+
+			default:
+				return false;
+			}
+		}
+
+private:
+	bool GetByte(uint8_t* b)
+		{
+		if ( pos == end )
+			return false;
+
+		*b = static_cast<uint8_t>(*pos++);
+		return true;
+		}
+
+	bool GetVarint(uint64_t* v)
+		{
+		*v = 0;
+
+		for ( int shift = 0; shift < 64; shift += 7 )
+			{
+			uint8_t b;
+
+			if ( ! GetByte(&b) )
+				return false;
+
+			*v |= uint64_t(b & 0x7f) << shift;
+
+			if ( ! (b & 0x80) )
+				return true;
+			}
+
+		return false;
+		}
+
+	bool GetSigned(int64_t* v)
+		{
+		uint64_t u;
+
+		if ( ! GetVarint(&u) )
+			return false;
+
+		*v = static_cast<int64_t>((u >> 1) ^ (~(u & 1) + 1));
+		return true;
+		}
+
+	bool GetString(std::string* s)
+		{
+		uint64_t len;
+
+		if ( ! GetVarint(&len) || len > static_cast<uint64_t>(end - pos) )
+			return false;
+
+		s->assign(pos, len);
+		pos += len;
+		return true;
+		}
+
+	bool GetAddress(broker::address* a)
+		{
+		if ( end - pos < 16 )
+			return false;
+
+		uint32_t bytes[4];
+		memcpy(bytes, pos, sizeof(bytes));
+		pos += sizeof(bytes);
+		*a = broker::address(bytes, broker::address::family::ipv6,
+		                     broker::address::byte_order::network);
+		return true;
+		}
+
+	const char* pos;
+	const char* end;
+	};
+
+	} // namespace
+
+std::string encode_data(const broker::data& d)
+	{
+	std::string rval;
+	visit(data_writer{rval}, d);
+	return rval;
+	}
+
+std::optional<broker::data> decode_data(const std::string& s)
+	{
+	DataReader reader(s);
+	broker::data rval;
+
+	if ( ! reader.Read(&rval) || ! reader.AtEnd() )
+		return std::nullopt;
+
+	return rval;
+	}
+
+bool batch_compression_available()
+	{
+#ifdef HAVE_ZSTD
+	return true;
+#else
+	return false;
+#endif
+	}
+
+std::optional<broker::data> compress_batch(const broker::vector& msgs, int level,
+                                           size_t* raw_size, size_t* compressed_size)
+	{
+#ifdef HAVE_ZSTD
+	std::string raw;
+	data_writer writer{raw};
+	writer(msgs);
+
+	std::string compressed(ZSTD_compressBound(raw.size()), '\0');
+	auto n = ZSTD_compress(compressed.data(), compressed.size(), raw.data(), raw.size(), level);
+
+	if ( ZSTD_isError(n) )
+		return std::nullopt;
+
+	compressed.resize(n);
+	*raw_size = raw.size();
+	*compressed_size = n;
+
+	broker::vector elem{broker::enum_value{compressed_batch_tag}, std::move(compressed)};
+	broker::vector batch;
+	batch.emplace_back(std::move(elem));
+	broker::zeek::Batch msg(std::move(batch));
+	return msg.move_data();
+#else
+	return std::nullopt;
+#endif
+	}
+
+bool is_compressed_batch(const broker::vector& batch)
+	{
+	if ( batch.size() != 1 )
+		return false;
+
+	auto elem = broker::get_if<broker::vector>(&batch[0]);
+
+	if ( ! elem || elem->size() != 2 || ! broker::is<std::string>((*elem)[1]) )
+		return false;
+
+	auto tag = broker::get_if<broker::enum_value>(&(*elem)[0]);
+	return tag && tag->name == compressed_batch_tag;
+	}
+
+std::optional<broker::vector> decompress_batch(const broker::vector& batch)
+	{
+#ifdef HAVE_ZSTD
+	const auto& compressed = broker::get<std::string>(broker::get<broker::vector>(batch[0])[1]);
+	auto size = ZSTD_getFrameContentSize(compressed.data(), compressed.size());
+
+	if ( size == ZSTD_CONTENTSIZE_ERROR || size == ZSTD_CONTENTSIZE_UNKNOWN ||
+	     size > max_decompressed_size )
+		return std::nullopt;
+
+	std::string raw(size, '\0');
+	auto n = ZSTD_decompress(raw.data(), raw.size(), compressed.data(), compressed.size());
+
+	if ( ZSTD_isError(n) || n != size )
+		return std::nullopt;
+
+	auto msgs = decode_data(raw);
+
+	if ( ! msgs || ! broker::is<broker::vector>(*msgs) )
+		return std::nullopt;
+
+	return std::move(broker::get<broker::vector>(*msgs));
+#else
+	return std::nullopt;
+#endif
+	}
+
+TEST_SUITE_BEGIN("BatchCompression");
+
+TEST_CASE("broker data encoding round trip")
+	{
+	broker::table t;
+	t.emplace(broker::data{"key"}, broker::data{broker::count{42}});
+
+	broker::vector v{broker::data{},
+	                 true,
+	                 broker::count{1} << 40,
+	                 broker::integer{-12345},
+	                 3.25,
+	                 std::string("a string"),
+	                 broker::address(),
+	                 broker::port(443, broker::port::protocol::tcp),
+	                 broker::timestamp{broker::timespan{1234567890}},
+	                 broker::timespan{-5},
+	                 broker::enum_value{"Conn::LOG"},
+	                 broker::set{broker::data{"x"}, broker::data{"y"}},
+	                 std::move(t)};
+
+	broker::data d{v};
+	auto decoded = decode_data(encode_data(d));
+	REQUIRE(decoded);
+	CHECK(*decoded == d);
+
+	auto encoded = encode_data(d);
+	encoded.pop_back();
+	CHECK_FALSE(decode_data(encoded));
+	CHECK_FALSE(decode_data(encode_data(d) + "x"));
+	}
+
+TEST_CASE("batch compression round trip")
+	{
+	if ( ! batch_compression_available() )
+		return;
+
+	broker::vector msgs;
+
+	for ( int i = 0; i < 100; ++i )
+		msgs.emplace_back(broker::vector{std::string("conn"), broker::count(i)});
+
+	size_t raw_size = 0;
+	size_t compressed_size = 0;
+	auto batch = compress_batch(msgs, 3, &raw_size, &compressed_size);
+	REQUIRE(batch);
+	CHECK(compressed_size < raw_size);
+
+	broker::zeek::Batch received(std::move(*batch));
+	REQUIRE(received.valid());
+	REQUIRE(is_compressed_batch(received.batch()));
+
+	auto decompressed = decompress_batch(received.batch());
+	REQUIRE(decompressed);
+	CHECK(*decompressed == msgs);
+	CHECK_FALSE(is_compressed_batch(msgs));
+	}
+
+TEST_SUITE_END();
+
+	} // namespace zeek::Broker::detail
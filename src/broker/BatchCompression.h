@@ -0,0 +1,66 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <broker/data.hh>
+#include <cstddef>
+#include <optional>
+#include <string>
+
+namespace zeek::Broker::detail
+	{
+
+/**
+ * Encodes Broker data into a compact binary form of Zeek's own, which
+ * decode_data() turns back into the same data.
+ */
+std::string encode_data(const broker::data& d);
+
+/**
+ * Decodes data encoded by encode_data().
+ *
+ * @return The data, or nothing if the encoding is malformed.
+ */
+std::optional<broker::data> decode_data(const std::string& s);
+
+/**
+ * Returns true if this build of Zeek can compress batches, which requires
+ * zstd.
+ */
+bool batch_compression_available();
+
+/**
+ * Compresses the messages of a batch with zstd, see
+ * Broker::batch_compression. The result is a broker::zeek::Batch holding a
+ * single element with the compressed messages, which only Zeek nodes of the
+ * same version understand.
+ *
+ * @param msgs The messages to compress.
+ *
+ * @param level The zstd compression level.
+ *
+ * @param raw_size Receives the size of the messages before compression.
+ *
+ * @param compressed_size Receives the size after compression.
+ *
+ * @return The batch to send instead, or nothing if compression isn't
+ * available or failed.
+ */
+std::optional<broker::data> compress_batch(const broker::vector& msgs, int level,
+                                           size_t* raw_size, size_t* compressed_size);
+
+/**
+ * Returns true if a batch's elements are compressed messages, as made by
+ * compress_batch().
+ */
+bool is_compressed_batch(const broker::vector& batch);
+
+/**
+ * Decompresses the messages of a compressed batch.
+ *
+ * @return The messages, or nothing if the batch is malformed or this build
+ * can't decompress it.
+ */
+std::optional<broker::vector> decompress_batch(const broker::vector& batch);
+
+	} // namespace zeek::Broker::detail
@@ -4,6 +4,7 @@
 #include <broker/configuration.hh>
 #include <broker/zeek.hh>
 #include <unistd.h>
+#include <algorithm>
 #include <cstdio>
 #include <cstring>
 
@@ -15,8 +16,10 @@
 #include "zeek/RunState.h"
 #include "zeek/SerializationFormat.h"
 #include "zeek/Var.h"
+#include "zeek/broker/BatchCompression.h"
 #include "zeek/broker/Data.h"
 #include "zeek/broker/Store.h"
+#include "zeek/broker/ValWire.h"
 #include "zeek/broker/comm.bif.h"
 #include "zeek/broker/data.bif.h"
 #include "zeek/broker/messaging.bif.h"
@@ -253,6 +256,41 @@ void Manager::InitPostScript()
 	DBG_LOG(DBG_BROKER, "Initializing");
 
 	log_batch_size = get_option("Broker::log_batch_size")->AsCount();
+	event_batch_size = get_option("Broker::event_batch_size")->AsCount();
+
+	if ( event_batch_size == 0 )
+		event_batch_size = 1;
+
+	event_batch_interval = get_option("Broker::event_batch_interval")->AsInterval();
+	wire_events = get_option("Broker::wire_events")->AsBool();
+	table_import_chunk_size = get_option("Broker::table_import_chunk_size")->AsCount();
+	batch_compression_level = get_option("Broker::batch_compression_level")->AsInt();
+
+	auto batch_compression = get_option("Broker::batch_compression")->AsString()->ToStdString();
+
+	if ( batch_compression == "zstd" )
+		{
+		if ( detail::batch_compression_available() )
+			compress_batches = true;
+		else
+			reporter->Error("Broker::batch_compression: zstd not available in this build");
+		}
+
+	else if ( batch_compression != "none" )
+		reporter->Error("Broker::batch_compression: unknown compression '%s'",
+		                batch_compression.c_str());
+
+	inbound_high_watermark = get_option("Broker::inbound_queue_high_watermark")->AsCount();
+	inbound_low_watermark = get_option("Broker::inbound_queue_low_watermark")->AsCount();
+
+	auto policy = get_option("Broker::inbound_overload_policy")->AsString()->ToStdString();
+
+	if ( policy == "drop_events" )
+		inbound_overload_policy = OverloadPolicy::DropEvents;
+	else if ( policy == "drop_logs" )
+		inbound_overload_policy = OverloadPolicy::DropLogs;
+	else if ( policy != "none" )
+		reporter->Error("Broker::inbound_overload_policy: unknown policy '%s'", policy.c_str());
 	default_log_topic_prefix =
 		get_option("Broker::default_log_topic_prefix")->AsString()->CheckString();
 	log_topic_func = get_option("Broker::log_topic")->AsFunc();
@@ -460,6 +498,7 @@ void Manager::InitializeBrokerStoreForwarding()
 
 void Manager::Terminate()
 	{
+	FlushEventBuffers();
 	FlushLogBuffers();
 
 	iosource_mgr->UnregisterFd(bstate->subscriber.fd(), this);
@@ -605,6 +644,7 @@ void Manager::Unpeer(const string& addr, uint16_t port)
 
 	DBG_LOG(DBG_BROKER, "Stopping to peer with %s:%" PRIu16, addr.c_str(), port);
 
+	FlushEventBuffers();
 	FlushLogBuffers();
 	bstate->endpoint.unpeer_nosync(addr, port);
 	}
@@ -632,8 +672,27 @@ bool Manager::PublishEvent(string topic, std::string name, broker::vector args)
 
 	DBG_LOG(DBG_BROKER, "Publishing event: %s", RenderEvent(topic, name, args).c_str());
 	broker::zeek::Event ev(std::move(name), std::move(args));
-	bstate->endpoint.publish(move(topic), ev.move_data());
 	++statistics.num_events_outgoing;
+
+	if ( event_batch_size == 1 )
+		{
+		bstate->endpoint.publish(move(topic), ev.move_data());
+		return true;
+		}
+
+	// Events to the same topic accumulate into one message, which the
+	// receiving side unpacks like a batch of log writes.
+	auto& eb = event_buffers[topic];
+
+	if ( eb.events.empty() )
+		eb.oldest = util::current_time();
+
+	eb.events.emplace_back(ev.move_data());
+	++pending_events;
+
+	if ( eb.events.size() >= event_batch_size )
+		pending_events -= eb.Flush(bstate->endpoint, topic);
+
 	return true;
 	}
 
@@ -663,6 +722,184 @@ bool Manager::PublishEvent(string topic, RecordVal* args)
 	return PublishEvent(std::move(topic), event_name, std::move(xs));
 	}
 
+bool Manager::PublishEvent(string topic, ValPList* args, zeek::detail::Frame* frame)
+	{
+	scoped_reporter_location srl{frame};
+
+	if ( args->length() < 1 || (*args)[0]->GetType()->Tag() != TYPE_FUNC )
+		{
+		Error("attempt to convert non-event into an event type");
+		return false;
+		}
+
+	auto func = (*args)[0]->AsFunc();
+
+	if ( func->Flavor() != FUNC_FLAVOR_EVENT )
+		{
+		Error("attempt to convert non-event into an event type");
+		return false;
+		}
+
+	const auto& types = func->GetType()->ParamList()->GetTypes();
+
+	if ( static_cast<int>(types.size()) != args->length() - 1 )
+		{
+		Error("bad # of arguments: got %d, expect %zu", args->length(), types.size() + 1);
+		return false;
+		}
+
+	for ( auto i = 1; i < args->length(); ++i )
+		{
+		const auto& got_type = (*args)[i]->GetType();
+		const auto& expected_type = types[i - 1];
+
+		if ( ! same_type(got_type, expected_type) )
+			{
+			Error("event parameter #%d type mismatch, got %s, expect %s", i,
+			      type_name(got_type->Tag()), type_name(expected_type->Tag()));
+			return false;
+			}
+		}
+
+	if ( bstate->endpoint.is_shutdown() )
+		return true;
+
+	// Nobody to send to, so don't bother converting the arguments.
+	if ( peer_count == 0 )
+		return true;
+
+	broker::vector xs;
+	xs.reserve(args->length() - 1);
+
+	for ( auto i = 1; i < args->length(); ++i )
+		{
+		auto arg = (*args)[i];
+
+		// Arguments that already are Broker data go along as they are.
+		if ( same_type(arg->GetType(), detail::DataVal::ScriptDataType()) )
+			{
+			const auto& val = arg->AsRecordVal()->GetField(0);
+
+			if ( val )
+				{
+				xs.emplace_back(static_cast<detail::DataVal*>(val.get())->data);
+				continue;
+				}
+			}
+		else if ( auto data = detail::val_to_data(arg) )
+			{
+			xs.emplace_back(std::move(*data));
+			continue;
+			}
+
+		Error("failed to convert param #%d of type %s to broker data", i,
+		      type_name(arg->GetType()->Tag()));
+		return false;
+		}
+
+	return PublishEvent(std::move(topic), func->Name(), std::move(xs));
+	}
+
+StringValPtr Manager::HRWTopic(RecordVal* pool, Val* key)
+	{
+	static int hrw_pool_off = -1;
+	static int sites_off;
+	static int site_id_off;
+	static int user_data_off;
+	static int name_off;
+
+	if ( hrw_pool_off < 0 )
+		{
+		hrw_pool_off = id::find_type<RecordType>("Cluster::Pool")->FieldOffset("hrw_pool");
+		sites_off = id::find_type<RecordType>("HashHRW::Pool")->FieldOffset("sites");
+		const auto& site_type = id::find_type<RecordType>("HashHRW::Site");
+		site_id_off = site_type->FieldOffset("id");
+		user_data_off = site_type->FieldOffset("user_data");
+		name_off = id::find_type<RecordType>("Cluster::PoolNode")->FieldOffset("name");
+		}
+
+	auto hrw_pool = pool->GetFieldOrDefault(hrw_pool_off);
+	auto sites = hrw_pool->AsRecordVal()->GetFieldOrDefault(sites_off);
+
+	// The same as HashHRW::get_site() with fnv1a32() and hrw_weight().
+	ODesc desc(DESC_BINARY);
+	key->Describe(&desc);
+
+	uint32_t digest = 2166136261;
+
+	for ( int i = 0; i < desc.Len(); ++i )
+		{
+		digest ^= desc.Bytes()[i];
+		digest *= 16777619;
+		}
+
+	digest &= 0x7fffffff;
+
+	const RecordVal* best_site = nullptr;
+	zeek_uint_t best_site_id = 0;
+	int64_t best_weight = -1;
+
+	for ( const auto& te : *sites->AsTable() )
+		{
+		auto site = te.value->GetVal()->AsRecordVal();
+		auto site_id = site->GetFieldAs<CountVal>(site_id_off);
+		uint32_t si = site_id;
+		int64_t w = (1103515245u * ((1103515245u * si + 12345u) ^ digest) + 12345u) % 2147483648u;
+
+		if ( w > best_weight || (w == best_weight && site_id > best_site_id) )
+			{
+			best_site = site;
+			best_site_id = site_id;
+			best_weight = w;
+			}
+		}
+
+	if ( ! best_site )
+		return val_mgr->EmptyString();
+
+	auto node = best_site->GetField(user_data_off)->AsRecordVal();
+	auto& topic = node_topics[node->GetFieldAs<StringVal>(name_off)->CheckString()];
+
+	if ( ! topic )
+		{
+		static auto node_topic = id::find_func("Cluster::node_topic");
+		Args vl{node->GetField(name_off)};
+		topic = cast_intrusive<StringVal>(node_topic->Invoke(&vl));
+		}
+
+	return topic;
+	}
+
+bool Manager::PublishWireEvent(std::string topic, ValPList* args)
+	{
+	if ( bstate->endpoint.is_shutdown() )
+		return true;
+
+	if ( peer_count == 0 )
+		return true;
+
+	if ( args->length() < 1 || (*args)[0]->GetType()->Tag() != TYPE_FUNC )
+		return false;
+
+	auto func = (*args)[0]->AsFunc();
+
+	if ( func->Flavor() != FUNC_FLAVOR_EVENT )
+		return false;
+
+	Args vl;
+	vl.reserve(args->length() - 1);
+
+	for ( auto i = 1; i < args->length(); ++i )
+		vl.emplace_back(NewRef{}, (*args)[i]);
+
+	auto xs = detail::encode_event_args(func->GetType()->ParamList()->GetTypes(), vl);
+
+	if ( ! xs )
+		return false;
+
+	return PublishEvent(std::move(topic), func->Name(), std::move(*xs));
+	}
+
 bool Manager::PublishIdentifier(std::string topic, std::string id)
 	{
 	if ( bstate->endpoint.is_shutdown() )
@@ -781,35 +1018,6 @@ bool Manager::PublishLogWrite(EnumVal* stream, EnumVal* writer, string path, int
 		return false;
 		}
 
-	zeek::detail::BinarySerializationFormat fmt;
-	char* data;
-	int len;
-
-	fmt.StartWrite();
-
-	bool success = fmt.Write(num_fields, "num_fields");
-
-	if ( ! success )
-		{
-		reporter->Error("Failed to remotely log stream %s: num_fields serialization failed",
-		                stream_id);
-		return false;
-		}
-
-	for ( int i = 0; i < num_fields; ++i )
-		{
-		if ( ! vals[i]->Write(&fmt) )
-			{
-			reporter->Error("Failed to remotely log stream %s: field %d serialization failed",
-			                stream_id, i);
-			return false;
-			}
-		}
-
-	len = fmt.EndWrite(&data);
-	std::string serial_data(data, len);
-	free(data);
-
 	auto v = log_topic_func->Invoke(IntrusivePtr{NewRef{}, stream},
 	                                make_intrusive<StringVal>(path));
 
@@ -823,19 +1031,26 @@ bool Manager::PublishLogWrite(EnumVal* stream, EnumVal* writer, string path, int
 
 	std::string topic = v->AsString()->CheckString();
 
-	auto bstream_id = broker::enum_value(move(stream_id));
-	auto bwriter_id = broker::enum_value(move(writer_id));
-	broker::zeek::LogWrite msg(move(bstream_id), move(bwriter_id), move(path), move(serial_data));
-
-	DBG_LOG(DBG_BROKER, "Buffering log record: %s", RenderMessage(topic, msg.as_data()).c_str());
+	DBG_LOG(DBG_BROKER, "Buffering log record for %s at path %s", stream_id, path.data());
 
 	if ( log_buffers.size() <= (unsigned int)stream_id_num )
 		log_buffers.resize(stream_id_num + 1);
 
+	// Entries for the same writer and path accumulate into one message,
+	// which the receiving side decodes straight into the writer's batch.
 	auto& lb = log_buffers[stream_id_num];
+	lb.stream_id = stream_id;
 	++lb.message_count;
-	auto& pending_batch = lb.msgs[topic];
-	pending_batch.emplace_back(msg.move_data());
+
+	auto& writes = lb.writes[topic][std::make_pair(std::string(writer_id), path)];
+
+	if ( writes.writer_id.empty() )
+		{
+		writes.writer_id = writer_id;
+		writes.path = path;
+		}
+
+	writes.entries.AddEntry(num_fields, vals);
 
 	if ( lb.message_count >= log_batch_size )
 		statistics.num_logs_outgoing += lb.Flush(bstate->endpoint, log_batch_size);
@@ -852,15 +1067,28 @@ size_t Manager::LogBuffer::Flush(broker::endpoint& endpoint, size_t log_batch_si
 		// No logs buffered for this stream.
 		return 0;
 
-	for ( auto& kv : msgs )
+	for ( auto& kv : writes )
 		{
 		auto& topic = kv.first;
-		auto& pending_batch = kv.second;
 		broker::vector batch;
-		batch.reserve(log_batch_size + 1);
-		pending_batch.swap(batch);
-		broker::zeek::Batch msg(std::move(batch));
-		endpoint.publish(topic, msg.move_data());
+
+		for ( auto& wkv : kv.second )
+			{
+			auto& pending = wkv.second;
+
+			if ( ! pending.entries.Entries() )
+				continue;
+
+			broker::zeek::LogWrite msg(broker::enum_value(stream_id),
+			                           broker::enum_value(pending.writer_id), pending.path,
+			                           pending.entries.Finish());
+			batch.emplace_back(msg.move_data());
+			}
+
+		if ( batch.empty() )
+			continue;
+
+		endpoint.publish(topic, broker_mgr->MakeBatch(topic, std::move(batch)));
 		}
 
 	auto rval = message_count;
@@ -880,6 +1108,129 @@ size_t Manager::FlushLogBuffers()
 	return rval;
 	}
 
+broker::data Manager::MakeBatch(const std::string& topic, broker::vector msgs)
+	{
+	if ( compress_batches )
+		{
+		auto start = util::curr_CPU_time();
+		size_t raw_size;
+		size_t compressed_size;
+		auto batch = detail::compress_batch(msgs, batch_compression_level, &raw_size,
+		                                    &compressed_size);
+
+		if ( batch )
+			{
+			auto it = compression_stats.find(topic);
+
+			if ( it == compression_stats.end() )
+				{
+				auto bytes = telemetry_mgr->CounterFamily(
+					"zeek", "broker-batch-bytes", {"topic", "stage"},
+					"Bytes of batches published to a topic, before and after compression", "1",
+					true);
+				auto seconds = telemetry_mgr->CounterInstance<double>(
+					"zeek", "broker-batch-compression-seconds", {{"topic", topic}},
+					"CPU time spent compressing batches published to a topic", "seconds", true);
+
+				CompressionStats stats{bytes.GetOrAdd({{"topic", topic}, {"stage", "raw"}}),
+				                       bytes.GetOrAdd({{"topic", topic}, {"stage", "compressed"}}),
+				                       seconds};
+				it = compression_stats.emplace(topic, std::move(stats)).first;
+				}
+
+			it->second.raw_bytes.Inc(raw_size);
+			it->second.compressed_bytes.Inc(compressed_size);
+			it->second.seconds.Inc(util::curr_CPU_time() - start);
+			return std::move(*batch);
+			}
+		}
+
+	broker::zeek::Batch batch(std::move(msgs));
+	return batch.move_data();
+	}
+
+size_t Manager::EventBuffer::Flush(broker::endpoint& endpoint, const std::string& topic)
+	{
+	static constexpr int64_t size_bounds[] = {1, 10, 100, 1000, 10000};
+
+	auto rval = events.size();
+
+	if ( ! rval )
+		return 0;
+
+	if ( ! sizes && telemetry_mgr )
+		sizes = telemetry_mgr->HistogramInstance<int64_t>(
+			"zeek", "broker-event-batch-size", {{"topic", topic}}, size_bounds,
+			"Events per message published to a topic");
+
+	if ( sizes )
+		sizes->Observe(rval);
+
+	if ( endpoint.is_shutdown() )
+		; // Nothing to send them to anymore.
+
+	else if ( rval == 1 )
+		endpoint.publish(topic, std::move(events.front()));
+
+	else
+		endpoint.publish(topic, broker_mgr->MakeBatch(topic, std::move(events)));
+
+	events.clear();
+	return rval;
+	}
+
+size_t Manager::FlushEventBuffers(bool due_only)
+	{
+	if ( ! pending_events )
+		return 0;
+
+	auto now = due_only ? util::current_time() : 0.0;
+	size_t rval = 0;
+
+	for ( auto& [topic, eb] : event_buffers )
+		{
+		if ( due_only && now - eb.oldest < event_batch_interval )
+			continue;
+
+		rval += eb.Flush(bstate->endpoint, topic);
+		}
+
+	pending_events -= rval;
+	return rval;
+	}
+
+size_t Manager::BufferedBytes() const
+	{
+	size_t rval = pending_events * sizeof(broker::data);
+
+	for ( const auto& lb : log_buffers )
+		for ( const auto& [topic, writes] : lb.writes )
+			for ( const auto& [key, w] : writes )
+				rval += w.entries.Bytes();
+
+	return rval;
+	}
+
+double Manager::GetNextTimeout()
+	{
+	// Table imports continue with each run-loop iteration.
+	if ( pending_imports )
+		return 0;
+
+	// With no interval, the run loop sends the batches when it's done
+	// with the current iteration anyway.
+	if ( ! pending_events || event_batch_interval <= 0 )
+		return -1;
+
+	auto oldest = -1.0;
+
+	for ( const auto& [topic, eb] : event_buffers )
+		if ( ! eb.events.empty() && (oldest < 0 || eb.oldest < oldest) )
+			oldest = eb.oldest;
+
+	return std::max(oldest + event_batch_interval - util::current_time(), 0.0);
+	}
+
 void Manager::Error(const char* format, ...)
 	{
 	va_list args;
@@ -1079,7 +1430,8 @@ void Manager::DispatchMessage(const broker::topic& topic, broker::data msg)
 			break;
 
 		case broker::zeek::Message::Type::Event:
-			ProcessEvent(topic, std::move(msg));
+			if ( ! DropInbound(broker::zeek::Message::Type::Event) )
+				ProcessEvent(topic, std::move(msg));
 			break;
 
 		case broker::zeek::Message::Type::LogCreate:
@@ -1087,7 +1439,8 @@ void Manager::DispatchMessage(const broker::topic& topic, broker::data msg)
 			break;
 
 		case broker::zeek::Message::Type::LogWrite:
-			ProcessLogWrite(std::move(msg));
+			if ( ! DropInbound(broker::zeek::Message::Type::LogWrite) )
+				ProcessLogWrite(std::move(msg));
 			break;
 
 		case broker::zeek::Message::Type::IdentifierUpdate:
@@ -1105,6 +1458,22 @@ void Manager::DispatchMessage(const broker::topic& topic, broker::data msg)
 				return;
 				}
 
+			if ( detail::is_compressed_batch(batch.batch()) )
+				{
+				auto msgs = detail::decompress_batch(batch.batch());
+
+				if ( ! msgs )
+					{
+					reporter->Warning("received broker Batch that failed to decompress");
+					return;
+					}
+
+				for ( auto& i : *msgs )
+					DispatchMessage(topic, std::move(i));
+
+				break;
+				}
+
 			for ( auto& i : batch.batch() )
 				DispatchMessage(topic, std::move(i));
 
@@ -1119,6 +1488,72 @@ void Manager::DispatchMessage(const broker::topic& topic, broker::data msg)
 		}
 	}
 
+void Manager::CheckInboundLoad(size_t depth)
+	{
+	if ( telemetry_mgr )
+		{
+		if ( ! inbound_depth_gauge )
+			inbound_depth_gauge = telemetry_mgr->GaugeSingleton(
+				"zeek", "broker-inbound-queue-depth",
+				"Received Broker messages waiting to be processed");
+
+		inbound_depth_gauge->Inc(static_cast<int64_t>(depth) - inbound_depth);
+		}
+
+	inbound_depth = depth;
+
+	if ( ! inbound_high_watermark )
+		return;
+
+	if ( ! inbound_overloaded && depth >= inbound_high_watermark )
+		{
+		inbound_overloaded = true;
+
+		if ( ::Broker::inbound_queue_high )
+			event_mgr.Enqueue(::Broker::inbound_queue_high, val_mgr->Count(depth));
+		}
+
+	else if ( inbound_overloaded && depth <= inbound_low_watermark )
+		{
+		inbound_overloaded = false;
+
+		if ( ::Broker::inbound_queue_low )
+			event_mgr.Enqueue(::Broker::inbound_queue_low, val_mgr->Count(depth));
+		}
+	}
+
+bool Manager::DropInbound(broker::zeek::Message::Type type)
+	{
+	if ( ! inbound_overloaded )
+		return false;
+
+	switch ( inbound_overload_policy )
+		{
+		case OverloadPolicy::DropEvents:
+			if ( type != broker::zeek::Message::Type::Event )
+				return false;
+			break;
+
+		case OverloadPolicy::DropLogs:
+			if ( type != broker::zeek::Message::Type::LogWrite )
+				return false;
+			break;
+
+		default:
+			return false;
+		}
+
+	if ( ! inbound_dropped && telemetry_mgr )
+		inbound_dropped = telemetry_mgr->CounterSingleton(
+			"zeek", "broker-inbound-dropped", "Received Broker messages dropped while overloaded",
+			"1", true);
+
+	if ( inbound_dropped )
+		inbound_dropped->Inc();
+
+	return true;
+	}
+
 void Manager::Process()
 	{
 	// Ensure that time gets update before processing broker messages, or events
@@ -1126,10 +1561,15 @@ void Manager::Process()
 	if ( use_real_time )
 		run_state::detail::update_network_time(util::current_time());
 
+	if ( pending_imports )
+		ContinueTableImports();
+
 	auto messages = bstate->subscriber.poll();
 
 	bool had_input = ! messages.empty();
 
+	CheckInboundLoad(messages.size());
+
 	for ( auto& message : messages )
 		{
 		auto& topic = broker::get_topic(message);
@@ -1280,6 +1720,12 @@ void Manager::ProcessStoreEvent(broker::data msg)
 		if ( ! storehandle )
 			return;
 
+		if ( storehandle->cache )
+			storehandle->cache->Update(insert.key(), insert.value());
+
+		if ( storehandle->import )
+			storehandle->import->touched.emplace(insert.key());
+
 		const auto& table = storehandle->forward_to;
 		if ( ! table )
 			return;
@@ -1297,6 +1743,12 @@ void Manager::ProcessStoreEvent(broker::data msg)
 		if ( ! storehandle )
 			return;
 
+		if ( storehandle->cache )
+			storehandle->cache->Update(update.key(), update.new_value());
+
+		if ( storehandle->import )
+			storehandle->import->touched.emplace(update.key());
+
 		const auto& table = storehandle->forward_to;
 		if ( ! table )
 			return;
@@ -1314,6 +1766,12 @@ void Manager::ProcessStoreEvent(broker::data msg)
 		if ( ! storehandle )
 			return;
 
+		if ( storehandle->cache )
+			storehandle->cache->Update(erase.key(), std::nullopt);
+
+		if ( storehandle->import )
+			storehandle->import->touched.emplace(erase.key());
+
 		auto table = storehandle->forward_to;
 		if ( ! table )
 			return;
@@ -1341,14 +1799,16 @@ void Manager::ProcessStoreEvent(broker::data msg)
 		}
 	else if ( auto expire = broker::store_event::expire::make(msg) )
 		{
-			// We just ignore expiries - expiring information on the Zeek side is handled by Zeek
-			// itself.
-#ifdef DEBUG
-		// let's only debug log for stores that we know.
 		auto storehandle = broker_mgr->LookupStore(expire.store_id());
 		if ( ! storehandle )
 			return;
 
+		// Other than for the cache, we just ignore expiries - expiring information on the Zeek
+		// side is handled by Zeek itself.
+		if ( storehandle->cache )
+			storehandle->cache->Update(expire.key(), std::nullopt);
+
+#ifdef DEBUG
 		auto table = storehandle->forward_to;
 		if ( ! table )
 			return;
@@ -1399,6 +1859,20 @@ void Manager::ProcessEvent(const broker::topic& topic, broker::zeek::Event ev)
 
 	const auto& arg_types = handler->GetType(false)->ParamList()->GetTypes();
 
+	if ( detail::is_wire_event_args(args) )
+		{
+		Args vl;
+
+		if ( ! detail::decode_event_args(args, arg_types, &vl) )
+			{
+			reporter->Warning("failed to decode remote event '%s'", name.data());
+			return;
+			}
+
+		event_mgr.Enqueue(handler, std::move(vl), util::detail::SOURCE_BROKER);
+		return;
+		}
+
 	if ( arg_types.size() != args.size() )
 		{
 		reporter->Warning("got event message '%s' with invalid # of args,"
@@ -1577,6 +2051,25 @@ bool Manager::ProcessLogWrite(broker::zeek::LogWrite lw)
 		return false;
 		}
 
+	if ( logging::LogWireReader::IsWireFormat(*serial_data) )
+		{
+		logging::LogWireReader entries(*serial_data);
+
+		if ( ! entries.Valid() )
+			{
+			reporter->Warning("failed to unpack remote log entries for stream: %s",
+			                  stream_id_name.data());
+			return false;
+			}
+
+		// The message was already counted once.
+		if ( entries.Entries() > 1 )
+			statistics.num_logs_incoming += entries.Entries() - 1;
+
+		return log_mgr->WriteFromRemote(stream_id->AsEnumVal(), writer_id->AsEnumVal(),
+		                                *path, &entries);
+		}
+
 	zeek::detail::BinarySerializationFormat fmt;
 	fmt.StartRead(serial_data->data(), serial_data->size());
 
@@ -1784,6 +2277,17 @@ void Manager::ProcessStoreResponse(detail::StoreHandleVal* s, broker::store::res
 		return;
 		}
 
+	if ( const auto& key = request->second->CacheKey(); key && s->cache )
+		{
+		s->cache->EndFetch(*key);
+
+		// Even if the query timed out, the answer is good for the cache.
+		if ( response.answer )
+			s->cache->Fill(*key, *response.answer, request->second->CacheEpoch());
+		else if ( response.answer.error() == broker::ec::no_such_key )
+			s->cache->Fill(*key, std::nullopt, request->second->CacheEpoch());
+		}
+
 	if ( request->second->Disabled() )
 		{
 		// Trigger timer must have timed the query out already.
@@ -1876,7 +2380,7 @@ detail::StoreHandleVal* Manager::MakeMaster(const string& name, broker::backend
 	return handle;
 	}
 
-void Manager::BrokerStoreToZeekTable(const std::string& name, const detail::StoreHandleVal* handle)
+void Manager::BrokerStoreToZeekTable(const std::string& name, detail::StoreHandleVal* handle)
 	{
 	if ( ! handle->forward_to )
 		return;
@@ -1886,15 +2390,47 @@ void Manager::BrokerStoreToZeekTable(const std::string& name, const detail::Stor
 		return;
 
 	auto set = get_if<broker::set>(&(keys->get_data()));
+	if ( ! set || set->empty() )
+		return;
+
+	if ( ! handle->import )
+		++pending_imports;
+
+	handle->import = std::make_unique<detail::TableImport>();
+	handle->import->keys.reserve(set->size());
+
+	for ( auto& key : *set )
+		handle->import->keys.emplace_back(key);
+
+	ContinueTableImport(name, handle,
+	                    table_import_chunk_size ? table_import_chunk_size : set->size());
+	}
+
+void Manager::ContinueTableImport(const std::string& name, detail::StoreHandleVal* handle,
+                                  size_t max_keys)
+	{
+	auto& import = *handle->import;
 	auto table = handle->forward_to;
 	const auto& its = table->GetType()->AsTableType()->GetIndexTypes();
 	bool is_set = table->GetType()->IsSet();
 
+	auto finish = [this, handle]()
+	{
+		handle->import.reset();
+		--pending_imports;
+	};
+
 	// disable &on_change notifications while filling the table.
 	table->DisableChangeNotifications();
 
-	for ( const auto& key : *set )
+	for ( size_t n = 0; n < max_keys && import.next < import.keys.size(); ++n )
 		{
+		const auto& key = import.keys[import.next++];
+
+		// Store events brought the key up to date already.
+		if ( import.touched.count(key) )
+			continue;
+
 		ValPtr zeek_key;
 		if ( its.size() == 1 )
 			zeek_key = detail::data_to_val(key, its[0].get());
@@ -1909,22 +2445,28 @@ void Manager::BrokerStoreToZeekTable(const std::string& name, const detail::Stor
 			                to_string(key).c_str(), name.c_str());
 			// just abort - this probably means the types are incompatible
 			table->EnableChangeNotifications();
+			finish();
 			return;
 			}
 
 		if ( is_set )
 			{
-			table->Assign(zeek_key, nullptr, false);
+			// The key may have gone away since the import started.
+			auto exists = handle->store.exists(key);
+			if ( exists && *exists == broker::data{true} )
+				table->Assign(zeek_key, nullptr, false);
+
 			continue;
 			}
 
 		auto value = handle->store.get(key);
 		if ( ! value )
 			{
-			reporter->Error(
-				"Failed to load value for key %s while importing Broker store %s to table",
-				to_string(key).c_str(), name.c_str());
-			table->EnableChangeNotifications();
+			if ( value.error() != broker::ec::no_such_key )
+				reporter->Error(
+					"Failed to load value for key %s while importing Broker store %s to table",
+					to_string(key).c_str(), name.c_str());
+
 			continue;
 			}
 
@@ -1935,6 +2477,7 @@ void Manager::BrokerStoreToZeekTable(const std::string& name, const detail::Stor
 			                "store %s. Aborting import.",
 			                to_string(value).c_str(), name.c_str());
 			table->EnableChangeNotifications();
+			finish();
 			return;
 			}
 
@@ -1942,7 +2485,16 @@ void Manager::BrokerStoreToZeekTable(const std::string& name, const detail::Stor
 		}
 
 	table->EnableChangeNotifications();
-	return;
+
+	if ( import.next == import.keys.size() )
+		finish();
+	}
+
+void Manager::ContinueTableImports()
+	{
+	for ( auto& [name, handle] : data_stores )
+		if ( handle->import )
+			ContinueTableImport(name, handle, table_import_chunk_size);
 	}
 
 detail::StoreHandleVal* Manager::MakeClone(const string& name, double resync_interval,
@@ -2003,6 +2555,12 @@ bool Manager::CloseStore(const string& name)
 			++i;
 			}
 
+	if ( s->second->import )
+		{
+		s->second->import.reset();
+		--pending_imports;
+		}
+
 	s->second->have_store = false;
 	s->second->store_pid = {};
 	s->second->proxy = {};
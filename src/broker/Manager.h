@@ -9,13 +9,19 @@
 #include <broker/error.hh>
 #include <broker/peer_info.hh>
 #include <broker/zeek.hh>
+#include <map>
 #include <memory>
+#include <optional>
 #include <string>
 #include <unordered_map>
 
 #include "zeek/IntrusivePtr.h"
 #include "zeek/iosource/IOSource.h"
+#include "zeek/logging/LogWire.h"
 #include "zeek/logging/WriterBackend.h"
+#include "zeek/telemetry/Counter.h"
+#include "zeek/telemetry/Gauge.h"
+#include "zeek/telemetry/Histogram.h"
 
 namespace zeek
 	{
@@ -198,6 +204,48 @@ public:
 	 */
 	bool PublishEvent(std::string topic, RecordVal* ev);
 
+	/**
+	 * Send an event to any interested peers, converting its arguments
+	 * straight into Broker data rather than going through a Broker::Event
+	 * record as MakeEvent() makes. Without any peers, the arguments are
+	 * only checked against the event's parameters.
+	 * @param topic a topic string associated with the message.
+	 * @param args the event and its arguments.  The event is always the first
+	 * elements in the list.
+	 * @param frame the calling frame, used to report location info upon error
+	 * @return true if the message is sent successfully.
+	 */
+	bool PublishEvent(std::string topic, ValPList* args, zeek::detail::Frame* frame);
+
+	/**
+	 * Send an event to any interested peers, with its arguments encoded
+	 * straight into the wire format, see Broker::wire_events.
+	 * @param topic a topic string associated with the message.
+	 * @param args the event and its arguments.  The event is always the first
+	 * elements in the list.
+	 * @return true if the message is sent, false if the event or its
+	 * arguments can't go into the wire format. The caller needs to send
+	 * the event the usual way then, which also reports any errors.
+	 */
+	bool PublishWireEvent(std::string topic, ValPList* args);
+
+	/**
+	 * @return true if published events should go out in the wire format,
+	 * see Broker::wire_events.
+	 */
+	bool WireEvents() const { return wire_events; }
+
+	/**
+	 * Picks the node of a cluster pool that a key maps to through
+	 * Rendezvous hashing, with the same result as Cluster::hrw_topic(),
+	 * but without running any script code.
+	 * @param pool a Cluster::Pool record.
+	 * @param key the key to hash.
+	 * @return the node's topic, or an empty string if the pool has no
+	 * nodes.
+	 */
+	StringValPtr HRWTopic(RecordVal* pool, Val* key);
+
 	/**
 	 * Send a message to create a log stream to any interested peers.
 	 * The log stream may or may not already exist on the receiving side.
@@ -359,6 +407,22 @@ public:
 	 */
 	size_t FlushLogBuffers();
 
+	/**
+	 * Send pending event batches.
+	 * @param due_only if true, sends only the batches that have waited for
+	 * Broker::event_batch_interval, as done at the end of each run-loop
+	 * iteration. Otherwise sends all of them.
+	 * @return the number of events sent.
+	 */
+	size_t FlushEventBuffers(bool due_only = false);
+
+	/**
+	 * @return an estimate of the memory taken by log writes and events
+	 * waiting in the buffers to go out, in bytes. Buffered events count
+	 * with a fixed size each.
+	 */
+	size_t BufferedBytes() const;
+
 	/**
 	 * Flushes all pending data store queries and also clears all contents.
 	 */
@@ -421,6 +485,13 @@ private:
 	bool ProcessLogCreate(broker::zeek::LogCreate lc);
 	bool ProcessLogWrite(broker::zeek::LogWrite lw);
 	bool ProcessIdentifierUpdate(broker::zeek::IdentifierUpdate iu);
+	// Raises the watermark events and switches the overload state, given
+	// the number of the received messages that are waiting.
+	void CheckInboundLoad(size_t depth);
+	// Returns true if a received message should be dropped while
+	// overloaded, counting it.
+	bool DropInbound(broker::zeek::Message::Type type);
+
 	void ProcessStatus(broker::status_view stat);
 	void ProcessError(broker::error_view err);
 	void ProcessStoreResponse(detail::StoreHandleVal*, broker::store::response response);
@@ -430,25 +501,69 @@ private:
 	// Check if a Broker store is associated to a table on the Zeek side.
 	void PrepareForwarding(const std::string& name);
 	// Send the content of a Broker store to the backing table. This is typically used
-	// when a master/clone is created.
-	void BrokerStoreToZeekTable(const std::string& name, const detail::StoreHandleVal* handle);
+	// when a master/clone is created. With Broker::table_import_chunk_size set, this
+	// only starts the import, which then continues over the following run-loop
+	// iterations.
+	void BrokerStoreToZeekTable(const std::string& name, detail::StoreHandleVal* handle);
+	// Imports up to the given number of keys into a store's backing table.
+	void ContinueTableImport(const std::string& name, detail::StoreHandleVal* handle,
+	                         size_t max_keys);
+	// Continues all imports in progress by a chunk each.
+	void ContinueTableImports();
 
 	void Error(const char* format, ...) __attribute__((format(printf, 2, 3)));
 
 	// IOSource interface overrides:
 	void Process() override;
 	const char* Tag() override { return "Broker::Manager"; }
-	double GetNextTimeout() override { return -1; }
+	double GetNextTimeout() override;
 
 	struct LogBuffer
 		{
-		// Indexed by topic string.
-		std::unordered_map<std::string, broker::vector> msgs;
+		// The entries for one writer and path that go out as a single
+		// message.
+		struct Writes
+			{
+			std::string writer_id;
+			std::string path;
+			logging::LogWireWriter entries;
+			};
+
+		std::string stream_id;
+
+		// Indexed by topic string, then writer and path.
+		std::map<std::string, std::map<std::pair<std::string, std::string>, Writes>> writes;
 		size_t message_count;
 
 		size_t Flush(broker::endpoint& endpoint, size_t batch_size);
 		};
 
+	// The events published to one topic that go out as a single message.
+	// Per topic, created on first use.
+	struct CompressionStats
+		{
+		telemetry::IntCounter raw_bytes;
+		telemetry::IntCounter compressed_bytes;
+		telemetry::DblCounter seconds;
+		};
+
+	// Makes a batch of messages to publish to a topic, compressed if
+	// Broker::batch_compression says so.
+	broker::data MakeBatch(const std::string& topic, broker::vector msgs);
+
+	struct EventBuffer
+		{
+		broker::vector events;
+
+		// When the oldest of the events was published.
+		double oldest = 0;
+
+		// Created on first use, labeled with the topic.
+		std::optional<telemetry::IntHistogram> sizes;
+
+		size_t Flush(broker::endpoint& endpoint, const std::string& topic);
+		};
+
 	// Data stores
 	using query_id = std::pair<broker::request_id, detail::StoreHandleVal*>;
 
@@ -464,10 +579,14 @@ private:
 		};
 
 	std::vector<LogBuffer> log_buffers; // Indexed by stream ID enum.
+	std::map<std::string, EventBuffer> event_buffers; // Indexed by topic.
+	std::map<std::string, CompressionStats> compression_stats; // Indexed by topic.
+	size_t pending_events = 0;
 	std::string default_log_topic_prefix;
 	std::shared_ptr<BrokerState> bstate;
 	std::unordered_map<std::string, detail::StoreHandleVal*> data_stores;
 	std::unordered_map<std::string, TableValPtr> forwarded_stores;
+	std::unordered_map<std::string, StringValPtr> node_topics; // Indexed by node name.
 	std::unordered_map<query_id, detail::StoreQueryCallback*, query_id_hasher> pending_queries;
 	std::vector<std::string> forwarded_prefixes;
 
@@ -478,6 +597,28 @@ private:
 	int peer_count;
 
 	size_t log_batch_size;
+	size_t event_batch_size = 1;
+	double event_batch_interval = 0;
+	bool wire_events = false;
+	size_t table_import_chunk_size = 0;
+	size_t pending_imports = 0;
+	bool compress_batches = false;
+	int batch_compression_level = 3;
+
+	enum class OverloadPolicy
+		{
+		None,
+		DropEvents,
+		DropLogs,
+		};
+
+	size_t inbound_high_watermark = 0;
+	size_t inbound_low_watermark = 0;
+	OverloadPolicy inbound_overload_policy = OverloadPolicy::None;
+	bool inbound_overloaded = false;
+	int64_t inbound_depth = 0;
+	std::optional<telemetry::IntGauge> inbound_depth_gauge;
+	std::optional<telemetry::IntCounter> inbound_dropped;
 	Func* log_topic_func;
 	VectorTypePtr vector_of_data_type;
 	EnumType* log_id_type;
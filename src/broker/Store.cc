@@ -2,6 +2,7 @@
 
 #include "zeek/Desc.h"
 #include "zeek/ID.h"
+#include "zeek/RunState.h"
 #include "zeek/broker/Manager.h"
 
 zeek::OpaqueTypePtr zeek::Broker::detail::opaque_of_store_handle;
@@ -26,6 +27,83 @@ EnumValPtr query_status(bool success)
 	return rval;
 	}
 
+const std::optional<broker::data>* StoreCache::Lookup(const broker::data& key)
+	{
+	auto it = index.find(key);
+
+	if ( it == index.end() )
+		return nullptr;
+
+	if ( it->second->expires < run_state::network_time )
+		{
+		entries.erase(it->second);
+		index.erase(it);
+		return nullptr;
+		}
+
+	entries.splice(entries.begin(), entries, it->second);
+	return &it->second->value;
+	}
+
+void StoreCache::Fill(const broker::data& key, std::optional<broker::data> value, uint64_t epoch)
+	{
+	// Whatever changed may have been this key, after the store answered.
+	if ( epoch == this->epoch )
+		Put(key, std::move(value));
+	}
+
+void StoreCache::Update(const broker::data& key, std::optional<broker::data> value)
+	{
+	++epoch;
+
+	// Only keys that are being looked up are worth keeping.
+	if ( index.find(key) != index.end() )
+		Put(key, std::move(value));
+	}
+
+void StoreCache::Invalidate(const broker::data& key)
+	{
+	++epoch;
+
+	if ( auto it = index.find(key); it != index.end() )
+		{
+		entries.erase(it->second);
+		index.erase(it);
+		}
+	}
+
+void StoreCache::Clear()
+	{
+	++epoch;
+	entries.clear();
+	index.clear();
+	}
+
+void StoreCache::Put(const broker::data& key, std::optional<broker::data> value)
+	{
+	if ( max_entries == 0 )
+		return;
+
+	double expires = run_state::network_time + ttl;
+
+	if ( auto it = index.find(key); it != index.end() )
+		{
+		it->second->value = std::move(value);
+		it->second->expires = expires;
+		entries.splice(entries.begin(), entries, it->second);
+		return;
+		}
+
+	if ( entries.size() >= max_entries )
+		{
+		index.erase(entries.back().key);
+		entries.pop_back();
+		}
+
+	entries.push_front({key, std::move(value), expires});
+	index.emplace(key, entries.begin());
+	}
+
 void StoreHandleVal::ValDescribe(ODesc* d) const
 	{
 	d->Add("broker::store::");
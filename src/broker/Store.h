@@ -4,6 +4,12 @@
 #include <broker/backend_options.hh>
 #include <broker/store.hh>
 #include <broker/store_event.hh>
+#include <list>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 #include "zeek/Expr.h"
 #include "zeek/OpaqueVal.h"
@@ -67,8 +73,99 @@ static std::optional<broker::timespan> convert_expiry(double e)
 	return ts;
 	}
 
+/**
+ * A node-local copy of some of a data store's contents, for lookups that
+ * don't need to wait for the store. Lookups fill it as they go, and the
+ * store's events keep it up to date. It holds a limited number of keys,
+ * dropping the least recently used ones, each for a limited time. It also
+ * remembers keys that the store doesn't have.
+ */
+class StoreCache
+	{
+public:
+	StoreCache(size_t max_entries, double ttl) : max_entries(max_entries), ttl(ttl) { }
+
+	/**
+	 * Looks up a key.
+	 * @return null if the key isn't cached, or else its value, which is
+	 * unset if the store doesn't have the key.
+	 */
+	const std::optional<broker::data>* Lookup(const broker::data& key);
+
+	/**
+	 * Caches a key's value as returned by a query, unless the store has
+	 * changed in the meantime.
+	 * @param epoch the value of Epoch() when the query was sent.
+	 */
+	void Fill(const broker::data& key, std::optional<broker::data> value, uint64_t epoch);
+
+	/**
+	 * Caches a key's new value, unset if the store dropped the key.
+	 */
+	void Update(const broker::data& key, std::optional<broker::data> value);
+
+	/**
+	 * Forgets a key, such as when this node changes it in a way that it
+	 * can't tell the result of.
+	 */
+	void Invalidate(const broker::data& key);
+
+	/**
+	 * Forgets all keys.
+	 */
+	void Clear();
+
+	/**
+	 * Returns a number that changes whenever the store changes.
+	 */
+	uint64_t Epoch() const { return epoch; }
+
+	/**
+	 * Marks a key as being fetched into the cache.
+	 * @return false if it already was.
+	 */
+	bool StartFetch(const broker::data& key) { return fetching.emplace(key, true).second; }
+
+	/**
+	 * Marks a key as no longer being fetched.
+	 */
+	void EndFetch(const broker::data& key) { fetching.erase(key); }
+
+private:
+	struct Entry
+		{
+		broker::data key;
+		std::optional<broker::data> value;
+		double expires;
+		};
+
+	void Put(const broker::data& key, std::optional<broker::data> value);
+
+	// The most recently used entries first.
+	std::list<Entry> entries;
+	std::unordered_map<broker::data, std::list<Entry>::iterator> index;
+	std::unordered_map<broker::data, bool> fetching;
+	size_t max_entries;
+	double ttl;
+	uint64_t epoch = 0;
+	};
+
+/**
+ * The progress of copying a store's contents into the table it backs, see
+ * Broker::table_import_chunk_size.
+ */
+struct TableImport
+	{
+	// The keys the store had when the import started.
+	std::vector<broker::data> keys;
+	size_t next = 0;
+	// Keys that changed since, which the import leaves alone.
+	std::unordered_set<broker::data> touched;
+	};
+
 /**
  * Used for asynchronous data store queries which use "when" statements.
+ * Without a trigger, it only fills the store's cache.
  */
 class StoreQueryCallback
 	{
@@ -77,32 +174,57 @@ public:
 	                   broker::store store)
 		: trigger(arg_trigger), assoc(arg_assoc), store(std::move(store))
 		{
-		Ref(trigger);
+		if ( trigger )
+			Ref(trigger);
 		}
 
-	~StoreQueryCallback() { Unref(trigger); }
+	~StoreQueryCallback()
+		{
+		if ( trigger )
+			Unref(trigger);
+		}
 
 	void Result(const RecordValPtr& result)
 		{
+		if ( ! trigger )
+			return;
+
 		trigger->Cache(assoc, result.get());
 		trigger->Release();
 		}
 
 	void Abort()
 		{
+		if ( ! trigger )
+			return;
+
 		auto result = query_result();
 		trigger->Cache(assoc, result.get());
 		trigger->Release();
 		}
 
-	bool Disabled() const { return trigger->Disabled(); }
+	bool Disabled() const { return trigger && trigger->Disabled(); }
 
 	const broker::store& Store() const { return store; }
 
+	/**
+	 * Makes the result of a lookup go into the store's cache as well.
+	 */
+	void SetCacheKey(broker::data key, uint64_t epoch)
+		{
+		cache_key = std::move(key);
+		cache_epoch = epoch;
+		}
+
+	const std::optional<broker::data>& CacheKey() const { return cache_key; }
+	uint64_t CacheEpoch() const { return cache_epoch; }
+
 private:
 	zeek::detail::trigger::Trigger* trigger;
 	const void* assoc;
 	broker::store store;
+	std::optional<broker::data> cache_key;
+	uint64_t cache_epoch = 0;
 	};
 
 /**
@@ -127,6 +249,10 @@ public:
 	// Zeek table that events are forwarded to.
 	TableValPtr forward_to;
 	bool have_store = false;
+	// Local copy of some of the contents, if enabled.
+	std::unique_ptr<StoreCache> cache;
+	// Copying of the contents into forward_to, while in progress.
+	std::unique_ptr<TableImport> import;
 
 protected:
 	IntrusivePtr<Val> DoClone(CloneState* state) override { return {NewRef{}, this}; }
@@ -0,0 +1,809 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/broker/ValWire.h"
+
+#include <climits>
+#include <cstring>
+#include <memory>
+#include <unordered_map>
+
+#include "zeek/Dict.h"
+#include "zeek/IPAddr.h"
+#include "zeek/Type.h"
+#include "zeek/Val.h"
+#include "zeek/module_util.h"
+
+namespace zeek::Broker::detail
+	{
+
+// Bumped whenever the format changes.
+static constexpr uint8_t WIRE_VERSION = 1;
+
+// Marks event arguments in the format. It's not the name of an actual
+// enum value, so it can't occur in arguments otherwise.
+static constexpr const char* WIRE_MARKER = "Broker::__wire";
+
+// How to encode and decode the values of one type.
+struct WireCodec
+	{
+	TypePtr type;
+	TypeTag tag = TYPE_VOID;
+
+	// False if the type, or a type it contains, isn't supported.
+	bool supported = true;
+
+	// For records, their fields' codecs. For tables, their indices',
+	// followed by their yield's unless they're sets. For vectors, their
+	// yield's.
+	std::vector<const WireCodec*> parts;
+	bool is_set = false;
+
+	// For enums, the names by value, as EnumType only searches for them.
+	std::unordered_map<zeek_int_t, std::string> enum_names;
+	};
+
+static const WireCodec& codec_for(const Type* t)
+	{
+	// The codecs come into existence once per type and stay, holding a
+	// reference to it.
+	static std::unordered_map<const Type*, std::unique_ptr<WireCodec>> codecs;
+
+	if ( auto it = codecs.find(t); it != codecs.end() )
+		return *it->second;
+
+	// Added before what it contains, for types that contain themselves.
+	auto c = new WireCodec();
+	codecs.emplace(t, std::unique_ptr<WireCodec>(c));
+	c->type = {NewRef{}, const_cast<Type*>(t)};
+	c->tag = t->Tag();
+
+	switch ( c->tag )
+		{
+		case TYPE_BOOL:
+		case TYPE_INT:
+		case TYPE_COUNT:
+		case TYPE_DOUBLE:
+		case TYPE_TIME:
+		case TYPE_INTERVAL:
+		case TYPE_PORT:
+		case TYPE_ADDR:
+		case TYPE_SUBNET:
+		case TYPE_STRING:
+			break;
+
+		case TYPE_ENUM:
+			for ( const auto& [name, val] : t->AsEnumType()->Names() )
+				c->enum_names.emplace(val, name);
+			break;
+
+		case TYPE_RECORD:
+			{
+			auto rt = t->AsRecordType();
+
+			for ( int i = 0; i < rt->NumFields(); ++i )
+				c->parts.push_back(&codec_for(rt->GetFieldType(i).get()));
+
+			break;
+			}
+
+		case TYPE_TABLE:
+			{
+			auto tt = t->AsTableType();
+
+			for ( const auto& it : tt->GetIndexTypes() )
+				c->parts.push_back(&codec_for(it.get()));
+
+			c->is_set = tt->IsSet();
+
+			if ( ! c->is_set )
+				c->parts.push_back(&codec_for(tt->Yield().get()));
+
+			break;
+			}
+
+		case TYPE_VECTOR:
+			c->parts.push_back(&codec_for(t->Yield().get()));
+			break;
+
+		default:
+			c->supported = false;
+			break;
+		}
+
+	for ( const auto* p : c->parts )
+		if ( ! p->supported )
+			c->supported = false;
+
+	return *c;
+	}
+
+bool wire_supports(const Type* t)
+	{
+	return codec_for(t).supported;
+	}
+
+ValWireWriter::ValWireWriter()
+	{
+	body.push_back(char(WIRE_VERSION));
+	}
+
+bool ValWireWriter::Add(const Val* v, const TypePtr& t)
+	{
+	return PutVal(v, codec_for(t.get()));
+	}
+
+std::string ValWireWriter::Finish()
+	{
+	std::string rval;
+	rval.swap(body);
+	body.push_back(char(WIRE_VERSION));
+	return rval;
+	}
+
+void ValWireWriter::PutVarint(uint64_t v)
+	{
+	while ( v >= 0x80 )
+		{
+		body.push_back(char(v | 0x80));
+		v >>= 7;
+		}
+
+	body.push_back(char(v));
+	}
+
+void ValWireWriter::PutDouble(double d)
+	{
+	uint64_t bits;
+	memcpy(&bits, &d, sizeof(bits));
+
+	for ( int i = 0; i < 8; ++i )
+		body.push_back(char(bits >> (8 * i)));
+	}
+
+void ValWireWriter::PutBytes(const void* data, size_t len)
+	{
+	body.append(static_cast<const char*>(data), len);
+	}
+
+void ValWireWriter::PutString(const std::string& s)
+	{
+	PutVarint(s.size());
+	PutBytes(s.data(), s.size());
+	}
+
+void ValWireWriter::PutAddr(const IPAddr& a)
+	{
+	in6_addr in6;
+	a.CopyIPv6(&in6);
+	PutBytes(&in6, sizeof(in6));
+	}
+
+void ValWireWriter::PutPort(const PortVal* p)
+	{
+	PutVarint(p->Port());
+	body.push_back(char(p->PortType()));
+	}
+
+bool ValWireWriter::PutEnum(const WireCodec& c, zeek_int_t i)
+	{
+	auto it = c.enum_names.find(i);
+
+	if ( it == c.enum_names.end() )
+		return false;
+
+	PutString(it->second);
+	return true;
+	}
+
+bool ValWireWriter::PutVal(const Val* v, const WireCodec& c)
+	{
+	if ( ! c.supported )
+		return false;
+
+	switch ( c.tag )
+		{
+		case TYPE_BOOL:
+			body.push_back(v->AsBool() ? 1 : 0);
+			return true;
+
+		case TYPE_INT:
+			PutSigned(v->AsInt());
+			return true;
+
+		case TYPE_COUNT:
+			PutVarint(v->AsCount());
+			return true;
+
+		case TYPE_ENUM:
+			return PutEnum(c, v->AsEnum());
+
+		case TYPE_DOUBLE:
+		case TYPE_TIME:
+		case TYPE_INTERVAL:
+			PutDouble(v->AsDouble());
+			return true;
+
+		case TYPE_PORT:
+			PutPort(v->AsPortVal());
+			return true;
+
+		case TYPE_ADDR:
+			PutAddr(v->AsAddr());
+			return true;
+
+		case TYPE_SUBNET:
+			PutAddr(v->AsSubNet().Prefix());
+			body.push_back(char(v->AsSubNet().LengthIPv6()));
+			return true;
+
+		case TYPE_STRING:
+			{
+			auto s = v->AsString();
+			PutVarint(s->Len());
+			PutBytes(s->Bytes(), s->Len());
+			return true;
+			}
+
+		case TYPE_RECORD:
+			return PutRecord(v->AsRecordVal(), c);
+
+		case TYPE_TABLE:
+			return PutTable(v->AsTableVal(), c);
+
+		case TYPE_VECTOR:
+			return PutVector(v->AsVectorVal(), c);
+
+		default:
+			return false;
+		}
+	}
+
+bool ValWireWriter::PutZVal(const ZVal& z, const WireCodec& c)
+	{
+	// The values of these live in the ZVal itself, without a Val to
+	// create for them.
+	switch ( c.tag )
+		{
+		case TYPE_BOOL:
+			body.push_back(z.AsInt() ? 1 : 0);
+			return true;
+
+		case TYPE_INT:
+			PutSigned(z.AsInt());
+			return true;
+
+		case TYPE_COUNT:
+			PutVarint(z.AsCount());
+			return true;
+
+		case TYPE_ENUM:
+			return PutEnum(c, z.AsInt());
+
+		case TYPE_DOUBLE:
+		case TYPE_TIME:
+		case TYPE_INTERVAL:
+			PutDouble(z.AsDouble());
+			return true;
+
+		case TYPE_PORT:
+			PutPort(val_mgr->Port(z.AsCount()).get());
+			return true;
+
+		default:
+			return PutVal(z.ToVal(c.type).get(), c);
+		}
+	}
+
+bool ValWireWriter::PutRecord(const RecordVal* rv, const WireCodec& c)
+	{
+	PutVarint(c.parts.size());
+
+	for ( size_t i = 0; i < c.parts.size(); ++i )
+		{
+		if ( ! rv->HasField(i) )
+			{
+			body.push_back(0);
+			continue;
+			}
+
+		body.push_back(1);
+
+		const auto& fc = *c.parts[i];
+
+		switch ( fc.tag )
+			{
+			case TYPE_BOOL:
+				body.push_back(rv->GetFieldAs<BoolVal>(i) ? 1 : 0);
+				break;
+
+			case TYPE_INT:
+				PutSigned(rv->GetFieldAs<IntVal>(i));
+				break;
+
+			case TYPE_COUNT:
+				PutVarint(rv->GetFieldAs<CountVal>(i));
+				break;
+
+			case TYPE_ENUM:
+				if ( ! PutEnum(fc, rv->GetFieldAs<EnumVal>(i)) )
+					return false;
+				break;
+
+			case TYPE_DOUBLE:
+			case TYPE_TIME:
+			case TYPE_INTERVAL:
+				PutDouble(rv->GetFieldAs<DoubleVal>(i));
+				break;
+
+			default:
+				if ( ! PutVal(rv->GetField(i).get(), fc) )
+					return false;
+				break;
+			}
+		}
+
+	return true;
+	}
+
+bool ValWireWriter::PutTable(const TableVal* tv, const WireCodec& c)
+	{
+	auto num_indices = c.is_set ? c.parts.size() : c.parts.size() - 1;
+	const auto* tbl = tv->AsTable();
+	PutVarint(tbl->Length());
+
+	for ( const auto& te : *tbl )
+		{
+		auto hk = te.GetHashKey();
+		auto vl = tv->RecreateIndex(*hk);
+
+		if ( static_cast<size_t>(vl->Length()) != num_indices )
+			return false;
+
+		for ( size_t k = 0; k < num_indices; ++k )
+			if ( ! PutVal(vl->Idx(k).get(), *c.parts[k]) )
+				return false;
+
+		if ( ! c.is_set && ! PutVal(te.value->GetVal().get(), *c.parts.back()) )
+			return false;
+		}
+
+	return true;
+	}
+
+bool ValWireWriter::PutVector(const VectorVal* vv, const WireCodec& c)
+	{
+	// Like with broker::data, holes don't travel.
+	const auto& elems = *vv->RawVec();
+	uint64_t n = 0;
+
+	for ( const auto& e : elems )
+		if ( e )
+			++n;
+
+	PutVarint(n);
+
+	for ( const auto& e : elems )
+		if ( e && ! PutZVal(*e, *c.parts[0]) )
+			return false;
+
+	return true;
+	}
+
+ValWireReader::ValWireReader(const std::string& data)
+	: pos(data.data()), end(data.data() + data.size())
+	{
+	if ( pos < end && uint8_t(*pos) == WIRE_VERSION )
+		{
+		++pos;
+		valid = true;
+		}
+	}
+
+ValPtr ValWireReader::Read(const TypePtr& t)
+	{
+	if ( ! valid )
+		return nullptr;
+
+	auto rval = GetVal(codec_for(t.get()));
+
+	if ( ! rval )
+		valid = false;
+
+	return rval;
+	}
+
+bool ValWireReader::GetByte(uint8_t* b)
+	{
+	if ( pos == end )
+		return false;
+
+	*b = uint8_t(*pos++);
+	return true;
+	}
+
+bool ValWireReader::GetVarint(uint64_t* v)
+	{
+	uint64_t rval = 0;
+
+	for ( int shift = 0; shift < 64; shift += 7 )
+		{
+		uint8_t b;
+
+		if ( ! GetByte(&b) )
+			return false;
+
+		rval |= uint64_t(b & 0x7f) << shift;
+
+		if ( ! (b & 0x80) )
+			{
+			*v = rval;
+			return true;
+			}
+		}
+
+	return false;
+	}
+
+bool ValWireReader::GetSigned(int64_t* v)
+	{
+	uint64_t u;
+
+	if ( ! GetVarint(&u) )
+		return false;
+
+	*v = int64_t((u >> 1) ^ (~(u & 1) + 1));
+	return true;
+	}
+
+bool ValWireReader::GetDouble(double* d)
+	{
+	if ( end - pos < 8 )
+		return false;
+
+	uint64_t bits = 0;
+
+	for ( int i = 0; i < 8; ++i )
+		bits |= uint64_t(uint8_t(pos[i])) << (8 * i);
+
+	pos += 8;
+	memcpy(d, &bits, sizeof(bits));
+	return true;
+	}
+
+bool ValWireReader::GetString(std::string* s)
+	{
+	uint64_t len;
+
+	if ( ! GetVarint(&len) || len > uint64_t(end - pos) )
+		return false;
+
+	s->assign(pos, len);
+	pos += len;
+	return true;
+	}
+
+bool ValWireReader::GetAddr(IPAddr* a)
+	{
+	in6_addr in6;
+
+	if ( end - pos < static_cast<ptrdiff_t>(sizeof(in6)) )
+		return false;
+
+	memcpy(&in6, pos, sizeof(in6));
+	pos += sizeof(in6);
+	*a = IPAddr(in6);
+	return true;
+	}
+
+ValPtr ValWireReader::GetVal(const WireCodec& c)
+	{
+	if ( ! c.supported )
+		return nullptr;
+
+	switch ( c.tag )
+		{
+		case TYPE_BOOL:
+			{
+			uint8_t b;
+
+			if ( ! GetByte(&b) || b > 1 )
+				return nullptr;
+
+			return val_mgr->Bool(b);
+			}
+
+		case TYPE_INT:
+			{
+			int64_t i;
+
+			if ( ! GetSigned(&i) )
+				return nullptr;
+
+			return val_mgr->Int(i);
+			}
+
+		case TYPE_COUNT:
+			{
+			uint64_t u;
+
+			if ( ! GetVarint(&u) )
+				return nullptr;
+
+			return val_mgr->Count(u);
+			}
+
+		case TYPE_ENUM:
+			{
+			std::string name;
+
+			if ( ! GetString(&name) )
+				return nullptr;
+
+			auto etype = c.type->AsEnumType();
+			auto i = etype->Lookup(zeek::detail::GLOBAL_MODULE_NAME, name.c_str());
+
+			if ( i == -1 )
+				return nullptr;
+
+			return etype->GetEnumVal(i);
+			}
+
+		case TYPE_DOUBLE:
+		case TYPE_TIME:
+		case TYPE_INTERVAL:
+			{
+			double d;
+
+			if ( ! GetDouble(&d) )
+				return nullptr;
+
+			if ( c.tag == TYPE_TIME )
+				return make_intrusive<TimeVal>(d);
+
+			if ( c.tag == TYPE_INTERVAL )
+				return make_intrusive<IntervalVal>(d);
+
+			return make_intrusive<DoubleVal>(d);
+			}
+
+		case TYPE_PORT:
+			{
+			uint64_t port;
+			uint8_t proto;
+
+			if ( ! GetVarint(&port) || port > 65535 || ! GetByte(&proto) ||
+			     proto > TRANSPORT_ICMP )
+				return nullptr;
+
+			return val_mgr->Port(port, static_cast<TransportProto>(proto));
+			}
+
+		case TYPE_ADDR:
+			{
+			IPAddr a;
+
+			if ( ! GetAddr(&a) )
+				return nullptr;
+
+			return make_intrusive<AddrVal>(a);
+			}
+
+		case TYPE_SUBNET:
+			{
+			IPAddr a;
+			uint8_t len;
+
+			if ( ! GetAddr(&a) || ! GetByte(&len) || len > 128 )
+				return nullptr;
+
+			return make_intrusive<SubNetVal>(IPPrefix(a, len, true));
+			}
+
+		case TYPE_STRING:
+			{
+			uint64_t len;
+
+			if ( ! GetVarint(&len) || len > uint64_t(end - pos) || len > INT_MAX )
+				return nullptr;
+
+			auto rval = make_intrusive<StringVal>(static_cast<int>(len), pos);
+			pos += len;
+			return rval;
+			}
+
+		case TYPE_RECORD:
+			return GetRecord(c);
+
+		case TYPE_TABLE:
+			return GetTable(c);
+
+		case TYPE_VECTOR:
+			return GetVector(c);
+
+		default:
+			return nullptr;
+		}
+	}
+
+ValPtr ValWireReader::GetRecord(const WireCodec& c)
+	{
+	uint64_t n;
+
+	if ( ! GetVarint(&n) || n != c.parts.size() )
+		return nullptr;
+
+	auto rval = make_intrusive<RecordVal>(cast_intrusive<RecordType>(c.type));
+
+	for ( size_t i = 0; i < c.parts.size(); ++i )
+		{
+		uint8_t set;
+
+		if ( ! GetByte(&set) || set > 1 )
+			return nullptr;
+
+		if ( ! set )
+			{
+			rval->Remove(i);
+			continue;
+			}
+
+		const auto& fc = *c.parts[i];
+
+		// Straight into the record's ZVals where that works.
+		switch ( fc.tag )
+			{
+			case TYPE_BOOL:
+				{
+				uint8_t b;
+
+				if ( ! GetByte(&b) || b > 1 )
+					return nullptr;
+
+				rval->Assign(i, b != 0);
+				break;
+				}
+
+			case TYPE_COUNT:
+				{
+				uint64_t u;
+
+				if ( ! GetVarint(&u) )
+					return nullptr;
+
+				rval->Assign(i, u);
+				break;
+				}
+
+			case TYPE_DOUBLE:
+			case TYPE_TIME:
+			case TYPE_INTERVAL:
+				{
+				double d;
+
+				if ( ! GetDouble(&d) )
+					return nullptr;
+
+				rval->Assign(i, d);
+				break;
+				}
+
+			default:
+				{
+				auto v = GetVal(fc);
+
+				if ( ! v )
+					return nullptr;
+
+				rval->Assign(i, std::move(v));
+				break;
+				}
+			}
+		}
+
+	return rval;
+	}
+
+ValPtr ValWireReader::GetTable(const WireCodec& c)
+	{
+	uint64_t n;
+
+	if ( ! GetVarint(&n) )
+		return nullptr;
+
+	auto num_indices = c.is_set ? c.parts.size() : c.parts.size() - 1;
+	auto rval = make_intrusive<TableVal>(cast_intrusive<TableType>(c.type));
+
+	for ( uint64_t i = 0; i < n; ++i )
+		{
+		auto list_val = make_intrusive<ListVal>(TYPE_ANY);
+
+		for ( size_t k = 0; k < num_indices; ++k )
+			{
+			auto index_val = GetVal(*c.parts[k]);
+
+			if ( ! index_val )
+				return nullptr;
+
+			list_val->Append(std::move(index_val));
+			}
+
+		ValPtr value_val;
+
+		if ( ! c.is_set && ! (value_val = GetVal(*c.parts.back())) )
+			return nullptr;
+
+		rval->Assign(std::move(list_val), std::move(value_val));
+		}
+
+	return rval;
+	}
+
+ValPtr ValWireReader::GetVector(const WireCodec& c)
+	{
+	uint64_t n;
+
+	if ( ! GetVarint(&n) )
+		return nullptr;
+
+	auto rval = make_intrusive<VectorVal>(cast_intrusive<VectorType>(c.type));
+
+	for ( uint64_t i = 0; i < n; ++i )
+		{
+		auto item_val = GetVal(*c.parts[0]);
+
+		if ( ! item_val )
+			return nullptr;
+
+		rval->Assign(rval->Size(), std::move(item_val));
+		}
+
+	return rval;
+	}
+
+std::optional<broker::vector> encode_event_args(const std::vector<TypePtr>& types,
+                                                const Args& args)
+	{
+	if ( types.size() != args.size() )
+		return std::nullopt;
+
+	ValWireWriter w;
+
+	for ( size_t i = 0; i < args.size(); ++i )
+		if ( ! same_type(args[i]->GetType(), types[i]) || ! w.Add(args[i].get(), types[i]) )
+			return std::nullopt;
+
+	broker::vector rval;
+	rval.reserve(2);
+	rval.emplace_back(broker::enum_value(WIRE_MARKER));
+	rval.emplace_back(w.Finish());
+	return rval;
+	}
+
+bool is_wire_event_args(const broker::vector& args)
+	{
+	if ( args.size() != 2 )
+		return false;
+
+	auto marker = broker::get_if<broker::enum_value>(&args[0]);
+	return marker && marker->name == WIRE_MARKER && broker::get_if<std::string>(&args[1]);
+	}
+
+bool decode_event_args(const broker::vector& args, const std::vector<TypePtr>& types, Args* vl)
+	{
+	ValWireReader r(broker::get<std::string>(args[1]));
+	vl->reserve(types.size());
+
+	for ( const auto& t : types )
+		{
+		auto v = r.Read(t);
+
+		if ( ! v )
+			return false;
+
+		vl->emplace_back(std::move(v));
+		}
+
+	return r.AtEnd();
+	}
+
+	} // namespace Broker::detail
@@ -0,0 +1,166 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <broker/data.hh>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "zeek/IntrusivePtr.h"
+#include "zeek/ZVal.h"
+#include "zeek/ZeekArgs.h"
+
+namespace zeek
+	{
+
+class IPAddr;
+class Type;
+class RecordVal;
+class TableVal;
+class VectorVal;
+class PortVal;
+using TypePtr = IntrusivePtr<Type>;
+
+namespace Broker::detail
+	{
+
+struct WireCodec;
+
+/**
+ * Encodes values straight into the compact format in which published
+ * events travel when Broker::wire_events is set, without building
+ * broker::data trees for them first. Both sides know an event's parameter
+ * types, so the encoding carries only values: integers and lengths as
+ * variable-length integers, records as their fields, each preceded by a
+ * byte saying whether it's set, and containers as their size followed by
+ * their elements. How to encode a type is worked out once per type.
+ *
+ * The format isn't stable across versions and only Zeek understands it,
+ * so it's meant for clusters of the same version.
+ */
+class ValWireWriter
+	{
+public:
+	ValWireWriter();
+
+	/**
+	 * Adds a value of the given type, which must be the value's.
+	 *
+	 * @return False if the type isn't supported, see wire_supports().
+	 * The encoding is incomplete then.
+	 */
+	bool Add(const Val* v, const TypePtr& t);
+
+	/**
+	 * Returns the encoding of the values and starts over.
+	 */
+	std::string Finish();
+
+private:
+	void PutVarint(uint64_t v);
+	void PutSigned(int64_t v) { PutVarint((uint64_t(v) << 1) ^ uint64_t(v >> 63)); }
+	void PutDouble(double d);
+	void PutBytes(const void* data, size_t len);
+	void PutString(const std::string& s);
+	void PutAddr(const IPAddr& a);
+	void PutPort(const PortVal* p);
+	bool PutEnum(const WireCodec& c, zeek_int_t i);
+	bool PutVal(const Val* v, const WireCodec& c);
+	bool PutZVal(const ZVal& z, const WireCodec& c);
+	bool PutRecord(const RecordVal* rv, const WireCodec& c);
+	bool PutTable(const TableVal* tv, const WireCodec& c);
+	bool PutVector(const VectorVal* vv, const WireCodec& c);
+
+	std::string body;
+	};
+
+/**
+ * Decodes values encoded by ValWireWriter.
+ */
+class ValWireReader
+	{
+public:
+	/**
+	 * Constructor. The data must remain valid while decoding. Checks
+	 * the header, see Valid().
+	 */
+	explicit ValWireReader(const std::string& data);
+
+	/**
+	 * Returns false if the data is malformed, or in a different version
+	 * of the format.
+	 */
+	bool Valid() const { return valid; }
+
+	/**
+	 * Returns true once all values have been read.
+	 */
+	bool AtEnd() const { return pos == end; }
+
+	/**
+	 * Decodes the next value, of the given type.
+	 *
+	 * @return The value, or null if the data is malformed or the type
+	 * isn't supported.
+	 */
+	ValPtr Read(const TypePtr& t);
+
+private:
+	bool GetByte(uint8_t* b);
+	bool GetVarint(uint64_t* v);
+	bool GetSigned(int64_t* v);
+	bool GetDouble(double* d);
+	bool GetString(std::string* s);
+	bool GetAddr(IPAddr* a);
+	ValPtr GetVal(const WireCodec& c);
+	ValPtr GetRecord(const WireCodec& c);
+	ValPtr GetTable(const WireCodec& c);
+	ValPtr GetVector(const WireCodec& c);
+
+	const char* pos;
+	const char* end;
+	bool valid = false;
+	};
+
+/**
+ * Returns true if values of the type can be encoded by ValWireWriter.
+ * That's all of them except for "any", functions, files, patterns and
+ * opaques, as well as the containers and records holding those. The
+ * answer is cached per type.
+ */
+bool wire_supports(const Type* t);
+
+/**
+ * Encodes an event's arguments into the form in which published events
+ * carry them in the wire format.
+ *
+ * @param types The event's parameter types, which the arguments must have.
+ *
+ * @return The arguments to send, or nothing if a type isn't supported, in
+ * which case they need converting into broker::data as usual.
+ */
+std::optional<broker::vector> encode_event_args(const std::vector<TypePtr>& types,
+                                                const Args& args);
+
+/**
+ * Returns true if an event's arguments are in the wire format.
+ */
+bool is_wire_event_args(const broker::vector& args);
+
+/**
+ * Decodes an event's arguments from the wire format.
+ *
+ * @param types The event's parameter types.
+ *
+ * @param vl Receives the arguments.
+ *
+ * @return False if the arguments are malformed or don't match the types.
+ */
+bool decode_event_args(const broker::vector& args, const std::vector<TypePtr>& types, Args* vl);
+
+	} // namespace Broker::detail
+
+	} // namespace zeek
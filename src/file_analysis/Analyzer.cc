@@ -9,6 +9,7 @@ namespace zeek::file_analysis
 	{
 
 ID Analyzer::id_counter = 0;
+zeek::detail::MemoryPool Analyzer::pool("file-analyzer", zeek::detail::ARENA_SESSIONS);
 
 Analyzer::~Analyzer()
 	{
@@ -4,6 +4,7 @@
 
 #include <sys/types.h> // for u_char
 
+#include "zeek/MemoryPool.h"
 #include "zeek/Tag.h"
 
 namespace zeek
@@ -30,6 +31,9 @@ public:
 	 */
 	virtual ~Analyzer();
 
+	// With memory pools enabled, all file analyzer classes share one pool.
+	ZEEK_POOL_ALLOCATED(pool)
+
 	/**
 	 * Initializes the analyzer before input processing starts.
 	 */
@@ -133,6 +137,15 @@ public:
 	 */
 	bool Skipping() const { return skip; }
 
+	/**
+	 * Subclasses may override this method to receive data exactly in the
+	 * chunks that it arrives in, rather than having small chunks coalesced
+	 * once default_file_coalesce_size is set.
+	 * @return true if the analyzer's results depend on where chunks start
+	 *         and end.
+	 */
+	virtual bool NeedsExactChunks() const { return false; }
+
 protected:
 	/**
 	 * Constructor.  Only derived classes are meant to be instantiated.
@@ -163,6 +176,7 @@ private:
 	bool skip;
 
 	static ID id_counter;
+	static zeek::detail::MemoryPool pool;
 	};
 
 	} // namespace file_analysis
@@ -5,6 +5,7 @@
 #include <utility>
 
 #include "zeek/Event.h"
+#include "zeek/ID.h"
 #include "zeek/Reporter.h"
 #include "zeek/RuleMatcher.h"
 #include "zeek/Type.h"
@@ -38,6 +39,8 @@ static RecordValPtr get_conn_id_val(const Connection* conn)
 	return v;
 	}
 
+zeek::detail::MemoryPool File::pool("file", zeek::detail::ARENA_SESSIONS);
+
 int File::id_idx = -1;
 int File::parent_id_idx = -1;
 int File::source_idx = -1;
@@ -82,7 +85,7 @@ File::File(const std::string& file_id, const std::string& source_name, Connectio
            zeek::Tag tag, bool is_orig)
 	: id(file_id), val(nullptr), file_reassembler(nullptr), stream_offset(0),
 	  reassembly_max_buffer(0), did_metadata_inference(false), reassembly_enabled(false),
-	  postpone_timeout(false), done(false), analyzers(this)
+	  postpone_timeout(false), done(false), ignored(false), analyzers(this)
 	{
 	StaticInit();
 
@@ -101,10 +104,20 @@ File::File(const std::string& file_id, const std::string& source_name, Connectio
 	UpdateLastActivityTime();
 	}
 
+struct File::MIMEScan
+	{
+	~MIMEScan() { delete state; }
+
+	zeek::detail::RuleFileMagicState* state = nullptr;
+	zeek::detail::RuleMatcher::MIME_Matches matches;
+	bool finished = false;
+	};
+
 File::~File()
 	{
 	DBG_LOG(DBG_FILE_ANALYSIS, "[%s] Destroying File object", id.c_str());
 	delete file_reassembler;
+	delete mime_scan;
 
 	for ( auto a : done_analyzers )
 		delete a;
@@ -234,7 +247,7 @@ bool File::IsComplete() const
 	if ( ! total )
 		return false;
 
-	if ( stream_offset >= total->AsCount() )
+	if ( stream_offset + staged.size() >= total->AsCount() )
 		return true;
 
 	return false;
@@ -321,10 +334,19 @@ void File::InferMetadata()
 		return;
 
 	zeek::detail::RuleMatcher::MIME_Matches matches;
-	const u_char* data = bof_buffer_val->AsString()->Bytes();
-	uint64_t len = bof_buffer_val->AsString()->Len();
-	len = std::min(len, LookupFieldDefaultCount(bof_buffer_size_idx));
-	file_mgr->DetectMIME(data, len, &matches);
+
+	if ( mime_scan && mime_scan->finished )
+		matches = std::move(mime_scan->matches);
+	else
+		{
+		const u_char* data = bof_buffer_val->AsString()->Bytes();
+		uint64_t len = bof_buffer_val->AsString()->Len();
+		len = std::min(len, LookupFieldDefaultCount(bof_buffer_size_idx));
+		file_mgr->DetectMIME(data, len, &matches);
+		}
+
+	delete mime_scan;
+	mime_scan = nullptr;
 
 	auto meta = make_intrusive<RecordVal>(id::fa_metadata);
 
@@ -343,11 +365,13 @@ bool File::BufferBOF(const u_char* data, uint64_t len)
 		return false;
 
 	uint64_t desired_size = LookupFieldDefaultCount(bof_buffer_size_idx);
+	bool certain = bof_buffer.size < desired_size &&
+	               ScanMIME(data, std::min(len, desired_size - bof_buffer.size));
 
 	bof_buffer.chunks.push_back(new String(data, len, false));
 	bof_buffer.size += len;
 
-	if ( bof_buffer.size < desired_size )
+	if ( bof_buffer.size < desired_size && ! certain )
 		return true;
 
 	bof_buffer.full = true;
@@ -361,6 +385,38 @@ bool File::BufferBOF(const u_char* data, uint64_t len)
 	return false;
 	}
 
+bool File::ScanMIME(const u_char* data, uint64_t len)
+	{
+	static const auto early = id::find("early_file_mime_detection");
+	bool first = bof_buffer.chunks.empty();
+
+	if ( first )
+		{
+		if ( ! early->GetVal()->AsBool() || did_metadata_inference ||
+		     ! FileEventAvailable(file_sniff) || ! zeek::detail::rule_matcher )
+			return false;
+
+		mime_scan = new MIMEScan();
+		mime_scan->state = zeek::detail::rule_matcher->InitFileMagic();
+		}
+
+	else if ( ! mime_scan )
+		return false;
+
+	// Data after a gap doesn't get matched.
+	if ( LookupFieldDefaultCount(missing_bytes_idx) > 0 )
+		return false;
+
+	mime_scan->finished = zeek::detail::rule_matcher->MatchMore(mime_scan->state, data, len,
+	                                                            first, &mime_scan->matches);
+
+	if ( mime_scan->finished )
+		DBG_LOG(DBG_FILE_ANALYSIS, "[%s] MIME types certain after %" PRIu64 " bytes", id.c_str(),
+		        bof_buffer.size + len);
+
+	return mime_scan->finished;
+	}
+
 void File::DeliverStream(const u_char* data, uint64_t len)
 	{
 	bool bof_was_full = bof_buffer.full;
@@ -498,17 +554,69 @@ void File::DoneWithAnalyzer(Analyzer* analyzer)
 	done_analyzers.push_back(analyzer);
 	}
 
+bool File::Stage(const u_char* data, uint64_t len, uint64_t offset)
+	{
+	static const auto coalesce_size = id::find("default_file_coalesce_size");
+	uint64_t threshold = coalesce_size->GetVal()->AsCount();
+
+	// The BOF buffer and reassembly keep getting chunks as they are.
+	if ( len >= threshold || ! bof_buffer.full || file_reassembler ||
+	     offset != stream_offset + staged.size() )
+		return false;
+
+	for ( const auto& entry : analyzers )
+		if ( entry.value->NeedsExactChunks() )
+			return false;
+
+	staged.append(reinterpret_cast<const char*>(data), len);
+
+	if ( staged.size() >= threshold || IsComplete() )
+		FlushStaged();
+
+	return true;
+	}
+
+void File::FlushStaged()
+	{
+	if ( staged.empty() )
+		return;
+
+	// Delivery may stage data again, so it mustn't see these bytes.
+	std::string data;
+	data.swap(staged);
+	DeliverChunk(reinterpret_cast<const u_char*>(data.data()), data.size(), stream_offset);
+
+	// Keep the allocation for the next round.
+	if ( staged.empty() )
+		{
+		data.clear();
+		staged.swap(data);
+		}
+	}
+
 void File::DataIn(const u_char* data, uint64_t len, uint64_t offset)
 	{
 	analyzers.DrainModifications();
-	DeliverChunk(data, len, offset);
+
+	if ( ! Stage(data, len, offset) )
+		{
+		FlushStaged();
+		DeliverChunk(data, len, offset);
+		}
+
 	analyzers.DrainModifications();
 	}
 
 void File::DataIn(const u_char* data, uint64_t len)
 	{
 	analyzers.DrainModifications();
-	DeliverChunk(data, len, stream_offset);
+
+	if ( ! Stage(data, len, stream_offset + staged.size()) )
+		{
+		FlushStaged();
+		DeliverChunk(data, len, stream_offset);
+		}
+
 	analyzers.DrainModifications();
 	}
 
@@ -519,6 +627,8 @@ void File::EndOfFile()
 	if ( done )
 		return;
 
+	FlushStaged();
+
 	if ( file_reassembler )
 		{
 		file_reassembler->Flush();
@@ -555,6 +665,8 @@ void File::Gap(uint64_t offset, uint64_t len)
 	DBG_LOG(DBG_FILE_ANALYSIS, "[%s] Gap of size %" PRIu64 " at offset %" PRIu64, id.c_str(), len,
 	        offset);
 
+	FlushStaged();
+
 	if ( file_reassembler && ! file_reassembler->IsCurrentlyFlushing() )
 		{
 		file_reassembler->FlushTo(offset + len);
@@ -620,4 +732,10 @@ bool File::PermitWeird(const char* name, uint64_t threshold, uint64_t rate, doub
 	return zeek::detail::PermitWeird(weird_state, name, threshold, rate, duration);
 	}
 
+bool File::PermitWeird(zeek::detail::WeirdID id, uint64_t threshold, uint64_t rate,
+                       double duration)
+	{
+	return zeek::detail::PermitWeird(weird_state, id, threshold, rate, duration);
+	}
+
 	} // namespace zeek::file_analysis
@@ -6,6 +6,7 @@
 #include <string>
 #include <utility>
 
+#include "zeek/MemoryPool.h"
 #include "zeek/Tag.h"
 #include "zeek/WeirdState.h"
 #include "zeek/ZeekArgs.h"
@@ -40,6 +41,11 @@ public:
 	 */
 	~File();
 
+	// Files come and go with the traffic, along with their analyzer set
+	// and BOF buffer, which they hold by value. With memory pools
+	// enabled, they get a pool of their own.
+	ZEEK_POOL_ALLOCATED(pool)
+
 	/**
 	 * @return the wrapped \c fa_file record value, #val.
 	 */
@@ -206,6 +212,8 @@ public:
 	 * framework.
 	 */
 	bool PermitWeird(const char* name, uint64_t threshold, uint64_t rate, double duration);
+	bool PermitWeird(zeek::detail::WeirdID id, uint64_t threshold, uint64_t rate,
+	                 double duration);
 
 protected:
 	friend class Manager;
@@ -270,6 +278,34 @@ protected:
 	 */
 	bool BufferBOF(const u_char* data, uint64_t len);
 
+	/**
+	 * With early_file_mime_detection, matches the next chunk of the BOF
+	 * buffer against the file magic signatures.
+	 * @param data pointer to the start of the chunk.
+	 * @param len number of bytes in the chunk that the BOF buffer has room
+	 *        for.
+	 * @return true if the MIME types are certain, so buffering is no longer
+	 *         required.
+	 */
+	bool ScanMIME(const u_char* data, uint64_t len);
+
+	/**
+	 * With default_file_coalesce_size, holds back a small chunk that
+	 * continues the file's data, to deliver it along with the following
+	 * ones.
+	 * @param data pointer to start of a chunk of file data.
+	 * @param len number of bytes in the data chunk.
+	 * @param offset number of bytes from start of file at which chunk occurs.
+	 * @return true if the chunk got staged (and possibly delivered), false
+	 *         if it needs to get delivered on its own.
+	 */
+	bool Stage(const u_char* data, uint64_t len, uint64_t offset);
+
+	/**
+	 * Delivers the data that Stage() held back, if any.
+	 */
+	void FlushStaged();
+
 	/**
 	 * Does metadata inference (e.g. mime type detection via file
 	 * magic signatures) using data in the BOF (beginning-of-file) buffer
@@ -331,6 +367,11 @@ protected:
 	bool reassembly_enabled; /**< Whether file stream reassembly is needed. */
 	bool postpone_timeout; /**< Whether postponing timeout is requested. */
 	bool done; /**< If this object is about to be deleted. */
+	bool ignored; /**< Whether analysis got disabled, see Manager::IgnoreFile(). */
+
+	struct MIMEScan;
+	MIMEScan* mime_scan = nullptr; /**< Progress of early MIME type detection. */
+	std::string staged; /**< Data following stream_offset that waits for delivery. */
 	detail::AnalyzerSet analyzers; /**< A set of attached file analyzers. */
 	std::list<Analyzer*> done_analyzers; /**< Analyzers we're done with, remembered here until they
 	                                        can be safely deleted. */
@@ -351,6 +392,7 @@ protected:
 
 	zeek::detail::WeirdStateMap weird_state;
 
+	static zeek::detail::MemoryPool pool;
 	static int id_idx;
 	static int parent_id_idx;
 	static int source_idx;
@@ -2,6 +2,7 @@
 
 #include "zeek/file_analysis/FileReassembler.h"
 
+#include "zeek/Reporter.h"
 #include "zeek/file_analysis/File.h"
 
 namespace zeek::file_analysis
@@ -9,6 +10,9 @@ namespace zeek::file_analysis
 
 class File;
 
+zeek::detail::MemoryPool FileReassembler::pool("file-reassembler",
+                                                 zeek::detail::ARENA_REASSEMBLY);
+
 FileReassembler::FileReassembler(File* f, uint64_t starting_offset)
 	: Reassembler(starting_offset, REASSEM_FILE), the_file(f), flushing(false)
 	{
@@ -112,4 +116,16 @@ void FileReassembler::Overlap(const u_char* b1, const u_char* b2, uint64_t n)
 	{
 	// Not doing anything here yet.
 	}
+
+void FileReassembler::Evict(bool flush)
+	{
+	reporter->Weird(the_file, "reassembly_memory_budget_exceeded", flush ? "flushed" : "dropped");
+
+	if ( flush && ! flushing )
+		Flush();
+
+	// Anything we drop here shows up as a gap once the file's done.
+	ClearBlocks();
+	ClearOldBlocks();
+	}
 	} // end file_analysis
@@ -2,6 +2,7 @@
 
 #pragma once
 
+#include "zeek/MemoryPool.h"
 #include "zeek/Reassem.h"
 
 namespace zeek
@@ -21,6 +22,9 @@ public:
 	FileReassembler(File* f, uint64_t starting_offset);
 	~FileReassembler() override = default;
 
+	// With memory pools enabled, file reassemblers get a pool of their own.
+	ZEEK_POOL_ALLOCATED(pool)
+
 	void Done();
 
 	// Checks if we have delivered all contents that we can possibly
@@ -54,9 +58,12 @@ protected:
 	void Undelivered(uint64_t up_to_seq) override;
 	void BlockInserted(DataBlockMap::const_iterator it) override;
 	void Overlap(const u_char* b1, const u_char* b2, uint64_t n) override;
+	void Evict(bool flush) override;
 
 	File* the_file = nullptr;
 	bool flushing = false;
+
+	static zeek::detail::MemoryPool pool;
 	};
 
 	} // namespace file_analysis
@@ -3,6 +3,7 @@
 #include "zeek/file_analysis/Manager.h"
 
 #include <openssl/md5.h>
+#include <algorithm>
 
 #include "zeek/Event.h"
 #include "zeek/UID.h"
@@ -53,7 +54,10 @@ void Manager::Terminate()
 	keys.reserve(id_map.size());
 
 	for ( const auto& entry : id_map )
-		keys.push_back(entry.first);
+		keys.emplace_back(entry.first);
+
+	// Time out in order of ID, independent of how the map lays them out.
+	std::sort(keys.begin(), keys.end());
 
 	for ( const string& key : keys )
 		Timeout(key, true);
@@ -318,7 +322,7 @@ File* Manager::GetFile(const string& file_id, Connection* conn, const zeek::Tag&
 		{
 		rval = new File(file_id, source_name ? source_name : analyzer_mgr->GetComponentName(tag),
 		                conn, tag, is_orig);
-		id_map[file_id] = rval;
+		id_map.emplace(rval->GetID(), rval);
 
 		++cumulative_files;
 		if ( id_map.size() > max_files )
@@ -363,6 +367,7 @@ void Manager::Timeout(const string& file_id, bool is_terminating)
 		return;
 
 	file->postpone_timeout = false;
+	file->FlushStaged();
 
 	file->FileEvent(file_timeout);
 
@@ -381,12 +386,14 @@ void Manager::Timeout(const string& file_id, bool is_terminating)
 
 bool Manager::IgnoreFile(const string& file_id)
 	{
-	if ( ! LookupFile(file_id) )
+	File* f = LookupFile(file_id);
+
+	if ( ! f )
 		return false;
 
 	DBG_LOG(DBG_FILE_ANALYSIS, "Ignore FileID %s", file_id.c_str());
 
-	ignored.insert(file_id);
+	f->ignored = true;
 	return true;
 	}
 
@@ -404,15 +411,15 @@ bool Manager::RemoveFile(const string& file_id)
 
 	f->EndOfFile();
 
-	id_map.erase(file_id);
-	ignored.erase(file_id);
+	id_map.erase(f->GetID());
 	delete f;
 	return true;
 	}
 
 bool Manager::IsIgnored(const string& file_id)
 	{
-	return ignored.find(file_id) != ignored.end();
+	File* f = LookupFile(file_id);
+	return f && f->ignored;
 	}
 
 string Manager::GetFileID(const zeek::Tag& tag, Connection* c, bool is_orig)
@@ -5,6 +5,8 @@
 #include <map>
 #include <set>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 
 #include "zeek/RuleMatcher.h"
 #include "zeek/RunState.h"
@@ -425,8 +427,9 @@ private:
 
 	TagSet* LookupMIMEType(const std::string& mtype, bool add_if_not_found);
 
-	std::map<std::string, File*> id_map; /**< Map file ID to file_analysis::File records. */
-	std::set<std::string> ignored; /**< Ignored files.  Will be finally removed on EOF. */
+	// Maps file IDs to file_analysis::File records. Keys refer to the
+	// IDs that the files hold, so entries must go before their file.
+	std::unordered_map<std::string_view, File*> id_map;
 	std::string current_file_id; /**< Hash of what get_file_handle event sets. */
 	zeek::detail::RuleFileMagicState* magic_state; /**< File magic signature match state. */
 	MIMEMap mime_types; /**< Mapping of MIME types to analyzers. */
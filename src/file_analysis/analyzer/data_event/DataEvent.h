@@ -37,6 +37,12 @@ public:
 	 */
 	bool DeliverStream(const u_char* data, uint64_t len) override;
 
+	/**
+	 * Scripts see each chunk as it arrives.
+	 * @return always true
+	 */
+	bool NeedsExactChunks() const override { return true; }
+
 	/**
 	 * Create a new instance of a DataEvent analyzer.
 	 * @param args the \c AnalyzerArgs value which represents the analyzer.
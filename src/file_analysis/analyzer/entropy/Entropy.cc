@@ -6,6 +6,7 @@
 
 #include "zeek/Event.h"
 #include "zeek/file_analysis/Manager.h"
+#include "zeek/file_analysis/file_analysis.bif.h"
 #include "zeek/util.h"
 
 namespace zeek::file_analysis::detail
@@ -14,7 +15,10 @@ namespace zeek::file_analysis::detail
 Entropy::Entropy(RecordValPtr args, file_analysis::File* file)
 	: file_analysis::Analyzer(file_mgr->GetComponentTag("ENTROPY"), std::move(args), file)
 	{
-	entropy = new EntropyVal;
+	static auto histogram_only_idx = BifType::Record::Files::AnalyzerArgs->FieldOffset(
+		"entropy_histogram_only");
+
+	entropy = new EntropyVal(GetArgs()->GetFieldOrDefault(histogram_only_idx)->AsBool());
 	fed = false;
 	}
 
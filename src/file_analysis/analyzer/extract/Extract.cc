@@ -3,47 +3,113 @@
 #include "zeek/file_analysis/analyzer/extract/Extract.h"
 
 #include <fcntl.h>
+#include <unistd.h>
 #include <string>
 
 #include "zeek/Event.h"
+#include "zeek/ID.h"
+#include "zeek/digest.h"
 #include "zeek/file_analysis/Manager.h"
 #include "zeek/util.h"
 
 namespace zeek::file_analysis::detail
 	{
 
-Extract::Extract(RecordValPtr args, file_analysis::File* file, const std::string& arg_filename,
-                 uint64_t arg_limit)
-	: file_analysis::Analyzer(file_mgr->GetComponentTag("EXTRACT"), std::move(args), file),
-	  filename(arg_filename), limit(arg_limit), depth(0)
+struct Extract::Store
+	{
+	~Store()
+		{
+		if ( sha )
+			{
+			u_char digest[SHA256_DIGEST_LENGTH];
+			zeek::detail::hash_final(sha, digest);
+			}
+		}
+
+	std::string dir;
+	std::string tmp_name;
+	EVP_MD_CTX* sha = nullptr;
+
+	// The contents so far, until they exceed FileExtract::store_buffer_bytes.
+	std::string buffer;
+	uint64_t buffer_limit = 0;
+	};
+
+static FILE* open_extract_file(const std::string& name)
 	{
 	char buf[128];
-	file_stream = fopen(filename.data(), "w");
+	FILE* f = fopen(name.data(), "w");
 
-	if ( file_stream )
+	if ( f )
 		{
 		// Try to ensure full buffering.
-		if ( setvbuf(file_stream, nullptr, _IOFBF, BUFSIZ) )
+		if ( setvbuf(f, nullptr, _IOFBF, BUFSIZ) )
 			{
 			util::zeek_strerror_r(errno, buf, sizeof(buf));
-			reporter->Warning("cannot set buffering mode for %s: %s", filename.data(), buf);
+			reporter->Warning("cannot set buffering mode for %s: %s", name.data(), buf);
 			}
 		}
 	else
 		{
 		util::zeek_strerror_r(errno, buf, sizeof(buf));
-		reporter->Error("cannot open %s: %s", filename.c_str(), buf);
+		reporter->Error("cannot open %s: %s", name.c_str(), buf);
+		}
+
+	return f;
+	}
+
+Extract::Extract(RecordValPtr args, file_analysis::File* file, const std::string& arg_filename,
+                 uint64_t arg_limit, bool arg_to_store)
+	: file_analysis::Analyzer(file_mgr->GetComponentTag("EXTRACT"), std::move(args), file),
+	  filename(arg_filename), file_stream(nullptr), limit(arg_limit), depth(0)
+	{
+	if ( arg_to_store )
+		{
+		// Nothing gets written until it's clear that the store doesn't
+		// have the file yet, or it grows too large to hold back.
+		store = std::make_unique<Store>();
+		store->dir = id::find_val("FileExtract::store_prefix")->AsString()->ToStdString();
+		store->tmp_name = store->dir + "/.tmp-" + file->GetID();
+		store->buffer_limit = id::find_val("FileExtract::store_buffer_bytes")->AsCount();
+		store->sha = zeek::detail::hash_init(zeek::detail::Hash_SHA256);
+		filename = store->tmp_name;
+		return;
+		}
+
+	file_stream = open_extract_file(filename);
+
+	if ( file_stream )
+		{
+		if ( auto pool = ExtractPool::Get() )
+			job = pool->Open(file_stream, filename);
 		}
 	}
 
 Extract::~Extract()
 	{
+	if ( job )
+		{
+		if ( auto pool = ExtractPool::Get() )
+			{
+			pool->Close(job);
+			return;
+			}
+
+		// The pool's workers are gone, having written all there was.
+		file_stream = job->stream;
+		delete job;
+		}
+
 	if ( file_stream && fclose(file_stream) )
 		{
 		char buf[128];
 		util::zeek_strerror_r(errno, buf, sizeof(buf));
 		reporter->Error("cannot close %s: %s", filename.data(), buf);
 		}
+
+	// The file didn't get to its end, so it doesn't go into the store.
+	if ( store && file_stream )
+		unlink(store->tmp_name.c_str());
 	}
 
 static ValPtr get_extract_field_val(const RecordValPtr& args, const char* name)
@@ -60,11 +126,13 @@ file_analysis::Analyzer* Extract::Instantiate(RecordValPtr args, file_analysis::
 	{
 	const auto& fname = get_extract_field_val(args, "extract_filename");
 	const auto& limit = get_extract_field_val(args, "extract_limit");
+	const auto& to_store = get_extract_field_val(args, "extract_to_store");
 
-	if ( ! fname || ! limit )
+	if ( ! fname || ! limit || ! to_store )
 		return nullptr;
 
-	return new Extract(std::move(args), file, fname->AsString()->CheckString(), limit->AsCount());
+	return new Extract(std::move(args), file, fname->AsString()->CheckString(), limit->AsCount(),
+	                   to_store->AsBool());
 	}
 
 static bool check_limit_exceeded(uint64_t lim, uint64_t depth, uint64_t len, uint64_t* n)
@@ -95,7 +163,7 @@ static bool check_limit_exceeded(uint64_t lim, uint64_t depth, uint64_t len, uin
 
 bool Extract::DeliverStream(const u_char* data, uint64_t len)
 	{
-	if ( ! file_stream )
+	if ( ! file_stream && ! store )
 		return false;
 
 	uint64_t towrite = 0;
@@ -113,25 +181,70 @@ bool Extract::DeliverStream(const u_char* data, uint64_t len)
 
 	char buf[128];
 
-	if ( towrite > 0 )
+	if ( store )
+		{
+		if ( towrite > 0 )
+			{
+			if ( ! StoreAppend(data, towrite) )
+				return false;
+
+			depth += towrite;
+			}
+
+		if ( limit_exceeded )
+			StoreFinish();
+
+		return (! limit_exceeded);
+		}
+
+	if ( towrite > 0 && job )
+		{
+		auto pool = ExtractPool::Get();
+
+		switch ( pool->Write(job, data, towrite) )
+			{
+			case ExtractPool::Result::Ok:
+				break;
+
+			case ExtractPool::Result::Failed:
+				Fail(pool->Error(job).c_str());
+				return false;
+
+			case ExtractPool::Result::Backlog:
+				if ( file_extraction_backlog )
+					{
+					file_analysis::File* f = GetFile();
+					f->FileEvent(file_extraction_backlog,
+					             {f->ToVal(), GetArgs(), val_mgr->Count(depth)});
+					}
+
+				return false;
+			}
+
+		depth += towrite;
+		}
+
+	else if ( towrite > 0 )
 		{
 		if ( fwrite(data, towrite, 1, file_stream) != 1 )
 			{
 			util::zeek_strerror_r(errno, buf, sizeof(buf));
-			reporter->Error("failed to write to extracted file %s: %s", filename.data(), buf);
-			fclose(file_stream);
-			file_stream = nullptr;
+			Fail(buf);
 			return false;
 			}
 
 		depth += towrite;
+		ExtractPool::CountWritten(towrite);
 		}
 
 	// Assume we may not try to write anything more for a while due to reaching
 	// the extraction limit and the file analysis File still proceeding to
 	// do other analysis without destructing/closing this one until the very end,
 	// so flush anything currently buffered.
-	if ( limit_exceeded && fflush(file_stream) )
+	if ( limit_exceeded && job )
+		ExtractPool::Get()->Flush(job);
+
+	else if ( limit_exceeded && fflush(file_stream) )
 		{
 		util::zeek_strerror_r(errno, buf, sizeof(buf));
 		reporter->Warning("cannot fflush extracted file %s: %s", filename.data(), buf);
@@ -142,20 +255,43 @@ bool Extract::DeliverStream(const u_char* data, uint64_t len)
 
 bool Extract::Undelivered(uint64_t offset, uint64_t len)
 	{
-	if ( ! file_stream )
+	if ( ! file_stream && ! store )
 		return false;
 
 	if ( depth == offset )
 		{
+		if ( store )
+			{
+			std::string zeros(len, '\0');
+
+			if ( ! StoreAppend(reinterpret_cast<const u_char*>(zeros.data()), len) )
+				return false;
+
+			depth += len;
+			return true;
+			}
+
+		if ( job )
+			{
+			auto pool = ExtractPool::Get();
+
+			if ( pool->WriteZeros(job, len) == ExtractPool::Result::Failed )
+				{
+				Fail(pool->Error(job).c_str());
+				return false;
+				}
+
+			depth += len;
+			return true;
+			}
+
 		char* tmp = new char[len]();
 
 		if ( fwrite(tmp, len, 1, file_stream) != 1 )
 			{
 			char buf[128];
 			util::zeek_strerror_r(errno, buf, sizeof(buf));
-			reporter->Error("failed to write to extracted file %s: %s", filename.data(), buf);
-			fclose(file_stream);
-			file_stream = nullptr;
+			Fail(buf);
 			delete[] tmp;
 			return false;
 			}
@@ -167,4 +303,157 @@ bool Extract::Undelivered(uint64_t offset, uint64_t len)
 	return true;
 	}
 
+bool Extract::EndOfFile()
+	{
+	if ( ! store )
+		return true;
+
+	StoreFinish();
+	return false;
+	}
+
+void Extract::Fail(const char* error)
+	{
+	reporter->Error("failed to write to extracted file %s: %s", filename.data(), error);
+
+	if ( job )
+		{
+		ExtractPool::Get()->Close(job);
+		job = nullptr;
+		}
+	else
+		fclose(file_stream);
+
+	file_stream = nullptr;
+
+	if ( store )
+		{
+		unlink(store->tmp_name.c_str());
+		store.reset();
+		}
+	}
+
+bool Extract::StoreAppend(const u_char* data, uint64_t len)
+	{
+	zeek::detail::hash_update(store->sha, data, len);
+
+	if ( ! file_stream )
+		{
+		if ( store->buffer.size() + len <= store->buffer_limit )
+			{
+			store->buffer.append(reinterpret_cast<const char*>(data), len);
+			return true;
+			}
+
+		// Too large to hold back, so it goes to disk after all.
+		if ( ! StoreSpill() )
+			return false;
+		}
+
+	if ( fwrite(data, len, 1, file_stream) != 1 )
+		{
+		char buf[128];
+		util::zeek_strerror_r(errno, buf, sizeof(buf));
+		Fail(buf);
+		return false;
+		}
+
+	ExtractPool::CountWritten(len);
+	return true;
+	}
+
+bool Extract::StoreSpill()
+	{
+	if ( ! util::detail::ensure_intermediate_dirs(store->dir.c_str()) )
+		{
+		reporter->Error("cannot create extraction store %s", store->dir.c_str());
+		store.reset();
+		return false;
+		}
+
+	file_stream = open_extract_file(store->tmp_name);
+
+	if ( ! file_stream )
+		{
+		store.reset();
+		return false;
+		}
+
+	if ( ! store->buffer.empty() )
+		{
+		if ( fwrite(store->buffer.data(), store->buffer.size(), 1, file_stream) != 1 )
+			{
+			char buf[128];
+			util::zeek_strerror_r(errno, buf, sizeof(buf));
+			Fail(buf);
+			return false;
+			}
+
+		ExtractPool::CountWritten(store->buffer.size());
+		}
+
+	store->buffer = std::string();
+	return true;
+	}
+
+void Extract::StoreFinish()
+	{
+	if ( ! store )
+		return;
+
+	u_char digest[SHA256_DIGEST_LENGTH];
+	zeek::detail::hash_final(store->sha, digest);
+	store->sha = nullptr;
+
+	std::string hex = zeek::detail::sha256_digest_print(digest);
+	auto subdir = store->dir + "/" + hex.substr(0, 2);
+	auto rel_path = hex.substr(0, 2) + "/" + hex;
+	auto path = store->dir + "/" + rel_path;
+
+	static const auto& stored_hashes = id::find_val<TableVal>("FileExtract::stored_hashes");
+	auto hex_val = make_intrusive<StringVal>(hex);
+	bool known = stored_hashes->FindOrDefault(hex_val) || access(path.c_str(), F_OK) == 0;
+	char buf[128];
+
+	if ( known )
+		{
+		if ( file_stream )
+			{
+			fclose(file_stream);
+			file_stream = nullptr;
+			unlink(store->tmp_name.c_str());
+			}
+		}
+	else
+		{
+		if ( ! file_stream && ! StoreSpill() )
+			return;
+
+		bool ok = fclose(file_stream) == 0;
+		file_stream = nullptr;
+
+		// Renaming is atomic, so that nothing ever sees a partial file
+		// in the store, and the last of concurrent writers wins.
+		if ( ! ok || ! util::detail::ensure_intermediate_dirs(subdir.c_str()) ||
+		     rename(store->tmp_name.c_str(), path.c_str()) < 0 )
+			{
+			util::zeek_strerror_r(errno, buf, sizeof(buf));
+			reporter->Error("cannot store extracted file %s: %s", path.c_str(), buf);
+			unlink(store->tmp_name.c_str());
+			store.reset();
+			return;
+			}
+		}
+
+	store.reset();
+
+	if ( file_extraction_stored )
+		{
+		file_analysis::File* f = GetFile();
+		f->FileEvent(file_extraction_stored, {f->ToVal(), GetArgs(), std::move(hex_val),
+		                                      make_intrusive<StringVal>(rel_path),
+		                                      val_mgr->Bool(known)});
+		}
+	}
+
 	} // namespace zeek::file_analysis::detail
@@ -3,11 +3,13 @@
 #pragma once
 
 #include <cstdio>
+#include <memory>
 #include <string>
 
 #include "zeek/Val.h"
 #include "zeek/file_analysis/Analyzer.h"
 #include "zeek/file_analysis/File.h"
+#include "zeek/file_analysis/analyzer/extract/ExtractPool.h"
 #include "zeek/file_analysis/analyzer/extract/events.bif.h"
 
 namespace zeek::file_analysis::detail
@@ -41,6 +43,14 @@ public:
 	 */
 	bool Undelivered(uint64_t offset, uint64_t len) override;
 
+	/**
+	 * With FileExtract::use_store, moves the file into the store, unless
+	 * it's there already, and raises "file_extraction_stored".
+	 * @return false in store mode so the analyzer will detach from the
+	 *         file, else true.
+	 */
+	bool EndOfFile() override;
+
 	/**
 	 * Create a new instance of an Extract analyzer.
 	 * @param args the \c AnalyzerArgs value which represents the analyzer.
@@ -65,15 +75,48 @@ protected:
 	 * @param arg_filename a file system path which specifies the local file
 	 *        to which the contents of the file will be extracted/written.
 	 * @param arg_limit the maximum allowed file size.
+	 * @param arg_to_store true to extract into the content-addressed
+	 *        store, see FileExtract::use_store, rather than to
+	 *        \a arg_filename.
 	 */
 	Extract(RecordValPtr args, file_analysis::File* file, const std::string& arg_filename,
-	        uint64_t arg_limit);
+	        uint64_t arg_limit, bool arg_to_store);
 
 private:
+	struct Store;
+
+	/**
+	 * Stops extracting after a write failed, reporting the error.
+	 */
+	void Fail(const char* error);
+
+	/**
+	 * Adds file contents in store mode, holding them back while small.
+	 */
+	bool StoreAppend(const u_char* data, uint64_t len);
+
+	/**
+	 * Starts writing the store's temporary file, with what was held back.
+	 */
+	bool StoreSpill();
+
+	/**
+	 * Moves the extracted file into the store, or drops it if the store
+	 * has it already.
+	 */
+	void StoreFinish();
+
 	std::string filename;
 	FILE* file_stream;
 	uint64_t limit;
 	uint64_t depth;
+
+	// Set if the file gets written by the pool's threads, see
+	// FileExtract::write_threads. The pool owns the stream then.
+	ExtractPool::Job* job = nullptr;
+
+	// Set while extracting into the store.
+	std::unique_ptr<Store> store;
 	};
 
 	} // namespace zeek::file_analysis::detail
@@ -0,0 +1,358 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/file_analysis/analyzer/extract/ExtractPool.h"
+
+#include <algorithm>
+#include <cerrno>
+
+#include "zeek/ID.h"
+#include "zeek/Reporter.h"
+#include "zeek/Val.h"
+#include "zeek/telemetry/Manager.h"
+#include "zeek/threading/Manager.h"
+#include "zeek/util.h"
+
+namespace zeek::file_analysis::detail
+	{
+
+namespace
+	{
+
+// Consecutive small chunks accumulate into one of up to this size, so
+// that workers write in larger pieces.
+constexpr size_t COALESCE_SIZE = 64 * 1024;
+
+const char zeros[COALESCE_SIZE] = {};
+
+struct ExtractMetrics
+	{
+	telemetry::IntCounter written =
+		telemetry_mgr->CounterInstance("zeek", "file-extract-written", {},
+	                                   "Data written to extracted files", "bytes", true);
+	telemetry::DblCounter write_time = telemetry_mgr->CounterInstance<double>(
+		"zeek", "file-extract-write", {}, "Time spent writing extracted files", "seconds",
+		true);
+	telemetry::IntGauge in_flight = telemetry_mgr->GaugeInstance(
+		"zeek", "file-extract-in-flight", {}, "Data of extracted files waiting to get written",
+		"bytes");
+	telemetry::IntCounter aborted = telemetry_mgr->CounterInstance(
+		"zeek", "file-extract-backlog-aborts", {},
+		"Extractions stopped because FileExtract::max_in_flight_bytes was reached", "1", true);
+	};
+
+// Created on the main thread, before any worker uses it.
+ExtractMetrics* metrics()
+	{
+	static ExtractMetrics* m = telemetry_mgr ? new ExtractMetrics() : nullptr;
+	return m;
+	}
+
+std::string errno_string()
+	{
+	char buf[128];
+	util::zeek_strerror_r(errno, buf, sizeof(buf));
+	return buf;
+	}
+
+ExtractPool* the_pool = nullptr;
+bool pool_checked = false;
+
+	} // namespace
+
+ExtractPool* ExtractPool::Get()
+	{
+	if ( ! pool_checked )
+		{
+		pool_checked = true;
+		auto threads = id::find_val("FileExtract::write_threads")->AsCount();
+		auto max_in_flight = id::find_val("FileExtract::max_in_flight_bytes")->AsCount();
+		auto policy = id::find_val("FileExtract::backlog_policy")->AsString()->ToStdString();
+
+		if ( policy != "block" && policy != "abort" )
+			{
+			reporter->Error("FileExtract::backlog_policy: unknown policy '%s'", policy.c_str());
+			policy = "block";
+			}
+
+		if ( threads > 0 )
+			the_pool = new ExtractPool(static_cast<int>(threads), max_in_flight,
+			                           policy == "abort");
+		}
+
+	return the_pool;
+	}
+
+void ExtractPool::Shutdown()
+	{
+	delete the_pool;
+	the_pool = nullptr;
+	}
+
+void ExtractPool::CountWritten(uint64_t bytes)
+	{
+	if ( auto m = metrics() )
+		m->written.Inc(bytes);
+	}
+
+ExtractPool::ExtractPool(int threads, uint64_t arg_max_in_flight, bool arg_abort_on_backlog)
+	: max_in_flight(arg_max_in_flight), abort_on_backlog(arg_abort_on_backlog)
+	{
+	metrics();
+
+	for ( int i = 0; i < std::max(threads, 1); ++i )
+		{
+		workers.emplace_back(&ExtractPool::Work, this);
+		thread_mgr->ApplyAffinity(workers.back(), "file-extract", "file-extract");
+		}
+	}
+
+ExtractPool::~ExtractPool()
+	{
+		{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+		}
+
+	work_cond.notify_all();
+
+	for ( auto& w : workers )
+		w.join();
+
+	ReportErrors();
+	}
+
+ExtractPool::Job* ExtractPool::Open(FILE* stream, std::string filename)
+	{
+	ReportErrors();
+	return new Job(stream, std::move(filename));
+	}
+
+ExtractPool::Result ExtractPool::Write(Job* job, const u_char* data, uint64_t len)
+	{
+	return Queue(job, reinterpret_cast<const char*>(data), len, false);
+	}
+
+ExtractPool::Result ExtractPool::WriteZeros(Job* job, uint64_t len)
+	{
+	return Queue(job, nullptr, len, true);
+	}
+
+ExtractPool::Result ExtractPool::Queue(Job* job, const char* data, uint64_t len, bool zeros)
+	{
+	ReportErrors();
+
+	std::unique_lock<std::mutex> lock(mutex);
+
+	if ( ! job->error.empty() )
+		{
+		job->reported = true;
+		return Result::Failed;
+		}
+
+	if ( len == 0 )
+		return Result::Ok;
+
+	if ( zeros )
+		{
+		if ( ! job->chunks.empty() && job->chunks.back().data.empty() )
+			job->chunks.back().zeros += len;
+		else
+			job->chunks.push_back({{}, len});
+		}
+	else
+		{
+		// Data larger than the cap still goes once nothing else waits.
+		if ( in_flight > 0 && in_flight + len > max_in_flight )
+			{
+			if ( abort_on_backlog )
+				{
+				if ( auto m = metrics() )
+					m->aborted.Inc();
+
+				return Result::Backlog;
+				}
+
+			done_cond.wait(lock, [this, len]
+			               { return in_flight == 0 || in_flight + len <= max_in_flight; });
+
+			if ( ! job->error.empty() )
+				{
+				job->reported = true;
+				return Result::Failed;
+				}
+			}
+
+		// Chunks still queued belong to the main thread, so the last
+		// one can grow in place.
+		if ( ! job->chunks.empty() && job->chunks.back().zeros == 0 &&
+		     job->chunks.back().data.size() + len <= COALESCE_SIZE )
+			job->chunks.back().data.append(data, len);
+		else
+			job->chunks.push_back({std::string(data, len), 0});
+
+		in_flight += len;
+
+		if ( auto m = metrics() )
+			m->in_flight.Inc(len);
+		}
+
+	Schedule(job);
+	return Result::Ok;
+	}
+
+void ExtractPool::Flush(Job* job)
+	{
+	std::lock_guard<std::mutex> lock(mutex);
+	job->flush = true;
+	Schedule(job);
+	}
+
+void ExtractPool::Close(Job* job)
+	{
+	ReportErrors();
+
+	std::lock_guard<std::mutex> lock(mutex);
+	job->closing = true;
+	Schedule(job);
+	}
+
+std::string ExtractPool::Error(Job* job)
+	{
+	std::lock_guard<std::mutex> lock(mutex);
+	return job->error;
+	}
+
+void ExtractPool::Schedule(Job* job)
+	{
+	if ( job->queued )
+		return;
+
+	job->queued = true;
+	runnable.push_back(job);
+	work_cond.notify_one();
+	}
+
+void ExtractPool::ReportErrors()
+	{
+	std::vector<std::string> pending;
+
+		{
+		std::lock_guard<std::mutex> lock(mutex);
+		pending.swap(errors);
+		}
+
+	for ( const auto& e : pending )
+		reporter->Error("%s", e.c_str());
+	}
+
+std::string ExtractPool::Run(Job* job, const std::deque<Chunk>& chunks, bool flush)
+	{
+	for ( const auto& c : chunks )
+		{
+		if ( ! c.data.empty() && fwrite(c.data.data(), c.data.size(), 1, job->stream) != 1 )
+			return errno_string();
+
+		for ( uint64_t n = c.zeros; n > 0; )
+			{
+			auto len = std::min(n, static_cast<uint64_t>(sizeof(zeros)));
+
+			if ( fwrite(zeros, len, 1, job->stream) != 1 )
+				return errno_string();
+
+			n -= len;
+			}
+		}
+
+	if ( flush && fflush(job->stream) )
+		return errno_string();
+
+	return "";
+	}
+
+void ExtractPool::Work()
+	{
+	util::detail::set_thread_name("zk/file-extract");
+
+	for ( ;; )
+		{
+		Job* job;
+		std::deque<Chunk> chunks;
+		bool flush;
+		bool closing;
+		bool failed;
+
+			{
+			std::unique_lock<std::mutex> lock(mutex);
+			work_cond.wait(lock, [this] { return stopping || ! runnable.empty(); });
+
+			// Finish the queued work even when stopping, so that no
+			// extracted file is left incomplete at termination.
+			if ( runnable.empty() )
+				return;
+
+			job = runnable.front();
+			runnable.pop_front();
+			chunks.swap(job->chunks);
+			flush = job->flush;
+			job->flush = false;
+			closing = job->closing;
+			failed = ! job->error.empty();
+			}
+
+		uint64_t bytes = 0;
+
+		for ( const auto& c : chunks )
+			bytes += c.data.size();
+
+		auto start = util::current_time(true);
+		std::string error;
+
+		if ( ! failed )
+			error = Run(job, chunks, flush);
+
+		// Nothing can arrive for a closing job anymore.
+		if ( closing && fclose(job->stream) && error.empty() && ! failed )
+			error = errno_string();
+
+		if ( auto m = metrics() )
+			{
+			m->write_time.Inc(util::current_time(true) - start);
+			m->in_flight.Dec(bytes);
+
+			if ( ! failed && error.empty() )
+				m->written.Inc(bytes);
+			}
+
+			{
+			std::lock_guard<std::mutex> lock(mutex);
+			in_flight -= bytes;
+
+			if ( ! error.empty() && job->error.empty() )
+				job->error = error;
+
+			if ( closing )
+				{
+				// An error that the analyzer didn't get to see.
+				if ( ! job->error.empty() && ! job->reported )
+					errors.push_back("failed to write to extracted file " + job->filename +
+					                 ": " + job->error);
+
+				delete job;
+				}
+
+			else if ( ! job->chunks.empty() || job->flush || job->closing )
+				{
+				// Whatever arrived meanwhile waits for another turn, so
+				// that one large file doesn't hold a worker to itself.
+				runnable.push_back(job);
+				work_cond.notify_one();
+				}
+			else
+				job->queued = false;
+			}
+
+		done_cond.notify_all();
+		}
+	}
+
+	} // namespace zeek::file_analysis::detail
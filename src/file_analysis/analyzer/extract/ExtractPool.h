@@ -0,0 +1,165 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <sys/types.h>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace zeek::file_analysis::detail
+	{
+
+/**
+ * Writes extracted files on a fixed number of worker threads rather than
+ * on the main thread, see FileExtract::write_threads, so that slow
+ * storage doesn't hold up packet processing. The extraction analyzers
+ * queue each file's contents with a job, which workers write out in
+ * order, one worker at a time. The data of all jobs that's waiting to
+ * get written is capped by FileExtract::max_in_flight_bytes.
+ *
+ * Write errors surface on the main thread the next time the pool gets
+ * used, or when it shuts down.
+ */
+class ExtractPool
+	{
+public:
+	/**
+	 * Data queued for writing, or a run of zeros for a gap.
+	 */
+	struct Chunk
+		{
+		std::string data;
+		uint64_t zeros = 0;
+		};
+
+	/**
+	 * The writing of one extracted file.
+	 */
+	struct Job
+		{
+		Job(FILE* arg_stream, std::string arg_filename)
+			: stream(arg_stream), filename(std::move(arg_filename))
+			{
+			}
+
+		// Only touched by a worker while the job is queued.
+		FILE* stream;
+		std::string filename;
+
+		// Guarded by the pool's mutex.
+		std::deque<Chunk> chunks;
+		std::string error;
+		bool reported = false; // The error made it to the analyzer.
+		bool flush = false;
+		bool closing = false;
+		bool queued = false;
+		};
+
+	/**
+	 * The outcome of queuing data.
+	 */
+	enum class Result
+		{
+		Ok,
+		Failed, // Writing the file failed, see Error().
+		Backlog, // The data didn't fit and FileExtract::backlog_policy is "abort".
+		};
+
+	/**
+	 * Returns the pool, creating it on first use, or null if
+	 * FileExtract::write_threads is zero.
+	 */
+	static ExtractPool* Get();
+
+	/**
+	 * Writes out all that's queued and stops the pool's workers. Called
+	 * when Zeek terminates, after all files are gone.
+	 */
+	static void Shutdown();
+
+	/**
+	 * Counts data written to extracted files on the main thread, so that
+	 * metrics cover both ways of writing.
+	 */
+	static void CountWritten(uint64_t bytes);
+
+	/**
+	 * Constructor.
+	 *
+	 * @param threads The number of worker threads, at least one.
+	 *
+	 * @param max_in_flight The most data to have waiting for writing, in
+	 * bytes.
+	 *
+	 * @param abort_on_backlog True to refuse data that doesn't fit, rather
+	 * than waiting for the workers to make room.
+	 */
+	ExtractPool(int threads, uint64_t max_in_flight, bool abort_on_backlog);
+
+	/**
+	 * Destructor. Writes out and closes all remaining files.
+	 */
+	~ExtractPool();
+
+	/**
+	 * Starts writing a file. The pool takes over the stream.
+	 */
+	Job* Open(FILE* stream, std::string filename);
+
+	/**
+	 * Queues data for writing.
+	 */
+	Result Write(Job* job, const u_char* data, uint64_t len);
+
+	/**
+	 * Queues zeros for writing, for a gap in the file's contents.
+	 */
+	Result WriteZeros(Job* job, uint64_t len);
+
+	/**
+	 * Makes the worker flush what it wrote so far, once it gets to it.
+	 */
+	void Flush(Job* job);
+
+	/**
+	 * Closes a file once everything queued for it has been written. The
+	 * job is gone afterwards.
+	 */
+	void Close(Job* job);
+
+	/**
+	 * Returns the error that writing a file ran into. Only valid after
+	 * Write() or WriteZeros() returned Result::Failed.
+	 */
+	std::string Error(Job* job);
+
+private:
+	Result Queue(Job* job, const char* data, uint64_t len, bool zeros);
+	void Schedule(Job* job);
+	void ReportErrors();
+	void Work();
+
+	// Runs a turn of writing the chunks, returning the error if that
+	// fails.
+	static std::string Run(Job* job, const std::deque<Chunk>& chunks, bool flush);
+
+	std::mutex mutex;
+	std::condition_variable work_cond;
+	std::condition_variable done_cond;
+	std::deque<Job*> runnable;
+	std::vector<std::thread> workers;
+	std::vector<std::string> errors; // To report from the main thread.
+	uint64_t max_in_flight;
+	uint64_t in_flight = 0;
+	bool abort_on_backlog;
+	bool stopping = false;
+	};
+
+	} // namespace zeek::file_analysis::detail
@@ -4,6 +4,7 @@
 
 #include "zeek/file_analysis/Component.h"
 #include "zeek/file_analysis/analyzer/extract/Extract.h"
+#include "zeek/file_analysis/analyzer/extract/ExtractPool.h"
 
 namespace zeek::plugin::detail::Zeek_FileExtract
 	{
@@ -21,6 +22,12 @@ public:
 		config.description = "Extract file content";
 		return config;
 		}
+
+	void Done() override
+		{
+		zeek::plugin::Plugin::Done();
+		zeek::file_analysis::detail::ExtractPool::Shutdown();
+		}
 	} plugin;
 
 	} // namespace zeek::plugin::detail::Zeek_FileExtract
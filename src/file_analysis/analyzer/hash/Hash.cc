@@ -2,7 +2,10 @@
 
 #include "zeek/file_analysis/analyzer/hash/Hash.h"
 
+#include <algorithm>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #include "zeek/Event.h"
 #include "zeek/file_analysis/Manager.h"
@@ -11,6 +14,18 @@
 namespace zeek::file_analysis::detail
 	{
 
+namespace
+	{
+
+// The hash analyzers attached to each file.
+std::unordered_map<const File*, std::vector<Hash*>> file_hashes;
+
+// While digests go over a chunk together, each takes a slice of this size
+// at a time, which stays in the CPU's cache for the others.
+constexpr uint64_t SLICE_SIZE = 16 * 1024;
+
+	} // namespace
+
 StringValPtr MD5::kind_val = make_intrusive<StringVal>("md5");
 StringValPtr SHA1::kind_val = make_intrusive<StringVal>("sha1");
 StringValPtr SHA256::kind_val = make_intrusive<StringVal>("sha256");
@@ -21,10 +36,29 @@ Hash::Hash(RecordValPtr args, file_analysis::File* file, HashVal* hv, StringValP
 	  hash(hv), fed(false), kind(std::move(arg_kind))
 	{
 	hash->Init();
+	file_hashes[file].push_back(this);
 	}
 
 Hash::~Hash()
 	{
+	// Without a pool anymore, its workers are done with the job.
+	if ( job )
+		{
+		if ( auto pool = HashPool::Get() )
+			pool->Cancel(job.get());
+		}
+
+	auto it = file_hashes.find(GetFile());
+
+	if ( it != file_hashes.end() )
+		{
+		auto& hashes = it->second;
+		hashes.erase(std::remove(hashes.begin(), hashes.end(), this), hashes.end());
+
+		if ( hashes.empty() )
+			file_hashes.erase(it);
+		}
+
 	Unref(hash);
 	}
 
@@ -33,11 +67,64 @@ bool Hash::DeliverStream(const u_char* data, uint64_t len)
 	if ( ! hash->IsValid() )
 		return false;
 
+	if ( prefed )
+		{
+		// Another of the file's hash analyzers took care of the chunk.
+		prefed = false;
+		return true;
+		}
+
+	// The file's other hash analyzers that are caught up with this one
+	// get the same chunk next, so their digests go over it now as well,
+	// in one pass rather than one after another.
+	static std::vector<Hash*> group;
+	group.clear();
+	group.push_back(this);
+
+	for ( auto h : file_hashes[GetFile()] )
+		{
+		if ( h != this && h->GotStreamDelivery() && ! h->Skipping() && ! h->prefed &&
+		     h->seen == seen && h->hash->IsValid() )
+			{
+			h->prefed = true;
+			group.push_back(h);
+			}
+		}
+
+	for ( auto h : group )
+		h->Take(data, len);
+
+	for ( uint64_t off = 0; off < len; off += SLICE_SIZE )
+		{
+		auto n = std::min(SLICE_SIZE, len - off);
+
+		for ( auto h : group )
+			{
+			if ( ! h->job )
+				h->hash->Feed(data + off, n);
+			}
+		}
+
+	return true;
+	}
+
+void Hash::Take(const u_char* data, uint64_t len)
+	{
 	if ( ! fed )
 		fed = len > 0;
 
-	hash->Feed(data, len);
-	return true;
+	seen += len;
+
+	if ( ! job && len > 0 )
+		{
+		auto pool = HashPool::Get();
+
+		if ( pool && seen > pool->MinBytes() )
+			job = std::make_unique<HashPool::Job>(hash);
+		}
+
+	if ( job && len > 0 )
+		HashPool::Get()->Feed(job.get(), data, len);
 	}
 
 bool Hash::EndOfFile()
@@ -53,6 +140,14 @@ bool Hash::Undelivered(uint64_t offset, uint64_t len)
 
 void Hash::Finalize()
 	{
+	if ( job )
+		{
+		if ( auto pool = HashPool::Get() )
+			pool->Finish(job.get());
+
+		job.reset();
+		}
+
 	if ( ! hash->IsValid() || ! fed )
 		return;
 
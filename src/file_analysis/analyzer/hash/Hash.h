@@ -2,12 +2,14 @@
 
 #pragma once
 
+#include <memory>
 #include <string>
 
 #include "zeek/OpaqueVal.h"
 #include "zeek/Val.h"
 #include "zeek/file_analysis/Analyzer.h"
 #include "zeek/file_analysis/File.h"
+#include "zeek/file_analysis/analyzer/hash/HashPool.h"
 #include "zeek/file_analysis/analyzer/hash/events.bif.h"
 
 namespace zeek::file_analysis::detail
@@ -64,9 +66,25 @@ protected:
 	void Finalize();
 
 private:
+	/**
+	 * Accounts for a chunk of file contents, handing it to the hashing
+	 * threads if the file goes there. The caller feeds the digest
+	 * otherwise.
+	 */
+	void Take(const u_char* data, uint64_t len);
+
 	HashVal* hash;
 	bool fed;
 	StringValPtr kind;
+	uint64_t seen = 0;
+
+	// Set when another of the file's hash analyzers already fed the
+	// digest with the chunk this one gets next.
+	bool prefed = false;
+
+	// Set once the file's contents go to the hashing threads, see
+	// FileHash::hash_threads.
+	std::unique_ptr<HashPool::Job> job;
 	};
 
 /**
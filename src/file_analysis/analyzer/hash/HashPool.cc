@@ -0,0 +1,164 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/file_analysis/analyzer/hash/HashPool.h"
+
+#include <algorithm>
+
+#include "zeek/ID.h"
+#include "zeek/OpaqueVal.h"
+#include "zeek/Val.h"
+#include "zeek/threading/Manager.h"
+#include "zeek/util.h"
+
+namespace zeek::file_analysis::detail
+	{
+
+namespace
+	{
+
+// Consecutive small chunks accumulate into one of up to this size, so
+// that a worker's turn isn't dominated by queueing overhead.
+constexpr size_t COALESCE_SIZE = 64 * 1024;
+
+// How much of a file may be waiting for a worker before the main thread
+// holds off delivering more.
+constexpr size_t MAX_PENDING = 4 * 1024 * 1024;
+
+HashPool* the_pool = nullptr;
+bool pool_checked = false;
+
+	} // namespace
+
+HashPool* HashPool::Get()
+	{
+	if ( ! pool_checked )
+		{
+		pool_checked = true;
+		auto threads = id::find_val("FileHash::hash_threads")->AsCount();
+		auto min_bytes = id::find_val("FileHash::hash_threads_min_bytes")->AsCount();
+
+		if ( threads > 0 )
+			the_pool = new HashPool(static_cast<int>(threads), min_bytes);
+		}
+
+	return the_pool;
+	}
+
+void HashPool::Shutdown()
+	{
+	delete the_pool;
+	the_pool = nullptr;
+	}
+
+HashPool::HashPool(int threads, uint64_t arg_min_bytes) : min_bytes(arg_min_bytes)
+	{
+	for ( int i = 0; i < std::max(threads, 1); ++i )
+		{
+		workers.emplace_back(&HashPool::Work, this);
+		thread_mgr->ApplyAffinity(workers.back(), "file-hash", "file-hash");
+		}
+	}
+
+HashPool::~HashPool()
+	{
+		{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+		}
+
+	work_cond.notify_all();
+
+	for ( auto& w : workers )
+		w.join();
+	}
+
+void HashPool::Feed(Job* job, const u_char* data, uint64_t len)
+	{
+	std::unique_lock<std::mutex> lock(mutex);
+
+	if ( job->pending >= MAX_PENDING )
+		done_cond.wait(lock, [job] { return job->pending < MAX_PENDING; });
+
+	// Chunks still queued belong to the main thread, so the last one can
+	// grow in place.
+	if ( ! job->chunks.empty() && job->chunks.back().size() + len <= COALESCE_SIZE )
+		job->chunks.back().append(reinterpret_cast<const char*>(data), len);
+	else
+		job->chunks.emplace_back(reinterpret_cast<const char*>(data), len);
+
+	job->pending += len;
+
+	if ( job->queued )
+		return;
+
+	job->queued = true;
+	runnable.push_back(job);
+	lock.unlock();
+	work_cond.notify_one();
+	}
+
+void HashPool::Finish(Job* job)
+	{
+	std::unique_lock<std::mutex> lock(mutex);
+	done_cond.wait(lock, [job] { return ! job->queued; });
+	}
+
+void HashPool::Cancel(Job* job)
+	{
+	std::unique_lock<std::mutex> lock(mutex);
+	job->chunks.clear();
+	job->pending = 0;
+	done_cond.wait(lock, [job] { return ! job->queued; });
+	}
+
+void HashPool::Work()
+	{
+	util::detail::set_thread_name("zk/file-hash");
+
+	for ( ;; )
+		{
+		Job* job;
+		std::deque<std::string> chunks;
+
+			{
+			std::unique_lock<std::mutex> lock(mutex);
+			work_cond.wait(lock, [this] { return stopping || ! runnable.empty(); });
+
+			if ( runnable.empty() )
+				return;
+
+			job = runnable.front();
+			runnable.pop_front();
+			chunks.swap(job->chunks);
+			}
+
+		size_t hashed = 0;
+
+		for ( const auto& c : chunks )
+			{
+			job->hash->Feed(c.data(), c.size());
+			hashed += c.size();
+			}
+
+			{
+			std::lock_guard<std::mutex> lock(mutex);
+
+			// A cancelled job has nothing pending anymore.
+			job->pending -= std::min(hashed, job->pending);
+
+			// Whatever arrived meanwhile waits for another turn, so
+			// that one large file doesn't hold a worker to itself.
+			if ( job->chunks.empty() )
+				job->queued = false;
+			else
+				{
+				runnable.push_back(job);
+				work_cond.notify_one();
+				}
+			}
+
+		done_cond.notify_all();
+		}
+	}
+
+	} // namespace zeek::file_analysis::detail
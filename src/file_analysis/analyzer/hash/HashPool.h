@@ -0,0 +1,112 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <sys/types.h>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace zeek
+	{
+
+class HashVal;
+
+namespace file_analysis::detail
+	{
+
+/**
+ * Hashes file contents on a fixed number of worker threads rather than on
+ * the main thread, see FileHash::hash_threads. The hash analyzers hand the
+ * chunks of a file over to a job, which workers feed into the file's
+ * digest in order, one worker at a time. At the end of the file, the
+ * analyzer waits for its job to finish and raises file_hash as usual, so
+ * that scripts see the hash at the same point as before.
+ */
+class HashPool
+	{
+public:
+	/**
+	 * The hashing of one file with one algorithm. Owned by its analyzer.
+	 */
+	struct Job
+		{
+		explicit Job(HashVal* arg_hash) : hash(arg_hash) { }
+
+		HashVal* hash; // Only touched by a worker while the job is queued.
+
+		// Guarded by the pool's mutex.
+		std::deque<std::string> chunks;
+		size_t pending = 0;
+		bool queued = false;
+		};
+
+	/**
+	 * Returns the pool, creating it on first use, or null if
+	 * FileHash::hash_threads is zero.
+	 */
+	static HashPool* Get();
+
+	/**
+	 * Stops the pool's workers. Called when Zeek terminates, after all
+	 * files are gone.
+	 */
+	static void Shutdown();
+
+	/**
+	 * Constructor.
+	 *
+	 * @param threads The number of worker threads, at least one.
+	 *
+	 * @param min_bytes See MinBytes().
+	 */
+	HashPool(int threads, uint64_t min_bytes);
+
+	/**
+	 * Destructor. All jobs must have finished.
+	 */
+	~HashPool();
+
+	/**
+	 * Returns the number of bytes of a file that get hashed on the main
+	 * thread before the file moves to the pool, so that small files
+	 * don't pay for the handover. See FileHash::hash_threads_min_bytes.
+	 */
+	uint64_t MinBytes() const { return min_bytes; }
+
+	/**
+	 * Queues a chunk of a file for hashing. If the job has too much
+	 * queued already, waits for the workers to catch up.
+	 */
+	void Feed(Job* job, const u_char* data, uint64_t len);
+
+	/**
+	 * Waits until all of a job's chunks have been hashed, after which
+	 * the caller may use the digest again.
+	 */
+	void Finish(Job* job);
+
+	/**
+	 * Drops a job's queued chunks and waits until no worker uses the
+	 * digest anymore.
+	 */
+	void Cancel(Job* job);
+
+private:
+	void Work();
+
+	std::mutex mutex;
+	std::condition_variable work_cond;
+	std::condition_variable done_cond;
+	std::deque<Job*> runnable;
+	std::vector<std::thread> workers;
+	uint64_t min_bytes;
+	bool stopping = false;
+	};
+
+	} // namespace file_analysis::detail
+	} // namespace zeek
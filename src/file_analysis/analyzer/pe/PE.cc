@@ -1,6 +1,11 @@
 #include "zeek/file_analysis/analyzer/pe/PE.h"
 
+#include <algorithm>
+
+#include "zeek/ID.h"
+#include "zeek/Reporter.h"
 #include "zeek/file_analysis/Manager.h"
+#include "zeek/util.h"
 
 namespace zeek::file_analysis::detail
 	{
@@ -21,9 +26,19 @@ PE::~PE()
 
 bool PE::DeliverStream(const u_char* data, uint64_t len)
 	{
+	static uint64_t budget_bytes = id::find_val("PE::parse_budget_bytes")->AsCount();
+	static double budget_time = id::find_val("PE::parse_budget_time")->AsInterval();
+
 	if ( conn->is_done() )
 		return false;
 
+	// The headers must fit into the budget, whatever follows them doesn't
+	// get parsed anyway.
+	if ( budget_bytes > 0 )
+		len = std::min(len, budget_bytes - parsed_bytes);
+
+	double start = budget_time > 0.0 ? util::current_time(true) : 0.0;
+
 	try
 		{
 		interp->NewData(data, data + len);
@@ -33,7 +48,30 @@ bool PE::DeliverStream(const u_char* data, uint64_t len)
 		return false;
 		}
 
-	return ! conn->is_done();
+	parsed_bytes += len;
+
+	if ( conn->is_done() )
+		return false;
+
+	if ( budget_bytes > 0 && parsed_bytes >= budget_bytes )
+		return ExceedBudget("bytes");
+
+	if ( budget_time > 0.0 )
+		{
+		parse_time += util::current_time(true) - start;
+
+		if ( parse_time > budget_time )
+			return ExceedBudget("time");
+		}
+
+	return true;
+	}
+
+bool PE::ExceedBudget(const char* what)
+	{
+	reporter->Weird(GetFile(), "pe_parse_budget_exceeded", what);
+	conn->mark_done();
+	return false;
 	}
 
 bool PE::EndOfFile()
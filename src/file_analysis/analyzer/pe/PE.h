@@ -32,6 +32,13 @@ protected:
 	binpac::PE::File* interp;
 	binpac::PE::MockConnection* conn;
 	bool done;
+
+private:
+	// Stops parsing with a weird, returning false.
+	bool ExceedBudget(const char* what);
+
+	uint64_t parsed_bytes = 0;
+	double parse_time = 0.0;
 	};
 
 	} // namespace zeek::file_analysis::detail
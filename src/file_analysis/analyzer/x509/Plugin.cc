@@ -31,6 +31,7 @@ public:
 		{
 		zeek::plugin::Plugin::Done();
 		zeek::file_analysis::detail::X509::FreeRootStore();
+		zeek::file_analysis::detail::X509::FreeParseCache();
 		}
 	} plugin;
 
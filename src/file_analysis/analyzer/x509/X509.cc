@@ -16,6 +16,7 @@
 #endif
 
 #include "zeek/Event.h"
+#include "zeek/ID.h"
 #include "zeek/file_analysis/File.h"
 #include "zeek/file_analysis/Manager.h"
 #include "zeek/file_analysis/analyzer/x509/events.bif.h"
@@ -45,14 +46,22 @@ bool X509::Undelivered(uint64_t offset, uint64_t len)
 bool X509::EndOfFile()
 	{
 	const unsigned char* cert_char = reinterpret_cast<const unsigned char*>(cert_data.data());
-	if ( certificate_cache )
+	std::string digest;
+
+	if ( certificate_cache || ParseCacheEntries() > 0 )
 		{
-		// first step - let's see if the certificate has been cached.
 		unsigned char buf[SHA256_DIGEST_LENGTH];
 		auto ctx = zeek::detail::hash_init(zeek::detail::Hash_SHA256);
 		zeek::detail::hash_update(ctx, cert_char, cert_data.size());
 		zeek::detail::hash_final(ctx, buf);
-		std::string cert_sha256 = zeek::detail::sha256_digest_print(buf);
+		digest.assign(reinterpret_cast<const char*>(buf), sizeof(buf));
+		}
+
+	if ( certificate_cache )
+		{
+		// first step - let's see if the certificate has been cached.
+		std::string cert_sha256 = zeek::detail::sha256_digest_print(
+			reinterpret_cast<const u_char*>(digest.data()));
 		auto index = make_intrusive<StringVal>(cert_sha256);
 		const auto& entry = certificate_cache->Find(index);
 
@@ -70,6 +79,9 @@ bool X509::EndOfFile()
 			}
 		}
 
+	if ( ParseCacheEntries() > 0 && ReplayParsed(digest) )
+		return false;
+
 	// ok, now we can try to parse the certificate with openssl. Should
 	// be rather straightforward...
 	::X509* ssl_cert = d2i_X509(NULL, &cert_char, cert_data.size());
@@ -79,6 +91,11 @@ bool X509::EndOfFile()
 		return false;
 		}
 
+	RecordedEvents events;
+
+	if ( ParseCacheEntries() > 0 )
+		recording = &events;
+
 	X509Val* cert_val = new X509Val(ssl_cert); // cert_val takes ownership of ssl_cert
 
 	// parse basic information into record.
@@ -86,8 +103,8 @@ bool X509::EndOfFile()
 
 	// and send the record on to scriptland
 	if ( x509_certificate )
-		event_mgr.Enqueue(x509_certificate, GetFile()->ToVal(), IntrusivePtr{NewRef{}, cert_val},
-		                  cert_record);
+		EnqueueEvent(x509_certificate,
+		             {GetFile()->ToVal(), IntrusivePtr{NewRef{}, cert_val}, cert_record});
 
 	// after parsing the certificate - parse the extensions...
 
@@ -108,9 +125,54 @@ bool X509::EndOfFile()
 
 	Unref(cert_val); // Same for cert_val
 
+	if ( recording )
+		{
+		recording = nullptr;
+		CacheParsed(digest, std::move(events));
+		}
+
 	return false;
 	}
 
+uint64_t X509::ParseCacheEntries()
+	{
+	static uint64_t entries = id::find_val("X509::parse_cache_entries")->AsCount();
+	return entries;
+	}
+
+bool X509::ReplayParsed(const std::string& digest)
+	{
+	auto it = parse_cache_index.find(digest);
+
+	if ( it == parse_cache_index.end() )
+		return false;
+
+	parse_cache.splice(parse_cache.begin(), parse_cache, it->second);
+
+	for ( const auto& [h, args] : it->second->events )
+		event_mgr.Enqueue(h, CopyEventArgs(args, GetFile()->ToVal()));
+
+	return true;
+	}
+
+void X509::CacheParsed(const std::string& digest, RecordedEvents events)
+	{
+	if ( parse_cache.size() >= ParseCacheEntries() )
+		{
+		parse_cache_index.erase(parse_cache.back().digest);
+		parse_cache.pop_back();
+		}
+
+	parse_cache.push_front({digest, std::move(events)});
+	parse_cache_index.emplace(parse_cache.front().digest, parse_cache.begin());
+	}
+
+void X509::FreeParseCache()
+	{
+	parse_cache_index.clear();
+	parse_cache.clear();
+	}
+
 RecordValPtr X509::ParseCertificate(X509Val* cert_val, file_analysis::File* f)
 	{
 	::X509* ssl_cert = cert_val->GetCertificate();
@@ -310,8 +372,8 @@ void X509::ParseBasicConstraints(X509_EXTENSION* ex)
 				pBasicConstraint->Assign(1,
 				                         static_cast<int32_t>(ASN1_INTEGER_get(constr->pathlen)));
 
-			event_mgr.Enqueue(x509_ext_basic_constraints, GetFile()->ToVal(),
-			                  std::move(pBasicConstraint));
+			EnqueueEvent(x509_ext_basic_constraints,
+			             {GetFile()->ToVal(), std::move(pBasicConstraint)});
 			}
 
 		BASIC_CONSTRAINTS_free(constr);
@@ -452,7 +514,7 @@ void X509::ParseSAN(X509_EXTENSION* ext)
 
 	sanExt->Assign(4, otherfields);
 
-	event_mgr.Enqueue(x509_ext_subject_alternative_name, GetFile()->ToVal(), std::move(sanExt));
+	EnqueueEvent(x509_ext_subject_alternative_name, {GetFile()->ToVal(), std::move(sanExt)});
 	GENERAL_NAMES_free(altname);
 	}
 
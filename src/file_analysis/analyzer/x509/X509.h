@@ -2,8 +2,11 @@
 
 #pragma once
 
+#include <list>
 #include <map>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 
 #include "zeek/Func.h"
 #include "zeek/OpaqueVal.h"
@@ -128,6 +131,12 @@ public:
 		cache_hit_callback = std::move(func);
 		}
 
+	/**
+	 * Empties the cache of parsed certificates, see
+	 * X509::parse_cache_entries. Called when Zeek terminates.
+	 */
+	static void FreeParseCache();
+
 protected:
 	X509(RecordValPtr args, file_analysis::File* file);
 
@@ -136,6 +145,17 @@ private:
 	void ParseSAN(X509_EXTENSION* ex);
 	void ParseExtensionsSpecific(X509_EXTENSION* ex, bool, ASN1_OBJECT*, const char*) override;
 
+	// Raises the events of a certificate whose DER has the given SHA256
+	// digest again, if it's in the parse cache.
+	bool ReplayParsed(const std::string& digest);
+
+	// Adds a certificate's events to the parse cache, making room if
+	// needed.
+	static void CacheParsed(const std::string& digest, RecordedEvents events);
+
+	// The value of X509::parse_cache_entries.
+	static uint64_t ParseCacheEntries();
+
 	std::string cert_data;
 
 	// Helpers for ParseCertificate.
@@ -145,6 +165,17 @@ private:
 	inline static std::map<Val*, X509_STORE*> x509_stores = std::map<Val*, X509_STORE*>();
 	inline static TableValPtr certificate_cache = nullptr;
 	inline static FuncPtr cache_hit_callback = nullptr;
+
+	// The parse cache, most recently used certificates first. The index
+	// refers to the entries' digests.
+	struct ParsedCertificate
+		{
+		std::string digest;
+		RecordedEvents events;
+		};
+	using ParseCache = std::list<ParsedCertificate>;
+	inline static ParseCache parse_cache;
+	inline static std::unordered_map<std::string_view, ParseCache::iterator> parse_cache_index;
 	};
 
 /**
@@ -8,7 +8,9 @@
 #include <openssl/x509.h>
 #include <openssl/x509v3.h>
 
+#include "zeek/Event.h"
 #include "zeek/Reporter.h"
+#include "zeek/Val.h"
 #include "zeek/file_analysis/analyzer/x509/events.bif.h"
 #include "zeek/file_analysis/analyzer/x509/ocsp_events.bif.h"
 #include "zeek/file_analysis/analyzer/x509/types.bif.h"
@@ -23,6 +25,33 @@ X509Common::X509Common(const zeek::Tag& arg_tag, RecordValPtr arg_args,
 	{
 	}
 
+void X509Common::EnqueueEvent(const EventHandlerPtr& h, zeek::Args args)
+	{
+	// The copy keeps neither this file nor what scripts do to the
+	// event's records.
+	if ( recording )
+		recording->emplace_back(h, CopyEventArgs(args, nullptr));
+
+	event_mgr.Enqueue(h, std::move(args));
+	}
+
+zeek::Args X509Common::CopyEventArgs(const zeek::Args& args, ValPtr file)
+	{
+	zeek::Args copy;
+	copy.reserve(args.size());
+	copy.emplace_back(std::move(file));
+
+	for ( size_t i = 1; i < args.size(); ++i )
+		{
+		if ( args[i]->GetType()->Tag() == TYPE_RECORD )
+			copy.emplace_back(args[i]->Clone());
+		else
+			copy.emplace_back(args[i]);
+		}
+
+	return copy;
+	}
+
 static void EmitWeird(const char* name, file_analysis::File* file, const char* addl = "")
 	{
 	if ( file )
@@ -294,9 +323,9 @@ void X509Common::ParseExtension(X509_EXTENSION* ex, const EventHandlerPtr& h, bo
 	// but I am not sure if there is a better way to do it...
 
 	if ( h == ocsp_extension )
-		event_mgr.Enqueue(h, GetFile()->ToVal(), std::move(pX509Ext), val_mgr->Bool(global));
+		EnqueueEvent(h, {GetFile()->ToVal(), std::move(pX509Ext), val_mgr->Bool(global)});
 	else
-		event_mgr.Enqueue(h, GetFile()->ToVal(), std::move(pX509Ext));
+		EnqueueEvent(h, {GetFile()->ToVal(), std::move(pX509Ext)});
 
 	// let individual analyzers parse more.
 	ParseExtensionsSpecific(ex, global, ext_asn, oid);
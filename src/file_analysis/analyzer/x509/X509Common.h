@@ -7,13 +7,16 @@
 
 #include <openssl/asn1.h>
 #include <openssl/x509.h>
+#include <utility>
+#include <vector>
 
+#include "zeek/EventHandler.h"
+#include "zeek/ZeekArgs.h"
 #include "zeek/file_analysis/Analyzer.h"
 
 namespace zeek
 	{
 
-class EventHandlerPtr;
 class Reporter;
 class StringVal;
 template <class T> class IntrusivePtr;
@@ -48,12 +51,34 @@ public:
 	static double GetTimeFromAsn1(const ASN1_TIME* atime, file_analysis::File* f,
 	                              Reporter* reporter);
 
+	/**
+	 * Raises an event about the file, whose value must be the first
+	 * argument. While #recording is set, the event also gets remembered
+	 * there.
+	 */
+	void EnqueueEvent(const EventHandlerPtr& h, zeek::Args args);
+
 protected:
+	using RecordedEvents = std::vector<std::pair<EventHandlerPtr, zeek::Args>>;
+
 	X509Common(const zeek::Tag& arg_tag, RecordValPtr arg_args, file_analysis::File* arg_file);
 
+	/**
+	 * Copies an event's arguments for another file. Records get cloned,
+	 * so that no two events share one that scripts may modify.
+	 *
+	 * @param args the event's arguments, the first of which is the file's
+	 * value.
+	 *
+	 * @param file the value to pass for the file instead.
+	 */
+	static zeek::Args CopyEventArgs(const zeek::Args& args, ValPtr file);
+
 	void ParseExtension(X509_EXTENSION* ex, const EventHandlerPtr& h, bool global);
 	void ParseSignedCertificateTimestamps(X509_EXTENSION* ext);
 	virtual void ParseExtensionsSpecific(X509_EXTENSION* ex, bool, ASN1_OBJECT*, const char*) = 0;
+
+	RecordedEvents* recording = nullptr;
 	};
 
 	} // namespace detail
@@ -0,0 +1,303 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/input/FileWatcher.h"
+
+#include "zeek/zeek-config.h"
+
+#include <fcntl.h>
+#ifdef HAVE_LINUX
+#include <sys/inotify.h>
+#else
+// clang-format off
+#include <sys/types.h>
+#include <sys/event.h>
+// clang-format on
+#endif
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+#include "zeek/Reporter.h"
+#include "zeek/input/ReaderBackend.h"
+#include "zeek/iosource/Manager.h"
+
+namespace zeek::input::detail
+	{
+
+namespace
+	{
+
+#ifdef HAVE_LINUX
+
+// What changes files in a directory, and the directory itself going away.
+constexpr uint32_t DIR_EVENTS = IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_CREATE | IN_DELETE |
+                                IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF |
+                                IN_ONLYDIR;
+
+constexpr uint32_t LOST_EVENTS = IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF;
+
+#else
+
+constexpr u_int DIR_EVENTS = NOTE_WRITE | NOTE_DELETE | NOTE_RENAME | NOTE_REVOKE;
+constexpr u_int FILE_EVENTS = NOTE_WRITE | NOTE_EXTEND | NOTE_ATTRIB | NOTE_DELETE | NOTE_RENAME |
+                              NOTE_REVOKE;
+constexpr u_int LOST_EVENTS = NOTE_DELETE | NOTE_RENAME | NOTE_REVOKE;
+
+// Opens a file or directory just for watching it, returning -1 if that
+// doesn't work.
+int watch_vnode(int kq, const std::string& path, u_int events)
+	{
+#ifdef O_EVTONLY
+	int flags = O_EVTONLY;
+#else
+	int flags = O_RDONLY;
+#endif
+
+	// Non-blocking, so FIFOs don't hang.
+	int vfd = open(path.c_str(), flags | O_NONBLOCK | O_CLOEXEC);
+
+	if ( vfd < 0 )
+		return -1;
+
+	struct kevent ev;
+	EV_SET(&ev, vfd, EVFILT_VNODE, EV_ADD | EV_CLEAR, events, 0, nullptr);
+
+	if ( kevent(kq, &ev, 1, nullptr, 0, nullptr) < 0 )
+		{
+		close(vfd);
+		return -1;
+		}
+
+	return vfd;
+	}
+
+#endif
+
+	} // namespace
+
+FileWatcher::FileWatcher()
+	{
+#ifdef HAVE_LINUX
+	fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#else
+	fd = kqueue();
+#endif
+
+	if ( fd < 0 )
+		{
+		reporter->Warning("cannot watch input files, checking them on heartbeats: %s",
+		                  strerror(errno));
+		return;
+		}
+
+	iosource_mgr->Register(this, true);
+
+	if ( ! iosource_mgr->RegisterFd(fd, this) )
+		reporter->FatalError("Failed to register input file watcher with iosource_mgr");
+	}
+
+FileWatcher::~FileWatcher()
+	{
+#ifndef HAVE_LINUX
+	for ( auto& [id, e] : entries )
+		{
+		if ( e.dir_watch >= 0 )
+			close(e.dir_watch);
+
+		if ( e.file_watch >= 0 )
+			close(e.file_watch);
+		}
+#endif
+
+	if ( fd >= 0 )
+		close(fd);
+	}
+
+int FileWatcher::Watch(const std::string& path, ReaderBackend* backend)
+	{
+	if ( fd < 0 || path.empty() )
+		return -1;
+
+	Entry e;
+	e.backend = backend;
+	e.path = path;
+
+	std::string dir;
+	auto slash = path.rfind('/');
+
+	if ( slash == std::string::npos )
+		{
+		dir = ".";
+		e.name = path;
+		}
+	else
+		{
+		dir = slash == 0 ? "/" : path.substr(0, slash);
+		e.name = path.substr(slash + 1);
+		}
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+#ifdef HAVE_LINUX
+	e.dir_watch = inotify_add_watch(fd, dir.c_str(), DIR_EVENTS);
+
+	if ( e.dir_watch < 0 )
+		return -1;
+
+	++dir_refs[e.dir_watch];
+#else
+	e.dir_watch = watch_vnode(fd, dir, DIR_EVENTS);
+
+	if ( e.dir_watch < 0 )
+		return -1;
+
+	// May not exist yet, the directory's events tell when it does.
+	e.file_watch = watch_vnode(fd, path, FILE_EVENTS);
+#endif
+
+	int id = next_id++;
+	entries.emplace(id, std::move(e));
+	return id;
+	}
+
+void FileWatcher::Unwatch(int id)
+	{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	auto it = entries.find(id);
+
+	if ( it == entries.end() )
+		return;
+
+	auto& e = it->second;
+
+#ifdef HAVE_LINUX
+	if ( e.dir_watch >= 0 && --dir_refs[e.dir_watch] == 0 )
+		{
+		dir_refs.erase(e.dir_watch);
+		inotify_rm_watch(fd, e.dir_watch);
+		}
+#else
+	if ( e.dir_watch >= 0 )
+		close(e.dir_watch);
+
+	if ( e.file_watch >= 0 )
+		close(e.file_watch);
+#endif
+
+	entries.erase(it);
+	}
+
+void FileWatcher::RewatchFile(Entry* e)
+	{
+#ifndef HAVE_LINUX
+	if ( e->file_watch >= 0 )
+		close(e->file_watch);
+
+	e->file_watch = watch_vnode(fd, e->path, FILE_EVENTS);
+#endif
+	}
+
+void FileWatcher::Process()
+	{
+#ifdef HAVE_LINUX
+	alignas(struct inotify_event) char buf[16384];
+
+	for ( ;; )
+		{
+		ssize_t n = read(fd, buf, sizeof(buf));
+
+		if ( n <= 0 )
+			break;
+
+		std::lock_guard<std::mutex> lock(mutex);
+
+		for ( char* p = buf; p < buf + n; )
+			{
+			auto* ev = reinterpret_cast<struct inotify_event*>(p);
+			p += sizeof(struct inotify_event) + ev->len;
+
+			if ( ev->mask & IN_Q_OVERFLOW )
+				{
+				// Events got dropped, so anything may have changed.
+				for ( auto& [id, e] : entries )
+					e.backend->NotifyFileChanged(false);
+
+				continue;
+				}
+
+			// If the directory went away, the readers need to go
+			// back to checking on their own.
+			bool lost = ev->mask & LOST_EVENTS;
+
+			for ( auto& [id, e] : entries )
+				{
+				if ( e.dir_watch != ev->wd )
+					continue;
+
+				if ( lost )
+					{
+					e.dir_watch = -1;
+					e.backend->NotifyFileChanged(true);
+					}
+
+				else if ( ev->len > 0 && e.name == ev->name )
+					e.backend->NotifyFileChanged(false);
+				}
+
+			if ( lost && dir_refs.erase(ev->wd) )
+				inotify_rm_watch(fd, ev->wd);
+			}
+		}
+#else
+	struct kevent events[64];
+	struct timespec no_wait = {0, 0};
+
+	for ( ;; )
+		{
+		int n = kevent(fd, nullptr, 0, events, 64, &no_wait);
+
+		if ( n <= 0 )
+			break;
+
+		std::lock_guard<std::mutex> lock(mutex);
+
+		for ( int i = 0; i < n; ++i )
+			{
+			int vfd = static_cast<int>(events[i].ident);
+			bool lost = events[i].fflags & LOST_EVENTS;
+
+			for ( auto& [id, e] : entries )
+				{
+				if ( e.dir_watch == vfd )
+					{
+					if ( lost )
+						{
+						close(e.dir_watch);
+						e.dir_watch = -1;
+						}
+					else
+						// Entries changed, the file may have been
+						// created or replaced.
+						RewatchFile(&e);
+
+					e.backend->NotifyFileChanged(lost);
+					}
+
+				else if ( e.file_watch == vfd )
+					{
+					if ( lost )
+						RewatchFile(&e);
+
+					e.backend->NotifyFileChanged(false);
+					}
+				}
+			}
+
+		if ( n < 64 )
+			break;
+		}
+#endif
+	}
+
+	} // namespace zeek::input::detail
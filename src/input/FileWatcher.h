@@ -0,0 +1,93 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <string>
+
+#include "zeek/iosource/IOSource.h"
+
+namespace zeek::input
+	{
+
+class ReaderBackend;
+
+namespace detail
+	{
+
+/**
+ * Tells readers when the files they read change, through inotify on Linux
+ * and kqueue elsewhere, so that they don't need to check them on every
+ * heartbeat. It watches the directories of the files, which also catches
+ * files getting created, replaced or removed, and on kqueue additionally
+ * the files themselves for their content. Notifications get sent to a
+ * reader as an update message in its queue; several changes before the
+ * reader gets to it make for one message.
+ *
+ * Readers may watch and unwatch from their own threads, while changes get
+ * picked up on the main thread. The watcher registers itself with the
+ * iosource manager, which owns it.
+ */
+class FileWatcher final : public iosource::IOSource
+	{
+public:
+	FileWatcher();
+	~FileWatcher() override;
+
+	/**
+	 * Starts watching a file for a reader. The file doesn't need to
+	 * exist, but its directory does.
+	 *
+	 * @param path The file.
+	 *
+	 * @param backend The reader to notify.
+	 *
+	 * @return An ID for Unwatch(), or -1 if the file can't be watched,
+	 * in which case the reader needs to check it itself.
+	 */
+	int Watch(const std::string& path, ReaderBackend* backend);
+
+	/**
+	 * Stops watching a file. Once this returns, no more notifications
+	 * for it get sent.
+	 *
+	 * @param id The ID that Watch() returned.
+	 */
+	void Unwatch(int id);
+
+	// IOSource interface.
+	double GetNextTimeout() override { return -1; }
+	void Process() override;
+	const char* Tag() override { return "Input::FileWatcher"; }
+
+private:
+	struct Entry
+		{
+		ReaderBackend* backend;
+		std::string path;
+		std::string name; // Within the directory.
+
+		// The inotify watch of the directory, or with kqueue, the
+		// descriptors of the directory and the file. -1 if not open.
+		int dir_watch = -1;
+		int file_watch = -1;
+		};
+
+	// With kqueue, reopens the file to watch after it got replaced.
+	void RewatchFile(Entry* e);
+
+	std::mutex mutex;
+	std::map<int, Entry> entries;
+	int next_id = 0;
+
+	// The inotify instance or kqueue.
+	int fd = -1;
+
+	// The number of entries for each inotify watch, as a directory only
+	// gets one.
+	std::map<int, int> dir_refs;
+	};
+
+	} // namespace detail
+	} // namespace zeek::input
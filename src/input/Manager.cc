@@ -14,10 +14,12 @@
 #include "zeek/NetVar.h"
 #include "zeek/RunState.h"
 #include "zeek/file_analysis/Manager.h"
+#include "zeek/input/FileWatcher.h"
 #include "zeek/input/ReaderBackend.h"
 #include "zeek/input/ReaderFrontend.h"
 #include "zeek/input/input.bif.h"
 #include "zeek/module_util.h"
+#include "zeek/threading/Manager.h"
 #include "zeek/threading/SerialTypes.h"
 
 using namespace std;
@@ -95,6 +97,7 @@ public:
 	unsigned int num_idx_fields;
 	unsigned int num_val_fields;
 	bool want_record;
+	bool delta; // The reader only sends changes.
 
 	TableVal* tab;
 	RecordType* rtype;
@@ -135,7 +138,7 @@ public:
 
 Manager::TableStream::TableStream()
 	: Manager::Stream::Stream(TABLE_STREAM), num_idx_fields(), num_val_fields(), want_record(),
-	  tab(), rtype(), itype(), currDict(), lastDict(), pred(), event()
+	  delta(), tab(), rtype(), itype(), currDict(), lastDict(), pred(), event()
 	{
 	}
 
@@ -210,8 +213,16 @@ ReaderBackend* Manager::CreateBackend(ReaderFrontend* frontend, EnumVal* tag)
 	return backend;
 	}
 
+detail::FileWatcher* Manager::GetFileWatcher()
+	{
+	if ( ! file_watcher )
+		file_watcher = new detail::FileWatcher();
+
+	return file_watcher;
+	}
+
 // Create a new input reader object to be used at whomevers leisure later on.
-bool Manager::CreateStream(Stream* info, RecordVal* description)
+bool Manager::CreateStream(Stream* info, RecordVal* description, int delta_index_fields)
 	{
 	RecordType* rtype = description->GetType()->AsRecordType();
 	if ( ! (same_type(rtype, BifType::Record::Input::TableDescription, false) ||
@@ -240,6 +251,7 @@ bool Manager::CreateStream(Stream* info, RecordVal* description)
 	ReaderBackend::ReaderInfo rinfo;
 	rinfo.source = util::copy_string(source.c_str());
 	rinfo.name = util::copy_string(name.c_str());
+	rinfo.delta_index_fields = delta_index_fields;
 
 	auto mode_val = description->GetFieldOrDefault("mode");
 	auto mode = mode_val->AsEnumVal();
@@ -686,9 +698,13 @@ bool Manager::CreateTableStream(RecordVal* fval)
 		return false;
 		}
 
+	// With delta reloads, the reader compares reloads with the previous
+	// version itself and only sends the changes.
+	int delta_index_fields = fval->GetFieldOrDefault("delta")->AsBool() ? idxfields : 0;
+
 	TableStream* stream = new TableStream();
 		{
-		bool res = CreateStream(stream, fval);
+		bool res = CreateStream(stream, fval, delta_index_fields);
 		if ( ! res )
 			{
 			delete stream;
@@ -715,6 +731,7 @@ bool Manager::CreateTableStream(RecordVal* fval)
 	stream->lastDict = new PDict<InputHash>;
 	stream->lastDict->SetDeleteFunc(input_hash_delete_func);
 	stream->want_record = (want_record->InternalInt() == 1);
+	stream->delta = (delta_index_fields > 0);
 
 	assert(stream->reader);
 	stream->reader->Init(fieldsV.size(), fields);
@@ -1141,6 +1158,12 @@ void Manager::SendEntry(ReaderFrontend* reader, Value** vals)
 		return;
 		}
 
+	int readFields = SendEntry(i, vals);
+	Value::delete_value_ptr_array(vals, readFields);
+	}
+
+int Manager::SendEntry(Stream* i, const Value* const* vals)
+	{
 	int readFields = 0;
 
 	if ( i->stream_type == TABLE_STREAM )
@@ -1164,7 +1187,7 @@ void Manager::SendEntry(ReaderFrontend* reader, Value** vals)
 	else
 		assert(false);
 
-	Value::delete_value_ptr_array(vals, readFields);
+	return readFields;
 	}
 
 int Manager::SendEntryTable(Stream* i, const Value* const* vals)
@@ -1498,6 +1521,12 @@ void Manager::Put(ReaderFrontend* reader, Value** vals)
 		return;
 		}
 
+	int readFields = Put(i, vals);
+	Value::delete_value_ptr_array(vals, readFields);
+	}
+
+int Manager::Put(Stream* i, const Value* const* vals)
+	{
 #ifdef DEBUG
 	DBG_LOG(DBG_INPUT, "Put for stream %s", i->name.c_str());
 #endif
@@ -1525,7 +1554,7 @@ void Manager::Put(ReaderFrontend* reader, Value** vals)
 	else
 		assert(false);
 
-	Value::delete_value_ptr_array(vals, readFields);
+	return readFields;
 	}
 
 int Manager::SendEventStreamEvent(Stream* i, EnumVal* type, const Value* const* vals)
@@ -1748,8 +1777,16 @@ bool Manager::Delete(ReaderFrontend* reader, Value** vals)
 		return false;
 		}
 
-	bool success = false;
 	int readVals = 0;
+	bool success = Delete(i, vals, &readVals);
+	Value::delete_value_ptr_array(vals, readVals);
+	return success;
+	}
+
+bool Manager::Delete(Stream* i, const Value* const* vals, int* readVals)
+	{
+	bool success = false;
+	*readVals = 0;
 
 	if ( i->stream_type == TABLE_STREAM )
 		{
@@ -1757,7 +1794,7 @@ bool Manager::Delete(ReaderFrontend* reader, Value** vals)
 		bool convert_error = false;
 		Val* idxval = ValueToIndexVal(i, stream->num_idx_fields, stream->itype, vals,
 		                              convert_error);
-		readVals = stream->num_idx_fields + stream->num_val_fields;
+		*readVals = stream->num_idx_fields + stream->num_val_fields;
 		bool streamresult = true;
 
 		if ( convert_error )
@@ -1799,29 +1836,47 @@ bool Manager::Delete(ReaderFrontend* reader, Value** vals)
 			// only if stream = true -> no streaming
 			if ( streamresult && stream->event )
 				{
-				Ref(idxval);
-				assert(val != nullptr);
-				auto ev = BifType::Enum::Input::Event->GetEnumVal(BifEnum::Input::EVENT_REMOVED);
-				if ( stream->num_val_fields == 0 )
-					SendEvent(stream->event, 3, stream->description->Ref(), ev.release(), idxval);
+				// The event takes the index as a record, like with
+				// the other operations.
+				int startpos = 0;
+				bool event_convert_error = false;
+				Val* predidx = ValueToRecordVal(i, vals, stream->itype, &startpos,
+				                                event_convert_error);
+
+				if ( event_convert_error )
+					Unref(predidx);
 				else
-					SendEvent(stream->event, 4, stream->description->Ref(), ev.release(), idxval,
-					          IntrusivePtr{val}.release());
+					{
+					assert(val != nullptr);
+					auto ev = BifType::Enum::Input::Event->GetEnumVal(
+						BifEnum::Input::EVENT_REMOVED);
+					if ( stream->num_val_fields == 0 )
+						SendEvent(stream->event, 3, stream->description->Ref(), ev.release(),
+						          predidx);
+					else
+						SendEvent(stream->event, 4, stream->description->Ref(), ev.release(),
+						          predidx, IntrusivePtr{val}.release());
+					}
 				}
 			}
 
 		// only if stream = true -> no streaming
 		if ( streamresult )
 			{
-			if ( ! stream->tab->Remove(*idxval) )
+			// With delta reloads, the entry may never have made it
+			// into the table because of the predicate.
+			if ( ! stream->tab->Remove(*idxval) && ! stream->delta )
 				Warning(i, "Internal error while deleting values from input table");
+
+			Unref(idxval);
+			success = true;
 			}
 		}
 
 	else if ( i->stream_type == EVENT_STREAM )
 		{
 		auto type = BifType::Enum::Input::Event->GetEnumVal(BifEnum::Input::EVENT_REMOVED);
-		readVals = SendEventStreamEvent(i, type.release(), vals);
+		*readVals = SendEventStreamEvent(i, type.release(), vals);
 		success = true;
 		}
 
@@ -1837,10 +1892,57 @@ bool Manager::Delete(ReaderFrontend* reader, Value** vals)
 		return false;
 		}
 
-	Value::delete_value_ptr_array(vals, readVals);
 	return success;
 	}
 
+bool Manager::ProcessBatch(ReaderFrontend* reader, ReaderBatch* batch)
+	{
+	Stream* i = FindStream(reader);
+	if ( i == nullptr )
+		{
+		reporter->InternalWarning("Unknown reader %s in ProcessBatch", reader->Name());
+		return true;
+		}
+
+	// Outside of a pass over the threads' output, such as when
+	// flushing at termination, the whole batch goes in one go.
+	double started = thread_mgr->PassStarted();
+	double budget = BifConst::Input::batch_time_budget;
+	bool limited = started > 0 && budget > 0;
+
+	while ( batch->processed < batch->Rows() )
+		{
+		int n = batch->processed++;
+		Value** vals = batch->Row(n);
+		int readVals = 0;
+
+		switch ( batch->GetKind() )
+			{
+			case ReaderBatch::PUT:
+				Put(i, vals);
+				break;
+
+			case ReaderBatch::DELETE:
+				Delete(i, vals, &readVals);
+				break;
+
+			case ReaderBatch::SEND_ENTRY:
+				SendEntry(i, vals);
+				break;
+			}
+
+		batch->Release(n);
+
+		// Looking at the clock for every row would cost more
+		// than it saves.
+		if ( limited && batch->processed % 64 == 0 &&
+		     util::current_time() - started > budget )
+			return batch->processed == batch->Rows();
+		}
+
+	return true;
+	}
+
 bool Manager::CallPred(Func* pred_func, const int numvals, ...) const
 	{
 	bool result = false;
@@ -22,6 +22,12 @@ namespace input
 
 class ReaderFrontend;
 class ReaderBackend;
+class ReaderBatch;
+
+namespace detail
+	{
+class FileWatcher;
+	}
 
 /**
  * Singleton class for managing input streams.
@@ -118,10 +124,17 @@ public:
 	 */
 	static bool IsCompatibleType(Type* t, bool atomic_only = false);
 
+	/**
+	 * Returns the watcher that tells readers when their files change,
+	 * creating it on first use. Must be called from the main thread.
+	 */
+	detail::FileWatcher* GetFileWatcher();
+
 protected:
 	friend class ReaderFrontend;
 	friend class PutMessage;
 	friend class DeleteMessage;
+	friend class BatchMessage;
 	friend class ClearMessage;
 	friend class SendEntryMessage;
 	friend class EndCurrentSendMessage;
@@ -146,6 +159,12 @@ protected:
 	void SendEntry(ReaderFrontend* reader, threading::Value** vals);
 	void EndCurrentSend(ReaderFrontend* reader);
 
+	// Processes the rows of a batch that a reader sends instead of
+	// single Put, Delete or SendEntry calls. Sticks to the time budget
+	// of Input::batch_time_budget per pass over the threads' output,
+	// and returns false if there are rows left for another pass.
+	bool ProcessBatch(ReaderFrontend* reader, ReaderBatch* batch);
+
 	// Instantiates a new ReaderBackend of the given type (note that
 	// doing so creates a new thread!).
 	ReaderBackend* CreateBackend(ReaderFrontend* frontend, EnumVal* tag);
@@ -185,7 +204,9 @@ private:
 	// protected definitions are wrappers around this function.
 	bool RemoveStream(Stream* i);
 
-	bool CreateStream(Stream*, RecordVal* description);
+	// For table streams, delta_index_fields is the number of index fields
+	// if the reader is to send only changes, or zero otherwise.
+	bool CreateStream(Stream*, RecordVal* description, int delta_index_fields = 0);
 
 	// Check if the types of the error_ev event are correct. If table is
 	// true, check for tablestream type, otherwhise check for eventstream
@@ -193,6 +214,13 @@ private:
 	bool CheckErrorEventTypes(const std::string& stream_name, const Func* error_event,
 	                          bool table) const;
 
+	// Put, Delete and SendEntry implementations for a known stream. They
+	// return the number of values they used, which the caller deletes;
+	// Delete returns whether it succeeded and sets that in readVals.
+	int Put(Stream* i, const threading::Value* const* vals);
+	bool Delete(Stream* i, const threading::Value* const* vals, int* readVals);
+	int SendEntry(Stream* i, const threading::Value* const* vals);
+
 	// SendEntry implementation for Table stream.
 	int SendEntryTable(Stream* i, const threading::Value* const* vals);
 
@@ -277,6 +305,9 @@ private:
 	std::map<ReaderFrontend*, Stream*> readers;
 
 	EventHandlerPtr end_of_data;
+
+	// Owned by the iosource manager.
+	detail::FileWatcher* file_watcher = nullptr;
 	};
 
 	} // namespace input
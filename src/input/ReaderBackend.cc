@@ -3,8 +3,12 @@
 #include "zeek/input/ReaderBackend.h"
 
 #include "zeek/Desc.h"
+#include "zeek/Hash.h"
+#include "zeek/SerializationFormat.h"
+#include "zeek/input/FileWatcher.h"
 #include "zeek/input/Manager.h"
 #include "zeek/input/ReaderFrontend.h"
+#include "zeek/input/input.bif.h"
 
 using zeek::threading::Field;
 using zeek::threading::Value;
@@ -44,6 +48,29 @@ private:
 	Value** val;
 	};
 
+class BatchMessage final : public threading::OutputMessage<ReaderFrontend>
+	{
+public:
+	BatchMessage(ReaderFrontend* reader, ReaderBatch* batch)
+		: threading::OutputMessage<ReaderFrontend>("Batch", reader), batch(batch)
+		{
+		}
+
+	~BatchMessage() override { delete batch; }
+
+	bool Process() override
+		{
+		finished = input_mgr->ProcessBatch(Object(), batch);
+		return true;
+		}
+
+	bool Unfinished() const override { return ! finished; }
+
+private:
+	ReaderBatch* batch;
+	bool finished = false;
+	};
+
 class ClearMessage final : public threading::OutputMessage<ReaderFrontend>
 	{
 public:
@@ -176,6 +203,20 @@ public:
 		}
 	};
 
+class FileChangedMessage final : public threading::InputMessage<ReaderBackend>
+	{
+public:
+	FileChangedMessage(ReaderBackend* backend, bool lost)
+		: threading::InputMessage<ReaderBackend>("FileChanged", backend), lost(lost)
+		{
+		}
+
+	bool Process() override { return Object()->FileChanged(lost); }
+
+private:
+	bool lost;
+	};
+
 bool ReaderErrorMessage::Process()
 	{
 	switch ( type )
@@ -197,6 +238,37 @@ bool ReaderErrorMessage::Process()
 	return true;
 	}
 
+ReaderBatch::ReaderBatch(Kind arg_kind, int arg_num_fields, int capacity)
+	{
+	kind = arg_kind;
+	num_fields = arg_num_fields;
+	vals.reserve(static_cast<size_t>(capacity) * num_fields);
+	}
+
+ReaderBatch::~ReaderBatch()
+	{
+	for ( auto v : vals )
+		delete v;
+	}
+
+void ReaderBatch::Add(Value** row)
+	{
+	vals.insert(vals.end(), row, row + num_fields);
+	delete[] row;
+	++rows;
+	}
+
+void ReaderBatch::Release(int n)
+	{
+	Value** row = Row(n);
+
+	for ( int i = 0; i < num_fields; ++i )
+		{
+		delete row[i];
+		row[i] = nullptr;
+		}
+	}
+
 using namespace input;
 
 ReaderBackend::ReaderBackend(ReaderFrontend* arg_frontend) : MsgThread()
@@ -207,42 +279,166 @@ ReaderBackend::ReaderBackend(ReaderFrontend* arg_frontend) : MsgThread()
 	num_fields = 0;
 	fields = nullptr;
 
+	batch_size = BifConst::Input::batch_size;
+
+	auto size = info->config.find("batch_size");
+
+	if ( size != info->config.end() )
+		batch_size = atoi(size->second);
+
+	if ( BifConst::Input::watch_files )
+		file_watcher = input_mgr->GetFileWatcher();
+
 	SetName(frontend->Name());
 	}
 
 ReaderBackend::~ReaderBackend()
 	{
+	StopWatchingFile();
+	delete batch;
 	delete info;
 	}
 
+void ReaderBackend::AddToBatch(ReaderBatch::Kind kind, Value** vals)
+	{
+	if ( batch && batch->GetKind() != kind )
+		FlushBatch();
+
+	if ( ! batch )
+		batch = new ReaderBatch(kind, num_fields, batch_size);
+
+	batch->Add(vals);
+
+	if ( batch->Rows() >= batch_size )
+		FlushBatch();
+	}
+
+void ReaderBackend::FlushBatch()
+	{
+	if ( ! batch )
+		return;
+
+	SendOut(new BatchMessage(frontend, batch));
+	batch = nullptr;
+	}
+
 void ReaderBackend::Put(Value** val)
 	{
-	SendOut(new PutMessage(frontend, val));
+	if ( batch_size > 1 )
+		AddToBatch(ReaderBatch::PUT, val);
+	else
+		SendOut(new PutMessage(frontend, val));
 	}
 
 void ReaderBackend::Delete(Value** val)
 	{
-	SendOut(new DeleteMessage(frontend, val));
+	if ( batch_size > 1 )
+		AddToBatch(ReaderBatch::DELETE, val);
+	else
+		SendOut(new DeleteMessage(frontend, val));
 	}
 
 void ReaderBackend::Clear()
 	{
+	FlushBatch();
 	SendOut(new ClearMessage(frontend));
 	}
 
 void ReaderBackend::EndCurrentSend()
 	{
-	SendOut(new EndCurrentSendMessage(frontend));
+	if ( info->delta_index_fields == 0 )
+		{
+		FlushBatch();
+		SendOut(new EndCurrentSendMessage(frontend));
+		return;
+		}
+
+	// What's left from the previous send is gone from the source. The
+	// manager only looks at the index fields for deleting, so leave the
+	// value fields unset.
+	int num_idx = info->delta_index_fields;
+
+	for ( const auto& [key, valhash] : delta_last )
+		{
+		zeek::detail::BinarySerializationFormat fmt;
+		fmt.StartRead(key.data(), key.size());
+
+		Value** vals = new Value*[num_fields];
+
+		for ( int i = 0; i < static_cast<int>(num_fields); ++i )
+			{
+			vals[i] = new Value(fields[i]->type, fields[i]->subtype, false);
+
+			if ( i < num_idx )
+				vals[i]->Read(&fmt);
+			}
+
+		fmt.EndRead();
+		Delete(vals);
+		}
+
+	delta_last.clear();
+	delta_last.swap(delta_curr);
+
+	EndOfData();
 	}
 
 void ReaderBackend::EndOfData()
 	{
+	FlushBatch();
 	SendOut(new EndOfDataMessage(frontend));
 	}
 
 void ReaderBackend::SendEntry(Value** vals)
 	{
-	SendOut(new SendEntryMessage(frontend, vals));
+	if ( info->delta_index_fields == 0 )
+		{
+		if ( batch_size > 1 )
+			AddToBatch(ReaderBatch::SEND_ENTRY, vals);
+		else
+			SendOut(new SendEntryMessage(frontend, vals));
+
+		return;
+		}
+
+	int num_idx = info->delta_index_fields;
+	auto key = SerializeValues(num_idx, vals);
+	auto vals_data = SerializeValues(num_fields - num_idx, vals + num_idx);
+	uint64_t valhash = zeek::detail::KeyedHash::StaticHash64(vals_data.data(), vals_data.size());
+
+	auto last = delta_last.find(key);
+
+	if ( last != delta_last.end() )
+		{
+		bool unchanged = (last->second == valhash);
+		delta_last.erase(last);
+
+		if ( unchanged )
+			{
+			delta_curr[std::move(key)] = valhash;
+			Value::delete_value_ptr_array(vals, num_fields);
+			return;
+			}
+		}
+
+	delta_curr[std::move(key)] = valhash;
+	Put(vals);
+	}
+
+std::string ReaderBackend::SerializeValues(int num_vals, const Value* const* vals)
+	{
+	zeek::detail::BinarySerializationFormat fmt;
+	fmt.StartWrite();
+
+	for ( int i = 0; i < num_vals; ++i )
+		vals[i]->Write(&fmt);
+
+	char* data;
+	uint32_t len = fmt.EndWrite(&data);
+	std::string result(data, len);
+	free(data);
+
+	return result;
 	}
 
 bool ReaderBackend::Init(const int arg_num_fields, const threading::Field* const* arg_fields)
@@ -274,6 +470,8 @@ bool ReaderBackend::OnFinish(double network_time)
 	if ( ! Failed() )
 		DoClose();
 
+	StopWatchingFile();
+	FlushBatch();
 	disabled = true; // frontend disables itself when it gets the Close-message.
 	SendOut(new ReaderClosedMessage(frontend));
 
@@ -298,12 +496,58 @@ bool ReaderBackend::Update()
 		return true;
 
 	bool success = DoUpdate();
+	FlushBatch();
+
 	if ( ! success )
 		DisableFrontend();
 
 	return ! disabled; // always return failure if we have been disabled in the meantime
 	}
 
+bool ReaderBackend::WatchFile(const std::string& path)
+	{
+	StopWatchingFile();
+
+	if ( file_watcher )
+		file_watch = file_watcher->Watch(path, this);
+
+	return FileWatched();
+	}
+
+void ReaderBackend::StopWatchingFile()
+	{
+	if ( file_watch < 0 )
+		return;
+
+	file_watcher->Unwatch(file_watch);
+	file_watch = -1;
+	}
+
+void ReaderBackend::NotifyFileChanged(bool lost)
+	{
+	// One message covers all changes until the reader gets to it.
+	if ( file_change_pending.exchange(true) && ! lost )
+		return;
+
+	SendIn(new FileChangedMessage(this, lost));
+	}
+
+bool ReaderBackend::FileChanged(bool lost)
+	{
+	// Clear first, so that changes during the update get another one.
+	file_change_pending = false;
+
+	if ( lost )
+		StopWatchingFile();
+
+	if ( Failed() )
+		return true;
+
+	// Like on heartbeats, a disabled reader just ignores it.
+	Update();
+	return true;
+	}
+
 void ReaderBackend::DisableFrontend()
 	{
 	// We might already have been disabled - e.g., due to a call to
@@ -313,6 +557,7 @@ void ReaderBackend::DisableFrontend()
 
 	// We also set disabled here, because there still may be other
 	// messages queued and we will dutifully ignore these from now.
+	FlushBatch();
 	disabled = true;
 	SendOut(new DisableMessage(frontend));
 	}
@@ -322,11 +567,20 @@ bool ReaderBackend::OnHeartbeat(double network_time, double current_time)
 	if ( Failed() )
 		return true;
 
-	return DoHeartbeat(network_time, current_time);
+	bool result = DoHeartbeat(network_time, current_time);
+	FlushBatch();
+	return result;
+	}
+
+void ReaderBackend::SendEvent(const char* name, const int num_vals, Value** vals)
+	{
+	FlushBatch();
+	MsgThread::SendEvent(name, num_vals, vals);
 	}
 
 void ReaderBackend::Info(const char* msg)
 	{
+	FlushBatch();
 	SendOut(new ReaderErrorMessage(frontend, ReaderErrorMessage::INFO, msg));
 	MsgThread::Info(msg);
 	}
@@ -351,12 +605,14 @@ void ReaderBackend::Warning(const char* msg)
 	if ( suppress_warnings )
 		return;
 
+	FlushBatch();
 	SendOut(new ReaderErrorMessage(frontend, ReaderErrorMessage::WARNING, msg));
 	MsgThread::Warning(msg);
 	}
 
 void ReaderBackend::Error(const char* msg)
 	{
+	FlushBatch();
 	SendOut(new ReaderErrorMessage(frontend, ReaderErrorMessage::ERROR, msg));
 	MsgThread::Error(msg);
 
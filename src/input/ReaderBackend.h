@@ -2,6 +2,12 @@
 
 #pragma once
 
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
 #include "zeek/ZeekString.h"
 #include "zeek/input/Component.h"
 #include "zeek/threading/MsgThread.h"
@@ -17,6 +23,11 @@ namespace zeek::input
 
 class ReaderFrontend;
 
+namespace detail
+	{
+class FileWatcher;
+	}
+
 /**
  * The modes a reader can be in.
  */
@@ -48,6 +59,76 @@ enum ReaderMode
 	MODE_NONE
 	};
 
+/**
+ * Rows that a reader sends to the main thread in one message, see
+ * Input::batch_size. The values of all rows are in one array, row after
+ * row.
+ */
+class ReaderBatch
+	{
+public:
+	/**
+	 * What the manager does with the rows, as for the ReaderBackend
+	 * method of the same name.
+	 */
+	enum Kind
+		{
+		PUT,
+		DELETE,
+		SEND_ENTRY
+		};
+
+	/**
+	 * Constructor.
+	 *
+	 * @param kind What the rows are for.
+	 *
+	 * @param num_fields The number of values of each row.
+	 *
+	 * @param capacity The number of rows to make room for.
+	 */
+	ReaderBatch(Kind kind, int num_fields, int capacity);
+
+	/**
+	 * Destructor. Deletes all values that are still there.
+	 */
+	~ReaderBatch();
+
+	Kind GetKind() const { return kind; }
+
+	/**
+	 * Returns the number of rows.
+	 */
+	int Rows() const { return rows; }
+
+	/**
+	 * Appends a row. Takes ownership of the values and deletes the array.
+	 */
+	void Add(threading::Value** vals);
+
+	/**
+	 * Returns the values of a row.
+	 */
+	threading::Value** Row(int n) { return vals.data() + n * num_fields; }
+
+	/**
+	 * Deletes the values of a row that the manager is done with.
+	 */
+	void Release(int n);
+
+	/**
+	 * The number of rows that the manager is done with, which it may
+	 * process over several passes of the main loop.
+	 */
+	int processed = 0;
+
+private:
+	Kind kind;
+	int num_fields;
+	int rows = 0;
+	std::vector<threading::Value*> vals;
+	};
+
 /**
  * Base class for reader implementation. When the input:Manager creates a new
  * input stream, it instantiates a ReaderFrontend. That then in turn creates
@@ -114,11 +195,19 @@ public:
 		 */
 		ReaderMode mode;
 
+		/**
+		 * For table streams that only want changes sent over, the
+		 * number of leading fields that form the table's index. Zero
+		 * if all entries are to be sent.
+		 */
+		int delta_index_fields;
+
 		ReaderInfo()
 			{
 			source = nullptr;
 			name = nullptr;
 			mode = MODE_NONE;
+			delta_index_fields = 0;
 			}
 
 		ReaderInfo(const ReaderInfo& other)
@@ -126,6 +215,7 @@ public:
 			source = other.source ? util::copy_string(other.source) : nullptr;
 			name = other.name ? util::copy_string(other.name) : nullptr;
 			mode = other.mode;
+			delta_index_fields = other.delta_index_fields;
 
 			for ( config_map::const_iterator i = other.config.begin(); i != other.config.end();
 			      i++ )
@@ -222,6 +312,11 @@ public:
 
 	void Info(const char* msg) override;
 
+	/**
+	 * Sends an event to the main thread, after the rows sent before it.
+	 */
+	void SendEvent(const char* name, const int num_vals, threading::Value** vals) override;
+
 	/**
 	 * Reports a warning in the child thread. For input readers, warning suppression
 	 * that is caused by calling FailWarn() is respected by the Warning function.
@@ -240,6 +335,9 @@ public:
 	void Error(const char* msg) override;
 
 protected:
+	const char* AffinityClass() const override { return "reader"; }
+	bool Poolable() const override { return true; }
+
 	// Methods that have to be overwritten by the individual readers
 
 	/**
@@ -295,6 +393,30 @@ protected:
 	 */
 	virtual bool DoHeartbeat(double network_time, double current_time) = 0;
 
+	/**
+	 * Asks for an update whenever the given file changes, including when
+	 * it gets created, replaced or removed, instead of checking it on
+	 * heartbeats. That applies changes within milliseconds and costs
+	 * nothing while the file stays the same. Readers in MODE_REREAD or
+	 * MODE_STREAM should call this from DoInit() before their first
+	 * read. It's up to DoUpdate() to tell what changed.
+	 *
+	 * @param path The file to watch. Each reader can watch one.
+	 *
+	 * @return True if the file is being watched. If not, because
+	 * Input::watch_files is off or the platform can't, the reader needs
+	 * to keep checking the file on heartbeats.
+	 */
+	bool WatchFile(const std::string& path);
+
+	/**
+	 * Returns true if WatchFile() succeeded and the watch still works.
+	 * DoHeartbeat() can skip checking the file then. Once a watch stops
+	 * working, for example if the file's directory goes away, the reader
+	 * gets one more update and this turns false.
+	 */
+	bool FileWatched() const { return file_watch >= 0; }
+
 	// Content-sending-functions (simple mode). Include table-specific
 	// functionality that simply is not used if we have no table.
 
@@ -349,6 +471,11 @@ protected:
 	 * If the stream is a table stream, the values are inserted into the
 	 * table; if it is an event stream, the event is raised.
 	 *
+	 * If the table stream only wants changes (see
+	 * ReaderInfo::delta_index_fields), the comparison with the previous
+	 * send happens right here, and only new and changed entries go to
+	 * the manager, as if sent by Put().
+	 *
 	 * @param val Array of threading::Values expected by the stream. The
 	 * array must have exactly NumEntries() elements.
 	 */
@@ -360,11 +487,35 @@ protected:
 	 *
 	 * For table streams, all entries that were not updated since the
 	 * last EndCurrentSend will be deleted, because they are no longer
-	 * present in the input source
+	 * present in the input source. If the stream only wants changes,
+	 * these entries go to the manager as if sent by Delete().
 	 */
 	void EndCurrentSend();
 
 private:
+	friend class FileChangedMessage;
+	friend class detail::FileWatcher;
+
+	// Called by the file watcher on the main thread when the watched
+	// file changed, or if lost, when it can't tell anymore.
+	void NotifyFileChanged(bool lost);
+
+	// Processes the notification in the reader's thread.
+	bool FileChanged(bool lost);
+
+	void StopWatchingFile();
+
+	// Returns the binary serialization of the given values.
+	static std::string SerializeValues(int num_vals, const threading::Value* const* vals);
+
+	// Adds a row to the current batch, starting a new one if it's for
+	// something else.
+	void AddToBatch(ReaderBatch::Kind kind, threading::Value** vals);
+
+	// Sends the current batch to the main thread. Everything else sent
+	// there must come after this, to keep the order.
+	void FlushBatch();
+
 	// Frontend that instantiated us. This object must not be accessed
 	// from this class, it's running in a different thread!
 	ReaderFrontend* frontend;
@@ -377,6 +528,23 @@ private:
 	// this is an internal indicator in case the read is currently in a failed state
 	// it's used to suppress duplicate error messages.
 	bool suppress_warnings = false;
+
+	// For table streams that only want changes, each index as of the
+	// previous and the current send, serialized, mapped to a hash of
+	// its values.
+	std::unordered_map<std::string, uint64_t> delta_last;
+	std::unordered_map<std::string, uint64_t> delta_curr;
+
+	// Rows to send together, or one at a time if at most one. See
+	// Input::batch_size.
+	int batch_size;
+	ReaderBatch* batch = nullptr;
+
+	// The watch of the file given to WatchFile(), if any, and whether a
+	// notification of a change is waiting in the queue.
+	detail::FileWatcher* file_watcher = nullptr;
+	int file_watch = -1;
+	std::atomic<bool> file_change_pending = false;
 	};
 
 	} // namespace zeek::input
@@ -2,11 +2,18 @@
 
 #include "zeek/input/readers/ascii/Ascii.h"
 
+#include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <algorithm>
 #include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
 #include <sstream>
+#include <thread>
 
 #include "zeek/input/readers/ascii/ascii.bif.h"
 #include "zeek/threading/SerialTypes.h"
@@ -47,12 +54,30 @@ FieldMapping FieldMapping::subType()
 	return FieldMapping(name, subtype, position);
 	}
 
+struct Ascii::Chunk
+	{
+	struct Line
+		{
+		int number; // Counting from the start of the chunk.
+		std::string_view text;
+		Value** vals; // Null if the line needs parsing again to report problems.
+		};
+
+	const char* begin;
+	const char* end;
+
+	std::vector<Line> lines;
+	int num_lines = 0; // Including comments and empty lines.
+	bool done = false;
+	};
+
 Ascii::Ascii(ReaderFrontend* frontend) : ReaderBackend(frontend)
 	{
 	mtime = 0;
 	ino = 0;
 	fail_on_file_problem = false;
 	fail_on_invalid_lines = false;
+	parse_threads = 0;
 	}
 
 void Ascii::DoClose()
@@ -82,6 +107,8 @@ bool Ascii::DoInit(const ReaderInfo& info, int num_fields, const Field* const* f
 	path_prefix.assign((const char*)BifConst::InputAscii::path_prefix->Bytes(),
 	                   BifConst::InputAscii::path_prefix->Len());
 
+	parse_threads = BifConst::InputAscii::parse_threads;
+
 	// Set per-filter configuration options.
 	for ( const auto& [k, v] : info.config )
 		{
@@ -102,6 +129,9 @@ bool Ascii::DoInit(const ReaderInfo& info, int num_fields, const Field* const* f
 
 		else if ( strcmp(k, "fail_on_file_problem") == 0 )
 			fail_on_file_problem = (strncmp(v, "T", 1) == 0);
+
+		else if ( strcmp(k, "parse_threads") == 0 )
+			parse_threads = atoi(v);
 		}
 
 	if ( separator.size() != 1 )
@@ -114,16 +144,8 @@ bool Ascii::DoInit(const ReaderInfo& info, int num_fields, const Field* const* f
 	                                                    empty_field);
 	formatter = unique_ptr<threading::Formatter>(new threading::formatter::Ascii(this, sep_info));
 
-	return DoUpdate();
-	}
-
-bool Ascii::OpenFile()
-	{
-	if ( file.is_open() )
-		return true;
-
 	// Handle path-prefixing. See similar logic in Binary::DoInit().
-	fname = Info().source;
+	fname = info.source;
 
 	if ( fname.front() != '/' && ! path_prefix.empty() )
 		{
@@ -138,6 +160,17 @@ bool Ascii::OpenFile()
 		fname = path + "/" + fname;
 		}
 
+	if ( info.mode == MODE_REREAD || info.mode == MODE_STREAM )
+		WatchFile(fname);
+
+	return DoUpdate();
+	}
+
+bool Ascii::OpenFile()
+	{
+	if ( file.is_open() )
+		return true;
+
 	file.open(fname);
 
 	if ( ! file.is_open() )
@@ -348,117 +381,367 @@ bool Ascii::DoUpdate()
 			assert(false);
 		}
 
+	// The reading ahead of mapping the file only pays off for reading
+	// all of it, and needs it uncompressed.
+	if ( parse_threads > 0 && Info().mode != MODE_STREAM &&
+	     threading::compression_for_file(fname) == threading::Compression::None )
+		{
+		bool mapped = true;
+		bool result = ReadMapped(&mapped);
+
+		if ( mapped )
+			return result;
+		}
+
 	string line;
 
 	file.sync();
 
 	while ( GetLine(line) )
 		{
-		// split on tabs
-		bool error = false;
-		auto stringfields = util::split(line, separator[0]);
+		bool fatal = false;
+		Value** fields = ParseLine(line, formatter.get(), true, &fatal);
+
+		if ( ! fields )
+			{
+			if ( fatal )
+				return false;
+
+			continue;
+			}
+
+		SendLine(fields, read_location ? read_location->first_line : 0);
+		}
+
+	if ( Info().mode != MODE_STREAM )
+		EndCurrentSend();
+
+	return true;
+	}
+
+Value** Ascii::ParseLine(std::string_view line, const threading::Formatter* fmt, bool report,
+                         bool* fatal)
+	{
+	*fatal = false;
+
+	// split on tabs
+	auto stringfields = util::split(line, std::string_view(separator.data(), 1));
 
-		// This needs to be a signed value or the comparisons below will fail.
-		int pos = static_cast<int>(stringfields.size() - 1);
+	// This needs to be a signed value or the comparisons below will fail.
+	int pos = static_cast<int>(stringfields.size() - 1);
 
-		Value** fields = new Value*[NumFields()];
+	Value** fields = new Value*[NumFields()];
 
-		int fpos = 0;
-		for ( const auto& fit : columnMap )
+	int fpos = 0;
+	for ( const auto& fit : columnMap )
+		{
+		if ( ! fit.present )
 			{
-			if ( ! fit.present )
-				{
-				// add non-present field
-				fields[fpos] = new Value(fit.type, false);
-				if ( read_location )
-					fields[fpos]->SetFileLineNumber(read_location->first_line);
-				fpos++;
-				continue;
-				}
+			// add non-present field
+			fields[fpos] = new Value(fit.type, false);
+			fpos++;
+			continue;
+			}
 
-			assert(fit.position >= 0);
+		assert(fit.position >= 0);
 
-			if ( fit.position > pos || fit.secondary_position > pos )
+		if ( fit.position > pos || fit.secondary_position > pos )
+			{
+			if ( report )
 				{
 				FailWarn(fail_on_invalid_lines, Fmt("Not enough fields in line '%s' of %s. Found "
 				                                    "%d fields, want positions %d and %d",
-				                                    line.c_str(), fname.c_str(), pos, fit.position,
-				                                    fit.secondary_position));
+				                                    string(line).c_str(), fname.c_str(), pos,
+				                                    fit.position, fit.secondary_position));
+				*fatal = fail_on_invalid_lines;
+				}
 
-				if ( fail_on_invalid_lines )
-					{
-					for ( int i = 0; i < fpos; i++ )
-						delete fields[i];
+			break;
+			}
 
-					delete[] fields;
+		Value* val = fmt->ParseValue(string(stringfields[fit.position]), fit.name, fit.type,
+		                             fit.subtype);
+		if ( ! val )
+			{
+			if ( report )
+				Warning(Fmt("Could not convert line '%s' of %s to Val. Ignoring line.",
+				            string(line).c_str(), fname.c_str()));
+			break;
+			}
 
-					return false;
-					}
-				else
-					{
-					error = true;
-					break;
-					}
+		if ( fit.secondary_position != -1 )
+			{
+			// we have a port definition :)
+			assert(val->type == TYPE_PORT);
+			//	Error(Fmt("Got type %d != PORT with secondary position!", val->type));
+
+			val->val.port_val.proto = fmt->ParseProto(
+				string(stringfields[fit.secondary_position]));
+			}
+
+		fields[fpos] = val;
+
+		fpos++;
+		}
+
+	if ( fpos != NumFields() )
+		{
+		// Encountered an error, ignoring line. But first, delete all
+		// successfully read fields and the array structure.
+		for ( int i = 0; i < fpos; i++ )
+			delete fields[i];
+
+		delete[] fields;
+		return nullptr;
+		}
+
+	return fields;
+	}
+
+void Ascii::SendLine(Value** vals, int line_number)
+	{
+	if ( read_location )
+		{
+		for ( int i = 0; i < NumFields(); i++ )
+			vals[i]->SetFileLineNumber(line_number);
+		}
+
+	if ( Info().mode == MODE_STREAM )
+		Put(vals);
+	else
+		SendEntry(vals);
+	}
+
+bool Ascii::ReadMapped(bool* mapped)
+	{
+	int fd = open(fname.c_str(), O_RDONLY | O_CLOEXEC);
+	struct stat sb;
+
+	if ( fd < 0 || fstat(fd, &sb) < 0 || ! S_ISREG(sb.st_mode) )
+		{
+		if ( fd >= 0 )
+			close(fd);
+
+		*mapped = false;
+		return true;
+		}
+
+	size_t size = sb.st_size;
+	const char* data = nullptr;
+
+	if ( size > 0 )
+		{
+		void* m = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+		if ( m == MAP_FAILED )
+			{
+			close(fd);
+			*mapped = false;
+			return true;
+			}
+
+		madvise(m, size, MADV_SEQUENTIAL);
+		data = static_cast<const char*>(m);
+		}
+
+	close(fd);
+
+	// Cut the file into chunks at line boundaries, a few per thread so
+	// that they even out.
+	constexpr size_t MIN_CHUNK_SIZE = 1024 * 1024;
+	size_t chunk_size = std::max(MIN_CHUNK_SIZE, size / (parse_threads * 4));
+	std::vector<Chunk> chunks;
+
+	for ( size_t start = 0; start < size; )
+		{
+		size_t end = std::min(start + chunk_size, size);
+
+		if ( end < size )
+			{
+			auto nl = static_cast<const char*>(memchr(data + end, '\n', size - end));
+			end = nl ? nl - data + 1 : size;
+			}
+
+		chunks.push_back({data + start, data + end});
+		start = end;
+		}
+
+	// Workers parse chunks in order, staying only a few ahead of the
+	// chunk we're sending so that memory stays bounded.
+	size_t max_ahead = parse_threads * 2;
+	std::mutex mutex;
+	std::condition_variable cond;
+	size_t next = 0;
+	size_t sent = 0;
+	bool stop = false;
+
+	threading::formatter::Ascii::SeparatorInfo sep_info(separator, set_separator, unset_field,
+	                                                    empty_field);
+
+	auto work = [&]()
+	{
+		// Without a thread, the formatter only counts problems, which
+		// makes us parse those lines again ourselves for reporting them.
+		threading::formatter::Ascii fmt(nullptr, sep_info);
+
+		for ( ;; )
+			{
+			size_t i;
+
+				{
+				std::unique_lock<std::mutex> lock(mutex);
+				cond.wait(lock, [&]
+				          { return stop || next >= chunks.size() || next < sent + max_ahead; });
+
+				if ( stop || next >= chunks.size() )
+					return;
+
+				i = next++;
 				}
 
-			Value* val = formatter->ParseValue(stringfields[fit.position], fit.name, fit.type,
-			                                   fit.subtype);
-			if ( ! val )
+			ParseChunk(&chunks[i], &fmt);
+
 				{
-				Warning(Fmt("Could not convert line '%s' of %s to Val. Ignoring line.",
-				            line.c_str(), fname.c_str()));
-				error = true;
-				break;
+				std::lock_guard<std::mutex> lock(mutex);
+				chunks[i].done = true;
 				}
 
+			cond.notify_all();
+			}
+	};
+
+	std::vector<std::thread> workers;
+
+	for ( size_t i = 0; i < std::min(static_cast<size_t>(parse_threads), chunks.size()); i++ )
+		workers.emplace_back(work);
+
+	bool result = true;
+	int line_base = 0;
+
+	for ( auto& chunk : chunks )
+		{
+			{
+			std::unique_lock<std::mutex> lock(mutex);
+			cond.wait(lock, [&] { return chunk.done; });
+			}
+
+		for ( auto& line : chunk.lines )
+			{
+			int number = line_base + line.number;
+
 			if ( read_location )
-				val->SetFileLineNumber(read_location->first_line);
+				{
+				read_location->first_line = number;
+				read_location->last_line = number;
+				}
+
+			Value** vals = line.vals;
+			line.vals = nullptr;
 
-			if ( fit.secondary_position != -1 )
+			if ( ! vals )
 				{
-				// we have a port definition :)
-				assert(val->type == TYPE_PORT);
-				//	Error(Fmt("Got type %d != PORT with secondary position!", val->type));
+				bool fatal = false;
+				vals = ParseLine(line.text, formatter.get(), true, &fatal);
 
-				val->val.port_val.proto = formatter->ParseProto(
-					stringfields[fit.secondary_position]);
-				}
+				if ( ! vals )
+					{
+					if ( fatal )
+						{
+						result = false;
+						break;
+						}
 
-			fields[fpos] = val;
+					continue;
+					}
+				}
 
-			fpos++;
+			SendLine(vals, number);
 			}
 
-		if ( error )
-			{
-			// Encountered non-fatal error, ignoring line. But
-			// first, delete all successfully read fields and the
-			// array structure.
+		if ( ! result )
+			break;
 
-			for ( int i = 0; i < fpos; i++ )
-				delete fields[i];
+		line_base += chunk.num_lines;
 
-			delete[] fields;
-			continue;
+			{
+			std::lock_guard<std::mutex> lock(mutex);
+			++sent;
 			}
 
-		// printf("fpos: %d, second.num_fields: %d\n", fpos, (*it).second.num_fields);
-		assert(fpos == NumFields());
+		cond.notify_all();
+		}
 
-		if ( Info().mode == MODE_STREAM )
-			Put(fields);
-		else
-			SendEntry(fields);
+		{
+		std::lock_guard<std::mutex> lock(mutex);
+		stop = true;
 		}
 
-	if ( Info().mode != MODE_STREAM )
+	cond.notify_all();
+
+	for ( auto& w : workers )
+		w.join();
+
+	// Only left over if we stopped early.
+	for ( auto& chunk : chunks )
+		{
+		for ( auto& line : chunk.lines )
+			{
+			if ( line.vals )
+				Value::delete_value_ptr_array(line.vals, NumFields());
+			}
+		}
+
+	if ( data )
+		munmap(const_cast<char*>(data), size);
+
+	if ( result )
 		EndCurrentSend();
 
-	return true;
+	return result;
+	}
+
+void Ascii::ParseChunk(Chunk* chunk, const threading::Formatter* fmt)
+	{
+	const char* p = chunk->begin;
+
+	while ( p < chunk->end )
+		{
+		auto nl = static_cast<const char*>(memchr(p, '\n', chunk->end - p));
+		const char* eol = nl ? nl : chunk->end;
+		std::string_view text(p, eol - p);
+		p = nl ? nl + 1 : chunk->end;
+
+		++chunk->num_lines;
+
+		if ( ! text.empty() && text.back() == '\r' ) // deal with \r\n by removing \r
+			text.remove_suffix(1);
+
+		// Skip empty lines, comments, and the header, which we have
+		// already read.
+		if ( text.empty() || text[0] == '#' )
+			continue;
+
+		int problems = fmt->Problems();
+		bool fatal;
+		Value** vals = ParseLine(text, fmt, false, &fatal);
+
+		if ( vals && fmt->Problems() != problems )
+			{
+			// Parsed, but with warnings to report.
+			Value::delete_value_ptr_array(vals, NumFields());
+			vals = nullptr;
+			}
+
+		chunk->lines.push_back({chunk->num_lines, text, vals});
+		}
 	}
 
 bool Ascii::DoHeartbeat(double network_time, double current_time)
 	{
+	if ( FileWatched() )
+		// Updates come with changes to the file instead.
+		return true;
+
 	if ( ! OpenFile() )
 		return ! fail_on_file_problem;
 
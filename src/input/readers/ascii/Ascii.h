@@ -6,10 +6,12 @@
 #include <fstream>
 #include <iostream>
 #include <memory>
+#include <string_view>
 #include <vector>
 
 #include "zeek/Obj.h"
 #include "zeek/input/ReaderBackend.h"
+#include "zeek/threading/Compression.h"
 #include "zeek/threading/formatters/Ascii.h"
 
 namespace zeek::input::reader::detail
@@ -62,11 +64,32 @@ protected:
 	const zeek::detail::Location* GetLocationInfo() const override { return read_location.get(); }
 
 private:
+	// A piece of a memory-mapped file, parsed on a worker thread.
+	struct Chunk;
+
 	bool ReadHeader(bool useCached);
 	bool GetLine(std::string& str);
 	bool OpenFile();
 
-	std::ifstream file;
+	// Parses a data line into the values to send, using the given
+	// formatter. Returns null if the line is invalid, in which case
+	// *fatal says whether to stop reading. With report false, it
+	// doesn't report the problem, which makes it safe to use from other
+	// threads with a formatter of their own.
+	threading::Value** ParseLine(std::string_view line, const threading::Formatter* fmt,
+	                             bool report, bool* fatal);
+
+	// Passes on the values of a line to the manager.
+	void SendLine(threading::Value** vals, int line_number);
+
+	// Reads the whole file through a memory mapping instead, parsing
+	// it on parse_threads worker threads. Returns false if reading
+	// should stop, like DoUpdate(), and sets *mapped to false if the
+	// file can't be mapped.
+	bool ReadMapped(bool* mapped);
+	void ParseChunk(Chunk* chunk, const threading::Formatter* fmt);
+
+	threading::DecompressingFile file;
 	time_t mtime;
 	ino_t ino;
 
@@ -89,6 +112,7 @@ private:
 	bool fail_on_invalid_lines;
 	bool fail_on_file_problem;
 	std::string path_prefix;
+	int parse_threads;
 
 	std::unique_ptr<threading::Formatter> formatter;
 
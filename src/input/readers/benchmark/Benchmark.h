@@ -20,6 +20,9 @@ public:
 	static ReaderBackend* Instantiate(ReaderFrontend* frontend) { return new Benchmark(frontend); }
 
 protected:
+	// Sleeps to spread out its entries.
+	bool Poolable() const override { return false; }
+
 	bool DoInit(const ReaderInfo& info, int arg_num_fields,
 	            const threading::Field* const* fields) override;
 	void DoClose() override;
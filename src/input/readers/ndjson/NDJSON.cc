@@ -0,0 +1,463 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/input/readers/ndjson/NDJSON.h"
+
+#include "zeek/zeek-config.h"
+
+#include <sys/stat.h>
+#include <cassert>
+#include <cstring>
+#include <string_view>
+
+#include <rapidjson/error/en.h>
+
+#include "zeek/threading/SerialTypes.h"
+
+using zeek::threading::Field;
+using zeek::threading::Value;
+
+namespace zeek::input::reader::detail
+	{
+
+NDJSON::NDJSON(ReaderFrontend* frontend) : ReaderBackend(frontend) { }
+
+bool NDJSON::DoInit(const ReaderInfo& info, int num_fields, const Field* const* fields)
+	{
+	StopWarningSuppression();
+
+	if ( ! info.source || strlen(info.source) == 0 )
+		{
+		Error("No source path provided");
+		return false;
+		}
+
+	fname = info.source;
+
+	// Set per-stream configuration options.
+	for ( const auto& [k, v] : info.config )
+		{
+		if ( strcmp(k, "fail_on_invalid_lines") == 0 )
+			fail_on_invalid_lines = (strncmp(v, "T", 1) == 0);
+
+		else if ( strcmp(k, "fail_on_file_problem") == 0 )
+			fail_on_file_problem = (strncmp(v, "T", 1) == 0);
+		}
+
+	for ( int i = 0; i < num_fields; ++i )
+		{
+		AddKey(fields[i]->name, i, false);
+
+		if ( fields[i]->secondary_name )
+			AddKey(fields[i]->secondary_name, i, true);
+		}
+
+	// For the values that JSON has no type for, such as addresses, which
+	// come as strings. An empty string means unset, like null.
+	io = std::make_unique<threading::formatter::Ascii>(
+		this, threading::formatter::Ascii::SeparatorInfo(std::string(), ",", "", ""));
+
+	return DoUpdate();
+	}
+
+void NDJSON::AddKey(const std::string& name, int field, bool proto)
+	{
+	auto set = [field, proto](KeyNode& node)
+	{
+		if ( proto )
+			node.proto_of = field;
+		else
+			node.field = field;
+	};
+
+	set(keys.children[name]);
+
+	if ( name.find('.') == std::string::npos )
+		return;
+
+	KeyNode* node = &keys;
+	size_t start = 0;
+
+	for ( size_t dot; (dot = name.find('.', start)) != std::string::npos; start = dot + 1 )
+		node = &node->children[name.substr(start, dot - start)];
+
+	set(node->children[name.substr(start)]);
+	}
+
+bool NDJSON::OpenFile()
+	{
+	if ( file.is_open() )
+		return true;
+
+	file.open(fname);
+
+	if ( ! file.is_open() )
+		{
+		FailWarn(fail_on_file_problem, Fmt("Init: cannot open %s", fname.c_str()), true);
+		return false;
+		}
+
+	line_number = 0;
+	partial.clear();
+	StopWarningSuppression();
+	return true;
+	}
+
+bool NDJSON::GetLine(std::string& line)
+	{
+	while ( std::getline(file, line) )
+		{
+		// While streaming, a last line without a newline may still be
+		// in the making.
+		if ( file.eof() && Info().mode == MODE_STREAM )
+			{
+			partial += line;
+			return false;
+			}
+
+		if ( ! partial.empty() )
+			{
+			line.insert(0, partial);
+			partial.clear();
+			}
+
+		++line_number;
+
+		if ( ! line.empty() && line.back() == '\r' )
+			line.pop_back();
+
+		if ( line.find_first_not_of(" \t") == std::string::npos )
+			continue;
+
+		return true;
+		}
+
+	return false;
+	}
+
+bool NDJSON::DoUpdate()
+	{
+	if ( ! OpenFile() )
+		return ! fail_on_file_problem;
+
+	switch ( Info().mode )
+		{
+		case MODE_REREAD:
+			{
+			// check if the file has changed
+			struct stat sb;
+			if ( stat(fname.c_str(), &sb) == -1 )
+				{
+				FailWarn(fail_on_file_problem, Fmt("Could not get stat for %s", fname.c_str()),
+				         true);
+
+				file.close();
+				return ! fail_on_file_problem;
+				}
+
+			if ( sb.st_ino == ino && sb.st_mtime == mtime )
+				// no change
+				return true;
+
+			// Warn again in case of trouble if the file changes.
+			if ( ino != 0 )
+				StopWarningSuppression();
+
+			mtime = sb.st_mtime;
+			ino = sb.st_ino;
+			}
+			[[fallthrough]];
+
+		case MODE_MANUAL:
+			// Start over from the beginning.
+			file.close();
+
+			if ( ! OpenFile() )
+				return ! fail_on_file_problem;
+
+			break;
+
+		case MODE_STREAM:
+			// Continue with whatever has been appended.
+			file.clear();
+			break;
+
+		default:
+			assert(false);
+		}
+
+	std::string line;
+
+	while ( GetLine(line) )
+		{
+		bool fatal = false;
+		Value** vals = ParseLine(line, &fatal);
+
+		if ( ! vals )
+			{
+			if ( fatal )
+				return false;
+
+			continue;
+			}
+
+		if ( Info().mode == MODE_STREAM )
+			Put(vals);
+		else
+			SendEntry(vals);
+		}
+
+	if ( Info().mode != MODE_STREAM )
+		EndCurrentSend();
+
+	return true;
+	}
+
+Value** NDJSON::ParseLine(std::string& line, bool* fatal)
+	{
+	*fatal = false;
+
+	// The document's memory isn't released on its own, so start over
+	// with each line. Parsing modifies the line, with the strings
+	// pointing into it.
+	doc.SetNull();
+	doc.GetAllocator().Clear();
+	doc.ParseInsitu(line.data());
+
+	if ( doc.HasParseError() || ! doc.IsObject() )
+		{
+		const char* problem = doc.HasParseError() ? rapidjson::GetParseError_En(doc.GetParseError())
+		                                          : "not an object";
+		FailWarn(fail_on_invalid_lines,
+		         Fmt("Invalid JSON in line %d of %s: %s", line_number, fname.c_str(), problem));
+		*fatal = fail_on_invalid_lines;
+		return nullptr;
+		}
+
+	int num_fields = NumFields();
+	const Field* const* fields = Fields();
+	Value** vals = new Value*[num_fields]();
+	std::vector<const rapidjson::Value*> protos(num_fields);
+	bool ok = ConvertMembers(doc, keys, vals, protos);
+
+	for ( int i = 0; ok && i < num_fields; ++i )
+		{
+		if ( ! vals[i] )
+			{
+			if ( fields[i]->optional )
+				{
+				vals[i] = new Value(fields[i]->type, fields[i]->subtype, false);
+				continue;
+				}
+
+			FailWarn(fail_on_invalid_lines, Fmt("Missing field %s in line %d of %s. Ignoring line.",
+			                                    fields[i]->name, line_number, fname.c_str()));
+			ok = false;
+			}
+
+		else if ( protos[i] && protos[i]->IsString() && vals[i]->type == TYPE_PORT )
+			vals[i]->val.port_val.proto = io->ParseProto(
+				std::string(protos[i]->GetString(), protos[i]->GetStringLength()));
+		}
+
+	if ( ! ok )
+		{
+		for ( int i = 0; i < num_fields; ++i )
+			delete vals[i];
+
+		delete[] vals;
+		*fatal = fail_on_invalid_lines;
+		return nullptr;
+		}
+
+	return vals;
+	}
+
+bool NDJSON::ConvertMembers(const rapidjson::Value& obj, const KeyNode& node, Value** vals,
+                            std::vector<const rapidjson::Value*>& protos)
+	{
+	for ( const auto& m : obj.GetObject() )
+		{
+		auto it = node.children.find(std::string_view(m.name.GetString(), m.name.GetStringLength()));
+
+		// Null is the same as not being there.
+		if ( it == node.children.end() || m.value.IsNull() )
+			continue;
+
+		const KeyNode& child = it->second;
+
+		if ( child.field >= 0 )
+			{
+			const Field* field = Fields()[child.field];
+			Value* val = ConvertValue(m.value, field, field->type, field->subtype);
+
+			if ( ! val )
+				{
+				FailWarn(fail_on_invalid_lines,
+				         Fmt("Could not convert field %s in line %d of %s. Ignoring line.",
+				             field->name, line_number, fname.c_str()));
+				return false;
+				}
+
+			// The same field may come both nested and not.
+			delete vals[child.field];
+			vals[child.field] = val;
+			}
+
+		if ( child.proto_of >= 0 )
+			protos[child.proto_of] = &m.value;
+
+		if ( m.value.IsObject() && ! child.children.empty() &&
+		     ! ConvertMembers(m.value, child, vals, protos) )
+			return false;
+		}
+
+	return true;
+	}
+
+Value* NDJSON::ConvertValue(const rapidjson::Value& j, const Field* field, TypeTag type,
+                            TypeTag subtype)
+	{
+	switch ( type )
+		{
+		case TYPE_BOOL:
+			if ( ! j.IsBool() )
+				break;
+
+			{
+			Value* val = new Value(type, true);
+			val->val.int_val = j.GetBool() ? 1 : 0;
+			return val;
+			}
+
+		case TYPE_INT:
+			if ( ! j.IsInt64() )
+				break;
+
+			{
+			Value* val = new Value(type, true);
+			val->val.int_val = j.GetInt64();
+			return val;
+			}
+
+		case TYPE_COUNT:
+			if ( ! j.IsUint64() )
+				break;
+
+			{
+			Value* val = new Value(type, true);
+			val->val.uint_val = j.GetUint64();
+			return val;
+			}
+
+		case TYPE_DOUBLE:
+		case TYPE_TIME:
+		case TYPE_INTERVAL:
+			if ( ! j.IsNumber() )
+				break;
+
+			{
+			Value* val = new Value(type, true);
+			val->val.double_val = j.GetDouble();
+			return val;
+			}
+
+		case TYPE_PORT:
+			if ( ! j.IsUint() )
+				break;
+
+			{
+			Value* val = new Value(type, true);
+			val->val.port_val.port = j.GetUint();
+			val->val.port_val.proto = TRANSPORT_UNKNOWN;
+			return val;
+			}
+
+		case TYPE_ENUM:
+		case TYPE_STRING:
+			{
+			if ( ! j.IsString() )
+				return nullptr;
+
+			// Unlike with the ASCII formatter, there's nothing to
+			// unescape anymore.
+			Value* val = new Value(type, true);
+			val->val.string_val.length = j.GetStringLength();
+			val->val.string_val.data = new char[j.GetStringLength()];
+			memcpy(val->val.string_val.data, j.GetString(), j.GetStringLength());
+			return val;
+			}
+
+		case TYPE_TABLE:
+		case TYPE_VECTOR:
+			{
+			if ( ! j.IsArray() )
+				return nullptr;
+
+			auto size = j.Size();
+			Value** elems = new Value*[size];
+
+			for ( rapidjson::SizeType i = 0; i < size; ++i )
+				{
+				elems[i] = ConvertValue(j[i], field, subtype, TYPE_VOID);
+
+				if ( ! elems[i] )
+					{
+					for ( rapidjson::SizeType k = 0; k < i; ++k )
+						delete elems[k];
+
+					delete[] elems;
+					return nullptr;
+					}
+				}
+
+			Value* val = new Value(type, subtype, true);
+
+			if ( type == TYPE_TABLE )
+				{
+				val->val.set_val.size = size;
+				val->val.set_val.vals = elems;
+				}
+			else
+				{
+				val->val.vector_val.size = size;
+				val->val.vector_val.vals = elems;
+				}
+
+			return val;
+			}
+
+		default:
+			break;
+		}
+
+	// Anything else needs parsing from its textual form, such as
+	// addresses and subnets, or ports with their protocol.
+	if ( ! j.IsString() )
+		return nullptr;
+
+	return io->ParseValue(std::string(j.GetString(), j.GetStringLength()), field->name, type,
+	                      subtype);
+	}
+
+bool NDJSON::DoHeartbeat(double network_time, double current_time)
+	{
+	switch ( Info().mode )
+		{
+		case MODE_MANUAL:
+			// yay, we do nothing :)
+			break;
+
+		case MODE_REREAD:
+		case MODE_STREAM:
+			Update(); // Call Update, not DoUpdate, because Update
+			          // checks the "disabled" flag.
+			break;
+
+		default:
+			assert(false);
+		}
+
+	return true;
+	}
+
+	} // namespace zeek::input::reader::detail
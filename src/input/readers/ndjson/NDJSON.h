@@ -0,0 +1,93 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <sys/types.h>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <rapidjson/document.h>
+
+#include "zeek/input/ReaderBackend.h"
+#include "zeek/threading/Compression.h"
+#include "zeek/threading/formatters/Ascii.h"
+
+namespace zeek::input::reader::detail
+	{
+
+/**
+ * Reader for files with a JSON object on each line, such as Zeek's own
+ * JSON logs. Object keys map to the stream's fields by name, either as
+ * they are, like "id.orig_h", or through nested objects, like {"id":
+ * {"orig_h": ...}}. Keys without a field are ignored. The reader parses
+ * each line in place, without copying it, and converts the values
+ * straight into the fields' types.
+ */
+class NDJSON : public ReaderBackend
+	{
+public:
+	explicit NDJSON(ReaderFrontend* frontend);
+	~NDJSON() override = default;
+
+	static ReaderBackend* Instantiate(ReaderFrontend* frontend) { return new NDJSON(frontend); }
+
+protected:
+	bool DoInit(const ReaderInfo& info, int arg_num_fields,
+	            const threading::Field* const* fields) override;
+	void DoClose() override { }
+	bool DoUpdate() override;
+	bool DoHeartbeat(double network_time, double current_time) override;
+
+private:
+	// Where a key leads: to a field, to the protocol of a port field,
+	// and to the keys of a nested object.
+	struct KeyNode
+		{
+		int field = -1;
+		int proto_of = -1;
+		std::map<std::string, KeyNode, std::less<>> children;
+		};
+
+	// Maps a field's name to it, at the top level as well as nested.
+	void AddKey(const std::string& name, int field, bool proto);
+
+	bool OpenFile();
+
+	// Returns the next complete line, if any.
+	bool GetLine(std::string& line);
+
+	// Parses a line into the values to send. Returns null if the line
+	// is invalid, in which case *fatal says whether to stop reading.
+	threading::Value** ParseLine(std::string& line, bool* fatal);
+
+	// Converts the members of an object into the fields they map to.
+	// Returns false if one doesn't convert.
+	bool ConvertMembers(const rapidjson::Value& obj, const KeyNode& node, threading::Value** vals,
+	                    std::vector<const rapidjson::Value*>& protos);
+
+	// Converts a JSON value into a field's type. Returns null if that
+	// isn't possible.
+	threading::Value* ConvertValue(const rapidjson::Value& j, const threading::Field* field,
+	                               TypeTag type, TypeTag subtype);
+
+	threading::DecompressingFile file;
+	std::string fname;
+	time_t mtime = 0;
+	ino_t ino = 0;
+	int line_number = 0;
+
+	// In streaming mode, the beginning of a line still being written.
+	std::string partial;
+
+	KeyNode keys;
+	rapidjson::Document doc;
+	std::unique_ptr<threading::formatter::Ascii> io;
+
+	bool fail_on_invalid_lines = false;
+	bool fail_on_file_problem = false;
+	};
+
+	} // namespace zeek::input::reader::detail
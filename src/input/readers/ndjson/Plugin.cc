@@ -0,0 +1,25 @@
+// See the file  in the main distribution directory for copyright.
+
+#include "zeek/plugin/Plugin.h"
+
+#include "zeek/input/readers/ndjson/NDJSON.h"
+
+namespace zeek::plugin::detail::Zeek_NDJSONReader
+	{
+
+class Plugin : public zeek::plugin::Plugin
+	{
+public:
+	zeek::plugin::Configuration Configure() override
+		{
+		AddComponent(
+			new zeek::input::Component("NDJSON", zeek::input::reader::detail::NDJSON::Instantiate));
+
+		zeek::plugin::Configuration config;
+		config.name = "Zeek::NDJSONReader";
+		config.description = "Newline-delimited JSON input reader";
+		return config;
+		}
+	} plugin;
+
+	} // namespace zeek::plugin::detail::Zeek_NDJSONReader
@@ -442,6 +442,9 @@ bool Raw::DoInit(const ReaderInfo& info, int num_fields, const Field* const* fie
 		return false;
 		}
 
+	if ( ! execute && (Info().mode == MODE_REREAD || Info().mode == MODE_STREAM) )
+		WatchFile(fname);
+
 	result = OpenInput();
 
 	if ( result == false )
@@ -776,6 +779,10 @@ bool Raw::DoUpdate()
 
 bool Raw::DoHeartbeat(double network_time, double current_time)
 	{
+	if ( FileWatched() )
+		// Updates come with changes to the file instead.
+		return true;
+
 	switch ( Info().mode )
 		{
 		case MODE_MANUAL:
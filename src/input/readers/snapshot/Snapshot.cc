@@ -0,0 +1,230 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/input/readers/snapshot/Snapshot.h"
+
+#include "zeek/zeek-config.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+#include "zeek/logging/LogWire.h"
+#include "zeek/threading/SerialTypes.h"
+
+using zeek::threading::Field;
+using zeek::threading::Value;
+
+namespace zeek::input::reader::detail
+	{
+
+Snapshot::Snapshot(ReaderFrontend* frontend) : ReaderBackend(frontend) { }
+
+Snapshot::~Snapshot()
+	{
+	DoClose();
+	}
+
+bool Snapshot::DoInit(const ReaderInfo& info, int num_fields, const Field* const* fields)
+	{
+	if ( ! info.source || strlen(info.source) == 0 )
+		{
+		Error("No source path provided");
+		return false;
+		}
+
+	if ( info.mode == MODE_STREAM )
+		{
+		Error("Streaming reading is not supported for snapshot files");
+		return false;
+		}
+
+	fname = info.source;
+
+	return DoUpdate();
+	}
+
+bool Snapshot::DoUpdate()
+	{
+	int fd = open(fname.c_str(), O_RDONLY | O_CLOEXEC);
+	struct stat sb;
+
+	if ( fd < 0 || fstat(fd, &sb) < 0 )
+		{
+		char buf[256];
+		util::zeek_strerror_r(errno, buf, sizeof(buf));
+		FailWarn(false, Fmt("cannot open %s: %s", fname.c_str(), buf), true);
+
+		if ( fd >= 0 )
+			close(fd);
+
+		return true;
+		}
+
+	if ( Info().mode == MODE_REREAD && sb.st_ino == ino && sb.st_mtime == mtime )
+		{
+		// No change.
+		close(fd);
+		return true;
+		}
+
+	// Warn again in case of trouble if the file changes.
+	if ( ino != 0 )
+		StopWarningSuppression();
+
+	mtime = sb.st_mtime;
+	ino = sb.st_ino;
+
+	size_t len = sb.st_size;
+	void* data = len ? mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+
+	if ( len && data == MAP_FAILED )
+		{
+		char buf[256];
+		util::zeek_strerror_r(errno, buf, sizeof(buf));
+		Error(Fmt("cannot map %s: %s", fname.c_str(), buf));
+		close(fd);
+		return false;
+		}
+
+	close(fd);
+
+	if ( len )
+		madvise(data, len, MADV_SEQUENTIAL);
+
+	bool ok = Load(len ? static_cast<const char*>(data) : "", len);
+
+	if ( len )
+		munmap(data, len);
+
+	return ok;
+	}
+
+bool Snapshot::Load(const char* data, size_t len)
+	{
+	logging::LogSnapshot snap(data, len);
+
+	if ( ! snap.Valid() )
+		{
+		Error(Fmt("%s is not a snapshot file", fname.c_str()));
+		return false;
+		}
+
+	const auto& columns = snap.Fields();
+	std::vector<const Field*> column_fields;
+
+	for ( const auto& c : columns )
+		column_fields.push_back(&c);
+
+	// For each of our fields, the file's column that has it, or -1 for
+	// none.
+	std::vector<int> column_for(NumFields(), -1);
+
+	for ( int i = 0; i < NumFields(); ++i )
+		{
+		const Field* f = Fields()[i];
+
+		for ( size_t j = 0; j < columns.size(); ++j )
+			{
+			if ( strcmp(f->name, columns[j].name) != 0 )
+				continue;
+
+			bool container = (f->type == TYPE_TABLE || f->type == TYPE_VECTOR);
+
+			if ( f->type != columns[j].type || (container && f->subtype != columns[j].subtype) )
+				{
+				Error(Fmt("field %s has type %s in %s", f->name, type_name(columns[j].type),
+				          fname.c_str()));
+				return false;
+				}
+
+			column_for[i] = static_cast<int>(j);
+			break;
+			}
+
+		if ( column_for[i] < 0 && ! f->optional )
+			{
+			Error(Fmt("field %s is missing in %s", f->name, fname.c_str()));
+			return false;
+			}
+		}
+
+	const char* block;
+	size_t block_len;
+	bool malformed = false;
+
+	while ( ! malformed && snap.NextBlock(&block, &block_len) )
+		{
+		logging::LogWireReader reader(block, block_len);
+
+		if ( ! reader.Valid() || reader.NumFields() != static_cast<int>(columns.size()) )
+			{
+			malformed = true;
+			break;
+			}
+
+		for ( int e = 0; e < reader.Entries(); ++e )
+			{
+			Value** row = reader.ReadEntry(column_fields.data());
+
+			if ( ! row )
+				{
+				malformed = true;
+				break;
+				}
+
+			Value** vals = new Value*[NumFields()];
+
+			for ( int i = 0; i < NumFields(); ++i )
+				{
+				if ( column_for[i] >= 0 )
+					{
+					vals[i] = row[column_for[i]];
+					row[column_for[i]] = nullptr;
+					}
+				else
+					vals[i] = new Value(Fields()[i]->type, Fields()[i]->subtype, false);
+				}
+
+			for ( size_t j = 0; j < columns.size(); ++j )
+				delete row[j];
+
+			delete[] row;
+			SendEntry(vals);
+			}
+		}
+
+	if ( malformed || ! snap.Valid() )
+		{
+		Error(Fmt("%s is malformed", fname.c_str()));
+		return false;
+		}
+
+	EndCurrentSend();
+	return true;
+	}
+
+bool Snapshot::DoHeartbeat(double network_time, double current_time)
+	{
+	switch ( Info().mode )
+		{
+		case MODE_MANUAL:
+			// Nothing to do.
+			break;
+
+		case MODE_REREAD:
+			Update(); // Call Update, not DoUpdate, because Update
+			          // checks the "disabled" flag.
+			break;
+
+		default:
+			assert(false);
+		}
+
+	return true;
+	}
+
+	} // namespace zeek::input::reader::detail
@@ -0,0 +1,44 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <sys/types.h>
+#include <string>
+
+#include "zeek/input/ReaderBackend.h"
+
+namespace zeek::input::reader::detail
+	{
+
+/**
+ * Reader for snapshot files written by the snapshot log writer. It maps a
+ * file into memory and decodes the values straight from there, matching
+ * the stream's fields to the file's by name, so that loading large tables
+ * doesn't need to parse any text. Only the manual and reread modes are
+ * supported.
+ */
+class Snapshot : public ReaderBackend
+	{
+public:
+	explicit Snapshot(ReaderFrontend* frontend);
+	~Snapshot() override;
+
+	static ReaderBackend* Instantiate(ReaderFrontend* frontend) { return new Snapshot(frontend); }
+
+protected:
+	bool DoInit(const ReaderInfo& info, int arg_num_fields,
+	            const threading::Field* const* fields) override;
+	void DoClose() override { }
+	bool DoUpdate() override;
+	bool DoHeartbeat(double network_time, double current_time) override;
+
+private:
+	// Sends the entries of a mapped file.
+	bool Load(const char* data, size_t len);
+
+	std::string fname;
+	time_t mtime = 0;
+	ino_t ino = 0;
+	};
+
+	} // namespace zeek::input::reader::detail
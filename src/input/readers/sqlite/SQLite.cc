@@ -7,6 +7,7 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <cstdint>
 #include <fstream>
 #include <sstream>
 
@@ -83,9 +84,14 @@ bool SQLite::DoInit(const ReaderInfo& info, int arg_num_fields,
 	sqlite3_enable_shared_cache(1);
 #endif
 
-	if ( Info().mode != MODE_MANUAL )
+	ReaderInfo::config_map::const_iterator key_it = info.config.find("key");
+
+	if ( key_it != info.config.end() )
+		key = key_it->second;
+
+	if ( Info().mode != MODE_MANUAL && (Info().mode != MODE_STREAM || key.empty()) )
 		{
-		Error("SQLite only supports manual reading mode.");
+		Error("SQLite only supports manual reading mode, and streaming mode with a key.");
 		return false;
 		}
 
@@ -118,6 +124,17 @@ bool SQLite::DoInit(const ReaderInfo& info, int arg_num_fields,
 		return false;
 		}
 
+	if ( ! key.empty() )
+		{
+		last_param = sqlite3_bind_parameter_index(st, ":last");
+
+		if ( ! last_param )
+			{
+			Error("A query with a key needs to select rows by the :last parameter.");
+			return false;
+			}
+		}
+
 	DoUpdate();
 
 	return true;
@@ -243,9 +260,79 @@ Value* SQLite::EntryToVal(sqlite3_stmt* st, const threading::Field* field, int p
 	return val;
 	}
 
+bool SQLite::BindLast()
+	{
+	switch ( last_type )
+		{
+		case SQLITE_INTEGER:
+			return ! checkError(sqlite3_bind_int64(st, last_param, last_int));
+
+		case SQLITE_FLOAT:
+			return ! checkError(sqlite3_bind_double(st, last_param, last_double));
+
+		default:
+			// Nothing yet, so take all rows.
+			return ! checkError(sqlite3_bind_int64(st, last_param, INT64_MIN));
+		}
+	}
+
+bool SQLite::UpdateLast(int column)
+	{
+	switch ( sqlite3_column_type(st, column) )
+		{
+		case SQLITE_INTEGER:
+			{
+			int64_t v = sqlite3_column_int64(st, column);
+
+			if ( last_type == SQLITE_NULL || (last_type == SQLITE_INTEGER && v > last_int) ||
+			     (last_type == SQLITE_FLOAT && v > last_double) )
+				{
+				last_type = SQLITE_INTEGER;
+				last_int = v;
+				}
+
+			return true;
+			}
+
+		case SQLITE_FLOAT:
+			{
+			double v = sqlite3_column_double(st, column);
+
+			if ( last_type == SQLITE_NULL || (last_type == SQLITE_INTEGER && v > last_int) ||
+			     (last_type == SQLITE_FLOAT && v > last_double) )
+				{
+				last_type = SQLITE_FLOAT;
+				last_double = v;
+				}
+
+			return true;
+			}
+
+		case SQLITE_NULL:
+			return true;
+
+		default:
+			Error(Fmt("Key column %s must be a number", key.c_str()));
+			return false;
+		}
+	}
+
+bool SQLite::DoHeartbeat(double network_time, double current_time)
+	{
+	if ( Info().mode == MODE_STREAM )
+		Update(); // Call Update, not DoUpdate, because Update
+		          // checks the "disabled" flag.
+
+	return true;
+	}
+
 bool SQLite::DoUpdate()
 	{
+	if ( ! key.empty() && ! BindLast() )
+		return false;
+
 	int numcolumns = sqlite3_column_count(st);
+	int key_column = -1;
 	int* mapping = new int[num_fields];
 	int* submapping = new int[num_fields];
 
@@ -260,6 +347,9 @@ bool SQLite::DoUpdate()
 		{
 		const char* name = sqlite3_column_name(st, i);
 
+		if ( ! key.empty() && key == name )
+			key_column = i;
+
 		for ( unsigned j = 0; j < num_fields; j++ )
 			{
 			if ( strcmp(fields[j]->name, name) == 0 )
@@ -307,6 +397,14 @@ bool SQLite::DoUpdate()
 			}
 		}
 
+	if ( ! key.empty() && key_column == -1 )
+		{
+		Error(Fmt("Key column %s not found after SQLite statement", key.c_str()));
+		delete[] mapping;
+		delete[] submapping;
+		return false;
+		}
+
 	int errorcode;
 	while ( (errorcode = sqlite3_step(st)) == SQLITE_ROW )
 		{
@@ -327,7 +425,22 @@ bool SQLite::DoUpdate()
 				}
 			}
 
-		SendEntry(ofields);
+		// With a key, the query only returns new rows, so they add to
+		// what's there rather than replacing it.
+		if ( key_column >= 0 )
+			{
+			if ( ! UpdateLast(key_column) )
+				{
+				Value::delete_value_ptr_array(ofields, num_fields);
+				delete[] mapping;
+				delete[] submapping;
+				return false;
+				}
+
+			Put(ofields);
+			}
+		else
+			SendEntry(ofields);
 		}
 
 	delete[] mapping;
@@ -336,7 +449,10 @@ bool SQLite::DoUpdate()
 	if ( checkError(errorcode) ) // check the last error code returned by sqlite
 		return false;
 
-	EndCurrentSend();
+	if ( key_column < 0 )
+		EndCurrentSend();
+	else if ( Info().mode == MODE_MANUAL )
+		EndOfData();
 
 	if ( checkError(sqlite3_reset(st)) )
 		return false;
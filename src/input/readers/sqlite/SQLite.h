@@ -27,11 +27,17 @@ protected:
 	            const threading::Field* const* arg_fields) override;
 	void DoClose() override;
 	bool DoUpdate() override;
-	bool DoHeartbeat(double network_time, double current_time) override { return true; }
+	bool DoHeartbeat(double network_time, double current_time) override;
 
 private:
 	bool checkError(int code);
 
+	// Binds the largest key seen so far to the query's :last parameter.
+	bool BindLast();
+
+	// Remembers a row's key if it's the largest so far.
+	bool UpdateLast(int column);
+
 	threading::Value* EntryToVal(sqlite3_stmt* st, const threading::Field* field, int pos,
 	                             int subpos);
 
@@ -44,6 +50,14 @@ private:
 	sqlite3_stmt* st;
 	threading::formatter::Ascii* io;
 
+	// For incremental queries, the column holding a key that increases
+	// with each new row, and the largest one seen so far.
+	std::string key;
+	int last_param = 0;
+	int last_type = SQLITE_NULL;
+	int64_t last_int = 0;
+	double last_double = 0;
+
 	std::string set_separator;
 	std::string unset_field;
 	std::string empty_field;
@@ -3,12 +3,16 @@
 #include "zeek/iosource/Manager.h"
 
 #include <cassert>
+#ifdef HAVE_LINUX
+#include <sys/epoll.h>
+#else
 // These two files have to remain in the same order or FreeBSD builds
 // stop working.
 // clang-format off
 #include <sys/types.h>
 #include <sys/event.h>
 // clang-format on
+#endif
 #include <sys/time.h>
 #include <unistd.h>
 
@@ -57,9 +61,19 @@ void Manager::WakeupHandler::Ping(std::string_view where)
 
 Manager::Manager()
 	{
+#ifdef HAVE_LINUX
+	event_queue = epoll_create1(EPOLL_CLOEXEC);
+	if ( event_queue == -1 )
+		reporter->FatalError("Failed to initialize epoll: %s", strerror(errno));
+
+	// epoll_wait() needs room for at least one event, even before any fds
+	// get registered.
+	events.resize(1);
+#else
 	event_queue = kqueue();
 	if ( event_queue == -1 )
 		reporter->FatalError("Failed to initialize kqueue: %s", strerror(errno));
+#endif
 	}
 
 Manager::~Manager()
@@ -96,6 +110,7 @@ Manager::~Manager()
 void Manager::InitPostScript()
 	{
 	wakeup = new WakeupHandler();
+	busy_poll = BifConst::io_busy_poll;
 	}
 
 void Manager::RemoveAll()
@@ -141,6 +156,17 @@ void Manager::FindReadySources(ReadySources* ready)
 		time_to_poll = true;
 		}
 
+	// While a live packet source keeps delivering packets, go straight
+	// back to it without looking at the other sources' timeouts. Timers
+	// still expire with each packet, and the other sources get their turn
+	// whenever it's time to poll.
+	if ( busy_poll && ! time_to_poll && pkt_src && pkt_src->IsLive() && pkt_src->IsOpen() &&
+	     pkt_src->Busy() )
+		{
+		ready->push_back({pkt_src, -1, 0});
+		return;
+		}
+
 	// Find the source with the next timeout value.
 	for ( auto src : sources )
 		{
@@ -196,6 +222,59 @@ void Manager::FindReadySources(ReadySources* ready)
 		Poll(ready, timeout, timeout_src);
 	}
 
+#ifdef HAVE_LINUX
+
+void Manager::Poll(ReadySources* ready, double timeout, IOSource* timeout_src)
+	{
+	struct timespec spec;
+	ConvertTimeout(timeout, spec);
+
+	// epoll_wait() can't wait for less than a millisecond. Round down, so
+	// that sources asking for shorter timeouts, like the ones without a
+	// selectable fd, get checked again right away rather than late.
+	int timeout_ms = static_cast<int>(spec.tv_sec * 1000 + spec.tv_nsec / 1000000);
+
+	int ret = epoll_wait(event_queue, events.data(), events.size(), timeout_ms);
+	if ( ret == -1 )
+		{
+		// Ignore interrupts since we may catch one during shutdown and we don't want the
+		// error to get printed.
+		if ( errno != EINTR )
+			reporter->InternalWarning("Error calling epoll_wait: %s", strerror(errno));
+		}
+	else if ( ret == 0 )
+		{
+		if ( timeout_src )
+			ready->push_back({timeout_src, -1, 0});
+		}
+	else
+		{
+		for ( int i = 0; i < ret; i++ )
+			{
+			int fd = events[i].data.fd;
+			uint32_t ev = events[i].events;
+
+			// kqueue reports errors and hangups as readability, and
+			// sources expect to find out about them when reading.
+			if ( (ev & (EPOLLIN | EPOLLHUP | EPOLLERR)) != 0 )
+				{
+				std::map<int, IOSource*>::const_iterator it = fd_map.find(fd);
+				if ( it != fd_map.end() )
+					ready->push_back({it->second, fd, IOSource::ProcessFlags::READ});
+				}
+
+			if ( (ev & EPOLLOUT) != 0 )
+				{
+				std::map<int, IOSource*>::const_iterator it = write_fd_map.find(fd);
+				if ( it != write_fd_map.end() )
+					ready->push_back({it->second, fd, IOSource::ProcessFlags::WRITE});
+				}
+			}
+		}
+	}
+
+#else
+
 void Manager::Poll(ReadySources* ready, double timeout, IOSource* timeout_src)
 	{
 	struct timespec kqueue_timeout;
@@ -238,6 +317,8 @@ void Manager::Poll(ReadySources* ready, double timeout, IOSource* timeout_src)
 		}
 	}
 
+#endif
+
 void Manager::ConvertTimeout(double timeout, struct timespec& spec)
 	{
 	// If timeout ended up -1, set it to some nominal value just to keep the loop
@@ -255,6 +336,91 @@ void Manager::ConvertTimeout(double timeout, struct timespec& spec)
 		}
 	}
 
+#ifdef HAVE_LINUX
+
+bool Manager::RegisterFd(int fd, IOSource* src, int flags)
+	{
+	bool have_read = fd_map.count(fd) != 0;
+	bool have_write = write_fd_map.count(fd) != 0;
+	bool add_read = (flags & IOSource::READ) != 0 && ! have_read;
+	bool add_write = (flags & IOSource::WRITE) != 0 && ! have_write;
+
+	if ( ! add_read && ! add_write )
+		return true;
+
+	// epoll keeps a single registration per fd, covering both directions.
+	struct epoll_event ev = {};
+	ev.data.fd = fd;
+	ev.events = (have_read || add_read ? EPOLLIN : 0) | (have_write || add_write ? EPOLLOUT : 0);
+
+	int op = have_read || have_write ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+
+	if ( epoll_ctl(event_queue, op, fd, &ev) == -1 )
+		{
+		reporter->Error("Failed to register fd %d from %s: %s (flags %d)", fd, src->Tag(),
+		                strerror(errno), flags);
+		return false;
+		}
+
+	DBG_LOG(DBG_MAINLOOP, "Registered fd %d from %s", fd, src->Tag());
+
+	if ( op == EPOLL_CTL_ADD )
+		events.push_back({});
+
+	if ( add_read )
+		fd_map[fd] = src;
+	if ( add_write )
+		write_fd_map[fd] = src;
+
+	Wakeup("RegisterFd");
+	return true;
+	}
+
+bool Manager::UnregisterFd(int fd, IOSource* src, int flags)
+	{
+	bool have_read = fd_map.count(fd) != 0;
+	bool have_write = write_fd_map.count(fd) != 0;
+	bool del_read = (flags & IOSource::READ) != 0 && have_read;
+	bool del_write = (flags & IOSource::WRITE) != 0 && have_write;
+
+	if ( ! del_read && ! del_write )
+		{
+		reporter->Error("Attempted to unregister an unknown file descriptor %d from %s", fd,
+		                src->Tag());
+		return false;
+		}
+
+	bool keep_read = have_read && ! del_read;
+	bool keep_write = have_write && ! del_write;
+
+	struct epoll_event ev = {};
+	ev.data.fd = fd;
+	ev.events = (keep_read ? EPOLLIN : 0) | (keep_write ? EPOLLOUT : 0);
+
+	// We don't care about failure here. If it failed to unregister, it's
+	// likely because the file descriptor was already closed, which removes
+	// it from the epoll set automatically.
+	if ( keep_read || keep_write )
+		epoll_ctl(event_queue, EPOLL_CTL_MOD, fd, &ev);
+	else
+		{
+		epoll_ctl(event_queue, EPOLL_CTL_DEL, fd, &ev);
+		events.pop_back();
+		}
+
+	DBG_LOG(DBG_MAINLOOP, "Unregistered fd %d from %s", fd, src->Tag());
+
+	if ( del_read )
+		fd_map.erase(fd);
+	if ( del_write )
+		write_fd_map.erase(fd);
+
+	Wakeup("UnregisterFd");
+	return true;
+	}
+
+#else
+
 bool Manager::RegisterFd(int fd, IOSource* src, int flags)
 	{
 	std::vector<struct kevent> new_events;
@@ -357,6 +523,8 @@ bool Manager::UnregisterFd(int fd, IOSource* src, int flags)
 	return true;
 	}
 
+#endif
+
 void Manager::Register(IOSource* src, bool dont_count, bool manage_lifetime)
 	{
 	// First see if we already have registered that source. If so, just
@@ -456,6 +624,20 @@ PktSrc* Manager::OpenPktSrc(const std::string& path, bool is_live)
 	return ps;
 	}
 
+void Manager::GetPktDumperStats(PktDumper::Stats* stats) const
+	{
+	*stats = PktDumper::Stats();
+
+	for ( auto* pd : pkt_dumpers )
+		{
+		PktDumper::Stats s;
+		pd->Statistics(&s);
+		stats->dumped += s.dumped;
+		stats->dropped += s.dropped;
+		stats->bytes_dumped += s.bytes_dumped;
+		}
+	}
+
 PktDumper* Manager::OpenPktDumper(const std::string& path, bool append)
 	{
 	std::pair<std::string, std::string> t = split_prefix(path);
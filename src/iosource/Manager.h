@@ -10,9 +10,14 @@
 
 #include "zeek/Flare.h"
 #include "zeek/iosource/IOSource.h"
+#include "zeek/iosource/PktDumper.h"
 
 struct timespec;
+#ifdef HAVE_LINUX
+struct epoll_event;
+#else
 struct kevent;
+#endif
 
 namespace zeek
 	{
@@ -20,7 +25,6 @@ namespace iosource
 	{
 
 class PktSrc;
-class PktDumper;
 
 /**
  * Manager class for IO sources. This handles all of the polling of sources
@@ -114,6 +118,14 @@ public:
 	 */
 	PktDumper* OpenPktDumper(const std::string& path, bool append);
 
+	/**
+	 * Returns the statistics of all packet dumpers opened so far, summed
+	 * up.
+	 *
+	 * @param stats A statistics structure that the method fills out.
+	 */
+	void GetPktDumperStats(PktDumper::Stats* stats) const;
+
 	/**
 	 * Finds the sources that have data ready to be processed.
 	 *
@@ -163,7 +175,7 @@ private:
 
 	/**
 	 * Converts a double timeout value into a timespec struct used for calls
-	 * to kevent().
+	 * to kevent(), or to epoll_wait() after rounding to milliseconds.
 	 */
 	void ConvertTimeout(double timeout, struct timespec& spec);
 
@@ -218,13 +230,21 @@ private:
 	int poll_counter = 0;
 	int poll_interval = 100;
 
+	// See io_busy_poll.
+	bool busy_poll = false;
+
+	// An epoll instance on Linux, a kqueue elsewhere.
 	int event_queue = -1;
 	std::map<int, IOSource*> fd_map;
 	std::map<int, IOSource*> write_fd_map;
 
-	// This is only used for the output of the call to kqueue in FindReadySources().
-	// The actual events are stored as part of the queue.
+	// This is only used for the output of the call to kqueue or epoll in
+	// FindReadySources(). The actual events are stored as part of the queue.
+#ifdef HAVE_LINUX
+	std::vector<struct epoll_event> events;
+#else
 	std::vector<struct kevent> events;
+#endif
 	};
 
 	} // namespace iosource
@@ -63,8 +63,13 @@ void Packet::Init(int arg_link_type, pkt_timeval* arg_ts, uint32_t arg_caplen, u
 
 	l4_checksummed = false;
 
+	flow_hash = 0;
+	has_flow_hash = false;
+	hw_timestamp = 0;
+
 	encap.reset();
 	ip_hdr.reset();
+	buffer.reset();
 
 	proto = -1;
 	tunnel_type = BifEnum::Tunnel::IP;
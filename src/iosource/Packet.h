@@ -18,6 +18,7 @@ using pkt_timeval = struct timeval;
 #include "zeek/IP.h"
 #include "zeek/NetVar.h" // For BifEnum::Tunnel
 #include "zeek/TunnelEncapsulation.h"
+#include "zeek/iosource/PacketBuffer.h"
 #include "zeek/session/Session.h"
 
 namespace zeek
@@ -150,6 +151,13 @@ public:
 	uint32_t cap_len; /// Captured packet length
 	uint32_t link_type; /// pcap link_type (DLT_EN10MB, DLT_RAW, etc)
 
+	/**
+	 * If set by the packet source, the buffer that *data* points into.
+	 * Holding a reference to it keeps the data valid beyond the packet's
+	 * processing, which allows to avoid copying it. Reset by Init().
+	 */
+	iosource::PacketBufferPtr buffer;
+
 	/**
 	 * Layer 3 protocol identified (if any).
 	 */
@@ -208,6 +216,25 @@ public:
 	 */
 	bool l4_checksummed = false;
 
+	/**
+	 * Flow hash that the capture hardware or kernel computed for the
+	 * packet, e.g. a NIC's RSS hash. Only meaningful if has_flow_hash is
+	 * set. Like the checksummed flags, this applies only to packets
+	 * received via a packet source.
+	 */
+	uint32_t flow_hash = 0;
+
+	/**
+	 * Indicates whether flow_hash is set.
+	 */
+	bool has_flow_hash = false;
+
+	/**
+	 * Hardware timestamp of the packet in nanoseconds since the epoch, or
+	 * zero if the packet source doesn't provide one.
+	 */
+	uint64_t hw_timestamp = 0;
+
 	/**
 	 * Indicates whether this packet should be recorded.
 	 */
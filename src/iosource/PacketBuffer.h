@@ -0,0 +1,151 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <sys/types.h> // for u_char
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "zeek/IntrusivePtr.h"
+
+namespace zeek::iosource
+	{
+
+class PacketBuffer;
+
+inline void Ref(PacketBuffer* b);
+inline void Unref(PacketBuffer* b);
+
+/**
+ * A reference-counted handle to the memory holding a packet's data.
+ *
+ * Packet sources can attach such a handle to a Packet to lend Zeek the
+ * memory the packet lives in, e.g. a slot of a ring buffer. Components
+ * that need to keep data around beyond the packet's processing, like the
+ * reassemblers, can then hold on to a reference instead of copying the
+ * data. Once the last reference goes away, Release() gives the memory
+ * back to its owner.
+ */
+class PacketBuffer
+	{
+public:
+	/**
+	 * Constructor.
+	 *
+	 * @param data The memory represented by the buffer.
+	 *
+	 * @param size The number of bytes available at *data*.
+	 */
+	PacketBuffer(const u_char* data, size_t size) : data(data), size(size) { }
+
+	virtual ~PacketBuffer() = default;
+
+	PacketBuffer(const PacketBuffer&) = delete;
+	PacketBuffer& operator=(const PacketBuffer&) = delete;
+
+	/**
+	 * Returns a pointer to the start of the buffer's memory.
+	 */
+	const u_char* Data() const { return data; }
+
+	/**
+	 * Returns the size of the buffer's memory in bytes.
+	 */
+	size_t Size() const { return size; }
+
+	/**
+	 * Returns true if the range of *len* bytes starting at *p* lies
+	 * completely within the buffer.
+	 */
+	bool Contains(const u_char* p, size_t len) const
+		{
+		auto start = reinterpret_cast<uintptr_t>(data);
+		auto addr = reinterpret_cast<uintptr_t>(p);
+		return addr >= start && addr - start <= size && len <= size - (addr - start);
+		}
+
+	/**
+	 * Returns true if it's worth keeping a reference to the buffer
+	 * rather than copying the given range out of it. That's the case if
+	 * the range lies within the buffer and covers a good part of it, so
+	 * that we don't hold on to a whole packet for just a few bytes.
+	 */
+	bool WorthRetaining(const u_char* p, size_t len) const
+		{
+		return len >= size / 2 && Contains(p, len);
+		}
+
+	/**
+	 * Returns the current number of references to the buffer.
+	 */
+	int RefCount() const { return ref_cnt; }
+
+protected:
+	/**
+	 * Updates the memory the buffer refers to. Meant for sources that
+	 * recycle buffer instances once they've been released.
+	 */
+	void SetData(const u_char* arg_data, size_t arg_size)
+		{
+		data = arg_data;
+		size = arg_size;
+		}
+
+	/**
+	 * Called once the last reference to the buffer has gone away.
+	 * Derived classes can override this to return the memory to its
+	 * source. The default implementation deletes the instance.
+	 */
+	virtual void Release() { delete this; }
+
+private:
+	friend void Ref(PacketBuffer* b);
+	friend void Unref(PacketBuffer* b);
+
+	const u_char* data;
+	size_t size;
+	int ref_cnt = 1;
+	};
+
+/**
+ * A packet buffer owning a heap-allocated chunk of memory. Packet sources
+ * that need to copy packet data anyway can use these to make that the
+ * only copy.
+ */
+class HeapPacketBuffer : public PacketBuffer
+	{
+public:
+	HeapPacketBuffer() : PacketBuffer(nullptr, 0) { }
+
+	/**
+	 * Copies *len* bytes from *src* into the buffer, growing it as
+	 * needed. Must only be called while nobody else holds a reference.
+	 */
+	void Assign(const u_char* src, size_t len)
+		{
+		if ( storage.size() < len )
+			storage.resize(len);
+
+		memcpy(storage.data(), src, len);
+		SetData(storage.data(), len);
+		}
+
+private:
+	std::vector<u_char> storage;
+	};
+
+inline void Ref(PacketBuffer* b)
+	{
+	++b->ref_cnt;
+	}
+
+inline void Unref(PacketBuffer* b)
+	{
+	if ( b && --b->ref_cnt == 0 )
+		b->Release();
+	}
+
+using PacketBufferPtr = IntrusivePtr<PacketBuffer>;
+
+	} // namespace zeek::iosource
@@ -4,6 +4,7 @@
 
 #include "zeek/zeek-config.h"
 
+#include <cstdint>
 #include <string>
 
 namespace zeek
@@ -45,6 +46,35 @@ public:
 	 */
 	double OpenTime() const;
 
+	/**
+	 * Statistics returned by Statistics().
+	 */
+	struct Stats
+		{
+		/**
+		 * Packets written, or queued for writing.
+		 */
+		uint64_t dumped = 0;
+
+		/**
+		 * Packets dropped because the dumper couldn't keep up.
+		 */
+		uint64_t dropped = 0;
+
+		/**
+		 * Bytes of packet data written, or queued for writing.
+		 */
+		uint64_t bytes_dumped = 0;
+		};
+
+	/**
+	 * Returns current statistics about the dumper. The default
+	 * implementation reports nothing.
+	 *
+	 * @param stats A statistics structure that the method fill out.
+	 */
+	virtual void Statistics(Stats* stats) { *stats = Stats(); }
+
 	/**
 	 * Returns returns true if the dumper has encountered an error.
 	 */
@@ -5,8 +5,10 @@
 #include "zeek/zeek-config.h"
 
 #include <sys/stat.h>
+#include <algorithm>
 
 #include "zeek/Hash.h"
+#include "zeek/PacketTracer.h"
 #include "zeek/RunState.h"
 #include "zeek/broker/Manager.h"
 #include "zeek/iosource/BPF_Program.h"
@@ -19,12 +21,17 @@
 namespace zeek::iosource
 	{
 
+// Compiled programs beyond this many that no index refers to anymore get
+// dropped from the cache.
+static constexpr size_t MAX_CACHED_FILTERS = 64;
+
 PktSrc::Properties::Properties()
 	{
 	selectable_fd = -1;
 	link_type = -1;
 	netmask = NETMASK_UNKNOWN;
 	is_live = false;
+	batch_size = 1;
 	}
 
 PktSrc::PktSrc()
@@ -34,11 +41,7 @@ PktSrc::PktSrc()
 	SetClosed(true);
 	}
 
-PktSrc::~PktSrc()
-	{
-	for ( auto code : filters )
-		delete code;
-	}
+PktSrc::~PktSrc() { }
 
 const std::string& PktSrc::Path() const
 	{
@@ -76,6 +79,14 @@ void PktSrc::Opened(const Properties& arg_props)
 	props = arg_props;
 	SetClosed(false);
 
+	if ( props.batch_size == 0 )
+		props.batch_size = 1;
+
+	if ( batch.size() != props.batch_size )
+		batch = std::vector<Packet>(props.batch_size);
+
+	batch_len = batch_pos = 0;
+
 	if ( ! PrecompileFilter(0, "") || ! SetFilter(0) )
 		{
 		Close();
@@ -148,13 +159,37 @@ void PktSrc::Process()
 	if ( ! IsOpen() )
 		return;
 
-	if ( ! ExtractNextPacketInternal() )
-		return;
+	busy = false;
 
-	run_state::detail::dispatch_packet(&current_packet, this);
+	// Work through all packets the source has given us with its most
+	// recent batch before returning to the run loop for polling.
+	while ( ExtractNextPacketInternal() )
+		{
+		busy = true;
+		run_state::detail::dispatch_packet(&batch[batch_pos], this);
 
-	have_packet = false;
-	DoneWithPacket();
+		have_packet = false;
+		++batch_pos;
+
+		if ( batch_pos >= batch_len || ! IsOpen() || run_state::is_processing_suspended() )
+			break;
+		}
+
+	if ( batch_pos >= batch_len )
+		ReleaseBatch();
+	}
+
+void PktSrc::ReleaseBatch()
+	{
+	if ( batch_len > 0 )
+		DoneWithPacket();
+
+	batch_len = batch_pos = 0;
+	}
+
+size_t PktSrc::ExtractNextPackets(Packet* pkts, size_t max)
+	{
+	return ExtractNextPacket(pkts) ? 1 : 0;
 	}
 
 const char* PktSrc::Tag()
@@ -167,8 +202,6 @@ bool PktSrc::ExtractNextPacketInternal()
 	if ( have_packet )
 		return true;
 
-	have_packet = false;
-
 	// Don't return any packets if processing is suspended (except for the
 	// very first packet which we need to set up times).
 	if ( run_state::is_processing_suspended() && run_state::detail::first_timestamp )
@@ -177,16 +210,38 @@ bool PktSrc::ExtractNextPacketInternal()
 	if ( run_state::pseudo_realtime )
 		run_state::detail::current_wallclock = util::current_time(true);
 
-	if ( ExtractNextPacket(&current_packet) )
+	if ( batch_pos >= batch_len && IsOpen() )
 		{
-		if ( current_packet.time < 0 )
+		ReleaseBatch();
+
+		// In pseudo-realtime mode every packet needs to wait for its
+		// own timestamp, so there's no point in fetching more than one.
+		size_t max = run_state::pseudo_realtime ? 1 : batch.size();
+
+		if ( zeek::detail::packet_tracer )
 			{
-			Weird("negative_packet_timestamp", &current_packet);
+			auto start = util::current_time(true);
+			batch_len = ExtractNextPackets(batch.data(), max);
+			zeek::detail::packet_tracer->ExtractedBatch(util::current_time(true) - start,
+			                                            batch_len);
+			}
+		else
+			batch_len = ExtractNextPackets(batch.data(), max);
+		}
+
+	if ( batch_pos < batch_len )
+		{
+		Packet* pkt = &batch[batch_pos];
+
+		if ( pkt->time < 0 )
+			{
+			Weird("negative_packet_timestamp", pkt);
+			++batch_pos;
 			return false;
 			}
 
 		if ( ! run_state::detail::first_timestamp )
-			run_state::detail::first_timestamp = current_packet.time;
+			run_state::detail::first_timestamp = pkt->time;
 
 		have_packet = true;
 		return true;
@@ -225,20 +280,37 @@ bool PktSrc::PrecompileBPFFilter(int index, const std::string& filter)
 	if ( index < 0 )
 		return false;
 
-	// Compile filter.
-	auto code = CompileFilter(filter);
-	if ( ! code )
-		return false;
+	detail::BPF_Program* code;
+
+	if ( auto it = compiled_filters.find(filter); it != compiled_filters.end() )
+		code = it->second.get();
+	else
+		{
+		// Compile filter.
+		code = CompileFilter(filter);
+		if ( ! code )
+			return false;
+
+		compiled_filters.emplace(filter, code);
+		}
 
 	// Store it in vector.
 	if ( index >= static_cast<int>(filters.size()) )
 		filters.resize(index + 1);
 
-	if ( auto* old = filters[index] )
-		delete old;
-
 	filters[index] = code;
 
+	if ( compiled_filters.size() > MAX_CACHED_FILTERS )
+		{
+		for ( auto it = compiled_filters.begin(); it != compiled_filters.end(); )
+			{
+			if ( std::find(filters.begin(), filters.end(), it->second.get()) == filters.end() )
+				it = compiled_filters.erase(it);
+			else
+				++it;
+			}
+		}
+
 	return true;
 	}
 
@@ -272,7 +344,7 @@ bool PktSrc::GetCurrentPacket(const Packet** pkt)
 	if ( ! have_packet )
 		return false;
 
-	*pkt = &current_packet;
+	*pkt = &batch[batch_pos];
 	return true;
 	}
 
@@ -303,11 +375,11 @@ double PktSrc::GetNextTimeout()
 	else if ( IsLive() )
 		return -1;
 
-	if ( ! run_state::pseudo_realtime )
+	if ( ! run_state::pseudo_realtime || ! pkt_available )
 		return 0;
 
 	// This duplicates the calculation used in run_state::check_pseudo_time().
-	double pseudo_time = current_packet.time - run_state::detail::first_timestamp;
+	double pseudo_time = batch[batch_pos].time - run_state::detail::first_timestamp;
 	double ct = (util::current_time(true) - run_state::detail::first_wallclock) *
 	            run_state::pseudo_realtime;
 	return std::max(0.0, pseudo_time - ct);
@@ -3,6 +3,9 @@
 #pragma once
 
 #include <sys/types.h> // for u_char
+#include <map>
+#include <memory>
+#include <string>
 #include <vector>
 
 #include "zeek/iosource/IOSource.h"
@@ -52,7 +55,14 @@ public:
 		 */
 		uint64_t bytes_received;
 
-		Stats() { received = dropped = link = bytes_received = 0; }
+		/**
+		 * Number of times the kernel's capture ring filled up and had to
+		 * stop taking packets until the source caught up. Optional, can
+		 * be left unset if not available.
+		 */
+		uint64_t freezes;
+
+		Stats() { received = dropped = link = bytes_received = freezes = 0; }
 		};
 
 	/**
@@ -76,6 +86,12 @@ public:
 	 */
 	bool IsLive() const;
 
+	/**
+	 * Returns true if the most recent processing of the source found
+	 * packets, so that more are likely waiting. See io_busy_poll.
+	 */
+	bool Busy() const { return busy; }
+
 	/**
 	 * Returns the link type of the source.
 	 */
@@ -105,6 +121,10 @@ public:
 	 * This is primarily a helper for packet source implementation that
 	 * want to apply BPF filtering to their packets.
 	 *
+	 * Compiled programs are cached by their filter text, so installing a
+	 * filter that has been compiled before (e.g., when the packet filter
+	 * framework reinstalls its filters) doesn't compile it again.
+	 *
 	 * @param index The index to associate with the filter.
 	 *
 	 * @param BPF filter The filter string to precompile.
@@ -246,6 +266,13 @@ protected:
 		 */
 		bool is_live;
 
+		/**
+		 * The maximum number of packets the source may hand back from
+		 * a single call to \a ExtractNextPackets(). Sources that don't
+		 * implement batching leave this at 1.
+		 */
+		size_t batch_size;
+
 		Properties();
 		};
 
@@ -330,9 +357,36 @@ protected:
 	 */
 	virtual bool ExtractNextPacket(Packet* pkt) = 0;
 
+	/**
+	 * Provides a batch of packets from the source. The base class will
+	 * dispatch all packets of a batch before it polls the source again,
+	 * which avoids going through the run loop once per packet.
+	 *
+	 * The default implementation falls back to \a ExtractNextPacket()
+	 * and returns at most one packet. Derived classes that can deliver
+	 * several packets at once should override this and set \a
+	 * Properties::batch_size accordingly when calling \a Opened().
+	 *
+	 * @param pkts An array of at least *max* packet structures to fill
+	 * in. As with \a ExtractNextPacket(), the callee keeps ownership of
+	 * the data but must guarantee that the data of all packets stays
+	 * available until \a DoneWithPacket() is called, which happens
+	 * once after the whole batch has been processed.
+	 *
+	 * @param max The maximum number of packets to return. This will be
+	 * at least one and at most the \a Properties::batch_size the source
+	 * passed to \a Opened().
+	 *
+	 * @return The number of packets filled in, which is zero if no
+	 * packet is available or an error occured (which must be flagged
+	 * via Error()).
+	 */
+	virtual size_t ExtractNextPackets(Packet* pkts, size_t max);
+
 	/**
 	 * Signals that the data of previously extracted packet will no
-	 * longer be needed.
+	 * longer be needed. If the source returned a batch of packets via
+	 * \a ExtractNextPackets(), this is called once for the whole batch.
 	 */
 	virtual void DoneWithPacket() = 0;
 
@@ -342,6 +396,10 @@ private:
 	// Internal helper for ExtractNextPacket().
 	bool ExtractNextPacketInternal();
 
+	// Signals the source that the current batch has been processed
+	// and resets the batch state.
+	void ReleaseBatch();
+
 	// IOSource interface implementation.
 	void InitSource() override;
 	void Done() override;
@@ -351,10 +409,19 @@ private:
 	Properties props;
 
 	bool have_packet;
-	Packet current_packet;
+	bool busy = false;
+
+	// The packets of the most recent batch returned by the source.
+	// batch_len of them are valid, and batch_pos is the index of the
+	// one currently being processed.
+	std::vector<Packet> batch;
+	size_t batch_len = 0;
+	size_t batch_pos = 0;
 
-	// For BPF filtering support.
+	// For BPF filtering support. The programs are owned by
+	// compiled_filters, keyed by their filter text.
 	std::vector<detail::BPF_Program*> filters;
+	std::map<std::string, std::unique_ptr<detail::BPF_Program>> compiled_filters;
 
 	std::string errbuf;
 	};
@@ -0,0 +1,121 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/iosource/af_packet/RX_Ring.h"
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+#include "zeek/util.h"
+
+namespace zeek::iosource::af_packet
+	{
+
+RX_Ring::RX_Ring(int sock, size_t bufsize, size_t blocksize, int blocktimeout_msec)
+	{
+	int ret, ver = TPACKET_V3;
+
+	ret = setsockopt(sock, SOL_PACKET, PACKET_VERSION, &ver, sizeof(ver));
+	if ( ret )
+		throw RX_RingException(util::fmt("unable to set TPACKET_V3: %s", strerror(errno)));
+
+	InitLayout(bufsize, blocksize, blocktimeout_msec);
+
+	ret = setsockopt(sock, SOL_PACKET, PACKET_RX_RING, &layout, sizeof(layout));
+	if ( ret )
+		throw RX_RingException(util::fmt("unable to create RX ring: %s", strerror(errno)));
+
+	size = static_cast<size_t>(layout.tp_block_size) * layout.tp_block_nr;
+
+	void* mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_LOCKED |
+	                    MAP_POPULATE, sock, 0);
+	if ( mapped == MAP_FAILED )
+		throw RX_RingException(util::fmt("unable to map RX ring: %s", strerror(errno)));
+
+	ring = static_cast<uint8_t*>(mapped);
+	}
+
+RX_Ring::~RX_Ring()
+	{
+	if ( ring )
+		munmap(ring, size);
+	}
+
+void RX_Ring::InitLayout(size_t bufsize, size_t blocksize, int blocktimeout_msec)
+	{
+	memset(&layout, 0, sizeof(layout));
+
+	// Frames are not used with TPACKET_V3 beyond satisfying the
+	// kernel's sanity checks, so let each block count as one frame.
+	layout.tp_block_size = blocksize;
+	layout.tp_frame_size = blocksize;
+	layout.tp_block_nr = bufsize / blocksize;
+	layout.tp_frame_nr = layout.tp_block_nr;
+	layout.tp_retire_blk_tov = blocktimeout_msec;
+
+#ifdef TP_FT_REQ_FILL_RXHASH
+	// Have the kernel pass along the flow hash it computed for each packet.
+	layout.tp_feature_req_word = TP_FT_REQ_FILL_RXHASH;
+#endif
+
+	if ( layout.tp_block_nr == 0 )
+		throw RX_RingException("buffer size must be at least the block size");
+	}
+
+bool RX_Ring::GetNextPacket(tpacket3_hdr** hdr)
+	{
+	if ( ! block_hdr )
+		{
+		auto* block = reinterpret_cast<tpacket_block_desc*>(ring + block_num *
+		                                                     layout.tp_block_size);
+
+		if ( (block->hdr.bh1.block_status & TP_STATUS_USER) == 0 )
+			return false;
+
+		block_hdr = block;
+
+		if ( block->hdr.bh1.num_pkts == 0 )
+			{
+			// An empty block, which the kernel produces when the
+			// block timeout expires without any packets arriving.
+			NextBlock();
+			return false;
+			}
+
+		packets_left = block->hdr.bh1.num_pkts;
+		packet_hdr = reinterpret_cast<tpacket3_hdr*>(reinterpret_cast<uint8_t*>(block) +
+		                                             block->hdr.bh1.offset_to_first_pkt);
+		}
+
+	if ( packets_left == 0 )
+		// Block needs to be released before we can move on.
+		return false;
+
+	*hdr = packet_hdr;
+	--packets_left;
+
+	if ( packets_left > 0 )
+		packet_hdr = reinterpret_cast<tpacket3_hdr*>(reinterpret_cast<uint8_t*>(packet_hdr) +
+		                                             packet_hdr->tp_next_offset);
+
+	return true;
+	}
+
+void RX_Ring::ReleasePacket()
+	{
+	if ( BlockExhausted() )
+		NextBlock();
+	}
+
+void RX_Ring::NextBlock()
+	{
+	block_hdr->hdr.bh1.block_status = TP_STATUS_KERNEL;
+	block_num = (block_num + 1) % layout.tp_block_nr;
+	block_hdr = nullptr;
+	packet_hdr = nullptr;
+	packets_left = 0;
+	}
+
+	} // namespace zeek::iosource::af_packet
@@ -0,0 +1,93 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+extern "C"
+	{
+#include <linux/if_packet.h> // AF_PACKET, etc.
+	}
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+namespace zeek::iosource::af_packet
+	{
+
+/**
+ * Exception indicating that a TPACKET_V3 ring could not be set up.
+ */
+class RX_RingException : public std::runtime_error
+	{
+public:
+	RX_RingException(const std::string& what_arg) : std::runtime_error(what_arg) { }
+	};
+
+/**
+ * A memory-mapped TPACKET_V3 receive ring attached to an AF_PACKET socket.
+ *
+ * The kernel fills the ring one block at a time and hands a block over to
+ * user space once it's full or its timeout expired. Packets are returned
+ * as pointers directly into the mapped block, so no data gets copied. A
+ * block is handed back to the kernel only once all of its packets have
+ * been consumed and released.
+ */
+class RX_Ring
+	{
+public:
+	/**
+	 * Constructor. Configures the socket for TPACKET_V3 and maps the ring.
+	 * Throws an RX_RingException if that fails.
+	 *
+	 * @param sock The AF_PACKET socket to attach the ring to.
+	 *
+	 * @param bufsize The total size of the ring in bytes.
+	 *
+	 * @param blocksize The size of a single block in bytes. Must be a
+	 * multiple of the page size.
+	 *
+	 * @param blocktimeout_msec Time in milliseconds after which the kernel
+	 * retires a block that's not yet full.
+	 */
+	RX_Ring(int sock, size_t bufsize, size_t blocksize, int blocktimeout_msec);
+	~RX_Ring();
+
+	/**
+	 * Returns the next packet from the ring, if any.
+	 *
+	 * @param hdr Set to point to the packet's frame header on success.
+	 * The packet's data follows at offset *tp_mac* and remains valid
+	 * until the block containing it has been released.
+	 *
+	 * @return True if a packet is available, false if not.
+	 */
+	bool GetNextPacket(tpacket3_hdr** hdr);
+
+	/**
+	 * Returns true if all packets of the current block have been
+	 * consumed via \a GetNextPacket().
+	 */
+	bool BlockExhausted() const { return block_hdr && packets_left == 0; }
+
+	/**
+	 * Hands the current block back to the kernel if all of its packets
+	 * have been consumed. Packets previously returned from that block
+	 * must not be accessed anymore afterwards.
+	 */
+	void ReleasePacket();
+
+protected:
+	void InitLayout(size_t bufsize, size_t blocksize, int blocktimeout_msec);
+	void NextBlock();
+
+private:
+	struct tpacket_req3 layout;
+	struct tpacket_block_desc* block_hdr = nullptr;
+	struct tpacket3_hdr* packet_hdr = nullptr;
+	uint8_t* ring = nullptr;
+	size_t size = 0;
+	unsigned int block_num = 0;
+	unsigned int packets_left = 0;
+	};
+
+	} // namespace zeek::iosource::af_packet
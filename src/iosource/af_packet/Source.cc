@@ -0,0 +1,429 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/iosource/af_packet/Source.h"
+
+#include "zeek/zeek-config.h"
+
+extern "C"
+	{
+#include <arpa/inet.h>
+#include <linux/filter.h> // sock_fprog
+#include <linux/if_ether.h> // ETH_P_ALL
+#include <linux/net_tstamp.h>
+#include <linux/sockios.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+	}
+
+#include <cerrno>
+#include <cinttypes>
+#include <cstring>
+
+#include "zeek/DebugLogger.h"
+#include "zeek/Type.h"
+#include "zeek/iosource/BPF_Program.h"
+#include "zeek/iosource/Packet.h"
+#include "zeek/iosource/af_packet/af_packet.bif.h"
+
+namespace zeek::iosource::af_packet
+	{
+
+AF_PacketSource::~AF_PacketSource()
+	{
+	Close();
+	}
+
+AF_PacketSource::AF_PacketSource(const std::string& path, bool is_live)
+	{
+	if ( ! is_live )
+		Error("AF_PACKET source does not support offline input");
+
+	props.path = path;
+	props.is_live = is_live;
+	}
+
+void AF_PacketSource::Open()
+	{
+	uint64_t buffer_size = BifConst::AF_Packet::buffer_size;
+	uint64_t block_size = BifConst::AF_Packet::block_size;
+	int block_timeout_msec = static_cast<int>(BifConst::AF_Packet::block_timeout * 1000.0);
+
+	socket_fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+
+	if ( socket_fd < 0 )
+		{
+		Error(util::fmt("AF_PACKET: unable to create socket: %s", strerror(errno)));
+		return;
+		}
+
+	int ifindex = GetIfIndex(props.path);
+
+	if ( ifindex < 0 )
+		{
+		SocketError("interface lookup");
+		return;
+		}
+
+	// The ring needs to be in place before binding the socket, as
+	// otherwise the kernel starts queuing packets to the socket's
+	// regular receive queue.
+	try
+		{
+		rx_ring = std::make_unique<RX_Ring>(socket_fd, buffer_size, block_size,
+		                                    block_timeout_msec);
+		}
+	catch ( const RX_RingException& e )
+		{
+		Error(util::fmt("AF_PACKET: %s", e.what()));
+		close(socket_fd);
+		socket_fd = -1;
+		return;
+		}
+
+	if ( ! BindInterface(ifindex) )
+		{
+		SocketError("bind");
+		return;
+		}
+
+	if ( ! EnablePromiscMode(ifindex) )
+		{
+		SocketError("enabling promiscuous mode");
+		return;
+		}
+
+	if ( BifConst::AF_Packet::enable_fanout && ! ConfigureFanoutGroup() )
+		{
+		SocketError("joining fanout group");
+		return;
+		}
+
+	if ( ! ConfigureChecksumMode() )
+		{
+		SocketError("configuring checksum validation");
+		return;
+		}
+
+	if ( BifConst::AF_Packet::enable_hw_timestamping && ! EnableHWTimestamping() )
+		{
+		SocketError("enabling hardware timestamping");
+		return;
+		}
+
+	props.selectable_fd = socket_fd;
+	props.link_type = BifConst::AF_Packet::link_type;
+	props.netmask = NETMASK_UNKNOWN;
+	props.is_live = true;
+
+	// All packets of a ring block stay valid until the block gets
+	// handed back to the kernel, so we can pass them on in batches
+	// without copying.
+	props.batch_size = BifConst::AF_Packet::batch_size;
+
+	Opened(props);
+	}
+
+int AF_PacketSource::GetIfIndex(const std::string& path)
+	{
+	struct ifreq ifr;
+	memset(&ifr, 0, sizeof(ifr));
+
+	if ( path.size() >= sizeof(ifr.ifr_name) )
+		{
+		errno = ENAMETOOLONG;
+		return -1;
+		}
+
+	snprintf(ifr.ifr_name, sizeof(ifr.ifr_name), "%s", path.c_str());
+
+	if ( ioctl(socket_fd, SIOCGIFINDEX, &ifr) < 0 )
+		return -1;
+
+	return ifr.ifr_ifindex;
+	}
+
+bool AF_PacketSource::BindInterface(int index)
+	{
+	struct sockaddr_ll saddr;
+	memset(&saddr, 0, sizeof(saddr));
+
+	saddr.sll_family = AF_PACKET;
+	saddr.sll_protocol = htons(ETH_P_ALL);
+	saddr.sll_ifindex = index;
+
+	return bind(socket_fd, reinterpret_cast<struct sockaddr*>(&saddr), sizeof(saddr)) == 0;
+	}
+
+bool AF_PacketSource::EnablePromiscMode(int index)
+	{
+	struct packet_mreq mreq;
+	memset(&mreq, 0, sizeof(mreq));
+
+	mreq.mr_ifindex = index;
+	mreq.mr_type = PACKET_MR_PROMISC;
+
+	return setsockopt(socket_fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) == 0;
+	}
+
+bool AF_PacketSource::EnableHWTimestamping()
+	{
+	// Ask the NIC to timestamp all incoming packets. Not all drivers
+	// support changing the configuration, and some have hardware
+	// timestamping enabled already, so we only report it if this fails.
+	struct hwtstamp_config config;
+	memset(&config, 0, sizeof(config));
+	config.tx_type = HWTSTAMP_TX_OFF;
+	config.rx_filter = HWTSTAMP_FILTER_ALL;
+
+	struct ifreq ifr;
+	memset(&ifr, 0, sizeof(ifr));
+	snprintf(ifr.ifr_name, sizeof(ifr.ifr_name), "%s", props.path.c_str());
+	ifr.ifr_data = reinterpret_cast<char*>(&config);
+
+	if ( ioctl(socket_fd, SIOCSHWTSTAMP, &ifr) < 0 )
+		Info(util::fmt("AF_PACKET: unable to configure hardware timestamping for %s: %s",
+		               props.path.c_str(), strerror(errno)));
+
+	// Have the ring report the raw hardware timestamps instead of the
+	// kernel's receive times.
+	int req = SOF_TIMESTAMPING_RAW_HARDWARE;
+	return setsockopt(socket_fd, SOL_PACKET, PACKET_TIMESTAMP, &req, sizeof(req)) == 0;
+	}
+
+bool AF_PacketSource::ConfigureChecksumMode()
+	{
+	const auto& mode = BifConst::AF_Packet::checksum_validation_mode;
+	const char* mode_name = mode->GetType()->AsEnumType()->Lookup(mode->AsEnum());
+
+	if ( strcmp(mode_name, "AF_Packet::CHECKSUM_ON") == 0 )
+		checksum_mode = CHECKSUM_ON;
+	else if ( strcmp(mode_name, "AF_Packet::CHECKSUM_OFF") == 0 )
+		checksum_mode = CHECKSUM_OFF;
+	else if ( strcmp(mode_name, "AF_Packet::CHECKSUM_KERNEL") == 0 )
+		checksum_mode = CHECKSUM_KERNEL;
+	else
+		{
+		errno = EINVAL;
+		return false;
+		}
+
+	return true;
+	}
+
+bool AF_PacketSource::ConfigureFanoutGroup()
+	{
+	const auto& mode = BifConst::AF_Packet::fanout_mode;
+	const char* mode_name = mode->GetType()->AsEnumType()->Lookup(mode->AsEnum());
+	uint32_t fanout_type;
+
+	if ( strcmp(mode_name, "AF_Packet::FANOUT_HASH") == 0 )
+		fanout_type = PACKET_FANOUT_HASH;
+	else if ( strcmp(mode_name, "AF_Packet::FANOUT_CPU") == 0 )
+		fanout_type = PACKET_FANOUT_CPU;
+#ifdef PACKET_FANOUT_QM
+	else if ( strcmp(mode_name, "AF_Packet::FANOUT_QM") == 0 )
+		fanout_type = PACKET_FANOUT_QM;
+#endif
+	else
+		{
+		errno = EINVAL;
+		return false;
+		}
+
+	if ( BifConst::AF_Packet::enable_defrag )
+		fanout_type |= PACKET_FANOUT_FLAG_DEFRAG;
+
+	uint32_t fanout_arg = (BifConst::AF_Packet::fanout_id & 0xffff) | (fanout_type << 16);
+
+	return setsockopt(socket_fd, SOL_PACKET, PACKET_FANOUT, &fanout_arg, sizeof(fanout_arg)) ==
+	       0;
+	}
+
+void AF_PacketSource::SocketError(const char* where)
+	{
+	Error(util::fmt("AF_PACKET: %s failed for %s: %s", where, props.path.c_str(),
+	                strerror(errno)));
+
+	rx_ring.reset();
+	close(socket_fd);
+	socket_fd = -1;
+	}
+
+void AF_PacketSource::Close()
+	{
+	if ( socket_fd < 0 )
+		return;
+
+	UpdateKernelStats();
+	DBG_LOG(DBG_PKTIO, "AF_PACKET ring on %s was frozen %" PRIu64 " times", props.path.c_str(),
+	        kernel_freezes);
+
+	Closed();
+
+	rx_ring.reset();
+	close(socket_fd);
+	socket_fd = -1;
+	}
+
+bool AF_PacketSource::ExtractNextPacket(Packet* pkt)
+	{
+	return ExtractNextPackets(pkt, 1) == 1;
+	}
+
+size_t AF_PacketSource::ExtractNextPackets(Packet* pkts, size_t max)
+	{
+	if ( ! rx_ring )
+		return 0;
+
+	size_t n = 0;
+	tpacket3_hdr* hdr;
+
+	// Stop at the end of the current block so that the whole batch can
+	// be returned to the kernel at once in DoneWithPacket().
+	while ( n < max && rx_ring->GetNextPacket(&hdr) )
+		{
+		Packet* pkt = &pkts[n];
+
+		pkt_timeval ts = {static_cast<time_t>(hdr->tp_sec),
+		                  static_cast<suseconds_t>(hdr->tp_nsec / 1000)};
+
+		pkt->Init(props.link_type, &ts, hdr->tp_snaplen, hdr->tp_len,
+		          reinterpret_cast<const u_char*>(hdr) + hdr->tp_mac);
+
+		// The kernel strips the outer VLAN tag and passes it along
+		// out of band.
+		if ( hdr->tp_status & TP_STATUS_VLAN_VALID )
+			pkt->vlan = hdr->hv1.tp_vlan_tci & 0x0fff;
+
+		if ( hdr->hv1.tp_rxhash )
+			{
+			pkt->flow_hash = hdr->hv1.tp_rxhash;
+			pkt->has_flow_hash = true;
+			}
+
+		if ( hdr->tp_status & TP_STATUS_TS_RAW_HARDWARE )
+			pkt->hw_timestamp = static_cast<uint64_t>(hdr->tp_sec) * 1000000000 + hdr->tp_nsec;
+
+		if ( checksum_mode == CHECKSUM_OFF )
+			{
+			pkt->l3_checksummed = true;
+			pkt->l4_checksummed = true;
+			}
+#ifdef TP_STATUS_CSUM_VALID
+		// Either the NIC verified the checksum or the packet is
+		// locally generated with checksum offloading, in which case
+		// it won't have been computed yet.
+		else if ( checksum_mode == CHECKSUM_KERNEL &&
+		          (hdr->tp_status & (TP_STATUS_CSUM_VALID | TP_STATUS_CSUMNOTREADY)) )
+			pkt->l4_checksummed = true;
+#endif
+
+		if ( hdr->tp_len == 0 || hdr->tp_snaplen == 0 )
+			{
+			Weird("empty_af_packet_header", pkt);
+			continue;
+			}
+
+		++stats.received;
+		stats.bytes_received += hdr->tp_len;
+		++n;
+
+		if ( rx_ring->BlockExhausted() )
+			break;
+		}
+
+	// If we skipped all remaining packets of a block, nobody will call
+	// DoneWithPacket() for it, so release it right away.
+	if ( n == 0 )
+		rx_ring->ReleasePacket();
+
+	return n;
+	}
+
+void AF_PacketSource::DoneWithPacket()
+	{
+	if ( rx_ring )
+		rx_ring->ReleasePacket();
+	}
+
+bool AF_PacketSource::PrecompileFilter(int index, const std::string& filter)
+	{
+	return PktSrc::PrecompileBPFFilter(index, filter);
+	}
+
+bool AF_PacketSource::SetFilter(int index)
+	{
+	if ( socket_fd < 0 )
+		return true; // Prevent error message.
+
+	iosource::detail::BPF_Program* code = GetBPFFilter(index);
+
+	if ( ! code )
+		{
+		Error(util::fmt("No precompiled filter for index %d", index));
+		return false;
+		}
+
+	if ( code->MatchesAnything() )
+		{
+		// Nothing to filter. Detaching fails if no filter is set,
+		// which is fine.
+		int dummy = 0;
+		setsockopt(socket_fd, SOL_SOCKET, SO_DETACH_FILTER, &dummy, sizeof(dummy));
+		return true;
+		}
+
+	// Let the kernel do the filtering; classic BPF instructions are what
+	// SO_ATTACH_FILTER expects.
+	struct bpf_program* program = code->GetProgram();
+	struct sock_fprog fprog;
+	fprog.len = program->bf_len;
+	fprog.filter = reinterpret_cast<struct sock_filter*>(program->bf_insns);
+
+	if ( setsockopt(socket_fd, SOL_SOCKET, SO_ATTACH_FILTER, &fprog, sizeof(fprog)) < 0 )
+		{
+		Error(util::fmt("AF_PACKET: unable to attach filter: %s", strerror(errno)));
+		return false;
+		}
+
+	return true;
+	}
+
+void AF_PacketSource::UpdateKernelStats()
+	{
+	struct tpacket_stats_v3 kstats;
+	socklen_t len = sizeof(kstats);
+
+	if ( getsockopt(socket_fd, SOL_PACKET, PACKET_STATISTICS, &kstats, &len) < 0 )
+		return;
+
+	kernel_packets += kstats.tp_packets;
+	kernel_drops += kstats.tp_drops;
+	kernel_freezes += kstats.tp_freeze_q_cnt;
+	}
+
+void AF_PacketSource::Statistics(Stats* s)
+	{
+	if ( socket_fd < 0 )
+		{
+		s->received = s->dropped = s->link = s->bytes_received = s->freezes = 0;
+		return;
+		}
+
+	UpdateKernelStats();
+
+	s->received = stats.received;
+	s->bytes_received = stats.bytes_received;
+	s->link = kernel_packets;
+	s->dropped = kernel_drops;
+	s->freezes = kernel_freezes;
+	}
+
+iosource::PktSrc* AF_PacketSource::Instantiate(const std::string& path, bool is_live)
+	{
+	return new AF_PacketSource(path, is_live);
+	}
+
+	} // namespace zeek::iosource::af_packet
@@ -0,0 +1,77 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <memory>
+
+#include "zeek/iosource/PktSrc.h"
+#include "zeek/iosource/af_packet/RX_Ring.h"
+
+namespace zeek::iosource::af_packet
+	{
+
+/**
+ * A live packet source reading from Linux AF_PACKET sockets through a
+ * memory-mapped TPACKET_V3 ring. Packets are passed on to Zeek without
+ * copying them out of the ring. Multiple Zeek processes can attach to the
+ * same interface through a PACKET_FANOUT group, with the kernel balancing
+ * flows among them.
+ */
+class AF_PacketSource : public PktSrc
+	{
+public:
+	/**
+	 * Constructor.
+	 *
+	 * @param path The name of the interface to read from.
+	 *
+	 * @param is_live Must be true, AF_PACKET only supports live sources.
+	 */
+	AF_PacketSource(const std::string& path, bool is_live);
+	~AF_PacketSource() override;
+
+	static PktSrc* Instantiate(const std::string& path, bool is_live);
+
+protected:
+	// PktSrc interface.
+	void Open() override;
+	void Close() override;
+	bool ExtractNextPacket(Packet* pkt) override;
+	size_t ExtractNextPackets(Packet* pkts, size_t max) override;
+	void DoneWithPacket() override;
+	bool PrecompileFilter(int index, const std::string& filter) override;
+	bool SetFilter(int index) override;
+	void Statistics(Stats* stats) override;
+
+private:
+	int GetIfIndex(const std::string& path);
+	bool BindInterface(int index);
+	bool EnablePromiscMode(int index);
+	bool ConfigureFanoutGroup();
+	bool ConfigureChecksumMode();
+	bool EnableHWTimestamping();
+	void UpdateKernelStats();
+	void SocketError(const char* where);
+
+	Properties props;
+	Stats stats;
+
+	enum ChecksumMode
+		{
+		CHECKSUM_ON,
+		CHECKSUM_OFF,
+		CHECKSUM_KERNEL,
+		};
+
+	ChecksumMode checksum_mode = CHECKSUM_KERNEL;
+	int socket_fd = -1;
+	std::unique_ptr<RX_Ring> rx_ring;
+
+	// Kernel counters are reset upon reading them, so we accumulate
+	// them here.
+	uint64_t kernel_packets = 0;
+	uint64_t kernel_drops = 0;
+	uint64_t kernel_freezes = 0;
+	};
+
+	} // namespace zeek::iosource::af_packet
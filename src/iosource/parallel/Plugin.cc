@@ -0,0 +1,27 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/plugin/Plugin.h"
+
+#include "zeek/iosource/Component.h"
+#include "zeek/iosource/parallel/Source.h"
+
+namespace zeek::plugin::detail::Zeek_Parallel
+	{
+
+class Plugin : public plugin::Plugin
+	{
+public:
+	plugin::Configuration Configure() override
+		{
+		AddComponent(new iosource::PktSrcComponent("ParallelReader", "parallel",
+		                                           iosource::PktSrcComponent::TRACE,
+		                                           iosource::parallel::ParallelSource::Instantiate));
+
+		plugin::Configuration config;
+		config.name = "Zeek::Parallel";
+		config.description = "Packet acquisition from the reading process of --parallel";
+		return config;
+		}
+	} plugin;
+
+	} // namespace zeek::plugin::detail::Zeek_Parallel
@@ -0,0 +1,302 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/iosource/parallel/Source.h"
+
+#include "zeek/zeek-config.h"
+
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+extern "C"
+	{
+#include <pcap.h>
+	}
+
+#include "zeek/Event.h"
+#include "zeek/Reporter.h"
+#include "zeek/RunState.h"
+#include "zeek/iosource/BPF_Program.h"
+#include "zeek/iosource/Packet.h"
+#include "zeek/iosource/pcap/pcap.bif.h"
+
+namespace zeek::iosource::parallel
+	{
+
+// How much to read from the pipe at once.
+static constexpr size_t READ_SIZE = 1024 * 1024;
+
+ParallelSource::ParallelSource(const std::string& path, bool is_live)
+	{
+	props.path = path;
+	props.is_live = is_live;
+	}
+
+ParallelSource::~ParallelSource()
+	{
+	Close();
+	}
+
+PktSrc* ParallelSource::Instantiate(const std::string& path, bool is_live)
+	{
+	return new ParallelSource(path, is_live);
+	}
+
+void ParallelSource::Open()
+	{
+	if ( props.is_live )
+		{
+		Error("parallel sources can only be read offline");
+		return;
+		}
+
+	char* end_ptr;
+	errno = 0;
+	long n = strtol(props.path.c_str(), &end_ptr, 10);
+
+	if ( props.path.empty() || *end_ptr || errno || n < 0 )
+		{
+		Error(util::fmt("invalid file descriptor '%s'", props.path.c_str()));
+		return;
+		}
+
+	fd = static_cast<int>(n);
+
+	if ( ! Fill(sizeof(StreamHeader)) )
+		{
+		Error("missing stream header");
+		::close(fd);
+		fd = -1;
+		return;
+		}
+
+	StreamHeader hdr;
+	memcpy(&hdr, buffer.data() + pos, sizeof(hdr));
+	pos += sizeof(hdr);
+
+	if ( hdr.magic != STREAM_MAGIC || ! Fill(hdr.path_len) )
+		{
+		Error("not a stream of the reading process");
+		::close(fd);
+		fd = -1;
+		return;
+		}
+
+	props.path.assign(reinterpret_cast<const char*>(buffer.data() + pos), hdr.path_len);
+	pos += hdr.path_len;
+
+	props.selectable_fd = fd;
+	props.link_type = hdr.link_type;
+	props.is_live = false;
+	props.batch_size = BifConst::Pcap::batch_size;
+
+	Opened(props);
+	}
+
+void ParallelSource::Close()
+	{
+	if ( fd < 0 )
+		return;
+
+	::close(fd);
+	fd = -1;
+	buffer.clear();
+	pos = end = 0;
+
+	Closed();
+
+	if ( Pcap::file_done )
+		event_mgr.Enqueue(Pcap::file_done, make_intrusive<StringVal>(props.path));
+	}
+
+bool ParallelSource::Fill(size_t n)
+	{
+	if ( end - pos >= n )
+		return true;
+
+	// Move what's left to the front. Nothing refers to the buffer when
+	// we need more of it.
+	if ( pos > 0 )
+		{
+		memmove(buffer.data(), buffer.data() + pos, end - pos);
+		end -= pos;
+		pos = 0;
+		}
+
+	if ( buffer.size() < std::max(n, READ_SIZE) )
+		buffer.resize(std::max(n, READ_SIZE));
+
+	while ( end < n )
+		{
+		ssize_t r = ::read(fd, buffer.data() + end, buffer.size() - end);
+
+		if ( r < 0 )
+			{
+			if ( errno == EINTR )
+				continue;
+
+			reporter->Error("failed to read from the reading process: %s", strerror(errno));
+			return false;
+			}
+
+		if ( r == 0 )
+			return false;
+
+		end += r;
+		}
+
+	return true;
+	}
+
+void ParallelSource::Finish(bool complete)
+	{
+	if ( ! complete )
+		reporter->Error("the reading process went away before the end of %s",
+		                props.path.c_str());
+
+	Close();
+	}
+
+bool ParallelSource::ExtractNextPacket(Packet* pkt)
+	{
+	return ExtractNextPackets(pkt, 1) == 1;
+	}
+
+size_t ParallelSource::ExtractNextPackets(Packet* pkts, size_t max)
+	{
+	if ( fd < 0 )
+		return 0;
+
+	size_t n = 0;
+
+	while ( n < max )
+		{
+		// Refilling would move the packets we have, so only the first
+		// one may wait for the pipe.
+		if ( end - pos < sizeof(FrameHeader) && n > 0 )
+			break;
+
+		if ( ! Fill(sizeof(FrameHeader)) )
+			{
+			Finish(false);
+			return 0;
+			}
+
+		FrameHeader hdr;
+		memcpy(&hdr, buffer.data() + pos, sizeof(hdr));
+
+		if ( hdr.kind != FRAME_PACKET )
+			{
+			// Time moves on with the packets we have dispatched, so
+			// those need to come first.
+			if ( n > 0 )
+				break;
+
+			pos += sizeof(hdr);
+			double t = hdr.ts_sec + hdr.ts_usec / 1e6;
+
+			if ( hdr.kind == FRAME_END )
+				{
+				// An empty trace doesn't have a time to end at.
+				if ( t > 0.0 )
+					run_state::detail::advance_network_time(t);
+
+				Finish(true);
+				return 0;
+				}
+
+			if ( hdr.kind != FRAME_TICK )
+				{
+				reporter->Error("unknown frame in stream from the reading process");
+				Close();
+				return 0;
+				}
+
+			// Let the run loop drain what the timers raise, like for a
+			// packet.
+			run_state::detail::advance_network_time(t);
+			return 0;
+			}
+
+		if ( end - pos < sizeof(hdr) + hdr.caplen )
+			{
+			if ( n > 0 )
+				break;
+
+			if ( ! Fill(sizeof(hdr) + hdr.caplen) )
+				{
+				Finish(false);
+				return 0;
+				}
+			}
+
+		pos += sizeof(hdr);
+		const u_char* data = buffer.data() + pos;
+		pos += hdr.caplen;
+
+		struct timeval ts;
+		ts.tv_sec = hdr.ts_sec;
+		ts.tv_usec = hdr.ts_usec;
+
+		Packet* pkt = &pkts[n];
+		pkt->Init(props.link_type, &ts, hdr.caplen, hdr.len, data);
+
+		if ( hdr.len == 0 || hdr.caplen == 0 )
+			{
+			Weird("empty_pcap_header", pkt);
+			continue;
+			}
+
+		struct pcap_pkthdr phdr;
+		phdr.ts = ts;
+		phdr.caplen = hdr.caplen;
+		phdr.len = hdr.len;
+
+		if ( props.link_type != DLT_NFLOG && ! ApplyBPFFilter(current_filter, &phdr, data) )
+			{
+			if ( ! IsOpen() )
+				return 0;
+
+			continue;
+			}
+
+		++stats.received;
+		stats.bytes_received += hdr.len;
+		++n;
+		}
+
+	return n;
+	}
+
+void ParallelSource::DoneWithPacket()
+	{
+	// Nothing to do, the buffer gets reused once we need more of it.
+	}
+
+bool ParallelSource::PrecompileFilter(int index, const std::string& filter)
+	{
+	return PktSrc::PrecompileBPFFilter(index, filter);
+	}
+
+bool ParallelSource::SetFilter(int index)
+	{
+	if ( ! GetBPFFilter(index) )
+		{
+		Error(util::fmt("No precompiled filter for index %d", index));
+		return false;
+		}
+
+	current_filter = index;
+	return true;
+	}
+
+void ParallelSource::Statistics(Stats* s)
+	{
+	s->received = stats.received;
+	s->bytes_received = stats.bytes_received;
+	s->link = stats.received;
+	s->dropped = 0;
+	}
+
+	} // namespace zeek::iosource::parallel
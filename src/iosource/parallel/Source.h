@@ -0,0 +1,104 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "zeek/iosource/PktSrc.h"
+
+namespace zeek::iosource::parallel
+	{
+
+// The stream that the reading process of --parallel writes to each
+// worker through a pipe, in host byte order: a StreamHeader followed by
+// the path of the trace, then any number of frames, each a FrameHeader,
+// followed by caplen bytes of packet data for packets.
+
+constexpr uint32_t STREAM_MAGIC = 0x5a4b5031; // "ZKP1"
+
+struct StreamHeader
+	{
+	uint32_t magic;
+	int32_t link_type;
+	uint32_t path_len;
+	uint32_t reserved;
+	};
+
+enum FrameKind : uint32_t
+	{
+	// A packet of the worker's share of the trace.
+	FRAME_PACKET = 1,
+
+	// The worker has seen all of its packets before the time, and may
+	// move network time up to it.
+	FRAME_TICK = 2,
+
+	// The trace ended at the time, nothing follows.
+	FRAME_END = 3,
+	};
+
+struct FrameHeader
+	{
+	uint32_t kind;
+	uint32_t caplen;
+	uint32_t len;
+	uint32_t reserved;
+	int64_t ts_sec;
+	int64_t ts_usec;
+	};
+
+/**
+ * An offline packet source reading a worker's share of a trace from the
+ * process that splits it up for --parallel. Besides the packets, the
+ * stream carries the trace's progress in time, which this source moves
+ * network time along with, so that the timers of all workers expire like
+ * they would when reading the whole trace.
+ *
+ * The path is the number of the file descriptor to read, like
+ * "parallel::5". Once open, the source reports the path of the trace
+ * instead.
+ */
+class ParallelSource : public PktSrc
+	{
+public:
+	ParallelSource(const std::string& path, bool is_live);
+	~ParallelSource() override;
+
+	static PktSrc* Instantiate(const std::string& path, bool is_live);
+
+protected:
+	// PktSrc interface.
+	void Open() override;
+	void Close() override;
+	bool ExtractNextPacket(Packet* pkt) override;
+	size_t ExtractNextPackets(Packet* pkts, size_t max) override;
+	void DoneWithPacket() override;
+	bool PrecompileFilter(int index, const std::string& filter) override;
+	bool SetFilter(int index) override;
+	void Statistics(Stats* stats) override;
+
+private:
+	// Makes sure the buffer holds at least n bytes past pos, reading
+	// more as needed. Returns false if the stream ends first.
+	bool Fill(size_t n);
+
+	// Ends the stream, complaining if it broke off.
+	void Finish(bool complete);
+
+	Properties props;
+	Stats stats;
+
+	int fd = -1;
+	int current_filter = 0;
+
+	// Bytes read from the stream, of which those before pos got used.
+	// Packets of the current batch point into it, so it only gets
+	// compacted once the batch is done.
+	std::vector<u_char> buffer;
+	size_t pos = 0;
+	size_t end = 0;
+	};
+
+	} // namespace zeek::iosource::parallel
@@ -0,0 +1,196 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/iosource/pcap/AsyncWriter.h"
+
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+namespace zeek::iosource::pcap
+	{
+
+// Large enough for any record libpcap can produce.
+static constexpr size_t MIN_CHUNK_SIZE = 256 * 1024 + 16;
+
+// We split the buffer into this many chunks, so that the main thread can
+// keep filling chunks while the writer works on others.
+static constexpr size_t NUM_CHUNKS = 8;
+
+AsyncWriter::AsyncWriter(int arg_fd, size_t buffer_size) : fd(arg_fd)
+	{
+	size_t chunk_size = std::max(buffer_size / NUM_CHUNKS, MIN_CHUNK_SIZE);
+
+	chunks.resize(NUM_CHUNKS);
+
+	for ( auto& c : chunks )
+		{
+		c.data.resize(chunk_size);
+		free_chunks.push_back(&c);
+		}
+	}
+
+AsyncWriter::~AsyncWriter()
+	{
+	Stop();
+	}
+
+void AsyncWriter::Start()
+	{
+	thread = std::thread(&AsyncWriter::Run, this);
+	}
+
+void AsyncWriter::Stop()
+	{
+	if ( ! thread.joinable() )
+		return;
+
+	if ( current && current->len )
+		Submit();
+
+		{
+		std::lock_guard<std::mutex> lock(mtx);
+		stopping = true;
+		}
+
+	has_chunks.notify_one();
+	thread.join();
+	}
+
+bool AsyncWriter::Write(const pcap_pkthdr* hdr, const u_char* data)
+	{
+	RecordHeader rh = {static_cast<uint32_t>(hdr->ts.tv_sec), static_cast<uint32_t>(hdr->ts.tv_usec),
+	                   hdr->caplen, hdr->len};
+
+	size_t needed = sizeof(rh) + hdr->caplen;
+
+	if ( current && current->len + needed > current->data.size() )
+		Submit();
+
+	if ( ! current )
+		{
+			{
+			std::lock_guard<std::mutex> lock(mtx);
+
+			if ( free_chunks.empty() )
+				// The writer can't keep up.
+				return false;
+
+			current = free_chunks.back();
+			free_chunks.pop_back();
+			current->len = 0;
+			current_len = 0;
+			current_started = std::chrono::steady_clock::now();
+			}
+		}
+
+	if ( needed > current->data.size() )
+		return false;
+
+	memcpy(current->data.data() + current->len, &rh, sizeof(rh));
+	memcpy(current->data.data() + current->len + sizeof(rh), data, hdr->caplen);
+	current->len += needed;
+	current_len.store(current->len, std::memory_order_release);
+
+	if ( std::chrono::steady_clock::now() - current_started >= MAX_CHUNK_AGE )
+		Submit();
+
+	return true;
+	}
+
+void AsyncWriter::Submit()
+	{
+		{
+		std::lock_guard<std::mutex> lock(mtx);
+		queued.push_back(current);
+		current = nullptr;
+		}
+
+	has_chunks.notify_one();
+	}
+
+void AsyncWriter::Run()
+	{
+	while ( true )
+		{
+		Chunk* c;
+		size_t end;
+		bool partial = false;
+
+			{
+			std::unique_lock<std::mutex> lock(mtx);
+
+			if ( ! has_chunks.wait_for(lock, MAX_CHUNK_AGE,
+			                           [this] { return stopping || ! queued.empty(); }) )
+				{
+				// No chunk got submitted for a while, probably because
+				// no packets came along to fill it up. Write out what
+				// the main thread has put into its chunk so far; it
+				// keeps appending to it meanwhile.
+				if ( ! current ||
+				     std::chrono::steady_clock::now() - current_started < MAX_CHUNK_AGE )
+					continue;
+
+				c = current;
+				end = current_len.load(std::memory_order_acquire);
+				partial = true;
+				}
+
+			// Write out whatever is left before terminating.
+			else if ( queued.empty() )
+				return;
+
+			else
+				{
+				c = queued.front();
+				queued.pop_front();
+				end = c->len;
+				}
+			}
+
+		// The actual writing happens without holding the lock.
+		std::string err = WriteChunk(c, end);
+
+		std::lock_guard<std::mutex> lock(mtx);
+
+		if ( ! err.empty() )
+			{
+			error = "write failed: " + err;
+			failed = true;
+			}
+
+		if ( ! partial )
+			{
+			c->len = 0;
+			c->written = 0;
+			free_chunks.push_back(c);
+			}
+		}
+	}
+
+std::string AsyncWriter::WriteChunk(Chunk* c, size_t end)
+	{
+	const u_char* p = c->data.data() + c->written;
+	size_t remaining = end - c->written;
+
+	while ( remaining > 0 && ! failed )
+		{
+		ssize_t n = write(fd, p, remaining);
+
+		if ( n < 0 )
+			{
+			if ( errno == EINTR )
+				continue;
+
+			return strerror(errno);
+			}
+
+		p += n;
+		remaining -= n;
+		c->written += n;
+		}
+
+	return {};
+	}
+
+	} // namespace zeek::iosource::pcap
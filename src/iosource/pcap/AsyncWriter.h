@@ -0,0 +1,141 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+extern "C"
+	{
+#include <pcap.h>
+	}
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace zeek::iosource::pcap
+	{
+
+/**
+ * Writes pcap records to a file from a background thread. The main thread
+ * copies packets into a fixed pool of chunks; the writer thread writes out
+ * full chunks with large sequential writes. If the writer falls behind so
+ * far that no chunk is free, packets are dropped rather than blocking the
+ * main thread.
+ *
+ * While the writer is running, it has exclusive use of the file descriptor.
+ */
+class AsyncWriter
+	{
+public:
+	/**
+	 * Constructor.
+	 *
+	 * @param fd The descriptor of the file to write to, positioned after
+	 * the pcap file header.
+	 *
+	 * @param buffer_size The total number of bytes to buffer.
+	 */
+	AsyncWriter(int fd, size_t buffer_size);
+
+	/**
+	 * Destructor. Stops the thread if it's still running.
+	 */
+	~AsyncWriter();
+
+	/**
+	 * Starts the background thread.
+	 */
+	void Start();
+
+	/**
+	 * Writes out all buffered packets, then stops the background thread
+	 * and waits for it to terminate.
+	 */
+	void Stop();
+
+	/**
+	 * Queues a packet for writing. Never blocks.
+	 *
+	 * @param hdr The packet's pcap header.
+	 *
+	 * @param data The packet's data, hdr->caplen bytes.
+	 *
+	 * @return False if the packet had to be dropped because no buffer
+	 * space was available.
+	 */
+	bool Write(const pcap_pkthdr* hdr, const u_char* data);
+
+	/**
+	 * Returns true if the writer thread hit a write error. No further
+	 * data will be written in that case.
+	 */
+	bool Failed() const { return failed; }
+
+	/**
+	 * Returns the write error the thread encountered, or an empty string.
+	 * Only valid once Failed() returned true.
+	 */
+	const std::string& Error() const { return error; }
+
+private:
+	// The on-disk header of a pcap record. Timestamps are 32 bits wide
+	// in the file format.
+	struct RecordHeader
+		{
+		uint32_t tv_sec;
+		uint32_t tv_usec;
+		uint32_t caplen;
+		uint32_t len;
+		};
+
+	struct Chunk
+		{
+		std::vector<u_char> data;
+		size_t len = 0;
+
+		// How much of the data the writer thread has written out
+		// already. Only accessed by the writer thread.
+		size_t written = 0;
+		};
+
+	// How long a partially filled chunk may wait before we hand it to
+	// the writer anyway, so that rarely written dumps still show up on
+	// disk in a timely manner. If no further packets come along to
+	// trigger that, the writer thread writes out what's in the chunk
+	// itself.
+	static constexpr std::chrono::seconds MAX_CHUNK_AGE{1};
+
+	void Submit();
+	void Run();
+
+	// Writes out a chunk's data up to the given length, returning an
+	// error message if that fails.
+	std::string WriteChunk(Chunk* c, size_t end);
+
+	int fd;
+
+	std::thread thread;
+	std::mutex mtx;
+	std::condition_variable has_chunks;
+
+	// Chunk currently being filled by the main thread. The main thread
+	// only changes these while holding the mutex, except for updating
+	// current_len after adding a packet.
+	Chunk* current = nullptr;
+	std::atomic<size_t> current_len = 0;
+	std::chrono::steady_clock::time_point current_started;
+
+	std::vector<Chunk> chunks;
+	std::deque<Chunk*> queued;
+	std::vector<Chunk*> free_chunks;
+
+	bool stopping = false;
+	std::atomic<bool> failed = false;
+	std::string error;
+	};
+
+	} // namespace zeek::iosource::pcap
@@ -4,6 +4,7 @@
 
 #include <sys/stat.h>
 #include <cerrno>
+#include <cstring>
 
 #include "zeek/RunState.h"
 #include "zeek/iosource/PktSrc.h"
@@ -84,6 +85,21 @@ void PcapDumper::Open()
 			}
 		}
 
+	if ( BifConst::Pcap::async_dump_buffer_size > 0 )
+		{
+		// Let libpcap write the file header, then hand the descriptor
+		// to the writer thread, which appends records from then on.
+		if ( pcap_dump_flush(dumper) < 0 )
+			{
+			Error(util::fmt("can't write dump %s: %s", props.path.c_str(), strerror(errno)));
+			return;
+			}
+
+		writer = std::make_unique<AsyncWriter>(fileno(pcap_dump_file(dumper)),
+		                                       BifConst::Pcap::async_dump_buffer_size);
+		writer->Start();
+		}
+
 	props.open_time = run_state::network_time;
 	Opened(props);
 	}
@@ -93,6 +109,17 @@ void PcapDumper::Close()
 	if ( ! dumper )
 		return;
 
+	if ( writer )
+		{
+		writer->Stop();
+
+		if ( writer->Failed() )
+			Error(util::fmt("can't write dump %s: %s", props.path.c_str(),
+			                writer->Error().c_str()));
+
+		writer.reset();
+		}
+
 	pcap_dump_close(dumper);
 	pcap_close(pd);
 	dumper = nullptr;
@@ -109,11 +136,38 @@ bool PcapDumper::Dump(const Packet* pkt)
 	// Reconstitute the pcap_pkthdr.
 	const struct pcap_pkthdr phdr = {.ts = pkt->ts, .caplen = pkt->cap_len, .len = pkt->len};
 
-	pcap_dump((u_char*)dumper, &phdr, pkt->data);
-	pcap_dump_flush(dumper);
+	if ( writer )
+		{
+		if ( writer->Failed() )
+			{
+			Error(util::fmt("can't write dump %s: %s", props.path.c_str(),
+			                writer->Error().c_str()));
+			return false;
+			}
+
+		if ( ! writer->Write(&phdr, pkt->data) )
+			{
+			// Not an error; the writer just can't keep up.
+			++stats.dropped;
+			return true;
+			}
+		}
+	else
+		{
+		pcap_dump((u_char*)dumper, &phdr, pkt->data);
+		pcap_dump_flush(dumper);
+		}
+
+	++stats.dumped;
+	stats.bytes_dumped += pkt->cap_len;
 	return true;
 	}
 
+void PcapDumper::Statistics(Stats* s)
+	{
+	*s = stats;
+	}
+
 iosource::PktDumper* PcapDumper::Instantiate(const std::string& path, bool append)
 	{
 	return new PcapDumper(path, append);
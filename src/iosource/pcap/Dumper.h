@@ -7,7 +7,10 @@ extern "C"
 #include <pcap.h>
 	}
 
+#include <memory>
+
 #include "zeek/iosource/PktDumper.h"
+#include "zeek/iosource/pcap/AsyncWriter.h"
 
 namespace zeek::iosource::pcap
 	{
@@ -25,6 +28,7 @@ protected:
 	void Open() override;
 	void Close() override;
 	bool Dump(const Packet* pkt) override;
+	void Statistics(Stats* stats) override;
 
 private:
 	Properties props;
@@ -32,6 +36,8 @@ private:
 	bool append;
 	pcap_dumper_t* dumper;
 	pcap_t* pd;
+	std::unique_ptr<AsyncWriter> writer;
+	Stats stats;
 	};
 
 	} // namespace zeek::iosource::pcap
@@ -0,0 +1,137 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/iosource/pcap/ReadAhead.h"
+
+#include "zeek/threading/Manager.h"
+
+namespace zeek::iosource::pcap
+	{
+
+ReadAhead::ReadAhead(pcap_t* arg_pd, size_t arg_capacity)
+	: pd(arg_pd), capacity(arg_capacity), ring(arg_capacity)
+	{
+	}
+
+ReadAhead::~ReadAhead()
+	{
+	Stop();
+	}
+
+void ReadAhead::Start()
+	{
+	thread = std::thread(&ReadAhead::Run, this);
+	thread_mgr->ApplyAffinity(thread, "pcap", "pcap-read-ahead");
+	}
+
+void ReadAhead::Stop()
+	{
+	if ( ! thread.joinable() )
+		return;
+
+		{
+		std::lock_guard<std::mutex> lock(mtx);
+		stopping = true;
+		}
+
+	has_space.notify_one();
+	thread.join();
+	}
+
+void ReadAhead::Run()
+	{
+	while ( true )
+		{
+		IntrusivePtr<HeapPacketBuffer> buffer;
+
+			{
+			std::unique_lock<std::mutex> lock(mtx);
+			has_space.wait(lock, [this] { return stopping || count < capacity; });
+
+			if ( stopping )
+				return;
+
+			if ( ! free_buffers.empty() )
+				{
+				buffer = std::move(free_buffers.back());
+				free_buffers.pop_back();
+				}
+			}
+
+		// The actual reading happens without holding the lock.
+		const u_char* data;
+		pcap_pkthdr* header;
+		int res = pcap_next_ex(pd, &header, &data);
+
+		Entry e;
+
+		if ( res == 1 )
+			{
+			e.ts = header->ts;
+			e.caplen = header->caplen;
+			e.len = header->len;
+
+			if ( data )
+				{
+				if ( ! buffer )
+					buffer = make_intrusive<HeapPacketBuffer>();
+
+				buffer->Assign(data, header->caplen);
+				e.buffer = std::move(buffer);
+				}
+			}
+
+		std::lock_guard<std::mutex> lock(mtx);
+
+		if ( res != 1 )
+			{
+			// PCAP_ERROR_BREAK signals the end of the file.
+			if ( res == PCAP_ERROR )
+				error = pcap_geterr(pd);
+			else if ( res != PCAP_ERROR_BREAK )
+				error = "unhandled pcap_next_ex return value: " + std::to_string(res);
+
+			done = true;
+			has_packets.notify_one();
+			return;
+			}
+
+		ring[(head + count) % capacity] = std::move(e);
+		++count;
+		has_packets.notify_one();
+		}
+	}
+
+bool ReadAhead::Next(Entry* e, bool wait)
+	{
+	std::unique_lock<std::mutex> lock(mtx);
+
+	if ( wait )
+		has_packets.wait(lock, [this] { return count > 0 || done; });
+
+	if ( count == 0 )
+		return false;
+
+	*e = std::move(ring[head]);
+	head = (head + 1) % capacity;
+	--count;
+
+	lock.unlock();
+	has_space.notify_one();
+	return true;
+	}
+
+bool ReadAhead::Finished()
+	{
+	std::lock_guard<std::mutex> lock(mtx);
+	return done && count == 0;
+	}
+
+void ReadAhead::Recycle(IntrusivePtr<HeapPacketBuffer> buffer)
+	{
+	std::lock_guard<std::mutex> lock(mtx);
+
+	if ( free_buffers.size() < capacity )
+		free_buffers.push_back(std::move(buffer));
+	}
+
+	} // namespace zeek::iosource::pcap
@@ -0,0 +1,123 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+extern "C"
+	{
+#include <pcap.h>
+	}
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "zeek/iosource/Packet.h"
+#include "zeek/iosource/PacketBuffer.h"
+
+namespace zeek::iosource::pcap
+	{
+
+/**
+ * Reads packets from a trace file in a background thread, keeping a
+ * bounded number of them ready for the main thread. This lets disk I/O
+ * overlap with analysis when processing large traces offline.
+ *
+ * While the reader is running, it has exclusive use of the pcap handle.
+ */
+class ReadAhead
+	{
+public:
+	/**
+	 * A packet as read by the background thread.
+	 */
+	struct Entry
+		{
+		pkt_timeval ts;
+		uint32_t caplen = 0;
+		uint32_t len = 0;
+
+		// The packet's data. Null if libpcap claimed to have read a
+		// packet but didn't provide any data.
+		IntrusivePtr<HeapPacketBuffer> buffer;
+		};
+
+	/**
+	 * Constructor.
+	 *
+	 * @param pd The handle of the trace file to read from.
+	 *
+	 * @param capacity The maximum number of packets to buffer.
+	 */
+	ReadAhead(pcap_t* pd, size_t capacity);
+
+	/**
+	 * Destructor. Stops the thread if it's still running.
+	 */
+	~ReadAhead();
+
+	/**
+	 * Starts the background thread.
+	 */
+	void Start();
+
+	/**
+	 * Stops the background thread and waits for it to terminate.
+	 */
+	void Stop();
+
+	/**
+	 * Retrieves the next packet in trace order.
+	 *
+	 * @param e The entry to fill in.
+	 *
+	 * @param wait If true, blocks until a packet becomes available or
+	 * the reader has finished.
+	 *
+	 * @return True if a packet was returned, false if none was available.
+	 */
+	bool Next(Entry* e, bool wait);
+
+	/**
+	 * Returns true once the reader has reached the end of the file or
+	 * hit an error, and all buffered packets have been retrieved.
+	 */
+	bool Finished();
+
+	/**
+	 * Returns the error the reader encountered, or an empty string if
+	 * none. Only valid once Finished() returned true.
+	 */
+	const std::string& Error() const { return error; }
+
+	/**
+	 * Hands a buffer back to the reader for reuse. The caller must hold
+	 * the only reference to it.
+	 */
+	void Recycle(IntrusivePtr<HeapPacketBuffer> buffer);
+
+private:
+	void Run();
+
+	pcap_t* pd;
+	size_t capacity;
+
+	std::thread thread;
+	std::mutex mtx;
+	std::condition_variable has_packets;
+	std::condition_variable has_space;
+
+	// Ring of buffered packets.
+	std::vector<Entry> ring;
+	size_t head = 0;
+	size_t count = 0;
+
+	std::vector<IntrusivePtr<HeapPacketBuffer>> free_buffers;
+
+	bool done = false;
+	bool stopping = false;
+	std::string error;
+	};
+
+	} // namespace zeek::iosource::pcap
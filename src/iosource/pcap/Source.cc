@@ -8,6 +8,10 @@
 #include <pcap-int.h>
 #endif
 
+#include <fcntl.h>
+#include <cerrno>
+#include <cstring>
+
 #include "zeek/Event.h"
 #include "zeek/iosource/BPF_Program.h"
 #include "zeek/iosource/Packet.h"
@@ -41,6 +45,10 @@ void PcapSource::Close()
 	if ( ! pd )
 		return;
 
+	// The reader thread needs to be gone before the handle goes away.
+	read_ahead.reset();
+	lent_buffers.clear();
+
 	pcap_close(pd);
 	pd = nullptr;
 
@@ -164,6 +172,7 @@ void PcapSource::OpenLive()
 
 	props.link_type = pcap_datalink(pd);
 	props.is_live = true;
+	props.batch_size = BifConst::Pcap::batch_size;
 
 	Opened(props);
 	}
@@ -171,8 +180,18 @@ void PcapSource::OpenLive()
 void PcapSource::OpenOffline()
 	{
 	char errbuf[PCAP_ERRBUF_SIZE];
+	bool use_read_ahead = BifConst::Pcap::read_ahead > 0;
 
-	pd = pcap_open_offline(props.path.c_str(), errbuf);
+	if ( use_read_ahead )
+		{
+		if ( ! OpenReadAheadFile(errbuf) )
+			{
+			Error(errbuf);
+			return;
+			}
+		}
+	else
+		pd = pcap_open_offline(props.path.c_str(), errbuf);
 
 	if ( ! pd )
 		{
@@ -187,8 +206,48 @@ void PcapSource::OpenOffline()
 
 	props.link_type = pcap_datalink(pd);
 	props.is_live = false;
+	props.batch_size = BifConst::Pcap::batch_size;
+
+	if ( use_read_ahead )
+		read_ahead = std::make_unique<ReadAhead>(pd, BifConst::Pcap::read_ahead);
 
 	Opened(props);
+
+	// Opened() may have closed us again if installing the default
+	// filter failed.
+	if ( read_ahead )
+		read_ahead->Start();
+	}
+
+bool PcapSource::OpenReadAheadFile(char* errbuf)
+	{
+	FILE* f = props.path == "-" ? stdin : fopen(props.path.c_str(), "rb");
+
+	if ( ! f )
+		{
+		snprintf(errbuf, PCAP_ERRBUF_SIZE, "%s: %s", props.path.c_str(), strerror(errno));
+		return false;
+		}
+
+	// Let the reader thread pull the file in with large sequential
+	// reads rather than libpcap's per-record ones.
+	setvbuf(f, nullptr, _IOFBF, 4 * 1024 * 1024);
+
+#ifdef POSIX_FADV_SEQUENTIAL
+	posix_fadvise(fileno(f), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+	pd = pcap_fopen_offline(f, errbuf);
+
+	if ( ! pd )
+		{
+		if ( f != stdin )
+			fclose(f);
+
+		return false;
+		}
+
+	return true;
 	}
 
 bool PcapSource::ExtractNextPacket(Packet* pkt)
@@ -196,6 +255,9 @@ bool PcapSource::ExtractNextPacket(Packet* pkt)
 	if ( ! pd )
 		return false;
 
+	if ( read_ahead )
+		return ExtractPrefetchedPackets(pkt, 1) == 1;
+
 	const u_char* data;
 	pcap_pkthdr* header;
 
@@ -210,12 +272,7 @@ bool PcapSource::ExtractNextPacket(Packet* pkt)
 			return false;
 		case PCAP_ERROR: // -1
 			// Error occurred while reading the packet.
-			if ( props.is_live )
-				reporter->Error("failed to read a packet from %s: %s", props.path.data(),
-				                pcap_geterr(pd));
-			else
-				reporter->FatalError("failed to read a packet from %s: %s", props.path.data(),
-				                     pcap_geterr(pd));
+			ReadError();
 			return false;
 		case 0:
 			// Read from live interface timed out (ok).
@@ -258,6 +315,167 @@ bool PcapSource::ExtractNextPacket(Packet* pkt)
 	return true;
 	}
 
+size_t PcapSource::ExtractNextPackets(Packet* pkts, size_t max)
+	{
+	if ( ! pd )
+		return 0;
+
+	if ( read_ahead )
+		return ExtractPrefetchedPackets(pkts, max);
+
+	// pcap_next_ex() avoids copying packet data, so stick with it when
+	// batching isn't requested.
+	if ( max <= 1 )
+		return ExtractNextPacket(pkts) ? 1 : 0;
+
+	if ( batch_buffers.size() < max )
+		batch_buffers.resize(max);
+
+	dispatch_pkts = pkts;
+	dispatch_count = 0;
+
+	int res = pcap_dispatch(pd, static_cast<int>(max), DispatchCallback,
+	                        reinterpret_cast<u_char*>(this));
+
+	dispatch_pkts = nullptr;
+
+	switch ( res )
+		{
+		case PCAP_ERROR_BREAK: // -2
+			// Loop got broken off, return what we have so far.
+			break;
+		case PCAP_ERROR: // -1
+			ReadError();
+			return 0;
+		case 0:
+			// For live interfaces this means no packets were available,
+			// for trace files that we've reached the end.
+			if ( ! props.is_live )
+				Close();
+			return 0;
+		default:
+			break;
+		}
+
+	return dispatch_count;
+	}
+
+void PcapSource::DispatchCallback(u_char* user, const struct pcap_pkthdr* hdr, const u_char* data)
+	{
+	auto* src = reinterpret_cast<PcapSource*>(user);
+	Packet* pkt = &src->dispatch_pkts[src->dispatch_count];
+
+	if ( ! data )
+		{
+		reporter->Weird("pcap_null_data_packet");
+		return;
+		}
+
+	// Drop the packet's reference to the buffer it used last time, so
+	// that we can tell whether anybody else is still using it.
+	pkt->buffer = nullptr;
+
+	auto& buffer = src->batch_buffers[src->dispatch_count];
+
+	if ( ! buffer || buffer->RefCount() > 1 )
+		buffer = make_intrusive<HeapPacketBuffer>();
+
+	buffer->Assign(data, hdr->caplen);
+
+	pkt_timeval ts = hdr->ts;
+	pkt->Init(src->props.link_type, &ts, hdr->caplen, hdr->len, buffer->Data());
+	pkt->buffer = buffer;
+
+	if ( hdr->len == 0 || hdr->caplen == 0 )
+		{
+		src->Weird("empty_pcap_header", pkt);
+		return;
+		}
+
+	++src->stats.received;
+	src->stats.bytes_received += hdr->len;
+	++src->dispatch_count;
+	}
+
+size_t PcapSource::ExtractPrefetchedPackets(Packet* pkts, size_t max)
+	{
+	RecycleBuffers(pkts, max);
+
+	size_t n = 0;
+	ReadAhead::Entry e;
+
+	// Wait for the first packet like pcap_next_ex() would, but don't hold
+	// up the batch for any further ones.
+	while ( n < max && read_ahead->Next(&e, n == 0) )
+		{
+		if ( ! e.buffer )
+			{
+			reporter->Weird("pcap_null_data_packet");
+			continue;
+			}
+
+		Packet* pkt = &pkts[n];
+		pkt->Init(props.link_type, &e.ts, e.caplen, e.len, e.buffer->Data());
+		pkt->buffer = e.buffer;
+		lent_buffers.emplace_back(std::move(e.buffer));
+
+		if ( e.len == 0 || e.caplen == 0 )
+			{
+			Weird("empty_pcap_header", pkt);
+			continue;
+			}
+
+		// The reader thread owns the pcap handle, so we apply the
+		// current filter here rather than through libpcap.
+		struct pcap_pkthdr hdr;
+		hdr.ts = e.ts;
+		hdr.caplen = e.caplen;
+		hdr.len = e.len;
+
+		if ( props.link_type != DLT_NFLOG &&
+		     ! ApplyBPFFilter(read_ahead_filter, &hdr, pkt->data) )
+			{
+			if ( ! IsOpen() )
+				return 0;
+
+			continue;
+			}
+
+		++stats.received;
+		stats.bytes_received += e.len;
+		++n;
+		}
+
+	if ( n == 0 && read_ahead->Finished() )
+		{
+		if ( ! read_ahead->Error().empty() )
+			reporter->FatalError("failed to read a packet from %s: %s", props.path.data(),
+			                     read_ahead->Error().c_str());
+
+		// Exhausted pcap file, no more packets to read.
+		Close();
+		}
+
+	return n;
+	}
+
+void PcapSource::RecycleBuffers(Packet* pkts, size_t max)
+	{
+	// Drop the references of the packets we're about to refill. Any
+	// buffer that's not referenced by anybody else afterwards can go
+	// back to the reader.
+	for ( size_t i = 0; i < max; ++i )
+		pkts[i].buffer = nullptr;
+
+	for ( auto& b : lent_buffers )
+		{
+		if ( b->RefCount() == 1 )
+			read_ahead->Recycle(std::move(b));
+		}
+
+	lent_buffers.clear();
+	}
+
 void PcapSource::DoneWithPacket()
 	{
 	// Nothing to do.
@@ -270,6 +488,10 @@ bool PcapSource::PrecompileFilter(int index, const std::string& filter)
 
 detail::BPF_Program* PcapSource::CompileFilter(const std::string& filter)
 	{
+	// The pcap handle belongs to the reader thread.
+	if ( read_ahead )
+		return PktSrc::CompileFilter(filter);
+
 	std::string errbuf;
 	auto code = std::make_unique<detail::BPF_Program>();
 
@@ -303,7 +525,11 @@ bool PcapSource::SetFilter(int index)
 		return false;
 		}
 
-	if ( LinkType() == DLT_NFLOG )
+	if ( read_ahead )
+		// Filtering happens as we take packets from the reader.
+		read_ahead_filter = index;
+
+	else if ( LinkType() == DLT_NFLOG )
 		{
 		// No-op, NFLOG does not support BPF filters.
 		// Raising a warning might be good, but it would also be noisy
@@ -357,6 +583,15 @@ void PcapSource::Statistics(Stats* s)
 		s->dropped = 0;
 	}
 
+void PcapSource::ReadError()
+	{
+	if ( props.is_live )
+		reporter->Error("failed to read a packet from %s: %s", props.path.data(), pcap_geterr(pd));
+	else
+		reporter->FatalError("failed to read a packet from %s: %s", props.path.data(),
+		                     pcap_geterr(pd));
+	}
+
 void PcapSource::PcapError(const char* where)
 	{
 	std::string location;
@@ -3,13 +3,17 @@
 #pragma once
 
 #include <sys/types.h> // for u_char
+#include <memory>
+#include <vector>
 
 extern "C"
 	{
 #include <pcap.h>
 	}
 
+#include "zeek/iosource/PacketBuffer.h"
 #include "zeek/iosource/PktSrc.h"
+#include "zeek/iosource/pcap/ReadAhead.h"
 
 namespace zeek::iosource::pcap
 	{
@@ -27,6 +31,7 @@ protected:
 	void Open() override;
 	void Close() override;
 	bool ExtractNextPacket(Packet* pkt) override;
+	size_t ExtractNextPackets(Packet* pkts, size_t max) override;
 	void DoneWithPacket() override;
 	bool PrecompileFilter(int index, const std::string& filter) override;
 	bool SetFilter(int index) override;
@@ -37,11 +42,35 @@ private:
 	void OpenLive();
 	void OpenOffline();
 	void PcapError(const char* where = nullptr);
+	void ReadError();
+	bool OpenReadAheadFile(char* errbuf);
+	size_t ExtractPrefetchedPackets(Packet* pkts, size_t max);
+	void RecycleBuffers(Packet* pkts, size_t max);
+
+	// Callback for pcap_dispatch(), copying a packet into the next
+	// slot of the batch currently being filled.
+	static void DispatchCallback(u_char* user, const struct pcap_pkthdr* hdr,
+	                             const u_char* data);
 
 	Properties props;
 	Stats stats;
 
 	pcap_t* pd;
+
+	// State of the batch being filled by pcap_dispatch(). libpcap
+	// only guarantees the packet data to be valid for the duration of
+	// the callback, so each packet is copied into a buffer of its own.
+	// The buffers are lent to the packets, and reused across batches
+	// unless somebody still holds a reference.
+	Packet* dispatch_pkts = nullptr;
+	size_t dispatch_count = 0;
+	std::vector<IntrusivePtr<HeapPacketBuffer>> batch_buffers;
+
+	// When reading a trace file ahead in a background thread, the
+	// reader owns the pcap handle, so filtering happens on our side.
+	std::unique_ptr<ReadAhead> read_ahead;
+	std::vector<IntrusivePtr<HeapPacketBuffer>> lent_buffers;
+	int read_ahead_filter = 0;
 	};
 
 	} // namespace zeek::iosource::pcap
@@ -0,0 +1,182 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/logging/LogBatch.h"
+
+#include "zeek/zeek-config.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <new>
+
+#include "zeek/3rdparty/doctest.h"
+
+namespace zeek::logging
+	{
+
+static constexpr size_t ARENA_BLOCK_SIZE = 64 * 1024;
+
+LogBatch::LogBatch(int arg_num_fields, int arg_capacity)
+	: num_fields(arg_num_fields), capacity(arg_capacity)
+	{
+	columns.reserve(num_fields);
+
+	for ( int i = 0; i < num_fields; ++i )
+		columns.emplace_back(new threading::Value[capacity]);
+	}
+
+LogBatch::~LogBatch()
+	{
+	// What the values point to goes away with the arena, so keep their
+	// destructors from freeing it.
+	for ( auto& c : columns )
+		for ( int j = 0; j < size; ++j )
+			c[j].present = false;
+	}
+
+char* LogBatch::Allocate(size_t n, size_t align)
+	{
+	auto pad = (align - reinterpret_cast<uintptr_t>(next) % align) % align;
+
+	if ( n + pad > remaining )
+		{
+		auto block_size = std::max(ARENA_BLOCK_SIZE, n + align);
+		blocks.emplace_back(new char[block_size]);
+		arena_size += block_size;
+		next = blocks.back().get();
+		remaining = block_size;
+		pad = (align - reinterpret_cast<uintptr_t>(next) % align) % align;
+		}
+
+	char* p = next + pad;
+	next = p + n;
+	remaining -= n + pad;
+
+	return p;
+	}
+
+threading::Value** LogBatch::AllocateValues(size_t n)
+	{
+	auto vals = reinterpret_cast<threading::Value**>(
+		Allocate(n * sizeof(threading::Value*), alignof(threading::Value*)));
+
+	// These never get destroyed, as they don't own what they point to.
+	for ( size_t i = 0; i < n; ++i )
+		vals[i] = new (Allocate(sizeof(threading::Value), alignof(threading::Value)))
+			threading::Value();
+
+	return vals;
+	}
+
+void LogBatch::CopyValue(threading::Value* dst, const threading::Value& src)
+	{
+	dst->type = src.type;
+	dst->subtype = src.subtype;
+	dst->present = src.present;
+	dst->val = src.val;
+
+	if ( ! src.present )
+		return;
+
+	switch ( src.type )
+		{
+		case TYPE_ENUM:
+		case TYPE_STRING:
+		case TYPE_FILE:
+		case TYPE_FUNC:
+			{
+			auto len = src.val.string_val.length;
+			auto data = AllocateChars(len + 1);
+			memcpy(data, src.val.string_val.data, len);
+			data[len] = '\0';
+			dst->val.string_val.data = data;
+			break;
+			}
+
+		case TYPE_PATTERN:
+			{
+			auto len = strlen(src.val.pattern_text_val);
+			auto text = AllocateChars(len + 1);
+			memcpy(text, src.val.pattern_text_val, len + 1);
+			dst->val.pattern_text_val = text;
+			break;
+			}
+
+		case TYPE_TABLE:
+		case TYPE_VECTOR:
+			{
+			// Sets and vectors have the same layout.
+			auto n = src.val.set_val.size;
+			auto vals = AllocateValues(n);
+
+			for ( zeek_int_t i = 0; i < n; ++i )
+				CopyValue(vals[i], *src.val.set_val.vals[i]);
+
+			dst->val.set_val.vals = vals;
+			break;
+			}
+
+		default:
+			break;
+		}
+	}
+
+TEST_SUITE_BEGIN("LogBatch");
+
+TEST_CASE("log batch")
+	{
+	LogBatch b(2, 3);
+
+	CHECK(b.Size() == 0);
+	CHECK_FALSE(b.Full());
+
+	threading::Value s(TYPE_STRING);
+	s.val.string_val.data = new char[5];
+	memcpy(s.val.string_val.data, "hello", 5);
+	s.val.string_val.length = 5;
+
+	threading::Value v(TYPE_VECTOR, TYPE_COUNT);
+	v.val.vector_val.size = 2;
+	v.val.vector_val.vals = new threading::Value*[2];
+	v.val.vector_val.vals[0] = new threading::Value(TYPE_COUNT);
+	v.val.vector_val.vals[0]->val.uint_val = 42;
+	v.val.vector_val.vals[1] = new threading::Value(TYPE_COUNT, false);
+
+	for ( int j = 0; j < 3; ++j )
+		{
+		auto e = b.AddEntry();
+		CHECK(e == j);
+		b.CopyValue(b.Get(e, 0), s);
+		b.CopyValue(b.Get(e, 1), v);
+		}
+
+	CHECK(b.Full());
+
+	// The copies don't share memory with the originals.
+	s.val.string_val.data[0] = 'j';
+
+	for ( int j = 0; j < 3; ++j )
+		{
+		auto bs = b.Get(j, 0);
+		CHECK(bs->type == TYPE_STRING);
+		CHECK(std::string(bs->val.string_val.data, bs->val.string_val.length) == "hello");
+
+		auto bv = b.Get(j, 1);
+		CHECK(bv->subtype == TYPE_COUNT);
+		REQUIRE(bv->val.vector_val.size == 2);
+		CHECK(bv->val.vector_val.vals[0]->val.uint_val == 42);
+		CHECK_FALSE(bv->val.vector_val.vals[1]->present);
+		}
+
+	CHECK(b.Column(1) == b.Get(0, 1));
+
+	// Strings larger than an arena block get one of their own.
+	LogBatch big(1, 1);
+	auto chars = big.AllocateChars(ARENA_BLOCK_SIZE * 2);
+	memset(chars, 'x', ARENA_BLOCK_SIZE * 2);
+	CHECK(big.AllocateChars(1) != nullptr);
+	}
+
+TEST_SUITE_END();
+
+	} // namespace zeek::logging
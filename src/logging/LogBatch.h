@@ -0,0 +1,120 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "zeek/threading/SerialTypes.h"
+
+namespace zeek::logging
+	{
+
+/**
+ * A batch of log entries on their way to a writer, stored by column: the
+ * values of each field for all entries sit in one array. Everything that
+ * these values point to, such as strings and the elements of sets and
+ * vectors, comes from an arena that the batch owns. Filling a batch and
+ * releasing it on the writer's thread thus take a handful of allocations
+ * rather than several per entry.
+ */
+class LogBatch
+	{
+public:
+	/**
+	 * Constructor.
+	 *
+	 * @param num_fields The number of log fields.
+	 *
+	 * @param capacity The maximum number of entries.
+	 */
+	LogBatch(int num_fields, int capacity);
+
+	~LogBatch();
+
+	LogBatch(const LogBatch&) = delete;
+	LogBatch& operator=(const LogBatch&) = delete;
+
+	/**
+	 * Returns the number of log fields.
+	 */
+	int NumFields() const { return num_fields; }
+
+	/**
+	 * Returns the number of entries.
+	 */
+	int Size() const { return size; }
+
+	/**
+	 * Returns the maximum number of entries.
+	 */
+	int Capacity() const { return capacity; }
+
+	/**
+	 * Returns true if the batch has no room for more entries.
+	 */
+	bool Full() const { return size == capacity; }
+
+	/**
+	 * Returns the memory that the batch takes up, in bytes.
+	 */
+	size_t Bytes() const
+		{
+		return sizeof(*this) + num_fields * capacity * sizeof(threading::Value) + arena_size;
+		}
+
+	/**
+	 * Adds an entry, returning its index. The caller then sets all of
+	 * its values. The batch must not be full.
+	 */
+	int AddEntry() { return size++; }
+
+	/**
+	 * Returns the value of a field of an entry. Any memory that the
+	 * value points to must come from the batch's arena, see
+	 * AllocateChars() and AllocateValues().
+	 */
+	threading::Value* Get(int entry, int field) { return &columns[field][entry]; }
+	const threading::Value* Get(int entry, int field) const { return &columns[field][entry]; }
+
+	/**
+	 * Returns the values of a field for all entries, in order.
+	 */
+	const threading::Value* Column(int field) const { return columns[field].get(); }
+
+	/**
+	 * Sets a value to a deep copy of another one, with the memory that
+	 * the copy points to coming from the batch's arena.
+	 */
+	void CopyValue(threading::Value* dst, const threading::Value& src);
+
+	/**
+	 * Returns arena memory for a string of the given length.
+	 */
+	char* AllocateChars(size_t n) { return Allocate(n, 1); }
+
+	/**
+	 * Returns an array of pointers to new values, all in the arena, for
+	 * the elements of a set or vector.
+	 */
+	threading::Value** AllocateValues(size_t n);
+
+private:
+	char* Allocate(size_t n, size_t align);
+
+	int num_fields;
+	int capacity;
+	int size = 0;
+
+	std::vector<std::unique_ptr<threading::Value[]>> columns;
+
+	// The arena's blocks, and where the free part of the last one
+	// starts and how large it is.
+	std::vector<std::unique_ptr<char[]>> blocks;
+	char* next = nullptr;
+	size_t remaining = 0;
+	size_t arena_size = 0; // The total size of the blocks.
+	};
+
+	} // namespace zeek::logging
@@ -0,0 +1,672 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/logging/LogWire.h"
+
+#include "zeek/zeek-config.h"
+
+#include <cstring>
+
+#include "zeek/3rdparty/doctest.h"
+#include "zeek/Reporter.h"
+
+namespace zeek::logging
+	{
+
+// Starts an encoding. The old per-entry serialization starts with the
+// number of fields in network byte order, which never has its top bit
+// set.
+static const char WIRE_MAGIC[] = "\xffZLW";
+static constexpr size_t WIRE_MAGIC_LEN = 4;
+
+static uint64_t zigzag(int64_t i)
+	{
+	return (static_cast<uint64_t>(i) << 1) ^ static_cast<uint64_t>(i >> 63);
+	}
+
+static int64_t unzigzag(uint64_t u)
+	{
+	return static_cast<int64_t>(u >> 1) ^ -static_cast<int64_t>(u & 1);
+	}
+
+static bool is_container(TypeTag type)
+	{
+	return type == TYPE_TABLE || type == TYPE_VECTOR;
+	}
+
+// Starts a snapshot file.
+static const char SNAPSHOT_MAGIC[] = "\xffZSNAP1";
+static constexpr size_t SNAPSHOT_MAGIC_LEN = 7;
+
+static void put_varint(std::string* s, uint64_t v)
+	{
+	while ( v >= 0x80 )
+		{
+		s->push_back(static_cast<char>((v & 0x7f) | 0x80));
+		v >>= 7;
+		}
+
+	s->push_back(static_cast<char>(v));
+	}
+
+static bool get_varint(const char** pos, const char* end, uint64_t* v)
+	{
+	*v = 0;
+
+	for ( int shift = 0; *pos < end && shift < 64; shift += 7 )
+		{
+		auto b = static_cast<unsigned char>(*(*pos)++);
+		*v |= static_cast<uint64_t>(b & 0x7f) << shift;
+
+		if ( ! (b & 0x80) )
+			return true;
+		}
+
+	return false;
+	}
+
+void LogWireWriter::AddEntry(int arg_num_fields, const threading::Value* const* vals)
+	{
+	num_fields = arg_num_fields;
+
+	for ( int i = 0; i < num_fields; ++i )
+		PutValue(*vals[i]);
+
+	++entries;
+	}
+
+std::string LogWireWriter::Finish()
+	{
+	std::string header(WIRE_MAGIC, WIRE_MAGIC_LEN);
+	std::swap(header, body);
+	PutVarint(num_fields);
+	PutVarint(entries);
+	std::swap(header, body);
+
+	std::string result;
+	result.reserve(header.size() + body.size());
+	result.append(header);
+	result.append(body);
+
+	body.clear();
+	entries = 0;
+
+	return result;
+	}
+
+void LogWireWriter::PutVarint(uint64_t v)
+	{
+	put_varint(&body, v);
+	}
+
+void LogWireWriter::PutBytes(const void* data, size_t len)
+	{
+	body.append(static_cast<const char*>(data), len);
+	}
+
+void LogWireWriter::PutValue(const threading::Value& v)
+	{
+	body.push_back(v.present ? 1 : 0);
+
+	if ( ! v.present )
+		return;
+
+	switch ( v.type )
+		{
+		case TYPE_BOOL:
+			body.push_back(v.val.int_val ? 1 : 0);
+			break;
+
+		case TYPE_INT:
+			PutVarint(zigzag(v.val.int_val));
+			break;
+
+		case TYPE_COUNT:
+			PutVarint(v.val.uint_val);
+			break;
+
+		case TYPE_PORT:
+			PutVarint(v.val.port_val.port);
+			body.push_back(static_cast<char>(v.val.port_val.proto));
+			break;
+
+		case TYPE_ADDR:
+			if ( v.val.addr_val.family == IPv4 )
+				{
+				body.push_back(4);
+				PutBytes(&v.val.addr_val.in.in4, 4);
+				}
+			else
+				{
+				body.push_back(6);
+				PutBytes(&v.val.addr_val.in.in6, 16);
+				}
+			break;
+
+		case TYPE_SUBNET:
+			body.push_back(static_cast<char>(v.val.subnet_val.length));
+
+			if ( v.val.subnet_val.prefix.family == IPv4 )
+				{
+				body.push_back(4);
+				PutBytes(&v.val.subnet_val.prefix.in.in4, 4);
+				}
+			else
+				{
+				body.push_back(6);
+				PutBytes(&v.val.subnet_val.prefix.in.in6, 16);
+				}
+			break;
+
+		case TYPE_DOUBLE:
+		case TYPE_TIME:
+		case TYPE_INTERVAL:
+			{
+			uint64_t bits;
+			memcpy(&bits, &v.val.double_val, sizeof(bits));
+
+			for ( int i = 0; i < 8; ++i )
+				body.push_back(static_cast<char>(bits >> (8 * i)));
+
+			break;
+			}
+
+		case TYPE_ENUM:
+		case TYPE_STRING:
+		case TYPE_FILE:
+		case TYPE_FUNC:
+			PutVarint(v.val.string_val.length);
+			PutBytes(v.val.string_val.data, v.val.string_val.length);
+			break;
+
+		case TYPE_PATTERN:
+			{
+			auto len = strlen(v.val.pattern_text_val);
+			PutVarint(len);
+			PutBytes(v.val.pattern_text_val, len);
+			break;
+			}
+
+		case TYPE_TABLE:
+		case TYPE_VECTOR:
+			// Sets and vectors have the same layout.
+			PutVarint(v.val.set_val.size);
+
+			for ( zeek_int_t i = 0; i < v.val.set_val.size; ++i )
+				PutValue(*v.val.set_val.vals[i]);
+
+			break;
+
+		default:
+			reporter->InternalError("unsupported type %s in LogWireWriter", type_name(v.type));
+		}
+	}
+
+bool LogWireReader::IsWireFormat(const std::string& data)
+	{
+	return data.size() >= WIRE_MAGIC_LEN && memcmp(data.data(), WIRE_MAGIC, WIRE_MAGIC_LEN) == 0;
+	}
+
+LogWireReader::LogWireReader(const std::string& data) : LogWireReader(data.data(), data.size())
+	{
+	}
+
+LogWireReader::LogWireReader(const char* data, size_t len) : pos(data), end(data + len)
+	{
+	uint64_t n, e;
+
+	if ( len < WIRE_MAGIC_LEN || memcmp(data, WIRE_MAGIC, WIRE_MAGIC_LEN) != 0 )
+		return;
+
+	pos += WIRE_MAGIC_LEN;
+
+	if ( ! (GetVarint(&n) && GetVarint(&e)) || n > INT32_MAX || e > INT32_MAX )
+		return;
+
+	num_fields = static_cast<int>(n);
+	entries = static_cast<int>(e);
+	valid = true;
+	}
+
+bool LogWireReader::ReadEntry(const threading::Field* const* fields, LogBatch* batch, int entry)
+	{
+	for ( int i = 0; i < num_fields; ++i )
+		{
+		if ( valid && GetValue(batch->Get(entry, i), fields[i]->type, fields[i]->subtype, batch) )
+			continue;
+
+		valid = false;
+
+		for ( int j = 0; j < num_fields; ++j )
+			{
+			auto v = batch->Get(entry, j);
+			v->type = fields[j]->type;
+			v->subtype = TYPE_ERROR;
+			v->present = false;
+			}
+
+		return false;
+		}
+
+	return true;
+	}
+
+threading::Value** LogWireReader::ReadEntry(const threading::Field* const* fields)
+	{
+	if ( ! valid )
+		return nullptr;
+
+	auto vals = new threading::Value*[num_fields];
+
+	for ( int i = 0; i < num_fields; ++i )
+		vals[i] = new threading::Value(fields[i]->type, false);
+
+	for ( int i = 0; i < num_fields; ++i )
+		{
+		if ( GetValue(vals[i], fields[i]->type, fields[i]->subtype, nullptr) )
+			continue;
+
+		valid = false;
+		threading::Value::delete_value_ptr_array(vals, num_fields);
+		return nullptr;
+		}
+
+	return vals;
+	}
+
+bool LogWireReader::GetVarint(uint64_t* v)
+	{
+	return get_varint(&pos, end, v);
+	}
+
+bool LogWireReader::GetBytes(void* data, size_t len)
+	{
+	if ( static_cast<size_t>(end - pos) < len )
+		return false;
+
+	memcpy(data, pos, len);
+	pos += len;
+	return true;
+	}
+
+bool LogWireReader::GetValue(threading::Value* v, TypeTag type, TypeTag subtype,
+                             LogBatch* batch)
+	{
+	char flag;
+
+	v->type = type;
+	v->subtype = is_container(type) ? subtype : TYPE_ERROR;
+	v->present = false;
+
+	if ( ! GetBytes(&flag, 1) )
+		return false;
+
+	if ( ! flag )
+		return true;
+
+	uint64_t u;
+
+	switch ( type )
+		{
+		case TYPE_BOOL:
+			if ( ! GetBytes(&flag, 1) )
+				return false;
+
+			v->val.int_val = flag ? 1 : 0;
+			break;
+
+		case TYPE_INT:
+			if ( ! GetVarint(&u) )
+				return false;
+
+			v->val.int_val = unzigzag(u);
+			break;
+
+		case TYPE_COUNT:
+			if ( ! GetVarint(&v->val.uint_val) )
+				return false;
+
+			break;
+
+		case TYPE_PORT:
+			{
+			char proto;
+
+			if ( ! (GetVarint(&u) && GetBytes(&proto, 1)) || u > 65535 || proto < 0 ||
+			     proto > TRANSPORT_ICMP )
+				return false;
+
+			v->val.port_val.port = static_cast<uint32_t>(u);
+			v->val.port_val.proto = static_cast<TransportProto>(proto);
+			break;
+			}
+
+		case TYPE_ADDR:
+		case TYPE_SUBNET:
+			{
+			char length = 0;
+			char family;
+
+			if ( type == TYPE_SUBNET && ! GetBytes(&length, 1) )
+				return false;
+
+			if ( ! GetBytes(&family, 1) )
+				return false;
+
+			auto& addr = type == TYPE_SUBNET ? v->val.subnet_val.prefix : v->val.addr_val;
+
+			if ( family == 4 )
+				{
+				addr.family = IPv4;
+
+				if ( ! GetBytes(&addr.in.in4, 4) )
+					return false;
+				}
+			else if ( family == 6 )
+				{
+				addr.family = IPv6;
+
+				if ( ! GetBytes(&addr.in.in6, 16) )
+					return false;
+				}
+			else
+				return false;
+
+			if ( type == TYPE_SUBNET )
+				v->val.subnet_val.length = static_cast<uint8_t>(length);
+
+			break;
+			}
+
+		case TYPE_DOUBLE:
+		case TYPE_TIME:
+		case TYPE_INTERVAL:
+			{
+			unsigned char bytes[8];
+
+			if ( ! GetBytes(bytes, sizeof(bytes)) )
+				return false;
+
+			uint64_t bits = 0;
+
+			for ( int i = 0; i < 8; ++i )
+				bits |= static_cast<uint64_t>(bytes[i]) << (8 * i);
+
+			memcpy(&v->val.double_val, &bits, sizeof(bits));
+			break;
+			}
+
+		case TYPE_ENUM:
+		case TYPE_STRING:
+		case TYPE_FILE:
+		case TYPE_FUNC:
+		case TYPE_PATTERN:
+			{
+			if ( ! GetVarint(&u) || u > static_cast<uint64_t>(end - pos) )
+				return false;
+
+			char* data = batch ? batch->AllocateChars(u + 1) : new char[u + 1];
+			GetBytes(data, u);
+			data[u] = '\0';
+
+			if ( type == TYPE_PATTERN )
+				v->val.pattern_text_val = data;
+			else
+				{
+				v->val.string_val.data = data;
+				v->val.string_val.length = static_cast<zeek_int_t>(u);
+				}
+
+			break;
+			}
+
+		case TYPE_TABLE:
+		case TYPE_VECTOR:
+			{
+			// Each element takes at least a byte.
+			if ( ! GetVarint(&u) || u > static_cast<uint64_t>(end - pos) )
+				return false;
+
+			threading::Value** vals;
+
+			if ( batch )
+				vals = batch->AllocateValues(u);
+			else
+				{
+				vals = new threading::Value*[u];
+
+				for ( uint64_t i = 0; i < u; ++i )
+					vals[i] = new threading::Value(subtype, false);
+
+				// Have the elements freed with the value in any
+				// case. Callers discard values that fail.
+				v->present = true;
+				}
+
+			// Sets and vectors have the same layout, so set up the
+			// size now to have the element values freed with the
+			// batch in any case.
+			v->val.set_val.size = static_cast<zeek_int_t>(u);
+			v->val.set_val.vals = vals;
+
+			for ( uint64_t i = 0; i < u; ++i )
+				if ( ! GetValue(vals[i], subtype, TYPE_ERROR, batch) )
+					return false;
+
+			break;
+			}
+
+		default:
+			return false;
+		}
+
+	v->present = true;
+	return true;
+	}
+
+std::string LogSnapshot::Header(int num_fields, const threading::Field* const* fields)
+	{
+	std::string header(SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_LEN);
+	put_varint(&header, num_fields);
+
+	for ( int i = 0; i < num_fields; ++i )
+		{
+		auto len = strlen(fields[i]->name);
+		put_varint(&header, len);
+		header.append(fields[i]->name, len);
+		put_varint(&header, fields[i]->type);
+		put_varint(&header, fields[i]->subtype);
+		}
+
+	return header;
+	}
+
+std::string LogSnapshot::Block(const std::string& entries)
+	{
+	std::string block;
+	block.reserve(entries.size() + 10);
+	put_varint(&block, entries.size());
+	block.append(entries);
+	return block;
+	}
+
+LogSnapshot::LogSnapshot(const char* data, size_t len) : pos(data), end(data + len)
+	{
+	uint64_t n;
+
+	if ( len < SNAPSHOT_MAGIC_LEN || memcmp(data, SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_LEN) != 0 )
+		return;
+
+	pos += SNAPSHOT_MAGIC_LEN;
+
+	// Each field takes at least three bytes.
+	if ( ! get_varint(&pos, end, &n) || n > static_cast<uint64_t>(end - pos) )
+		return;
+
+	fields.reserve(n);
+
+	for ( uint64_t i = 0; i < n; ++i )
+		{
+		uint64_t name_len, type, subtype;
+
+		if ( ! get_varint(&pos, end, &name_len) || name_len > static_cast<uint64_t>(end - pos) )
+			return;
+
+		std::string name(pos, name_len);
+		pos += name_len;
+
+		if ( ! (get_varint(&pos, end, &type) && get_varint(&pos, end, &subtype)) ||
+		     type > TYPE_ERROR || subtype > TYPE_ERROR )
+			return;
+
+		fields.emplace_back(name.c_str(), nullptr, static_cast<TypeTag>(type),
+		                    static_cast<TypeTag>(subtype), true);
+		}
+
+	valid = true;
+	}
+
+bool LogSnapshot::NextBlock(const char** block, size_t* len)
+	{
+	uint64_t n;
+
+	if ( ! valid || pos == end )
+		return false;
+
+	if ( ! get_varint(&pos, end, &n) || n > static_cast<uint64_t>(end - pos) )
+		{
+		valid = false;
+		return false;
+		}
+
+	*block = pos;
+	*len = n;
+	pos += n;
+	return true;
+	}
+
+TEST_SUITE_BEGIN("LogWire");
+
+TEST_CASE("log wire round trip")
+	{
+	threading::Field f_count("c", nullptr, TYPE_COUNT, TYPE_ERROR, false);
+	threading::Field f_int("i", nullptr, TYPE_INT, TYPE_ERROR, false);
+	threading::Field f_str("s", nullptr, TYPE_STRING, TYPE_ERROR, true);
+	threading::Field f_time("t", nullptr, TYPE_TIME, TYPE_ERROR, false);
+	threading::Field f_vec("v", nullptr, TYPE_VECTOR, TYPE_COUNT, false);
+	const threading::Field* fields[] = {&f_count, &f_int, &f_str, &f_time, &f_vec};
+
+	threading::Value c(TYPE_COUNT);
+	c.val.uint_val = 300;
+	threading::Value i(TYPE_INT);
+	i.val.int_val = -5;
+	threading::Value s(TYPE_STRING, false);
+	threading::Value t(TYPE_TIME);
+	t.val.double_val = 1234.5;
+	threading::Value v(TYPE_VECTOR, TYPE_COUNT);
+	v.val.vector_val.size = 2;
+	v.val.vector_val.vals = new threading::Value*[2];
+	v.val.vector_val.vals[0] = new threading::Value(TYPE_COUNT);
+	v.val.vector_val.vals[0]->val.uint_val = 1;
+	v.val.vector_val.vals[1] = new threading::Value(TYPE_COUNT, false);
+	const threading::Value* vals[] = {&c, &i, &s, &t, &v};
+
+	LogWireWriter w;
+	w.AddEntry(5, vals);
+	w.AddEntry(5, vals);
+	CHECK(w.Entries() == 2);
+
+	auto data = w.Finish();
+	CHECK(w.Entries() == 0);
+	CHECK(LogWireReader::IsWireFormat(data));
+
+	LogWireReader r(data);
+	REQUIRE(r.Valid());
+	CHECK(r.NumFields() == 5);
+	REQUIRE(r.Entries() == 2);
+
+	LogBatch batch(5, 2);
+
+	for ( int e = 0; e < 2; ++e )
+		{
+		REQUIRE(r.ReadEntry(fields, &batch, batch.AddEntry()));
+		CHECK(batch.Get(e, 0)->val.uint_val == 300);
+		CHECK(batch.Get(e, 1)->val.int_val == -5);
+		CHECK_FALSE(batch.Get(e, 2)->present);
+		CHECK(batch.Get(e, 2)->type == TYPE_STRING);
+		CHECK(batch.Get(e, 3)->val.double_val == 1234.5);
+		REQUIRE(batch.Get(e, 4)->val.vector_val.size == 2);
+		CHECK(batch.Get(e, 4)->val.vector_val.vals[0]->val.uint_val == 1);
+		CHECK_FALSE(batch.Get(e, 4)->val.vector_val.vals[1]->present);
+		}
+
+	// Decoding into values of their own.
+	LogWireReader heap(data.data(), data.size());
+	REQUIRE(heap.Valid());
+	auto hvals = heap.ReadEntry(fields);
+	REQUIRE(hvals);
+	CHECK(hvals[0]->val.uint_val == 300);
+	CHECK_FALSE(hvals[2]->present);
+	REQUIRE(hvals[4]->val.vector_val.size == 2);
+	CHECK(hvals[4]->val.vector_val.vals[0]->val.uint_val == 1);
+	threading::Value::delete_value_ptr_array(hvals, 5);
+
+	// Truncated data leaves the entry unset.
+	LogWireReader truncated(data.substr(0, data.size() - 3));
+	LogBatch b2(5, 2);
+	REQUIRE(truncated.ReadEntry(fields, &b2, b2.AddEntry()));
+	CHECK_FALSE(truncated.ReadEntry(fields, &b2, b2.AddEntry()));
+	CHECK_FALSE(b2.Get(1, 0)->present);
+
+	CHECK_FALSE(LogWireReader::IsWireFormat(std::string("\0\0\0\5", 4)));
+	}
+
+TEST_CASE("log snapshot round trip")
+	{
+	threading::Field f_count("c", nullptr, TYPE_COUNT, TYPE_ERROR, false);
+	threading::Field f_set("s", nullptr, TYPE_TABLE, TYPE_STRING, false);
+	const threading::Field* fields[] = {&f_count, &f_set};
+
+	LogWireWriter w;
+	threading::Value c(TYPE_COUNT);
+	c.val.uint_val = 7;
+	threading::Value set(TYPE_TABLE, TYPE_STRING);
+	set.val.set_val.size = 0;
+	set.val.set_val.vals = nullptr;
+	const threading::Value* vals[] = {&c, &set};
+	w.AddEntry(2, vals);
+
+	auto data = LogSnapshot::Header(2, fields) + LogSnapshot::Block(w.Finish());
+
+	LogSnapshot snap(data.data(), data.size());
+	REQUIRE(snap.Valid());
+	REQUIRE(snap.Fields().size() == 2);
+	CHECK(std::string(snap.Fields()[1].name) == "s");
+	CHECK(snap.Fields()[1].type == TYPE_TABLE);
+	CHECK(snap.Fields()[1].subtype == TYPE_STRING);
+
+	const char* block;
+	size_t len;
+	REQUIRE(snap.NextBlock(&block, &len));
+
+	LogWireReader r(block, len);
+	REQUIRE(r.Valid());
+	CHECK(r.Entries() == 1);
+	auto rvals = r.ReadEntry(fields);
+	REQUIRE(rvals);
+	CHECK(rvals[0]->val.uint_val == 7);
+	CHECK(rvals[1]->val.set_val.size == 0);
+	threading::Value::delete_value_ptr_array(rvals, 2);
+
+	CHECK_FALSE(snap.NextBlock(&block, &len));
+	CHECK(snap.Valid());
+
+	auto truncated = data.substr(0, data.size() - 1);
+	LogSnapshot t(truncated.data(), truncated.size());
+	REQUIRE(t.Valid());
+	CHECK_FALSE(t.NextBlock(&block, &len));
+	CHECK_FALSE(t.Valid());
+	}
+
+TEST_SUITE_END();
+
+	} // namespace zeek::logging
@@ -0,0 +1,180 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "zeek/logging/LogBatch.h"
+#include "zeek/threading/SerialTypes.h"
+
+namespace zeek::logging
+	{
+
+/**
+ * Encodes log entries into the compact format in which they travel to
+ * remote loggers. Both sides know a writer's fields from its creation
+ * message, so entries carry only values: for each field, a byte saying
+ * whether it's set and then its value, with integers and lengths as
+ * variable-length integers. One encoding holds any number of entries of
+ * the same writer.
+ */
+class LogWireWriter
+	{
+public:
+	/**
+	 * Adds an entry. All entries must have the same fields.
+	 */
+	void AddEntry(int num_fields, const threading::Value* const* vals);
+
+	/**
+	 * Returns the number of entries added since the last Finish().
+	 */
+	int Entries() const { return entries; }
+
+	/**
+	 * Returns the size of the encoding so far, in bytes.
+	 */
+	size_t Bytes() const { return body.size(); }
+
+	/**
+	 * Returns the encoding of the entries and starts over.
+	 */
+	std::string Finish();
+
+private:
+	void PutVarint(uint64_t v);
+	void PutBytes(const void* data, size_t len);
+	void PutValue(const threading::Value& v);
+
+	std::string body;
+	int num_fields = 0;
+	int entries = 0;
+	};
+
+/**
+ * Decodes log entries encoded by LogWireWriter straight into a writer's
+ * batch, or into values of their own.
+ */
+class LogWireReader
+	{
+public:
+	/**
+	 * Returns true if data is in the format, as opposed to the per-entry
+	 * serialization that older versions send.
+	 */
+	static bool IsWireFormat(const std::string& data);
+
+	/**
+	 * Constructor. Reads the header, see Valid().
+	 */
+	explicit LogWireReader(const std::string& data);
+
+	/**
+	 * Constructor for data somewhere else, such as a mapped file. The
+	 * data must remain valid while decoding.
+	 */
+	LogWireReader(const char* data, size_t len);
+
+	/**
+	 * Returns false if the data is malformed.
+	 */
+	bool Valid() const { return valid; }
+
+	/**
+	 * Returns the number of fields that the entries have.
+	 */
+	int NumFields() const { return num_fields; }
+
+	/**
+	 * Returns the number of entries.
+	 */
+	int Entries() const { return entries; }
+
+	/**
+	 * Decodes the next entry into a batch, with the given fields.
+	 *
+	 * @return False if the data is malformed, in which case all of the
+	 * entry's values are unset.
+	 */
+	bool ReadEntry(const threading::Field* const* fields, LogBatch* batch, int entry);
+
+	/**
+	 * Decodes the next entry into newly allocated values, with the
+	 * given fields.
+	 *
+	 * @return The values, with ownership passed to the caller, or null
+	 * if the data is malformed.
+	 */
+	threading::Value** ReadEntry(const threading::Field* const* fields);
+
+private:
+	bool GetVarint(uint64_t* v);
+	bool GetBytes(void* data, size_t len);
+
+	// Without a batch, the value's memory comes from the heap.
+	bool GetValue(threading::Value* v, TypeTag type, TypeTag subtype, LogBatch* batch);
+
+	const char* pos;
+	const char* end;
+	bool valid = false;
+	int num_fields = 0;
+	int entries = 0;
+	};
+
+/**
+ * The layout of snapshot files, which hold a log's entries for reading
+ * them back quickly, such as into input tables. A file starts with a
+ * header naming the fields and their types, followed by blocks of entries
+ * encoded by LogWireWriter, each prefixed with its length. Readers can map
+ * a file into memory and decode it in place.
+ */
+class LogSnapshot
+	{
+public:
+	/**
+	 * Returns the header for a file with the given fields.
+	 */
+	static std::string Header(int num_fields, const threading::Field* const* fields);
+
+	/**
+	 * Returns a block of entries as returned by LogWireWriter::Finish(),
+	 * framed for the file.
+	 */
+	static std::string Block(const std::string& entries);
+
+	/**
+	 * Constructor for reading a file. Reads the header, see Valid(). The
+	 * data must remain valid while reading.
+	 */
+	LogSnapshot(const char* data, size_t len);
+
+	/**
+	 * Returns false if the header is malformed.
+	 */
+	bool Valid() const { return valid; }
+
+	/**
+	 * Returns the fields that the header names.
+	 */
+	const std::vector<threading::Field>& Fields() const { return fields; }
+
+	/**
+	 * Returns the next block of entries, for decoding with
+	 * LogWireReader.
+	 *
+	 * @return False at the end of the file, or if it's malformed, see
+	 * Valid().
+	 */
+	bool NextBlock(const char** block, size_t* len);
+
+private:
+	const char* pos;
+	const char* end;
+	bool valid = false;
+	std::vector<threading::Field> fields;
+	};
+
+	} // namespace zeek::logging
@@ -3,6 +3,8 @@
 #include "zeek/logging/Manager.h"
 
 #include <broker/endpoint_info.hh>
+#include <cmath>
+#include <optional>
 #include <utility>
 
 #include "zeek/Desc.h"
@@ -10,17 +12,21 @@
 #include "zeek/EventHandler.h"
 #include "zeek/File.h"
 #include "zeek/Func.h"
+#include "zeek/Hash.h"
 #include "zeek/IntrusivePtr.h"
 #include "zeek/NetVar.h"
 #include "zeek/RunState.h"
 #include "zeek/Type.h"
 #include "zeek/broker/Manager.h"
 #include "zeek/input.h"
+#include "zeek/logging/RotationPipeline.h"
 #include "zeek/logging/WriterBackend.h"
 #include "zeek/logging/WriterFrontend.h"
 #include "zeek/logging/logging.bif.h"
 #include "zeek/plugin/Manager.h"
 #include "zeek/plugin/Plugin.h"
+#include "zeek/telemetry/Manager.h"
+#include "zeek/threading/Compression.h"
 #include "zeek/threading/Manager.h"
 #include "zeek/threading/SerialTypes.h"
 
@@ -29,6 +35,44 @@ using namespace std;
 namespace zeek::logging
 	{
 
+namespace
+	{
+
+// Limits writes to a number per second of network time.
+struct RateLimit
+	{
+	zeek_uint_t max_rate = 0; // Zero for no limit.
+	double second = 0.0;
+	zeek_uint_t writes = 0;
+
+	bool Allow(double now)
+		{
+		if ( ! max_rate )
+			return true;
+
+		double s = floor(now);
+
+		if ( s != second )
+			{
+			second = s;
+			writes = 0;
+			}
+
+		return ++writes <= max_rate;
+		}
+	};
+
+telemetry::IntCounter dropped_writes_counter(const string& stream, const string& filter,
+                                             const char* reason)
+	{
+	auto family = telemetry_mgr->CounterFamily(
+		"zeek", "log-writes-dropped", {"stream", "filter", "reason"},
+		"Log writes dropped by sampling or rate limits", "1", true);
+	return family.GetOrAdd({{"stream", stream}, {"filter", filter}, {"reason", reason}});
+	}
+
+	} // namespace
+
 struct Manager::Filter
 	{
 	Val* fval = nullptr;
@@ -58,7 +102,32 @@ struct Manager::Filter
 	// sub-records.
 	vector<list<int>> indices;
 
+	// An earlier filter of the stream that logs the same columns, and
+	// whether a later filter logs the same columns as this one. These
+	// filters share the conversion of a record, see SharedVals.
+	Filter* same_columns = nullptr;
+	bool columns_shared = false;
+
+	// The number of writers to spread the filter's writes across, and
+	// the one to use next.
+	zeek_uint_t shards = 1;
+	zeek_uint_t next_shard = 0;
+
+	// Sampling keeps the writes whose sampling field's hash is below the
+	// threshold or, without a field, spreads the sampled writes evenly.
+	double sampling = 1.0;
+	int sample_field = -1;
+	uint64_t sample_threshold = 0;
+	double sample_credit = 0.0;
+	std::optional<telemetry::IntCounter> sampled_out;
+
+	RateLimit rate_limit;
+	std::optional<telemetry::IntCounter> rate_limited;
+
 	~Filter();
+
+	// Returns true if sampling keeps a write of the record.
+	bool Sample(RecordVal* columns);
 	};
 
 struct Manager::WriterInfo
@@ -75,6 +144,18 @@ struct Manager::WriterInfo
 	string instantiating_filter;
 	};
 
+// Records converted into log values during a write, for filters that log
+// the same columns. They stay valid until script code gets a chance to
+// change the record.
+struct Manager::SharedVals
+	{
+	~SharedVals() { Clear(); }
+
+	void Clear();
+
+	std::vector<std::pair<const Filter*, threading::Value**>> vals;
+	};
+
 struct Manager::Stream
 	{
 	EnumVal* id = nullptr;
@@ -92,6 +173,9 @@ struct Manager::Stream
 
 	bool enable_remote;
 
+	RateLimit rate_limit;
+	std::optional<telemetry::IntCounter> rate_limited;
+
 	~Stream();
 	};
 
@@ -111,6 +195,71 @@ Manager::Filter::~Filter()
 	Unref(config);
 	}
 
+// Returns a hash of a value for sampling on it, which is the same on all
+// nodes of a cluster.
+static uint64_t sample_hash(const Val* v)
+	{
+	if ( ! v )
+		return 0;
+
+	switch ( v->GetType()->Tag() )
+		{
+		case TYPE_STRING:
+			{
+			auto s = v->AsString();
+			return zeek::detail::KeyedHash::StaticHash64(s->Bytes(), s->Len());
+			}
+
+		case TYPE_ADDR:
+			{
+			uint32_t bytes[4];
+			v->AsAddr().CopyIPv6(bytes);
+			return zeek::detail::KeyedHash::StaticHash64(bytes, sizeof(bytes));
+			}
+
+		case TYPE_PORT:
+			{
+			uint32_t p = v->AsPortVal()->Port() | (v->AsPortVal()->PortType() << 16);
+			return zeek::detail::KeyedHash::StaticHash64(&p, sizeof(p));
+			}
+
+		case TYPE_ENUM:
+			{
+			zeek_int_t i = v->AsEnum();
+			return zeek::detail::KeyedHash::StaticHash64(&i, sizeof(i));
+			}
+
+		case TYPE_COUNT:
+			{
+			zeek_uint_t u = v->AsCount();
+			return zeek::detail::KeyedHash::StaticHash64(&u, sizeof(u));
+			}
+
+		default:
+			{
+			zeek_int_t i = v->AsInt();
+			return zeek::detail::KeyedHash::StaticHash64(&i, sizeof(i));
+			}
+		}
+	}
+
+bool Manager::Filter::Sample(RecordVal* columns)
+	{
+	if ( sampling >= 1.0 )
+		return true;
+
+	if ( sample_field >= 0 )
+		return sample_hash(columns->GetField(sample_field).get()) < sample_threshold;
+
+	sample_credit += sampling;
+
+	if ( sample_credit < 1.0 )
+		return false;
+
+	sample_credit -= 1.0;
+	return true;
+	}
+
 Manager::Stream::~Stream()
 	{
 	Unref(columns);
@@ -327,6 +476,11 @@ bool Manager::CreateStream(EnumVal* id, RecordVal* sval)
 	streams[idx]->columns = columns->Ref()->AsRecordType();
 
 	streams[idx]->enable_remote = id::find_val("Log::enable_remote_logging")->AsBool();
+	streams[idx]->rate_limit.max_rate = sval->GetFieldOrDefault("max_rate")->AsCount();
+
+	if ( streams[idx]->rate_limit.max_rate && telemetry_mgr )
+		streams[idx]->rate_limited = dropped_writes_counter(streams[idx]->name, "",
+		                                                    "stream-max-rate");
 
 	DBG_LOG(DBG_LOGGING, "Created new logging stream '%s', raising event %s",
 	        streams[idx]->name.c_str(), event ? streams[idx]->event->Name() : "<none>");
@@ -568,6 +722,57 @@ bool Manager::AddFilter(EnumVal* id, RecordVal* fval)
 	auto scope_sep = fval->GetFieldOrDefault("scope_sep");
 	auto ext_prefix = fval->GetFieldOrDefault("ext_prefix");
 	auto ext_func = fval->GetFieldOrDefault("ext_func");
+	auto shards = fval->GetFieldOrDefault("shards");
+	auto sampling = fval->GetFieldOrDefault("sampling");
+	auto sample_field = fval->GetFieldOrDefault("sample_field");
+	auto max_rate = fval->GetFieldOrDefault("max_rate");
+
+	if ( shards->AsCount() == 0 )
+		{
+		reporter->Error("log filter '%s' needs at least one shard",
+		                name->AsString()->CheckString());
+		return false;
+		}
+
+	if ( sampling->AsDouble() < 0.0 || sampling->AsDouble() > 1.0 )
+		{
+		reporter->Error("log filter '%s' has sampling outside of [0, 1]",
+		                name->AsString()->CheckString());
+		return false;
+		}
+
+	int sample_field_idx = -1;
+
+	if ( sample_field->AsString()->Len() )
+		{
+		const char* fname = sample_field->AsString()->CheckString();
+		sample_field_idx = stream->columns->FieldOffset(fname);
+
+		if ( sample_field_idx < 0 )
+			{
+			reporter->Error("log filter '%s' samples on unknown field '%s'",
+			                name->AsString()->CheckString(), fname);
+			return false;
+			}
+
+		switch ( stream->columns->GetFieldType(sample_field_idx)->Tag() )
+			{
+			case TYPE_STRING:
+			case TYPE_ADDR:
+			case TYPE_PORT:
+			case TYPE_ENUM:
+			case TYPE_COUNT:
+			case TYPE_INT:
+			case TYPE_BOOL:
+				break;
+
+			default:
+				reporter->Error("log filter '%s' cannot sample on field '%s' of type %s",
+				                name->AsString()->CheckString(), fname,
+				                type_name(stream->columns->GetFieldType(sample_field_idx)->Tag()));
+				return false;
+			}
+		}
 
 	Filter* filter = new Filter;
 	filter->fval = fval->Ref();
@@ -585,6 +790,23 @@ bool Manager::AddFilter(EnumVal* id, RecordVal* fval)
 	filter->scope_sep = scope_sep->AsString()->CheckString();
 	filter->ext_prefix = ext_prefix->AsString()->CheckString();
 	filter->ext_func = ext_func ? ext_func->AsFunc() : nullptr;
+	filter->shards = shards->AsCount();
+	filter->sampling = sampling->AsDouble();
+	filter->sample_field = sample_field_idx;
+
+	if ( filter->sampling < 1.0 )
+		filter->sample_threshold = static_cast<uint64_t>(ldexp(filter->sampling, 64));
+
+	filter->rate_limit.max_rate = max_rate->AsCount();
+
+	if ( telemetry_mgr )
+		{
+		if ( filter->sampling < 1.0 )
+			filter->sampled_out = dropped_writes_counter(stream->name, filter->name, "sampling");
+
+		if ( filter->rate_limit.max_rate )
+			filter->rate_limited = dropped_writes_counter(stream->name, filter->name, "max-rate");
+		}
 
 	// Build the list of fields that the filter wants included, including
 	// potentially rolling out fields.
@@ -644,6 +866,7 @@ bool Manager::AddFilter(EnumVal* id, RecordVal* fval)
 
 	// Add the new one.
 	stream->filters.push_back(filter);
+	UpdateSharedColumns(stream);
 
 #ifdef DEBUG
 	ODesc desc;
@@ -684,6 +907,7 @@ bool Manager::RemoveFilter(EnumVal* id, const string& name)
 			{
 			Filter* filter = *i;
 			stream->filters.erase(i);
+			UpdateSharedColumns(stream);
 			DBG_LOG(DBG_LOGGING, "Removed filter '%s' from stream '%s'", filter->name.c_str(),
 			        stream->name.c_str());
 			delete filter;
@@ -698,6 +922,12 @@ bool Manager::RemoveFilter(EnumVal* id, const string& name)
 	return true;
 	}
 
+// Returns what a shard of a filter appends to its path.
+static string shard_suffix(zeek_uint_t n)
+	{
+	return "." + std::to_string(n);
+	}
+
 bool Manager::Write(EnumVal* id, RecordVal* columns_arg)
 	{
 	Stream* stream = FindStream(id);
@@ -707,6 +937,14 @@ bool Manager::Write(EnumVal* id, RecordVal* columns_arg)
 	if ( ! stream->enabled )
 		return true;
 
+	if ( ! stream->rate_limit.Allow(run_state::network_time) )
+		{
+		if ( stream->rate_limited )
+			stream->rate_limited->Inc();
+
+		return true;
+		}
+
 	auto columns = columns_arg->CoerceTo({NewRef{}, stream->columns});
 
 	if ( ! columns )
@@ -734,6 +972,8 @@ bool Manager::Write(EnumVal* id, RecordVal* columns_arg)
 			}
 		}
 
+	SharedVals shared_vals;
+
 	// Send to each of our filters.
 	for ( list<Filter*>::iterator i = stream->filters.begin(); i != stream->filters.end(); ++i )
 		{
@@ -749,6 +989,12 @@ bool Manager::Write(EnumVal* id, RecordVal* columns_arg)
 			{
 			auto v = filter->policy->Invoke(columns, IntrusivePtr{NewRef{}, id},
 			                                IntrusivePtr{NewRef{}, filter->fval});
+
+			// Earlier filters must not see changes from this
+			// filter's hook, nor this one miss them.
+			if ( filter->policy->HasBodies() )
+				shared_vals.Clear();
+
 			if ( v && ! v->AsBool() )
 				continue;
 			}
@@ -756,6 +1002,22 @@ bool Manager::Write(EnumVal* id, RecordVal* columns_arg)
 		if ( stream_veto )
 			continue;
 
+		if ( ! filter->Sample(columns.get()) )
+			{
+			if ( filter->sampled_out )
+				filter->sampled_out->Inc();
+
+			continue;
+			}
+
+		if ( ! filter->rate_limit.Allow(run_state::network_time) )
+			{
+			if ( filter->rate_limited )
+				filter->rate_limited->Inc();
+
+			continue;
+			}
+
 		if ( filter->path_func )
 			{
 			ValPtr path_arg;
@@ -777,6 +1039,9 @@ bool Manager::Write(EnumVal* id, RecordVal* columns_arg)
 			auto v = filter->path_func->Invoke(IntrusivePtr{NewRef{}, id}, std::move(path_arg),
 			                                   std::move(rec_arg));
 
+			// The path function gets the record as well.
+			shared_vals.Clear();
+
 			if ( ! v )
 				return false;
 
@@ -800,7 +1065,13 @@ bool Manager::Write(EnumVal* id, RecordVal* columns_arg)
 #endif
 			}
 
-		Stream::WriterPathPair wpp(filter->writer->AsEnum(), path);
+		// Spread the writes of a sharded filter across its writers.
+		string shard;
+
+		if ( filter->shards > 1 )
+			shard = shard_suffix(filter->next_shard++ % filter->shards);
+
+		Stream::WriterPathPair wpp(filter->writer->AsEnum(), path + shard);
 
 		// See if we already have a writer for this path.
 		Stream::WriterMap::iterator w = stream->writers.find(wpp);
@@ -817,7 +1088,7 @@ bool Manager::Write(EnumVal* id, RecordVal* columns_arg)
 				char num[32];
 				snprintf(num, sizeof(num), "-%u", i++);
 				new_path = path + num;
-				wpp.second = new_path;
+				wpp.second = new_path + shard;
 				w = stream->writers.find(wpp);
 				} while ( w != stream->writers.end() &&
 				          CheckFilterWriterConflict(w->second, filter) );
@@ -857,79 +1128,119 @@ bool Manager::Write(EnumVal* id, RecordVal* columns_arg)
 
 		else
 			{
-			// No, need to create one.
+			// No, need to create one. A sharded filter gets the
+			// writers for all of its shards at once, so that they
+			// rotate together.
+			for ( zeek_uint_t n = 0; n < filter->shards; ++n )
+				{
+				string shard_path = filter->shards > 1 ? path + shard_suffix(n) : path;
 
-			// Copy the fields for WriterFrontend::Init() as it
-			// will take ownership.
-			threading::Field** arg_fields = new threading::Field*[filter->num_fields];
+				if ( stream->writers.count({filter->writer->AsEnum(), shard_path}) )
+					continue;
 
-			for ( int j = 0; j < filter->num_fields; ++j )
-				{
-				// Rename fields if a field name map is set.
-				if ( filter->field_name_map )
-					{
-					const char* name = filter->fields[j]->name;
-					auto fn = make_intrusive<StringVal>(name);
+				// Copy the fields for WriterFrontend::Init() as it
+				// will take ownership.
+				threading::Field** arg_fields = new threading::Field*[filter->num_fields];
 
-					if ( const auto& val = filter->field_name_map->Find(fn) )
+				for ( int j = 0; j < filter->num_fields; ++j )
+					{
+					// Rename fields if a field name map is set.
+					if ( filter->field_name_map )
 						{
-						delete[] filter->fields[j]->name;
-						filter->fields[j]->name = util::copy_string(
-							val->AsStringVal()->CheckString());
+						const char* name = filter->fields[j]->name;
+						auto fn = make_intrusive<StringVal>(name);
+
+						if ( const auto& val = filter->field_name_map->Find(fn) )
+							{
+							delete[] filter->fields[j]->name;
+							filter->fields[j]->name = util::copy_string(
+								val->AsStringVal()->CheckString());
+							}
 						}
+					arg_fields[j] = new threading::Field(*filter->fields[j]);
 					}
-				arg_fields[j] = new threading::Field(*filter->fields[j]);
-				}
 
-			info = new WriterBackend::WriterInfo;
-			info->path = util::copy_string(path.c_str());
-			info->network_time = run_state::network_time;
+				auto shard_info = new WriterBackend::WriterInfo;
+				shard_info->path = util::copy_string(shard_path.c_str());
+				shard_info->network_time = run_state::network_time;
 
-			auto* filter_config_table = filter->config->AsTable();
-			for ( const auto& fcte : *filter_config_table )
-				{
-				auto k = fcte.GetHashKey();
-				auto* v = fcte.value;
-
-				auto index = filter->config->RecreateIndex(*k);
-				string key = index->Idx(0)->AsString()->CheckString();
-				string value = v->GetVal()->AsString()->CheckString();
-				info->config.insert(std::make_pair(util::copy_string(key.c_str()),
-				                                   util::copy_string(value.c_str())));
-				}
+				auto* filter_config_table = filter->config->AsTable();
+				for ( const auto& fcte : *filter_config_table )
+					{
+					auto k = fcte.GetHashKey();
+					auto* v = fcte.value;
+
+					auto index = filter->config->RecreateIndex(*k);
+					string key = index->Idx(0)->AsString()->CheckString();
+					string value = v->GetVal()->AsString()->CheckString();
+					shard_info->config.insert(std::make_pair(util::copy_string(key.c_str()),
+					                                         util::copy_string(value.c_str())));
+					}
 
-			// CreateWriter() will set the other fields in info.
+				// CreateWriter() will set the other fields in info.
 
-			writer = CreateWriter(stream->id, filter->writer, info, filter->num_fields, arg_fields,
-			                      filter->local, filter->remote, false, filter->name);
+				auto shard_writer = CreateWriter(stream->id, filter->writer, shard_info,
+				                                 filter->num_fields, arg_fields, filter->local,
+				                                 filter->remote, false, filter->name);
 
-			if ( ! writer )
-				return false;
+				if ( ! shard_writer )
+					return false;
+
+				if ( shard_path == wpp.second )
+					{
+					writer = shard_writer;
+					info = shard_info;
+					}
+				}
 			}
 
 		// Alright, can do the write now.
+		assert(writer);
+
+		bool shared = filter->same_columns || filter->columns_shared;
 
-		threading::Value** vals = RecordToFilterVals(stream, filter, columns.get());
+		if ( ! plugin_mgr->HavePluginForHook(plugin::HOOK_LOG_WRITE) && writer->WritesBatches() )
+			{
+			// Convert the record straight into the writer's batch.
+			auto batch = writer->BatchForWrite();
+
+			if ( shared )
+				SharedRecordToFilterVals(&shared_vals, stream, filter, columns.get(), batch,
+				                         batch->AddEntry());
+			else
+				RecordToFilterVals(stream, filter, columns.get(), batch, batch->AddEntry());
+
+			writer->FinishWrite();
+			}
 
-		if ( ! PLUGIN_HOOK_WITH_RESULT(
-				 HOOK_LOG_WRITE,
-				 HookLogWrite(
-					 filter->writer->GetType()->AsEnumType()->Lookup(filter->writer->InternalInt()),
-					 filter->name, *info, filter->num_fields, filter->fields, vals),
-				 true) )
+		else
 			{
-			DeleteVals(filter->num_fields, vals);
+			threading::Value** vals;
+
+			if ( shared )
+				vals = SharedRecordToFilterVals(&shared_vals, stream, filter, columns.get());
+			else
+				vals = RecordToFilterVals(stream, filter, columns.get());
+
+			if ( ! PLUGIN_HOOK_WITH_RESULT(HOOK_LOG_WRITE,
+			                               HookLogWrite(filter->writer->GetType()->AsEnumType()->Lookup(
+			                                                filter->writer->InternalInt()),
+			                                            filter->name, *info, filter->num_fields,
+			                                            filter->fields, vals),
+			                               true) )
+				{
+				DeleteVals(filter->num_fields, vals);
 
 #ifdef DEBUG
-			DBG_LOG(DBG_LOGGING, "Hook prevented writing to filter '%s' on stream '%s'",
-			        filter->name.c_str(), stream->name.c_str());
+				DBG_LOG(DBG_LOGGING, "Hook prevented writing to filter '%s' on stream '%s'",
+				        filter->name.c_str(), stream->name.c_str());
 #endif
-			return true;
-			}
+				return true;
+				}
 
-		// Write takes ownership of vals.
-		assert(writer);
-		writer->Write(filter->num_fields, vals);
+			// Write takes ownership of vals.
+			writer->Write(filter->num_fields, vals);
+			}
 
 #ifdef DEBUG
 		DBG_LOG(DBG_LOGGING, "Wrote record to filter '%s' on stream '%s'", filter->name.c_str(),
@@ -940,15 +1251,172 @@ bool Manager::Write(EnumVal* id, RecordVal* columns_arg)
 	return true;
 	}
 
+// Returns a copy of a string, from the batch's arena if there is one.
+static char* copy_log_string(const char* s, size_t len, LogBatch* batch)
+	{
+	char* c = batch ? batch->AllocateChars(len + 1) : new char[len + 1];
+	memcpy(c, s, len);
+	c[len] = '\0';
+	return c;
+	}
+
+// Returns an array of new, unset values.
+static threading::Value** allocate_log_vals(size_t n, LogBatch* batch)
+	{
+	if ( batch )
+		return batch->AllocateValues(n);
+
+	auto vals = new threading::Value*[n];
+
+	for ( size_t i = 0; i < n; ++i )
+		vals[i] = new threading::Value();
+
+	return vals;
+	}
+
+// Sets a log value to a deep copy of another one, with any memory it
+// needs coming from the batch, if given, or the heap.
+static void copy_log_val(threading::Value* dst, const threading::Value& src, LogBatch* batch)
+	{
+	if ( batch )
+		{
+		batch->CopyValue(dst, src);
+		return;
+		}
+
+	dst->type = src.type;
+	dst->subtype = src.subtype;
+	dst->present = src.present;
+	dst->val = src.val;
+
+	if ( ! src.present )
+		return;
+
+	switch ( src.type )
+		{
+		case TYPE_ENUM:
+		case TYPE_STRING:
+		case TYPE_FILE:
+		case TYPE_FUNC:
+			dst->val.string_val.data = copy_log_string(src.val.string_val.data,
+			                                           src.val.string_val.length, nullptr);
+			break;
+
+		case TYPE_PATTERN:
+			dst->val.pattern_text_val = util::copy_string(src.val.pattern_text_val);
+			break;
+
+		case TYPE_TABLE:
+		case TYPE_VECTOR:
+			{
+			// Sets and vectors have the same layout.
+			auto n = src.val.set_val.size;
+			auto vals = allocate_log_vals(n, nullptr);
+
+			for ( zeek_int_t i = 0; i < n; ++i )
+				copy_log_val(vals[i], *src.val.set_val.vals[i], nullptr);
+
+			dst->val.set_val.vals = vals;
+			break;
+			}
+
+		default:
+			break;
+		}
+	}
+
+void Manager::SharedVals::Clear()
+	{
+	for ( auto& [filter, fvals] : vals )
+		{
+		for ( int i = 0; i < filter->num_fields; i++ )
+			delete fvals[i];
+
+		delete[] fvals;
+		}
+
+	vals.clear();
+	}
+
+void Manager::UpdateSharedColumns(Stream* stream)
+	{
+	for ( auto filter : stream->filters )
+		{
+		filter->same_columns = nullptr;
+		filter->columns_shared = false;
+		}
+
+	// Extension fields come from a per-filter function, so filters with
+	// them never share.
+	for ( auto i = stream->filters.begin(); i != stream->filters.end(); ++i )
+		{
+		Filter* filter = *i;
+
+		if ( filter->num_ext_fields > 0 || filter->same_columns )
+			continue;
+
+		for ( auto j = std::next(i); j != stream->filters.end(); ++j )
+			{
+			Filter* other = *j;
+
+			if ( other->num_ext_fields == 0 && ! other->same_columns &&
+			     other->indices == filter->indices )
+				{
+				other->same_columns = filter;
+				filter->columns_shared = true;
+				}
+			}
+		}
+	}
+
+threading::Value** Manager::SharedRecordToFilterVals(SharedVals* shared, Stream* stream,
+                                                     Filter* filter, RecordVal* columns,
+                                                     LogBatch* batch, int entry)
+	{
+	const Filter* first = filter->same_columns ? filter->same_columns : filter;
+	threading::Value** vals = nullptr;
+
+	for ( const auto& [f, fvals] : shared->vals )
+		{
+		if ( f == first )
+			{
+			vals = fvals;
+			break;
+			}
+		}
+
+	if ( ! vals )
+		{
+		vals = RecordToFilterVals(stream, filter, columns);
+		shared->vals.emplace_back(first, vals);
+		}
+
+	threading::Value** copy = batch ? nullptr : allocate_log_vals(filter->num_fields, nullptr);
+
+	for ( int i = 0; i < filter->num_fields; ++i )
+		copy_log_val(batch ? batch->Get(entry, i) : copy[i], *vals[i], batch);
+
+	return copy;
+	}
+
 threading::Value* Manager::ValToLogVal(Val* val, Type* ty)
+	{
+	threading::Value* lval = new threading::Value();
+	FillLogVal(lval, val, ty, nullptr);
+	return lval;
+	}
+
+void Manager::FillLogVal(threading::Value* lval, Val* val, Type* ty, LogBatch* batch)
 	{
 	if ( ! ty )
 		ty = val->GetType().get();
 
-	if ( ! val )
-		return new threading::Value(ty->Tag(), false);
+	lval->type = ty->Tag();
+	lval->subtype = TYPE_ERROR;
+	lval->present = (val != nullptr);
 
-	threading::Value* lval = new threading::Value(ty->Tag());
+	if ( ! val )
+		return;
 
 	switch ( lval->type )
 		{
@@ -961,18 +1429,14 @@ threading::Value* Manager::ValToLogVal(Val* val, Type* ty)
 			{
 			const char* s = val->GetType()->AsEnumType()->Lookup(val->InternalInt());
 
-			if ( s )
-				{
-				lval->val.string_val.data = util::copy_string(s);
-				lval->val.string_val.length = strlen(s);
-				}
-
-			else
+			if ( ! s )
 				{
 				val->GetType()->Error("enum type does not contain value", val);
-				lval->val.string_val.data = util::copy_string("");
-				lval->val.string_val.length = 0;
+				s = "";
 				}
+
+			lval->val.string_val.length = strlen(s);
+			lval->val.string_val.data = copy_log_string(s, lval->val.string_val.length, batch);
 			break;
 			}
 
@@ -1002,7 +1466,7 @@ threading::Value* Manager::ValToLogVal(Val* val, Type* ty)
 		case TYPE_STRING:
 			{
 			const String* s = val->AsString();
-			char* buf = new char[s->Len()];
+			char* buf = batch ? batch->AllocateChars(s->Len()) : new char[s->Len()];
 			memcpy(buf, s->Bytes(), s->Len());
 
 			lval->val.string_val.data = buf;
@@ -1014,7 +1478,7 @@ threading::Value* Manager::ValToLogVal(Val* val, Type* ty)
 			{
 			const File* f = val->AsFile();
 			string s = f->Name();
-			lval->val.string_val.data = util::copy_string(s.c_str());
+			lval->val.string_val.data = copy_log_string(s.c_str(), s.size(), batch);
 			lval->val.string_val.length = s.size();
 			break;
 			}
@@ -1025,8 +1489,8 @@ threading::Value* Manager::ValToLogVal(Val* val, Type* ty)
 			const Func* f = val->AsFunc();
 			f->Describe(&d);
 			const char* s = d.Description();
-			lval->val.string_val.data = util::copy_string(s);
 			lval->val.string_val.length = strlen(s);
+			lval->val.string_val.data = copy_log_string(s, lval->val.string_val.length, batch);
 			break;
 			}
 
@@ -1038,11 +1502,12 @@ threading::Value* Manager::ValToLogVal(Val* val, Type* ty)
 				// already. Just keep going by making something up.
 				set = make_intrusive<ListVal>(TYPE_INT);
 
-			lval->val.set_val.size = set->Length();
-			lval->val.set_val.vals = new threading::Value*[lval->val.set_val.size];
+			auto n = set->Length();
+			lval->val.set_val.size = n;
+			lval->val.set_val.vals = allocate_log_vals(n, batch);
 
-			for ( zeek_int_t i = 0; i < lval->val.set_val.size; i++ )
-				lval->val.set_val.vals[i] = ValToLogVal(set->Idx(i).get());
+			for ( zeek_int_t i = 0; i < n; i++ )
+				FillLogVal(lval->val.set_val.vals[i], set->Idx(i).get(), nullptr, batch);
 
 			break;
 			}
@@ -1050,14 +1515,13 @@ threading::Value* Manager::ValToLogVal(Val* val, Type* ty)
 		case TYPE_VECTOR:
 			{
 			VectorVal* vec = val->AsVectorVal();
-			lval->val.vector_val.size = vec->Size();
-			lval->val.vector_val.vals = new threading::Value*[lval->val.vector_val.size];
+			auto n = vec->Size();
+			lval->val.vector_val.size = n;
+			lval->val.vector_val.vals = allocate_log_vals(n, batch);
 
-			for ( zeek_int_t i = 0; i < lval->val.vector_val.size; i++ )
-				{
-				lval->val.vector_val.vals[i] = ValToLogVal(vec->ValAt(i).get(),
-				                                           vec->GetType()->Yield().get());
-				}
+			for ( zeek_int_t i = 0; i < n; i++ )
+				FillLogVal(lval->val.vector_val.vals[i], vec->ValAt(i).get(),
+				           vec->GetType()->Yield().get(), batch);
 
 			break;
 			}
@@ -1065,11 +1529,10 @@ threading::Value* Manager::ValToLogVal(Val* val, Type* ty)
 		default:
 			reporter->InternalError("unsupported type %s for log_write", type_name(lval->type));
 		}
-
-	return lval;
 	}
 
-threading::Value** Manager::RecordToFilterVals(Stream* stream, Filter* filter, RecordVal* columns)
+threading::Value** Manager::RecordToFilterVals(Stream* stream, Filter* filter, RecordVal* columns,
+                                               LogBatch* batch, int entry)
 	{
 	RecordValPtr ext_rec;
 
@@ -1081,19 +1544,23 @@ threading::Value** Manager::RecordToFilterVals(Stream* stream, Filter* filter, R
 			ext_rec = {AdoptRef{}, res.release()->AsRecordVal()};
 		}
 
-	threading::Value** vals = new threading::Value*[filter->num_fields];
+	threading::Value** vals = batch ? nullptr : allocate_log_vals(filter->num_fields, nullptr);
 
 	for ( int i = 0; i < filter->num_fields; ++i )
 		{
+		threading::Value* lval = batch ? batch->Get(entry, i) : vals[i];
+
+		// Until we know better, the value is unset.
+		lval->type = filter->fields[i]->type;
+		lval->subtype = TYPE_ERROR;
+		lval->present = false;
+
 		Val* val;
 		if ( i < filter->num_ext_fields )
 			{
 			if ( ! ext_rec )
-				{
 				// executing function did not return record. Send empty for all vals.
-				vals[i] = new threading::Value(filter->fields[i]->type, false);
 				continue;
-				}
 
 			val = ext_rec.get();
 			}
@@ -1112,15 +1579,12 @@ threading::Value** Manager::RecordToFilterVals(Stream* stream, Filter* filter, R
 			val = val_ptr.get();
 
 			if ( ! val )
-				{
 				// Value, or any of its parents, is not set.
-				vals[i] = new threading::Value(filter->fields[i]->type, false);
 				break;
-				}
 			}
 
 		if ( val )
-			vals[i] = ValToLogVal(val);
+			FillLogVal(lval, val, nullptr, batch);
 		}
 
 	return vals;
@@ -1191,7 +1655,9 @@ WriterFrontend* Manager::CreateWriter(EnumVal* id, EnumVal* writer, WriterBacken
 	for ( it = stream->filters.begin(); it != stream->filters.end(); ++it )
 		{
 		Filter* f = *it;
-		if ( f->writer->AsEnum() == writer->AsEnum() && f->path == info->path )
+		// A sharded filter's writers each add their shard to its path.
+		if ( f->writer->AsEnum() == writer->AsEnum() &&
+		     (f->path == info->path || (f->shards > 1 && f->name == instantiating_filter)) )
 			{
 			found_filter_match = true;
 			winfo->interval = f->interval;
@@ -1308,6 +1774,77 @@ bool Manager::WriteFromRemote(EnumVal* id, EnumVal* writer, const string& path,
 	return true;
 	}
 
+bool Manager::WriteFromRemote(EnumVal* id, EnumVal* writer, const string& path,
+                              LogWireReader* entries)
+	{
+	Stream* stream = FindStream(id);
+
+	if ( ! stream )
+		{
+			// Don't know this stream.
+#ifdef DEBUG
+		ODesc desc;
+		id->Describe(&desc);
+		DBG_LOG(DBG_LOGGING, "unknown stream %s in Manager::Write()", desc.Description());
+#endif
+		return false;
+		}
+
+	if ( ! stream->enabled )
+		return true;
+
+	Stream::WriterMap::iterator w = stream->writers.find(
+		Stream::WriterPathPair(writer->AsEnum(), path));
+
+	if ( w == stream->writers.end() )
+		{
+			// Don't know this writer.
+#ifdef DEBUG
+		ODesc desc;
+		id->Describe(&desc);
+		DBG_LOG(DBG_LOGGING, "unknown writer %s in Manager::Write()", desc.Description());
+#endif
+		return false;
+		}
+
+	WriterFrontend* frontend = w->second->writer;
+
+	if ( entries->NumFields() != frontend->NumFields() )
+		{
+		reporter->Warning("WriterFrontend %s expected %d fields in write, got %d. Skipping %d "
+		                  "lines.",
+		                  frontend->Name(), frontend->NumFields(), entries->NumFields(),
+		                  entries->Entries());
+		return false;
+		}
+
+	if ( ! frontend->WritesBatches() )
+		// Disabled, or without a backend to write to. (Writers for
+		// remote logs don't forward them once more.)
+		return true;
+
+	for ( int i = 0; i < entries->Entries(); ++i )
+		{
+		auto batch = frontend->BatchForWrite();
+		bool ok = entries->ReadEntry(frontend->Fields(), batch, batch->AddEntry());
+
+		// A malformed entry stays in the batch with all of its
+		// values unset.
+		frontend->FinishWrite();
+
+		if ( ! ok )
+			{
+			reporter->Warning("failed to decode remote log entries for path '%s'", path.c_str());
+			return false;
+			}
+		}
+
+	DBG_LOG(DBG_LOGGING, "Wrote %d pre-filtered records to path '%s' on stream '%s'",
+	        entries->Entries(), path.c_str(), stream->name.c_str());
+
+	return true;
+	}
+
 void Manager::SendAllWritersTo(const broker::endpoint_info& ei)
 	{
 	auto et = id::find_type("Log::Writer")->AsEnumType();
@@ -1373,6 +1910,44 @@ void Manager::Terminate()
 		}
 	}
 
+bool Manager::ArchiveRotatedLog(RecordVal* info, const string& dir, const string& compression,
+                                bool checksum)
+	{
+	auto c = threading::compression_from_name(compression);
+
+	if ( ! c || ! threading::compression_available(*c) )
+		{
+		reporter->Error("unsupported log archive compression '%s'", compression.c_str());
+		return false;
+		}
+
+	auto fname = info->GetFieldAs<StringVal>(1)->ToStdString();
+	time_t open_time = static_cast<time_t>(info->GetFieldAs<TimeVal>(3));
+
+	char day[32];
+	struct tm tm;
+	strftime(day, sizeof(day), "%Y-%m-%d", localtime_r(&open_time, &tm));
+
+	string dst_dir = dir + "/" + day;
+
+	if ( ! util::detail::ensure_intermediate_dirs(dst_dir.c_str()) )
+		return false;
+
+	string dst = dst_dir + "/" + util::SafeBasename(fname).result;
+
+	if ( *c != threading::Compression::None )
+		dst = dst + "." + threading::compression_extension(*c);
+
+	if ( ! rotation_pipeline )
+		{
+		auto threads = id::find_val("Log::archive_threads")->AsCount();
+		rotation_pipeline = new RotationPipeline(static_cast<int>(threads));
+		}
+
+	rotation_pipeline->Archive({NewRef{}, info}, std::move(fname), std::move(dst), *c, checksum);
+	return true;
+	}
+
 bool Manager::EnableRemoteLogs(EnumVal* stream_id)
 	{
 	auto stream = FindStream(stream_id);
@@ -10,6 +10,7 @@
 #include "zeek/Tag.h"
 #include "zeek/Val.h"
 #include "zeek/logging/Component.h"
+#include "zeek/logging/LogWire.h"
 #include "zeek/logging/WriterBackend.h"
 #include "zeek/plugin/ComponentManager.h"
 
@@ -31,6 +32,7 @@ namespace logging
 
 class WriterFrontend;
 class RotationFinishedMessage;
+class RotationPipeline;
 class RotationTimer;
 
 /**
@@ -197,6 +199,21 @@ public:
 	bool WriteFromRemote(EnumVal* stream, EnumVal* writer, const std::string& path, int num_fields,
 	                     threading::Value** vals);
 
+	/**
+	 * Like the other WriteFromRemote(), for a batch of entries in the
+	 * wire format. These get decoded right into the writer's batch.
+	 *
+	 * @param stream The enum value corresponding to the log stream.
+	 *
+	 * @param writer The enum value corresponding to the desired log writer.
+	 *
+	 * @param path The path of the target log stream to write to.
+	 *
+	 * @param entries The entries to write.
+	 */
+	bool WriteFromRemote(EnumVal* stream, EnumVal* writer, const std::string& path,
+	                     LogWireReader* entries);
+
 	/**
 	 * Announces all instantiated writers to a given Broker peer.
 	 */
@@ -225,6 +242,26 @@ public:
 	 */
 	bool Flush(EnumVal* id);
 
+	/**
+	 * Queues a rotated log for archiving on worker threads. The file
+	 * moves into a subdirectory of the archive directory named after the
+	 * day the log was opened, and Log::log_archived reports when it's
+	 * there.
+	 *
+	 * @param info The Log::RotationInfo of the rotation.
+	 *
+	 * @param dir The archive directory.
+	 *
+	 * @param compression The name of the compression to use.
+	 *
+	 * @param checksum True to compute the archived file's SHA-256.
+	 *
+	 * This methods corresponds directly to the internal BiF defined in
+	 * logging.bif, which just forwards here.
+	 */
+	bool ArchiveRotatedLog(RecordVal* info, const std::string& dir, const std::string& compression,
+	                       bool checksum);
+
 	/**
 	 * Signals the manager to shutdown at Zeek's termination.
 	 */
@@ -284,13 +321,32 @@ private:
 	struct Filter;
 	struct Stream;
 	struct WriterInfo;
+	struct SharedVals;
 
 	bool TraverseRecord(Stream* stream, Filter* filter, RecordType* rt, TableVal* include,
 	                    TableVal* exclude, const std::string& path, const std::list<int>& indices);
 
-	threading::Value** RecordToFilterVals(Stream* stream, Filter* filter, RecordVal* columns);
+	// Converts a record into the values of a filter's fields. If given
+	// a batch, fills in its entry and returns null, otherwise returns
+	// newly allocated values.
+	threading::Value** RecordToFilterVals(Stream* stream, Filter* filter, RecordVal* columns,
+	                                      LogBatch* batch = nullptr, int entry = 0);
+
+	// Like RecordToFilterVals(), for filters that log the same columns
+	// as others of their stream. The first of them to write a record
+	// converts it, and the rest copy those values.
+	threading::Value** SharedRecordToFilterVals(SharedVals* shared, Stream* stream,
+	                                            Filter* filter, RecordVal* columns,
+	                                            LogBatch* batch = nullptr, int entry = 0);
+
+	// Determines which of a stream's filters log the same columns.
+	void UpdateSharedColumns(Stream* stream);
 
 	threading::Value* ValToLogVal(Val* val, Type* ty = nullptr);
+
+	// Sets a log value from a script value, with any memory it needs
+	// coming from the batch, if given, or the heap.
+	void FillLogVal(threading::Value* lval, Val* val, Type* ty, LogBatch* batch);
 	Stream* FindStream(EnumVal* id);
 	void RemoveDisabledWriters(Stream* stream);
 	void InstallRotationTimer(WriterInfo* winfo);
@@ -305,6 +361,7 @@ private:
 	int rotations_pending; // Number of rotations not yet finished.
 	FuncPtr rotation_format_func;
 	FuncPtr log_stream_policy_hook;
+	RotationPipeline* rotation_pipeline = nullptr; // Owned by the iosource manager.
 	};
 
 	} // namespace logging;
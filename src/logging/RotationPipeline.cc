@@ -0,0 +1,369 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/logging/RotationPipeline.h"
+
+#include "zeek/zeek-config.h"
+
+#include <fcntl.h>
+#include <openssl/evp.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <memory>
+
+#include "zeek/Event.h"
+#include "zeek/EventRegistry.h"
+#include "zeek/ID.h"
+#include "zeek/Reporter.h"
+#include "zeek/Val.h"
+#include "zeek/iosource/Manager.h"
+#include "zeek/telemetry/Manager.h"
+#include "zeek/threading/Manager.h"
+#include "zeek/util.h"
+
+namespace zeek::logging
+	{
+
+namespace
+	{
+
+constexpr size_t CHUNK_SIZE = 1024 * 1024;
+
+std::string errno_string(const char* what, const std::string& file)
+	{
+	char buf[128];
+	util::zeek_strerror_r(errno, buf, sizeof(buf));
+	return std::string(what) + " " + file + ": " + buf;
+	}
+
+bool write_all(int fd, const char* data, size_t len)
+	{
+	while ( len > 0 )
+		{
+		ssize_t n = write(fd, data, len);
+
+		if ( n < 0 )
+			{
+			if ( errno == EINTR )
+				continue;
+
+			return false;
+			}
+
+		data += n;
+		len -= n;
+		}
+
+	return true;
+	}
+
+struct PipelineMetrics
+	{
+	static constexpr double latency_bounds[] = {0.1, 1.0, 10.0, 60.0, 300.0};
+
+	telemetry::IntCounter archived = telemetry_mgr->CounterInstance(
+		"zeek", "log-archive-files", {{"result", "success"}}, "Rotated logs archived", "1", true);
+	telemetry::IntCounter failed = telemetry_mgr->CounterInstance(
+		"zeek", "log-archive-files", {{"result", "failure"}}, "Rotated logs archived", "1", true);
+	telemetry::IntGauge backlog = telemetry_mgr->GaugeInstance(
+		"zeek", "log-archive-backlog", {}, "Rotated logs queued or being archived");
+	telemetry::DblHistogram latency = telemetry_mgr->HistogramInstance<double>(
+		"zeek", "log-archive-latency", {}, latency_bounds,
+		"Time from queueing rotated logs to having archived them", "seconds");
+	};
+
+PipelineMetrics* metrics()
+	{
+	static PipelineMetrics* m = telemetry_mgr ? new PipelineMetrics() : nullptr;
+	return m;
+	}
+
+	} // namespace
+
+RotationPipeline::RotationPipeline(int threads)
+	{
+	for ( int i = 0; i < std::max(threads, 1); ++i )
+		{
+		workers.emplace_back(&RotationPipeline::Work, this);
+		thread_mgr->ApplyAffinity(workers.back(), "log-archive", "log-archive");
+		}
+
+	iosource_mgr->Register(this, true);
+
+	if ( ! iosource_mgr->RegisterFd(flare.FD(), this) )
+		reporter->FatalError("Failed to register log archiving flare with iosource_mgr");
+	}
+
+RotationPipeline::~RotationPipeline()
+	{
+		{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+		}
+
+	work_cond.notify_all();
+
+	for ( auto& w : workers )
+		w.join();
+
+	for ( auto job : done )
+		delete job;
+	}
+
+void RotationPipeline::Archive(RecordValPtr info, std::string src, std::string dst,
+                               threading::Compression c, bool checksum)
+	{
+	auto job = new Job();
+	job->info = std::move(info);
+	job->src = std::move(src);
+	job->dst = std::move(dst);
+	job->compression = c;
+	job->checksum = checksum;
+	job->queued = util::current_time(true);
+
+		{
+		std::lock_guard<std::mutex> lock(mutex);
+		work.push_back(job);
+		}
+
+	work_cond.notify_one();
+
+	if ( auto m = metrics() )
+		m->backlog.Inc();
+
+	++backlog;
+	}
+
+void RotationPipeline::Work()
+	{
+	util::detail::set_thread_name("zk/log-archive");
+
+	for ( ;; )
+		{
+		Job* job;
+
+			{
+			std::unique_lock<std::mutex> lock(mutex);
+			work_cond.wait(lock, [this] { return stopping || ! work.empty(); });
+
+			// Finish the queued work even when stopping, so that no
+			// rotated file is left behind at termination.
+			if ( work.empty() )
+				return;
+
+			job = work.front();
+			work.pop_front();
+			}
+
+		Run(job);
+		job->finished = util::current_time(true);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		done.push_back(job);
+		flare.Fire();
+		}
+	}
+
+bool RotationPipeline::Run(Job* job)
+	{
+	bool moved = false;
+
+	if ( job->compression == threading::Compression::None )
+		{
+		if ( rename(job->src.c_str(), job->dst.c_str()) == 0 )
+			moved = true;
+
+		// Fall back to copying below if the archive is on another
+		// file system.
+		else if ( errno != EXDEV )
+			{
+			job->error = errno_string("cannot move", job->src);
+			return false;
+			}
+		}
+
+	if ( ! moved )
+		{
+		// Write to a temporary name first, so that whatever picks up
+		// files from the archive never sees a partial one.
+		auto tmp = job->dst + ".tmp";
+		int in = open(job->src.c_str(), O_RDONLY | O_CLOEXEC);
+
+		if ( in < 0 )
+			{
+			job->error = errno_string("cannot open", job->src);
+			return false;
+			}
+
+		int out = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+
+		if ( out < 0 )
+			{
+			job->error = errno_string("cannot create", tmp);
+			close(in);
+			return false;
+			}
+
+		std::unique_ptr<threading::BlockCompressor> compressor;
+
+		if ( job->compression != threading::Compression::None )
+			compressor = std::make_unique<threading::BlockCompressor>(out, job->compression, 0, 0);
+
+		std::string buf(CHUNK_SIZE, '\0');
+
+		for ( ;; )
+			{
+			ssize_t n = read(in, buf.data(), buf.size());
+
+			if ( n < 0 && errno == EINTR )
+				continue;
+
+			if ( n < 0 )
+				{
+				job->error = errno_string("cannot read", job->src);
+				break;
+				}
+
+			if ( n == 0 )
+				break;
+
+			bool ok = compressor ? compressor->Write(buf.data(), n)
+			                     : write_all(out, buf.data(), n);
+
+			if ( ! ok )
+				{
+				job->error = compressor ? compressor->Error() : errno_string("cannot write", tmp);
+				break;
+				}
+			}
+
+		if ( job->error.empty() && compressor && ! compressor->Close() )
+			job->error = compressor->Error();
+
+		close(in);
+
+		if ( close(out) < 0 && job->error.empty() )
+			job->error = errno_string("cannot write", tmp);
+
+		if ( job->error.empty() && rename(tmp.c_str(), job->dst.c_str()) < 0 )
+			job->error = errno_string("cannot move", tmp);
+
+		if ( ! job->error.empty() )
+			{
+			unlink(tmp.c_str());
+			return false;
+			}
+
+		unlink(job->src.c_str());
+		}
+
+	int fd = open(job->dst.c_str(), O_RDONLY | O_CLOEXEC);
+	struct stat st;
+
+	if ( fd < 0 || fstat(fd, &st) < 0 )
+		{
+		job->error = errno_string("cannot open", job->dst);
+
+		if ( fd >= 0 )
+			close(fd);
+
+		return false;
+		}
+
+	job->size = st.st_size;
+
+	if ( job->checksum )
+		{
+		EVP_MD_CTX* ctx = EVP_MD_CTX_new();
+		EVP_DigestInit_ex(ctx, EVP_sha256(), nullptr);
+
+		std::string buf(CHUNK_SIZE, '\0');
+		ssize_t n;
+
+		while ( (n = read(fd, buf.data(), buf.size())) != 0 )
+			{
+			if ( n < 0 && errno == EINTR )
+				continue;
+
+			if ( n < 0 )
+				{
+				job->error = errno_string("cannot read", job->dst);
+				break;
+				}
+
+			EVP_DigestUpdate(ctx, buf.data(), n);
+			}
+
+		unsigned char digest[EVP_MAX_MD_SIZE];
+		unsigned int len = 0;
+		EVP_DigestFinal_ex(ctx, digest, &len);
+		EVP_MD_CTX_free(ctx);
+
+		static constexpr char hex[] = "0123456789abcdef";
+
+		for ( unsigned int i = 0; i < len; ++i )
+			{
+			job->checksum_hex += hex[digest[i] >> 4];
+			job->checksum_hex += hex[digest[i] & 0x0f];
+			}
+		}
+
+	close(fd);
+	return job->error.empty();
+	}
+
+void RotationPipeline::Process()
+	{
+	std::deque<Job*> finished;
+
+		{
+		std::lock_guard<std::mutex> lock(mutex);
+		flare.Extinguish();
+		finished.swap(done);
+		}
+
+	static auto log_archived = event_registry->Register("Log::log_archived");
+	static auto archive_info_type = id::find_type<RecordType>("Log::ArchiveInfo");
+
+	for ( auto job : finished )
+		{
+		--backlog;
+		double latency = job->finished - job->queued;
+
+		if ( auto m = metrics() )
+			{
+			m->backlog.Dec();
+			m->latency.Observe(latency);
+
+			if ( job->error.empty() )
+				m->archived.Inc();
+			else
+				m->failed.Inc();
+			}
+
+		if ( log_archived )
+			{
+			auto ai = make_intrusive<RecordVal>(archive_info_type);
+
+			if ( job->error.empty() )
+				{
+				ai->Assign(0, job->dst);
+				ai->Assign(1, job->size);
+
+				if ( job->checksum )
+					ai->Assign(2, job->checksum_hex);
+				}
+			else
+				ai->Assign(4, job->error);
+
+			ai->AssignInterval(3, latency);
+			event_mgr.Enqueue(log_archived, std::move(job->info), std::move(ai));
+			}
+
+		delete job;
+		}
+	}
+
+	} // namespace zeek::logging
@@ -0,0 +1,114 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "zeek/Flare.h"
+#include "zeek/IntrusivePtr.h"
+#include "zeek/iosource/IOSource.h"
+#include "zeek/threading/Compression.h"
+
+namespace zeek
+	{
+
+class RecordVal;
+using RecordValPtr = IntrusivePtr<RecordVal>;
+
+namespace logging
+	{
+
+/**
+ * Archives rotated log files on a fixed number of worker threads, so that
+ * compressing and moving them doesn't hold up the main thread or need a
+ * process per file. For each file, a worker compresses it into the archive
+ * location (or just moves it there), optionally computes a SHA-256 of the
+ * result, and removes the original. The main thread then raises
+ * Log::log_archived for it.
+ *
+ * The pipeline registers itself with the iosource manager, which owns it.
+ */
+class RotationPipeline : public iosource::IOSource
+	{
+public:
+	/**
+	 * Constructor.
+	 *
+	 * @param threads The number of worker threads, at least one.
+	 */
+	explicit RotationPipeline(int threads);
+
+	/**
+	 * Destructor. Finishes all archiving that's still pending, without
+	 * raising events for it.
+	 */
+	~RotationPipeline() override;
+
+	/**
+	 * Queues a rotated file for archiving.
+	 *
+	 * @param info The Log::RotationInfo of the rotation, passed on to
+	 * Log::log_archived.
+	 *
+	 * @param src The rotated file.
+	 *
+	 * @param dst The file to archive it as. Its directory must exist.
+	 *
+	 * @param c The compression to use, which must be available.
+	 *
+	 * @param checksum True to compute the archived file's SHA-256.
+	 */
+	void Archive(RecordValPtr info, std::string src, std::string dst, threading::Compression c,
+	             bool checksum);
+
+	/**
+	 * Returns the number of files that are queued or being archived.
+	 */
+	size_t Backlog() const { return backlog; }
+
+	// IOSource interface.
+	double GetNextTimeout() override { return -1; }
+	void Process() override;
+	const char* Tag() override { return "Log::RotationPipeline"; }
+
+private:
+	struct Job
+		{
+		RecordValPtr info; // Only touched by the main thread.
+		std::string src;
+		std::string dst;
+		threading::Compression compression;
+		bool checksum;
+		double queued;
+
+		// Filled in by the worker.
+		std::string checksum_hex;
+		uint64_t size = 0;
+		std::string error;
+		double finished = 0;
+		};
+
+	void Work();
+
+	// Runs the job, returning false (with the error set) if that fails.
+	static bool Run(Job* job);
+
+	std::mutex mutex;
+	std::condition_variable work_cond;
+	std::deque<Job*> work;
+	std::deque<Job*> done;
+	std::vector<std::thread> workers;
+	zeek::detail::Flare flare;
+	bool stopping = false;
+
+	size_t backlog = 0; // Only touched by the main thread.
+	};
+
+	} // namespace logging
+	} // namespace zeek
@@ -3,6 +3,7 @@
 #include "zeek/logging/WriterBackend.h"
 
 #include <broker/data.hh>
+#include <vector>
 
 #include "zeek/logging/Manager.h"
 #include "zeek/logging/WriterFrontend.h"
@@ -272,6 +273,54 @@ bool WriterBackend::Write(int arg_num_fields, int num_writes, Value*** vals)
 	return success;
 	}
 
+bool WriterBackend::WriteBatch(LogBatch* batch)
+	{
+	// Double-check that the arguments match. If we get this from remote,
+	// something might be mixed up.
+	if ( num_fields != batch->NumFields() )
+		{
+
+#ifdef DEBUG
+		const char* msg = Fmt(
+			"Number of fields don't match in WriterBackend::WriteBatch() (%d vs. %d)",
+			batch->NumFields(), num_fields);
+		Debug(DBG_LOGGING, msg);
+#endif
+
+		delete batch;
+		DisableFrontend();
+		return false;
+		}
+
+	bool success = true;
+
+	if ( ! Failed() )
+		success = DoWriteBatch(num_fields, fields, *batch);
+
+	delete batch;
+
+	if ( ! success )
+		DisableFrontend();
+
+	return success;
+	}
+
+bool WriterBackend::DoWriteBatch(int num_fields, const Field* const* fields, LogBatch& batch)
+	{
+	std::vector<Value*> vals(num_fields);
+
+	for ( int j = 0; j < batch.Size(); ++j )
+		{
+		for ( int i = 0; i < num_fields; ++i )
+			vals[i] = batch.Get(j, i);
+
+		if ( ! DoWrite(num_fields, fields, vals.data()) )
+			return false;
+		}
+
+	return true;
+	}
+
 bool WriterBackend::SetBuf(bool enabled)
 	{
 	if ( enabled == buffering )
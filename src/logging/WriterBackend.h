@@ -5,6 +5,7 @@
 #pragma once
 
 #include "zeek/logging/Component.h"
+#include "zeek/logging/LogBatch.h"
 #include "zeek/threading/MsgThread.h"
 
 namespace broker
@@ -165,6 +166,20 @@ public:
 	 */
 	bool Write(int num_fields, int num_writes, threading::Value*** vals);
 
+	/**
+	 * Writes a batch of log entries.
+	 *
+	 * Returns false if an error occured, in which case the writer must
+	 * not be used any further.
+	 *
+	 * @param batch The entries, with their number of fields matching
+	 * what was passed to Init(), and their types matching the fields.
+	 * The method takes ownership of \a batch.
+	 *
+	 * @return False if an error occured.
+	 */
+	bool WriteBatch(LogBatch* batch);
+
 	/**
 	 * Sets the buffering status for the writer, assuming the writer
 	 * supports that. (If not, it will be ignored).
@@ -271,6 +286,9 @@ public:
 protected:
 	friend class FinishMessage;
 
+	const char* AffinityClass() const override { return "writer"; }
+	bool Poolable() const override { return true; }
+
 	/**
 	 * Writer-specific intialization method.
 	 *
@@ -296,6 +314,19 @@ protected:
 	virtual bool DoWrite(int num_fields, const threading::Field* const* fields,
 	                     threading::Value** vals) = 0;
 
+	/**
+	 * Writer-specific output method implementing recording of a batch
+	 * of log entries.
+	 *
+	 * Writers that can make use of the batch's column layout may
+	 * override this method. The default implementation passes each
+	 * entry to DoWrite() in turn. The batch's memory remains valid only
+	 * until the method returns. The return value has the same meaning
+	 * as for DoWrite().
+	 */
+	virtual bool DoWriteBatch(int num_fields, const threading::Field* const* fields,
+	                          LogBatch& batch);
+
 	/**
 	 * Writer-specific method implementing a change of fthe buffering
 	 * state.  If buffering is disabled, the writer should attempt to
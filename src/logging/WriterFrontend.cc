@@ -1,9 +1,21 @@
 #include "zeek/logging/WriterFrontend.h"
 
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+#include "zeek/Event.h"
+#include "zeek/EventRegistry.h"
 #include "zeek/RunState.h"
 #include "zeek/broker/Manager.h"
+#include "zeek/logging/LogWire.h"
 #include "zeek/logging/Manager.h"
 #include "zeek/logging/WriterBackend.h"
+#include "zeek/logging/logging.bif.h"
+#include "zeek/telemetry/Manager.h"
 #include "zeek/threading/SerialTypes.h"
 
 using zeek::threading::Field;
@@ -12,6 +24,56 @@ using zeek::threading::Value;
 namespace zeek::logging
 	{
 
+// What the frontend has sent to the backend and the backend hasn't
+// written yet. Shared between the two threads.
+struct WriterFrontend::Queue
+	{
+	std::atomic<uint64_t> batches{0};
+	std::atomic<uint64_t> bytes{0};
+
+	std::mutex mutex;
+	std::condition_variable released;
+
+	void Add(size_t n)
+		{
+		++batches;
+		bytes += n;
+		}
+
+	void Release(size_t n)
+		{
+			{
+			// Lock so that a waiting frontend doesn't miss this.
+			std::lock_guard<std::mutex> lock(mutex);
+			--batches;
+			bytes -= n;
+			}
+
+		released.notify_all();
+		}
+	};
+
+// A batch on its way to the backend. Whichever thread takes it, the
+// backend to write it or the frontend to drop it, releases it from the
+// queue.
+struct WriterFrontend::QueuedBatch
+	{
+	std::atomic<LogBatch*> batch;
+	size_t bytes;
+	};
+
+struct WriterFrontend::QueueMetrics
+	{
+	telemetry::IntGauge batches;
+	telemetry::IntGauge bytes;
+	telemetry::IntCounter dropped;
+	telemetry::IntCounter spilled;
+
+	// What the gauges currently say.
+	int64_t reported_batches = 0;
+	int64_t reported_bytes = 0;
+	};
+
 // Messages sent from frontend to backend (i.e., "InputMessages").
 
 class InitMessage final : public threading::InputMessage<WriterBackend>
@@ -53,21 +115,42 @@ private:
 	const bool terminating;
 	};
 
-class WriteMessage final : public threading::InputMessage<WriterBackend>
+class WriteBatchMessage final : public threading::InputMessage<WriterBackend>
 	{
 public:
-	WriteMessage(WriterBackend* backend, int num_fields, int num_writes, Value*** vals)
-		: threading::InputMessage<WriterBackend>("Write", backend), num_fields(num_fields),
-		  num_writes(num_writes), vals(vals)
+	WriteBatchMessage(WriterBackend* backend, std::shared_ptr<WriterFrontend::Queue> queue,
+	                  std::shared_ptr<WriterFrontend::QueuedBatch> batch)
+		: threading::InputMessage<WriterBackend>("WriteBatch", backend), queue(std::move(queue)),
+		  batch(std::move(batch))
+		{
+		}
+
+	~WriteBatchMessage() override
 		{
+		// Not processed, as the thread terminated.
+		if ( auto b = batch->batch.exchange(nullptr) )
+			{
+			delete b;
+			queue->Release(batch->bytes);
+			}
 		}
 
-	bool Process() override { return Object()->Write(num_fields, num_writes, vals); }
+	bool Process() override
+		{
+		auto b = batch->batch.exchange(nullptr);
+
+		// The frontend dropped it.
+		if ( ! b )
+			return true;
+
+		bool result = Object()->WriteBatch(b);
+		queue->Release(batch->bytes);
+		return result;
+		}
 
 private:
-	int num_fields;
-	int num_writes;
-	Value*** vals;
+	std::shared_ptr<WriterFrontend::Queue> queue;
+	std::shared_ptr<WriterFrontend::QueuedBatch> batch;
 	};
 
 class SetBufMessage final : public threading::InputMessage<WriterBackend>
@@ -112,16 +195,47 @@ WriterFrontend::WriterFrontend(const WriterBackend::WriterInfo& arg_info, EnumVa
 	buf = true;
 	local = arg_local;
 	remote = arg_remote;
-	write_buffer = nullptr;
-	write_buffer_pos = 0;
+	write_batch = nullptr;
+	batch_capacity = MIN_WRITER_BUFFER_SIZE;
 	info = new WriterBackend::WriterInfo(arg_info);
 
 	num_fields = 0;
 	fields = nullptr;
 
+	static auto max_bytes = id::find_val("Log::writer_queue_max_bytes")->AsCount();
+	static auto max_batches = id::find_val("Log::writer_queue_max_batches")->AsCount();
+	static auto policy = id::find_val("Log::writer_backpressure_policy")->AsEnum();
+
+	queue = std::make_shared<Queue>();
+	max_queue_bytes = max_bytes;
+	max_queue_batches = max_batches;
+	backpressure_policy = policy;
+	backpressured = false;
+	spill_file = nullptr;
+	spill_read = spill_write = 0;
+
 	const char* w = arg_writer->GetType()->AsEnumType()->Lookup(arg_writer->InternalInt());
 	name = util::copy_string(util::fmt("%s/%s", arg_info.path, w));
 
+	if ( local && telemetry_mgr )
+		{
+		queue_metrics.reset(new QueueMetrics{
+			telemetry_mgr->GaugeInstance("zeek", "log-writer-queue-batches", {{"writer", name}},
+		                                 "Log batches queued for a writer"),
+			telemetry_mgr->GaugeInstance("zeek", "log-writer-queue-bytes", {{"writer", name}},
+		                                 "Memory of the log batches queued for a writer",
+		                                 "bytes"),
+			telemetry_mgr->CounterInstance("zeek", "log-writer-dropped-entries",
+		                                   {{"writer", name}},
+		                                   "Log entries dropped as a writer's queue was full",
+		                                   "1", true),
+			telemetry_mgr->CounterInstance("zeek", "log-writer-spilled-entries",
+		                                   {{"writer", name}},
+		                                   "Log entries spilled to disk as a writer's queue "
+		                                   "was full",
+		                                   "1", true)});
+		}
+
 	if ( local )
 		{
 		backend = log_mgr->CreateBackend(this, writer);
@@ -136,6 +250,17 @@ WriterFrontend::WriterFrontend(const WriterBackend::WriterInfo& arg_info, EnumVa
 
 WriterFrontend::~WriterFrontend()
 	{
+	delete write_batch;
+
+	if ( spill_file )
+		fclose(spill_file);
+
+	if ( queue_metrics )
+		{
+		queue_metrics->batches.Dec(queue_metrics->reported_batches);
+		queue_metrics->bytes.Dec(queue_metrics->reported_bytes);
+		}
+
 	for ( auto i = 0; i < num_fields; ++i )
 		delete fields[i];
 
@@ -150,6 +275,10 @@ WriterFrontend::~WriterFrontend()
 void WriterFrontend::Stop()
 	{
 	FlushWriteBuffer();
+
+	if ( backend && ! disabled )
+		Unspill(true);
+
 	SetDisable();
 
 	if ( backend )
@@ -215,32 +344,299 @@ void WriterFrontend::Write(int arg_num_fields, Value** vals)
 		return;
 		}
 
-	if ( ! write_buffer )
+	for ( int i = 0; i < num_fields; ++i )
 		{
-		// Need new buffer.
-		write_buffer = new Value**[WRITER_BUFFER_SIZE];
-		write_buffer_pos = 0;
+		if ( vals[i]->type != fields[i]->type )
+			{
+			reporter->Warning("WriterFrontend %s got type %s for field %s. Skipping line.", name,
+			                  type_name(vals[i]->type), fields[i]->name);
+			DeleteVals(arg_num_fields, vals);
+			return;
+			}
 		}
 
-	write_buffer[write_buffer_pos++] = vals;
+	auto batch = BatchForWrite();
+	auto entry = batch->AddEntry();
+
+	for ( int i = 0; i < num_fields; ++i )
+		batch->CopyValue(batch->Get(entry, i), *vals[i]);
 
-	if ( write_buffer_pos >= WRITER_BUFFER_SIZE || ! buf || run_state::terminating )
+	DeleteVals(arg_num_fields, vals);
+	FinishWrite();
+	}
+
+LogBatch* WriterFrontend::BatchForWrite()
+	{
+	if ( ! write_batch )
+		write_batch = new LogBatch(num_fields, buf ? batch_capacity : 1);
+
+	return write_batch;
+	}
+
+void WriterFrontend::FinishWrite()
+	{
+	if ( write_batch->Full() || ! buf || run_state::terminating )
 		// Buffer full (or no bufferin desired or termiating).
 		FlushWriteBuffer();
 	}
 
 void WriterFrontend::FlushWriteBuffer()
 	{
-	if ( ! write_buffer_pos )
+	// This runs at every heartbeat of the backend, which gives spilled
+	// entries a chance to go out even when there are no new ones.
+	if ( spill_read < spill_write )
+		Unspill(false);
+
+	UpdateQueueMetrics();
+
+	if ( ! write_batch )
 		// Nothing to do.
 		return;
 
+	// Size the next batch by what this one needed, so that streams
+	// seeing few writes between flushes don't carry full-size buffers.
+	if ( write_batch->Capacity() == batch_capacity )
+		{
+		if ( write_batch->Full() )
+			batch_capacity = std::min(2 * batch_capacity, int(WRITER_BUFFER_SIZE));
+		else if ( write_batch->Size() < batch_capacity / 4 )
+			batch_capacity = std::max(batch_capacity / 2, int(MIN_WRITER_BUFFER_SIZE));
+		}
+
 	if ( backend )
-		backend->SendIn(new WriteMessage(backend, num_fields, write_buffer_pos, write_buffer));
+		SendBatch(write_batch);
+	else
+		delete write_batch;
+
+	write_batch = nullptr;
+	}
+
+void WriterFrontend::SendBatch(LogBatch* batch)
+	{
+	bool full = QueueFull();
+
+	if ( full )
+		Backpressure();
+	else
+		backpressured = false;
+
+	// Spilled entries go out first, so later ones have to queue up
+	// behind them.
+	if ( spill_read < spill_write ||
+	     (full && backpressure_policy == BifEnum::Log::BACKPRESSURE_SPILL) )
+		{
+		Spill(batch);
+		return;
+		}
+
+	if ( full )
+		{
+		switch ( backpressure_policy )
+			{
+			case BifEnum::Log::BACKPRESSURE_BLOCK:
+				WaitForQueue();
+				break;
+
+			case BifEnum::Log::BACKPRESSURE_DROP_OLDEST:
+				DropOldest();
+				break;
+
+			default:
+				if ( queue_metrics )
+					queue_metrics->dropped.Inc(batch->Size());
+
+				delete batch;
+				return;
+			}
+		}
+
+	EnqueueBatch(batch);
+	}
+
+void WriterFrontend::EnqueueBatch(LogBatch* batch)
+	{
+	auto qb = std::make_shared<QueuedBatch>();
+	qb->batch = batch;
+	qb->bytes = batch->Bytes();
+	queue->Add(qb->bytes);
+
+	if ( backpressure_policy == BifEnum::Log::BACKPRESSURE_DROP_OLDEST &&
+	     (max_queue_bytes || max_queue_batches) )
+		{
+		// The backend takes batches in order, so the ones it has
+		// started on are at the front.
+		while ( ! queued.empty() && ! queued.front()->batch )
+			queued.pop_front();
+
+		queued.push_back(qb);
+		}
+
+	// Passes ownership to child thread.
+	backend->SendIn(new WriteBatchMessage(backend, queue, std::move(qb)));
+	UpdateQueueMetrics();
+	}
+
+bool WriterFrontend::QueueFull() const
+	{
+	return (max_queue_batches && queue->batches >= max_queue_batches) ||
+	       (max_queue_bytes && queue->bytes >= max_queue_bytes);
+	}
+
+void WriterFrontend::WaitForQueue()
+	{
+	std::unique_lock<std::mutex> lock(queue->mutex);
+
+	// Check back now and then in case the backend went away.
+	while ( QueueFull() && ! backend->Killed() )
+		queue->released.wait_for(lock, std::chrono::milliseconds(100));
+	}
+
+void WriterFrontend::DropOldest()
+	{
+	while ( QueueFull() && ! queued.empty() )
+		{
+		auto qb = std::move(queued.front());
+		queued.pop_front();
+
+		auto b = qb->batch.exchange(nullptr);
+
+		// The backend has started on it.
+		if ( ! b )
+			continue;
+
+		if ( queue_metrics )
+			queue_metrics->dropped.Inc(b->Size());
+
+		delete b;
+		queue->Release(qb->bytes);
+		}
+	}
+
+void WriterFrontend::Spill(LogBatch* batch)
+	{
+	if ( ! spill_file && ! (spill_file = tmpfile()) )
+		{
+		reporter->Error("cannot create spill file for writer %s, dropping log entries", name);
+		delete batch;
+		return;
+		}
+
+	LogWireWriter w;
+	std::vector<const Value*> vals(num_fields);
+
+	for ( int i = 0; i < batch->Size(); ++i )
+		{
+		for ( int j = 0; j < num_fields; ++j )
+			vals[j] = batch->Get(i, j);
+
+		w.AddEntry(num_fields, vals.data());
+		}
 
-	// Clear buffer (no delete, we pass ownership to child thread.)
-	write_buffer = nullptr;
-	write_buffer_pos = 0;
+	auto data = w.Finish();
+	uint32_t len = data.size();
+	int fd = fileno(spill_file);
+
+	auto written = pwrite(fd, &len, sizeof(len), spill_write) == sizeof(len)
+	                   ? pwrite(fd, data.data(), len, spill_write + sizeof(len))
+	                   : -1;
+
+	if ( written != static_cast<ssize_t>(len) )
+		{
+		reporter->Error("cannot write spill file for writer %s, dropping log entries", name);
+		delete batch;
+		return;
+		}
+
+	spill_write += sizeof(len) + len;
+
+	if ( queue_metrics )
+		queue_metrics->spilled.Inc(batch->Size());
+
+	delete batch;
+	}
+
+void WriterFrontend::Unspill(bool all)
+	{
+	if ( ! spill_file )
+		return;
+
+	int fd = fileno(spill_file);
+
+	while ( spill_read < spill_write && (all || ! QueueFull()) )
+		{
+		uint32_t len;
+		std::string data;
+
+		if ( pread(fd, &len, sizeof(len), spill_read) == sizeof(len) )
+			{
+			data.resize(len);
+
+			auto n = pread(fd, data.data(), len, spill_read + sizeof(len));
+
+			if ( n != static_cast<ssize_t>(len) )
+				data.clear();
+			}
+
+		LogWireReader r(data);
+
+		if ( ! r.Valid() || r.NumFields() != num_fields )
+			{
+			reporter->Error("cannot read spill file for writer %s, dropping log entries", name);
+			spill_read = spill_write;
+			break;
+			}
+
+		spill_read += sizeof(len) + len;
+
+		if ( ! r.Entries() )
+			continue;
+
+		auto batch = new LogBatch(num_fields, r.Entries());
+
+		for ( int i = 0; i < r.Entries(); ++i )
+			r.ReadEntry(fields, batch, batch->AddEntry());
+
+		EnqueueBatch(batch);
+		}
+
+	if ( spill_read == spill_write )
+		{
+		// Start over rather than letting the file grow.
+		if ( ftruncate(fd, 0) < 0 )
+			reporter->Warning("cannot truncate spill file for writer %s", name);
+
+		spill_read = spill_write = 0;
+		}
+	}
+
+void WriterFrontend::Backpressure()
+	{
+	if ( backpressured )
+		return;
+
+	backpressured = true;
+
+	static auto writer_backpressure = event_registry->Register("Log::writer_backpressure");
+
+	if ( writer_backpressure )
+		event_mgr.Enqueue(
+			writer_backpressure, make_intrusive<StringVal>(info->path), IntrusivePtr{NewRef{}, writer},
+			BifType::Enum::Log::BackpressurePolicy->GetEnumVal(backpressure_policy),
+			val_mgr->Count(queue->batches), val_mgr->Count(queue->bytes));
+	}
+
+void WriterFrontend::UpdateQueueMetrics()
+	{
+	if ( ! queue_metrics )
+		return;
+
+	int64_t batches = queue->batches;
+	int64_t bytes = queue->bytes;
+
+	queue_metrics->batches.Inc(batches - queue_metrics->reported_batches);
+	queue_metrics->bytes.Inc(bytes - queue_metrics->reported_bytes);
+	queue_metrics->reported_batches = batches;
+	queue_metrics->reported_bytes = bytes;
 	}
 
 void WriterFrontend::SetBuf(bool enabled)
@@ -276,6 +672,10 @@ void WriterFrontend::Rotate(const char* rotated_path, double open, double close,
 
 	FlushWriteBuffer();
 
+	// The rotated file must have all the spilled entries.
+	if ( backend && spill_read < spill_write )
+		Unspill(true);
+
 	if ( backend )
 		backend->SendIn(new RotateMessage(backend, this, rotated_path, open, close, terminating));
 	else
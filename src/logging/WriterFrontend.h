@@ -2,6 +2,11 @@
 
 #pragma once
 
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+
 #include "zeek/logging/WriterBackend.h"
 
 namespace zeek::logging
@@ -95,6 +100,30 @@ public:
 	 */
 	void Write(int num_fields, threading::Value** vals);
 
+	/**
+	 * Returns true if the manager can fill in log entries directly
+	 * with BatchForWrite() and FinishWrite(), rather than through
+	 * Write().
+	 */
+	bool WritesBatches() const { return backend && ! disabled && ! remote; }
+
+	/**
+	 * Returns the batch that the next log entry goes into, which has
+	 * room for at least one more. Once the caller has added the entry,
+	 * it must call FinishWrite().
+	 *
+	 * This method must only be called from the main thread.
+	 */
+	LogBatch* BatchForWrite();
+
+	/**
+	 * Completes a write started with BatchForWrite(), passing the
+	 * batch on to the backend if it's full or buffering is disabled.
+	 *
+	 * This method must only be called from the main thread.
+	 */
+	void FinishWrite();
+
 	/**
 	 * Sets the buffering state.
 	 *
@@ -187,9 +216,44 @@ public:
 
 protected:
 	friend class Manager;
+	friend class WriteBatchMessage;
+
+	struct Queue;
+	struct QueuedBatch;
+	struct QueueMetrics;
 
 	void DeleteVals(int num_fields, threading::Value** vals);
 
+	// Passes a batch on to the backend, unless its queue is at the
+	// limits, in which case the backpressure policy decides.
+	void SendBatch(LogBatch* batch);
+
+	// Passes a batch on to the backend regardless of the limits.
+	void EnqueueBatch(LogBatch* batch);
+
+	// Returns true if the backend's queue is at one of its limits.
+	bool QueueFull() const;
+
+	// Waits for the backend to get its queue below the limits.
+	void WaitForQueue();
+
+	// Takes batches out of the backend's queue that it hasn't started
+	// on, oldest first, until the queue is below the limits.
+	void DropOldest();
+
+	// Appends a batch to the spill file.
+	void Spill(LogBatch* batch);
+
+	// Passes spilled entries on to the backend, as many as the limits
+	// allow or all of them.
+	void Unspill(bool all);
+
+	// Raises Log::writer_backpressure, if it didn't already since the
+	// queue was last below the limits.
+	void Backpressure();
+
+	void UpdateQueueMetrics();
+
 	EnumVal* stream;
 	EnumVal* writer;
 
@@ -205,10 +269,32 @@ protected:
 	int num_fields; // The number of log fields.
 	const threading::Field* const* fields; // The log fields.
 
-	// Buffer for bulk writes.
+	// Buffer for bulk writes. Its capacity adapts to how many writes
+	// happen between flushes, up to WRITER_BUFFER_SIZE.
 	static const int WRITER_BUFFER_SIZE = 1000;
-	int write_buffer_pos; // Position of next write in buffer.
-	threading::Value*** write_buffer; // Buffer of size WRITER_BUFFER_SIZE.
+	static const int MIN_WRITER_BUFFER_SIZE = 16;
+	LogBatch* write_batch; // Entries not yet sent to the backend.
+	int batch_capacity; // Capacity for the next batch.
+
+	// The batches sent to the backend that it hasn't written yet, and
+	// those it may not have started on, for dropping the oldest.
+	std::shared_ptr<Queue> queue;
+	std::deque<std::shared_ptr<QueuedBatch>> queued;
+	std::unique_ptr<QueueMetrics> queue_metrics;
+
+	// Limits for the queue, with zero for none, and what to do when
+	// it's at them.
+	uint64_t max_queue_bytes;
+	uint64_t max_queue_batches;
+	int backpressure_policy;
+	bool backpressured; // True if the queue hit its limits.
+
+	// Entries waiting to go to the backend, encoded as by LogWireWriter,
+	// each batch with its length in front. Reading starts at spill_read,
+	// and writing at spill_write.
+	FILE* spill_file;
+	uint64_t spill_read;
+	uint64_t spill_write;
 	};
 
 	} // namespace zeek::logging
@@ -226,6 +226,9 @@ Ascii::Ascii(WriterFrontend* frontend) : WriterBackend(frontend)
 	formatter = nullptr;
 	gzip_level = 0;
 	gzfile = nullptr;
+	compression = threading::Compression::None;
+	compression_level = 0;
+	compression_threads = 0;
 
 	InitConfigOptions();
 	init_options = InitFilterOptions();
@@ -263,6 +266,10 @@ void Ascii::InitConfigOptions()
 	gzip_file_extension.assign((const char*)BifConst::LogAscii::gzip_file_extension->Bytes(),
 	                           BifConst::LogAscii::gzip_file_extension->Len());
 
+	compression_name = BifConst::LogAscii::compression->ToStdString();
+	compression_level = BifConst::LogAscii::compression_level;
+	compression_threads = BifConst::LogAscii::compression_threads;
+
 	// Remove in v6.1: LogAscii::logdir should be gone in favor
 	// of using Log::default_logdir.
 	logdir.assign((const char*)BifConst::LogAscii::logdir->Bytes(),
@@ -379,6 +386,23 @@ bool Ascii::InitFilterOptions()
 		else if ( strcmp(i->first, "gzip_file_extension") == 0 )
 			gzip_file_extension.assign(i->second);
 
+		else if ( strcmp(i->first, "compression") == 0 )
+			compression_name.assign(i->second);
+
+		else if ( strcmp(i->first, "compression_level") == 0 )
+			compression_level = atoi(i->second);
+
+		else if ( strcmp(i->first, "compression_threads") == 0 )
+			{
+			compression_threads = atoi(i->second);
+
+			if ( compression_threads < 0 )
+				{
+				Error("invalid value for 'compression_threads', must not be negative");
+				return false;
+				}
+			}
+
 		else if ( strcmp(i->first, "logdir") == 0 )
 			{
 			// This doesn't play nice with leftover log rotation
@@ -389,12 +413,64 @@ bool Ascii::InitFilterOptions()
 			}
 		}
 
+	if ( ! InitCompression() )
+		return false;
+
 	if ( ! InitFormatter() )
 		return false;
 
 	return true;
 	}
 
+bool Ascii::InitCompression()
+	{
+	auto c = threading::compression_from_name(compression_name);
+
+	if ( ! c )
+		{
+		Error(Fmt("invalid value for 'compression': %s", compression_name.c_str()));
+		return false;
+		}
+
+	if ( ! threading::compression_available(*c) )
+		{
+		Error(Fmt("compression '%s' is not available in this build", compression_name.c_str()));
+		return false;
+		}
+
+	compression = *c;
+
+	// gzip_level predates the other compression options.
+	if ( compression == threading::Compression::None && gzip_level > 0 )
+		compression = threading::Compression::Gzip;
+
+	if ( compression == threading::Compression::Gzip )
+		{
+		if ( compression_level > 0 )
+			gzip_level = compression_level;
+
+		else if ( gzip_level == 0 )
+			gzip_level = Z_DEFAULT_COMPRESSION;
+		}
+
+	return true;
+	}
+
+std::string Ascii::CompressionExt() const
+	{
+	switch ( compression )
+		{
+		case threading::Compression::None:
+			return "";
+
+		case threading::Compression::Gzip:
+			return "." + (gzip_file_extension.empty() ? "gz" : gzip_file_extension);
+
+		default:
+			return std::string(".") + threading::compression_extension(compression);
+		}
+	}
+
 bool Ascii::InitFormatter()
 	{
 	delete formatter;
@@ -484,13 +560,7 @@ bool Ascii::DoInit(const WriterInfo& info, int num_fields, const threading::Fiel
 
 	if ( ! IsSpecial(fname) )
 		{
-		std::string ext = "." + LogExt();
-
-		if ( gzip_level > 0 )
-			{
-			ext += ".";
-			ext += gzip_file_extension.empty() ? "gz" : gzip_file_extension;
-			}
+		std::string ext = "." + LogExt() + CompressionExt();
 
 		if ( fname.front() != '/' && ! logdir.empty() )
 			fname = zeek::filesystem::path(logdir) / fname;
@@ -545,16 +615,20 @@ bool Ascii::DoInit(const WriterInfo& info, int num_fields, const threading::Fiel
 		return false;
 		}
 
-	if ( gzip_level > 0 )
+	if ( compression == threading::Compression::Gzip && compression_threads == 0 )
 		{
-		if ( gzip_level < 0 || gzip_level > 9 )
+		if ( gzip_level != Z_DEFAULT_COMPRESSION && (gzip_level < 1 || gzip_level > 9) )
 			{
 			Error("invalid value for 'gzip_level', must be a number between 0 and 9.");
 			return false;
 			}
 
 		char mode[4];
-		snprintf(mode, sizeof(mode), "wb%d", gzip_level);
+
+		if ( gzip_level == Z_DEFAULT_COMPRESSION )
+			snprintf(mode, sizeof(mode), "wb");
+		else
+			snprintf(mode, sizeof(mode), "wb%d", gzip_level);
 		errno = 0; // errno will only be set under certain circumstances by gzdopen.
 		gzfile = gzdopen(fd, mode);
 
@@ -567,6 +641,14 @@ bool Ascii::DoInit(const WriterInfo& info, int num_fields, const threading::Fiel
 	else
 		{
 		gzfile = nullptr;
+
+		if ( compression != threading::Compression::None )
+			{
+			auto level = compression == threading::Compression::Gzip ? gzip_level
+			                                                          : compression_level;
+			compressor = std::make_unique<threading::BlockCompressor>(fd, compression, level,
+			                                                          compression_threads);
+			}
 		}
 
 	if ( ! WriteHeader(path) )
@@ -629,6 +711,12 @@ bool Ascii::WriteHeader(const string& path)
 
 bool Ascii::DoFlush(double network_time)
 	{
+	if ( compressor && ! compressor->Flush() )
+		{
+		Error(Fmt("error writing to %s: %s", fname.c_str(), compressor->Error().c_str()));
+		return false;
+		}
+
 	fsync(fd);
 	return true;
 	}
@@ -702,13 +790,7 @@ bool Ascii::DoRotate(const char* rotated_path, double open, double close, bool t
 
 	CloseFile(close);
 
-	string nname = string(rotated_path) + "." + LogExt();
-
-	if ( gzip_level > 0 )
-		{
-		nname += ".";
-		nname += gzip_file_extension.empty() ? "gz" : gzip_file_extension;
-		}
+	string nname = string(rotated_path) + "." + LogExt() + CompressionExt();
 
 	if ( rename(fname.c_str(), nname.c_str()) != 0 )
 		{
@@ -930,6 +1012,15 @@ string Ascii::Timestamp(double t)
 
 bool Ascii::InternalWrite(int fd, const char* data, int len)
 	{
+	if ( compressor )
+		{
+		if ( compressor->Write(data, len) )
+			return true;
+
+		Error(Fmt("Ascii::InternalWrite error: %s\n", compressor->Error().c_str()));
+		return false;
+		}
+
 	if ( ! gzfile )
 		return util::safe_write(fd, data, len);
 
@@ -953,6 +1044,18 @@ bool Ascii::InternalWrite(int fd, const char* data, int len)
 
 bool Ascii::InternalClose(int fd)
 	{
+	if ( compressor )
+		{
+		bool ok = compressor->Close();
+
+		if ( ! ok )
+			Error(Fmt("Ascii::InternalClose error: %s\n", compressor->Error().c_str()));
+
+		compressor.reset();
+		util::safe_close(fd);
+		return ok;
+		}
+
 	if ( ! gzfile )
 		{
 		util::safe_close(fd);
@@ -8,6 +8,7 @@
 
 #include "zeek/Desc.h"
 #include "zeek/logging/WriterBackend.h"
+#include "zeek/threading/Compression.h"
 #include "zeek/threading/formatters/Ascii.h"
 #include "zeek/threading/formatters/JSON.h"
 
@@ -53,11 +54,14 @@ private:
 	void InitConfigOptions();
 	bool InitFilterOptions();
 	bool InitFormatter();
+	bool InitCompression();
+	std::string CompressionExt() const;
 	bool InternalWrite(int fd, const char* data, int len);
 	bool InternalClose(int fd);
 
 	int fd;
 	gzFile gzfile;
+	std::unique_ptr<threading::BlockCompressor> compressor;
 	std::string fname;
 	ODesc desc;
 	bool ascii_done;
@@ -75,6 +79,10 @@ private:
 
 	int gzip_level; // level > 0 enables gzip compression
 	std::string gzip_file_extension;
+	std::string compression_name;
+	threading::Compression compression;
+	int compression_level;
+	int compression_threads;
 	bool use_json;
 	bool enable_utf_8;
 	std::string json_timestamps;
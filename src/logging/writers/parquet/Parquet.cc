@@ -0,0 +1,424 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/logging/writers/parquet/Parquet.h"
+
+#include "zeek/zeek-config.h"
+
+#include <arrow/util/compression.h>
+#include <parquet/properties.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "zeek/ID.h"
+#include "zeek/Val.h"
+#include "zeek/logging/writers/parquet/parquet.bif.h"
+#include "zeek/threading/Formatter.h"
+#include "zeek/threading/SerialTypes.h"
+#include "zeek/util.h"
+
+using zeek::threading::Field;
+using zeek::threading::Value;
+
+namespace zeek::logging::writer::detail
+	{
+
+// Returns the Arrow type for values of a log field, or null if there's
+// none.
+static std::shared_ptr<arrow::DataType> arrow_type(TypeTag type, TypeTag subtype)
+	{
+	switch ( type )
+		{
+		case TYPE_BOOL:
+			return arrow::boolean();
+
+		case TYPE_INT:
+			return arrow::int64();
+
+		case TYPE_COUNT:
+			return arrow::uint64();
+
+		case TYPE_PORT:
+			return arrow::uint16();
+
+		case TYPE_DOUBLE:
+		case TYPE_INTERVAL:
+			return arrow::float64();
+
+		case TYPE_TIME:
+			return arrow::timestamp(arrow::TimeUnit::MICRO, "UTC");
+
+		case TYPE_ENUM:
+		case TYPE_STRING:
+		case TYPE_FILE:
+		case TYPE_FUNC:
+		case TYPE_PATTERN:
+		case TYPE_ADDR:
+		case TYPE_SUBNET:
+			return arrow::utf8();
+
+		case TYPE_TABLE:
+		case TYPE_VECTOR:
+			{
+			auto elem = arrow_type(subtype, TYPE_ERROR);
+			return elem ? arrow::list(elem) : nullptr;
+			}
+
+		default:
+			return nullptr;
+		}
+	}
+
+// Adds a log value to the builder for its column. The builder's type must
+// come from arrow_type() for the value's type.
+static arrow::Status append_value(arrow::ArrayBuilder* b, TypeTag type, TypeTag subtype,
+                                  const Value* v)
+	{
+	if ( ! v->present )
+		return b->AppendNull();
+
+	switch ( type )
+		{
+		case TYPE_BOOL:
+			return static_cast<arrow::BooleanBuilder*>(b)->Append(v->val.int_val != 0);
+
+		case TYPE_INT:
+			return static_cast<arrow::Int64Builder*>(b)->Append(v->val.int_val);
+
+		case TYPE_COUNT:
+			return static_cast<arrow::UInt64Builder*>(b)->Append(v->val.uint_val);
+
+		case TYPE_PORT:
+			return static_cast<arrow::UInt16Builder*>(b)->Append(v->val.port_val.port);
+
+		case TYPE_DOUBLE:
+		case TYPE_INTERVAL:
+			return static_cast<arrow::DoubleBuilder*>(b)->Append(v->val.double_val);
+
+		case TYPE_TIME:
+			return static_cast<arrow::TimestampBuilder*>(b)->Append(
+				static_cast<int64_t>(v->val.double_val * 1e6));
+
+		case TYPE_ENUM:
+		case TYPE_STRING:
+		case TYPE_FILE:
+		case TYPE_FUNC:
+			return static_cast<arrow::StringBuilder*>(b)->Append(v->val.string_val.data,
+			                                                     v->val.string_val.length);
+
+		case TYPE_PATTERN:
+			return static_cast<arrow::StringBuilder*>(b)->Append(v->val.pattern_text_val);
+
+		case TYPE_ADDR:
+			return static_cast<arrow::StringBuilder*>(b)->Append(
+				threading::Formatter::Render(v->val.addr_val));
+
+		case TYPE_SUBNET:
+			return static_cast<arrow::StringBuilder*>(b)->Append(
+				threading::Formatter::Render(v->val.subnet_val));
+
+		case TYPE_TABLE:
+		case TYPE_VECTOR:
+			{
+			// Sets and vectors have the same layout.
+			auto lb = static_cast<arrow::ListBuilder*>(b);
+			ARROW_RETURN_NOT_OK(lb->Append());
+
+			for ( zeek_int_t i = 0; i < v->val.set_val.size; ++i )
+				ARROW_RETURN_NOT_OK(
+					append_value(lb->value_builder(), subtype, TYPE_ERROR, v->val.set_val.vals[i]));
+
+			return arrow::Status::OK();
+			}
+
+		default:
+			return arrow::Status::NotImplemented("unsupported field type ", type_name(type));
+		}
+	}
+
+Parquet::Parquet(WriterFrontend* frontend) : WriterBackend(frontend)
+	{
+	row_group_size = BifConst::LogParquet::row_group_size;
+	compression = BifConst::LogParquet::compression->ToStdString();
+	compression_level = BifConst::LogParquet::compression_level;
+	enable_dictionary = BifConst::LogParquet::enable_dictionary;
+	logdir = zeek::id::find_const<StringVal>("Log::default_logdir")->ToStdString();
+
+	init_options = InitFilterOptions();
+	}
+
+Parquet::~Parquet()
+	{
+	// DoFinish() may not have been called.
+	if ( writer )
+		CloseFile();
+	}
+
+bool Parquet::InitFilterOptions()
+	{
+	const WriterInfo& info = Info();
+
+	// Set per-filter configuration options.
+	for ( WriterInfo::config_map::const_iterator i = info.config.begin(); i != info.config.end();
+	      ++i )
+		{
+		if ( strcmp(i->first, "row_group_size") == 0 )
+			{
+			row_group_size = atoll(i->second);
+
+			if ( row_group_size <= 0 )
+				{
+				Error("invalid value for 'row_group_size', must be a positive number");
+				return false;
+				}
+			}
+
+		else if ( strcmp(i->first, "compression") == 0 )
+			compression.assign(i->second);
+
+		else if ( strcmp(i->first, "compression_level") == 0 )
+			compression_level = atoi(i->second);
+
+		else if ( strcmp(i->first, "enable_dictionary") == 0 )
+			{
+			if ( strcmp(i->second, "T") == 0 )
+				enable_dictionary = true;
+			else if ( strcmp(i->second, "F") == 0 )
+				enable_dictionary = false;
+			else
+				{
+				Error("invalid value for 'enable_dictionary', must be a string and either \"T\" "
+				      "or \"F\"");
+				return false;
+				}
+			}
+		}
+
+	if ( row_group_size <= 0 )
+		{
+		Error("LogParquet::row_group_size must be positive");
+		return false;
+		}
+
+	return true;
+	}
+
+bool Parquet::CheckStatus(const arrow::Status& status, const char* what)
+	{
+	if ( status.ok() )
+		return true;
+
+	Error(Fmt("%s %s: %s", what, fname.c_str(), status.ToString().c_str()));
+	return false;
+	}
+
+bool Parquet::DoInit(const WriterInfo& info, int num_fields, const Field* const* fields)
+	{
+	if ( ! init_options )
+		return false;
+
+	arrow::FieldVector afields;
+
+	for ( int i = 0; i < num_fields; ++i )
+		{
+		auto t = arrow_type(fields[i]->type, fields[i]->subtype);
+
+		if ( ! t )
+			{
+			Error(Fmt("unsupported type %s for field %s", type_name(fields[i]->type),
+			          fields[i]->name));
+			return false;
+			}
+
+		// Even fields that aren't &optional can come out unset, for
+		// example when an extension function fails.
+		afields.push_back(arrow::field(fields[i]->name, t, true));
+		}
+
+	schema = arrow::schema(afields);
+
+	fname = info.path;
+
+	if ( fname.front() != '/' && ! logdir.empty() )
+		fname = zeek::filesystem::path(logdir) / fname;
+
+	fname += "." + LogExt();
+
+	return OpenFile();
+	}
+
+bool Parquet::OpenFile()
+	{
+	arrow::Result<arrow::Compression::type> codec = arrow::Compression::UNCOMPRESSED;
+
+	if ( compression != "none" )
+		codec = arrow::util::Codec::GetCompressionType(compression);
+
+	if ( ! codec.ok() )
+		return CheckStatus(codec.status(), "unknown compression for");
+
+	parquet::WriterProperties::Builder props;
+	props.compression(*codec);
+	props.max_row_group_length(row_group_size);
+
+	if ( compression_level != 0 )
+		props.compression_level(compression_level);
+
+	if ( enable_dictionary )
+		props.enable_dictionary();
+	else
+		props.disable_dictionary();
+
+	auto out = arrow::io::FileOutputStream::Open(fname);
+
+	if ( ! out.ok() )
+		return CheckStatus(out.status(), "cannot open");
+
+	file = *out;
+
+	auto w = parquet::arrow::FileWriter::Open(*schema, arrow::default_memory_pool(), file,
+	                                          props.build());
+
+	if ( ! w.ok() )
+		return CheckStatus(w.status(), "cannot write to");
+
+	writer = std::move(*w);
+
+	auto b = arrow::RecordBatchBuilder::Make(schema, arrow::default_memory_pool(),
+	                                         row_group_size);
+
+	if ( ! b.ok() )
+		return CheckStatus(b.status(), "cannot write to");
+
+	builder = std::move(*b);
+	pending_rows = 0;
+
+	return true;
+	}
+
+bool Parquet::WriteRowGroup()
+	{
+	if ( pending_rows == 0 )
+		return true;
+
+	auto batch = builder->Flush();
+
+	if ( ! batch.ok() )
+		return CheckStatus(batch.status(), "cannot write to");
+
+	auto table = arrow::Table::FromRecordBatches({*batch});
+
+	if ( ! table.ok() )
+		return CheckStatus(table.status(), "cannot write to");
+
+	pending_rows = 0;
+
+	return CheckStatus(writer->WriteTable(**table, row_group_size), "cannot write to");
+	}
+
+bool Parquet::CloseFile()
+	{
+	bool ok = WriteRowGroup();
+
+	// The file is only readable once its footer is there.
+	ok = CheckStatus(writer->Close(), "cannot close") && ok;
+	ok = CheckStatus(file->Close(), "cannot close") && ok;
+
+	writer.reset();
+	file.reset();
+	builder.reset();
+
+	return ok;
+	}
+
+bool Parquet::DoWrite(int num_fields, const Field* const* fields, Value** vals)
+	{
+	if ( ! writer && ! OpenFile() )
+		return false;
+
+	for ( int i = 0; i < num_fields; ++i )
+		if ( ! CheckStatus(append_value(builder->GetField(i), fields[i]->type, fields[i]->subtype,
+		                                vals[i]),
+		                   "cannot write to") )
+			return false;
+
+	if ( ++pending_rows >= row_group_size )
+		return WriteRowGroup();
+
+	return true;
+	}
+
+bool Parquet::DoWriteBatch(int num_fields, const Field* const* fields, LogBatch& batch)
+	{
+	if ( ! writer && ! OpenFile() )
+		return false;
+
+	// Fill in one column at a time, which is how both the batch and the
+	// builders keep their values.
+	for ( int i = 0; i < num_fields; ++i )
+		{
+		auto b = builder->GetField(i);
+		auto column = batch.Column(i);
+
+		if ( ! CheckStatus(b->Reserve(batch.Size()), "cannot write to") )
+			return false;
+
+		for ( int j = 0; j < batch.Size(); ++j )
+			if ( ! CheckStatus(append_value(b, fields[i]->type, fields[i]->subtype, &column[j]),
+			                   "cannot write to") )
+				return false;
+		}
+
+	pending_rows += batch.Size();
+
+	if ( pending_rows >= row_group_size )
+		return WriteRowGroup();
+
+	return true;
+	}
+
+bool Parquet::DoRotate(const char* rotated_path, double open, double close, bool terminating)
+	{
+	// Don't rotate if there's not a file currently open.
+	if ( ! writer )
+		{
+		FinishedRotation();
+		return true;
+		}
+
+	if ( ! CloseFile() )
+		{
+		FinishedRotation();
+		return false;
+		}
+
+	std::string nname = std::string(rotated_path) + "." + LogExt();
+
+	if ( rename(fname.c_str(), nname.c_str()) != 0 )
+		{
+		char buf[256];
+		util::zeek_strerror_r(errno, buf, sizeof(buf));
+		Error(Fmt("failed to rename %s to %s: %s", fname.c_str(), nname.c_str(), buf));
+		FinishedRotation();
+		return false;
+		}
+
+	if ( ! FinishedRotation(nname.c_str(), fname.c_str(), open, close, terminating) )
+		{
+		Error(Fmt("error rotating %s to %s", fname.c_str(), nname.c_str()));
+		return false;
+		}
+
+	return true;
+	}
+
+bool Parquet::DoFinish(double network_time)
+	{
+	if ( ! writer )
+		return true;
+
+	return CloseFile();
+	}
+
+	} // namespace zeek::logging::writer::detail
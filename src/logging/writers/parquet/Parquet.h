@@ -0,0 +1,70 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+//
+// Log writer for Apache Parquet files.
+
+#pragma once
+
+#include <arrow/api.h>
+#include <arrow/io/file.h>
+#include <memory>
+#include <parquet/arrow/writer.h>
+#include <string>
+
+#include "zeek/logging/WriterBackend.h"
+
+namespace zeek::logging::writer::detail
+	{
+
+/**
+ * Writes each log into a Parquet file, with one column per log field.
+ * Entries collect in Arrow builders until there are enough for a row
+ * group, so that a file's contents become readable once it's rotated or
+ * closed.
+ */
+class Parquet : public WriterBackend
+	{
+public:
+	explicit Parquet(WriterFrontend* frontend);
+	~Parquet() override;
+
+	static std::string LogExt() { return "parquet"; }
+
+	static WriterBackend* Instantiate(WriterFrontend* frontend) { return new Parquet(frontend); }
+
+protected:
+	bool DoInit(const WriterInfo& info, int num_fields,
+	            const threading::Field* const* fields) override;
+	bool DoWrite(int num_fields, const threading::Field* const* fields,
+	             threading::Value** vals) override;
+	bool DoWriteBatch(int num_fields, const threading::Field* const* fields,
+	                  LogBatch& batch) override;
+	bool DoSetBuf(bool enabled) override { return true; }
+	bool DoRotate(const char* rotated_path, double open, double close, bool terminating) override;
+	bool DoFlush(double network_time) override { return true; }
+	bool DoFinish(double network_time) override;
+	bool DoHeartbeat(double network_time, double current_time) override { return true; }
+
+private:
+	bool InitFilterOptions();
+	bool OpenFile();
+	bool CloseFile();
+	bool WriteRowGroup();
+	bool CheckStatus(const arrow::Status& status, const char* what);
+
+	std::string fname;
+	std::shared_ptr<arrow::Schema> schema;
+	std::shared_ptr<arrow::io::FileOutputStream> file;
+	std::unique_ptr<parquet::arrow::FileWriter> writer;
+	std::unique_ptr<arrow::RecordBatchBuilder> builder;
+	int64_t pending_rows = 0; // Entries in the builders.
+	bool init_options;
+
+	// Options set from the script-level.
+	int64_t row_group_size;
+	std::string compression;
+	int compression_level;
+	bool enable_dictionary;
+	std::string logdir;
+	};
+
+	} // namespace zeek::logging::writer::detail
@@ -0,0 +1,25 @@
+// See the file  in the main distribution directory for copyright.
+
+#include "zeek/plugin/Plugin.h"
+
+#include "zeek/logging/writers/parquet/Parquet.h"
+
+namespace zeek::plugin::detail::Zeek_ParquetWriter
+	{
+
+class Plugin : public zeek::plugin::Plugin
+	{
+public:
+	zeek::plugin::Configuration Configure() override
+		{
+		AddComponent(new zeek::logging::Component(
+			"Parquet", zeek::logging::writer::detail::Parquet::Instantiate));
+
+		zeek::plugin::Configuration config;
+		config.name = "Zeek::ParquetWriter";
+		config.description = "Parquet log writer";
+		return config;
+		}
+	} plugin;
+
+	} // namespace zeek::plugin::detail::Zeek_ParquetWriter
@@ -0,0 +1,25 @@
+// See the file  in the main distribution directory for copyright.
+
+#include "zeek/plugin/Plugin.h"
+
+#include "zeek/logging/writers/snapshot/Snapshot.h"
+
+namespace zeek::plugin::detail::Zeek_SnapshotWriter
+	{
+
+class Plugin : public zeek::plugin::Plugin
+	{
+public:
+	zeek::plugin::Configuration Configure() override
+		{
+		AddComponent(new zeek::logging::Component(
+			"Snapshot", zeek::logging::writer::detail::Snapshot::Instantiate));
+
+		zeek::plugin::Configuration config;
+		config.name = "Zeek::SnapshotWriter";
+		config.description = "Binary snapshot log writer";
+		return config;
+		}
+	} plugin;
+
+	} // namespace zeek::plugin::detail::Zeek_SnapshotWriter
@@ -0,0 +1,194 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/logging/writers/snapshot/Snapshot.h"
+
+#include "zeek/zeek-config.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+
+#include "zeek/ID.h"
+#include "zeek/Val.h"
+#include "zeek/util.h"
+
+using zeek::threading::Field;
+using zeek::threading::Value;
+
+namespace zeek::logging::writer::detail
+	{
+
+// Entries per block. Readers decode a block at a time, so this bounds
+// the memory that a block takes rather than affecting speed much.
+static constexpr int BLOCK_ENTRIES = 4096;
+
+Snapshot::Snapshot(WriterFrontend* frontend) : WriterBackend(frontend)
+	{
+	logdir = zeek::id::find_const<StringVal>("Log::default_logdir")->ToStdString();
+	}
+
+Snapshot::~Snapshot()
+	{
+	// DoFinish() may not have been called.
+	if ( fd >= 0 )
+		{
+		close(fd);
+		unlink(tmpname.c_str());
+		}
+	}
+
+bool Snapshot::DoInit(const WriterInfo& info, int num_fields, const Field* const* fields)
+	{
+	for ( int i = 0; i < num_fields; ++i )
+		{
+		auto type = fields[i]->type;
+
+		if ( type == TYPE_RECORD || type == TYPE_ANY || type == TYPE_OPAQUE )
+			{
+			Error(Fmt("unsupported type %s for field %s", type_name(type), fields[i]->name));
+			return false;
+			}
+		}
+
+	fname = info.path;
+
+	if ( fname.front() != '/' && ! logdir.empty() )
+		fname = zeek::filesystem::path(logdir) / fname;
+
+	fname += "." + LogExt();
+	tmpname = fname + ".tmp";
+
+	return OpenFile();
+	}
+
+bool Snapshot::OpenFile()
+	{
+	fd = open(tmpname.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+
+	if ( fd < 0 )
+		{
+		char buf[256];
+		util::zeek_strerror_r(errno, buf, sizeof(buf));
+		Error(Fmt("cannot open %s: %s", tmpname.c_str(), buf));
+		return false;
+		}
+
+	return WriteData(LogSnapshot::Header(NumFields(), Fields()));
+	}
+
+bool Snapshot::WriteData(const std::string& data)
+	{
+	const char* p = data.data();
+	size_t len = data.size();
+
+	while ( len > 0 )
+		{
+		ssize_t n = write(fd, p, len);
+
+		if ( n < 0 && errno == EINTR )
+			continue;
+
+		if ( n < 0 )
+			{
+			char buf[256];
+			util::zeek_strerror_r(errno, buf, sizeof(buf));
+			Error(Fmt("cannot write to %s: %s", tmpname.c_str(), buf));
+			return false;
+			}
+
+		p += n;
+		len -= n;
+		}
+
+	return true;
+	}
+
+bool Snapshot::WriteBlock()
+	{
+	if ( entries.Entries() == 0 )
+		return true;
+
+	return WriteData(LogSnapshot::Block(entries.Finish()));
+	}
+
+bool Snapshot::CloseFile(const std::string& dst)
+	{
+	bool ok = WriteBlock();
+
+	if ( close(fd) < 0 && ok )
+		{
+		char buf[256];
+		util::zeek_strerror_r(errno, buf, sizeof(buf));
+		Error(Fmt("cannot write to %s: %s", tmpname.c_str(), buf));
+		ok = false;
+		}
+
+	fd = -1;
+
+	if ( ! ok )
+		{
+		unlink(tmpname.c_str());
+		return false;
+		}
+
+	if ( rename(tmpname.c_str(), dst.c_str()) != 0 )
+		{
+		char buf[256];
+		util::zeek_strerror_r(errno, buf, sizeof(buf));
+		Error(Fmt("failed to rename %s to %s: %s", tmpname.c_str(), dst.c_str(), buf));
+		unlink(tmpname.c_str());
+		return false;
+		}
+
+	return true;
+	}
+
+bool Snapshot::DoWrite(int num_fields, const Field* const* fields, Value** vals)
+	{
+	if ( fd < 0 && ! OpenFile() )
+		return false;
+
+	entries.AddEntry(num_fields, vals);
+
+	if ( entries.Entries() >= BLOCK_ENTRIES )
+		return WriteBlock();
+
+	return true;
+	}
+
+bool Snapshot::DoRotate(const char* rotated_path, double open, double close, bool terminating)
+	{
+	// Don't rotate if there's not a file currently open.
+	if ( fd < 0 )
+		{
+		FinishedRotation();
+		return true;
+		}
+
+	std::string nname = std::string(rotated_path) + "." + LogExt();
+
+	if ( ! CloseFile(nname) )
+		{
+		FinishedRotation();
+		return false;
+		}
+
+	if ( ! FinishedRotation(nname.c_str(), fname.c_str(), open, close, terminating) )
+		{
+		Error(Fmt("error rotating %s to %s", fname.c_str(), nname.c_str()));
+		return false;
+		}
+
+	return true;
+	}
+
+bool Snapshot::DoFinish(double network_time)
+	{
+	if ( fd < 0 )
+		return true;
+
+	return CloseFile(fname);
+	}
+
+	} // namespace zeek::logging::writer::detail
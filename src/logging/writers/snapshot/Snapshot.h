@@ -0,0 +1,56 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+//
+// Log writer for binary snapshot files, which the snapshot input reader
+// loads without parsing text.
+
+#pragma once
+
+#include <string>
+
+#include "zeek/logging/LogWire.h"
+#include "zeek/logging/WriterBackend.h"
+
+namespace zeek::logging::writer::detail
+	{
+
+/**
+ * Writes each log into a snapshot file, see LogSnapshot. The file gets
+ * written under a temporary name and only appears under its own once it's
+ * complete, on rotation or when closing it, so that readers never see a
+ * partial one.
+ */
+class Snapshot : public WriterBackend
+	{
+public:
+	explicit Snapshot(WriterFrontend* frontend);
+	~Snapshot() override;
+
+	static std::string LogExt() { return "zsnap"; }
+
+	static WriterBackend* Instantiate(WriterFrontend* frontend) { return new Snapshot(frontend); }
+
+protected:
+	bool DoInit(const WriterInfo& info, int num_fields,
+	            const threading::Field* const* fields) override;
+	bool DoWrite(int num_fields, const threading::Field* const* fields,
+	             threading::Value** vals) override;
+	bool DoSetBuf(bool enabled) override { return true; }
+	bool DoRotate(const char* rotated_path, double open, double close, bool terminating) override;
+	bool DoFlush(double network_time) override { return true; }
+	bool DoFinish(double network_time) override;
+	bool DoHeartbeat(double network_time, double current_time) override { return true; }
+
+private:
+	bool OpenFile();
+	bool CloseFile(const std::string& dst);
+	bool WriteBlock();
+	bool WriteData(const std::string& data);
+
+	std::string fname;
+	std::string tmpname;
+	std::string logdir;
+	int fd = -1;
+	LogWireWriter entries; // Entries not written yet.
+	};
+
+	} // namespace zeek::logging::writer::detail
@@ -4,7 +4,11 @@
 
 #include "zeek/zeek-config.h"
 
+#include <strings.h>
+#include <unistd.h>
+#include <algorithm>
 #include <cerrno>
+#include <cstring>
 #include <string>
 #include <vector>
 
@@ -31,6 +35,10 @@ SQLite::SQLite(WriterFrontend* frontend)
 	empty_field.assign((const char*)BifConst::LogSQLite::empty_field->Bytes(),
 	                   BifConst::LogSQLite::empty_field->Len());
 
+	transaction_rows = BifConst::LogSQLite::transaction_rows;
+	journal_mode = BifConst::LogSQLite::journal_mode->ToStdString();
+	synchronous = BifConst::LogSQLite::synchronous->ToStdString();
+
 	threading::formatter::Ascii::SeparatorInfo sep_info(string(), set_separator, unset_field,
 	                                                    empty_field);
 	io = new threading::formatter::Ascii(this, sep_info);
@@ -111,6 +119,86 @@ bool SQLite::checkError(int code)
 	return false;
 	}
 
+bool SQLite::Exec(const std::string& sql)
+	{
+	// Other writers to the same database, in this process or another,
+	// hold it locked for the duration of their transactions. Those
+	// don't last long, as none of them spans more than a batch.
+	constexpr int MAX_TRIES = 10000;
+
+	for ( int i = 0; i < MAX_TRIES; ++i )
+		{
+		char* errorMsg = 0;
+		int res = sqlite3_exec(db, sql.c_str(), NULL, NULL, &errorMsg);
+
+		if ( res == SQLITE_OK )
+			return true;
+
+		if ( (res == SQLITE_BUSY || res == SQLITE_LOCKED) && i + 1 < MAX_TRIES )
+			{
+			sqlite3_free(errorMsg);
+			usleep(1000);
+			continue;
+			}
+
+		Error(Fmt("Error executing %s: %s", sql.c_str(), errorMsg));
+		sqlite3_free(errorMsg);
+		break;
+		}
+
+	return false;
+	}
+
+bool SQLite::InitFilterOptions()
+	{
+	const WriterInfo& info = Info();
+
+	// Set per-filter configuration options.
+	for ( WriterInfo::config_map::const_iterator i = info.config.begin(); i != info.config.end();
+	      ++i )
+		{
+		if ( strcmp(i->first, "transaction_rows") == 0 )
+			transaction_rows = strtoull(i->second, nullptr, 10);
+
+		else if ( strcmp(i->first, "journal_mode") == 0 )
+			journal_mode = i->second;
+
+		else if ( strcmp(i->first, "synchronous") == 0 )
+			synchronous = i->second;
+		}
+
+	// These go into PRAGMA statements as they are, so only take the
+	// values that SQLite knows.
+	static const char* journal_modes[] = {"DELETE", "TRUNCATE", "PERSIST",
+	                                      "MEMORY", "WAL",      "OFF"};
+	static const char* synchronous_levels[] = {"OFF", "NORMAL", "FULL", "EXTRA"};
+
+	auto known = [](const std::string& v, const auto& values)
+	{
+		for ( auto k : values )
+			{
+			if ( strcasecmp(v.c_str(), k) == 0 )
+				return true;
+			}
+
+		return false;
+	};
+
+	if ( ! journal_mode.empty() && ! known(journal_mode, journal_modes) )
+		{
+		Error(Fmt("invalid value for 'journal_mode': %s", journal_mode.c_str()));
+		return false;
+		}
+
+	if ( ! synchronous.empty() && ! known(synchronous, synchronous_levels) )
+		{
+		Error(Fmt("invalid value for 'synchronous': %s", synchronous.c_str()));
+		return false;
+		}
+
+	return true;
+	}
+
 bool SQLite::DoInit(const WriterInfo& info, int arg_num_fields, const Field* const* arg_fields)
 	{
 	if ( sqlite3_threadsafe() == 0 )
@@ -129,6 +217,9 @@ bool SQLite::DoInit(const WriterInfo& info, int arg_num_fields, const Field* con
 	num_fields = arg_num_fields;
 	fields = arg_fields;
 
+	if ( ! InitFilterOptions() )
+		return false;
+
 	auto fullpath = zeek::filesystem::path(
 		zeek::id::find_const<StringVal>("Log::default_logdir")->ToStdString());
 
@@ -151,6 +242,12 @@ bool SQLite::DoInit(const WriterInfo& info, int arg_num_fields, const Field* con
 			 SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_NOMUTEX, NULL)) )
 		return false;
 
+	if ( ! journal_mode.empty() && ! Exec("PRAGMA journal_mode=" + journal_mode) )
+		return false;
+
+	if ( ! synchronous.empty() && ! Exec("PRAGMA synchronous=" + synchronous) )
+		return false;
+
 	string create = "CREATE TABLE IF NOT EXISTS " + tablename + " (\n";
 	//"id SERIAL UNIQUE NOT NULL"; // SQLite has rowids, we do not need a counter here.
 
@@ -361,6 +458,44 @@ bool SQLite::DoWrite(int num_fields, const Field* const* fields, Value** vals)
 	return true;
 	}
 
+bool SQLite::DoWriteBatch(int num_fields, const Field* const* fields, LogBatch& batch)
+	{
+	// Committing each row separately costs a sync of the database file
+	// each time, so group them unless asked to write them right away.
+	// Transactions end with the batch, so that they don't keep other
+	// writers to the database waiting while there's nothing to write.
+	if ( transaction_rows <= 1 || ! IsBuf() )
+		return WriterBackend::DoWriteBatch(num_fields, fields, batch);
+
+	std::vector<Value*> vals(num_fields);
+	int rows = std::min(transaction_rows, uint64_t(batch.Size()));
+
+	for ( int j = 0; j < batch.Size(); j += rows )
+		{
+		int end = std::min(batch.Size(), j + rows);
+
+		if ( ! Exec("BEGIN IMMEDIATE") )
+			return false;
+
+		for ( int k = j; k < end; ++k )
+			{
+			for ( int i = 0; i < num_fields; ++i )
+				vals[i] = batch.Get(k, i);
+
+			if ( ! DoWrite(num_fields, fields, vals.data()) )
+				{
+				Exec("ROLLBACK");
+				return false;
+				}
+			}
+
+		if ( ! Exec("COMMIT") )
+			return false;
+		}
+
+	return true;
+	}
+
 bool SQLite::DoRotate(const char* rotated_path, double open, double close, bool terminating)
 	{
 	if ( ! FinishedRotation("/dev/null", Info().path, open, close, terminating) )
@@ -27,6 +27,8 @@ protected:
 	            const threading::Field* const* arg_fields) override;
 	bool DoWrite(int num_fields, const threading::Field* const* fields,
 	             threading::Value** vals) override;
+	bool DoWriteBatch(int num_fields, const threading::Field* const* fields,
+	                  LogBatch& batch) override;
 	bool DoSetBuf(bool enabled) override { return true; }
 	bool DoRotate(const char* rotated_path, double open, double close, bool terminating) override;
 	bool DoFlush(double network_time) override { return true; }
@@ -36,6 +38,12 @@ protected:
 private:
 	bool checkError(int code);
 
+	bool InitFilterOptions();
+
+	// Runs a statement without results, waiting for other connections
+	// to finish their transactions. Returns false on error.
+	bool Exec(const std::string& sql);
+
 	int AddParams(threading::Value* val, int pos);
 	std::string GetTableType(int, int);
 
@@ -49,6 +57,12 @@ private:
 	std::string unset_field;
 	std::string empty_field;
 
+	// Batches go into the database in transactions of up to this many
+	// rows.
+	uint64_t transaction_rows;
+	std::string journal_mode;
+	std::string synchronous;
+
 	threading::formatter::Ascii* io;
 	};
 
@@ -8,7 +8,18 @@
 #include <netinet/in.h>
 #include <sys/socket.h>
 #include <sys/types.h>
-
+#include <algorithm>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "zeek/3rdparty/doctest.h"
 #include "zeek/IP.h"
 #include "zeek/IPAddr.h"
 #include "zeek/Reporter.h"
@@ -32,12 +43,164 @@ const char* transport_proto_string(TransportProto proto)
 namespace zeek
 	{
 
+namespace
+	{
+
+// Loads a 64-bit word without alignment requirements.
+inline uint64_t load64(const uint8_t* p)
+	{
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+	}
+
+// Sums up the tail that's too short for a full word. Words are added in
+// native byte order, like the vector kernels do; one's complement sums are
+// byte order independent as long as we're consistent.
+uint64_t cksum_tail(const uint8_t* data, size_t len, uint64_t sum)
+	{
+	while ( len >= 2 )
+		{
+		uint16_t w;
+		memcpy(&w, data, sizeof(w));
+		sum += w;
+		data += 2;
+		len -= 2;
+		}
+
+	if ( len )
+		{
+		uint8_t pad[2] = {data[0], 0};
+		uint16_t w;
+		memcpy(&w, pad, sizeof(w));
+		sum += w;
+		}
+
+	return sum;
+	}
+
+uint64_t cksum_add_generic(const uint8_t* data, size_t len, uint64_t sum)
+	{
+	// A 32-bit word is congruent to the sum of its two 16-bit halves
+	// modulo 0xffff, so we can add up whole 32-bit words.
+	while ( len >= 8 )
+		{
+		uint64_t v = load64(data);
+		sum += (v & 0xffffffff) + (v >> 32);
+		data += 8;
+		len -= 8;
+		}
+
+	return cksum_tail(data, len, sum);
+	}
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+
+#define HAVE_AVX2_CKSUM
+
+__attribute__((target("avx2"))) uint64_t cksum_add_avx2(const uint8_t* data, size_t len,
+                                                         uint64_t sum)
+	{
+	const __m256i low_mask = _mm256_set1_epi32(0xffff);
+
+	while ( len >= 32 )
+		{
+		// Each iteration adds at most 2 * 0xffff to a 32-bit lane, so
+		// flush the lanes before they can overflow.
+		size_t n = std::min(len / 32, size_t(16384));
+		__m256i acc = _mm256_setzero_si256();
+
+		for ( size_t i = 0; i < n; i++ )
+			{
+			__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+			acc = _mm256_add_epi32(acc, _mm256_and_si256(v, low_mask));
+			acc = _mm256_add_epi32(acc, _mm256_srli_epi32(v, 16));
+			data += 32;
+			}
+
+		len -= n * 32;
+
+		alignas(32) uint32_t lanes[8];
+		_mm256_store_si256(reinterpret_cast<__m256i*>(lanes), acc);
+
+		for ( auto l : lanes )
+			sum += l;
+		}
+
+	return cksum_add_generic(data, len, sum);
+	}
+
+#elif defined(__ARM_NEON)
+
+#define HAVE_NEON_CKSUM
+
+uint64_t cksum_add_neon(const uint8_t* data, size_t len, uint64_t sum)
+	{
+	while ( len >= 16 )
+		{
+		// Each iteration adds at most 2 * 0xffff to a 32-bit lane, so
+		// flush the lanes before they can overflow.
+		size_t n = std::min(len / 16, size_t(16384));
+		uint32x4_t acc = vdupq_n_u32(0);
+
+		for ( size_t i = 0; i < n; i++ )
+			{
+			acc = vpadalq_u16(acc, vreinterpretq_u16_u8(vld1q_u8(data)));
+			data += 16;
+			}
+
+		len -= n * 16;
+		sum += vgetq_lane_u64(vpaddlq_u32(acc), 0) + vgetq_lane_u64(vpaddlq_u32(acc), 1);
+		}
+
+	return cksum_add_generic(data, len, sum);
+	}
+
+#endif
+
+using cksum_kernel_func = uint64_t (*)(const uint8_t*, size_t, uint64_t);
+
+struct CksumKernel
+	{
+	cksum_kernel_func func;
+	const char* name;
+	};
+
+CksumKernel select_cksum_kernel()
+	{
+#ifdef ZEEK_SIMD_CKSUM
+#if defined(HAVE_AVX2_CKSUM)
+	if ( __builtin_cpu_supports("avx2") )
+		return {cksum_add_avx2, "avx2"};
+#elif defined(HAVE_NEON_CKSUM)
+	return {cksum_add_neon, "neon"};
+#endif
+#endif
+
+	return {cksum_add_generic, "generic"};
+	}
+
+const CksumKernel& get_cksum_kernel()
+	{
+	static const CksumKernel kernel = select_cksum_kernel();
+	return kernel;
+	}
+
+	}
+
+uint64_t detail::cksum_add(const uint8_t* data, size_t len, uint64_t sum)
+	{
+	return get_cksum_kernel().func(data, len, sum);
+	}
+
+const char* detail::cksum_kernel()
+	{
+	return get_cksum_kernel().name;
+	}
+
 uint16_t detail::ip4_in_cksum(const IPAddr& src, const IPAddr& dst, uint8_t next_proto,
                               const uint8_t* data, int len)
 	{
-	constexpr auto nblocks = 2;
-	detail::checksum_block blocks[nblocks];
-
 	ipv4_pseudo_hdr ph;
 	memset(&ph, 0, sizeof(ph));
 
@@ -45,20 +208,16 @@ uint16_t detail::ip4_in_cksum(const IPAddr& src, const IPAddr& dst, uint8_t next
 	dst.CopyIPv4(&ph.dst);
 	ph.len = htons(static_cast<uint16_t>(len));
 	ph.next_proto = next_proto;
-	blocks[0].block = reinterpret_cast<const uint8_t*>(&ph);
-	blocks[0].len = sizeof(ph);
-	blocks[1].block = data;
-	blocks[1].len = len;
 
-	return in_cksum(blocks, nblocks);
+	// The pseudo header has an even length, so it can be summed up
+	// separately from the data.
+	uint64_t sum = cksum_add(reinterpret_cast<const uint8_t*>(&ph), sizeof(ph));
+	return fold_cksum(cksum_add(data, len, sum));
 	}
 
 uint16_t detail::ip6_in_cksum(const IPAddr& src, const IPAddr& dst, uint8_t next_proto,
                               const uint8_t* data, int len)
 	{
-	constexpr auto nblocks = 2;
-	detail::checksum_block blocks[nblocks];
-
 	ipv6_pseudo_hdr ph;
 	memset(&ph, 0, sizeof(ph));
 
@@ -66,32 +225,19 @@ uint16_t detail::ip6_in_cksum(const IPAddr& src, const IPAddr& dst, uint8_t next
 	dst.CopyIPv6(&ph.dst);
 	ph.len = htonl(static_cast<uint32_t>(len));
 	ph.next_proto = next_proto;
-	blocks[0].block = reinterpret_cast<const uint8_t*>(&ph);
-	blocks[0].len = sizeof(ph);
-	blocks[1].block = data;
-	blocks[1].len = len;
 
-	return in_cksum(blocks, nblocks);
+	// The pseudo header has an even length, so it can be summed up
+	// separately from the data.
+	uint64_t sum = cksum_add(reinterpret_cast<const uint8_t*>(&ph), sizeof(ph));
+	return fold_cksum(cksum_add(data, len, sum));
 	}
 
 // Returns the ones-complement checksum of a chunk of 'b' bytes.
 int ones_complement_checksum(const void* p, int b, uint32_t sum)
 	{
-	const unsigned char* sp = (unsigned char*)p;
-
-	b /= 2; // convert to count of short's
-
-	/* No need for endian conversions. */
-	while ( --b >= 0 )
-		{
-		sum += *sp + (*(sp + 1) << 8);
-		sp += 2;
-		}
-
-	while ( sum > 0xffff )
-		sum = (sum & 0xffff) + (sum >> 16);
-
-	return sum;
+	// The trailing byte of an odd-sized chunk isn't included.
+	size_t len = b > 0 ? b & ~1 : 0;
+	return detail::fold_cksum(detail::cksum_add(static_cast<const uint8_t*>(p), len, sum));
 	}
 
 int ones_complement_checksum(const IPAddr& a, uint32_t sum)
@@ -212,3 +358,110 @@ uint32_t extract_uint32(const u_char* data)
 	}
 
 	} // namespace zeek
+
+using namespace zeek;
+using zeek::detail::fold_cksum;
+
+namespace
+	{
+
+// Sums up 16-bit words one at a time, padding an odd trailing byte.
+uint16_t reference_cksum(const uint8_t* data, size_t len, uint64_t sum)
+	{
+	for ( size_t i = 0; i < len; i += 2 )
+		{
+		uint8_t w[2] = {data[i], i + 1 < len ? data[i + 1] : uint8_t(0)};
+		uint16_t v;
+		memcpy(&v, w, sizeof(v));
+		sum += v;
+		}
+
+	return fold_cksum(sum);
+	}
+
+// The kernels' sums may differ before folding, but not after.
+void check_cksum_kernel(cksum_kernel_func kernel)
+	{
+	std::mt19937 rng(42);
+	std::vector<uint8_t> data(2048);
+
+	for ( auto& b : data )
+		b = rng();
+
+	for ( size_t start = 0; start < 32; ++start )
+		for ( size_t len = 0; len <= 64; ++len )
+			{
+			const uint8_t* p = data.data() + start;
+			CHECK_EQ(fold_cksum(kernel(p, len, 0)), fold_cksum(cksum_add_generic(p, len, 0)));
+			CHECK_EQ(fold_cksum(kernel(p, len, 0x1fffe)),
+			         fold_cksum(cksum_add_generic(p, len, 0x1fffe)));
+			}
+
+	for ( size_t start = 0; start < 2; ++start )
+		for ( size_t len = 65; len < 2000; len += 37 )
+			{
+			const uint8_t* p = data.data() + start;
+			CHECK_EQ(fold_cksum(kernel(p, len, 0)), fold_cksum(cksum_add_generic(p, len, 0)));
+			}
+
+	// Large enough for the kernels to flush their lanes in between, and
+	// all ones so that the lanes get as full as they can.
+	std::vector<uint8_t> big(16384 * 32 * 2 + 35, 0xff);
+
+	for ( size_t start = 0; start < 2; ++start )
+		{
+		size_t len = big.size() - start;
+		CHECK_EQ(fold_cksum(kernel(big.data() + start, len, 0)),
+		         fold_cksum(cksum_add_generic(big.data() + start, len, 0)));
+		}
+
+	for ( auto& b : big )
+		b = rng();
+
+	CHECK_EQ(fold_cksum(kernel(big.data() + 1, big.size() - 1, 0)),
+	         fold_cksum(cksum_add_generic(big.data() + 1, big.size() - 1, 0)));
+	}
+
+	} // namespace
+
+TEST_SUITE_BEGIN("net_util");
+
+TEST_CASE("generic checksum kernel")
+	{
+	std::mt19937 rng(1);
+	std::vector<uint8_t> data(300);
+
+	for ( auto& b : data )
+		b = rng();
+
+	for ( size_t start = 0; start < 8; ++start )
+		for ( size_t len = 0; len < 260; ++len )
+			CHECK_EQ(fold_cksum(cksum_add_generic(data.data() + start, len, 0)),
+			         reference_cksum(data.data() + start, len, 0));
+
+	std::vector<uint8_t> ones(99, 0xff);
+	CHECK_EQ(fold_cksum(cksum_add_generic(ones.data(), ones.size(), 0)),
+	         reference_cksum(ones.data(), ones.size(), 0));
+	}
+
+#ifdef HAVE_AVX2_CKSUM
+TEST_CASE("avx2 checksum kernel")
+	{
+	if ( ! __builtin_cpu_supports("avx2") )
+		{
+		MESSAGE("CPU doesn't support AVX2, not testing its checksum kernel");
+		return;
+		}
+
+	check_cksum_kernel(cksum_add_avx2);
+	}
+#endif
+
+#ifdef HAVE_NEON_CKSUM
+TEST_CASE("neon checksum kernel")
+	{
+	check_cksum_kernel(cksum_add_neon);
+	}
+#endif
+
+TEST_SUITE_END();
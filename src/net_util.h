@@ -174,10 +174,41 @@ struct ipv6_pseudo_hdr
 
 extern uint16_t in_cksum(const checksum_block* blocks, int num_blocks);
 
+/**
+ * Adds the 16-bit words of a chunk of data to an unfolded one's complement
+ * sum. An odd trailing byte is padded with zero. When configured with
+ * --enable-simd-cksum, uses an AVX2 or NEON kernel if the CPU supports it,
+ * selected at runtime on x86.
+ *
+ * @param data The data to sum up.
+ * @param len The number of bytes to sum up.
+ * @param sum The sum to add to.
+ *
+ * @return The new sum. Use fold_cksum() to reduce it to 16 bits.
+ */
+extern uint64_t cksum_add(const uint8_t* data, size_t len, uint64_t sum = 0);
+
+/**
+ * Folds a sum returned by cksum_add() into a 16-bit one's complement sum.
+ */
+inline uint16_t fold_cksum(uint64_t sum)
+	{
+	while ( sum > 0xffff )
+		sum = (sum & 0xffff) + (sum >> 16);
+
+	return static_cast<uint16_t>(sum);
+	}
+
+/**
+ * Returns the name of the checksum kernel that cksum_add() uses on this
+ * CPU: "avx2", "neon", or "generic". Always "generic" unless configured with
+ * --enable-simd-cksum.
+ */
+extern const char* cksum_kernel();
+
 inline uint16_t in_cksum(const uint8_t* data, int len)
 	{
-	checksum_block cb{data, len};
-	return in_cksum(&cb, 1);
+	return fold_cksum(cksum_add(data, len));
 	}
 
 extern uint16_t ip4_in_cksum(const IPAddr& src, const IPAddr& dst, uint8_t next_proto,
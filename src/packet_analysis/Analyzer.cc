@@ -6,6 +6,7 @@
 #include "zeek/Event.h"
 #include "zeek/RunState.h"
 #include "zeek/session/Manager.h"
+#include "zeek/telemetry/Manager.h"
 #include "zeek/util.h"
 
 namespace zeek::packet_analysis
@@ -30,6 +31,15 @@ Analyzer::Analyzer(const Tag& tag)
 void Analyzer::Init(const Tag& _tag)
 	{
 	tag = _tag;
+
+	if ( telemetry_mgr )
+		{
+		auto family = telemetry_mgr->CounterFamily("zeek", "packet-analyzer-packets",
+		                                           {"analyzer"},
+		                                           "Packets handed to packet analyzers", "1", true);
+		packets = std::make_unique<telemetry::ShardedIntCounter>(
+			family.GetOrAdd({{"analyzer", GetAnalyzerName()}}));
+		}
 	}
 
 void Analyzer::Initialize()
@@ -76,7 +86,11 @@ AnalyzerPtr Analyzer::Lookup(uint32_t identifier) const
 bool Analyzer::ForwardPacket(size_t len, const uint8_t* data, Packet* packet,
                              uint32_t identifier) const
 	{
-	auto inner_analyzer = Lookup(identifier);
+	// Use a raw pointer here so that the lookup on the packet path
+	// doesn't need to touch the analyzer's reference count.
+	Analyzer* inner_analyzer = dispatcher.Find(identifier);
+	bool dispatched = inner_analyzer != nullptr;
+
 	if ( ! inner_analyzer )
 		{
 		for ( const auto& child : analyzers_to_detect )
@@ -86,14 +100,14 @@ bool Analyzer::ForwardPacket(size_t len, const uint8_t* data, Packet* packet,
 				DBG_LOG(DBG_PACKET_ANALYSIS,
 				        "Protocol detection in %s succeeded, next layer analyzer is %s",
 				        GetAnalyzerName(), child->GetAnalyzerName());
-				inner_analyzer = child;
+				inner_analyzer = child.get();
 				break;
 				}
 			}
 		}
 
 	if ( ! inner_analyzer )
-		inner_analyzer = default_analyzer;
+		inner_analyzer = default_analyzer.get();
 
 	if ( ! inner_analyzer )
 		{
@@ -109,6 +123,17 @@ bool Analyzer::ForwardPacket(size_t len, const uint8_t* data, Packet* packet,
 
 	DBG_LOG(DBG_PACKET_ANALYSIS, "Analysis in %s succeeded, next layer identifier is %#x.",
 	        GetAnalyzerName(), identifier);
+
+	if ( auto* cache = packet_mgr->GetChainCache() )
+		{
+		if ( cache->Recording(packet) )
+			cache->Step(this, inner_analyzer, dispatched, len, data, packet);
+
+		else if ( dispatched && inner_analyzer->IsChainCacheable() )
+			return cache->Process(this, identifier, inner_analyzer, len, data, packet);
+		}
+
+	inner_analyzer->CountPacket();
 	return inner_analyzer->AnalyzePacket(len, data, packet);
 	}
 
@@ -142,6 +167,19 @@ bool Analyzer::ForwardPacket(size_t len, const uint8_t* data, Packet* packet) co
 		return false;
 		}
 
+	if ( auto* cache = packet_mgr->GetChainCache() )
+		{
+		if ( cache->Recording(packet) )
+			cache->StopRecording();
+
+		// Without protocol detection, the default analyzer is the only
+		// choice here.
+		else if ( analyzers_to_detect.empty() && inner_analyzer->IsChainCacheable() )
+			return cache->Process(this, ChainCache::DEFAULT_KEY, inner_analyzer.get(), len, data,
+			                      packet);
+		}
+
+	inner_analyzer->CountPacket();
 	return inner_analyzer->AnalyzePacket(len, data, packet);
 	}
 
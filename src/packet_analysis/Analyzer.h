@@ -1,12 +1,14 @@
 // See the file "COPYING" in the main distribution directory for copyright.
 #pragma once
 
+#include <memory>
 #include <set>
 
 #include "zeek/Tag.h"
 #include "zeek/iosource/Packet.h"
 #include "zeek/packet_analysis/Manager.h"
 #include "zeek/session/Session.h"
+#include "zeek/telemetry/Sharded.h"
 
 namespace zeek::packet_analysis
 	{
@@ -174,6 +176,16 @@ public:
 		       session::AnalyzerConfirmationState::VIOLATED;
 		}
 
+	/**
+	 * Returns true if the chain cache may skip this analyzer for packets
+	 * whose headers match an earlier packet's. Analyzers returning true
+	 * must base all decisions on the header bytes they consume and on
+	 * lower bounds of the remaining length, must only modify the packet's
+	 * link-layer fields, and must pass on the remaining data through the
+	 * dispatcher. See ChainCache for details.
+	 */
+	virtual bool IsChainCacheable() const { return false; }
+
 	/**
 	 * Reports a Weird with the analyzer's name included in the addl field.
 	 *
@@ -186,6 +198,17 @@ public:
 	 */
 	void Weird(const char* name, Packet* packet = nullptr, const char* addl = "") const;
 
+	/**
+	 * Counts a packet about to get analyzed, for the
+	 * zeek_packet_analyzer_packets metric. The analyzers that a cached
+	 * chain skips over don't get to count the packet, see ChainCache.
+	 */
+	void CountPacket() const
+		{
+		if ( packets )
+			packets->Inc();
+		}
+
 protected:
 	friend class Manager;
 
@@ -252,6 +275,8 @@ private:
 
 	std::set<AnalyzerPtr> analyzers_to_detect;
 
+	std::unique_ptr<telemetry::ShardedIntCounter> packets;
+
 	void Init(const zeek::Tag& tag);
 	};
 
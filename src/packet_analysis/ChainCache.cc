@@ -0,0 +1,151 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/packet_analysis/ChainCache.h"
+
+#include <cstring>
+
+#include "zeek/packet_analysis/Analyzer.h"
+
+namespace zeek::packet_analysis
+	{
+
+ChainCache::ChainCache(size_t size) : entries(size) { }
+
+size_t ChainCache::Slot(const Analyzer* from, uint64_t key, const uint8_t* data) const
+	{
+	// FNV-1a over the entry point and the leading header bytes.
+	uint64_t h = 14695981039346656037ull;
+
+	auto mix = [&h](uint64_t v)
+	{
+		h ^= v;
+		h *= 1099511628211ull;
+	};
+
+	mix(reinterpret_cast<uintptr_t>(from));
+	mix(key);
+
+	for ( size_t i = 0; i < KEY_BYTES; i++ )
+		mix(data[i]);
+
+	return h % entries.size();
+	}
+
+bool ChainCache::Process(const Analyzer* from, uint64_t key, Analyzer* to, size_t len,
+                         const uint8_t* data, Packet* packet)
+	{
+	bool result;
+
+	if ( Forward(from, key, len, data, packet, &result) )
+		return result;
+
+	recording = packet;
+	recording_from = from;
+	recording_key = key;
+	recording_len = len;
+	recording_data = data;
+	recording_state = GetState(packet);
+	recording_l2_src = packet->l2_src;
+	recording_l2_dst = packet->l2_dst;
+
+	to->CountPacket();
+	result = to->AnalyzePacket(len, data, packet);
+
+	// The chain didn't reach an analyzer we could hand off to.
+	if ( Recording(packet) )
+		StopRecording();
+
+	return result;
+	}
+
+bool ChainCache::Forward(const Analyzer* from, uint64_t key, size_t len, const uint8_t* data,
+                         Packet* packet, bool* result)
+	{
+	if ( len < KEY_BYTES )
+		return false;
+
+	const Entry& e = entries[Slot(from, key, data)];
+	State in = GetState(packet);
+
+	// The cached chain passed all of its length checks with min_len
+	// bytes, so it passes them for any longer packet as well.
+	if ( e.from != from || e.key != key || len < e.min_len || in.eth_type != e.in.eth_type ||
+	     in.vlan != e.in.vlan || in.inner_vlan != e.in.inner_vlan ||
+	     memcmp(e.prefix, data, e.prefix_len) != 0 )
+		{
+		++misses;
+		return false;
+		}
+
+	++hits;
+
+	packet->eth_type = e.out.eth_type;
+	packet->vlan = e.out.vlan;
+	packet->inner_vlan = e.out.inner_vlan;
+
+	if ( e.l2_src >= 0 )
+		packet->l2_src = data + e.l2_src;
+
+	if ( e.l2_dst >= 0 )
+		packet->l2_dst = data + e.l2_dst;
+
+	e.target->CountPacket();
+	*result = e.target->AnalyzePacket(len - e.prefix_len, data + e.prefix_len, packet);
+	return true;
+	}
+
+void ChainCache::Step(const Analyzer* from, Analyzer* to, bool dispatched, size_t len,
+                      const uint8_t* data, Packet* packet)
+	{
+	if ( ! dispatched || ! from->IsChainCacheable() )
+		{
+		// The choice of the next analyzer may depend on more than the
+		// consumed header bytes.
+		StopRecording();
+		return;
+		}
+
+	if ( to->IsChainCacheable() )
+		return;
+
+	// Everything up to here can be skipped next time.
+	StopRecording();
+
+	if ( data < recording_data )
+		return;
+
+	size_t offset = data - recording_data;
+
+	if ( offset < KEY_BYTES || offset > MAX_PREFIX || offset + len != recording_len )
+		return;
+
+	// Returns the offset of a link-layer pointer into the consumed bytes,
+	// -1 if the chain left it alone, or -2 if we can't reproduce it.
+	auto l2_offset = [&](const u_char* p, const u_char* before) -> int
+	{
+		if ( p >= recording_data && p < data )
+			return p - recording_data;
+
+		return p == before ? -1 : -2;
+	};
+
+	int l2_src = l2_offset(packet->l2_src, recording_l2_src);
+	int l2_dst = l2_offset(packet->l2_dst, recording_l2_dst);
+
+	if ( l2_src < -1 || l2_dst < -1 )
+		return;
+
+	Entry& e = entries[Slot(recording_from, recording_key, recording_data)];
+	e.from = recording_from;
+	e.key = recording_key;
+	e.target = to;
+	e.min_len = recording_len;
+	e.in = recording_state;
+	e.out = GetState(packet);
+	e.l2_src = l2_src;
+	e.l2_dst = l2_dst;
+	e.prefix_len = offset;
+	memcpy(e.prefix, recording_data, offset);
+	}
+
+	} // namespace zeek::packet_analysis
@@ -0,0 +1,158 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "zeek/iosource/Packet.h"
+
+namespace zeek::packet_analysis
+	{
+
+class Analyzer;
+
+/**
+ * Caches the outcome of running packets through sequences of link-layer
+ * analyzers such as Ethernet and VLAN. A sequence starts where an analyzer
+ * forwards a packet to one of these analyzers (e.g. the root analyzer for
+ * the outer headers, or a VXLAN analyzer for the inner frame). It's keyed by
+ * the exact bytes the sequence consumed. A later packet entering at the same
+ * point with the same bytes gets its link-layer fields restored from the
+ * cache and is handed straight to the analyzer following the sequence,
+ * usually IP.
+ *
+ * Only analyzers that report IsChainCacheable() are skipped. Such analyzers
+ * must base all of their decisions on the header bytes they consume and on
+ * lower bounds of the remaining length, must only modify the packet's
+ * link-layer fields, and must forward the rest of the packet unmodified
+ * through the dispatcher.
+ */
+class ChainCache
+	{
+public:
+	/**
+	 * Key used for packets forwarded without an identifier, i.e. to a
+	 * default analyzer.
+	 */
+	static constexpr uint64_t DEFAULT_KEY = uint64_t(1) << 32;
+
+	/**
+	 * Constructor.
+	 *
+	 * @param size The number of cache slots.
+	 */
+	explicit ChainCache(size_t size);
+
+	/**
+	 * Passes a packet from an analyzer to a chain-cacheable child,
+	 * skipping the child and its cacheable successors if the cache has an
+	 * entry for the packet's headers, and recording the chain otherwise.
+	 *
+	 * @param from The forwarding analyzer.
+	 * @param key The identifier \a from dispatched on, or DEFAULT_KEY.
+	 * @param to The analyzer \a from selected.
+	 * @param len The remaining length of the packet.
+	 * @param data The remaining data of the packet.
+	 * @param packet The packet being processed.
+	 *
+	 * @return The result of the analysis.
+	 */
+	bool Process(const Analyzer* from, uint64_t key, Analyzer* to, size_t len,
+	             const uint8_t* data, Packet* packet);
+
+	/**
+	 * Returns true if the chain of the given packet is being recorded.
+	 */
+	bool Recording(const Packet* packet) const { return recording == packet; }
+
+	/**
+	 * Stops recording without adding an entry.
+	 */
+	void StopRecording() { recording = nullptr; }
+
+	/**
+	 * Records one step of the analyzer chain. Called by
+	 * Analyzer::ForwardPacket() while recording.
+	 *
+	 * @param from The analyzer forwarding the packet.
+	 * @param to The analyzer receiving the packet.
+	 * @param dispatched True if \a to was found through the dispatcher
+	 * rather than through protocol detection or a default analyzer.
+	 * @param len The remaining length that \a to receives.
+	 * @param data The data that \a to receives.
+	 * @param packet The packet being processed.
+	 */
+	void Step(const Analyzer* from, Analyzer* to, bool dispatched, size_t len,
+	          const uint8_t* data, Packet* packet);
+
+	/**
+	 * Returns the number of packets forwarded from the cache.
+	 */
+	uint64_t Hits() const { return hits; }
+
+	/**
+	 * Returns the number of packets that had to go through the full chain.
+	 */
+	uint64_t Misses() const { return misses; }
+
+private:
+	// The number of leading bytes a cache slot is selected by. Chains
+	// consuming fewer bytes aren't cached.
+	static constexpr size_t KEY_BYTES = 14;
+
+	// Chains consuming more bytes aren't cached.
+	static constexpr size_t MAX_PREFIX = 64;
+
+	// Link-layer fields of a packet that cacheable analyzers may modify.
+	struct State
+		{
+		uint32_t eth_type = 0;
+		uint32_t vlan = 0;
+		uint32_t inner_vlan = 0;
+		};
+
+	struct Entry
+		{
+		const Analyzer* from = nullptr;
+		uint64_t key = 0;
+		Analyzer* target = nullptr;
+		size_t min_len = 0;
+		State in;
+		State out;
+
+		// Offsets of l2_src/l2_dst into the prefix, or -1 if the
+		// chain didn't set them.
+		int16_t l2_src = -1;
+		int16_t l2_dst = -1;
+
+		uint16_t prefix_len = 0;
+		uint8_t prefix[MAX_PREFIX];
+		};
+
+	size_t Slot(const Analyzer* from, uint64_t key, const uint8_t* data) const;
+	bool Forward(const Analyzer* from, uint64_t key, size_t len, const uint8_t* data,
+	             Packet* packet, bool* result);
+
+	static State GetState(const Packet* packet)
+		{
+		return {packet->eth_type, packet->vlan, packet->inner_vlan};
+		}
+
+	std::vector<Entry> entries;
+
+	// The chain currently being recorded.
+	Packet* recording = nullptr;
+	const Analyzer* recording_from = nullptr;
+	uint64_t recording_key = 0;
+	size_t recording_len = 0;
+	const uint8_t* recording_data = nullptr;
+	State recording_state;
+	const u_char* recording_l2_src = nullptr;
+	const u_char* recording_l2_dst = nullptr;
+
+	uint64_t hits = 0;
+	uint64_t misses = 0;
+	};
+
+	} // namespace zeek::packet_analysis
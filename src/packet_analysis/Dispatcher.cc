@@ -18,6 +18,9 @@ Dispatcher::~Dispatcher()
 
 void Dispatcher::Register(uint32_t identifier, AnalyzerPtr analyzer)
 	{
+	// Any compiled table is outdated now.
+	compiled = false;
+
 	// If the table has size 1 and the entry is nullptr, there was nothing added yet. Just add it.
 	if ( table.size() == 1 && table[0] == nullptr )
 		{
@@ -77,10 +80,94 @@ size_t Dispatcher::Count() const
 						 });
 	}
 
+void Dispatcher::Compile()
+	{
+	compiled = false;
+	dense.clear();
+	dense_size = 0;
+	hash_slots.clear();
+
+	if ( table.size() > MAX_DENSE_SIZE && CompileHash() )
+		{
+		compiled = true;
+		return;
+		}
+
+	dense_size = table.size();
+	dense.resize((dense_size + DenseLine::SLOTS - 1) / DenseLine::SLOTS, DenseLine{});
+
+	for ( size_t i = 0; i < table.size(); i++ )
+		dense[i / DenseLine::SLOTS].slots[i % DenseLine::SLOTS] = table[i].get();
+
+	compiled = true;
+	}
+
+bool Dispatcher::CompileHash()
+	{
+	std::vector<uint32_t> identifiers;
+
+	for ( size_t i = 0; i < table.size(); i++ )
+		if ( table[i] )
+			identifiers.push_back(lowest_identifier + i);
+
+	if ( identifiers.empty() )
+		return false;
+
+	// Odd multipliers with well-mixed bits. We try them in turn for
+	// increasing table sizes until one maps all identifiers to distinct
+	// slots, which gives us a perfect hash with a single probe per lookup.
+	static constexpr uint32_t multipliers[] = {0x9e3779b1, 0x85ebca6b, 0xc2b2ae35, 0x27d4eb2f,
+	                                           0x165667b1, 0xfd7046c5, 0xb55a4f09, 0x7feb352d};
+
+	uint32_t bits = 1;
+	while ( (size_t(1) << bits) < 2 * identifiers.size() )
+		++bits;
+
+	// Give up once the hash table would be larger than a dense one.
+	for ( ; bits < 32 && (size_t(1) << bits) * sizeof(HashSlot) <= table.size() * sizeof(Analyzer*);
+	      ++bits )
+		{
+		uint32_t shift = 32 - bits;
+
+		for ( auto m : multipliers )
+			{
+			std::vector<HashSlot> slots(size_t(1) << bits, HashSlot{0, nullptr});
+			bool collision = false;
+
+			for ( auto id : identifiers )
+				{
+				auto& slot = slots[(id * m) >> shift];
+
+				if ( slot.analyzer )
+					{
+					collision = true;
+					break;
+					}
+
+				slot = {id, table[id - lowest_identifier].get()};
+				}
+
+			if ( ! collision )
+				{
+				hash_slots = std::move(slots);
+				hash_multiplier = m;
+				hash_shift = shift;
+				return true;
+				}
+			}
+		}
+
+	return false;
+	}
+
 void Dispatcher::Clear()
 	{
 	FreeValues();
 	table.clear();
+	compiled = false;
+	dense.clear();
+	dense_size = 0;
+	hash_slots.clear();
 	}
 
 void Dispatcher::FreeValues()
@@ -92,8 +179,9 @@ void Dispatcher::FreeValues()
 void Dispatcher::DumpDebug() const
 	{
 #ifdef DEBUG
-	DBG_LOG(DBG_PACKET_ANALYSIS, "Dispatcher elements (used/total): %lu/%lu", Count(),
-	        table.size());
+	DBG_LOG(DBG_PACKET_ANALYSIS, "Dispatcher elements (used/total): %lu/%lu, %s", Count(),
+	        table.size(),
+	        ! compiled ? "not compiled" : (hash_slots.empty() ? "dense table" : "hash table"));
 	for ( size_t i = 0; i < table.size(); i++ )
 		{
 		if ( table[i] != nullptr )
@@ -39,6 +39,51 @@ public:
 	 */
 	AnalyzerPtr Lookup(uint32_t identifier) const;
 
+	/**
+	 * Looks up the analyzer for an identifier without touching the
+	 * analyzer's reference count. Uses the compiled table if Compile()
+	 * has been called. This is what the packet path uses.
+	 *
+	 * @param identifier The identifier to look up.
+	 * @return The analyzer registered for the given identifier. Returns a
+	 * nullptr if no analyzer is registered.
+	 */
+	Analyzer* Find(uint32_t identifier) const
+		{
+		++lookups;
+
+		Analyzer* a = compiled ? FindCompiled(identifier) : FindInTable(identifier);
+
+		if ( ! a )
+			++misses;
+
+		return a;
+		}
+
+	/**
+	 * Freezes the current set of mappings into a table optimized for
+	 * lookups: a dense, cache-aligned array if the identifier space is
+	 * small, or a collision-free hash table if it's sparse (e.g. ports).
+	 * Further calls to Register() invalidate the compiled table.
+	 */
+	void Compile();
+
+	/**
+	 * Returns true if lookups currently go through a compiled table.
+	 */
+	bool IsCompiled() const { return compiled; }
+
+	/**
+	 * Returns the number of lookups performed through Find().
+	 */
+	uint64_t Lookups() const { return lookups; }
+
+	/**
+	 * Returns the number of lookups through Find() that didn't yield an
+	 * analyzer.
+	 */
+	uint64_t Misses() const { return misses; }
+
 	/**
 	 * Returns the number of registered analyzers.
 	 * @return Number of registered analyzers.
@@ -56,9 +101,61 @@ public:
 	void DumpDebug() const;
 
 private:
+	// Identifier spaces up to this size get compiled into a dense array.
+	static constexpr size_t MAX_DENSE_SIZE = 1024;
+
+	// A cache line worth of slots of the compiled dense array.
+	struct alignas(64) DenseLine
+		{
+		static constexpr size_t SLOTS = 64 / sizeof(Analyzer*);
+		Analyzer* slots[SLOTS];
+		};
+
+	// A slot of the compiled hash table.
+	struct HashSlot
+		{
+		uint32_t identifier;
+		Analyzer* analyzer;
+		};
+
+	Analyzer* FindInTable(uint32_t identifier) const
+		{
+		uint32_t index = identifier - lowest_identifier;
+		return index < table.size() ? table[index].get() : nullptr;
+		}
+
+	Analyzer* FindCompiled(uint32_t identifier) const
+		{
+		if ( ! hash_slots.empty() )
+			{
+			const auto& slot = hash_slots[(identifier * hash_multiplier) >> hash_shift];
+			return slot.identifier == identifier ? slot.analyzer : nullptr;
+			}
+
+		uint32_t index = identifier - lowest_identifier;
+
+		if ( index >= dense_size )
+			return nullptr;
+
+		return dense[index / DenseLine::SLOTS].slots[index % DenseLine::SLOTS];
+		}
+
+	bool CompileHash();
+
 	uint32_t lowest_identifier = 0;
 	std::vector<AnalyzerPtr> table;
 
+	// Compiled lookup structures, see Compile().
+	bool compiled = false;
+	std::vector<DenseLine> dense;
+	uint32_t dense_size = 0;
+	std::vector<HashSlot> hash_slots;
+	uint32_t hash_multiplier = 0;
+	uint32_t hash_shift = 0;
+
+	mutable uint64_t lookups = 0;
+	mutable uint64_t misses = 0;
+
 	void FreeValues();
 
 	inline uint32_t GetHighestIdentifier() const { return lowest_identifier + table.size() - 1; }
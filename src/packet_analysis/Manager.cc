@@ -4,6 +4,7 @@
 
 #include "zeek/RunState.h"
 #include "zeek/Stats.h"
+#include "zeek/Val.h"
 #include "zeek/iosource/Manager.h"
 #include "zeek/iosource/PktDumper.h"
 #include "zeek/packet_analysis/Analyzer.h"
@@ -22,6 +23,7 @@ Manager::~Manager()
 	{
 	delete pkt_profiler;
 	delete pkt_filter;
+	delete chain_cache;
 	}
 
 void Manager::InitPostScript(const std::string& unprocessed_output_file)
@@ -50,6 +52,9 @@ void Manager::InitPostScript(const std::string& unprocessed_output_file)
 	unknown_sampling_duration = id::find_val("UnknownProtocol::sampling_duration")->AsInterval();
 	unknown_first_bytes_count = id::find_val("UnknownProtocol::first_bytes_count")->AsCount();
 
+	if ( auto size = id::find_val("PacketAnalyzer::chain_cache_size")->AsCount(); size > 0 )
+		chain_cache = new ChainCache(size);
+
 	if ( ! unprocessed_output_file.empty() )
 		// This gets automatically cleaned up by iosource_mgr. No need to delete it locally.
 		unprocessed_dumper = iosource_mgr->OpenPktDumper(unprocessed_output_file, true);
@@ -70,6 +75,33 @@ void Manager::DumpDebug()
 #endif
 	}
 
+void Manager::CompileDispatchers()
+	{
+	for ( auto& [name, analyzer] : analyzers )
+		analyzer->dispatcher.Compile();
+	}
+
+TableValPtr Manager::GetDispatchStats() const
+	{
+	static auto stats_type = id::find_type<RecordType>("PacketAnalyzer::DispatchStats");
+	static auto table_type = id::find_type<TableType>("PacketAnalyzer::DispatchStatsTable");
+
+	auto rval = make_intrusive<TableVal>(table_type);
+
+	for ( const auto& [name, analyzer] : analyzers )
+		{
+		const auto& d = analyzer->dispatcher;
+		auto r = make_intrusive<RecordVal>(stats_type);
+		r->Assign(0, val_mgr->Count(d.Lookups()));
+		r->Assign(1, val_mgr->Count(d.Misses()));
+		r->Assign(2, val_mgr->Count(d.Count()));
+		r->Assign(3, val_mgr->Bool(d.IsCompiled()));
+		rval->Assign(make_intrusive<StringVal>(name), std::move(r));
+		}
+
+	return rval;
+	}
+
 AnalyzerPtr Manager::GetAnalyzer(EnumVal* val)
 	{
 	auto analyzer_comp = Lookup(val);
@@ -6,6 +6,7 @@
 #include "zeek/PacketFilter.h"
 #include "zeek/Tag.h"
 #include "zeek/iosource/Packet.h"
+#include "zeek/packet_analysis/ChainCache.h"
 #include "zeek/packet_analysis/Component.h"
 #include "zeek/packet_analysis/Dispatcher.h"
 #include "zeek/plugin/ComponentManager.h"
@@ -64,6 +65,21 @@ public:
 	 */
 	void DumpDebug(); // Called after zeek_init() events.
 
+	/**
+	 * Compiles the dispatchers of all analyzers into their lookup-optimized
+	 * form. Should be called only after any \c zeek_init events have
+	 * executed, since no further protocols can get registered after that.
+	 */
+	void CompileDispatchers(); // Called after zeek_init() events.
+
+	/**
+	 * Returns the lookup statistics of all analyzers' dispatchers.
+	 *
+	 * @return A table of PacketAnalyzer::DispatchStats records, indexed by
+	 * analyzer name.
+	 */
+	TableValPtr GetDispatchStats() const;
+
 	/**
 	 * Looks up an analyzer instance.
 	 *
@@ -142,6 +158,12 @@ public:
 	 */
 	uint64_t GetUnprocessedCount() const { return total_not_processed; }
 
+	/**
+	 * Returns the per-flow analyzer chain cache, or nullptr if it's
+	 * disabled via PacketAnalyzer::chain_cache_size.
+	 */
+	ChainCache* GetChainCache() const { return chain_cache; }
+
 private:
 	/**
 	 * Instantiates a new analyzer instance.
@@ -167,6 +189,7 @@ private:
 
 	std::map<std::string, AnalyzerPtr> analyzers;
 	AnalyzerPtr root_analyzer = nullptr;
+	ChainCache* chain_cache = nullptr;
 
 	uint64_t num_packets_processed = 0;
 	detail::PacketProfiler* pkt_profiler = nullptr;
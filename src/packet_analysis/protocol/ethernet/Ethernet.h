@@ -16,6 +16,7 @@ public:
 
 	void Initialize() override;
 	bool AnalyzePacket(size_t len, const uint8_t* data, Packet* packet) override;
+	bool IsChainCacheable() const override { return true; }
 
 	static zeek::packet_analysis::AnalyzerPtr Instantiate()
 		{
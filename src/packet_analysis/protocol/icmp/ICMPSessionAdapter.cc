@@ -2,6 +2,7 @@
 
 #include "zeek/packet_analysis/protocol/icmp/ICMPSessionAdapter.h"
 
+#include "zeek/ID.h"
 #include "zeek/analyzer/Manager.h"
 #include "zeek/analyzer/protocol/conn-size/ConnSize.h"
 
@@ -25,8 +26,11 @@ void ICMPSessionAdapter::AddExtraAnalyzers(Connection* conn)
 
 void ICMPSessionAdapter::UpdateConnVal(zeek::RecordVal* conn_val)
 	{
-	const auto& orig_endp = conn_val->GetField("orig");
-	const auto& resp_endp = conn_val->GetField("resp");
+	static auto orig_idx = zeek::id::connection->FieldOffset("orig");
+	static auto resp_idx = zeek::id::connection->FieldOffset("resp");
+
+	const auto& orig_endp = conn_val->GetField(orig_idx);
+	const auto& resp_endp = conn_val->GetField(resp_idx);
 
 	UpdateEndpointVal(orig_endp, true);
 	UpdateEndpointVal(resp_endp, false);
@@ -43,13 +47,13 @@ void ICMPSessionAdapter::UpdateEndpointVal(const ValPtr& endp_arg, bool is_orig)
 
 	if ( size < 0 )
 		{
-		endp->Assign(0, val_mgr->Count(0));
-		endp->Assign(1, val_mgr->Count(int(ICMP_INACTIVE)));
+		endp->Assign(0, 0);
+		endp->Assign(1, int(ICMP_INACTIVE));
 		}
 	else
 		{
-		endp->Assign(0, val_mgr->Count(size));
-		endp->Assign(1, val_mgr->Count(int(ICMP_ACTIVE)));
+		endp->Assign(0, size);
+		endp->Assign(1, int(ICMP_ACTIVE));
 		}
 	}
 
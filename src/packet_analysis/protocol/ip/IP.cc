@@ -171,9 +171,18 @@ bool IPAnalyzer::AnalyzePacket(size_t len, const uint8_t* data, Packet* packet)
 			}
 		else
 			{
-			f = detail::fragment_mgr->NextFragment(run_state::processing_start_time, packet->ip_hdr,
-			                                       packet->data + hdr_size);
-			std::shared_ptr<IP_Hdr> ih = f->ReassembledPkt();
+			std::shared_ptr<IP_Hdr> ih;
+
+			if ( auto* table = detail::fragment_mgr->CompactTable() )
+				// The table frees the datagram's state once it's complete.
+				ih = table->NextFragment(run_state::processing_start_time, packet->ip_hdr,
+				                         packet->data + hdr_size);
+			else
+				{
+				f = detail::fragment_mgr->NextFragment(run_state::processing_start_time,
+				                                       packet->ip_hdr, packet->data + hdr_size);
+				ih = f->ReassembledPkt();
+				}
 
 			if ( ! ih )
 				// It didn't reassemble into anything yet.
@@ -2,7 +2,11 @@
 
 #include "zeek/packet_analysis/protocol/ip/IPBasedAnalyzer.h"
 
+#include <chrono>
+
 #include "zeek/Conn.h"
+#include "zeek/PacketRing.h"
+#include "zeek/PacketTracer.h"
 #include "zeek/RunState.h"
 #include "zeek/Val.h"
 #include "zeek/analyzer/Manager.h"
@@ -35,7 +39,59 @@ bool IPBasedAnalyzer::AnalyzePacket(size_t len, const uint8_t* data, Packet* pkt
 	const std::shared_ptr<IP_Hdr>& ip_hdr = pkt->ip_hdr;
 	detail::ConnKey key(tuple);
 
-	Connection* conn = session_mgr->FindConnection(key);
+	// Shunted traffic gets dropped before anything else looks at it.
+	if ( session_mgr->HaveShunts() && session_mgr->CheckShunt(key, pkt) )
+		{
+		pkt->processed = true;
+		return true;
+		}
+
+	if ( zeek::detail::packet_ring )
+		zeek::detail::packet_ring->Add(key, pkt);
+
+	zeek::detail::PacketTraceScope lookup_pts(zeek::detail::PacketTracer::SESSION_LOOKUP);
+
+	Connection* conn = pkt->has_flow_hash ? session_mgr->FindConnection(key, pkt->flow_hash)
+	                                      : session_mgr->FindConnection(key);
+
+	if ( ! conn && zeek::detail::flow_sampling_fraction < 1.0 && ! session_mgr->SampleFlow(key) )
+		{
+		session_mgr->CountUnsampled(key, pkt);
+
+		// The flow gets summarized, so the packet counts as processed.
+		pkt->processed = true;
+		return true;
+		}
+
+	if ( ! conn && AggregatePacket(tuple, pkt) )
+		{
+		// The flow gets summarized, so the packet counts as processed.
+		pkt->processed = true;
+		return true;
+		}
+
+	if ( ! conn && zeek::detail::embryonic_sessions )
+		{
+		session::detail::EmbryonicFlow flow;
+
+		if ( session_mgr->TakeEmbryonic(key, &flow) )
+			conn = PromoteEmbryonic(key, flow);
+
+		else if ( EmbryonicCandidate(len, pkt) )
+			{
+			if ( double timeout = EmbryonicTimeout(len, pkt); timeout > 0 )
+				{
+				session_mgr->InsertEmbryonic(key, pkt, timeout);
+
+				// The flow gets logged either way, so the packet counts
+				// as processed.
+				pkt->processed = true;
+				pkt->is_orig = true;
+				pkt->dump_packet = true;
+				return true;
+				}
+			}
+		}
 
 	if ( ! conn )
 		{
@@ -63,6 +119,16 @@ bool IPBasedAnalyzer::AnalyzePacket(size_t len, const uint8_t* data, Packet* pkt
 	if ( ! conn )
 		return false;
 
+	lookup_pts.End();
+	ProcessConnPacket(conn, tuple, len, pkt);
+	return true;
+	}
+
+void IPBasedAnalyzer::ProcessConnPacket(Connection* conn, const ConnTuple& tuple, size_t len,
+                                        Packet* pkt)
+	{
+	const std::shared_ptr<IP_Hdr>& ip_hdr = pkt->ip_hdr;
+
 	// If we successfuly made a connection for this packet that means it'll eventually
 	// get logged, which means we can mark this packet as having been processed.
 	pkt->processed = true;
@@ -94,10 +160,23 @@ bool IPBasedAnalyzer::AnalyzePacket(size_t len, const uint8_t* data, Packet* pkt
 
 	// TODO: Does this actually mean anything?
 	if ( conn->GetSessionAdapter()->Skipping() )
-		return true;
+		return;
+
+	zeek::detail::PacketTraceScope delivery_pts(zeek::detail::PacketTracer::ANALYZER_DELIVERY);
+	bool time_cpu = session_mgr->SampleCPU();
+	auto cpu_start = time_cpu ? std::chrono::steady_clock::now()
+	                          : std::chrono::steady_clock::time_point();
 
 	DeliverPacket(conn, run_state::processing_start_time, is_orig, len, pkt);
 
+	if ( time_cpu )
+		{
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - cpu_start;
+		session_mgr->ChargeCPU(conn, elapsed.count());
+		}
+
+	delivery_pts.End();
+
 	run_state::current_timestamp = 0;
 	run_state::current_pkt = nullptr;
 
@@ -114,8 +193,130 @@ bool IPBasedAnalyzer::AnalyzePacket(size_t len, const uint8_t* data, Packet* pkt
 		if ( ! conn->RecordContents() )
 			pkt->dump_size = payload - pkt->data;
 		}
+	}
 
-	return true;
+bool IPBasedAnalyzer::EmbryonicCandidate(size_t len, const Packet* pkt) const
+	{
+	// Events raised for every packet need a connection.
+	if ( new_packet || packet_contents )
+		return false;
+
+	if ( pkt->encap && pkt->encap->Depth() > 0 )
+		return false;
+
+	const auto& ip = pkt->ip_hdr;
+
+	// The headers need to fit into the flow's record, and it only keeps
+	// complete packets.
+	return ! ip->Reassembled() && ip->NumHeaders() == 1 && ip->TotalLen() > 0 &&
+	       ip->TotalLen() <= session::detail::EmbryonicFlow::MAX_PACKET_SIZE &&
+	       len >= static_cast<size_t>(ip->PayloadLen());
+	}
+
+zeek::Connection* IPBasedAnalyzer::PromoteEmbryonic(const detail::ConnKey& key,
+                                                    const session::detail::EmbryonicFlow& flow)
+	{
+	Packet first;
+	flow.InitPacket(&first);
+
+	const auto& ip = first.ip_hdr;
+	size_t len = ip->PayloadLen();
+
+	ConnTuple tuple;
+	if ( ! BuildConnTuple(len, ip->Payload(), &first, tuple) )
+		return nullptr;
+
+	// Process the flow's first packet as if it was just arriving, then
+	// get back to the current one.
+	double saved_start_time = run_state::processing_start_time;
+	double saved_timestamp = run_state::current_timestamp;
+	const Packet* saved_pkt = run_state::current_pkt;
+	run_state::processing_start_time = first.time;
+
+	Connection* conn = NewConn(&tuple, key, &first);
+
+	if ( conn )
+		{
+		session_mgr->Insert(conn, false);
+		ProcessConnPacket(conn, tuple, len, &first);
+		}
+
+	run_state::processing_start_time = saved_start_time;
+	run_state::current_timestamp = saved_timestamp;
+	run_state::current_pkt = saved_pkt;
+
+	return conn;
+	}
+
+bool IPBasedAnalyzer::AggregatePacket(const ConnTuple& tuple, const Packet* pkt)
+	{
+	// Like likely_server_ports, in-core for speed.
+	static std::set<zeek_uint_t> port_cache;
+	static bool have_cache = false;
+
+	if ( ! have_cache )
+		{
+		auto aggregated_ports = id::find_val<TableVal>("aggregated_ports");
+		auto lv = aggregated_ports->ToPureListVal();
+		for ( int i = 0; i < lv->Length(); i++ )
+			port_cache.insert(lv->Idx(i)->InternalUnsigned());
+		have_cache = true;
+		}
+
+	if ( port_cache.empty() || transport == TRANSPORT_TCP )
+		return false;
+
+	// Events raised for every packet need a connection.
+	if ( new_packet || packet_contents )
+		return false;
+
+	auto covered = [this](uint32_t port)
+	{
+		return port_cache.find(port | server_port_mask) != port_cache.end();
+	};
+
+	uint32_t src_port = ntohs(tuple.src_port);
+	uint32_t dst_port = ntohs(tuple.dst_port);
+	uint32_t port;
+	bool is_orig;
+
+	if ( transport == TRANSPORT_ICMP )
+		{
+		// A request carries the type in question, a reply has it as its
+		// counterpart.
+		if ( covered(src_port) )
+			{
+			port = src_port;
+			is_orig = true;
+			}
+		else if ( ! tuple.is_one_way && covered(dst_port) )
+			{
+			port = dst_port;
+			is_orig = false;
+			}
+		else
+			return false;
+		}
+	else
+		{
+		if ( covered(dst_port) )
+			{
+			port = dst_port;
+			is_orig = true;
+			}
+		else if ( covered(src_port) )
+			{
+			port = src_port;
+			is_orig = false;
+			}
+		else
+			return false;
+		}
+
+	const auto& orig = is_orig ? tuple.src_addr : tuple.dst_addr;
+	const auto& resp = is_orig ? tuple.dst_addr : tuple.src_addr;
+
+	return session_mgr->Aggregate(orig, resp, port, transport, is_orig, pkt);
 	}
 
 bool IPBasedAnalyzer::CheckHeaderTrunc(size_t min_hdr_len, size_t remaining, Packet* packet)
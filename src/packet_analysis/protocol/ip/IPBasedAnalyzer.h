@@ -14,6 +14,11 @@ namespace zeek::analyzer::pia
 class PIA;
 	}
 
+namespace zeek::session::detail
+	{
+struct EmbryonicFlow;
+	}
+
 namespace zeek::packet_analysis::IP
 	{
 
@@ -142,6 +147,21 @@ protected:
 		return true;
 		}
 
+	/**
+	 * Upon seeing the first packet of a connection while embryonic_sessions
+	 * is on, checks whether the flow may be tracked in compact form until
+	 * a second packet arrives, rather than as a full connection. Only
+	 * packets that WantConnection() accepts without flipping roles
+	 * qualify. The default never tracks flows in compact form.
+	 *
+	 * @param len The remaining length of the packet's data.
+	 * @param pkt The packet. Its IP and transport headers are known to fit
+	 * into a session::detail::EmbryonicFlow.
+	 * @return How long to wait for a second packet, or zero if the flow
+	 * needs a connection right away.
+	 */
+	virtual double EmbryonicTimeout(size_t len, const Packet* pkt) const { return 0.0; }
+
 	/**
 	 * Returns an analyzer adapter appropriate for this IP-based analyzer. This adapter
 	 * is used to hook into the session analyzer framework. This function can also be used
@@ -198,6 +218,34 @@ private:
 
 	void BuildSessionAnalyzerTree(Connection* conn);
 
+	/**
+	 * Processes a packet belonging to a connection, after it has been
+	 * found or created.
+	 */
+	void ProcessConnPacket(Connection* conn, const ConnTuple& tuple, size_t len, Packet* pkt);
+
+	/**
+	 * Checks the conditions that all flows need to meet for being tracked
+	 * in compact form, see EmbryonicTimeout().
+	 */
+	bool EmbryonicCandidate(size_t len, const Packet* pkt) const;
+
+	/**
+	 * Turns a flow tracked in compact form into a connection, processing
+	 * its first packet again.
+	 */
+	zeek::Connection* PromoteEmbryonic(const detail::ConnKey& key,
+	                                   const session::detail::EmbryonicFlow& flow);
+
+	/**
+	 * Counts a packet of a flow without a connection into the aggregated
+	 * traffic, if aggregated_ports covers it.
+	 *
+	 * @return True if the packet got counted, false if it needs a
+	 * connection.
+	 */
+	bool AggregatePacket(const ConnTuple& tuple, const Packet* pkt);
+
 	TransportProto transport;
 	uint32_t server_port_mask;
 	static TableValPtr ignore_checksums_nets_table;
@@ -6,6 +6,9 @@
 
 using namespace zeek::packet_analysis::IP;
 
+zeek::detail::MemoryPool SessionAdapter::pool("session-adapter",
+                                                zeek::detail::ARENA_SESSIONS);
+
 void SessionAdapter::Done()
 	{
 	Analyzer::Done();
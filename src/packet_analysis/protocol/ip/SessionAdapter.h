@@ -23,6 +23,8 @@ class SessionAdapter : public analyzer::Analyzer
 public:
 	SessionAdapter(const char* name, Connection* conn) : analyzer::Analyzer(name, conn) { }
 
+	ZEEK_POOL_ALLOCATED(pool)
+
 	/**
 	 * Overridden from parent class.
 	 */
@@ -99,6 +101,9 @@ public:
 protected:
 	IPBasedAnalyzer* parent = nullptr;
 	analyzer::pia::PIA* pia = nullptr;
+
+private:
+	static zeek::detail::MemoryPool pool;
 	};
 
 	} // namespace zeek::packet_analysis::IP
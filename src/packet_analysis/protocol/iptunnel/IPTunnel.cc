@@ -225,8 +225,8 @@ void IPTunnelTimer::Dispatch(double t, bool is_expire)
 		analyzer->ip_tunnels.erase(tunnel_idx);
 
 	else if ( ! is_expire )
-		// tunnel activity didn't timeout, schedule another timer
-		zeek::detail::timer_mgr->Add(new IPTunnelTimer(t, tunnel_idx, analyzer));
+		// tunnel activity didn't timeout, check again later
+		Rearm(t + BifConst::Tunnel::ip_tunnel_timeout);
 	}
 
 	} // namespace detail
@@ -15,6 +15,7 @@ public:
 	~RootAnalyzer() override = default;
 
 	bool AnalyzePacket(size_t len, const uint8_t* data, Packet* packet) override;
+	bool IsChainCacheable() const override { return true; }
 
 	static zeek::packet_analysis::AnalyzerPtr Instantiate()
 		{
@@ -6,6 +6,7 @@
 #include "zeek/analyzer/protocol/pia/PIA.h"
 #include "zeek/analyzer/protocol/tcp/events.bif.h"
 #include "zeek/analyzer/protocol/tcp/types.bif.h"
+#include "zeek/net_util.h"
 #include "zeek/packet_analysis/protocol/tcp/TCPSessionAdapter.h"
 
 using namespace zeek;
@@ -92,6 +93,34 @@ bool TCPAnalyzer::WantConnection(uint16_t src_port, uint16_t dst_port, const u_c
 	return true;
 	}
 
+double TCPAnalyzer::EmbryonicTimeout(size_t len, const Packet* pkt) const
+	{
+	// Without an attempt timer, nothing would ever expire such flows.
+	if ( ! zeek::detail::tcp_attempt_delay )
+		return 0.0;
+
+	if ( tcp_packet || connection_SYN_packet || tcp_option || tcp_options )
+		return 0.0;
+
+	const auto& ip = pkt->ip_hdr;
+	const struct tcphdr* tp = (const struct tcphdr*)ip->Payload();
+	uint32_t tcp_hdr_len = tp->th_off * 4;
+
+	// Only a plain SYN without payload, as scans send them.
+	if ( tp->th_flags != TH_SYN || tcp_hdr_len < sizeof(struct tcphdr) ||
+	     tcp_hdr_len != ip->PayloadLen() )
+		return 0.0;
+
+	// A bad checksum would go into the connection's history.
+	if ( ! pkt->l4_checksummed && ! zeek::detail::ignore_checksums &&
+	     ! GetIgnoreChecksumsNets()->Contains(ip->IPHeaderSrcAddr()) &&
+	     zeek::detail::ip_in_cksum(ip->IP4_Hdr(), ip->SrcAddr(), ip->DstAddr(), IPPROTO_TCP,
+	                               reinterpret_cast<const uint8_t*>(tp), tcp_hdr_len) != 0xffff )
+		return 0.0;
+
+	return zeek::detail::tcp_attempt_delay;
+	}
+
 void TCPAnalyzer::DeliverPacket(Connection* c, double t, bool is_orig, int remaining, Packet* pkt)
 	{
 	const u_char* data = pkt->ip_hdr->Payload();
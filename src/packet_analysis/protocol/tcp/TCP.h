@@ -65,6 +65,12 @@ protected:
 	bool WantConnection(uint16_t src_port, uint16_t dst_port, const u_char* data,
 	                    bool& flip_roles) const override;
 
+	/**
+	 * Tracks connection attempts starting with a plain SYN in compact form
+	 * until tcp_attempt_delay passes.
+	 */
+	double EmbryonicTimeout(size_t len, const Packet* pkt) const override;
+
 	/**
 	 * Returns an analyzer adapter appropriate for this IP-based analyzer. This adapter
 	 * is used to hook into the session analyzer framework. This function can also be used
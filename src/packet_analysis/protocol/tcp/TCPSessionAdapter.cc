@@ -23,6 +23,10 @@ using namespace zeek::packet_analysis::TCP;
 
 TCPSessionAdapter::TCPSessionAdapter(Connection* conn)
 	: packet_analysis::IP::SessionAdapter("TCP", conn)
+#ifdef ZEEK_COMPACT_VALUES
+	  ,
+	  orig_endp(this, true), resp_endp(this, false)
+#endif
 	{
 	// Set a timer to eventually time out this connection.
 	ADD_ANALYZER_TIMER(&TCPSessionAdapter::ExpireTimer,
@@ -38,8 +42,13 @@ TCPSessionAdapter::TCPSessionAdapter(Connection* conn)
 	first_packet_seen = 0;
 	is_partial = 0;
 
+#ifdef ZEEK_COMPACT_VALUES
+	orig = &orig_endp;
+	resp = &resp_endp;
+#else
 	orig = new analyzer::tcp::TCP_Endpoint(this, true);
 	resp = new analyzer::tcp::TCP_Endpoint(this, false);
+#endif
 
 	orig->SetPeer(resp);
 	resp->SetPeer(orig);
@@ -50,8 +59,10 @@ TCPSessionAdapter::~TCPSessionAdapter()
 	LOOP_OVER_GIVEN_CHILDREN(i, packet_children)
 	delete *i;
 
+#ifndef ZEEK_COMPACT_VALUES
 	delete orig;
 	delete resp;
+#endif
 	}
 
 void TCPSessionAdapter::Init()
@@ -751,6 +762,19 @@ bool TCPSessionAdapter::RemoveChildAnalyzer(analyzer::ID id)
 	return RemoveChild(packet_children, id);
 	}
 
+bool TCPSessionAdapter::ChildrenDoneWithContent(bool is_orig) const
+	{
+	// Analyzers about to be added haven't had a chance to say so.
+	if ( ! new_children.empty() )
+		return false;
+
+	for ( const auto* child : children )
+		if ( ! (child->IsFinished() || child->Removing() || child->ContentDone(is_orig)) )
+			return false;
+
+	return true;
+	}
+
 void TCPSessionAdapter::EnableReassembly()
 	{
 	SetReassembler(new analyzer::tcp::TCP_Reassembler(
@@ -1166,8 +1190,11 @@ void TCPSessionAdapter::FlipRoles()
 
 void TCPSessionAdapter::UpdateConnVal(RecordVal* conn_val)
 	{
-	auto orig_endp_val = conn_val->GetFieldAs<RecordVal>("orig");
-	auto resp_endp_val = conn_val->GetFieldAs<RecordVal>("resp");
+	static auto orig_idx = id::connection->FieldOffset("orig");
+	static auto resp_idx = id::connection->FieldOffset("resp");
+
+	auto orig_endp_val = conn_val->GetFieldAs<RecordVal>(orig_idx);
+	auto resp_endp_val = conn_val->GetFieldAs<RecordVal>(resp_idx);
 
 	orig_endp_val->Assign(0, orig->Size());
 	orig_endp_val->Assign(1, orig->state);
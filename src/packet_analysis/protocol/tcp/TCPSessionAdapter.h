@@ -54,6 +54,13 @@ public:
 
 	bool HadGap(bool orig) const;
 
+	/**
+	 * Returns true if none of the analyzers below the connection needs
+	 * any further stream data from the given endpoint, because they're
+	 * done with it (see Analyzer::SetContentDone()) or got removed.
+	 */
+	bool ChildrenDoneWithContent(bool is_orig) const;
+
 	analyzer::tcp::TCP_Endpoint* Orig() const { return orig; }
 	analyzer::tcp::TCP_Endpoint* Resp() const { return resp; }
 	int OrigState() const { return orig->state; }
@@ -162,6 +169,12 @@ private:
 
 	void CheckRecording(bool need_contents, analyzer::tcp::TCP_Flags flags);
 
+#ifdef ZEEK_COMPACT_VALUES
+	// The endpoints live right here rather than on the heap. FlipRoles()
+	// swaps the pointers, not the endpoints.
+	analyzer::tcp::TCP_Endpoint orig_endp;
+	analyzer::tcp::TCP_Endpoint resp_endp;
+#endif
 	analyzer::tcp::TCP_Endpoint* orig;
 	analyzer::tcp::TCP_Endpoint* resp;
 
@@ -2,6 +2,7 @@
 
 #include "zeek/packet_analysis/protocol/udp/UDPSessionAdapter.h"
 
+#include "zeek/ID.h"
 #include "zeek/analyzer/Manager.h"
 #include "zeek/analyzer/protocol/conn-size/ConnSize.h"
 #include "zeek/packet_analysis/protocol/udp/events.bif.h"
@@ -26,8 +27,11 @@ void UDPSessionAdapter::AddExtraAnalyzers(Connection* conn)
 
 void UDPSessionAdapter::UpdateConnVal(RecordVal* conn_val)
 	{
-	auto orig_endp = conn_val->GetField("orig");
-	auto resp_endp = conn_val->GetField("resp");
+	static auto orig_idx = id::connection->FieldOffset("orig");
+	static auto resp_idx = id::connection->FieldOffset("resp");
+
+	const auto& orig_endp = conn_val->GetField(orig_idx);
+	const auto& resp_endp = conn_val->GetField(resp_idx);
 
 	UpdateEndpointVal(orig_endp, true);
 	UpdateEndpointVal(resp_endp, false);
@@ -43,7 +47,7 @@ void UDPSessionAdapter::UpdateEndpointVal(const ValPtr& endp_arg, bool is_orig)
 
 	if ( size < 0 )
 		{
-		endp->Assign(0, val_mgr->Count(0));
+		endp->Assign(0, 0);
 		endp->Assign(1, UDP_INACTIVE);
 		}
 
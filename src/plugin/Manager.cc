@@ -231,6 +231,7 @@ bool Manager::ActivateDynamicPluginInternal(const std::string& name, bool ok_if_
 				continue;
 				}
 
+			auto init_start = util::current_time(true);
 			current_plugin->SetDynamic(true);
 			current_plugin->DoConfigure();
 			DBG_LOG(DBG_PLUGINS, "  InitializingComponents");
@@ -243,6 +244,7 @@ bool Manager::ActivateDynamicPluginInternal(const std::string& name, bool ok_if_
 			// fact could be *during* script initialization if we got
 			// triggered via @load-plugin.
 			current_plugin->InitPreScript();
+			AddInitTime(current_plugin, init_start);
 
 			// Make sure the name the plugin reports is consistent with
 			// what we expect from its magic file.
@@ -456,7 +458,9 @@ void Manager::InitPreScript()
 	for ( plugin_list::iterator i = Manager::ActivePluginsInternal()->begin();
 	      i != Manager::ActivePluginsInternal()->end(); i++ )
 		{
+		auto start = util::current_time(true);
 		(*i)->DoConfigure();
+		AddInitTime(*i, start);
 		}
 
 	// Sort plugins by name to make sure we have a deterministic order.
@@ -469,8 +473,10 @@ void Manager::InitPreScript()
 	for ( plugin_list::iterator i = Manager::ActivePluginsInternal()->begin();
 	      i != Manager::ActivePluginsInternal()->end(); i++ )
 		{
+		auto start = util::current_time(true);
 		(*i)->InitializeComponents();
 		(*i)->InitPreScript();
+		AddInitTime(*i, start);
 		}
 
 	init = true;
@@ -487,9 +493,13 @@ void Manager::InitBifs()
 
 		if ( b != bifs->end() )
 			{
+			auto start = util::current_time(true);
+
 			for ( bif_init_func_list::const_iterator j = b->second->begin(); j != b->second->end();
 			      ++j )
 				(**j)(*i);
+
+			AddInitTime(*i, start);
 			}
 		}
 	}
@@ -500,7 +510,16 @@ void Manager::InitPostScript()
 
 	for ( plugin_list::iterator i = Manager::ActivePluginsInternal()->begin();
 	      i != Manager::ActivePluginsInternal()->end(); i++ )
+		{
+		auto start = util::current_time(true);
 		(*i)->InitPostScript();
+		AddInitTime(*i, start);
+		}
+	}
+
+void Manager::AddInitTime(const Plugin* plugin, double start)
+	{
+	init_times[plugin->Name()] += util::current_time(true) - start;
 	}
 
 void Manager::FinishPlugins()
@@ -147,6 +147,14 @@ public:
 	 */
 	inactive_plugin_list InactivePlugins() const;
 
+	/**
+	 * Returns how long each plugin took to initialize, in seconds of
+	 * wall-clock time. This covers configuring the plugin, registering its
+	 * components and BiFs, and its pre- and post-script initialization.
+	 * Plugins are keyed by name.
+	 */
+	const std::map<std::string, double>& InitTimes() const { return init_times; }
+
 	/**
 	 * Returns a list of all available components, in any plugin, that
 	 * are derived from a specific class. The class is given as the
@@ -476,6 +484,7 @@ private:
 	bool ActivateDynamicPluginInternal(const std::string& name, bool ok_if_not_found,
 	                                   std::vector<std::string>* errors);
 	void UpdateInputFiles();
+	void AddInitTime(const Plugin* plugin, double start);
 	void MetaHookPre(HookType hook, const HookArgumentList& args) const;
 	void MetaHookPost(HookType hook, const HookArgumentList& args,
 	                  const HookArgument& result) const;
@@ -500,6 +509,9 @@ private:
 
 	bool init; // Flag indicating whether InitPreScript() has run yet.
 
+	// Initialization time per plugin name, see InitTimes().
+	std::map<std::string, double> init_times;
+
 	// A hook list keeps pairs of plugin and priority interested in a
 	// given hook.
 	using hook_list = std::list<std::pair<int, Plugin*>>;
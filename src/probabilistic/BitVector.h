@@ -246,6 +246,14 @@ public:
 	 */
 	size_type Blocks() const;
 
+	/**
+	 * Provides direct access to the underlying storage, for operating on
+	 * whole blocks at a time.
+	 * @return A pointer to the first of `Blocks()` blocks.
+	 */
+	block_type* Data() { return bits.data(); }
+	const block_type* Data() const { return bits.data(); }
+
 	/**
 	 * Retrieves the number of bits the bitvector consist of.
 	 * @return The length of the bit vector in bits.
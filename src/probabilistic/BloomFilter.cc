@@ -2,12 +2,22 @@
 
 #include "zeek/probabilistic/BloomFilter.h"
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <broker/data.hh>
 #include <broker/error.hh>
+#include <algorithm>
+#include <cerrno>
 #include <cmath>
+#include <cstdio>
+#include <cstring>
 #include <limits>
+#include <utility>
 
 #include "zeek/Reporter.h"
+#include "zeek/RunState.h"
 #include "zeek/probabilistic/CounterVector.h"
 #include "zeek/util.h"
 
@@ -70,6 +80,21 @@ std::unique_ptr<BloomFilter> BloomFilter::Unserialize(const broker::data& data)
 		case Counting:
 			bf = std::unique_ptr<BloomFilter>(new CountingBloomFilter());
 			break;
+
+		case Blocked:
+			bf = std::unique_ptr<BloomFilter>(new BlockedBloomFilter());
+			break;
+
+		case Aging:
+			bf = std::unique_ptr<BloomFilter>(new AgingBloomFilter());
+			break;
+
+		case Mapped:
+			bf = std::unique_ptr<BloomFilter>(new MappedBloomFilter());
+			break;
+
+		default:
+			return nullptr;
 		}
 
 	if ( ! bf->DoUnserialize((*v)[2]) )
@@ -371,4 +396,661 @@ bool CountingBloomFilter::DoUnserialize(const broker::data& data)
 	return true;
 	}
 
+BlockedBloomFilter::BlockedBloomFilter()
+	{
+	bits = nullptr;
+	}
+
+BlockedBloomFilter::BlockedBloomFilter(const detail::Hasher* hasher, size_t cells)
+	: BloomFilter(hasher)
+	{
+	size_t blocks = std::max((cells + BLOCK_BITS - 1) / BLOCK_BITS, static_cast<size_t>(1));
+	bits = new detail::BitVector(blocks * BLOCK_BITS);
+	}
+
+BlockedBloomFilter::~BlockedBloomFilter()
+	{
+	delete bits;
+	}
+
+bool BlockedBloomFilter::Empty() const
+	{
+	return bits->AllZero();
+	}
+
+void BlockedBloomFilter::Clear()
+	{
+	bits->Reset();
+	}
+
+bool BlockedBloomFilter::Merge(const BloomFilter* other)
+	{
+	if ( typeid(*this) != typeid(*other) )
+		return false;
+
+	const BlockedBloomFilter* o = static_cast<const BlockedBloomFilter*>(other);
+
+	if ( ! hasher->Equals(o->hasher) )
+		{
+		reporter->Error("incompatible hashers in BlockedBloomFilter merge");
+		return false;
+		}
+
+	else if ( bits->Size() != o->bits->Size() )
+		{
+		reporter->Error("different bitvector size in BlockedBloomFilter merge");
+		return false;
+		}
+
+	(*bits) |= *o->bits;
+
+	return true;
+	}
+
+BlockedBloomFilter* BlockedBloomFilter::Intersect(const BloomFilter* other) const
+	{
+	if ( typeid(*this) != typeid(*other) )
+		return nullptr;
+
+	const BlockedBloomFilter* o = static_cast<const BlockedBloomFilter*>(other);
+
+	if ( ! hasher->Equals(o->hasher) )
+		{
+		reporter->Error("incompatible hashers in BlockedBloomFilter intersect");
+		return nullptr;
+		}
+
+	else if ( bits->Size() != o->bits->Size() )
+		{
+		reporter->Error("different bitvector size in BlockedBloomFilter intersect");
+		return nullptr;
+		}
+
+	auto copy = Clone();
+	(*copy->bits) &= *o->bits;
+
+	return copy;
+	}
+
+BlockedBloomFilter* BlockedBloomFilter::Clone() const
+	{
+	BlockedBloomFilter* copy = new BlockedBloomFilter();
+
+	copy->hasher = hasher->Clone();
+	copy->bits = new detail::BitVector(*bits);
+
+	return copy;
+	}
+
+std::string BlockedBloomFilter::InternalState() const
+	{
+	return util::fmt("%" PRIu64, bits->Hash());
+	}
+
+size_t BlockedBloomFilter::Mask(const zeek::detail::HashKey* key, uint64_t* mask) const
+	{
+	// One keyed hash provides everything: the upper half picks the block
+	// (by multiplying rather than by a modulo), the lower half and a
+	// mix of the upper one are the two hashes for the bit positions.
+	uint64_t d = detail::UHF(hasher->Seed())(key->Key(), key->Size());
+	uint64_t blocks = bits->Size() / BLOCK_BITS;
+	uint64_t block = ((d >> 32) * blocks) >> 32;
+	uint32_t h1 = static_cast<uint32_t>(d);
+	uint32_t h2 = static_cast<uint32_t>(((d >> 32) * 0x9e3779b97f4a7c15ULL) >> 32) | 1;
+
+	for ( size_t w = 0; w < BLOCK_WORDS; ++w )
+		mask[w] = 0;
+
+	for ( size_t i = 0; i < hasher->K(); ++i )
+		{
+		// The top nine bits address the block's 512 bits.
+		uint32_t pos = (h1 + static_cast<uint32_t>(i) * h2) >> 23;
+		mask[pos / 64] |= uint64_t(1) << (pos % 64);
+		}
+
+	return block * BLOCK_WORDS;
+	}
+
+void BlockedBloomFilter::Add(const zeek::detail::HashKey* key)
+	{
+	uint64_t mask[BLOCK_WORDS];
+	auto* block = bits->Data() + Mask(key, mask);
+
+	for ( size_t w = 0; w < BLOCK_WORDS; ++w )
+		block[w] |= mask[w];
+	}
+
+bool BlockedBloomFilter::Decrement(const zeek::detail::HashKey* key)
+	{
+	// operation not supported by blocked bloom filter
+	return false;
+	}
+
+size_t BlockedBloomFilter::Count(const zeek::detail::HashKey* key) const
+	{
+	uint64_t mask[BLOCK_WORDS];
+	const auto* block = bits->Data() + Mask(key, mask);
+
+	// Compares the whole block without branching, which the compiler
+	// turns into a few vector instructions.
+	uint64_t missing = 0;
+
+	for ( size_t w = 0; w < BLOCK_WORDS; ++w )
+		missing |= mask[w] & ~block[w];
+
+	return missing == 0 ? 1 : 0;
+	}
+
+broker::expected<broker::data> BlockedBloomFilter::DoSerialize() const
+	{
+	auto b = bits->Serialize();
+	return b;
+	}
+
+bool BlockedBloomFilter::DoUnserialize(const broker::data& data)
+	{
+	auto b = detail::BitVector::Unserialize(data);
+	if ( ! b || b->Size() == 0 || b->Size() % BLOCK_BITS != 0 )
+		return false;
+
+	bits = b.release();
+	return true;
+	}
+
+AgingBloomFilter::AgingBloomFilter()
+	{
+	current = previous = nullptr;
+	started = window = 0;
+	}
+
+AgingBloomFilter::AgingBloomFilter(const detail::Hasher* hasher, size_t cells, double arg_window)
+	: BloomFilter(hasher)
+	{
+	current = new detail::BitVector(cells);
+	previous = new detail::BitVector(cells);
+	started = run_state::network_time;
+	window = arg_window;
+	}
+
+AgingBloomFilter::~AgingBloomFilter()
+	{
+	delete current;
+	delete previous;
+	}
+
+void AgingBloomFilter::Age(double now) const
+	{
+	// Filters created before network time is known start with it.
+	if ( started == 0 )
+		{
+		started = now;
+		return;
+		}
+
+	if ( window <= 0 || now < started + window )
+		return;
+
+	if ( now >= started + 2 * window )
+		{
+		// Both generations are past their time.
+		current->Reset();
+		previous->Reset();
+		}
+	else
+		{
+		std::swap(current, previous);
+		current->Reset();
+		}
+
+	// Generations keep starting at multiples of the window, so that they
+	// line up between filters of the same window.
+	started += std::floor((now - started) / window) * window;
+	}
+
+bool AgingBloomFilter::Empty() const
+	{
+	Age(run_state::network_time);
+	return current->AllZero() && previous->AllZero();
+	}
+
+void AgingBloomFilter::Clear()
+	{
+	current->Reset();
+	previous->Reset();
+	}
+
+bool AgingBloomFilter::Merge(const BloomFilter* other)
+	{
+	if ( typeid(*this) != typeid(*other) )
+		return false;
+
+	const AgingBloomFilter* o = static_cast<const AgingBloomFilter*>(other);
+
+	if ( ! hasher->Equals(o->hasher) )
+		{
+		reporter->Error("incompatible hashers in AgingBloomFilter merge");
+		return false;
+		}
+
+	else if ( current->Size() != o->current->Size() )
+		{
+		reporter->Error("different bitvector size in AgingBloomFilter merge");
+		return false;
+		}
+
+	else if ( window != o->window )
+		{
+		reporter->Error("different windows in AgingBloomFilter merge");
+		return false;
+		}
+
+	// Brings both to the same generation first.
+	Age(run_state::network_time);
+	o->Age(run_state::network_time);
+
+	(*current) |= *o->current;
+	(*previous) |= *o->previous;
+
+	return true;
+	}
+
+AgingBloomFilter* AgingBloomFilter::Intersect(const BloomFilter* other) const
+	{
+	if ( typeid(*this) != typeid(*other) )
+		return nullptr;
+
+	const AgingBloomFilter* o = static_cast<const AgingBloomFilter*>(other);
+
+	if ( ! hasher->Equals(o->hasher) )
+		{
+		reporter->Error("incompatible hashers in AgingBloomFilter intersect");
+		return nullptr;
+		}
+
+	else if ( current->Size() != o->current->Size() )
+		{
+		reporter->Error("different bitvector size in AgingBloomFilter intersect");
+		return nullptr;
+		}
+
+	else if ( window != o->window )
+		{
+		reporter->Error("different windows in AgingBloomFilter intersect");
+		return nullptr;
+		}
+
+	Age(run_state::network_time);
+	o->Age(run_state::network_time);
+
+	auto copy = Clone();
+	(*copy->current) &= *o->current;
+	(*copy->previous) &= *o->previous;
+
+	return copy;
+	}
+
+AgingBloomFilter* AgingBloomFilter::Clone() const
+	{
+	AgingBloomFilter* copy = new AgingBloomFilter();
+
+	copy->hasher = hasher->Clone();
+	copy->current = new detail::BitVector(*current);
+	copy->previous = new detail::BitVector(*previous);
+	copy->started = started;
+	copy->window = window;
+
+	return copy;
+	}
+
+std::string AgingBloomFilter::InternalState() const
+	{
+	return util::fmt("%" PRIu64 " %" PRIu64, current->Hash(), previous->Hash());
+	}
+
+void AgingBloomFilter::Add(const zeek::detail::HashKey* key)
+	{
+	Age(run_state::network_time);
+
+	detail::Hasher::digest_vector h = hasher->Hash(key);
+
+	for ( size_t i = 0; i < h.size(); ++i )
+		current->Set(h[i] % current->Size());
+	}
+
+bool AgingBloomFilter::Decrement(const zeek::detail::HashKey* key)
+	{
+	// operation not supported by aging bloom filter
+	return false;
+	}
+
+size_t AgingBloomFilter::Count(const zeek::detail::HashKey* key) const
+	{
+	Age(run_state::network_time);
+
+	detail::Hasher::digest_vector h = hasher->Hash(key);
+	bool in_current = true;
+	bool in_previous = true;
+
+	for ( size_t i = 0; i < h.size() && (in_current || in_previous); ++i )
+		{
+		auto pos = h[i] % current->Size();
+		in_current = in_current && (*current)[pos];
+		in_previous = in_previous && (*previous)[pos];
+		}
+
+	return (in_current || in_previous) ? 1 : 0;
+	}
+
+broker::expected<broker::data> AgingBloomFilter::DoSerialize() const
+	{
+	auto c = current->Serialize();
+	auto p = previous->Serialize();
+
+	if ( ! (c && p) )
+		return broker::ec::invalid_data;
+
+	return {broker::vector{window, started, std::move(*c), std::move(*p)}};
+	}
+
+bool AgingBloomFilter::DoUnserialize(const broker::data& data)
+	{
+	auto v = broker::get_if<broker::vector>(&data);
+
+	if ( ! (v && v->size() == 4) )
+		return false;
+
+	auto window_ = broker::get_if<double>(&(*v)[0]);
+	auto started_ = broker::get_if<double>(&(*v)[1]);
+	auto c = detail::BitVector::Unserialize((*v)[2]);
+	auto p = detail::BitVector::Unserialize((*v)[3]);
+
+	if ( ! (window_ && started_ && c && p) || c->Size() != p->Size() )
+		return false;
+
+	window = *window_;
+	started = *started_;
+	current = c.release();
+	previous = p.release();
+	return true;
+	}
+
+static constexpr char mapped_magic[8] = {'Z', 'E', 'E', 'K', 'B', 'F', '0', '1'};
+
+// The hasher's type, k and seed, the cells and the metadata's length.
+static constexpr size_t mapped_fields = 6;
+static constexpr size_t mapped_header_size = sizeof(mapped_magic) + mapped_fields * sizeof(uint64_t);
+
+static std::string errno_msg(const char* what, const std::string& path)
+	{
+	return std::string(what) + " " + path + ": " + strerror(errno);
+	}
+
+struct MappedBloomFilter::Mapping
+	{
+	~Mapping() { munmap(const_cast<char*>(base), size); }
+
+	std::string path;
+	const char* base = nullptr;
+	size_t size = 0;
+	std::string meta;
+	const uint64_t* bits = nullptr;
+	size_t cells = 0;
+	size_t blocks = 0;
+	};
+
+bool MappedBloomFilter::Write(const std::string& path, const BasicBloomFilter* bf,
+                              const std::string& meta, std::string* error)
+	{
+	// The hasher's type isn't public otherwise.
+	auto h = bf->hasher->Serialize();
+	auto hv = h ? broker::get_if<broker::vector>(&*h) : nullptr;
+
+	if ( ! (hv && hv->size() == 4) )
+		{
+		*error = "cannot write the Bloom filter's hasher to " + path;
+		return false;
+		}
+
+	uint64_t fields[mapped_fields];
+
+	for ( size_t i = 0; i < 4; ++i )
+		{
+		auto x = broker::get_if<uint64_t>(&(*hv)[i]);
+
+		if ( ! x )
+			{
+			*error = "cannot write the Bloom filter's hasher to " + path;
+			return false;
+			}
+
+		fields[i] = *x;
+		}
+
+	fields[4] = bf->bits->Size();
+	fields[5] = meta.size();
+
+	const char padding[sizeof(uint64_t)] = {};
+	auto padding_len = (sizeof(uint64_t) - meta.size() % sizeof(uint64_t)) % sizeof(uint64_t);
+	const auto* blocks = bf->bits->Data();
+	auto num_blocks = bf->bits->Blocks();
+
+	// Write a new file and move it into place, rather than changing a
+	// file that others may have mapped.
+	auto tmp_path = path + ".tmp";
+	FILE* f = fopen(tmp_path.c_str(), "wb");
+
+	if ( ! f )
+		{
+		*error = errno_msg("cannot create", tmp_path);
+		return false;
+		}
+
+	// The bits go straight from the filter, as they may be large.
+	bool ok = fwrite(mapped_magic, sizeof(mapped_magic), 1, f) == 1 &&
+	          fwrite(fields, sizeof(fields), 1, f) == 1 &&
+	          fwrite(meta.data(), 1, meta.size(), f) == meta.size() &&
+	          fwrite(padding, 1, padding_len, f) == padding_len &&
+	          fwrite(blocks, sizeof(*blocks), num_blocks, f) == num_blocks;
+
+	if ( fclose(f) != 0 )
+		ok = false;
+
+	if ( ! ok )
+		{
+		*error = errno_msg("cannot write", tmp_path);
+		unlink(tmp_path.c_str());
+		return false;
+		}
+
+	if ( rename(tmp_path.c_str(), path.c_str()) != 0 )
+		{
+		*error = errno_msg("cannot rename to", path);
+		unlink(tmp_path.c_str());
+		return false;
+		}
+
+	return true;
+	}
+
+std::unique_ptr<MappedBloomFilter> MappedBloomFilter::Open(const std::string& path,
+                                                           std::string* error)
+	{
+	int fd = open(path.c_str(), O_RDONLY);
+
+	if ( fd < 0 )
+		{
+		*error = errno_msg("cannot open", path);
+		return nullptr;
+		}
+
+	struct stat st;
+
+	if ( fstat(fd, &st) != 0 )
+		{
+		*error = errno_msg("cannot stat", path);
+		close(fd);
+		return nullptr;
+		}
+
+	size_t size = st.st_size;
+
+	if ( size < mapped_header_size )
+		{
+		*error = path + " is not a mapped Bloom filter";
+		close(fd);
+		return nullptr;
+		}
+
+	void* base = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if ( base == MAP_FAILED )
+		{
+		*error = errno_msg("cannot map", path);
+		return nullptr;
+		}
+
+	auto m = std::make_shared<Mapping>();
+	m->path = path;
+	m->base = static_cast<const char*>(base);
+	m->size = size;
+
+	uint64_t fields[mapped_fields];
+	memcpy(fields, m->base + sizeof(mapped_magic), sizeof(fields));
+
+	auto cells = fields[4];
+	auto meta_len = fields[5];
+	auto available = size - mapped_header_size;
+	auto padded_len = meta_len + (sizeof(uint64_t) - meta_len % sizeof(uint64_t)) % sizeof(uint64_t);
+	auto blocks = cells / 64 + (cells % 64 != 0);
+
+	if ( memcmp(m->base, mapped_magic, sizeof(mapped_magic)) != 0 || cells == 0 ||
+	     meta_len > available || padded_len > available ||
+	     (available - padded_len) / sizeof(uint64_t) < blocks )
+		{
+		*error = path + " is not a valid mapped Bloom filter";
+		return nullptr;
+		}
+
+	auto hasher = detail::Hasher::Unserialize(
+		broker::vector{fields[0], fields[1], fields[2], fields[3]});
+
+	if ( ! hasher )
+		{
+		*error = path + " has an unknown hasher";
+		return nullptr;
+		}
+
+	m->meta.assign(m->base + mapped_header_size, meta_len);
+	// Aligned, as the mapping starts at a page.
+	m->bits = reinterpret_cast<const uint64_t*>(m->base + mapped_header_size + padded_len);
+	m->cells = cells;
+	m->blocks = blocks;
+
+	std::unique_ptr<MappedBloomFilter> bf{new MappedBloomFilter()};
+	bf->hasher = hasher.release();
+	bf->mapping = std::move(m);
+	return bf;
+	}
+
+MappedBloomFilter::MappedBloomFilter() { }
+
+MappedBloomFilter::~MappedBloomFilter() { }
+
+std::string MappedBloomFilter::Meta() const
+	{
+	return mapping->meta;
+	}
+
+bool MappedBloomFilter::Empty() const
+	{
+	for ( size_t i = 0; i < mapping->blocks; ++i )
+		if ( mapping->bits[i] )
+			return false;
+
+	return true;
+	}
+
+void MappedBloomFilter::Clear()
+	{
+	reporter->Error("cannot clear a Bloom filter mapped from a file");
+	}
+
+bool MappedBloomFilter::Merge(const BloomFilter* other)
+	{
+	reporter->Error("cannot merge into a Bloom filter mapped from a file");
+	return false;
+	}
+
+MappedBloomFilter* MappedBloomFilter::Clone() const
+	{
+	MappedBloomFilter* copy = new MappedBloomFilter();
+
+	copy->hasher = hasher->Clone();
+	copy->mapping = mapping;
+
+	return copy;
+	}
+
+MappedBloomFilter* MappedBloomFilter::Intersect(const BloomFilter* other) const
+	{
+	reporter->Error("cannot intersect a Bloom filter mapped from a file");
+	return nullptr;
+	}
+
+std::string MappedBloomFilter::InternalState() const
+	{
+	// The same as for the basic filter that got written, for testing.
+	detail::BitVector bits(mapping->bits, mapping->bits + mapping->blocks);
+	return util::fmt("%" PRIu64, bits.Hash());
+	}
+
+void MappedBloomFilter::Add(const zeek::detail::HashKey* key)
+	{
+	reporter->Error("cannot add to a Bloom filter mapped from a file");
+	}
+
+bool MappedBloomFilter::Decrement(const zeek::detail::HashKey* key)
+	{
+	// operation not supported by mapped bloom filter
+	return false;
+	}
+
+size_t MappedBloomFilter::Count(const zeek::detail::HashKey* key) const
+	{
+	detail::Hasher::digest_vector h = hasher->Hash(key);
+
+	for ( size_t i = 0; i < h.size(); ++i )
+		{
+		auto pos = h[i] % mapping->cells;
+
+		if ( ! ((mapping->bits[pos / 64] >> (pos % 64)) & 1) )
+			return 0;
+		}
+
+	return 1;
+	}
+
+broker::expected<broker::data> MappedBloomFilter::DoSerialize() const
+	{
+	// The receiver maps the same file, which only works on the same host.
+	return {mapping->path};
+	}
+
+bool MappedBloomFilter::DoUnserialize(const broker::data& data)
+	{
+	auto path = broker::get_if<std::string>(&data);
+	if ( ! path )
+		return false;
+
+	std::string error;
+	auto bf = Open(*path, &error);
+	if ( ! bf )
+		return false;
+
+	// Unserialize() sets the hasher that went along.
+	mapping = bf->mapping;
+	return true;
+	}
+
 	} // namespace zeek::probabilistic
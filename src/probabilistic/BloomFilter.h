@@ -28,7 +28,10 @@ class CounterVector;
 enum BloomFilterType
 	{
 	Basic,
-	Counting
+	Counting,
+	Blocked,
+	Aging,
+	Mapped
 	};
 
 /**
@@ -136,6 +139,7 @@ protected:
 	};
 
 class CountingBloomFilter;
+class MappedBloomFilter;
 
 /**
  * A basic Bloom filter.
@@ -143,6 +147,7 @@ class CountingBloomFilter;
 class BasicBloomFilter : public BloomFilter
 	{
 	friend class CountingBloomFilter;
+	friend class MappedBloomFilter;
 
 public:
 	/**
@@ -281,4 +286,222 @@ private:
 	detail::CounterVector* cells;
 	};
 
+/**
+ * A blocked Bloom filter. Each element maps to a single block of 512 bits,
+ * the size of a cache line, and sets all of its *k* bits within that
+ * block. This makes adds and lookups touch a single cache line rather
+ * than *k* of them, at the cost of a slightly higher false-positive rate
+ * than a basic Bloom filter of the same size.
+ *
+ * All positions derive from a single hash of the element: its upper half
+ * selects the block, its lower half seeds the double hashing of the bit
+ * positions inside it.
+ */
+class BlockedBloomFilter : public BloomFilter
+	{
+public:
+	/**
+	 * The number of bits per block.
+	 */
+	static constexpr size_t BLOCK_BITS = 512;
+
+	/**
+	 * Constructs a blocked Bloom filter.
+	 *
+	 * @param hasher The hasher to use. Only its seed and its number of
+	 * hash functions *k* matter.
+	 *
+	 * @param cells The number of cells, rounded up to a multiple of
+	 * BLOCK_BITS.
+	 */
+	BlockedBloomFilter(const detail::Hasher* hasher, size_t cells);
+
+	/**
+	 * Destructor.
+	 */
+	~BlockedBloomFilter() override;
+
+	// Overridden from BloomFilter.
+	bool Empty() const override;
+	void Clear() override;
+	bool Merge(const BloomFilter* other) override;
+	BlockedBloomFilter* Clone() const override;
+	BlockedBloomFilter* Intersect(const BloomFilter* other) const override;
+	std::string InternalState() const override;
+
+protected:
+	friend class BloomFilter;
+
+	/**
+	 * Default constructor.
+	 */
+	BlockedBloomFilter();
+
+	// Overridden from BloomFilter.
+	void Add(const zeek::detail::HashKey* key) override;
+	bool Decrement(const zeek::detail::HashKey* key) override;
+	size_t Count(const zeek::detail::HashKey* key) const override;
+	broker::expected<broker::data> DoSerialize() const override;
+	bool DoUnserialize(const broker::data& data) override;
+	BloomFilterType Type() const override { return BloomFilterType::Blocked; }
+
+private:
+	static constexpr size_t BLOCK_WORDS = BLOCK_BITS / 64;
+
+	// Computes the key's block and the mask of its bits within it,
+	// returning the index of the block's first word.
+	size_t Mask(const zeek::detail::HashKey* key, uint64_t* mask) const;
+
+	detail::BitVector* bits;
+	};
+
+/**
+ * A Bloom filter that forgets elements over time, for tracking what was
+ * seen within a recent window. It keeps two generations of bits, one
+ * being filled and the one before it. Once a window's worth of network
+ * time has passed, the older generation gets dropped and a new one
+ * starts, so that an element remains in the filter for at least one
+ * window and at most two after it was last added.
+ */
+class AgingBloomFilter : public BloomFilter
+	{
+public:
+	/**
+	 * Constructs an aging Bloom filter.
+	 *
+	 * @param hasher The hasher to use. The ideal number of hash
+	 * functions can be computed with BasicBloomFilter::K().
+	 *
+	 * @param cells The number of cells of each generation.
+	 *
+	 * @param window The network time after which a generation ages.
+	 */
+	AgingBloomFilter(const detail::Hasher* hasher, size_t cells, double window);
+
+	/**
+	 * Destructor.
+	 */
+	~AgingBloomFilter() override;
+
+	// Overridden from BloomFilter.
+	bool Empty() const override;
+	void Clear() override;
+	bool Merge(const BloomFilter* other) override;
+	AgingBloomFilter* Clone() const override;
+	AgingBloomFilter* Intersect(const BloomFilter* other) const override;
+	std::string InternalState() const override;
+
+protected:
+	friend class BloomFilter;
+
+	/**
+	 * Default constructor.
+	 */
+	AgingBloomFilter();
+
+	// Overridden from BloomFilter.
+	void Add(const zeek::detail::HashKey* key) override;
+	bool Decrement(const zeek::detail::HashKey* key) override;
+	size_t Count(const zeek::detail::HashKey* key) const override;
+	broker::expected<broker::data> DoSerialize() const override;
+	bool DoUnserialize(const broker::data& data) override;
+	BloomFilterType Type() const override { return BloomFilterType::Aging; }
+
+private:
+	// Starts new generations as far as network time requires.
+	void Age(double now) const;
+
+	// Generations change with time, also when only looking up elements.
+	mutable detail::BitVector* current;
+	mutable detail::BitVector* previous;
+	mutable double started; // network time the current generation started
+	double window;
+	};
+
+/**
+ * A read-only basic Bloom filter kept in a file that processes map into
+ * memory rather than load, so that all processes on a host using the same
+ * file, such as the workers of a cluster, share a single copy of it
+ * through the page cache. Lookups match those of the BasicBloomFilter that
+ * the file got written from.
+ *
+ * The file starts with an 8-byte magic, followed by the hasher's type, *k*
+ * and seed, the number of cells and the length of the caller's metadata,
+ * all as uint64_t. Then come the metadata, padded to 8 bytes, and the
+ * filter's bits as uint64_t blocks. Numbers are in host byte order, as the
+ * file is meant to be used on the host that wrote it.
+ */
+class MappedBloomFilter : public BloomFilter
+	{
+public:
+	/**
+	 * Writes a basic Bloom filter to a file, replacing any previous one
+	 * atomically so that processes mapping the old file keep a
+	 * consistent view of it.
+	 *
+	 * @param path The file's path.
+	 *
+	 * @param bf The Bloom filter to write.
+	 *
+	 * @param meta Data to store along with the filter, see Meta().
+	 *
+	 * @param error Receives a description of the problem on failure.
+	 *
+	 * @return False on failure.
+	 */
+	static bool Write(const std::string& path, const BasicBloomFilter* bf, const std::string& meta,
+	                  std::string* error);
+
+	/**
+	 * Maps a file that Write() created.
+	 *
+	 * @param path The file's path.
+	 *
+	 * @param error Receives a description of the problem on failure.
+	 *
+	 * @return The Bloom filter, or nullptr on failure.
+	 */
+	static std::unique_ptr<MappedBloomFilter> Open(const std::string& path, std::string* error);
+
+	/**
+	 * Destructor.
+	 */
+	~MappedBloomFilter() override;
+
+	/**
+	 * Returns the data that Write() stored along with the filter.
+	 */
+	std::string Meta() const;
+
+	// Overridden from BloomFilter.
+	bool Empty() const override;
+	void Clear() override;
+	bool Merge(const BloomFilter* other) override;
+	MappedBloomFilter* Clone() const override;
+	MappedBloomFilter* Intersect(const BloomFilter* other) const override;
+	std::string InternalState() const override;
+
+protected:
+	friend class BloomFilter;
+
+	/**
+	 * Default constructor.
+	 */
+	MappedBloomFilter();
+
+	// Overridden from BloomFilter.
+	void Add(const zeek::detail::HashKey* key) override;
+	bool Decrement(const zeek::detail::HashKey* key) override;
+	size_t Count(const zeek::detail::HashKey* key) const override;
+	broker::expected<broker::data> DoSerialize() const override;
+	bool DoUnserialize(const broker::data& data) override;
+	BloomFilterType Type() const override { return BloomFilterType::Mapped; }
+
+private:
+	struct Mapping;
+
+	// Clones share the mapping, which never changes.
+	std::shared_ptr<const Mapping> mapping;
+	};
+
 	} // namespace zeek::probabilistic
@@ -3,6 +3,7 @@
 #include "zeek/probabilistic/CardinalityCounter.h"
 
 #include <broker/data.hh>
+#include <algorithm>
 #include <cmath>
 #include <cstdint>
 #include <utility>
@@ -61,16 +62,20 @@ void CardinalityCounter::Init(uint64_t size)
 
 	p = calc_p;
 
-	buckets.reserve(m);
-	for ( uint64_t i = 0; i < m; i++ )
-		buckets.push_back(0);
+	// Huge counters use indices that don't fit into a sparse entry.
+	sparse = m <= SPARSE_MAX_M;
 
-	assert(buckets.size() == m);
+	if ( ! sparse )
+		{
+		buckets.assign(m, 0);
+		assert(buckets.size() == m);
+		}
 
 	V = m;
 	}
 
-CardinalityCounter::CardinalityCounter(CardinalityCounter& other) : buckets(other.buckets)
+CardinalityCounter::CardinalityCounter(CardinalityCounter& other)
+	: buckets(other.buckets), sparse_buckets(other.sparse_buckets), sparse(other.sparse)
 	{
 	V = other.V;
 	alpha_m = other.alpha_m;
@@ -87,6 +92,8 @@ CardinalityCounter::CardinalityCounter(CardinalityCounter&& o) noexcept
 
 	o.m = 0;
 	buckets = std::move(o.buckets);
+	sparse_buckets = std::move(o.sparse_buckets);
+	sparse = o.sparse;
 	}
 
 CardinalityCounter::CardinalityCounter(double error_margin, double confidence)
@@ -106,9 +113,7 @@ CardinalityCounter::CardinalityCounter(uint64_t arg_size, uint64_t arg_V, double
 	{
 	m = arg_size;
 
-	buckets.reserve(m);
-	for ( uint64_t i = 0; i < m; i++ )
-		buckets.push_back(0);
+	buckets.assign(m, 0);
 
 	alpha_m = arg_alpha_m;
 	V = arg_V;
@@ -131,11 +136,17 @@ void CardinalityCounter::AddElement(uint64_t hash)
 	uint64_t index = hash % m;
 	hash = hash - index;
 
+	uint8_t temp = Rank(hash);
+
+	if ( sparse )
+		{
+		AddSparse(index, temp);
+		return;
+		}
+
 	if ( buckets[index] == 0 )
 		V--;
 
-	uint8_t temp = Rank(hash);
-
 	if ( temp > buckets[index] )
 		buckets[index] = temp;
 	}
@@ -151,9 +162,29 @@ void CardinalityCounter::AddElement(uint64_t hash)
  **/
 double CardinalityCounter::Size() const
 	{
+	// Summing up per bucket value rather than per bucket saves a pow()
+	// for each bucket. Smallest terms go first, for precision.
+	uint64_t counts[256] = {};
+
+	if ( sparse )
+		{
+		counts[0] = m - sparse_buckets.size();
+
+		for ( auto e : sparse_buckets )
+			++counts[e & 0xff];
+		}
+	else
+		{
+		for ( uint64_t i = 0; i < m; i++ )
+			++counts[buckets[i]];
+		}
+
 	double answer = 0;
-	for ( unsigned int i = 0; i < m; i++ )
-		answer += pow(2, -((int)buckets[i]));
+	for ( int i = 255; i >= 0; i-- )
+		{
+		if ( counts[i] )
+			answer += counts[i] * ldexp(1.0, -i);
+		}
 
 	answer = 1 / answer;
 	answer = (alpha_m * m * m * answer);
@@ -173,24 +204,131 @@ bool CardinalityCounter::Merge(CardinalityCounter* c)
 	if ( m != c->GetM() )
 		return false;
 
-	const std::vector<uint8_t>& temp = c->GetBuckets();
+	if ( sparse && c->sparse )
+		{
+		const auto& a = sparse_buckets;
+		const auto& b = c->sparse_buckets;
+		std::vector<uint32_t> merged;
+		merged.reserve(a.size() + b.size());
+
+		size_t i = 0;
+		size_t j = 0;
+
+		while ( i < a.size() && j < b.size() )
+			{
+			if ( (a[i] >> 8) < (b[j] >> 8) )
+				merged.push_back(a[i++]);
+			else if ( (b[j] >> 8) < (a[i] >> 8) )
+				merged.push_back(b[j++]);
+			else
+				merged.push_back(std::max(a[i++], b[j++]));
+			}
+
+		merged.insert(merged.end(), a.begin() + i, a.end());
+		merged.insert(merged.end(), b.begin() + j, b.end());
+
+		sparse_buckets.swap(merged);
+		V = m - sparse_buckets.size();
+
+		if ( sparse_buckets.size() > SparseLimit() )
+			Densify();
+
+		return true;
+		}
+
+	Densify();
 
-	V = 0;
+	uint8_t* dst = buckets.data();
 
-	for ( size_t i = 0; i < m; i++ )
+	if ( c->sparse )
+		{
+		for ( auto e : c->sparse_buckets )
+			dst[e >> 8] = std::max(dst[e >> 8], static_cast<uint8_t>(e & 0xff));
+		}
+	else
 		{
-		if ( temp[i] > buckets[i] )
-			buckets[i] = temp[i];
+		// Plain loops over the bytes, without branches, so that the
+		// compiler vectorizes them.
+		const uint8_t* src = c->buckets.data();
 
-		if ( buckets[i] == 0 )
-			++V;
+		for ( size_t i = 0; i < m; i++ )
+			dst[i] = std::max(dst[i], src[i]);
 		}
 
+	uint64_t zeros = 0;
+
+	for ( size_t i = 0; i < m; i++ )
+		zeros += (dst[i] == 0);
+
+	V = zeros;
+
 	return true;
 	}
 
+void CardinalityCounter::AddSparse(uint64_t index, uint8_t rank)
+	{
+	uint32_t key = static_cast<uint32_t>(index << 8);
+	auto it = std::lower_bound(sparse_buckets.begin(), sparse_buckets.end(), key);
+
+	if ( it != sparse_buckets.end() && (*it >> 8) == index )
+		{
+		if ( rank > (*it & 0xff) )
+			*it = key | rank;
+
+		return;
+		}
+
+	sparse_buckets.insert(it, key | rank);
+	V--;
+
+	if ( sparse_buckets.size() > SparseLimit() )
+		Densify();
+	}
+
+void CardinalityCounter::Densify() const
+	{
+	if ( ! sparse )
+		return;
+
+	buckets.assign(m, 0);
+
+	for ( auto e : sparse_buckets )
+		buckets[e >> 8] = e & 0xff;
+
+	sparse_buckets.clear();
+	sparse_buckets.shrink_to_fit();
+	sparse = false;
+	}
+
+void CardinalityCounter::Compact()
+	{
+	if ( sparse || m > SPARSE_MAX_M )
+		return;
+
+	uint64_t set = 0;
+
+	for ( size_t i = 0; i < m; i++ )
+		set += (buckets[i] != 0);
+
+	if ( set > SparseLimit() )
+		return;
+
+	sparse_buckets.reserve(set);
+
+	for ( size_t i = 0; i < m; i++ )
+		{
+		if ( buckets[i] )
+			sparse_buckets.push_back(static_cast<uint32_t>(i << 8) | buckets[i]);
+		}
+
+	buckets.clear();
+	buckets.shrink_to_fit();
+	sparse = true;
+	}
+
 const std::vector<uint8_t>& CardinalityCounter::GetBuckets() const
 	{
+	Densify();
 	return buckets;
 	}
 
@@ -204,8 +342,21 @@ broker::expected<broker::data> CardinalityCounter::Serialize() const
 	broker::vector v = {m, V, alpha_m};
 	v.reserve(3 + m);
 
+	// Sparse counters serialize like dense ones.
+	auto next = sparse_buckets.begin();
+
 	for ( size_t i = 0; i < m; ++i )
-		v.emplace_back(static_cast<uint64_t>(buckets[i]));
+		{
+		uint64_t x = 0;
+
+		if ( ! sparse )
+			x = buckets[i];
+
+		else if ( next != sparse_buckets.end() && (*next >> 8) == i )
+			x = *next++ & 0xff;
+
+		v.emplace_back(x);
+		}
 
 	return {std::move(v)};
 	}
@@ -240,6 +391,7 @@ std::unique_ptr<CardinalityCounter> CardinalityCounter::Unserialize(const broker
 		cc->buckets[i] = *x;
 		}
 
+	cc->Compact();
 	return cc;
 	}
 
@@ -105,7 +105,8 @@ protected:
 
 	/**
 	 * Returns the buckets array that holds all of the rough cardinality
-	 * estimates.
+	 * estimates. A sparse counter switches to the dense representation
+	 * for this.
 	 *
 	 * Use GetM() to determine the size.
 	 *
@@ -163,6 +164,37 @@ private:
 	 */
 	static int flsll(uint64_t mask);
 
+	/**
+	 * Records a bucket value while the counter is sparse, switching to
+	 * the dense representation once too many buckets are set.
+	 * @param index the bucket's index
+	 * @param rank the value to store if larger than the current one
+	 */
+	void AddSparse(uint64_t index, uint8_t rank);
+
+	/**
+	 * Switches a sparse counter to the dense representation. This doesn't
+	 * change the counter's value, hence it's const.
+	 */
+	void Densify() const;
+
+	/**
+	 * Switches a dense counter to the sparse representation if that's
+	 * smaller.
+	 */
+	void Compact();
+
+	/**
+	 * Counters with at most this many buckets start out sparse.
+	 */
+	static constexpr uint64_t SPARSE_MAX_M = 1 << 24;
+
+	/**
+	 * Returns the number of set buckets at which a sparse counter takes
+	 * half the memory of a dense one.
+	 */
+	uint64_t SparseLimit() const { return m / 8; }
+
 	/**
 	 * This is the number of buckets that will be stored. The standard
 	 * error is 1.04/sqrt(m), so the actual cardinality will be the
@@ -176,7 +208,16 @@ private:
 	 * appears in the bitstring and that location is at most 65, so not
 	 * that many bits are needed to store it.
 	 */
-	std::vector<uint8_t> buckets;
+	mutable std::vector<uint8_t> buckets;
+
+	/**
+	 * While few buckets are set, only those get stored, as a list of
+	 * entries (index << 8 | value) sorted by index. Most counters, like
+	 * those of SumStats keys with few unique values, never leave this
+	 * representation. Only one of buckets and sparse_buckets is in use.
+	 */
+	mutable std::vector<uint32_t> sparse_buckets;
+	mutable bool sparse = false;
 
 	/**
 	 * There are some state constants that need to be kept track of to
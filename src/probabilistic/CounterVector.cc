@@ -35,6 +35,19 @@ bool CounterVector::Increment(size_type cell, count_type value)
 	assert(cell < Size());
 	assert(value != 0);
 
+	if ( Packed() )
+		{
+		size_t lsb = cell * width;
+		auto& block = bits->Data()[lsb / 64];
+		auto shift = lsb % 64;
+		uint64_t mask = Max();
+		uint64_t cur = (block >> shift) & mask;
+		bool overflow = value > mask - cur;
+		uint64_t next = overflow ? mask : cur + value;
+		block = (block & ~(mask << shift)) | (next << shift);
+		return ! overflow;
+		}
+
 	size_t lsb = cell * width;
 	bool carry = false;
 
@@ -60,6 +73,19 @@ bool CounterVector::Decrement(size_type cell, count_type value)
 	assert(cell < Size());
 	assert(value != 0);
 
+	if ( Packed() )
+		{
+		// Like the bitwise version, this wraps around on underflow.
+		size_t lsb = cell * width;
+		auto& block = bits->Data()[lsb / 64];
+		auto shift = lsb % 64;
+		uint64_t mask = Max();
+		uint64_t cur = (block >> shift) & mask;
+		uint64_t next = (cur - value) & mask;
+		block = (block & ~(mask << shift)) | (next << shift);
+		return cur >= value;
+		}
+
 	value = ~value + 1; // A - B := A + ~B + 1
 	bool carry = false;
 	size_t lsb = cell * width;
@@ -89,6 +115,12 @@ CounterVector::count_type CounterVector::Count(size_type cell) const
 	{
 	assert(cell < Size());
 
+	if ( Packed() )
+		{
+		size_t lsb = cell * width;
+		return (bits->Data()[lsb / 64] >> (lsb % 64)) & Max();
+		}
+
 	size_t cnt = 0, order = 1;
 	size_t lsb = cell * width;
 
@@ -119,6 +151,12 @@ CounterVector& CounterVector::Merge(const CounterVector& other)
 	assert(Size() == other.Size());
 	assert(Width() == other.Width());
 
+	if ( Packed() )
+		{
+		MergePacked(other);
+		return *this;
+		}
+
 	for ( size_t cell = 0; cell < Size(); ++cell )
 		{
 		size_t lsb = cell * width;
@@ -142,6 +180,29 @@ CounterVector& CounterVector::Merge(const CounterVector& other)
 	return *this;
 	}
 
+void CounterVector::MergePacked(const CounterVector& other)
+	{
+	// Adds all counters of a block in parallel, with each counter's top
+	// bit kept out of the addition so that carries don't cross into the
+	// next counter. Overflowing counters saturate. The loop has no
+	// branches, so the compiler vectorizes it.
+	uint64_t low = width == 64 ? 1 : ~uint64_t(0) / ((uint64_t(1) << width) - 1);
+	uint64_t high = low << (width - 1);
+
+	auto* x = bits->Data();
+	const auto* y = other.bits->Data();
+
+	for ( size_t i = 0; i < bits->Blocks(); ++i )
+		{
+		uint64_t a = x[i];
+		uint64_t b = y[i];
+		uint64_t sum = ((a & ~high) + (b & ~high)) ^ ((a ^ b) & high);
+		uint64_t overflow = ((a & b) | ((a | b) & ~sum)) & high;
+		uint64_t saturate = (overflow << 1) - (overflow >> (width - 1));
+		x[i] = sum | saturate;
+		}
+	}
+
 BitVector CounterVector::ToBitVector() const
 	{
 	auto newbits = BitVector(Size());
@@ -163,6 +163,20 @@ protected:
 private:
 	CounterVector& operator=(const CounterVector&); // Disable.
 
+	/**
+	 * Returns true if the width divides the block size, such as for
+	 * the common 4- and 8-bit counters. No counter then straddles two
+	 * blocks, and each gets updated within its block word at once
+	 * rather than bit by bit.
+	 */
+	bool Packed() const { return width <= 64 && 64 % width == 0; }
+
+	/**
+	 * Merges a vector of packed counters, adding all counters of a
+	 * block at once.
+	 */
+	void MergePacked(const CounterVector& other);
+
 	BitVector* bits = nullptr;
 	size_t width = 0;
 	};
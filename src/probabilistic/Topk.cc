@@ -3,7 +3,12 @@
 #include "zeek/probabilistic/Topk.h"
 
 #include <broker/error.hh>
+#include <algorithm>
+#include <cstring>
+#include <random>
+#include <string>
 
+#include "zeek/3rdparty/doctest.h"
 #include "zeek/CompHash.h"
 #include "zeek/Dict.h"
 #include "zeek/Reporter.h"
@@ -12,12 +17,6 @@
 namespace zeek::probabilistic::detail
 	{
 
-static void topk_element_hash_delete_func(void* val)
-	{
-	Element* e = (Element*)val;
-	delete e;
-	}
-
 void TopkVal::Typify(TypePtr t)
 	{
 	assert(! hash && ! type);
@@ -27,11 +26,532 @@ void TopkVal::Typify(TypePtr t)
 	hash = new zeek::detail::CompositeHash(std::move(tl));
 	}
 
-zeek::detail::HashKey* TopkVal::GetHash(Val* v) const
+const zeek::detail::HashKey* TopkVal::GetHash(Val* v) const
 	{
-	auto key = hash->MakeHashKey(*v, true);
+	auto key = zeek::detail::probabilistic_hash_key(hash, v);
 	assert(key);
-	return key.release();
+	return key;
+	}
+
+#ifdef ZEEK_TOPK_ARRAYS
+
+// Capacity preallocated at construction, at most.
+constexpr uint64_t MAX_PREALLOCATE = 65536;
+
+TopkVal::TopkVal(uint64_t arg_size) : OpaqueVal(topk_type)
+	{
+	size = arg_size;
+	numElements = 0;
+	pruned = false;
+	hash = nullptr;
+
+	auto prealloc = std::min(size, MAX_PREALLOCATE);
+	elements.reserve(prealloc);
+	buckets.reserve(prealloc);
+
+	size_t slots = 16;
+	while ( slots < prealloc * 2 )
+		slots *= 2;
+
+	index.Rehash(elements, slots);
+	}
+
+TopkVal::TopkVal() : OpaqueVal(topk_type)
+	{
+	size = 0;
+	numElements = 0;
+	hash = nullptr;
+	}
+
+TopkVal::~TopkVal()
+	{
+	delete hash;
+	}
+
+uint32_t TopkIndex::Find(const std::vector<Element>& elements, const void* key, size_t len,
+                         zeek::detail::hash_t h) const
+	{
+	if ( slots.empty() )
+		return TOPK_NONE;
+
+	size_t mask = slots.size() - 1;
+
+	for ( size_t i = h & mask;; i = (i + 1) & mask )
+		{
+		uint32_t e = slots[i];
+
+		if ( e == TOPK_NONE )
+			return TOPK_NONE;
+
+		const auto& el = elements[e];
+
+		if ( el.hash == h && el.key.size() == len && memcmp(el.key.data(), key, len) == 0 )
+			return e;
+		}
+	}
+
+void TopkIndex::Rehash(const std::vector<Element>& elements, size_t num_slots)
+	{
+	std::vector<uint32_t> old;
+	old.swap(slots);
+	slots.assign(num_slots, TOPK_NONE);
+	used = 0;
+
+	for ( auto e : old )
+		{
+		if ( e != TOPK_NONE )
+			Insert(elements, e);
+		}
+	}
+
+void TopkIndex::Insert(const std::vector<Element>& elements, uint32_t e)
+	{
+	// Linear probing stays fast while at most half the slots are taken.
+	if ( (used + 1) * 2 > slots.size() )
+		Rehash(elements, std::max(slots.size() * 2, size_t(16)));
+
+	size_t mask = slots.size() - 1;
+	size_t i = elements[e].hash & mask;
+
+	while ( slots[i] != TOPK_NONE )
+		i = (i + 1) & mask;
+
+	slots[i] = e;
+	++used;
+	}
+
+void TopkIndex::Remove(const std::vector<Element>& elements, uint32_t e)
+	{
+	size_t mask = slots.size() - 1;
+	size_t i = elements[e].hash & mask;
+
+	while ( slots[i] != e )
+		i = (i + 1) & mask;
+
+	// Shifts later entries of the probe sequence back into the gap, so
+	// that lookups don't need tombstones.
+	for ( size_t j = (i + 1) & mask; slots[j] != TOPK_NONE; j = (j + 1) & mask )
+		{
+		size_t home = elements[slots[j]].hash & mask;
+
+		// Entries whose home lies cyclically within (i, j] stay put.
+		bool stays = i <= j ? (home > i && home <= j) : (home > i || home <= j);
+
+		if ( ! stays )
+			{
+			slots[i] = slots[j];
+			i = j;
+			}
+		}
+
+	slots[i] = TOPK_NONE;
+	--used;
+	}
+
+uint32_t TopkVal::Find(const void* key, size_t len, zeek::detail::hash_t h) const
+	{
+	return index.Find(elements, key, len, h);
+	}
+
+uint32_t TopkVal::NewElement(ValPtr value, const void* key, size_t len, zeek::detail::hash_t h,
+                             uint64_t epsilon)
+	{
+	uint32_t e;
+
+	if ( free_elements.empty() )
+		{
+		e = elements.size();
+		elements.emplace_back();
+		}
+	else
+		{
+		e = free_elements.back();
+		free_elements.pop_back();
+		}
+
+	auto& el = elements[e];
+	el.epsilon = epsilon;
+	el.value = std::move(value);
+	el.key.assign(static_cast<const char*>(key), len);
+	el.hash = h;
+	return e;
+	}
+
+void TopkVal::FreeElement(uint32_t e)
+	{
+	// Keeps the key's storage for the next element in this slot.
+	elements[e].value = nullptr;
+	free_elements.push_back(e);
+	}
+
+// Inserts a bucket before the given one, or as the last one for TOPK_NONE.
+uint32_t TopkVal::NewBucket(uint64_t count, uint32_t before)
+	{
+	uint32_t b;
+
+	if ( free_buckets.empty() )
+		{
+		b = buckets.size();
+		buckets.emplace_back();
+		}
+	else
+		{
+		b = free_buckets.back();
+		free_buckets.pop_back();
+		buckets[b] = Bucket();
+		}
+
+	auto& bu = buckets[b];
+	bu.count = count;
+	bu.next = before;
+	bu.prev = before == TOPK_NONE ? max_bucket : buckets[before].prev;
+
+	if ( bu.prev == TOPK_NONE )
+		min_bucket = b;
+	else
+		buckets[bu.prev].next = b;
+
+	if ( before == TOPK_NONE )
+		max_bucket = b;
+	else
+		buckets[before].prev = b;
+
+	return b;
+	}
+
+void TopkVal::FreeBucket(uint32_t b)
+	{
+	auto& bu = buckets[b];
+	assert(bu.num == 0);
+
+	if ( bu.prev == TOPK_NONE )
+		min_bucket = bu.next;
+	else
+		buckets[bu.prev].next = bu.next;
+
+	if ( bu.next == TOPK_NONE )
+		max_bucket = bu.prev;
+	else
+		buckets[bu.next].prev = bu.prev;
+
+	free_buckets.push_back(b);
+	}
+
+void TopkVal::Append(uint32_t b, uint32_t e)
+	{
+	auto& bu = buckets[b];
+	auto& el = elements[e];
+
+	el.parent = b;
+	el.prev = bu.tail;
+	el.next = TOPK_NONE;
+
+	if ( bu.tail == TOPK_NONE )
+		bu.head = e;
+	else
+		elements[bu.tail].next = e;
+
+	bu.tail = e;
+	++bu.num;
+	}
+
+// Takes an element out of its bucket, leaving the bucket in place even if
+// it's empty now.
+void TopkVal::Unlink(uint32_t e)
+	{
+	auto& el = elements[e];
+	auto& bu = buckets[el.parent];
+
+	if ( el.prev == TOPK_NONE )
+		bu.head = el.next;
+	else
+		elements[el.prev].next = el.next;
+
+	if ( el.next == TOPK_NONE )
+		bu.tail = el.prev;
+	else
+		elements[el.next].prev = el.prev;
+
+	el.prev = el.next = TOPK_NONE;
+	--bu.num;
+	}
+
+void TopkVal::Merge(const TopkVal* value, bool doPrune)
+	{
+	if ( value == this )
+		{
+		// Merging would walk our arrays while changing them.
+		auto copy = make_intrusive<TopkVal>(size);
+		copy->Merge(this);
+		Merge(copy.get(), doPrune);
+		return;
+		}
+
+	if ( ! value->type )
+		{
+		// Merge-from is empty. Nothing to do.
+		assert(value->numElements == 0);
+		return;
+		}
+
+	if ( type == nullptr )
+		{
+		assert(numElements == 0);
+		Typify(value->type);
+		}
+
+	else
+		{
+		if ( ! same_type(type, value->type) )
+			{
+			reporter->Error("Cannot merge top-k elements of differing types.");
+			return;
+			}
+		}
+
+	// Both sides hash values of the same type the same way, so the other
+	// side's hash keys serve for lookups here without rehashing values.
+	for ( uint32_t b = value->min_bucket; b != TOPK_NONE; b = value->buckets[b].next )
+		{
+		uint64_t currcount = value->buckets[b].count;
+
+		for ( uint32_t oe = value->buckets[b].head; oe != TOPK_NONE; oe = value->elements[oe].next )
+			{
+			const auto& other = value->elements[oe];
+			// lookup if we already know this one...
+			uint32_t e = Find(other.key.data(), other.key.size(), other.hash);
+
+			if ( e == TOPK_NONE )
+				{
+				// insert at bucket position 0
+				if ( min_bucket != TOPK_NONE )
+					{
+					assert(buckets[min_bucket].count > 0);
+					}
+
+				uint32_t nb = NewBucket(0, min_bucket);
+				e = NewElement(other.value, other.key.data(), other.key.size(), other.hash, 0);
+				Append(nb, e);
+				index.Insert(elements, e);
+				numElements++;
+				}
+
+			// now that we are sure that the old element is present - increment epsilon
+			elements[e].epsilon += other.epsilon;
+
+			// and increment position...
+			IncrementCounter(e, currcount);
+			}
+		}
+
+	// now we have added everything. And our top-k table could be too big.
+	// prune everything...
+
+	assert(size > 0);
+
+	if ( ! doPrune )
+		return;
+
+	while ( numElements > size )
+		{
+		pruned = true;
+		assert(min_bucket != TOPK_NONE);
+		uint32_t b = min_bucket;
+		assert(buckets[b].num > 0);
+
+		uint32_t e = buckets[b].head;
+		index.Remove(elements, e);
+		Unlink(e);
+		FreeElement(e);
+
+		if ( buckets[b].num == 0 )
+			FreeBucket(b);
+
+		numElements--;
+		}
+	}
+
+ValPtr TopkVal::DoClone(CloneState* state)
+	{
+	auto clone = make_intrusive<TopkVal>(size);
+	clone->Merge(this);
+	return state->NewClone(this, std::move(clone));
+	}
+
+VectorValPtr TopkVal::GetTopK(int k) const // returns vector
+	{
+	if ( numElements == 0 )
+		{
+		reporter->Error("Cannot return topk of empty");
+		return nullptr;
+		}
+
+	auto v = make_intrusive<VectorType>(type);
+	auto t = make_intrusive<VectorVal>(std::move(v));
+
+	// this does no estimation if the results is correct!
+	// in any case - just to make this future-proof (and I am lazy) - this can return more than k.
+
+	int read = 0;
+	uint32_t b = max_bucket;
+	while ( read < k && b != TOPK_NONE )
+		{
+		for ( uint32_t e = buckets[b].head; e != TOPK_NONE; e = elements[e].next )
+			{
+			t->Assign(read, elements[e].value);
+			read++;
+			}
+
+		b = buckets[b].prev;
+		}
+
+	return t;
+	}
+
+uint64_t TopkVal::GetCount(Val* value) const
+	{
+	uint32_t e = Find(*GetHash(value));
+
+	if ( e == TOPK_NONE )
+		{
+		reporter->Error("GetCount for element that is not in top-k");
+		return 0;
+		}
+
+	return buckets[elements[e].parent].count;
+	}
+
+uint64_t TopkVal::GetEpsilon(Val* value) const
+	{
+	uint32_t e = Find(*GetHash(value));
+
+	if ( e == TOPK_NONE )
+		{
+		reporter->Error("GetEpsilon for element that is not in top-k");
+		return 0;
+		}
+
+	return elements[e].epsilon;
+	}
+
+uint64_t TopkVal::GetSum() const
+	{
+	uint64_t sum = 0;
+
+	for ( uint32_t b = min_bucket; b != TOPK_NONE; b = buckets[b].next )
+		sum += buckets[b].num * buckets[b].count;
+
+	if ( pruned )
+		reporter->Warning("TopkVal::GetSum() was used on a pruned data structure. Result values do "
+		                  "not represent total element count");
+
+	return sum;
+	}
+
+void TopkVal::Encountered(ValPtr encountered)
+	{
+	// ok, let's see if we already know this one.
+
+	if ( numElements == 0 )
+		Typify(encountered->GetType());
+	else if ( ! same_type(type, encountered->GetType()) )
+		{
+		reporter->Error("Trying to add element to topk with differing type from other elements");
+		return;
+		}
+
+	// Step 1 - get the hash.
+	auto key = GetHash(encountered);
+	uint32_t e = Find(*key);
+
+	if ( e == TOPK_NONE )
+		{
+		// well, we do not know this one yet...
+		if ( numElements < size )
+			{
+			// brilliant. just add it at position 1
+			uint32_t b = min_bucket;
+
+			if ( b == TOPK_NONE || buckets[b].count > 1 )
+				b = NewBucket(1, min_bucket);
+
+			assert(buckets[b].count == 1);
+
+			e = NewElement(std::move(encountered), key->Key(), key->Size(), key->Hash(), 0);
+			Append(b, e);
+			index.Insert(elements, e);
+			numElements++;
+
+			return; // done. it is at pos 1.
+			}
+
+		else
+			{
+			// replace element with min-value
+			uint32_t b = min_bucket; // bucket with smallest elements
+
+			if ( b == TOPK_NONE )
+				return; // a top-k of size zero
+
+			// evict oldest element with least hits.
+			assert(buckets[b].num > 0);
+			uint32_t victim = buckets[b].head;
+			index.Remove(elements, victim);
+			Unlink(victim);
+			FreeElement(victim);
+
+			// and add the new one to the end
+			e = NewElement(std::move(encountered), key->Key(), key->Size(), key->Hash(),
+			               buckets[b].count);
+			Append(b, e);
+			index.Insert(elements, e);
+
+			// fallthrough, increment operation has to run!
+			}
+		}
+
+	// ok, we now have an element in e
+	IncrementCounter(e); // well, this certainly was anticlimatic.
+	}
+
+// increment by count
+void TopkVal::IncrementCounter(uint32_t e, uint64_t count)
+	{
+	uint32_t currBucket = elements[e].parent;
+	uint64_t target = buckets[currBucket].count + count;
+
+	// well, let's test if there is a bucket for currcount++
+	uint32_t b = buckets[currBucket].next;
+
+	while ( b != TOPK_NONE && buckets[b].count < target )
+		b = buckets[b].next;
+
+	// the bucket for the value that we want does not exist.
+	// create it...
+	if ( b == TOPK_NONE || buckets[b].count != target )
+		b = NewBucket(target, b);
+
+	// ok, now we have the new bucket in b. Shift the element over...
+	Unlink(e);
+	Append(b, e);
+
+	// if currBucket is empty, we have to delete it now
+	if ( buckets[currBucket].num == 0 )
+		FreeBucket(currBucket);
+	}
+
+#else
+
+static void topk_element_hash_delete_func(void* val)
+	{
+	Element* e = (Element*)val;
+	delete e;
+	}
+
+// The keys that GetHash() returns are shared, so the dictionary gets a copy.
+static void insert_element(PDict<Element>* d, const zeek::detail::HashKey* key, Element* e)
+	{
+	d->Insert(const_cast<void*>(key->Key()), key->Size(), key->Hash(), e, true);
 	}
 
 TopkVal::TopkVal(uint64_t arg_size) : OpaqueVal(topk_type)
@@ -71,6 +591,15 @@ TopkVal::~TopkVal()
 
 void TopkVal::Merge(const TopkVal* value, bool doPrune)
 	{
+	if ( value == this )
+		{
+		// Merging would walk our lists while changing them.
+		auto copy = make_intrusive<TopkVal>(size);
+		copy->Merge(this);
+		Merge(copy.get(), doPrune);
+		return;
+		}
+
 	if ( ! value->type )
 		{
 		// Merge-from is empty. Nothing to do.
@@ -104,7 +633,7 @@ void TopkVal::Merge(const TopkVal* value, bool doPrune)
 			{
 			Element* e = *eit;
 			// lookup if we already know this one...
-			zeek::detail::HashKey* key = GetHash(e->value);
+			auto key = GetHash(e->value);
 			Element* olde = (Element*)elementDict->Lookup(key);
 
 			if ( olde == nullptr )
@@ -125,7 +654,7 @@ void TopkVal::Merge(const TopkVal* value, bool doPrune)
 				olde->parent = newbucket;
 				newbucket->elements.insert(newbucket->elements.end(), olde);
 
-				elementDict->Insert(key, olde);
+				insert_element(elementDict, key, olde);
 				numElements++;
 				}
 
@@ -134,7 +663,6 @@ void TopkVal::Merge(const TopkVal* value, bool doPrune)
 
 			// and increment position...
 			IncrementCounter(olde, currcount);
-			delete key;
 
 			eit++;
 			}
@@ -158,9 +686,7 @@ void TopkVal::Merge(const TopkVal* value, bool doPrune)
 		assert(b->elements.size() > 0);
 
 		Element* e = b->elements.front();
-		zeek::detail::HashKey* key = GetHash(e->value);
-		elementDict->RemoveEntry(key);
-		delete key;
+		elementDict->RemoveEntry(GetHash(e->value));
 		delete e;
 
 		b->elements.pop_front();
@@ -222,9 +748,7 @@ VectorValPtr TopkVal::GetTopK(int k) const // returns vector
 
 uint64_t TopkVal::GetCount(Val* value) const
 	{
-	zeek::detail::HashKey* key = GetHash(value);
-	Element* e = (Element*)elementDict->Lookup(key);
-	delete key;
+	Element* e = elementDict->Lookup(GetHash(value));
 
 	if ( e == nullptr )
 		{
@@ -237,9 +761,7 @@ uint64_t TopkVal::GetCount(Val* value) const
 
 uint64_t TopkVal::GetEpsilon(Val* value) const
 	{
-	zeek::detail::HashKey* key = GetHash(value);
-	Element* e = (Element*)elementDict->Lookup(key);
-	delete key;
+	Element* e = elementDict->Lookup(GetHash(value));
 
 	if ( e == nullptr )
 		{
@@ -282,8 +804,8 @@ void TopkVal::Encountered(ValPtr encountered)
 		}
 
 	// Step 1 - get the hash.
-	zeek::detail::HashKey* key = GetHash(encountered);
-	Element* e = (Element*)elementDict->Lookup(key);
+	auto key = GetHash(encountered);
+	Element* e = elementDict->Lookup(key);
 
 	if ( e == nullptr )
 		{
@@ -312,9 +834,8 @@ void TopkVal::Encountered(ValPtr encountered)
 				e->parent = b;
 				}
 
-			elementDict->Insert(key, e);
+			insert_element(elementDict, key, e);
 			numElements++;
-			delete key;
 
 			return; // done. it is at pos 1.
 			}
@@ -322,21 +843,27 @@ void TopkVal::Encountered(ValPtr encountered)
 		else
 			{
 			// replace element with min-value
+			if ( buckets.empty() )
+				{
+				delete e; // a top-k of size zero
+				return;
+				}
+
 			Bucket* b = *buckets.begin(); // bucket with smallest elements
 
 			// evict oldest element with least hits.
 			assert(b->elements.size() > 0);
-			zeek::detail::HashKey* deleteKey = GetHash((*(b->elements.begin()))->value);
+			// GetHash() would replace the key we still need.
+			auto deleteKey = hash->MakeHashKey(*(*(b->elements.begin()))->value, true);
 			b->elements.erase(b->elements.begin());
-			Element* deleteElement = (Element*)elementDict->RemoveEntry(deleteKey);
+			Element* deleteElement = elementDict->RemoveEntry(deleteKey.get());
 			assert(deleteElement); // there has to have been a minimal element...
 			delete deleteElement;
-			delete deleteKey;
 
 			// and add the new one to the end
 			e->epsilon = b->count;
 			b->elements.insert(b->elements.end(), e);
-			elementDict->Insert(key, e);
+			insert_element(elementDict, key, e);
 			e->parent = b;
 
 			// fallthrough, increment operation has to run!
@@ -344,12 +871,11 @@ void TopkVal::Encountered(ValPtr encountered)
 		}
 
 	// ok, we now have an element in e
-	delete key;
 	IncrementCounter(e); // well, this certainly was anticlimatic.
 	}
 
 // increment by count
-void TopkVal::IncrementCounter(Element* e, unsigned int count)
+void TopkVal::IncrementCounter(Element* e, uint64_t count)
 	{
 	Bucket* currBucket = e->parent;
 	uint64_t currcount = currBucket->count;
@@ -396,8 +922,118 @@ void TopkVal::IncrementCounter(Element* e, unsigned int count)
 		}
 	}
 
+#endif
+
 IMPLEMENT_OPAQUE_VALUE(TopkVal)
 
+#ifdef ZEEK_TOPK_ARRAYS
+
+broker::expected<broker::data> TopkVal::DoSerialize() const
+	{
+	broker::vector d = {size, numElements, pruned};
+
+	if ( type )
+		{
+		auto t = SerializeType(type);
+		if ( ! t )
+			return broker::ec::invalid_data;
+
+		d.emplace_back(std::move(*t));
+		}
+	else
+		d.emplace_back(broker::none());
+
+	uint64_t i = 0;
+	for ( uint32_t b = min_bucket; b != TOPK_NONE; b = buckets[b].next )
+		{
+		d.emplace_back(buckets[b].num);
+		d.emplace_back(buckets[b].count);
+
+		for ( uint32_t e = buckets[b].head; e != TOPK_NONE; e = elements[e].next )
+			{
+			d.emplace_back(elements[e].epsilon);
+			auto v = Broker::detail::val_to_data(elements[e].value.get());
+			if ( ! v )
+				return broker::ec::invalid_data;
+
+			d.emplace_back(*v);
+
+			i++;
+			}
+		}
+
+	assert(i == numElements);
+	return {std::move(d)};
+	}
+
+bool TopkVal::DoUnserialize(const broker::data& data)
+	{
+	auto v = broker::get_if<broker::vector>(&data);
+
+	if ( ! (v && v->size() >= 4) )
+		return false;
+
+	auto size_ = broker::get_if<uint64_t>(&(*v)[0]);
+	auto numElements_ = broker::get_if<uint64_t>(&(*v)[1]);
+	auto pruned_ = broker::get_if<bool>(&(*v)[2]);
+
+	if ( ! (size_ && numElements_ && pruned_) )
+		return false;
+
+	size = *size_;
+	numElements = *numElements_;
+	pruned = *pruned_;
+
+	auto no_type = broker::get_if<broker::none>(&(*v)[3]);
+	if ( ! no_type )
+		{
+		auto t = UnserializeType((*v)[3]);
+
+		if ( ! t )
+			return false;
+
+		Typify(t);
+		}
+
+	uint64_t i = 0;
+	uint64_t idx = 4;
+
+	while ( i < numElements )
+		{
+		auto elements_count = broker::get_if<uint64_t>(&(*v)[idx++]);
+		auto count = broker::get_if<uint64_t>(&(*v)[idx++]);
+
+		if ( ! (elements_count && count) )
+			return false;
+
+		uint32_t b = NewBucket(*count, TOPK_NONE);
+
+		for ( uint64_t j = 0; j < *elements_count; j++ )
+			{
+			auto epsilon = broker::get_if<uint64_t>(&(*v)[idx++]);
+			auto val = Broker::detail::data_to_val((*v)[idx++], type.get());
+
+			if ( ! (epsilon && val) )
+				return false;
+
+			auto key = GetHash(val);
+			assert(Find(*key) == TOPK_NONE);
+
+			uint32_t e = NewElement(std::move(val), key->Key(), key->Size(), key->Hash(),
+			                        *epsilon);
+			Append(b, e);
+			index.Insert(elements, e);
+
+			i++;
+			}
+		}
+
+	assert(i == numElements);
+	return true;
+	}
+
+#else
+
 broker::expected<broker::data> TopkVal::DoSerialize() const
 	{
 	broker::vector d = {size, numElements, pruned};
@@ -504,11 +1140,10 @@ bool TopkVal::DoUnserialize(const broker::data& data)
 
 			b->elements.insert(b->elements.end(), e);
 
-			zeek::detail::HashKey* key = GetHash(e->value);
+			auto key = GetHash(e->value);
 			assert(elementDict->Lookup(key) == nullptr);
 
-			elementDict->Insert(key, e);
-			delete key;
+			insert_element(elementDict, key, e);
 
 			i++;
 			}
@@ -518,4 +1153,137 @@ bool TopkVal::DoUnserialize(const broker::data& data)
 	return true;
 	}
 
+#endif
+
 	} // namespace zeek::probabilistic::detail
+
+#ifdef ZEEK_TOPK_ARRAYS
+
+using namespace zeek::probabilistic::detail;
+
+namespace
+	{
+
+// Adds an element with the given hash, keyed by its position.
+void add_element(std::vector<Element>& elements, zeek::detail::hash_t h)
+	{
+	Element el;
+	el.hash = h;
+	el.key = std::to_string(elements.size());
+	elements.push_back(std::move(el));
+	}
+
+uint32_t find(const TopkIndex& index, const std::vector<Element>& elements, uint32_t e)
+	{
+	const auto& key = elements[e].key;
+	return index.Find(elements, key.data(), key.size(), elements[e].hash);
+	}
+
+	} // namespace
+
+TEST_SUITE_BEGIN("Topk");
+
+TEST_CASE("topk index collisions that wrap around")
+	{
+	std::vector<Element> elements;
+	TopkIndex index;
+	index.Rehash(elements, 16);
+
+	// Three elements at home in the last slot, which spill over into
+	// the first slots, followed by ones at home in slots 0, 1 and 14.
+	for ( auto h : {15, 31, 47, 0, 1, 14} )
+		add_element(elements, h);
+
+	for ( uint32_t e = 0; e < elements.size(); ++e )
+		index.Insert(elements, e);
+
+	REQUIRE(index.Slots() == 16);
+	CHECK(index.Size() == elements.size());
+
+	for ( uint32_t e = 0; e < elements.size(); ++e )
+		CHECK(find(index, elements, e) == e);
+
+	// Removing any one of them leaves the others findable.
+	for ( uint32_t gone = 0; gone < elements.size(); ++gone )
+		{
+		TopkIndex copy = index;
+		copy.Remove(elements, gone);
+		CHECK(copy.Size() == elements.size() - 1);
+
+		for ( uint32_t e = 0; e < elements.size(); ++e )
+			CHECK(find(copy, elements, e) == (e == gone ? TOPK_NONE : e));
+		}
+
+	// So does removing them all, front to back and back to front.
+	TopkIndex forward = index;
+	TopkIndex backward = index;
+
+	for ( uint32_t e = 0; e < elements.size(); ++e )
+		{
+		forward.Remove(elements, e);
+		backward.Remove(elements, elements.size() - 1 - e);
+
+		for ( uint32_t o = 0; o < elements.size(); ++o )
+			{
+			CHECK(find(forward, elements, o) == (o <= e ? TOPK_NONE : o));
+			CHECK(find(backward, elements, o) ==
+			      (o >= elements.size() - 1 - e ? TOPK_NONE : o));
+			}
+		}
+
+	CHECK(forward.Size() == 0);
+	CHECK(backward.Size() == 0);
+	}
+
+TEST_CASE("topk index churn")
+	{
+	std::mt19937 rng(7);
+	std::vector<Element> elements;
+	std::vector<uint32_t> live;
+	std::vector<uint32_t> removed;
+	TopkIndex index;
+
+	for ( int round = 0; round < 20000; ++round )
+		{
+		// Grows for a while, then mostly shrinks. Few distinct hashes
+		// make for long collision chains.
+		bool grow = live.empty() || rng() % 100 < (round < 10000 ? 70 : 30);
+
+		if ( grow )
+			{
+			add_element(elements, rng() % 256);
+			live.push_back(elements.size() - 1);
+			index.Insert(elements, live.back());
+			}
+		else
+			{
+			size_t i = rng() % live.size();
+			index.Remove(elements, live[i]);
+			removed.push_back(live[i]);
+			live[i] = live.back();
+			live.pop_back();
+			}
+
+		REQUIRE(index.Size() == live.size());
+		CHECK(index.Slots() >= 2 * index.Size());
+
+		if ( round % 1000 == 0 )
+			{
+			for ( auto e : live )
+				CHECK(find(index, elements, e) == e);
+
+			for ( auto e : removed )
+				CHECK(find(index, elements, e) == TOPK_NONE);
+			}
+		}
+
+	for ( auto e : live )
+		CHECK(find(index, elements, e) == e);
+
+	for ( auto e : removed )
+		CHECK(find(index, elements, e) == TOPK_NONE);
+	}
+
+TEST_SUITE_END();
+
+#endif
@@ -2,8 +2,14 @@
 
 #pragma once
 
+#include "zeek/zeek-config.h"
+
+#include <cstdint>
 #include <list>
+#include <string>
+#include <vector>
 
+#include "zeek/Hash.h"
 #include "zeek/OpaqueVal.h"
 #include "zeek/Val.h"
 
@@ -21,6 +27,86 @@ class CompositeHash;
 namespace zeek::probabilistic::detail
 	{
 
+#ifdef ZEEK_TOPK_ARRAYS
+
+// The stream summary lives in two arrays, with elements and buckets
+// referring to each other by index, and an open-addressed index from
+// element hashes into the elements. Freed slots get reused, so that the
+// structure stops allocating once it is at capacity. Only used when
+// configured with --enable-topk-arrays.
+
+constexpr uint32_t TOPK_NONE = UINT32_MAX;
+
+struct Bucket
+	{
+	uint64_t count = 0;
+	uint64_t num = 0; // number of elements
+	uint32_t head = TOPK_NONE; // oldest element
+	uint32_t tail = TOPK_NONE; // newest element
+	uint32_t prev = TOPK_NONE; // bucket with the next-lower count
+	uint32_t next = TOPK_NONE; // bucket with the next-higher count
+	};
+
+struct Element
+	{
+	uint64_t epsilon = 0;
+	ValPtr value;
+	std::string key; // the value's hash key
+	zeek::detail::hash_t hash = 0;
+	uint32_t parent = TOPK_NONE;
+	uint32_t prev = TOPK_NONE; // next-older element in the bucket
+	uint32_t next = TOPK_NONE; // next-newer element in the bucket
+	};
+
+/**
+ * An index from hash keys to elements, using linear probing with
+ * backward-shift deletion, so that it doesn't need tombstones. It only
+ * stores element indices, and takes the elements' hashes and keys from
+ * the array that's passed in.
+ */
+class TopkIndex
+	{
+public:
+	/**
+	 * Returns the index of the element with the given key, or TOPK_NONE
+	 * if there's none.
+	 */
+	uint32_t Find(const std::vector<Element>& elements, const void* key, size_t len,
+	              zeek::detail::hash_t h) const;
+
+	/**
+	 * Adds an element, growing the index to keep at least half of the
+	 * slots free.
+	 */
+	void Insert(const std::vector<Element>& elements, uint32_t e);
+
+	/**
+	 * Removes an element, which must be in the index.
+	 */
+	void Remove(const std::vector<Element>& elements, uint32_t e);
+
+	/**
+	 * Moves all elements into a given number of slots, a power of two.
+	 */
+	void Rehash(const std::vector<Element>& elements, size_t num_slots);
+
+	/**
+	 * Returns the number of slots.
+	 */
+	size_t Slots() const { return slots.size(); }
+
+	/**
+	 * Returns the number of elements in the index.
+	 */
+	size_t Size() const { return used; }
+
+private:
+	std::vector<uint32_t> slots; // element indices, a power of two in size
+	size_t used = 0;
+	};
+
+#else
+
 struct Element;
 
 struct Bucket
@@ -41,6 +127,8 @@ struct Element
 	Bucket* parent;
 	};
 
+#endif
+
 class TopkVal : public OpaqueVal
 	{
 
@@ -154,7 +242,11 @@ private:
 	 *
 	 * @param count increment counter by this much
 	 */
-	void IncrementCounter(Element* e, unsigned int count = 1);
+#ifdef ZEEK_TOPK_ARRAYS
+	void IncrementCounter(uint32_t e, uint64_t count = 1);
+#else
+	void IncrementCounter(Element* e, uint64_t count = 1);
+#endif
 
 	/**
 	 * get the hashkey for a specific value
@@ -163,8 +255,30 @@ private:
 	 *
 	 * @returns HashKey for value
 	 */
-	zeek::detail::HashKey* GetHash(Val* v) const; // this probably should go somewhere else.
-	zeek::detail::HashKey* GetHash(const ValPtr& v) const { return GetHash(v.get()); }
+	const zeek::detail::HashKey* GetHash(Val* v) const;
+	const zeek::detail::HashKey* GetHash(const ValPtr& v) const { return GetHash(v.get()); }
+
+#ifdef ZEEK_TOPK_ARRAYS
+	/**
+	 * Looks up an element.
+	 *
+	 * @returns the element's index, or TOPK_NONE if it's not tracked
+	 */
+	uint32_t Find(const void* key, size_t len, zeek::detail::hash_t h) const;
+	uint32_t Find(const zeek::detail::HashKey& key) const
+		{
+		return Find(key.Key(), key.Size(), key.Hash());
+		}
+
+	// Maintenance of the arrays.
+	uint32_t NewElement(ValPtr value, const void* key, size_t len, zeek::detail::hash_t h,
+	                    uint64_t epsilon);
+	void FreeElement(uint32_t e);
+	uint32_t NewBucket(uint64_t count, uint32_t before);
+	void FreeBucket(uint32_t b);
+	void Append(uint32_t b, uint32_t e);
+	void Unlink(uint32_t e);
+#endif
 
 	/**
 	 * Set the type that this TopK instance tracks
@@ -175,8 +289,18 @@ private:
 
 	TypePtr type;
 	zeek::detail::CompositeHash* hash = nullptr;
+#ifdef ZEEK_TOPK_ARRAYS
+	std::vector<Element> elements;
+	std::vector<uint32_t> free_elements;
+	std::vector<Bucket> buckets;
+	std::vector<uint32_t> free_buckets;
+	uint32_t min_bucket = TOPK_NONE;
+	uint32_t max_bucket = TOPK_NONE;
+	TopkIndex index;
+#else
 	std::list<Bucket*> buckets;
 	PDict<Element>* elementDict = nullptr;
+#endif
 	uint64_t size = 0; // how many elements are we tracking?
 	uint64_t numElements = 0; // how many elements do we have at the moment
 	bool pruned = false; // was this data structure pruned?
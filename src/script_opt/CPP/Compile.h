@@ -127,7 +127,8 @@ class CPPCompile
 	{
 public:
 	CPPCompile(std::vector<FuncInfo>& _funcs, ProfileFuncs& pfs, const std::string& gen_name,
-	           bool add, bool _standalone, bool report_uncompilable);
+	           bool add, bool _standalone, bool report_uncompilable,
+	           const std::string& unit_name = "");
 	~CPPCompile();
 
 	// Constructing a CPPCompile object does all of the compilation.
@@ -354,6 +355,12 @@ private:
 	// compilation units.
 	int addl_tag = 0;
 
+	// The name of the namespace (under zeek::detail) holding the
+	// generated code.  Derived from the addl_tag, or for separately
+	// built units, from their name, so that several units can be
+	// loaded into the same process.
+	std::string scope;
+
 	// If true, the generated code should run "standalone".
 	bool standalone = false;
 
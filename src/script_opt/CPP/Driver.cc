@@ -14,7 +14,8 @@ namespace zeek::detail
 using namespace std;
 
 CPPCompile::CPPCompile(vector<FuncInfo>& _funcs, ProfileFuncs& _pfs, const string& gen_name,
-                       bool add, bool _standalone, bool report_uncompilable)
+                       bool add, bool _standalone, bool report_uncompilable,
+                       const string& unit_name)
 	: funcs(_funcs), pfs(_pfs), standalone(_standalone)
 	{
 	auto target_name = gen_name.c_str();
@@ -53,6 +54,8 @@ CPPCompile::CPPCompile(vector<FuncInfo>& _funcs, ProfileFuncs& _pfs, const strin
 	else
 		addl_tag = 0;
 
+	scope = unit_name.empty() ? Fmt(addl_tag) : "unit_" + Canonicalize(unit_name.c_str());
+
 	Compile(report_uncompilable);
 	}
 
@@ -208,7 +211,7 @@ void CPPCompile::GenProlog()
 		Emit("#include \"zeek/script_opt/CPP/Runtime.h\"\n");
 
 	Emit("namespace zeek::detail { //\n");
-	Emit("namespace CPP_%s { // %s\n", Fmt(addl_tag), working_dir);
+	Emit("namespace CPP_%s { // %s\n", scope, working_dir);
 
 	// The following might-or-might-not wind up being populated/used.
 	Emit("std::vector<int> field_mapping;");
@@ -358,7 +361,7 @@ void CPPCompile::GenEpilog()
 
 	GenInitHook();
 
-	Emit("} // %s\n\n", scope_prefix(addl_tag));
+	Emit("} // %s\n\n", scope_prefix(scope));
 	Emit("} // zeek::detail");
 	}
 
@@ -12,6 +12,12 @@ namespace zeek::detail
 
 constexpr int MAX_INLINE_SIZE = 1000;
 
+// The same for functions that a ZAM profile shows to be among the busiest,
+// where inlining pays off the most, and for those that it shows not to have
+// run at all, where it only costs compilation time.
+constexpr int HOT_MAX_INLINE_SIZE = 4 * MAX_INLINE_SIZE;
+constexpr int COLD_MAX_INLINE_SIZE = MAX_INLINE_SIZE / 10;
+
 void Inliner::Analyze()
 	{
 	// Locate self- and indirectly recursive functions.
@@ -142,6 +148,23 @@ void Inliner::InlineFunction(FuncInfo* f)
 	// particular body.
 	curr_frame_size = f->Scope()->Length();
 
+	switch ( profiled_heat(f->Func()) )
+		{
+		case FuncHeat::Hot:
+			max_inline_size = HOT_MAX_INLINE_SIZE;
+			break;
+
+		case FuncHeat::Cold:
+			max_inline_size = COLD_MAX_INLINE_SIZE;
+			break;
+
+		default:
+			max_inline_size = MAX_INLINE_SIZE;
+			break;
+		}
+
+	curr_stats = &body_stats[f];
+
 	auto oi = f->Body()->GetOptInfo();
 	num_stmts = oi->num_stmts;
 	num_exprs = oi->num_exprs;
@@ -189,9 +212,13 @@ ExprPtr Inliner::CheckForInlining(CallExprPtr c)
 	auto body = func_vf->GetBodies()[0].stmts; // there's only 1 body
 	auto oi = body->GetOptInfo();
 
-	if ( num_stmts + oi->num_stmts + num_exprs + oi->num_exprs > MAX_INLINE_SIZE )
+	if ( num_stmts + oi->num_stmts + num_exprs + oi->num_exprs > max_inline_size )
+		{
+		++curr_stats->too_large;
 		return nullptr;
+		}
 
+	++curr_stats->inlined;
 	num_stmts += oi->num_stmts;
 	num_exprs += oi->num_exprs;
 
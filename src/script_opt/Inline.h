@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include <unordered_map>
 #include <unordered_set>
 
 #include "zeek/Expr.h"
@@ -34,6 +35,22 @@ public:
 	// True if the given function has been inlined.
 	bool WasInlined(const Func* f) { return inline_ables.count(f) > 0; }
 
+	// How many calls got inlined into a function body, including those
+	// within inlined bodies, and how many didn't because the body would
+	// have grown too large.
+	struct BodyStats
+		{
+		int inlined = 0;
+		int too_large = 0;
+		};
+
+	// Returns nil if the body wasn't considered for inlining into.
+	const BodyStats* GetBodyStats(const FuncInfo* f) const
+		{
+		auto it = body_stats.find(f);
+		return it != body_stats.end() ? &it->second : nullptr;
+		}
+
 protected:
 	// Driver routine that analyzes all of the script functions and
 	// recursively inlines eligible ones.
@@ -49,6 +66,11 @@ protected:
 	// Functions that we've determined to be suitable for inlining.
 	std::unordered_set<const Func*> inline_ables;
 
+	std::unordered_map<const FuncInfo*, BodyStats> body_stats;
+
+	// The statistics of the body being inlined into.
+	BodyStats* curr_stats = nullptr;
+
 	// As we do inlining for a given function, this tracks the
 	// largest frame size of any inlined function.
 	int max_inlined_frame_size;
@@ -57,6 +79,10 @@ protected:
 	// prior to increasing it to accommodate inlining.
 	int curr_frame_size;
 
+	// How large the function being inlined into may grow, in terms of
+	// statements and expressions.
+	int max_inline_size;
+
 	// The number of statements and expressions in the function being
 	// inlined.  Dynamically updated as the inlining proceeds.  Used
 	// to cap inlining complexity.
@@ -2,6 +2,14 @@
 
 #include "zeek/script_opt/ScriptOpt.h"
 
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
 #include "zeek/Desc.h"
 #include "zeek/EventHandler.h"
 #include "zeek/EventRegistry.h"
@@ -38,6 +46,30 @@ static std::string CPP_dir; // where to generate C++ code
 
 static ScriptFuncPtr global_stmts;
 
+// How often each compiled function ran according to the loaded ZAM
+// profile, if any, and the count from which on a function is hot.
+static std::unordered_map<std::string, zeek_uint_t> profiled_counts;
+static zeek_uint_t hot_count = 0;
+
+// What happened to a function body during compilation to ZAM, for the
+// report requested by analysis_options.ZAM_report_file.
+struct BodyReport
+	{
+	std::string location;
+	int ast_size = 0; // statements and expressions, as parsed
+	int inlined_ast_size = 0; // the same, after inlining
+	int inlined_calls = 0;
+	int calls_too_large = 0; // calls not inlined as the body grew too large
+	bool was_inlined = false; // into its callers
+	std::string skip_reason; // why the body didn't get compiled, if it didn't
+	int unoptimized_insts = 0;
+	int insts = 0;
+	double compile_time = 0.0;
+	};
+
+// Parallel to funcs, if there's a report to write.
+static std::vector<BodyReport> body_reports;
+
 void analyze_func(ScriptFuncPtr f)
 	{
 	// Even if we're analyzing only a subset of the scripts, we still
@@ -142,7 +174,7 @@ static bool optimize_AST(ScriptFunc* f, std::shared_ptr<ProfileFunc>& pf,
 	}
 
 static void optimize_func(ScriptFunc* f, std::shared_ptr<ProfileFunc> pf, ScopePtr scope,
-                          StmtPtr& body)
+                          StmtPtr& body, BodyReport* report)
 	{
 	if ( reporter->Errors() > 0 )
 		return;
@@ -151,14 +183,21 @@ static void optimize_func(ScriptFunc* f, std::shared_ptr<ProfileFunc> pf, ScopeP
 		printf("Original: %s\n", obj_desc(body.get()).c_str());
 
 	if ( body->Tag() == STMT_CPP )
+		{
 		// We're not able to optimize this.
+		if ( report )
+			report->skip_reason = "compiled to C++";
 		return;
+		}
 
 	const char* reason;
 	if ( ! is_ZAM_compilable(pf.get(), &reason) )
 		{
 		if ( analysis_options.report_uncompilable )
 			printf("Skipping compilation of %s due to %s\n", f->Name(), reason);
+
+		if ( report )
+			report->skip_reason = reason;
 		return;
 		}
 
@@ -238,6 +277,12 @@ static void optimize_func(ScriptFunc* f, std::shared_ptr<ProfileFunc> pf, ScopeP
 		if ( analysis_options.dump_ZAM )
 			ZAM->Dump();
 
+		if ( report )
+			{
+			report->unoptimized_insts = ZAM->NumUnoptimizedInsts();
+			report->insts = ZAM->NumInsts();
+			}
+
 		f->ReplaceBody(body, new_body);
 		body = new_body;
 		}
@@ -245,6 +290,64 @@ static void optimize_func(ScriptFunc* f, std::shared_ptr<ProfileFunc> pf, ScopeP
 	pop_scope();
 	}
 
+static void load_ZAM_profile(const std::string& file)
+	{
+	std::ifstream in(file);
+	if ( ! in )
+		reporter->FatalError("cannot open ZAM profile %s", file.c_str());
+
+	// For each compiled body, the profile either says that it did not
+	// execute or lists its instructions as "<func> <inst> <count> ...".
+	// The count of the first instruction is how often the body ran.
+	// Event handlers and hooks can have several bodies, which we add up.
+	std::string line;
+	while ( std::getline(in, line) )
+		{
+		std::istringstream is(line);
+		std::string name, inst, count;
+
+		if ( ! (is >> name >> inst >> count) )
+			continue;
+
+		if ( inst == "did" && count == "not" )
+			profiled_counts[name] += 0;
+
+		else if ( inst == "0" && count.find_first_not_of("0123456789") == std::string::npos )
+			profiled_counts[name] += strtoull(count.c_str(), nullptr, 10);
+		}
+
+	// Hot are the busiest tenth of the functions that ran.
+	std::vector<zeek_uint_t> counts;
+	for ( const auto& [name, n] : profiled_counts )
+		if ( n > 0 )
+			counts.push_back(n);
+
+	if ( counts.empty() )
+		{
+		// Profiles only have counts in debug builds.
+		reporter->Warning("ZAM profile %s shows no executed functions, ignoring it",
+		                  file.c_str());
+		profiled_counts.clear();
+		return;
+		}
+
+	auto nth = counts.begin() + counts.size() * 9 / 10;
+	std::nth_element(counts.begin(), nth, counts.end());
+	hot_count = *nth;
+	}
+
+FuncHeat profiled_heat(const Func* f)
+	{
+	auto pc = profiled_counts.find(f->Name());
+	if ( pc == profiled_counts.end() )
+		return FuncHeat::Unknown;
+
+	if ( pc->second == 0 )
+		return FuncHeat::Cold;
+
+	return pc->second >= hot_count ? FuncHeat::Hot : FuncHeat::Warm;
+	}
+
 static void check_env_opt(const char* opt, bool& opt_flag)
 	{
 	if ( getenv(opt) )
@@ -278,9 +381,13 @@ static void init_options()
 	check_env_opt("ZEEK_REPORT_CPP", analysis_options.report_CPP);
 	check_env_opt("ZEEK_USE_CPP", analysis_options.use_CPP);
 
-	if ( analysis_options.gen_standalone_CPP || analysis_options.add_CPP )
+	if ( analysis_options.gen_standalone_CPP || analysis_options.add_CPP ||
+	     ! analysis_options.CPP_unit.empty() )
 		analysis_options.gen_CPP = true;
 
+	if ( analysis_options.add_CPP && ! analysis_options.CPP_unit.empty() )
+		reporter->FatalError("adding C++ incompatible with generating a C++ unit");
+
 	if ( analysis_options.gen_CPP )
 		generating_CPP = true;
 
@@ -306,6 +413,20 @@ static void init_options()
 			add_file_analysis_pattern(analysis_options, zo);
 		}
 
+	if ( ! analysis_options.ZAM_profile_file.empty() && ! generating_CPP )
+		// The profile steers compilation to ZAM.
+		analysis_options.gen_ZAM = true;
+
+	if ( ! analysis_options.ZAM_report_file.empty() )
+		{
+		if ( generating_CPP )
+			reporter->FatalError("ZAM-report requires compiling to ZAM, not C++");
+
+		// Without any other choice, report on a full ZAM compilation.
+		if ( ! analysis_options.gen_ZAM_code )
+			analysis_options.gen_ZAM = true;
+		}
+
 	if ( analysis_options.gen_ZAM )
 		{
 		analysis_options.gen_ZAM_code = true;
@@ -423,13 +544,14 @@ static void use_CPP()
 
 static void generate_CPP(std::unique_ptr<ProfileFuncs>& pfs)
 	{
-	const auto gen_name = CPP_dir + "CPP-gen.cc";
+	const auto& unit = analysis_options.CPP_unit;
+	const auto gen_name = CPP_dir + (unit.empty() ? "CPP-gen.cc" : "CPP-gen-" + unit + ".cc");
 
 	const bool add = analysis_options.add_CPP;
 	const bool standalone = analysis_options.gen_standalone_CPP;
 	const bool report = analysis_options.report_uncompilable;
 
-	CPPCompile cpp(funcs, *pfs, gen_name, add, standalone, report);
+	CPPCompile cpp(funcs, *pfs, gen_name, add, standalone, report, unit);
 	}
 
 static void analyze_scripts_for_ZAM(std::unique_ptr<ProfileFuncs>& pfs)
@@ -442,20 +564,55 @@ static void analyze_scripts_for_ZAM(std::unique_ptr<ProfileFuncs>& pfs)
 		}
 
 	// Re-profile the functions, now without worrying about compatibility
-	// with compilation to C++.  Note that the first profiling pass earlier
-	// may have marked some of the functions as to-skip, so first clear
-	// those markings.  Once we have full compile-to-C++ and ZAM support
+	// with compilation to C++.  Note that the first profiling pass earlier,
+	// if there was one, may have marked some of the functions as to-skip,
+	// so first clear those markings.  Once we have full compile-to-C++ and ZAM support
 	// for all Zeek language features, we can remove the re-profiling here.
 	for ( auto& f : funcs )
 		f.SetSkip(false);
 
 	pfs = std::make_unique<ProfileFuncs>(funcs, nullptr, true);
 
+	if ( ! analysis_options.ZAM_report_file.empty() )
+		{
+		body_reports.assign(funcs.size(), {});
+
+		for ( auto i = 0U; i < funcs.size(); ++i )
+			{
+			const auto& body = funcs[i].Body();
+			auto loc = body->GetLocationInfo();
+			auto oi = body->GetOptInfo();
+			auto& r = body_reports[i];
+
+			r.location = util::fmt("%s:%d", loc->filename ? loc->filename : "<none>",
+			                       loc->first_line);
+			r.ast_size = r.inlined_ast_size = oi->num_stmts + oi->num_exprs;
+			}
+		}
+
 	bool report_recursive = analysis_options.report_recursive;
 	std::unique_ptr<Inliner> inl;
 	if ( analysis_options.inliner )
 		inl = std::make_unique<Inliner>(funcs, report_recursive);
 
+	if ( inl && ! body_reports.empty() )
+		{
+		for ( auto i = 0U; i < funcs.size(); ++i )
+			{
+			auto oi = funcs[i].Body()->GetOptInfo();
+			auto& r = body_reports[i];
+
+			r.inlined_ast_size = oi->num_stmts + oi->num_exprs;
+			r.was_inlined = inl->WasInlined(funcs[i].Func());
+
+			if ( auto bs = inl->GetBodyStats(&funcs[i]) )
+				{
+				r.inlined_calls = bs->inlined;
+				r.calls_too_large = bs->too_large;
+				}
+			}
+		}
+
 	if ( ! analysis_options.activate )
 		// Some --optimize options stop short of AST transformations,
 		// for development/debugging purposes.
@@ -493,25 +650,40 @@ static void analyze_scripts_for_ZAM(std::unique_ptr<ProfileFuncs>& pfs)
 
 	bool did_one = false;
 
-	for ( auto& f : funcs )
+	for ( auto i = 0U; i < funcs.size(); ++i )
 		{
+		auto& f = funcs[i];
 		auto func = f.Func();
+		auto report = body_reports.empty() ? nullptr : &body_reports[i];
 
 		if ( ! analysis_options.only_funcs.empty() || ! analysis_options.only_files.empty() )
 			{
 			if ( ! should_analyze(f.FuncPtr(), f.Body()) )
+				{
+				if ( report )
+					report->skip_reason = "not selected for optimization";
 				continue;
+				}
 			}
 
 		else if ( ! analysis_options.compile_all && inl && inl->WasInlined(func) &&
 		          func_used_indirectly.count(func) == 0 )
+			{
 			// No need to compile as it won't be called directly.
+			if ( report )
+				report->skip_reason = "inlined everywhere";
 			continue;
+			}
+
+		double start = report ? util::curr_CPU_time() : 0.0;
 
 		auto new_body = f.Body();
-		optimize_func(func, f.ProfilePtr(), f.Scope(), new_body);
+		optimize_func(func, f.ProfilePtr(), f.Scope(), new_body, report);
 		f.SetBody(new_body);
 		did_one = true;
+
+		if ( report )
+			report->compile_time = util::curr_CPU_time() - start;
 		}
 
 	if ( ! did_one )
@@ -520,6 +692,39 @@ static void analyze_scripts_for_ZAM(std::unique_ptr<ProfileFuncs>& pfs)
 	finalize_functions(funcs);
 	}
 
+// Tells each event which of its arguments any of its handlers look at,
+// so that what raises the event can skip building the others.
+static void find_event_arg_usage()
+	{
+	std::unordered_map<EventHandler*, std::vector<bool>> used_args;
+
+	for ( auto& f : funcs )
+		{
+		auto func = f.Func();
+
+		if ( func->Flavor() != FUNC_FLAVOR_EVENT )
+			continue;
+
+		auto eh = event_registry->Lookup(func->Name());
+
+		if ( ! eh )
+			continue;
+
+		auto& used = used_args[eh];
+		used.resize(func->GetType()->Params()->NumFields());
+
+		// Parameters have the offsets of the event's canonical
+		// prototype, even for bodies using alternate prototypes.
+		ProfileFunc pf(func, f.Body(), false);
+
+		for ( auto p : pf.Params() )
+			used[p->Offset()] = true;
+		}
+
+	for ( auto& [eh, used] : used_args )
+		eh->SetUsedArgs(std::move(used));
+	}
+
 void analyze_scripts(bool no_unused_warnings)
 	{
 	static bool did_init = false;
@@ -534,6 +739,8 @@ void analyze_scripts(bool no_unused_warnings)
 	if ( ! no_unused_warnings )
 		ua = std::make_unique<UsageAnalyzer>(funcs);
 
+	find_event_arg_usage();
+
 	auto& ofuncs = analysis_options.only_funcs;
 	auto& ofiles = analysis_options.only_files;
 
@@ -556,12 +763,37 @@ void analyze_scripts(bool no_unused_warnings)
 		else
 			func.SetSkip(true);
 
+	if ( ! analysis_options.ZAM_profile_file.empty() )
+		{
+		load_ZAM_profile(analysis_options.ZAM_profile_file);
+
+		if ( generating_CPP )
+			{
+			// Only compile the hot functions to C++.  Running with
+			// "-O use-C++ -O ZAM" then leaves the rest to ZAM.
+			have_one_to_do = false;
+
+			for ( auto& func : funcs )
+				if ( ! func.ShouldSkip() && profiled_heat(func.Func()) == FuncHeat::Hot )
+					have_one_to_do = true;
+				else
+					func.SetSkip(true);
+			}
+		}
+
 	if ( ! have_one_to_do )
 		reporter->FatalError("no matching functions/files for C++ compilation");
 
 	// Now that everything's parsed and BiF's have been initialized,
-	// profile the functions.
-	auto pfs = std::make_unique<ProfileFuncs>(funcs, is_CPP_compilable, false);
+	// profile the functions.  This profile only serves C++ compilation,
+	// so when there isn't any we leave it to the ZAM analysis below to
+	// do the one profiling pass it needs, which saves a full pass over
+	// all of the loaded scripts at startup.
+	std::unique_ptr<ProfileFuncs> pfs;
+
+	if ( CPP_init_hook || analysis_options.report_CPP || analysis_options.use_CPP ||
+	     generating_CPP )
+		pfs = std::make_unique<ProfileFuncs>(funcs, is_CPP_compilable, false);
 
 	if ( CPP_init_hook )
 		{
@@ -610,9 +842,61 @@ void profile_script_execution()
 		}
 	}
 
+static void write_ZAM_report(const std::string& file)
+	{
+	FILE* out = fopen(file.c_str(), "w");
+	if ( ! out )
+		{
+		reporter->Error("cannot write ZAM report %s: %s", file.c_str(), strerror(errno));
+		return;
+		}
+
+	static const char* flavors[] = {"function", "event", "hook"};
+
+	// One line of JSON per function body.
+	for ( auto i = 0U; i < funcs.size() && i < body_reports.size(); ++i )
+		{
+		const auto& f = funcs[i];
+		const auto& r = body_reports[i];
+		bool compiled = f.Body()->Tag() == STMT_ZAM;
+		uint64_t calls = 0;
+		double exec_time = 0.0;
+
+		if ( compiled )
+			{
+			auto zb = static_cast<const ZBody*>(f.Body().get());
+			calls = zb->NumCalls();
+			exec_time = zb->ExecTime();
+			}
+
+		auto skip_reason = compiled ? std::string() : r.skip_reason;
+
+		if ( ! compiled && skip_reason.empty() )
+			skip_reason = "compilation failed";
+
+		fprintf(out,
+		        "{\"function\":\"%s\",\"flavor\":\"%s\",\"location\":\"%s\","
+		        "\"compiled\":%s,\"skip_reason\":\"%s\",\"ast_size\":%d,"
+		        "\"inlined_ast_size\":%d,\"was_inlined\":%s,\"inlined_calls\":%d,"
+		        "\"calls_too_large_to_inline\":%d,\"unoptimized_insts\":%d,\"insts\":%d,"
+		        "\"compile_secs\":%.6f,\"calls\":%" PRIu64 ",\"exec_secs\":%.6f}\n",
+		        util::json_escape_utf8(f.Func()->Name()).c_str(), flavors[f.Func()->Flavor()],
+		        util::json_escape_utf8(r.location).c_str(), compiled ? "true" : "false",
+		        util::json_escape_utf8(skip_reason).c_str(), r.ast_size, r.inlined_ast_size,
+		        r.was_inlined ? "true" : "false",
+		        r.inlined_calls, r.calls_too_large, r.unoptimized_insts, r.insts,
+		        r.compile_time, calls, exec_time);
+		}
+
+	fclose(out);
+	}
+
 void finish_script_execution()
 	{
 	profile_script_execution();
+
+	if ( ! analysis_options.ZAM_report_file.empty() )
+		write_ZAM_report(analysis_options.ZAM_report_file);
 	}
 
 	} // namespace zeek::detail
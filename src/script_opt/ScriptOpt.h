@@ -72,6 +72,15 @@ struct AnalyOpt
 	// Produce a profile of ZAM execution.
 	bool profile_ZAM = false;
 
+	// If non-empty, the output of an earlier run with profile_ZAM,
+	// which tells the inliner which functions are hot and which cold.
+	std::string ZAM_profile_file;
+
+	// If non-empty, the file to write a JSON report to at exit, with
+	// what happened to each function body during compilation to ZAM and
+	// how often and how long the compiled ones ran.
+	std::string ZAM_report_file;
+
 	// If true, dump out transformed code: the results of reducing
 	// interpreted scripts, and, if optimize is set, of then optimizing
 	// them.
@@ -105,6 +114,12 @@ struct AnalyOpt
 	// Generate C++ that's added to existing generated code.
 	bool add_CPP = false;
 
+	// If non-empty, generate C++ as a separately built unit of this
+	// name, such as for a single script package, which goes into its
+	// own file and namespace so that it can be compiled into a plugin
+	// and loaded alongside other units.
+	std::string CPP_unit;
+
 	// If true, use C++ bodies if available.
 	bool use_CPP = false;
 
@@ -164,6 +179,19 @@ protected:
 // we err on the conservative side and assume every function is recursive.
 extern std::unordered_set<const Func*> non_recursive_funcs;
 
+// How busy a function was in the run that produced the ZAM profile given
+// by analysis_options.ZAM_profile_file.  Unknown if there's no profile or
+// the function wasn't compiled in that run.
+enum class FuncHeat
+	{
+	Unknown,
+	Cold, // compiled but never ran
+	Warm,
+	Hot, // among the most frequently run of the profiled functions
+	};
+
+extern FuncHeat profiled_heat(const Func* f);
+
 // Analyze a given function for optimization.
 extern void analyze_func(ScriptFuncPtr f);
 
@@ -121,6 +121,20 @@ void ZAMCompiler::OptimizeInsts()
 
 		ComputeFrameLifetimes();
 
+		if ( FuseFieldAccesses() )
+			{
+			something_changed = true;
+
+			if ( dump_intermediaries )
+				{
+				printf("Did some fusing:\n");
+				DumpInsts1(nullptr);
+				}
+
+			// Lifetimes need recomputing before we can prune.
+			continue;
+			}
+
 		if ( PruneUnused() )
 			{
 			something_changed = true;
@@ -338,6 +352,65 @@ bool ZAMCompiler::PruneUnused()
 	return did_prune;
 	}
 
+bool ZAMCompiler::FuseFieldAccesses()
+	{
+	auto table_index_to_record = AssignmentFlavor(OP_TABLE_INDEX1_VVV, TYPE_RECORD, false);
+	bool did_fuse = false;
+
+	for ( auto i0 : insts1 )
+		{
+		if ( ! i0->live || ! i0->AssignsToSlot1() )
+			continue;
+
+		bool is_field = i0->IsFieldLoad();
+
+		if ( ! is_field && (i0->op != table_index_to_record || i0->op_type != OP_VVV) )
+			continue;
+
+		auto i1 = NextLiveInst(i0);
+
+		if ( ! i1 || i1->num_labels > 0 || ! i1->IsFieldLoad() )
+			continue;
+
+		// The intermediary record has to be a temporary that's set
+		// by i0 and used for the last time by i1.
+		int slot = i0->v1;
+
+		if ( i1->v2 != slot || ! reducer->IsTemporary(frame_denizens[slot]) )
+			continue;
+
+		auto b = denizen_beginning.find(slot);
+		auto e = denizen_ending.find(slot);
+
+		if ( b == denizen_beginning.end() || b->second != i0 || e == denizen_ending.end() ||
+		     e->second != i1 )
+			continue;
+
+		if ( is_field )
+			{ // v1 = v2$v3$v4
+			i1->op = OP_FIELD_CHAIN_VVii;
+			i1->op_type = OP_VVVV_I3_I4;
+			i1->v4 = i1->v3;
+			i1->v3 = i0->v3;
+			}
+		else
+			{ // v1 = v2[v3]$v4
+			i1->op = OP_TABLE_INDEX_FIELD_VVVi;
+			i1->op_type = OP_VVVV_I4;
+			i1->v4 = i1->v3;
+			i1->v3 = i0->v3;
+			i1->t2 = i0->t; // the type of the index
+			}
+
+		i1->v2 = i0->v2;
+
+		KillInst(i0);
+		did_fuse = true;
+		}
+
+	return did_fuse;
+	}
+
 void ZAMCompiler::ComputeFrameLifetimes()
 	{
 	// Start analysis from scratch, since we might do this repeatedly.
@@ -49,6 +49,7 @@ bool ZAMCompiler::IsZAM_BuiltIn(const Expr* e)
 		{"Files::__enable_reassembly", &ZAMCompiler::BuiltIn_Files__enable_reassembly},
 		{"Files::__set_reassembly_buffer", &ZAMCompiler::BuiltIn_Files__set_reassembly_buffer},
 		{"Log::__write", &ZAMCompiler::BuiltIn_Log__write},
+		{"cat", &ZAMCompiler::BuiltIn_cat},
 		{"current_time", &ZAMCompiler::BuiltIn_current_time},
 		{"get_port_transport_proto", &ZAMCompiler::BuiltIn_get_port_etc},
 		{"network_time", &ZAMCompiler::BuiltIn_network_time},
@@ -199,6 +200,58 @@ bool ZAMCompiler::BuiltIn_Log__write(const NameExpr* n, const ExprPList& args)
 	return true;
 	}
 
+bool ZAMCompiler::BuiltIn_cat(const NameExpr* n, const ExprPList& args)
+	{
+	if ( ! n )
+		{
+		reporter->Warning("return value from built-in function ignored");
+		return true;
+		}
+
+	auto nargs = args.length();
+
+	if ( nargs < 2 || nargs > 3 )
+		return false;
+
+	for ( auto a : args )
+		if ( a->GetType()->Tag() != TYPE_STRING )
+			return false;
+
+	auto a1 = args[0];
+	auto a2 = args[1];
+
+	auto a1_n = a1->Tag() == EXPR_NAME ? a1->AsNameExpr() : nullptr;
+	auto a2_n = a2->Tag() == EXPR_NAME ? a2->AsNameExpr() : nullptr;
+
+	ZInstI z;
+
+	if ( nargs == 3 )
+		{
+		auto a3 = args[2];
+
+		if ( ! a1_n || ! a2_n || a3->Tag() != EXPR_NAME )
+			return false;
+
+		int nslot = Frame1Slot(n, OP1_WRITE);
+		z = ZInstI(OP_CAT_VVVV, nslot, FrameSlot(a1_n), FrameSlot(a2_n),
+		           FrameSlot(a3->AsNameExpr()));
+		z.op_type = OP_VVVV;
+		}
+
+	else if ( a1_n && a2_n )
+		z = GenInst(OP_CAT_VVV, n, a1_n, a2_n);
+	else if ( a1_n )
+		z = GenInst(OP_CAT_VVC, n, a1_n, a2->AsConstExpr());
+	else if ( a2_n )
+		z = GenInst(OP_CAT_VCV, n, a2_n, a1->AsConstExpr());
+	else
+		return false;
+
+	AddInst(z);
+
+	return true;
+	}
+
 bool ZAMCompiler::BuiltIn_current_time(const NameExpr* n, const ExprPList& args)
 	{
 	if ( ! n )
@@ -88,6 +88,11 @@ public:
 
 	void Dump();
 
+	// Once CompileBody() is done, the number of instructions before and
+	// after the low-level optimizer ran.
+	int NumUnoptimizedInsts() const { return num_unopt_insts; }
+	int NumInsts() const { return insts2.size(); }
+
 private:
 	void Init();
 	void InitGlobals();
@@ -403,6 +408,12 @@ private:
 	// pruned.
 	bool PruneUnused();
 
+	// Fuse a record field access with the field access or table lookup
+	// that produces its record, when nothing else uses the intermediary
+	// record.  Requires up-to-date frame lifetimes.  True if some fusing
+	// happened.
+	bool FuseFieldAccesses();
+
 	// For the current state of insts1, compute lifetimes of frame
 	// denizens (variable(s) using a given frame slot) in terms of
 	// first-instruction-to-last-instruction during which they're
@@ -494,6 +505,7 @@ private:
 	// to make it easy to remove dead code.
 	std::vector<ZInstI*> insts1;
 	std::vector<ZInstI*> insts2;
+	int num_unopt_insts = 0;
 
 	// Used as a placeholder when we have to generate a GoTo target
 	// beyond the end of what we've compiled so far.
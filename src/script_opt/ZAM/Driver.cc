@@ -155,6 +155,8 @@ StmtPtr ZAMCompiler::CompileBody()
 
 	ComputeLoopLevels();
 
+	num_unopt_insts = insts1.size();
+
 	if ( ! analysis_options.no_ZAM_opt )
 		OptimizeInsts();
 
@@ -355,9 +357,21 @@ void ZAMCompiler::ConcretizeSwitchTables(const CaseMapsI<T>& abstract_cases,
 	for ( auto& targs : abstract_cases )
 		{
 		CaseMap<T> cm;
-		for ( auto& targ : targs )
-			cm[targ.first] = targ.second->inst_num;
-		concrete_cases.emplace_back(cm);
+
+		if constexpr ( std::is_same_v<CaseMap<T>, std::map<T, int>> )
+			{
+			for ( auto& targ : targs )
+				cm[targ.first] = targ.second->inst_num;
+			}
+		else
+			{
+			for ( auto& targ : targs )
+				cm.Insert(targ.first, targ.second->inst_num);
+
+			cm.Build();
+			}
+
+		concrete_cases.emplace_back(std::move(cm));
 		}
 	}
 
@@ -33,6 +33,11 @@ public:
 		{
 		tv = _tv;
 		aux = _aux;
+		fast_index = tv->HasFastIndex();
+
+		if ( fast_index )
+			index_vals.resize(aux->loop_vars.size());
+
 		auto tvd = tv->AsTable();
 		tbl_iter = tvd->begin();
 		tbl_end = tvd->end();
@@ -48,7 +53,30 @@ public:
 	// false), assigning to the index variables.
 	void NextIter(ZVal* frame)
 		{
-		auto ind_lv = tv->RecreateIndex(*(*tbl_iter)->GetHashKey());
+		auto k = (*tbl_iter)->GetHashKeyView();
+
+		if ( fast_index )
+			{
+			// Decode the index directly into ZVals, skipping the
+			// parts that the loop body doesn't use.
+			tv->RecreateIndex(k, aux->loop_vars_used, index_vals.data());
+
+			for ( size_t i = 0; i < index_vals.size(); ++i )
+				{
+				if ( ! aux->loop_vars_used[i] )
+					continue;
+
+				auto& var = frame[aux->loop_vars[i]];
+				if ( ZVal::IsManagedType(aux->loop_var_types[i]) )
+					ZVal::DeleteManagedType(var);
+				var = index_vals[i];
+				}
+
+			IterFinished();
+			return;
+			}
+
+		auto ind_lv = tv->RecreateIndex(k);
 		for ( int i = 0; i < ind_lv->Length(); ++i )
 			{
 			ValPtr ind_lv_p = ind_lv->Idx(i);
@@ -88,6 +116,11 @@ private:
 	// Associated auxiliary information.
 	ZInstAux* aux = nullptr;
 
+	// Whether the table's index can be recovered directly as ZVals,
+	// and the buffer for doing so.
+	bool fast_index = false;
+	std::vector<ZVal> index_vals;
+
 	std::optional<DictIterator<TableEntryVal>> tbl_iter;
 	std::optional<DictIterator<TableEntryVal>> tbl_end;
 	};
@@ -527,12 +527,11 @@ const ZAMStmt ZAMCompiler::ValueSwitch(const SwitchStmt* sw, const NameExpr* v,
 
 			case TYPE_INTERNAL_STRING:
 				{
-				// This leaks, but only statically so not worth
-				// tracking the value for ultimate deletion.
-				auto sv = cv->AsString()->Render();
-				std::string s(sv);
+				// The raw bytes, so that lookups needn't render
+				// the switch value.
+				auto sv = cv->AsString();
+				std::string s(reinterpret_cast<const char*>(sv->Bytes()), sv->Len());
 				new_str_cases[s] = case_body_start;
-				delete[] sv;
 				break;
 				}
 
@@ -811,11 +810,14 @@ const ZAMStmt ZAMCompiler::LoopOverTable(const ForStmt* f, const NameExpr* val)
 		{
 		auto id = (*loop_vars)[i];
 
-		if ( body_pf.Locals().count(id) == 0 )
+		bool used = body_pf.Locals().count(id) > 0;
+
+		if ( ! used )
 			++num_unused;
 
 		aux->loop_vars.push_back(FrameSlot(id));
 		aux->loop_var_types.push_back(id->GetType());
+		aux->loop_vars_used.push_back(used);
 		}
 
 	bool no_loop_vars = (num_unused == loop_vars->length());
@@ -1,5 +1,10 @@
 // See the file "COPYING" in the main distribution directory for copyright.
 
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <optional>
+
 #include "zeek/Desc.h"
 #include "zeek/EventHandler.h"
 #include "zeek/Frame.h"
@@ -42,6 +47,68 @@ void report_ZOP_profile()
 			printf("%s\t%d\t%.06f\n", ZOP_name(ZOp(i)), ZOP_count[i], ZOP_CPU[i]);
 	}
 
+// Frames of bodies that can be active more than once at a time come
+// from a stack of ZVal's shared by all such calls, rather than from the
+// heap.  The stack grows in blocks, so frames in use never move.
+static constexpr size_t ZVAL_BLOCK_SIZE = 64 * 1024;
+
+struct ZValBlock
+	{
+	std::unique_ptr<ZVal[]> vals;
+	size_t size;
+	};
+
+static vector<ZValBlock> zval_blocks;
+static size_t zval_block = 0; // the block holding the top of the stack
+static size_t zval_top = 0; // the first free slot in that block
+
+// Pushes a frame on the stack for its lifetime, which includes unwinding
+// due to an exception.
+class ZValStackFrame
+	{
+public:
+	ZValStackFrame(size_t n) : prev_block(zval_block), prev_top(zval_top)
+		{
+		if ( zval_blocks.empty() )
+			zval_blocks.push_back({std::make_unique<ZVal[]>(ZVAL_BLOCK_SIZE), ZVAL_BLOCK_SIZE});
+
+		if ( zval_blocks[zval_block].size - zval_top < n )
+			{
+			// Move on to the next block.  Nothing above the top is in
+			// use, so a block there that's too small can be replaced.
+			++zval_block;
+			zval_top = 0;
+
+			auto size = std::max(ZVAL_BLOCK_SIZE, n);
+
+			if ( zval_block == zval_blocks.size() )
+				zval_blocks.push_back({std::make_unique<ZVal[]>(size), size});
+			else if ( zval_blocks[zval_block].size < n )
+				zval_blocks[zval_block] = {std::make_unique<ZVal[]>(size), size};
+			}
+
+		vals = &zval_blocks[zval_block].vals[zval_top];
+		zval_top += n;
+
+		// Earlier frames leave their values behind.
+		for ( size_t i = 0; i < n; ++i )
+			vals[i].ClearManagedVal();
+		}
+
+	~ZValStackFrame()
+		{
+		zval_block = prev_block;
+		zval_top = prev_top;
+		}
+
+	ZVal* Vals() const { return vals; }
+
+private:
+	size_t prev_block;
+	size_t prev_top;
+	ZVal* vals;
+	};
+
 // Sets the given element to a copy of an existing (not newly constructed)
 // ZVal, including underlying memory management.  Returns false if the
 // assigned value was missing (which we can only tell for managed types),
@@ -127,6 +194,7 @@ VEC_COERCE(UI, TYPE_COUNT, zeek_int_t, AsInt(), int_to_count_would_overflow, "si
 ZBody::ZBody(const char* _func_name, const ZAMCompiler* zc) : Stmt(STMT_ZAM)
 	{
 	func_name = _func_name;
+	track_calls = ! analysis_options.ZAM_report_file.empty();
 
 	frame_denizens = zc->FrameDenizens();
 	frame_size = frame_denizens.size();
@@ -236,8 +304,18 @@ ValPtr ZBody::Exec(Frame* f, StmtFlowType& flow)
 	double t = analysis_options.profile_ZAM ? util::curr_CPU_time() : 0.0;
 #endif
 
+	auto start = track_calls ? std::chrono::steady_clock::now()
+	                         : std::chrono::steady_clock::time_point();
+
 	auto val = DoExec(f, 0, flow);
 
+	if ( track_calls )
+		{
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		++num_calls;
+		exec_time += elapsed.count();
+		}
+
 #ifdef DEBUG
 	if ( analysis_options.profile_ZAM )
 		*CPU_time += util::curr_CPU_time() - t;
@@ -262,6 +340,7 @@ ValPtr ZBody::DoExec(Frame* f, int start_pc, StmtFlowType& flow)
 #endif
 
 	ZVal* frame;
+	std::optional<ZValStackFrame> stack_frame;
 	std::unique_ptr<TableIterVec> local_table_iters;
 	std::vector<StepIterInfo> step_iters(num_step_iters);
 
@@ -269,10 +348,8 @@ ValPtr ZBody::DoExec(Frame* f, int start_pc, StmtFlowType& flow)
 		frame = fixed_frame;
 	else
 		{
-		frame = new ZVal[frame_size];
-		// Clear slots for which we do explicit memory management.
-		for ( auto s : managed_slots )
-			frame[s].ClearManagedVal();
+		stack_frame.emplace(frame_size);
+		frame = stack_frame->Vals();
 
 		if ( ! table_iters.empty() )
 			{
@@ -349,15 +426,13 @@ ValPtr ZBody::DoExec(Frame* f, int start_pc, StmtFlowType& flow)
 	else
 		{
 		// Free those slots for which we do explicit memory management.
-		// No need to then clear them, as we're about to throw away
-		// the entire frame.
+		// No need to then clear them, as the next frame to use the
+		// stack space clears it.
 		for ( auto& ms : managed_slots )
 			{
 			auto& v = frame[ms];
 			ZVal::DeleteManagedType(v);
 			}
-
-		delete[] frame;
 		}
 
 	// Clear any error state.
@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include "zeek/CaseTable.h"
 #include "zeek/script_opt/ZAM/IterInfo.h"
 #include "zeek/script_opt/ZAM/Support.h"
 
@@ -20,10 +21,26 @@ public:
 
 // These are the counterparts to CaseMapI and CaseMapsI in ZAM.h,
 // but concretized to use instruction numbers rather than pointers
-// to instructions.
-template <typename T> using CaseMap = std::map<T, int>;
+// to instructions. Integers and strings get the tables of CaseTable.h,
+// for jump tables and perfect hashing.
+template <typename T>
+using CaseMap = std::conditional_t<
+	std::is_same_v<T, std::string>, StrCaseTable,
+	std::conditional_t<std::is_integral_v<T>, IntCaseTable<T>, std::map<T, int>>>;
 template <typename T> using CaseMaps = std::vector<CaseMap<T>>;
 
+// Returns the branch target for a switch value, or the default.
+template <typename M, typename V> int case_lookup(const M& cases, const V& v, int dflt)
+	{
+	if constexpr ( std::is_same_v<M, std::map<V, int>> )
+		{
+		auto it = cases.find(v);
+		return it == cases.end() ? dflt : it->second;
+		}
+	else
+		return cases.Lookup(v, dflt);
+	}
+
 using TableIterVec = std::vector<TableIterInfo>;
 
 class ZBody : public Stmt
@@ -51,6 +68,11 @@ public:
 
 	void ProfileExecution() const;
 
+	// How often the body ran and the time that took, including what it
+	// called. Only maintained for analysis_options.ZAM_report_file.
+	uint64_t NumCalls() const { return num_calls; }
+	double ExecTime() const { return exec_time; }
+
 protected:
 	friend class ZAMResumption;
 
@@ -111,6 +133,10 @@ private:
 	double* CPU_time = nullptr; // cumulative CPU time for the program
 	std::vector<double>* inst_CPU = nullptr; // per-instruction CPU time.
 
+	bool track_calls = false;
+	uint64_t num_calls = 0;
+	double exec_time = 0.0;
+
 	CaseMaps<zeek_int_t> int_cases;
 	CaseMaps<zeek_uint_t> uint_cases;
 	CaseMaps<double> double_cases;
@@ -396,6 +396,33 @@ bool ZInstI::IsDirectAssignment() const
 		}
 	}
 
+bool ZInstI::IsFieldLoad() const
+	{
+	if ( op_type != OP_VVV_I3 )
+		return false;
+
+	switch ( op )
+		{
+		case OP_FIELD_VVi_N:
+		case OP_FIELD_VVi_A:
+		case OP_FIELD_VVi_O:
+		case OP_FIELD_VVi_P:
+		case OP_FIELD_VVi_R:
+		case OP_FIELD_VVi_S:
+		case OP_FIELD_VVi_F:
+		case OP_FIELD_VVi_T:
+		case OP_FIELD_VVi_V:
+		case OP_FIELD_VVi_L:
+		case OP_FIELD_VVi_f:
+		case OP_FIELD_VVi_t:
+		case OP_FIELD_VVi:
+			return true;
+
+		default:
+			return false;
+		}
+	}
+
 bool ZInstI::HasSideEffects() const
 	{
 	return op_side_effects[op];
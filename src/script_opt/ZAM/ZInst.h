@@ -214,6 +214,10 @@ public:
 	// True if this instruction is of the form "v1 = v2".
 	bool IsDirectAssignment() const;
 
+	// True if this instruction is of the form "v1 = v2$field", with
+	// the field's offset in v3.
+	bool IsFieldLoad() const;
+
 	// True if this instruction has side effects when executed, so
 	// should not be pruned even if it has a dead assignment.
 	bool HasSideEffects() const;
@@ -421,6 +425,9 @@ public:
 	// Their types.
 	std::vector<TypePtr> loop_var_types;
 
+	// Whether the loop body uses them.
+	std::vector<bool> loop_vars_used;
+
 	// Type associated with the "value" entry, for "k, value in aggr"
 	// iteration.
 	TypePtr value_var_type;
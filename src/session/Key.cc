@@ -19,6 +19,7 @@ Key::Key(Key&& rhs)
 	{
 	data = rhs.data;
 	size = rhs.size;
+	type = rhs.type;
 	copied = rhs.copied;
 
 	rhs.data = nullptr;
@@ -32,6 +33,7 @@ Key& Key::operator=(Key&& rhs)
 		{
 		data = rhs.data;
 		size = rhs.size;
+		type = rhs.type;
 		copied = rhs.copied;
 
 		rhs.data = nullptr;
@@ -66,6 +66,10 @@ public:
 
 	std::size_t Hash() const { return zeek::detail::HashKey::HashBytes(data, size); }
 
+	const uint8_t* Data() const { return data; }
+	size_t Size() const { return size; }
+	size_t Type() const { return type; }
+
 private:
 	friend struct KeyHash;
 
@@ -8,16 +8,20 @@
 #include <netinet/in.h>
 #include <pcap.h>
 #include <unistd.h>
+#include <algorithm>
 #include <cstdlib>
 
 #include "zeek/Desc.h"
 #include "zeek/Event.h"
+#include "zeek/Func.h"
+#include "zeek/ID.h"
 #include "zeek/NetVar.h"
 #include "zeek/Reporter.h"
 #include "zeek/RuleMatcher.h"
 #include "zeek/RunState.h"
 #include "zeek/Timer.h"
 #include "zeek/TunnelEncapsulation.h"
+#include "zeek/UID.h"
 #include "zeek/analyzer/Manager.h"
 #include "zeek/iosource/IOSource.h"
 #include "zeek/packet_analysis/Manager.h"
@@ -83,11 +87,41 @@ private:
 	ProtocolMap entries;
 	};
 
+void EmbryonicFlow::InitPacket(Packet* pkt) const
+	{
+	pkt_timeval pkt_ts = ts;
+	pkt->Init(DLT_RAW, &pkt_ts, len, len, data);
+	pkt->vlan = vlan;
+	pkt->inner_vlan = inner_vlan;
+	pkt->l2_src = have_l2_src ? l2_src : nullptr;
+	pkt->l2_dst = have_l2_dst ? l2_dst : nullptr;
+	pkt->l4_checksummed = l4_checksummed;
+
+	if ( (data[0] >> 4) == 4 )
+		{
+		pkt->l3_proto = L3_IPV4;
+		pkt->ip_hdr = std::make_shared<IP_Hdr>(reinterpret_cast<const struct ip*>(data), false);
+		}
+	else
+		{
+		pkt->l3_proto = L3_IPV6;
+		pkt->ip_hdr = std::make_shared<IP_Hdr>(reinterpret_cast<const struct ip6_hdr*>(data),
+		                                       false, len);
+		}
+
+	pkt->proto = pkt->ip_hdr->NextProto();
+	}
+
 	} // namespace detail
 
 Manager::Manager()
 	{
 	stats = new detail::ProtocolStats();
+
+	size_t num_shards = std::max(zeek_uint_t(1), zeek::detail::session_shards);
+
+	for ( size_t i = 0; i < num_shards; ++i )
+		shards.emplace_back(std::make_unique<detail::SessionTable>());
 	}
 
 Manager::~Manager()
@@ -98,6 +132,16 @@ Manager::~Manager()
 
 void Manager::Done() { }
 
+unsigned int Manager::CurrentSessions()
+	{
+	size_t n = 0;
+
+	for ( const auto& shard : shards )
+		n += shard->Size();
+
+	return n;
+	}
+
 Connection* Manager::FindConnection(Val* v)
 	{
 	zeek::detail::ConnKey conn_key(v);
@@ -112,24 +156,62 @@ Connection* Manager::FindConnection(const zeek::detail::ConnKey& conn_key)
 	{
 	detail::Key key(&conn_key, sizeof(conn_key), detail::Key::CONNECTION_KEY_TYPE, false);
 
-	auto it = session_map.find(key);
-	if ( it != session_map.end() )
-		return static_cast<Connection*>(it->second);
+	return static_cast<Connection*>(ShardFor(key).Lookup(key));
+	}
+
+Connection* Manager::FindConnection(const zeek::detail::ConnKey& conn_key, uint32_t flow_hash)
+	{
+	if ( flow_cache.empty() )
+		flow_cache.resize(FLOW_CACHE_SIZE, nullptr);
+
+	detail::Key key(&conn_key, sizeof(conn_key), detail::Key::CONNECTION_KEY_TYPE, false);
+	size_t slot = flow_hash % FLOW_CACHE_SIZE;
+
+	// The flow hash is only a hint, different flows may share a slot.
+	if ( Session* s = flow_cache[slot]; s && s->SessionKey(false) == key )
+		return static_cast<Connection*>(s);
+
+	Session* s = ShardFor(key).Lookup(key);
+	if ( ! s )
+		return nullptr;
+
+	// Each session occupies at most one slot. With a flow hash that isn't
+	// symmetric, the two directions of a connection compete for it.
+	if ( flow_cache[slot] )
+		flow_cache[slot]->flow_cache_slot = -1;
+
+	ForgetFlowHash(s);
+	flow_cache[slot] = s;
+	s->flow_cache_slot = slot;
+
+	return static_cast<Connection*>(s);
+	}
+
+void Manager::ForgetFlowHash(Session* s)
+	{
+	if ( s->flow_cache_slot < 0 )
+		return;
+
+	// Clear() may have dropped the cache already.
+	if ( static_cast<size_t>(s->flow_cache_slot) < flow_cache.size() &&
+	     flow_cache[s->flow_cache_slot] == s )
+		flow_cache[s->flow_cache_slot] = nullptr;
 
-	return nullptr;
+	s->flow_cache_slot = -1;
 	}
 
 void Manager::Remove(Session* s)
 	{
 	if ( s->IsInSessionTable() )
 		{
+		ForgetFlowHash(s);
 		s->CancelTimers();
 		s->Done();
 		s->RemovalEvent();
 
 		detail::Key key = s->SessionKey(false);
 
-		if ( session_map.erase(key) == 0 )
+		if ( ! ShardFor(key).Remove(key) )
 			reporter->InternalWarning("connection missing");
 		else
 			{
@@ -150,23 +232,20 @@ void Manager::Remove(Session* s)
 void Manager::Insert(Session* s, bool remove_existing)
 	{
 	Session* old = nullptr;
-	detail::Key key = s->SessionKey(true);
 
-	if ( remove_existing )
-		{
-		auto it = session_map.find(key);
-		if ( it != session_map.end() )
-			old = it->second;
+	// The session table keeps its own copy of the key.
+	detail::Key key = s->SessionKey(false);
 
-		session_map.erase(key);
-		}
+	if ( remove_existing )
+		old = ShardFor(key).Remove(key);
 
-	InsertSession(std::move(key), s);
+	InsertSession(key, s);
 
 	if ( old && old != s )
 		{
 		// Some clean-ups similar to those in Remove() (but invisible
 		// to the script layer).
+		ForgetFlowHash(old);
 		old->CancelTimers();
 		old->SetInSessionTable(false);
 		Unref(old);
@@ -180,41 +259,79 @@ void Manager::Drain()
 	// every run.
 	if ( zeek::util::detail::have_random_seed() )
 		{
-		std::vector<const detail::Key*> keys;
-		keys.reserve(session_map.size());
+		std::vector<Session*> sessions;
+		sessions.reserve(CurrentSessions());
 
-		for ( auto& entry : session_map )
-			keys.push_back(&(entry.first));
-		std::sort(keys.begin(), keys.end(),
-		          [](const detail::Key* a, const detail::Key* b)
+		ForEachSession([&sessions](Session* s) { sessions.push_back(s); });
+		std::sort(sessions.begin(), sessions.end(),
+		          [](const Session* a, const Session* b)
 		          {
-					  return *a < *b;
+					  return a->SessionKey(false) < b->SessionKey(false);
 				  });
 
-		for ( const auto* k : keys )
+		for ( auto* tc : sessions )
 			{
-			Session* tc = session_map.at(*k);
 			tc->Done();
 			tc->RemovalEvent();
 			}
 		}
 	else
 		{
-		for ( const auto& entry : session_map )
+		ForEachSession(
+			[](Session* tc)
 			{
-			Session* tc = entry.second;
-			tc->Done();
-			tc->RemovalEvent();
-			}
+				tc->Done();
+				tc->RemovalEvent();
+			});
+		}
+
+	// Embryonic flows still pending get reported as if they had expired,
+	// in the order they arrived in.
+	for ( const auto& [expire_time, key] : embryonic_expiry )
+		{
+		if ( auto it = embryonic.find(key);
+		     it != embryonic.end() && it->second.expire_time == expire_time )
+			ReportEmbryonic(it->second, run_state::network_time);
 		}
+
+	embryonic.clear();
+	embryonic_expiry.clear();
+	FlushEmbryonic();
+
+	if ( unsampled_start > 0.0 )
+		FlushUnsampled(run_state::network_time);
+
+	unsampled.clear();
+
+	if ( aggregated_start > 0.0 )
+		FlushAggregated(run_state::network_time);
+
+	shunts.clear();
+	addr_shunts.clear();
 	}
 
 void Manager::Clear()
 	{
-	for ( const auto& entry : session_map )
-		Unref(entry.second);
+	ForEachSession([](Session* s) { Unref(s); });
+
+	for ( auto& shard : shards )
+		shard->Clear();
 
-	session_map.clear();
+	flow_cache.clear();
+
+	embryonic.clear();
+	embryonic_expiry.clear();
+	embryonic_batch = nullptr;
+
+	unsampled.clear();
+	std::fill(std::begin(unsampled_counts), std::end(unsampled_counts), detail::UnsampledCounts{});
+	unsampled_start = 0.0;
+
+	aggregated.clear();
+	aggregated_start = 0.0;
+
+	shunts.clear();
+	addr_shunts.clear();
 
 	zeek::detail::fragment_mgr->Clear();
 	}
@@ -239,6 +356,497 @@ void Manager::GetStats(Stats& s)
 	s.num_fragments = zeek::detail::fragment_mgr->Size();
 	s.max_fragments = zeek::detail::fragment_mgr->MaxFragments();
 	s.num_packets = packet_mgr->PacketsProcessed();
+
+	s.table_capacity = 0;
+	s.table_lookups = 0;
+	s.table_probes = 0;
+	s.table_max_probe_length = 0;
+	s.num_shards = shards.size();
+	s.max_shard_size = 0;
+
+	for ( const auto& shard : shards )
+		{
+		detail::SessionTable::Stats ts;
+		shard->GetStats(&ts);
+		s.table_capacity += ts.capacity;
+		s.table_lookups += ts.lookups;
+		s.table_probes += ts.probes;
+		s.table_max_probe_length = std::max(s.table_max_probe_length, ts.max_probe_length);
+		s.max_shard_size = std::max(s.max_shard_size, shard->Size());
+		}
+
+	s.num_embryonic = embryonic.size();
+	s.cumulative_embryonic = cumulative_embryonic;
+	s.promoted_embryonic = promoted_embryonic;
+
+	s.num_unsampled = unsampled.size();
+	s.cumulative_unsampled = cumulative_unsampled;
+
+	s.num_shunts = shunts.size() + addr_shunts.size();
+	s.shunted_packets = shunted_packets;
+	s.shunted_ip_bytes = shunted_ip_bytes;
+	}
+
+void Manager::InsertEmbryonic(const zeek::detail::ConnKey& conn_key, const Packet* pkt,
+                              double timeout)
+	{
+	const auto& ip = pkt->ip_hdr;
+	const u_char* ip_data = ip->IP4_Hdr() ? reinterpret_cast<const u_char*>(ip->IP4_Hdr())
+	                                      : reinterpret_cast<const u_char*>(ip->IP6_Hdr());
+
+	auto& flow = embryonic[conn_key];
+	flow.ts = pkt->ts;
+	flow.expire_time = run_state::processing_start_time + timeout;
+	flow.vlan = pkt->vlan;
+	flow.inner_vlan = pkt->inner_vlan;
+	flow.have_l2_src = pkt->l2_src != nullptr;
+	flow.have_l2_dst = pkt->l2_dst != nullptr;
+
+	if ( pkt->l2_src )
+		memcpy(flow.l2_src, pkt->l2_src, sizeof(flow.l2_src));
+
+	if ( pkt->l2_dst )
+		memcpy(flow.l2_dst, pkt->l2_dst, sizeof(flow.l2_dst));
+
+	flow.l4_checksummed = pkt->l4_checksummed;
+	flow.len = ip->TotalLen();
+	memcpy(flow.data, ip_data, flow.len);
+
+	embryonic_expiry.emplace_back(flow.expire_time, conn_key);
+	++cumulative_embryonic;
+	}
+
+bool Manager::TakeEmbryonic(const zeek::detail::ConnKey& conn_key, detail::EmbryonicFlow* flow)
+	{
+	if ( embryonic.empty() )
+		return false;
+
+	auto it = embryonic.find(conn_key);
+
+	if ( it == embryonic.end() )
+		return false;
+
+	*flow = it->second;
+	embryonic.erase(it);
+	++promoted_embryonic;
+
+	return true;
+	}
+
+void Manager::ExpireEmbryonic(double t)
+	{
+	while ( ! embryonic_expiry.empty() && embryonic_expiry.front().first <= t )
+		{
+		const auto& [expire_time, key] = embryonic_expiry.front();
+
+		// The flow may have been promoted meanwhile, possibly followed by
+		// a new one with the same key.
+		if ( auto it = embryonic.find(key);
+		     it != embryonic.end() && it->second.expire_time == expire_time )
+			{
+			ReportEmbryonic(it->second, t);
+			embryonic.erase(it);
+			}
+
+		embryonic_expiry.pop_front();
+		}
+
+	if ( embryonic_batch && t - embryonic_batch_start >= zeek::detail::embryonic_summary_interval )
+		FlushEmbryonic();
+	}
+
+void Manager::ReportEmbryonic(const detail::EmbryonicFlow& flow, double t)
+	{
+	if ( ! embryonic_flows )
+		return;
+
+	static auto flow_type = id::find_type<RecordType>("embryonic_flow");
+	static auto flow_vec_type = id::find_type<VectorType>("embryonic_flow_vec");
+
+	Packet pkt;
+	flow.InitPacket(&pkt);
+	const auto& ip = pkt.ip_hdr;
+
+	// TCP and UDP headers both start out with the ports.
+	TransportProto proto = ip->NextProto() == IPPROTO_TCP ? TRANSPORT_TCP : TRANSPORT_UDP;
+	const uint16_t* ports = reinterpret_cast<const uint16_t*>(ip->Payload());
+
+	auto id_val = make_intrusive<RecordVal>(id::conn_id);
+	id_val->Assign(0, val_mgr->Addr(ip->SrcAddr()));
+	id_val->Assign(1, val_mgr->Port(ntohs(ports[0]), proto));
+	id_val->Assign(2, val_mgr->Addr(ip->DstAddr()));
+	id_val->Assign(3, val_mgr->Port(ntohs(ports[1]), proto));
+
+	auto rec = make_intrusive<RecordVal>(flow_type);
+	rec->AssignTime(0, pkt.time);
+	rec->Assign(1, UID(zeek::detail::bits_per_uid).Base62("C"));
+	rec->Assign(2, std::move(id_val));
+	rec->Assign(3, static_cast<uint64_t>(flow.len));
+
+	if ( ! embryonic_batch )
+		{
+		embryonic_batch = make_intrusive<VectorVal>(flow_vec_type);
+		embryonic_batch_start = t;
+		}
+
+	embryonic_batch->Append(std::move(rec));
+
+	if ( embryonic_batch->Size() >= zeek::detail::embryonic_summary_batch_size )
+		FlushEmbryonic();
+	}
+
+void Manager::FlushEmbryonic()
+	{
+	if ( ! embryonic_batch )
+		return;
+
+	event_mgr.Enqueue(embryonic_flows, std::move(embryonic_batch));
+	embryonic_batch = nullptr;
+	}
+
+bool Manager::SampleFlow(const zeek::detail::ConnKey& conn_key) const
+	{
+	double fraction = zeek::detail::flow_sampling_fraction;
+
+	if ( fraction >= 1.0 )
+		return true;
+
+	if ( fraction <= 0.0 )
+		return false;
+
+	// Keys are the same for both directions of a flow, and the static
+	// hash is the same across a cluster.
+	auto h = zeek::detail::KeyedHash::StaticHash64(&conn_key, sizeof(conn_key));
+	return h < static_cast<uint64_t>(fraction * 0x1p64);
+	}
+
+void Manager::CountUnsampled(const zeek::detail::ConnKey& conn_key, const Packet* pkt)
+	{
+	double t = run_state::network_time;
+
+	if ( unsampled.empty() )
+		unsampled_last_sweep = t;
+
+	auto [it, is_new] = unsampled.try_emplace(conn_key, t);
+	auto& counts = unsampled_counts[conn_key.transport];
+
+	if ( is_new )
+		{
+		++counts.flows;
+		++cumulative_unsampled;
+		}
+	else
+		it->second = t;
+
+	++counts.packets;
+	counts.ip_bytes += pkt->ip_hdr->TotalLen();
+
+	if ( unsampled_start == 0.0 )
+		unsampled_start = t;
+	}
+
+void Manager::ExpireUnsampled(double t)
+	{
+	double interval = zeek::detail::flow_sampling_summary_interval;
+
+	if ( unsampled_start > 0.0 && t - unsampled_start >= interval )
+		FlushUnsampled(t);
+
+	if ( t - unsampled_last_sweep < interval )
+		return;
+
+	unsampled_last_sweep = t;
+
+	for ( auto it = unsampled.begin(); it != unsampled.end(); )
+		{
+		if ( t - it->second >= zeek::detail::flow_sampling_inactivity_timeout )
+			it = unsampled.erase(it);
+		else
+			++it;
+		}
+	}
+
+void Manager::FlushUnsampled(double t)
+	{
+	static auto summary_type = id::find_type<RecordType>("flow_summary");
+
+	for ( int proto = 0; proto <= TRANSPORT_ICMP; ++proto )
+		{
+		auto& counts = unsampled_counts[proto];
+
+		if ( counts.packets && flow_sampling_summary )
+			{
+			auto rec = make_intrusive<RecordVal>(summary_type);
+			rec->AssignTime(0, unsampled_start);
+			rec->AssignInterval(1, t - unsampled_start);
+			rec->Assign(2, id::transport_proto->GetEnumVal(proto));
+			rec->Assign(3, zeek::detail::flow_sampling_fraction);
+			rec->Assign(4, counts.flows);
+			rec->Assign(5, counts.packets);
+			rec->Assign(6, counts.ip_bytes);
+			event_mgr.Enqueue(flow_sampling_summary, std::move(rec));
+			}
+
+		counts = {};
+		}
+
+	unsampled_start = 0.0;
+	}
+
+bool Manager::Aggregate(const IPAddr& orig, const IPAddr& resp, uint32_t port, TransportProto proto,
+                        bool is_orig, const Packet* pkt)
+	{
+	double t = run_state::network_time;
+	zeek::detail::ConnKey key(orig, resp, 0, htons(port), proto, true);
+
+	auto [it, is_new] = aggregated.try_emplace(key);
+	auto& flow = it->second;
+
+	if ( is_new )
+		{
+		static auto policy = id::find_func("aggregate_flow_policy");
+
+		// Hooks return false when a handler broke out of them.
+		if ( policy )
+			{
+			auto rval = policy->Invoke(make_intrusive<AddrVal>(orig), make_intrusive<AddrVal>(resp),
+			                           val_mgr->Port(port, proto));
+			flow.analyze = rval && ! rval->AsBool();
+			}
+
+		flow.first_seen = t;
+
+		if ( aggregated_start == 0.0 )
+			aggregated_start = t;
+		}
+
+	if ( flow.analyze )
+		return false;
+
+	flow.last_seen = t;
+
+	if ( is_orig )
+		{
+		++flow.orig_pkts;
+		flow.orig_ip_bytes += pkt->ip_hdr->TotalLen();
+		}
+	else
+		{
+		++flow.resp_pkts;
+		flow.resp_ip_bytes += pkt->ip_hdr->TotalLen();
+		}
+
+	return true;
+	}
+
+void Manager::ExpireAggregated(double t)
+	{
+	if ( t - aggregated_start >= zeek::detail::aggregation_interval )
+		FlushAggregated(t);
+	}
+
+void Manager::FlushAggregated(double t)
+	{
+	static auto flow_type = id::find_type<RecordType>("aggregated_flow");
+	static auto flow_vec_type = id::find_type<VectorType>("aggregated_flow_vec");
+
+	if ( aggregated_flows )
+		{
+		auto flows = make_intrusive<VectorVal>(flow_vec_type);
+
+		for ( const auto& [key, flow] : aggregated )
+			{
+			if ( flow.analyze )
+				continue;
+
+			auto rec = make_intrusive<RecordVal>(flow_type);
+			rec->AssignTime(0, flow.first_seen);
+			rec->AssignInterval(1, flow.last_seen - flow.first_seen);
+			rec->Assign(2, make_intrusive<AddrVal>(IPAddr(key.ip1)));
+			rec->Assign(3, make_intrusive<AddrVal>(IPAddr(key.ip2)));
+			rec->Assign(4, val_mgr->Port(ntohs(key.port2), key.transport));
+			rec->Assign(5, flow.orig_pkts);
+			rec->Assign(6, flow.orig_ip_bytes);
+			rec->Assign(7, flow.resp_pkts);
+			rec->Assign(8, flow.resp_ip_bytes);
+			flows->Append(std::move(rec));
+			}
+
+		if ( flows->Size() > 0 )
+			event_mgr.Enqueue(aggregated_flows, std::move(flows));
+		}
+
+	aggregated.clear();
+	aggregated_start = 0.0;
+	}
+
+namespace
+	{
+
+template <typename M, typename K> bool install_shunt(M& map, const K& key, double timeout)
+	{
+	auto [it, is_new] = map.try_emplace(key);
+	it->second.expire_time = timeout > 0.0 ? run_state::network_time + timeout : 0.0;
+	return is_new;
+	}
+
+template <typename M, typename K> bool remove_shunt(M& map, const K& key, detail::Shunt* counts)
+	{
+	auto it = map.find(key);
+
+	if ( it == map.end() )
+		return false;
+
+	if ( counts )
+		*counts = it->second;
+
+	map.erase(it);
+	return true;
+	}
+
+// Looks up a shunt, forgetting it if it expired.
+template <typename M, typename K> detail::Shunt* find_shunt(M& map, const K& key)
+	{
+	auto it = map.find(key);
+
+	if ( it == map.end() )
+		return nullptr;
+
+	if ( it->second.expire_time > 0.0 && run_state::network_time >= it->second.expire_time )
+		{
+		map.erase(it);
+		return nullptr;
+		}
+
+	return &it->second;
+	}
+
+template <typename M> void expire_shunts(M& map, double t)
+	{
+	for ( auto it = map.begin(); it != map.end(); )
+		{
+		if ( it->second.expire_time > 0.0 && t >= it->second.expire_time )
+			it = map.erase(it);
+		else
+			++it;
+		}
+	}
+
+	} // namespace
+
+bool Manager::InstallShunt(const zeek::detail::ConnKey& conn_key, double timeout)
+	{
+	return install_shunt(shunts, conn_key, timeout);
+	}
+
+bool Manager::InstallShunt(const IPAddr& addr, double timeout)
+	{
+	return install_shunt(addr_shunts, addr, timeout);
+	}
+
+bool Manager::RemoveShunt(const zeek::detail::ConnKey& conn_key, detail::Shunt* counts)
+	{
+	return remove_shunt(shunts, conn_key, counts);
+	}
+
+bool Manager::RemoveShunt(const IPAddr& addr, detail::Shunt* counts)
+	{
+	return remove_shunt(addr_shunts, addr, counts);
+	}
+
+const detail::Shunt* Manager::FindShunt(const zeek::detail::ConnKey& conn_key)
+	{
+	return find_shunt(shunts, conn_key);
+	}
+
+const detail::Shunt* Manager::FindShunt(const IPAddr& addr)
+	{
+	return find_shunt(addr_shunts, addr);
+	}
+
+bool Manager::CheckShunt(const zeek::detail::ConnKey& conn_key, const Packet* pkt)
+	{
+	detail::Shunt* shunt = nullptr;
+
+	if ( ! shunts.empty() )
+		shunt = find_shunt(shunts, conn_key);
+
+	if ( ! shunt && ! addr_shunts.empty() )
+		{
+		shunt = find_shunt(addr_shunts, IPAddr(conn_key.ip1));
+
+		if ( ! shunt )
+			shunt = find_shunt(addr_shunts, IPAddr(conn_key.ip2));
+		}
+
+	if ( ! shunt )
+		return false;
+
+	uint64_t len = pkt->ip_hdr->TotalLen();
+	++shunt->packets;
+	shunt->ip_bytes += len;
+	++shunted_packets;
+	shunted_ip_bytes += len;
+
+	return true;
+	}
+
+void Manager::ExpireShunts(double t)
+	{
+	// Shunts of flows that keep sending expire on their next packet, so
+	// sweeping only needs to catch the ones gone quiet.
+	if ( t - shunts_last_sweep < 1.0 )
+		return;
+
+	shunts_last_sweep = t;
+	expire_shunts(shunts, t);
+	expire_shunts(addr_shunts, t);
+	}
+
+void Manager::SetCPUAccounting(uint64_t rate, double budget)
+	{
+	cpu_sample_rate = rate;
+	cpu_countdown = rate;
+	cpu_budget = budget;
+	}
+
+void Manager::ChargeCPU(Session* s, double seconds)
+	{
+	s->cpu_time += seconds * cpu_sample_rate;
+
+	if ( cpu_budget <= 0.0 || s->cpu_time <= cpu_budget || s->cpu_budget_exceeded )
+		return;
+
+	// Once per session, so that the handlers can decide what to do
+	// about it without getting flooded.
+	s->cpu_budget_exceeded = true;
+
+	if ( connection_cpu_budget_exceeded )
+		s->EnqueueEvent(connection_cpu_budget_exceeded, nullptr, s->GetVal(),
+		                make_intrusive<IntervalVal>(s->cpu_time));
+	}
+
+std::vector<Session*> Manager::MostExpensiveSessions(size_t n) const
+	{
+	std::vector<Session*> sessions;
+
+	ForEachSession(
+		[&sessions](Session* s)
+		{
+			if ( s->cpu_time > 0.0 )
+				sessions.push_back(s);
+		});
+
+	auto more_expensive = [](const Session* a, const Session* b)
+	{
+		return a->cpu_time > b->cpu_time;
+	};
+
+	n = std::min(n, sessions.size());
+	std::partial_sort(sessions.begin(), sessions.begin() + n, sessions.end(), more_expensive);
+	sessions.resize(n);
+
+	return sessions;
 	}
 
 void Manager::Weird(const char* name, const Packet* pkt, const char* addl, const char* source)
@@ -268,11 +876,10 @@ void Manager::Weird(const char* name, const IP_Hdr* ip, const char* addl)
 	reporter->Weird(ip->SrcAddr(), ip->DstAddr(), name, addl);
 	}
 
-void Manager::InsertSession(detail::Key key, Session* session)
+void Manager::InsertSession(const detail::Key& key, Session* session)
 	{
 	session->SetInSessionTable(true);
-	key.CopyData();
-	session_map.insert_or_assign(std::move(key), session);
+	ShardFor(key).Insert(key, session);
 
 	std::string protocol = session->TransportIdentifier();
 
@@ -3,13 +3,19 @@
 #pragma once
 
 #include <sys/types.h> // for u_char
+#include <deque>
+#include <memory>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 #include "zeek/Frag.h"
 #include "zeek/Hash.h"
+#include "zeek/IPAddr.h"
 #include "zeek/NetVar.h"
+#include "zeek/iosource/Packet.h"
 #include "zeek/session/Session.h"
+#include "zeek/session/SessionTable.h"
 #include "zeek/telemetry/Manager.h"
 
 namespace zeek
@@ -32,6 +38,96 @@ namespace session
 namespace detail
 	{
 class ProtocolStats;
+
+/**
+ * A compact record of a flow that hasn't gotten past its first packet,
+ * which the manager tracks in place of a Connection while
+ * embryonic_sessions is on. It keeps a copy of that packet's IP and
+ * transport headers, so that the connection can still be built from it
+ * once a second packet shows up.
+ */
+struct EmbryonicFlow
+	{
+	// Room for IPv4 or IPv6 and TCP headers, including options.
+	static constexpr size_t MAX_PACKET_SIZE = 120;
+
+	pkt_timeval ts;
+	double expire_time;
+	uint32_t vlan;
+	uint32_t inner_vlan;
+	u_char l2_src[Packet::L2_ADDR_LEN];
+	u_char l2_dst[Packet::L2_ADDR_LEN];
+	bool have_l2_src;
+	bool have_l2_dst;
+	bool l4_checksummed;
+	uint16_t len;
+	u_char data[MAX_PACKET_SIZE];
+
+	/**
+	 * Sets up a packet for processing the flow's packet again. The
+	 * packet refers to the record's data, so the record must outlive it.
+	 */
+	void InitPacket(Packet* pkt) const;
+	};
+
+/**
+ * The traffic of one transport protocol that flow sampling left out in the
+ * current summary interval.
+ */
+struct UnsampledCounts
+	{
+	uint64_t flows = 0;
+	uint64_t packets = 0;
+	uint64_t ip_bytes = 0;
+	};
+
+/**
+ * The traffic between an originator and a responder on a port that
+ * aggregated_ports covers, in the current aggregation interval.
+ */
+struct AggregatedFlow
+	{
+	double first_seen = 0.0;
+	double last_seen = 0.0;
+	uint64_t orig_pkts = 0;
+	uint64_t orig_ip_bytes = 0;
+	uint64_t resp_pkts = 0;
+	uint64_t resp_ip_bytes = 0;
+
+	// If aggregate_flow_policy asked for them to get analyzed as
+	// connections instead.
+	bool analyze = false;
+	};
+
+/**
+ * A flow or address whose packets get dropped right after flow hashing,
+ * with the traffic that it dropped so far.
+ */
+struct Shunt
+	{
+	double expire_time = 0.0; // Zero for never.
+	uint64_t packets = 0;
+	uint64_t ip_bytes = 0;
+	};
+
+struct ConnKeyHash
+	{
+	size_t operator()(const zeek::detail::ConnKey& k) const
+		{
+		return zeek::detail::HashKey::HashBytes(&k, sizeof(k));
+		}
+	};
+
+struct IPAddrHash
+	{
+	size_t operator()(const IPAddr& a) const
+		{
+		in6_addr in6;
+		a.CopyIPv6(&in6);
+		return zeek::detail::HashKey::HashBytes(&in6, sizeof(in6));
+		}
+	};
+
 	}
 
 struct Stats
@@ -51,6 +147,30 @@ struct Stats
 	size_t num_fragments;
 	size_t max_fragments;
 	uint64_t num_packets;
+
+	// Session table statistics, see detail::SessionTable::Stats.
+	size_t table_capacity;
+	uint64_t table_lookups;
+	uint64_t table_probes;
+	uint64_t table_max_probe_length;
+
+	// Session table shards, see session_shards.
+	size_t num_shards;
+	size_t max_shard_size;
+
+	// Embryonic flows, see Manager::InsertEmbryonic().
+	size_t num_embryonic;
+	uint64_t cumulative_embryonic;
+	uint64_t promoted_embryonic;
+
+	// Flows that flow sampling left out, see Manager::SampleFlow().
+	size_t num_unsampled;
+	uint64_t cumulative_unsampled;
+
+	// Shunted flows and addresses, see Manager::CheckShunt().
+	size_t num_shunts;
+	uint64_t shunted_packets;
+	uint64_t shunted_ip_bytes;
 	};
 
 class Manager final
@@ -74,6 +194,18 @@ public:
 	 */
 	Connection* FindConnection(const zeek::detail::ConnKey& conn_key);
 
+	/**
+	 * Looks up the connection referred to by a given key, using a flow
+	 * hash that the capture hardware computed for the packet to skip
+	 * hashing the key where possible. The flow hash is only used as a
+	 * hint: the result is the same as for FindConnection(conn_key).
+	 *
+	 * @param conn_key The key for the connection to search for.
+	 * @param flow_hash The packet's flow hash, see Packet::flow_hash.
+	 * @return The connection, or nullptr if one doesn't exist.
+	 */
+	Connection* FindConnection(const zeek::detail::ConnKey& conn_key, uint32_t flow_hash);
+
 	void Remove(Session* s);
 	void Insert(Session* c, bool remove_existing = true);
 
@@ -89,20 +221,318 @@ public:
 	void Weird(const char* name, const Packet* pkt, const char* addl = "", const char* source = "");
 	void Weird(const char* name, const IP_Hdr* ip, const char* addl = "");
 
-	unsigned int CurrentSessions() { return session_map.size(); }
+	unsigned int CurrentSessions();
+
+	/**
+	 * Returns the number of shards that the sessions are split into, see
+	 * session_shards.
+	 */
+	size_t NumShards() const { return shards.size(); }
+
+	/**
+	 * Returns the shard that the session with the given key belongs to.
+	 * The key's flow hash determines the shard, so all packets of a flow
+	 * map to the same one.
+	 */
+	size_t ShardOf(const detail::Key& key) const
+		{
+		// The session tables use the hash's lower bits themselves.
+		return shards.size() > 1 ? (key.Hash() >> 40) % shards.size() : 0;
+		}
+
+	/**
+	 * Starts tracking a new flow in compact form, based on its first
+	 * packet. The caller must make sure that there's no connection for
+	 * the key, and that the packet's IP and transport headers fit into
+	 * an EmbryonicFlow.
+	 *
+	 * @param conn_key The key for the flow.
+	 * @param pkt The flow's first packet.
+	 * @param timeout How long to wait for a second packet before the flow
+	 * expires.
+	 */
+	void InsertEmbryonic(const zeek::detail::ConnKey& conn_key, const Packet* pkt,
+	                     double timeout);
+
+	/**
+	 * Stops tracking a flow in compact form, so that the caller can turn
+	 * it into a connection.
+	 *
+	 * @param conn_key The key for the flow.
+	 * @param flow Receives the flow's record.
+	 * @return True if the flow was tracked.
+	 */
+	bool TakeEmbryonic(const zeek::detail::ConnKey& conn_key, detail::EmbryonicFlow* flow);
+
+	/**
+	 * Reports and removes flows that have been waiting for a second
+	 * packet for too long.
+	 *
+	 * @param t The current network time.
+	 */
+	void ExpireEmbryonic(double t);
+
+	/**
+	 * Returns true if flows are being tracked in compact form.
+	 */
+	bool HaveEmbryonic() const { return ! embryonic.empty() || embryonic_batch; }
+
+	/**
+	 * Decides whether a new flow gets analyzed under flow sampling, see
+	 * flow_sampling_fraction. The decision depends only on the flow's
+	 * key and digest_salt, so that both directions of a flow, and all
+	 * workers of a cluster, make the same one.
+	 *
+	 * @param conn_key The key for the flow.
+	 * @return True if the flow is to get analyzed.
+	 */
+	bool SampleFlow(const zeek::detail::ConnKey& conn_key) const;
+
+	/**
+	 * Counts a packet of a flow that flow sampling left out into the
+	 * current summary, see flow_sampling_summary.
+	 *
+	 * @param conn_key The key for the flow.
+	 * @param pkt The packet.
+	 */
+	void CountUnsampled(const zeek::detail::ConnKey& conn_key, const Packet* pkt);
+
+	/**
+	 * Reports the current summary of flows left out by flow sampling once
+	 * its interval is over, and forgets flows that went inactive.
+	 *
+	 * @param t The current network time.
+	 */
+	void ExpireUnsampled(double t);
+
+	/**
+	 * Returns true if flow sampling left out any flows that are still
+	 * tracked.
+	 */
+	bool HaveUnsampled() const { return ! unsampled.empty() || unsampled_start > 0.0; }
+
+	/**
+	 * Counts a packet of traffic that aggregated_ports covers into the
+	 * current aggregation interval. The first time the originator,
+	 * responder and port show up in the interval, this asks
+	 * aggregate_flow_policy whether to analyze them after all.
+	 *
+	 * @param orig The originator's address.
+	 * @param resp The responder's address.
+	 * @param port The port, or for ICMP the message type, in host order.
+	 * @param proto The transport protocol.
+	 * @param is_orig True if the originator sent the packet.
+	 * @param pkt The packet.
+	 * @return False if the packet is to get analyzed as part of a
+	 * connection instead.
+	 */
+	bool Aggregate(const IPAddr& orig, const IPAddr& resp, uint32_t port, TransportProto proto,
+	               bool is_orig, const Packet* pkt);
+
+	/**
+	 * Reports the aggregated traffic once the current interval is over,
+	 * see aggregated_flows.
+	 *
+	 * @param t The current network time.
+	 */
+	void ExpireAggregated(double t);
+
+	/**
+	 * Returns true if traffic is being aggregated in the current interval.
+	 */
+	bool HaveAggregated() const { return aggregated_start > 0.0; }
+
+	/**
+	 * Shunts a flow: its packets, in both directions, get dropped right
+	 * after flow hashing, before any analysis, and only get counted. A
+	 * connection that already exists for the flow sees no more packets
+	 * and eventually times out.
+	 *
+	 * @param conn_key The key for the flow.
+	 * @param timeout The time after which the shunt goes away, or zero for
+	 * never.
+	 * @return True if the flow wasn't shunted yet. Otherwise, only its
+	 * timeout changes.
+	 */
+	bool InstallShunt(const zeek::detail::ConnKey& conn_key, double timeout);
+
+	/**
+	 * Shunts all flows from or to an address, like InstallShunt().
+	 */
+	bool InstallShunt(const IPAddr& addr, double timeout);
+
+	/**
+	 * Removes the shunt of a flow.
+	 *
+	 * @param conn_key The key for the flow.
+	 * @param counts If not null, receives the traffic that the shunt
+	 * dropped.
+	 * @return True if the flow was shunted.
+	 */
+	bool RemoveShunt(const zeek::detail::ConnKey& conn_key, detail::Shunt* counts = nullptr);
+
+	/**
+	 * Removes the shunt of an address, like RemoveShunt().
+	 */
+	bool RemoveShunt(const IPAddr& addr, detail::Shunt* counts = nullptr);
+
+	/**
+	 * Returns the shunt of a flow, or null if it's not shunted.
+	 */
+	const detail::Shunt* FindShunt(const zeek::detail::ConnKey& conn_key);
+
+	/**
+	 * Returns the shunt of an address, or null if it's not shunted.
+	 */
+	const detail::Shunt* FindShunt(const IPAddr& addr);
+
+	/**
+	 * Checks whether a packet belongs to a shunted flow or address, and
+	 * counts it to the shunt if so. Callers check HaveShunts() first,
+	 * which keeps this off the packet path while nothing is shunted.
+	 *
+	 * @param conn_key The key for the packet's flow.
+	 * @param pkt The packet.
+	 * @return True if the packet is to get dropped.
+	 */
+	bool CheckShunt(const zeek::detail::ConnKey& conn_key, const Packet* pkt);
+
+	/**
+	 * Removes shunts whose timeout passed.
+	 *
+	 * @param t The current network time.
+	 */
+	void ExpireShunts(double t);
+
+	/**
+	 * Returns true if any flows or addresses are shunted.
+	 */
+	bool HaveShunts() const { return ! shunts.empty() || ! addr_shunts.empty(); }
+
+	/**
+	 * Sets up the estimation of each session's processing time, see
+	 * Conn::cpu_sample_rate and Conn::cpu_budget.
+	 *
+	 * @param rate Times the processing of one in this many packets, or
+	 * none if zero.
+	 *
+	 * @param budget The estimated time in seconds after which a connection
+	 * raises connection_cpu_budget_exceeded, or zero for no limit.
+	 */
+	void SetCPUAccounting(uint64_t rate, double budget);
+
+	/**
+	 * Returns true if processing the next packet is to get timed.
+	 */
+	bool SampleCPU()
+		{
+		if ( ! cpu_sample_rate || --cpu_countdown > 0 )
+			return false;
+
+		cpu_countdown = cpu_sample_rate;
+		return true;
+		}
+
+	/**
+	 * Charges a session for the processing of a timed packet. The time
+	 * gets scaled up by the sample rate, to account for the packets that
+	 * weren't timed.
+	 *
+	 * @param s The session the packet belongs to.
+	 *
+	 * @param seconds The time the packet's processing took.
+	 */
+	void ChargeCPU(Session* s, double seconds);
+
+	/**
+	 * Returns the sessions with the highest estimated processing times.
+	 *
+	 * @param n The maximum number of sessions to return.
+	 *
+	 * @return The sessions, the most expensive first.
+	 */
+	std::vector<Session*> MostExpensiveSessions(size_t n) const;
 
 private:
-	using SessionMap = std::unordered_map<detail::Key, Session*, detail::KeyHash>;
+	// Adds a flow to the batch of expired ones, reporting the batch once
+	// it's full.
+	void ReportEmbryonic(const detail::EmbryonicFlow& flow, double t);
+
+	// Raises embryonic_flows for the current batch.
+	void FlushEmbryonic();
+
+	// Raises flow_sampling_summary for the current interval's traffic.
+	void FlushUnsampled(double t);
+
+	// Raises aggregated_flows for the current interval's traffic.
+	void FlushAggregated(double t);
 
 	// Inserts a new connection into the sessions map. If a connection with
 	// the same key already exists in the map, it will be overwritten by
 	// the new one.  Connection count stats get updated either way (so most
 	// cases should likely check that the key is not already in the map to
 	// avoid unnecessary incrementing of connecting counts).
-	void InsertSession(detail::Key key, Session* session);
+	void InsertSession(const detail::Key& key, Session* session);
+
+	// Drops the flow hash cache's reference to a session, if any.
+	void ForgetFlowHash(Session* s);
+
+	detail::SessionTable& ShardFor(const detail::Key& key) { return *shards[ShardOf(key)]; }
+
+	template <typename F> void ForEachSession(F f) const
+		{
+		for ( const auto& shard : shards )
+			shard->ForEach(f);
+		}
 
-	SessionMap session_map;
+	std::vector<std::unique_ptr<detail::SessionTable>> shards;
+
+	// Direct-mapped cache of sessions, indexed by the flow hash of their
+	// most recent packet. Allocated on first use.
+	static constexpr size_t FLOW_CACHE_SIZE = 65536;
+	std::vector<Session*> flow_cache;
 	detail::ProtocolStats* stats;
+
+	std::unordered_map<zeek::detail::ConnKey, detail::EmbryonicFlow, detail::ConnKeyHash>
+		embryonic;
+
+	// Embryonic flows in the order they'll expire, with their expiration
+	// time. Entries for flows that got promoted stay until they come up.
+	std::deque<std::pair<double, zeek::detail::ConnKey>> embryonic_expiry;
+
+	// Expired flows not reported yet, and when the first of them expired.
+	VectorValPtr embryonic_batch;
+	double embryonic_batch_start = 0.0;
+
+	uint64_t cumulative_embryonic = 0;
+	uint64_t promoted_embryonic = 0;
+
+	// Flows that flow sampling left out, with when they last saw a
+	// packet, and their traffic in the current summary interval by
+	// transport protocol.
+	std::unordered_map<zeek::detail::ConnKey, double, detail::ConnKeyHash> unsampled;
+	detail::UnsampledCounts unsampled_counts[TRANSPORT_ICMP + 1];
+	double unsampled_start = 0.0;
+	double unsampled_last_sweep = 0.0;
+	uint64_t cumulative_unsampled = 0;
+
+	// Traffic counted in aggregate in the current interval, keyed by
+	// originator, responder, port and transport protocol.
+	std::unordered_map<zeek::detail::ConnKey, detail::AggregatedFlow, detail::ConnKeyHash>
+		aggregated;
+	double aggregated_start = 0.0;
+
+	// Shunted flows and addresses, and their traffic over all shunts,
+	// including those that went away.
+	std::unordered_map<zeek::detail::ConnKey, detail::Shunt, detail::ConnKeyHash> shunts;
+	std::unordered_map<IPAddr, detail::Shunt, detail::IPAddrHash> addr_shunts;
+	double shunts_last_sweep = 0.0;
+	uint64_t shunted_packets = 0;
+	uint64_t shunted_ip_bytes = 0;
+
+	uint64_t cpu_sample_rate = 0;
+	uint64_t cpu_countdown = 0;
+	double cpu_budget = 0.0;
 	};
 
 	} // namespace session
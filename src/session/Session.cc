@@ -37,6 +37,21 @@ void Timer::Dispatch(double t, bool is_expire)
 	if ( is_expire && ! do_expire )
 		return;
 
+	// Packets only push out the session's inactivity deadline, without
+	// touching this timer. If the deadline moved, we just go back into
+	// the queue.
+	if ( type == zeek::detail::TIMER_CONN_INACTIVITY && ! is_expire &&
+	     session->inactivity_timeout )
+		{
+		double deadline = session->last_time + session->inactivity_timeout;
+
+		if ( deadline > t )
+			{
+			Rearm(deadline);
+			return;
+			}
+		}
+
 	// Remove ourselves from the session's set of timers so
 	// it doesn't try to cancel us.
 	session->RemoveTimer(this);
@@ -100,10 +115,17 @@ void Session::SetInactivityTimeout(double timeout)
 	if ( timeout == inactivity_timeout )
 		return;
 
-	// First cancel and remove any existing inactivity timer.
 	for ( const auto& timer : timers )
 		if ( timer->Type() == zeek::detail::TIMER_CONN_INACTIVITY )
 			{
+			// A pending timer firing no later than the new deadline
+			// can stay, it'll rearm itself for the deadline.
+			if ( timeout && timer->Time() <= last_time + timeout )
+				{
+				inactivity_timeout = timeout;
+				return;
+				}
+
 			zeek::detail::timer_mgr->Cancel(timer);
 			break;
 			}
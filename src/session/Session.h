@@ -197,8 +197,16 @@ public:
 	AnalyzerConfirmationState AnalyzerState(const zeek::Tag& tag) const;
 	void SetAnalyzerState(const zeek::Tag& tag, AnalyzerConfirmationState);
 
+	/**
+	 * Returns the estimated time spent processing the session's packets so
+	 * far, in seconds. This stays zero unless Manager::SetCPUAccounting()
+	 * turned sampling on.
+	 */
+	double CPUTime() const { return cpu_time; }
+
 protected:
 	friend class detail::Timer;
+	friend class Manager;
 
 	/**
 	 * Add a given timer to expire at a specific time.
@@ -245,6 +253,14 @@ protected:
 	unsigned int record_current_packet : 1, record_current_content : 1;
 	bool in_session_table;
 
+	// Slot of the session manager's flow hash cache that refers to this
+	// session, or -1 if none.
+	int64_t flow_cache_slot = -1;
+
+	// Estimated processing time, and whether it went over the budget.
+	double cpu_time = 0.0;
+	bool cpu_budget_exceeded = false;
+
 	std::map<zeek::Tag, AnalyzerConfirmationState> analyzer_confirmations;
 	};
 
@@ -0,0 +1,747 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/session/SessionTable.h"
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <set>
+#include <string>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "zeek/3rdparty/doctest.h"
+
+namespace zeek::session::detail
+	{
+
+uint32_t FlatSessionTable::MatchByte(const int8_t* ctrl, int8_t b)
+	{
+#ifdef __SSE2__
+	__m128i group = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl));
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(b)));
+#else
+	uint32_t mask = 0;
+
+	for ( size_t i = 0; i < GROUP_SIZE; i++ )
+		if ( ctrl[i] == b )
+			mask |= 1u << i;
+
+	return mask;
+#endif
+	}
+
+uint32_t FlatSessionTable::MatchFree(const int8_t* ctrl)
+	{
+#ifdef __SSE2__
+	// Empty and deleted are the only negative control bytes.
+	__m128i group = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl));
+	return _mm_movemask_epi8(group);
+#else
+	uint32_t mask = 0;
+
+	for ( size_t i = 0; i < GROUP_SIZE; i++ )
+		if ( ctrl[i] < 0 )
+			mask |= 1u << i;
+
+	return mask;
+#endif
+	}
+
+void FlatSessionTable::FreeKey(Slot* slot)
+	{
+	if ( slot->key_size > INLINE_KEY_SIZE )
+		delete[] slot->heap_key;
+	}
+
+void FlatSessionTable::Table::Allocate(size_t arg_capacity)
+	{
+	capacity = arg_capacity;
+	used = 0;
+	deleted = 0;
+
+	// Slots are only initialized once they become full.
+	ctrl.reset(new int8_t[capacity]);
+	slots.reset(new Slot[capacity]);
+	memset(ctrl.get(), CTRL_EMPTY, capacity);
+	}
+
+void FlatSessionTable::Table::Release()
+	{
+	for ( size_t i = 0; i < capacity; i++ )
+		if ( ctrl[i] >= 0 )
+			FreeKey(&slots[i]);
+
+	ctrl.reset();
+	slots.reset();
+	capacity = 0;
+	used = 0;
+	deleted = 0;
+	}
+
+size_t FlatSessionTable::Table::Find(uint64_t hash, const Key& key, uint64_t* probes) const
+	{
+	if ( used == 0 )
+		return NOT_FOUND;
+
+	int8_t h2 = H2(hash);
+	size_t pos = FirstGroup(hash, capacity);
+
+	while ( true )
+		{
+		++*probes;
+
+		for ( uint32_t m = MatchByte(&ctrl[pos], h2); m; m &= m - 1 )
+			{
+			size_t idx = pos + __builtin_ctz(m);
+			const Slot& s = slots[idx];
+
+			if ( s.hash == hash && s.key_size == key.Size() && s.key_type == key.Type() &&
+			     memcmp(s.KeyData(), key.Data(), key.Size()) == 0 )
+				return idx;
+			}
+
+		// Insertion never skips a group with an empty slot, so the key
+		// can't be further along.
+		if ( MatchByte(&ctrl[pos], CTRL_EMPTY) )
+			return NOT_FOUND;
+
+		pos = (pos + GROUP_SIZE) & (capacity - 1);
+		}
+	}
+
+size_t FlatSessionTable::Table::FindFree(uint64_t hash) const
+	{
+	size_t pos = FirstGroup(hash, capacity);
+
+	while ( true )
+		{
+		if ( uint32_t m = MatchFree(&ctrl[pos]) )
+			return pos + __builtin_ctz(m);
+
+		pos = (pos + GROUP_SIZE) & (capacity - 1);
+		}
+	}
+
+void FlatSessionTable::Table::Place(size_t idx, const Slot& slot)
+	{
+	if ( ctrl[idx] == CTRL_DELETED )
+		--deleted;
+
+	ctrl[idx] = H2(slot.hash);
+	slots[idx] = slot;
+	++used;
+	}
+
+void FlatSessionTable::Table::Erase(size_t idx)
+	{
+	size_t group = idx & ~(GROUP_SIZE - 1);
+
+	// A group that still has an empty slot ends every probe sequence
+	// passing through it, so this slot may become empty as well.
+	// Otherwise later entries may have probed past it.
+	if ( MatchByte(&ctrl[group], CTRL_EMPTY) )
+		ctrl[idx] = CTRL_EMPTY;
+	else
+		{
+		ctrl[idx] = CTRL_DELETED;
+		++deleted;
+		}
+
+	--used;
+	}
+
+FlatSessionTable::FlatSessionTable()
+	{
+	cur.Allocate(MIN_CAPACITY);
+	}
+
+FlatSessionTable::~FlatSessionTable()
+	{
+	cur.Release();
+	old.Release();
+	}
+
+Session* FlatSessionTable::Lookup(const Key& key)
+	{
+	uint64_t hash = key.Hash();
+	uint64_t n = 0;
+	Session* result = nullptr;
+
+	if ( size_t idx = cur.Find(hash, key, &n); idx != NOT_FOUND )
+		result = cur.slots[idx].session;
+
+	else if ( old.capacity )
+		{
+		if ( idx = old.Find(hash, key, &n); idx != NOT_FOUND )
+			result = old.slots[idx].session;
+		}
+
+	++lookups;
+	probes += n;
+
+	if ( n > max_probe_length )
+		max_probe_length = n;
+
+	return result;
+	}
+
+Session* FlatSessionTable::Insert(const Key& key, Session* s)
+	{
+	uint64_t hash = key.Hash();
+	uint64_t n = 0;
+
+	if ( size_t idx = cur.Find(hash, key, &n); idx != NOT_FOUND )
+		{
+		Session* prev = cur.slots[idx].session;
+		cur.slots[idx].session = s;
+		return prev;
+		}
+
+	Session* prev = nullptr;
+
+	if ( old.capacity )
+		{
+		// Entries must only ever live in one of the tables.
+		if ( size_t idx = old.Find(hash, key, &n); idx != NOT_FOUND )
+			{
+			prev = old.slots[idx].session;
+			FreeKey(&old.slots[idx]);
+			old.Erase(idx);
+			}
+
+		Migrate(MIGRATE_SLOTS);
+		}
+
+	// Keep at least one in eight slots empty so probe sequences stay short.
+	if ( (cur.used + cur.deleted + 1) * 8 > cur.capacity * 7 )
+		Grow();
+
+	Slot slot;
+	slot.hash = hash;
+	slot.session = s;
+	slot.key_size = key.Size();
+	slot.key_type = key.Type();
+
+	if ( key.Size() <= INLINE_KEY_SIZE )
+		memcpy(slot.inline_key, key.Data(), key.Size());
+	else
+		{
+		slot.heap_key = new uint8_t[key.Size()];
+		memcpy(slot.heap_key, key.Data(), key.Size());
+		}
+
+	cur.Place(cur.FindFree(hash), slot);
+	return prev;
+	}
+
+Session* FlatSessionTable::Remove(const Key& key)
+	{
+	uint64_t hash = key.Hash();
+	uint64_t n = 0;
+
+	for ( Table* t : {&cur, &old} )
+		{
+		if ( ! t->capacity )
+			continue;
+
+		if ( size_t idx = t->Find(hash, key, &n); idx != NOT_FOUND )
+			{
+			Session* s = t->slots[idx].session;
+			FreeKey(&t->slots[idx]);
+			t->Erase(idx);
+			return s;
+			}
+		}
+
+	return nullptr;
+	}
+
+void FlatSessionTable::Clear()
+	{
+	cur.Release();
+	old.Release();
+	migrate_pos = 0;
+	cur.Allocate(MIN_CAPACITY);
+	}
+
+void FlatSessionTable::Grow()
+	{
+	// We only get here with a migration still pending if the table
+	// filled up from mostly tombstones; finish it first.
+	if ( old.capacity )
+		Migrate(old.capacity);
+
+	// If most of the load is tombstones, rebuilding at the same size
+	// suffices.
+	size_t capacity = cur.capacity;
+
+	if ( cur.used * 16 >= cur.capacity * 7 )
+		capacity *= 2;
+
+	old = std::move(cur);
+	cur.Allocate(capacity);
+	migrate_pos = 0;
+
+	Migrate(MIGRATE_SLOTS);
+	}
+
+void FlatSessionTable::Migrate(size_t num_slots)
+	{
+	size_t end = std::min(old.capacity, migrate_pos + num_slots);
+
+	for ( ; migrate_pos < end; ++migrate_pos )
+		{
+		if ( old.ctrl[migrate_pos] < 0 )
+			continue;
+
+		// The slot's key storage moves along with it.
+		const Slot& slot = old.slots[migrate_pos];
+		cur.Place(cur.FindFree(slot.hash), slot);
+		old.ctrl[migrate_pos] = CTRL_DELETED;
+		--old.used;
+		}
+
+	if ( migrate_pos == old.capacity )
+		{
+		// All keys have been moved, nothing left to free.
+		old.ctrl.reset();
+		old.slots.reset();
+		old.capacity = 0;
+		old.used = 0;
+		old.deleted = 0;
+		migrate_pos = 0;
+		}
+	}
+
+void FlatSessionTable::GetStats(Stats* s) const
+	{
+	s->capacity = cur.capacity + old.capacity;
+	s->lookups = lookups;
+	s->probes = probes;
+	s->max_probe_length = max_probe_length;
+	}
+
+MapSessionTable::~MapSessionTable() = default;
+
+Session* MapSessionTable::Lookup(const Key& key)
+	{
+	++lookups;
+
+	auto it = map.find(key);
+	return it != map.end() ? it->second : nullptr;
+	}
+
+Session* MapSessionTable::Insert(const Key& key, Session* s)
+	{
+	if ( auto it = map.find(key); it != map.end() )
+		{
+		Session* prev = it->second;
+		it->second = s;
+		return prev;
+		}
+
+	map.emplace(Key(key.Data(), key.Size(), key.Type(), true), s);
+	return nullptr;
+	}
+
+Session* MapSessionTable::Remove(const Key& key)
+	{
+	auto it = map.find(key);
+
+	if ( it == map.end() )
+		return nullptr;
+
+	Session* s = it->second;
+	map.erase(it);
+	return s;
+	}
+
+void MapSessionTable::GetStats(Stats* s) const
+	{
+	s->capacity = map.bucket_count();
+	s->lookups = lookups;
+	s->probes = 0;
+	s->max_probe_length = 0;
+	}
+
+	} // namespace zeek::session::detail
+
+using namespace zeek::session;
+using namespace zeek::session::detail;
+
+namespace
+	{
+
+// The table never looks at its sessions, so the tests number them instead.
+Session* session(uintptr_t n)
+	{
+	return reinterpret_cast<Session*>(n + 1);
+	}
+
+uintptr_t num(Session* s)
+	{
+	return reinterpret_cast<uintptr_t>(s) - 1;
+	}
+
+Key key(const std::string& data)
+	{
+	return Key(data.data(), data.size(), 1);
+	}
+
+size_t capacity(const FlatSessionTable& t)
+	{
+	FlatSessionTable::Stats stats;
+	t.GetStats(&stats);
+	return stats.capacity;
+	}
+
+// The group of control bytes a key's probe sequence starts at in a table
+// of the initial 64 slots, mirroring FlatSessionTable::FirstGroup().
+size_t first_group(const std::string& data)
+	{
+	return (key(data).Hash() >> 7) & 63 & ~size_t(15);
+	}
+
+// Returns n keys whose probe sequences start at the given group.
+std::deque<std::string> keys_for_group(size_t group, size_t n, const std::string& prefix)
+	{
+	std::deque<std::string> keys;
+
+	for ( int i = 0; keys.size() < n; i++ )
+		{
+		auto data = prefix + std::to_string(i);
+
+		if ( first_group(data) == group )
+			keys.push_back(data);
+		}
+
+	return keys;
+	}
+
+	} // namespace
+
+TEST_SUITE_BEGIN("SessionTable");
+
+TEST_CASE("session table insert, replace, and remove")
+	{
+	FlatSessionTable t;
+	std::string a = "a";
+
+	CHECK(t.Lookup(key(a)) == nullptr);
+	CHECK(t.Remove(key(a)) == nullptr);
+
+	CHECK(t.Insert(key(a), session(1)) == nullptr);
+	CHECK(t.Size() == 1);
+	CHECK(t.Lookup(key(a)) == session(1));
+
+	CHECK(t.Insert(key(a), session(2)) == session(1));
+	CHECK(t.Size() == 1);
+	CHECK(t.Lookup(key(a)) == session(2));
+
+	// The same bytes under a different key type are a different key.
+	Key other_type(a.data(), a.size(), 2);
+	CHECK(t.Lookup(other_type) == nullptr);
+	CHECK(t.Insert(other_type, session(3)) == nullptr);
+	CHECK(t.Size() == 2);
+
+	CHECK(t.Remove(key(a)) == session(2));
+	CHECK(t.Remove(key(a)) == nullptr);
+	CHECK(t.Lookup(key(a)) == nullptr);
+	CHECK(t.Lookup(other_type) == session(3));
+	CHECK(t.Size() == 1);
+	}
+
+TEST_CASE("session table migration")
+	{
+	FlatSessionTable t;
+	std::deque<std::string> keys;
+
+	for ( int i = 0; i < 57; i++ )
+		keys.push_back("key" + std::to_string(i));
+
+	// 56 entries fit into the initial table.
+	for ( int i = 0; i < 56; i++ )
+		CHECK(t.Insert(key(keys[i]), session(i)) == nullptr);
+
+	CHECK(capacity(t) == 64);
+
+	// The next one makes it grow. Only half of the old slots get migrated
+	// right away, and those can't hold all 56 entries, so some still
+	// sit in the old table.
+	CHECK(t.Insert(key(keys[56]), session(56)) == nullptr);
+	CHECK(capacity(t) == 64 + 128);
+	CHECK(t.Size() == 57);
+
+	for ( int i = 0; i < 57; i++ )
+		CHECK(t.Lookup(key(keys[i])) == session(i));
+
+	// ForEach() visits the old table last, so that's where the last
+	// session it sees lives.
+	Session* in_old = nullptr;
+	t.ForEach([&in_old](Session* s) { in_old = s; });
+	REQUIRE(in_old);
+	uintptr_t removed = num(in_old);
+
+	CHECK(t.Remove(key(keys[removed])) == in_old);
+	CHECK(t.Remove(key(keys[removed])) == nullptr);
+	CHECK(t.Lookup(key(keys[removed])) == nullptr);
+	CHECK(t.Size() == 56);
+	CHECK(capacity(t) == 64 + 128);
+
+	// Replacing an entry of the old table moves it to the new one. The
+	// insertion also finishes the migration.
+	t.ForEach([&in_old](Session* s) { in_old = s; });
+	uintptr_t replaced = num(in_old);
+
+	CHECK(t.Insert(key(keys[replaced]), session(100)) == in_old);
+	CHECK(t.Size() == 56);
+	CHECK(capacity(t) == 128);
+
+	std::set<Session*> seen;
+	t.ForEach([&seen](Session* s) { CHECK(seen.insert(s).second); });
+	CHECK(seen.size() == 56);
+
+	for ( uintptr_t i = 0; i < 57; i++ )
+		{
+		auto* s = t.Lookup(key(keys[i]));
+
+		if ( i == removed )
+			CHECK(s == nullptr);
+		else if ( i == replaced )
+			CHECK(s == session(100));
+		else
+			CHECK(s == session(i));
+		}
+	}
+
+TEST_CASE("session table rebuilds when full of tombstones")
+	{
+	FlatSessionTable t;
+
+	// Filling the first two groups completely and emptying them again
+	// leaves 32 tombstones.
+	auto tombstones = keys_for_group(0, 16, "t");
+	auto more = keys_for_group(16, 16, "t");
+	tombstones.insert(tombstones.end(), more.begin(), more.end());
+
+	for ( const auto& k : tombstones )
+		t.Insert(key(k), session(0));
+
+	for ( const auto& k : tombstones )
+		CHECK(t.Remove(key(k)) == session(0));
+
+	CHECK(t.Size() == 0);
+
+	// Entries in the other two groups don't reuse the tombstones. With
+	// 24 of them, the table is as full as it gets, but less than half of
+	// it are live entries.
+	auto keys = keys_for_group(32, 12, "k");
+	more = keys_for_group(48, 12, "k");
+	keys.insert(keys.end(), more.begin(), more.end());
+	keys.push_back("last");
+
+	for ( size_t i = 0; i < 24; i++ )
+		t.Insert(key(keys[i]), session(i));
+
+	CHECK(capacity(t) == 64);
+
+	// So the next one rebuilds the table at the same size.
+	t.Insert(key(keys[24]), session(24));
+	CHECK(capacity(t) == 64 + 64);
+
+	t.Insert(key("another"), session(25));
+	CHECK(capacity(t) == 64);
+	CHECK(t.Size() == 26);
+
+	for ( size_t i = 0; i < keys.size(); i++ )
+		CHECK(t.Lookup(key(keys[i])) == session(i));
+
+	for ( const auto& k : tombstones )
+		CHECK(t.Lookup(key(k)) == nullptr);
+	}
+
+TEST_CASE("session table removal keeps later entries findable")
+	{
+	FlatSessionTable t;
+
+	// The first 16 keys fill their group, the 17th probes past it.
+	auto keys = keys_for_group(0, 17, "k");
+
+	for ( size_t i = 0; i < keys.size(); i++ )
+		t.Insert(key(keys[i]), session(i));
+
+	// Removing from the full group must leave a tombstone, or the probe
+	// for the last key would stop there.
+	CHECK(t.Remove(key(keys[3])) == session(3));
+	CHECK(t.Lookup(key(keys[16])) == session(16));
+
+	for ( size_t i = 0; i < 16; i++ )
+		t.Remove(key(keys[i]));
+
+	CHECK(t.Size() == 1);
+	CHECK(t.Lookup(key(keys[16])) == session(16));
+
+	// New keys may take the tombstones without hiding the last key.
+	auto again = keys_for_group(0, 4, "a");
+
+	for ( size_t i = 0; i < again.size(); i++ )
+		CHECK(t.Insert(key(again[i]), session(20 + i)) == nullptr);
+
+	CHECK(t.Lookup(key(keys[16])) == session(16));
+	CHECK(t.Insert(key(keys[16]), session(30)) == session(16));
+	CHECK(t.Size() == 5);
+
+	for ( size_t i = 0; i < again.size(); i++ )
+		CHECK(t.Remove(key(again[i])) == session(20 + i));
+
+	CHECK(t.Remove(key(keys[16])) == session(30));
+	CHECK(t.Size() == 0);
+	}
+
+TEST_CASE("session table clear")
+	{
+	FlatSessionTable t;
+	std::deque<std::string> keys;
+
+	for ( int i = 0; i < 200; i++ )
+		{
+		keys.push_back("key" + std::to_string(i));
+		t.Insert(key(keys.back()), session(i));
+		}
+
+	CHECK(capacity(t) > 64);
+
+	t.Clear();
+	CHECK(t.Size() == 0);
+	CHECK(capacity(t) == 64);
+
+	for ( const auto& k : keys )
+		CHECK(t.Lookup(key(k)) == nullptr);
+
+	// Clearing in the middle of a migration drops both tables.
+	for ( int i = 0; i < 57; i++ )
+		t.Insert(key(keys[i]), session(i));
+
+	CHECK(capacity(t) == 64 + 128);
+
+	t.Clear();
+	CHECK(t.Size() == 0);
+	CHECK(capacity(t) == 64);
+
+	CHECK(t.Insert(key(keys[0]), session(0)) == nullptr);
+	CHECK(t.Lookup(key(keys[0])) == session(0));
+	CHECK(t.Size() == 1);
+	}
+
+TEST_CASE("session table large keys")
+	{
+	FlatSessionTable t;
+	std::deque<std::string> keys;
+
+	// Keys only differing past the inline size need to be stored in full.
+	for ( int i = 0; i < 300; i++ )
+		keys.push_back(std::string(FlatSessionTable::INLINE_KEY_SIZE + 10, 'x') +
+		               std::to_string(i));
+
+	// The table copies the keys, they can go away after insertion.
+	for ( size_t i = 0; i < keys.size(); i++ )
+		{
+		std::string copy = keys[i];
+		CHECK(t.Insert(key(copy), session(i)) == nullptr);
+		copy.assign(copy.size(), 'y');
+		}
+
+	CHECK(t.Size() == keys.size());
+
+	for ( size_t i = 0; i < keys.size(); i++ )
+		CHECK(t.Lookup(key(keys[i])) == session(i));
+
+	// Removing and replacing entries, some of them in the middle of
+	// migrations, must free each key exactly once. Running this under
+	// ASan checks that, along with the rest being freed by Clear() and
+	// the destructor.
+	for ( size_t i = 0; i < keys.size(); i += 2 )
+		CHECK(t.Remove(key(keys[i])) == session(i));
+
+	for ( size_t i = 1; i < keys.size(); i += 4 )
+		CHECK(t.Insert(key(keys[i]), session(1000 + i)) == session(i));
+
+	for ( int i = 0; i < 300; i++ )
+		{
+		keys.push_back(std::string(FlatSessionTable::INLINE_KEY_SIZE * 2, 'z') + std::to_string(i));
+		t.Insert(key(keys.back()), session(2000 + i));
+		}
+
+	for ( size_t i = 0; i < 300; i++ )
+		{
+		auto* s = t.Lookup(key(keys[i]));
+
+		if ( i % 2 == 0 )
+			CHECK(s == nullptr);
+		else if ( i % 4 == 1 )
+			CHECK(s == session(1000 + i));
+		else
+			CHECK(s == session(i));
+		}
+
+	for ( size_t i = 0; i < 300; i++ )
+		CHECK(t.Lookup(key(keys[300 + i])) == session(2000 + i));
+
+	t.Clear();
+
+	// Same for replacing and removing entries of the old table.
+	for ( size_t i = 0; i < 57; i++ )
+		t.Insert(key(keys[i]), session(i));
+
+	CHECK(capacity(t) == 64 + 128);
+
+	Session* in_old = nullptr;
+	t.ForEach([&in_old](Session* s) { in_old = s; });
+	REQUIRE(in_old);
+	CHECK(t.Remove(key(keys[num(in_old)])) == in_old);
+
+	t.ForEach([&in_old](Session* s) { in_old = s; });
+	CHECK(t.Insert(key(keys[num(in_old)]), session(3000)) == in_old);
+	CHECK(t.Lookup(key(keys[num(in_old)])) == session(3000));
+	CHECK(capacity(t) == 128);
+	CHECK(t.Size() == 56);
+	}
+
+TEST_CASE("map session table")
+	{
+	MapSessionTable t;
+	std::string a = "a";
+	std::string b = "b";
+
+	CHECK(t.Lookup(key(a)) == nullptr);
+	CHECK(t.Insert(key(a), session(1)) == nullptr);
+	CHECK(t.Insert(key(a), session(2)) == session(1));
+	CHECK(t.Insert(key(b), session(3)) == nullptr);
+	CHECK(t.Size() == 2);
+
+	// The table keeps its own copy of the key data.
+	a[0] = 'x';
+	CHECK(t.Lookup(key("a")) == session(2));
+	CHECK(t.Lookup(key(a)) == nullptr);
+
+	std::set<uintptr_t> seen;
+	t.ForEach([&seen](Session* s) { seen.insert(num(s)); });
+	CHECK(seen == std::set<uintptr_t>({2, 3}));
+
+	CHECK(t.Remove(key("a")) == session(2));
+	CHECK(t.Remove(key("a")) == nullptr);
+	CHECK(t.Size() == 1);
+
+	MapSessionTable::Stats stats;
+	t.GetStats(&stats);
+	CHECK(stats.lookups == 3);
+
+	t.Clear();
+	CHECK(t.Size() == 0);
+	CHECK(t.Lookup(key(b)) == nullptr);
+	}
+
+TEST_SUITE_END();
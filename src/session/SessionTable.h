@@ -0,0 +1,259 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include "zeek/zeek-config.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
+#include <unordered_map>
+
+#include "zeek/session/Key.h"
+
+namespace zeek::session
+	{
+
+class Session;
+
+namespace detail
+	{
+
+struct SessionTableStats
+	{
+	size_t capacity; //< Number of slots, including those still being migrated.
+	uint64_t lookups; //< Number of lookups.
+	uint64_t probes; //< Number of control byte groups examined by lookups.
+	uint64_t max_probe_length; //< The most groups a single lookup examined.
+	};
+
+/**
+ * The session table used unless configured with --enable-session-table: a
+ * std::unordered_map with copies of the keys. Its statistics only count
+ * lookups, and report the number of buckets as the capacity.
+ */
+class MapSessionTable
+	{
+public:
+	using Stats = SessionTableStats;
+
+	MapSessionTable() = default;
+	~MapSessionTable();
+
+	MapSessionTable(const MapSessionTable&) = delete;
+	MapSessionTable& operator=(const MapSessionTable&) = delete;
+
+	/**
+	 * Returns the session for the given key, or null if there's none.
+	 */
+	Session* Lookup(const Key& key);
+
+	/**
+	 * Associates a session with a key, copying the key's data. Replaces
+	 * any session the key was associated with before.
+	 *
+	 * @return The replaced session, or null if there was none.
+	 */
+	Session* Insert(const Key& key, Session* s);
+
+	/**
+	 * Removes the entry for a key.
+	 *
+	 * @return The removed session, or null if there was none.
+	 */
+	Session* Remove(const Key& key);
+
+	/**
+	 * Removes all entries.
+	 */
+	void Clear() { map.clear(); }
+
+	/**
+	 * Returns the number of entries.
+	 */
+	size_t Size() const { return map.size(); }
+
+	/**
+	 * Calls a function for every session in the table, in no particular
+	 * order. The function must not modify the table.
+	 */
+	template <typename F> void ForEach(F f) const
+		{
+		for ( const auto& entry : map )
+			f(entry.second);
+		}
+
+	/**
+	 * Fills in statistics about the table.
+	 */
+	void GetStats(Stats* s) const;
+
+private:
+	std::unordered_map<Key, Session*, KeyHash> map;
+	uint64_t lookups = 0;
+	};
+
+/**
+ * An open-addressing hash table mapping session keys to sessions, laid out
+ * for few cache misses per lookup. Slots live in one flat array and store
+ * the full hash and (for keys up to INLINE_KEY_SIZE bytes, which covers
+ * connection keys) the key itself. A parallel array of control bytes holds
+ * seven bits of each slot's hash, so a lookup usually examines a single
+ * group of control bytes and touches a single slot.
+ *
+ * Growing the table doesn't move all entries at once. The new, larger table
+ * takes over immediately while the old one is migrated a few slots per
+ * insertion; until that's done, lookups consult both.
+ *
+ * Only used when configured with --enable-session-table.
+ */
+class FlatSessionTable
+	{
+public:
+	/**
+	 * Keys up to this size are stored within the slot.
+	 */
+	static constexpr size_t INLINE_KEY_SIZE = 48;
+
+	using Stats = SessionTableStats;
+
+	FlatSessionTable();
+	~FlatSessionTable();
+
+	FlatSessionTable(const FlatSessionTable&) = delete;
+	FlatSessionTable& operator=(const FlatSessionTable&) = delete;
+
+	/**
+	 * Returns the session for the given key, or null if there's none.
+	 */
+	Session* Lookup(const Key& key);
+
+	/**
+	 * Associates a session with a key, copying the key's data. Replaces
+	 * any session the key was associated with before.
+	 *
+	 * @return The replaced session, or null if there was none.
+	 */
+	Session* Insert(const Key& key, Session* s);
+
+	/**
+	 * Removes the entry for a key.
+	 *
+	 * @return The removed session, or null if there was none.
+	 */
+	Session* Remove(const Key& key);
+
+	/**
+	 * Removes all entries and shrinks the table to its initial size.
+	 */
+	void Clear();
+
+	/**
+	 * Returns the number of entries.
+	 */
+	size_t Size() const { return cur.used + old.used; }
+
+	/**
+	 * Calls a function for every session in the table, in no particular
+	 * order. The function must not modify the table.
+	 */
+	template <typename F> void ForEach(F f) const
+		{
+		for ( const Table* t : {&cur, &old} )
+			for ( size_t i = 0; i < t->capacity; i++ )
+				if ( t->ctrl[i] >= 0 )
+					f(t->slots[i].session);
+		}
+
+	/**
+	 * Fills in statistics about the table.
+	 */
+	void GetStats(Stats* s) const;
+
+private:
+	// Control bytes: a slot is empty, deleted (a tombstone in a probe
+	// sequence), or full, in which case it holds seven bits of the hash.
+	static constexpr int8_t CTRL_EMPTY = -128;
+	static constexpr int8_t CTRL_DELETED = -2;
+
+	// The number of control bytes matched in one step.
+	static constexpr size_t GROUP_SIZE = 16;
+
+	static constexpr size_t MIN_CAPACITY = 64;
+
+	// The number of old slots migrated to the new table per insertion
+	// while growing. Since the new table is twice as large, this finishes
+	// long before the new one fills up.
+	static constexpr size_t MIGRATE_SLOTS = 2 * GROUP_SIZE;
+
+	static constexpr size_t NOT_FOUND = ~size_t(0);
+
+	struct Slot
+		{
+		uint64_t hash;
+		Session* session;
+		uint32_t key_size;
+		uint32_t key_type;
+
+		union
+			{
+			uint8_t inline_key[INLINE_KEY_SIZE];
+			uint8_t* heap_key;
+			};
+
+		const uint8_t* KeyData() const
+			{
+			return key_size <= INLINE_KEY_SIZE ? inline_key : heap_key;
+			}
+		};
+
+	struct Table
+		{
+		std::unique_ptr<int8_t[]> ctrl;
+		std::unique_ptr<Slot[]> slots;
+		size_t capacity = 0;
+		size_t used = 0;
+		size_t deleted = 0;
+
+		void Allocate(size_t capacity);
+		void Release();
+		size_t Find(uint64_t hash, const Key& key, uint64_t* probes) const;
+		size_t FindFree(uint64_t hash) const;
+		void Place(size_t idx, const Slot& slot);
+		void Erase(size_t idx);
+		};
+
+	static uint32_t MatchByte(const int8_t* ctrl, int8_t b);
+	static uint32_t MatchFree(const int8_t* ctrl);
+	static int8_t H2(uint64_t hash) { return hash & 0x7f; }
+	static size_t FirstGroup(uint64_t hash, size_t capacity)
+		{
+		return (hash >> 7) & (capacity - 1) & ~(GROUP_SIZE - 1);
+		}
+
+	static void FreeKey(Slot* slot);
+
+	void Grow();
+	void Migrate(size_t num_slots);
+
+	// The table new entries go into.
+	Table cur;
+
+	// The table we're migrating away from while growing. Empty otherwise.
+	Table old;
+	size_t migrate_pos = 0;
+
+	uint64_t lookups = 0;
+	uint64_t probes = 0;
+	uint64_t max_probe_length = 0;
+	};
+
+#ifdef ZEEK_SESSION_TABLE
+using SessionTable = FlatSessionTable;
+#else
+using SessionTable = MapSessionTable;
+#endif
+
+	} // namespace detail
+	} // namespace zeek::session
@@ -69,6 +69,11 @@ void Manager::InitPostBrokerSetup(broker::endpoint& ep)
 	pimpl.swap(ptr);
 	}
 
+void Manager::FlushShardedMetrics()
+	{
+	detail::flush_sharded_metrics();
+	}
+
 // -- collect metric stuff -----------------------------------------------------
 
 template <typename T>
@@ -382,6 +387,8 @@ private:
 std::vector<Manager::CollectedValueMetric> Manager::CollectMetrics(std::string_view prefix,
                                                                    std::string_view name)
 	{
+	FlushShardedMetrics();
+
 	auto collector = MetricsCollector(prefix, name);
 
 	pimpl->collect(collector);
@@ -488,6 +495,8 @@ private:
 std::vector<Manager::CollectedHistogramMetric>
 Manager::CollectHistogramMetrics(std::string_view prefix, std::string_view name)
 	{
+	FlushShardedMetrics();
+
 	auto collector = HistogramMetricsCollector(prefix, name);
 
 	pimpl->collect(collector);
@@ -908,3 +917,56 @@ SCENARIO("telemetry managers provide access to histogram families")
 			}
 		}
 	}
+
+SCENARIO("sharded metrics reach their underlying metrics when flushed")
+	{
+	GIVEN("a telemetry manager")
+		{
+		Manager mgr;
+		WHEN("incrementing a sharded counter from several threads")
+			{
+			ShardedIntCounter counter{mgr.CounterSingleton("zeek", "sharded-count", "test")};
+			std::vector<std::thread> threads;
+
+			for ( int i = 0; i < 4; ++i )
+				threads.emplace_back(
+					[&counter]
+					{
+						for ( int j = 0; j < 1000; ++j )
+							counter.Inc();
+					});
+
+			for ( auto& t : threads )
+				t.join();
+
+			THEN("the underlying counter only changes once flushed")
+				{
+				CHECK_EQ(counter.Underlying().Value(), 0);
+				mgr.FlushShardedMetrics();
+				CHECK_EQ(counter.Underlying().Value(), 4000);
+				counter.Inc(5);
+				mgr.FlushShardedMetrics();
+				CHECK_EQ(counter.Underlying().Value(), 4005);
+				}
+			}
+		WHEN("observing values with a sharded histogram")
+			{
+			int64_t bounds[] = {10, 20};
+			ShardedIntHistogram hist{
+				mgr.HistogramSingleton("zeek", "sharded-hist", bounds, "test")};
+
+			for ( int64_t v : {1, 2, 4, 15, 30, 31} )
+				hist.Observe(v);
+
+			THEN("flushing keeps the bucket counts and the sum")
+				{
+				mgr.FlushShardedMetrics();
+				auto h = hist.Underlying();
+				CHECK_EQ(h.CountAt(0), 3);
+				CHECK_EQ(h.CountAt(1), 1);
+				CHECK_EQ(h.CountAt(2), 2);
+				CHECK_EQ(h.Sum(), 83);
+				}
+			}
+		}
+	}
@@ -14,6 +14,7 @@
 #include "zeek/telemetry/Counter.h"
 #include "zeek/telemetry/Gauge.h"
 #include "zeek/telemetry/Histogram.h"
+#include "zeek/telemetry/Sharded.h"
 
 #include "broker/telemetry/fwd.hh"
 
@@ -164,6 +165,13 @@ public:
 	zeek::RecordValPtr GetMetricOptsRecord(MetricType metric_type,
 	                                       const broker::telemetry::metric_family_hdl* family);
 
+	/**
+	 * Adds what sharded metrics collected since the previous call to their
+	 * underlying metrics. Collecting metrics does so first, and the script
+	 * layer every :zeek:see:`Telemetry::sync_interval`.
+	 */
+	void FlushShardedMetrics();
+
 	/**
 	 * @return All counter and gauge metrics and their values matching prefix and name.
 	 * @param prefix The prefix pattern to use for filtering. Supports globbing.
@@ -0,0 +1,58 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/telemetry/Sharded.h"
+
+#include <mutex>
+
+namespace zeek::telemetry::detail
+	{
+
+namespace
+	{
+
+// Function-local, since metrics may get created during static
+// initialization.
+std::mutex& registry_mutex()
+	{
+	static std::mutex m;
+	return m;
+	}
+
+std::vector<ShardedMetric*>& registry()
+	{
+	static std::vector<ShardedMetric*> r;
+	return r;
+	}
+
+std::atomic<size_t> next_slot{0};
+
+	} // namespace
+
+size_t shard_slot() noexcept
+	{
+	thread_local size_t slot = std::min(next_slot++, MAX_SHARDS - 1);
+	return slot;
+	}
+
+void ShardedMetric::Register()
+	{
+	std::lock_guard<std::mutex> lock(registry_mutex());
+	registry().push_back(this);
+	}
+
+void ShardedMetric::Unregister()
+	{
+	std::lock_guard<std::mutex> lock(registry_mutex());
+	auto& r = registry();
+	r.erase(std::remove(r.begin(), r.end(), this), r.end());
+	}
+
+void flush_sharded_metrics()
+	{
+	std::lock_guard<std::mutex> lock(registry_mutex());
+
+	for ( auto m : registry() )
+		m->Flush();
+	}
+
+	} // namespace zeek::telemetry::detail
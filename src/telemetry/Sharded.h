@@ -0,0 +1,323 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+#include "zeek/telemetry/Counter.h"
+#include "zeek/telemetry/Histogram.h"
+
+namespace zeek::telemetry
+	{
+
+namespace detail
+	{
+
+// The most threads with a shard of their own. Any further threads share
+// the last shard.
+constexpr size_t MAX_SHARDS = 64;
+
+/**
+ * @return The calling thread's shard slot, assigned on first use.
+ */
+size_t shard_slot() noexcept;
+
+/**
+ * Adds to a shard's value. Only the thread owning the shard changes it,
+ * so that doesn't take a read-modify-write, unless the shard is shared.
+ */
+template <class T> void shard_add(std::atomic<T>& x, T amount, bool shared) noexcept
+	{
+	if ( ! shared )
+		{
+		x.store(x.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+		return;
+		}
+
+	auto old = x.load(std::memory_order_relaxed);
+
+	while ( ! x.compare_exchange_weak(old, old + amount, std::memory_order_relaxed) )
+		;
+	}
+
+/**
+ * Base class of the sharded metrics, which keep their own tally per thread
+ * and hand it to the underlying metric only when flushed.
+ */
+class ShardedMetric
+	{
+public:
+	ShardedMetric(const ShardedMetric&) = delete;
+	ShardedMetric& operator=(const ShardedMetric&) = delete;
+
+	virtual ~ShardedMetric() = default;
+
+	/**
+	 * Adds what the shards collected since the previous flush to the
+	 * underlying metric. Called with the registry locked.
+	 */
+	virtual void Flush() = 0;
+
+protected:
+	ShardedMetric() = default;
+
+	// Derived classes register once constructed, and unregister first
+	// thing when destructed, so that flushing never sees them half-built.
+	void Register();
+	void Unregister();
+	};
+
+/**
+ * Flushes all sharded metrics.
+ */
+void flush_sharded_metrics();
+
+	} // namespace detail
+
+/**
+ * A counter for hot paths. Increments go to a per-thread shard with a
+ * plain store, rather than to the shared broker counter, and only reach
+ * the latter once Manager::FlushShardedMetrics() collects them. Until
+ * then, the underlying counter's value lags behind.
+ *
+ * Sharded metrics normally live as long as the process. Destroying one
+ * discards what it didn't flush yet.
+ */
+template <class ValueType> class ShardedCounter : public detail::ShardedMetric
+	{
+public:
+	/**
+	 * Constructor.
+	 *
+	 * @param counter The counter that flushing adds to.
+	 */
+	explicit ShardedCounter(Counter<ValueType> counter) : counter(counter) { Register(); }
+
+	~ShardedCounter() override
+		{
+		Unregister();
+
+		for ( auto& s : shards )
+			delete s.load(std::memory_order_relaxed);
+		}
+
+	/**
+	 * Increments the value by @p amount.
+	 * @pre `amount >= 0`
+	 */
+	void Inc(ValueType amount = 1) noexcept
+		{
+		auto slot = detail::shard_slot();
+		auto s = shards[slot].load(std::memory_order_acquire);
+
+		if ( ! s )
+			s = AddShard(slot);
+
+		detail::shard_add(s->value, amount, slot == detail::MAX_SHARDS - 1);
+		}
+
+	/**
+	 * @return The underlying counter.
+	 */
+	Counter<ValueType> Underlying() const noexcept { return counter; }
+
+	void Flush() override
+		{
+		ValueType delta = 0;
+
+		for ( auto& p : shards )
+			if ( auto s = p.load(std::memory_order_acquire) )
+				{
+				auto v = s->value.load(std::memory_order_relaxed);
+				delta += v - s->flushed;
+				s->flushed = v;
+				}
+
+		if ( delta > 0 )
+			counter.Inc(delta);
+		}
+
+private:
+	struct alignas(64) Shard
+		{
+		std::atomic<ValueType> value{0};
+		ValueType flushed = 0; // Only touched when flushing.
+		};
+
+	Shard* AddShard(size_t slot)
+		{
+		Shard* expected = nullptr;
+		auto s = new Shard();
+
+		// Only the shared slot sees several threads racing here.
+		if ( shards[slot].compare_exchange_strong(expected, s, std::memory_order_acq_rel) )
+			return s;
+
+		delete s;
+		return expected;
+		}
+
+	Counter<ValueType> counter;
+	std::atomic<Shard*> shards[detail::MAX_SHARDS] = {};
+	};
+
+using ShardedIntCounter = ShardedCounter<int64_t>;
+using ShardedDblCounter = ShardedCounter<double>;
+
+/**
+ * A histogram for hot paths, sharded like ShardedCounter. The shards keep
+ * the count and the sum of the observations per bucket of the underlying
+ * histogram.
+ *
+ * Broker's histograms take one observation at a time, so flushing replays
+ * the observations, with the mean of each bucket's new observations as
+ * their value. That keeps the buckets' counts and the sum exact, but
+ * flushing takes time proportional to the observations.
+ */
+template <class ValueType> class ShardedHistogram : public detail::ShardedMetric
+	{
+public:
+	/**
+	 * Constructor.
+	 *
+	 * @param hist The histogram that flushing adds to.
+	 */
+	explicit ShardedHistogram(Histogram<ValueType> hist) : hist(hist)
+		{
+		// The last bucket has no bound.
+		for ( size_t i = 0; i + 1 < hist.NumBuckets(); ++i )
+			bounds.push_back(hist.UpperBoundAt(i));
+
+		Register();
+		}
+
+	~ShardedHistogram() override
+		{
+		Unregister();
+
+		for ( auto& s : shards )
+			delete s.load(std::memory_order_relaxed);
+		}
+
+	/**
+	 * Adds an observation of @p value.
+	 */
+	void Observe(ValueType value) noexcept
+		{
+		auto slot = detail::shard_slot();
+		auto s = shards[slot].load(std::memory_order_acquire);
+
+		if ( ! s )
+			s = AddShard(slot);
+
+		auto i = std::lower_bound(bounds.begin(), bounds.end(), value) - bounds.begin();
+		bool shared = slot == detail::MAX_SHARDS - 1;
+		detail::shard_add(s->buckets[i].count, int64_t(1), shared);
+		detail::shard_add(s->buckets[i].sum, value, shared);
+		}
+
+	/**
+	 * @return The underlying histogram.
+	 */
+	Histogram<ValueType> Underlying() const noexcept { return hist; }
+
+	void Flush() override
+		{
+		std::vector<int64_t> counts(bounds.size() + 1);
+		std::vector<ValueType> sums(bounds.size() + 1);
+
+		for ( auto& p : shards )
+			{
+			auto s = p.load(std::memory_order_acquire);
+
+			if ( ! s )
+				continue;
+
+			for ( size_t i = 0; i < counts.size(); ++i )
+				{
+				auto& b = s->buckets[i];
+				auto count = b.count.load(std::memory_order_relaxed);
+				auto sum = b.sum.load(std::memory_order_relaxed);
+				counts[i] += count - b.flushed_count;
+				sums[i] += sum - b.flushed_sum;
+				b.flushed_count = count;
+				b.flushed_sum = sum;
+				}
+			}
+
+		for ( size_t i = 0; i < counts.size(); ++i )
+			Replay(counts[i], sums[i]);
+		}
+
+private:
+	struct Bucket
+		{
+		std::atomic<int64_t> count{0};
+		std::atomic<ValueType> sum{0};
+		int64_t flushed_count = 0;
+		ValueType flushed_sum = 0;
+		};
+
+	struct alignas(64) Shard
+		{
+		explicit Shard(size_t n) : buckets(n) { }
+
+		std::vector<Bucket> buckets;
+		};
+
+	Shard* AddShard(size_t slot)
+		{
+		Shard* expected = nullptr;
+		auto s = new Shard(bounds.size() + 1);
+
+		if ( shards[slot].compare_exchange_strong(expected, s, std::memory_order_acq_rel) )
+			return s;
+
+		delete s;
+		return expected;
+		}
+
+	void Replay(int64_t count, ValueType sum)
+		{
+		if ( count <= 0 )
+			return;
+
+		if constexpr ( std::is_integral_v<ValueType> )
+			{
+			// Spread the remainder, so that all values stay within the
+			// range of the observations and the sum comes out exact.
+			auto mean = sum / count;
+			auto rest = sum % count;
+
+			if ( rest < 0 )
+				{
+				mean -= 1;
+				rest += count;
+				}
+
+			for ( int64_t i = 0; i < count; ++i )
+				hist.Observe(i < rest ? mean + 1 : mean);
+			}
+		else
+			{
+			auto mean = sum / count;
+
+			for ( int64_t i = 0; i < count; ++i )
+				hist.Observe(mean);
+			}
+		}
+
+	Histogram<ValueType> hist;
+	std::vector<ValueType> bounds;
+	std::atomic<Shard*> shards[detail::MAX_SHARDS] = {};
+	};
+
+using ShardedIntHistogram = ShardedHistogram<int64_t>;
+using ShardedDblHistogram = ShardedHistogram<double>;
+
+	} // namespace zeek::telemetry
@@ -50,6 +50,10 @@ void BasicThread::SetOSName(const char* arg_name)
 	{
 	static_assert(std::is_same<std::thread::native_handle_type, pthread_t>::value,
 	              "libstdc++ doesn't use pthread_t");
+	// Threads running elsewhere don't have an OS thread of their own.
+	if ( ! thread.joinable() )
+		return;
+
 	util::detail::set_thread_name(arg_name, thread.native_handle());
 	}
 
@@ -97,9 +101,18 @@ void BasicThread::Start()
 
 	started = true;
 
-	thread = std::thread(&BasicThread::launcher, this);
+	if ( OnStartElsewhere() )
+		DBG_LOG(DBG_THREADING, "Started thread %s elsewhere", name);
 
-	DBG_LOG(DBG_THREADING, "Started thread %s", name);
+	else
+		{
+		thread = std::thread(&BasicThread::launcher, this);
+
+		if ( int node = thread_mgr->ApplyAffinity(thread, AffinityClass(), name); node >= 0 )
+			OnNUMANode(node);
+
+		DBG_LOG(DBG_THREADING, "Started thread %s", name);
+		}
 
 	OnStart();
 	}
@@ -135,6 +148,8 @@ void BasicThread::Join()
 	if ( ! started )
 		return;
 
+	OnJoin();
+
 	if ( ! thread.joinable() )
 		return;
 
@@ -170,12 +185,8 @@ void BasicThread::Done()
 	killed = true;
 	}
 
-void* BasicThread::launcher(void* arg)
+void BasicThread::BlockSignals()
 	{
-	static_assert(std::is_same<std::thread::native_handle_type, pthread_t>::value,
-	              "libstdc++ doesn't use pthread_t");
-	BasicThread* thread = (BasicThread*)arg;
-
 	// Block signals in thread. We handle signals only in the main
 	// process.
 	sigset_t mask_set;
@@ -190,6 +201,15 @@ void* BasicThread::launcher(void* arg)
 	sigdelset(&mask_set, SIGBUS);
 	int res = pthread_sigmask(SIG_BLOCK, &mask_set, 0);
 	assert(res == 0);
+	}
+
+void* BasicThread::launcher(void* arg)
+	{
+	static_assert(std::is_same<std::thread::native_handle_type, pthread_t>::value,
+	              "libstdc++ doesn't use pthread_t");
+	BasicThread* thread = (BasicThread*)arg;
+
+	BlockSignals();
 
 	// Run thread's main function.
 	thread->Run();
@@ -130,6 +130,12 @@ public:
 	 */
 	const char* Strerror(int err);
 
+	/**
+	 * Blocks the signals that Zeek handles in its main process. Threads
+	 * that Zeek starts call this first thing.
+	 */
+	static void BlockSignals();
+
 protected:
 	friend class Manager;
 
@@ -149,6 +155,39 @@ protected:
 	 */
 	virtual void OnStart() { }
 
+	/**
+	 * Returns the class of thread for Threading::affinity, such as
+	 * "writer". The default is "other".
+	 */
+	virtual const char* AffinityClass() const { return "other"; }
+
+	/**
+	 * Executed with Start() if the thread's CPUs, as configured by
+	 * Threading::affinity, all belong to the same NUMA node. This is a
+	 * hook into moving memory that the thread uses a lot to that node.
+	 * It will be called from Zeek's main thread after the OS thread has
+	 * been started, but possibly already running.
+	 */
+	virtual void OnNUMANode(int node) { }
+
+	/**
+	 * Executed with Start() instead of starting an OS thread. This is a
+	 * hook into running the thread elsewhere, such as on a thread pool,
+	 * in which case Run() isn't called. It will be called from Zeek's
+	 * main thread.
+	 *
+	 * @return True if the thread runs elsewhere, false to start an OS
+	 * thread for it.
+	 */
+	virtual bool OnStartElsewhere() { return false; }
+
+	/**
+	 * Executed with Join(). This is a hook into waiting for a thread
+	 * that runs elsewhere, see OnStartElsewhere(). It will be called
+	 * from Zeek's main thread.
+	 */
+	virtual void OnJoin() { }
+
 	/**
 	 * Executed with SignalStop(). This is a hook into preparing the
 	 * thread for stopping. It will be called from Zeek's main thread
@@ -0,0 +1,632 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/threading/Compression.h"
+
+#include "zeek/zeek-config.h"
+
+#include <unistd.h>
+#include <zlib.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#ifdef HAVE_LZ4
+#include <lz4frame.h>
+#endif
+
+#include "zeek/3rdparty/doctest.h"
+#include "zeek/util.h"
+
+namespace zeek::threading
+	{
+
+std::optional<Compression> compression_from_name(std::string_view name)
+	{
+	if ( name == "none" )
+		return Compression::None;
+	if ( name == "gzip" )
+		return Compression::Gzip;
+	if ( name == "zstd" )
+		return Compression::Zstd;
+	if ( name == "lz4" )
+		return Compression::Lz4;
+
+	return std::nullopt;
+	}
+
+bool compression_available(Compression c)
+	{
+	switch ( c )
+		{
+		case Compression::None:
+		case Compression::Gzip:
+			return true;
+
+		case Compression::Zstd:
+#ifdef HAVE_ZSTD
+			return true;
+#else
+			return false;
+#endif
+
+		case Compression::Lz4:
+#ifdef HAVE_LZ4
+			return true;
+#else
+			return false;
+#endif
+		}
+
+	return false;
+	}
+
+const char* compression_extension(Compression c)
+	{
+	switch ( c )
+		{
+		case Compression::None:
+			return "";
+		case Compression::Gzip:
+			return "gz";
+		case Compression::Zstd:
+			return "zst";
+		case Compression::Lz4:
+			return "lz4";
+		}
+
+	return "";
+	}
+
+Compression compression_for_file(std::string_view name)
+	{
+	for ( auto c : {Compression::Gzip, Compression::Zstd, Compression::Lz4} )
+		{
+		std::string ext = std::string(".") + compression_extension(c);
+
+		if ( name.size() > ext.size() && name.substr(name.size() - ext.size()) == ext )
+			return c;
+		}
+
+	return Compression::None;
+	}
+
+// Compresses a block into a complete frame.
+static bool compress_block(Compression c, int level, const std::string& in, std::string* out,
+                           std::string* error)
+	{
+	switch ( c )
+		{
+		case Compression::Gzip:
+			{
+			z_stream zs;
+			memset(&zs, 0, sizeof(zs));
+
+			// 16 added to the window bits asks for a gzip header.
+			if ( deflateInit2(&zs, level ? level : Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+			                  Z_DEFAULT_STRATEGY) != Z_OK )
+				{
+				*error = "cannot initialize gzip compression";
+				return false;
+				}
+
+			out->resize(deflateBound(&zs, in.size()));
+			zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+			zs.avail_in = in.size();
+			zs.next_out = reinterpret_cast<Bytef*>(out->data());
+			zs.avail_out = out->size();
+
+			auto r = deflate(&zs, Z_FINISH);
+			out->resize(zs.total_out);
+			deflateEnd(&zs);
+
+			if ( r != Z_STREAM_END )
+				{
+				*error = "gzip compression failed";
+				return false;
+				}
+
+			return true;
+			}
+
+#ifdef HAVE_ZSTD
+		case Compression::Zstd:
+			{
+			out->resize(ZSTD_compressBound(in.size()));
+			auto r = ZSTD_compress(out->data(), out->size(), in.data(), in.size(), level);
+
+			if ( ZSTD_isError(r) )
+				{
+				*error = ZSTD_getErrorName(r);
+				return false;
+				}
+
+			out->resize(r);
+			return true;
+			}
+#endif
+
+#ifdef HAVE_LZ4
+		case Compression::Lz4:
+			{
+			LZ4F_preferences_t prefs;
+			memset(&prefs, 0, sizeof(prefs));
+			prefs.compressionLevel = level;
+			prefs.frameInfo.contentSize = in.size();
+
+			out->resize(LZ4F_compressFrameBound(in.size(), &prefs));
+			auto r = LZ4F_compressFrame(out->data(), out->size(), in.data(), in.size(), &prefs);
+
+			if ( LZ4F_isError(r) )
+				{
+				*error = LZ4F_getErrorName(r);
+				return false;
+				}
+
+			out->resize(r);
+			return true;
+			}
+#endif
+
+		default:
+			*error = "compression not available";
+			return false;
+		}
+	}
+
+BlockCompressor::BlockCompressor(int arg_fd, Compression c, int arg_level, int threads,
+                                 size_t arg_block_size)
+	: fd(arg_fd), compression(c), level(arg_level), block_size(arg_block_size),
+	  max_pending(2 * threads)
+	{
+	buffer.reserve(block_size);
+
+	for ( int i = 0; i < threads; ++i )
+		workers.emplace_back(&BlockCompressor::Work, this);
+	}
+
+BlockCompressor::~BlockCompressor()
+	{
+	StopWorkers();
+	}
+
+bool BlockCompressor::Write(const char* data, size_t len)
+	{
+	while ( len > 0 )
+		{
+		auto n = std::min(len, block_size - buffer.size());
+		buffer.append(data, n);
+		data += n;
+		len -= n;
+
+		if ( buffer.size() == block_size && ! Submit() )
+			return false;
+		}
+
+	return true;
+	}
+
+bool BlockCompressor::Flush()
+	{
+	return Submit() && WriteFinished(0);
+	}
+
+bool BlockCompressor::Close()
+	{
+	bool ok = Flush();
+	StopWorkers();
+	return ok;
+	}
+
+bool BlockCompressor::Submit()
+	{
+	if ( buffer.empty() )
+		return true;
+
+	auto job = std::make_shared<Job>();
+	job->in.swap(buffer);
+	buffer.reserve(block_size);
+
+	if ( workers.empty() )
+		{
+		if ( ! compress_block(compression, level, job->in, &job->out, &error) )
+			return false;
+
+		if ( ! util::safe_write(fd, job->out.data(), job->out.size()) )
+			{
+			error = strerror(errno);
+			return false;
+			}
+
+		return true;
+		}
+
+	pending.push_back(job);
+
+		{
+		std::lock_guard<std::mutex> lock(mutex);
+		work.push_back(job);
+		}
+
+	work_cond.notify_one();
+
+	// Bound the memory that queued blocks take.
+	return WriteFinished(max_pending);
+	}
+
+bool BlockCompressor::WriteFinished(size_t max_left)
+	{
+	while ( ! pending.empty() )
+		{
+		auto job = pending.front();
+
+			{
+			std::unique_lock<std::mutex> lock(mutex);
+
+			if ( ! job->done )
+				{
+				if ( pending.size() <= max_left )
+					return true;
+
+				done_cond.wait(lock, [&job] { return job->done; });
+				}
+			}
+
+		pending.pop_front();
+
+		if ( ! job->error.empty() )
+			{
+			error = job->error;
+			return false;
+			}
+
+		if ( ! util::safe_write(fd, job->out.data(), job->out.size()) )
+			{
+			error = strerror(errno);
+			return false;
+			}
+		}
+
+	return true;
+	}
+
+void BlockCompressor::Work()
+	{
+	for ( ;; )
+		{
+		std::shared_ptr<Job> job;
+
+			{
+			std::unique_lock<std::mutex> lock(mutex);
+			work_cond.wait(lock, [this] { return stopping || ! work.empty(); });
+
+			if ( work.empty() )
+				return;
+
+			job = work.front();
+			work.pop_front();
+			}
+
+		compress_block(compression, level, job->in, &job->out, &job->error);
+		job->in.clear();
+
+			{
+			std::lock_guard<std::mutex> lock(mutex);
+			job->done = true;
+			}
+
+		done_cond.notify_all();
+		}
+	}
+
+void BlockCompressor::StopWorkers()
+	{
+		{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+		}
+
+	work_cond.notify_all();
+
+	for ( auto& w : workers )
+		w.join();
+
+	workers.clear();
+	}
+
+namespace
+	{
+
+// A read-only stream buffer for decompressed file contents. Subclasses
+// provide the decompression.
+class DecompressingBuf : public std::streambuf
+	{
+public:
+	DecompressingBuf() : out(64 * 1024) { }
+
+protected:
+	// Decompresses into the given buffer, returning the number of bytes
+	// or 0 at the end of the data available so far.
+	virtual size_t Read(char* data, size_t len) = 0;
+
+	int_type underflow() override
+		{
+		if ( gptr() < egptr() )
+			return traits_type::to_int_type(*gptr());
+
+		auto n = Read(out.data(), out.size());
+
+		if ( n == 0 )
+			return traits_type::eof();
+
+		setg(out.data(), out.data(), out.data() + n);
+		return traits_type::to_int_type(*gptr());
+		}
+
+private:
+	std::vector<char> out;
+	};
+
+class GzipBuf : public DecompressingBuf
+	{
+public:
+	explicit GzipBuf(gzFile arg_gz) : gz(arg_gz) { }
+	~GzipBuf() override { gzclose(gz); }
+
+protected:
+	size_t Read(char* data, size_t len) override
+		{
+		auto n = gzread(gz, data, len);
+
+		if ( n > 0 )
+			return n;
+
+		// Allows reading on once the file grows.
+		gzclearerr(gz);
+		return 0;
+		}
+
+private:
+	gzFile gz;
+	};
+
+// Base for the decompressors that read raw input from a file.
+class FileDecompressingBuf : public DecompressingBuf
+	{
+public:
+	explicit FileDecompressingBuf(FILE* arg_f) : f(arg_f), in(64 * 1024) { }
+	~FileDecompressingBuf() override { fclose(f); }
+
+protected:
+	// Returns true if there's unconsumed input, reading more if needed.
+	bool HaveInput()
+		{
+		if ( in_pos < in_len )
+			return true;
+
+		in_len = fread(in.data(), 1, in.size(), f);
+		in_pos = 0;
+
+		if ( in_len == 0 )
+			{
+			// Allows reading on once the file grows.
+			clearerr(f);
+			return false;
+			}
+
+		return true;
+		}
+
+	FILE* f;
+	std::vector<char> in;
+	size_t in_pos = 0;
+	size_t in_len = 0;
+	};
+
+#ifdef HAVE_ZSTD
+class ZstdBuf : public FileDecompressingBuf
+	{
+public:
+	explicit ZstdBuf(FILE* f) : FileDecompressingBuf(f), ds(ZSTD_createDStream())
+		{
+		ZSTD_initDStream(ds);
+		}
+
+	~ZstdBuf() override { ZSTD_freeDStream(ds); }
+
+protected:
+	size_t Read(char* data, size_t len) override
+		{
+		// A frame boundary may leave us without output even though
+		// input remains, so keep going until there's some.
+		while ( HaveInput() )
+			{
+			ZSTD_inBuffer zin = {in.data(), in_len, in_pos};
+			ZSTD_outBuffer zout = {data, len, 0};
+
+			auto r = ZSTD_decompressStream(ds, &zout, &zin);
+			in_pos = zin.pos;
+
+			if ( ZSTD_isError(r) )
+				return 0;
+
+			if ( zout.pos > 0 )
+				return zout.pos;
+			}
+
+		return 0;
+		}
+
+private:
+	ZSTD_DStream* ds;
+	};
+#endif
+
+#ifdef HAVE_LZ4
+class Lz4Buf : public FileDecompressingBuf
+	{
+public:
+	explicit Lz4Buf(FILE* f) : FileDecompressingBuf(f)
+		{
+		LZ4F_createDecompressionContext(&dctx, LZ4F_VERSION);
+		}
+
+	~Lz4Buf() override { LZ4F_freeDecompressionContext(dctx); }
+
+protected:
+	size_t Read(char* data, size_t len) override
+		{
+		while ( HaveInput() )
+			{
+			size_t src_size = in_len - in_pos;
+			size_t dst_size = len;
+
+			auto r = LZ4F_decompress(dctx, data, &dst_size, in.data() + in_pos, &src_size,
+			                         nullptr);
+			in_pos += src_size;
+
+			if ( LZ4F_isError(r) )
+				return 0;
+
+			if ( dst_size > 0 )
+				return dst_size;
+			}
+
+		return 0;
+		}
+
+private:
+	LZ4F_dctx* dctx = nullptr;
+	};
+#endif
+
+	} // namespace
+
+DecompressingFile::DecompressingFile() : std::istream(nullptr) { }
+
+DecompressingFile::~DecompressingFile()
+	{
+	close();
+	}
+
+void DecompressingFile::open(const std::string& name)
+	{
+	close();
+
+	auto c = compression_for_file(name);
+
+	if ( c == Compression::None || ! compression_available(c) )
+		{
+		auto fb = std::make_unique<std::filebuf>();
+
+		if ( fb->open(name, std::ios::in) )
+			buf = std::move(fb);
+		}
+
+	else if ( c == Compression::Gzip )
+		{
+		if ( auto gz = gzopen(name.c_str(), "rb") )
+			buf = std::make_unique<GzipBuf>(gz);
+		}
+
+	else if ( auto f = fopen(name.c_str(), "rb") )
+		{
+#ifdef HAVE_ZSTD
+		if ( c == Compression::Zstd )
+			buf = std::make_unique<ZstdBuf>(f);
+#endif
+
+#ifdef HAVE_LZ4
+		if ( c == Compression::Lz4 )
+			buf = std::make_unique<Lz4Buf>(f);
+#endif
+
+		if ( ! buf )
+			fclose(f);
+		}
+
+	rdbuf(buf.get());
+
+	if ( buf )
+		clear();
+	else
+		setstate(std::ios::failbit);
+	}
+
+void DecompressingFile::close()
+	{
+	rdbuf(nullptr);
+	buf.reset();
+	}
+
+TEST_SUITE_BEGIN("Compression");
+
+TEST_CASE("compression names")
+	{
+	CHECK(compression_from_name("zstd") == Compression::Zstd);
+	CHECK_FALSE(compression_from_name("zip"));
+	CHECK(compression_for_file("conn.log.gz") == Compression::Gzip);
+	CHECK(compression_for_file("conn.log.zst") == Compression::Zstd);
+	CHECK(compression_for_file("conn.log.lz4") == Compression::Lz4);
+	CHECK(compression_for_file("conn.log") == Compression::None);
+	CHECK(compression_for_file(".gz") == Compression::None);
+	}
+
+TEST_CASE("block compression round trip")
+	{
+	std::string data;
+
+	for ( int i = 0; i < 20000; ++i )
+		data += "line " + std::to_string(i) + "\n";
+
+	for ( auto c : {Compression::Gzip, Compression::Zstd, Compression::Lz4} )
+		{
+		if ( ! compression_available(c) )
+			continue;
+
+		for ( int threads : {0, 3} )
+			{
+			std::string name = std::string("/tmp/zeek-compression-XXXXXX.") +
+			                   compression_extension(c);
+			std::vector<char> tmpl(name.begin(), name.end());
+			tmpl.push_back('\0');
+			int fd = mkstemps(tmpl.data(), strlen(compression_extension(c)) + 1);
+			REQUIRE(fd >= 0);
+
+			// Small blocks, so that there are many frames.
+			BlockCompressor bc(fd, c, 0, threads, 1000);
+
+			// Write in odd pieces that straddle the blocks.
+			for ( size_t i = 0; i < data.size(); i += 777 )
+				REQUIRE(bc.Write(data.data() + i, std::min<size_t>(777, data.size() - i)));
+
+			REQUIRE(bc.Close());
+			close(fd);
+
+			DecompressingFile f;
+			f.open(tmpl.data());
+			REQUIRE(f.is_open());
+
+			std::string line;
+			int n = 0;
+
+			while ( std::getline(f, line) )
+				{
+				CHECK(line == "line " + std::to_string(n));
+				++n;
+				}
+
+			CHECK(n == 20000);
+			unlink(tmpl.data());
+			}
+		}
+	}
+
+TEST_SUITE_END();
+
+	} // namespace zeek::threading
@@ -0,0 +1,183 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+//
+// Compressed file I/O for the log writers and input readers.
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace zeek::threading
+	{
+
+/**
+ * The compression formats for log files.
+ */
+enum class Compression
+	{
+	None,
+	Gzip,
+	Zstd,
+	Lz4,
+	};
+
+/**
+ * Returns the compression with the given name ("none", "gzip", "zstd" or
+ * "lz4"), or nothing if there's no such compression.
+ */
+std::optional<Compression> compression_from_name(std::string_view name);
+
+/**
+ * Returns true if this build of Zeek supports a compression. Zstd and LZ4
+ * are only available if their libraries were found at build time.
+ */
+bool compression_available(Compression c);
+
+/**
+ * Returns the usual file name extension for a compression, without the
+ * dot, or an empty string for no compression.
+ */
+const char* compression_extension(Compression c);
+
+/**
+ * Returns the compression that a file name's extension indicates.
+ */
+Compression compression_for_file(std::string_view name);
+
+/**
+ * Compresses output into a file descriptor in blocks, each of which
+ * becomes a separate, complete compressed frame (or gzip member). The
+ * concatenation of these is a valid compressed file for the usual tools.
+ * With worker threads, several blocks get compressed in parallel, while
+ * the frames still reach the file in order.
+ *
+ * All methods must be called from the same thread.
+ */
+class BlockCompressor
+	{
+public:
+	/**
+	 * Constructor.
+	 *
+	 * @param fd The file descriptor to write to. The compressor doesn't
+	 * close it.
+	 *
+	 * @param c The compression, which must be available and not None.
+	 *
+	 * @param level The compression level, with 0 for the default.
+	 *
+	 * @param threads The number of worker threads. With 0, compression
+	 * happens in the calling thread.
+	 *
+	 * @param block_size The amount of input per frame.
+	 */
+	BlockCompressor(int fd, Compression c, int level, int threads,
+	                size_t block_size = 1024 * 1024);
+
+	/**
+	 * Destructor. Stops the workers, dropping any output that Close()
+	 * hasn't written out.
+	 */
+	~BlockCompressor();
+
+	BlockCompressor(const BlockCompressor&) = delete;
+	BlockCompressor& operator=(const BlockCompressor&) = delete;
+
+	/**
+	 * Adds data to the output.
+	 *
+	 * @return False if an error occured, see Error().
+	 */
+	bool Write(const char* data, size_t len);
+
+	/**
+	 * Compresses all data added so far and writes it to the file, even
+	 * if that ends a block early.
+	 *
+	 * @return False if an error occured, see Error().
+	 */
+	bool Flush();
+
+	/**
+	 * Flushes the output and stops the workers. The compressor must not
+	 * be used afterwards.
+	 *
+	 * @return False if an error occured, see Error().
+	 */
+	bool Close();
+
+	/**
+	 * Returns a description of the last error.
+	 */
+	const std::string& Error() const { return error; }
+
+private:
+	struct Job
+		{
+		std::string in;
+		std::string out;
+		std::string error;
+		bool done = false;
+		};
+
+	// Hands the buffered data to a worker, or compresses it right
+	// away if there are none.
+	bool Submit();
+
+	// Writes out the finished jobs at the front of the pending ones,
+	// waiting for more until at most `max_left` remain.
+	bool WriteFinished(size_t max_left);
+
+	void Work();
+	void StopWorkers();
+
+	int fd;
+	Compression compression;
+	int level;
+	size_t block_size;
+	size_t max_pending;
+
+	std::string buffer;
+	std::deque<std::shared_ptr<Job>> pending; // In output order.
+	std::string error;
+
+	std::mutex mutex;
+	std::condition_variable work_cond;
+	std::condition_variable done_cond;
+	std::deque<std::shared_ptr<Job>> work; // Jobs for the workers.
+	std::vector<std::thread> workers;
+	bool stopping = false;
+	};
+
+/**
+ * An input stream for a file that transparently decompresses it if its
+ * name ends in the extension of one of the available compressions. It
+ * follows std::ifstream's interface for opening and closing, and like an
+ * ifstream it keeps reading data appended to the file once a caller
+ * clears its EOF state.
+ */
+class DecompressingFile : public std::istream
+	{
+public:
+	DecompressingFile();
+	~DecompressingFile() override;
+
+	void open(const std::string& name);
+	bool is_open() const { return buf != nullptr; }
+	void close();
+
+private:
+	std::unique_ptr<std::streambuf> buf;
+	};
+
+	} // namespace zeek::threading
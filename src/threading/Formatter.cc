@@ -44,6 +44,14 @@ std::string Formatter::Render(const threading::Value::addr_t& addr)
 		}
 	}
 
+void Formatter::Warning(const char* msg) const
+	{
+	if ( thread )
+		thread->Warning(msg);
+	else
+		++problems;
+	}
+
 TransportProto Formatter::ParseProto(const std::string& proto) const
 	{
 	if ( proto == "unknown" )
@@ -55,7 +63,7 @@ TransportProto Formatter::ParseProto(const std::string& proto) const
 	else if ( proto == "icmp" )
 		return TRANSPORT_ICMP;
 
-	thread->Warning(thread->Fmt("Tried to parse invalid/unknown protocol: %s", proto.c_str()));
+	Warning("Tried to parse invalid/unknown protocol: %s", proto.c_str());
 
 	return TRANSPORT_UNKNOWN;
 	}
@@ -71,7 +79,7 @@ threading::Value::addr_t Formatter::ParseAddr(const std::string& s) const
 
 		if ( inet_aton(s.c_str(), &(val.in.in4)) <= 0 )
 			{
-			thread->Warning(thread->Fmt("Bad address: %s", s.c_str()));
+			Warning("Bad address: %s", s.c_str());
 			memset(&val.in.in4.s_addr, 0, sizeof(val.in.in4.s_addr));
 			}
 		}
@@ -84,7 +92,7 @@ threading::Value::addr_t Formatter::ParseAddr(const std::string& s) const
 			clean_s = s.substr(1, s.length() - 2);
 		if ( inet_pton(AF_INET6, clean_s.c_str(), val.in.in6.s6_addr) <= 0 )
 			{
-			thread->Warning(thread->Fmt("Bad address: %s", clean_s.c_str()));
+			Warning("Bad address: %s", clean_s.c_str());
 			memset(val.in.in6.s6_addr, 0, sizeof(val.in.in6.s6_addr));
 			}
 		}
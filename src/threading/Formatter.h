@@ -5,6 +5,7 @@
 #include <string>
 
 #include "zeek/Type.h"
+#include "zeek/threading/MsgThread.h"
 #include "zeek/threading/SerialTypes.h"
 
 namespace zeek::threading
@@ -25,7 +26,9 @@ public:
 	 *
 	 * @param t The thread that uses this class instance. The class uses
 	 * some of the thread's methods, e.g., for error reporting and
-	 * internal formatting.
+	 * internal formatting. May be null for formatters that only parse
+	 * input on other threads, which then count problems rather than
+	 * reporting them, see Problems().
 	 *
 	 */
 	explicit Formatter(MsgThread* t);
@@ -154,6 +157,12 @@ public:
 	 */
 	Value::addr_t ParseAddr(const std::string& addr) const;
 
+	/**
+	 * Returns the number of problems that a formatter without a thread
+	 * has run into so far.
+	 */
+	int Problems() const { return problems; }
+
 protected:
 	/**
 	 * Returns the thread associated with the formatter via the
@@ -161,8 +170,26 @@ protected:
 	 */
 	MsgThread* GetThread() const { return thread; }
 
+	/**
+	 * Reports a problem with a value through the thread's Warning(), or
+	 * just counts it without a thread.
+	 */
+	void Warning(const char* msg) const;
+
+	/**
+	 * Like Warning(const char*), with a printf-style format string.
+	 */
+	template <typename... Args> void Warning(const char* fmt, Args... args) const
+		{
+		if ( thread )
+			Warning(thread->Fmt(fmt, args...));
+		else
+			++problems;
+		}
+
 private:
 	MsgThread* thread;
+	mutable int problems = 0;
 	};
 
 	} // namespace zeek::threading
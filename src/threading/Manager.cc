@@ -2,12 +2,19 @@
 
 #include <sys/socket.h>
 #include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
 
 #include "zeek/Event.h"
+#include "zeek/ID.h"
 #include "zeek/IPAddr.h"
 #include "zeek/NetVar.h"
 #include "zeek/RunState.h"
+#include "zeek/Scope.h"
+#include "zeek/Val.h"
 #include "zeek/iosource/Manager.h"
+#include "zeek/zeek-affinity.h"
 
 namespace zeek::threading
 	{
@@ -67,6 +74,8 @@ void Manager::Terminate()
 
 		all_threads.clear();
 		msg_threads.clear();
+		ready.clear();
+		pool.reset();
 		terminating = false;
 	}
 
@@ -79,10 +88,67 @@ void Manager::AddThread(BasicThread* thread)
 		StartHeartbeatTimer();
 	}
 
+Pool* Manager::GetPool()
+	{
+	if ( ! pool && BifConst::Threading::pool_threads > 0 )
+		pool = std::make_unique<Pool>(BifConst::Threading::pool_threads);
+
+	return pool.get();
+	}
+
 void Manager::AddMsgThread(MsgThread* thread)
 	{
 	DBG_LOG(DBG_THREADING, "%s is a MsgThread ...", thread->Name());
 	msg_threads.push_back(thread);
+
+	// The iosource manager doesn't exist yet when we're created, so
+	// hook in with the first thread.
+	if ( ! registered )
+		{
+		iosource_mgr->Register(this, true, false);
+
+		if ( ! iosource_mgr->RegisterFd(flare.FD(), this) )
+			reporter->FatalError("Failed to register thread manager fd with iosource_mgr");
+
+		registered = true;
+		}
+	}
+
+void Manager::SignalOut(MsgThread* thread)
+	{
+	std::lock_guard<std::mutex> lock(ready_mutex);
+
+	// The flare stays lit until Process() takes the list, so only the
+	// first thread needs to fire it.
+	if ( ready.empty() )
+		flare.Fire();
+
+	ready.push_back(thread);
+	}
+
+void Manager::RemoveReady(MsgThread* thread)
+	{
+	std::lock_guard<std::mutex> lock(ready_mutex);
+	ready.erase(std::remove(ready.begin(), ready.end(), thread), ready.end());
+	}
+
+void Manager::Process()
+	{
+		{
+		std::lock_guard<std::mutex> lock(ready_mutex);
+		flare.Extinguish();
+		processing.swap(ready);
+		}
+
+	pass_started = util::current_time();
+
+	// Each thread is on the list once, and won't add itself again until
+	// its Process() has started.
+	for ( MsgThread* t : processing )
+		t->Process();
+
+	processing.clear();
+	pass_started = 0;
 	}
 
 void Manager::KillThreads()
@@ -195,6 +261,55 @@ bool Manager::SendEvent(MsgThread* thread, const std::string& name, const int nu
 	return true;
 	}
 
+int Manager::ApplyAffinity(std::thread& t, const char* cls, const char* name)
+	{
+	// Threads may start before the scripts are parsed.
+	if ( ! zeek::detail::global_scope() )
+		return -1;
+
+	const auto& id = id::find("Threading::affinity");
+
+	if ( ! id || ! id->GetVal() )
+		return -1;
+
+	auto affinity = id->GetVal()->AsTableVal()->FindOrDefault(make_intrusive<StringVal>(cls));
+
+	if ( ! affinity )
+		return -1;
+
+	auto rec = affinity->AsRecordVal();
+	auto cpu_list = rec->GetField<TableVal>("cpus")->ToPureListVal();
+	std::vector<int> cpus;
+
+	for ( int i = 0; i < cpu_list->Length(); ++i )
+		cpus.push_back(cpu_list->Idx(i)->AsCount());
+
+	if ( cpus.empty() )
+		return -1;
+
+	// Sets have no order, but spreading out must be predictable.
+	std::sort(cpus.begin(), cpus.end());
+
+	if ( rec->GetField<BoolVal>("spread")->Get() )
+		cpus = {cpus[next_cpu[cls]++ % cpus.size()]};
+
+	if ( ! set_thread_affinity(t.native_handle(), cpus) )
+		{
+		reporter->Warning("cannot set CPU affinity of thread %s: %s", name, strerror(errno));
+		return -1;
+		}
+
+	int node = cpu_numa_node(cpus[0]);
+
+	for ( auto cpu : cpus )
+		{
+		if ( cpu_numa_node(cpu) != node )
+			return -1;
+		}
+
+	return node;
+	}
+
 void Manager::Flush()
 	{
 	bool do_beat = false;
@@ -1,10 +1,19 @@
 #pragma once
 
 #include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
 #include <utility>
+#include <vector>
 
+#include "zeek/Flare.h"
 #include "zeek/Timer.h"
+#include "zeek/iosource/IOSource.h"
 #include "zeek/threading/MsgThread.h"
+#include "zeek/threading/Pool.h"
 
 namespace zeek
 	{
@@ -33,11 +42,13 @@ protected:
  * once it has terminated.
  *
  * In addition to basic threads, the manager also provides additional
- * functionality specific to MsgThread instances. In particular, it polls
- * their outgoing message queue on a regular basis and feeds data sent into
- * the rest of Zeek. It also triggers the regular heartbeats.
+ * functionality specific to MsgThread instances. In particular, it feeds
+ * the messages they send into the rest of Zeek. Threads put themselves on
+ * a ready list when they queue output, and signal the manager through a
+ * single flare, so that the main loop only visits threads that have
+ * something pending. It also triggers the regular heartbeats.
  */
-class Manager
+class Manager : public iosource::IOSource
 	{
 public:
 	/**
@@ -107,6 +118,34 @@ public:
 	bool SendEvent(MsgThread* thread, const std::string& name, const int num_vals,
 	               Value** vals) const;
 
+	/**
+	 * Returns the time at which the main thread started its current pass
+	 * over the threads' output, or zero outside of one. Output messages
+	 * doing a lot of work can use this to stick to a time budget per
+	 * pass, see BasicOutputMessage::Unfinished().
+	 */
+	double PassStarted() const { return pass_started; }
+
+	/**
+	 * Restricts a thread to the CPUs that Threading::affinity configures
+	 * for its class of threads, if any. Reports a warning if that's not
+	 * possible.
+	 *
+	 * @param t The thread, which must be running.
+	 * @param cls The class of thread, such as "writer".
+	 * @param name The thread's name, for the warning.
+	 * @return The NUMA node that all of the thread's CPUs belong to, or
+	 * -1 if there's none or it isn't known.
+	 */
+	int ApplyAffinity(std::thread& t, const char* cls, const char* name);
+
+	/**
+	 * Overridden from iosource::IOSource.
+	 */
+	void Process() override;
+	const char* Tag() override { return "threading::Manager"; }
+	double GetNextTimeout() override { return -1; }
+
 protected:
 	friend class BasicThread;
 	friend class MsgThread;
@@ -130,6 +169,28 @@ protected:
 	 */
 	void AddMsgThread(MsgThread* thread);
 
+	/**
+	 * Puts a message thread on the ready list, so that the main thread
+	 * processes its output. Called by the thread itself, once for each
+	 * time it's been processed.
+	 *
+	 * @param thread The thread.
+	 */
+	void SignalOut(MsgThread* thread);
+
+	/**
+	 * Takes a message thread off the ready list when it goes away.
+	 *
+	 * @param thread The thread.
+	 */
+	void RemoveReady(MsgThread* thread);
+
+	/**
+	 * Returns the pool for running message threads, creating it on first
+	 * use, or null if Threading::pool_threads disables it.
+	 */
+	Pool* GetPool();
+
 	void Flush();
 
 	/**
@@ -156,6 +217,20 @@ private:
 	msg_stats_list stats;
 
 	bool heartbeat_timer_running = false;
+
+	// Message threads with output pending. Filled by the threads
+	// themselves, guarded by the mutex together with the flare.
+	std::mutex ready_mutex;
+	std::vector<MsgThread*> ready;
+	std::vector<MsgThread*> processing; // Only touched by the main thread.
+	zeek::detail::Flare flare;
+	bool registered = false;
+	double pass_started = 0;
+
+	// The next CPU by class of thread, for spreading threads out.
+	std::map<std::string, size_t> next_cpu;
+
+	std::unique_ptr<Pool> pool;
 	};
 
 	} // namespace threading
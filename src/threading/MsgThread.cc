@@ -10,6 +10,7 @@
 #include "zeek/RunState.h"
 #include "zeek/iosource/Manager.h"
 #include "zeek/threading/Manager.h"
+#include "zeek/threading/Pool.h"
 
 // Set by Zeek's main signal handler.
 extern int signal_val;
@@ -232,19 +233,17 @@ MsgThread::MsgThread() : BasicThread(), queue_in(this, nullptr), queue_out(nullp
 	child_finished = false;
 	child_sent_finish = false;
 	failed = false;
+	out_signaled = false;
 	thread_mgr->AddMsgThread(this);
 
-	if ( ! iosource_mgr->RegisterFd(flare.FD(), this) )
-		reporter->FatalError("Failed to register MsgThread fd with iosource_mgr");
-
 	SetClosed(false);
 	}
 
 MsgThread::~MsgThread()
 	{
-	// Unregister this thread from the iosource manager so it doesn't wake
-	// up the main poll anymore.
-	iosource_mgr->UnregisterFd(flare.FD(), this);
+	// Make sure the manager doesn't try to process our output anymore.
+	thread_mgr->RemoveReady(this);
+	delete unfinished_out;
 	}
 
 void MsgThread::OnSignalStop()
@@ -325,6 +324,34 @@ void MsgThread::OnKill()
 	// input. This is just an optimization to make it terminate more
 	// quickly, even without the message it will eventually time out.
 	queue_in.WakeUp();
+
+	// On the pool, the thread needs a turn to notice.
+	if ( pool )
+		pool->Schedule(this);
+	}
+
+bool MsgThread::OnStartElsewhere()
+	{
+	if ( ! Poolable() || ! thread_mgr->GetPool() )
+		return false;
+
+	pool = thread_mgr->GetPool();
+	pool->Add(this);
+	return true;
+	}
+
+void MsgThread::OnJoin()
+	{
+	if ( pool )
+		pool->Remove(this);
+	}
+
+void MsgThread::OnNUMANode(int node)
+	{
+	// Moving pages is safe while they're in use. It's just an
+	// optimization, so there's nothing to do if it doesn't work.
+	queue_in.MoveToNode(node);
+	queue_out.MoveToNode(node);
 	}
 
 void MsgThread::Heartbeat()
@@ -418,6 +445,9 @@ void MsgThread::SendIn(BasicInputMessage* msg, bool force)
 
 	queue_in.Put(msg);
 	++cnt_sent_in;
+
+	if ( pool )
+		pool->Schedule(this);
 	}
 
 void MsgThread::SendOut(BasicOutputMessage* msg, bool force)
@@ -432,7 +462,8 @@ void MsgThread::SendOut(BasicOutputMessage* msg, bool force)
 
 	++cnt_sent_out;
 
-	flare.Fire();
+	if ( ! out_signaled.exchange(true) )
+		thread_mgr->SignalOut(this);
 	}
 
 void MsgThread::SendEvent(const char* name, const int num_vals, Value** vals)
@@ -442,6 +473,13 @@ void MsgThread::SendEvent(const char* name, const int num_vals, Value** vals)
 
 BasicOutputMessage* MsgThread::RetrieveOut()
 	{
+	if ( unfinished_out )
+		{
+		BasicOutputMessage* msg = unfinished_out;
+		unfinished_out = nullptr;
+		return msg;
+		}
+
 	BasicOutputMessage* msg = queue_out.Get();
 	if ( ! msg )
 		return nullptr;
@@ -451,9 +489,14 @@ BasicOutputMessage* MsgThread::RetrieveOut()
 	return msg;
 	}
 
-BasicInputMessage* MsgThread::RetrieveIn()
+BasicInputMessage* MsgThread::RetrieveIn(bool block)
 	{
-	BasicInputMessage* msg = queue_in.Get();
+	BasicInputMessage* msg = nullptr;
+
+	if ( block )
+		msg = queue_in.Get();
+	else
+		queue_in.TryGet(&msg);
 
 	if ( ! msg )
 		return nullptr;
@@ -472,26 +515,58 @@ void MsgThread::Run()
 		{
 		BasicInputMessage* msg = RetrieveIn();
 
+		if ( msg )
+			ProcessIn(msg);
+		}
+
+	FinishRun();
+	}
+
+bool MsgThread::RunTurn()
+	{
+	// Enough to make good progress, but not so much that other pooled
+	// threads wait for long.
+	static constexpr int TURN_MESSAGES = 64;
+
+	for ( int i = 0; i < TURN_MESSAGES && ! (child_finished || Killed()); ++i )
+		{
+		BasicInputMessage* msg = RetrieveIn(false);
+
 		if ( ! msg )
-			continue;
+			return true;
 
-		bool result = msg->Process();
+		ProcessIn(msg);
+		}
 
-		delete msg;
+	if ( ! (child_finished || Killed()) )
+		return true;
 
-		if ( ! result )
-			{
-			Error("terminating thread");
-
-			// This will eventually kill this thread, but only
-			// after all other outgoing messages (in particular
-			// error messages have been processed by then main
-			// thread).
-			SendOut(new detail::KillMeMessage(this));
-			failed = true;
-			}
+	FinishRun();
+	Done();
+	return false;
+	}
+
+void MsgThread::ProcessIn(BasicInputMessage* msg)
+	{
+	bool result = msg->Process();
+
+	delete msg;
+
+	if ( ! result )
+		{
+		Error("terminating thread");
+
+		// This will eventually kill this thread, but only
+		// after all other outgoing messages (in particular
+		// error messages have been processed by then main
+		// thread).
+		SendOut(new detail::KillMeMessage(this));
+		failed = true;
 		}
+	}
 
+void MsgThread::FinishRun()
+	{
 	// In case we haven't sent the finish method yet, do it now. Reading
 	// global network_time here should be fine, it isn't changing
 	// anymore.
@@ -514,11 +589,13 @@ void MsgThread::GetStats(Stats* stats)
 
 void MsgThread::Process()
 	{
-	flare.Extinguish();
+	// Clear this first, so that output queued from here on puts us back
+	// on the ready list.
+	out_signaled = false;
 
 	while ( HasOut() )
 		{
-		Message* msg = RetrieveOut();
+		BasicOutputMessage* msg = RetrieveOut();
 		assert(msg);
 
 		if ( ! msg->Process() )
@@ -527,6 +604,18 @@ void MsgThread::Process()
 			SignalStop();
 			}
 
+		else if ( msg->Unfinished() )
+			{
+			// Continue with it on the next pass, before anything
+			// else that the thread has sent.
+			unfinished_out = msg;
+
+			if ( ! out_signaled.exchange(true) )
+				thread_mgr->SignalOut(this);
+
+			return;
+			}
+
 		delete msg;
 		}
 	}
@@ -2,8 +2,8 @@
 
 #include <atomic>
 
+#include "zeek/Arena.h"
 #include "zeek/DebugLogger.h"
-#include "zeek/Flare.h"
 #include "zeek/iosource/IOSource.h"
 #include "zeek/threading/BasicThread.h"
 #include "zeek/threading/Queue.h"
@@ -20,6 +20,7 @@ struct Value;
 struct Field;
 class BasicInputMessage;
 class BasicOutputMessage;
+class Pool;
 
 namespace detail
 	{
@@ -88,7 +89,7 @@ public:
 	 *
 	 * @param vals the values to be given to the event
 	 */
-	void SendEvent(const char* name, const int num_vals, Value** vals);
+	virtual void SendEvent(const char* name, const int num_vals, Value** vals);
 
 	/**
 	 * Reports an informational message from the child thread. The main
@@ -214,7 +215,8 @@ public:
 	void GetStats(Stats* stats);
 
 	/**
-	 * Overridden from iosource::IOSource.
+	 * Overridden from iosource::IOSource. The threading::Manager calls
+	 * this once the thread has queued output for the main thread.
 	 */
 	void Process() override;
 	const char* Tag() override { return Name(); }
@@ -222,6 +224,7 @@ public:
 
 protected:
 	friend class Manager;
+	friend class Pool;
 	friend class detail::HeartbeatMessage;
 	friend class detail::FinishMessage;
 	friend class detail::FinishedMessage;
@@ -279,6 +282,17 @@ protected:
 	void OnWaitForStop() override;
 	void OnSignalStop() override;
 	void OnKill() override;
+	void OnNUMANode(int node) override;
+	bool OnStartElsewhere() override;
+	void OnJoin() override;
+
+	/**
+	 * Returns true if the thread may run on the thread pool that
+	 * Threading::pool_threads sets up, rather than on an OS thread of
+	 * its own. That requires processing messages without blocking for
+	 * long. The default is false.
+	 */
+	virtual bool Poolable() const { return false; }
 
 	/**
 	 * Method for child classes to override to provide file location
@@ -298,10 +312,13 @@ private:
 	 *
 	 * Must only be called by the child thread.
 	 *
+	 * @param block False to return right away if there's no message,
+	 * rather than waiting for one for a little while.
+	 *
 	 * @return The message, wth ownership passed to caller. Returns null
 	 * if the queue is empty.
 	 */
-	BasicInputMessage* RetrieveIn();
+	BasicInputMessage* RetrieveIn(bool block = true);
 
 	/**
 	 * Queues a message for the child.
@@ -339,7 +356,7 @@ private:
 	 * Returns true if there's at least one message pending for the main
 	 * thread.
 	 */
-	bool HasOut() { return queue_out.Ready(); }
+	bool HasOut() { return unfinished_out || queue_out.Ready(); }
 
 	/**
 	 * Returns true if there might be at least one message pending for
@@ -367,7 +384,31 @@ private:
 	bool child_sent_finish; // Child thread asked to be finished.
 	bool failed; // Set to true when a command failed.
 
-	zeek::detail::Flare flare;
+	// A message that Process() didn't finish within its pass, see
+	// BasicOutputMessage::Unfinished(). Only touched by the main thread.
+	BasicOutputMessage* unfinished_out = nullptr;
+
+	// True while the thread is on the manager's ready list, so that it
+	// signals the manager only once per batch of output.
+	std::atomic<bool> out_signaled;
+
+	// Runs a pooled thread for one turn, returning false once it has
+	// finished. Called by the pool.
+	bool RunTurn();
+
+	// Processes a message from the main thread.
+	void ProcessIn(BasicInputMessage* msg);
+
+	// Finishes up once done with processing messages.
+	void FinishRun();
+
+	// The pool that the thread runs on, if any, and its state there,
+	// guarded by the pool's mutex.
+	Pool* pool = nullptr;
+	bool pool_queued = false; // Waiting for a turn.
+	bool pool_running = false; // Having a turn.
+	bool pool_again = false; // Got input during its turn.
+	bool pool_done = false; // Won't get any more turns.
 	};
 
 /**
@@ -393,6 +434,9 @@ public:
 	 */
 	virtual bool Process() = 0; // Thread will be terminated if returngin false.
 
+	// Messages get created on one thread and destroyed on another.
+	ZEEK_ARENA_ALLOCATED(zeek::detail::ARENA_MESSAGES)
+
 protected:
 	/**
 	 * Constructor.
@@ -426,6 +470,15 @@ protected:
  */
 class BasicOutputMessage : public Message
 	{
+public:
+	/**
+	 * Returns true if Process() stopped before doing all of the
+	 * message's work, to be called again on a later pass of the main
+	 * loop. The thread's later output waits for that. Messages can do
+	 * so only while Manager::PassStarted() is set.
+	 */
+	virtual bool Unfinished() const { return false; }
+
 protected:
 	/**
 	 * Constructor.
@@ -0,0 +1,110 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/threading/Pool.h"
+
+#include "zeek/zeek-config.h"
+
+#include <algorithm>
+
+#include "zeek/threading/Manager.h"
+#include "zeek/threading/MsgThread.h"
+#include "zeek/util.h"
+
+namespace zeek::threading
+	{
+
+Pool::Pool(int threads)
+	{
+	for ( int i = 0; i < std::max(threads, 1); ++i )
+		{
+		workers.emplace_back(&Pool::Work, this);
+		thread_mgr->ApplyAffinity(workers.back(), "pool", "thread-pool");
+		}
+	}
+
+Pool::~Pool()
+	{
+		{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+		}
+
+	work_cond.notify_all();
+
+	for ( auto& w : workers )
+		w.join();
+	}
+
+void Pool::Add(MsgThread* thread)
+	{
+	Schedule(thread);
+	}
+
+void Pool::Schedule(MsgThread* thread)
+	{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	if ( thread->pool_done || thread->pool_queued )
+		return;
+
+	// The thread takes another turn once done with this one.
+	if ( thread->pool_running )
+		{
+		thread->pool_again = true;
+		return;
+		}
+
+	thread->pool_queued = true;
+	runnable.push_back(thread);
+	work_cond.notify_one();
+	}
+
+void Pool::Remove(MsgThread* thread)
+	{
+	std::unique_lock<std::mutex> lock(mutex);
+	done_cond.wait(lock, [thread] { return thread->pool_done; });
+	}
+
+void Pool::Work()
+	{
+	BasicThread::BlockSignals();
+	util::detail::set_thread_name("zk/thread-pool");
+
+	std::unique_lock<std::mutex> lock(mutex);
+
+	for ( ;; )
+		{
+		work_cond.wait(lock, [this] { return stopping || ! runnable.empty(); });
+
+		if ( runnable.empty() )
+			return;
+
+		MsgThread* thread = runnable.front();
+		runnable.pop_front();
+		thread->pool_queued = false;
+		thread->pool_running = true;
+		thread->pool_again = false;
+
+		lock.unlock();
+		bool more = thread->RunTurn();
+		bool again = more && (thread->HasIn() || thread->Killed());
+		lock.lock();
+
+		thread->pool_running = false;
+
+		if ( ! more )
+			{
+			thread->pool_done = true;
+			done_cond.notify_all();
+			}
+
+		else if ( again || thread->pool_again )
+			{
+			// To the back, so that other threads get their turns.
+			thread->pool_queued = true;
+			runnable.push_back(thread);
+			}
+		}
+	}
+
+	} // namespace zeek::threading
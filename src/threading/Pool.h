@@ -0,0 +1,75 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace zeek::threading
+	{
+
+class MsgThread;
+
+/**
+ * A fixed number of OS threads that take turns running message threads,
+ * so that the number of OS threads doesn't grow with the number of log
+ * writers and input readers. A pooled message thread gets a turn whenever
+ * it has input, for which it processes a limited number of messages
+ * without blocking, so that one busy thread doesn't starve the others.
+ * Each message thread runs on one pool thread at a time, and in order, so
+ * that backends need no locking beyond what they'd need on a thread of
+ * their own. They must not block for long, though, as that holds up a
+ * pool thread.
+ *
+ * The threading::Manager creates the pool once a message thread asks for
+ * it, see Threading::pool_threads.
+ */
+class Pool
+	{
+public:
+	/**
+	 * Constructor.
+	 *
+	 * @param threads The number of OS threads, at least one.
+	 */
+	explicit Pool(int threads);
+
+	/**
+	 * Destructor. All message threads must have been removed.
+	 */
+	~Pool();
+
+	/**
+	 * Adds a message thread and gives it its first turn. Called by the
+	 * main thread from MsgThread::Start().
+	 */
+	void Add(MsgThread* thread);
+
+	/**
+	 * Gives a message thread a turn, once it has new input or has been
+	 * killed. Called by the main thread.
+	 */
+	void Schedule(MsgThread* thread);
+
+	/**
+	 * Waits until a message thread has finished running, after which it
+	 * doesn't get any more turns. Called by the main thread when joining
+	 * the thread.
+	 */
+	void Remove(MsgThread* thread);
+
+private:
+	void Work();
+
+	std::mutex mutex;
+	std::condition_variable work_cond;
+	std::condition_variable done_cond;
+	std::deque<MsgThread*> runnable;
+	std::vector<std::thread> workers;
+	bool stopping = false;
+	};
+
+	} // namespace zeek::threading
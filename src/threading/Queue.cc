@@ -0,0 +1,182 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/threading/Queue.h"
+
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+#include "zeek/3rdparty/doctest.h"
+
+using namespace zeek::threading;
+
+namespace
+	{
+
+using Elem = void*;
+
+Elem elem(uintptr_t n)
+	{
+	// Zero is the null element that Get() returns if nothing shows up.
+	return reinterpret_cast<Elem>(n + 1);
+	}
+
+uintptr_t num(Elem e)
+	{
+	return reinterpret_cast<uintptr_t>(e) - 1;
+	}
+
+// Puts n elements from the writer's thread while the reader takes them
+// out as they come, returning true if they came in order.
+template <typename Q> bool transfer_in_order(Q* q, uintptr_t n)
+	{
+	std::thread writer(
+		[q, n]
+		{
+			for ( uintptr_t i = 0; i < n; ++i )
+				q->Put(elem(i));
+		});
+
+	bool in_order = true;
+
+	for ( uintptr_t i = 0; i < n; ++i )
+		{
+		// Get() may come back empty-handed after a wakeup, like
+		// MsgThread, just try again.
+		Elem e;
+
+		do
+			e = q->Get();
+		while ( ! e );
+
+		if ( num(e) != i )
+			{
+			in_order = false;
+			break;
+			}
+		}
+
+	writer.join();
+	return in_order;
+	}
+
+// Blocks the reader in Get() before the writer puts an element, returning
+// how long the reader waited.
+template <typename Q> std::chrono::milliseconds wake_up(Q* q, Elem* got)
+	{
+	auto start = std::chrono::steady_clock::now();
+	std::thread reader([q, got] { *got = q->Get(); });
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	q->Put(elem(42));
+	reader.join();
+
+	return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() -
+	                                                             start);
+	}
+
+	} // namespace
+
+TEST_SUITE_BEGIN("Queue");
+
+TEST_CASE("ring queue keeps order across its overflow")
+	{
+	RingQueue<Elem> q(nullptr, nullptr);
+	const uintptr_t ring = RingQueue<Elem>::RING_SIZE;
+	uintptr_t next_put = 0;
+	uintptr_t next_get = 0;
+	Elem e;
+
+	// Fill the ring and then some, which goes into the overflow.
+	for ( ; next_put < 2 * ring + 5; ++next_put )
+		q.Put(elem(next_put));
+
+	CHECK(q.Size() == 2 * ring + 5);
+	CHECK(q.Ready());
+
+	// Make room in the ring. New elements still need to go behind the
+	// overflowed ones.
+	for ( ; next_get < ring / 2; ++next_get )
+		{
+		REQUIRE(q.TryGet(&e));
+		CHECK(num(e) == next_get);
+		}
+
+	for ( ; next_put < 2 * ring + 5 + ring / 4; ++next_put )
+		q.Put(elem(next_put));
+
+	// Drain everything, ring first, then the overflow.
+	while ( q.TryGet(&e) )
+		{
+		CHECK(num(e) == next_get);
+		++next_get;
+		}
+
+	CHECK(next_get == next_put);
+	CHECK(q.Size() == 0);
+	CHECK_FALSE(q.Ready());
+
+	// With the overflow empty, the ring takes elements again.
+	for ( uintptr_t i = 0; i < ring + 1; ++i )
+		q.Put(elem(next_put++));
+
+	while ( q.TryGet(&e) )
+		{
+		CHECK(num(e) == next_get);
+		++next_get;
+		}
+
+	CHECK(next_get == next_put);
+
+	QueueStats stats;
+	q.GetStats(&stats);
+	CHECK(stats.num_reads == next_get);
+	CHECK(stats.num_writes == next_put);
+	}
+
+TEST_CASE("ring queue between threads")
+	{
+	RingQueue<Elem> q(nullptr, nullptr);
+	CHECK(transfer_in_order(&q, 1000000));
+	CHECK(q.Size() == 0);
+	}
+
+TEST_CASE("ring queue wakes up a waiting reader")
+	{
+	RingQueue<Elem> q(nullptr, nullptr);
+	Elem got = nullptr;
+
+	// Get() gives up after five seconds without Put().
+	CHECK(wake_up(&q, &got) < std::chrono::seconds(4));
+	REQUIRE(got);
+	CHECK(num(got) == 42);
+	}
+
+TEST_CASE("locking queue")
+	{
+	LockingQueue<Elem> q(nullptr, nullptr);
+	Elem e;
+
+	CHECK_FALSE(q.TryGet(&e));
+
+	for ( uintptr_t i = 0; i < 20; ++i )
+		q.Put(elem(i));
+
+	CHECK(q.Size() == 20);
+
+	for ( uintptr_t i = 0; i < 20; ++i )
+		{
+		REQUIRE(q.TryGet(&e));
+		CHECK(num(e) == i);
+		}
+
+	CHECK_FALSE(q.Ready());
+	CHECK(transfer_in_order(&q, 100000));
+
+	Elem got = nullptr;
+	CHECK(wake_up(&q, &got) < std::chrono::seconds(4));
+	REQUIRE(got);
+	CHECK(num(got) == 42);
+	}
+
+TEST_SUITE_END();
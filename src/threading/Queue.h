@@ -1,13 +1,22 @@
 #pragma once
 
 #include <sys/time.h>
+#include <atomic>
+#include <cerrno>
 #include <condition_variable>
 #include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <deque>
 #include <mutex>
 #include <queue>
+#include <type_traits>
+#include <vector>
+
+#include "zeek/zeek-config.h"
 
 #include "zeek/Reporter.h"
+#include "zeek/zeek-affinity.h"
 #include "zeek/threading/BasicThread.h"
 
 #undef Queue // Defined elsewhere unfortunately.
@@ -16,7 +25,17 @@ namespace zeek::threading
 	{
 
 /**
- * A thread-safe single-reader single-writer queue.
+ * Statistics about inter-thread communication.
+ */
+struct QueueStats
+	{
+	uint64_t num_reads; //! Number of messages read from the queue.
+	uint64_t num_writes; //! Number of messages written to the queue.
+	};
+
+/**
+ * A thread-safe single-reader single-writer queue, used as Queue by
+ * default.
  *
  * The implementation uses multiple queues and reads/writes in rotary fashion
  * in an attempt to limit contention.
@@ -26,7 +45,7 @@ namespace zeek::threading
  * TODO: Unclear how critical performance is for this qeueue. We could likely
  * optimize it further if helpful.
  */
-template <typename T> class Queue
+template <typename T> class LockingQueue
 	{
 public:
 	/**
@@ -36,12 +55,12 @@ public:
 	 * whether they have terminated so that we can abort I/O opeations.
 	 * Can be left null for the main thread.
 	 */
-	Queue(BasicThread* arg_reader, BasicThread* arg_writer);
+	LockingQueue(BasicThread* arg_reader, BasicThread* arg_writer);
 
 	/**
 	 * Destructor.
 	 */
-	~Queue();
+	~LockingQueue();
 
 	/**
 	 * Retrieves one element. This may block for a little while of no
@@ -50,6 +69,13 @@ public:
 	 */
 	T Get();
 
+	/**
+	 * Retrieves one element if there's one, without blocking.
+	 *
+	 * @return True if there was one.
+	 */
+	bool TryGet(T* data);
+
 	/**
 	 * Queues one element.
 	 */
@@ -82,14 +108,7 @@ public:
 	 */
 	uint64_t Size();
 
-	/**
-	 * Statistics about inter-thread communication.
-	 */
-	struct Stats
-		{
-		uint64_t num_reads; //! Number of messages read from the queue.
-		uint64_t num_writes; //! Number of messages written to the queue.
-		};
+	using Stats = QueueStats;
 
 	/**
 	 * Returns statistics about the queue's usage.
@@ -99,6 +118,17 @@ public:
 	 */
 	void GetStats(Stats* stats);
 
+	/**
+	 * Does nothing, as the queued elements get allocated one by one.
+	 *
+	 * @return Always false, with errno set to ENOTSUP.
+	 */
+	bool MoveToNode(int node)
+		{
+		errno = ENOTSUP;
+		return false;
+		}
+
 private:
 	static const int NUM_QUEUES = 8;
 
@@ -133,7 +163,8 @@ inline static std::unique_lock<std::mutex> acquire_lock(std::mutex& m)
 		}
 	}
 
-template <typename T> inline Queue<T>::Queue(BasicThread* arg_reader, BasicThread* arg_writer)
+template <typename T>
+inline LockingQueue<T>::LockingQueue(BasicThread* arg_reader, BasicThread* arg_writer)
 	{
 	read_ptr = 0;
 	write_ptr = 0;
@@ -142,9 +173,9 @@ template <typename T> inline Queue<T>::Queue(BasicThread* arg_reader, BasicThrea
 	writer = arg_writer;
 	}
 
-template <typename T> inline Queue<T>::~Queue() { }
+template <typename T> inline LockingQueue<T>::~LockingQueue() { }
 
-template <typename T> inline T Queue<T>::Get()
+template <typename T> inline T LockingQueue<T>::Get()
 	{
 	auto lock = acquire_lock(mutex[read_ptr]);
 
@@ -169,7 +200,23 @@ template <typename T> inline T Queue<T>::Get()
 	return data;
 	}
 
-template <typename T> inline void Queue<T>::Put(T data)
+template <typename T> inline bool LockingQueue<T>::TryGet(T* data)
+	{
+	auto lock = acquire_lock(mutex[read_ptr]);
+
+	if ( messages[read_ptr].empty() )
+		return false;
+
+	*data = messages[read_ptr].front();
+	messages[read_ptr].pop();
+
+	read_ptr = (read_ptr + 1) % NUM_QUEUES;
+	++num_reads;
+
+	return true;
+	}
+
+template <typename T> inline void LockingQueue<T>::Put(T data)
 	{
 	auto lock = acquire_lock(mutex[write_ptr]);
 
@@ -189,7 +236,7 @@ template <typename T> inline void Queue<T>::Put(T data)
 		}
 	}
 
-template <typename T> inline bool Queue<T>::Ready()
+template <typename T> inline bool LockingQueue<T>::Ready()
 	{
 	auto lock = acquire_lock(mutex[read_ptr]);
 
@@ -198,7 +245,8 @@ template <typename T> inline bool Queue<T>::Ready()
 	return ret;
 	}
 
-template <typename T> inline std::vector<std::unique_lock<std::mutex>> Queue<T>::LocksForAllQueues()
+template <typename T>
+inline std::vector<std::unique_lock<std::mutex>> LockingQueue<T>::LocksForAllQueues()
 	{
 	std::vector<std::unique_lock<std::mutex>> locks;
 
@@ -218,7 +266,7 @@ template <typename T> inline std::vector<std::unique_lock<std::mutex>> Queue<T>:
 	return locks;
 	}
 
-template <typename T> inline uint64_t Queue<T>::Size()
+template <typename T> inline uint64_t LockingQueue<T>::Size()
 	{
 	// Need to lock all queues.
 	auto locks = LocksForAllQueues();
@@ -231,7 +279,7 @@ template <typename T> inline uint64_t Queue<T>::Size()
 	return size;
 	}
 
-template <typename T> inline void Queue<T>::GetStats(Stats* stats)
+template <typename T> inline void LockingQueue<T>::GetStats(Stats* stats)
 	{
 	// To be safe, we look all queues. That's probably unneccessary, but
 	// doesn't really hurt.
@@ -241,7 +289,7 @@ template <typename T> inline void Queue<T>::GetStats(Stats* stats)
 	stats->num_writes = num_writes;
 	}
 
-template <typename T> inline void Queue<T>::WakeUp()
+template <typename T> inline void LockingQueue<T>::WakeUp()
 	{
 	for ( int i = 0; i < NUM_QUEUES; i++ )
 		{
@@ -250,4 +298,307 @@ template <typename T> inline void Queue<T>::WakeUp()
 		}
 	}
 
+/**
+ * A thread-safe single-reader single-writer queue that doesn't lock for
+ * every element. Used as Queue if Zeek is configured with
+ * --enable-spsc-queue.
+ *
+ * Elements go into a fixed-size ring that the two threads share without
+ * locking. The reader only blocks, and the writer only signals it, when
+ * the reader has run out of elements. If the ring fills up, further
+ * elements go into a mutex-protected overflow queue until the reader has
+ * caught up, so writing never blocks nor fails.
+ *
+ * All Queue instances must be instantiated by Zeek's main thread. Get()
+ * and Ready() must only be called by the reader, and Put() only by the
+ * writer.
+ */
+template <typename T> class RingQueue
+	{
+public:
+	/**
+	 * Constructor.
+	 *
+	 * reader, writer: The corresponding threads. This is for checking
+	 * whether they have terminated so that we can abort I/O opeations.
+	 * Can be left null for the main thread.
+	 */
+	RingQueue(BasicThread* arg_reader, BasicThread* arg_writer);
+
+	/**
+	 * Destructor.
+	 */
+	~RingQueue();
+
+	/**
+	 * Retrieves one element. This may block for a little while of no
+	 * input is available and eventually return with a null element if
+	 * nothing shows up.
+	 */
+	T Get();
+
+	/**
+	 * Retrieves one element if there's one, without blocking.
+	 *
+	 * @return True if there was one.
+	 */
+	bool TryGet(T* data) { return Pop(data); }
+
+	/**
+	 * Queues one element.
+	 */
+	void Put(T data);
+
+	/**
+	 * Returns true if the next Get() operation will succeed.
+	 */
+	bool Ready();
+
+	/**
+	 * Returns true if the next Get() operation might succeed. This
+	 * function may occasionally return a value not indicating the actual
+	 * state, but won't do so very often. Note that this means that it can
+	 * consistently return false even if there is something in the Queue.
+	 * You have to check real queue status from time to time to be sure that
+	 * it is empty. In other words, this method helps to avoid locking the queue
+	 * frequently, but doesn't allow you to forgo it completely.
+	 */
+	bool MaybeReady()
+		{
+		return num_reads.load(std::memory_order_relaxed) !=
+		       num_writes.load(std::memory_order_relaxed);
+		}
+
+	/**
+	 * Wake up the reader if it's currently blocked for input. This is
+	 * primarily to give it a chance to check termination quickly.
+	 */
+	void WakeUp();
+
+	/**
+	 * Returns the number of queued items not yet retrieved.
+	 */
+	uint64_t Size();
+
+	using Stats = QueueStats;
+
+	/**
+	 * Returns statistics about the queue's usage.
+	 *
+	 * @param stats A pointer to a structure that will be filled with
+	 * current numbers.
+	 */
+	void GetStats(Stats* stats);
+
+	/**
+	 * Moves the ring to a NUMA node, such as the one of the thread that
+	 * uses it the most. Elements in the overflow queue stay where they
+	 * are.
+	 *
+	 * @return False if that's not possible, with errno set.
+	 */
+	bool MoveToNode(int node) { return move_to_numa_node(ring, RING_BYTES, node); }
+
+	/**
+	 * The number of elements the ring holds. Put() adds elements beyond
+	 * that to the overflow queue. A power of two.
+	 */
+	static constexpr size_t RING_SIZE = 1024;
+
+private:
+	static constexpr int SPIN_COUNT = 1000;
+
+	// The ring takes whole pages of its own, so that moving it doesn't
+	// move anything else.
+	static constexpr size_t RING_ALIGN = 4096;
+	static constexpr size_t RING_BYTES = (RING_SIZE * sizeof(T) + RING_ALIGN - 1) & ~(RING_ALIGN - 1);
+	static_assert(std::is_trivial_v<T>, "queue elements must be trivial");
+
+	// Takes the next element, if there's one.
+	bool Pop(T* data);
+
+	// The ring. The reader advances head and the writer tail, each
+	// keeping the other's index as last seen to touch it less often.
+	// What each thread writes sits in a cache line of its own.
+	T* ring;
+	alignas(64) std::atomic<size_t> head;
+	size_t cached_tail;
+	std::atomic<uint64_t> num_reads;
+	alignas(64) std::atomic<size_t> tail;
+	size_t cached_head;
+	std::atomic<uint64_t> num_writes;
+
+	// Elements that didn't fit into the ring, all of them newer than
+	// those in the ring.
+	alignas(64) std::mutex overflow_mutex;
+	std::deque<T> overflow;
+	std::atomic<size_t> overflow_size;
+
+	// For the reader to wait for elements.
+	std::mutex wait_mutex;
+	std::condition_variable has_data;
+	std::atomic<bool> waiting;
+
+	BasicThread* reader;
+	BasicThread* writer;
+	};
+
+template <typename T>
+inline RingQueue<T>::RingQueue(BasicThread* arg_reader, BasicThread* arg_writer)
+	{
+	head = tail = 0;
+	cached_head = cached_tail = 0;
+	overflow_size = 0;
+	waiting = false;
+	num_reads = num_writes = 0;
+	reader = arg_reader;
+	writer = arg_writer;
+
+	// Touch the ring now, so that it has its memory before any thread
+	// uses it, see MoveToNode().
+	ring = static_cast<T*>(aligned_alloc(RING_ALIGN, RING_BYTES));
+
+	if ( ! ring )
+		reporter->FatalError("out of memory for thread queue");
+
+	memset(ring, 0, RING_BYTES);
+	}
+
+template <typename T> inline RingQueue<T>::~RingQueue()
+	{
+	free(ring);
+	}
+
+template <typename T> inline bool RingQueue<T>::Pop(T* data)
+	{
+	size_t h = head.load(std::memory_order_relaxed);
+
+	if ( h == cached_tail )
+		{
+		// The writer only overflows once the ring is full, and stops
+		// adding to the ring until the overflowed elements are gone.
+		// Checking for them first thus means seeing the ring's final
+		// state below, so that if it's empty they come next.
+		bool overflowed = overflow_size.load(std::memory_order_acquire);
+		cached_tail = tail.load(std::memory_order_acquire);
+
+		if ( h == cached_tail )
+			{
+			if ( ! overflowed )
+				return false;
+
+			std::lock_guard<std::mutex> lock(overflow_mutex);
+			*data = overflow.front();
+			overflow.pop_front();
+			--overflow_size;
+			num_reads.store(num_reads.load(std::memory_order_relaxed) + 1,
+			                std::memory_order_relaxed);
+			return true;
+			}
+		}
+
+	*data = ring[h & (RING_SIZE - 1)];
+	head.store(h + 1, std::memory_order_release);
+	num_reads.store(num_reads.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	return true;
+	}
+
+template <typename T> inline T RingQueue<T>::Get()
+	{
+	T data;
+
+	if ( Pop(&data) )
+		return data;
+
+	// Elements often follow each other closely, so look again for a
+	// little while before going to sleep.
+	for ( int i = 0; i < SPIN_COUNT; ++i )
+		{
+		if ( Pop(&data) )
+			return data;
+		}
+
+	if ( ! ((reader && reader->Killed()) || (writer && writer->Killed())) )
+		{
+		std::unique_lock<std::mutex> lock(wait_mutex);
+
+		// Once the writer can see that we're waiting, check once more
+		// whether there's something, so that we don't miss its signal.
+		waiting = true;
+
+		if ( ! Ready() )
+			has_data.wait_for(lock, std::chrono::seconds(5));
+
+		waiting = false;
+		}
+
+	if ( Pop(&data) )
+		return data;
+
+	return nullptr;
+	}
+
+template <typename T> inline void RingQueue<T>::Put(T data)
+	{
+	size_t t = tail.load(std::memory_order_relaxed);
+
+	if ( t - cached_head == RING_SIZE )
+		cached_head = head.load(std::memory_order_acquire);
+
+	if ( t - cached_head < RING_SIZE && ! overflow_size.load(std::memory_order_acquire) )
+		{
+		ring[t & (RING_SIZE - 1)] = data;
+		tail.store(t + 1);
+		}
+
+	else
+		{
+		std::lock_guard<std::mutex> lock(overflow_mutex);
+		overflow.push_back(data);
+		++overflow_size;
+		}
+
+	num_writes.store(num_writes.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+	// Signal the reader only once per wait. Taking the lock makes sure
+	// that it's actually waiting, rather than about to.
+	if ( waiting.load() && waiting.exchange(false) )
+		{
+		std::lock_guard<std::mutex> lock(wait_mutex);
+		has_data.notify_one();
+		}
+	}
+
+template <typename T> inline bool RingQueue<T>::Ready()
+	{
+	return head.load(std::memory_order_relaxed) != tail.load() || overflow_size.load();
+	}
+
+template <typename T> inline uint64_t RingQueue<T>::Size()
+	{
+	return num_writes.load(std::memory_order_relaxed) - num_reads.load(std::memory_order_relaxed);
+	}
+
+template <typename T> inline void RingQueue<T>::GetStats(Stats* stats)
+	{
+	stats->num_reads = num_reads.load(std::memory_order_relaxed);
+	stats->num_writes = num_writes.load(std::memory_order_relaxed);
+	}
+
+template <typename T> inline void RingQueue<T>::WakeUp()
+	{
+	std::lock_guard<std::mutex> lock(wait_mutex);
+	has_data.notify_all();
+	}
+
+/**
+ * The queue between two threads. The lock-free ring is opt-in until it
+ * has shown to be faster on multi-core systems.
+ */
+#ifdef ZEEK_SPSC_QUEUE
+template <typename T> using Queue = RingQueue<T>;
+#else
+template <typename T> using Queue = LockingQueue<T>;
+#endif
+
 	} // namespace zeek::threading
@@ -6,6 +6,7 @@
 #include <sys/socket.h>
 #include <sys/types.h>
 
+#include "zeek/Arena.h"
 #include "zeek/Type.h"
 #include "zeek/net_util.h"
 
@@ -206,6 +207,8 @@ struct Value
 	 */
 	~Value();
 
+	ZEEK_ARENA_ALLOCATED(zeek::detail::ARENA_MESSAGES)
+
 	/**
 	 * Unserializes a value.
 	 *
@@ -8,12 +8,20 @@
 #define __STDC_LIMIT_MACROS
 #endif
 
+#include <rapidjson/internal/dtoa.h>
 #include <rapidjson/internal/ieee754.h>
+#include <rapidjson/internal/itoa.h>
 #include <cerrno>
 #include <cmath>
 #include <cstdint>
+#include <cstring>
 #include <sstream>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "zeek/3rdparty/doctest.h"
 #include "zeek/Desc.h"
 #include "zeek/threading/MsgThread.h"
 
@@ -28,6 +36,146 @@ bool JSON::NullDoubleWriter::Double(double d)
 	return rapidjson::Writer<rapidjson::StringBuffer>::Double(d);
 	}
 
+static bool needs_escaping(unsigned char c)
+	{
+	return c < 0x20 || c >= 0x7f || c == '"' || c == '\\';
+	}
+
+// Returns the length of the leading part of a string that goes into JSON
+// unchanged, which for most log strings is all of it.
+static size_t plain_length(const char* s, size_t len)
+	{
+	size_t i = 0;
+
+#ifdef __SSE2__
+	const __m128i space = _mm_set1_epi8(0x20);
+	const __m128i quote = _mm_set1_epi8('"');
+	const __m128i backslash = _mm_set1_epi8('\\');
+	const __m128i del = _mm_set1_epi8(0x7f);
+
+	for ( ; i + 16 <= len; i += 16 )
+		{
+		__m128i group = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+
+		// The signed comparison catches both control characters and
+		// bytes with the high bit set.
+		__m128i special = _mm_or_si128(
+			_mm_or_si128(_mm_cmplt_epi8(group, space), _mm_cmpeq_epi8(group, del)),
+			_mm_or_si128(_mm_cmpeq_epi8(group, quote), _mm_cmpeq_epi8(group, backslash)));
+
+		if ( int mask = _mm_movemask_epi8(special) )
+			return i + __builtin_ctz(mask);
+		}
+#endif
+
+	for ( ; i < len; ++i )
+		if ( needs_escaping(s[i]) )
+			return i;
+
+	return len;
+	}
+
+// Appends a string with the escaping that rapidjson's writer applies.
+static void append_escaped(std::string& out, const char* s, size_t len)
+	{
+	static const char hex[] = "0123456789ABCDEF";
+
+	for ( size_t i = 0; i < len; ++i )
+		{
+		unsigned char c = s[i];
+
+		switch ( c )
+			{
+			case '"':
+				out.append("\\\"", 2);
+				break;
+			case '\\':
+				out.append("\\\\", 2);
+				break;
+			case '\b':
+				out.append("\\b", 2);
+				break;
+			case '\f':
+				out.append("\\f", 2);
+				break;
+			case '\n':
+				out.append("\\n", 2);
+				break;
+			case '\r':
+				out.append("\\r", 2);
+				break;
+			case '\t':
+				out.append("\\t", 2);
+				break;
+			default:
+				if ( c < 0x20 )
+					{
+					char u[] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf]};
+					out.append(u, sizeof(u));
+					}
+				else
+					out.push_back(c);
+			}
+		}
+	}
+
+static void append_quoted(std::string& out, const char* s, size_t len)
+	{
+	out.push_back('"');
+
+	size_t n = plain_length(s, len);
+	out.append(s, n);
+
+	if ( n < len )
+		{
+		bool ascii = true;
+
+		for ( size_t i = n; i < len && ascii; ++i )
+			{
+			unsigned char c = s[i];
+			ascii = (c >= 0x20 && c < 0x7f) || c == '\b' || c == '\f' || c == '\n' ||
+			        c == '\r' || c == '\t';
+			}
+
+		// json_escape_utf8() leaves such strings alone, and as it only
+		// ever rewrites non-ASCII bytes and control characters, it's
+		// enough to run it on the rest.
+		if ( ascii )
+			append_escaped(out, s + n, len - n);
+		else
+			{
+			auto rest = util::json_escape_utf8(s + n, len - n);
+			append_escaped(out, rest.data(), rest.size());
+			}
+		}
+
+	out.push_back('"');
+	}
+
+static void append_int(std::string& out, int64_t i)
+	{
+	char buf[24];
+	out.append(buf, rapidjson::internal::i64toa(i, buf) - buf);
+	}
+
+static void append_uint(std::string& out, uint64_t u)
+	{
+	char buf[24];
+	out.append(buf, rapidjson::internal::u64toa(u, buf) - buf);
+	}
+
+static void append_double(std::string& out, double d)
+	{
+	if ( rapidjson::internal::Double(d).IsNanOrInf() )
+		{
+		out.append("null", 4);
+		return;
+		}
+
+	char buf[32];
+	out.append(buf, rapidjson::internal::dtoa(d, buf) - buf);
+	}
+
 JSON::JSON(MsgThread* t, TimeFormat tf, bool arg_include_unset_fields)
 	: Formatter(t), surrounding_braces(true), include_unset_fields(arg_include_unset_fields)
 	{
@@ -36,21 +184,49 @@ JSON::JSON(MsgThread* t, TimeFormat tf, bool arg_include_unset_fields)
 
 JSON::~JSON() { }
 
+const std::vector<std::string>& JSON::Keys(int num_fields, const Field* const* fields) const
+	{
+	if ( fields == key_fields && keys.size() == static_cast<size_t>(num_fields) )
+		return keys;
+
+	keys.clear();
+	keys.reserve(num_fields);
+
+	for ( int i = 0; i < num_fields; i++ )
+		{
+		std::string key = "\"";
+		append_escaped(key, fields[i]->name, strlen(fields[i]->name));
+		key += "\":";
+		keys.push_back(std::move(key));
+		}
+
+	key_fields = fields;
+	return keys;
+	}
+
 bool JSON::Describe(ODesc* desc, int num_fields, const Field* const* fields, Value** vals) const
 	{
-	rapidjson::StringBuffer buffer;
-	NullDoubleWriter writer(buffer);
+	const auto& field_keys = Keys(num_fields, fields);
+	bool first = true;
 
-	writer.StartObject();
+	line.clear();
+	line.push_back('{');
 
 	for ( int i = 0; i < num_fields; i++ )
 		{
 		if ( vals[i]->present || include_unset_fields )
-			BuildJSON(writer, vals[i], fields[i]->name);
+			{
+			if ( ! first )
+				line.push_back(',');
+
+			line.append(field_keys[i]);
+			BuildJSON(line, vals[i]);
+			first = false;
+			}
 		}
 
-	writer.EndObject();
-	desc->Add(buffer.GetString());
+	line.push_back('}');
+	desc->AddBytes(line.data(), line.size());
 
 	return true;
 	}
@@ -66,15 +242,13 @@ bool JSON::Describe(ODesc* desc, Value* val, const std::string& name) const
 	if ( (! val->present && ! include_unset_fields) || name.empty() )
 		return true;
 
-	rapidjson::Document doc;
-	rapidjson::StringBuffer buffer;
-	NullDoubleWriter writer(buffer);
-
-	writer.StartObject();
-	BuildJSON(writer, val, name);
-	writer.EndObject();
+	line.assign("{\"");
+	append_escaped(line, name.data(), name.size());
+	line.append("\":");
+	BuildJSON(line, val);
+	line.push_back('}');
 
-	desc->Add(buffer.GetString());
+	desc->Add(line.c_str());
 	return true;
 	}
 
@@ -85,86 +259,114 @@ Value* JSON::ParseValue(const std::string& s, const std::string& name, TypeTag t
 	return nullptr;
 	}
 
-void JSON::BuildJSON(NullDoubleWriter& writer, Value* val, const std::string& name) const
+void JSON::AppendTime(std::string& out, double t) const
 	{
-	if ( ! name.empty() )
-		writer.Key(name);
+	time_t the_time = time_t(floor(t));
+
+	// Most timestamps in a log fall into the same second as the
+	// previous one.
+	if ( iso_seconds.empty() || the_time != iso_time )
+		{
+		char buffer[40];
+		struct tm tm;
+
+		if ( ! gmtime_r(&the_time, &tm) ||
+		     ! strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%S", &tm) )
+			{
+			GetThread()->Error(
+				GetThread()->Fmt("json formatter: failure getting time: (%lf)", t));
+			// This was a failure, doesn't really matter what gets put here
+			// but it should probably stand out...
+			out.append("\"2000-01-01T00:00:00.000000\"");
+			return;
+			}
+
+		iso_time = the_time;
+		iso_seconds = buffer;
+		}
+
+	double integ;
+	double frac = modf(t, &integ);
+
+	if ( frac < 0 )
+		frac += 1;
+
+	// Rounds like printf()'s "%06.0f", to even in the default rounding
+	// mode, including to 1000000 just below a full second.
+	char usec[24];
+	char* end = rapidjson::internal::u64toa(uint64_t(nearbyint(fabs(frac) * 1000000)), usec);
 
+	out.push_back('"');
+	out.append(iso_seconds);
+	out.push_back('.');
+
+	if ( end - usec < 6 )
+		out.append(6 - (end - usec), '0');
+
+	out.append(usec, end - usec);
+	out.append("Z\"", 2);
+	}
+
+void JSON::BuildJSON(std::string& out, const Value* val) const
+	{
 	if ( ! val->present )
 		{
-		writer.Null();
+		out.append("null", 4);
 		return;
 		}
 
 	switch ( val->type )
 		{
 		case TYPE_BOOL:
-			writer.Bool(val->val.int_val != 0);
+			if ( val->val.int_val != 0 )
+				out.append("true", 4);
+			else
+				out.append("false", 5);
 			break;
 
 		case TYPE_INT:
-			writer.Int64(val->val.int_val);
+			append_int(out, val->val.int_val);
 			break;
 
 		case TYPE_COUNT:
-			writer.Uint64(val->val.uint_val);
+			append_uint(out, val->val.uint_val);
 			break;
 
 		case TYPE_PORT:
-			writer.Uint64(val->val.port_val.port);
+			append_uint(out, val->val.port_val.port);
 			break;
 
 		case TYPE_SUBNET:
-			writer.String(Formatter::Render(val->val.subnet_val));
+			{
+			auto s = Formatter::Render(val->val.subnet_val);
+			append_quoted(out, s.data(), s.size());
 			break;
+			}
 
 		case TYPE_ADDR:
-			writer.String(Formatter::Render(val->val.addr_val));
+			{
+			auto s = Formatter::Render(val->val.addr_val);
+			append_quoted(out, s.data(), s.size());
 			break;
+			}
 
 		case TYPE_DOUBLE:
 		case TYPE_INTERVAL:
-			writer.Double(val->val.double_val);
+			append_double(out, val->val.double_val);
 			break;
 
 		case TYPE_TIME:
 			{
 			if ( timestamps == TS_ISO8601 )
-				{
-				char buffer[40];
-				char buffer2[48];
-				time_t the_time = time_t(floor(val->val.double_val));
-				struct tm t;
-
-				if ( ! gmtime_r(&the_time, &t) ||
-				     ! strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%S", &t) )
-					{
-					GetThread()->Error(GetThread()->Fmt(
-						"json formatter: failure getting time: (%lf)", val->val.double_val));
-					// This was a failure, doesn't really matter what gets put here
-					// but it should probably stand out...
-					writer.String("2000-01-01T00:00:00.000000");
-					}
-				else
-					{
-					double integ;
-					double frac = modf(val->val.double_val, &integ);
-
-					if ( frac < 0 )
-						frac += 1;
-
-					snprintf(buffer2, sizeof(buffer2), "%s.%06.0fZ", buffer, fabs(frac) * 1000000);
-					writer.String(buffer2, strlen(buffer2));
-					}
-				}
+				AppendTime(out, val->val.double_val);
 
 			else if ( timestamps == TS_EPOCH )
-				writer.Double(val->val.double_val);
+				append_double(out, val->val.double_val);
 
 			else if ( timestamps == TS_MILLIS )
 				{
 				// ElasticSearch uses milliseconds for timestamps
-				writer.Uint64((uint64_t)(val->val.double_val * 1000));
+				append_uint(out, (uint64_t)(val->val.double_val * 1000));
 				}
 
 			break;
@@ -174,38 +376,128 @@ void JSON::BuildJSON(NullDoubleWriter& writer, Value* val, const std::string& na
 		case TYPE_STRING:
 		case TYPE_FILE:
 		case TYPE_FUNC:
-			{
-			writer.String(util::json_escape_utf8(
-				std::string(val->val.string_val.data, val->val.string_val.length)));
+			append_quoted(out, val->val.string_val.data, val->val.string_val.length);
 			break;
-			}
 
 		case TYPE_TABLE:
 			{
-			writer.StartArray();
+			out.push_back('[');
 
 			for ( zeek_int_t idx = 0; idx < val->val.set_val.size; idx++ )
-				BuildJSON(writer, val->val.set_val.vals[idx]);
+				{
+				if ( idx > 0 )
+					out.push_back(',');
+
+				BuildJSON(out, val->val.set_val.vals[idx]);
+				}
 
-			writer.EndArray();
+			out.push_back(']');
 			break;
 			}
 
 		case TYPE_VECTOR:
 			{
-			writer.StartArray();
+			out.push_back('[');
 
 			for ( zeek_int_t idx = 0; idx < val->val.vector_val.size; idx++ )
-				BuildJSON(writer, val->val.vector_val.vals[idx]);
+				{
+				if ( idx > 0 )
+					out.push_back(',');
+
+				BuildJSON(out, val->val.vector_val.vals[idx]);
+				}
 
-			writer.EndArray();
+			out.push_back(']');
 			break;
 			}
 
 		default:
 			reporter->Warning("Unhandled type in JSON::BuildJSON");
+			out.append("null", 4);
 			break;
 		}
 	}
 
+TEST_SUITE_BEGIN("JSON formatter");
+
+TEST_CASE("json formatter output matches rapidjson")
+	{
+	JSON f(nullptr, JSON::TS_EPOCH);
+
+	auto describe = [&f](Value* v)
+	{
+		ODesc d;
+		f.Describe(&d, v, "k");
+		return std::string(d.Description());
+	};
+
+	const char* strings[] = {
+		"",
+		"plain",
+		"a string that is longer than a single sixteen byte group",
+		"quote \" and backslash \\ after the first group of bytes",
+		"\b\f\n\r\t",
+		"\x01\x1f\x7f",
+		"\xc3\xb1 valid utf-8",
+		"invalid utf-8 \xc3\x28 somewhere in the second group",
+		"\xc3\xb1\xc0\x81",
+	};
+
+	for ( auto s : strings )
+		{
+		rapidjson::StringBuffer buffer;
+		JSON::NullDoubleWriter writer(buffer);
+		writer.StartObject();
+		writer.Key("k");
+		writer.String(util::json_escape_utf8(std::string(s)));
+		writer.EndObject();
+
+		Value v(TYPE_STRING);
+		v.val.string_val.length = strlen(s);
+		v.val.string_val.data = new char[v.val.string_val.length];
+		memcpy(v.val.string_val.data, s, v.val.string_val.length);
+
+		CHECK(describe(&v) == buffer.GetString());
+		}
+
+	double doubles[] = {0.0, -0.0, 1.0, 0.1, 1.5e-7, 123456789.123456, 1e21, -3.25e300,
+	                    NAN, INFINITY};
+
+	for ( auto d : doubles )
+		{
+		rapidjson::StringBuffer buffer;
+		JSON::NullDoubleWriter writer(buffer);
+		writer.StartObject();
+		writer.Key("k");
+		writer.Double(d);
+		writer.EndObject();
+
+		Value v(TYPE_DOUBLE);
+		v.val.double_val = d;
+
+		CHECK(describe(&v) == buffer.GetString());
+		}
+	}
+
+TEST_CASE("json formatter iso8601 timestamps")
+	{
+	JSON f(nullptr, JSON::TS_ISO8601);
+
+	auto describe = [&f](double t)
+	{
+		Value v(TYPE_TIME);
+		v.val.double_val = t;
+		ODesc d;
+		f.Describe(&d, &v, "ts");
+		return std::string(d.Description());
+	};
+
+	CHECK(describe(1.5) == "{\"ts\":\"1970-01-01T00:00:01.500000Z\"}");
+	CHECK(describe(1.000001) == "{\"ts\":\"1970-01-01T00:00:01.000001Z\"}");
+	CHECK(describe(1600000000.25) == "{\"ts\":\"2020-09-13T12:26:40.250000Z\"}");
+	CHECK(describe(-0.5) == "{\"ts\":\"1969-12-31T23:59:59.500000Z\"}");
+	}
+
+TEST_SUITE_END();
+
 	} // namespace zeek::threading::formatter
@@ -5,6 +5,9 @@
 #define RAPIDJSON_HAS_STDSTRING 1
 #include <rapidjson/document.h>
 #include <rapidjson/writer.h>
+#include <ctime>
+#include <string>
+#include <vector>
 
 #include "zeek/threading/Formatter.h"
 
@@ -13,7 +16,8 @@ namespace zeek::threading::formatter
 
 /**
  * A thread-safe class for converting values into a JSON representation
- * and vice versa.
+ * and vice versa. Each instance must only be used by one thread, as it
+ * keeps buffers around between calls.
  */
 class JSON : public Formatter
 	{
@@ -46,11 +50,30 @@ public:
 		};
 
 private:
-	void BuildJSON(NullDoubleWriter& writer, Value* val, const std::string& name = "") const;
+	// Appends the JSON representation of a value. This writes the same
+	// bytes that going through a NullDoubleWriter would, without its
+	// per-call overhead.
+	void BuildJSON(std::string& out, const Value* val) const;
+	void AppendTime(std::string& out, double t) const;
+
+	// Returns the keys for a stream's fields, each quoted and escaped
+	// and followed by the colon.
+	const std::vector<std::string>& Keys(int num_fields, const Field* const* fields) const;
 
 	TimeFormat timestamps;
 	bool surrounding_braces;
 	bool include_unset_fields;
+
+	// State for encoding log lines. A formatter only ever runs in its
+	// thread, and a writer passes the same fields for all of its lines,
+	// so the keys are computed once.
+	mutable std::string line;
+	mutable const Field* const* key_fields = nullptr;
+	mutable std::vector<std::string> keys;
+
+	// The last second that an ISO 8601 timestamp was rendered for.
+	mutable time_t iso_time = 0;
+	mutable std::string iso_seconds;
 	};
 
 	} // namespace zeek::threading::formatter
@@ -43,6 +43,12 @@
 #include <string>
 #include <vector>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 #include "zeek/3rdparty/ConvertUTF.h"
 #include "zeek/3rdparty/doctest.h"
 #include "zeek/Desc.h"
@@ -496,6 +502,14 @@ bool have_random_seed()
 	return zeek_rand_determistic;
 	}
 
+// Gets added to the UID instances of deterministic runs.
+static uint64_t uid_instance_offset = 0;
+
+void set_unique_id_instance(uint64_t instance)
+	{
+	uid_instance_offset = instance << 32;
+	}
+
 constexpr uint32_t zeek_prng_mod = 2147483647;
 constexpr uint32_t zeek_prng_max = zeek_prng_mod - 1;
 
@@ -1492,15 +1506,154 @@ int strstr_n(const int big_len, const u_char* big, const int little_len, const u
 	if ( little_len > big_len )
 		return -1;
 
-	for ( int i = 0; i <= big_len - little_len; ++i )
+	if ( little_len <= 0 )
+		return 0;
+
+	// memchr() skips ahead to candidates much faster than comparing at
+	// every position.
+	const u_char* p = big;
+	const u_char* last = big + big_len - little_len;
+
+	while ( p <= last )
 		{
-		if ( ! memcmp(big + i, little, little_len) )
-			return i;
+		p = static_cast<const u_char*>(memchr(p, little[0], last - p + 1));
+
+		if ( ! p )
+			break;
+
+		if ( ! memcmp(p + 1, little + 1, little_len - 1) )
+			return p - big;
+
+		++p;
 		}
 
 	return -1;
 	}
 
+TEST_CASE("util is_ascii")
+	{
+	std::string s(100, 'a');
+	CHECK(is_ascii(reinterpret_cast<const u_char*>(s.data()), s.size()));
+	CHECK(is_ascii(nullptr, 0));
+
+	// Each position, in the vector part and in the tail.
+	for ( size_t i = 0; i < s.size(); ++i )
+		{
+		auto t = s;
+		t[i] = '\x80';
+		CHECK_FALSE(is_ascii(reinterpret_cast<const u_char*>(t.data()), t.size()));
+		}
+	}
+
+TEST_CASE("util ascii_to_lower/ascii_to_upper")
+	{
+	std::string all;
+
+	for ( int r = 0; r < 3; ++r )
+		for ( int c = 0; c < 256; ++c )
+			all.push_back(static_cast<char>(c));
+
+	std::string lower(all.size(), '\0');
+	std::string upper(all.size(), '\0');
+	ascii_to_lower(reinterpret_cast<const u_char*>(all.data()), all.size(),
+	               reinterpret_cast<u_char*>(lower.data()));
+	ascii_to_upper(reinterpret_cast<const u_char*>(all.data()), all.size(),
+	               reinterpret_cast<u_char*>(upper.data()));
+
+	for ( size_t i = 0; i < all.size(); ++i )
+		{
+		int c = static_cast<u_char>(all[i]);
+		CHECK(static_cast<u_char>(lower[i]) == (c >= 'A' && c <= 'Z' ? c + 32 : c));
+		CHECK(static_cast<u_char>(upper[i]) == (c >= 'a' && c <= 'z' ? c - 32 : c));
+		}
+
+	std::string s = "Mixed Case, In Place";
+	auto p = reinterpret_cast<u_char*>(s.data());
+	ascii_to_upper(p, s.size(), p);
+	CHECK(s == "MIXED CASE, IN PLACE");
+	}
+
+// The kernels below handle 16 bytes at a time with SSE2 or NEON, which
+// every x86-64 and AArch64 CPU has, and the remaining bytes one by one.
+
+bool is_ascii(const u_char* s, size_t len)
+	{
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	__m128i high = _mm_setzero_si128();
+
+	for ( ; i + 16 <= len; i += 16 )
+		high = _mm_or_si128(high, _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i)));
+
+	if ( _mm_movemask_epi8(high) )
+		return false;
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+	uint8x16_t high = vdupq_n_u8(0);
+
+	for ( ; i + 16 <= len; i += 16 )
+		high = vorrq_u8(high, vld1q_u8(s + i));
+
+	if ( vmaxvq_u8(high) & 0x80 )
+		return false;
+#endif
+
+	for ( ; i < len; ++i )
+		if ( s[i] & 0x80 )
+			return false;
+
+	return true;
+	}
+
+// Flips the case bit of the bytes from *first* to *first* + 25.
+static void ascii_fold_case(const u_char* s, size_t len, u_char* out, u_char first)
+	{
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	// Shift the range so that it starts at -128 and use a signed compare.
+	const __m128i shift = _mm_set1_epi8(static_cast<char>(0x80 - first));
+	const __m128i bound = _mm_set1_epi8(static_cast<char>(-128 + 26));
+	const __m128i bit = _mm_set1_epi8(0x20);
+
+	for ( ; i + 16 <= len; i += 16 )
+		{
+		__m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+		__m128i in_range = _mm_cmplt_epi8(_mm_add_epi8(x, shift), bound);
+		// The bit is clear in upper case letters and set in lower case.
+		x = _mm_xor_si128(x, _mm_and_si128(in_range, bit));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), x);
+		}
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+	const uint8x16_t base = vdupq_n_u8(first);
+	const uint8x16_t bound = vdupq_n_u8(26);
+	const uint8x16_t bit = vdupq_n_u8(0x20);
+
+	for ( ; i + 16 <= len; i += 16 )
+		{
+		uint8x16_t x = vld1q_u8(s + i);
+		uint8x16_t in_range = vcltq_u8(vsubq_u8(x, base), bound);
+		vst1q_u8(out + i, veorq_u8(x, vandq_u8(in_range, bit)));
+		}
+#endif
+
+	for ( ; i < len; ++i )
+		{
+		u_char c = s[i];
+		out[i] = static_cast<u_char>(c - first) < 26 ? c ^ 0x20 : c;
+		}
+	}
+
+void ascii_to_lower(const u_char* s, size_t len, u_char* out)
+	{
+	ascii_fold_case(s, len, out, 'A');
+	}
+
+void ascii_to_upper(const u_char* s, size_t len, u_char* out)
+	{
+	ascii_fold_case(s, len, out, 'a');
+	}
+
 int fputs(int len, const char* s, FILE* fp)
 	{
 	for ( int i = 0; i < len; ++i )
@@ -2116,12 +2269,12 @@ uint64_t calculate_unique_id(size_t pool)
 			unique.pid = getpid();
 			unique.rnd = static_cast<int>(detail::random_number());
 
-			uid_instance = zeek::detail::HashKey::HashBytes(&unique, sizeof(unique));
+			uid_instance = zeek::detail::KeyedHash::Hash64(&unique, sizeof(unique));
 			++uid_instance; // Now it's larger than zero.
 			}
 		else
 			// Generate determistic UIDs for each individual pool.
-			uid_instance = pool;
+			uid_instance = pool + detail::uid_instance_offset;
 
 		// Our instance is unique.  Huzzah.
 		uid_pool[pool] = UIDEntry(uid_instance);
@@ -2131,7 +2284,7 @@ uint64_t calculate_unique_id(size_t pool)
 	assert(uid_pool[pool].key.instance != 0);
 
 	++uid_pool[pool].key.counter;
-	return zeek::detail::HashKey::HashBytes(&(uid_pool[pool].key), sizeof(uid_pool[pool].key));
+	return zeek::detail::KeyedHash::Hash64(&(uid_pool[pool].key), sizeof(uid_pool[pool].key));
 	}
 
 bool safe_write(int fd, const char* data, int len)
@@ -134,6 +134,11 @@ unsigned int initial_seed();
 // Returns true if the user explicitly set a seed via init_random_seed();
 extern bool have_random_seed();
 
+// Sets a number that tells this process's deterministic UIDs apart from
+// those of other processes using the same seed, such as the workers of
+// --parallel. Needs calling before the first UID gets drawn.
+extern void set_unique_id_instance(uint64_t instance);
+
 /**
  * A platform-independent PRNG implementation.  Note that this is not
  * necessarily a "statistically sound" implementation as the main purpose is
@@ -339,6 +344,14 @@ extern const char* strpbrk_n(size_t len, const char* s, const char* charset);
 int strstr_n(const int big_len, const unsigned char* big, const int little_len,
              const unsigned char* little);
 
+// Returns whether none of the bytes has its high bit set.
+extern bool is_ascii(const unsigned char* s, size_t len);
+
+// Copy *len* bytes from *s* to *out*, folding ASCII letters to lower or
+// upper case and leaving all other bytes as they are. *out* may be *s*.
+extern void ascii_to_lower(const unsigned char* s, size_t len, unsigned char* out);
+extern void ascii_to_upper(const unsigned char* s, size_t len, unsigned char* out);
+
 // Replaces all occurences of *o* in *s* with *n*.
 extern std::string strreplace(const std::string& s, const std::string& o, const std::string& n);
 
@@ -12,7 +12,18 @@
 #define _GNU_SOURCE
 #endif
 
+#include <dirent.h>
+#include <pthread.h>
 #include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "zeek/zeek-affinity.h"
 
 namespace zeek
 	{
@@ -24,6 +35,73 @@ bool set_affinity(int core_number)
 	auto res = sched_setaffinity(0, sizeof(cpus), &cpus);
 	return res == 0;
 	}
+
+bool set_thread_affinity(pthread_t thread, const std::vector<int>& core_numbers)
+	{
+	cpu_set_t cpus;
+	CPU_ZERO(&cpus);
+
+	for ( auto c : core_numbers )
+		{
+		if ( c < 0 || c >= CPU_SETSIZE )
+			{
+			errno = EINVAL;
+			return false;
+			}
+
+		CPU_SET(c, &cpus);
+		}
+
+	auto res = pthread_setaffinity_np(thread, sizeof(cpus), &cpus);
+
+	if ( res != 0 )
+		errno = res;
+
+	return res == 0;
+	}
+
+int cpu_numa_node(int core_number)
+	{
+	// Each CPU's directory links to the directory of its node.
+	auto path = "/sys/devices/system/cpu/cpu" + std::to_string(core_number);
+	DIR* dir = opendir(path.c_str());
+
+	if ( ! dir )
+		return -1;
+
+	int node = -1;
+
+	while ( auto e = readdir(dir) )
+		{
+		if ( strncmp(e->d_name, "node", 4) == 0 && isdigit(e->d_name[4]) )
+			{
+			node = atoi(e->d_name + 4);
+			break;
+			}
+		}
+
+	closedir(dir);
+	return node;
+	}
+
+bool move_to_numa_node(void* addr, size_t len, int node)
+	{
+	// From <numaif.h>, which comes with libnuma rather than libc.
+	constexpr int MPOL_MF_MOVE = 1 << 1;
+
+	size_t page_size = sysconf(_SC_PAGESIZE);
+	size_t count = (len + page_size - 1) / page_size;
+	std::vector<void*> pages(count);
+	std::vector<int> nodes(count, node);
+	std::vector<int> status(count);
+
+	for ( size_t i = 0; i < count; ++i )
+		pages[i] = static_cast<char*>(addr) + i * page_size;
+
+	auto res = syscall(SYS_move_pages, 0, count, pages.data(), nodes.data(), status.data(),
+	                   MPOL_MF_MOVE);
+	return res >= 0;
+	}
 	} // namespace zeek
 
 #elif defined(__FreeBSD__)
@@ -31,7 +109,11 @@ bool set_affinity(int core_number)
 // clang-format off
 #include <sys/param.h>
 #include <sys/cpuset.h>
+#include <pthread_np.h>
 // clang-format on
+#include <cerrno>
+
+#include "zeek/zeek-affinity.h"
 
 namespace zeek
 	{
@@ -43,12 +125,49 @@ bool set_affinity(int core_number)
 	auto res = cpuset_setaffinity(CPU_LEVEL_WHICH, CPU_WHICH_PID, -1, sizeof(cpus), &cpus);
 	return res == 0;
 	}
+
+bool set_thread_affinity(pthread_t thread, const std::vector<int>& core_numbers)
+	{
+	cpuset_t cpus;
+	CPU_ZERO(&cpus);
+
+	for ( auto c : core_numbers )
+		{
+		if ( c < 0 || c >= CPU_SETSIZE )
+			{
+			errno = EINVAL;
+			return false;
+			}
+
+		CPU_SET(c, &cpus);
+		}
+
+	auto res = pthread_setaffinity_np(thread, sizeof(cpus), &cpus);
+
+	if ( res != 0 )
+		errno = res;
+
+	return res == 0;
+	}
+
+int cpu_numa_node(int core_number)
+	{
+	return -1;
+	}
+
+bool move_to_numa_node(void* addr, size_t len, int node)
+	{
+	errno = ENOTSUP;
+	return false;
+	}
 	} // namespace zeek
 
 #else
 
 #include <cerrno>
 
+#include "zeek/zeek-affinity.h"
+
 namespace zeek
 	{
 bool set_affinity(int core_number)
@@ -56,6 +175,23 @@ bool set_affinity(int core_number)
 	errno = ENOTSUP;
 	return false;
 	}
+
+bool set_thread_affinity(pthread_t thread, const std::vector<int>& core_numbers)
+	{
+	errno = ENOTSUP;
+	return false;
+	}
+
+int cpu_numa_node(int core_number)
+	{
+	return -1;
+	}
+
+bool move_to_numa_node(void* addr, size_t len, int node)
+	{
+	errno = ENOTSUP;
+	return false;
+	}
 	} // namespace zeek
 
 #endif
@@ -2,6 +2,10 @@
 
 #pragma once
 
+#include <pthread.h>
+#include <cstddef>
+#include <vector>
+
 namespace zeek
 	{
 
@@ -15,4 +19,34 @@ namespace zeek
  */
 bool set_affinity(int core_number);
 
+/**
+ * Restrict a thread to a set of CPUs.  Currently only supported on Linux
+ * and FreeBSD.
+ * @param thread  the thread.
+ * @param core_numbers  the cores that the thread may run on.
+ * @return true if the affinity is successfully set and false if not with
+ * errno additionally being set to indicate the reason.
+ */
+bool set_thread_affinity(pthread_t thread, const std::vector<int>& core_numbers);
+
+/**
+ * Get the NUMA node that a CPU belongs to.  Currently only supported on
+ * Linux.
+ * @param core_number  the core.
+ * @return the node, or -1 if not known.
+ */
+int cpu_numa_node(int core_number);
+
+/**
+ * Move memory to a NUMA node, such as the one of the thread using it.
+ * Parts of the memory that haven't been used yet stay where they end up
+ * once used.  Currently only supported on Linux.
+ * @param addr  the start of the memory, which must be at a page boundary.
+ * @param len  the size of the memory.
+ * @param node  the node.
+ * @return true if the memory is successfully moved and false if not with
+ * errno additionally being set to indicate the reason.
+ */
+bool move_to_numa_node(void* addr, size_t len, int node);
+
 	} // namespace zeek
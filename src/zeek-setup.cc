@@ -28,6 +28,7 @@
 #include "zeek/Desc.h"
 #include "zeek/Event.h"
 #include "zeek/EventRegistry.h"
+#include "zeek/EventReplay.h"
 #include "zeek/EventTrace.h"
 #include "zeek/File.h"
 #include "zeek/Frag.h"
@@ -36,6 +37,8 @@
 #include "zeek/Hash.h"
 #include "zeek/NetVar.h"
 #include "zeek/Options.h"
+#include "zeek/PacketRing.h"
+#include "zeek/Parallel.h"
 #include "zeek/Reporter.h"
 #include "zeek/RuleMatcher.h"
 #include "zeek/RunState.h"
@@ -216,6 +219,8 @@ zeek::OpaqueTypePtr bloomfilter_type;
 zeek::OpaqueTypePtr x509_opaque_type;
 zeek::OpaqueTypePtr ocsp_resp_opaque_type;
 zeek::OpaqueTypePtr paraglob_type;
+zeek::OpaqueTypePtr pattern_set_type;
+zeek::OpaqueTypePtr shared_table_type;
 zeek::OpaqueTypePtr int_counter_metric_type;
 zeek::OpaqueTypePtr int_counter_metric_family_type;
 zeek::OpaqueTypePtr dbl_counter_metric_type;
@@ -418,13 +423,17 @@ static void terminate_zeek()
 	finish_script_execution();
 
 	script_coverage_mgr.WriteStats();
+	DFA_Machine::SaveCaches();
 
 	delete zeekygen_mgr;
 	delete packet_mgr;
+	PacketRing::Close();
+	EventRecorder::Close();
 	delete analyzer_mgr;
 	delete file_mgr;
 	// broker_mgr, timer_mgr, supervisor, and dns_mgr are deleted via iosource_mgr
 	delete iosource_mgr;
+	EventReplayer::Close();
 	delete event_registry;
 	delete log_mgr;
 	delete reporter;
@@ -434,6 +443,10 @@ static void terminate_zeek()
 	delete fragment_mgr;
 	delete telemetry_mgr;
 
+	// Regular expressions may still go away later and update their
+	// metrics.
+	telemetry_mgr = nullptr;
+
 	// free the global scope
 	pop_scope();
 
@@ -531,6 +544,14 @@ SetupResult setup(int argc, char** argv, Options* zopts)
 	if ( options.run_unit_tests )
 		options.deterministic_mode = true;
 
+	// The workers carry on from here, leaving the original process to
+	// feed them the trace.
+	if ( options.parallel_workers > 0 )
+		{
+		if ( auto code = run_parallel(&options) )
+			exit(*code);
+		}
+
 	auto stem = Supervisor::CreateStem(options.supervisor_mode);
 
 	if ( Supervisor::ThisNode() )
@@ -742,6 +763,8 @@ SetupResult setup(int argc, char** argv, Options* zopts)
 	x509_opaque_type = make_intrusive<OpaqueType>("x509");
 	ocsp_resp_opaque_type = make_intrusive<OpaqueType>("ocsp_resp");
 	paraglob_type = make_intrusive<OpaqueType>("paraglob");
+	pattern_set_type = make_intrusive<OpaqueType>("pattern_set");
+	shared_table_type = make_intrusive<OpaqueType>("shared_table");
 	int_counter_metric_type = make_intrusive<OpaqueType>("int_counter_metric");
 	int_counter_metric_family_type = make_intrusive<OpaqueType>("int_counter_metric_family");
 	dbl_counter_metric_type = make_intrusive<OpaqueType>("dbl_counter_metric");
@@ -786,7 +809,10 @@ SetupResult setup(int argc, char** argv, Options* zopts)
 		// when we actually end up reading interactively from stdin.
 		set_signal_mask(false);
 		run_state::is_parsing = true;
+		double phase_start = util::current_time(true);
 		yyparse();
+		startup_stats.parse = util::current_time(true) - phase_start;
+		phase_start += startup_stats.parse;
 		run_state::is_parsing = false;
 		set_signal_mask(true);
 
@@ -797,6 +823,11 @@ SetupResult setup(int argc, char** argv, Options* zopts)
 		init_net_var();
 		run_bif_initializers();
 
+		// Patterns that scripts define have been compiled by now; the
+		// signatures' ones pick up their states when they get compiled.
+		if ( const auto& dir = id::find_val<StringVal>("dfa_cache_dir"); dir->Len() > 0 )
+			DFA_Machine::UseCacheDirectory(dir->ToStdString());
+
 		// Assign the script_args for command line processing in Zeek scripts.
 		if ( ! options.script_args.empty() )
 			{
@@ -831,6 +862,7 @@ SetupResult setup(int argc, char** argv, Options* zopts)
 		broker_mgr->InitPostScript();
 		telemetry_mgr->InitPostScript();
 		timer_mgr->InitPostScript();
+		fragment_mgr->InitPostScript();
 		event_mgr.InitPostScript();
 
 		if ( supervisor_mgr )
@@ -874,6 +906,10 @@ SetupResult setup(int argc, char** argv, Options* zopts)
 		file_mgr->InitPostScript();
 		dns_mgr->InitPostScript();
 
+		if ( auto ring_size = id::find_val("packet_ring_size")->AsCount() )
+			PacketRing::Open(ring_size, id::find_val<StringVal>("packet_ring_file")->ToStdString(),
+			                 id::find_val("packet_ring_conn_cutoff")->AsCount());
+
 		//		dns_mgr->LookupAddr("17.253.144.10");
 
 #ifdef USE_PERFTOOLS_DEBUG
@@ -957,10 +993,15 @@ SetupResult setup(int argc, char** argv, Options* zopts)
 			exit(reporter->Errors() != 0);
 			}
 
+		startup_stats.init = util::current_time(true) - phase_start;
+		phase_start += startup_stats.init;
+
 		auto init_stmts = stmts ? analyze_global_stmts(stmts) : nullptr;
 
 		analyze_scripts(options.no_unused_warnings);
 
+		startup_stats.optimize = util::current_time(true) - phase_start;
+
 		if ( analysis_options.report_recursive )
 			{
 			// This option is report-and-exit.
@@ -972,6 +1013,17 @@ SetupResult setup(int argc, char** argv, Options* zopts)
 			run_state::detail::init_run(options.interface, options.pcap_file,
 			                            options.pcap_output_file, options.use_watchdog);
 
+		if ( options.event_replay_file )
+			{
+			// The recorded events take the place of packets, along with
+			// the network time they carry.
+			run_state::reading_traces = true;
+			EventReplayer::Open(*options.event_replay_file);
+			}
+
+		if ( options.event_record_file )
+			EventRecorder::Open(*options.event_record_file);
+
 		if ( ! g_policy_debug )
 			{
 			(void)setsignal(SIGTERM, sig_handler);
@@ -1034,6 +1086,8 @@ SetupResult setup(int argc, char** argv, Options* zopts)
 		if ( CPP_activation_hook )
 			(*CPP_activation_hook)();
 
+		phase_start = util::current_time(true);
+
 		if ( zeek_init )
 			event_mgr.Enqueue(zeek_init, Args{});
 
@@ -1091,10 +1145,14 @@ SetupResult setup(int argc, char** argv, Options* zopts)
 		// Drain the event queue here to support the protocols framework configuring DPM
 		event_mgr.Drain();
 
+		startup_stats.zeek_init = util::current_time(true) - phase_start;
+		startup_stats.total = util::current_time(true) - run_state::zeek_start_time;
+
 		if ( reporter->Errors() > 0 && ! getenv("ZEEK_ALLOW_INIT_ERRORS") )
 			reporter->FatalError("errors occurred while initializing");
 
 		run_state::detail::zeek_init_done = true;
+		packet_mgr->CompileDispatchers();
 		packet_mgr->DumpDebug();
 		analyzer_mgr->DumpDebug();
 
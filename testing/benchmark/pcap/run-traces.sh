@@ -0,0 +1,35 @@
+#! /usr/bin/env bash
+#
+# Runs zeek-bench over a fixed set of traces, with the default local
+# configuration, and prints a JSON line per trace. Usage:
+#
+#     run-traces.sh <path/to/zeek-bench> [zeek options, e.g. -O ZAM]
+#
+# Build zeek-bench by configuring with --enable-benchmarks. Pass the same
+# options to compare builds; the traces are the btest ones, so results
+# from the same commit stay comparable.
+
+set -e
+
+if [ $# -lt 1 ]; then
+    echo "usage: $(basename "$0") <zeek-bench> [zeek options]" >&2
+    exit 1
+fi
+
+bench=$1
+shift
+
+traces=$(cd "$(dirname "$0")/../../btest/Traces" && pwd)
+
+for trace in \
+    http/bro.org.pcap \
+    http/206_example_b.pcap \
+    tls/tls-conn-with-extensions.trace \
+    dns53.pcap \
+    smtp.trace \
+    ssh/ssh.trace \
+    smb/smb2.pcap \
+    modbus/modbus.trace \
+    contentline-irc-5k-line.pcap; do
+    "$bench" --pcap "$traces/$trace" -- "$@" local
+done